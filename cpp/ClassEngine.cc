@@ -21,6 +21,7 @@
 #include<sstream>
 #include<numeric>
 #include<cassert>
+#include<algorithm>
 
 //#define DBUG
 
@@ -65,7 +66,7 @@ template string str(const unsigned long long &x);
 //---------------
 // Constructors --
 //----------------
-ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(true){
+ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),last_index_back(0),computed(0),digests(){
 
   //prepare fp structure
   size_t n=pars.size();
@@ -88,8 +89,8 @@ ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(tr
   if( verbose ) cout << __FILE__ << " : using lmax=" << _lmax <<endl;
   // assert(_lmax>0); // this collides with transfer function calculations
 
-    //input
-  if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&sd,&op,_errmsg) == _FAILURE_)
+  //calcul class (input is read once, inside class_main)
+  if (computeCls() == _FAILURE_)
     throw invalid_argument(_errmsg);
 
   //proetction parametres mal defini
@@ -97,12 +98,9 @@ ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(tr
     if (fc.read[i] !=_TRUE_) throw invalid_argument(string("invalid CLASS parameter: ")+fc.name[i]);
   }
 
-  //calcul class
-  computeCls();
-
-  //cout <<"creating " << sp.ct_size << " arrays" <<endl;
+  //cout <<"creating " << hr.ct_size << " arrays" <<endl;
   if( pt.has_cl_cmb_temperature || pt.has_cl_cmb_polarization || pt.has_cl_lensing_potential ){
-    cl=new double[sp.ct_size];
+    cl=new double[hr.ct_size];
   }
 
   //printFC();
@@ -110,7 +108,7 @@ ClassEngine::ClassEngine(const ClassParams& pars, bool verbose): cl(0),dofree(tr
 }
 
 
-ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file, bool verbose): cl(0),dofree(true){
+ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file, bool verbose): cl(0),last_index_back(0),computed(0),digests(){
 
   struct file_content fc_precision;
   fc_precision.size = 0;
@@ -146,8 +144,8 @@ ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file,
   //parser_free(&fc_input);
   parser_free(&fc_precision);
 
-  //input
-  if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&sd,&op,_errmsg) == _FAILURE_)
+  //calcul class (input is read once, inside class_main)
+  if (computeCls() == _FAILURE_)
     throw invalid_argument(_errmsg);
 
   //proetction parametres mal defini
@@ -155,12 +153,9 @@ ClassEngine::ClassEngine(const ClassParams& pars,const string & precision_file,
     if (fc.read[i] !=_TRUE_) throw invalid_argument(string("invalid CLASS parameter: ")+fc.name[i]);
   }
 
-  //calcul class
-  computeCls();
-
-  //cout <<"creating " << sp.ct_size << " arrays" <<endl;
+  //cout <<"creating " << hr.ct_size << " arrays" <<endl;
   if( pt.has_cl_cmb_temperature || pt.has_cl_cmb_polarization || pt.has_cl_lensing_potential ){
-    cl=new double[sp.ct_size];
+    cl=new double[hr.ct_size];
   }
   //printFC();
 
@@ -176,11 +171,11 @@ ClassEngine::~ClassEngine()
 {
 
   //printFC();
-  dofree && freeStructs();
+  freeStructs(computed);
 
-  if( pt.has_cl_cmb_temperature || pt.has_cl_cmb_polarization || pt.has_cl_lensing_potential ){
-    delete [] cl;
-  }
+  delete [] cl;
+
+  parser_free(&fc);
 
 }
 
@@ -188,7 +183,6 @@ ClassEngine::~ClassEngine()
 // Member functions --
 //-----------------
 bool ClassEngine::updateParValues(const std::vector<double>& par){
-  dofree && freeStructs();
   for (size_t i=0;i<par.size();i++) {
     double val=par[i];
     strcpy(fc.value[i],str(val).c_str());
@@ -197,6 +191,9 @@ bool ClassEngine::updateParValues(const std::vector<double>& par){
     cout << "update par values #" << i << "\t" <<  val << "\t" << str(val).c_str() << endl;
 #endif
   }
+  //the names are written directly: the index of parser_find() is stale
+  parser_reset_index(&fc);
+  //only the modules depending on the changed parameters are recomputed
   int status=computeCls();
 #ifdef DBUG
   cout << "update par status=" << status << " succes=" << _SUCCESS_ << endl;
@@ -212,119 +209,90 @@ void ClassEngine::printFC() {
 
 
 }
+//read the input of a new model, keep the modules of the previous model
+//whose inputs are unchanged (as classy compute()), and compute the others
 int ClassEngine::class_main(
 			    struct file_content *pfc,
 			    struct precision * ppr,
 			    struct background * pba,
-			    struct thermo * pth,
-			    struct perturbs * ppt,
-			    struct transfers * ptr,
+			    struct thermodynamics * pth,
+			    struct perturbations * ppt,
+			    struct transfer * ptr,
 			    struct primordial * ppm,
-			    struct spectra * psp,
-			    struct nonlinear * pnl,
+			    struct harmonic * phr,
+			    struct fourier * pfo,
 			    struct lensing * ple,
 			    struct distortions * psd,
 			    struct output * pop,
 			    ErrorMsg errmsg) {
 
-
-  if (input_read_from_file(pfc,ppr,pba,pth,ppt,ptr,ppm,psp,pnl,ple,psd,pop,errmsg) == _FAILURE_) {
+  struct precision pr_new;
+  struct background ba_new;
+  struct thermodynamics th_new;
+  struct perturbations pt_new;
+  struct transfer tr_new;
+  struct primordial pm_new;
+  struct harmonic hr_new;
+  struct fourier fo_new;
+  struct lensing le_new;
+  struct distortions sd_new;
+  struct output op_new;
+  unsigned long long digest_new[_NUM_INPUT_MODULES_];
+  short was_computed[_NUM_INPUT_MODULES_];
+  short can_reuse[_NUM_INPUT_MODULES_];
+  int modules=0;
+  int computed_new=0;
+
+  if (input_read_from_file(pfc,&pr_new,&ba_new,&th_new,&pt_new,&tr_new,&pm_new,&hr_new,&fo_new,&le_new,&sd_new,&op_new,errmsg) == _FAILURE_) {
     printf("\n\nError running input_read_from_file \n=>%s\n",errmsg);
-    dofree=false;
+    freeStructs(computed);
     return _FAILURE_;
   }
 
-  if (background_init(ppr,pba) == _FAILURE_) {
-    printf("\n\nError running background_init \n=>%s\n",pba->error_message);
-    dofree=false;
+  if (input_module_digests(pfc,&pr_new,digest_new,errmsg) == _FAILURE_) {
+    printf("\n\nError running input_module_digests \n=>%s\n",errmsg);
+    freeStructs(computed);
     return _FAILURE_;
   }
 
-  if (thermodynamics_init(ppr,pba,pth) == _FAILURE_) {
-    printf("\n\nError in thermodynamics_init \n=>%s\n",pth->error_message);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
-
-  if (perturb_init(ppr,pba,pth,ppt) == _FAILURE_) {
-    printf("\n\nError in perturb_init \n=>%s\n",ppt->error_message);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
-
-  if (primordial_init(ppr,ppt,ppm) == _FAILURE_) {
-    printf("\n\nError in primordial_init \n=>%s\n",ppm->error_message);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
-
-  if (nonlinear_init(ppr,pba,pth,ppt,ppm,pnl) == _FAILURE_)  {
-    printf("\n\nError in nonlinear_init \n=>%s\n",pnl->error_message);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
-
-  if (transfer_init(ppr,pba,pth,ppt,pnl,ptr) == _FAILURE_) {
-    printf("\n\nError in transfer_init \n=>%s\n",ptr->error_message);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
+  //the input modules come in the order of the modules, output last
+  for (int i=0;i<_NUM_INPUT_MODULES_;i++)
+    was_computed[i] = ((i < module_size) && (computed & (1 << i))) ? _TRUE_ : _FALSE_;
+  input_module_reuse(digests,digest_new,was_computed,(fo_new.method != nl_none),can_reuse);
+  for (int i=0;i<module_size;i++)
+    if (can_reuse[i] == _FALSE_) modules |= (1 << i);
 
-  if (spectra_init(ppr,pba,ppt,ppm,pnl,ptr,psp) == _FAILURE_) {
-    printf("\n\nError in spectra_init \n=>%s\n",psp->error_message);
-    transfer_free(&tr);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
+  if (freeStructs(modules) == _FAILURE_) {
+    freeStructs(computed);
     return _FAILURE_;
   }
 
-  if (lensing_init(ppr,ppt,psp,pnl,ple) == _FAILURE_) {
-    printf("\n\nError in lensing_init \n=>%s\n",ple->error_message);
-    spectra_free(&sp);
-    transfer_free(&tr);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
+  //the recomputed modules take the new input structures; for the reused
+  //ones, the new input structures (identical to the old ones) are dropped
+  *ppr = pr_new;
+  *pop = op_new;
+  if (modules & (1 << module_background)) *pba = ba_new; else background_free_input(&ba_new);
+  if (modules & (1 << module_thermodynamics)) *pth = th_new; else thermodynamics_free_input(&th_new);
+  if (modules & (1 << module_perturbations)) *ppt = pt_new; else perturbations_free_input(&pt_new);
+  if (modules & (1 << module_primordial)) *ppm = pm_new;
+  if (modules & (1 << module_fourier)) *pfo = fo_new;
+  if (modules & (1 << module_transfer)) *ptr = tr_new;
+  if (modules & (1 << module_harmonic)) *phr = hr_new;
+  if (modules & (1 << module_lensing)) *ple = le_new;
+  if (modules & (1 << module_distortions)) *psd = sd_new;
+  memcpy(digests,digest_new,sizeof(digests));
+
+  int status=modules_init(ppr,pba,pth,ppt,ppm,pfo,ptr,phr,ple,psd,modules,&computed_new,errmsg);
+  computed |= computed_new;
+  if (status == _FAILURE_) {
+    printf("\n\nError in modules_init \n=>%s\n",errmsg);
+    freeStructs(computed);
     return _FAILURE_;
   }
 
-  if (distortions_init(ppr,pba,pth,ppt,ppm,psd) == _FAILURE_) {
-    printf("\n\nError in distortions_init \n=>%s\n",psd->error_message);
-    lensing_free(&le);
-    spectra_free(&sp);
-    transfer_free(&tr);
-    nonlinear_free(&nl);
-    primordial_free(&pm);
-    perturb_free(&pt);
-    thermodynamics_free(&th);
-    background_free(&ba);
-    dofree=false;
-    return _FAILURE_;
-  }
+  pvecback.assign(pba->bg_size,0.);
+  last_index_back=0;
 
-  dofree=true;
   return _SUCCESS_;
 }
 
@@ -336,7 +304,19 @@ int ClassEngine::computeCls(){
   //printFC();
 #endif
 
-  int status=this->class_main(&fc,&pr,&ba,&th,&pt,&tr,&pm,&sp,&nl,&le,&sd,&op,_errmsg);
+  //input_read_from_file() extends its file_content with the shooting
+  //parameters: each run works on a fresh copy of fc, and only the read
+  //flags of the user entries are brought back
+  struct file_content fc_run;
+  if (parser_init_from_pfc(&fc,&fc_run,_errmsg) == _FAILURE_) {
+    freeStructs(computed);
+    return _FAILURE_;
+  }
+
+  int status=this->class_main(&fc_run,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,_errmsg);
+
+  memcpy(fc.read,fc_run.read,fc.size*sizeof(short));
+  parser_free(&fc_run);
 #ifdef DBUG
   cout <<"status=" << status << endl;
 #endif
@@ -344,66 +324,71 @@ int ClassEngine::computeCls(){
 
 }
 
+//free the computed modules among the flags (1 << module_xxx), in the
+//reverse order of their dependencies
 int
-ClassEngine::freeStructs(){
+ClassEngine::freeStructs(int modules){
 
+  modules &= computed;
 
-  if (distortions_free(&sd) == _FAILURE_) {
+  if ((modules & (1 << module_distortions)) && (distortions_free(&sd) == _FAILURE_)) {
     printf("\n\nError in distortions_free \n=>%s\n",sd.error_message);
     return _FAILURE_;
   }
 
-  if (lensing_free(&le) == _FAILURE_) {
-    printf("\n\nError in spectra_free \n=>%s\n",le.error_message);
+  if ((modules & (1 << module_lensing)) && (lensing_free(&le) == _FAILURE_)) {
+    printf("\n\nError in lensing_free \n=>%s\n",le.error_message);
     return _FAILURE_;
   }
 
-  if (nonlinear_free(&nl) == _FAILURE_) {
-    printf("\n\nError in nonlinear_free \n=>%s\n",nl.error_message);
+  if ((modules & (1 << module_harmonic)) && (harmonic_free(&hr) == _FAILURE_)) {
+    printf("\n\nError in harmonic_free \n=>%s\n",hr.error_message);
     return _FAILURE_;
   }
 
-  if (spectra_free(&sp) == _FAILURE_) {
-    printf("\n\nError in spectra_free \n=>%s\n",sp.error_message);
+  if ((modules & (1 << module_transfer)) && (transfer_free(&tr) == _FAILURE_)) {
+    printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
     return _FAILURE_;
   }
 
-  if (primordial_free(&pm) == _FAILURE_) {
-    printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
+  if ((modules & (1 << module_fourier)) && (fourier_free(&fo) == _FAILURE_)) {
+    printf("\n\nError in fourier_free \n=>%s\n",fo.error_message);
     return _FAILURE_;
   }
 
-  if (transfer_free(&tr) == _FAILURE_) {
-    printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
+  if ((modules & (1 << module_primordial)) && (primordial_free(&pm) == _FAILURE_)) {
+    printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
     return _FAILURE_;
   }
 
-  if (perturb_free(&pt) == _FAILURE_) {
-    printf("\n\nError in perturb_free \n=>%s\n",pt.error_message);
+  if ((modules & (1 << module_perturbations)) && (perturbations_free(&pt) == _FAILURE_)) {
+    printf("\n\nError in perturbations_free \n=>%s\n",pt.error_message);
     return _FAILURE_;
   }
 
-  if (thermodynamics_free(&th) == _FAILURE_) {
+  if ((modules & (1 << module_thermodynamics)) && (thermodynamics_free(&th) == _FAILURE_)) {
     printf("\n\nError in thermodynamics_free \n=>%s\n",th.error_message);
     return _FAILURE_;
   }
 
-  if (background_free(&ba) == _FAILURE_) {
+  if ((modules & (1 << module_background)) && (background_free(&ba) == _FAILURE_)) {
     printf("\n\nError in background_free \n=>%s\n",ba.error_message);
     return _FAILURE_;
   }
 
+  computed &= ~modules;
+
   return _SUCCESS_;
 }
 
-void ClassEngine::call_perturb_sources_at_tau(
+void ClassEngine::call_perturbations_sources_at_tau(
                            int index_md,
                            int index_ic,
                            int index_tp,
                            double tau,
                            double * psource
                            ) {
-  if( perturb_sources_at_tau( &pt, index_md, index_ic, index_tp, tau, psource ) == _FAILURE_){
+  if( perturbations_sources_at_tau( &pt, index_md, index_ic, index_tp, tau, psource ) == _FAILURE_){
     cerr << ">>>fail getting Tk type=" << (int)index_tp <<endl;
     throw out_of_range(pt.error_message);
   }
@@ -422,10 +407,9 @@ ClassEngine::getTk( double z,
    std::vector<double>& t_tot )
 {
 
-  if (!dofree) throw out_of_range("no Tk available because CLASS failed");
+  if (computed != _ALL_MODULES_) throw out_of_range("no Tk available because CLASS failed");
 
   double tau;
-  int index;
   //transform redshift in conformal time
   background_tau_of_z(&ba,z,&tau);
 
@@ -434,10 +418,8 @@ ClassEngine::getTk( double z,
     throw out_of_range(pt.error_message);
   }
 
-  double *pvecback=new double[ba.bg_size];
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
+  backgroundAtZ(z,inter_normal);
   double fHa = pvecback[ba.index_bg_f] * (pvecback[ba.index_bg_a]*pvecback[ba.index_bg_H]);
-  delete[] pvecback;
 
   // copy transfer func data to temporary
   const size_t index_md = pt.index_md_scalars;
@@ -454,20 +436,21 @@ ClassEngine::getTk( double z,
     cerr << ">>>have more than 1 ICs, will use first and ignore others" << endl;
   }
 
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_delta_cdm, tau, &d_cdm[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_delta_b, tau, &d_b[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_delta_ncdm1, tau, &d_ncdm[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_delta_tot, tau, &d_tot[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_theta_b, tau, &t_b[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_theta_ncdm1, tau, &t_ncdm[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_theta_tot, tau, &d_tot[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_delta_cdm, tau, &d_cdm[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_delta_b, tau, &d_b[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_delta_ncdm1, tau, &d_ncdm[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_delta_tot, tau, &d_tot[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_theta_b, tau, &t_b[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_theta_ncdm1, tau, &t_ncdm[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_theta_tot, tau, &t_tot[0]);
 
   //
   std::vector<double> h_prime(pt.k_size[index_md],0.0), eta_prime(pt.k_size[index_md],0.0);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_eta_prime, tau, &eta_prime[0]);
-  call_perturb_sources_at_tau(index_md, 0, pt.index_tp_h_prime, tau, &h_prime[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_eta_prime, tau, &eta_prime[0]);
+  call_perturbations_sources_at_tau(index_md, 0, pt.index_tp_h_prime, tau, &h_prime[0]);
 
   // gauge trafo velocities, store k-vector
+  k.clear();
   for (int index_k=0; index_k<pt.k_size[index_md]; index_k++)
   {
     auto ak = pt.k[index_md][index_k];
@@ -486,49 +469,82 @@ ClassEngine::getTk( double z,
   }
 }
 
+//index of a spectrum type in the array of output_total_cl_at_l(), and
+//power of T_cmb (in micro-K) converting it; false if not computed
+static bool cl_index(const struct harmonic & hr, Engine::cltype t, int & index, int & power){
+
+  switch(t)
+    {
+    case Engine::TT:
+      index=hr.index_ct_tt; power=2; return (hr.has_tt==_TRUE_);
+    case Engine::TE:
+      index=hr.index_ct_te; power=2; return (hr.has_te==_TRUE_);
+    case Engine::EE:
+      index=hr.index_ct_ee; power=2; return (hr.has_ee==_TRUE_);
+    case Engine::BB:
+      index=hr.index_ct_bb; power=2; return (hr.has_bb==_TRUE_);
+    case Engine::PP:
+      index=hr.index_ct_pp; power=0; return (hr.has_pp==_TRUE_);
+    case Engine::TP:
+      index=hr.index_ct_tp; power=1; return (hr.has_tp==_TRUE_);
+    case Engine::EP:
+      index=hr.index_ct_ep; power=1; return (hr.has_ep==_TRUE_);
+    }
+
+  return false;
+}
+
 double
 ClassEngine::getCl(Engine::cltype t,const long &l){
 
-  if (!dofree) throw out_of_range("no Cl available because CLASS failed");
+  if (computed != _ALL_MODULES_) throw out_of_range("no Cl available because CLASS failed");
+  if (cl==0) throw invalid_argument("no Cl requested in the output");
 
-  if (output_total_cl_at_l(&sp,&le,&op,static_cast<double>(l),cl) == _FAILURE_){
+  int index,power;
+  if (!cl_index(hr,t,index,power)){
+    const char* names[]={"TT","EE","TE","BB","Phi-Phi","T-Phi","E-Phi"};
+    throw invalid_argument(string("no Cl")+names[t]+" available");
+  }
+
+  if (output_total_cl_at_l(&hr,&le,&op,static_cast<int>(l),cl) == _FAILURE_){
     cerr << ">>>fail getting Cl type=" << (int)t << " @l=" << l <<endl;
-    throw out_of_range(sp.error_message);
+    throw out_of_range(op.error_message);
   }
 
-  double zecl=-1;
+  return pow(1e6*Tcmb(),power)*cl[index];
 
-  double tomuk=1e6*Tcmb();
-  double tomuk2=tomuk*tomuk;
+}
 
-  switch(t)
-    {
-    case TT:
-      (sp.has_tt==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_tt] : throw invalid_argument("no ClTT available");
-      break;
-    case TE:
-      (sp.has_te==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_te] : throw invalid_argument("no ClTE available");
-      break;
-    case EE:
-      (sp.has_ee==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_ee] : throw invalid_argument("no ClEE available");
-      break;
-    case BB:
-      (sp.has_bb==_TRUE_) ? zecl=tomuk2*cl[sp.index_ct_bb] : throw invalid_argument("no ClBB available");
-      break;
-    case PP:
-      (sp.has_pp==_TRUE_) ? zecl=cl[sp.index_ct_pp] : throw invalid_argument("no ClPhi-Phi available");
-      break;
-    case TP:
-      (sp.has_tp==_TRUE_) ? zecl=tomuk*cl[sp.index_ct_tp] : throw invalid_argument("no ClT-Phi available");
-      break;
-    case EP:
-      (sp.has_ep==_TRUE_) ? zecl=tomuk*cl[sp.index_ct_ep] : throw invalid_argument("no ClE-Phi available");
-      break;
-    }
+void
+ClassEngine::getAllCls(const std::vector<unsigned>& lvec, //input
+		       std::vector<std::vector<double> >& cls)
+{
+  if (computed != _ALL_MODULES_) throw out_of_range("no Cl available because CLASS failed");
+  if (cl==0) throw invalid_argument("no Cl requested in the output");
 
-  return zecl;
+  const int ntypes=Engine::EP+1;
+  int index[ntypes],power[ntypes];
+  double factor[ntypes];
+  bool has[ntypes];
+
+  cls.resize(ntypes);
+  for (int t=0;t<ntypes;t++){
+    has[t]=cl_index(hr,static_cast<Engine::cltype>(t),index[t],power[t]);
+    factor[t]=pow(1e6*Tcmb(),power[t]);
+    cls[t].resize(has[t] ? lvec.size() : 0);
+  }
+
+  for (size_t i=0;i<lvec.size();i++){
+    if (output_total_cl_at_l(&hr,&le,&op,static_cast<int>(lvec[i]),cl) == _FAILURE_){
+      cerr << ">>>fail getting Cl's @l=" << lvec[i] <<endl;
+      throw out_of_range(op.error_message);
+    }
+    for (int t=0;t<ntypes;t++)
+      if (has[t]) cls[t][i]=factor[t]*cl[index[t]];
+  }
 
 }
+
 void
 ClassEngine::getCls(const std::vector<unsigned>& lvec, //input
 		      std::vector<double>& cltt,
@@ -536,22 +552,19 @@ ClassEngine::getCls(const std::vector<unsigned>& lvec, //input
 		      std::vector<double>& clee,
 		      std::vector<double>& clbb)
 {
-  cltt.resize(lvec.size());
-  clte.resize(lvec.size());
-  clee.resize(lvec.size());
-  clbb.resize(lvec.size());
+  std::vector<std::vector<double> > cls;
 
-  for (size_t i=0;i<lvec.size();i++){
-    try{
-      cltt[i]=getCl(ClassEngine::TT,lvec[i]);
-      clte[i]=getCl(ClassEngine::TE,lvec[i]);
-      clee[i]=getCl(ClassEngine::EE,lvec[i]);
-      clbb[i]=getCl(ClassEngine::BB,lvec[i]);
-    }
-    catch(exception &e){
-      throw e;
-    }
-  }
+  getAllCls(lvec,cls);
+
+  if (cls[TT].empty()) throw invalid_argument("no ClTT available");
+  if (cls[TE].empty()) throw invalid_argument("no ClTE available");
+  if (cls[EE].empty()) throw invalid_argument("no ClEE available");
+  if (cls[BB].empty()) throw invalid_argument("no ClBB available");
+
+  cltt.swap(cls[TT]);
+  clte.swap(cls[TE]);
+  clee.swap(cls[EE]);
+  clbb.swap(cls[BB]);
 
 }
 
@@ -561,42 +574,73 @@ ClassEngine::getLensing(const std::vector<unsigned>& lvec, //input
 		std::vector<double>& cltp  ,
 		std::vector<double>& clep  ){
 
+  std::vector<std::vector<double> > cls;
 
-  clpp.resize(lvec.size());
-  cltp.resize(lvec.size());
-  clep.resize(lvec.size());
-
-  for (size_t i=0;i<lvec.size();i++){
-    try{
-      clpp[i]=getCl(ClassEngine::PP,lvec[i]);
-      cltp[i]=getCl(ClassEngine::TP,lvec[i]);
-      clep[i]=getCl(ClassEngine::EP,lvec[i]);
-    }
-    catch(exception &e){
-      cout << "plantage!" << endl;
-      cout << __FILE__ << e.what() << endl;
-      return false;
-    }
+  try{
+    getAllCls(lvec,cls);
+  }
+  catch(exception &e){
+    cout << "plantage!" << endl;
+    cout << __FILE__ << e.what() << endl;
+    return false;
   }
+
+  if (cls[PP].empty() || cls[TP].empty() || cls[EP].empty()) return false;
+
+  clpp.swap(cls[PP]);
+  cltp.swap(cls[TP]);
+  clep.swap(cls[EP]);
+
   return true;
 }
 
+//same output as Engine::writeCls(), from a single sweep over l
+void
+ClassEngine::writeCls(std::ostream &of){
 
-double ClassEngine::get_f(double z)
-{
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
+  vector<unsigned> lvec(_lmax-1,1);
+  lvec[0]=2;
+  partial_sum(lvec.begin(),lvec.end(),lvec.begin());
+
+  std::vector<std::vector<double> > cls;
+  try{
+    getAllCls(lvec,cls);
+  }
+  catch (std::exception &e){
+    cout << "GIOSH" << e.what() << endl;
+    return;
+  }
 
-  //pvecback must be allocated
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
+  bool hasLensing=!(cls[PP].empty() || cls[TP].empty() || cls[EP].empty());
+  for (int t=TT;t<=BB;t++)
+    if (cls[t].empty()) cls[t].assign(lvec.size(),0.);
 
-  //call to fill pvecback
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
+  for (size_t i=0;i<lvec.size();i++) {
+    of << lvec[i] << "\t"
+       << cls[TT][i] << "\t"
+       << cls[TE][i] << "\t"
+       << cls[EE][i] << "\t"
+       << cls[BB][i];
+    if (hasLensing){
+      of << "\t" << cls[PP][i] << "\t" << cls[TP][i] << "\t" << cls[EP][i];
+    }
+    of << "\n";
+  }
+
+}
 
+void ClassEngine::backgroundAtZ(double z, enum interpolation_method inter_mode)
+{
+  if (computed != _ALL_MODULES_) throw out_of_range("no background available because CLASS failed");
 
+  if (background_at_z(&ba,z,long_info,inter_mode,&last_index_back,&pvecback[0]) == _FAILURE_){
+    throw out_of_range(ba.error_message);
+  }
+}
+
+double ClassEngine::get_f(double z)
+{
+  backgroundAtZ(z,inter_normal);
 
   double f_z=pvecback[ba.index_bg_f];
 #ifdef DBUG
@@ -608,20 +652,13 @@ double ClassEngine::get_f(double z)
 
 double ClassEngine::get_sigma8(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
   double sigma8 = 0.;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
 
-  //pvecback must be allocated
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
+  if (computed != _ALL_MODULES_) throw out_of_range("no sigma8 available because CLASS failed");
 
-  //call to fill pvecback
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
-  //background_at_tau(pba,tau,pba->long_info,pba->inter_normal,&last_index,pvecback);
-  spectra_sigma(&ba,&pm,&sp,8./ba.h,z,&sigma8);
+  if (fourier_sigmas_at_z(&pr,&ba,&fo,8./ba.h,z,fo.index_pk_m,out_sigma,&sigma8) == _FAILURE_){
+    throw out_of_range(fo.error_message);
+  }
 
 #ifdef DBUG
   cout << "sigma_8= "<< sigma8 <<endl;
@@ -640,20 +677,8 @@ double ClassEngine::get_Az(double z)
 }
 //      --------------------------
 
-double ClassEngine::get_Dv(double z)
+double ClassEngine::DvFromBackground(double z) const
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
-
-  //pvecback must be allocated
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
-
   double H_z=pvecback[ba.index_bg_H];
   double D_ang=pvecback[ba.index_bg_ang_distance];
 #ifdef DBUG
@@ -670,20 +695,16 @@ double ClassEngine::get_Dv(double z)
   return D_v;
 }
 
-double ClassEngine::get_Fz(double z)
+double ClassEngine::get_Dv(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
+  backgroundAtZ(z,inter_normal);
 
-  //pvecback must be allocated
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
+  return DvFromBackground(z);
+}
 
+double ClassEngine::get_Fz(double z)
+{
+  backgroundAtZ(z,inter_normal);
 
   double H_z=pvecback[ba.index_bg_H];
   double D_ang=pvecback[ba.index_bg_ang_distance];
@@ -697,18 +718,7 @@ double ClassEngine::get_Fz(double z)
 
 double ClassEngine::get_Hz(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
-
-  //pvecback must be allocated
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
-
+  backgroundAtZ(z,inter_normal);
 
   double H_z=pvecback[ba.index_bg_H];
 
@@ -719,18 +729,7 @@ double ClassEngine::get_Hz(double z)
 
 double ClassEngine::get_Da(double z)
 {
-  double tau;
-  int index;
-  double *pvecback;
-  //transform redshift in conformal time
-  background_tau_of_z(&ba,z,&tau);
-
-  //pvecback must be allocated
-  pvecback=(double *)malloc(ba.bg_size*sizeof(double));
-
-  //call to fill pvecback
-  background_at_tau(&ba,tau,long_info,inter_normal, &index, pvecback);
-
+  backgroundAtZ(z,inter_normal);
 
   double H_z=pvecback[ba.index_bg_H];
   double D_ang=pvecback[ba.index_bg_ang_distance];
@@ -740,3 +739,103 @@ double ClassEngine::get_Da(double z)
 #endif
   return D_ang;
 }
+
+std::vector<size_t> ClassEngine::sortedZ(const std::vector<double>& z) const
+{
+  std::vector<size_t> order(z.size());
+  for (size_t i=0;i<z.size();i++) order[i]=i;
+  std::sort(order.begin(),order.end(),[&z](size_t i,size_t j){return z[i]<z[j];});
+  return order;
+}
+
+//in the vector getters the last index is kept from one redshift to the
+//next, so that each interpolation only moves the cursor a few steps
+void ClassEngine::get_Dv(const std::vector<double>& z, std::vector<double>& Dv)
+{
+  Dv.resize(z.size());
+  const std::vector<size_t> order=sortedZ(z);
+  for (size_t i=0;i<order.size();i++){
+    backgroundAtZ(z[order[i]],inter_closeby);
+    Dv[order[i]]=DvFromBackground(z[order[i]]);
+  }
+}
+
+void ClassEngine::get_Da(const std::vector<double>& z, std::vector<double>& Da)
+{
+  Da.resize(z.size());
+  const std::vector<size_t> order=sortedZ(z);
+  for (size_t i=0;i<order.size();i++){
+    backgroundAtZ(z[order[i]],inter_closeby);
+    Da[order[i]]=pvecback[ba.index_bg_ang_distance];
+  }
+}
+
+void ClassEngine::get_f(const std::vector<double>& z, std::vector<double>& f)
+{
+  f.resize(z.size());
+  const std::vector<size_t> order=sortedZ(z);
+  for (size_t i=0;i<order.size();i++){
+    backgroundAtZ(z[order[i]],inter_closeby);
+    f[order[i]]=pvecback[ba.index_bg_f];
+  }
+}
+
+void ClassEngine::get_Hz(const std::vector<double>& z, std::vector<double>& Hz)
+{
+  Hz.resize(z.size());
+  const std::vector<size_t> order=sortedZ(z);
+  for (size_t i=0;i<order.size();i++){
+    backgroundAtZ(z[order[i]],inter_closeby);
+    Hz[order[i]]=pvecback[ba.index_bg_H];
+  }
+}
+
+void ClassEngine::get_Hz_Da(const std::vector<double>& z, //input
+			    std::vector<double>& H,
+			    std::vector<double>& D_A)
+{
+  H.resize(z.size());
+  D_A.resize(z.size());
+  const std::vector<size_t> order=sortedZ(z);
+  for (size_t i=0;i<order.size();i++){
+    backgroundAtZ(z[order[i]],inter_closeby);
+    H[order[i]]=pvecback[ba.index_bg_H];
+    D_A[order[i]]=pvecback[ba.index_bg_ang_distance];
+  }
+}
+
+void ClassEngine::get_sigma8(const std::vector<double>& z, std::vector<double>& sigma8)
+{
+  if (computed != _ALL_MODULES_) throw out_of_range("no sigma8 available because CLASS failed");
+
+  sigma8.resize(z.size());
+  if (z.empty()) return;
+
+  if (fourier_sigmas_at_z_list(&pr,&ba,&fo,8./ba.h,z.size(),const_cast<double*>(&z[0]),fo.index_pk_m,out_sigma,&sigma8[0]) == _FAILURE_){
+    throw out_of_range(fo.error_message);
+  }
+}
+
+std::map<std::string,std::map<std::string,double> > ClassEngine::getTimings() const
+{
+  const std::pair<std::string,const struct class_stats *> modules[]={
+    std::make_pair("background",&ba.stats),
+    std::make_pair("thermodynamics",&th.stats),
+    std::make_pair("perturbations",&pt.stats),
+    std::make_pair("primordial",&pm.stats),
+    std::make_pair("fourier",&fo.stats),
+    std::make_pair("transfer",&tr.stats),
+    std::make_pair("harmonic",&hr.stats),
+    std::make_pair("lensing",&le.stats),
+    std::make_pair("distortions",&sd.stats)};
+
+  std::map<std::string,std::map<std::string,double> > timings;
+  for (size_t i=0;i<sizeof(modules)/sizeof(modules[0]);i++){
+    std::map<std::string,double>& t=timings[modules[i].first];
+    t["wall_time"]=modules[i].second->wall_time;
+    t["cpu_time"]=modules[i].second->cpu_time;
+    for (int index=0;index<counter_size;index++)
+      t[class_stats_counter_name(index)]=modules[i].second->counter[index];
+  }
+  return timings;
+}
@@ -10,6 +10,9 @@
 //
 // History (add to end):
 //	creation:   ven. nov. 4 11:02:20 CET 2011
+//	port to the v3 modules (harmonic, fourier, perturbations, transfer),
+//	with all the spectra of one multipole read in a single call
+//	updateParValues() recomputes only the modules whose inputs changed
 //
 //-----------------------------------------------------------------------
 
@@ -23,6 +26,7 @@
 //STD
 #include<string>
 #include<vector>
+#include<map>
 #include<utility>
 #include<ostream>
 
@@ -62,6 +66,9 @@ private:
 };
 
 ///////////////////////////////////////////////////////////////////////////
+// The structures of one model are computed once, by the constructor or
+// by updateParValues(), and kept until the next update: all the getters
+// below only read them.
 class ClassEngine : public Engine
 {
 
@@ -96,7 +103,14 @@ public:
 	      std::vector<double>& cltphi,
 	      std::vector<double>& clephi);
 
-  void call_perturb_sources_at_tau(
+  //all the spectra over lVec, with one output_total_cl_at_l() call per l:
+  //cls[t][i] for each Engine::cltype t (left empty when t is not computed)
+  void getAllCls(const std::vector<unsigned>& lVec, //input
+		 std::vector<std::vector<double> >& cls);
+
+  void writeCls(std::ostream &o);
+
+  void call_perturbations_sources_at_tau(
                            int index_md,
                            int index_ic,
                            int index_tp,
@@ -128,14 +142,31 @@ public:
   double get_Hz(double z);
   double get_Az(double z);
 
+  //same for a list of redshifts: the background is read in increasing
+  //z order with one cursor, and sigma8 with one fourier pass
+  void get_Dv(const std::vector<double>& z, std::vector<double>& Dv);
+  void get_Da(const std::vector<double>& z, std::vector<double>& Da);
+  void get_sigma8(const std::vector<double>& z, std::vector<double>& sigma8);
+  void get_f(const std::vector<double>& z, std::vector<double>& f);
+  void get_Hz(const std::vector<double>& z, std::vector<double>& Hz);
+
+  //H(z) and D_A(z) for a list of redshifts
+  void get_Hz_Da(const std::vector<double>& z, //input
+		 std::vector<double>& H,
+		 std::vector<double>& D_A);
+
   double getTauReio() const {return th.tau_reio;}
 
   //may need that
-  inline int numCls() const {return sp.ct_size;};
+  inline int numCls() const {return hr.ct_size;};
   inline double Tcmb() const {return ba.T_cmb;}
 
   inline int l_max_scalars() const {return _lmax;}
 
+  //wall time, cpu time and counters of the last run of each module:
+  //timings[module][name], name being "wall_time", "cpu_time" or a counter name
+  std::map<std::string,std::map<std::string,double> > getTimings() const;
+
   //print content of file_content
   void printFC();
 
@@ -144,12 +175,12 @@ private:
   struct file_content fc;
   struct precision pr;        /* for precision parameters */
   struct background ba;       /* for cosmological background */
-  struct thermo th;           /* for thermodynamics */
-  struct perturbs pt;         /* for source functions */
-  struct transfers tr;        /* for transfer functions */
+  struct thermodynamics th;   /* for thermodynamics */
+  struct perturbations pt;    /* for source functions */
+  struct transfer tr;         /* for transfer functions */
   struct primordial pm;       /* for primordial spectra */
-  struct spectra sp;          /* for output spectra */
-  struct nonlinear nl;        /* for non-linear spectra */
+  struct harmonic hr;         /* for output spectra */
+  struct fourier fo;          /* for non-linear spectra */
   struct lensing le;          /* for lensed spectra */
   struct distortions sd;      /* for spectral distortions */
   struct output op;           /* for output files */
@@ -157,23 +188,38 @@ private:
   ErrorMsg _errmsg;            /* for error messages */
   double * cl;
 
+  //background vector and last index, kept between the background getters
+  std::vector<double> pvecback;
+  int last_index_back;
+
+  //flags (1 << module_xxx) of the modules computed for the current model,
+  //and digests of their inputs (see input_module_digests())
+  int computed;
+  unsigned long long digests[_NUM_INPUT_MODULES_];
+
   //helpers
-  bool dofree;
-  int freeStructs();
+  int freeStructs(int modules);
 
   //call once /model
   int computeCls();
 
+  //fill pvecback at z
+  void backgroundAtZ(double z, enum interpolation_method inter_mode);
+  //indices of z in increasing order
+  std::vector<size_t> sortedZ(const std::vector<double>& z) const;
+  //D_V(z) from pvecback filled at z
+  double DvFromBackground(double z) const;
+
   int class_main(
 		 struct file_content *pfc,
 		 struct precision * ppr,
 		 struct background * pba,
-		 struct thermo * pth,
-		 struct perturbs * ppt,
-		 struct transfers * ptr,
+		 struct thermodynamics * pth,
+		 struct perturbations * ppt,
+		 struct transfer * ptr,
 		 struct primordial * ppm,
-		 struct spectra * psp,
-		 struct nonlinear * pnl,
+		 struct harmonic * phr,
+		 struct fourier * pfo,
 		 struct lensing * ple,
 		 struct distortions * psd,
 		 struct output * pop,
@@ -187,4 +233,3 @@ protected:
 };
 
 #endif
-
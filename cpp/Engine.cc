@@ -68,3 +68,33 @@ Engine::writeCls(std::ostream &of){
   
 
 }
+
+void
+Engine::get_Dv(const std::vector<double>& z, std::vector<double>& Dv){
+  Dv.resize(z.size());
+  for (size_t i=0;i<z.size();i++) Dv[i]=get_Dv(z[i]);
+}
+
+void
+Engine::get_Da(const std::vector<double>& z, std::vector<double>& Da){
+  Da.resize(z.size());
+  for (size_t i=0;i<z.size();i++) Da[i]=get_Da(z[i]);
+}
+
+void
+Engine::get_sigma8(const std::vector<double>& z, std::vector<double>& sigma8){
+  sigma8.resize(z.size());
+  for (size_t i=0;i<z.size();i++) sigma8[i]=get_sigma8(z[i]);
+}
+
+void
+Engine::get_f(const std::vector<double>& z, std::vector<double>& f){
+  f.resize(z.size());
+  for (size_t i=0;i<z.size();i++) f[i]=get_f(z[i]);
+}
+
+void
+Engine::get_Hz(const std::vector<double>& z, std::vector<double>& Hz){
+  Hz.resize(z.size());
+  for (size_t i=0;i<z.size();i++) Hz[i]=get_Hz(z[i]);
+}
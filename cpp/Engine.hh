@@ -58,6 +58,13 @@ public:
   virtual double get_Az(double z)=0;
   virtual double get_Hz(double z)=0;
 
+  //same for a list of redshifts (default: one call per redshift)
+  virtual void get_Dv(const std::vector<double>& z, std::vector<double>& Dv);
+  virtual void get_Da(const std::vector<double>& z, std::vector<double>& Da);
+  virtual void get_sigma8(const std::vector<double>& z, std::vector<double>& sigma8);
+  virtual void get_f(const std::vector<double>& z, std::vector<double>& f);
+  virtual void get_Hz(const std::vector<double>& z, std::vector<double>& Hz);
+
   virtual double getTauReio() const=0;
 
   // destructor
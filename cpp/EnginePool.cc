@@ -0,0 +1,131 @@
+//--------------------------------------------------------------------------
+//
+// Description:
+// 	class EnginePool : see header file (EnginePool.hh) for description.
+//
+//------------------------------------------------------------------------
+//-----------------------
+// This Class's Header --
+//-----------------------
+#include "EnginePool.hh"
+//--------------------
+// C++
+//--------------------
+#include<stdexcept>
+#include<string>
+
+using namespace std;
+
+//---------------
+// Constructors --
+//----------------
+EnginePool::EnginePool(const ClassParams& pars, unsigned num_engines)
+{
+  create(pars,NULL,num_engines);
+}
+
+EnginePool::EnginePool(const ClassParams& pars, const string & precision_file, unsigned num_engines)
+{
+  create(pars,&precision_file,num_engines);
+}
+
+//--------------
+// Destructor --
+//--------------
+EnginePool::~EnginePool()
+{
+}
+
+//-----------------
+// Member functions --
+//-----------------
+
+//the engines compute their first model in their constructor: build them
+//concurrently as well
+void EnginePool::create(const ClassParams& pars, const string * precision_file, unsigned num_engines)
+{
+  if (num_engines<1) throw invalid_argument("EnginePool needs at least one engine");
+
+  engines.resize(num_engines);
+  vector<string> errors(num_engines);
+
+  auto build=[&](unsigned i) -> int {
+    try{
+      if (precision_file==NULL)
+	engines[i].reset(new ClassEngine(pars,false));
+      else
+	engines[i].reset(new ClassEngine(pars,*precision_file,false));
+    }
+    catch (std::exception &e){
+      errors[i]=e.what();
+      return _FAILURE_;
+    }
+    return _SUCCESS_;
+  };
+
+  auto build_all=[&]() -> int {
+    class_setup_parallel();
+    for (unsigned i=0;i<num_engines;i++){
+      class_run_parallel(=,
+        return build(i);
+      );
+    }
+    class_finish_parallel();
+    return _SUCCESS_;
+  };
+
+  if (build_all()==_FAILURE_){
+    for (unsigned i=0;i<num_engines;i++)
+      if (!errors[i].empty()) throw invalid_argument(errors[i]);
+  }
+}
+
+int EnginePool::run(const vector<vector<double> >& batch,
+		    const Callback& use,
+		    vector<char>& status)
+{
+  const size_t num_engines=engines.size();
+  //the tasks capture by value: pass the arrays by address
+  const vector<vector<double> >* pbatch=&batch;
+  const Callback* puse=&use;
+  char* pstatus=status.data();
+
+  class_setup_parallel();
+
+  //one task per engine, computing its models one after the other
+  for (size_t index_engine=0;index_engine<num_engines;index_engine++){
+    class_run_parallel(=,
+      ClassEngine& engine=*engines[index_engine];
+      for (size_t i=index_engine;i<pbatch->size();i+=num_engines){
+        bool success=engine.updateParValues((*pbatch)[i]);
+        try{
+          if (*puse) (*puse)(i,engine,success);
+        }
+        catch (std::exception &){
+          success=false;
+        }
+        pstatus[i]=success;
+      }
+      return _SUCCESS_;
+    );
+  }
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+bool EnginePool::evaluate(const vector<vector<double> >& batch,
+			  const Callback& use,
+			  vector<bool>& ok)
+{
+  //one char per model, since the threads cannot share a vector<bool>
+  vector<char> status(batch.size(),0);
+
+  run(batch,use,status);
+
+  ok.assign(status.begin(),status.end());
+  for (size_t i=0;i<status.size();i++)
+    if (!status[i]) return false;
+  return true;
+}
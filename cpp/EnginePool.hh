@@ -0,0 +1,70 @@
+//--------------------------------------------------------------------------
+//
+// Description:
+// 	class EnginePool :
+// a set of independent ClassEngine's evaluating batches of models
+// concurrently
+//
+//
+// History (add to end):
+//	creation: for ensemble samplers (one walker per parameter vector)
+//
+//-----------------------------------------------------------------------
+
+#ifndef EnginePool_hh
+#define EnginePool_hh
+
+#include"ClassEngine.hh"
+
+//STD
+#include<functional>
+#include<memory>
+#include<string>
+#include<vector>
+
+///////////////////////////////////////////////////////////////////////////
+// Each engine owns its own CLASS structures, while the caches of the
+// modules (Bessel and HyRec tables, quadrature rules...) are shared by
+// the whole process. The engines run as tasks of the shared thread pool
+// (see include/parallel.h), and the parallel regions of each CLASS run
+// go to the same pool: its threads are thus split between the engines,
+// without oversubscribing the node. Its size can be set with
+// class_parallel_attach().
+class EnginePool
+{
+
+public:
+  //called for each model, by the thread of its engine, right after the
+  //computation: index in the batch, engine holding the model, and
+  //whether CLASS succeeded. Must not keep a reference to the engine.
+  typedef std::function<void(size_t,ClassEngine&,bool)> Callback;
+
+  //num_engines engines, all initialised (concurrently) with pars
+  EnginePool(const ClassParams& pars, unsigned num_engines);
+  EnginePool(const ClassParams& pars, const std::string & precision_file, unsigned num_engines);
+
+  ~EnginePool();
+
+  //compute the models of batch (same parameters as updateParValues()),
+  //batch[i] being done by engine i%size(), and call use on each of them;
+  //ok[i] is false if CLASS or use failed. Returns true if all succeeded.
+  bool evaluate(const std::vector<std::vector<double> >& batch,
+		const Callback& use,
+		std::vector<bool>& ok);
+
+  inline unsigned size() const {return engines.size();}
+  inline ClassEngine& engine(unsigned i) {return *engines[i];}
+
+private:
+  std::vector<std::unique_ptr<ClassEngine> > engines;
+
+  void create(const ClassParams& pars, const std::string * precision_file, unsigned num_engines);
+  int run(const std::vector<std::vector<double> >& batch,
+	  const Callback& use,
+	  std::vector<char>& status);
+
+  EnginePool(const EnginePool&);
+  EnginePool& operator=(const EnginePool&);
+};
+
+#endif
@@ -20,7 +20,7 @@
  * @param ppm        Input: pointer to primordial structure
  * @param pfo        Input: pointer to fourier structure
  * @param index_pk   Input: index of the pk type, either index_m or index_cb
- * @param index_tau  Input: index of tau, at which to compute the nl correction
+ * @param index_tau  Input: index of tau in pfo->tau, at which to compute the nl correction, or -1 for a time out of this table
  * @param tau        Input: tau, at which to compute the nl correction
  * @param pk_nl      Output:nonlinear power spectrum
  * @param lnpk_l     Input: logarithm of the linear power spectrum for both index_m and index_cb
@@ -55,6 +55,8 @@ int hmcode(
   /* The baryonic contribution is calculated as the ratio of three different
      simpler models, which are computed below
      (baryonic/unfitted_nobaryons * nobaryons) */
+  phw->hm_version = pfo->hm_version;
+
   if (pfo->hm_version == hmcode_version_2020_baryonic) {
 
     class_call(hmcode_compute(ppr, pba, ppt, ppm, pfo,
@@ -69,7 +71,7 @@ int hmcode(
                 pfo->k_size*sizeof(double),
                 pfo->error_message);
 
-    pfo->hm_version = hmcode_version_2020;
+    phw->hm_version = hmcode_version_2020;
 
     class_call(hmcode_compute(ppr, pba, ppt, ppm, pfo,
                               index_pk, index_tau, tau,
@@ -79,7 +81,7 @@ int hmcode(
                pfo->error_message,
                pfo->error_message);
 
-    pfo->hm_version = hmcode_version_2020_unfitted;
+    phw->hm_version = hmcode_version_2020_unfitted;
 
     class_alloc(pk_nl_denominator,
                 pfo->k_size*sizeof(double),
@@ -93,7 +95,7 @@ int hmcode(
                pfo->error_message,
                pfo->error_message);
 
-    pfo->hm_version = hmcode_version_2020_baryonic;
+    phw->hm_version = hmcode_version_2020_baryonic;
 
     for(index_k=0;index_k<pfo->k_size;++index_k){
       pk_nl[index_k] = pk_nl[index_k] * pk_nl_baseline[index_k] / pk_nl_denominator[index_k];
@@ -115,6 +117,302 @@ int hmcode(
   return _SUCCESS_;
 }
 
+/**
+ * Computes the nonlinear power spectra with HMcode at all times
+ * index_tau_min <= index_tau < pfo->tau_size, going backward from
+ * today. The times are sent to the thread pool by batches of as many
+ * times as there are threads, each time being computed by its own
+ * task with its own copy of the workspace (see
+ * hmcode_workspace_copy_init()). For each time the linear spectra
+ * P_L(k) are computed and splined again, the table of sigma(R) is
+ * filled and hmcode() is called for each index_pk in increasing
+ * order, until one of them cannot be computed. The loop stops after
+ * the first batch containing a time at which the nonlinear
+ * corrections could not be computed, since fourier_init() does not
+ * use any earlier time.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param pba           Input: pointer to background structure
+ * @param ppt           Input: pointer to perturbation structure
+ * @param ppm           Input: pointer to primordial structure
+ * @param pfo           Input/Output: pointer to fourier structure (pfo->k_nl is filled)
+ * @param index_tau_min Input: smallest index of tau at which P_NL(k) is needed
+ * @param pk_nl         Output: nonlinear power spectra, pk_nl[index_pk][index_tau*pfo->k_size+index_k]
+ * @param nl_corr_not_computable Output: flags nl_corr_not_computable[index_tau*pfo->pk_size+index_pk], set to _FALSE_ only if pk_nl was computed for this time and this index_pk
+ * @param phw           Input: pointer to hmcode workspace, initialized and with growth tables
+ * @return the error status
+ */
+
+int hmcode_at_all_tau(
+                      struct precision *ppr,
+                      struct background *pba,
+                      struct perturbations *ppt,
+                      struct primordial *ppm,
+                      struct fourier *pfo,
+                      int index_tau_min,
+                      double **pk_nl,
+                      short *nl_corr_not_computable,
+                      struct hmcode_workspace * phw
+                      ) {
+
+  int index_tau;
+  int index_tau_batch;
+  int index_pk;
+  int batch_size;
+  short batch_is_computable;
+
+  for (index_tau=0; index_tau<pfo->tau_size*pfo->pk_size; index_tau++) {
+    nl_corr_not_computable[index_tau] = _TRUE_;
+  }
+
+  class_setup_parallel();
+
+  batch_size = MAX(1,(int)task_system.get_num_threads());
+  batch_is_computable = _TRUE_;
+
+  for (index_tau_batch = pfo->tau_size-1;
+       (index_tau_batch >= index_tau_min) && (batch_is_computable == _TRUE_);
+       index_tau_batch -= batch_size) {
+
+    for (index_tau = index_tau_batch; index_tau > MAX(index_tau_batch-batch_size,index_tau_min-1); index_tau--) {
+
+      class_run_parallel(=,
+
+                         struct hmcode_workspace hw_tau;
+                         double ** lnpk_l;
+                         double ** ddlnpk_l;
+                         int index_pk;
+
+                         class_call(hmcode_workspace_copy_init(ppr,pfo,phw,&hw_tau),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         class_alloc(lnpk_l,pfo->pk_size*sizeof(double*),pfo->error_message);
+                         class_alloc(ddlnpk_l,pfo->pk_size*sizeof(double*),pfo->error_message);
+                         for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
+                           class_alloc(lnpk_l[index_pk],pfo->k_size_extra*sizeof(double),pfo->error_message);
+                           class_alloc(ddlnpk_l[index_pk],pfo->k_size_extra*sizeof(double),pfo->error_message);
+                         }
+
+                         /* index_pk_cb comes first, such that P_cb is available when computing P_m */
+                         for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+                           class_call(fourier_pk_linear(pba,
+                                                        ppt,
+                                                        ppm,
+                                                        pfo,
+                                                        index_pk,
+                                                        index_tau,
+                                                        pfo->k_size_extra,
+                                                        lnpk_l[index_pk],
+                                                        NULL),
+                                      pfo->error_message,
+                                      pfo->error_message);
+
+                           class_call(array_spline_table_columns(pfo->ln_k,
+                                                                 pfo->k_size_extra,
+                                                                 lnpk_l[index_pk],
+                                                                 1,
+                                                                 ddlnpk_l[index_pk],
+                                                                 _SPLINE_NATURAL_,
+                                                                 pfo->error_message),
+                                      pfo->error_message,
+                                      pfo->error_message);
+
+                           class_call(hmcode_fill_sigtab(ppr,
+                                                         pba,
+                                                         ppt,
+                                                         ppm,
+                                                         pfo,
+                                                         pfo->tau[index_tau],
+                                                         index_pk,
+                                                         lnpk_l,
+                                                         ddlnpk_l,
+                                                         &hw_tau),
+                                      pfo->error_message,
+                                      pfo->error_message);
+
+                           class_call(hmcode(ppr,
+                                             pba,
+                                             ppt,
+                                             ppm,
+                                             pfo,
+                                             index_pk,
+                                             index_tau,
+                                             pfo->tau[index_tau],
+                                             pk_nl[index_pk]+index_tau*pfo->k_size,
+                                             lnpk_l,
+                                             ddlnpk_l,
+                                             &(pfo->k_nl[index_pk][index_tau]),
+                                             &(nl_corr_not_computable[index_tau*pfo->pk_size+index_pk]),
+                                             &hw_tau),
+                                      pfo->error_message,
+                                      pfo->error_message);
+
+                           if (nl_corr_not_computable[index_tau*pfo->pk_size+index_pk] == _TRUE_)
+                             break;
+                         }
+
+                         for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
+                           free(lnpk_l[index_pk]);
+                           free(ddlnpk_l[index_pk]);
+                         }
+                         free(lnpk_l);
+                         free(ddlnpk_l);
+
+                         class_call(hmcode_workspace_copy_free(&hw_tau),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         return _SUCCESS_;
+                         );
+    }
+
+    class_finish_parallel();
+
+    for (index_tau = index_tau_batch; index_tau > MAX(index_tau_batch-batch_size,index_tau_min-1); index_tau--) {
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+        if (nl_corr_not_computable[index_tau*pfo->pk_size+index_pk] == _TRUE_)
+          batch_is_computable = _FALSE_;
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Computes the nonlinear power spectra with HMcode at a list of
+ * arbitrary times, given the linear spectra at these times, for
+ * fourier_prepare_pk_nl(). Each time is computed by its own task with
+ * its own copy of the workspace, as in hmcode_at_all_tau(), but all
+ * times are sent to the thread pool at once, since they do not depend
+ * on each other.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param pba           Input: pointer to background structure
+ * @param ppt           Input: pointer to perturbation structure
+ * @param ppm           Input: pointer to primordial structure
+ * @param pfo           Input: pointer to fourier structure
+ * @param tau_size      Input: number of times
+ * @param tau           Input: times tau[index_tau]
+ * @param lnpk_l        Input: linear spectra, lnpk_l[index_pk][index_tau*pfo->k_size_extra+index_k]
+ * @param pk_nl         Output: nonlinear power spectra, pk_nl[index_pk][index_tau*pfo->k_size+index_k]
+ * @param k_nl          Output: nonlinear scales, k_nl[index_pk][index_tau]
+ * @param nl_corr_not_computable Output: flags nl_corr_not_computable[index_tau*pfo->pk_size+index_pk], set to _FALSE_ only if pk_nl was computed for this time and this index_pk
+ * @param phw           Input: pointer to hmcode workspace, initialized and with growth tables
+ * @return the error status
+ */
+
+int hmcode_at_tau_list(
+                       struct precision *ppr,
+                       struct background *pba,
+                       struct perturbations *ppt,
+                       struct primordial *ppm,
+                       struct fourier *pfo,
+                       int tau_size,
+                       double *tau,
+                       double **lnpk_l,
+                       double **pk_nl,
+                       double **k_nl,
+                       short *nl_corr_not_computable,
+                       struct hmcode_workspace * phw
+                       ) {
+
+  int index_tau;
+
+  for (index_tau=0; index_tau<tau_size*pfo->pk_size; index_tau++) {
+    nl_corr_not_computable[index_tau] = _TRUE_;
+  }
+
+  class_setup_parallel();
+
+  for (index_tau=0; index_tau<tau_size; index_tau++) {
+
+    class_run_parallel(=,
+
+                       struct hmcode_workspace hw_tau;
+                       double ** lnpk_l_tau;
+                       double ** ddlnpk_l_tau;
+                       int index_pk;
+
+                       class_call(hmcode_workspace_copy_init(ppr,pfo,phw,&hw_tau),
+                                  pfo->error_message,
+                                  pfo->error_message);
+
+                       class_alloc(lnpk_l_tau,pfo->pk_size*sizeof(double*),pfo->error_message);
+                       class_alloc(ddlnpk_l_tau,pfo->pk_size*sizeof(double*),pfo->error_message);
+                       for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
+                         lnpk_l_tau[index_pk] = lnpk_l[index_pk]+index_tau*pfo->k_size_extra;
+                         class_alloc(ddlnpk_l_tau[index_pk],pfo->k_size_extra*sizeof(double),pfo->error_message);
+                       }
+
+                       /* index_pk_cb comes first, such that P_cb is available when computing P_m */
+                       for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+                         class_call(array_spline_table_columns(pfo->ln_k,
+                                                               pfo->k_size_extra,
+                                                               lnpk_l_tau[index_pk],
+                                                               1,
+                                                               ddlnpk_l_tau[index_pk],
+                                                               _SPLINE_NATURAL_,
+                                                               pfo->error_message),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         class_call(hmcode_fill_sigtab(ppr,
+                                                       pba,
+                                                       ppt,
+                                                       ppm,
+                                                       pfo,
+                                                       tau[index_tau],
+                                                       index_pk,
+                                                       lnpk_l_tau,
+                                                       ddlnpk_l_tau,
+                                                       &hw_tau),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         class_call(hmcode(ppr,
+                                           pba,
+                                           ppt,
+                                           ppm,
+                                           pfo,
+                                           index_pk,
+                                           -1,
+                                           tau[index_tau],
+                                           pk_nl[index_pk]+index_tau*pfo->k_size,
+                                           lnpk_l_tau,
+                                           ddlnpk_l_tau,
+                                           &(k_nl[index_pk][index_tau]),
+                                           &(nl_corr_not_computable[index_tau*pfo->pk_size+index_pk]),
+                                           &hw_tau),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         if (nl_corr_not_computable[index_tau*pfo->pk_size+index_pk] == _TRUE_)
+                           break;
+                       }
+
+                       for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
+                         free(ddlnpk_l_tau[index_pk]);
+                       }
+                       free(lnpk_l_tau);
+                       free(ddlnpk_l_tau);
+
+                       class_call(hmcode_workspace_copy_free(&hw_tau),
+                                  pfo->error_message,
+                                  pfo->error_message);
+
+                       return _SUCCESS_;
+                       );
+  }
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
 /**
  * Computes the nonlinear correction on the linear power spectrum via
  * HMcode 2015 (Mead et al. 1505.07833), 2016 (Mead et al. 1602.02154)
@@ -126,7 +424,7 @@ int hmcode(
  * @param ppm        Input: pointer to primordial structure
  * @param pfo        Input: pointer to fourier structure
  * @param index_pk   Input: index of the pk type, either index_m or index_cb
- * @param index_tau  Input: index of tau, at which to compute the nl correction
+ * @param index_tau  Input: index of tau in pfo->tau, at which to compute the nl correction, or -1 for a time out of this table (sigma_8, sigma_disp, ... are then not stored in phw)
  * @param tau        Input: tau, at which to compute the nl correction
  * @param pk_nl      Output:nonlinear power spectrum
  * @param lnpk_l     Input: logarithm of the linear power spectrum for both index_m and index_cb
@@ -155,15 +453,13 @@ int hmcode_compute(
                    ) {
 
   /* integers */
-  int index_mass, i, ng, nsig;
-  int index_k, index_ncol;
+  int index_mass, ng, nsig;
+  int index_k;
   int last_index=0;
   int index_pk_cb;
   int counter, index_nl;
 
-  int index_nu, index_cut;
-  int index_y;
-  int index_ddy;
+  int index_cut;
 
   /* Background parameters */
   double Omega_m,fnu,Omega0_m;
@@ -218,7 +514,21 @@ int hmcode_compute(
   double *r_real;
   double *nu_arr;
 
-  double *p1h_integrand;
+  /* k-independent factors of the 1h integrand at each mass */
+  double *p1h_weight;
+  double *nu_eta;
+  double *nfw_norm;
+  double *window_factor;
+  double window_shift;
+  double gst, sbar_bar, sbarz_bar, mbar_bar, mbarz_bar, mb, sb, ratio_m, fb, fc;
+
+  /* P(k) sampled once for all the integrals over k giving sigma(R), sigma'(R), ... */
+  double *pk_table;
+  double *pk_table_cb;
+  int pk_table_size;
+
+  /* with FFTLog: ln(R), sigma_cb(R), its spline, sigma_cb'(R), its spline */
+  double *sig_fftlog_cb = NULL;
 
   struct timeval begin, end;
   long seconds;
@@ -277,7 +587,7 @@ int hmcode_compute(
   free(pvecback);
 
   /* Read additional quantities for HMcode 2020 if required, and setup the 2020 nowiggle workspace */
-  if (pfo->hm_version == hmcode_version_2020 || pfo->hm_version == hmcode_version_2020_baryonic || pfo->hm_version == hmcode_version_2020_unfitted){
+  if (phw->hm_version == hmcode_version_2020 || phw->hm_version == hmcode_version_2020_baryonic || phw->hm_version == hmcode_version_2020_unfitted){
 
     class_call(hmcode_nowiggle_init(pfo,lnpk_l,ddlnpk_l,index_pk,phw),
                pfo->error_message,
@@ -303,51 +613,78 @@ int hmcode_compute(
   }
 
 
+  /** Sample P(k) (and P_cb(k)) on the grid of the integrals giving sigma(R) and similar quantities */
+
+  class_call(fourier_sigmas_pk_table(pfo,
+                                     lnpk_l[index_pk],ddlnpk_l[index_pk],
+                                     pfo->k_size_extra,
+                                     ppr->sigma_k_per_decade,
+                                     &pk_table_size,
+                                     &pk_table),
+             pfo->error_message,
+             pfo->error_message);
+
+  if (index_pk_cb != index_pk) {
+    class_call(fourier_sigmas_pk_table(pfo,
+                                       lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
+                                       pfo->k_size_extra,
+                                       ppr->sigma_k_per_decade,
+                                       &pk_table_size,
+                                       &pk_table_cb),
+               pfo->error_message,
+               pfo->error_message);
+  }
+  else {
+    pk_table_cb = pk_table;
+  }
+
   /** Get sigma(R=8 Mpc/h), sigma_disp(R=0), sigma_disp(R=100 Mpc/h) and write them into pfo structure */
 
-  class_call(fourier_sigmas(pfo,
+  class_call(fourier_sigmas_from_pk_table(pfo,
                             8./pba->h,
-                            lnpk_l[index_pk],ddlnpk_l[index_pk],
-                            pfo->k_size_extra,
+                            pk_table,
+                            pk_table_size,
                             ppr->sigma_k_per_decade,
                             out_sigma,
                             &sigma8),
              pfo->error_message,
              pfo->error_message);
 
-  class_call(fourier_sigmas(pfo,
+  class_call(fourier_sigmas_from_pk_table(pfo,
                             8./pba->h,
-                            lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
-                            pfo->k_size_extra,
+                            pk_table_cb,
+                            pk_table_size,
                             ppr->sigma_k_per_decade,
                             out_sigma,
                             &sigma8_cb),
              pfo->error_message,
              pfo->error_message);
 
-  class_call(fourier_sigmas(pfo,
+  class_call(fourier_sigmas_from_pk_table(pfo,
                             0.,
-                            lnpk_l[index_pk],ddlnpk_l[index_pk],
-                            pfo->k_size_extra,
+                            pk_table,
+                            pk_table_size,
                             ppr->sigma_k_per_decade,
                             out_sigma_disp,
                             &sigma_disp),
              pfo->error_message,
              pfo->error_message);
 
-  class_call(fourier_sigmas(pfo,
+  class_call(fourier_sigmas_from_pk_table(pfo,
                             100./pba->h,
-                            lnpk_l[index_pk],ddlnpk_l[index_pk],
-                            pfo->k_size_extra,
+                            pk_table,
+                            pk_table_size,
                             ppr->sigma_k_per_decade,
                             out_sigma_disp,
                             &sigma_disp100),
              pfo->error_message,
              pfo->error_message);
 
-  phw->sigma_8[index_pk][index_tau] = sigma8;
-  phw->sigma_disp[index_pk][index_tau] = sigma_disp;
-  phw->sigma_disp_100[index_pk][index_tau] = sigma_disp100;
+  if (index_tau >= 0) {
+    phw->sigma_8[index_pk][index_tau] = sigma8;
+    phw->sigma_disp[index_pk][index_tau] = sigma_disp;
+    phw->sigma_disp_100[index_pk][index_tau] = sigma_disp100;
+  }
 
   /** Initialisation steps for the 1-Halo Power Integral */
   mmin=ppr->mmin_for_p1h_integral/pba->h; //Minimum mass for integration; (unit conversion from  m[Msun/h] to m[Msun]  )
@@ -363,7 +700,7 @@ int hmcode_compute(
   // Linear theory density perturbation threshold for spherical collapse
   // The Einstein de-Sitter value would be delta_c = (3./20.)*pow(12.*_PI_,2./3.) ~1.686
   // Also virialized overdensity
-  switch (pfo->hm_version ){
+  switch (phw->hm_version ){
   case hmcode_version_2015:
     delta_c = 1.59+0.0314*log(sigma8); //Mead et al. (2015; arXiv 1505.07833)
     delta_c = delta_c*(1.+0.012299*log10(Omega_m)); //Nakamura & Suto (1997) fitting formula for LCDM models (as in Mead 2016) //BUGFIX :: changed 0.0123 to 0.012299
@@ -456,6 +793,8 @@ int hmcode_compute(
     free(sigma_r);
     free(sigmaf_r);
     free(nu_arr);
+    free(pk_table);
+    if (pk_table_cb != pk_table) free(pk_table_cb);
     return _SUCCESS_;
   }
 
@@ -484,18 +823,60 @@ int hmcode_compute(
   //fprintf(stdout, "r1=%e nu1=%e r2=%e nu2=%e\n", r1, nu_arr[index_nl-1], r2, nu_arr[index_nl+2]);
 
 
+  /* with FFTLog, sigma_cb(R) and sigma_cb'(R) are computed for all R at once, and then interpolated */
+  if (ppr->sigma_fftlog == _TRUE_) {
+
+    class_alloc(sig_fftlog_cb,5*pk_table_size*sizeof(double),pfo->error_message);
+
+    class_call(fourier_sigmas_fftlog(pfo,
+                                     &(phw->sigma_plan),
+                                     pk_table_cb,
+                                     out_sigma,
+                                     sig_fftlog_cb,
+                                     sig_fftlog_cb+pk_table_size,
+                                     sig_fftlog_cb+2*pk_table_size),
+               pfo->error_message,
+               pfo->error_message);
+
+    class_call(fourier_sigmas_fftlog(pfo,
+                                     &(phw->sigma_prime_plan),
+                                     pk_table_cb,
+                                     out_sigma_prime,
+                                     sig_fftlog_cb,
+                                     sig_fftlog_cb+3*pk_table_size,
+                                     sig_fftlog_cb+4*pk_table_size),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   // do iteration between r1 and r2 to find the precise value of r_nl --> TODO :: speed up by semi-newtonian iterations
   counter = 0;
   do {
 
-    class_call(fourier_sigmas(pfo,
-                              r_nl,
-                              lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
-                              pfo->k_size_extra,
-                              ppr->sigma_k_per_decade,
-                              out_sigma,
-                              &sigma_nl),
-               pfo->error_message, pfo->error_message);
+    if (ppr->sigma_fftlog == _TRUE_) {
+      class_call(fourier_sigmas_from_fftlog_table(pfo,
+                                                  r_nl,
+                                                  sig_fftlog_cb,
+                                                  sig_fftlog_cb+pk_table_size,
+                                                  sig_fftlog_cb+2*pk_table_size,
+                                                  pk_table_cb,
+                                                  pk_table_size,
+                                                  ppr->sigma_k_per_decade,
+                                                  out_sigma,
+                                                  &last_index,
+                                                  &sigma_nl),
+                 pfo->error_message, pfo->error_message);
+    }
+    else {
+      class_call(fourier_sigmas_from_pk_table(pfo,
+                                              r_nl,
+                                              pk_table_cb,
+                                              pk_table_size,
+                                              ppr->sigma_k_per_decade,
+                                              out_sigma,
+                                              &sigma_nl),
+                 pfo->error_message, pfo->error_message);
+    }
 
     diff = sigma_nl - delta_c;
 
@@ -527,6 +908,9 @@ int hmcode_compute(
     free(sigma_r);
     free(sigmaf_r);
     free(nu_arr);
+    free(pk_table);
+    if (pk_table_cb != pk_table) free(pk_table_cb);
+    free(sig_fftlog_cb);
     return _SUCCESS_;
   }
   else {
@@ -535,25 +919,43 @@ int hmcode_compute(
 
   /* call sigma_prime function at r_nl to find the effective spectral index n_eff */
 
-  class_call(fourier_sigmas(pfo,
-                            r_nl,
-                            lnpk_l[index_pk_cb],ddlnpk_l[index_pk_cb],
-                            pfo->k_size_extra,
-                            ppr->sigma_k_per_decade,
-                            out_sigma_prime,
-                            &sigma_prime),
-             pfo->error_message,
-             pfo->error_message);
+  if (ppr->sigma_fftlog == _TRUE_) {
+    class_call(fourier_sigmas_from_fftlog_table(pfo,
+                                                r_nl,
+                                                sig_fftlog_cb,
+                                                sig_fftlog_cb+3*pk_table_size,
+                                                sig_fftlog_cb+4*pk_table_size,
+                                                pk_table_cb,
+                                                pk_table_size,
+                                                ppr->sigma_k_per_decade,
+                                                out_sigma_prime,
+                                                &last_index,
+                                                &sigma_prime),
+               pfo->error_message,
+               pfo->error_message);
+  }
+  else {
+    class_call(fourier_sigmas_from_pk_table(pfo,
+                                            r_nl,
+                                            pk_table_cb,
+                                            pk_table_size,
+                                            ppr->sigma_k_per_decade,
+                                            out_sigma_prime,
+                                            &sigma_prime),
+               pfo->error_message,
+               pfo->error_message);
+  }
 
   dlnsigdlnR = r_nl*pow(sigma_nl, -2)*sigma_prime;
   n_eff = -3.- dlnsigdlnR;
 
-  phw->sigma_prime[index_pk][index_tau] = sigma_prime;
+  if (index_tau >= 0)
+    phw->sigma_prime[index_pk][index_tau] = sigma_prime;
 
   /** Calculate halo concentration-mass relation conc(mass) (Bullock et al. 2001) */
   class_alloc(conc,ppr->nsteps_for_p1h_integral*sizeof(double),pfo->error_message);
 
-  switch (pfo->hm_version ){
+  switch (phw->hm_version ){
   case hmcode_version_2015:
     DEcorr = phw->dark_energy_correction;
     break;
@@ -577,7 +979,7 @@ int hmcode_compute(
     DEcorr = phw->dark_energy_correction*g_lcdm/growth;
     break;
   }
-  switch (pfo->hm_version ){
+  switch (phw->hm_version ){
   case hmcode_version_2015:
     Abary = pfo->c_min;
     alpha = 3.24 * pow(1.85, n_eff);
@@ -638,7 +1040,7 @@ int hmcode_compute(
   }
 
   /* HMcode parameters for non-linear corerction */
-  switch (pfo->hm_version ){
+  switch (phw->hm_version ){
   case hmcode_version_2015:
     k_star=0.584/sigma_disp;   // Damping wavenumber of the 1-halo term at very large scales;
     eta = pfo->eta_0 - 0.3*sigma8; // halo bloating parameter
@@ -663,7 +1065,7 @@ int hmcode_compute(
   // Damping factor for 2-halo term
   if (fdamp<1.e-3) fdamp=1.e-3;
   if (fdamp>0.99)  fdamp=0.99;
-  if ( pfo->hm_version == hmcode_version_2020_baryonic || pfo->hm_version == hmcode_version_2020_unfitted ){
+  if ( phw->hm_version == hmcode_version_2020_baryonic || phw->hm_version == hmcode_version_2020_unfitted ){
     fdamp = 0.;
   }
 
@@ -680,19 +1082,73 @@ int hmcode_compute(
     index_cut = ppr->nsteps_for_p1h_integral;
   }
 
-  i=0;
-  index_nu=i;
-  i++;
-  index_y=i;
-  i++;
-  index_ddy=i;
-  i++;
-  index_ncol=i;
+  /** Prepare the factors of the 1h integrand that do not depend on
+      k. The integral over nu is a weighted sum of the integrand at
+      each mass (with the weights of the trapezoidal rule, as in
+      array_integrate_all_trapzd_or_spline() with index_start_spline
+      at the last point), and the integrand is mass*g(nu)*W^2, with
+      the window W = window_factor*W_NFW(nu^eta*k*r_v/c)+window_shift */
+
+  class_alloc(p1h_weight,index_cut*sizeof(double),pfo->error_message);
+  class_alloc(nu_eta,index_cut*sizeof(double),pfo->error_message);
+  class_alloc(nfw_norm,index_cut*sizeof(double),pfo->error_message);
+  class_alloc(window_factor,index_cut*sizeof(double),pfo->error_message);
+
+  class_call(array_integrate_all_trapzd_or_spline_weights(nu_arr,
+                                                          index_cut,
+                                                          index_cut-1, //ranges from 0 to n-1
+                                                          p1h_weight,
+                                                          pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  window_shift = 0.;
+
+  for (index_mass=0; index_mass<index_cut; index_mass++){
+
+    //get the value of the halo mass function
+    //equivalent to g_nu function (or g_ST)
+    class_call(hmcode_halomassfunction(nu_arr[index_mass],
+                                       &gst),
+               pfo->error_message, pfo->error_message);
+
+    p1h_weight[index_mass] *= mass[index_mass]*gst;
+
+    //the window is evaluated at nu^eta*k
+    nu_eta[index_mass] = pow(nu_arr[index_mass], eta);
+    nfw_norm[index_mass] = log(1.+conc[index_mass])-conc[index_mass]/(1.+conc[index_mass]);
+
+    switch (phw->hm_version ){
+    case hmcode_version_2015:
+      window_factor[index_mass] = 1.;
+      break;
+    case hmcode_version_2020_unfitted:
+    case hmcode_version_2020:
+      window_factor[index_mass] = 1.-fnu;
+      break;
+    case hmcode_version_2020_baryonic:
+      sbar_bar = -0.0030*(pfo->log10T_heat_hmcode-7.8)+0.0201;
+      sbarz_bar = 0.0224*(pfo->log10T_heat_hmcode-7.8)+0.409;
+      sb = MIN(sbar_bar*pow(10,z_at_tau*sbarz_bar),pba->Omega0_b/pba->Omega0_m);
+
+      mbar_bar = pow(10.,1.81*(pfo->log10T_heat_hmcode-7.8)+13.87);
+      mbarz_bar = 0.195*(pfo->log10T_heat_hmcode-7.8)-0.108;
+
+      mb = mbar_bar*pow(10,mbarz_bar*z_at_tau);
+      ratio_m = pow(pba->h*mass[index_mass]/mb,2.); //hmod%nbar
+      fb = pba->Omega0_b/pba->Omega0_m;
+      fc = pba->Omega0_cdm/pba->Omega0_m;
+
+      window_factor[index_mass] = fc+(fb-sb)*ratio_m/(1.+ratio_m); //Account for gas expulsion
+      window_shift = sb; //Account for star formation
+      break;
+    }
+  }
 
   class_setup_parallel();
 
   if (pfo->fourier_verbose>2) {
-    num_threads = task_system.GetNumThreads();
+    num_threads = task_system.get_num_threads();
     gettimeofday(&begin, 0);
   }
 
@@ -701,93 +1157,42 @@ int hmcode_compute(
     class_run_parallel( \
                        =,
 
-                       double declare_list_of_variables_inside_parallel_region(k,logk,pk_lin,window_nfw,gst,pk_1h,fac,pk_2h,pk_wig,fac_dewiggle);
-                       double declare_list_of_variables_inside_parallel_region(sbar_bar,sbarz_bar,mbar_bar,mbarz_bar,mb,sb,ratio_m,fb,fc,fs);
-                       double DMONLY_halo_mass_fraction;
+                       double declare_list_of_variables_inside_parallel_region(k,logk,pk_lin,pk_1h,fac,pk_2h,pk_wig,fac_dewiggle);
                        int index_mass_p;
-                       double * p1h_integrand;
+                       double * ks;
+                       double * window_nfw;
                        int last_index_p;
 
                        k = pfo->k[index_k];
                        logk = log(k);
 
-                       class_alloc(p1h_integrand,index_cut*index_ncol*sizeof(double),pfo->error_message);
+                       class_alloc(ks,8*index_cut*sizeof(double),pfo->error_message);
+                       window_nfw = ks+index_cut;
 
                        pk_lin = exp(lnpk_l[index_pk][index_k])*pow(k,3)*anorm; //convert P_k to Delta_k^2
 
-                       for (index_mass_p=0; index_mass_p<index_cut; index_mass_p++){ //Calculates the integrand for the ph1 integral at all nu values
-                         //get the nu^eta-value of the window
-                         class_call(hmcode_window_nfw(pfo,
-                                                      pow(nu_arr[index_mass_p], eta)*k,
-                                                      r_virial[index_mass_p],
-                                                      conc[index_mass_p], //(rv/rs)
-                                                      &window_nfw),
-                                    pfo->error_message, pfo->error_message);
-
-                         //get the value of the halo mass function
-                         //equivalent to g_nu function (or g_ST)
-                         class_call(hmcode_halomassfunction(nu_arr[index_mass_p],
-                                                            &gst),
-                                    pfo->error_message, pfo->error_message);
-
-                         p1h_integrand[index_mass_p*index_ncol+index_nu] = nu_arr[index_mass_p];
-
-                         switch (pfo->hm_version ){
-                         case hmcode_version_2015:
-                           break;
-                         case hmcode_version_2020_unfitted:
-                         case hmcode_version_2020:
-                           window_nfw *= (1.-fnu);
-                           break;
-                         case hmcode_version_2020_baryonic:
-                           sbar_bar = -0.0030*(pfo->log10T_heat_hmcode-7.8)+0.0201;
-                           sbarz_bar = 0.0224*(pfo->log10T_heat_hmcode-7.8)+0.409;
-                           sb = MIN(sbar_bar*pow(10,z_at_tau*sbarz_bar),pba->Omega0_b/pba->Omega0_m);
-
-                           mbar_bar = pow(10.,1.81*(pfo->log10T_heat_hmcode-7.8)+13.87);
-                           mbarz_bar = 0.195*(pfo->log10T_heat_hmcode-7.8)-0.108;
-
-                           mb = mbar_bar*pow(10,mbarz_bar*z_at_tau);
-                           ratio_m = pow(pba->h*mass[index_mass_p]/mb,2.); //hmod%nbar
-                           fb = pba->Omega0_b/pba->Omega0_m;
-                           fc = pba->Omega0_cdm/pba->Omega0_m;
-                           fs = sb;
-                           DMONLY_halo_mass_fraction = fc+(fb-fs)*ratio_m/(1.+ratio_m);
-
-                           window_nfw = window_nfw*DMONLY_halo_mass_fraction; //Account for gas expulsion
-
-                           window_nfw = window_nfw+sb; //Account for star formation
-                           break;
-                         }
-
-                         p1h_integrand[index_mass_p*index_ncol+index_y] = mass[index_mass_p]*gst*pow(window_nfw, 2.);
+                       //get the nu^eta-value of the window at all masses
+                       for (index_mass_p=0; index_mass_p<index_cut; index_mass_p++){
+                         ks[index_mass_p] = nu_eta[index_mass_p]*k*r_virial[index_mass_p]/conc[index_mass_p];
                        }
 
-                       class_call(array_spline(p1h_integrand,
-                                               index_ncol,
-                                               index_cut,
-                                               index_nu,
-                                               index_y,
-                                               index_ddy,
-                                               _SPLINE_EST_DERIV_,
-                                               pfo->error_message),
-                                  pfo->error_message,
-                                  pfo->error_message);
-
-                       class_call(array_integrate_all_trapzd_or_spline(
-                                                                       p1h_integrand,
-                                                                       index_ncol,
-                                                                       index_cut,
-                                                                       index_cut-1, //ranges from 0 to n-1
-                                                                       index_nu,
-                                                                       index_y,
-                                                                       index_ddy,
-                                                                       &pk_1h,
-                                                                       pfo->error_message),
-                                  pfo->error_message,
-                                  pfo->error_message);
+                       class_call(hmcode_window_nfw_list(pfo,
+                                                         index_cut,
+                                                         ks,
+                                                         conc,
+                                                         nfw_norm,
+                                                         window_nfw+index_cut,
+                                                         window_nfw),
+                                  pfo->error_message, pfo->error_message);
+
+                       //Calculates the ph1 integral as a weighted sum over all nu values
+                       pk_1h = 0.;
+                       for (index_mass_p=0; index_mass_p<index_cut; index_mass_p++){
+                         window_nfw[index_mass_p] = window_nfw[index_mass_p]*window_factor[index_mass_p]+window_shift;
+                         pk_1h += p1h_weight[index_mass_p]*window_nfw[index_mass_p]*window_nfw[index_mass_p];
+                       }
 
-                       switch (pfo->hm_version ){
+                       switch (phw->hm_version ){
                        case hmcode_version_2015:
                          if (pow(k/k_star, 2)>7.){
                            fac = 1.;     //prevents problems if (k/k*)^2 is large
@@ -811,7 +1216,7 @@ int hmcode_compute(
 
                        pk_1h = pk_1h*anorm*pow(k,3)*fac/(rho_crit_today_in_msun_mpc3*Omega0_m);  // dimensionless power
 
-                       switch (pfo->hm_version ){
+                       switch (phw->hm_version ){
                        case hmcode_version_2015:
                          pk_2h = pk_lin;
                          if(fdamp>0){
@@ -850,7 +1255,7 @@ int hmcode_compute(
                        //p_hm function: Combine pk_1h and pk_2h
                        class_test(pk_2h < 0. || pk_1h < 0.,pfo->error_message,"The 2 halo or 1 halo term is negative for HMcode, and the 'safe_negative' option is disabled. Aborting");
                        pk_nl[index_k] = pow((pow(pk_1h, alpha) + pow(pk_2h, alpha)), (1./alpha))/pow(k,3)/anorm;
-                       free(p1h_integrand);
+                       free(ks);
 
                        return _SUCCESS_;
                         );
@@ -902,12 +1307,19 @@ int hmcode_compute(
   }
 
   free(conc);
+  free(p1h_weight);
+  free(nu_eta);
+  free(nfw_norm);
+  free(window_factor);
   free(mass);
   free(r_real);
   free(r_virial);
   free(sigma_r);
   free(sigmaf_r);
   free(nu_arr);
+  free(pk_table);
+  if (pk_table_cb != pk_table) free(pk_table_cb);
+  free(sig_fftlog_cb);
 
   return _SUCCESS_;
 }
@@ -956,6 +1368,8 @@ int hmcode_workspace_init(
     class_alloc(phw->sigma_prime[index_pk],pfo->tau_size*sizeof(double),pfo->error_message);
   }
 
+  phw->hm_version = pfo->hm_version;
+
   /** - fill table with scale independent growth factor */
 
   class_call(hmcode_fill_growtab(ppr,pba,pfo,phw),
@@ -966,18 +1380,41 @@ int hmcode_workspace_init(
   class_alloc(phw->ddpk_wiggle, pfo->nk_wiggle*sizeof(double), pfo->error_message);
   class_alloc(phw->lnk_wiggle, pfo->nk_wiggle*sizeof(double), pfo->error_message);
 
+  /** - prepare the FFTLog transforms for the tables of sigma(R), shared by all times */
+
+  if (ppr->sigma_fftlog == _TRUE_) {
+
+    class_call(fourier_sigmas_fftlog_init(pfo,
+                                          pfo->k_size_extra,
+                                          ppr->sigma_k_per_decade,
+                                          out_sigma,
+                                          &(phw->sigma_plan)),
+               pfo->error_message,
+               pfo->error_message);
+
+    class_call(fourier_sigmas_fftlog_init(pfo,
+                                          pfo->k_size_extra,
+                                          ppr->sigma_k_per_decade,
+                                          out_sigma_prime,
+                                          &(phw->sigma_prime_plan)),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   return _SUCCESS_;
 }
 
 /**
  * Deallocate arrays in the hmcode workspace
  *
+ * @param ppr Input: pointer to precision structure
  * @param pfo Input: pointer to fourier structure
  * @param phw Input: pointer to hmcode workspace
  * @return the error status
  */
 
 int hmcode_workspace_free(
+                          struct precision *ppr,
                           struct fourier *pfo,
                           struct hmcode_workspace *phw
                           ) {
@@ -1008,6 +1445,67 @@ int hmcode_workspace_free(
   free(phw->ddpk_wiggle);
   free(phw->lnk_wiggle);
 
+  if (ppr->sigma_fftlog == _TRUE_) {
+    fftlog_plan_free(&(phw->sigma_plan));
+    fftlog_plan_free(&(phw->sigma_prime_plan));
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Initialize a copy of the hmcode workspace for one task of
+ * hmcode_at_all_tau(). The copy shares the read-only tables of phw
+ * (growth tables, sigma_8(tau), ..., which are written by each task
+ * at its own index_tau only), and owns the scratch arrays rewritten
+ * at each call of hmcode_fill_sigtab() and hmcode().
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pfo      Input: pointer to fourier structure
+ * @param phw      Input: pointer to initialized hmcode workspace
+ * @param phw_copy Output: pointer to the copy
+ * @return the error status
+ */
+
+int hmcode_workspace_copy_init(
+                               struct precision *ppr,
+                               struct fourier *pfo,
+                               struct hmcode_workspace *phw,
+                               struct hmcode_workspace *phw_copy
+                               ){
+
+  *phw_copy = *phw;
+
+  class_alloc(phw_copy->rtab,ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
+  class_alloc(phw_copy->stab,ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
+  class_alloc(phw_copy->ddstab,ppr->n_hmcode_tables*sizeof(double),pfo->error_message);
+
+  class_alloc(phw_copy->pk_wiggle, pfo->nk_wiggle*sizeof(double), pfo->error_message);
+  class_alloc(phw_copy->ddpk_wiggle, pfo->nk_wiggle*sizeof(double), pfo->error_message);
+  class_alloc(phw_copy->lnk_wiggle, pfo->nk_wiggle*sizeof(double), pfo->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Deallocate the arrays owned by a copy of the hmcode workspace
+ *
+ * @param phw_copy Input: pointer to the copy
+ * @return the error status
+ */
+
+int hmcode_workspace_copy_free(
+                               struct hmcode_workspace *phw_copy
+                               ) {
+
+  free(phw_copy->rtab);
+  free(phw_copy->stab);
+  free(phw_copy->ddstab);
+
+  free(phw_copy->pk_wiggle);
+  free(phw_copy->ddpk_wiggle);
+  free(phw_copy->lnk_wiggle);
+
   return _SUCCESS_;
 }
 
@@ -1166,7 +1664,7 @@ int hmcode_baryonic_feedback(
  * @param ppt        Input: pointer to perturbation structure
  * @param ppm        Input: pointer to primordial structure
  * @param pfo        Input: pointer to fourier structure
- * @param index_tau  Input: index of tau, at which to compute the nl correction
+ * @param tau        Input: tau, at which to compute the nl correction
  * @param index_pk   Input: index of the pk type, either index_m or index_cb
  * @param lnpk_l     Input: logarithm of the linear power spectrum for either index_m or index_cb
  * @param ddlnpk_l   Input: spline of the logarithm of the linear power spectrum for either index_m or index_cb
@@ -1180,7 +1678,7 @@ int hmcode_fill_sigtab(
                        struct perturbations *ppt,
                        struct primordial *ppm,
                        struct fourier *pfo,
-                       int index_tau,
+                       double tau,
                        int index_pk,
                        double **lnpk_l,
                        double **ddlnpk_l,
@@ -1192,6 +1690,9 @@ int hmcode_fill_sigtab(
   double sig;
   double *sigtab;
   double *lpk, *ddlpk;
+  double *pk_table;
+  int pk_table_size;
+  double *sig_fftlog;
   int i, index_r, index_sig, index_ddsig, index_n, nsig;
   double cbcorr, z, growth;
   int last_index = 0;
@@ -1226,7 +1727,7 @@ int hmcode_fill_sigtab(
     if ((pfo->has_pk_m == _TRUE_ && pfo->has_pk_cb == _TRUE_ && index_pk == pfo->index_pk_m)
         && (pfo->hm_version == hmcode_version_2020 || pfo->hm_version == hmcode_version_2020_baryonic)){
 
-      class_call(background_z_of_tau(pba,pfo->tau[index_tau],&z),
+      class_call(background_z_of_tau(pba,tau,&z),
                  pba->error_message,
                  phg->error_message);
 
@@ -1277,24 +1778,68 @@ int hmcode_fill_sigtab(
              pfo->error_message,
              pfo->error_message);
 
-  for (i=0;i<nsig;i++){
-    r=exp(log(rmin)+log(rmax/rmin)*i/(nsig-1));
+  class_call(fourier_sigmas_pk_table(pfo,
+                                     lpk,
+                                     ddlpk,
+                                     pfo->k_size_extra,
+                                     ppr->sigma_k_per_decade,
+                                     &pk_table_size,
+                                     &pk_table),
+             pfo->error_message,
+             pfo->error_message);
 
-    class_call(fourier_sigmas(pfo,
-                              r,
-                              lpk,
-                              ddlpk,
-                              pfo->k_size_extra,
-                              ppr->sigma_k_per_decade,
-                              out_sigma,
-                              &sig),
+  /* with FFTLog, sigma(R) is computed for all R at once, and then interpolated */
+  if (ppr->sigma_fftlog == _TRUE_) {
+    class_alloc(sig_fftlog,3*pk_table_size*sizeof(double),pfo->error_message);
+    class_call(fourier_sigmas_fftlog(pfo,
+                                     &(phw->sigma_plan),
+                                     pk_table,
+                                     out_sigma,
+                                     sig_fftlog,
+                                     sig_fftlog+pk_table_size,
+                                     sig_fftlog+2*pk_table_size),
                pfo->error_message,
                pfo->error_message);
+  }
+
+  for (i=0;i<nsig;i++){
+    r=exp(log(rmin)+log(rmax/rmin)*i/(nsig-1));
+
+    if (ppr->sigma_fftlog == _TRUE_) {
+      class_call(fourier_sigmas_from_fftlog_table(pfo,
+                                                  r,
+                                                  sig_fftlog,
+                                                  sig_fftlog+pk_table_size,
+                                                  sig_fftlog+2*pk_table_size,
+                                                  pk_table,
+                                                  pk_table_size,
+                                                  ppr->sigma_k_per_decade,
+                                                  out_sigma,
+                                                  &last_index,
+                                                  &sig),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+    else {
+      class_call(fourier_sigmas_from_pk_table(pfo,
+                                              r,
+                                              pk_table,
+                                              pk_table_size,
+                                              ppr->sigma_k_per_decade,
+                                              out_sigma,
+                                              &sig),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
 
     sigtab[i*index_n+index_r]=r;
     sigtab[i*index_n+index_sig]=sig;
   }
 
+  if (ppr->sigma_fftlog == _TRUE_) {
+    free(sig_fftlog);
+  }
+
   class_call(array_spline(sigtab,
 						  index_n,
 						  nsig,
@@ -1306,22 +1851,17 @@ int hmcode_fill_sigtab(
              pfo->error_message,
              pfo->error_message);
 
-  if (index_tau == pfo->tau_size-1){
-    for (i=0;i<nsig;i++){
-      phw->rtab[i] = sigtab[i*index_n+index_r];
-      phw->stab[i] = sigtab[i*index_n+index_sig];
-      phw->ddstab[i] = sigtab[i*index_n+index_ddsig];
-    }
-  }
-  else{
-    for (i=0;i<nsig;i++){
-      phw->stab[i] = sigtab[i*index_n+index_sig];
-      phw->ddstab[i] = sigtab[i*index_n+index_ddsig];
-    }
+  /* the radii do not depend on time, but they are copied at each
+     call, since each time may be computed with its own workspace */
+  for (i=0;i<nsig;i++){
+    phw->rtab[i] = sigtab[i*index_n+index_r];
+    phw->stab[i] = sigtab[i*index_n+index_sig];
+    phw->ddstab[i] = sigtab[i*index_n+index_ddsig];
   }
 
   free(lpk);
   free(ddlpk);
+  free(pk_table);
   free(sigtab);
 
   return _SUCCESS_;
@@ -1552,6 +2092,58 @@ int hmcode_window_nfw(
   return _SUCCESS_;
 }
 
+/**
+ * Same as hmcode_window_nfw() for a list of halos, with the sine and
+ * cosine integrals of all of them computed at once by
+ * sine_cosine_integrals().
+ *
+ * @param pfo        Input: pointer to fourier structure
+ * @param size       Input: number of halos
+ * @param ks         Input: array of k*rv/c (wave vector times scale radius)
+ * @param c          Input: array of concentrations
+ * @param norm       Input: array of log(1+c)-c/(1+c)
+ * @param work       Input: workspace of 6*size doubles
+ * @param window_nfw Output: array of window functions of the NFW profiles
+ * @return the error status
+ */
+
+int hmcode_window_nfw_list(
+                           struct fourier *pfo,
+                           int size,
+                           double *ks,
+                           double *c,
+                           double *norm,
+                           double *work,
+                           double *window_nfw
+                           ){
+
+  int i;
+  double *x = work;
+  double *si = work+2*size;
+  double *ci = work+4*size;
+
+  /* the integrals are needed at ks (first half) and ks*(1+c) (second half) */
+  for (i=0; i<size; i++) {
+    x[i] = ks[i];
+    x[size+i] = ks[i]*(1.+c[i]);
+  }
+
+  class_call(sine_cosine_integrals(2*size,
+                                   x,
+                                   si,
+                                   ci,
+                                   pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  for (i=0; i<size; i++) {
+    window_nfw[i] = cos(ks[i])*(ci[size+i]-ci[i])+sin(ks[i])*(si[size+i]-si[i])-sin(ks[i]*c[i])/(ks[i]*(1.+c[i]));
+    window_nfw[i] = window_nfw[i]/norm[i];
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * This is the Sheth-Tormen halo mass function (1999, MNRAS, 308, 119)
  *
@@ -1905,16 +2497,19 @@ int hmcode_nowiggle_init(
 
   /* Get P_wiggle = P_l - P_nowiggle */
 
-  class_call(hmcode_nowiggle(pfo,
-                             lnpk_l[index_pk],
-                             ddlnpk_l[index_pk],
-                             pfo->nk_wiggle,
-                             phw->lnk_wiggle,
-                             pk_nw,
-                             phw->pk_wiggle),
+  class_call(nowiggle_split(pfo->nowiggle_plan,
+                            pfo->ln_k,
+                            lnpk_l[index_pk],
+                            ddlnpk_l[index_pk],
+                            pfo->k_size_extra,
+                            pk_nw,
+                            phw->pk_wiggle,
+                            pfo->error_message),
              pfo->error_message,
              pfo->error_message);
 
+  memcpy(phw->lnk_wiggle,pfo->nowiggle_plan->lnk,pfo->nk_wiggle*sizeof(double));
+
   /* Transform P_wiggle into a dimensionless linear spectrum {cal
      P}_wiggle = k^3/(2pi^2) P_l, where {cal P}_l would scale like
      k^(4+n_s) for k<k_eq. Store the result in phw->pk_wiggle. */
@@ -1990,7 +2585,7 @@ int hmcode_wnw_split(
   class_alloc(lnpk_l,pfo->k_size_extra*sizeof(double),pfo->error_message);
   class_alloc(ddlnpk_l,pfo->k_size_extra*sizeof(double),pfo->error_message);
 
-  class_alloc(ln_k_nw, pfo->nk_wiggle*sizeof(double), pfo->error_message);
+  ln_k_nw = pfo->nowiggle_plan->lnk;
   class_alloc(pk_nw, pfo->nk_wiggle*sizeof(double), pfo->error_message);
   class_alloc(pk_w, pfo->nk_wiggle*sizeof(double), pfo->error_message);
 
@@ -2005,7 +2600,7 @@ int hmcode_wnw_split(
     memcpy(lnpk_l, &(pfo->ln_pk_l_extra[index_pk][index_tau*pfo->k_size_extra]),
            pfo->k_size_extra * sizeof(double));
 
-    /** - spline it with respect to k, needed for interpolation inside hmcode_nowiggle() */
+    /** - spline it with respect to k, needed for interpolation inside nowiggle_split() */
 
     class_call(array_spline_table_columns(pfo->ln_k,
                                           pfo->k_size_extra,
@@ -2018,16 +2613,17 @@ int hmcode_wnw_split(
                pfo->error_message);
 
     /* - compute P_nowiggle and P_wiggle (here the later is not used,
-         only the former). These spectra are sampled over an array
-         ln_k_nw determined by the function hmcode_nowiggle() */
-
-    class_call(hmcode_nowiggle(pfo,
-                               lnpk_l,
-                               ddlnpk_l,
-                               pfo->nk_wiggle,
-                               ln_k_nw,
-                               pk_nw,
-                               pk_w),
+         only the former). These spectra are sampled over the array
+         ln_k_nw of the plan prepared by hmcode_nowiggle_plan_init() */
+
+    class_call(nowiggle_split(pfo->nowiggle_plan,
+                              pfo->ln_k,
+                              lnpk_l,
+                              ddlnpk_l,
+                              pfo->k_size_extra,
+                              pk_nw,
+                              pk_w,
+                              pfo->error_message),
                pfo->error_message,
                pfo->error_message);
 
@@ -2079,7 +2675,6 @@ int hmcode_wnw_split(
   free(lnpk_l);
   free(ddlnpk_l);
 
-  free(ln_k_nw);
   free(pk_nw);
   free(pk_w);
 
@@ -2090,28 +2685,22 @@ int hmcode_wnw_split(
 }
 
 /**
- * Dewiggle the linear spectrum
+ * Prepare the dewiggling of the linear spectra, with the smoothing
+ * algorithm of HMcode 2020: the ratio of the linear spectrum to the
+ * analytic nowiggle spectrum pfo->ln_pk_l_an_extra is smoothed with
+ * a Gaussian of width 0.25 in ln(k), on nk_wiggle points uniformly
+ * spaced in ln(k). The plan is shared by hmcode_nowiggle_init() at
+ * each time and by hmcode_wnw_split().
  *
- * @param pfo            Input: pointer to fourier structure
- * @param lnpk_l         Input: linear power spectrum
- * @param ddlnpk_l       Input: its second derivatives
- * @param index_pk       Input: index of the pk type, either index_m or index_cb
- * @param nw_size        Input: number of sampled values of the output spectra
- * @param ln_k_nw        Ouput: ln(k) array of size nw_size
- * @param pk_nw          Output: P_nowiggle array of size nw_size
- * @param pk_w           Output: P_wiggle array of size nw_size
+ * @param pfo            Input: pointer to fourier structure, with the analytic nowiggle spectrum
+ * @param pnp            Output: pointer to the plan
  * @return the error status
  */
 
-int hmcode_nowiggle(
-                    struct fourier *pfo,
-                    double * lnpk_l,
-                    double * ddlnpk_l,
-                    int nw_size,
-                    double * ln_k_nw,
-                    double * pk_nw,
-                    double * pk_w
-                    ) {
+int hmcode_nowiggle_plan_init(
+                              struct fourier *pfo,
+                              struct nowiggle_plan *pnp
+                              ) {
 
   // JL: The following parameters define the smoothing algorithm.
   //     In principle, they should be precision parameters rather than hard-coded.
@@ -2122,86 +2711,19 @@ int hmcode_nowiggle(
   double kmax_wiggle = 5.; // Mpc/h
   double logkmax_wiggle = log(kmax_wiggle);
 
-  int i;
-  int last_index = 0;
-  double * lnpk_lin;
-  double * lnpk_analytic_nowiggle;
-  double * pk_ratio;
-
-  class_alloc(lnpk_lin, nw_size*sizeof(double), pfo->error_message);
-  class_alloc(lnpk_analytic_nowiggle, nw_size*sizeof(double), pfo->error_message);
-  class_alloc(pk_ratio, nw_size*sizeof(double), pfo->error_message);
-
-  for(i=0; i<nw_size; ++i){
-
-    /* Define a new sampling in k-space, from logkmin_wiggle to
-       logkmax_wiggle with nw_size steps */
-
-    ln_k_nw[i] = logkmin_wiggle+i*(logkmax_wiggle-logkmin_wiggle)/(nw_size-1);
-
-    /* Interpolate the linear spectrum to fill lnpk_lin */
-
-    class_call(array_interpolate_spline(pfo->ln_k,
-                                        pfo->k_size_extra,
-                                        lnpk_l,
-                                        ddlnpk_l,
-                                        1,
-                                        ln_k_nw[i],
-                                        &last_index,
-                                        &(lnpk_lin[i]),
-                                        1,
-                                        pfo->error_message),
-               pfo->error_message,
-               pfo->error_message);
-
-    /* Interpolate the smooth analytic spectrum to populate
-       lnpk_analytic_nowiggle. This spectrum is only used to reduce the
-       dynamical range before smoothing. */
-
-    class_call(array_interpolate_spline(pfo->ln_k,
-                                        pfo->k_size_extra,
-                                        pfo->ln_pk_l_an_extra,
-                                        pfo->ddln_pk_l_an_extra,
-                                        1,
-                                        ln_k_nw[i],
-                                        &last_index,
-                                        &(lnpk_analytic_nowiggle[i]),
-                                        1,
-                                        pfo->error_message),
-               pfo->error_message,
-               pfo->error_message);
-
-    /* Compute the ratio P_l / P_analytic_nowiggle */
-
-    pk_ratio[i] = exp(lnpk_lin[i]-lnpk_analytic_nowiggle[i]);
-
-  }
-
-  /* Perform a Gaussian smoothing of this ratio, the result is stored in pk_nw */
-
-  class_call(array_smooth_Gaussian(ln_k_nw,
-                                   pk_ratio,
-                                   pk_nw,
-                                   nw_size,
-                                   wiggle_sigma,
-                                   pfo->error_message),
+  class_call(nowiggle_plan_init(pnp,
+                                pfo->nk_wiggle,
+                                logkmin_wiggle,
+                                logkmax_wiggle,
+                                wiggle_sigma,
+                                pfo->ln_k,
+                                pfo->ln_pk_l_an_extra,
+                                pfo->ddln_pk_l_an_extra,
+                                pfo->k_size_extra,
+                                pfo->error_message),
              pfo->error_message,
              pfo->error_message);
 
-  /* Multiply the smoothed ratio by the previously used analytic
-     approximation to get the actual nowiggle spectrum P_nowiggle, and
-     compute the difference P_wiggle = P_l - P_nowiggle */
-
-  for(i=0; i<nw_size; ++i){
-
-    pk_nw[i] = pk_nw[i]*exp(lnpk_analytic_nowiggle[i]);
-    pk_w[i] = exp(lnpk_lin[i])-pk_nw[i];
-  }
-
-  free(lnpk_lin);
-  free(lnpk_analytic_nowiggle);
-  free(pk_ratio);
-
   return _SUCCESS_;
 }
 
@@ -2480,6 +3002,7 @@ int hmcode_noradiation_growth_compute(
                              phg->a_size,
                              hmcode_growth_sources,
                              NULL,
+                             NULL,
                              phg->error_message),
              phg->error_message,
              phg->error_message);
@@ -1,6 +1,7 @@
 /** @file hmcode.h Documented includes for HMcode module */
 
 #include "primordial.h"
+#include "fourier.h"
 
 #ifndef __HMCODE__
 #define __HMCODE__
@@ -89,6 +90,11 @@ struct hmcode_workspace {
   double* ddpk_wiggle;
 
   struct hmcode_growth* phg;
+
+  struct fftlog_plan sigma_plan;       /** FFTLog plan for the tables of sigma(R) (if ppr->sigma_fftlog) */
+  struct fftlog_plan sigma_prime_plan; /** FFTLog plan for the tables of sigma'(R) (if ppr->sigma_fftlog) */
+
+  enum hmcode_version hm_version; /** version used by hmcode_compute(): the same as pfo->hm_version, except while hmcode() combines several 2020 versions for the baryonic feedback */
   //@}
 
 };
@@ -120,6 +126,33 @@ extern "C" {
              struct hmcode_workspace *phw
              );
 
+  int hmcode_at_all_tau(
+                        struct precision *ppr,
+                        struct background *pba,
+                        struct perturbations *ppt,
+                        struct primordial *ppm,
+                        struct fourier *pfo,
+                        int index_tau_min,
+                        double **pk_nl,
+                        short *nl_corr_not_computable,
+                        struct hmcode_workspace *phw
+                        );
+
+  int hmcode_at_tau_list(
+                         struct precision *ppr,
+                         struct background *pba,
+                         struct perturbations *ppt,
+                         struct primordial *ppm,
+                         struct fourier *pfo,
+                         int tau_size,
+                         double *tau,
+                         double **lnpk_l,
+                         double **pk_nl,
+                         double **k_nl,
+                         short *nl_corr_not_computable,
+                         struct hmcode_workspace *phw
+                         );
+
   int hmcode_compute(
                      struct precision *ppr,
                      struct background *pba,
@@ -145,10 +178,22 @@ extern "C" {
                             );
 
   int hmcode_workspace_free(
+                            struct precision *ppr,
                             struct fourier *pfo,
                             struct hmcode_workspace *phw
                             );
 
+  int hmcode_workspace_copy_init(
+                                 struct precision *ppr,
+                                 struct fourier *pfo,
+                                 struct hmcode_workspace *phw,
+                                 struct hmcode_workspace *phw_copy
+                                 );
+
+  int hmcode_workspace_copy_free(
+                                 struct hmcode_workspace *phw_copy
+                                 );
+
   int hmcode_dark_energy_correction(
                                     struct precision *ppr,
                                     struct background *pba,
@@ -167,7 +212,7 @@ extern "C" {
                          struct perturbations *ppt,
                          struct primordial *ppm,
                          struct fourier *pfo,
-                         int index_tau,
+                         double tau,
                          int index_pk,
                          double **lnpk_l,
                          double **ddlnpk_l,
@@ -199,6 +244,16 @@ extern "C" {
                         double *window_nfw
                         );
 
+  int hmcode_window_nfw_list(
+                             struct fourier *pfo,
+                             int size,
+                             double *ks,
+                             double *c,
+                             double *norm,
+                             double *work,
+                             double *window_nfw
+                             );
+
   int hmcode_halomassfunction(
                               double nu,
                               double *hmf
@@ -254,15 +309,10 @@ extern "C" {
                        struct fourier *pfo
                        );
 
-  int hmcode_nowiggle(
-                      struct fourier *pfo,
-                      double * lnpk_l,
-                      double * ddlnpk_l,
-                      int nw_size,
-                      double * ln_k_nw,
-                      double * pk_nw,
-                      double * pk_w
-                      );
+  int hmcode_nowiggle_plan_init(
+                                struct fourier *pfo,
+                                struct nowiggle_plan *pnp
+                                );
 
   int hmcode_eisenstein_hu(
                            struct precision *ppr,
@@ -1,5 +1,275 @@
 #include "halofit.h"
 #include "fourier.h"
+#include "parallel.h"
+
+/**
+ * Compute P_NL(k) with Halofit at all times from today back to
+ * index_tau_min, in parallel. The times are split into blocks of
+ * _HALOFIT_TAU_BLOCK_ consecutive values, each computed by one task
+ * with its own workspace; within a block, the bisection on the
+ * non-linear scale starts from its value at the previous (later)
+ * time. A block stops at the first time at which the non-linear
+ * corrections are not computable: at earlier times they would not be
+ * computable either, and they are discarded by the caller anyway. For
+ * the same reason, the blocks are run by batches of one block per
+ * thread, and no batch is started after one containing such a time.
+ *
+ * @param ppr            Input: pointer to precision structure
+ * @param pba            Input: pointer to background structure
+ * @param ppt            Input: pointer to perturbation structure
+ * @param ppm            Input: pointer to primordial structure
+ * @param pfo            Input/Output: pointer to fourier structure (pfo->k_nl is filled)
+ * @param index_tau_min  Input: smallest index of time at which P_NL(k) is needed
+ * @param pk_nl          Output: P_NL(k) for each index_pk, at pk_nl[index_pk][index_tau*pfo->k_size+index_k]
+ * @param nl_corr_not_computable Output: at [index_tau*pfo->pk_size+index_pk], _TRUE_ where P_NL(k) was not computed
+ * @param pfp            Input: FFTLog plan from halofit_fftlog_init(), or NULL for the direct quadrature at each R
+ * @return the error status
+ */
+
+int halofit_at_all_tau(
+                       struct precision *ppr,
+                       struct background *pba,
+                       struct perturbations *ppt,
+                       struct primordial *ppm,
+                       struct fourier *pfo,
+                       int index_tau_min,
+                       double **pk_nl,
+                       short *nl_corr_not_computable,
+                       struct fftlog_plan *pfp
+                       ) {
+
+  int index_tau;
+  int index_tau_batch;
+  int index_tau_block;
+  int index_pk;
+  int batch_size;
+  short batch_is_computable;
+
+  for (index_tau=0; index_tau<pfo->tau_size*pfo->pk_size; index_tau++) {
+    nl_corr_not_computable[index_tau] = _TRUE_;
+  }
+
+  class_setup_parallel();
+
+  batch_size = MAX(1,(int)task_system.get_num_threads())*_HALOFIT_TAU_BLOCK_;
+  batch_is_computable = _TRUE_;
+
+  for (index_tau_batch = pfo->tau_size-1;
+       (index_tau_batch >= index_tau_min) && (batch_is_computable == _TRUE_);
+       index_tau_batch -= batch_size) {
+
+    for (index_tau_block = index_tau_batch;
+         index_tau_block > MAX(index_tau_batch-batch_size,index_tau_min-1);
+         index_tau_block -= _HALOFIT_TAU_BLOCK_) {
+
+      class_run_parallel(=,
+
+                         struct halofit_workspace hw;
+                         double * lnpk_l;
+                         double * ddlnpk_l;
+                         double k_nl_guess;
+                         int index_tau;
+                         int index_pk;
+                         short is_computable = _TRUE_;
+
+                         class_call(halofit_workspace_init(ppr,pba,pfo,pfp,&hw),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         class_alloc(lnpk_l,pfo->k_size_extra*sizeof(double),pfo->error_message);
+                         class_alloc(ddlnpk_l,pfo->k_size_extra*sizeof(double),pfo->error_message);
+
+                         for (index_tau = index_tau_block;
+                              (index_tau > MAX(index_tau_block-_HALOFIT_TAU_BLOCK_,index_tau_min-1)) && (is_computable == _TRUE_);
+                              index_tau--) {
+
+                           for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+                             class_call(fourier_pk_linear(pba,
+                                                          ppt,
+                                                          ppm,
+                                                          pfo,
+                                                          index_pk,
+                                                          index_tau,
+                                                          pfo->k_size_extra,
+                                                          lnpk_l,
+                                                          NULL),
+                                        pfo->error_message,
+                                        pfo->error_message);
+
+                             class_call(array_spline_table_columns(pfo->ln_k,
+                                                                   pfo->k_size_extra,
+                                                                   lnpk_l,
+                                                                   1,
+                                                                   ddlnpk_l,
+                                                                   _SPLINE_NATURAL_,
+                                                                   pfo->error_message),
+                                        pfo->error_message,
+                                        pfo->error_message);
+
+                             /* guess for k_nl from the previous times of
+                                the block, extrapolated linearly in ln(k_nl) */
+                             if (index_tau < index_tau_block-1)
+                               k_nl_guess = pfo->k_nl[index_pk][index_tau+1]*pfo->k_nl[index_pk][index_tau+1]/pfo->k_nl[index_pk][index_tau+2];
+                             else if (index_tau < index_tau_block)
+                               k_nl_guess = pfo->k_nl[index_pk][index_tau+1];
+                             else
+                               k_nl_guess = 0.;
+
+                             class_call(halofit(ppr,
+                                                pba,
+                                                ppt,
+                                                ppm,
+                                                pfo,
+                                                index_pk,
+                                                pfo->tau[index_tau],
+                                                pk_nl[index_pk]+index_tau*pfo->k_size,
+                                                lnpk_l,
+                                                ddlnpk_l,
+                                                k_nl_guess,
+                                                &(pfo->k_nl[index_pk][index_tau]),
+                                                &(nl_corr_not_computable[index_tau*pfo->pk_size+index_pk]),
+                                                &hw),
+                                        pfo->error_message,
+                                        pfo->error_message);
+
+                             if (nl_corr_not_computable[index_tau*pfo->pk_size+index_pk] == _TRUE_) {
+                               is_computable = _FALSE_;
+                               break;
+                             }
+                           }
+                         }
+
+                         free(lnpk_l);
+                         free(ddlnpk_l);
+
+                         class_call(halofit_workspace_free(&hw),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         return _SUCCESS_;
+                         );
+    }
+
+    class_finish_parallel();
+
+    for (index_tau = index_tau_batch; index_tau > MAX(index_tau_batch-batch_size,index_tau_min-1); index_tau--) {
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+        if (nl_corr_not_computable[index_tau*pfo->pk_size+index_pk] == _TRUE_)
+          batch_is_computable = _FALSE_;
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute P_NL(k) with Halofit at a list of arbitrary times, given
+ * P_L(k) at these times, for fourier_prepare_pk_nl(). All times are
+ * independent: each of them is computed by one task with its own
+ * workspace, and the bisection on the non-linear scale starts from
+ * scratch.
+ *
+ * @param ppr            Input: pointer to precision structure
+ * @param pba            Input: pointer to background structure
+ * @param ppt            Input: pointer to perturbation structure
+ * @param ppm            Input: pointer to primordial structure
+ * @param pfo            Input: pointer to fourier structure
+ * @param tau_size       Input: number of times
+ * @param tau            Input: times tau[index_tau]
+ * @param lnpk_l         Input: ln(P_L(k)) for each index_pk, at lnpk_l[index_pk][index_tau*pfo->k_size_extra+index_k]
+ * @param pk_nl          Output: P_NL(k) for each index_pk, at pk_nl[index_pk][index_tau*pfo->k_size+index_k]
+ * @param k_nl           Output: non-linear scale for each index_pk, at k_nl[index_pk][index_tau]
+ * @param nl_corr_not_computable Output: at [index_tau*pfo->pk_size+index_pk], _TRUE_ where P_NL(k) was not computed
+ * @param pfp            Input: FFTLog plan from halofit_fftlog_init(), or NULL for the direct quadrature at each R
+ * @return the error status
+ */
+
+int halofit_at_tau_list(
+                        struct precision *ppr,
+                        struct background *pba,
+                        struct perturbations *ppt,
+                        struct primordial *ppm,
+                        struct fourier *pfo,
+                        int tau_size,
+                        double *tau,
+                        double **lnpk_l,
+                        double **pk_nl,
+                        double **k_nl,
+                        short *nl_corr_not_computable,
+                        struct fftlog_plan *pfp
+                        ) {
+
+  int index_tau;
+
+  for (index_tau=0; index_tau<tau_size*pfo->pk_size; index_tau++) {
+    nl_corr_not_computable[index_tau] = _TRUE_;
+  }
+
+  class_setup_parallel();
+
+  for (index_tau=0; index_tau<tau_size; index_tau++) {
+
+    class_run_parallel(=,
+
+                       struct halofit_workspace hw;
+                       double * ddlnpk_l;
+                       int index_pk;
+
+                       class_call(halofit_workspace_init(ppr,pba,pfo,pfp,&hw),
+                                  pfo->error_message,
+                                  pfo->error_message);
+
+                       class_alloc(ddlnpk_l,pfo->k_size_extra*sizeof(double),pfo->error_message);
+
+                       for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+                         class_call(array_spline_table_columns(pfo->ln_k,
+                                                               pfo->k_size_extra,
+                                                               lnpk_l[index_pk]+index_tau*pfo->k_size_extra,
+                                                               1,
+                                                               ddlnpk_l,
+                                                               _SPLINE_NATURAL_,
+                                                               pfo->error_message),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         class_call(halofit(ppr,
+                                            pba,
+                                            ppt,
+                                            ppm,
+                                            pfo,
+                                            index_pk,
+                                            tau[index_tau],
+                                            pk_nl[index_pk]+index_tau*pfo->k_size,
+                                            lnpk_l[index_pk]+index_tau*pfo->k_size_extra,
+                                            ddlnpk_l,
+                                            0.,
+                                            &(k_nl[index_pk][index_tau]),
+                                            &(nl_corr_not_computable[index_tau*pfo->pk_size+index_pk]),
+                                            &hw),
+                                    pfo->error_message,
+                                    pfo->error_message);
+
+                         if (nl_corr_not_computable[index_tau*pfo->pk_size+index_pk] == _TRUE_)
+                           break;
+                       }
+
+                       free(ddlnpk_l);
+
+                       class_call(halofit_workspace_free(&hw),
+                                  pfo->error_message,
+                                  pfo->error_message);
+
+                       return _SUCCESS_;
+                       );
+  }
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
 
 /**
  * Calculation of the nonlinear matter power spectrum with Halofit
@@ -21,8 +291,10 @@
  * @param pk_nl       Output: non linear spectrum at the relevant time
  * @param lnpk_l      Input: array of log(P(k)_linear)
  * @param ddlnpk_l    Input: array of second derivative of log(P(k)_linear) wrt k, for spline interpolation
+ * @param k_nl_guess  Input: non-linear wavenumber at a neighbouring time, used to start the bisection, or 0 if unknown
  * @param k_nl        Output: non-linear wavenumber
  * @param nl_corr_not_computable_at_this_k Ouput: flag concerning the status of the calculation (_TRUE_ if not possible)
+ * @param phw         Input/Output: pointer to halofit workspace
  * @return the error status
  */
 
@@ -37,8 +309,10 @@ int halofit(
             double *pk_nl,
             double *lnpk_l,
             double *ddlnpk_l,
+            double k_nl_guess,
             double *k_nl,
-            short *nl_corr_not_computable_at_this_k
+            short *nl_corr_not_computable_at_this_k,
+            struct halofit_workspace *phw
             ) {
 
   double Omega_m,Omega_v,fnu,w, dw_over_da_fld, integral_fld;
@@ -48,7 +322,7 @@ int halofit(
   int index_k;
   double pk_lin,pk_quasi,pk_halo,rk;
   double sigma,rknl,rneff,rncur,d1,d2;
-  double diff,xlogr1,xlogr2,rmid;
+  double diff,xlogr1,xlogr2,rmid,xlogr_guess,dxlogr;
 
   double gam,a,b,c,xmu,xnu,alpha,beta,f1,f2,f3;
   double pk_linaa;
@@ -62,20 +336,11 @@ int halofit(
   double sum1,sum2,sum3;
   double anorm;
 
-  double *integrand_array;
-  int integrand_size;
-  int index_ia_k;
-  int index_ia_pk;
-  int index_ia_sum;
-  int index_ia_ddsum;
-  /*
-    int index_ia_sum2;
-    int index_ia_ddsum2;
-    int index_ia_sum3;
-    int index_ia_ddsum3;
-  */
-  int ia_size;
-  int index_ia;
+  double *integrand_array = phw->integrand_array;
+  int integrand_size = phw->integrand_size;
+  int index_ia_k = phw->index_ia_k;
+  int index_ia_pk = phw->index_ia_pk;
+  int ia_size = phw->ia_size;
 
   double k_integrand;
   double lnpk_integrand;
@@ -84,7 +349,7 @@ int halofit(
 
   double *w_and_Omega;
 
-  class_alloc(pvecback,pba->bg_size*sizeof(double),pfo->error_message);
+  pvecback = phw->pvecback;
 
   if ((pfo->has_pk_m == _TRUE_) && (index_pk == pfo->index_pk_m)) {
     fnu = pba->Omega0_ncdm_tot/pba->Omega0_m;
@@ -146,28 +411,6 @@ int halofit(
 
   anorm    = 1./(2*pow(_PI_,2));
 
-  /*      Until the 17.02.2015 the values of k used for integrating sigma(R) quantities needed by Halofit where the same as in the perturbation module.
-          Since then, we sample these integrals on more values, in order to get more precise integrals (thanks Matteo Zennaro for noticing the need for this).
-
-          We create a temporary integrand_array which columns will be:
-          - k in 1/Mpc
-          - just linear P(k) in Mpc**3
-          - 1/(2(pi**2)) P(k) k**2 exp(-(kR)**2) or 1/(2(pi**2)) P(k) k**2 2 (kR) exp(-(kR)**2) or 1/(2(pi**2)) P(k) k**2 4 (kR)(1-kR) exp(-(kR)**2)
-          - second derivative of previous line with spline
-  */
-
-  index_ia=0;
-  class_define_index(index_ia_k,     _TRUE_,index_ia,1);
-  class_define_index(index_ia_pk,    _TRUE_,index_ia,1);
-  class_define_index(index_ia_sum,   _TRUE_,index_ia,1);
-  class_define_index(index_ia_ddsum, _TRUE_,index_ia,1);
-  ia_size = index_ia;
-
-  integrand_size=(int)(log(pfo->k[pfo->k_size-1]/pfo->k[0])/log(10.)*ppr->halofit_k_per_decade)+1;
-
-  class_alloc(integrand_array,integrand_size*ia_size*sizeof(double),pfo->error_message);
-
-
   /* we fill integrand_array with values of k and P(k) using interpolation */
 
   last_index=0;
@@ -235,8 +478,8 @@ int halofit(
                                ia_size,
                                index_ia_k,
                                index_ia_pk,
-                               index_ia_sum,
-                               index_ia_ddsum,
+                               phw->index_ia_sum,
+                               phw->index_ia_ddsum,
                                R,
                                halofit_integral_one,
                                &sum1
@@ -264,8 +507,6 @@ int halofit(
 
   if (sigma < 1.) {
     * nl_corr_not_computable_at_this_k = _TRUE_;
-    free(pvecback);
-    free(integrand_array);
     return _SUCCESS_;
   }
   else {
@@ -293,8 +534,8 @@ int halofit(
                                ia_size,
                                index_ia_k,
                                index_ia_pk,
-                               index_ia_sum,
-                               index_ia_ddsum,
+                               phw->index_ia_sum,
+                               phw->index_ia_ddsum,
                                R,
                                halofit_integral_one,
                                &sum1
@@ -311,24 +552,82 @@ int halofit(
 
   xlogr2 = log(R)/log(10.);
 
+  /* with FFTLog, the integral giving sigma(R) is computed for all R
+     at once, and then interpolated during the bisection (see
+     halofit_sigma_squared()) */
+  if (phw->pfp != NULL) {
+
+    class_call(halofit_integrate_fftlog(pfo,
+                                        phw->pfp,
+                                        integrand_array,
+                                        integrand_size,
+                                        ia_size,
+                                        index_ia_k,
+                                        index_ia_pk,
+                                        phw->sum_fftlog,
+                                        phw->sum_fftlog+integrand_size,
+                                        phw->sum_fftlog+2*integrand_size),
+               pfo->error_message,
+               pfo->error_message);
+
+  }
+
+  /* if we have a guess for R_nl=1/k_nl (from a neighbouring time),
+     start from a narrow bracket on one side of it, and widen it until
+     it contains R_nl: this saves most of the iterations of the
+     bisection below, which ends when the bracket is small enough */
+  if ((k_nl_guess > 0.) && (-log10(k_nl_guess) > xlogr1) && (-log10(k_nl_guess) < xlogr2)) {
+
+    xlogr_guess = -log10(k_nl_guess);
+
+    class_call(halofit_sigma_squared(pfo,phw,pow(10.,xlogr_guess),&last_index,&sum1),
+               pfo->error_message,
+               pfo->error_message);
+
+    dxlogr = _HALOFIT_GUESS_DLOGR_;
+
+    if (sqrt(sum1) > 1.) {
+      /* R_nl is above the guess */
+      xlogr1 = xlogr_guess;
+      while (xlogr_guess+dxlogr < xlogr2) {
+        class_call(halofit_sigma_squared(pfo,phw,pow(10.,xlogr_guess+dxlogr),&last_index,&sum1),
+                   pfo->error_message,
+                   pfo->error_message);
+        if (sqrt(sum1) > 1.) {
+          xlogr1 = xlogr_guess+dxlogr;
+          dxlogr *= 2.;
+        }
+        else {
+          xlogr2 = xlogr_guess+dxlogr;
+          break;
+        }
+      }
+    }
+    else {
+      /* R_nl is below the guess */
+      xlogr2 = xlogr_guess;
+      while (xlogr_guess-dxlogr > xlogr1) {
+        class_call(halofit_sigma_squared(pfo,phw,pow(10.,xlogr_guess-dxlogr),&last_index,&sum1),
+                   pfo->error_message,
+                   pfo->error_message);
+        if (sqrt(sum1) < 1.) {
+          xlogr2 = xlogr_guess-dxlogr;
+          dxlogr *= 2.;
+        }
+        else {
+          xlogr1 = xlogr_guess-dxlogr;
+          break;
+        }
+      }
+    }
+  }
+
   counter = 0;
   do {
     rmid = pow(10,(xlogr2+xlogr1)/2.0);
     counter ++;
 
-    class_call(halofit_integrate(
-                                 pfo,
-                                 integrand_array,
-                                 integrand_size,
-                                 ia_size,
-                                 index_ia_k,
-                                 index_ia_pk,
-                                 index_ia_sum,
-                                 index_ia_ddsum,
-                                 rmid,
-                                 halofit_integral_one,
-                                 &sum1
-                                 ),
+    class_call(halofit_sigma_squared(pfo,phw,rmid,&last_index,&sum1),
                pfo->error_message,
                pfo->error_message);
 
@@ -357,7 +656,8 @@ int halofit(
 
   } while (fabs(diff) > ppr->halofit_tol_sigma);
 
-  /* evaluate all the other integrals at R=rmid */
+  /* evaluate all the other integrals at R=rmid (directly, since they
+     are only needed at this value of R) */
 
   class_call(halofit_integrate(
                                pfo,
@@ -366,8 +666,8 @@ int halofit(
                                ia_size,
                                index_ia_k,
                                index_ia_pk,
-                               index_ia_sum,
-                               index_ia_ddsum,
+                               phw->index_ia_sum,
+                               phw->index_ia_ddsum,
                                rmid,
                                halofit_integral_two,
                                &sum2
@@ -382,8 +682,8 @@ int halofit(
                                ia_size,
                                index_ia_k,
                                index_ia_pk,
-                               index_ia_sum,
-                               index_ia_ddsum,
+                               phw->index_ia_sum,
+                               phw->index_ia_ddsum,
                                rmid,
                                halofit_integral_three,
                                &sum3
@@ -391,6 +691,7 @@ int halofit(
              pfo->error_message,
              pfo->error_message);
 
+
   sigma  = sqrt(sum1);
   d1 = -sum2/sum1;
   d2 = -sum2*sum2/sum1/sum1 - sum3/sum1;
@@ -401,6 +702,44 @@ int halofit(
 
   *k_nl = rknl;
 
+  /* coefficients of the fitting formulas, which depend on the time
+     but not on k */
+
+  /*SPB11: Standard halofit underestimates the power on the smallest
+   * scales by a factor of two. Add an extra correction from the
+   * simulations in Bird, Viel,Haehnelt 2011 which partially accounts for
+   * this.*/
+  /*SPB14: This version of halofit is an updated version of the fit to the massive neutrinos
+   * based on the results of Takahashi 2012, (arXiv:1208.2701).
+   */
+  gam=0.1971-0.0843*rneff+0.8460*rncur;
+  a=1.5222+2.8553*rneff+2.3706*rneff*rneff+0.9903*rneff*rneff*rneff+ 0.2250*rneff*rneff*rneff*rneff-0.6038*rncur+0.1749*Omega_v*(1.+w);
+  a=pow(10,a);
+  b=pow(10, (-0.5642+0.5864*rneff+0.5716*rneff*rneff-1.5474*rncur+0.2279*Omega_v*(1.+w)));
+  c=pow(10, 0.3698+2.0404*rneff+0.8161*rneff*rneff+0.5869*rncur);
+  xmu=0.;
+  xnu=pow(10,5.2105+3.6902*rneff);
+  alpha=fabs(6.0835+1.3373*rneff-0.1959*rneff*rneff-5.5274*rncur);
+  beta=2.0379-0.7354*rneff+0.3157*pow(rneff,2)+1.2490*pow(rneff,3)+0.3980*pow(rneff,4)-0.1682*rncur + fnu*(1.081 + 0.395*pow(rneff,2));
+
+  if (fabs(1-Omega_m)>0.01) { /*then omega evolution */
+    f1a=pow(Omega_m,(-0.0732));
+    f2a=pow(Omega_m,(-0.1423));
+    f3a=pow(Omega_m,(0.0725));
+    f1b=pow(Omega_m,(-0.0307));
+    f2b=pow(Omega_m,(-0.0585));
+    f3b=pow(Omega_m,(0.0743));
+    frac=Omega_v/(1.-Omega_m);
+    f1=frac*f1b + (1-frac)*f1a;
+    f2=frac*f2b + (1-frac)*f2a;
+    f3=frac*f3b + (1-frac)*f3a;
+  }
+  else {
+    f1=1.;
+    f2=1.;
+    f3=1.;
+  }
+
   for (index_k = 0; index_k < pfo->k_size; index_k++){
 
     rk = pfo->k[index_k];
@@ -411,41 +750,6 @@ int halofit(
 
       /* in original halofit, this is the beginning of the function halofit() */
 
-      /*SPB11: Standard halofit underestimates the power on the smallest
-       * scales by a factor of two. Add an extra correction from the
-       * simulations in Bird, Viel,Haehnelt 2011 which partially accounts for
-       * this.*/
-      /*SPB14: This version of halofit is an updated version of the fit to the massive neutrinos
-       * based on the results of Takahashi 2012, (arXiv:1208.2701).
-       */
-      gam=0.1971-0.0843*rneff+0.8460*rncur;
-      a=1.5222+2.8553*rneff+2.3706*rneff*rneff+0.9903*rneff*rneff*rneff+ 0.2250*rneff*rneff*rneff*rneff-0.6038*rncur+0.1749*Omega_v*(1.+w);
-      a=pow(10,a);
-      b=pow(10, (-0.5642+0.5864*rneff+0.5716*rneff*rneff-1.5474*rncur+0.2279*Omega_v*(1.+w)));
-      c=pow(10, 0.3698+2.0404*rneff+0.8161*rneff*rneff+0.5869*rncur);
-      xmu=0.;
-      xnu=pow(10,5.2105+3.6902*rneff);
-      alpha=fabs(6.0835+1.3373*rneff-0.1959*rneff*rneff-5.5274*rncur);
-      beta=2.0379-0.7354*rneff+0.3157*pow(rneff,2)+1.2490*pow(rneff,3)+0.3980*pow(rneff,4)-0.1682*rncur + fnu*(1.081 + 0.395*pow(rneff,2));
-
-      if (fabs(1-Omega_m)>0.01) { /*then omega evolution */
-        f1a=pow(Omega_m,(-0.0732));
-        f2a=pow(Omega_m,(-0.1423));
-        f3a=pow(Omega_m,(0.0725));
-        f1b=pow(Omega_m,(-0.0307));
-        f2b=pow(Omega_m,(-0.0585));
-        f3b=pow(Omega_m,(0.0743));
-        frac=Omega_v/(1.-Omega_m);
-        f1=frac*f1b + (1-frac)*f1a;
-        f2=frac*f2b + (1-frac)*f2a;
-        f3=frac*f3b + (1-frac)*f3a;
-      }
-      else {
-        f1=1.;
-        f2=1.;
-        f3=1.;
-      }
-
       y=(rk/rknl);
       pk_halo = a*pow(y,f1*3.)/(1.+b*pow(y,f2)+pow(f3*c*y,3.-gam));
       pk_halo=pk_halo/(1+xmu*pow(y,-1)+xnu*pow(y,-2))*(1+fnu*0.977);
@@ -468,8 +772,69 @@ int halofit(
     }
   }
 
-  free(pvecback);
-  free(integrand_array);
+  return _SUCCESS_;
+}
+
+/**
+ * Integral giving sigma(R)^2 for a Gaussian window, used in the
+ * bisection of halofit(). When the workspace contains a table
+ * computed with FFTLog, it is interpolated, except within one decade
+ * of the edges of the table (i.e. for R close to 1/k_max or 1/k_min),
+ * where the transform is less accurate and halofit_integrate() is
+ * called instead.
+ *
+ * @param pfo        Input: pointer to non linear structure
+ * @param phw        Input: pointer to halofit workspace, with P_L(k) in integrand_array
+ * @param R          Input: radius
+ * @param last_index Input/Output: index for faster successive interpolations
+ * @param sum        Output: result of the integral
+ * @return the error status
+ */
+
+int halofit_sigma_squared(
+                          struct fourier *pfo,
+                          struct halofit_workspace *phw,
+                          double R,
+                          int *last_index,
+                          double *sum
+                          ) {
+
+  double *lnR = phw->sum_fftlog;
+
+  if ((phw->pfp != NULL) &&
+      (log(R) > lnR[0]+log(10.)) &&
+      (log(R) < lnR[phw->integrand_size-1]-log(10.))) {
+
+    class_call(array_interpolate_spline(lnR,
+                                        phw->integrand_size,
+                                        phw->sum_fftlog+phw->integrand_size,
+                                        phw->sum_fftlog+2*phw->integrand_size,
+                                        1,
+                                        log(R),
+                                        last_index,
+                                        sum,
+                                        1,
+                                        pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+  }
+  else {
+
+    class_call(halofit_integrate(pfo,
+                                 phw->integrand_array,
+                                 phw->integrand_size,
+                                 phw->ia_size,
+                                 phw->index_ia_k,
+                                 phw->index_ia_pk,
+                                 phw->index_ia_sum,
+                                 phw->index_ia_ddsum,
+                                 R,
+                                 halofit_integral_one,
+                                 sum),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   return _SUCCESS_;
 }
 
@@ -548,3 +913,182 @@ int halofit_integrate(
 
   return _SUCCESS_;
 }
+
+/**
+ * Same integral as halofit_integrate() for halofit_integral_one,
+ * i.e. sigma(R)^2 for a Gaussian window, but for all values of R on
+ * the logarithmic grid R_j = 1/k_(n-1-j) at once, with one FFTLog
+ * transform (see tools/fftlog.c), and splined along ln(R).
+ *
+ * @param pfo             Input: pointer to non linear structure
+ * @param pfp             Input: pointer to FFTLog plan from halofit_fftlog_init()
+ * @param integrand_array Input: array with k, P_L(k) values
+ * @param integrand_size  Input: one dimension of that array
+ * @param ia_size         Input: other dimension of that array
+ * @param index_ia_k      Input: index for k
+ * @param index_ia_pk     Input: index for pk
+ * @param lnR             Output: array of ln(R_j), of size integrand_size
+ * @param sum             Output: array of results of the integral at R_j
+ * @param ddsum           Output: array of their second derivatives along ln(R)
+ * @return the error status
+ */
+
+int halofit_integrate_fftlog(
+                             struct fourier *pfo,
+                             struct fftlog_plan *pfp,
+                             double *integrand_array,
+                             int integrand_size,
+                             int ia_size,
+                             int index_ia_k,
+                             int index_ia_pk,
+                             double *lnR,
+                             double *sum,
+                             double *ddsum
+                             ) {
+
+  double k;
+  double *integrand;
+  int index_k;
+  double anorm = 1./(2*pow(_PI_,2));
+
+  class_test(pfp->n != integrand_size,
+             pfo->error_message,
+             "FFTLog plan for %d wavenumbers used for %d wavenumbers",pfp->n,integrand_size);
+
+  class_alloc(integrand,integrand_size*sizeof(double),pfo->error_message);
+
+  for (index_k=0; index_k < integrand_size; index_k++) {
+    k = integrand_array[index_k*ia_size + index_ia_k];
+    integrand[index_k] = integrand_array[index_k*ia_size + index_ia_pk]*k*k*k*anorm;
+  }
+
+  class_call(fftlog_execute(pfp,
+                            integrand,
+                            log(integrand_array[index_ia_k]),
+                            lnR,
+                            sum,
+                            pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  class_call(array_spline_table_columns(lnR,
+                                        integrand_size,
+                                        sum,
+                                        1,
+                                        ddsum,
+                                        _SPLINE_EST_DERIV_,
+                                        pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  free(integrand);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Prepare the FFTLog transform used by halofit(). It depends only on
+ * the grid of wavenumbers, so it is computed once for all times.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pfo Input: pointer to non linear structure
+ * @param pfp Output: pointer to plan
+ * @return the error status
+ */
+
+int halofit_fftlog_init(
+                        struct precision *ppr,
+                        struct fourier *pfo,
+                        struct fftlog_plan *pfp
+                        ) {
+
+  int integrand_size;
+
+  /* same grid as in halofit() */
+  integrand_size=(int)(log(pfo->k[pfo->k_size-1]/pfo->k[0])/log(10.)*ppr->halofit_k_per_decade)+1;
+
+  class_call(fftlog_plan_init(pfp,
+                              integrand_size,
+                              log(10.)/ppr->halofit_k_per_decade,
+                              1.5,
+                              fftlog_gauss,
+                              pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Allocate the arrays of the halofit workspace
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pfo Input: pointer to non linear structure
+ * @param pfp Input: FFTLog plan from halofit_fftlog_init(), or NULL for the direct quadrature at each R
+ * @param phw Output: pointer to halofit workspace
+ * @return the error status
+ */
+
+int halofit_workspace_init(
+                           struct precision *ppr,
+                           struct background *pba,
+                           struct fourier *pfo,
+                           struct fftlog_plan *pfp,
+                           struct halofit_workspace *phw
+                           ) {
+
+  int index_ia;
+
+  /*      Until the 17.02.2015 the values of k used for integrating sigma(R) quantities needed by Halofit where the same as in the perturbation module.
+          Since then, we sample these integrals on more values, in order to get more precise integrals (thanks Matteo Zennaro for noticing the need for this).
+
+          We create a temporary integrand_array which columns will be:
+          - k in 1/Mpc
+          - just linear P(k) in Mpc**3
+          - 1/(2(pi**2)) P(k) k**2 exp(-(kR)**2) or 1/(2(pi**2)) P(k) k**2 2 (kR) exp(-(kR)**2) or 1/(2(pi**2)) P(k) k**2 4 (kR)(1-kR) exp(-(kR)**2)
+          - second derivative of previous line with spline
+  */
+
+  index_ia=0;
+  class_define_index(phw->index_ia_k,     _TRUE_,index_ia,1);
+  class_define_index(phw->index_ia_pk,    _TRUE_,index_ia,1);
+  class_define_index(phw->index_ia_sum,   _TRUE_,index_ia,1);
+  class_define_index(phw->index_ia_ddsum, _TRUE_,index_ia,1);
+  phw->ia_size = index_ia;
+
+  phw->integrand_size=(int)(log(pfo->k[pfo->k_size-1]/pfo->k[0])/log(10.)*ppr->halofit_k_per_decade)+1;
+
+  class_alloc(phw->integrand_array,phw->integrand_size*phw->ia_size*sizeof(double),pfo->error_message);
+
+  class_alloc(phw->pvecback,pba->bg_size*sizeof(double),pfo->error_message);
+
+  phw->pfp = pfp;
+
+  if (pfp != NULL) {
+    class_alloc(phw->sum_fftlog,3*phw->integrand_size*sizeof(double),pfo->error_message);
+  }
+  else {
+    phw->sum_fftlog = NULL;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the arrays of the halofit workspace
+ *
+ * @param phw Input: pointer to halofit workspace
+ * @return the error status
+ */
+
+int halofit_workspace_free(
+                           struct halofit_workspace *phw
+                           ) {
+
+  free(phw->integrand_array);
+  free(phw->pvecback);
+  free(phw->sum_fftlog);
+
+  return _SUCCESS_;
+}
@@ -1,12 +1,38 @@
 /** @file halofit.h Documented includes for halofit module */
 
 #include "primordial.h"
+#include "fftlog.h"
 
 #ifndef __HALOFIT__
 #define __HALOFIT__
 
 enum halofit_integral_type {halofit_integral_one, halofit_integral_two, halofit_integral_three};
 
+#define _HALOFIT_TAU_BLOCK_ 8 /**< number of consecutive times computed in sequence by one task of halofit_at_all_tau(); it is fixed, such that results do not depend on the number of threads */
+#define _HALOFIT_GUESS_DLOGR_ 0.003 /**< initial width, in log10(R), of the bracket next to a guess for R_nl in halofit() */
+
+/**
+ * Arrays needed by halofit() at each time, allocated once for a
+ * sequence of times
+ */
+
+struct halofit_workspace {
+
+  int integrand_size; /**< number of values of k in the integrals over P_L(k) */
+  int ia_size;        /**< number of columns of integrand_array */
+  int index_ia_k;     /**< column of k */
+  int index_ia_pk;    /**< column of P_L(k) */
+  int index_ia_sum;   /**< column of the integrand of halofit_integrate() */
+  int index_ia_ddsum; /**< column of its second derivative */
+
+  double * integrand_array; /**< k, P_L(k), integrand and its second derivative, at each k */
+  double * pvecback;        /**< background quantities */
+
+  struct fftlog_plan * pfp; /**< FFTLog plan from halofit_fftlog_init(), shared by all workspaces, or NULL for the direct quadrature at each R */
+  double * sum_fftlog;      /**< with FFTLog: ln(R), the integral giving sigma(R)^2 and its spline, for all R */
+
+};
+
 /********************************************************************************/
 
 /* @cond INCLUDE_WITH_DOXYGEN */
@@ -17,6 +43,33 @@ enum halofit_integral_type {halofit_integral_one, halofit_integral_two, halofit_
 extern "C" {
 #endif
 
+  int halofit_at_all_tau(
+                         struct precision *ppr,
+                         struct background *pba,
+                         struct perturbations *ppt,
+                         struct primordial *ppm,
+                         struct fourier *pfo,
+                         int index_tau_min,
+                         double **pk_nl,
+                         short *nl_corr_not_computable,
+                         struct fftlog_plan *pfp
+                         );
+
+  int halofit_at_tau_list(
+                          struct precision *ppr,
+                          struct background *pba,
+                          struct perturbations *ppt,
+                          struct primordial *ppm,
+                          struct fourier *pfo,
+                          int tau_size,
+                          double *tau,
+                          double **lnpk_l,
+                          double **pk_nl,
+                          double **k_nl,
+                          short *nl_corr_not_computable,
+                          struct fftlog_plan *pfp
+                          );
+
   int halofit(
               struct precision *ppr,
               struct background *pba,
@@ -28,10 +81,20 @@ extern "C" {
               double *pk_nl,
               double *lnpk_l,
               double *ddlnpk_l,
+              double k_nl_guess,
               double *k_nl,
-              short *nl_corr_not_computable_at_this_k
+              short *nl_corr_not_computable_at_this_k,
+              struct halofit_workspace *phw
               );
 
+  int halofit_sigma_squared(
+                            struct fourier *pfo,
+                            struct halofit_workspace *phw,
+                            double R,
+                            int *last_index,
+                            double *sum
+                            );
+
   int halofit_integrate(
                         struct fourier *pfo,
                         double *integrand_array,
@@ -46,6 +109,37 @@ extern "C" {
                         double *sum
                         );
 
+  int halofit_integrate_fftlog(
+                               struct fourier *pfo,
+                               struct fftlog_plan *pfp,
+                               double *integrand_array,
+                               int integrand_size,
+                               int ia_size,
+                               int index_ia_k,
+                               int index_ia_pk,
+                               double *lnR,
+                               double *sum,
+                               double *ddsum
+                               );
+
+  int halofit_fftlog_init(
+                          struct precision *ppr,
+                          struct fourier *pfo,
+                          struct fftlog_plan *pfp
+                          );
+
+  int halofit_workspace_init(
+                             struct precision *ppr,
+                             struct background *pba,
+                             struct fourier *pfo,
+                             struct fftlog_plan *pfp,
+                             struct halofit_workspace *phw
+                             );
+
+  int halofit_workspace_free(
+                             struct halofit_workspace *phw
+                             );
+
 #ifdef __cplusplus
 }
 #endif
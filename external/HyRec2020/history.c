@@ -37,6 +37,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include "history.h"
 #include "helium.h"
@@ -922,6 +923,86 @@ char* rec_build_history(HYREC_DATA *data, int model, double *hubble_array){
 }
 
 
+/***********************************************************
+Atomic and fit tables read from the files in path_to_hyrec.
+They do not depend on the cosmology and are never modified
+after being read, so they are read only once per process
+for each path, and then shared by all HYREC_DATA structures
+(also from several threads). They are kept until the end of
+the process. A failed read is freed and not kept, so that
+its error is reported again at the next attempt.
+***********************************************************/
+
+typedef struct HYREC_TABLES {
+  char *path_to_hyrec;
+  HYREC_ATOMIC *atomic;
+  FIT_FUNC *fit;
+  struct HYREC_TABLES *next;
+} HYREC_TABLES;
+
+static HYREC_TABLES *hyrec_tables = NULL;
+static pthread_mutex_t hyrec_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Free tables whose read has failed, including the arrays already
+   allocated or read */
+static void hyrec_free_tables(HYREC_ATOMIC *atomic, FIT_FUNC *fit) {
+  unsigned l;
+
+  if (atomic != NULL) {
+    for (l = 0; l <= 3; l++) {
+      if (atomic->logAlpha_tab[l] != NULL) free_2D_array(atomic->logAlpha_tab[l], NTM);
+    }
+    free(atomic);
+  }
+  if (fit != NULL) {
+    free_fit(fit);
+    free(fit);
+  }
+}
+
+void hyrec_get_tables(HYREC_DATA *data) {
+  HYREC_TABLES *tables;
+
+  pthread_mutex_lock(&hyrec_tables_mutex);
+
+  for (tables = hyrec_tables; tables != NULL; tables = tables->next) {
+    if (strcmp(tables->path_to_hyrec, data->path_to_hyrec) == 0) break;
+  }
+
+  if (tables == NULL) {
+    /* calloc, such that the arrays not yet allocated when a read fails are NULL */
+    data->atomic = (HYREC_ATOMIC *) calloc(1, sizeof(HYREC_ATOMIC));
+    data->fit = NULL;
+    allocate_and_read_atomic(data->atomic, &data->error, data->path_to_hyrec, data->error_message);
+
+    if (data->error == 0) {
+      data->fit = (FIT_FUNC *) calloc(1, sizeof(FIT_FUNC));
+      allocate_and_read_fit(data->fit, &data->error, data->path_to_hyrec, data->error_message);
+    }
+
+    if (data->error != 0) {
+      hyrec_free_tables(data->atomic, data->fit);
+      data->atomic = NULL;
+      data->fit = NULL;
+    }
+    else {
+      tables = (HYREC_TABLES *) malloc(sizeof(HYREC_TABLES));
+      tables->path_to_hyrec = malloc(strlen(data->path_to_hyrec)+1);
+      strcpy(tables->path_to_hyrec, data->path_to_hyrec);
+      tables->atomic = data->atomic;
+      tables->fit = data->fit;
+      tables->next = hyrec_tables;
+      hyrec_tables = tables;
+    }
+  }
+  else {
+    data->atomic = tables->atomic;
+    data->fit = tables->fit;
+  }
+
+  pthread_mutex_unlock(&hyrec_tables_mutex);
+}
+
 /***********************************************************
 Function to allocate and initialize HYREC-2 internal tables
 Note that path_to_hyrec in HYREC_DATA should be defined first
@@ -940,11 +1021,8 @@ void hyrec_allocate(HYREC_DATA *data, double zmax, double zmin) {
   data->zmax = (zmax > 3000.? zmax : 3000.);
   data->zmin = zmin;
 
-  data->atomic = (HYREC_ATOMIC *) malloc(sizeof(HYREC_ATOMIC));
-  allocate_and_read_atomic(data->atomic, &data->error, data->path_to_hyrec, data->error_message);
-
-  data->fit = (FIT_FUNC *) malloc(sizeof(FIT_FUNC));
-  allocate_and_read_fit(data->fit, &data->error, data->path_to_hyrec, data->error_message);
+  /* shared atomic and fit tables, read only at the first call for this path */
+  hyrec_get_tables(data);
 
   data->cosmo  = (REC_COSMOPARAMS *) malloc(sizeof(REC_COSMOPARAMS));
   data->cosmo->inj_params = (INJ_PARAMS *)  malloc(sizeof(INJ_PARAMS));
@@ -962,18 +1040,15 @@ void hyrec_allocate(HYREC_DATA *data, double zmax, double zmin) {
 }
 
 
+/* (the atomic and fit tables are shared, see hyrec_get_tables()) */
 void hyrec_free(HYREC_DATA *data) {
-  free_atomic(data->atomic);
   free(data->cosmo->inj_params);
   free(data->cosmo);
-  free(data->atomic);
   free(data->xe_output);
   free(data->Tm_output);
   free(data->error_message);
   if (MODEL == FULL) free_radiation(data->rad);
   free(data->rad);
-  free_fit(data->fit);
-  free(data->fit);
 }
 
 /******************************************************************
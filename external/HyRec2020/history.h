@@ -61,6 +61,7 @@ void rec_get_xe_next2_HTm(HYREC_DATA *data, int model, double z_in, long iz, dou
 
 char* rec_build_history(HYREC_DATA *data, int model, double *hubble_array);
 
+void hyrec_get_tables(HYREC_DATA *data);
 void hyrec_allocate(HYREC_DATA *data, double zmax, double zmin);
 void hyrec_free(HYREC_DATA *data);
 void hyrec_compute(HYREC_DATA *data, int model);
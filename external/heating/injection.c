@@ -8,6 +8,12 @@
  */
 #include "injection.h"
 #include "thermodynamics.h"
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* tables of the external files read by injection_get_file_table(), shared by all the runs */
+static struct injection_file_table * injection_file_tables = NULL;
+static pthread_mutex_t injection_file_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * Initialize injection structure.
@@ -100,8 +106,9 @@ int injection_init(struct precision * ppr,
   /** - Initialize injection efficiency */
   /* Read from external file, if needed */
   if(pin->f_eff_type == f_eff_from_file){
-    class_call(injection_read_feff_from_file(ppr,pin,
-                                             pin->f_eff_file),
+    class_call(injection_get_file_table(ppr,pin,
+                                        pin->f_eff_file,
+                                        injection_file_f_eff),
                pin->error_message,
                pin->error_message);
   }
@@ -114,20 +121,23 @@ int injection_init(struct precision * ppr,
 
   /* Read from external file, if needed */
   if(pin->chi_type == chi_Galli_file){
-    class_call(injection_read_chi_x_from_file(ppr,pin,
-                                              ppr->chi_z_Galli),
+    class_call(injection_get_file_table(ppr,pin,
+                                        ppr->chi_z_Galli,
+                                        injection_file_chi_x),
                pin->error_message,
                pin->error_message);
   }
   else if(pin->chi_type == chi_from_x_file){
-    class_call(injection_read_chi_x_from_file(ppr,pin,
-                                              pin->chi_x_file),
+    class_call(injection_get_file_table(ppr,pin,
+                                        pin->chi_x_file,
+                                        injection_file_chi_x),
                pin->error_message,
                pin->error_message);
   }
   else if(pin->chi_type == chi_from_z_file){
-    class_call(injection_read_chi_z_from_file(ppr,pin,
-                                              pin->chi_z_file),
+    class_call(injection_get_file_table(ppr,pin,
+                                        pin->chi_z_file,
+                                        injection_file_chi_z),
                pin->error_message,
                pin->error_message);
   }
@@ -765,7 +775,7 @@ int injection_rate_PBH_evaporation_mass_evolution(struct background * pba,
 
   /** - Define local variables */
   double * pvecback_loop;
-  int last_index_back_loop;
+  int last_index_back_loop = 0;
   int i_step;
   double current_mass, current_pbh_temperature;
   double f_EM, f_nu, f_q, f_pi, f_bos, f;
@@ -842,7 +852,7 @@ int injection_rate_PBH_evaporation_mass_evolution(struct background * pba,
     class_call(background_at_z(pba,
                                loop_z,
                                long_info,
-                               inter_normal,
+                               inter_closeby,
                                &last_index_back_loop,
                                pvecback_loop),
                pba->error_message,
@@ -1122,6 +1132,131 @@ int injection_rate_PBH_accretion(struct injection * pin,
 }
 
 
+/**
+ * Give to the injection structure the splined table of an external
+ * file (f_eff(z), chi(x) or chi(z), depending on type), as
+ * pin->feff_table, pin->chix_table or pin->chiz_table. The file is
+ * read and splined only the first time it is needed in the process (or
+ * when it has changed on disk since); the next runs get a copy of the
+ * same table.
+ *
+ * @param ppr       Input: pointer to precision structure
+ * @param pin       Input/Output: pointer to injection structure
+ * @param file_name Input: full path of the file
+ * @param type      Input: kind of table contained in the file
+ * @return the error status
+ */
+int injection_get_file_table(struct precision* ppr,
+                             struct injection* pin,
+                             char* file_name,
+                             enum injection_file_type type){
+
+  /** - Define local variables */
+  struct injection_file_table * pift;
+  struct stat file_stat;
+  int * size;
+  double ** table;
+  int columns;
+
+  /** - Find where this kind of table is stored in the injection structure */
+  switch (type) {
+  case injection_file_f_eff:
+    size = &(pin->feff_z_size);
+    table = &(pin->feff_table);
+    columns = 3;
+    break;
+  case injection_file_chi_x:
+    size = &(pin->chix_size);
+    table = &(pin->chix_table);
+    columns = 2*pin->dep_size+1;
+    break;
+  case injection_file_chi_z:
+    size = &(pin->chiz_size);
+    table = &(pin->chiz_table);
+    columns = 2*pin->dep_size+1;
+    break;
+  default:
+    class_stop(pin->error_message,
+               "unknown type of injection file table");
+  }
+
+  class_test(stat(file_name,&file_stat) != 0,
+             pin->error_message,
+             "could not open %s",file_name);
+
+  pthread_mutex_lock(&injection_file_tables_mutex);
+
+  /** - Look for a table read from the same (unchanged) file */
+  for (pift=injection_file_tables; pift!=NULL; pift=pift->next) {
+    if ((pift->type == type) &&
+        (pift->columns == columns) &&
+        (strcmp(pift->file_name,file_name) == 0) &&
+        (pift->file_size == (long long)file_stat.st_size) &&
+        (pift->file_mtime == (long long)file_stat.st_mtime)) {
+
+      *table = (double *)malloc(pift->size*pift->columns*sizeof(double));
+      class_test_except(*table == NULL,
+                        pin->error_message,
+                        pthread_mutex_unlock(&injection_file_tables_mutex),
+                        "could not allocate the table of %s",file_name);
+      memcpy(*table,pift->table,pift->size*pift->columns*sizeof(double));
+      *size = pift->size;
+
+      pthread_mutex_unlock(&injection_file_tables_mutex);
+      return _SUCCESS_;
+    }
+  }
+
+  /** - Otherwise, read and spline the file, and keep a copy of the result */
+  if (type == injection_file_f_eff) {
+    class_call_except(injection_read_feff_from_file(ppr,pin,file_name),
+                      pin->error_message,
+                      pin->error_message,
+                      pthread_mutex_unlock(&injection_file_tables_mutex));
+  }
+  else if (type == injection_file_chi_x) {
+    class_call_except(injection_read_chi_x_from_file(ppr,pin,file_name),
+                      pin->error_message,
+                      pin->error_message,
+                      pthread_mutex_unlock(&injection_file_tables_mutex));
+  }
+  else {
+    class_call_except(injection_read_chi_z_from_file(ppr,pin,file_name),
+                      pin->error_message,
+                      pin->error_message,
+                      pthread_mutex_unlock(&injection_file_tables_mutex));
+  }
+
+  pift = (struct injection_file_table *)calloc(1,sizeof(struct injection_file_table));
+  class_test_except(pift == NULL,
+                    pin->error_message,
+                    pthread_mutex_unlock(&injection_file_tables_mutex),
+                    "could not allocate the table of %s",file_name);
+
+  pift->table = (double *)malloc((*size)*columns*sizeof(double));
+  class_test_except(pift->table == NULL,
+                    pin->error_message,
+                    free(pift);pthread_mutex_unlock(&injection_file_tables_mutex),
+                    "could not allocate the table of %s",file_name);
+
+  class_sprintf(pift->file_name,"%s",file_name);
+  pift->type = type;
+  pift->file_size = (long long)file_stat.st_size;
+  pift->file_mtime = (long long)file_stat.st_mtime;
+  pift->size = *size;
+  pift->columns = columns;
+  memcpy(pift->table,*table,(*size)*columns*sizeof(double));
+
+  /* the tables are never freed, since other runs may be using them */
+  pift->next = injection_file_tables;
+  injection_file_tables = pift;
+
+  pthread_mutex_unlock(&injection_file_tables_mutex);
+
+  return _SUCCESS_;
+}
+
+
 /**
  * Read and interpolate the deposition function from external file.
  *
@@ -9,6 +9,7 @@
 enum PBH_accretion_approx {spherical_accretion, disk_accretion};
 enum f_eff_approx {f_eff_on_the_spot, f_eff_from_file};
 enum chi_approx {chi_CK, chi_PF, chi_Galli_file, chi_Galli_analytic, chi_full_heating, chi_from_x_file, chi_from_z_file};
+enum injection_file_type {injection_file_f_eff, injection_file_chi_x, injection_file_chi_z};
 
 struct injection{
 
@@ -179,7 +180,23 @@ struct injection{
   //@}
 };
 
+/**
+ * Splined content of one of the external files of the injection module
+ * (f_eff(z), chi(x) or chi(z)). These tables do not depend on cosmology:
+ * each file is read once per process, and a copy of the table is given
+ * to each run (see injection_get_file_table()).
+ */
 
+struct injection_file_table {
+  FileName file_name;                  /**< full path of the file */
+  enum injection_file_type type;       /**< which kind of table was read from the file */
+  long long file_size;                 /**< size of the file when it was read */
+  long long file_mtime;                /**< modification time of the file when it was read */
+  int size;                            /**< number of lines of the table */
+  int columns;                         /**< number of columns of the table (values and second derivatives) */
+  double * table;                      /**< table[index_line*columns+index_column], as feff_table, chix_table or chiz_table */
+  struct injection_file_table * next;  /**< next table read by the process */
+};
 
 
 /**************************************************************/
@@ -240,6 +257,12 @@ extern "C" {
                                    double z,
                                    double * energy_rate);
 
+  /* Tables read from external files */
+  int injection_get_file_table(struct precision* ppr,
+                               struct injection* phe,
+                               char* file_name,
+                               enum injection_file_type type);
+
   /* Injection efficiency */
   int injection_read_feff_from_file(struct precision* ppr,
                                      struct injection* phe,
@@ -8,6 +8,7 @@
  */
 #include "primordial.h"
 #include "noninjection.h"
+#include "parallel.h"
 
 /**
  * Initialize the noninjection structure.
@@ -31,10 +32,9 @@ int noninjection_init(struct precision* ppr,
 
   /** - Define local variables */
   int index_k,index_z;
-  int last_index_back, last_index_thermo, last_index_coarse = 0;
-  double *pvecback, *pvecthermo;
-  double R, dkappa;
-  double dEdt;
+  int last_index_back, last_index_coarse = 0;
+  double *pvecback;
+  double *pvecback_table, *pvecthermo_table;
   double z_wkb;
   double h,a,b;
   double temp_injection;
@@ -112,19 +112,11 @@ int noninjection_init(struct precision* ppr,
              pni->error_message,
              pni->error_message);
 
-  class_alloc(pni->integrand_approx,
-              pni->k_size*sizeof(double),
-              pni->error_message);
-
-  /** - Allocate backgorund and thermodynamcis vectors */
+  /** - Allocate background vector */
   last_index_back = 0;
-  last_index_thermo = 0;
   class_alloc(pvecback,
               pba->bg_size*sizeof(double),
               pni->error_message);
-  class_alloc(pvecthermo,
-              pth->tt_size*sizeof(double),
-              pni->error_message);
 
   /** - Calculate WKB approximation ampltidue factor f_nu at early times */
   z_wkb = ppr->z_wkb_acc_diss;
@@ -151,64 +143,60 @@ int noninjection_init(struct precision* ppr,
   pni->fHe = pth->fHe;                                                                              // [-]
   pni->N_e0 = pth->n_e;                                                                             // [1/m^3]
 
-  /** - Loop over z and calculate the heating at each point */
-  dEdt = 0.;
-  for(index_z=0; index_z<pni->z_size_coarse; ++index_z){
-
-    z_coarse = pni->z_table_coarse[index_z];
-    pni->noninjection_table[index_z] = 0.;
+  /** - Import quantities from background and thermodynamics structure at each z of the coarse table */
+  class_alloc(pvecback_table,
+              pni->z_size_coarse*pba->bg_size*sizeof(double),
+              pni->error_message);
+  class_alloc(pvecthermo_table,
+              pni->z_size_coarse*pth->th_size*sizeof(double),
+              pni->error_message);
 
-    /* Import quantities from background and thermodynamics structure */
+  for(index_z=0; index_z<pni->z_size_coarse; ++index_z){
     class_call(background_at_z(pba,
-                               z_coarse,
+                               pni->z_table_coarse[index_z],
                                long_info,
                                inter_closeby,
                                &last_index_back,
-                               pvecback),
+                               pvecback_table+index_z*pba->bg_size),
                pba->error_message,
                pni->error_message);
+  }
 
-    pni->H = pvecback[pba->index_bg_H]*_c_/_Mpc_over_m_;                                            // [1/s]
-    pni->a = pvecback[pba->index_bg_a];                                                             // [-]
-    pni->rho_g = pvecback[pba->index_bg_rho_g]*_Jm3_over_Mpc2_;                                     // [J/m^3]
-    R = (3./4.)*pvecback[pba->index_bg_rho_b]/pvecback[pba->index_bg_rho_g];                        // [-]
-    pni->nH = pni->N_e0*pow(pni->a,-3);
-
-    class_call(thermodynamics_at_z(pba,
-                                   pth,
-                                   z_coarse,
-                                   inter_normal,
-                                   &last_index_thermo,
-                                   pvecback,
-                                   pvecthermo),
-               pth->error_message,
-               pni->error_message);
+  class_call(thermodynamics_at_z_array(pba,
+                                       pth,
+                                       pni->z_table_coarse,
+                                       pni->z_size_coarse,
+                                       pvecback_table,
+                                       pba->bg_size,
+                                       pvecthermo_table),
+             pth->error_message,
+             pni->error_message);
 
-    dkappa = pvecthermo[pth->index_th_dkappa];                                                      // [1/Mpc]
-    pni->dkD_dz = 1./(pvecback[pba->index_bg_H]*dkappa)*(16./15.+pow(R,2.)/(1.+R))/(6.*(1.0+R));    // [Mpc^2]
-    pni->kD = 2.*_PI_/pvecthermo[pth->index_th_r_d];                                                // [1/Mpc]
-    pni->T_b = pvecthermo[pth->index_th_Tb];                                                        // [K]
-    pni->T_g = pni->T_g0/pni->a;                                                                    // [K]
-    pni->x_e = pvecthermo[pth->index_th_xe];                                                        // [-]
-    pni->heat_capacity = (3./2.)*_k_B_*pni->nH*(1.+pni->fHe+pni->x_e);                              // [J/(K m^3)]
+  /** - Loop over z and calculate the heating at each point, by blocks of
+      _NONINJECTION_Z_PER_TASK_ values of z running in parallel */
+  class_setup_parallel();
+
+  for(index_z=0; index_z<pni->z_size_coarse; index_z+=_NONINJECTION_Z_PER_TASK_){
+
+    class_run_parallel(with_arguments(pba,pth,pni,pvecback_table,pvecthermo_table,index_z),
+
+      class_call(noninjection_heating_at_coarse_z(pba,
+                                                  pth,
+                                                  pni,
+                                                  pvecback_table,
+                                                  pvecthermo_table,
+                                                  index_z,
+                                                  MIN(index_z+_NONINJECTION_Z_PER_TASK_,pni->z_size_coarse)),
+                 pni->error_message,
+                 pni->error_message);
+      return _SUCCESS_;
+    );
+  }
 
-    /* Include all non-injected energy that does not need to be deposited (i.e. adiabatic terms as below) */
-    /* First order cooling of photons due to adiabatic interaction with baryons */
-    class_call(noninjection_rate_adiabatic_cooling(pni,
-                                                   z_coarse,
-                                                   &dEdt),
-               pni->error_message,
-               pni->error_message);
-    pni->noninjection_table[index_z]+=dEdt;
+  class_finish_parallel();
 
-    /* Second order acoustic dissipation of BAO */
-    class_call(noninjection_rate_acoustic_diss(pni,
-                                               z_coarse,
-                                               &dEdt),
-               pni->error_message,
-               pni->error_message);
-    pni->noninjection_table[index_z]+=dEdt;
-  }
+  free(pvecback_table);
+  free(pvecthermo_table);
 
   /** - Spline coarse z table in view of interpolation */
   class_call(array_spline_table_columns2(pni->z_table_coarse,
@@ -242,7 +230,81 @@ int noninjection_init(struct precision* ppr,
 
   /** - Free temporary variables */
   free(pvecback);
-  free(pvecthermo);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Calculate the heating at the values z_table_coarse[index_z] of the
+ * coarse z table, for index_z_min <= index_z < index_z_max. Each call
+ * has its own copy of the temporary quantities of the noninjection
+ * structure, so that several blocks can run in parallel.
+ *
+ * @param pba              Input: pointer to background structure
+ * @param pth              Input: pointer to thermodynamics structure
+ * @param pni              Input/Output: pointer to noninjection structure
+ * @param pvecback_table   Input: background quantities at each z of the coarse table
+ * @param pvecthermo_table Input: thermodynamics quantities at each z of the coarse table
+ * @param index_z_min      Input: first index in the coarse z table
+ * @param index_z_max      Input: last index in the coarse z table plus one
+ * @return the error status
+ */
+int noninjection_heating_at_coarse_z(struct background* pba,
+                                     struct thermodynamics* pth,
+                                     struct noninjection* pni,
+                                     double * pvecback_table,
+                                     double * pvecthermo_table,
+                                     int index_z_min,
+                                     int index_z_max){
+
+  /** Define local variables */
+  struct noninjection ni = *pni;
+  int index_z;
+  double *pvecback, *pvecthermo;
+  double R, dkappa;
+  double dEdt;
+  double z_coarse;
+
+  for(index_z=index_z_min; index_z<index_z_max; ++index_z){
+
+    z_coarse = pni->z_table_coarse[index_z];
+    pni->noninjection_table[index_z] = 0.;
+
+    /* Quantities from background and thermodynamics structure */
+    pvecback = pvecback_table+index_z*pba->bg_size;
+    pvecthermo = pvecthermo_table+index_z*pth->th_size;
+
+    ni.H = pvecback[pba->index_bg_H]*_c_/_Mpc_over_m_;                                              // [1/s]
+    ni.a = pvecback[pba->index_bg_a];                                                               // [-]
+    ni.rho_g = pvecback[pba->index_bg_rho_g]*_Jm3_over_Mpc2_;                                       // [J/m^3]
+    R = (3./4.)*pvecback[pba->index_bg_rho_b]/pvecback[pba->index_bg_rho_g];                        // [-]
+    ni.nH = ni.N_e0*pow(ni.a,-3);
+
+    dkappa = pvecthermo[pth->index_th_dkappa];                                                      // [1/Mpc]
+    ni.dkD_dz = 1./(pvecback[pba->index_bg_H]*dkappa)*(16./15.+pow(R,2.)/(1.+R))/(6.*(1.0+R));      // [Mpc^2]
+    ni.kD = 2.*_PI_/pvecthermo[pth->index_th_r_d];                                                  // [1/Mpc]
+    ni.T_b = pvecthermo[pth->index_th_Tb];                                                          // [K]
+    ni.T_g = ni.T_g0/ni.a;                                                                          // [K]
+    ni.x_e = pvecthermo[pth->index_th_xe];                                                          // [-]
+    ni.heat_capacity = (3./2.)*_k_B_*ni.nH*(1.+ni.fHe+ni.x_e);                                      // [J/(K m^3)]
+
+    /* Include all non-injected energy that does not need to be deposited (i.e. adiabatic terms as below) */
+    /* First order cooling of photons due to adiabatic interaction with baryons */
+    class_call(noninjection_rate_adiabatic_cooling(&ni,
+                                                   z_coarse,
+                                                   &dEdt),
+               ni.error_message,
+               pni->error_message);
+    pni->noninjection_table[index_z]+=dEdt;
+
+    /* Second order acoustic dissipation of BAO */
+    class_call(noninjection_rate_acoustic_diss(&ni,
+                                               z_coarse,
+                                               &dEdt),
+               ni.error_message,
+               pni->error_message);
+    pni->noninjection_table[index_z]+=dEdt;
+  }
 
   return _SUCCESS_;
 }
@@ -266,8 +328,6 @@ int noninjection_free(struct noninjection* pni){
   free(pni->noninjection_table);
   free(pni->ddnoninjection_table);
 
-  free(pni->integrand_approx);
-
   return _SUCCESS_;
 }
 
@@ -338,6 +398,7 @@ int noninjection_rate_acoustic_diss(struct noninjection * pni,
   int index_k;
   double dQrho_dz;
   double A_wkb;
+  double damping;
 
   /** a) Calculate full function */
   // CURRENTLY NOT YET IMPLEMENTED
@@ -347,22 +408,21 @@ int noninjection_rate_acoustic_diss(struct noninjection * pni,
 
     A_wkb = 1./(1.+4./15.*pni->f_nu_wkb);
 
-    /* Define integrand for approximated function */
+    /* Integrate the approximated function with the trapezoidal
+       weights. The k are increasing: once the damping factor
+       exp(-2(k/kD)^2) underflows to zero, all the next terms vanish
+       too, so they are not computed. */
+    dQrho_dz = 0.;
     for (index_k=0; index_k<pni->k_size; index_k++) {
-      pni->integrand_approx[index_k] = 4.*A_wkb*A_wkb*pow(pni->k[index_k],1.)*
-                              pni->pk_primordial_k[index_k]*
-                              exp(-2.*pow(pni->k[index_k]/pni->kD,2.))*
-                              pni->dkD_dz;
+      damping = exp(-2.*pow(pni->k[index_k]/pni->kD,2.));
+      if (damping == 0.)
+        break;
+      dQrho_dz += 4.*A_wkb*A_wkb*pow(pni->k[index_k],1.)*
+        pni->pk_primordial_k[index_k]*
+        damping*
+        pni->dkD_dz*pni->k_weights[index_k];
     }
 
-    class_call(array_trapezoidal_integral(pni->integrand_approx,
-                                          pni->k_size,
-                                          pni->k_weights,
-                                          &dQrho_dz,
-                                          pni->error_message),
-               pni->error_message,
-               pni->error_message);
-
   }
 
   *energy_rate = dQrho_dz*pni->H*pni->rho_g/pni->a;                                                 // [J/(m^3 s)]
@@ -3,6 +3,8 @@
 
 #include "common.h" //Use here ONLY the things required for defining the struct (i.e. common.h for the ErrorMsg)
 
+#define _NONINJECTION_Z_PER_TASK_ 50 /**< number of redshifts of the coarse table computed by each parallel task */
+
 struct noninjection{
 
   /** @name - Imported parameters */
@@ -16,9 +18,6 @@ struct noninjection{
   double* k_weights;
   double* pk_primordial_k;
 
-  /* Array related to WKB approximation for diss. of acc. waves */
-  double* integrand_approx;
-
   /* Arrays related to redshift */
   double* z_table_coarse;
   int z_size_coarse;
@@ -91,6 +90,14 @@ extern "C" {
                         struct primordial* ppm,
                         struct noninjection* pni);
 
+  int noninjection_heating_at_coarse_z(struct background* pba,
+                                       struct thermodynamics* pth,
+                                       struct noninjection* pni,
+                                       double * pvecback_table,
+                                       double * pvecthermo_table,
+                                       int index_z_min,
+                                       int index_z_max);
+
   int noninjection_free(struct noninjection* pni);
 
   int noninjection_photon_heating_at_z(struct noninjection* pni,
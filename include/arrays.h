@@ -9,7 +9,9 @@
 
 #define _SPLINE_NATURAL_ 0 /**< natural spline: ddy0=ddyn=0 */
 #define _SPLINE_EST_DERIV_ 1 /**< spline with estimation of first derivative on both edges */
+#define _SPLINE_COLUMN_BLOCK_ 64 /**< number of columns splined together by one task in array_spline_table_lines2() and array_spline_table_columns2() */
 #define array_spline_eval(y,ddy,inf,sup,h,a,b) ((a)*(y)[inf]+(b)*(y)[sup] + (((a)*(a)*(a)-(a))* (ddy)[inf] + ((b)*(b)*(b)-(b))* (ddy)[sup])*(h)*(h)/6.)
+#define array_spline_eval_derivative(y,ddy,inf,sup,h,a,b) (((y)[sup]-(y)[inf])/(h) + ((3.*(b)*(b)-1.)* (ddy)[sup] - (3.*(a)*(a)-1.)* (ddy)[inf])*(h)/6.)
 
 /**
  * Boilerplate for C++
@@ -126,6 +128,16 @@ extern "C" {
 		       ErrorMsg errmsg
 		       );
 
+  int array_spline_table_lines2(
+		       double * x,
+		       int x_size,
+		       double * y_array,
+		       int y_size,
+		       double * ddy_array,
+		       short spline_mode,
+		       ErrorMsg errmsg
+		       );
+
   int array_logspline_table_lines(
 				  double * x,
 				  int x_size,
@@ -193,6 +205,13 @@ int array_integrate_all_trapzd_or_spline(
 		   double * result,
 		   ErrorMsg errmsg);
 
+  int array_integrate_all_trapzd_or_spline_weights(
+                                                   double * x,
+                                                   int n_lines,
+                                                   int index_start_spline,
+                                                   double * weights,
+                                                   ErrorMsg errmsg);
+
   int array_integrate_spline_table_line_to_line(
 						double * x_array,
 						int n_lines,
@@ -337,6 +356,35 @@ int array_integrate_all_trapzd_or_spline(
                         double* b,
                         ErrorMsg errmsg);
 
+  int array_spline_bisect(double * __restrict__ x_array,
+                          int x_size,
+                          double x,
+                          int * __restrict__ last,
+                          double * h,
+                          double * a,
+                          double * b,
+                          ErrorMsg errmsg);
+
+  int array_spline_closeby(double * __restrict__ x_array,
+                           int x_size,
+                           double x,
+                           int * __restrict__ last,
+                           double * h,
+                           double * a,
+                           double * b,
+                           ErrorMsg errmsg);
+
+  void array_spline_eval_columns(double * __restrict__ array,
+                                 double * __restrict__ array_splined,
+                                 int n_columns,
+                                 int inf,
+                                 double h,
+                                 double a,
+                                 double b,
+                                 int * __restrict__ columns,
+                                 double * __restrict__ result,
+                                 int result_size);
+
   int array_interpolate_two(
 			    double * array_x,
 			    int n_columns_x,
@@ -508,6 +556,12 @@ int array_integrate_all_trapzd_or_spline(
                             double sigma,
                             ErrorMsg errmsg);
 
+  int array_symmetric_eigen(
+                            double * matrix,
+                            int n,
+                            double * eigenvalues,
+                            ErrorMsg errmsg);
+
 #ifdef __cplusplus
 }
 #endif
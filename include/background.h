@@ -9,6 +9,7 @@
 #include "arrays.h"
 #include "dei_rkck.h"
 #include "parser.h"
+#include "data_files.h"
 
 /** list of possible parametrisations of the DE equation of state */
 
@@ -29,6 +30,46 @@ enum vecback_format {short_info, normal_info, long_info};
 
 enum interpolation_method {inter_normal, inter_closeby};
 
+#define _MAX_BACKGROUND_BREAKPOINTS_ 8 /**< maximum number of values of log(a) at which the background densities are not smooth, see background_breakpoints() */
+
+/**
+ * Constants of the unimodular-gravity (UG) energy transfer that do
+ * not depend on the scale factor. They are filled once by
+ * background_UG_constants(), so that background_functions() only
+ * evaluates the a-dependent part of the UG densities.
+ */
+
+struct background_UG_cache {
+
+  double rho_b0;        /**< \f$ \rho_{b,0} \f$ in class units */
+  double rho_dm0;       /**< \f$ \rho_{cdm,0} \f$ in class units */
+  double rho_lambda;    /**< \f$ \rho_{\Lambda,0} \f$ in class units */
+  double Delta_rho;     /**< Delta_rho_Lambda converted to class units */
+  double a_start;       /**< scale factor at the centre of the transition */
+  double delta;         /**< width of the transition */
+  double f_b;           /**< baryon fraction of the matter absorbing the transfer, \f$ \rho_{b,0}/(\rho_{b,0}+\rho_{cdm,0}) \f$ */
+  double f_dm;          /**< cdm fraction of the matter absorbing the transfer */
+
+  /* model 1 (linear transition between a_minus and a_plus) */
+  double a_minus;       /**< a_start - delta/2 */
+  double a_plus;        /**< a_start + delta/2 */
+  double a_minus4;      /**< a_minus^4 */
+  double rho_b_early;   /**< \f$ a^3 \rho_b \f$ before the transition */
+  double rho_dm_early;  /**< \f$ a^3 \rho_{cdm} \f$ before the transition */
+  double slope_b;       /**< f_b * Delta_rho/(4 delta) */
+  double slope_dm;      /**< f_dm * Delta_rho/(4 delta) */
+
+  /* model 2 (arctan transition) */
+  double F_norm;        /**< prefactor -(Delta_rho/2 pi) delta^3 of F(a) */
+  double F_atan;        /**< coefficient of the arctan term of F(a) */
+  double F_log;         /**< coefficient of the logarithmic term of F(a) */
+  double rho_b_shift;   /**< \f$ \rho_{b,0} - f_b F(1) \f$ */
+  double rho_dm_shift;  /**< \f$ \rho_{cdm,0} - (1-f_b) F(1) \f$ */
+  double lambda_norm;   /**< Delta_rho/pi */
+  double atan_today;    /**< arctan((1-a_start)/delta) */
+
+};
+
 /**
  * background structure containing all the background information that
  * other modules need to know.
@@ -78,6 +119,8 @@ struct background
   
   short has_UG;
   short model;
+
+  struct background_UG_cache UG; /**< a-independent UG constants, see background_UG_constants() */
   
   /* double count_terminal;*/
 
@@ -239,6 +282,9 @@ struct background
   double * z_table;          /**< vector z_table[index_loga] with values of \f$ z \f$ (redshift) */
   double * background_table; /**< table background_table[index_tau*pba->bg_size+pba->index_bg] with all other quantities (array of size bg_size*bt_size) **/
 
+  int loga_break_size;       /**< number of breakpoints of the background, i.e. of values of log(a) at which the densities have a kink */
+  double loga_break[_MAX_BACKGROUND_BREAKPOINTS_]; /**< their sorted values (see background_breakpoints()), also values of loga_table with background_split_at_breakpoints */
+
   //@}
 
 
@@ -325,6 +371,12 @@ struct background
   int * q_size_ncdm;    /**< Size of the q_ncdm arrays */
   double * factor_ncdm; /**< List of normalization factors for calculating energy density etc.*/
 
+  int ncdm_bg_table_size;        /**< number of values of log(a) in the tables of the background momentum sums of the ncdm species (0 if they are not tabulated, see background_ncdm_tabulate()) */
+  double ncdm_bg_table_loga_min; /**< first value of log(a) in these tables */
+  double ncdm_bg_table_dloga;    /**< step in log(a) */
+  double ** ncdm_bg_table;       /**< momentum sums of the density, pressure and pseudo-pressure of each species, over factor_ncdm/a^4: ncdm_bg_table[n_ncdm][index_loga*3+index] */
+  double ** ncdm_bg_table_dd;    /**< their second derivatives with respect to log(a) */
+
   //@}
 
   /** @name - technical parameters */
@@ -338,6 +390,8 @@ struct background
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to background_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
   //@}
 };
@@ -355,6 +409,10 @@ struct background_parameters_and_workspace {
   /* workspace */
   double * pvecback;
 
+  /* index in the background table of the first output value of the
+     current integration (non-zero when it is split at breakpoints) */
+  int index_loga_offset;
+
 };
 
 /**
@@ -413,6 +471,13 @@ extern "C" {
                           double * tau
                           );
 
+  int background_tau_of_z_array(
+                                struct background *pba,
+                                double * z,
+                                int z_size,
+                                double * tau
+                                );
+
   int background_z_of_tau(
                           struct background *pba,
                           double tau,
@@ -427,6 +492,26 @@ extern "C" {
                            double * pvecback
                            );
 
+  int background_UG_constants(
+                              struct background *pba
+                              );
+
+  int background_UG_densities(
+                              struct background *pba,
+                              double * a,
+                              int a_size,
+                              double * rho_b,
+                              double * rho_cdm,
+                              double * rho_lambda
+                              );
+
+  void background_functions_of_integrated(
+                                          struct background *pba,
+                                          double a,
+                                          double * pvecback_B,
+                                          double * pvecback
+                                          );
+
   int background_w_fld(
                        struct background * pba,
                        double a,
@@ -493,6 +578,21 @@ extern "C" {
                               double * pseudo_p
                               );
 
+  int background_ncdm_tabulate(
+                               struct precision *ppr,
+                               struct background *pba
+                               );
+
+  int background_ncdm_at_a(
+                           struct background *pba,
+                           int n_ncdm,
+                           double a,
+                           double loga,
+                           double * rho,
+                           double * p,
+                           double * pseudo_p
+                           );
+
   int background_ncdm_M_from_Omega(
                                    struct precision *ppr,
                                    struct background *pba,
@@ -540,6 +640,36 @@ extern "C" {
                         ErrorMsg error_message
                         );
 
+  int background_derivs_of_vecback(
+                                   struct background *pba,
+                                   double a,
+                                   double * pvecback,
+                                   double * y,
+                                   double * dy,
+                                   ErrorMsg error_message
+                                   );
+
+  int background_breakpoints(
+                             struct background *pba,
+                             double loga_ini,
+                             double loga_final
+                             );
+
+  int background_table_sampling(
+                                struct precision *ppr,
+                                struct background *pba,
+                                int (*generic_evolver)(EVOLVER_PROTOTYPE),
+                                double loga_ini,
+                                double loga_final,
+                                double * pvecback_integration
+                                );
+
+  int background_solve_UG_quadrature(
+                                     struct precision *ppr,
+                                     struct background *pba,
+                                     double * pvecback_integration
+                                     );
+
   int background_sources(
                          double loga,
                          double * y,
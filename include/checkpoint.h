@@ -0,0 +1,79 @@
+/** @file checkpoint.h Binary checkpoints of the computed modules */
+
+#ifndef __CHECKPOINT__
+#define __CHECKPOINT__
+
+#include "input.h"
+#include "modules.h"
+
+#define _CHECKPOINT_VERSION_ 1 /* version of the format of the files written by checkpoint_write() */
+
+/** modules whose structures can be saved in a checkpoint, in the order of the file */
+#define _CHECKPOINT_MODULES_ ((1 << module_background) | (1 << module_thermodynamics) | (1 << module_perturbations) | \
+                              (1 << module_transfer) | (1 << module_harmonic) | (1 << module_lensing))
+
+/**
+ * Header of a checkpoint file. It is followed, for each saved module
+ * (in the order of enum class_module), by the bytes of the module
+ * structure and by its arrays, each of them preceded by its number of
+ * elements (or -1 for a NULL pointer).
+ *
+ * The structures are saved as they are in memory: a checkpoint can
+ * only be read by the same build of CLASS on the same architecture,
+ * which is checked (roughly) through the size of each structure.
+ */
+
+struct checkpoint_header {
+  char magic[8];                                  /**< "CLASSCKP" */
+  int version;                                    /**< _CHECKPOINT_VERSION_ */
+  int size_of_double;                             /**< sizeof(double) when the file was written */
+  int size_of_pointer;                            /**< sizeof(void*) when the file was written */
+  int struct_size[module_size];                   /**< sizeof() of the structure of each module (0 if it cannot be saved) */
+  int modules;                                    /**< flags (1 << module_xxx) of the saved modules */
+  long long offset[module_size];                  /**< position of each saved module in the file */
+  unsigned long long digest[_NUM_INPUT_MODULES_]; /**< digests of the input of each module (see input_module_digests()) */
+};
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int checkpoint_write(
+                       char * file_name,
+                       unsigned long long * digest,
+                       int modules,
+                       struct background * pba,
+                       struct thermodynamics * pth,
+                       struct perturbations * ppt,
+                       struct transfer * ptr,
+                       struct harmonic * phr,
+                       struct lensing * ple,
+                       short verbose,
+                       int * written,
+                       ErrorMsg error_message
+                       );
+
+  int checkpoint_read(
+                      char * file_name,
+                      unsigned long long * digest,
+                      int modules,
+                      struct background * pba,
+                      struct thermodynamics * pth,
+                      struct perturbations * ppt,
+                      struct fourier * pfo,
+                      struct transfer * ptr,
+                      struct harmonic * phr,
+                      struct lensing * ple,
+                      short verbose,
+                      int * restored,
+                      ErrorMsg error_message
+                      );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
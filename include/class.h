@@ -17,6 +17,8 @@
 #include "arrays.h"
 #include "dei_rkck.h"
 #include "parser.h"
+#include "parallel.h"
+#include "class_mpi.h"
 
 /* class modules */
 #include "common.h"
@@ -30,6 +32,8 @@
 #include "harmonic.h"
 #include "distortions.h"
 #include "lensing.h"
+#include "modules.h"
+#include "checkpoint.h"
 #include "output.h"
 
 #endif
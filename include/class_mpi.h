@@ -0,0 +1,39 @@
+/** @file class_mpi.h Distribution of single runs over several MPI processes */
+
+#ifndef __CLASS_MPI__
+#define __CLASS_MPI__
+
+#include "common.h"
+
+/**
+ * With _CLASS_MPI_ defined (make MPI=yes), the processes of an MPI job
+ * share the most expensive loops of one run: each of them integrates
+ * part of the wavenumbers of perturbations_init() and computes part of
+ * the wavenumbers of transfer_init(), and the results are then
+ * exchanged such that all processes continue with complete tables.
+ * Otherwise these functions describe a single process, and the code
+ * does not depend on MPI at all.
+ */
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int class_mpi_init(int * argc, char *** argv);
+
+  int class_mpi_size();
+
+  int class_mpi_rank();
+
+  int class_mpi_agree(int status, ErrorMsg error_message);
+
+  int class_mpi_broadcast(double * buffer, size_t count, int root, ErrorMsg error_message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,6 +15,8 @@
 #ifndef __COMMON__
 #define __COMMON__
 
+#include "timing.h"
+
 #define _VERSION_ "v3.3.0"
 
 /* @cond INCLUDE_WITH_DOXYGEN */
@@ -77,6 +79,20 @@ typedef char FileName[_FILENAMESIZE_];
 #define NRSIGN(a,b) ((b) >= 0.0 ? fabs(a) : -fabs(a))
 #define index_symmetric_matrix(i1,i2,N) (((i1)<=(i2)) ? ((i2)+N*(i1)-((i1)*((i1)+1))/2) : ((i1)+N*(i2)-((i2)*((i2)+1))/2)) /**< assigns an index from 0 to [N(N+1)/2-1] to the coefficients M_{i1,i2} of an N*N symmetric matrix; useful for converting a symmetric matrix to a vector, without losing or double-counting any information */
 
+/* With GCC on x86-64 Linux, the functions with this attribute (the
+   vectorised kernels: spline evaluation, Hermite interpolation of the
+   Bessel functions, recurrences of the Wigner d-functions,
+   interpolation of the sources in the transfer module) are also
+   compiled for SSE4.2, AVX2 and AVX-512, and the version matching the
+   processor is selected when the program is loaded. Compile with
+   -D_CLASS_NO_TARGET_CLONES_ (e.g. together with -march=native) to
+   only build the version of the base flags. */
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__) && !defined(_CLASS_NO_TARGET_CLONES_)
+#define _CLASS_TARGET_CLONES_ __attribute__((target_clones("avx512f","avx2","sse4.2","default")))
+#else
+#define _CLASS_TARGET_CLONES_
+#endif
+
 /* @endcond */
 
 
@@ -87,6 +103,13 @@ extern "C" {
     void class_protect_sprintf(char* dest, char* tpl, ...);
     void class_protect_fprintf(FILE* dest, char* tpl, ...);
     void* class_protect_memcpy(void* dest, void* from, size_t sz);
+    /* the error messages are not written while muted; returns the previous state */
+    int class_mute_error_messages(int muted);
+    /* allocation of big tables on transparent huge pages, released by class_free_large() (see class_alloc_large()) */
+    void* class_malloc_large(size_t size);
+    void class_free_large(void * pointer);
+    /* keep the big tables released by class_free_large() for the next model; returns the previous state */
+    int class_recycle_large(int recycle);
 
     /* some general functions */
     int get_number_of_titles(char * titlestring);
@@ -163,6 +186,25 @@ extern "C" {
 /* macro for allocating memory and returning error if it failed */
 #define class_alloc(pointer, size, error_message_output)  {                                                      \
   pointer=(__typeof__(pointer))malloc(size);                                                                                          \
+  class_counter_add(counter_allocations,1);                                                                      \
+  class_counter_add(counter_allocated_bytes,(long)(size));                                                       \
+  if (pointer == NULL) {                                                                                         \
+    int size_int;                                                                                                \
+    size_int = size;                                                                                             \
+    class_alloc_message(error_message_output,#pointer, size_int);                                                \
+    return _FAILURE_;                                                                                            \
+  }                                                                                                              \
+}
+
+/* same as class_alloc() for the big tables (source functions,
+   transfer functions, Bessel functions...): above 2 MB, the array is
+   aligned on 2 MB and placed on transparent huge pages, which reduces
+   the TLB misses of the loops running over it (see
+   class_malloc_large()). It is released by class_free_large(). */
+#define class_alloc_large(pointer, size, error_message_output)  {                                                \
+  pointer=(__typeof__(pointer))class_malloc_large(size);                                                         \
+  class_counter_add(counter_allocations,1);                                                                      \
+  class_counter_add(counter_allocated_bytes,(long)(size));                                                       \
   if (pointer == NULL) {                                                                                         \
     int size_int;                                                                                                \
     size_int = size;                                                                                             \
@@ -189,6 +231,8 @@ extern "C" {
 /* macro for allocating memory, initializing it with zeros/ and returning error if it failed */
 #define class_calloc(pointer, init,size, error_message_output)  {                                                \
   pointer=(__typeof__(pointer))calloc(init,size);                                                                                     \
+  class_counter_add(counter_allocations,1);                                                                      \
+  class_counter_add(counter_allocated_bytes,(long)(init)*(long)(size));                                          \
   if (pointer == NULL) {                                                                                         \
     int size_int;                                                                                                \
     size_int = size;                                                                                             \
@@ -200,6 +244,8 @@ extern "C" {
 /* macro for re-allocating memory, returning error if it failed */
 #define class_realloc(pointer, size, error_message_output)  {                                          \
     pointer=(__typeof__(pointer))realloc(pointer,size);                                                                               \
+    class_counter_add(counter_allocations,1);                                                                    \
+    class_counter_add(counter_allocated_bytes,(long)(size));                                                     \
   if (pointer == NULL) {                                                                                         \
     int size_int;                                                                                                \
     size_int = size;                                                                                             \
@@ -354,8 +400,13 @@ printf("-> %-30s Omega = %-15g , omega = %-15g\n",name,pba->Omega0_##type,pba->O
     double, double *, int, \
     int (*)(double, double *, double *, int, void *, ErrorMsg), \
     int (*)(double, double *, double *, void *, ErrorMsg), \
+    struct jacobian_pattern *, \
     ErrorMsg
 
+/* Forward-Declare the sparsity pattern which the ndf15 evolver can
+   keep from one integration to the next (see evolver_ndf15.h) */
+struct jacobian_pattern;
+
 /* Forward-Declare the structs of CLASS */
 struct background;
 struct thermodynamics;
@@ -375,7 +426,8 @@ struct output;
  */
 enum evolver_type {
   rk, /* Runge-Kutta integrator */
-  ndf15 /* stiff integrator */
+  ndf15, /* stiff integrator */
+  rk_batch /* Runge-Kutta integrator advancing several wavenumbers together (perturbations only) */
 };
 
 /**
@@ -0,0 +1,105 @@
+/** @file data_files.h Tables of numbers read from external files */
+
+#ifndef __DATA_FILES__
+#define __DATA_FILES__
+
+#include "common.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _DATA_FILES_MMAP_            /* binary copies can be memory-mapped */
+#endif
+#define _DATA_FILES_VERSION_ 1       /* version of the format of the binary copies written by data_file_write_binary() */
+#define _DATA_FILES_HEADER_SIZE_ 64  /* bytes reserved for the header of a binary copy, keeping the data aligned */
+
+/**
+ * Layout of an external file of numbers. Apart from the header line
+ * (if any), the lines that are blank or start with a comment character
+ * are ignored.
+ */
+
+enum data_file_format {
+  data_file_columns,     /**< rows of a fixed number of columns, until the first entry that is not a number (or end of file) */
+  data_file_rows_header, /**< a header line (number of rows, n), followed by rows of n plus a fixed number of columns */
+  data_file_grid_header  /**< a header line (n1, n2), followed by n1*n2 rows of a fixed number of columns */
+};
+
+/**
+ * Content of an external file of numbers (BBN table, phase-space
+ * distribution, selection function, tables of the distortions
+ * module...). These files do not depend on cosmology: each file is
+ * parsed once per process, and the table is shared by all the runs
+ * (see data_file_get()), which only read it, and give it back with
+ * data_file_release().
+ */
+
+struct data_file {
+  char * file_name;            /**< full path of the file */
+  long long file_size;         /**< size of the file when it was read */
+  long long file_mtime;        /**< modification time of the file when it was read */
+  enum data_file_format format;/**< layout of the file */
+  int format_columns;          /**< fixed number of columns requested for this layout */
+  int header[2];               /**< numbers of the header line (zero without header) */
+  int rows;                    /**< number of rows */
+  int columns;                 /**< number of numbers in each row */
+  double * data;               /**< data[index_column*rows+index_row] */
+  void * map;                  /**< memory-mapped binary copy holding data, or NULL if data was allocated */
+  int users;                   /**< number of runs using the table (see data_file_release()) */
+  short is_stale;              /**< whether the table has been replaced in the list, and is freed by its last user */
+  struct data_file * next;     /**< next table read by the process */
+};
+
+/* Header of the binary copy of an external file, followed (at offset
+   _DATA_FILES_HEADER_SIZE_) by the data array of struct data_file */
+struct data_file_binary_header {
+  char magic[8];               /**< "CLASSDAT" */
+  int version;                 /**< _DATA_FILES_VERSION_ */
+  int size_of_double;          /**< sizeof(double) when the file was written */
+  long long file_size;         /**< size of the text file */
+  long long file_mtime;        /**< modification time of the text file */
+  int format;                  /**< layout of the text file */
+  int format_columns;          /**< fixed number of columns requested for this layout */
+  int header[2];               /**< numbers of the header line */
+  int rows;                    /**< number of rows */
+  int columns;                 /**< number of numbers in each row */
+};
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int data_file_get(char * file_name,
+                    enum data_file_format format,
+                    int format_columns,
+                    short use_binary,
+                    struct data_file ** ppdf,
+                    ErrorMsg error_message);
+
+  int data_file_set(char * file_name,
+                    enum data_file_format format,
+                    int format_columns,
+                    int * header,
+                    int rows,
+                    int columns,
+                    double * data,
+                    short use_binary,
+                    ErrorMsg error_message);
+
+  int data_file_release(struct data_file * pdf);
+
+  int data_file_read(struct data_file * pdf,
+                     ErrorMsg error_message);
+
+  int data_file_read_binary(char * binary_file_name,
+                            struct data_file * pdf);
+
+  int data_file_write_binary(char * binary_file_name,
+                             struct data_file * pdf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -7,6 +7,7 @@
 #define __DISTORTIONS__
 
 #include "arrays.h"
+#include "data_files.h"
 #include "background.h"
 #include "thermodynamics.h"
 #include "perturbations.h"
@@ -14,9 +15,11 @@
 #include "noninjection.h"
 
 #define _MAX_DETECTOR_NAME_LENGTH_ 100
+#define _SD_DETECTOR_PCA_SIZE_ 6     /* number of E and S vectors computed by distortions_generate_detector() */
 typedef char DetectorName[_MAX_DETECTOR_NAME_LENGTH_];
 typedef char DetectorFileName[_FILENAMESIZE_+_MAX_DETECTOR_NAME_LENGTH_+256];
 
+
 /** List of possible branching ratio approximations */
 
 enum br_approx {bra_sharp_sharp,bra_sharp_soft,bra_soft_soft,bra_soft_soft_cons,bra_exact};
@@ -92,7 +95,6 @@ struct distortions
 
   /* File names for the PCA */
   char sd_detector_noise_file[2*_FILENAMESIZE_+_MAX_DETECTOR_NAME_LENGTH_+256];              /**< Full path of detector noise file */
-  DetectorFileName sd_PCA_file_generator;               /**< Full path of PCA generator file */
   DetectorFileName sd_detector_list_file;               /**< Full path of detector list file */
 
 
@@ -181,6 +183,8 @@ struct distortions
 
   ErrorMsg error_message;    /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to distortions_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
 
   //@}
@@ -215,6 +219,14 @@ extern "C" {
   int distortions_generate_detector(struct precision * ppr,
                                     struct distortions * psd);
 
+  int distortions_write_detector_table(char * file_name,
+                                       char * description,
+                                       int rows,
+                                       int vectors,
+                                       double * table,
+                                       short use_binary,
+                                       ErrorMsg error_message);
+
   int distortions_set_detector(struct precision * ppr,
                                struct distortions* psd);
 
@@ -257,6 +269,13 @@ extern "C" {
                                    double * y_reio,
                                    double * DI);
 
+  /* External files */
+  int distortions_get_table(struct precision * ppr,
+                            struct distortions * psd,
+                            char * file_name,
+                            int first_columns,
+                            struct data_file ** pptable);
+
   /* PCA decomposition (branching ratios and spectral shapes) for known detector */
   int distortions_read_br_data(struct precision * ppr,
                                struct distortions * psd);
@@ -0,0 +1,73 @@
+/** @file emulator.h Polynomial emulators of vectors of outputs */
+
+#ifndef __EMULATOR__
+#define __EMULATOR__
+
+#include "common.h"
+
+#define _EMULATOR_VERSION_ 1         /* version of the format written by emulator_write() */
+#define _EMULATOR_DEGREE_MAX_ 4      /* maximum degree of the polynomials */
+#define _EMULATOR_PARAMETERS_MAX_ 16 /* maximum number of parameters */
+
+/**
+ * Emulator of a vector of outputs (e.g. C_l's) depending on a few
+ * parameters, trained by emulator_train() on samples computed with
+ * CLASS. Each output is standardized by its mean and by a scale (by
+ * default, its rms value over the sample); the vectors are decomposed on their principal
+ * components, and the coefficient of each component is fitted by a
+ * polynomial of the parameters (rescaled to [-1,1] over the sample).
+ */
+
+struct emulator {
+  int num_parameters;     /**< number of parameters */
+  int num_outputs;        /**< number of outputs */
+  int degree;             /**< total degree of the polynomials */
+  int num_terms;          /**< number of monomials of degree <= degree */
+  int num_components;     /**< number of principal components kept */
+  int * exponent;         /**< exponent[index_term*num_parameters+index_parameter] of each monomial */
+  double * parameter_min; /**< smallest value of each parameter in the sample */
+  double * parameter_max; /**< largest value of each parameter in the sample */
+  double * mean;          /**< mean of each output over the sample */
+  double * scale;         /**< scale of each output (by default its rms over the sample, 1 if it is always zero) */
+  double * component;     /**< component[index_component*num_outputs+index_output] */
+  double * coefficient;   /**< coefficient[index_component*num_terms+index_term] of the polynomials */
+  double error;           /**< largest leave-one-out error on a standardized output of the sample */
+};
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int emulator_train(int num_parameters,
+                     int num_outputs,
+                     int num_samples,
+                     double * parameters,
+                     double * outputs,
+                     double * scale,
+                     int degree,
+                     struct emulator * pem,
+                     ErrorMsg error_message);
+
+  int emulator_predict(struct emulator * pem,
+                       double * parameters,
+                       double * outputs,
+                       short * inside);
+
+  int emulator_write(FILE * file,
+                     struct emulator * pem,
+                     ErrorMsg error_message);
+
+  int emulator_read(FILE * file,
+                    struct emulator * pem,
+                    ErrorMsg error_message);
+
+  int emulator_free(struct emulator * pem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,6 +31,37 @@ struct jacobian{
 	sp_num *Numerical; /*Stores the LU decomposition.*/
 	int *Cp; /* Stores the column pointers of the spJ+spJ' sparsity pattern. */
 	int *Ci; /* Stores the row indices of the  spJ+spJ' sparsity pattern. */
+	int has_registered_pattern; /* True if the pattern was given by the caller and has not been checked yet. */
+	struct jacobian_pattern *pattern; /* The registered pattern, or NULL. */
+	int symbolic_from_pattern; /* True if Numerical holds the symbolic LU decomposition of the registered pattern. */
+};
+
+/* Sparsity pattern of the jacobian, registered by the caller of evolver_ndf15. It is
+   trusted from the first jacobian, which saves the full (non-grouped) jacobians otherwise
+   needed by numjac to learn it. For a linear system, which is integrated many times with
+   the same structure (e.g. the perturbations for each wavenumber), it can be found once
+   with jacobian_pattern_of_linear_system(), and kept by the caller until the structure
+   changes (jacobian_pattern_reset).
+   The pattern also keeps the symbolic LU decomposition of the iteration matrix (ordering,
+   static pivots on the diagonal and fill-in), so that each new jacobian or step size only
+   costs a numerical refactorization for as long as the pattern is kept. */
+struct jacobian_pattern{
+	int neq;      /* Size of the system, or 0 if no pattern is known yet */
+	int nonzero;  /* Number of non-zero entries */
+	int neq_capacity;     /* Allocated size of Ap, minus one */
+	int nonzero_capacity; /* Allocated size of Ai */
+	int *Ap;      /* Column pointers (size neq+1), compressed column format as in sparse.h */
+	int *Ai;      /* Row indices (size nonzero) */
+	int has_symbolic; /* True if the symbolic LU decomposition below is known */
+	int symbolic_capacity; /* Allocated size of q and topvec */
+	int *q;       /* Column ordering (size neq) */
+	int *topvec;  /* First index of each row of xi (size neq) */
+	int *xi;      /* Reach of each column, xi[k*neq+topvec[k]..k*neq+neq-1] (size neq*neq) */
+	int refresh_on_convergence; /* Set by the caller: if true, the LU decomposition is not redone when the
+	                               step size or order changes, but only when the Newton iterations slow down */
+	int stepstat[6]; /* Statistics of the integrations using this pattern, added by evolver_ndf15
+	                    (same entries as its own stepstat vector). Reset by the caller. */
+	int symbolic_decompositions; /* Number of symbolic LU decompositions, also added by evolver_ndf15 */
 };
 
 struct numjac_workspace{
@@ -63,6 +94,13 @@ extern "C" {
   int uninitialize_jacobian(struct jacobian *jac);
   int initialize_numjac_workspace(struct numjac_workspace * nj_ws,int neq, ErrorMsg error_message);
   int uninitialize_numjac_workspace(struct numjac_workspace * nj_ws);
+  int jacobian_pattern_reset(struct jacobian_pattern *pattern);
+  int jacobian_pattern_free(struct jacobian_pattern *pattern);
+  int jacobian_pattern_load(struct jacobian_pattern *pattern, struct jacobian *jac, int neq);
+  int jacobian_pattern_symbolic(struct jacobian_pattern *pattern, struct jacobian *jac, int neq, ErrorMsg error_message);
+  int jacobian_pattern_of_linear_system(int (*derivs)(double x,double * y,double * dy,void * parameters_and_workspace,ErrorMsg error_message),
+                                        double t, int neq, void * parameters_and_workspace_for_derivs,
+                                        struct jacobian_pattern *pattern, ErrorMsg error_message);
   int calc_C(struct jacobian *jac);
   int interp_from_dif(double tinterp,double tnew,double *ynew,double h,double **dif,int k, double *yinterp,
 		      double *ypinterp, double *yppinterp, int* index, int neq, int output);
@@ -82,6 +120,7 @@ extern "C" {
                    double tolx,
                    double tolF,
                    void *param,
+                   void **param_jacobian,
                    int *fevals,
                    ErrorMsg error_message);
 
@@ -113,6 +152,7 @@ int evolver_ndf15(
 		ErrorMsg error_message),
 	int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
 		ErrorMsg error_message),
+	struct jacobian_pattern * jacobian_pattern,
 	ErrorMsg error_message);
 
 
@@ -3,6 +3,56 @@
 
 #include "dei_rkck.h"
 
+/**
+ * One of the systems of equations integrated together by
+ * evolver_rk_batch(). The caller sets the public fields before the
+ * first call, and again in the restart function for integrating the
+ * lane over a new interval.
+ */
+
+struct evolver_rk_lane {
+
+  /** @name - public fields */
+
+  //@{
+
+  double x_ini;                     /**< start of the interval */
+  double x_end;                     /**< end of the interval */
+  double * y;                       /**< y[index_y]: vector integrated in place */
+  int y_size;                       /**< size of the vector */
+  void * parameters_and_workspace;  /**< passed to derivs, evaluate_timescale, output and print_variables */
+  int (*print_variables)(double x,
+                         double y[],
+                         double dy[],
+                         void * parameters_and_workspace,
+                         ErrorMsg error_message); /**< called as by evolver_rk(), or NULL */
+
+  //@}
+
+  /** @name - state of the integration, private to evolver_rk_batch() */
+
+  //@{
+
+  int state;                        /**< point reached in the steps of evolver_rk() (see evolver_rk_lane_advance()) */
+  int stage;                        /**< last stage of rkck() whose derivatives were requested */
+  struct generic_integrator_workspace gi; /**< vectors of generic_integrator() */
+  double * dy;                      /**< derivatives at the points of output */
+  int size_allocated;               /**< size of the allocated vectors */
+  int next_index_x;                 /**< index of the next point of output */
+  short call_output;                /**< whether the current step ends at a point of output */
+  double x1;                        /**< start of the current step of evolver_rk() */
+  double x2;                        /**< end of the current step of evolver_rk() */
+  double x;                         /**< current point of generic_integrator() */
+  double h;                         /**< step tried by generic_integrator() */
+  double h_stage;                   /**< step tried by rkqs() */
+  int nstp;                         /**< number of steps of generic_integrator() */
+  double request_x;                 /**< argument of the requested derivatives */
+  double * request_y;               /**< vector of the requested derivatives */
+  double * request_dy;              /**< output of the requested derivatives */
+
+  //@}
+};
+
 /**************************************************************/
 
 /**
@@ -43,8 +93,39 @@ extern "C" {
 					     double dy[],
 					     void * parameters_and_workspace,
 					     ErrorMsg error_message),
+		      struct jacobian_pattern * jacobian_pattern,
 		      ErrorMsg error_message);
 
+  int evolver_rk_batch(int (*derivs)(double x,
+                                     double * y,
+                                     double * dy,
+                                     void * parameters_and_workspace,
+                                     ErrorMsg error_message),
+                       int lane_size,
+                       struct evolver_rk_lane * lanes,
+                       double tolerance,
+                       double minimum_variation,
+                       int (*evaluate_timescale)(double x,
+                                                 void * parameters_and_workspace,
+                                                 double * timescale,
+                                                 ErrorMsg error_message),
+                       double timestep_over_timescale,
+                       double * x_sampling,
+                       int x_size,
+                       int (*output)(double x,
+                                     double y[],
+                                     double dy[],
+                                     int index_x,
+                                     void * parameters_and_workspace,
+                                     ErrorMsg error_message),
+                       int (*restart)(int index_lane,
+                                      struct evolver_rk_lane * plane,
+                                      void * restart_parameters,
+                                      short * is_done,
+                                      ErrorMsg error_message),
+                       void * restart_parameters,
+                       ErrorMsg error_message);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,78 @@
+/**
+ * definitions for module fftlog.c
+ */
+
+#ifndef __FFTLOG__
+#define __FFTLOG__
+
+#include "common.h"
+
+/**
+ * Kernels K(x) of the transforms F(r) = int dlnk f(k) K(kr) computed
+ * by fftlog_transform(). For each of them the Mellin transform
+ * M(s) = int dx x^(s-1) K(x) is known analytically.
+ */
+
+enum fftlog_kernel {
+  fftlog_tophat_sq,      /**< K(x) = W(x)^2, with W(x) = 3(sin(x)-x cos(x))/x^3 the top-hat window; 0 < bias < 4 */
+  fftlog_tophat_sq_dlnx, /**< K(x) = x d[W(x)^2]/dx; 0 < bias < 4 */
+  fftlog_gauss,          /**< K(x) = exp(-x^2); bias > 0 */
+  fftlog_gauss_x2,       /**< K(x) = 2 x^2 exp(-x^2); bias > -2 */
+  fftlog_gauss_x2_x4     /**< K(x) = 4 x^2 (1-x^2) exp(-x^2); bias > -2 */
+};
+
+/**
+ * Plan for the transforms of functions sampled on a given logarithmic
+ * grid, with a given kernel and bias (see fftlog_plan_init())
+ */
+
+struct fftlog_plan {
+  int n;                     /**< number of samples of the input function */
+  int N;                     /**< size of the zero-padded FFT, power of 2 */
+  double dlnk;               /**< logarithmic step */
+  double bias;               /**< power-law bias */
+  enum fftlog_kernel kernel; /**< kernel */
+  double * u;                /**< transform of the kernel for each Fourier mode 0 <= m <= N/2, as (real, imaginary) pairs */
+  double * twiddle;          /**< exp(-2 i pi m/N) for 0 <= m < N/2, as (real, imaginary) pairs */
+};
+
+/**
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int fftlog_plan_init(
+                       struct fftlog_plan * pfp,
+                       int n,
+                       double dlnk,
+                       double bias,
+                       enum fftlog_kernel kernel,
+                       ErrorMsg error_message
+                       );
+
+  int fftlog_execute(
+                     struct fftlog_plan * pfp,
+                     double * f,
+                     double lnk_min,
+                     double * lnr,
+                     double * F,
+                     ErrorMsg error_message
+                     );
+
+  int fftlog_plan_free(
+                       struct fftlog_plan * pfp
+                       );
+
+  void fftlog_fft(
+                  double * data,
+                  int n,
+                  double * twiddle
+                  );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "primordial.h"
 #include "trigonometric_integrals.h"
+#include "fftlog.h"
+#include "nowiggle.h"
 
 #ifndef __FOURIER__
 #define __FOURIER__
@@ -22,6 +24,18 @@ enum hmcode_version {hmcode_version_2015, hmcode_version_2020, hmcode_version_20
 
 enum out_sigmas {out_sigma,out_sigma_prime,out_sigma_disp};
 
+/**
+ * Nonlinear spectra at one redshift, computed on demand by
+ * fourier_prepare_pk_nl() and kept in a list
+ */
+
+struct fourier_nl_spectrum {
+  double z;                           /**< redshift */
+  double * ln_pk_nl;                  /**< ln_pk_nl[index_pk * pfo->k_size + index_k] = ln(P_NL(k)) at this redshift, or ln(P_L(k)) if the nonlinear corrections are not computable */
+  double * k_nl;                      /**< k_nl[index_pk] = non-linear wavenumber at this redshift */
+  struct fourier_nl_spectrum * next;  /**< spectrum at another redshift, or NULL */
+};
+
 /**
  * Structure containing all information on non-linear spectra.
  *
@@ -71,6 +85,11 @@ struct fourier {
                                      to build the nonlinear spectrum
                                      (IR resummation) */
 
+  short has_nl_on_demand; /**< do we want to compute the nonlinear
+                             spectra only at the redshifts at which
+                             they are requested, rather than
+                             tabulating them in fourier_init()? */
+
   //@}
 
   /** @name - information on number of modes and pairs of initial conditions */
@@ -189,6 +208,9 @@ struct fourier {
 
   double * ddln_pk_l_an_extra; /**< second derivative of above array with respect to log(k), for spline interpolation. */
 
+  struct nowiggle_plan * nowiggle_plan; /**< plan of the wiggle/nowiggle decomposition relative to the above analytic spectrum,
+                                             shared by HMcode 2020 and by the numerical nowiggle spectrum (NULL when neither is needed) */
+
   int * pk_l_nw_index;  /**< pointer to a single index_pk: compute the nowiggle spectrum for this index_pk */
 
   double * ln_pk_l_nw_extra; /**< No-wiggle linear power spectrum.
@@ -232,6 +254,22 @@ struct fourier {
 
   //@}
 
+  /** @name - nonlinear spectra computed on demand */
+
+  //@{
+
+  short nl_on_demand;                 /**< _TRUE_ if has_nl_on_demand could be honoured: ln_pk_nl, ddln_pk_nl and k_nl
+                                         are then not filled, and the spectra are computed by fourier_prepare_pk_nl() */
+  struct fourier_nl_spectrum * nl_spectra;  /**< list of the nonlinear spectra computed so far */
+
+  struct precision * nl_ppr;          /**< structures used by Halofit and HMcode, kept from fourier_init() */
+  struct perturbations * nl_ppt;
+  struct primordial * nl_ppm;
+  struct fftlog_plan * nl_halofit_plan;         /**< Halofit FFTLog plan (or NULL) */
+  struct hmcode_workspace * nl_hmcode_workspace; /**< HMcode workspace with its growth tables (or NULL) */
+
+  //@}
+
   /** @name - technical parameters */
 
   //@{
@@ -240,6 +278,8 @@ struct fourier {
 
   ErrorMsg error_message; 	/**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to fourier_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
 
   //@}
@@ -317,6 +357,31 @@ extern "C" {
                                    double * out_pk_cb
                                    );
 
+  int fourier_pk_at_kvec_and_zvec(
+                                  struct background * pba,
+                                  struct fourier * pfo,
+                                  enum pk_outputs pk_output,
+                                  int index_pk,
+                                  double * kvec,
+                                  int kvec_size,
+                                  double * zvec,
+                                  int zvec_size,
+                                  double * out_pk
+                                  );
+
+  int fourier_pk_and_tilt_at_kvec_and_zvec(
+                                           struct background * pba,
+                                           struct fourier * pfo,
+                                           enum pk_outputs pk_output,
+                                           int index_pk,
+                                           double * kvec,
+                                           int kvec_size,
+                                           double * zvec,
+                                           int zvec_size,
+                                           double * out_pk,
+                                           double * out_tilt
+                                           );
+
   int fourier_sigmas_at_z(
                           struct precision * ppr,
                           struct background * pba,
@@ -328,6 +393,18 @@ extern "C" {
                           double * result
                           );
 
+  int fourier_sigmas_at_z_list(
+                               struct precision * ppr,
+                               struct background * pba,
+                               struct fourier * pfo,
+                               double R,
+                               int z_size,
+                               double * z,
+                               int index_pk,
+                               enum out_sigmas sigma_output,
+                               double * result
+                               );
+
   int fourier_pk_tilt_at_k_and_z(
                                  struct background * pba,
                                  struct primordial * ppm,
@@ -347,6 +424,13 @@ extern "C" {
                         double * k_nl_cb
                         );
 
+  int fourier_prepare_pk_nl(
+                            struct background *pba,
+                            struct fourier * pfo,
+                            int z_size,
+                            double * z
+                            );
+
   /* internal functions */
 
   int fourier_init(
@@ -362,6 +446,19 @@ extern "C" {
                    struct fourier *pfo
                    );
 
+  int fourier_nl_spectrum_at_z(
+                                struct background *pba,
+                                struct fourier * pfo,
+                                double z,
+                                int index_pk,
+                                double * ln_pk_nl,
+                                double * k_nl
+                                );
+
+  int fourier_nl_spectra_free(
+                              struct fourier * pfo
+                              );
+
   int fourier_indices(
                       struct precision *ppr,
                       struct background *pba,
@@ -390,7 +487,6 @@ extern "C" {
                          int index_ic,
                          int index_tp,
                          int index_tau,
-                         double ** sources,
                          double * source);
 
   int fourier_pk_linear(
@@ -430,6 +526,58 @@ extern "C" {
                      double * result
                      );
 
+  int fourier_sigmas_pk_table(
+                              struct fourier * pfo,
+                              double * lnpk_l,
+                              double * ddlnpk_l,
+                              int k_size,
+                              double k_per_decade,
+                              int * integrand_size,
+                              double ** pk_table
+                              );
+
+  int fourier_sigmas_from_pk_table(
+                                   struct fourier * pfo,
+                                   double R,
+                                   double * pk_table,
+                                   int integrand_size,
+                                   double k_per_decade,
+                                   enum out_sigmas sigma_output,
+                                   double * result
+                                   );
+
+  int fourier_sigmas_fftlog_init(
+                                 struct fourier * pfo,
+                                 int k_size,
+                                 double k_per_decade,
+                                 enum out_sigmas sigma_output,
+                                 struct fftlog_plan * pfp
+                                 );
+
+  int fourier_sigmas_fftlog(
+                            struct fourier * pfo,
+                            struct fftlog_plan * pfp,
+                            double * pk_table,
+                            enum out_sigmas sigma_output,
+                            double * lnR,
+                            double * result,
+                            double * ddresult
+                            );
+
+  int fourier_sigmas_from_fftlog_table(
+                                       struct fourier * pfo,
+                                       double R,
+                                       double * lnR,
+                                       double * table,
+                                       double * ddtable,
+                                       double * pk_table,
+                                       int pk_table_size,
+                                       double k_per_decade,
+                                       enum out_sigmas sigma_output,
+                                       int * last_index,
+                                       double * result
+                                       );
+
   int fourier_sigma_at_z(
                          struct background * pba,
                          struct fourier * pfo,
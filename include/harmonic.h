@@ -134,6 +134,8 @@ struct harmonic {
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to harmonic_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
 
   //@}
@@ -158,6 +160,13 @@ extern "C" {
                        double ** cl_md_ic
                        );
 
+  int harmonic_cl_at_l_range(
+                             struct harmonic * phr,
+                             int l_min,
+                             int l_max,
+                             double * cl_tot
+                             );
+
   /* internal functions */
 
   int harmonic_init(
@@ -191,25 +200,92 @@ extern "C" {
                    struct harmonic * phr
                    );
 
+  int harmonic_cl_weights(
+                          struct precision * ppr,
+                          struct background * pba,
+                          struct transfer * ptr,
+                          struct primordial * ppm,
+                          struct harmonic * phr,
+                          int index_md,
+                          double ** cl_weight,
+                          double ** cl_weight_limber,
+                          double ** cl_weight_lcmb_direct
+                          );
+
+  int harmonic_cl_weights_at_k(
+                               struct background * pba,
+                               struct primordial * ppm,
+                               struct harmonic * phr,
+                               int index_md,
+                               double * k,
+                               int k_size,
+                               int index_spline,
+                               double q_min,
+                               double k_min,
+                               double * cl_weight
+                               );
+
   int harmonic_compute_cl(
                           struct precision * ppr,
                           struct background * pba,
                           struct perturbations * ppt,
                           struct transfer * ptr,
-                          struct primordial * ppm,
                           struct harmonic * phr,
                           int index_md,
                           int index_ic1,
                           int index_ic2,
                           int index_l,
-                          int cl_integrand_num_columns,
-                          double * cl_integrand,
-                          double * cl_integrand_limber,
-                          double * primordial_pk,
-                          double * transfer_ic1,
-                          double * transfer_ic2
+                          double * cl_weight,
+                          double * cl_weight_limber,
+                          double * cl_weight_lcmb_direct,
+                          short * cl_sampled
                           );
 
+  int harmonic_cl_fill_l(
+                         struct harmonic * phr,
+                         int index_md,
+                         short * cl_sampled
+                         );
+
+  int harmonic_compute_cl_limber(
+                                 struct transfer * ptr,
+                                 struct harmonic * phr,
+                                 int index_md,
+                                 int index_ic1,
+                                 int index_ic2,
+                                 int index_l,
+                                 double * cl_weight_limber,
+                                 double * clvalue
+                                 );
+
+  int harmonic_compute_cl_lcmb_direct(
+                                      struct transfer * ptr,
+                                      struct harmonic * phr,
+                                      int index_md,
+                                      int index_ic1,
+                                      int index_ic2,
+                                      int index_l,
+                                      double * cl_weight_lcmb_direct,
+                                      double * clvalue
+                                      );
+
+  double harmonic_cl_product(
+                             double * weight,
+                             double * field1,
+                             double * field2,
+                             int size
+                             );
+
+  double harmonic_cl_symmetric_product(
+                                       double * weight,
+                                       double * field1_a,
+                                       double * field1_b,
+                                       double * field2_a,
+                                       double * field2_b,
+                                       int size,
+                                       short same_ic
+                                       );
+
   int harmonic_k_and_tau(
                          struct background * pba,
                          struct perturbations * ppt,
@@ -14,6 +14,13 @@
 #define _HYPER_CHUNK_ 16
 #define _TWO_OVER_THREE_ 0.666666666666666666666666666667e0
 #define _HIS_BYTE_ALIGNMENT_ 16
+#define _HERMITE_BLOCK_ 64           /* number of points interpolated at once by the hyperspherical_HermiteN_interpolation_vector functions */
+#define _HIS_CACHE_VERSION_ 1       /* version of the format of the cache files of hyperspherical_HIS_create_cached() */
+#define _HIS_CACHE_HEADER_SIZE_ 128 /* bytes reserved for the header of a cache file, keeping the arrays aligned */
+#define _HIS_CACHE_BLOCK_ 4096      /* the number of x-values of a cached table is a multiple of this */
+#if defined(__unix__) || defined(__APPLE__)
+#define _HIS_CACHE_MMAP_            /* cache files can be memory-mapped */
+#endif
 
 typedef struct HypersphericalInterpolationStructure{
   int K;                 //Sign of the curvature, (0,-1,1)
@@ -29,8 +36,30 @@ typedef struct HypersphericalInterpolationStructure{
   double *cotK;          //Vector of cot_K(xvec)
   double *phi;        //array of size nl*nx. [y_{l1}(x1) t_{l1}(x2)...]
   double *dphi;       //Same as phivec, but containing derivatives.
+  void *cache_map;    //If not NULL, all arrays point into this read-only mapping of a cache file
+  size_t cache_size;  //Size of the mapping
 } HyperInterpStruct;
 
+/* Header of the cache files: the table itself follows at offset _HIS_CACHE_HEADER_SIZE_,
+   as chi_at_phimin[l_size], x[x_size], sinK[x_size], cotK[x_size], phi[l_size*x_size],
+   dphi[l_size*x_size], l[l_size] */
+struct hyperspherical_cache_header{
+  char magic[8];        //"CLASSHIS"
+  int version;          //_HIS_CACHE_VERSION_
+  int size_of_int;
+  int size_of_double;
+  int K;
+  int l_size;
+  int x_size;
+  int trig_order;
+  int l_WKB;
+  double one;           //1.0, to detect files written with another byte order
+  double beta;
+  double x_min;
+  double delta_x;
+  double phiminabs;
+};
+
 struct WKB_parameters{
    int K;
    int l;
@@ -56,6 +85,52 @@ extern "C" {
                                 HyperInterpStruct *pHIS,
                                 ErrorMsg error_message);
 
+  int hyperspherical_HIS_create_grid(int K,
+                                     double beta,
+                                     int nl,
+                                     int *lvec,
+                                     double xmin,
+                                     int nx,
+                                     double deltax,
+                                     int l_WKB,
+                                     double phiminabs,
+                                     HyperInterpStruct *pHIS,
+                                     ErrorMsg error_message);
+
+  int hyperspherical_HIS_create_cached(char * cache_directory,
+                                       int K,
+                                       double beta,
+                                       int nl,
+                                       int *lvec,
+                                       double xmin,
+                                       double xmax,
+                                       double sampling,
+                                       int l_WKB,
+                                       double phiminabs,
+                                       HyperInterpStruct *pHIS,
+                                       short * from_cache,
+                                       ErrorMsg error_message);
+
+  size_t hyperspherical_cache_size(int nl, int nx);
+  int hyperspherical_cache_map(char * file_name,
+                               int K,
+                               double beta,
+                               int nl,
+                               int *lvec,
+                               double xmin,
+                               double deltax,
+                               int nx_needed,
+                               int l_WKB,
+                               double phiminabs,
+                               HyperInterpStruct *pHIS,
+                               short * has_map);
+  int hyperspherical_cache_write(char * cache_directory,
+                                 char * file_name,
+                                 HyperInterpStruct *pHIS,
+                                 double xmin,
+                                 int l_WKB,
+                                 double phiminabs);
+
   int hyperspherical_HIS_free(HyperInterpStruct *pHIS, ErrorMsg error_message);
   int hyperspherical_forwards_recurrence(int K,
                                          int lmax,
@@ -210,6 +210,19 @@ enum target_names {theta_s, theta_s_100, Neff, Omega_dcdmdr, omega_dcdmdr, Omega
 /* Until which class stage is being computed? Pretty much fixed list, don't change. */
 enum computation_stage {cs_background, cs_thermodynamics, cs_perturbations, cs_primordial, cs_nonlinear, cs_transfer, cs_spectra};
 
+/**
+ * Modules whose results a wrapper (classy, ClassEngine) computing
+ * several models in a row may reuse, when the input parameters they
+ * depend on did not change. Listed in the order in which they are run.
+ */
+
+enum input_module {im_background, im_thermodynamics, im_perturbations, im_primordial, im_fourier, im_transfer, im_harmonic, im_lensing, im_distortions, im_output};
+/* Important: Keep this number equal to the number of input_module */
+#define _NUM_INPUT_MODULES_ 10
+
+/* Number of precision tiers (see input_precision_tier()) */
+#define _PRECISION_TIERS_ 3
+
 /**
  * Structure for all temporary parameters for background fzero function
  */
@@ -351,6 +364,9 @@ extern "C" {
                             struct output * pop,
                             ErrorMsg errmsg);
 
+  int input_precision_tier(struct precision * ppr,
+                           ErrorMsg errmsg);
+
   /* Read from .ini file */
 
   int input_read_parameters(struct file_content * pfc,
@@ -454,6 +470,39 @@ extern "C" {
                        struct output * pop,
                        ErrorMsg errmsg);
 
+  /* Dependency tracking for wrappers computing several models */
+
+  unsigned long long input_digest_bytes(unsigned long long digest,
+                                        const void * data,
+                                        size_t size);
+
+  int input_module_of_parameter(char * name,
+                                enum input_module * module);
+
+  int input_module_digests(struct file_content * pfc,
+                           struct precision * ppr,
+                           unsigned long long * digest,
+                           ErrorMsg errmsg);
+
+  int input_module_reuse(unsigned long long * digest_old,
+                         unsigned long long * digest_new,
+                         short * was_computed,
+                         short has_nl_corrections,
+                         short * can_reuse);
+
+  int input_update_primordial(struct file_content * pfc,
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermodynamics * pth,
+                              struct perturbations * ppt,
+                              struct transfer * ptr,
+                              struct primordial * ppm,
+                              struct harmonic * phr,
+                              struct fourier * pfo,
+                              struct lensing * ple,
+                              struct distortions * psd,
+                              ErrorMsg errmsg);
+
   /* Set default parameters */
 
   int input_default_params(struct background *pba,
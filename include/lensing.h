@@ -5,6 +5,13 @@
 
 #include "harmonic.h"
 
+#define _LENSING_DXX_VERSION_ 1       /* version of the format of the cache files of lensing_dxx_get() */
+#define _LENSING_DXX_HEADER_SIZE_ 128 /* bytes reserved for the header of a cache file, keeping the arrays aligned */
+#define _LENSING_DXX_LANES_ 8         /* number of values of mu going together through the recurrences of lensing_dxx() */
+#if defined(__unix__) || defined(__APPLE__)
+#define _LENSING_DXX_MMAP_            /* cache files can be memory-mapped */
+#endif
+
 /**
  * Structure containing everything about lensed spectra that other modules need to know.
  *
@@ -89,11 +96,69 @@ struct lensing {
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to lensing_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
 
   //@}
 };
 
+/**
+ * Values of \f$ \mu \f$, quadrature weights and tables of \f$
+ * d^l_{mm'}(\mu) \f$ used by lensing_init(). They depend only on
+ * l_unlensed_max and on the lensing precision parameters, so that
+ * they can be shared by successive runs (see lensing_dxx_get()).
+ */
+
+struct lensing_dxx {
+
+  int accurate_lensing;      /**< value of ppr->accurate_lensing */
+  int num_mu;                /**< number of values of \f$ \mu \f$ (the last one is \f$ \mu=1 \f$) */
+  int l_unlensed_max;        /**< last multipole in tables */
+  double tol_gauss_legendre; /**< value of ppr->tol_gauss_legendre */
+
+  short has_d_te;  /**< are d20, d3m1, d4m2 (needed for TE) computed? */
+  short has_d_pol; /**< are d22, d31, d3m3, d40, d4m4 (needed for EE, BB) computed? */
+
+  double * buf;    /**< contiguous buffer holding all arrays below, as in the cache files (after the header) */
+  double * mu;     /**< mu[index_mu] */
+  double * w8;     /**< w8[index_mu], num_mu-1 quadrature weights */
+  double * d00;    /**< d00[index_mu*(l_unlensed_max+1)+l], and similarly for the other tables (NULL if not computed) */
+  double * d11;
+  double * d1m1;
+  double * d2m2;
+  double * d20;
+  double * d3m1;
+  double * d4m2;
+  double * d22;
+  double * d31;
+  double * d3m3;
+  double * d40;
+  double * d4m4;
+
+  int users;       /**< number of calls to lensing_init() currently using these tables */
+  short is_cached; /**< are these tables kept for the next runs? */
+  void * map;      /**< if not NULL, buf points into this read-only mapping of a cache file */
+  size_t map_size; /**< size of the mapping */
+};
+
+/* Header of the cache files of struct lensing_dxx: the arrays follow at
+   offset _LENSING_DXX_HEADER_SIZE_, as mu[num_mu], w8[num_mu-1], then
+   d00, d11, d1m1, d2m2, (d20, d3m1, d4m2), (d22, d31, d3m3, d40, d4m4) */
+struct lensing_dxx_cache_header {
+  char magic[8];             /**< "CLASSDXX" */
+  int version;               /**< _LENSING_DXX_VERSION_ */
+  int size_of_int;
+  int size_of_double;
+  int accurate_lensing;
+  int num_mu;
+  int l_unlensed_max;
+  int has_d_te;
+  int has_d_pol;
+  double one;                /**< 1.0, to detect files written with another byte order */
+  double tol_gauss_legendre;
+};
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -109,6 +174,13 @@ extern "C" {
                       double * cl_lensed
                       );
 
+  int lensing_cl_at_l_range(
+                            struct lensing * ple,
+                            int l_min,
+                            int l_max,
+                            double * cl_lensed
+                            );
+
   int lensing_init(
                    struct precision * ppr,
                    struct perturbations * ppt,
@@ -127,11 +199,106 @@ extern "C" {
                       struct lensing * ple
                       );
 
+  int lensing_dxx_get(
+                      struct precision * ppr,
+                      struct lensing * ple,
+                      int num_mu,
+                      short need_d_te,
+                      short need_d_pol,
+                      struct lensing_dxx ** ppdxx
+                      );
+
+  int lensing_dxx_release(
+                          struct lensing_dxx * pdxx
+                          );
+
+  int lensing_dxx_cache_clear(void);
+
+  int lensing_dxx_compute(
+                          struct precision * ppr,
+                          struct lensing_dxx * pdxx,
+                          ErrorMsg error_message
+                          );
+
+  int lensing_quadrature(
+                         struct precision * ppr,
+                         int num_mu,
+                         double * mu,
+                         double * w8,
+                         ErrorMsg error_message
+                         );
+
+  int lensing_dxx_block(
+                        double * mu,
+                        int index_mu_start,
+                        int index_mu_end,
+                        int lmax,
+                        double * buf,
+                        double ** d00,
+                        double ** d11,
+                        double ** d1m1,
+                        double ** d2m2,
+                        double ** d20,
+                        double ** d3m1,
+                        double ** d4m2,
+                        double ** d22,
+                        double ** d31,
+                        double ** d3m3,
+                        double ** d40,
+                        double ** d4m4
+                        );
+
+  int lensing_dxx_free(
+                       struct lensing_dxx * pdxx
+                       );
+
+  size_t lensing_dxx_size(
+                          struct lensing_dxx * pdxx
+                          );
+
+  int lensing_dxx_set_pointers(
+                               struct lensing_dxx * pdxx
+                               );
+
+  int lensing_dxx_cache_file_name(
+                                  struct precision * ppr,
+                                  struct lensing_dxx * pdxx,
+                                  char * file_name,
+                                  ErrorMsg error_message
+                                  );
+
+  int lensing_dxx_cache_map(
+                            char * file_name,
+                            struct lensing_dxx * pdxx,
+                            short need_d_te,
+                            short need_d_pol,
+                            short * has_map
+                            );
+
+  int lensing_dxx_cache_write(
+                              char * cache_directory,
+                              char * file_name,
+                              struct lensing_dxx * pdxx
+                              );
+
+  int lensing_cgl(
+                  struct lensing * ple,
+                  int index_mu_start,
+                  int index_mu_end,
+                  double * cl_pp,
+                  double ** d11,
+                  double ** d1m1,
+                  double * Cgl,
+                  double * Cgl2
+                  );
+
   int lensing_lensed_cl_tt(
                            double *ksi,
                            double **d00,
                            double *w8,
-                           int nmu,
+                           int index_mu_start,
+                           int index_mu_end,
+                           double * sum,
                            struct lensing * ple
                            );
 
@@ -139,7 +306,9 @@ extern "C" {
                            double *ksiX,
                            double **d20,
                            double *w8,
-                           int nmu,
+                           int index_mu_start,
+                           int index_mu_end,
+                           double * sum,
                            struct lensing * ple
                            );
 
@@ -149,7 +318,9 @@ extern "C" {
                               double **d22,
                               double **d2m2,
                               double *w8,
-                              int nmu,
+                              int index_mu_start,
+                              int index_mu_end,
+                              double * sum,
                               struct lensing * ple
                               );
   int lensing_addback_cl_tt(
@@ -233,6 +404,37 @@ extern "C" {
                    double ** X242
                    );
 
+  int lensing_dxx_prefactors(
+                             int lmax,
+                             double * fac
+                             );
+
+  int lensing_dxx_lanes(
+                        double * mu,
+                        int num_lanes,
+                        int lmax,
+                        double * fac,
+                        double *** dxx
+                        );
+
+  int lensing_dxx(
+                  double * mu,
+                  int num_mu,
+                  int lmax,
+                  double ** d00,
+                  double ** d11,
+                  double ** d1m1,
+                  double ** d2m2,
+                  double ** d20,
+                  double ** d3m1,
+                  double ** d4m2,
+                  double ** d22,
+                  double ** d31,
+                  double ** d3m3,
+                  double ** d40,
+                  double ** d4m4
+                  );
+
   int lensing_d00(
                   double * mu,
                   int num_mu,
@@ -0,0 +1,65 @@
+/** @file modules.h Documented includes for running the init functions of all modules */
+
+#ifndef __MODULES__
+#define __MODULES__
+
+#include "lensing.h"
+#include "distortions.h"
+
+/**
+ * The modules computed by modules_init(), in the order of the
+ * sequential runs. The argument modules of modules_init() is a
+ * combination of the flags (1 << module_xxx).
+ */
+
+enum class_module {
+  module_background,
+  module_thermodynamics,
+  module_perturbations,
+  module_primordial,
+  module_fourier,
+  module_transfer,
+  module_harmonic,
+  module_lensing,
+  module_distortions,
+  module_size          /**< number of modules */
+};
+
+#define _ALL_MODULES_ ((1 << module_size) - 1) /**< flags of all the modules */
+
+/*************************************************************************************************************/
+/* @cond INCLUDE_WITH_DOXYGEN */
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int modules_init(
+                   struct precision * ppr,
+                   struct background * pba,
+                   struct thermodynamics * pth,
+                   struct perturbations * ppt,
+                   struct primordial * ppm,
+                   struct fourier * pfo,
+                   struct transfer * ptr,
+                   struct harmonic * phr,
+                   struct lensing * ple,
+                   struct distortions * psd,
+                   int modules,
+                   int * computed,
+                   ErrorMsg error_message
+                   );
+
+  unsigned int modules_dependencies(
+                                    struct fourier * pfo,
+                                    int index_module
+                                    );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+/* @endcond */
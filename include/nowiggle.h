@@ -0,0 +1,67 @@
+/**
+ * definitions for module nowiggle.c
+ */
+
+#ifndef __NOWIGGLE__
+#define __NOWIGGLE__
+
+#include "common.h"
+
+/**
+ * Plan for the decomposition of power spectra into a wiggle and a
+ * nowiggle part on a given uniform grid of ln(k), relative to a given
+ * smooth reference spectrum (see nowiggle_plan_init())
+ */
+
+struct nowiggle_plan {
+  int n;                     /**< number of points of the grid */
+  int N;                     /**< size of the zero-padded FFT, power of 2 */
+  double * lnk;              /**< lnk[i] = ln(k) on the uniform grid */
+  double * lnpk_ref;         /**< lnpk_ref[i] = ln(P_ref(k)) of the smooth reference spectrum on this grid */
+  double * kernel;           /**< kernel[m] = discrete Fourier transform of the Gaussian weights, for 0 <= m < N (real, since they are symmetric) */
+  double * norm;             /**< norm[i] = inverse of the sum of the weights of the grid points around point i */
+  int i_min;                 /**< points i_min <= i <= i_max are smoothed, the other ones are closer to the ends than nsig*sigma */
+  int i_max;
+  double * twiddle;          /**< exp(-2 i pi m/N) for 0 <= m < N/2, as (real, imaginary) pairs */
+};
+
+/**
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int nowiggle_plan_init(
+                         struct nowiggle_plan * pnp,
+                         int n,
+                         double lnk_min,
+                         double lnk_max,
+                         double sigma,
+                         double * lnk_ref,
+                         double * lnpk_ref,
+                         double * ddlnpk_ref,
+                         int ref_size,
+                         ErrorMsg error_message
+                         );
+
+  int nowiggle_split(
+                     struct nowiggle_plan * pnp,
+                     double * lnk,
+                     double * lnpk,
+                     double * ddlnpk,
+                     int k_size,
+                     double * pk_nw,
+                     double * pk_w,
+                     ErrorMsg error_message
+                     );
+
+  int nowiggle_plan_free(
+                         struct nowiggle_plan * pnp
+                         );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
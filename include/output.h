@@ -6,6 +6,7 @@
 #include "common.h"
 #include "lensing.h"
 #include "distortions.h"
+#include "input.h"
 
 /**
  * Maximum number of values of redshift at which the spectra will be
@@ -45,6 +46,8 @@ struct output {
 
   enum file_format output_format; /**< which format for output files (definitions, order of columns, etc.) */
 
+  short write_npy; /**< flag for writing the tables in binary .npy files instead of text .dat files */
+
   short write_background; /**< flag for outputing background evolution in file */
   short write_thermodynamics; /**< flag for outputing thermodynamical evolution in file */
   short write_perturbations; /**< flag for outputing perturbations of selected wavenumber(s) in file(s) */
@@ -52,6 +55,19 @@ struct output {
   short write_exotic_injection; /**< flag for outputing exotic energy injection/deposition in files */
   short write_noninjection; /**< flag for outputing non-injected contributions in files */
   short write_distortions; /**< flag for outputing spectral distortions in files */
+  short write_timings; /**< flag for outputing the timings and counters of the modules in a file */
+  short write_trace; /**< flag for recording the tasks of the parallel regions and outputing them in a Chrome trace file */
+
+  //@}
+
+  /** @name - binary checkpoints of the computed modules (see checkpoint.h) */
+
+  //@{
+
+  short write_checkpoint; /**< flag for saving the computed modules in the checkpoint file <root>checkpoint.bin */
+  FileName checkpoint_file; /**< checkpoint file from which the modules are restored instead of being computed (empty for none) */
+  int checkpoint_modules; /**< flags (1 << module_xxx) of the modules which can be restored from checkpoint_file (those before restart_from) */
+  unsigned long long digest[_NUM_INPUT_MODULES_]; /**< digests of the input of each module (see input_module_digests()), set when a checkpoint is written or read */
 
   //@}
 
@@ -152,10 +168,55 @@ extern "C" {
                          struct output * pop
                          );
 
-  int output_print_data(FILE *out,
+  int output_timings(
+                     struct background * pba,
+                     struct thermodynamics * pth,
+                     struct perturbations * ppt,
+                     struct primordial * ppm,
+                     struct transfer * ptr,
+                     struct harmonic * phr,
+                     struct fourier * pfo,
+                     struct lensing * ple,
+                     struct distortions * psd,
+                     struct output * pop
+                     );
+
+  int output_open_file(
+                       struct output * pop,
+                       FILE ** file,
+                       FileName filename,
+                       ErrorMsg error_message
+                       );
+
+  int output_print_data(struct output * pop,
+                        FILE *out,
                         char titles[_MAXTITLESTRINGLENGTH_],
                         double *dataptr,
                         int tau_size);
+
+  int output_print_titles(struct output * pop,
+                          FILE *out,
+                          char titles[_MAXTITLESTRINGLENGTH_],
+                          int rows);
+
+  int output_print_rows(struct output * pop,
+                        FILE *out,
+                        int number_of_titles,
+                        double *dataptr,
+                        int size_dataptr);
+
+  int output_print_streamed_data(struct output * pop,
+                                 FILE *out,
+                                 char titles[_MAXTITLESTRINGLENGTH_],
+                                 FILE *tmp_file,
+                                 double *dataptr,
+                                 int size_dataptr,
+                                 ErrorMsg error_message);
+
+  int output_npy_header(FILE *out,
+                        char titles[_MAXTITLESTRINGLENGTH_],
+                        int rows);
+
   int output_open_cl_file(
                           struct harmonic * phr,
                           struct output * pop,
@@ -186,11 +247,19 @@ extern "C" {
                           );
 
   int output_one_line_of_pk(
+                            struct output * pop,
                             FILE * tkfile,
                             double one_k,
                             double one_pk
                             );
 
+  int output_write_double(
+                          struct output * pop,
+                          FILE * file,
+                          double value,
+                          short condition
+                          );
+
 #ifdef __cplusplus
 }
 #endif
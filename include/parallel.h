@@ -19,29 +19,47 @@
 // 'declare_list_of_variables-inside_parallel_region' due to the peculiarities
 // of the C++ preprocessor macros. See examples e.g.
 // in source/perturbations.c, source/lensing.c, or tools/hypershperical.c
-#define class_run_parallel(arg1, arg2) future_output.push_back(task_system.AsyncTask([arg1] () {arg2}));
+#define class_run_parallel(arg1, arg2) task_system.Run([arg1] () {arg2});
 // The mutable version allows one to change variables outside the scope of the parallel region
 // Be careful, this is very dangerous, and you should be sure that you don't access any
 // variables you edit during the parallel region outside of it, as that value will be random
-#define class_run_parallel_mutable(arg1, arg2) future_output.push_back(task_system.AsyncTask([arg1] () mutable {arg2}));
+#define class_run_parallel_mutable(arg1, arg2) task_system.Run([arg1] () mutable {arg2});
+
+// To be called instead of a loop calling class_run_parallel() once per index, for index from
+// begin to end-1 (the loop itself being replaced by this call). The index is passed to the body,
+// which is otherwise written as for class_run_parallel() (with the index removed from the list of
+// captured arguments), and returns _SUCCESS_ or _FAILURE_ for each index. The loop is split into
+// a few tasks per thread, which take chunks of consecutive indices of decreasing size (guided
+// scheduling), of at least grain indices (0 for automatic). class_finish_parallel() must then be
+// called as for class_run_parallel().
+#define class_parallel_for(index, begin, end, grain, arg1, arg2) task_system.ParallelFor(begin, end, grain, [arg1] (int index) {arg2});
 
 // To be called ONLY ONCE without arguments before the intended parallel loop(s).
+// The tasks are sent to the process-wide pool (see Tools::TaskSystem::Shared()),
+// unless the shared pool has been detached with class_parallel_detach()
 #define class_setup_parallel()                    \
-Tools::TaskSystem task_system;                    \
-std::vector<std::future<int>> future_output;
+Tools::TaskScope task_system;
+
+// Optional, to be called just before class_run_parallel(): name the next task in the traces
+// of the task system (see class_parallel_trace_start()). The label must be a string literal
+// such as "perturbations:index_k", the index the corresponding loop index.
+#define class_label_parallel(label, index) task_system.SetLabel(label, index)
 
 // To be called ONLY ONCE without arguments before the intended parallel loop(s).
+// When is_multi_threaded is false, the tasks are executed directly by the calling thread
 #define class_setup_parallel_optional(is_multi_threaded) \
-Tools::TaskSystem task_system{ (is_multi_threaded) ? Tools::TaskSystem::GetNumThreads() : 1 }; \
-std::vector<std::future<int>> future_output;
+Tools::TaskScope task_system{ (is_multi_threaded) };
 
 // To be called without arguments AFTER ANY parallel loop in order to actually execute the jobs.
 // NEEDS TO BE CALLED BEFORE USING THE RESULTS!
+// All tasks are waited for before returning, even if one of them failed, since with a shared
+// pool they could otherwise still be running on data that the caller is about to free. After a
+// failure however, the tasks of the region (and of the regions nested in them) which have not
+// started yet are skipped, and long computations stop early (see class_parallel_cancelled()).
 #define class_finish_parallel()                   \
-for (std::future<int>& future : future_output) {  \
-  if(future.get()!=_SUCCESS_) return _FAILURE_;   \
-}                                                 \
-future_output.clear();
+{                                                 \
+  if (task_system.WaitAll() != _SUCCESS_) return _FAILURE_; \
+}
 
 //
 //  thread_pool.h
@@ -52,11 +70,56 @@ future_output.clear();
 //
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
+
+/**
+ * C interface to the process-wide thread pool shared by all modules.
+ * The pool is created lazily at the first parallel region, and then lives
+ * until the end of the process (or until it is detached), such that the
+ * thread startup cost is paid only once when CLASS is run many times.
+ */
+
+/**
+ * Placement of the workers of the pools on the cores, selected with the
+ * environment variable CLASS_AFFINITY (none, compact or spread) or with
+ * class_parallel_set_affinity(). With compact, the successive workers are
+ * pinned to the successive cores allowed to the process; with spread, they
+ * alternate between the NUMA nodes. The big tables filled by the workers
+ * are then also first-touched in parallel (see class_parallel_first_touch()).
+ */
+enum class_affinity {affinity_none, affinity_compact, affinity_spread};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  int class_parallel_attach(int num_threads);
+  int class_parallel_detach();
+  int class_parallel_get_num_threads();
+  int class_parallel_is_attached();
+  int class_parallel_attach_thread(int num_threads);
+  int class_parallel_attach_thread_share(int num_instances);
+  int class_parallel_set_budget(int num_threads);
+  int class_parallel_get_budget();
+  int class_parallel_set_affinity(int policy);
+  int class_parallel_get_affinity();
+  void class_parallel_pin_worker();
+  int class_parallel_first_touch(void * array, size_t size);
+  int class_parallel_trace_start();
+  int class_parallel_trace_stop();
+  int class_parallel_trace_write(char * filename, char * error_message);
+  int class_parallel_cancelled();
+#ifdef __cplusplus
+}
+#endif
+
+#ifdef __cplusplus
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
 #include <condition_variable>
+#include <cstring>
 #include <deque>
-#include <functional>
-#include <future>
 #include <mutex>
 #include <thread>
 #include <utility>
@@ -64,80 +127,198 @@ future_output.clear();
 
 namespace Tools {
 
-class NotificationQueue {
-public:
-  bool TryPop(std::function<void()>& x) {
-    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
-    if (!lock || queue_.empty()) {
-      return false;
+/* A task of a parallel region: the callable is stored in the task itself,
+   which is the only allocation per task, and its completion is counted
+   down in the TaskCompletion of its region instead of going through a
+   future */
+struct TaskCompletion {
+  std::atomic<int> pending{0};
+  std::atomic<int> status{_SUCCESS_};
+  /* region of the task which opened this one, if any: it outlives this
+     region, since that task waits for this region before returning */
+  TaskCompletion* parent = nullptr;
+
+  /* Whether a task of this region, or of a region enclosing it, has failed */
+  bool Cancelled() const {
+    for (const TaskCompletion* region = this; region != nullptr; region = region->parent) {
+      if (region->status.load(std::memory_order_relaxed) != _SUCCESS_) {
+        return true;
+      }
     }
-    x = std::move(queue_.front());
-    queue_.pop_front();
-    return true;
+    return false;
+  }
+
+  /* Region of the task being executed by the calling thread */
+  static TaskCompletion*& Current() {
+    static thread_local TaskCompletion* current = nullptr;
+    return current;
   }
+};
+
+class Task {
+public:
+  virtual ~Task() {}
+  virtual void Execute() = 0;
+};
 
-  bool Pop(std::function<void()>& x) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    while (queue_.empty() && !done_) {
-      ready_.wait(lock);
+template<typename F>
+class RegionTask : public Task {
+public:
+  RegionTask(F&& f, TaskCompletion* completion)
+  : f_(std::forward<F>(f))
+  , completion_(completion) {}
+
+  void Execute() {
+    int status = _FAILURE_;
+    /* the tasks of a cancelled region are skipped (see class_parallel_cancelled()) */
+    if (!completion_->Cancelled()) {
+      TaskCompletion* current = TaskCompletion::Current();
+      int muted = class_mute_error_messages(_FALSE_);
+      TaskCompletion::Current() = completion_;
+      try {
+        status = f_();
+      }
+      catch (...) {
+      }
+      TaskCompletion::Current() = current;
+      class_mute_error_messages(muted);
     }
-    if (queue_.empty()) {
-      return false;
+    if (status != _SUCCESS_) {
+      completion_->status.store(_FAILURE_, std::memory_order_relaxed);
     }
-    x = std::move(queue_.front());
-    queue_.pop_front();
-    return true;
+    /* last access to the region, which may be gone right after */
+    completion_->pending.fetch_sub(1, std::memory_order_release);
   }
 
-  template<typename F>
-  bool TryPush(F&& f) {
-    {
-      std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
-      if (!lock) {
-        return false;
-      }
-      queue_.emplace_back(std::forward<F>(f));
+private:
+  typename std::decay<F>::type f_;
+  TaskCompletion* completion_;
+};
+
+/* Chase-Lev work-stealing deque (in the formulation of Le, Pop, Cohen and
+   Zappa Nardelli, PPoPP 2013): the owning worker pushes and pops at the
+   bottom without any lock, the other threads steal from the top with one
+   compare-and-swap. The array grows when it is full; the old arrays are
+   kept until the deque is destroyed, since a thief may still read them. */
+class WorkStealingDeque {
+public:
+  WorkStealingDeque()
+  : top_(0)
+  , bottom_(0)
+  , array_(new Array(64)) {}
+
+  ~WorkStealingDeque() {
+    delete array_.load(std::memory_order_relaxed);
+    for (Array* a : old_arrays_) delete a;
+  }
+
+  /* owner only */
+  void Push(Task* task) {
+    long b = bottom_.load(std::memory_order_relaxed);
+    long t = top_.load(std::memory_order_acquire);
+    Array* a = array_.load(std::memory_order_relaxed);
+    if (b - t > a->size - 1) {
+      a = Grow(a, t, b);
     }
-    ready_.notify_one();
-    return true;
+    a->Put(b, task);
+    bottom_.store(b + 1, std::memory_order_release);
   }
 
-  template<typename F>
-  void Push(F&& f) {
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      queue_.emplace_back(std::forward<F>(f));
+  /* owner only */
+  Task* Pop() {
+    long b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long t = top_.load(std::memory_order_relaxed);
+    Task* task = nullptr;
+    if (t <= b) {
+      task = a->Get(b);
+      if (t == b) {
+        /* last task: race against the thieves */
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+          task = nullptr;
+        }
+        bottom_.store(b + 1, std::memory_order_relaxed);
+      }
+    }
+    else {
+      bottom_.store(b + 1, std::memory_order_relaxed);
     }
-    ready_.notify_one();
+    return task;
   }
 
-  void Done() {
-    {
-      std::unique_lock<std::mutex> lock(mutex_);
-      done_ = true;
+  /* any thread; nullptr when empty or when another thread won the race */
+  Task* Steal() {
+    long t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long b = bottom_.load(std::memory_order_acquire);
+    if (t < b) {
+      Array* a = array_.load(std::memory_order_acquire);
+      Task* task = a->Get(t);
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+      }
+      return task;
     }
-    ready_.notify_all();
+    return nullptr;
   }
+
+  bool Empty() const {
+    return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+  }
+
 private:
-  std::deque<std::function<void()>> queue_;
-  bool done_ = false;
-  std::mutex mutex_;
-  std::condition_variable ready_;
+  struct Array {
+    long size;
+    std::unique_ptr<std::atomic<Task*>[]> items;
+    explicit Array(long n) : size(n), items(new std::atomic<Task*>[n]) {}
+    Task* Get(long i) { return items[i & (size - 1)].load(std::memory_order_relaxed); }
+    void Put(long i, Task* task) { items[i & (size - 1)].store(task, std::memory_order_relaxed); }
+  };
+
+  Array* Grow(Array* a, long t, long b) {
+    Array* bigger = new Array(2 * a->size);
+    for (long i = t; i < b; i++) bigger->Put(i, a->Get(i));
+    old_arrays_.push_back(a);
+    array_.store(bigger, std::memory_order_release);
+    return bigger;
+  }
+
+  /* on separate cache lines, since the owner and the thieves write them */
+  alignas(64) std::atomic<long> top_;
+  alignas(64) std::atomic<long> bottom_;
+  std::atomic<Array*> array_;
+  std::vector<Array*> old_arrays_;
 };
 
+/* Pool of worker threads, each with its own WorkStealingDeque. The tasks
+   submitted by a worker go to its own deque; those submitted from outside
+   the pool go to an injection queue, from which the workers take them in
+   small batches. Idle workers spin shortly, then sleep until a new task is
+   submitted. */
 class TaskSystem {
 public:
-  TaskSystem(unsigned int count = GetNumThreads())
+  TaskSystem(unsigned int count = GetNumThreads(), bool bound = false)
   : count_(count)
-  , index_(0)
-  , queues_{count_} {
+  , bound_(bound)
+  , deques_(new WorkStealingDeque[count])
+  , injected_size_(0)
+  , sleepers_(0)
+  , epoch_(0)
+  , done_(false) {
     for (unsigned int n = 0; n < count_; ++n) {
       threads_.emplace_back([&, n]{ Run(n); });
     }
   }
 
   ~TaskSystem() {
-    for (auto& e : queues_) e.Done();
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      done_.store(true);
+      epoch_++;
+    }
+    sleep_ready_.notify_all();
     for (auto& e : threads_) e.join();
   }
 
@@ -155,78 +336,675 @@ public:
     return number_of_threads;
   }
 
-  template <typename F>
-  void Async(F&& f) {
-    auto i = index_++;
-    for (unsigned int n = 0; n < count_; ++n) {
-      if (queues_[(i + n) % count_].TryPush(std::forward<F>(f))) {
-        return;
-      }
+  /* Queue a task of a region, whose completion counter was already incremented */
+  void Submit(Task* task) {
+    if (WorkerPool() == this) {
+      deques_[WorkerIndex()].Push(task);
+    }
+    else {
+      std::lock_guard<std::mutex> lock(injection_mutex_);
+      injection_.push_back(task);
+      injected_size_.store(injection_.size(), std::memory_order_relaxed);
     }
-    queues_[i % count_].Push(std::forward<F>(f));
+    Notify();
   }
 
-  template<typename F>
-  std::future<typename std::result_of<F()>::type> AsyncTask(F&& f) {
-    using return_type = typename std::result_of<F()>::type;
-    auto task = std::make_shared<std::packaged_task<return_type()>>(f);
-    std::future<return_type> res = task->get_future();
+  unsigned int get_num_threads(){
+    return count_;
+  }
+
+  /* Execute one queued task in the calling thread, if there is any */
+  bool TryRunOne() {
+    Task* task = FindTask();
+    if (task == nullptr) {
+      return false;
+    }
+    task->Execute();
+    delete task;
+    return true;
+  }
 
-    auto work = [task](){ (*task)(); };
-    unsigned int i = index_++;
-    for(unsigned int n = 0; n < count_; ++n) {
-      if(queues_[(i + n) % count_].TryPush(work)){
-        return res;
+  /* Wait for all the tasks of a region, executing queued tasks in the
+     meantime. This is what makes nested parallel regions safe on the
+     shared pool: a worker waiting for its sub-tasks keeps on working
+     instead of blocking. */
+  void Wait(TaskCompletion& completion) {
+    unsigned int spins = 0;
+    while (completion.pending.load(std::memory_order_acquire) > 0) {
+      if (TryRunOne()) {
+        spins = 0;
+      }
+      else if (++spins < 64) {
+        std::this_thread::yield();
+      }
+      else {
+        std::this_thread::sleep_for(std::chrono::microseconds(20));
       }
     }
-    queues_[i % count_].Push(work);
+  }
 
-    return res;
+  /* The process-wide pool, created at first use */
+  static TaskSystem& Shared() {
+    SharedState& state = GetSharedState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (!state.pool) {
+      state.pool.reset(new TaskSystem((state.num_threads > 0) ? state.num_threads : GetNumThreads()));
+    }
+    return *state.pool;
+  }
+
+  static bool SharedIsAttached() {
+    return GetSharedState().attached;
   }
 
-  template<typename F, typename... Args>
-  std::future<typename std::result_of<F(Args...)>::type> AsyncTask(F&& f, Args&&... args) {
-    using return_type = typename std::result_of<F(Args...)>::type;
-    auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-    std::future<return_type> res = task->get_future();
+  /* Select the size of the shared pool (0 for the default from GetNumThreads()).
+     The present pool is only destroyed when its size has to change. This must
+     not be called while a parallel region is running. */
+  static void AttachShared(unsigned int num_threads) {
+    SharedState& state = GetSharedState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    unsigned int count = (num_threads > 0) ? num_threads : GetNumThreads();
+    if (state.pool && state.pool->get_num_threads() != count) {
+      state.pool.reset();
+    }
+    state.num_threads = num_threads;
+    state.attached = true;
+  }
+
+  /* Join the threads of the shared pool. Until the next AttachShared(),
+     each parallel region uses its own private pool. */
+  static void DetachShared() {
+    SharedState& state = GetSharedState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.pool.reset();
+    state.attached = false;
+  }
 
-    auto work = [task](){ (*task)(); };
-    unsigned int i = index_++;
-    for(unsigned int n = 0; n < count_; ++n) {
-      if(queues_[(i + n) % count_].TryPush(work)){
-        return res;
+  static unsigned int SharedNumThreads() {
+    SharedState& state = GetSharedState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.pool) {
+      return state.pool->get_num_threads();
+    }
+    return (state.num_threads > 0) ? state.num_threads : GetNumThreads();
+  }
+
+  /* Index of the worker executing the calling thread, or -1 outside of any pool */
+  static int CurrentWorker() {
+    return WorkerIndex();
+  }
+
+  /* Give the calling thread its own quota of num_threads threads, taken
+     from the budget (see AcquireThreads()), the calling thread being one of
+     them; num_threads = 0 goes back to the shared pool. The parallel regions
+     started from this thread, including the nested ones executed by the
+     workers of its pool, then use this pool instead of the shared one, or
+     run serially when a single thread was granted. The pool is kept, and
+     reused by the next runs of the same thread, until the quota changes or
+     the thread exits; a quota which was not fully granted is requested
+     again at each call. */
+  static void AttachThread(unsigned int num_threads) {
+    struct OwnedPool {
+      std::unique_ptr<TaskSystem> pool;
+      unsigned int requested = 0;
+      unsigned int granted = 0;
+      void Reset() {
+        pool.reset();
+        ReleaseThreads(granted);
+        requested = 0;
+        granted = 0;
       }
+      ~OwnedPool() { Reset(); }
+    };
+    static thread_local OwnedPool owned;
+    if (num_threads == 0) {
+      owned.Reset();
     }
-    queues_[i % count_].Push(work);
+    else if (owned.requested != num_threads || owned.granted < num_threads) {
+      owned.Reset();
+      owned.requested = num_threads;
+      owned.granted = AcquireThreads(num_threads);
+      if (owned.granted > 1) {
+        owned.pool.reset(new TaskSystem(owned.granted - 1, true));
+      }
+    }
+    BoundPool() = owned.pool.get();
+    BoundThreads() = owned.granted;
+  }
 
-    return res;
+  /* The pool attached to the calling thread (or to the pool it works for)
+     with AttachThread(), or nullptr */
+  static TaskSystem*& BoundPool() {
+    static thread_local TaskSystem* pool = nullptr;
+    return pool;
   }
 
-  unsigned int get_num_threads(){
-    return count_;
+  /* The number of threads granted to the calling thread by AttachThread()
+     (1 when its parallel regions run serially), or 0 */
+  static unsigned int& BoundThreads() {
+    static thread_local unsigned int num_threads = 0;
+    return num_threads;
+  }
+
+  /* The budget of threads shared by the pools attached to the threads of
+     the caller (AttachThread()) and by the private pools of the parallel
+     regions (when the shared pool is detached). Each of them is granted its
+     threads when it is created, in the order of the requests, and gives
+     them back when it is destroyed: several instances of CLASS running side
+     by side thus never start more threads than the budget in total, instead
+     of one full-size pool each. The thread requesting a quota counts as one
+     of the threads granted, and always gets at least this one. */
+  static unsigned int AcquireThreads(unsigned int num_threads) {
+    BudgetState& budget = GetBudgetState();
+    std::lock_guard<std::mutex> lock(budget.mutex);
+    unsigned int total = (budget.total > 0) ? budget.total : GetNumThreads();
+    unsigned int available = (budget.used < total) ? total - budget.used : 0;
+    unsigned int granted = std::max(1u, std::min(num_threads, available));
+    budget.used += granted;
+    return granted;
+  }
+
+  static void ReleaseThreads(unsigned int num_threads) {
+    BudgetState& budget = GetBudgetState();
+    std::lock_guard<std::mutex> lock(budget.mutex);
+    budget.used -= std::min(num_threads, budget.used);
+  }
+
+  /* Set the budget (0 for the default from GetNumThreads()). The threads
+     already granted are not affected. */
+  static void SetBudget(unsigned int num_threads) {
+    BudgetState& budget = GetBudgetState();
+    std::lock_guard<std::mutex> lock(budget.mutex);
+    budget.total = num_threads;
+  }
+
+  static unsigned int Budget() {
+    BudgetState& budget = GetBudgetState();
+    std::lock_guard<std::mutex> lock(budget.mutex);
+    return (budget.total > 0) ? budget.total : GetNumThreads();
   }
 
 private:
+  static int& WorkerIndex() {
+    static thread_local int index = -1;
+    return index;
+  }
+
+  struct SharedState {
+    std::mutex mutex;
+    std::unique_ptr<TaskSystem> pool;
+    unsigned int num_threads = 0;
+    std::atomic<bool> attached{true};
+  };
+
+  static SharedState& GetSharedState() {
+    static SharedState state;
+    return state;
+  }
+
+  struct BudgetState {
+    std::mutex mutex;
+    unsigned int total = 0;
+    unsigned int used = 0;
+  };
+
+  /* never destroyed, since the pools of the threads may give their threads back after the static objects are destroyed at exit */
+  static BudgetState& GetBudgetState() {
+    static BudgetState* state = new BudgetState;
+    return *state;
+  }
+
+  /* The pool of which the calling thread is a worker, or nullptr */
+  static TaskSystem*& WorkerPool() {
+    static thread_local TaskSystem* pool = nullptr;
+    return pool;
+  }
+
+  /* Wake up one sleeping worker, if any. The fence pairs with the one of
+     a worker going to sleep (Run()): either the worker sees the new task
+     when it looks for one a last time, or this thread sees it sleeping. */
+  void Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) > 0) {
+      {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        epoch_++;
+      }
+      sleep_ready_.notify_one();
+    }
+  }
+
+  /* Take the oldest task of the injection queue. A worker also moves a
+     share of the following ones to its own deque, where the others can
+     steal them without going through the lock. */
+  Task* TakeInjected() {
+    if (injected_size_.load(std::memory_order_relaxed) == 0) {
+      return nullptr;
+    }
+    Task* task = nullptr;
+    size_t moved = 0;
+    {
+      std::lock_guard<std::mutex> lock(injection_mutex_);
+      if (injection_.empty()) {
+        return nullptr;
+      }
+      task = injection_.front();
+      injection_.pop_front();
+      if (WorkerPool() == this) {
+        moved = std::min<size_t>(injection_.size() / count_, 32);
+        for (size_t n = 0; n < moved; n++) {
+          deques_[WorkerIndex()].Push(injection_.front());
+          injection_.pop_front();
+        }
+      }
+      injected_size_.store(injection_.size(), std::memory_order_relaxed);
+    }
+    if (moved > 0) {
+      Notify();
+    }
+    return task;
+  }
+
+  /* A task for the calling thread: from its own deque if it is a worker,
+     then from the injection queue, then stolen from the other workers */
+  Task* FindTask() {
+    Task* task = nullptr;
+    unsigned int first = 0;
+    if (WorkerPool() == this) {
+      task = deques_[WorkerIndex()].Pop();
+      first = (unsigned int)WorkerIndex() + 1;
+    }
+    if (task == nullptr) {
+      task = TakeInjected();
+    }
+    for (unsigned int n = 0; task == nullptr && n < count_; ++n) {
+      WorkStealingDeque& victim = deques_[(first + n) % count_];
+      /* retry when another thief won the race but tasks are left */
+      while (task == nullptr && !victim.Empty()) {
+        task = victim.Steal();
+      }
+    }
+    return task;
+  }
+
   void Run(unsigned int i) {
+    WorkerIndex() = (int)i;
+    WorkerPool() = this;
+    class_parallel_pin_worker();
+    if (bound_) BoundPool() = this;
+    unsigned int spins = 0;
     while (true) {
-      std::function<void()> f;
-      for (unsigned n = 0; n != count_; ++n) {
-        if (queues_[(i + n) % count_].TryPop(f)) {
-          break;
-        }
+      if (TryRunOne()) {
+        spins = 0;
+        continue;
+      }
+      if (++spins < 64) {
+        std::this_thread::yield();
+        continue;
       }
-      if (!f && !queues_[i].Pop(f)) {
+      /* go to sleep, unless a task was submitted in the meantime */
+      unsigned long epoch = epoch_.load();
+      sleepers_.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (TryRunOne()) {
+        sleepers_.fetch_sub(1);
+        spins = 0;
+        continue;
+      }
+      {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_ready_.wait(lock, [&]{ return epoch_.load() != epoch || done_.load(); });
+      }
+      sleepers_.fetch_sub(1);
+      if (done_.load()) {
         break;
       }
-      f();
+      spins = 0;
     }
   }
 
   const unsigned int count_;
+  const bool bound_;
   std::vector<std::thread> threads_;
-  std::atomic<unsigned int> index_;
-  std::vector<NotificationQueue> queues_;
+  std::unique_ptr<WorkStealingDeque[]> deques_;
+  std::mutex injection_mutex_;
+  std::deque<Task*> injection_;
+  std::atomic<size_t> injected_size_;
+  std::atomic<unsigned int> sleepers_;
+  std::atomic<unsigned long> epoch_;
+  std::atomic<bool> done_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_ready_;
+};
+
+/* Optional record of the tasks executed (see class_parallel_trace_start()).
+   Each thread writes the tasks it executes in its own ring buffer, without
+   any lock: only the last `capacity` tasks of each thread are kept. The
+   buffers are read once all the tasks have completed, and written as a
+   Chrome trace (readable by chrome://tracing or https://ui.perfetto.dev). */
+class TaskTrace {
+public:
+  struct Event {
+    const char* label;      /* label given with class_label_parallel(), or "task" */
+    int index;              /* its index, or the rank of the task in its parallel region */
+    int source;             /* buffer of the thread which enqueued the task */
+    long long flow;         /* identifier linking the enqueue to the execution */
+    long long enqueue_ns;
+    long long start_ns;
+    long long end_ns;
+  };
+
+  static const unsigned long long capacity = 1 << 16;
+
+  struct Buffer {
+    Event events[capacity];
+    std::atomic<unsigned long long> count{0};
+    int id;
+    int worker;             /* worker index of the owning thread, or -1 */
+  };
+
+  static bool Enabled() {
+    return GetState().enabled.load(std::memory_order_relaxed);
+  }
+
+  static long long Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /* The buffer of the calling thread, created at its first use. The buffers
+     are never freed, such that they survive the threads which wrote them. */
+  static Buffer& LocalBuffer() {
+    static thread_local Buffer* buffer = nullptr;
+    if (buffer == nullptr) {
+      State& state = GetState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+      state.buffers.emplace_back(new Buffer);
+      buffer = state.buffers.back().get();
+      buffer->id = (int)state.buffers.size();
+      buffer->worker = TaskSystem::CurrentWorker();
+    }
+    return *buffer;
+  }
+
+  /* Only the owning thread writes in a buffer: the release store of the
+     count publishes the event to the reader */
+  static void Record(const Event& event) {
+    Buffer& buffer = LocalBuffer();
+    unsigned long long n = buffer.count.load(std::memory_order_relaxed);
+    buffer.events[n % capacity] = event;
+    buffer.count.store(n + 1, std::memory_order_release);
+  }
+
+  static long long NextFlow() {
+    return ++GetState().flow;
+  }
+
+  /* Forget the previous events and start recording. This must not be called while a parallel region is running. */
+  static void Start() {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for (auto& buffer : state.buffers) buffer->count.store(0, std::memory_order_relaxed);
+    state.origin_ns = Now();
+    state.enabled.store(true, std::memory_order_relaxed);
+  }
+
+  static void Stop() {
+    GetState().enabled.store(false, std::memory_order_relaxed);
+  }
+
+  /* Write the recorded events as Chrome trace JSON, one track per thread */
+  static void Write(FILE* out) {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    const char* separator = "";
+    unsigned long long dropped = 0;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (auto& buffer : state.buffers) {
+      unsigned long long count = buffer->count.load(std::memory_order_acquire);
+      if (count == 0) continue;
+      if (buffer->worker >= 0)
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d (thread %d)\"}}", separator, buffer->id, buffer->worker, buffer->id);
+      else
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"caller (thread %d)\"}}", separator, buffer->id, buffer->id);
+      separator = ",\n";
+      unsigned long long first = (count > capacity) ? count - capacity : 0;
+      dropped += first;
+      for (unsigned long long n = first; n < count; n++) {
+        const Event& e = buffer->events[n % capacity];
+        const char* colon = std::strchr(e.label, ':');
+        int category_length = (colon != nullptr) ? (int)(colon - e.label) : (int)std::strlen(e.label);
+        fprintf(out, "%s{\"name\":\"%s=%d\",\"cat\":\"%.*s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"index\":%d,\"worker\":%d,\"queued_us\":%.3f}}",
+                separator, e.label, e.index, category_length, e.label, buffer->id,
+                1.e-3*(e.start_ns - state.origin_ns), 1.e-3*(e.end_ns - e.start_ns), e.index, buffer->worker, 1.e-3*(e.start_ns - e.enqueue_ns));
+        /* arrow from the thread which enqueued the task to its execution */
+        fprintf(out, ",\n{\"name\":\"enqueue\",\"cat\":\"%.*s\",\"ph\":\"s\",\"id\":%lld,\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+                category_length, e.label, e.flow, e.source, 1.e-3*(e.enqueue_ns - state.origin_ns));
+        fprintf(out, ",\n{\"name\":\"enqueue\",\"cat\":\"%.*s\",\"ph\":\"f\",\"bp\":\"e\",\"id\":%lld,\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+                category_length, e.label, e.flow, buffer->id, 1.e-3*(e.start_ns - state.origin_ns));
+      }
+    }
+    fprintf(out, "\n],\"otherData\":{\"dropped_events\":%llu}}\n", dropped);
+  }
+
+  /* The task executed in place of f, recording its start and end */
+  template<typename F>
+  struct Traced {
+    typename std::decay<F>::type f;
+    Event event;
+
+    struct Recorder {
+      Event& event;
+      Recorder(Event& e) : event(e) { event.start_ns = Now(); }
+      ~Recorder() { event.end_ns = Now(); Record(event); }
+    };
+
+    typename std::result_of<typename std::decay<F>::type()>::type operator()() {
+      Recorder recorder(event);
+      return f();
+    }
+  };
+
+  template<typename F>
+  static Traced<F> Wrap(F&& f, const char* label, int index) {
+    Traced<F> traced{std::forward<F>(f), Event()};
+    traced.event.label = label;
+    traced.event.index = index;
+    traced.event.source = LocalBuffer().id;
+    traced.event.flow = NextFlow();
+    traced.event.enqueue_ns = Now();
+    return traced;
+  }
+
+private:
+  struct State {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::atomic<bool> enabled{false};
+    std::atomic<long long> flow{0};
+    long long origin_ns = 0;
+  };
+
+  static State& GetState() {
+    static State state;
+    return state;
+  }
+};
+
+/* The object declared by class_setup_parallel(): it forwards the tasks of one
+   parallel region either to the pool of the calling thread (see
+   TaskSystem::AttachThread()), to the shared pool, to a private pool (when the
+   shared one is detached), or executes them directly (single-threaded) */
+class TaskScope {
+public:
+  TaskScope(bool is_multi_threaded = true)
+  : pool_(nullptr)
+  , granted_(0) {
+    if (is_multi_threaded && TaskSystem::BoundThreads() != 1) {
+      if (TaskSystem::BoundPool() != nullptr) {
+        pool_ = TaskSystem::BoundPool();
+      }
+      else if (TaskSystem::SharedIsAttached()) {
+        pool_ = &TaskSystem::Shared();
+      }
+      else {
+        /* the private pool takes whatever remains of the budget, such that nested regions do not oversubscribe the cores */
+        granted_ = TaskSystem::AcquireThreads(TaskSystem::GetNumThreads());
+        if (granted_ > 1) {
+          private_pool_.reset(new TaskSystem(granted_ - 1));
+          pool_ = private_pool_.get();
+        }
+      }
+    }
+    completion_.parent = TaskCompletion::Current();
+  }
+
+  /* the tasks still running may use the variables of the region (e.g. after an early return) */
+  ~TaskScope() {
+    WaitAll();
+    private_pool_.reset();
+    TaskSystem::ReleaseThreads(granted_);
+  }
+
+  template<typename F>
+  void Run(F&& f) {
+    const char* label = (label_ != nullptr) ? label_ : "task";
+    int index = (label_ != nullptr) ? label_index_ : num_tasks_;
+    label_ = nullptr;
+    num_tasks_++;
+    if (TaskTrace::Enabled()) {
+      Submit(TaskTrace::Wrap(std::forward<F>(f), label, index));
+    }
+    else {
+      Submit(std::forward<F>(f));
+    }
+  }
+
+  /* Same as Run(), but may also be called by the tasks of the region
+     themselves, e.g. to start the tasks which depend on them (the region
+     is only complete once these new tasks are done as well). The label is
+     then given explicitly. */
+  template<typename F>
+  void Spawn(const char* label, int index, F&& f) {
+    if (TaskTrace::Enabled()) {
+      Submit(TaskTrace::Wrap(std::forward<F>(f), label, index));
+    }
+    else {
+      Submit(std::forward<F>(f));
+    }
+  }
+
+  /* Run f(index) for index from begin to end-1 (see class_parallel_for()).
+     With a pool, a few tasks per thread (including the calling thread,
+     which helps in WaitAll()) take the chunks of indices from a shared
+     counter: each chunk is a fraction of the remaining indices, such that
+     the last chunks are small and balance the load. After a failure, the
+     chunks not yet started are skipped. */
+  template<typename F>
+  void ParallelFor(int begin, int end, int grain, F&& f) {
+    if (end <= begin) {
+      label_ = nullptr;
+      return;
+    }
+    if (grain < 1) {
+      grain = 1;
+    }
+    if (pool_ == nullptr) {
+      label_ = nullptr;
+      for (int index = begin; index < end; index++) {
+        if (completion_.Cancelled() || (f(index) != _SUCCESS_)) {
+          completion_.status.store(_FAILURE_, std::memory_order_relaxed);
+          break;
+        }
+      }
+      return;
+    }
+    struct Loop {
+      std::atomic<int> next;
+      int end;
+      int grain;
+      int num_parts;
+      typename std::decay<F>::type f;
+      Loop(int b, int e, int g, int p, F&& body) : next(b), end(e), grain(g), num_parts(p), f(std::forward<F>(body)) {}
+    };
+    int num_threads = (int)pool_->get_num_threads() + 1;
+    int num_tasks = std::min((end - begin + grain - 1) / grain, 2 * num_threads);
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>(begin, end, grain, 2 * num_threads, std::forward<F>(f));
+    const char* label = label_;
+    for (int n = 0; n < num_tasks; n++) {
+      if (label != nullptr) {
+        SetLabel(label, n);
+      }
+      Run([loop] () {
+        int start = loop->next.load(std::memory_order_relaxed);
+        while ((start < loop->end) && !TaskCompletion::Current()->Cancelled()) {
+          int chunk = std::min(std::max(loop->grain, (loop->end - start) / loop->num_parts), loop->end - start);
+          if (!loop->next.compare_exchange_weak(start, start + chunk, std::memory_order_relaxed)) {
+            continue;
+          }
+          for (int index = start; index < start + chunk; index++) {
+            if (loop->f(index) != _SUCCESS_) {
+              return _FAILURE_;
+            }
+          }
+          start = loop->next.load(std::memory_order_relaxed);
+        }
+        return _SUCCESS_;
+      });
+    }
+  }
+
+  /* Name the next task in the traces (see class_label_parallel()) */
+  void SetLabel(const char* label, int index) {
+    label_ = label;
+    label_index_ = index;
+  }
+
+  /* Wait for all the tasks submitted so far (see class_finish_parallel()),
+     and return _FAILURE_ if any of them failed */
+  int WaitAll() {
+    if (pool_ != nullptr) {
+      pool_->Wait(completion_);
+    }
+    int status = completion_.status.exchange(_SUCCESS_);
+    /* when the enclosing region is cancelled too, the caller unwinds silently */
+    if (status != _SUCCESS_) {
+      class_parallel_cancelled();
+    }
+    return status;
+  }
+
+  unsigned int get_num_threads() {
+    return (pool_ != nullptr) ? pool_->get_num_threads() : 1;
+  }
+
+  /* Whether the tasks are sent to a pool, or executed directly by the calling thread */
+  bool IsParallel() const {
+    return pool_ != nullptr;
+  }
+
+private:
+  template<typename F>
+  void Submit(F&& f) {
+    if (pool_ != nullptr) {
+      completion_.pending.fetch_add(1, std::memory_order_relaxed);
+      pool_->Submit(new RegionTask<F>(std::forward<F>(f), &completion_));
+    }
+    else {
+      RegionTask<F> task(std::forward<F>(f), &completion_);
+      completion_.pending.fetch_add(1, std::memory_order_relaxed);
+      task.Execute();
+    }
+  }
+
+  TaskCompletion completion_;
+  TaskSystem* pool_;
+  std::unique_ptr<TaskSystem> private_pool_;
+  unsigned int granted_;
+  const char* label_ = nullptr;
+  int label_index_ = 0;
+  int num_tasks_ = 0;
 };
 
 }
+#endif /* __cplusplus */
 #endif
@@ -15,6 +15,10 @@ struct file_content {
   FileArg * name;      /**< list of (size) names */
   FileArg * value;     /**< list of (size) values */
   short * read;        /**< set to _TRUE_ if this parameter is effectively read */
+  int index_size;      /**< size of the hash index of the names (0 as long as it has not been built by parser_find()) */
+  int index_entries;   /**< number of entries (size) when the index was built */
+  int * index;         /**< hash index with open addressing: position in the lists of the entry found in each slot, or -1 for empty slots */
+  short * multiple;    /**< set to _TRUE_ for the first of several entries with the same name */
 };
 
 /**************************************************************/
@@ -33,6 +37,13 @@ extern "C" {
 
   int parser_free(struct file_content * pfc);
 
+  int parser_find(struct file_content * pfc,
+                  char * name,
+                  int * index,
+                  ErrorMsg errmsg);
+
+  int parser_reset_index(struct file_content * pfc);
+
 
   int parser_read_file(char * filename,
                        struct file_content * pfc,
@@ -11,6 +11,18 @@
 
 #define _set_source_(index) ppt->sources[index_md][index_ic * ppt->tp_size[index_md] + index][index_tau * ppt->k_size[index_md] + index_k]
 
+/* macros: value of a source function (or of its second derivative in
+   time at late times) at a given position index of the table
+   ppt->sources[index_md][index_ic_tp] (or ppt->late_sources,
+   ppt->ddlate_sources), whatever the storage mode */
+#define _source_stored_value_(ppt,index_md,index_ic_tp,index,table)     \
+  ((ppt)->storage == sources_storage_double ?                           \
+   (ppt)->table[index_md][index_ic_tp][index] :                         \
+   (double)((ppt)->table##_float[index_md][index_ic_tp][index]))
+#define _source_value_(ppt,index_md,index_ic_tp,index) _source_stored_value_(ppt,index_md,index_ic_tp,index,sources)
+#define _late_source_value_(ppt,index_md,index_ic_tp,index) _source_stored_value_(ppt,index_md,index_ic_tp,index,late_sources)
+#define _ddlate_source_value_(ppt,index_md,index_ic_tp,index) _source_stored_value_(ppt,index_md,index_ic_tp,index,ddlate_sources)
+
 /**
  * flags for various approximation schemes
  * (tca = tight-coupling approximation,
@@ -43,6 +55,14 @@ enum tca_method {first_order_MB,first_order_CAMB,first_order_CLASS,second_order_
 enum rsa_method {rsa_null,rsa_MD,rsa_MD_with_reio,rsa_none};
 enum idr_method {idr_free_streaming,idr_fluid}; /* for the idm-idr case */
 enum rsa_idr_method {rsa_idr_none,rsa_idr_MD};  /* for the idm-idr case */
+enum k_schedule_method {k_schedule_reverse,k_schedule_cost}; /* order in which the wavenumbers are sent to the thread pool */
+
+/**
+ * storage of the tables of source functions, once they have been
+ * computed (and splined in time): in double or in single precision
+ */
+
+enum sources_storage {sources_storage_double, sources_storage_float};
 enum ufa_method {ufa_mb,ufa_hu,ufa_CLASS,ufa_none};
 enum ncdmfa_method {ncdmfa_mb,ncdmfa_hu,ncdmfa_CLASS,ncdmfa_none};
 enum tensor_methods {tm_photons_only,tm_massless_approximation,tm_exact};
@@ -80,6 +100,17 @@ enum selection_type {gaussian,tophat,dirac};
  */
 #define _MAX_NUMBER_OF_K_FILES_ 30
 
+/**
+ * Number of rows of each perturbation output table kept in memory in
+ * streaming mode (see perturbations_output_new_row())
+ */
+
+#define _PERTURBATIONS_OUTPUT_CHUNK_ 1024
+
+#define _MAX_NUMBER_OF_MODES_ 3 /**< scalars, vectors and tensors: size of the per-thread pool of workspaces */
+
+#define _MAX_NUMBER_OF_JACOBIAN_PATTERNS_ 64 /**< number of approximation schemes (and hierarchy lengths, see perturbations_find_l_max()) per mode for which a workspace keeps the sparsity pattern of the jacobian */
+
 //@}
 
 
@@ -150,6 +181,8 @@ struct perturbations
   int l_lss_max; /**< maximum l value for LSS \f$ C_l \f$'s (density and lensing potential in  bins) */
   double k_max_for_pk; /**< maximum value of k in 1/Mpc required for the output of P(k,z) and T(k,z) */
 
+  short want_lcmb_direct_limber; /**< Do we want to compute C_l^phiphi for l > ppr->l_switch_lcmb_direct_limber directly by a Limber integral over the times of the lensing source, skipping the CMB lensing potential in the transfer functions at these multipoles? (flat case only) */
+
   short want_lcmb_full_limber; /**< In general, do we want to use the full Limber scheme introduced in v3.2.2? With this full Limber scheme, the calculation of the CMB lensing potential spectrum C_l^phiphi for l > ppr->l_switch_limber is based on a new integration scheme. Compared to the previous scheme, which can be recovered by switching this parameter to _FALSE_, the new scheme uses a larger k_max and a coarser k-grid (or q-grid) than the CMB transfer function. The new scheme is used by default, because the old one is inaccurate at large l due to the too small k_max. */
 
   int selection_num;                            /**< number of selection functions
@@ -365,6 +398,9 @@ struct perturbations
   double * tau_sampling;    /**< array of tau values */
   int tau_size;             /**< number of values in this array */
 
+  double * pvecback_sampling;   /**< background quantities at each tau value, pvecback_sampling[index_tau*pba->bg_size_normal+index_bg] (common to all wavenumbers, used by perturbations_sources()) */
+  double * pvecthermo_sampling; /**< thermodynamics quantities at each tau value, pvecthermo_sampling[index_tau*pth->th_size+index_th] */
+
   double selection_min_of_tau_min; /**< used in presence of selection functions (for matter density, cosmic shear...) */
   double selection_max_of_tau_max; /**< used in presence of selection functions (for matter density, cosmic shear...) */
 
@@ -409,6 +445,14 @@ struct perturbations
                                 [index_ic * ppt->tp_size[index_md] + index_tp]
                                 [index_tau * ppt->k_size + index_k] */
 
+  enum sources_storage storage; /**< how the tables of source functions are stored once computed. If not in double precision, the tables of ppt->sources and ppt->ddlate_sources are freed (and set to NULL) and replaced by the arrays below; use _source_value_() to read them in any case */
+
+  float *** sources_float;        /**< ppt->sources in single precision (float storage) */
+  float *** late_sources_float;   /**< pointers to the late times of ppt->sources_float, as ppt->late_sources (float storage) */
+  float *** ddlate_sources_float; /**< ppt->ddlate_sources in single precision (float storage) */
+
+  double storage_error; /**< largest error on a source function caused by the storage mode, relative to the maximum of its absolute value over time and wavenumber (for the same mode, initial condition and type) */
+
   //@}
 
   /** @name - arrays storing the evolution of all sources for given k values, passed as k_output_values */
@@ -434,6 +478,24 @@ struct perturbations
   int size_vector_perturbation_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of sizes of vector double pointers  */
   int size_tensor_perturbation_data[_MAX_NUMBER_OF_K_FILES_]; /**< Array of sizes of tensor double pointers  */
 
+  short stream_perturbations; /**< if _TRUE_, the arrays above only contain the last rows, the previous ones having been moved by chunks to the temporary files below */
+
+  FILE * scalar_perturbations_file[_MAX_NUMBER_OF_K_FILES_]; /**< Array of temporary files with the first rows of scalar perturbation output in streaming mode (or NULL) */
+  FILE * vector_perturbations_file[_MAX_NUMBER_OF_K_FILES_]; /**< Array of temporary files with the first rows of vector perturbation output in streaming mode (or NULL) */
+  FILE * tensor_perturbations_file[_MAX_NUMBER_OF_K_FILES_]; /**< Array of temporary files with the first rows of tensor perturbation output in streaming mode (or NULL) */
+
+  //@}
+
+  /** @name - approximation switches tabulated on a coarse grid of
+      wavenumbers, only while perturbations_init() runs (see
+      perturbations_tabulate_approximation_switches()) */
+
+  //@{
+
+  int * switch_table_size;    /**< number of tabulated wavenumbers for each mode (0 when there is no table) */
+  double ** switch_table_lnk; /**< logarithm of these wavenumbers, switch_table_lnk[index_md][index_kt] */
+  double ** switch_table_tau; /**< time of the switch of each approximation, switch_table_tau[index_md][index_kt*ap_size+index_ap] (0 if it does not switch exactly once) */
+
   //@}
 
   /** @name - technical parameters */
@@ -444,12 +506,30 @@ struct perturbations
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to perturbations_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
 
   //@}
 
 };
 
+/**
+ * One task of the parallel loop in perturbations_init(): the evolution
+ * of a given wavenumber for a given mode and initial condition, with
+ * an a priori estimate of its cost used for scheduling.
+ */
+
+struct perturbations_task
+{
+  int index_md; /**< index of mode */
+  int index_ic; /**< index of initial condition */
+  int ic_size;  /**< number of initial conditions evolved one after the other from index_ic (all of them for the wavenumbers of k_output_values, whose output tables are shared by the initial conditions, otherwise one) */
+  int index_k;  /**< index of wavenumber */
+  double cost;  /**< estimated cost, in arbitrary units (roughly, number of integration steps) */
+  int allocations; /**< number of workspace (re)allocations performed while evolving this wavenumber */
+};
+
 /**
  * Structure containing the indices and the values of the perturbation
  * variables which are integrated over time (as well as their
@@ -523,6 +603,11 @@ struct perturbations_vector
                             perturbations enter in the calculation of
                             source functions */
 
+  int pt_capacity;        /**< allocated size of y, dy and used_in_sources (at least pt_size, since vectors are recycled) */
+  int N_ncdm_capacity;    /**< allocated size of l_max_ncdm and q_size_ncdm */
+
+  struct jacobian_pattern * jacobian_pattern; /**< sparsity pattern of the jacobian for the current approximation scheme, kept in the workspace for the ndf15 evolver (NULL if none) */
+
 };
 
 
@@ -646,7 +731,70 @@ struct perturbations_workspace
   //@{
 
   int max_l_max;    /**< maximum l_max for any multipole */
+  int l_max_g;      /**< l_max of the scalar photon temperature hierarchy for the current wavenumber (see perturbations_find_l_max()) */
+  int l_max_pol_g;  /**< l_max of the scalar photon polarization hierarchy for the current wavenumber */
+  int l_max_ur;     /**< l_max of the scalar ur hierarchy for the current wavenumber */
+  int l_max_ncdm;   /**< l_max of the scalar ncdm hierarchies for the current wavenumber */
   double * s_l;     /**< array of freestreaming coefficients \f$ s_l = \sqrt{1-K*(l^2-1)/k^2} \f$*/
+  double * s_l_minus; /**< coefficients \f$ l s_l/(2l+1) \f$ of \f$ F_{l-1} \f$ in the free-streaming recurrence of the hierarchies */
+  double * s_l_plus;  /**< coefficients \f$ (l+1) s_{l+1}/(2l+1) \f$ of \f$ F_{l+1} \f$ in the free-streaming recurrence of the hierarchies */
+
+  //@}
+
+  /** @name - quantities of perturbations_derivs() which do not depend on
+      the perturbations, memoized for the successive calls at the same
+      time (numerical jacobian and Newton iterations of ndf15) */
+
+  //@{
+
+  double tau_derivs;          /**< time at which pvecback_derivs and pvecthermo_derivs were computed (negative if never) */
+  double * pvecback_derivs;   /**< background quantities at tau_derivs */
+  double * pvecthermo_derivs; /**< thermodynamics quantities at tau_derivs */
+  double a_w_fld;             /**< scale factor at which w_fld, dw_over_da_fld and integral_fld were computed by perturbations_w_fld() (negative if never) */
+  double w_fld;               /**< equation of state of the fluid at a_w_fld */
+  double dw_over_da_fld;      /**< its derivative at a_w_fld */
+  double integral_fld;        /**< its integral at a_w_fld (see background_w_fld()) */
+  double a_ncdm;              /**< scale factor at which the momentum kernels of the ncdm species below were computed by perturbations_ncdm_kernels() (negative if never) */
+  double * epsilon_ncdm;        /**< energy \f$ \epsilon = \sqrt{q^2+a^2 M^2} \f$ of each momentum bin of each ncdm species at a_ncdm, epsilon_ncdm[index_kernel] with index_kernel running over the species and their momenta */
+  double * w_rho_ncdm;          /**< weight \f$ q^2 \epsilon w \f$ of the momentum integral of the density */
+  double * w_theta_ncdm;        /**< weight \f$ q^3 w \f$ of the momentum integral of the velocity */
+  double * w_p_ncdm;            /**< weight \f$ q^4/\epsilon w \f$ of the momentum integrals of the pressure and shear */
+
+  //@}
+
+  /** @name - allocated sizes, allowing to reuse the same workspace for many wavenumbers (and runs) */
+
+  //@{
+
+  int s_l_capacity;        /**< allocated size of s_l */
+  int s_l_minus_capacity;  /**< allocated size of s_l_minus */
+  int s_l_plus_capacity;   /**< allocated size of s_l_plus */
+  int pvecback_capacity;   /**< allocated size of pvecback */
+  int pvecthermo_capacity; /**< allocated size of pvecthermo */
+  int pvecback_derivs_capacity;   /**< allocated size of pvecback_derivs */
+  int pvecthermo_derivs_capacity; /**< allocated size of pvecthermo_derivs */
+  int pvecmetric_capacity; /**< allocated size of pvecmetric */
+  int approx_capacity;     /**< allocated size of approx */
+  int ncdm_capacity;       /**< allocated size of delta_ncdm, theta_ncdm, shear_ncdm */
+  int ncdm_kernels_capacity; /**< allocated size of ncdm_kernels */
+  double * ncdm_kernels;     /**< memory of epsilon_ncdm, w_rho_ncdm, w_theta_ncdm and w_p_ncdm */
+
+  struct perturbations_vector * pv_spare[2]; /**< released vectors kept for the next approximation switch or wavenumber */
+
+  int allocation_count; /**< number of (re)allocations performed by this workspace so far */
+  short is_in_use;      /**< set while a wavenumber is being evolved with this workspace */
+
+  //@}
+
+  /** @name - sparsity patterns of the jacobian for the ndf15 evolver, reused for all wavenumbers of a run */
+
+  //@{
+
+  struct jacobian_pattern * jacobian_pattern; /**< one pattern for each approximation scheme met so far: jacobian_pattern[index_pattern] */
+  int * jacobian_pattern_key;     /**< pt_size and approximation flags for each pattern: jacobian_pattern_key[index_pattern*(ap_size+1)+...] */
+  int jacobian_pattern_key_capacity; /**< allocated size of jacobian_pattern_key */
+  int jacobian_pattern_size;      /**< number of patterns in use */
+  unsigned long jacobian_pattern_run; /**< run of perturbations_init() to which the patterns belong */
 
   //@}
 
@@ -672,6 +820,45 @@ struct perturbations_parameters_and_workspace {
 
 };
 
+/**
+ * State of the integration of one wavenumber and initial condition,
+ * which perturbations_solve() performs in three steps:
+ * perturbations_solve_begin(), perturbations_solve_interval() for each
+ * interval over which the approximation scheme is uniform (followed by
+ * the call to the evolver), and perturbations_solve_end(). With the
+ * rk_batch evolver, perturbations_solve_batch() interleaves these steps
+ * for several wavenumbers.
+ */
+
+struct perturbations_solve_state {
+
+  struct perturbations_parameters_and_workspace ppaw; /**< parameters of perturbations_derivs() */
+
+  int tau_actual_size;   /**< number of values in the tau_sampling array that should be considered for this mode */
+  int interval_number;   /**< number of time intervals where the approximation scheme is uniform */
+  int index_interval;    /**< current interval */
+  double * interval_limit; /**< edge of intervals where approximation scheme is uniform: tau_ini, tau_switch_1, ..., tau_end */
+  int ** interval_approx;  /**< array of approximation scheme within each interval: interval_approx[index_interval][index_ap] */
+
+  int (*print_variables)(double, double*, double*, void*, char*); /**< perturbations_print_variables() for the wavenumbers of k_output_values, NULL otherwise */
+
+};
+
+/**
+ * One lane of perturbations_solve_batch(): the wavenumber of a task,
+ * with its own workspace, evolved for each of the initial conditions of
+ * the task in turn.
+ */
+
+struct perturbations_batch_lane {
+
+  struct perturbations_task * ptask;   /**< task of this lane */
+  int index_ic;                        /**< initial condition being evolved */
+  struct perturbations_workspace * ppw; /**< workspace of this lane */
+  struct perturbations_solve_state pss; /**< state of the integration */
+
+};
+
 /*************************************************************************************************************/
 /* @cond INCLUDE_WITH_DOXYGEN */
 /*
@@ -759,6 +946,10 @@ extern "C" {
                          struct perturbations * ppt
                          );
 
+  int perturbations_storage_convert(
+                                     struct perturbations * ppt
+                                     );
+
   int perturbations_free_input(
                                struct perturbations * ppt
                                );
@@ -802,6 +993,15 @@ extern "C" {
                                    struct perturbations_workspace * ppw
                                    );
 
+  int perturbations_workspace_reserve(
+                                      void ** pointer,
+                                      int * capacity,
+                                      int size,
+                                      size_t element_size,
+                                      struct perturbations_workspace * ppw,
+                                      ErrorMsg error_message
+                                      );
+
   int perturbations_solve(
                           struct precision * ppr,
                           struct background * pba,
@@ -813,6 +1013,143 @@ extern "C" {
                           struct perturbations_workspace * ppw
                           );
 
+  int perturbations_tabulate_approximation_switches(
+                                                    struct precision * ppr,
+                                                    struct background * pba,
+                                                    struct thermodynamics * pth,
+                                                    struct perturbations * ppt
+                                                    );
+
+  int perturbations_free_approximation_switches(
+                                                struct perturbations * ppt
+                                                );
+
+  int perturbations_predict_approximation_switch(
+                                                 struct precision * ppr,
+                                                 struct background * pba,
+                                                 struct thermodynamics * pth,
+                                                 struct perturbations * ppt,
+                                                 int index_md,
+                                                 double k,
+                                                 struct perturbations_workspace * ppw,
+                                                 int index_ap,
+                                                 int flag_switch,
+                                                 double * tau_before,
+                                                 double * tau_after
+                                                 );
+
+  int perturbations_find_approximation_intervals(
+                                                 struct precision * ppr,
+                                                 struct background * pba,
+                                                 struct thermodynamics * pth,
+                                                 struct perturbations * ppt,
+                                                 int index_md,
+                                                 double k,
+                                                 struct perturbations_workspace * ppw,
+                                                 double tau_end,
+                                                 int * interval_number,
+                                                 double ** interval_limit,
+                                                 int *** interval_approx
+                                                 );
+
+  int perturbations_find_l_max(
+                               struct precision * ppr,
+                               struct background * pba,
+                               struct thermodynamics * pth,
+                               struct perturbations * ppt,
+                               int index_md,
+                               double k,
+                               struct perturbations_workspace * ppw,
+                               int interval_number,
+                               double * interval_limit,
+                               int ** interval_approx
+                               );
+
+  int perturbations_solve_begin(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermodynamics * pth,
+                                struct perturbations * ppt,
+                                int index_md,
+                                int index_ic,
+                                int index_k,
+                                struct perturbations_workspace * ppw,
+                                struct perturbations_solve_state * pss
+                                );
+
+  int perturbations_solve_interval(
+                                   struct perturbations_solve_state * pss
+                                   );
+
+  int perturbations_solve_end(
+                              struct perturbations_solve_state * pss
+                              );
+
+  int perturbations_solve_batch(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermodynamics * pth,
+                                struct perturbations * ppt,
+                                int lane_size,
+                                struct perturbations_batch_lane * lanes
+                                );
+
+  int perturbations_batch_restart(
+                                  int index_lane,
+                                  struct evolver_rk_lane * plane,
+                                  void * restart_parameters,
+                                  short * is_done,
+                                  ErrorMsg error_message
+                                  );
+
+  int perturbations_estimate_cost(
+                                  struct precision * ppr,
+                                  struct background * pba,
+                                  struct thermodynamics * pth,
+                                  struct perturbations * ppt,
+                                  int index_md,
+                                  double k,
+                                  double * cost
+                                  );
+
+  int perturbations_schedule_tasks(
+                                   struct precision * ppr,
+                                   struct background * pba,
+                                   struct thermodynamics * pth,
+                                   struct perturbations * ppt,
+                                   int * task_size,
+                                   struct perturbations_task ** task_list
+                                   );
+
+  int perturbations_task_rank(
+                              struct perturbations * ppt,
+                              struct perturbations_task * task_list,
+                              int index_task
+                              );
+
+  int perturbations_share_sources(
+                                  struct perturbations * ppt,
+                                  int task_size,
+                                  struct perturbations_task * task_list
+                                  );
+
+  void perturbations_copy_sources(
+                                  struct perturbations * ppt,
+                                  int task_size,
+                                  struct perturbations_task * task_list,
+                                  int rank,
+                                  double * buffer,
+                                  int to_buffer
+                                  );
+
+  int perturbations_print_load_balance(
+                                       struct perturbations * ppt,
+                                       int task_size,
+                                       struct perturbations_task * task_list,
+                                       double * task_time,
+                                       int num_threads
+                                       );
+
   int perturbations_prepare_k_output(
                                      struct background * pba,
                                      struct perturbations * ppt
@@ -866,6 +1203,30 @@ extern "C" {
                                 struct perturbations_vector * pv
                                 );
 
+  int perturbations_vector_acquire(
+                                   struct background * pba,
+                                   struct perturbations * ppt,
+                                   struct perturbations_workspace * ppw,
+                                   struct perturbations_vector ** ppv
+                                   );
+
+  int perturbations_vector_reserve(
+                                   struct perturbations * ppt,
+                                   struct perturbations_workspace * ppw,
+                                   struct perturbations_vector * pv
+                                   );
+
+  int perturbations_vector_release(
+                                   struct perturbations_workspace * ppw,
+                                   struct perturbations_vector * pv
+                                   );
+
+  int perturbations_vector_jacobian_pattern(
+                                            struct perturbations * ppt,
+                                            struct perturbations_workspace * ppw,
+                                            struct perturbations_vector * pv
+                                            );
+
   int perturbations_initial_conditions(
                                        struct precision * ppr,
                                        struct background * pba,
@@ -907,6 +1268,22 @@ extern "C" {
                              struct perturbations_workspace * ppw
                              );
 
+  int perturbations_w_fld(
+                          struct background * pba,
+                          struct perturbations_workspace * ppw,
+                          double a,
+                          double * w_fld,
+                          double * dw_over_da_fld,
+                          double * integral_fld,
+                          ErrorMsg error_message
+                          );
+
+  int perturbations_ncdm_kernels(
+                                 struct background * pba,
+                                 struct perturbations_workspace * ppw,
+                                 double a
+                                 );
+
   int perturbations_total_stress_energy(
                                         struct precision * ppr,
                                         struct background * pba,
@@ -927,6 +1304,16 @@ extern "C" {
                             ErrorMsg error_message
                             );
 
+  int perturbations_output_new_row(
+                                   struct perturbations * ppt,
+                                   double ** data,
+                                   int * size_data,
+                                   FILE ** file,
+                                   int number_of_titles,
+                                   double ** dataptr,
+                                   ErrorMsg error_message
+                                   );
+
   int perturbations_print_variables(
                                     double tau,
                                     double * y,
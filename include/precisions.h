@@ -1,5 +1,25 @@
 #include "macros_precision.h"
 
+/*
+ * Precision tier
+ */
+
+/**
+ * Precision tier of the run: 0 for the default settings below, 1 or 2
+ * for coarser samplings in k, l and q and a looser tolerance of the
+ * perturbation integration (see input_precision_tier()), meant for
+ * cheap preliminary evaluations. Parameters passed explicitly
+ * override the values set by the tier.
+ */
+class_precision_parameter(precision_tier,int,0)
+/**
+ * Estimated relative error of the C_l's of a preliminary
+ * evaluation, set according to precision_tier (0 at tier 0). It does
+ * not change the computation, and may be passed to replace the
+ * default estimate by one calibrated on the models of interest.
+ */
+class_precision_parameter(precision_tier_error,double,0.)
+
 /*
  * Background Quantities
  */
@@ -28,6 +48,54 @@ class_precision_parameter(tol_background_integration,double,1.e-10)
  * background_timescale (given by the sampling step)
  */
 class_precision_parameter(background_integration_stepsize,double,0.5)
+/**
+ * If set, a line is added to the background table at each
+ * breakpoint of the background (the kinks of UG model 1, see
+ * background_breakpoints()), and background_evolver is called
+ * separately on each smooth segment between them
+ */
+class_precision_parameter(background_split_at_breakpoints,int,_FALSE_)
+/**
+ * If set, the lines of the background table are not uniform in loga,
+ * but placed by background_table_sampling() after a pilot integration,
+ * such that the relative error of the spline interpolation of the
+ * table is about background_table_tol, with at most background_Nloga
+ * lines (not used with background_UG_quadrature)
+ */
+class_precision_parameter(background_table_adaptive,int,_FALSE_)
+/**
+ * Target relative error of the interpolation of the adaptive background table
+ */
+class_precision_parameter(background_table_tol,double,1.e-8)
+/**
+ * Number of lines, uniform in loga, of the pilot integration placing
+ * the lines of the adaptive background table
+ */
+class_precision_parameter(background_table_Nloga_pilot,int,2000)
+/**
+ * Smallest and largest steps in loga between lines of the adaptive background table
+ */
+class_precision_parameter(background_table_dloga_min,double,1.e-4)
+class_precision_parameter(background_table_dloga_max,double,0.02)
+/**
+ * If set, and if the only non-trivial species are those of the
+ * unimodular-gravity (UG) model (no ncdm, scf, dcdm or fld), the
+ * background table is built by fourth-order quadrature directly on
+ * the sampling grid (split at the kinks of UG model 1), instead of
+ * calling background_evolver. The table agrees with the evolver run at
+ * tol_background_integration=1e-14 to about 5e-11, but the cost of
+ * background_init() hardly changes, since filling and splining the
+ * background_Nloga lines dominate it (about 10 ms with the default
+ * table)
+ */
+class_precision_parameter(background_UG_quadrature,int,_FALSE_)
+/**
+ * With background_UG_quadrature: half-width, in units of delta, of the
+ * region around a_start integrated interval by interval, and number of
+ * sub-steps per width delta/a_start in log(a)
+ */
+class_precision_parameter(background_UG_transition_width,double,10.)
+class_precision_parameter(background_UG_transition_steps,double,100.)
 /**
  * Tolerance of the deviation of \f$ \Omega_r \f$ from 1 for which to start integration:
  * The starting point of integration will be chosen,
@@ -61,6 +129,18 @@ class_precision_parameter(tol_ncdm_newtonian,double,1.e-5)
  * non-cold dark matter phase-space distributions during the background evolution.
  */
 class_precision_parameter(tol_ncdm_bg,double,1.e-5)
+/**
+ * If _TRUE_, the background density, pressure and pseudo-pressure of
+ * each non-cold dark matter species are tabulated once in log(a), with
+ * a step background_ncdm_table_dloga, and interpolated with cubic
+ * splines, instead of being summed over the momenta at each call of
+ * background_functions() (which is still done outside of the table).
+ * The relative error of the tabulated quantities is about 1e-9, but
+ * the adaptive steps of the later integrations turn it into changes of
+ * order 1e-5 of the spectra, so the exact sums remain the default.
+ */
+class_precision_parameter(background_ncdm_table,int,_FALSE_)
+class_precision_parameter(background_ncdm_table_dloga,double,0.005)
 /**
  * Tolerance on the initial deviation of non-cold dark matter from being fully relativistic.
  * Using w = pressure/density, this quantifies the maximum deviation from 1/3. (for relativistic species)
@@ -109,6 +189,14 @@ class_precision_parameter(M_nfsm_threshold,double,1.e4)
  * \f$ Y_\mathrm{He} \f$ for given \f$ \omega_b \f$ and \f$ N_\mathrm{eff} \f$.
  */
 class_string_parameter(sBBN_file,"/external/bbn/sBBN_2025.dat","sBBN file")
+/**
+ * If _TRUE_, each external file of numbers (BBN table, phase-space
+ * distributions of ncdm species, selection functions, tables of the
+ * distortions module) is also written in binary format next to it, with
+ * extension .bin, and mapped from there by the next processes as long
+ * as the text file is unchanged (see data_file_get()).
+ */
+class_precision_parameter(data_binary_files,int,_FALSE_)
 
 /*
  *  Thermodynamical quantities
@@ -312,6 +400,18 @@ class_precision_parameter(l_max_idr,int,17)   /**< number of momenta in Boltzman
 class_precision_parameter(l_max_ncdm,int,17)   /**< number of momenta in Boltzmann hierarchy for relativistic neutrino/relics (scalar), at least 4 */
 class_precision_parameter(l_max_g_ten,int,5)     /**< number of momenta in Boltzmann hierarchy for photon temperature (tensor), at least 4 */
 class_precision_parameter(l_max_pol_g_ten,int,5) /**< number of momenta in Boltzmann hierarchy for photon polarization (tensor), at least 4 */
+/**
+ * if _TRUE_, the scalar hierarchies of photons, ur and ncdm are
+ * truncated for each wavenumber at l_max_adaptive_min +
+ * l_max_adaptive_k_tau * k * d, bounded by l_max_g, l_max_pol_g,
+ * l_max_ur and l_max_ncdm, where d is the distance over which the
+ * species free-streams while its hierarchy is evolved (for photons,
+ * from recombination on, plus the damping scale at recombination).
+ * The truncation closure is the same as for fixed l_max.
+ */
+class_precision_parameter(l_max_adaptive,int,_FALSE_)
+class_precision_parameter(l_max_adaptive_k_tau,double,1.5)
+class_precision_parameter(l_max_adaptive_min,int,6)
 
 class_precision_parameter(curvature_ini,double,1.0)     /**< initial condition for curvature for adiabatic */
 class_precision_parameter(entropy_ini,double,1.0) /**< initial condition for entropy perturbation for isocurvature */
@@ -321,6 +421,12 @@ class_precision_parameter(gw_ini,double,1.0)      /**< initial condition for ten
  * default step \f$ d \tau \f$ in perturbation integration, in units of the timescale involved in the equations (usually, the min of \f$ 1/k \f$, \f$ 1/aH \f$, \f$ 1/\dot{\kappa} \f$)
  */
 class_precision_parameter(perturbations_integration_stepsize,double,0.5)
+/**
+ * Only relevant for ndf15 evolver: if _TRUE_, the LU decomposition of
+ * the iteration matrix is not redone each time the step size or order
+ * changes, but only when the Newton iterations converge too slowly
+ */
+class_precision_parameter(perturbations_refresh_lu_on_convergence,int,_FALSE_)
 /**
  * default step \f$ d \tau \f$ for sampling the source function, in units of the timescale involved in the sources: \f$ (\dot{\kappa}- \ddot{\kappa}/\dot{\kappa})^{-1} \f$
  */
@@ -352,6 +458,17 @@ class_precision_parameter(c_gamma_k_H_square_max,double,1.0e3)
  * approximations must be switched on/off (units of Mpc)
  */
 class_precision_parameter(tol_tau_approx,double,1.0e-10)
+/**
+ * The switching times of the approximations are first found for one
+ * wavenumber out of approximation_switch_k_step (0: never), and
+ * interpolated in k for the other ones. The bisection of each switch
+ * then only probes the times around the interpolated value, starting
+ * at a relative distance approximation_switch_bracket and widening
+ * until the switch is bracketed (the result is the same as without
+ * the table)
+ */
+class_precision_parameter(approximation_switch_k_step,int,16)
+class_precision_parameter(approximation_switch_bracket,double,1.e-14)
 /**
  * method for switching off photon perturbations
  */
@@ -393,9 +510,23 @@ class_precision_parameter(ncdm_fluid_trigger_tau_over_tau_k,double,31.0)
  */
 class_precision_parameter(neglect_CMB_sources_below_visibility,double,1.0e-3)
 /**
- * The type of evolver to use: options are ndf15 or rk
+ * The type of evolver to use: options are ndf15, rk, or rk_batch (the
+ * method of rk, for perturbations_batch_size wavenumbers integrated in
+ * lockstep by each task, see evolver_rk_batch())
  */
 class_type_parameter(evolver,int,enum evolver_type,ndf15)
+/**
+ * Only relevant for the rk_batch evolver: number of wavenumbers
+ * integrated together by each task
+ */
+class_precision_parameter(perturbations_batch_size,int,32)
+/**
+ * Order in which the wavenumbers are sent to the thread pool: by
+ * decreasing k (k_schedule_reverse=0), or by decreasing estimated
+ * cost (k_schedule_cost=1, longest processing time first), which
+ * reduces the idle time at the end of the loop on many cores
+ */
+class_precision_parameter(perturbations_k_schedule,int,k_schedule_reverse)
 
 /*
  * Primordial parameters
@@ -413,6 +544,7 @@ class_precision_parameter(primordial_inflation_attractor_precision_pivot,double,
 class_precision_parameter(primordial_inflation_attractor_precision_initial,double,0.1) /**< targeted precision when searching attractor solution near phi_ini */
 class_precision_parameter(primordial_inflation_attractor_maxit,int,10) /**< maximum number of iteration when searching attractor solution */
 class_precision_parameter(primordial_inflation_tol_curvature,double,1.0e-3) /**< for each k, stop following wavenumber, at the latest, when curvature perturbation R is stable up to to this tolerance */
+class_precision_parameter(primordial_inflation_tol_sampling,double,0.0) /**< if positive, refine the sampling in k (starting from k_per_decade_primordial) until the spline interpolation of ln(P_k) is accurate up to this tolerance (for both scalars and tensors; should remain above the numerical noise in ln(P_k), of order 1.e-5 with default precision); if zero, keep the fixed sampling */
 class_precision_parameter(primordial_inflation_aH_ini_target,double,0.9) /**< control the step size in the search for a suitable initial field value */
 class_precision_parameter(primordial_inflation_end_dphi,double,1.0e-10) /**< first bracketing width, when trying to bracket the value phi_end at which inflation ends naturally */
 class_precision_parameter(primordial_inflation_end_logstep,double,10.0) /**< logarithmic step for updating the bracketing width, when trying to bracket the value phi_end at which inflation ends naturally */
@@ -428,6 +560,11 @@ class_precision_parameter(l_linstep,int,40) /**< factor for logarithmic spacing
 
 class_precision_parameter(l_logstep,double,1.12) /**< maximum spacing of values of l over which Bessel and transfer functions are sampled (so, spacing becomes linear instead of logarithmic at some point) */
 
+class_precision_parameter(transfer_l_adaptive,int,_FALSE_) /**< if _TRUE_, the scalar transfer functions of each field of the harmonic module (temperature, E, CMB lensing, number count or lensing of each bin) are first computed for one value of l out of 2^transfer_l_adaptive_levels in the list defined above; each interval is then bisected as long as the spline interpolation in l of \f$ \int \Delta_l(q)^2 d\ln q \f$ (estimated by comparison with every other value, and then with the previous level) has a relative error larger than transfer_l_adaptive_tol, each field being refined on its own. The harmonic module computes the cross-spectra of two fields at the values of l sampled for both of them, and interpolates the \f$ C_l \f$'s at the other values of l */
+class_precision_parameter(transfer_l_adaptive_tol,double,1.e-4) /**< tolerance of the adaptive l sampling */
+class_precision_parameter(transfer_l_adaptive_levels,int,1) /**< maximum number of bisections of each interval in the adaptive l sampling. With more levels, the first sampling is so coarse that the error estimate can miss the BAO wiggles of the number count \f$ C_l \f$'s */
+class_precision_parameter(transfer_l_adaptive_cache_size,double,256.) /**< maximum memory, in MB, of the sources kept between the passes of the adaptive l sampling, such that each pass only computes its line-of-sight integrals; the types that do not fit are interpolated and resampled again at each pass */
+
 class_precision_parameter(hyper_x_min,double,1.0e-5)  /**< flat case: lower bound on the smallest value of x at which we sample \f$ \Phi_l^{\nu}(x)\f$ or \f$ j_l(x)\f$ */
 class_precision_parameter(hyper_sampling_flat,double,8.0)  /**< flat case: number of sampled points x per approximate wavelength \f$ 2\pi \f$, should remain >7.5 */
 class_precision_parameter(hyper_sampling_curved_low_nu,double,7.0)  /**< open/closed cases: number of sampled points x per approximate wavelength \f$ 2\pi/\nu\f$, when \f$ \nu \f$ smaller than hyper_nu_sampling_step */
@@ -436,6 +573,8 @@ class_precision_parameter(hyper_nu_sampling_step,double,1000.0)  /**< open/close
 class_precision_parameter(hyper_phi_min_abs,double,1.0e-10)  /**< small value of Bessel function used in calculation of first point x (\f$ \Phi_l^{\nu}(x) \f$ equals hyper_phi_min_abs) */
 class_precision_parameter(hyper_x_tol,double,1.0e-4)  /**< tolerance parameter used to determine first value of x */
 class_precision_parameter(hyper_flat_approximation_nu,double,4000.0)  /**< value of nu below which the flat approximation is used to compute Bessel function */
+class_precision_parameter(hyper_flat_cache,int,_FALSE_)  /**< flat case: if _TRUE_, store the table of Bessel functions on disk in hyper_flat_cache_path, on a fixed grid of step \f$ 2\pi/\f$hyper_sampling_flat, and map it back in the next runs */
+class_string_parameter(hyper_flat_cache_path,"/hyper_cache","hyper_flat_cache_path") /**< directory of the cached tables of Bessel functions */
 
 class_precision_parameter(q_linstep,double,0.45)         /**< asymptotic linear sampling step in q
                                space, in units of \f$ 2\pi/r_a(\tau_rec) \f$
@@ -470,6 +609,13 @@ class_precision_parameter(q_numstep_transition,double,250.0) /**< number of step
                                  q_logstep_spline steps (transition
                                  must be smooth for spline) */
 
+class_precision_parameter(transfer_q_adaptive,int,_FALSE_) /**< if _TRUE_, the list of q values defined above is refined adaptively: each interval is bisected, up to transfer_q_adaptive_levels times, as long as the error on the integral of \f$ \Delta_l(q)^2 \f$ over \f$ \ln q \f$ (estimated by comparison with every other value, and then with the previous level) exceeds transfer_q_adaptive_tol times this integral, for at least one type and multipole (the three temperature terms being summed like in the harmonic module). Flat and open cases only */
+class_precision_parameter(transfer_q_adaptive_coarsening,double,1.0) /**< factor multiplying q_linstep and q_logstep_spline for the starting point of the adaptive q sampling. Values larger than one save time in the logarithmic part of the list, but the error estimate is then blind to oscillations sampled with steps close to their period */
+class_precision_parameter(transfer_q_adaptive_tol,double,1.e-4) /**< tolerance of the adaptive q sampling */
+class_precision_parameter(transfer_q_adaptive_levels,int,4) /**< maximum number of bisections of each interval in the adaptive q sampling */
+class_precision_parameter(transfer_q_list_cache,int,_FALSE_) /**< if _TRUE_, the list of q values (adaptive or not) is written in transfer_q_list_file, together with the oscillation period \f$ 2\pi/r_a(\tau_{rec}) \f$, and read back from this file in the next runs, e.g. for all points of a chain (rescaled by the ratio of the periods, such that a run with the same cosmology gets exactly the same list) */
+class_string_parameter(transfer_q_list_file,"/q_list.dat","transfer_q_list_file") /**< file storing the list of q values when transfer_q_list_cache is _TRUE_ */
+
 class_precision_parameter(q_logstep_limber,double,1.025) /**< new in v3.2.2: in the new 'full limber' scheme, logarithmic step for the k-grid (and q-grid) */
 class_precision_parameter(k_max_limber_over_l_max_scalars,double,0.001) /**< new in v3.2.2: in the new 'full limber' scheme, the integral runs up to k_max = l_max_scalars times this parameter (units of 1/Mpc) */
 
@@ -487,7 +633,11 @@ class_precision_parameter(transfer_neglect_delta_k_T_b,double,0.1)  /**< same fo
 
 class_precision_parameter(transfer_neglect_late_source,double,400.0)  /**< value of l below which the CMB source functions can be neglected at late time, excepted when there is a Late ISW contribution */
 
+class_precision_parameter(transfer_l_block_size,int,1)  /**< number of multipoles whose transfer functions are integrated together, in one pass over the time grid by tiles of _TRANSFER_TILE_ values, such that each tile of the source is reused for all of them (if 1, each multipole is integrated separately) */
+class_precision_parameter(transfer_q_block_size,int,1)  /**< number of consecutive wavenumbers computed by the same thread, with the same workspace */
+
 class_precision_parameter(l_switch_limber,double,10.) /**< when to use the Limber approximation for project gravitational potential cl's */
+class_precision_parameter(l_switch_lcmb_direct_limber,double,500.) /**< with want_lcmb_direct_limber, multipole above which C_l^phiphi is computed by a direct Limber integral over the times of the lensing source, and no longer from transfer functions (C_l^Tphi and C_l^Ephi are then set to zero) */
 // For density Cl, we recommend not to use the Limber approximation
 // at all, and hence to put here a very large number (e.g. 10000); but
 // if you have wide and smooth selection functions you may wish to
@@ -511,6 +661,7 @@ class_precision_parameter(selection_tophat_edge,double,0.1) /**< controls how sm
  * */
 
 class_precision_parameter(sigma_k_per_decade,double,80.) /**< logarithmic stepsize controlling the precision of integrals for sigma(R,k) and similar quantitites */
+class_precision_parameter(sigma_fftlog,int,_TRUE_) /**< when sigma(R) and similar integrals are needed for many values of R (tables of HMcode, search of the non-linear scale in HMcode and Halofit), compute them for all R at once with FFTLog; set to 0 for the direct quadrature at each R */
 
 class_precision_parameter(nonlinear_min_k_max,double,5.0) /**< when
                                using an algorithm to compute nonlinear
@@ -588,6 +739,10 @@ class_precision_parameter(accurate_lensing,int,_FALSE_) /**< switch between Gaus
 class_precision_parameter(num_mu_minus_lmax,int,70) /**< difference between num_mu and l_max, increase for more precision */
 class_precision_parameter(delta_l_max,int,500)/**< difference between l_max in unlensed and lensed spectra */
 class_precision_parameter(tol_gauss_legendre,double,ppr->smallest_allowed_variation) /**< tolerance with which quadrature points are found: must be very small for an accurate integration (if not entered manually, set automatically to match machine precision) */
+class_precision_parameter(lensing_dxx_cache,int,_FALSE_) /**< if _TRUE_, keep the quadrature nodes and the tables of \f$ d^l_{mm'}(\mu) \f$ in memory, and reuse them in the next runs with the same l_unlensed_max and lensing precision parameters */
+class_precision_parameter(lensing_dxx_cache_disk,int,_FALSE_) /**< if _TRUE_ (together with lensing_dxx_cache), also store these tables on disk in lensing_dxx_cache_path and map them back in the next runs */
+class_string_parameter(lensing_dxx_cache_path,"/lensing_cache","lensing_dxx_cache_path") /**< directory of the cached tables of \f$ d^l_{mm'}(\mu) \f$ */
+class_precision_parameter(lensing_mu_block_size,int,0) /**< if positive, streaming mode: the tables of \f$ d^l_{mm'}(\mu) \f$ are computed on the fly by blocks of this many values of \f$ \mu \f$ and never stored at full size (then lensing_dxx_cache has no effect) */
 
 /*
  * Spectral distortions precision parameters
@@ -608,6 +763,8 @@ class_precision_parameter(tol_sd_detector,double,1.e-5)
 
 class_string_parameter(sd_external_path,"/external/distortions","sd_external_path")
 
+class_precision_parameter(sd_binary_files,int,_FALSE_) /**< if _TRUE_, each external file of sd_external_path (branching ratios, spectral shapes, detector noise) is also written in binary format next to it, with extension .bin, and mapped from there by the next processes as long as the text file is unchanged (as with data_binary_files, for these files only) */
+
 
 #undef class_precision_parameter
 #undef class_string_parameter
@@ -300,6 +300,8 @@ struct primordial {
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to primordial_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
 
 };
@@ -424,11 +426,28 @@ extern "C" {
                                    double * y_ini
                                    );
 
+  int primordial_inflation_wavenumbers(
+                                       struct perturbations * ppt,
+                                       struct primordial * ppm,
+                                       struct precision * ppr,
+                                       double * y_ini,
+                                       int index_k_min
+                                       );
+
+  int primordial_inflation_background_at_k(
+                                           struct primordial * ppm,
+                                           struct precision * ppr,
+                                           double * y_ini,
+                                           double * lnk,
+                                           int lnk_size,
+                                           double * y_table
+                                           );
+
   int primordial_inflation_one_wavenumber(
                                           struct perturbations * ppt,
                                           struct primordial * ppm,
                                           struct precision * ppr,
-                                          double * y_ini,
+                                          double * y_bg,
                                           int index_k
                                           );
 
@@ -530,6 +549,7 @@ extern "C" {
 //@{
 
 #define _K_PER_DECADE_PRIMORDIAL_MIN_ 1.
+#define _PRIMORDIAL_INFLATION_MAX_REFINEMENTS_ 4 /**< maximum number of halvings of the initial intervals in k, when primordial_inflation_tol_sampling > 0 */
 
 //@}
 
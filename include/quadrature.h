@@ -12,6 +12,21 @@
 
 enum ncdm_quadrature_method {qm_auto, qm_Laguerre, qm_trapz_indefinite, qm_trapz};
 
+/* Types of the quadrature rules kept by quadrature_gauss_legendre() and compute_Laguerre() */
+
+enum quadrature_rule_type {quadrature_rule_legendre, quadrature_rule_laguerre, quadrature_rule_laguerre_total};
+
+/* Nodes and weights of a quadrature rule computed earlier in the process */
+
+struct quadrature_rule {
+  enum quadrature_rule_type type; /* type of rule */
+  int n;                          /* number of nodes */
+  double param;                   /* tolerance on the nodes (Legendre) or alpha (Laguerre) */
+  double *x;                      /* nodes */
+  double *w;                      /* weights */
+  struct quadrature_rule *next;   /* next rule in the list */
+};
+
 /* Structures for QSS */
 
 typedef struct adaptive_integration_tree_node{
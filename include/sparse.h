@@ -49,7 +49,8 @@ void dfsr(int j, sp_mat *G, int *top, int *xik, int *pinv);
 int sp_splsolve(sp_mat *G, sp_mat *B, int k, int*xik, int top, double *x, int *pinv);
 int sp_ludcmp(sp_num *N, sp_mat *A, double pivtol);
 int sp_lusolve(sp_num *N, double *b, double *x);
-int sp_refactor(sp_num *N, sp_mat *A);
+int sp_symbolic(sp_num *N, sp_mat *A);
+int sp_refactor(sp_num *N, sp_mat *A, double pivtol);
 int column_grouping(sp_mat *G, int *col_g, int *col_wi);
 int sp_amd(int *Cp, int *Ci, int n, int cnzmax, int *P, int *W);
 int sp_wclear(int mark, int lemax, int *w, int n);
@@ -331,6 +331,8 @@ struct thermodynamics
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to thermodynamics_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
   //@}
 
@@ -517,6 +519,14 @@ extern "C" {
                           double * pvecback,
                           double * pvecthermo);
 
+  int thermodynamics_at_z_array(struct background * pba,
+                                struct thermodynamics * pth,
+                                double * z,
+                                int z_size,
+                                double * pvecback_table,
+                                int pvecback_size,
+                                double * pvecthermo_table);
+
   int thermodynamics_init(struct precision * ppr,
                           struct background * pba,
                           struct thermodynamics * pth);
@@ -582,6 +592,28 @@ extern "C" {
                                                   double * mz_output,
                                                   int Nz);
 
+  int thermodynamics_reionization_set_redshift(struct precision * ppr,
+                                               struct thermodynamics * pth,
+                                               struct thermo_reionization_parameters * preio,
+                                               double z_reio);
+
+  int thermodynamics_reionization_tau_model(struct precision * ppr,
+                                            struct thermodynamics * pth,
+                                            struct thermo_reionization_parameters * preio,
+                                            int z_size,
+                                            double * weight,
+                                            double z_reio,
+                                            double * tau);
+
+  int thermodynamics_reionization_z_of_tau_model(struct precision * ppr,
+                                                 struct thermodynamics * pth,
+                                                 struct thermo_reionization_parameters * preio,
+                                                 int z_size,
+                                                 double * weight,
+                                                 double tau,
+                                                 double z_max,
+                                                 double * z_reio);
+
   int thermodynamics_derivs(
                             double mz,
                             double * y,
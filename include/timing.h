@@ -0,0 +1,82 @@
+/** @file timing.h Timers and counters of the modules of CLASS */
+
+#ifndef __TIMING__
+#define __TIMING__
+
+/**
+ * Counters incremented by the hot helpers of the code. They are kept
+ * per thread and summed when they are read, so that incrementing them
+ * costs no synchronisation; they are therefore process-wide, and the
+ * counts attributed to a module include those of any other instance of
+ * CLASS running at the same time in the process.
+ */
+
+enum class_counter {
+  counter_k_modes,                    /**< wavenumbers (and initial conditions) integrated by perturbations_solve() */
+  counter_ndf15_integrations,         /**< calls to evolver_ndf15() */
+  counter_ndf15_steps,                /**< successful steps of evolver_ndf15() */
+  counter_ndf15_failed_steps,         /**< failed steps of evolver_ndf15() */
+  counter_ndf15_function_evaluations, /**< calls to the derivative function by evolver_ndf15() and numjac() */
+  counter_ndf15_jacobians,            /**< jacobians computed by numjac() */
+  counter_ndf15_lu_decompositions,    /**< LU decompositions of evolver_ndf15() */
+  counter_interpolations,             /**< calls to the array_interpolate_spline/linear functions */
+  counter_allocations,                /**< allocations by class_alloc(), class_calloc() and class_realloc() */
+  counter_allocated_bytes,            /**< bytes requested by these allocations (the new size for class_realloc()) */
+  counter_approximation_probes,       /**< calls to perturbations_approximations() searching for the switching times of the approximations */
+  counter_size                        /**< number of counters */
+};
+
+/**
+ * Timings and counters of one call to the init function of a module:
+ * each module structure has such a field, filled by
+ * class_timer_begin() and class_timer_end(). The CPU time is that of
+ * all the threads of the process. The peak resident set size is also
+ * that of the process: its increase is attributed to the module during
+ * which the process reaches a new peak.
+ */
+
+struct class_stats {
+  double wall_time;            /**< wall time in s */
+  double cpu_time;             /**< CPU time in s */
+  long counter[counter_size];  /**< increase of each counter */
+  long peak_rss;               /**< increase of the peak resident set size of the process, in bytes */
+};
+
+/*
+ * With _CLASS_STATS_ undefined (see the Makefile), the counters
+ * compile to nothing and the stats of all modules stay at zero.
+ */
+#ifdef _CLASS_STATS_
+#define class_timer_begin(pstats) class_stats_begin(pstats)
+#define class_timer_end(pstats) class_stats_end(pstats)
+#define class_counter_add(index,n) class_stats_count(index,n)
+#else
+#define class_timer_begin(pstats) memset(pstats,0,sizeof(struct class_stats))
+#define class_timer_end(pstats)
+#define class_counter_add(index,n)
+#endif
+
+/**************************************************************/
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  void class_stats_count(int index, long n);
+
+  void class_stats_read(long * counter);
+
+  void class_stats_begin(struct class_stats * pstats);
+
+  void class_stats_end(struct class_stats * pstats);
+
+  const char * class_stats_counter_name(int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
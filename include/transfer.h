@@ -5,8 +5,11 @@
 
 #include "fourier.h"
 #include "hyperspherical.h"
+#include "transfer_offload.h"
 #include "errno.h"
 
+#define _TRANSFER_TILE_ 256 /* number of time values for which the radial functions are computed at once in transfer_radial_function() */
+
 /* macro: test if index_tt is in the range between index and index+num, while the flag is true */
 #define _index_tt_in_range_(index,num,flag) (flag == _TRUE_) && (index_tt >= index) && (index_tt < index+num)
 /* macro: test if index_tt corresponds to an integrated nCl/sCl contribution */
@@ -48,6 +51,31 @@
     bin = index_tt - ptr->index_tt_nc_g4;                               \
   if (_index_tt_in_range_(ptr->index_tt_nc_g5,   ppt->selection_num, ppt->has_nc_gr)) \
     bin = index_tt - ptr->index_tt_nc_g5;
+
+/**
+ * storage of the tables of transfer functions, once they have been
+ * computed: in double precision, in single precision, or as 16-bit
+ * integers in units of the maximum of |Delta_l(q)| over q for each
+ * mode, initial condition, type and multipole
+ */
+
+enum transfer_storage {transfer_storage_double, transfer_storage_float, transfer_storage_int16};
+
+#define _TRANSFER_INT16_MAX_ 32767. /* largest absolute value of the 16-bit integers in int16 storage mode */
+
+/* macros: value of the transfer function at a given position index of
+   the table ptr->transfer[index_md] (or ptr->transfer_limber[index_md]),
+   whatever the storage mode */
+#define _transfer_stored_value_(ptr,index_md,index,table,q_size)       \
+  ((ptr)->storage == transfer_storage_double ?                          \
+   (ptr)->table[index_md][index] :                                      \
+   ((ptr)->storage == transfer_storage_float ?                          \
+    (double)((ptr)->table##_float[index_md][index]) :                   \
+    (ptr)->table##_int16[index_md][index]                               \
+    *(ptr)->table##_scale[index_md][(index)/(ptr)->q_size]/_TRANSFER_INT16_MAX_))
+#define _transfer_value_(ptr,index_md,index) _transfer_stored_value_(ptr,index_md,index,transfer,q_size)
+#define _transfer_limber_value_(ptr,index_md,index) _transfer_stored_value_(ptr,index_md,index,transfer_limber,q_size_limber)
+
 /**
  * Structure containing everything about transfer functions in
  * harmonic space \f$ \Delta_l^{X} (q) \f$ that other modules need to
@@ -159,6 +187,8 @@ struct transfer {
 
   int * l;        /**< list of multipole values l[index_l] */
 
+  short ** l_sampled; /**< with the adaptive l sampling (ppr->transfer_l_adaptive), _TRUE_ for the multipoles at which the transfer functions have been computed, l_sampled[index_md][index_tt * ptr->l_size[index_md] + index_l] (the others are set to zero, and the harmonic module interpolates the C_l's there); NULL otherwise */
+
   //int * l_size_bessel; /**< for each wavenumber, maximum value of l at which bessel functions must be evaluated */
 
   double angular_rescaling; /**< correction between l and k space due to curvature (= comoving angular diameter distance to recombination / comoving radius to recombination) */
@@ -177,6 +207,8 @@ struct transfer {
 
   int index_q_flat_approximation; /**< index of the first q value using the flat rescaling approximation */
 
+  short q_list_from_file; /**< _TRUE_ if the list of q values has been read from ppr->transfer_q_list_file (it is then not refined any further) */
+
   short do_lcmb_full_limber; /**< in this particular run, will we use the full Limber scheme? */
 
   size_t q_size_limber; /**< number of wavenumber values corresponding to k up to k_max */
@@ -185,6 +217,16 @@ struct transfer {
 
   double ** k_limber; /**< list of wavenumber values used in full limber scheme */
 
+  short do_lcmb_direct_limber; /**< in this particular run, will we compute C_l^phiphi directly in the Limber approximation for l > ppr->l_switch_lcmb_direct_limber (see transfer_lcmb_direct_limber())? */
+
+  int index_l_lcmb_direct; /**< index of the first multipole of the direct Limber scheme: from there on, the CMB lensing potential is set to zero in ptr->transfer and ptr->transfer_limber */
+
+  int tau_size_lcmb_direct; /**< maximum number of wavenumbers of each multipole in the direct Limber scheme (number of times of the lensing source after recombination) */
+
+  int * k_size_lcmb_direct; /**< number of wavenumbers of each multipole in the direct Limber scheme, k_size_lcmb_direct[index_l-index_l_lcmb_direct] */
+
+  double * k_lcmb_direct; /**< wavenumbers k=(l+1/2)/(tau0-tau) probed by each multipole at the times tau of the lensing source, in growing order, k_lcmb_direct[(index_l-index_l_lcmb_direct)*tau_size_lcmb_direct+index_k] */
+
   //@}
 
   /** @name - transfer functions */
@@ -195,6 +237,20 @@ struct transfer {
 
   double ** transfer_limber; /**< table of transfer functions used in full limber scheme */
 
+  double * transfer_lcmb_direct; /**< Limber transfer functions of the CMB lensing potential at the wavenumbers of the direct Limber scheme (scalars only, always in double precision), transfer_lcmb_direct[(index_ic*(l_size[index_md_scalars]-index_l_lcmb_direct)+index_l-index_l_lcmb_direct)*tau_size_lcmb_direct+index_k] */
+
+  enum transfer_storage storage; /**< how the tables of transfer functions are stored once computed. If not in double precision, ptr->transfer and ptr->transfer_limber are freed and replaced by the arrays below; use _transfer_value_() to read them in any case */
+
+  float ** transfer_float;        /**< ptr->transfer in single precision (float storage) */
+  float ** transfer_limber_float; /**< ptr->transfer_limber in single precision (float storage) */
+
+  short ** transfer_int16;        /**< ptr->transfer in units of ptr->transfer_scale/_TRANSFER_INT16_MAX_ (int16 storage) */
+  short ** transfer_limber_int16; /**< ptr->transfer_limber in units of ptr->transfer_limber_scale/_TRANSFER_INT16_MAX_ (int16 storage) */
+  double ** transfer_scale;        /**< maximum of |Delta_l(q)| over q, transfer_scale[index_md][(index_ic * ptr->tt_size[index_md] + index_tt) * ptr->l_size[index_md] + index_l] (int16 storage) */
+  double ** transfer_limber_scale; /**< same for ptr->transfer_limber (int16 storage) */
+
+  double storage_error; /**< largest error on a transfer function caused by the storage mode, relative to the maximum of |Delta_l(q)| over q for the same mode, initial condition, type and multipole */
+
   //@}
 
   /** @name - technical parameters */
@@ -205,11 +261,35 @@ struct transfer {
 
   ErrorMsg error_message; /**< zone for writing error messages */
 
+  struct class_stats stats; /**< timings and counters of the last call to transfer_init() */
+
   short is_allocated; /**< flag is set to true if allocated */
 
   //@}
 };
 
+/**
+ * Structure containing, in the adaptive l sampling
+ * (ppr->transfer_l_adaptive), the sources of the scalar transfer
+ * functions kept between the passes over the new multipoles, such that
+ * each pass only computes its line-of-sight integrals
+ */
+
+struct transfer_sources_cache {
+
+  int index_md;             /**< index of the mode of the sources (scalars) */
+  int tt_size;              /**< number of types of this mode */
+  int ic_tt_size;           /**< number of pairs of initial condition and type */
+  int q_size;               /**< number of wavenumbers */
+
+  short * kept;             /**< kept[index_ic * tt_size + index_tt]: whether the sources of this initial condition and type are kept (types with multipoles still to be computed) */
+  int * tau_size;           /**< tau_size[index_tt]: number of times at which the sources of this type are sampled */
+  double ** tau0_minus_tau; /**< tau0_minus_tau[index_tt][index_tau]: values of (tau0-tau), the same at all wavenumbers */
+  double ** w_trapz;        /**< w_trapz[index_tt][index_tau]: trapezoidal weights of the integration over tau */
+  double *** sources;       /**< sources[index_q][index_ic * tt_size + index_tt][index_tau]: sources of the line-of-sight integrals, NULL until computed */
+
+};
+
 /**
  * Structure containing all the quantities that each thread needs to
  * know for computing transfer functions (but that can be forgotten
@@ -229,6 +309,8 @@ struct transfer_workspace {
 
   HyperInterpStruct * pBIS;  /**< pointer to structure containing all the spherical bessel functions of the flat case (used even in the non-flat case, for approximation schemes). pBIS = pointer to Bessel Interpolation Structure. */
 
+  struct transfer_offload * pto; /**< pointer to the copy of *pBIS on the device, if the line-of-sight integrals are offloaded (see transfer_offload.h) */
+
   int l_size;        /**< number of l values */
 
   //@}
@@ -259,6 +341,18 @@ struct transfer_workspace {
 
   //@}
 
+  /** @name - weights of the spline interpolation of the perturbation sources in k, at the wavenumber at hand (shared by all types, initial conditions and times, see transfer_interpolation_weights()) */
+
+  //@{
+
+  int interp_index_k;  /**< index of the sampled wavenumber of the perturbation module just below k */
+  double interp_a;     /**< weight a = (k[index_k+1]-k)/h of the source at index_k, with h = k[index_k+1]-k[index_k] */
+  double interp_b;     /**< weight b = 1-a of the source at index_k+1 */
+  double interp_c;     /**< weight (a^3-a) h^2/6 of the second derivative of the source at index_k */
+  double interp_d;     /**< weight (b^3-b) h^2/6 of the second derivative of the source at index_k+1 */
+
+  //@}
+
   /** @name - parameters defining the spatial curvature (copied from background structure) */
 
   //@{
@@ -270,6 +364,35 @@ struct transfer_workspace {
 
   double tau0_minus_tau_cut; /**< critical value of (tau0-tau) in time cut approximation for the wavenumber at hand */
   short neglect_late_source; /**< flag stating whether we use the time cut approximation for the wavenumber at hand */
+
+  short ** l_needed; /**< in the adaptive l sampling, flags of the multipoles computed in the current pass, l_needed[index_md][index_tt * ptr->l_size[index_md] + index_l]; NULL when all of them are computed */
+  struct transfer_sources_cache * psc; /**< in the adaptive l sampling, sources kept between the passes; NULL otherwise */
+
+  /** @name - multipoles whose transfer functions are integrated together by transfer_integrate_l_block() */
+
+  //@{
+
+  int l_block_size;                     /**< maximum number of multipoles in the block (1 if they are integrated separately) */
+  int l_block_num;                      /**< number of multipoles currently in the block */
+  int * l_block_index_l;                /**< l_block_index_l[index_block]: index of multipole */
+  short * l_block_neglect_late_source;  /**< l_block_neglect_late_source[index_block]: time cut approximation flag for this multipole */
+  int * l_block_index_tau_max;          /**< l_block_index_tau_max[index_block]: last time index of the integral, or -1 if the transfer function vanishes */
+  short * l_block_bessel_truncation;    /**< l_block_bessel_truncation[index_block]: whether the integral is truncated by the Bessel function */
+  double * l_block_tau0_minus_tau_min_bessel; /**< l_block_tau0_minus_tau_min_bessel[index_block]: value of (tau0-tau) below which the Bessel function vanishes */
+  double * l_block_trsf;                /**< l_block_trsf[index_block]: transfer function being integrated */
+
+  //@}
+
+  double * radial_function;             /**< radial_function[index_tau]: radial function of the multipole being integrated */
+
+  /** @name - Limber kernel of the source at hand, shared by all multipoles (see transfer_limber()) */
+
+  //@{
+
+  double * limber_sources;  /**< limber_sources[index_tau]: product sources*(tau0-tau) interpolated in the Limber approximation */
+  int limber_index_tau;     /**< bracketing index found by the last Limber interpolation, used as a starting point by the next one; -1 when limber_sources must be rebuilt */
+
+  //@}
 };
 
 /**
@@ -322,6 +445,21 @@ extern "C" {
                     struct transfer * ptr
                     );
 
+  int transfer_storage_convert(
+                               struct perturbations * ppt,
+                               struct transfer * ptr
+                               );
+
+  int transfer_storage_convert_table(
+                                     struct transfer * ptr,
+                                     double * table,
+                                     int block_num,
+                                     int block_size,
+                                     float ** table_float,
+                                     short ** table_int16,
+                                     double ** scale
+                                     );
+
   int transfer_free(
                     struct transfer * ptr
                     );
@@ -339,13 +477,16 @@ extern "C" {
                                                             struct perturbations * ppt,
                                                             struct fourier * pfo,
                                                             struct transfer * ptr,
-                                                            double *** sources
+                                                            double *** sources,
+                                                            double *** nl_corrections
                                                             );
 
   int transfer_perturbation_source_spline(
                                           struct perturbations * ppt,
                                           struct transfer * ptr,
+                                          int ** tp_of_tt,
                                           double *** sources,
+                                          double *** nl_corrections,
                                           double *** sources_spline
                                           );
 
@@ -353,7 +494,8 @@ extern "C" {
                                          struct perturbations * ppt,
                                          struct fourier * pfo,
                                          struct transfer * ptr,
-                                         double *** sources
+                                         double *** sources,
+                                         double *** nl_corrections
                                          );
 
   int transfer_perturbation_sources_spline_free(
@@ -377,6 +519,81 @@ extern "C" {
                           int sgnK
                           );
 
+  int transfer_get_q_flat_approximation(
+                                        struct precision * ppr,
+                                        struct transfer * ptr,
+                                        double K,
+                                        int sgnK
+                                        );
+
+  int transfer_refine_q_list(
+                             struct precision * ppr,
+                             struct perturbations * ppt,
+                             struct transfer * ptr,
+                             double K,
+                             int sgnK,
+                             short ** q_needed,
+                             int * q_new
+                             );
+
+  int transfer_l_field(
+                       struct perturbations * ppt,
+                       struct transfer * ptr,
+                       int index_md,
+                       int index_tt
+                       );
+
+  int transfer_get_l_sampling(
+                              struct precision * ppr,
+                              struct perturbations * ppt,
+                              struct transfer * ptr
+                              );
+
+  int transfer_refine_l_list(
+                             struct precision * ppr,
+                             struct perturbations * ppt,
+                             struct transfer * ptr,
+                             short *** l_needed,
+                             int * l_new
+                             );
+
+  int transfer_sources_cache_init(
+                                  struct precision * ppr,
+                                  struct background * pba,
+                                  struct perturbations * ppt,
+                                  struct transfer * ptr,
+                                  double tau_rec,
+                                  double * window,
+                                  int tau_size_max,
+                                  struct transfer_sources_cache * psc
+                                  );
+
+  int transfer_sources_cache_release(
+                                     struct transfer * ptr,
+                                     short ** l_needed,
+                                     struct transfer_sources_cache * psc
+                                     );
+
+  int transfer_sources_cache_free(
+                                  struct transfer_sources_cache * psc
+                                  );
+
+  int transfer_q_bisection_test(
+                                struct precision * ppr,
+                                struct transfer * ptr,
+                                double * trsf,
+                                int q_size,
+                                short * q_needed,
+                                double * bisection_error,
+                                short * bisect
+                                );
+
+  int transfer_write_q_list(
+                            struct precision * ppr,
+                            struct transfer * ptr,
+                            double q_period
+                            );
+
   int transfer_get_q_limber_list(
                                  struct precision * ppr,
                                  struct perturbations * ppt,
@@ -434,6 +651,7 @@ extern "C" {
                                   int tau_size_max,
                                   double tau_rec,
                                   double *** sources,
+                                  double *** nl_corrections,
                                   double *** sources_spline,
                                   double * window,
                                   struct transfer_workspace * ptw,
@@ -447,14 +665,22 @@ extern "C" {
                                   int index_q
                                   );
 
+  int transfer_interpolation_weights(
+                                     struct perturbations * ppt,
+                                     struct transfer * ptr,
+                                     struct transfer_workspace * ptw,
+                                     int index_md,
+                                     double k
+                                     );
+
   int transfer_interpolate_sources(
                                    struct perturbations * ppt,
-                                   struct transfer * ptr,
-                                   double k,
+                                   struct transfer_workspace * ptw,
                                    int index_md,
                                    int index_ic,
                                    int index_type,
                                    double * sources,
+                                   double * nl_correction,
                                    double * source_spline,
                                    double * interpolated_sources
                                    );
@@ -588,6 +814,31 @@ extern "C" {
                          double * trsf
                          );
 
+  int transfer_integration_bounds(
+                                  struct transfer * ptr,
+                                  struct transfer_workspace * ptw,
+                                  int index_q,
+                                  double l,
+                                  int index_l,
+                                  double k,
+                                  short neglect_late_source,
+                                  int * index_tau_max,
+                                  double * tau0_minus_tau_min_bessel,
+                                  short * bessel_truncation
+                                  );
+
+  int transfer_integrate_l_block(
+                                 struct perturbations * ppt,
+                                 struct transfer * ptr,
+                                 struct transfer_workspace * ptw,
+                                 int index_q,
+                                 int index_md,
+                                 int index_ic,
+                                 int index_tt,
+                                 double k,
+                                 radial_function_type radial_type
+                                 );
+
   int transfer_limber(
                       struct transfer * ptr,
                       struct transfer_workspace * ptw,
@@ -599,12 +850,27 @@ extern "C" {
                       double * trsf
                       );
 
+  int transfer_limber_sources(
+                              struct transfer_workspace * ptw
+                              );
+
+  int transfer_lcmb_direct_limber(
+                                  struct perturbations * ppt,
+                                  struct transfer * ptr,
+                                  double tau_rec,
+                                  double tau0,
+                                  int ** tp_of_tt,
+                                  double *** pert_nl_corrections,
+                                  double *** pert_sources_spline
+                                  );
+
   int transfer_limber_interpolate(
                                   struct transfer * ptr,
                                   double * tau0_minus_tau,
-                                  double * sources,
+                                  double * limber_sources,
                                   int tau_size,
                                   double tau0_minus_tau_limber,
+                                  int * index_tau,
                                   double * S
                                   );
 
@@ -659,6 +925,8 @@ extern "C" {
                                int index_q,
                                int index_l,
                                int x_size,
+                               int index_min,
+                               int index_max,
                                double * radial_function,
                                radial_function_type radial_type
                                );
@@ -669,6 +937,7 @@ extern "C" {
                                     );
 
   int transfer_global_selection_read(
+                                     struct precision * ppr,
                                      struct transfer * ptr
                                      );
 
@@ -681,7 +950,8 @@ extern "C" {
                               double K,
                               int sgnK,
                               double tau0_minus_tau_cut,
-                              HyperInterpStruct * pBIS
+                              HyperInterpStruct * pBIS,
+                              struct transfer_offload * pto
                               );
 
   int transfer_workspace_free(
@@ -689,6 +959,25 @@ extern "C" {
                               struct transfer_workspace *ptw
                               );
 
+  int transfer_share_q(
+                       struct perturbations * ppt,
+                       struct transfer * ptr,
+                       int q_block_size,
+                       int q_loop_size,
+                       short * q_needed
+                       );
+
+  size_t transfer_copy_q(
+                         struct perturbations * ppt,
+                         struct transfer * ptr,
+                         int q_block_size,
+                         int q_loop_size,
+                         short * q_needed,
+                         int rank,
+                         double * buffer,
+                         int to_buffer
+                         );
+
   int transfer_update_HIS(
                           struct precision * ppr,
                           struct transfer * ptr,
@@ -725,6 +1014,19 @@ extern "C" {
                                     double ** window
                                     );
 
+  int transfer_precompute_selection_for_each_type(
+                                                  struct precision * ppr,
+                                                  struct background * pba,
+                                                  struct perturbations * ppt,
+                                                  struct transfer * ptr,
+                                                  double tau_rec,
+                                                  double tau0,
+                                                  int tau_size_max,
+                                                  int index_md,
+                                                  int index_tt,
+                                                  double * window
+                                                  );
+
   int transfer_f_evo(
                      struct background* pba,
                      struct transfer * ptr,
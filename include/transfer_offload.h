@@ -0,0 +1,87 @@
+/** @file transfer_offload.h Line-of-sight integrals of the transfer module on an accelerator */
+
+#ifndef __TRANSFER_OFFLOAD__
+#define __TRANSFER_OFFLOAD__
+
+#include "common.h"
+#include "hyperspherical.h"
+
+/**
+ * With _CLASS_OFFLOAD_ defined (make OFFLOAD=yes), the line-of-sight
+ * integrals of the flat case computed by transfer_integrate_l_block()
+ * are sent to the default device of OpenMP (e.g. a GPU), one kernel per
+ * wavenumber and type with all the multipoles at once. The table of
+ * spherical Bessel functions is copied to the device once per call of
+ * transfer_init(); the sources, weights and arguments of the block are
+ * copied at each call. The types whose radial functions are not
+ * implemented on the device (vector modes), the non-flat case, and all
+ * runs without a device remain on the CPU.
+ *
+ * The environment variable CLASS_OFFLOAD=no keeps everything on the
+ * CPU, and CLASS_OFFLOAD=host runs the kernels on the host even without
+ * a device (for checking them).
+ */
+
+struct transfer_offload {
+
+  short is_active;   /**< _TRUE_ if the integrals of transfer_integrate_l_block() are computed by the device */
+  int device;        /**< OpenMP device number */
+
+  /** @name - copy of the flat Bessel table on the device (see HyperInterpStruct) */
+
+  //@{
+
+  HyperInterpStruct * pBIS; /**< table on the host */
+  int K;                    /**< sign of the curvature of the table */
+  double beta;              /**< beta of the table */
+  double delta_x;           /**< x-spacing */
+  int x_size;               /**< number of x values */
+  int l_size;               /**< number of l values */
+  int * l;                  /**< l values */
+  double * x;               /**< x values */
+  double * sinK;            /**< sin_K(x) */
+  double * cotK;            /**< cot_K(x) */
+  double * phi;             /**< phi[index_l*x_size+index_x] */
+  double * dphi;            /**< dphi[index_l*x_size+index_x] */
+
+  //@}
+};
+
+struct transfer_workspace;
+
+/*
+ * Boilerplate for C++
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  int transfer_offload_init(
+                            struct transfer_offload * pto,
+                            HyperInterpStruct * pBIS,
+                            ErrorMsg error_message
+                            );
+
+  int transfer_offload_free(
+                            struct transfer_offload * pto
+                            );
+
+  short transfer_offload_supports(
+                                  struct transfer_offload * pto,
+                                  struct transfer_workspace * ptw,
+                                  int radial_type
+                                  );
+
+  int transfer_offload_l_block(
+                               struct transfer_offload * pto,
+                               struct transfer_workspace * ptw,
+                               int tau_size_block,
+                               int radial_type,
+                               ErrorMsg error_message
+                               );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
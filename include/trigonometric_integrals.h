@@ -26,6 +26,14 @@ extern "C" {
          ErrorMsg error_message
 				 );
 
+  int sine_cosine_integrals(
+                            int size,
+                            double * __restrict__ x,
+                            double * __restrict__ Si,
+                            double * __restrict__ Ci,
+                            ErrorMsg error_message
+                            );
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,58 +18,51 @@ int main(int argc, char **argv) {
   struct distortions sd;      /* for spectral distortions */
   struct output op;           /* for output files */
   ErrorMsg errmsg;            /* for error messages */
+  int computed;               /* modules initialized by modules_init() */
+  int restored = 0;           /* modules restored from a checkpoint */
+  int written;                /* modules saved in a checkpoint */
+  FileName checkpoint_name;   /* checkpoint written for this run */
 
-  if (input_init(argc, argv,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
-    printf("\n\nError running input_init \n=>%s\n",errmsg);
-    return _FAILURE_;
-  }
-
-  if (background_init(&pr,&ba) == _FAILURE_) {
-    printf("\n\nError running background_init \n=>%s\n",ba.error_message);
-    return _FAILURE_;
-  }
-
-  if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
-    printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
-    return _FAILURE_;
-  }
-
-  if (perturbations_init(&pr,&ba,&th,&pt) == _FAILURE_) {
-    printf("\n\nError in perturbations_init \n=>%s\n",pt.error_message);
-    return _FAILURE_;
-  }
-
-  if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
-    printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
+  if (class_mpi_init(&argc,&argv) == _FAILURE_) {
+    printf("\n\nError in class_mpi_init\n");
     return _FAILURE_;
   }
 
-  if (fourier_init(&pr,&ba,&th,&pt,&pm,&fo) == _FAILURE_) {
-    printf("\n\nError in fourier_init \n=>%s\n",fo.error_message);
+  if (input_init(argc, argv,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+    printf("\n\nError running input_init \n=>%s\n",errmsg);
     return _FAILURE_;
   }
 
-  if (transfer_init(&pr,&ba,&th,&pt,&fo,&tr) == _FAILURE_) {
-    printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
-    return _FAILURE_;
+  /* record the tasks of the parallel regions, written by output_init() */
+  if (op.write_trace == _TRUE_) {
+    class_parallel_trace_start();
   }
 
-  if (harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr) == _FAILURE_) {
-    printf("\n\nError in harmonic_init \n=>%s\n",hr.error_message);
+  /* modules computed in a previous run with the same input */
+  if ((op.checkpoint_file[0] != '\0') &&
+      (checkpoint_read(op.checkpoint_file,op.digest,op.checkpoint_modules,&ba,&th,&pt,&fo,&tr,&hr,&le,op.output_verbose,&restored,errmsg) == _FAILURE_)) {
+    printf("\n\nError in checkpoint_read \n=>%s\n",errmsg);
     return _FAILURE_;
   }
 
-  if (lensing_init(&pr,&pt,&hr,&fo,&le) == _FAILURE_) {
-    printf("\n\nError in lensing_init \n=>%s\n",le.error_message);
+  /* background, thermodynamics, perturbations, primordial, fourier,
+     transfer, harmonic, lensing and distortions, the independent ones
+     concurrently */
+  if (modules_init(&pr,&ba,&th,&pt,&pm,&fo,&tr,&hr,&le,&sd,_ALL_MODULES_ & ~restored,&computed,errmsg) == _FAILURE_) {
+    printf("\n\nError in modules_init \n=>%s\n",errmsg);
     return _FAILURE_;
   }
 
-  if (distortions_init(&pr,&ba,&th,&pt,&pm,&sd) == _FAILURE_) {
-    printf("\n\nError in distortions_init \n=>%s\n",sd.error_message);
-    return _FAILURE_;
+  if ((class_mpi_rank() == 0) && (op.write_checkpoint == _TRUE_)) {
+    sprintf(checkpoint_name,"%s%s",op.root,"checkpoint.bin");
+    if (checkpoint_write(checkpoint_name,op.digest,computed | restored,&ba,&th,&pt,&tr,&hr,&le,op.output_verbose,&written,errmsg) == _FAILURE_) {
+      printf("\n\nError in checkpoint_write \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
   }
 
-  if (output_init(&ba,&th,&pt,&pm,&tr,&hr,&fo,&le,&sd,&op) == _FAILURE_) {
+  /* with MPI, all processes have the same results, written by the first one */
+  if ((class_mpi_rank() == 0) && (output_init(&ba,&th,&pt,&pm,&tr,&hr,&fo,&le,&sd,&op) == _FAILURE_)) {
     printf("\n\nError in output_init \n=>%s\n",op.error_message);
     return _FAILURE_;
   }
@@ -0,0 +1,689 @@
+/** @file class_fisher.c
+ *
+ * Derivatives of the C_l's with respect to input parameters, for
+ * Fisher forecasts.
+ */
+
+/* this main reads one input file (the fiducial model) and a list of
+   parameters, and computes the derivatives of the C_l's with respect
+   to each of them by finite differences, within the same process.
+
+   Usage: class_fisher [-j points] input.ini parameters.dat output.dat
+
+   Each line of the parameter file gives 'name step [stencil]' for one
+   parameter (empty lines and lines starting with # are skipped). The
+   parameter must be set to a number in the input file; step is the
+   absolute step of the finite differences, and stencil the number of
+   points (2, the default, or 4): dC_l/dp is
+
+     [C_l(p+h) - C_l(p-h)] / 2h
+
+   or [-C_l(p+2h) + 8 C_l(p+h) - 8 C_l(p-h) + C_l(p-2h)] / 12h.
+
+   The fiducial model is computed first. Each point of the stencils
+   then only recomputes the modules whose input changed (as tracked by
+   input_module_digests()), and the modules on which they depend: the
+   others are shared with the fiducial model, which is only read. For
+   instance, the points of A_s, n_s or r only recompute the primordial,
+   harmonic and lensing modules (and fourier, and then transfer, with
+   non-linear corrections). The points are sent as tasks to the
+   process-wide thread pool, at most 'points' of them at a time
+   (default: 4), and their modules share the same pool. With MPI, the
+   points are computed one after the other, each of them by all the
+   processes.
+
+   The output file has one line per multipole, with l, the C_l's of
+   the fiducial model (lensed if lensing is requested, dimensionless
+   and without the factor l(l+1)/2pi), and their derivatives with
+   respect to each parameter. The modules shared with the fiducial
+   model by the points of each parameter are printed. */
+
+#include "class.h"
+
+#define _FISHER_TYPES_ 5
+
+char * fisher_type_names[_FISHER_TYPES_] = {"TT","EE","TE","BB","phiphi"};
+
+/* modules which can be shared with the fiducial model, in the order of enum class_module */
+char * fisher_module_names[module_size] = {"background","thermodynamics","perturbations","primordial","fourier",
+                                           "transfer","harmonic","lensing","distortions"};
+
+struct fisher_parameter {
+  char name[_ARGUMENT_LENGTH_MAX_];
+  double value;                   /* value in the fiducial model */
+  double step;
+  int stencil;                    /* 2 or 4 */
+  int shared;                     /* flags (1 << module_xxx) of the modules shared by all points with the fiducial model */
+};
+
+struct fisher_point {
+  int index_parameter;
+  int offset;                     /* the parameter is value+offset*step */
+  int status;
+  ErrorMsg error_message;
+  int shared;                     /* flags (1 << module_xxx) of the modules shared with the fiducial model */
+  double * cl;                    /* cl[(l-2)*_FISHER_TYPES_+index_type] */
+};
+
+/* fiducial model, shared by all points (only read by them) */
+struct fisher_fiducial {
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  unsigned long long digest[_NUM_INPUT_MODULES_]; /* see input_module_digests() */
+  int computed;                   /* modules initialized by modules_init() */
+  short has_type[_FISHER_TYPES_];
+  short is_lensed;                /* _TRUE_ if the C_l's are lensed */
+  int l_max;                      /* last multipole of cl */
+  double * cl;                    /* cl[(l-2)*_FISHER_TYPES_+index_type] */
+};
+
+/* replace the value of a parameter */
+int fisher_set_parameter(
+                         struct file_content * pfc,
+                         char * name,
+                         double value,
+                         ErrorMsg errmsg
+                         ) {
+
+  int index;
+
+  for (index=0; index<pfc->size; index++) {
+    if (strcmp(pfc->name[index],name) == 0)
+      break;
+  }
+  class_test(index == pfc->size,
+             errmsg,
+             "the parameter %s should be set in the input file",name);
+
+  sprintf(pfc->value[index],"%.17e",value);
+  pfc->read[index] = _FALSE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read the list of parameters, and their values in the input file.
+ *
+ * @param filename     Input: name of the parameter file
+ * @param pfc          Input: content of the input file
+ * @param pparameters  Output: array of parameters, allocated here
+ * @param psize        Output: number of parameters
+ * @param errmsg       Output: error message
+ * @return the error status
+ */
+
+int fisher_read_parameters(
+                           char * filename,
+                           struct file_content * pfc,
+                           struct fisher_parameter ** pparameters,
+                           int * psize,
+                           ErrorMsg errmsg
+                           ) {
+
+  FILE * list;
+  char line[_LINE_LENGTH_MAX_];
+  char * start;
+  struct fisher_parameter * parameter;
+  int capacity = 0;
+  int line_number = 0;
+  int num_read, index;
+
+  *pparameters = NULL;
+  *psize = 0;
+
+  class_open(list,filename,"r",errmsg);
+
+  while (fgets(line,_LINE_LENGTH_MAX_,list) != NULL) {
+    line_number++;
+    for (start = line; (*start == ' ') || (*start == '\t'); start++);
+    if ((*start == '#') || (*start == '\n') || (*start == '\r') || (*start == '\0'))
+      continue;
+
+    if (*psize == capacity) {
+      capacity = MAX(2*capacity,16);
+      class_realloc(*pparameters,capacity*sizeof(struct fisher_parameter),errmsg);
+    }
+    parameter = &((*pparameters)[*psize]);
+    memset(parameter,0,sizeof(struct fisher_parameter));
+    parameter->stencil = 2;
+
+    num_read = sscanf(start,"%s %lf %d",parameter->name,&(parameter->step),&(parameter->stencil));
+    class_test_except((num_read < 2) || (parameter->step <= 0.) ||
+                      ((parameter->stencil != 2) && (parameter->stencil != 4)),
+                      errmsg,
+                      fclose(list),
+                      "line %d of %s should give: name step [stencil], with a positive step and a stencil of 2 or 4 points",
+                      line_number,filename);
+
+    for (index=0; index<pfc->size; index++) {
+      if (strcmp(pfc->name[index],parameter->name) == 0)
+        break;
+    }
+    class_test_except((index == pfc->size) || (sscanf(pfc->value[index],"%lf",&(parameter->value)) != 1),
+                      errmsg,
+                      fclose(list),
+                      "the parameter %s of %s should be set to a number in the input file",parameter->name,filename);
+
+    (*psize)++;
+  }
+
+  fclose(list);
+
+  class_test(*psize == 0,
+             errmsg,
+             "no parameter in %s",filename);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Get the C_l's of a model, lensed if the lensing module computed
+ * them.
+ *
+ * @param ppt       Input: perturbations
+ * @param phr       Input: harmonic
+ * @param ple       Input: lensing
+ * @param has_type  Output: which of the types of fisher_type_names are there
+ * @param is_lensed Output: _TRUE_ if the C_l's are lensed
+ * @param l_max     Output: last multipole
+ * @param pcl       Output: cl[(l-2)*_FISHER_TYPES_+index_type], allocated here
+ * @param errmsg    Output: error message
+ * @return the error status
+ */
+
+int fisher_get_cl(
+                  struct perturbations * ppt,
+                  struct harmonic * phr,
+                  struct lensing * ple,
+                  short * has_type,
+                  short * is_lensed,
+                  int * l_max,
+                  double ** pcl,
+                  ErrorMsg errmsg
+                  ) {
+
+  int index_ct[_FISHER_TYPES_];
+  int ct_size, index_type, l;
+  double * cl;
+
+  class_test(ppt->has_cls == _FALSE_,
+             errmsg,
+             "the input file should request C_l's");
+
+  if (ple->has_lensed_cls == _TRUE_) {
+    has_type[0] = ple->has_tt; index_ct[0] = ple->index_lt_tt;
+    has_type[1] = ple->has_ee; index_ct[1] = ple->index_lt_ee;
+    has_type[2] = ple->has_te; index_ct[2] = ple->index_lt_te;
+    has_type[3] = ple->has_bb; index_ct[3] = ple->index_lt_bb;
+    has_type[4] = ple->has_pp; index_ct[4] = ple->index_lt_pp;
+    ct_size = ple->lt_size;
+    *is_lensed = _TRUE_;
+    *l_max = ple->l_lensed_max;
+  }
+  else {
+    has_type[0] = phr->has_tt; index_ct[0] = phr->index_ct_tt;
+    has_type[1] = phr->has_ee; index_ct[1] = phr->index_ct_ee;
+    has_type[2] = phr->has_te; index_ct[2] = phr->index_ct_te;
+    has_type[3] = phr->has_bb; index_ct[3] = phr->index_ct_bb;
+    has_type[4] = phr->has_pp; index_ct[4] = phr->index_ct_pp;
+    ct_size = phr->ct_size;
+    *is_lensed = _FALSE_;
+    *l_max = phr->l_max_tot;
+  }
+
+  class_test(*l_max < 2,
+             errmsg,
+             "the C_l's should extend to l >= 2");
+
+  class_alloc(cl,(*l_max-1)*ct_size*sizeof(double),errmsg);
+  class_alloc(*pcl,(*l_max-1)*_FISHER_TYPES_*sizeof(double),errmsg);
+  if (*is_lensed == _TRUE_) {
+    class_call_except(lensing_cl_at_l_range(ple,2,*l_max,cl),
+                      ple->error_message,
+                      errmsg,
+                      free(cl));
+  }
+  else {
+    class_call_except(harmonic_cl_at_l_range(phr,2,*l_max,cl),
+                      phr->error_message,
+                      errmsg,
+                      free(cl));
+  }
+  for (l=2; l<=*l_max; l++) {
+    for (index_type=0; index_type<_FISHER_TYPES_; index_type++) {
+      (*pcl)[(l-2)*_FISHER_TYPES_+index_type] =
+        (has_type[index_type] == _TRUE_) ? cl[(l-2)*ct_size+index_ct[index_type]] : 0.;
+    }
+  }
+  free(cl);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the fiducial model.
+ *
+ * @param pfc_base Input: content of the input file (not modified)
+ * @param pff      Output: fiducial model
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int fisher_run_fiducial(
+                        struct file_content * pfc_base,
+                        struct fisher_fiducial * pff,
+                        ErrorMsg errmsg
+                        ) {
+
+  struct file_content fc;
+  int status;
+
+  pff->computed = 0;
+
+  class_call(parser_init_from_pfc(pfc_base,&fc,errmsg),
+             errmsg,
+             errmsg);
+
+  status = input_read_from_file(&fc,&(pff->pr),&(pff->ba),&(pff->th),&(pff->pt),&(pff->tr),&(pff->pm),
+                                &(pff->hr),&(pff->fo),&(pff->le),&(pff->sd),&(pff->op),errmsg);
+  if (status == _SUCCESS_)
+    status = input_module_digests(&fc,&(pff->pr),pff->digest,errmsg);
+  parser_free(&fc);
+  class_call(status,errmsg,errmsg);
+
+  class_call(modules_init(&(pff->pr),&(pff->ba),&(pff->th),&(pff->pt),&(pff->pm),&(pff->fo),&(pff->tr),
+                          &(pff->hr),&(pff->le),&(pff->sd),_ALL_MODULES_,&(pff->computed),errmsg),
+             errmsg,
+             errmsg);
+
+  class_call(fisher_get_cl(&(pff->pt),&(pff->hr),&(pff->le),pff->has_type,&(pff->is_lensed),&(pff->l_max),&(pff->cl),errmsg),
+             errmsg,
+             errmsg);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute one point of a stencil, sharing with the fiducial model all
+ * the modules which do not depend on the parameter, and keep its
+ * C_l's.
+ *
+ * @param pfc_base    Input: content of the input file (not modified)
+ * @param pff         Input: fiducial model (not modified)
+ * @param pparameter  Input: parameter of the point
+ * @param pfp         Input/Output: point, C_l's filled here
+ * @param errmsg      Output: error message
+ * @return the error status
+ */
+
+int fisher_run_point(
+                     struct file_content * pfc_base,
+                     struct fisher_fiducial * pff,
+                     struct fisher_parameter * pparameter,
+                     struct fisher_point * pfp,
+                     ErrorMsg errmsg
+                     ) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermodynamics th;   /* for thermodynamics */
+  struct perturbations pt;    /* for source functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct fourier fo;          /* for non-linear spectra */
+  struct transfer tr;         /* for transfer functions */
+  struct harmonic hr;         /* for output spectra */
+  struct lensing le;          /* for lensed spectra */
+  struct distortions sd;      /* for spectral distortions */
+  struct output op;           /* for output files */
+  struct file_content fc;
+  unsigned long long digest[_NUM_INPUT_MODULES_];
+  short was_computed[_NUM_INPUT_MODULES_];
+  short can_reuse[_NUM_INPUT_MODULES_];
+  short has_type[_FISHER_TYPES_];
+  short is_lensed;
+  int l_max;
+  int computed = 0;
+  int status, index_module;
+
+  pfp->shared = 0;
+
+  /** - each point has its own file content, since input_read_from_file() marks the entries as read */
+  class_call(parser_init_from_pfc(pfc_base,&fc,errmsg),
+             errmsg,
+             errmsg);
+
+  status = fisher_set_parameter(&fc,pparameter->name,pparameter->value+pfp->offset*pparameter->step,errmsg);
+  if (status == _SUCCESS_)
+    status = input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg);
+  if (status == _SUCCESS_)
+    status = input_module_digests(&fc,&pr,digest,errmsg);
+  parser_free(&fc);
+  class_call(status,errmsg,errmsg);
+
+  /** - modules of the fiducial model with the same input */
+  for (index_module=0; index_module<_NUM_INPUT_MODULES_; index_module++) {
+    if (index_module < module_size)
+      was_computed[index_module] = ((pff->computed & (1 << index_module)) != 0) ? _TRUE_ : _FALSE_;
+    else
+      was_computed[index_module] = _TRUE_;
+  }
+  input_module_reuse(pff->digest,digest,was_computed,fo.method != nl_none,can_reuse);
+  for (index_module=0; index_module<module_size; index_module++) {
+    if (can_reuse[index_module] == _TRUE_)
+      pfp->shared |= (1 << index_module);
+  }
+
+  /* the new input structures of the shared modules (identical to those
+     of the fiducial model) are dropped */
+  if ((pfp->shared & (1 << module_background)) != 0) {
+    background_free_input(&ba);
+    ba = pff->ba;
+  }
+  if ((pfp->shared & (1 << module_thermodynamics)) != 0) {
+    thermodynamics_free_input(&th);
+    th = pff->th;
+  }
+  if ((pfp->shared & (1 << module_perturbations)) != 0) {
+    perturbations_free_input(&pt);
+    pt = pff->pt;
+  }
+  if ((pfp->shared & (1 << module_primordial)) != 0) pm = pff->pm;
+  if ((pfp->shared & (1 << module_fourier)) != 0) fo = pff->fo;
+  if ((pfp->shared & (1 << module_transfer)) != 0) tr = pff->tr;
+  if ((pfp->shared & (1 << module_harmonic)) != 0) hr = pff->hr;
+  if ((pfp->shared & (1 << module_lensing)) != 0) le = pff->le;
+  if ((pfp->shared & (1 << module_distortions)) != 0) sd = pff->sd;
+
+  /** - the other modules, the independent ones concurrently */
+  status = modules_init(&pr,&ba,&th,&pt,&pm,&fo,&tr,&hr,&le,&sd,_ALL_MODULES_ & ~(pfp->shared),&computed,errmsg);
+
+  /** - keep the C_l's */
+  if (status == _SUCCESS_) {
+    status = fisher_get_cl(&pt,&hr,&le,has_type,&is_lensed,&l_max,&(pfp->cl),errmsg);
+    if ((status == _SUCCESS_) && ((l_max != pff->l_max) || (is_lensed != pff->is_lensed))) {
+      class_sprintf(errmsg,"the C_l's of the point do not have the same multipoles as those of the fiducial model");
+      status = _FAILURE_;
+    }
+  }
+
+  /** - free the modules which were computed for this point */
+  if ((computed & (1 << module_distortions)) != 0) distortions_free(&sd);
+  if ((computed & (1 << module_lensing)) != 0) lensing_free(&le);
+  if ((computed & (1 << module_harmonic)) != 0) harmonic_free(&hr);
+  if ((computed & (1 << module_transfer)) != 0) transfer_free(&tr);
+  if ((computed & (1 << module_fourier)) != 0) fourier_free(&fo);
+  if ((computed & (1 << module_primordial)) != 0) primordial_free(&pm);
+  if ((computed & (1 << module_perturbations)) != 0) perturbations_free(&pt);
+  if ((computed & (1 << module_thermodynamics)) != 0) thermodynamics_free(&th);
+  if ((computed & (1 << module_background)) != 0) background_free(&ba);
+
+  return status;
+}
+
+/**
+ * Run the points index_first <= index < index_last concurrently, on
+ * the shared pool. The status and error message of each point are
+ * kept in the point.
+ */
+
+int fisher_run_points(
+                      struct file_content * pfc_base,
+                      struct fisher_fiducial * pff,
+                      struct fisher_parameter * parameters,
+                      struct fisher_point * points,
+                      int index_first,
+                      int index_last
+                      ) {
+
+  class_setup_parallel();
+
+  class_parallel_for(index_point,index_first,index_last,1,with_arguments(pfc_base,pff,parameters,points),
+    points[index_point].status = fisher_run_point(pfc_base,pff,&(parameters[points[index_point].index_parameter]),
+                                                  &(points[index_point]),points[index_point].error_message);
+    return _SUCCESS_;
+  );
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the C_l's of the fiducial model and their derivatives.
+ *
+ * @param filename       Input: name of the output file
+ * @param pff            Input: fiducial model
+ * @param parameters     Input: parameters
+ * @param num_parameters Input: number of parameters
+ * @param points         Input: points of the stencils, in the order of the parameters
+ * @param errmsg         Output: error message
+ * @return the error status
+ */
+
+int fisher_write_derivatives(
+                             char * filename,
+                             struct fisher_fiducial * pff,
+                             struct fisher_parameter * parameters,
+                             int num_parameters,
+                             struct fisher_point * points,
+                             ErrorMsg errmsg
+                             ) {
+
+  /* weights of the stencils of 2 and 4 points, with offsets (-1,1) and (-2,-1,1,2) */
+  double weight_2[2] = {-1./2.,1./2.};
+  double weight_4[4] = {1./12.,-8./12.,8./12.,-1./12.};
+  FILE * output;
+  struct fisher_point * pfp;
+  double * weight;
+  double derivative;
+  int index_parameter, index_type, index_stencil, column = 1, l;
+
+  class_open(output,filename,"w",errmsg);
+
+  fprintf(output,"# dimensionless %s C_l's of the fiducial model, and their derivatives\n",
+          (pff->is_lensed == _TRUE_) ? "lensed" : "unlensed");
+  fprintf(output,"#");
+  fprintf(output," %d:l",column++);
+  for (index_type=0; index_type<_FISHER_TYPES_; index_type++) {
+    if (pff->has_type[index_type] == _TRUE_)
+      fprintf(output," %d:%s",column++,fisher_type_names[index_type]);
+  }
+  for (index_parameter=0; index_parameter<num_parameters; index_parameter++) {
+    for (index_type=0; index_type<_FISHER_TYPES_; index_type++) {
+      if (pff->has_type[index_type] == _TRUE_)
+        fprintf(output," %d:d%s/d[%s]",column++,fisher_type_names[index_type],parameters[index_parameter].name);
+    }
+  }
+  fprintf(output,"\n");
+
+  for (l=2; l<=pff->l_max; l++) {
+    fprintf(output,"%d",l);
+    for (index_type=0; index_type<_FISHER_TYPES_; index_type++) {
+      if (pff->has_type[index_type] == _TRUE_)
+        fprintf(output," %.10e",pff->cl[(l-2)*_FISHER_TYPES_+index_type]);
+    }
+    pfp = points;
+    for (index_parameter=0; index_parameter<num_parameters; index_parameter++) {
+      weight = (parameters[index_parameter].stencil == 2) ? weight_2 : weight_4;
+      for (index_type=0; index_type<_FISHER_TYPES_; index_type++) {
+        if (pff->has_type[index_type] == _FALSE_)
+          continue;
+        derivative = 0.;
+        for (index_stencil=0; index_stencil<parameters[index_parameter].stencil; index_stencil++)
+          derivative += weight[index_stencil]*pfp[index_stencil].cl[(l-2)*_FISHER_TYPES_+index_type];
+        fprintf(output," %.10e",derivative/parameters[index_parameter].step);
+      }
+      pfp += parameters[index_parameter].stencil;
+    }
+    fprintf(output,"\n");
+  }
+
+  fclose(output);
+
+  return _SUCCESS_;
+}
+
+int main(int argc, char **argv) {
+
+  int num_concurrent = 4;
+  char * filenames[3];
+  int num_filenames = 0;
+  struct file_content fc;
+  struct fisher_fiducial ff;
+  struct fisher_parameter * parameters;
+  struct fisher_point * points;
+  int num_parameters, num_points, index_parameter, index_point, index_first, index_last, index_module, index_stencil;
+  int num_failures = 0;
+  ErrorMsg errmsg;
+  int i;
+
+  if (class_mpi_init(&argc,&argv) == _FAILURE_) {
+    printf("\n\nError in class_mpi_init\n");
+    return _FAILURE_;
+  }
+
+  for (i=1; i<argc; i++) {
+    if ((strcmp(argv[i],"-j") == 0) && (i+1 < argc)) {
+      num_concurrent = atoi(argv[++i]);
+    }
+    else if ((argv[i][0] == '-') || (num_filenames == 3)) {
+      num_filenames = 0;
+      break;
+    }
+    else {
+      filenames[num_filenames++] = argv[i];
+    }
+  }
+  if (num_filenames != 3) {
+    fprintf(stderr,"usage: %s [-j points] input.ini parameters.dat output.dat\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /* the collective calls of the modules must be made in the same order by all MPI processes */
+  if ((num_concurrent < 1) || (class_mpi_size() > 1))
+    num_concurrent = 1;
+
+  if (parser_read_file(filenames[0],&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError in parser_read_file \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /* the points run concurrently: no output from the modules (the
+     output parameters are only read by input_init()) */
+  for (i=0; i<fc.size; i++) {
+    if ((strlen(fc.name[i]) > 8) && (strcmp(fc.name[i]+strlen(fc.name[i])-8,"_verbose") == 0))
+      strcpy(fc.value[i],"0");
+    if (strcmp(fc.name[i],"overwrite_root") == 0)
+      fc.read[i] = _TRUE_;
+  }
+
+  if (fisher_read_parameters(filenames[1],&fc,&parameters,&num_parameters,errmsg) == _FAILURE_) {
+    printf("\n\nError in fisher_read_parameters \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /** - points of the stencils, in the order of the parameters, with
+      the offsets expected by fisher_write_derivatives() */
+  num_points = 0;
+  for (index_parameter=0; index_parameter<num_parameters; index_parameter++)
+    num_points += parameters[index_parameter].stencil;
+  points = (struct fisher_point *) calloc(num_points,sizeof(struct fisher_point));
+  if (points == NULL) {
+    printf("\n\nError: could not allocate the points\n");
+    return _FAILURE_;
+  }
+  index_point = 0;
+  for (index_parameter=0; index_parameter<num_parameters; index_parameter++) {
+    for (index_stencil=0; index_stencil<parameters[index_parameter].stencil; index_stencil++) {
+      points[index_point].index_parameter = index_parameter;
+      if (parameters[index_parameter].stencil == 2)
+        points[index_point].offset = 2*index_stencil-1;
+      else
+        points[index_point].offset = (index_stencil < 2) ? index_stencil-2 : index_stencil-1;
+      index_point++;
+    }
+  }
+
+  if (fisher_run_fiducial(&fc,&ff,errmsg) == _FAILURE_) {
+    printf("\n\nError in fisher_run_fiducial \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  for (index_first=0; index_first<num_points; index_first=index_last) {
+
+    index_last = MIN(index_first+num_concurrent,num_points);
+
+    if (fisher_run_points(&fc,&ff,parameters,points,index_first,index_last) == _FAILURE_) {
+      printf("\n\nError in fisher_run_points\n");
+      return _FAILURE_;
+    }
+  }
+
+  /** - modules shared by all the points of each parameter */
+  for (index_parameter=0; index_parameter<num_parameters; index_parameter++)
+    parameters[index_parameter].shared = _ALL_MODULES_;
+  for (index_point=0; index_point<num_points; index_point++) {
+    if (points[index_point].status != _SUCCESS_) {
+      if (class_mpi_rank() == 0)
+        printf("# point %s = %+d step failed: %s\n",parameters[points[index_point].index_parameter].name,
+               points[index_point].offset,points[index_point].error_message);
+      num_failures++;
+    }
+    parameters[points[index_point].index_parameter].shared &= points[index_point].shared;
+  }
+
+  if (class_mpi_rank() == 0) {
+    for (index_parameter=0; index_parameter<num_parameters; index_parameter++) {
+      printf("# %s: %d points, shared with the fiducial model:",parameters[index_parameter].name,parameters[index_parameter].stencil);
+      if (parameters[index_parameter].shared == 0)
+        printf(" none");
+      for (index_module=0; index_module<module_size; index_module++) {
+        if ((parameters[index_parameter].shared & (1 << index_module)) != 0)
+          printf(" %s",fisher_module_names[index_module]);
+      }
+      printf("\n");
+    }
+  }
+
+  if ((num_failures == 0) && (class_mpi_rank() == 0) &&
+      (fisher_write_derivatives(filenames[2],&ff,parameters,num_parameters,points,errmsg) == _FAILURE_)) {
+    printf("\n\nError in fisher_write_derivatives \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /****** all calculations done, now free the structures ******/
+
+  for (index_point=0; index_point<num_points; index_point++)
+    free(points[index_point].cl);
+  free(points);
+  free(parameters);
+  free(ff.cl);
+
+  if ((ff.computed & (1 << module_distortions)) != 0) distortions_free(&(ff.sd));
+  if ((ff.computed & (1 << module_lensing)) != 0) lensing_free(&(ff.le));
+  if ((ff.computed & (1 << module_harmonic)) != 0) harmonic_free(&(ff.hr));
+  if ((ff.computed & (1 << module_transfer)) != 0) transfer_free(&(ff.tr));
+  if ((ff.computed & (1 << module_fourier)) != 0) fourier_free(&(ff.fo));
+  if ((ff.computed & (1 << module_primordial)) != 0) primordial_free(&(ff.pm));
+  if ((ff.computed & (1 << module_perturbations)) != 0) perturbations_free(&(ff.pt));
+  if ((ff.computed & (1 << module_thermodynamics)) != 0) thermodynamics_free(&(ff.th));
+  if ((ff.computed & (1 << module_background)) != 0) background_free(&(ff.ba));
+
+  parser_free(&fc);
+
+  if (num_failures > 0) {
+    printf("# %d point(s) failed\n",num_failures);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
@@ -0,0 +1,1223 @@
+/** @file class_scan.c
+ *
+ * Scan of the parameters of the unimodular-gravity (UG) model.
+ */
+
+/* this main reads one input file (e.g. UG.ini) and a grid of values of
+   the UG parameters, and runs all the modules of CLASS for each point
+   of the grid within the same process.
+
+   Usage: class_scan [-j points] [-c directory [-m entries]]
+                     [-t emulator.bin | -e emulator.bin [-b error]]
+                     input.ini grid.dat output.dat
+
+   Each line of the grid file gives 'model a_start delta
+   Delta_rho_Lambda' for one point (empty lines and lines starting with
+   # are skipped). These values replace those of the input file, in
+   which has_UG is set to yes.
+
+   The input file is parsed once. The points are sent as tasks to the
+   process-wide thread pool, at most 'points' of them at a time
+   (default: 2, since each of them holds the memory of a full run), and
+   their modules share the same pool. The caches of the process are
+   filled by the first points and used by all the others: HyRec
+   tables, quadrature rules, Wigner d-functions of the lensing module
+   and, with hyper_flat_cache = yes in the input file, the table of
+   Bessel functions. Everything else depends on the background (for
+   instance the lists of wavenumbers and multipoles, through the
+   conformal age) and is computed again for each point. With MPI, the
+   points are computed one after the other, each of them by all the
+   processes.
+
+   The output file has one line per point and per multipole, with the
+   index and the parameters of the point, some derived parameters, the
+   multipole l and the C_l's (lensed if lensing is requested,
+   dimensionless and without the factor l(l+1)/2pi). Without C_l's, it
+   has one line per point. The points for which CLASS fails are
+   reported on a comment line, and the scan goes on.
+
+   With -c, the results of each point (derived parameters and C_l's)
+   are kept in a file of the given directory, named after a digest of
+   the input parameters of the point (in any order, apart from those
+   which only affect the output). A point whose file exists is read
+   back without running CLASS at all, from input_read_from_file() to
+   lensing_init(). The directory can be shared by several scans, run
+   one after the other or at the same time. It keeps at most 'entries'
+   files (default: 10000), the least recently used ones being removed
+   at the end of each scan. The digest does not know about the code
+   itself: the directory should be emptied when CLASS is modified. The
+   numbers of points read from and added to the directory are printed
+   at the end.
+
+   With -t, an emulator of the results is trained on the points of the
+   scan which succeeded and written to the given file at the end: for
+   each model, the derived parameters and C_l's are fitted as functions
+   of (a_start, delta, Delta_rho_Lambda), see tools/emulator.c. With
+   -e, such a file (trained with the same input file) is read first,
+   and the results of a point are predicted by the emulator, without
+   running CLASS, if the point is within the range of parameters of
+   the training points of its model and if the leave-one-out error of
+   the emulator of this model (relative to the rms value of each C_l
+   over the training points) is below the error given by -b (default:
+   1e-3). The other points are computed by CLASS. */
+
+#include "class.h"
+#include "emulator.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#define _SCAN_PARAMETERS_ 4
+#define _SCAN_DERIVED_ 5
+#define _SCAN_TYPES_ 5
+#define _SCAN_CACHE_VERSION_ 1
+#define _SCAN_EMULATOR_VERSION_ 1
+#define _SCAN_EMULATOR_DEGREE_ 3
+
+char * scan_parameter_names[_SCAN_PARAMETERS_] = {"model","a_start","delta","Delta_rho_Lambda"};
+
+char * scan_derived_names[_SCAN_DERIVED_] = {"age[Gyr]","conformal_age[Mpc]","z_rec","100*theta_s","sigma8"};
+
+char * scan_type_names[_SCAN_TYPES_] = {"TT","EE","TE","BB","phiphi"};
+
+struct scan_point {
+  double parameter[_SCAN_PARAMETERS_];
+  int status;
+  ErrorMsg error_message;
+  double derived[_SCAN_DERIVED_]; /* sigma8 is zero without matter power spectrum */
+  short has_type[_SCAN_TYPES_];
+  short is_lensed;                /* _TRUE_ if the C_l's are lensed */
+  int l_max;                      /* last multipole of cl, 0 without C_l's */
+  double * cl;                    /* cl[(l-2)*_SCAN_TYPES_+index_type] */
+  short from_cache;               /* _TRUE_ if the results were read from the cache directory */
+  short from_emulator;            /* _TRUE_ if the results were predicted by the emulator */
+};
+
+/* header of a file of the cache directory, followed by the C_l's of the point */
+struct scan_cache_header {
+  char magic[8];                  /* "CLASSSCN" */
+  int version;                    /* _SCAN_CACHE_VERSION_ */
+  unsigned long long key;         /* digest of the input parameters, see scan_cache_key() */
+  double parameter[_SCAN_PARAMETERS_];
+  double derived[_SCAN_DERIVED_];
+  short has_type[_SCAN_TYPES_];
+  short is_lensed;
+  int l_max;
+};
+
+/* emulators of the results, one per model (see scan_emulator_train()) */
+struct scan_emulator {
+  unsigned long long key;         /* digest of the input file, without the UG parameters, see scan_base_key() */
+  int l_max;                      /* last multipole of the C_l's, 0 without C_l's */
+  short has_type[_SCAN_TYPES_];
+  short is_lensed;
+  int num_models;
+  int * model;                    /* value of the parameter 'model' of each emulator */
+  struct emulator * emulator;     /* emulator of the derived parameters and C_l's, functions of the other parameters */
+};
+
+/* how the results of the points are obtained, shared by all points */
+struct scan_options {
+  char * cache_directory;         /* cache directory, or NULL */
+  struct scan_emulator * pse;     /* emulator, or NULL */
+  double error_budget;            /* largest leave-one-out error of an emulator used for predictions */
+};
+
+/* replace the value of a parameter, or add it */
+int scan_set_parameter(
+                       struct file_content * pfc,
+                       char * name,
+                       char * value,
+                       ErrorMsg errmsg
+                       ) {
+
+  int index;
+
+  for (index=0; index<pfc->size; index++) {
+    if (strcmp(pfc->name[index],name) == 0)
+      break;
+  }
+  if (index == pfc->size) {
+    class_call(parser_extend(pfc,1,errmsg),
+               errmsg,
+               errmsg);
+    strcpy(pfc->name[index],name);
+  }
+  strcpy(pfc->value[index],value);
+  pfc->read[index] = _FALSE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read the grid of UG parameters.
+ *
+ * @param filename Input: name of the grid file
+ * @param ppoints  Output: array of points, allocated here
+ * @param psize    Output: number of points
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int scan_read_grid(
+                   char * filename,
+                   struct scan_point ** ppoints,
+                   int * psize,
+                   ErrorMsg errmsg
+                   ) {
+
+  FILE * grid;
+  char line[_LINE_LENGTH_MAX_];
+  char * start;
+  struct scan_point * point;
+  int capacity = 0;
+  int line_number = 0;
+
+  *ppoints = NULL;
+  *psize = 0;
+
+  class_open(grid,filename,"r",errmsg);
+
+  while (fgets(line,_LINE_LENGTH_MAX_,grid) != NULL) {
+    line_number++;
+    for (start = line; (*start == ' ') || (*start == '\t'); start++);
+    if ((*start == '#') || (*start == '\n') || (*start == '\r') || (*start == '\0'))
+      continue;
+
+    if (*psize == capacity) {
+      capacity = MAX(2*capacity,16);
+      class_realloc(*ppoints,capacity*sizeof(struct scan_point),errmsg);
+    }
+    point = &((*ppoints)[*psize]);
+    memset(point,0,sizeof(struct scan_point));
+
+    class_test_except(sscanf(start,"%lf %lf %lf %lf",
+                             &(point->parameter[0]),
+                             &(point->parameter[1]),
+                             &(point->parameter[2]),
+                             &(point->parameter[3])) != _SCAN_PARAMETERS_,
+                      errmsg,
+                      fclose(grid),
+                      "line %d of %s should give: model a_start delta Delta_rho_Lambda",line_number,filename);
+
+    (*psize)++;
+  }
+
+  fclose(grid);
+
+  class_test(*psize == 0,
+             errmsg,
+             "no point in the grid file %s",filename);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Digest of the input parameters of a point. The digests of the
+ * 'name = value' entries are summed, so that the result does not
+ * depend on their order; the parameters which only affect the output
+ * module are ignored.
+ *
+ * @param pfc    Input: content of the input file of the point
+ * @param pkey   Output: digest
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int scan_cache_key(
+                   struct file_content * pfc,
+                   unsigned long long * pkey,
+                   ErrorMsg errmsg
+                   ) {
+
+  const unsigned long long fnv_offset = 14695981039346656037ULL;
+  unsigned long long entry, sum = 0;
+  enum input_module module;
+  int i;
+
+  for (i=0; i<pfc->size; i++) {
+    class_call(input_module_of_parameter(pfc->name[i],&module),
+               errmsg,
+               errmsg);
+    if (module == im_output)
+      continue;
+    entry = input_digest_bytes(fnv_offset,pfc->name[i],strlen(pfc->name[i]));
+    entry = input_digest_bytes(entry,"=",1);
+    entry = input_digest_bytes(entry,pfc->value[i],strlen(pfc->value[i]));
+    sum += entry;
+  }
+
+  *pkey = input_digest_bytes(fnv_offset,_VERSION_,strlen(_VERSION_));
+  *pkey = input_digest_bytes(*pkey,&sum,sizeof(sum));
+
+  return _SUCCESS_;
+}
+
+/* name of the file of the cache directory for a given digest */
+void scan_cache_file_name(
+                          char * cache_directory,
+                          unsigned long long key,
+                          char * file_name
+                          ) {
+  sprintf(file_name,"%s/%016llx.scan",cache_directory,key);
+}
+
+/**
+ * Read the results of a point from the cache directory, if they are
+ * there. A file which cannot be read is ignored (and will be written
+ * again). Its modification time is updated, since the least recently
+ * used files are removed first by scan_cache_prune().
+ *
+ * @param cache_directory Input: cache directory
+ * @param key             Input: digest of the input parameters of the point
+ * @param psp             Input/Output: point, with parameters set, results filled here if found
+ * @param pfound          Output: _TRUE_ if the results were found
+ * @param errmsg          Output: error message
+ * @return the error status
+ */
+
+int scan_cache_read(
+                    char * cache_directory,
+                    unsigned long long key,
+                    struct scan_point * psp,
+                    short * pfound,
+                    ErrorMsg errmsg
+                    ) {
+
+  FileName file_name;
+  FILE * cache_file;
+  struct scan_cache_header header;
+  size_t cl_size;
+  int index;
+
+  *pfound = _FALSE_;
+
+  scan_cache_file_name(cache_directory,key,file_name);
+  cache_file = fopen(file_name,"rb");
+  if (cache_file == NULL)
+    return _SUCCESS_;
+
+  if ((fread(&header,sizeof(header),1,cache_file) != 1) ||
+      (strncmp(header.magic,"CLASSSCN",8) != 0) ||
+      (header.version != _SCAN_CACHE_VERSION_) ||
+      (header.key != key) ||
+      (header.l_max < 0)) {
+    fclose(cache_file);
+    return _SUCCESS_;
+  }
+  for (index=0; index<_SCAN_PARAMETERS_; index++) {
+    if (header.parameter[index] != psp->parameter[index]) {
+      fclose(cache_file);
+      return _SUCCESS_;
+    }
+  }
+
+  psp->l_max = header.l_max;
+  if (psp->l_max > 0) {
+    cl_size = (psp->l_max-1)*_SCAN_TYPES_;
+    class_alloc(psp->cl,cl_size*sizeof(double),errmsg);
+    if (fread(psp->cl,sizeof(double),cl_size,cache_file) != cl_size) {
+      free(psp->cl);
+      psp->cl = NULL;
+      psp->l_max = 0;
+      fclose(cache_file);
+      return _SUCCESS_;
+    }
+  }
+  fclose(cache_file);
+
+  for (index=0; index<_SCAN_DERIVED_; index++)
+    psp->derived[index] = header.derived[index];
+  for (index=0; index<_SCAN_TYPES_; index++)
+    psp->has_type[index] = header.has_type[index];
+  psp->is_lensed = header.is_lensed;
+
+  utime(file_name,NULL);
+  *pfound = _TRUE_;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the results of a point to the cache directory. The file is
+ * written under a temporary name and renamed at the end, so that
+ * concurrent scans never read a partial file. Since the cache is only
+ * an optimisation, a failure is not an error.
+ *
+ * @param cache_directory Input: cache directory
+ * @param key             Input: digest of the input parameters of the point
+ * @param psp             Input: point, with results filled
+ */
+
+void scan_cache_write(
+                      char * cache_directory,
+                      unsigned long long key,
+                      struct scan_point * psp
+                      ) {
+
+  FileName file_name, tmp_name;
+  FILE * cache_file;
+  struct scan_cache_header header;
+  size_t cl_size;
+  int index, status;
+
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,"CLASSSCN",8);
+  header.version = _SCAN_CACHE_VERSION_;
+  header.key = key;
+  for (index=0; index<_SCAN_PARAMETERS_; index++)
+    header.parameter[index] = psp->parameter[index];
+  for (index=0; index<_SCAN_DERIVED_; index++)
+    header.derived[index] = psp->derived[index];
+  for (index=0; index<_SCAN_TYPES_; index++)
+    header.has_type[index] = psp->has_type[index];
+  header.is_lensed = psp->is_lensed;
+  header.l_max = psp->l_max;
+
+  scan_cache_file_name(cache_directory,key,file_name);
+  /* several points of the same process may have the same parameters */
+  sprintf(tmp_name,"%s.%ld.%lx.tmp",file_name,(long)getpid(),(unsigned long)psp);
+
+  cache_file = fopen(tmp_name,"wb");
+  if (cache_file == NULL)
+    return;
+
+  status = (fwrite(&header,sizeof(header),1,cache_file) == 1);
+  if ((status != 0) && (psp->l_max > 0)) {
+    cl_size = (psp->l_max-1)*_SCAN_TYPES_;
+    status = (fwrite(psp->cl,sizeof(double),cl_size,cache_file) == cl_size);
+  }
+
+  if ((fclose(cache_file) != 0) || (status == 0) || (rename(tmp_name,file_name) != 0))
+    remove(tmp_name);
+}
+
+/* file of the cache directory, for scan_cache_prune() */
+struct scan_cache_file {
+  FileName file_name;
+  time_t mtime;
+};
+
+int scan_cache_compare(const void * a, const void * b) {
+  time_t ta = ((const struct scan_cache_file *)a)->mtime;
+  time_t tb = ((const struct scan_cache_file *)b)->mtime;
+  return (ta < tb) ? 1 : ((ta > tb) ? -1 : 0);
+}
+
+/**
+ * Keep at most max_entries files in the cache directory, removing the
+ * least recently used ones.
+ *
+ * @param cache_directory Input: cache directory
+ * @param max_entries     Input: maximum number of files
+ * @param errmsg          Output: error message
+ * @return the error status
+ */
+
+int scan_cache_prune(
+                     char * cache_directory,
+                     int max_entries,
+                     ErrorMsg errmsg
+                     ) {
+
+  DIR * directory;
+  struct dirent * pentry;
+  struct stat file_stat;
+  struct scan_cache_file * files = NULL;
+  int num_files = 0, capacity = 0, index, length;
+
+  directory = opendir(cache_directory);
+  class_test(directory == NULL,
+             errmsg,
+             "cannot open the cache directory %s",cache_directory);
+
+  while ((pentry = readdir(directory)) != NULL) {
+    length = strlen(pentry->d_name);
+    if ((length != 21) || (strcmp(pentry->d_name+16,".scan") != 0))
+      continue;
+    if (num_files == capacity) {
+      capacity = MAX(2*capacity,256);
+      class_realloc(files,capacity*sizeof(struct scan_cache_file),errmsg);
+    }
+    sprintf(files[num_files].file_name,"%s/%s",cache_directory,pentry->d_name);
+    if (stat(files[num_files].file_name,&file_stat) != 0)
+      continue;
+    files[num_files].mtime = file_stat.st_mtime;
+    num_files++;
+  }
+  closedir(directory);
+
+  if (num_files > max_entries) {
+    qsort(files,num_files,sizeof(struct scan_cache_file),scan_cache_compare);
+    for (index=max_entries; index<num_files; index++)
+      remove(files[index].file_name);
+  }
+
+  free(files);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Digest of the input file of the scan, without the UG parameters,
+ * which identifies the input file with which an emulator was trained.
+ *
+ * @param pfc_base Input: content of the input file, shared by all points (not modified)
+ * @param pkey     Output: digest
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int scan_base_key(
+                  struct file_content * pfc_base,
+                  unsigned long long * pkey,
+                  ErrorMsg errmsg
+                  ) {
+
+  struct file_content fc;
+  int index_parameter, status = _SUCCESS_;
+
+  class_call(parser_init_from_pfc(pfc_base,&fc,errmsg),
+             errmsg,
+             errmsg);
+
+  status = scan_set_parameter(&fc,"has_UG","1",errmsg);
+  for (index_parameter=0; (index_parameter<_SCAN_PARAMETERS_) && (status == _SUCCESS_); index_parameter++)
+    status = scan_set_parameter(&fc,scan_parameter_names[index_parameter],"0",errmsg);
+  if (status == _SUCCESS_)
+    status = scan_cache_key(&fc,pkey,errmsg);
+
+  parser_free(&fc);
+
+  return status;
+}
+
+/**
+ * Train the emulators of the results, one per model, on the points
+ * which succeeded. The outputs of each emulator are the derived
+ * parameters followed by the C_l's of the point, and its parameters
+ * are those of the point apart from the model. The errors are
+ * measured relative to the rms value of each output over the points,
+ * except for C_l^TE, relative to sqrt(C_l^TT C_l^EE) since it crosses
+ * zero.
+ *
+ * @param points     Input: points, with results
+ * @param num_points Input: number of points
+ * @param key        Input: digest of the input file, see scan_base_key()
+ * @param pse        Output: emulators, allocated here
+ * @param errmsg     Output: error message
+ * @return the error status
+ */
+
+int scan_emulator_train(
+                        struct scan_point * points,
+                        int num_points,
+                        unsigned long long key,
+                        struct scan_emulator * pse,
+                        ErrorMsg errmsg
+                        ) {
+
+  struct scan_point * first = NULL;
+  double * parameters;
+  double * outputs;
+  double * scale;
+  int num_outputs, num_samples, index_point, index_model, index, index_output, model;
+
+  for (index_point=0; index_point<num_points; index_point++) {
+    if (points[index_point].status == _SUCCESS_) {
+      first = &(points[index_point]);
+      break;
+    }
+  }
+  class_test(first == NULL,
+             errmsg,
+             "no point of the scan succeeded: cannot train an emulator");
+
+  pse->key = key;
+  pse->l_max = first->l_max;
+  for (index=0; index<_SCAN_TYPES_; index++)
+    pse->has_type[index] = first->has_type[index];
+  pse->is_lensed = first->is_lensed;
+  pse->num_models = 0;
+  class_alloc(pse->model,num_points*sizeof(int),errmsg);
+  class_alloc(pse->emulator,num_points*sizeof(struct emulator),errmsg);
+
+  num_outputs = _SCAN_DERIVED_ + MAX(pse->l_max-1,0)*_SCAN_TYPES_;
+  class_alloc(parameters,num_points*(_SCAN_PARAMETERS_-1)*sizeof(double),errmsg);
+  class_alloc(outputs,num_points*num_outputs*sizeof(double),errmsg);
+  class_alloc(scale,num_outputs*sizeof(double),errmsg);
+
+  for (index_point=0; index_point<num_points; index_point++) {
+
+    if (points[index_point].status != _SUCCESS_)
+      continue;
+    model = (int)points[index_point].parameter[0];
+    for (index_model=0; index_model<pse->num_models; index_model++) {
+      if (pse->model[index_model] == model)
+        break;
+    }
+    if (index_model < pse->num_models)
+      continue;
+
+    /* all the points of this model */
+    num_samples = 0;
+    for (index=index_point; index<num_points; index++) {
+      if ((points[index].status != _SUCCESS_) || ((int)points[index].parameter[0] != model))
+        continue;
+      class_test(points[index].l_max != pse->l_max,
+                 errmsg,
+                 "the points of the scan do not have the same C_l's");
+      memcpy(parameters+num_samples*(_SCAN_PARAMETERS_-1),points[index].parameter+1,(_SCAN_PARAMETERS_-1)*sizeof(double));
+      memcpy(outputs+num_samples*num_outputs,points[index].derived,_SCAN_DERIVED_*sizeof(double));
+      if (pse->l_max > 0)
+        memcpy(outputs+num_samples*num_outputs+_SCAN_DERIVED_,points[index].cl,(num_outputs-_SCAN_DERIVED_)*sizeof(double));
+      num_samples++;
+    }
+
+    if (num_samples < 2) {
+      printf("# emulator: model %d skipped, with a single point\n",model);
+      continue;
+    }
+
+    for (index_output=0; index_output<num_outputs; index_output++) {
+      scale[index_output] = 0.;
+      for (index=0; index<num_samples; index++)
+        scale[index_output] += outputs[index*num_outputs+index_output]*outputs[index*num_outputs+index_output]/num_samples;
+      scale[index_output] = sqrt(scale[index_output]);
+    }
+    for (index_output=_SCAN_DERIVED_; index_output<num_outputs; index_output+=_SCAN_TYPES_)
+      scale[index_output+2] = sqrt(scale[index_output]*scale[index_output+1]);
+
+    class_call(emulator_train(_SCAN_PARAMETERS_-1,num_outputs,num_samples,parameters,outputs,scale,
+                              _SCAN_EMULATOR_DEGREE_,&(pse->emulator[pse->num_models]),errmsg),
+               errmsg,
+               errmsg);
+    pse->model[pse->num_models] = model;
+
+    printf("# emulator: model %d from %d points, degree %d, %d components, leave-one-out error %.3e\n",
+           model,num_samples,pse->emulator[pse->num_models].degree,
+           pse->emulator[pse->num_models].num_components,pse->emulator[pse->num_models].error);
+
+    pse->num_models++;
+  }
+
+  free(parameters);
+  free(outputs);
+  free(scale);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Predict the results of a point with the emulator of its model, if
+ * the point is within the range of the training points and if the
+ * emulator is accurate enough.
+ *
+ * @param pse          Input: emulators
+ * @param error_budget Input: largest leave-one-out error of an emulator used for predictions
+ * @param psp          Input/Output: point, with parameters set, results filled here if predicted
+ * @param errmsg       Output: error message
+ * @return the error status
+ */
+
+int scan_emulator_predict(
+                          struct scan_emulator * pse,
+                          double error_budget,
+                          struct scan_point * psp,
+                          ErrorMsg errmsg
+                          ) {
+
+  struct emulator * pem = NULL;
+  double * outputs;
+  short inside;
+  int index_model, index;
+
+  psp->from_emulator = _FALSE_;
+
+  for (index_model=0; index_model<pse->num_models; index_model++) {
+    if (pse->model[index_model] == (int)psp->parameter[0]) {
+      pem = &(pse->emulator[index_model]);
+      break;
+    }
+  }
+  if ((pem == NULL) || (pem->error > error_budget))
+    return _SUCCESS_;
+
+  class_alloc(outputs,pem->num_outputs*sizeof(double),errmsg);
+  emulator_predict(pem,psp->parameter+1,outputs,&inside);
+
+  if (inside == _TRUE_) {
+    for (index=0; index<_SCAN_DERIVED_; index++)
+      psp->derived[index] = outputs[index];
+    for (index=0; index<_SCAN_TYPES_; index++)
+      psp->has_type[index] = pse->has_type[index];
+    psp->is_lensed = pse->is_lensed;
+    psp->l_max = pse->l_max;
+    if (psp->l_max > 0) {
+      class_alloc(psp->cl,(pem->num_outputs-_SCAN_DERIVED_)*sizeof(double),errmsg);
+      memcpy(psp->cl,outputs+_SCAN_DERIVED_,(pem->num_outputs-_SCAN_DERIVED_)*sizeof(double));
+    }
+    psp->from_emulator = _TRUE_;
+  }
+
+  free(outputs);
+
+  return _SUCCESS_;
+}
+
+/* header of an emulator file, followed by the model and the emulator of each model */
+struct scan_emulator_header {
+  char magic[8];                  /* "CLASSSEM" */
+  int version;                    /* _SCAN_EMULATOR_VERSION_ */
+  unsigned long long key;
+  int l_max;
+  short has_type[_SCAN_TYPES_];
+  short is_lensed;
+  int num_models;
+};
+
+/**
+ * Write the emulators to a file.
+ *
+ * @param file_name Input: name of the file
+ * @param pse       Input: emulators
+ * @param errmsg    Output: error message
+ * @return the error status
+ */
+
+int scan_emulator_write(
+                        char * file_name,
+                        struct scan_emulator * pse,
+                        ErrorMsg errmsg
+                        ) {
+
+  FILE * emulator_file;
+  struct scan_emulator_header header;
+  int index_model, index;
+
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,"CLASSSEM",8);
+  header.version = _SCAN_EMULATOR_VERSION_;
+  header.key = pse->key;
+  header.l_max = pse->l_max;
+  for (index=0; index<_SCAN_TYPES_; index++)
+    header.has_type[index] = pse->has_type[index];
+  header.is_lensed = pse->is_lensed;
+  header.num_models = pse->num_models;
+
+  class_open(emulator_file,file_name,"wb",errmsg);
+
+  class_test_except(fwrite(&header,sizeof(header),1,emulator_file) != 1,
+                    errmsg,
+                    fclose(emulator_file),
+                    "could not write %s",file_name);
+
+  for (index_model=0; index_model<pse->num_models; index_model++) {
+    class_test_except(fwrite(&(pse->model[index_model]),sizeof(int),1,emulator_file) != 1,
+                      errmsg,
+                      fclose(emulator_file),
+                      "could not write %s",file_name);
+    class_call_except(emulator_write(emulator_file,&(pse->emulator[index_model]),errmsg),
+                      errmsg,
+                      errmsg,
+                      fclose(emulator_file));
+  }
+
+  class_test(fclose(emulator_file) != 0,
+             errmsg,
+             "could not write %s",file_name);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read the emulators written by scan_emulator_write().
+ *
+ * @param file_name Input: name of the file
+ * @param key       Input: digest of the input file, see scan_base_key()
+ * @param pse       Output: emulators, allocated here
+ * @param errmsg    Output: error message
+ * @return the error status
+ */
+
+int scan_emulator_read(
+                       char * file_name,
+                       unsigned long long key,
+                       struct scan_emulator * pse,
+                       ErrorMsg errmsg
+                       ) {
+
+  FILE * emulator_file;
+  struct scan_emulator_header header;
+  int index_model, index;
+
+  class_open(emulator_file,file_name,"rb",errmsg);
+
+  class_test_except((fread(&header,sizeof(header),1,emulator_file) != 1) ||
+                    (strncmp(header.magic,"CLASSSEM",8) != 0) ||
+                    (header.version != _SCAN_EMULATOR_VERSION_) ||
+                    (header.num_models < 0),
+                    errmsg,
+                    fclose(emulator_file),
+                    "%s is not an emulator written by this version of class_scan",file_name);
+
+  class_test_except(header.key != key,
+                    errmsg,
+                    fclose(emulator_file),
+                    "the emulator %s was trained with another input file",file_name);
+
+  pse->key = header.key;
+  pse->l_max = header.l_max;
+  for (index=0; index<_SCAN_TYPES_; index++)
+    pse->has_type[index] = header.has_type[index];
+  pse->is_lensed = header.is_lensed;
+  pse->num_models = 0;
+  class_alloc(pse->model,MAX(header.num_models,1)*sizeof(int),errmsg);
+  class_alloc(pse->emulator,MAX(header.num_models,1)*sizeof(struct emulator),errmsg);
+
+  for (index_model=0; index_model<header.num_models; index_model++) {
+    class_test_except(fread(&(pse->model[index_model]),sizeof(int),1,emulator_file) != 1,
+                      errmsg,
+                      fclose(emulator_file),
+                      "%s is truncated",file_name);
+    class_call_except(emulator_read(emulator_file,&(pse->emulator[index_model]),errmsg),
+                      errmsg,
+                      errmsg,
+                      fclose(emulator_file));
+    pse->num_models++;
+  }
+
+  fclose(emulator_file);
+
+  return _SUCCESS_;
+}
+
+void scan_emulator_free(
+                        struct scan_emulator * pse
+                        ) {
+
+  int index_model;
+
+  for (index_model=0; index_model<pse->num_models; index_model++)
+    emulator_free(&(pse->emulator[index_model]));
+  free(pse->model);
+  free(pse->emulator);
+}
+
+/**
+ * Run all the modules for one point, and keep its results.
+ *
+ * @param pfc_base Input: content of the input file, shared by all points (not modified)
+ * @param pso      Input: options of the scan
+ * @param psp      Input/Output: point, with parameters set, results filled here
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int scan_run_point(
+                   struct file_content * pfc_base,
+                   struct scan_options * pso,
+                   struct scan_point * psp,
+                   ErrorMsg errmsg
+                   ) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermodynamics th;   /* for thermodynamics */
+  struct perturbations pt;    /* for source functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct fourier fo;          /* for non-linear spectra */
+  struct transfer tr;         /* for transfer functions */
+  struct harmonic hr;         /* for output spectra */
+  struct lensing le;          /* for lensed spectra */
+  struct distortions sd;      /* for spectral distortions */
+  struct output op;           /* for output files */
+  struct file_content fc;
+  char value[_ARGUMENT_LENGTH_MAX_];
+  int computed = 0;
+  int status, index_parameter, index_type, l;
+  int index_ct[_SCAN_TYPES_];
+  int ct_size;
+  double * cl;
+  unsigned long long key = 0;
+
+  /** - results predicted by the emulator */
+  if (pso->pse != NULL) {
+    class_call(scan_emulator_predict(pso->pse,pso->error_budget,psp,errmsg),
+               errmsg,
+               errmsg);
+    if (psp->from_emulator == _TRUE_)
+      return _SUCCESS_;
+  }
+
+  /** - each point has its own file content, since input_read_from_file() marks the entries as read */
+  class_call(parser_init_from_pfc(pfc_base,&fc,errmsg),
+             errmsg,
+             errmsg);
+
+  class_call(scan_set_parameter(&fc,"has_UG","1",errmsg),
+             errmsg,
+             errmsg);
+  for (index_parameter=0; index_parameter<_SCAN_PARAMETERS_; index_parameter++) {
+    if (index_parameter == 0)
+      sprintf(value,"%d",(int)psp->parameter[index_parameter]);
+    else
+      sprintf(value,"%.17e",psp->parameter[index_parameter]);
+    class_call(scan_set_parameter(&fc,scan_parameter_names[index_parameter],value,errmsg),
+               errmsg,
+               errmsg);
+  }
+
+  /** - results of a previous run with the same parameters */
+  if (pso->cache_directory != NULL) {
+    status = scan_cache_key(&fc,&key,errmsg);
+    if (status == _SUCCESS_)
+      status = scan_cache_read(pso->cache_directory,key,psp,&(psp->from_cache),errmsg);
+    if ((status == _FAILURE_) || (psp->from_cache == _TRUE_)) {
+      parser_free(&fc);
+      return status;
+    }
+  }
+
+  status = input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg);
+  parser_free(&fc);
+  class_call(status,errmsg,errmsg);
+
+  /** - all modules, the independent ones concurrently */
+  status = modules_init(&pr,&ba,&th,&pt,&pm,&fo,&tr,&hr,&le,&sd,_ALL_MODULES_,&computed,errmsg);
+
+  /** - keep the results */
+  if (status == _SUCCESS_) {
+
+    psp->derived[0] = ba.age;
+    psp->derived[1] = ba.conformal_age;
+    psp->derived[2] = th.z_rec;
+    psp->derived[3] = 100.*th.rs_rec/th.ra_rec;
+    psp->derived[4] = (fo.has_pk_matter == _TRUE_) ? fo.sigma8[fo.index_pk_m] : 0.;
+
+    if (le.has_lensed_cls == _TRUE_) {
+      psp->has_type[0] = le.has_tt; index_ct[0] = le.index_lt_tt;
+      psp->has_type[1] = le.has_ee; index_ct[1] = le.index_lt_ee;
+      psp->has_type[2] = le.has_te; index_ct[2] = le.index_lt_te;
+      psp->has_type[3] = le.has_bb; index_ct[3] = le.index_lt_bb;
+      psp->has_type[4] = le.has_pp; index_ct[4] = le.index_lt_pp;
+      ct_size = le.lt_size;
+      psp->is_lensed = _TRUE_;
+      psp->l_max = le.l_lensed_max;
+    }
+    else if (pt.has_cls == _TRUE_) {
+      psp->has_type[0] = hr.has_tt; index_ct[0] = hr.index_ct_tt;
+      psp->has_type[1] = hr.has_ee; index_ct[1] = hr.index_ct_ee;
+      psp->has_type[2] = hr.has_te; index_ct[2] = hr.index_ct_te;
+      psp->has_type[3] = hr.has_bb; index_ct[3] = hr.index_ct_bb;
+      psp->has_type[4] = hr.has_pp; index_ct[4] = hr.index_ct_pp;
+      ct_size = hr.ct_size;
+      psp->l_max = hr.l_max_tot;
+    }
+
+    if (psp->l_max >= 2) {
+      class_alloc(cl,(psp->l_max-1)*ct_size*sizeof(double),errmsg);
+      class_alloc(psp->cl,(psp->l_max-1)*_SCAN_TYPES_*sizeof(double),errmsg);
+      if (psp->is_lensed == _TRUE_)
+        status = lensing_cl_at_l_range(&le,2,psp->l_max,cl);
+      else
+        status = harmonic_cl_at_l_range(&hr,2,psp->l_max,cl);
+      if (status == _FAILURE_)
+        strcpy(errmsg,(psp->is_lensed == _TRUE_) ? le.error_message : hr.error_message);
+      for (l=2; l<=psp->l_max; l++) {
+        for (index_type=0; index_type<_SCAN_TYPES_; index_type++) {
+          psp->cl[(l-2)*_SCAN_TYPES_+index_type] =
+            (psp->has_type[index_type] == _TRUE_) ? cl[(l-2)*ct_size+index_ct[index_type]] : 0.;
+        }
+      }
+      free(cl);
+    }
+    else {
+      psp->l_max = 0;
+    }
+
+    if ((status == _SUCCESS_) && (pso->cache_directory != NULL))
+      scan_cache_write(pso->cache_directory,key,psp);
+  }
+
+  /** - free the modules which were computed */
+  if ((computed & (1 << module_distortions)) != 0) distortions_free(&sd);
+  if ((computed & (1 << module_lensing)) != 0) lensing_free(&le);
+  if ((computed & (1 << module_harmonic)) != 0) harmonic_free(&hr);
+  if ((computed & (1 << module_transfer)) != 0) transfer_free(&tr);
+  if ((computed & (1 << module_fourier)) != 0) fourier_free(&fo);
+  if ((computed & (1 << module_primordial)) != 0) primordial_free(&pm);
+  if ((computed & (1 << module_perturbations)) != 0) perturbations_free(&pt);
+  if ((computed & (1 << module_thermodynamics)) != 0) thermodynamics_free(&th);
+  if ((computed & (1 << module_background)) != 0) background_free(&ba);
+
+  return status;
+}
+
+/**
+ * Run the points index_first <= index < index_last concurrently, on
+ * the shared pool. A failing point does not stop the others: its
+ * status and error message are kept in the point.
+ */
+
+int scan_run_points(
+                    struct file_content * pfc_base,
+                    struct scan_options * pso,
+                    struct scan_point * points,
+                    int index_first,
+                    int index_last
+                    ) {
+
+  class_setup_parallel();
+
+  class_parallel_for(index_point,index_first,index_last,1,with_arguments(pfc_base,pso,points),
+    points[index_point].status = scan_run_point(pfc_base,pso,&(points[index_point]),points[index_point].error_message);
+    return _SUCCESS_;
+  );
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+/* header of the output file, from the first point which succeeded */
+void scan_write_header(
+                       FILE * output,
+                       struct scan_point * psp
+                       ) {
+
+  int index, column = 1;
+
+  if (psp->l_max > 0)
+    fprintf(output,"# one line per point and per multipole, with the dimensionless %s C_l's\n",
+            (psp->is_lensed == _TRUE_) ? "lensed" : "unlensed");
+  else
+    fprintf(output,"# one line per point\n");
+  fprintf(output,"#");
+  fprintf(output," %d:point",column++);
+  for (index=0; index<_SCAN_PARAMETERS_; index++)
+    fprintf(output," %d:%s",column++,scan_parameter_names[index]);
+  for (index=0; index<_SCAN_DERIVED_; index++)
+    fprintf(output," %d:%s",column++,scan_derived_names[index]);
+  if (psp->l_max > 0) {
+    fprintf(output," %d:l",column++);
+    for (index=0; index<_SCAN_TYPES_; index++) {
+      if (psp->has_type[index] == _TRUE_)
+        fprintf(output," %d:%s",column++,scan_type_names[index]);
+    }
+  }
+  fprintf(output,"\n");
+}
+
+/* lines of one point */
+void scan_write_point(
+                      FILE * output,
+                      int index_point,
+                      struct scan_point * psp
+                      ) {
+
+  int index, l;
+
+  if (psp->status != _SUCCESS_) {
+    fprintf(output,"# point %d failed: %s\n",index_point,psp->error_message);
+    return;
+  }
+
+  for (l=2; l<=MAX(psp->l_max,2); l++) {
+    fprintf(output,"%d",index_point);
+    fprintf(output," %d",(int)psp->parameter[0]);
+    for (index=1; index<_SCAN_PARAMETERS_; index++)
+      fprintf(output," %.10e",psp->parameter[index]);
+    for (index=0; index<_SCAN_DERIVED_; index++)
+      fprintf(output," %.10e",psp->derived[index]);
+    if (psp->l_max > 0) {
+      fprintf(output," %d",l);
+      for (index=0; index<_SCAN_TYPES_; index++) {
+        if (psp->has_type[index] == _TRUE_)
+          fprintf(output," %.10e",psp->cl[(l-2)*_SCAN_TYPES_+index]);
+      }
+    }
+    fprintf(output,"\n");
+  }
+}
+
+int main(int argc, char **argv) {
+
+  int num_concurrent = 2;
+  struct scan_options so = {NULL,NULL,1.e-3};
+  struct scan_emulator se;
+  char * train_file = NULL;
+  char * emulator_file = NULL;
+  unsigned long long base_key;
+  int max_cache_entries = 10000;
+  int num_hits = 0, num_misses = 0, num_predicted = 0;
+  char * filenames[3];
+  int num_filenames = 0;
+  struct file_content fc;
+  struct scan_point * points;
+  int num_points, index_point, index_first, index_last;
+  int num_failures = 0;
+  int has_header = _FALSE_;
+  FILE * output = NULL;
+  ErrorMsg errmsg;
+  int i;
+
+  if (class_mpi_init(&argc,&argv) == _FAILURE_) {
+    printf("\n\nError in class_mpi_init\n");
+    return _FAILURE_;
+  }
+
+  for (i=1; i<argc; i++) {
+    if ((strcmp(argv[i],"-j") == 0) && (i+1 < argc)) {
+      num_concurrent = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i],"-c") == 0) && (i+1 < argc)) {
+      so.cache_directory = argv[++i];
+    }
+    else if ((strcmp(argv[i],"-m") == 0) && (i+1 < argc)) {
+      max_cache_entries = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i],"-t") == 0) && (i+1 < argc) && (emulator_file == NULL)) {
+      train_file = argv[++i];
+    }
+    else if ((strcmp(argv[i],"-e") == 0) && (i+1 < argc) && (train_file == NULL)) {
+      emulator_file = argv[++i];
+    }
+    else if ((strcmp(argv[i],"-b") == 0) && (i+1 < argc)) {
+      so.error_budget = atof(argv[++i]);
+    }
+    else if ((argv[i][0] == '-') || (num_filenames == 3)) {
+      num_filenames = 0;
+      break;
+    }
+    else {
+      filenames[num_filenames++] = argv[i];
+    }
+  }
+  if (num_filenames != 3) {
+    fprintf(stderr,"usage: %s [-j points] [-c directory [-m entries]] [-t emulator.bin | -e emulator.bin [-b error]] input.ini grid.dat output.dat\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  /* the collective calls of the modules must be made in the same order by all MPI processes */
+  if ((num_concurrent < 1) || (class_mpi_size() > 1))
+    num_concurrent = 1;
+
+  if (parser_read_file(filenames[0],&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError in parser_read_file \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /* the points run concurrently: no output from the modules (the
+     output parameters are only read by input_init()) */
+  for (i=0; i<fc.size; i++) {
+    if ((strlen(fc.name[i]) > 8) && (strcmp(fc.name[i]+strlen(fc.name[i])-8,"_verbose") == 0))
+      strcpy(fc.value[i],"0");
+    if (strcmp(fc.name[i],"overwrite_root") == 0)
+      fc.read[i] = _TRUE_;
+  }
+
+  if ((train_file != NULL) || (emulator_file != NULL)) {
+    if (scan_base_key(&fc,&base_key,errmsg) == _FAILURE_) {
+      printf("\n\nError in scan_base_key \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  if (emulator_file != NULL) {
+    if (scan_emulator_read(emulator_file,base_key,&se,errmsg) == _FAILURE_) {
+      printf("\n\nError in scan_emulator_read \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+    so.pse = &se;
+  }
+
+  if (scan_read_grid(filenames[1],&points,&num_points,errmsg) == _FAILURE_) {
+    printf("\n\nError in scan_read_grid \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  if (class_mpi_rank() == 0) {
+    output = fopen(filenames[2],"w");
+    if (output == NULL) {
+      printf("\n\nError: cannot open %s\n",filenames[2]);
+      return _FAILURE_;
+    }
+  }
+
+  for (index_first=0; index_first<num_points; index_first=index_last) {
+
+    index_last = MIN(index_first+num_concurrent,num_points);
+
+    if (scan_run_points(&fc,&so,points,index_first,index_last) == _FAILURE_) {
+      printf("\n\nError in scan_run_points\n");
+      return _FAILURE_;
+    }
+
+    for (index_point=index_first; index_point<index_last; index_point++) {
+      if (points[index_point].status != _SUCCESS_)
+        num_failures++;
+      else if (points[index_point].from_emulator == _TRUE_)
+        num_predicted++;
+      else if (points[index_point].from_cache == _TRUE_)
+        num_hits++;
+      else
+        num_misses++;
+      if (output != NULL) {
+        if ((has_header == _FALSE_) && (points[index_point].status == _SUCCESS_)) {
+          scan_write_header(output,&(points[index_point]));
+          has_header = _TRUE_;
+        }
+        scan_write_point(output,index_point,&(points[index_point]));
+      }
+      /* the C_l's of all points are needed to train the emulator */
+      if (train_file == NULL) {
+        free(points[index_point].cl);
+        points[index_point].cl = NULL;
+      }
+    }
+    if (output != NULL)
+      fflush(output);
+  }
+
+  if (output != NULL)
+    fclose(output);
+
+  if ((train_file != NULL) && (class_mpi_rank() == 0)) {
+    if ((scan_emulator_train(points,num_points,base_key,&se,errmsg) == _FAILURE_) ||
+        (scan_emulator_write(train_file,&se,errmsg) == _FAILURE_)) {
+      printf("\n\nError in scan_emulator_train \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+    scan_emulator_free(&se);
+  }
+  if (train_file != NULL) {
+    for (index_point=0; index_point<num_points; index_point++)
+      free(points[index_point].cl);
+  }
+
+  if (emulator_file != NULL) {
+    if (class_mpi_rank() == 0)
+      printf("# emulator %s: %d point(s) predicted, %d point(s) computed\n",emulator_file,num_predicted,num_points-num_predicted);
+    scan_emulator_free(&se);
+  }
+
+  free(points);
+  parser_free(&fc);
+
+  if ((so.cache_directory != NULL) && (class_mpi_rank() == 0)) {
+    printf("# cache %s: %d point(s) read, %d point(s) added\n",so.cache_directory,num_hits,num_misses);
+    if (scan_cache_prune(so.cache_directory,MAX(max_cache_entries,1),errmsg) == _FAILURE_) {
+      printf("\n\nError in scan_cache_prune \n=>%s\n",errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  if (num_failures > 0) {
+    printf("# %d point(s) of the scan failed\n",num_failures);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
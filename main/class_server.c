@@ -0,0 +1,495 @@
+/** @file class_server.c
+ *
+ * Long-lived CLASS process answering requests on a Unix domain socket.
+ */
+
+/* this main reads one input file and then waits for requests on a
+   Unix domain socket, each of them giving parameters which replace
+   (or are added to) those of the input file. The process keeps
+   everything which is not specific to one model between the
+   requests: the process-wide thread pool, the tables of external
+   files, HyRec tables, quadrature rules, Wigner d-functions of the
+   lensing module, (with hyper_flat_cache = yes) the Bessel functions,
+   and the memory of the big tables (see class_recycle_large()). It also keeps the modules of the previous request, and
+   only recomputes those whose input changed (as tracked by
+   input_module_digests()) and the modules depending on them: for
+   instance, a request changing only A_s, n_s or r recomputes the
+   primordial, harmonic and lensing modules.
+
+   Usage: class_server socket input.ini
+
+   The protocol is made of lines of text. A request is a list of lines
+   'name = value', as in an input file, ended by an empty line (a
+   single empty line requests the model of the input file). The
+   answer is either
+
+     error <message>
+     end
+
+   or
+
+     ok
+     age[Gyr] = <value>
+     conformal_age[Mpc] = <value>
+     z_rec = <value>
+     100*theta_s = <value>
+     sigma8 = <value>                (with the matter power spectrum)
+     precision_tier = <tier>
+     cl_error = <value>              (estimated relative error of the C_l's)
+     reused = <modules>              (modules kept from the previous request)
+     cl = <lensed|unlensed> <l_max> <types>   (with C_l's)
+     <l> <C_l of each type>          (one line per l, from 2 to l_max)
+     end
+
+   where the C_l's are dimensionless, without the factor l(l+1)/2pi,
+   and the types are among TT, EE, TE, BB and phiphi. With
+   'precision_tier = 1' or '2' (see input_precision_tier()), a client
+   gets cheap preliminary C_l's, for instance to reject a proposal of
+   a Markov chain early; the same request with 'precision_tier = 0'
+   then refines them, with the background and thermodynamics of the
+   preliminary evaluation. A client can send any number of requests
+   on the same connection; the connections are served one after the
+   other. A request made of the single line 'shutdown' stops the
+   server. */
+
+#include "class.h"
+#include "timing.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define _SERVER_TYPES_ 5
+#define _SERVER_LINE_LENGTH_ (_LINE_LENGTH_MAX_+2*_ARGUMENT_LENGTH_MAX_)
+
+char * server_type_names[_SERVER_TYPES_] = {"TT","EE","TE","BB","phiphi"};
+
+char * server_module_names[module_size] = {"background","thermodynamics","perturbations","primordial","fourier",
+                                           "transfer","harmonic","lensing","distortions"};
+
+/* model of the previous request, kept for the next one */
+struct server_model {
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  unsigned long long digest[_NUM_INPUT_MODULES_]; /* see input_module_digests() */
+  int computed;                   /* flags (1 << module_xxx) of the initialized modules (0 before the first request) */
+};
+
+/* replace the value of a parameter, or add it */
+int server_set_parameter(
+                         struct file_content * pfc,
+                         char * name,
+                         char * value,
+                         ErrorMsg errmsg
+                         ) {
+
+  int index;
+
+  for (index=0; index<pfc->size; index++) {
+    if (strcmp(pfc->name[index],name) == 0)
+      break;
+  }
+  if (index == pfc->size) {
+    class_call(parser_extend(pfc,1,errmsg),
+               errmsg,
+               errmsg);
+    strcpy(pfc->name[index],name);
+  }
+  strcpy(pfc->value[index],value);
+  pfc->read[index] = _FALSE_;
+
+  return _SUCCESS_;
+}
+
+/* free the modules given by flags (1 << module_xxx) */
+void server_free_modules(
+                         struct server_model * psm,
+                         int modules
+                         ) {
+
+  if ((modules & (1 << module_distortions)) != 0) distortions_free(&(psm->sd));
+  if ((modules & (1 << module_lensing)) != 0) lensing_free(&(psm->le));
+  if ((modules & (1 << module_harmonic)) != 0) harmonic_free(&(psm->hr));
+  if ((modules & (1 << module_transfer)) != 0) transfer_free(&(psm->tr));
+  if ((modules & (1 << module_fourier)) != 0) fourier_free(&(psm->fo));
+  if ((modules & (1 << module_primordial)) != 0) primordial_free(&(psm->pm));
+  if ((modules & (1 << module_perturbations)) != 0) perturbations_free(&(psm->pt));
+  if ((modules & (1 << module_thermodynamics)) != 0) thermodynamics_free(&(psm->th));
+  if ((modules & (1 << module_background)) != 0) background_free(&(psm->ba));
+}
+
+/**
+ * Compute the model of a request, keeping the modules of the previous
+ * model which do not depend on the parameters that changed.
+ *
+ * @param pfc     Input: content of the input file, with the parameters of the request
+ * @param psm     Input/Output: model of the previous request, replaced by the new one
+ * @param preused Output: flags (1 << module_xxx) of the modules kept from the previous model
+ * @param errmsg  Output: error message
+ * @return the error status
+ */
+
+int server_compute(
+                   struct file_content * pfc,
+                   struct server_model * psm,
+                   int * preused,
+                   ErrorMsg errmsg
+                   ) {
+
+  struct precision pr;
+  struct background ba;
+  struct thermodynamics th;
+  struct perturbations pt;
+  struct primordial pm;
+  struct fourier fo;
+  struct transfer tr;
+  struct harmonic hr;
+  struct lensing le;
+  struct distortions sd;
+  struct output op;
+  unsigned long long digest[_NUM_INPUT_MODULES_];
+  short was_computed[_NUM_INPUT_MODULES_];
+  short can_reuse[_NUM_INPUT_MODULES_];
+  int index_module, index, computed, reused = 0, status;
+
+  *preused = 0;
+
+  /** - read the input in new structures, the previous model being still there */
+  class_call(input_read_from_file(pfc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg),
+             errmsg,
+             errmsg);
+
+  /* as with classy, a parameter which was not read is an error (often a typo) */
+  for (index=0; index<pfc->size; index++) {
+    if (pfc->read[index] == _FALSE_)
+      break;
+  }
+  if (index < pfc->size) {
+    background_free_input(&ba);
+    thermodynamics_free_input(&th);
+    perturbations_free_input(&pt);
+    class_stop(errmsg,"CLASS did not read input parameter %s",pfc->name[index]);
+  }
+  class_call(input_module_digests(pfc,&pr,digest,errmsg),
+             errmsg,
+             errmsg);
+
+  /** - modules of the previous model with the same input */
+  for (index_module=0; index_module<_NUM_INPUT_MODULES_; index_module++) {
+    if (index_module < module_size)
+      was_computed[index_module] = ((psm->computed & (1 << index_module)) != 0) ? _TRUE_ : _FALSE_;
+    else
+      was_computed[index_module] = (psm->computed != 0) ? _TRUE_ : _FALSE_;
+  }
+  input_module_reuse(psm->digest,digest,was_computed,fo.method != nl_none,can_reuse);
+  for (index_module=0; index_module<module_size; index_module++) {
+    if (can_reuse[index_module] == _TRUE_)
+      reused |= (1 << index_module);
+  }
+
+  /** - free the other modules of the previous model; the new input
+      structures of the kept modules (identical to the previous ones)
+      are dropped */
+  server_free_modules(psm,psm->computed & ~reused);
+
+  psm->pr = pr;
+  psm->op = op;
+  if ((reused & (1 << module_background)) != 0) background_free_input(&ba); else psm->ba = ba;
+  if ((reused & (1 << module_thermodynamics)) != 0) thermodynamics_free_input(&th); else psm->th = th;
+  if ((reused & (1 << module_perturbations)) != 0) perturbations_free_input(&pt); else psm->pt = pt;
+  if ((reused & (1 << module_primordial)) == 0) psm->pm = pm;
+  if ((reused & (1 << module_fourier)) == 0) psm->fo = fo;
+  if ((reused & (1 << module_transfer)) == 0) psm->tr = tr;
+  if ((reused & (1 << module_harmonic)) == 0) psm->hr = hr;
+  if ((reused & (1 << module_lensing)) == 0) psm->le = le;
+  if ((reused & (1 << module_distortions)) == 0) psm->sd = sd;
+  memcpy(psm->digest,digest,_NUM_INPUT_MODULES_*sizeof(unsigned long long));
+
+  /** - the other modules, the independent ones concurrently */
+  status = modules_init(&(psm->pr),&(psm->ba),&(psm->th),&(psm->pt),&(psm->pm),&(psm->fo),&(psm->tr),
+                        &(psm->hr),&(psm->le),&(psm->sd),_ALL_MODULES_ & ~reused,&computed,errmsg);
+  psm->computed = reused | computed;
+  *preused = reused;
+
+  return status;
+}
+
+/**
+ * Write the answer to a request which succeeded.
+ *
+ * @param stream  Input: stream of the connection
+ * @param psm     Input: model of the request
+ * @param reused  Input: flags (1 << module_xxx) of the modules kept from the previous request
+ * @param errmsg  Output: error message
+ * @return the error status
+ */
+
+int server_write_answer(
+                        FILE * stream,
+                        struct server_model * psm,
+                        int reused,
+                        ErrorMsg errmsg
+                        ) {
+
+  struct lensing * ple = &(psm->le);
+  struct harmonic * phr = &(psm->hr);
+  short has_type[_SERVER_TYPES_];
+  int index_ct[_SERVER_TYPES_];
+  short is_lensed = _FALSE_;
+  int ct_size = 0, l_max = 0;
+  int index_type, index_module, l;
+  double * cl;
+
+  fprintf(stream,"ok\n");
+  fprintf(stream,"age[Gyr] = %.10e\n",psm->ba.age);
+  fprintf(stream,"conformal_age[Mpc] = %.10e\n",psm->ba.conformal_age);
+  fprintf(stream,"z_rec = %.10e\n",psm->th.z_rec);
+  fprintf(stream,"100*theta_s = %.10e\n",100.*psm->th.rs_rec/psm->th.ra_rec);
+  if (psm->fo.has_pk_matter == _TRUE_)
+    fprintf(stream,"sigma8 = %.10e\n",psm->fo.sigma8[psm->fo.index_pk_m]);
+  fprintf(stream,"precision_tier = %d\n",psm->pr.precision_tier);
+  fprintf(stream,"cl_error = %.10e\n",psm->pr.precision_tier_error);
+  fprintf(stream,"reused =");
+  for (index_module=0; index_module<module_size; index_module++) {
+    if ((reused & (1 << index_module)) != 0)
+      fprintf(stream," %s",server_module_names[index_module]);
+  }
+  fprintf(stream,"\n");
+
+  if (ple->has_lensed_cls == _TRUE_) {
+    has_type[0] = ple->has_tt; index_ct[0] = ple->index_lt_tt;
+    has_type[1] = ple->has_ee; index_ct[1] = ple->index_lt_ee;
+    has_type[2] = ple->has_te; index_ct[2] = ple->index_lt_te;
+    has_type[3] = ple->has_bb; index_ct[3] = ple->index_lt_bb;
+    has_type[4] = ple->has_pp; index_ct[4] = ple->index_lt_pp;
+    ct_size = ple->lt_size;
+    is_lensed = _TRUE_;
+    l_max = ple->l_lensed_max;
+  }
+  else if (psm->pt.has_cls == _TRUE_) {
+    has_type[0] = phr->has_tt; index_ct[0] = phr->index_ct_tt;
+    has_type[1] = phr->has_ee; index_ct[1] = phr->index_ct_ee;
+    has_type[2] = phr->has_te; index_ct[2] = phr->index_ct_te;
+    has_type[3] = phr->has_bb; index_ct[3] = phr->index_ct_bb;
+    has_type[4] = phr->has_pp; index_ct[4] = phr->index_ct_pp;
+    ct_size = phr->ct_size;
+    l_max = phr->l_max_tot;
+  }
+
+  if (l_max >= 2) {
+    class_alloc(cl,(l_max-1)*ct_size*sizeof(double),errmsg);
+    if (is_lensed == _TRUE_) {
+      class_call_except(lensing_cl_at_l_range(ple,2,l_max,cl),
+                        ple->error_message,
+                        errmsg,
+                        free(cl));
+    }
+    else {
+      class_call_except(harmonic_cl_at_l_range(phr,2,l_max,cl),
+                        phr->error_message,
+                        errmsg,
+                        free(cl));
+    }
+    fprintf(stream,"cl = %s %d",(is_lensed == _TRUE_) ? "lensed" : "unlensed",l_max);
+    for (index_type=0; index_type<_SERVER_TYPES_; index_type++) {
+      if (has_type[index_type] == _TRUE_)
+        fprintf(stream," %s",server_type_names[index_type]);
+    }
+    fprintf(stream,"\n");
+    for (l=2; l<=l_max; l++) {
+      fprintf(stream,"%d",l);
+      for (index_type=0; index_type<_SERVER_TYPES_; index_type++) {
+        if (has_type[index_type] == _TRUE_)
+          fprintf(stream," %.10e",cl[(l-2)*ct_size+index_ct[index_type]]);
+      }
+      fprintf(stream,"\n");
+    }
+    free(cl);
+  }
+
+  fprintf(stream,"end\n");
+
+  return _SUCCESS_;
+}
+
+/* answer to a request which failed, on a single line */
+void server_write_error(
+                        FILE * stream,
+                        char * message
+                        ) {
+
+  char * c;
+
+  for (c=message; *c != '\0'; c++) {
+    if ((*c == '\n') || (*c == '\r'))
+      *c = ' ';
+  }
+  fprintf(stream,"error %s\nend\n",message);
+}
+
+/**
+ * Serve the requests of one connection, until the client closes it or
+ * asks for a shutdown.
+ *
+ * @param fd        Input: socket of the connection
+ * @param pfc_base  Input: content of the input file (not modified)
+ * @param psm       Input/Output: model of the previous request
+ * @param pshutdown Output: _TRUE_ if the client asked for a shutdown
+ * @param pnum_requests Input/Output: number of requests served so far
+ */
+
+void server_serve_connection(
+                             int fd,
+                             struct file_content * pfc_base,
+                             struct server_model * psm,
+                             short * pshutdown,
+                             int * pnum_requests
+                             ) {
+
+  FILE * input;
+  FILE * output;
+  struct file_content fc;
+  char line[_SERVER_LINE_LENGTH_];
+  FileArg name, value;
+  ErrorMsg errmsg;
+  int is_data, num_lines, is_complete, reused, status;
+  struct class_stats stats;
+
+  input = fdopen(fd,"r");
+  output = fdopen(dup(fd),"w");
+  if ((input == NULL) || (output == NULL)) {
+    if (input != NULL) fclose(input); else close(fd);
+    if (output != NULL) fclose(output);
+    return;
+  }
+
+  while (*pshutdown == _FALSE_) {
+
+    /** - read a request, on top of the input file */
+    if (parser_init_from_pfc(pfc_base,&fc,errmsg) == _FAILURE_)
+      break;
+    status = _SUCCESS_;
+    num_lines = 0;
+    is_complete = _FALSE_;
+    while (fgets(line,_SERVER_LINE_LENGTH_,input) != NULL) {
+      line[strcspn(line,"\r\n")] = '\0';
+      if (line[0] == '\0') {
+        is_complete = _TRUE_;
+        break;
+      }
+      num_lines++;
+      if ((num_lines == 1) && (strcmp(line,"shutdown") == 0)) {
+        *pshutdown = _TRUE_;
+        continue;
+      }
+      if (status == _FAILURE_)
+        continue;
+      status = parser_read_line(line,&is_data,name,value,errmsg);
+      if ((status == _SUCCESS_) && (is_data == _TRUE_))
+        status = server_set_parameter(&fc,name,value,errmsg);
+    }
+    /* the connection was closed (an unfinished request is ignored) */
+    if ((is_complete == _FALSE_) || (*pshutdown == _TRUE_)) {
+      parser_free(&fc);
+      break;
+    }
+
+    /** - compute the model and answer */
+    class_stats_begin(&stats);
+    if (status == _SUCCESS_)
+      status = server_compute(&fc,psm,&reused,errmsg);
+    if (status == _SUCCESS_)
+      status = server_write_answer(output,psm,reused,errmsg);
+    if (status == _FAILURE_)
+      server_write_error(output,errmsg);
+    fflush(output);
+    parser_free(&fc);
+
+    class_stats_end(&stats);
+    (*pnum_requests)++;
+    printf("# request %d: %s in %.3f s\n",*pnum_requests,(status == _SUCCESS_) ? "done" : "failed",stats.wall_time);
+    fflush(stdout);
+  }
+
+  fclose(input);
+  fclose(output);
+}
+
+int main(int argc, char **argv) {
+
+  struct file_content fc;
+  struct server_model sm;
+  struct sockaddr_un address;
+  ErrorMsg errmsg;
+  short shutdown = _FALSE_;
+  int num_requests = 0;
+  int fd_server, fd, i;
+
+  if (argc != 3) {
+    fprintf(stderr,"usage: %s socket input.ini\n",argv[0]);
+    return _FAILURE_;
+  }
+
+  if (parser_read_file(argv[2],&fc,errmsg) == _FAILURE_) {
+    printf("\n\nError in parser_read_file \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  /* the output module is not used */
+  for (i=0; i<fc.size; i++) {
+    if (strcmp(fc.name[i],"overwrite_root") == 0)
+      fc.read[i] = _TRUE_;
+  }
+
+  /* a client closing its connection early must not stop the server */
+  signal(SIGPIPE,SIG_IGN);
+
+  /* successive models have tables of (nearly) the same sizes: keep the
+     big ones from one request to the next */
+  class_recycle_large(_TRUE_);
+
+  if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+    printf("\n\nError: the name of the socket %s is too long\n",argv[1]);
+    return _FAILURE_;
+  }
+  memset(&address,0,sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path,argv[1]);
+
+  fd_server = socket(AF_UNIX,SOCK_STREAM,0);
+  unlink(argv[1]);
+  if ((fd_server < 0) ||
+      (bind(fd_server,(struct sockaddr *) &address,sizeof(address)) != 0) ||
+      (listen(fd_server,16) != 0)) {
+    printf("\n\nError: cannot listen on the socket %s\n",argv[1]);
+    return _FAILURE_;
+  }
+  printf("# listening on %s\n",argv[1]);
+  fflush(stdout);
+
+  memset(&sm,0,sizeof(struct server_model));
+
+  while (shutdown == _FALSE_) {
+    fd = accept(fd_server,NULL,NULL);
+    if (fd < 0)
+      continue;
+    server_serve_connection(fd,&fc,&sm,&shutdown,&num_requests);
+  }
+
+  close(fd_server);
+  unlink(argv[1]);
+
+  server_free_modules(&sm,sm.computed);
+  parser_free(&fc);
+
+  return _SUCCESS_;
+}
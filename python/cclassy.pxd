@@ -50,13 +50,29 @@ cdef extern from "class.h":
         out_sigma_prime
         out_sigma_disp
 
+    cdef enum sources_storage:
+        sources_storage_double
+        sources_storage_float
+
+    cdef enum class_counter:
+        counter_size
+
+    cdef struct class_stats:
+        double wall_time
+        double cpu_time
+        long counter[counter_size]
+        long peak_rss
+
     cdef struct precision:
         double nonlinear_min_k_max
+        int precision_tier
+        double precision_tier_error
         ErrorMsg error_message
 
     cdef struct background:
         short is_allocated
         ErrorMsg error_message
+        class_stats stats
         int bg_size
         int index_bg_ang_distance
         int index_bg_lum_distance
@@ -118,6 +134,7 @@ cdef extern from "class.h":
     cdef struct thermodynamics:
         short is_allocated
         ErrorMsg error_message
+        class_stats stats
         int th_size
         int index_th_xe
         int index_th_Tb
@@ -155,6 +172,7 @@ cdef extern from "class.h":
     cdef struct perturbations:
         short is_allocated
         ErrorMsg error_message
+        class_stats stats
         short has_scalars
         short has_vectors
         short has_tensors
@@ -184,6 +202,7 @@ cdef extern from "class.h":
         int size_scalar_perturbation_data[30]
         int size_vector_perturbation_data[30]
         int size_tensor_perturbation_data[30]
+        short stream_perturbations
 
         double * alpha_idm_dr
         double * beta_idr
@@ -277,6 +296,9 @@ cdef extern from "class.h":
 
 
         double *** sources
+        sources_storage storage
+        float *** sources_float
+        double storage_error
         double * tau_sampling
         int tau_size
         int k_size_pk
@@ -292,10 +314,12 @@ cdef extern from "class.h":
     cdef struct transfer:
         short is_allocated
         ErrorMsg error_message
+        class_stats stats
 
     cdef struct primordial:
         short is_allocated
         ErrorMsg error_message
+        class_stats stats
         double k_pivot
         double A_s
         double n_s
@@ -328,6 +352,7 @@ cdef extern from "class.h":
     cdef struct harmonic:
         short is_allocated
         ErrorMsg error_message
+        class_stats stats
         int has_tt
         int has_te
         int has_ee
@@ -380,6 +405,7 @@ cdef extern from "class.h":
         int has_distortions
         int x_size
         ErrorMsg error_message
+        class_stats stats
 
     cdef struct lensing:
         short is_allocated
@@ -411,6 +437,7 @@ cdef extern from "class.h":
         int l_lensed_max
         int l_unlensed_max
         ErrorMsg error_message
+        class_stats stats
 
     cdef struct fourier:
         short is_allocated
@@ -439,6 +466,7 @@ cdef extern from "class.h":
         int index_pk_total
         int index_pk_cluster
         ErrorMsg error_message
+        class_stats stats
 
     cdef struct file_content:
         char * filename
@@ -461,22 +489,35 @@ cdef extern from "class.h":
     cdef int _FALSE_
     cdef int _TRUE_
 
+    enum: _NUM_INPUT_MODULES_
+
     cdef double _Mpc_over_m_
     cdef double _c_
     cdef double _G_
     cdef double _eV_
 
+    const char * class_stats_counter_name(int index)
     int input_read_from_file(void*, void*, void*, void*, void*, void*, void*, void*, void*,
-        void*, void*, void*, char*)
-    int background_init(void*,void*)
-    int thermodynamics_init(void*,void*,void*)
-    int perturbations_init(void*,void*,void*,void*)
-    int primordial_init(void*,void*,void*)
-    int fourier_init(void*,void*,void*,void*,void*,void*)
-    int transfer_init(void*,void*,void*,void*,void*,void*)
-    int harmonic_init(void*,void*,void*,void*,void*,void*,void*)
-    int lensing_init(void*,void*,void*,void*,void*)
-    int distortions_init(void*,void*,void*,void*,void*,void*)
+        void*, void*, void*, char*) nogil
+    int parser_reset_index(void*)
+    int input_module_digests(void*, void*, unsigned long long*, char*)
+    int input_module_reuse(unsigned long long*, unsigned long long*, short*, short, short*)
+    int background_free_input(void*)
+    int thermodynamics_free_input(void*)
+    int perturbations_free_input(void*)
+    int background_init(void*,void*) nogil
+    int thermodynamics_init(void*,void*,void*) nogil
+    int perturbations_init(void*,void*,void*,void*) nogil
+    int primordial_init(void*,void*,void*) nogil
+    int fourier_init(void*,void*,void*,void*,void*,void*) nogil
+    int transfer_init(void*,void*,void*,void*,void*,void*) nogil
+    int harmonic_init(void*,void*,void*,void*,void*,void*,void*) nogil
+    int lensing_init(void*,void*,void*,void*,void*) nogil
+    int distortions_init(void*,void*,void*,void*,void*,void*) nogil
+    int modules_init(void*,void*,void*,void*,void*,void*,void*,void*,void*,void*,int,int*,char*) nogil
+
+    int class_parallel_attach_thread(int num_threads)
+    int class_recycle_large(int recycle)
 
     int background_tau_of_z(void* pba, double z,double* tau)
     int background_z_of_tau(void* pba, double tau,double* z)
@@ -500,6 +541,8 @@ cdef extern from "class.h":
 
     int harmonic_cl_at_l(void* phr,double l,double * cl,double * * cl_md,double * * cl_md_ic)
     int lensing_cl_at_l(void * ple,int l,double * cl_lensed)
+    int harmonic_cl_at_l_range(void * phr,int l_min,int l_max,double * cl_tot) nogil
+    int lensing_cl_at_l_range(void * ple,int l_min,int l_max,double * cl_lensed) nogil
 
     int harmonic_pk_at_z(
         void * pba,
@@ -592,6 +635,29 @@ cdef extern from "class.h":
         double * out_pk,
         double * out_pk_cb)
 
+    int fourier_pk_at_kvec_and_zvec(
+        void * pba,
+        void * pfo,
+        int pk_output,
+        int index_pk,
+        double * kvec,
+        int kvec_size,
+        double * zvec,
+        int zvec_size,
+        double * out_pk)
+
+    int fourier_pk_and_tilt_at_kvec_and_zvec(
+        void * pba,
+        void * pfo,
+        int pk_output,
+        int index_pk,
+        double * kvec,
+        int kvec_size,
+        double * zvec,
+        int zvec_size,
+        double * out_pk,
+        double * out_tilt) nogil
+
     int fourier_k_nl_at_z(void* pba, void* pfo, double z, double* k_nl, double* k_nl_cb)
 
     int harmonic_firstline_and_ic_suffix(void *ppt, int index_ic, char first_line[1024], FileName ic_suffix)
@@ -106,6 +106,8 @@ cdef class Class:
     cdef int allocated # Flag to see if classy structs are allocated already
     cdef object _pars # Dictionary of the parameters
     cdef object ncp   # Keeps track of the structures initialized, in view of cleaning.
+    cdef object _digests # Digests of the inputs of each module for the computed model, see input_module_digests()
+    cdef int _num_threads # Threads of the pool used by compute() for this instance (0 for the shared pool), see set_num_threads()
 
     _levellist = ["input","background","thermodynamics","perturbations", "primordial", "fourier", "transfer", "harmonic", "lensing", "distortions"]
 
@@ -142,6 +144,11 @@ cdef class Class:
         dumc = "NOFILE"
         sprintf(self.fc.filename,"%s",dumc)
         self.ncp = set()
+        self._digests = None
+        self._num_threads = 0
+        # successive models have tables of (nearly) the same sizes: keep
+        # the big ones from one compute() to the next (see recycle_memory())
+        class_recycle_large(_TRUE_)
         if default: self.set_default()
 
     def __dealloc__(self):
@@ -149,6 +156,7 @@ cdef class Class:
           self.struct_cleanup()
         self.empty()
         # Reset all the fc to zero if its not already done
+        parser_reset_index(&self.fc)
         if self.fc.size !=0:
             self.fc.size=0
             free(self.fc.name)
@@ -173,11 +181,65 @@ cdef class Class:
         self._pars = {}
         self.computed = False
 
+    def set_num_threads(self, num_threads=0):
+        """
+        set_num_threads(num_threads=0)
+
+        Bound the number of threads used by the next calls to compute() of
+        this instance. By default (num_threads=0), all instances share one
+        pool of threads for the whole process (OMP_NUM_THREADS threads, or
+        one per core). With num_threads > 0, compute() runs on this number of
+        threads (the calling Python thread and a pool owned by it, reused by
+        its next calls). These threads are taken from a budget shared by all
+        instances (OMP_NUM_THREADS or one per core by default): when it is
+        exhausted, the instance gets less threads, down to running serially,
+        such that the cores are never oversubscribed. compute() releases the
+        GIL, so that several instances can be
+        computed concurrently from a thread pool, e.g.
+
+            with ThreadPoolExecutor(4) as ex:
+                for M in instances: M.set_num_threads(2)
+                list(ex.map(lambda M: M.compute(), instances))
+
+        Each instance must only be used by one thread at a time.
+
+        Parameters
+        ----------
+        num_threads : int
+                Number of threads (0 for the shared pool of the process)
+        """
+        if num_threads < 0:
+            raise CosmoSevereError("num_threads must be positive or zero")
+        self._num_threads = num_threads
+
+    def recycle_memory(self, recycle=True):
+        """
+        recycle_memory(recycle=True)
+
+        By default, the big tables of CLASS (source functions, transfer
+        functions, Bessel functions...) freed by struct_cleanup() or by
+        the next compute() are kept by the process and reused by the next
+        models whose tables have nearly the same sizes, as usual along a
+        chain: this avoids mapping and zeroing new pages for each model.
+        The memory kept never makes the total memory used by these tables
+        exceed its largest value so far. With recycle=False, the kept
+        tables are freed, and the tables are then freed as soon as they
+        are released (this setting is shared by all instances).
+
+        Parameters
+        ----------
+        recycle : bool
+                Whether to keep the released tables for the next models
+        """
+        class_recycle_large(_TRUE_ if recycle else _FALSE_)
+
     # Create an equivalent of the parameter file. Non specified values will be
     # taken at their default (in Class)
     def _fillparfile(self):
         cdef char* dumc
 
+        # the names change: forget the hash index built by the previous run
+        parser_reset_index(&self.fc)
         if self.fc.size!=0:
             free(self.fc.name)
             free(self.fc.value)
@@ -209,28 +271,34 @@ cdef class Class:
     def struct_cleanup(self):
         if(self.allocated != True):
           return
-        if self.sd.is_allocated:
+        self._free_modules(self._levellist)
+        self.ncp = set()
+        self._digests = None
+
+        self.allocated = False
+        self.computed = False
+
+    # Free the structures of the given modules, in reverse order of computation
+    def _free_modules(self, modules):
+        if "distortions" in modules and self.sd.is_allocated:
             distortions_free(&self.sd)
-        if self.le.is_allocated:
+        if "lensing" in modules and self.le.is_allocated:
             lensing_free(&self.le)
-        if self.hr.is_allocated:
+        if "harmonic" in modules and self.hr.is_allocated:
             harmonic_free(&self.hr)
-        if self.tr.is_allocated:
+        if "transfer" in modules and self.tr.is_allocated:
             transfer_free(&self.tr)
-        if self.fo.is_allocated:
+        if "fourier" in modules and self.fo.is_allocated:
             fourier_free(&self.fo)
-        if self.pm.is_allocated:
+        if "primordial" in modules and self.pm.is_allocated:
             primordial_free(&self.pm)
-        if self.pt.is_allocated:
+        if "perturbations" in modules and self.pt.is_allocated:
             perturbations_free(&self.pt)
-        if self.th.is_allocated:
+        if "thermodynamics" in modules and self.th.is_allocated:
             thermodynamics_free(&self.th)
-        if self.ba.is_allocated:
+        if "background" in modules and self.ba.is_allocated:
             background_free(&self.ba)
-        self.ncp = set()
-
-        self.allocated = False
-        self.computed = False
+        self.ncp.difference_update(modules)
 
     def _check_task_dependency(self, level):
         """
@@ -303,6 +371,12 @@ cdef class Class:
                 necessary modules to compute in order to initialize this last
                 one. The default last module is "lensing".
 
+        If a model was already computed, the modules whose inputs (as
+        tracked by input_module_digests() in CLASS) did not change, and
+        which only depend on such modules, are not recomputed. For
+        instance, changing only primordial parameters keeps the
+        background, thermodynamics, perturbations and transfer modules.
+
         .. warning::
 
             level default value should be left as an array (it was creating
@@ -310,6 +384,36 @@ cdef class Class:
 
         """
         cdef ErrorMsg errmsg
+        cdef precision pr_new
+        cdef background ba_new
+        cdef thermodynamics th_new
+        cdef perturbations pt_new
+        cdef primordial pm_new
+        cdef fourier fo_new
+        cdef transfer tr_new
+        cdef harmonic hr_new
+        cdef output op_new
+        cdef lensing le_new
+        cdef distortions sd_new
+        cdef unsigned long long digest_old[_NUM_INPUT_MODULES_]
+        cdef unsigned long long digest_new[_NUM_INPUT_MODULES_]
+        cdef short was_computed[_NUM_INPUT_MODULES_]
+        cdef short can_reuse[_NUM_INPUT_MODULES_]
+        cdef int status
+        cdef int modules
+        cdef int computed
+        # The C calls below run without the GIL, from these addresses
+        cdef void * pfc = &self.fc
+        cdef void * ppr = &self.pr
+        cdef void * pba = &self.ba
+        cdef void * pth = &self.th
+        cdef void * ppt = &self.pt
+        cdef void * ppm = &self.pm
+        cdef void * pfo = &self.fo
+        cdef void * ptr = &self.tr
+        cdef void * phr = &self.hr
+        cdef void * ple = &self.le
+        cdef void * psd = &self.sd
 
         # Append to the list level all the modules necessary to compute.
         level = self._check_task_dependency(level)
@@ -321,113 +425,124 @@ cdef class Class:
         if self.computed and self.ncp.issuperset(level):
             return
 
-        # Check if already allocated to prevent memory leaks
-        if self.allocated:
-            self.struct_cleanup()
-
         # Otherwise, proceed with the normal computation.
         self.computed = False
 
         # Equivalent of writing a parameter file
         self._fillparfile()
 
-        # self.ncp will contain the list of computed modules (under the form of
-        # a set, instead of a python list)
-        self.ncp=set()
-        # Up until the empty set, all modules are allocated
-        # (And then we successively keep track of the ones we allocate additionally)
-        self.allocated = True
-
         # --------------------------------------------------------------------
         # Check the presence for all CLASS modules in the list 'level'. If a
         # module is found in level, executure its "_init" method.
         # --------------------------------------------------------------------
         # The input module should raise a CosmoSevereError, because
         # non-understood parameters asked to the wrapper is a problematic
-        # situation.
-        if "input" in level:
-            if input_read_from_file(&self.fc, &self.pr, &self.ba, &self.th,
-                                    &self.pt, &self.tr, &self.pm, &self.hr,
-                                    &self.fo, &self.le, &self.sd, &self.op, errmsg) == _FAILURE_:
-                raise CosmoSevereError(errmsg)
-            self.ncp.add("input")
-            # This part is done to list all the unread parameters, for debugging
-            problem_flag = False
-            problematic_parameters = []
-            for i in range(self.fc.size):
-                if self.fc.read[i] == _FALSE_:
-                    problem_flag = True
-                    problematic_parameters.append(self.fc.name[i].decode())
-            if problem_flag:
-                raise CosmoSevereError(
-                    "Class did not read input parameter(s): %s\n" % ', '.join(
-                    problematic_parameters))
-
-        # The following list of computation is straightforward. If the "_init"
-        # methods fail, call `struct_cleanup` and raise a CosmoComputationError
-        # with the error message from the faulty module of CLASS.
-        if "background" in level:
-            if background_init(&(self.pr), &(self.ba)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.ba.error_message)
-            self.ncp.add("background")
-
-        if "thermodynamics" in level:
-            if thermodynamics_init(&(self.pr), &(self.ba),
-                                   &(self.th)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.th.error_message)
-            self.ncp.add("thermodynamics")
-
-        if "perturbations" in level:
-            if perturbations_init(&(self.pr), &(self.ba),
-                            &(self.th), &(self.pt)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.pt.error_message)
-            self.ncp.add("perturbations")
-
-        if "primordial" in level:
-            if primordial_init(&(self.pr), &(self.pt),
-                               &(self.pm)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.pm.error_message)
-            self.ncp.add("primordial")
-
-        if "fourier" in level:
-            if fourier_init(&self.pr, &self.ba, &self.th,
-                              &self.pt, &self.pm, &self.fo) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.fo.error_message)
-            self.ncp.add("fourier")
-
-        if "transfer" in level:
-            if transfer_init(&(self.pr), &(self.ba), &(self.th),
-                             &(self.pt), &(self.fo), &(self.tr)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.tr.error_message)
-            self.ncp.add("transfer")
-
-        if "harmonic" in level:
-            if harmonic_init(&(self.pr), &(self.ba), &(self.pt),
-                            &(self.pm), &(self.fo), &(self.tr),
-                            &(self.hr)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.hr.error_message)
-            self.ncp.add("harmonic")
-
-        if "lensing" in level:
-            if lensing_init(&(self.pr), &(self.pt), &(self.hr),
-                            &(self.fo), &(self.le)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.le.error_message)
-            self.ncp.add("lensing")
-
-        if "distortions" in level:
-            if distortions_init(&(self.pr), &(self.ba), &(self.th),
-                                &(self.pt), &(self.pm), &(self.sd)) == _FAILURE_:
-                self.struct_cleanup()
-                raise CosmoComputationError(self.sd.error_message)
-            self.ncp.add("distortions")
+        # situation. The input is read in new structures, such that the
+        # modules of the previous model are still available below.
+        # The threads of this instance (see set_num_threads())
+        class_parallel_attach_thread(self._num_threads)
+
+        with nogil:
+            status = input_read_from_file(pfc, &pr_new, &ba_new, &th_new,
+                                          &pt_new, &tr_new, &pm_new, &hr_new,
+                                          &fo_new, &le_new, &sd_new, &op_new, errmsg)
+        if status == _FAILURE_:
+            self.struct_cleanup()
+            raise CosmoSevereError(errmsg)
+        # This part is done to list all the unread parameters, for debugging
+        problem_flag = False
+        problematic_parameters = []
+        for i in range(self.fc.size):
+            if self.fc.read[i] == _FALSE_:
+                problem_flag = True
+                problematic_parameters.append(self.fc.name[i].decode())
+        if problem_flag:
+            self.struct_cleanup()
+            raise CosmoSevereError(
+                "Class did not read input parameter(s): %s\n" % ', '.join(
+                problematic_parameters))
+
+        # Find which modules of the previous model (if any) only depend on
+        # inputs identical to the new ones: those are kept, all other
+        # modules are freed and recomputed.
+        if input_module_digests(&self.fc, &pr_new, digest_new, errmsg) == _FAILURE_:
+            self.struct_cleanup()
+            raise CosmoSevereError(errmsg)
+        for i in range(_NUM_INPUT_MODULES_):
+            if self.allocated and self._digests is not None and i+1 < len(self._levellist) and self._levellist[i+1] in self.ncp:
+                was_computed[i] = _TRUE_
+                digest_old[i] = self._digests[i]
+            else:
+                was_computed[i] = _FALSE_
+                digest_old[i] = 0
+        # Without non-linear corrections, the transfer functions do not
+        # depend on the primordial parameters
+        input_module_reuse(digest_old, digest_new, was_computed,
+                           fo_new.method != nl_none, can_reuse)
+        reused = set()
+        for i in range(len(self._levellist)-1):
+            if can_reuse[i] == _TRUE_:
+                reused.add(self._levellist[i+1])
+
+        if self.allocated:
+            self._free_modules(set(self._levellist[1:]).difference(reused))
+
+        # Modules to recompute take the new input structures; for reused
+        # modules, the new input structures (identical to the old ones)
+        # are dropped.
+        self.pr = pr_new
+        self.op = op_new
+        if "background" in reused:
+            background_free_input(&ba_new)
+        else:
+            self.ba = ba_new
+        if "thermodynamics" in reused:
+            thermodynamics_free_input(&th_new)
+        else:
+            self.th = th_new
+        if "perturbations" in reused:
+            perturbations_free_input(&pt_new)
+        else:
+            self.pt = pt_new
+        if "primordial" not in reused:
+            self.pm = pm_new
+        if "fourier" not in reused:
+            self.fo = fo_new
+        if "transfer" not in reused:
+            self.tr = tr_new
+        if "harmonic" not in reused:
+            self.hr = hr_new
+        if "lensing" not in reused:
+            self.le = le_new
+        if "distortions" not in reused:
+            self.sd = sd_new
+
+        self._digests = [digest_new[i] for i in range(_NUM_INPUT_MODULES_)]
+
+        # self.ncp will contain the list of computed modules (under the form of
+        # a set, instead of a python list)
+        self.ncp = set(["input"]).union(reused)
+        # Up until the empty set, all modules are allocated
+        # (And then we successively keep track of the ones we allocate additionally)
+        self.allocated = True
+
+        # The requested modules are initialized by modules_init(), which
+        # runs the independent ones concurrently (e.g. transfer next to
+        # primordial and fourier). Its list of modules follows the order of
+        # _levellist. If one of them fails, call `struct_cleanup` and raise
+        # a CosmoComputationError with the error message of the faulty module.
+        modules = 0
+        for index_module, module in enumerate(self._levellist[1:]):
+            if module in level and module not in self.ncp:
+                modules |= (1 << index_module)
+        with nogil:
+            status = modules_init(ppr, pba, pth, ppt, ppm, pfo, ptr, phr, ple, psd, modules, &computed, errmsg)
+        for index_module, module in enumerate(self._levellist[1:]):
+            if computed & (1 << index_module):
+                self.ncp.add(module)
+        if status == _FAILURE_:
+            self.struct_cleanup()
+            raise CosmoComputationError(errmsg)
 
         self.computed = True
 
@@ -435,6 +550,43 @@ cdef class Class:
         # following functions are only to output the desired numbers
         return
 
+    def refine(self, level=["distortions"]):
+        """
+        refine(level=["distortions"])
+
+        Recompute at full precision a model computed with a coarse
+        'precision_tier' (1 or 2, see input_precision_tier() in CLASS),
+        for instance after its preliminary spectra did not allow to
+        reject it. The 'precision_tier' parameter is removed, and the
+        background and thermodynamics of the preliminary evaluation are
+        kept.
+
+        Parameters
+        ----------
+        level : list
+                list of the last module desired, as for compute()
+
+        """
+        if "precision_tier" in self._pars:
+            del self._pars["precision_tier"]
+            self.computed = False
+        self.compute(level)
+
+    def precision_error(self):
+        """
+        precision_error()
+
+        Return the estimated relative error of the C_l's of the
+        computed model: 0 at full precision, and a bound on the error of
+        the preliminary spectra computed with 'precision_tier' = 1 or 2
+        (this estimate can be replaced by passing 'precision_tier_error').
+
+        Returns
+        -------
+        error : float
+        """
+        return self.pr.precision_tier_error
+
     def set_baseline(self, baseline_name):
         # Taken from montepython [https://github.com/brinckmann/montepython_public] (see also 1210.7183, 1804.07261)
         if ('planck' in baseline_name and '18' in baseline_name and 'lens' in baseline_name and 'bao' in baseline_name) or 'p18lb' in baseline_name.lower():
@@ -589,46 +741,27 @@ cdef class Class:
 
         # Now that the conditions are all checked, we can allocate and do what we want
 
-        #temporary storage for the cls (total)
-        cdef double *rcl = <double*> calloc(self.hr.ct_size,sizeof(double))
-
-        # Quantities for tensor modes
-        cdef double **cl_md = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md[index_md] = <double*> calloc(self.hr.ct_size, sizeof(double))
-
-        # Quantities for isocurvature modes
-        cdef double **cl_md_ic = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md_ic[index_md] = <double*> calloc(self.hr.ct_size*self.hr.ic_ic_size[index_md], sizeof(double))
+        # All the C_l's are interpolated in one C call (without the GIL) into a
+        # single table, and the returned arrays are views of its columns
+        cdef int ct_size = self.hr.ct_size
+        cdef int lmax_c = lmax
+        cdef int status = _SUCCESS_
+        cdef void * phr = &self.hr
+        cl_table = np.zeros((lmax+1, ct_size), dtype=np.double)
+        cdef double[:,::1] cl_mv = cl_table
+
+        if lmax_c >= 2:
+            with nogil:
+                status = harmonic_cl_at_l_range(phr, 2, lmax_c, &cl_mv[2,0])
+        if status == _FAILURE_:
+            raise CosmoSevereError(self.hr.error_message)
 
-        # Initialise all the needed Cls arrays
         cl = {}
-        for elem in spectra:
-            cl[elem] = np.zeros(lmax+1, dtype=np.double)
-
-        success = True
-        # Recover for each ell the information from CLASS
-        for ell from 2<=ell<lmax+1:
-            if harmonic_cl_at_l(&self.hr, ell, rcl, cl_md, cl_md_ic) == _FAILURE_:
-                success = False
-                break
-            for flag, index, name in has_flags:
-                if name in spectra:
-                    cl[name][ell] = rcl[index]
+        for flag, index, name in has_flags:
+            if name in spectra:
+                cl[name] = cl_table[:, index]
         cl['ell'] = np.arange(lmax+1)
 
-        free(rcl)
-        for index_md in range(self.hr.md_size):
-            free(cl_md[index_md])
-            free(cl_md_ic[index_md])
-        free(cl_md)
-        free(cl_md_ic)
-
-        # This has to be delayed until AFTER freeing the memory
-        if not success:
-          raise CosmoSevereError(self.hr.error_message)
-
         return cl
 
     def lensed_cl(self, lmax=-1,nofail=False):
@@ -688,28 +821,28 @@ cdef class Class:
                 raise CosmoSevereError("Can only compute up to lmax=%d"%lmaxR)
 
         # Now that the conditions are all checked, we can allocate and do what we want
-        cdef double *lcl = <double*> calloc(self.le.lt_size,sizeof(double))
+
+        # All the lensed C_l's are interpolated in one C call (without the GIL)
+        # into a single table, and the returned arrays are views of its columns
+        cdef int lt_size = self.le.lt_size
+        cdef int lmax_c = lmax
+        cdef int status = _SUCCESS_
+        cdef void * ple = &self.le
+        cl_table = np.zeros((lmax+1, lt_size), dtype=np.double)
+        cdef double[:,::1] cl_mv = cl_table
+
+        if lmax_c >= 2:
+            with nogil:
+                status = lensing_cl_at_l_range(ple, 2, lmax_c, &cl_mv[2,0])
+        if status == _FAILURE_:
+            raise CosmoSevereError(self.le.error_message)
 
         cl = {}
-        success = True
-        # Simple Cls, for temperature and polarisation, are not so big in size
-        for elem in spectra:
-            cl[elem] = np.zeros(lmax+1, dtype=np.double)
-        for ell from 2<=ell<lmax+1:
-            if lensing_cl_at_l(&self.le,ell,lcl) == _FAILURE_:
-                success = False
-                break
-            for flag, index, name in has_flags:
-                if name in spectra:
-                    cl[name][ell] = lcl[index]
+        for flag, index, name in has_flags:
+            if name in spectra:
+                cl[name] = cl_table[:, index]
         cl['ell'] = np.arange(lmax+1)
 
-        free(lcl)
-
-        # This has to be delayed until AFTER freeing the memory
-        if not success:
-          raise CosmoSevereError(self.le.error_message)
-
         return cl
 
     def density_cl(self, lmax=-1, nofail=False):
@@ -771,17 +904,21 @@ cdef class Class:
                 raise CosmoSevereError("Can only compute up to lmax=%d"%lmaxR)
 
         # Now that the conditions are all checked, we can allocate and do what we want
-        cdef double *dcl = <double*> calloc(self.hr.ct_size,sizeof(double))
-
-        # Quantities for tensor modes
-        cdef double **cl_md = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md[index_md] = <double*> calloc(self.hr.ct_size, sizeof(double))
 
-        # Quantities for isocurvature modes
-        cdef double **cl_md_ic = <double**> calloc(self.hr.md_size, sizeof(double*))
-        for index_md in range(self.hr.md_size):
-            cl_md_ic[index_md] = <double*> calloc(self.hr.ct_size*self.hr.ic_ic_size[index_md], sizeof(double))
+        # All the C_l's are interpolated in one C call (without the GIL) into a
+        # single table, and the returned arrays are views of its columns
+        cdef int ct_size = self.hr.ct_size
+        cdef int lmax_c = lmax
+        cdef int status = _SUCCESS_
+        cdef void * phr = &self.hr
+        cl_table = np.zeros((lmax+1, ct_size), dtype=np.double)
+        cdef double[:,::1] cl_mv = cl_table
+
+        if lmax_c >= 2:
+            with nogil:
+                status = harmonic_cl_at_l_range(phr, 2, lmax_c, &cl_mv[2,0])
+        if status == _FAILURE_:
+            raise CosmoSevereError(self.hr.error_message)
 
         cl = {}
 
@@ -794,46 +931,19 @@ cdef class Class:
           for index_d2 in range(max(index_d1-self.hr.non_diag,0), min(index_d1+self.hr.non_diag+1, self.hr.d_size)):
             names['dl'].append("dens[%d]-lens[%d]"%(index_d1+1, index_d2+1))
 
+        first_index = {'dd':self.hr.index_ct_dd, 'll':self.hr.index_ct_ll, 'dl':self.hr.index_ct_dl}
         for elem in names:
             if elem in spectra:
                 cl[elem] = {}
-                for name in names[elem]:
-                    cl[elem][name] = np.zeros(lmax+1, dtype=np.double)
+                for index, name in enumerate(names[elem]):
+                    cl[elem][name] = cl_table[:, first_index[elem]+index]
 
-        for elem in ['td', 'tl']:
-            if elem in spectra:
-                cl[elem] = np.zeros(lmax+1, dtype=np.double)
-
-        success = True
-        for ell from 2<=ell<lmax+1:
-            if harmonic_cl_at_l(&self.hr, ell, dcl, cl_md, cl_md_ic) == _FAILURE_:
-                success = False
-                break
-            if 'dd' in spectra:
-                for index, name in enumerate(names['dd']):
-                  cl['dd'][name][ell] = dcl[self.hr.index_ct_dd+index]
-            if 'll' in spectra:
-                for index, name in enumerate(names['ll']):
-                  cl['ll'][name][ell] = dcl[self.hr.index_ct_ll+index]
-            if 'dl' in spectra:
-                for index, name in enumerate(names['dl']):
-                  cl['dl'][name][ell] = dcl[self.hr.index_ct_dl+index]
-            if 'td' in spectra:
-                cl['td'][ell] = dcl[self.hr.index_ct_td]
-            if 'tl' in spectra:
-                cl['tl'][ell] = dcl[self.hr.index_ct_tl]
+        if 'td' in spectra:
+            cl['td'] = cl_table[:, self.hr.index_ct_td]
+        if 'tl' in spectra:
+            cl['tl'] = cl_table[:, self.hr.index_ct_tl]
         cl['ell'] = np.arange(lmax+1)
 
-        free(dcl)
-        for index_md in range(self.hr.md_size):
-            free(cl_md[index_md])
-            free(cl_md_ic[index_md])
-        free(cl_md)
-        free(cl_md_ic)
-
-        # This has to be delayed until AFTER freeing the memory
-        if not success:
-          raise CosmoSevereError(self.hr.error_message)
         return cl
 
     def z_of_r (self, z):
@@ -2554,6 +2664,9 @@ cdef class Class:
         if self.pt.k_output_values_num<1:
             return perturbations
 
+        if self.pt.stream_perturbations:
+            raise CosmoSevereError("The perturbations are not kept in memory when 'stream_perturbations' is set")
+
         cdef:
             Py_ssize_t j
             Py_ssize_t i
@@ -2678,6 +2791,51 @@ cdef class Class:
 
         return transfers
 
+    def get_timings(self):
+        """
+        get_timings()
+
+        Return the wall time, CPU time and counters of the last run of the
+        init function of each module. The counters are process-wide, and
+        all zero when CLASS was compiled without the flag _CLASS_STATS_.
+
+        Returns
+        -------
+        timings : dict
+                timings[module][name], with name 'wall_time', 'cpu_time' (in s),
+                'peak_rss' (increase of the peak resident set size of the
+                process, in bytes) or one of the counter names (e.g.
+                'ndf15_steps', 'allocated_bytes')
+        """
+        cdef class_stats * pstats
+        cdef int index_module, index
+        names = ['background','thermodynamics','perturbations','primordial','fourier',
+                 'transfer','harmonic','lensing','distortions']
+        timings = {}
+        for index_module in range(len(names)):
+            if index_module == 0:
+                pstats = &self.ba.stats
+            elif index_module == 1:
+                pstats = &self.th.stats
+            elif index_module == 2:
+                pstats = &self.pt.stats
+            elif index_module == 3:
+                pstats = &self.pm.stats
+            elif index_module == 4:
+                pstats = &self.fo.stats
+            elif index_module == 5:
+                pstats = &self.tr.stats
+            elif index_module == 6:
+                pstats = &self.hr.stats
+            elif index_module == 7:
+                pstats = &self.le.stats
+            else:
+                pstats = &self.sd.stats
+            timings[names[index_module]] = {'wall_time':pstats.wall_time, 'cpu_time':pstats.cpu_time, 'peak_rss':pstats.peak_rss}
+            for index in range(counter_size):
+                timings[names[index_module]][class_stats_counter_name(index).decode()] = pstats.counter[index]
+        return timings
+
     def get_current_derived_parameters(self, names):
         """
         get_current_derived_parameters(names)
@@ -3021,6 +3179,116 @@ make        nonlinear_scale_cb(z, z_size)
 
         return pk_cb
 
+    def get_pk_at_kvec_and_zvec(self, k, z, nonlinear=True, only_clustering_species=False):
+        """
+        Fast function to get the power spectrum on the dense grid of all
+        pairs (k,z), without python loops.
+
+        Parameters
+        ----------
+        k : array of wavenumbers in 1/Mpc, in arbitrary order
+        z : array of redshifts, in arbitrary order
+        nonlinear : bool
+                Whether the returned power spectrum values are linear or non-linear (default)
+        only_clustering_species : bool
+                Whether the returned power spectrum is for galaxy clustering and excludes massive neutrinos, or always includes everything (default)
+
+        Returns
+        -------
+        pk : grid of power spectrum values, pk[index_k,index_z] (zero for k outside of the computed range)
+        """
+        self.compute(["fourier"])
+
+        cdef np.ndarray[DTYPE_t, ndim=1] k_arr = np.ascontiguousarray(np.atleast_1d(k), dtype='float64')
+        cdef np.ndarray[DTYPE_t, ndim=1] z_arr = np.ascontiguousarray(np.atleast_1d(z), dtype='float64')
+        cdef np.ndarray[DTYPE_t, ndim=2] pk = np.empty((z_arr.shape[0],k_arr.shape[0]),'float64')
+        cdef int index_pk = self.fo.index_pk_cluster if only_clustering_species else self.fo.index_pk_total
+
+        if nonlinear and self.fo.method == nl_none:
+            raise CosmoSevereError("You ask classy to return a nonlinear power spectrum, but the input parameters do not specify a nonlinear method")
+
+        if fourier_pk_at_kvec_and_zvec(&self.ba, &self.fo, (pk_nonlinear if nonlinear else pk_linear), index_pk,
+                                       <double*> k_arr.data, k_arr.shape[0], <double*> z_arr.data, z_arr.shape[0],
+                                       <double*> pk.data) == _FAILURE_:
+            raise CosmoSevereError(self.fo.error_message)
+
+        return pk.T
+
+    def pk_grid(self, k, z, nonlinear=True, only_clustering_species=False, tilt=False, out=None, out_tilt=None):
+        """
+        pk_grid(k, z, nonlinear=True, only_clustering_species=False, tilt=False, out=None, out_tilt=None)
+
+        Power spectrum (and optionally its logarithmic slope) on the dense
+        grid of all pairs (k,z), in one C call made without the GIL. Meant
+        for likelihoods calling pk() in loops: the output buffers can be
+        allocated once and passed again at each call.
+
+        Parameters
+        ----------
+        k : array of wavenumbers in 1/Mpc, in arbitrary order
+        z : array of redshifts, in arbitrary order
+        nonlinear : bool
+                Whether the returned power spectrum values are linear or non-linear (default)
+        only_clustering_species : bool
+                Whether the returned power spectrum is for galaxy clustering and excludes massive neutrinos, or always includes everything (default)
+        tilt : bool
+                Whether to return also dln(P)/dln(k) on the same grid
+        out, out_tilt : arrays of shape (len(k),len(z)) in Fortran order, optional
+                Buffers for the results, e.g. the arrays returned by a
+                previous call, or np.empty((len(k),len(z)),order='F')
+
+        Returns
+        -------
+        pk : grid of power spectrum values, pk[index_k,index_z] (zero for k outside of the computed range)
+        pk, pk_tilt : if tilt is True (pk_tilt is zero for k outside of the computed range)
+        """
+        self.compute(["fourier"])
+
+        cdef np.ndarray[DTYPE_t, ndim=1] k_arr = np.ascontiguousarray(np.atleast_1d(k), dtype='float64')
+        cdef np.ndarray[DTYPE_t, ndim=1] z_arr = np.ascontiguousarray(np.atleast_1d(z), dtype='float64')
+        cdef int k_size = k_arr.shape[0]
+        cdef int z_size = z_arr.shape[0]
+        cdef int index_pk = self.fo.index_pk_cluster if only_clustering_species else self.fo.index_pk_total
+        cdef int pk_output = pk_nonlinear if nonlinear else pk_linear
+        cdef int status
+        cdef void * pba = &self.ba
+        cdef void * pfo = &self.fo
+        cdef double * k_ptr = <double*> k_arr.data
+        cdef double * z_ptr = <double*> z_arr.data
+        cdef double * pk_ptr
+        cdef double * tilt_ptr = NULL
+        cdef double[:,::1] pk_mv
+        cdef double[:,::1] tilt_mv
+
+        if nonlinear and self.fo.method == nl_none:
+            raise CosmoSevereError("You ask classy to return a nonlinear power spectrum, but the input parameters do not specify a nonlinear method")
+
+        # The C function fills arrays [index_z][index_k]: the buffers are
+        # their transposes, i.e. (k,z) arrays in Fortran order
+        for arr, name in ((out, "out"), (out_tilt if tilt else None, "out_tilt")):
+            if arr is not None and (arr.shape != (k_size, z_size) or arr.dtype != np.float64 or not arr.T.flags.c_contiguous):
+                raise CosmoSevereError("%s must be a float64 array of shape (%d,%d) in Fortran order" % (name, k_size, z_size))
+
+        pk_T = np.empty((z_size, k_size), dtype='float64') if out is None else out.T
+        pk_mv = pk_T
+        pk_ptr = &pk_mv[0,0] if (k_size > 0 and z_size > 0) else NULL
+        if tilt:
+            tilt_T = np.empty((z_size, k_size), dtype='float64') if out_tilt is None else out_tilt.T
+            tilt_mv = tilt_T
+            tilt_ptr = &tilt_mv[0,0] if (k_size > 0 and z_size > 0) else NULL
+
+        if k_size > 0 and z_size > 0:
+            with nogil:
+                status = fourier_pk_and_tilt_at_kvec_and_zvec(pba, pfo, pk_output, index_pk,
+                                                              k_ptr, k_size, z_ptr, z_size,
+                                                              pk_ptr, tilt_ptr)
+            if status == _FAILURE_:
+                raise CosmoSevereError(self.fo.error_message)
+
+        if tilt:
+            return pk_T.T, tilt_T.T
+        return pk_T.T
+
     def Omega0_k(self):
         """ Curvature contribution """
         return self.ba.Omega0_k
@@ -3073,6 +3341,7 @@ make        nonlinear_scale_cb(z, z_size)
             int tau_size = self.pt.tau_size;
             int tp_size = self.pt.tp_size[index_md];
             double *** sources_ptr = self.pt.sources;
+            float *** sources_float_ptr = self.pt.sources_float;
             double [:,:] tmparray = np.zeros((k_size, tau_size)) ;
             double [:] k_array = np.zeros(k_size);
             double [:] tau_array = np.zeros(tau_size);
@@ -3221,7 +3490,10 @@ make        nonlinear_scale_cb(z, z_size)
             tmparray = np.empty((k_size,tau_size))
             for index_k in range(k_size):
                 for index_tau in range(tau_size):
-                    tmparray[index_k][index_tau] = sources_ptr[index_md][index_ic*tp_size+index_type][index_tau*k_size + index_k];
+                    if self.pt.storage == sources_storage_float:
+                        tmparray[index_k][index_tau] = sources_float_ptr[index_md][index_ic*tp_size+index_type][index_tau*k_size + index_k];
+                    else:
+                        tmparray[index_k][index_tau] = sources_ptr[index_md][index_ic*tp_size+index_type][index_tau*k_size + index_k];
 
             sources[name] = np.asarray(tmparray)
 
@@ -241,10 +241,30 @@ int background_at_tau(
   /** - define local variables */
   double z;
 
-  /** - Get current redshift */
-  class_call(background_z_of_tau(pba,tau,&z),
-             pba->error_message,
-             pba->error_message);
+  /** - Get current redshift. The rows of tau_table and loga_table
+      coincide: in closeby mode, the index of the previous call is
+      used as a starting point to find tau, like it is for log(a)
+      below, instead of a bisection over the full table */
+  if (inter_mode == inter_closeby) {
+    class_call(array_interpolate_spline_growing_closeby(
+                                                        pba->tau_table,
+                                                        pba->bt_size,
+                                                        pba->z_table,
+                                                        pba->d2z_dtau2_table,
+                                                        1,
+                                                        tau,
+                                                        last_index,
+                                                        &z,
+                                                        1,
+                                                        pba->error_message),
+               pba->error_message,
+               pba->error_message);
+  }
+  else {
+    class_call(background_z_of_tau(pba,tau,&z),
+               pba->error_message,
+               pba->error_message);
+  }
 
   /** - Get background at corresponding redshift */
   class_call(background_at_z(pba,z,return_format,inter_mode,last_index,pvecback),
@@ -304,6 +324,71 @@ int background_tau_of_z(
 
   return _SUCCESS_;
 }
+
+/**
+ * Conformal time at each redshift of a sorted array.
+ *
+ * Same as calling background_tau_of_z() for each element, but the
+ * interval of the pre-computed table containing each redshift is
+ * found by stepping from the one of the previous redshift, instead
+ * of a bisection over the full table.
+ *
+ * @param pba    Input: pointer to background structure
+ * @param z      Input: array of redshifts, in increasing or decreasing order
+ * @param z_size Input: size of the array
+ * @param tau    Output: array of conformal times (already allocated, same size)
+ * @return the error status
+ */
+
+int background_tau_of_z_array(
+                              struct background *pba,
+                              double * z,
+                              int z_size,
+                              double * tau
+                              ) {
+
+  int index_z, inf, sup;
+  double h, a, b;
+
+  if (z_size < 1)
+    return _SUCCESS_;
+
+  /** - check that the whole array is in the pre-computed range */
+  class_test((MIN(z[0],z[z_size-1]) < pba->z_table[pba->bt_size-1]),
+             pba->error_message,
+             "out of range: z=%e < z_min=%e\n",MIN(z[0],z[z_size-1]),pba->z_table[pba->bt_size-1]);
+
+  class_test((MAX(z[0],z[z_size-1]) > pba->z_table[0]),
+             pba->error_message,
+             "out of range: z=%e > z_max=%e\n",MAX(z[0],z[z_size-1]),pba->z_table[0]);
+
+  /** - pba->z_table is in decreasing order: for each z, find inf
+      such that z_table[inf] >= z > z_table[inf+1], as the bisection
+      of array_interpolate_spline() does, and use the same
+      interpolation formula */
+  inf = 0;
+  for (index_z=0; index_z<z_size; index_z++) {
+
+    while ((inf > 0) && (z[index_z] > pba->z_table[inf]))
+      inf--;
+    while ((inf < pba->bt_size-2) && (z[index_z] <= pba->z_table[inf+1]))
+      inf++;
+    sup = inf+1;
+
+    h = pba->z_table[sup] - pba->z_table[inf];
+    b = (z[index_z]-pba->z_table[inf])/h;
+    a = 1-b;
+
+    tau[index_z] =
+      a * pba->tau_table[inf] +
+      b * pba->tau_table[sup] +
+      ((a*a*a-a) * pba->d2tau_dz2_table[inf] +
+       (b*b*b-b) * pba->d2tau_dz2_table[sup])*h*h/6.;
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Redshift at given conformal time.
  *
@@ -391,7 +476,7 @@ int background_functions(
   /* total non-relativistic density */
   double rho_m;
   /* background ncdm quantities */
-  double rho_ncdm,p_ncdm,pseudo_p_ncdm;
+  double rho_ncdm,p_ncdm,pseudo_p_ncdm,loga;
   /* index for n_ncdm species */
   int n_ncdm;
   /* fluid's time-dependent equation of state parameter */
@@ -452,68 +537,19 @@ int background_functions(
 /*----------------------------------------------------------------------------------------------------------------------*/
 
 if(pba->has_UG == _TRUE_){
-  double rho_dm0 = pba->Omega0_cdm*pow(pba->H0,2.);
-  double rho_b0 = pba->Omega0_b*pow(pba->H0,2.);
-  double delta = pba->delta;
-  double F_1;
-  double F;
-
-
-
-/* densities are all expressed in units of \f$ [3c^2/8\pi G] \f$, ie
-      \f$ \rho_{class} = [8 \pi G \rho_{physical} / 3 c^2]\f$ */
-  
-  double Delta_rho =pba->Delta_rho_Lambda*pow(100,2)/pow((_c_/1000),2);
-  double a_start = pba->a_start;
-  double rho_lambda = pba->Omega0_lambda*pow(pba->H0,2.);
-  double Model= pba->model;
-
-/* for a ---(a_rad, a_start-delta/2) */
-  if (Model==1){
-    if(a<= a_start-delta/2 ){
-    
-        
-      // Baryonic density
-      pvecback[pba->index_bg_rho_b]= (rho_b0 + (rho_b0/(rho_b0+rho_dm0))*Delta_rho*(pow(a_start,3)+a_start*pow(delta,2)/4))/pow(a,3) ;
-      // Dark matter density 
-      pvecback[pba->index_bg_rho_cdm]= (rho_dm0 + (rho_dm0/(rho_b0+rho_dm0))*Delta_rho*(pow(a_start,3)+a_start*pow(delta,2)/4))/pow(a,3);
-      // Cosmological "constant"
-      pvecback[pba->index_bg_rho_lambda]= rho_lambda-Delta_rho ;
-  
-    }
-   
-  /*for a ---(a_rad-delta, a_start+delta/2)  */
-    if(a>a_start-delta/2 && a<a_start+delta/2  ){
-      // Baryonic density
-      pvecback[pba->index_bg_rho_b]= (rho_b0 + (rho_b0/(rho_b0+rho_dm0))*Delta_rho*(pow(a_start,3)+a_start*pow(delta,2)/4))/pow(a,3)- (rho_b0/(rho_b0+rho_dm0))*(Delta_rho/(4*delta))*(a-pow((a_start-delta/2),4)/pow(a,3));
-      // Dark matter density  
-      pvecback[pba->index_bg_rho_cdm]= (rho_dm0 + (rho_dm0/(rho_b0+rho_dm0))*Delta_rho*(pow(a_start,3)+a_start*pow(delta,2)/4))/pow(a,3)- (rho_dm0/(rho_b0+rho_dm0))*(Delta_rho/(4*delta))*(a-pow(a_start-delta/2,4)/pow(a,3));
-      // Cosmological density 
-      pvecback[pba->index_bg_rho_lambda]= rho_lambda + Delta_rho*((a-a_start+delta/2)/delta-1) ;
-  }
-
-/*for a ---(a_start+delta/2, a_0)  */
-    if(a>=a_start+delta/2 ){
-      // Baryonic density
-      pvecback[pba->index_bg_rho_b]= rho_b0/pow(a,3);
-      // Dark matter density  
-      pvecback[pba->index_bg_rho_cdm]= rho_dm0/pow(a,3);
-      // Cosmological density 
-      pvecback[pba->index_bg_rho_lambda]= rho_lambda;
-  
-  }
-  }
 
-if (Model==2){
+  /* densities are all expressed in units of \f$ [3c^2/8\pi G] \f$, ie
+      \f$ \rho_{class} = [8 \pi G \rho_{physical} / 3 c^2]\f$ ; the
+      a-independent constants are cached in pba->UG */
+  class_call(background_UG_densities(pba,
+                                     &a,
+                                     1,
+                                     &(pvecback[pba->index_bg_rho_b]),
+                                     &(pvecback[pba->index_bg_rho_cdm]),
+                                     &(pvecback[pba->index_bg_rho_lambda])),
+             pba->error_message,
+             pba->error_message);
 
-  F=-(Delta_rho/(2*_PI_))*pow(delta,3)*((a/delta)*(4*a_start+a)/delta-2*(a_start/delta)*(-3+pow(a_start/delta,2))*atan((a_start-a)/delta)+(-1+3*pow(a_start/delta,2))*log(1+pow((a_start-a)/delta,2)));
-  F_1=-(Delta_rho/(2*_PI_))*pow(delta,3)*((1/delta)*(4*a_start+1)/delta-2*(a_start/delta)*(-3+pow(a_start/delta,2))*atan((a_start-1)/delta)+(-1+3*pow(a_start/delta,2))*log(1+pow((a_start-1)/delta,2)));
-  
-  pvecback[pba->index_bg_rho_b]= (rho_b0-(rho_b0/(rho_b0+rho_dm0))*F_1)/pow(a,3)+(rho_b0/(rho_b0+rho_dm0))*F/pow(a,3);           
-  pvecback[pba->index_bg_rho_cdm]=(rho_dm0-(1-(rho_b0/(rho_b0+rho_dm0)))*F_1)/pow(a,3)+(rho_dm0/(rho_b0+rho_dm0))*F/pow(a,3) ;
-  pvecback[pba->index_bg_rho_lambda]= rho_lambda+ ((Delta_rho)/_PI_)*(atan((a-a_start)/delta)-atan((1-a_start)/delta));
-}
-    
     rho_tot += pvecback[pba->index_bg_rho_cdm];
     p_tot += 0.;
     rho_m += pvecback[pba->index_bg_rho_cdm];
@@ -593,23 +629,20 @@ fclose(fptr); */
   /* ncdm */
   if (pba->has_ncdm == _TRUE_) {
 
+    loga = log(a);
+
     /* Loop over species: */
     for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
 
-      /* function returning background ncdm[n_ncdm] quantities (only
-         those for which non-NULL pointers are passed) */
-      class_call(background_ncdm_momenta(
-                                         pba->q_ncdm_bg[n_ncdm],
-                                         pba->w_ncdm_bg[n_ncdm],
-                                         pba->q_size_ncdm_bg[n_ncdm],
-                                         pba->M_ncdm[n_ncdm],
-                                         pba->factor_ncdm[n_ncdm],
-                                         1./a-1.,
-                                         NULL,
-                                         &rho_ncdm,
-                                         &p_ncdm,
-                                         NULL,
-                                         &pseudo_p_ncdm),
+      /* function returning background ncdm[n_ncdm] quantities, from
+         the table of background_ncdm_tabulate() if possible */
+      class_call(background_ncdm_at_a(pba,
+                                      n_ncdm,
+                                      a,
+                                      loga,
+                                      &rho_ncdm,
+                                      &p_ncdm,
+                                      &pseudo_p_ncdm),
                  pba->error_message,
                  pba->error_message);
 
@@ -717,17 +750,8 @@ fclose(fptr); */
     /** - compute Omega_m */
     pvecback[pba->index_bg_Omega_m] = rho_m / rho_crit;
 
-    /** - cosmological time */
-    pvecback[pba->index_bg_time] = pvecback_B[pba->index_bi_time];
-
-    /** - comoving sound horizon */
-    pvecback[pba->index_bg_rs] = pvecback_B[pba->index_bi_rs];
-
-    /** - growth factor */
-    pvecback[pba->index_bg_D] = pvecback_B[pba->index_bi_D];
-
-    /** - velocity growth factor */
-    pvecback[pba->index_bg_f] = pvecback_B[pba->index_bi_D_prime]/( pvecback_B[pba->index_bi_D]*a*pvecback[pba->index_bg_H]);
+    /** - cosmological time, comoving sound horizon, growth factors */
+    background_functions_of_integrated(pba,a,pvecback_B,pvecback);
 
     /**- Varying fundamental constants */
     if (pba->has_varconst == _TRUE_) {
@@ -750,6 +774,188 @@ fclose(fptr); */
 
 }
 
+/**
+ * Copy into a vector of background quantities in long format the
+ * quantities that are directly given by the integrated variables {B}
+ * (time, sound horizon, growth factor and growth rate). Called by
+ * background_functions(), and by background_solve_UG_quadrature()
+ * to update a table line once the integrated variables are known.
+ *
+ * @param pba        Input: pointer to background structure
+ * @param a          Input: scale factor
+ * @param pvecback_B Input: vector of integrated quantities (with index_bi)
+ * @param pvecback   Input/Output: vector of background quantities, with H already filled
+ */
+
+void background_functions_of_integrated(
+                                        struct background *pba,
+                                        double a,
+                                        double * pvecback_B,
+                                        double * pvecback
+                                        ) {
+
+  /** - cosmological time */
+  pvecback[pba->index_bg_time] = pvecback_B[pba->index_bi_time];
+
+  /** - comoving sound horizon */
+  pvecback[pba->index_bg_rs] = pvecback_B[pba->index_bi_rs];
+
+  /** - growth factor */
+  pvecback[pba->index_bg_D] = pvecback_B[pba->index_bi_D];
+
+  /** - velocity growth factor */
+  pvecback[pba->index_bg_f] = pvecback_B[pba->index_bi_D_prime]/( pvecback_B[pba->index_bi_D]*a*pvecback[pba->index_bg_H]);
+}
+
+/**
+ * Energy F(a) transferred to matter in UG model 2, up to the
+ * normalisation to F(1) applied in background_UG_densities().
+ */
+
+static double background_UG_F(
+                              struct background_UG_cache * pug,
+                              double a
+                              ) {
+  return pug->F_norm*((a/pug->delta)*(4*pug->a_start+a)/pug->delta
+                      - pug->F_atan*atan((pug->a_start-a)/pug->delta)
+                      + pug->F_log*log(1+pow((pug->a_start-a)/pug->delta,2)));
+}
+
+/**
+ * Fill the cache of a-independent constants entering the
+ * unimodular-gravity (UG) densities, so that background_functions()
+ * does not recompute them (and, for model 2, the whole F(a=1)) at
+ * each call. Must be called after background_indices(), once
+ * Omega0_lambda is known.
+ *
+ * @param pba Input/Output: pointer to background structure
+ * @return the error status
+ */
+
+int background_UG_constants(
+                            struct background *pba
+                            ) {
+
+  struct background_UG_cache * pug = &(pba->UG);
+  double rho_m0;
+
+  if (pba->has_UG == _FALSE_)
+    return _SUCCESS_;
+
+  pug->rho_b0 = pba->Omega0_b*pow(pba->H0,2.);
+  pug->rho_dm0 = pba->Omega0_cdm*pow(pba->H0,2.);
+  pug->rho_lambda = pba->Omega0_lambda*pow(pba->H0,2.);
+  pug->Delta_rho = pba->Delta_rho_Lambda*pow(100,2)/pow((_c_/1000),2);
+  pug->a_start = pba->a_start;
+  pug->delta = pba->delta;
+
+  rho_m0 = pug->rho_b0+pug->rho_dm0;
+  class_test(rho_m0 <= 0.,
+             pba->error_message,
+             "UG energy transfer requires Omega0_b+Omega0_cdm > 0");
+  pug->f_b = pug->rho_b0/rho_m0;
+  pug->f_dm = pug->rho_dm0/rho_m0;
+
+  /* model 1 */
+  pug->a_minus = pug->a_start-pug->delta/2;
+  pug->a_plus = pug->a_start+pug->delta/2;
+  pug->a_minus4 = pow(pug->a_minus,4);
+  pug->rho_b_early = pug->rho_b0 + pug->f_b*pug->Delta_rho*(pow(pug->a_start,3)+pug->a_start*pow(pug->delta,2)/4);
+  pug->rho_dm_early = pug->rho_dm0 + pug->f_dm*pug->Delta_rho*(pow(pug->a_start,3)+pug->a_start*pow(pug->delta,2)/4);
+  pug->slope_b = pug->f_b*(pug->Delta_rho/(4*pug->delta));
+  pug->slope_dm = pug->f_dm*(pug->Delta_rho/(4*pug->delta));
+
+  /* model 2 */
+  pug->F_norm = -(pug->Delta_rho/(2*_PI_))*pow(pug->delta,3);
+  pug->F_atan = 2*(pug->a_start/pug->delta)*(-3+pow(pug->a_start/pug->delta,2));
+  pug->F_log = (-1+3*pow(pug->a_start/pug->delta,2));
+  pug->lambda_norm = (pug->Delta_rho)/_PI_;
+  pug->atan_today = atan((1-pug->a_start)/pug->delta);
+
+  if (pba->model == 2) {
+    double F_1 = background_UG_F(pug,1.);
+    pug->rho_b_shift = pug->rho_b0-pug->f_b*F_1;
+    pug->rho_dm_shift = pug->rho_dm0-(1-pug->f_b)*F_1;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Evaluate the UG baryon, cdm and cosmological-constant densities
+ * for an array of scale factors, using the constants cached by
+ * background_UG_constants(). background_functions() calls it with
+ * a_size=1; callers needing many values of a at once can avoid the
+ * per-point overhead of background_functions().
+ *
+ * @param pba        Input: pointer to background structure
+ * @param a          Input: array of scale factors
+ * @param a_size     Input: number of scale factors
+ * @param rho_b      Output: baryon densities (array of size a_size)
+ * @param rho_cdm    Output: cdm densities
+ * @param rho_lambda Output: cosmological-constant densities
+ * @return the error status
+ */
+
+int background_UG_densities(
+                            struct background *pba,
+                            double * a,
+                            int a_size,
+                            double * rho_b,
+                            double * rho_cdm,
+                            double * rho_lambda
+                            ) {
+
+  struct background_UG_cache * pug = &(pba->UG);
+  double a_i, a3, F;
+  int i;
+
+  switch (pba->model) {
+
+  case 1:
+    for (i=0; i<a_size; i++) {
+      a_i = a[i];
+      a3 = pow(a_i,3);
+      /* for a in (a_rad, a_start-delta/2) */
+      if (a_i <= pug->a_minus) {
+        rho_b[i] = pug->rho_b_early/a3;
+        rho_cdm[i] = pug->rho_dm_early/a3;
+        rho_lambda[i] = pug->rho_lambda-pug->Delta_rho;
+      }
+      /* for a in (a_start-delta/2, a_start+delta/2) */
+      else if (a_i < pug->a_plus) {
+        rho_b[i] = pug->rho_b_early/a3 - pug->slope_b*(a_i-pug->a_minus4/a3);
+        rho_cdm[i] = pug->rho_dm_early/a3 - pug->slope_dm*(a_i-pug->a_minus4/a3);
+        rho_lambda[i] = pug->rho_lambda + pug->Delta_rho*((a_i-pug->a_start+pug->delta/2)/pug->delta-1);
+      }
+      /* for a in (a_start+delta/2, a_0) */
+      else {
+        rho_b[i] = pug->rho_b0/a3;
+        rho_cdm[i] = pug->rho_dm0/a3;
+        rho_lambda[i] = pug->rho_lambda;
+      }
+    }
+    break;
+
+  case 2:
+    for (i=0; i<a_size; i++) {
+      a_i = a[i];
+      a3 = pow(a_i,3);
+      F = background_UG_F(pug,a_i);
+      rho_b[i] = pug->rho_b_shift/a3+pug->f_b*F/a3;
+      rho_cdm[i] = pug->rho_dm_shift/a3+pug->f_dm*F/a3;
+      rho_lambda[i] = pug->rho_lambda+pug->lambda_norm*(atan((a_i-pug->a_start)/pug->delta)-pug->atan_today);
+    }
+    break;
+
+  default:
+    class_stop(pba->error_message,
+               "UG model=%d not understood, choose 1 or 2",pba->model);
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Single place where the fluid equation of state is
  * defined. Parameters of the function are passed through the
@@ -912,6 +1118,9 @@ int background_init(
 
   /** Summary: */
 
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(pba->stats));
+
   /** - write class version */
   if (pba->background_verbose > 0) {
     printf("Running CLASS version %s\n",_VERSION_);
@@ -929,6 +1138,16 @@ int background_init(
              pba->error_message,
              pba->error_message);
 
+  /** - precompute the a-independent constants of the UG densities */
+  class_call(background_UG_constants(pba),
+             pba->error_message,
+             pba->error_message);
+
+  /** - tabulate the momentum sums of the ncdm species */
+  class_call(background_ncdm_tabulate(ppr,pba),
+             pba->error_message,
+             pba->error_message);
+
   /** - check that input parameters make sense and write additional information about them */
   class_call(background_checks(ppr,pba),
              pba->error_message,
@@ -951,6 +1170,8 @@ int background_init(
 
   pba->is_allocated = _TRUE_;
 
+  class_timer_end(&(pba->stats));
+
   return _SUCCESS_;
 
 }
@@ -992,6 +1213,8 @@ int background_free_noinput(
                             struct background *pba
                             ) {
 
+  int n_ncdm;
+
   free(pba->tau_table);
   free(pba->z_table);
   free(pba->loga_table);
@@ -1000,6 +1223,17 @@ int background_free_noinput(
   free(pba->background_table);
   free(pba->d2background_dloga2_table);
 
+  if (pba->ncdm_bg_table != NULL) {
+    for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+      free(pba->ncdm_bg_table[n_ncdm]);
+      free(pba->ncdm_bg_table_dd[n_ncdm]);
+    }
+    free(pba->ncdm_bg_table);
+    free(pba->ncdm_bg_table_dd);
+    pba->ncdm_bg_table = NULL;
+    pba->ncdm_bg_table_dd = NULL;
+  }
+
   return _SUCCESS_;
 }
 /**
@@ -1491,10 +1725,10 @@ int background_ncdm_init(
                          struct background *pba
                          ) {
 
-  int index_q, k,tolexp,row,status,filenum;
-  double f0m2,f0m1,f0,f0p1,f0p2,dq,q,df0dq,tmp1,tmp2;
+  int index_q, k,tolexp,filenum;
+  double f0m2,f0m1,f0,f0p1,f0p2,dq,q,df0dq;
   struct background_parameters_for_distributions pbadist;
-  FILE *psdfile;
+  struct data_file * pdf;
 
   pbadist.pba = pba;
 
@@ -1516,26 +1750,24 @@ int background_ncdm_init(
     pbadist.tablesize = 0;
     /*Do we need to read in a file to interpolate the distribution function? */
     if ((pba->got_files!=NULL)&&(pba->got_files[k]==_TRUE_)) {
-      psdfile = fopen(pba->ncdm_psd_files+filenum*_ARGUMENT_LENGTH_MAX_,"r");
-      class_test(psdfile == NULL,pba->error_message,
-                 "Could not open file %s!",pba->ncdm_psd_files+filenum*_ARGUMENT_LENGTH_MAX_);
-      // Find size of table:
-      for (row=0,status=2; status==2; row++) {
-        status = fscanf(psdfile,"%lf %lf",&tmp1,&tmp2);
-      }
-      rewind(psdfile);
-      pbadist.tablesize = row-1;
+      /* the file is parsed once per process, see data_file_get() */
+      class_call(data_file_get(pba->ncdm_psd_files+filenum*_ARGUMENT_LENGTH_MAX_,
+                               data_file_columns,
+                               2,
+                               ppr->data_binary_files,
+                               &pdf,
+                               pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+      pbadist.tablesize = pdf->rows;
 
       /*Allocate room for interpolation table: */
       class_alloc(pbadist.q,sizeof(double)*pbadist.tablesize,pba->error_message);
       class_alloc(pbadist.f0,sizeof(double)*pbadist.tablesize,pba->error_message);
       class_alloc(pbadist.d2f0,sizeof(double)*pbadist.tablesize,pba->error_message);
-      for (row=0; row<pbadist.tablesize; row++) {
-        status = fscanf(psdfile,"%lf %lf",
-                        &pbadist.q[row],&pbadist.f0[row]);
-        //        printf("(q,f0) = (%g,%g)\n",pbadist.q[row],pbadist.f0[row]);
-      }
-      fclose(psdfile);
+      memcpy(pbadist.q,pdf->data,sizeof(double)*pbadist.tablesize);
+      memcpy(pbadist.f0,pdf->data+pdf->rows,sizeof(double)*pbadist.tablesize);
+      data_file_release(pdf);
       /* Call spline interpolation: */
       class_call(array_spline_table_lines(pbadist.q,
                                           pbadist.tablesize,
@@ -1777,6 +2009,168 @@ int background_ncdm_momenta(
   return _SUCCESS_;
 }
 
+/**
+ * Tabulate the momentum sums giving the density, pressure and
+ * pseudo-pressure of each ncdm species (background_ncdm_momenta()),
+ * which only depend on a once the masses and normalisations are
+ * known, such that background_functions() can interpolate them
+ * instead of summing over the momenta at each call. The table is
+ * uniform in log(a), with step ppr->background_ncdm_table_dloga,
+ * from a hundredth of ppr->a_ini_over_a_today_default to today, and
+ * the quantities are tabulated over factor_ncdm/a^4, i.e. as smooth
+ * functions of the ratio of mass to temperature. It is not built if
+ * ppr->background_ncdm_table is _FALSE_.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input/Output: pointer to background structure
+ * @return the error status
+ */
+
+int background_ncdm_tabulate(
+                             struct precision *ppr,
+                             struct background *pba
+                             ) {
+
+  int n_ncdm,index_loga;
+  double a;
+  double * loga_table;
+  double * table;
+
+  pba->ncdm_bg_table_size = 0;
+  pba->ncdm_bg_table = NULL;
+  pba->ncdm_bg_table_dd = NULL;
+
+  if ((pba->has_ncdm == _FALSE_) || (ppr->background_ncdm_table == _FALSE_))
+    return _SUCCESS_;
+
+  class_test(ppr->background_ncdm_table_dloga <= 0.,
+             pba->error_message,
+             "background_ncdm_table_dloga=%e should be positive",ppr->background_ncdm_table_dloga);
+
+  pba->ncdm_bg_table_dloga = ppr->background_ncdm_table_dloga;
+  pba->ncdm_bg_table_loga_min = log(ppr->a_ini_over_a_today_default/100.);
+  pba->ncdm_bg_table_size = (int)ceil(-pba->ncdm_bg_table_loga_min/pba->ncdm_bg_table_dloga)+2;
+
+  class_alloc(loga_table,pba->ncdm_bg_table_size*sizeof(double),pba->error_message);
+  for (index_loga=0; index_loga<pba->ncdm_bg_table_size; index_loga++)
+    loga_table[index_loga] = pba->ncdm_bg_table_loga_min+index_loga*pba->ncdm_bg_table_dloga;
+
+  class_alloc(pba->ncdm_bg_table,pba->N_ncdm*sizeof(double*),pba->error_message);
+  class_alloc(pba->ncdm_bg_table_dd,pba->N_ncdm*sizeof(double*),pba->error_message);
+
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+
+    class_alloc(pba->ncdm_bg_table[n_ncdm],3*pba->ncdm_bg_table_size*sizeof(double),pba->error_message);
+    class_alloc(pba->ncdm_bg_table_dd[n_ncdm],3*pba->ncdm_bg_table_size*sizeof(double),pba->error_message);
+    table = pba->ncdm_bg_table[n_ncdm];
+
+    for (index_loga=0; index_loga<pba->ncdm_bg_table_size; index_loga++) {
+
+      a = exp(loga_table[index_loga]);
+
+      /* with the normalisation a^4, the sums do not contain factor_ncdm/a^4 */
+      class_call(background_ncdm_momenta(pba->q_ncdm_bg[n_ncdm],
+                                         pba->w_ncdm_bg[n_ncdm],
+                                         pba->q_size_ncdm_bg[n_ncdm],
+                                         pba->M_ncdm[n_ncdm],
+                                         pow(a,4),
+                                         1./a-1.,
+                                         NULL,
+                                         table+3*index_loga,
+                                         table+3*index_loga+1,
+                                         NULL,
+                                         table+3*index_loga+2),
+                 pba->error_message,
+                 pba->error_message);
+    }
+
+    class_call(array_spline_table_lines(loga_table,
+                                        pba->ncdm_bg_table_size,
+                                        table,
+                                        3,
+                                        pba->ncdm_bg_table_dd[n_ncdm],
+                                        _SPLINE_EST_DERIV_,
+                                        pba->error_message),
+               pba->error_message,
+               pba->error_message);
+  }
+
+  free(loga_table);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Density, pressure and pseudo-pressure of an ncdm species at scale
+ * factor a: interpolated in the table of background_ncdm_tabulate()
+ * when a is inside it, and summed over the momenta by
+ * background_ncdm_momenta() otherwise.
+ *
+ * @param pba      Input: pointer to background structure
+ * @param n_ncdm   Input: index of the species
+ * @param a        Input: scale factor
+ * @param loga     Input: its logarithm
+ * @param rho      Output: density
+ * @param p        Output: pressure
+ * @param pseudo_p Output: pseudo-pressure
+ * @return the error status
+ */
+
+int background_ncdm_at_a(
+                         struct background *pba,
+                         int n_ncdm,
+                         double a,
+                         double loga,
+                         double * rho,
+                         double * p,
+                         double * pseudo_p
+                         ) {
+
+  double x,b,factor;
+  double result[3];
+  int index_loga;
+
+  x = (loga-pba->ncdm_bg_table_loga_min)/pba->ncdm_bg_table_dloga;
+
+  if ((pba->ncdm_bg_table_size == 0) || (x < 0.) || (x >= pba->ncdm_bg_table_size-1)) {
+    class_call(background_ncdm_momenta(pba->q_ncdm_bg[n_ncdm],
+                                       pba->w_ncdm_bg[n_ncdm],
+                                       pba->q_size_ncdm_bg[n_ncdm],
+                                       pba->M_ncdm[n_ncdm],
+                                       pba->factor_ncdm[n_ncdm],
+                                       1./a-1.,
+                                       NULL,
+                                       rho,
+                                       p,
+                                       NULL,
+                                       pseudo_p),
+               pba->error_message,
+               pba->error_message);
+    return _SUCCESS_;
+  }
+
+  index_loga = (int)x;
+  b = x-index_loga;
+
+  array_spline_eval_columns(pba->ncdm_bg_table[n_ncdm],
+                            pba->ncdm_bg_table_dd[n_ncdm],
+                            3,
+                            index_loga,
+                            pba->ncdm_bg_table_dloga,
+                            1.-b,
+                            b,
+                            NULL,
+                            result,
+                            3);
+
+  factor = pba->factor_ncdm[n_ncdm]/pow(a,4);
+  *rho = factor*result[0];
+  *p = factor*result[1];
+  *pseudo_p = factor*result[2];
+
+  return _SUCCESS_;
+}
+
 /**
  * When the user passed the density fraction Omega_ncdm or
  * omega_ncdm in input but not the mass, infer the mass with Newton iteration method.
@@ -2023,14 +2417,22 @@ int background_solve(
   int index_loga, index_scf;
   /* what parameters are used in the output? */
   int * used_in_output;
+  /* table filled by quadrature instead of the evolver? */
+  short use_quadrature;
 
   /* index of ncdm species */
   int n_ncdm;
 
+  /* table with the breakpoints added, and last line of each integration between them */
+  double * loga_table;
+  int index_break, index_segment, index_loga_first, index_loga_new, segment_size;
+  int index_loga_end[_MAX_BACKGROUND_BREAKPOINTS_+1];
+
   /** - setup background workspace */
   bpaw.pba = pba;
   class_alloc(pvecback,pba->bg_size*sizeof(double),pba->error_message);
   bpaw.pvecback = pvecback;
+  bpaw.index_loga_offset = 0;
 
   /** - allocate vector of quantities to be integrated */
   class_alloc(pvecback_integration,pba->bi_size*sizeof(double),pba->error_message);
@@ -2042,12 +2444,91 @@ int background_solve(
 
   /** - Determine output vector */
   loga_final = 0.; // with our conventions, loga is in fact log(a/a_0); we integrate until today, when log(a/a_0) = 0
-  pba->bt_size = ppr->background_Nloga;
+
+  /** - in the pure UG case, if requested, the table will be filled by
+      direct quadrature on the sampling grid; otherwise, choose the
+      right evolver */
+  use_quadrature = ((ppr->background_UG_quadrature == _TRUE_) &&
+                    (pba->has_UG == _TRUE_) &&
+                    (pba->has_ncdm == _FALSE_) &&
+                    (pba->has_scf == _FALSE_) &&
+                    (pba->has_dcdm == _FALSE_) &&
+                    (pba->has_fld == _FALSE_));
+
+  if (use_quadrature == _TRUE_) {
+    if (pba->background_verbose > 1) {
+      printf("%s\n", "Chose UG quadrature instead of generic_evolver");
+    }
+  }
+  else {
+    switch (ppr->background_evolver) {
+
+    case rk:
+      generic_evolver = evolver_rk;
+      if (pba->background_verbose > 1) {
+        printf("%s\n", "Chose rk as generic_evolver");
+      }
+      break;
+
+    case ndf15:
+      generic_evolver = evolver_ndf15;
+      if (pba->background_verbose > 1) {
+        printf("%s\n", "Chose ndf15 as generic_evolver");
+      }
+      break;
+    }
+  }
+
+  /** - define values of loga at which results will be stored: if
+      requested, and unless the quadrature (which needs a uniform
+      grid) is used, placed by background_table_sampling() according
+      to the interpolation error; otherwise uniformly in loga */
+  if ((ppr->background_table_adaptive == _TRUE_) && (use_quadrature == _FALSE_)) {
+    class_call(background_table_sampling(ppr,pba,generic_evolver,loga_ini,loga_final,pvecback_integration),
+               pba->error_message,
+               pba->error_message);
+  }
+  else {
+    pba->bt_size = ppr->background_Nloga;
+    class_alloc(pba->loga_table,pba->bt_size * sizeof(double),pba->error_message);
+    for (index_loga=0; index_loga<pba->bt_size; index_loga++) {
+      pba->loga_table[index_loga] = loga_ini + index_loga*(loga_final-loga_ini)/(pba->bt_size-1);
+    }
+  }
+
+  /** - if requested, add a line to the table at each breakpoint of
+      the background (see background_breakpoints()), unless it is
+      already one of its values; the integration is then split at
+      these lines, and the splines of the table have a node at each
+      kink of the densities, while the other lines keep their place */
+  class_call(background_breakpoints(pba,loga_ini,loga_final),
+             pba->error_message,
+             pba->error_message);
+
+  segment_size = 0;
+  if ((ppr->background_split_at_breakpoints == _TRUE_) && (pba->loga_break_size > 0)) {
+    class_alloc(loga_table,(pba->bt_size+pba->loga_break_size)*sizeof(double),pba->error_message);
+    index_loga_new = 0;
+    index_break = 0;
+    for (index_loga=0; index_loga<pba->bt_size; index_loga++) {
+      while ((index_break < pba->loga_break_size) && (pba->loga_break[index_break] < pba->loga_table[index_loga])) {
+        index_loga_end[segment_size++] = index_loga_new;
+        loga_table[index_loga_new++] = pba->loga_break[index_break++];
+      }
+      if ((index_break < pba->loga_break_size) && (pba->loga_break[index_break] == pba->loga_table[index_loga])) {
+        index_loga_end[segment_size++] = index_loga_new;
+        index_break++;
+      }
+      loga_table[index_loga_new++] = pba->loga_table[index_loga];
+    }
+    free(pba->loga_table);
+    pba->loga_table = loga_table;
+    pba->bt_size = index_loga_new;
+  }
 
   /** - allocate background tables */
   class_alloc(pba->tau_table,pba->bt_size * sizeof(double),pba->error_message);
   class_alloc(pba->z_table,pba->bt_size * sizeof(double),pba->error_message);
-  class_alloc(pba->loga_table,pba->bt_size * sizeof(double),pba->error_message);
 
   class_alloc(pba->d2tau_dz2_table,pba->bt_size * sizeof(double),pba->error_message);
   class_alloc(pba->d2z_dtau2_table,pba->bt_size * sizeof(double),pba->error_message);
@@ -2057,49 +2538,54 @@ int background_solve(
 
   class_alloc(used_in_output, pba->bt_size*sizeof(int), pba->error_message);
 
-  /** - define values of loga at which results will be stored */
   for (index_loga=0; index_loga<pba->bt_size; index_loga++) {
-    pba->loga_table[index_loga] = loga_ini + index_loga*(loga_final-loga_ini)/(pba->bt_size-1);
     used_in_output[index_loga] = 1;
   }
 
-  /** - choose the right evolver */
-  switch (ppr->background_evolver) {
+  index_loga_end[segment_size++] = pba->bt_size-1;
 
-  case rk:
-    generic_evolver = evolver_rk;
-    if (pba->background_verbose > 1) {
-      printf("%s\n", "Chose rk as generic_evolver");
-    }
-    break;
+  /** - in the pure UG case, if requested, fill the table by direct
+      quadrature on the sampling grid */
+  if (use_quadrature == _TRUE_) {
 
-  case ndf15:
-    generic_evolver = evolver_ndf15;
-    if (pba->background_verbose > 1) {
-      printf("%s\n", "Chose ndf15 as generic_evolver");
-    }
-    break;
+    class_call(background_solve_UG_quadrature(ppr,
+                                              pba,
+                                              pvecback_integration),
+               pba->error_message,
+               pba->error_message);
   }
+  else {
 
-  /** - perform the integration */
-  class_call(generic_evolver(background_derivs,
-                             loga_ini,
-                             loga_final,
-                             pvecback_integration,
-                             used_in_output,
-                             pba->bi_size,
-                             &bpaw,
-                             ppr->tol_background_integration,
-                             ppr->smallest_allowed_variation,
-                             background_timescale, //'evaluate_timescale', required by evolver_rk but not by ndf15
-                             ppr->background_integration_stepsize,
-                             pba->loga_table,
-                             pba->bt_size,
-                             background_sources,
-                             NULL, //'print_variables' in evolver_rk could be set, but, not required
-                             pba->error_message),
-             pba->error_message,
-             pba->error_message);
+    /** - perform the integration, in one call of the evolver between
+        each pair of lines carrying consecutive breakpoints, such that
+        no step crosses a kink of the densities */
+    for (index_segment=0; index_segment<segment_size; index_segment++) {
+
+      index_loga_first = (index_segment == 0) ? 0 : index_loga_end[index_segment-1]+1;
+      bpaw.index_loga_offset = index_loga_first;
+
+      class_call(generic_evolver(background_derivs,
+                                 (index_segment == 0) ? loga_ini : pba->loga_table[index_loga_first-1],
+                                 (index_segment == segment_size-1) ? loga_final : pba->loga_table[index_loga_end[index_segment]],
+                                 pvecback_integration,
+                                 used_in_output+index_loga_first,
+                                 pba->bi_size,
+                                 &bpaw,
+                                 ppr->tol_background_integration,
+                                 ppr->smallest_allowed_variation,
+                                 background_timescale, //'evaluate_timescale', required by evolver_rk but not by ndf15
+                                 ppr->background_integration_stepsize,
+                                 pba->loga_table+index_loga_first,
+                                 index_loga_end[index_segment]-index_loga_first+1,
+                                 background_sources,
+                                 NULL, //'print_variables' in evolver_rk could be set, but, not required
+                                 NULL, //'jacobian_pattern' in evolver_ndf15, not useful for a single integration
+                                 pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+    }
+    bpaw.index_loga_offset = 0;
+  }
 
   /** - recover some quantities today */
   /* -> age in Gyears */
@@ -2239,6 +2725,490 @@ int background_solve(
 
 }
 
+/**
+ * Collect the breakpoints of the background, i.e. the values of log(a)
+ * at which the density of some species has a kink (a discontinuous
+ * derivative), in pba->loga_break. If requested, background_solve()
+ * adds a line to the table at each of them and integrates each smooth
+ * segment separately. A species with such a piecewise density simply adds its
+ * breakpoints here.
+ *
+ * @param pba        Input/Output: pointer to background structure
+ * @param loga_ini   Input: initial value of log(a) of the integration
+ * @param loga_final Input: final value of log(a) of the integration
+ * @return the error status
+ */
+
+int background_breakpoints(
+                           struct background *pba,
+                           double loga_ini,
+                           double loga_final
+                           ) {
+
+  double loga_candidate[_MAX_BACKGROUND_BREAKPOINTS_];
+  int candidate_size=0;
+  int index_candidate, index_break;
+  double loga;
+
+  /** - UG model 1: linear transition between a_start -/+ delta/2 (smooth without energy transfer) */
+  if ((pba->has_UG == _TRUE_) && (pba->model == 1) && (pba->UG.delta > 0.) && (pba->UG.Delta_rho != 0.)) {
+    if (pba->UG.a_minus > 0.)
+      loga_candidate[candidate_size++] = log(pba->UG.a_minus);
+    loga_candidate[candidate_size++] = log(pba->UG.a_plus);
+  }
+
+  /** - keep those strictly inside the integration range, sorted and without duplicates */
+  pba->loga_break_size = 0;
+  for (index_candidate=0; index_candidate<candidate_size; index_candidate++) {
+    loga = loga_candidate[index_candidate];
+    if ((loga <= loga_ini) || (loga >= loga_final))
+      continue;
+    for (index_break=0; index_break<pba->loga_break_size; index_break++) {
+      if (pba->loga_break[index_break] == loga)
+        break;
+    }
+    if (index_break < pba->loga_break_size)
+      continue;
+    for (index_break=pba->loga_break_size; (index_break > 0) && (pba->loga_break[index_break-1] > loga); index_break--)
+      pba->loga_break[index_break] = pba->loga_break[index_break-1];
+    pba->loga_break[index_break] = loga;
+    pba->loga_break_size++;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Place the lines of the background table, for
+ * ppr->background_table_adaptive, such that the spline interpolation
+ * of its columns in loga reaches a given relative error with as few
+ * lines as possible.
+ *
+ * A pilot integration stores ppr->background_table_Nloga_pilot lines
+ * uniform in loga. The fourth derivative of each column (and of tau)
+ * is estimated from the second differences of its spline second
+ * derivatives, and gives the step h(loga) for which the error of the
+ * cubic spline, (5/384) h^4 |f''''|, is ppr->background_table_tol
+ * times the local value of the quantity. The lines are then
+ * distributed with a density 1/h, with h between
+ * ppr->background_table_dloga_min and ppr->background_table_dloga_max,
+ * and rescaled if necessary such that there are at most
+ * ppr->background_Nloga of them. Most lines thus go to the
+ * transitions of the background (radiation-matter equality, the UG
+ * transition, the non-relativistic transition of ncdm species), and
+ * few to the long stretches dominated by a single species.
+ *
+ * @param ppr                  Input: precision structure
+ * @param pba                  Input/Output: background structure; in output, bt_size is set and loga_table is allocated and filled
+ * @param generic_evolver      Input: evolver used for the pilot integration
+ * @param loga_ini             Input: first value of loga
+ * @param loga_final           Input: last value of loga
+ * @param pvecback_integration Input: initial conditions of the integrated quantities (unchanged)
+ * @return the error status
+ */
+
+int background_table_sampling(
+                              struct precision *ppr,
+                              struct background *pba,
+                              int (*generic_evolver)(EVOLVER_PROTOTYPE),
+                              double loga_ini,
+                              double loga_final,
+                              double * pvecback_integration
+                              ) {
+
+  struct background_parameters_and_workspace bpaw;
+  double * y, * d2_table, * d2tau_table, * density, * cumulative, * loga_pilot;
+  int * used_in_output;
+  int pilot_size, index_loga, index_bg, index_line;
+  double dloga, f4, scale, rho, target;
+
+  pilot_size = ppr->background_table_Nloga_pilot;
+
+  class_test(pilot_size < 4,
+             pba->error_message,
+             "background_table_Nloga_pilot=%d should be at least 4",pilot_size);
+
+  /** - pilot integration on a uniform grid, in temporary tables (the
+      columns filled after the integration, like distances, remain
+      zero and are ignored) */
+  pba->bt_size = pilot_size;
+  class_alloc(pba->loga_table,pilot_size*sizeof(double),pba->error_message);
+  class_alloc(pba->tau_table,pilot_size*sizeof(double),pba->error_message);
+  class_alloc(pba->z_table,pilot_size*sizeof(double),pba->error_message);
+  class_calloc(pba->background_table,pilot_size*pba->bg_size,sizeof(double),pba->error_message);
+  class_alloc(used_in_output,pilot_size*sizeof(int),pba->error_message);
+  class_alloc(y,pba->bi_size*sizeof(double),pba->error_message);
+  class_alloc(bpaw.pvecback,pba->bg_size*sizeof(double),pba->error_message);
+  bpaw.pba = pba;
+  bpaw.index_loga_offset = 0;
+
+  dloga = (loga_final-loga_ini)/(pilot_size-1);
+  for (index_loga=0; index_loga<pilot_size; index_loga++) {
+    pba->loga_table[index_loga] = loga_ini + index_loga*dloga;
+    used_in_output[index_loga] = 1;
+  }
+  memcpy(y,pvecback_integration,pba->bi_size*sizeof(double));
+
+  class_call(generic_evolver(background_derivs,
+                             loga_ini,
+                             loga_final,
+                             y,
+                             used_in_output,
+                             pba->bi_size,
+                             &bpaw,
+                             ppr->tol_background_integration,
+                             ppr->smallest_allowed_variation,
+                             background_timescale,
+                             ppr->background_integration_stepsize,
+                             pba->loga_table,
+                             pilot_size,
+                             background_sources,
+                             NULL,
+                             NULL,
+                             pba->error_message),
+             pba->error_message,
+             pba->error_message);
+
+  class_alloc(d2_table,pilot_size*pba->bg_size*sizeof(double),pba->error_message);
+  class_alloc(d2tau_table,pilot_size*sizeof(double),pba->error_message);
+
+  class_call(array_spline_table_lines(pba->loga_table,
+                                      pilot_size,
+                                      pba->background_table,
+                                      pba->bg_size,
+                                      d2_table,
+                                      _SPLINE_EST_DERIV_,
+                                      pba->error_message),
+             pba->error_message,
+             pba->error_message);
+
+  class_call(array_spline_table_lines(pba->loga_table,
+                                      pilot_size,
+                                      pba->tau_table,
+                                      1,
+                                      d2tau_table,
+                                      _SPLINE_EST_DERIV_,
+                                      pba->error_message),
+             pba->error_message,
+             pba->error_message);
+
+  /** - density of lines required at each line of the pilot table, set
+      by the column varying fastest relative to its local value */
+  class_alloc(density,pilot_size*sizeof(double),pba->error_message);
+
+  for (index_loga=1; index_loga<pilot_size-1; index_loga++) {
+    density[index_loga] = 1./ppr->background_table_dloga_max;
+    /* the last value of index_bg stands for tau */
+    for (index_bg=0; index_bg<=pba->bg_size; index_bg++) {
+      if (index_bg < pba->bg_size) {
+        f4 = (d2_table[(index_loga+1)*pba->bg_size+index_bg]
+              -2.*d2_table[index_loga*pba->bg_size+index_bg]
+              +d2_table[(index_loga-1)*pba->bg_size+index_bg])/dloga/dloga;
+        scale = MAX(fabs(pba->background_table[(index_loga-1)*pba->bg_size+index_bg]),
+                    MAX(fabs(pba->background_table[index_loga*pba->bg_size+index_bg]),
+                        fabs(pba->background_table[(index_loga+1)*pba->bg_size+index_bg])));
+      }
+      else {
+        f4 = (d2tau_table[index_loga+1]-2.*d2tau_table[index_loga]+d2tau_table[index_loga-1])/dloga/dloga;
+        scale = fabs(pba->tau_table[index_loga+1]);
+      }
+      if ((f4 != 0.) && (scale > 0.))
+        density[index_loga] = MAX(density[index_loga],pow(5.*fabs(f4)/(384.*ppr->background_table_tol*scale),0.25));
+    }
+    density[index_loga] = MIN(density[index_loga],1./ppr->background_table_dloga_min);
+  }
+  /* the splines are less accurate near the ends of the table, where
+     the first derivative is only estimated: use the smallest step in
+     the first and last pilot intervals */
+  density[0] = 1./ppr->background_table_dloga_min;
+  density[pilot_size-1] = 1./ppr->background_table_dloga_min;
+
+  /** - cumulative number of steps, taking in each pilot interval the
+      largest density of its two ends */
+  class_alloc(cumulative,pilot_size*sizeof(double),pba->error_message);
+  cumulative[0] = 0.;
+  for (index_loga=0; index_loga<pilot_size-1; index_loga++) {
+    cumulative[index_loga+1] = cumulative[index_loga] + dloga*MAX(density[index_loga],density[index_loga+1]);
+  }
+
+  loga_pilot = pba->loga_table;
+  free(pba->tau_table);
+  free(pba->z_table);
+  free(pba->background_table);
+
+  pba->bt_size = MIN((int)ceil(cumulative[pilot_size-1])+1,ppr->background_Nloga);
+  pba->bt_size = MAX(pba->bt_size,4);
+
+  if (pba->background_verbose > 1) {
+    printf(" -> %d lines in the background table, placed after a pilot integration on %d lines\n",pba->bt_size,pilot_size);
+  }
+
+  /** - lines of the table at equal increments of the cumulative number
+      of steps (linear in each pilot interval) */
+  class_alloc(pba->loga_table,pba->bt_size*sizeof(double),pba->error_message);
+  pba->loga_table[0] = loga_ini;
+  index_loga = 0;
+  for (index_line=1; index_line<pba->bt_size-1; index_line++) {
+    target = index_line*cumulative[pilot_size-1]/(pba->bt_size-1);
+    while (cumulative[index_loga+1] < target)
+      index_loga++;
+    rho = (cumulative[index_loga+1]-cumulative[index_loga])/dloga;
+    pba->loga_table[index_line] = loga_pilot[index_loga] + (target-cumulative[index_loga])/rho;
+  }
+  pba->loga_table[pba->bt_size-1] = loga_final;
+
+  free(loga_pilot);
+  free(used_in_output);
+  free(y);
+  free(bpaw.pvecback);
+  free(d2_table);
+  free(d2tau_table);
+  free(density);
+  free(cumulative);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Fill the background table without calling the generic evolver, in
+ * the case of the unimodular-gravity (UG) model with no species
+ * requiring a differential equation for its density (no ncdm, scf,
+ * dcdm or fld).
+ *
+ * All densities are then known analytically as a function of a
+ * (piecewise for UG model 1, in closed form for model 2), so the
+ * integrals giving time, tau and rs, and the linear equation for the
+ * growth factor, are integrated with a fixed-step fourth-order
+ * Runge-Kutta scheme (i.e. Simpson's rule for the pure quadratures)
+ * directly on the sampling grid pba->loga_table: each step covers two
+ * sampling intervals, uses the middle line of the table as its
+ * midpoint, and the integrated quantities on that middle line are
+ * obtained by cubic Hermite interpolation. Hence
+ * background_functions() is called exactly once per line of the
+ * table, as in the evolver case, but without the evolver overhead.
+ *
+ * Steps containing or ending at a breakpoint of the background (the
+ * kinks of model 1 at a_start -/+ delta/2, see
+ * background_breakpoints()), and a possible last single interval, are
+ * instead integrated interval by interval, with sub-steps split at
+ * the breakpoints. So are the steps within the transition around
+ * a_start, with sub-steps resolving its width delta.
+ *
+ * @param ppr                  Input: pointer to precision structure
+ * @param pba                  Input/Output: pointer to background structure, with allocated tables and loga_table filled
+ * @param pvecback_integration Input/Output: integrated quantities, from initial conditions at loga_table[0] to values today
+ * @return the error status
+ */
+
+int background_solve_UG_quadrature(
+                                   struct precision *ppr,
+                                   struct background *pba,
+                                   double * pvecback_integration
+                                   ) {
+
+  struct background_parameters_and_workspace bpaw;
+  double * pvecback_left, * pvecback_mid, * pvecback_right, * pvecback_swap;
+  double * row_left, * row_mid, * row_right;
+  double * y, * y_stage, * k1, * k2, * k3, * k4;
+  double loga_left, loga_right, h, a_left, a_mid, a_right;
+  double loga_fine_min, loga_fine_max, dloga_fine;
+  int index_loga, index_kink, index_bi, has_kink, n_sub;
+
+  class_alloc(pvecback_left,pba->bg_size*sizeof(double),pba->error_message);
+  class_alloc(pvecback_mid,pba->bg_size*sizeof(double),pba->error_message);
+  class_alloc(pvecback_right,pba->bg_size*sizeof(double),pba->error_message);
+  class_alloc(y_stage,5*pba->bi_size*sizeof(double),pba->error_message);
+  k1 = y_stage + pba->bi_size;
+  k2 = k1 + pba->bi_size;
+  k3 = k2 + pba->bi_size;
+  k4 = k3 + pba->bi_size;
+  y = pvecback_integration;
+
+  bpaw.pba = pba;
+  bpaw.pvecback = NULL;
+  bpaw.index_loga_offset = 0;
+
+  /** - the densities vary quickly in the UG transition around a_start
+      (of width delta, with a kink at each end in model 1), which steps
+      over two sampling intervals do not resolve at the level of
+      tol_background_integration: within background_UG_transition_width
+      times delta of a_start, the table is integrated interval by
+      interval, with sub-steps of at most 1/background_UG_transition_steps
+      of the width delta/a_start of the transition in log(a) */
+  loga_fine_min = 1.;
+  loga_fine_max = 0.;
+  dloga_fine = 0.;
+  if ((pba->delta > 0.) && (pba->UG.Delta_rho != 0.)) {
+    loga_fine_min = log(MAX(pba->a_start-ppr->background_UG_transition_width*pba->delta,exp(pba->loga_table[0])));
+    loga_fine_max = log(pba->a_start+ppr->background_UG_transition_width*pba->delta);
+    dloga_fine = pba->delta/pba->a_start/ppr->background_UG_transition_steps;
+  }
+
+  /** - store first line of the table */
+  class_call(background_sources(pba->loga_table[0], y, NULL, 0, &bpaw, pba->error_message),
+             pba->error_message,
+             pba->error_message);
+
+  index_loga = 0;
+
+  while (index_loga < pba->bt_size-1) {
+
+    row_left = pba->background_table + index_loga*pba->bg_size;
+
+    has_kink = _FALSE_;
+    if (index_loga+2 <= pba->bt_size-1) {
+      for (index_kink=0; index_kink<pba->loga_break_size; index_kink++) {
+        if ((pba->loga_break[index_kink] >= pba->loga_table[index_loga]) &&
+            (pba->loga_break[index_kink] <= pba->loga_table[index_loga+2]))
+          has_kink = _TRUE_;
+      }
+      if ((pba->loga_table[index_loga+2] > loga_fine_min) && (pba->loga_table[index_loga] < loga_fine_max))
+        has_kink = _TRUE_;
+    }
+
+    /** - regular case: one step over two intervals */
+    if ((index_loga+2 <= pba->bt_size-1) && (has_kink == _FALSE_)) {
+
+      row_mid = row_left + pba->bg_size;
+      row_right = row_mid + pba->bg_size;
+      h = pba->loga_table[index_loga+2]-pba->loga_table[index_loga];
+      a_left = exp(pba->loga_table[index_loga]);
+      a_mid = exp(pba->loga_table[index_loga+1]);
+      a_right = exp(pba->loga_table[index_loga+2]);
+
+      /* the densities only depend on a: fill the next two lines now,
+         and the integrated quantities in them once they are known */
+      class_call(background_functions(pba, a_mid, y, long_info, row_mid),
+                 pba->error_message,
+                 pba->error_message);
+      class_call(background_functions(pba, a_right, y, long_info, row_right),
+                 pba->error_message,
+                 pba->error_message);
+
+      class_call(background_derivs_of_vecback(pba, a_left, row_left, y, k1, pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+
+      for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+        y_stage[index_bi] = y[index_bi] + 0.5*h*k1[index_bi];
+      class_call(background_derivs_of_vecback(pba, a_mid, row_mid, y_stage, k2, pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+
+      for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+        y_stage[index_bi] = y[index_bi] + 0.5*h*k2[index_bi];
+      class_call(background_derivs_of_vecback(pba, a_mid, row_mid, y_stage, k3, pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+
+      for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+        y_stage[index_bi] = y[index_bi] + h*k3[index_bi];
+      class_call(background_derivs_of_vecback(pba, a_right, row_right, y_stage, k4, pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+
+      /* y_stage <- y at the end of the step, k4 <- its derivative */
+      for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+        y_stage[index_bi] = y[index_bi] + h/6.*(k1[index_bi]+2.*k2[index_bi]+2.*k3[index_bi]+k4[index_bi]);
+      class_call(background_derivs_of_vecback(pba, a_right, row_right, y_stage, k4, pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+
+      /* cubic Hermite interpolation at the midpoint */
+      for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+        y[index_bi] = 0.5*(y[index_bi]+y_stage[index_bi]) + h/8.*(k1[index_bi]-k4[index_bi]);
+
+      pba->z_table[index_loga+1] = MAX(0.,1./a_mid-1.);
+      pba->tau_table[index_loga+1] = y[pba->index_bi_tau];
+      background_functions_of_integrated(pba, a_mid, y, row_mid);
+
+      for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+        y[index_bi] = y_stage[index_bi];
+
+      pba->z_table[index_loga+2] = MAX(0.,1./a_right-1.);
+      pba->tau_table[index_loga+2] = y[pba->index_bi_tau];
+      background_functions_of_integrated(pba, a_right, y, row_right);
+
+      index_loga += 2;
+    }
+
+    /** - otherwise: one interval, with sub-steps separated by kinks */
+    else {
+
+      loga_left = pba->loga_table[index_loga];
+      memcpy(pvecback_left,row_left,pba->bg_size*sizeof(double));
+
+      while (loga_left < pba->loga_table[index_loga+1]) {
+
+        loga_right = pba->loga_table[index_loga+1];
+        for (index_kink=0; index_kink<pba->loga_break_size; index_kink++) {
+          if ((pba->loga_break[index_kink] > loga_left) && (pba->loga_break[index_kink] < loga_right))
+            loga_right = pba->loga_break[index_kink];
+        }
+        if ((loga_right > loga_fine_min) && (loga_left < loga_fine_max)) {
+          n_sub = (int)ceil((loga_right-loga_left)/dloga_fine);
+          if (n_sub > 1)
+            loga_right = loga_left+(loga_right-loga_left)/n_sub;
+        }
+        h = loga_right-loga_left;
+
+        class_call(background_derivs_of_vecback(pba, exp(loga_left), pvecback_left, y, k1, pba->error_message),
+                   pba->error_message,
+                   pba->error_message);
+
+        class_call(background_functions(pba, exp(loga_left+0.5*h), y, normal_info, pvecback_mid),
+                   pba->error_message,
+                   pba->error_message);
+
+        for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+          y_stage[index_bi] = y[index_bi] + 0.5*h*k1[index_bi];
+        class_call(background_derivs_of_vecback(pba, exp(loga_left+0.5*h), pvecback_mid, y_stage, k2, pba->error_message),
+                   pba->error_message,
+                   pba->error_message);
+
+        for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+          y_stage[index_bi] = y[index_bi] + 0.5*h*k2[index_bi];
+        class_call(background_derivs_of_vecback(pba, exp(loga_left+0.5*h), pvecback_mid, y_stage, k3, pba->error_message),
+                   pba->error_message,
+                   pba->error_message);
+
+        class_call(background_functions(pba, exp(loga_right), y, normal_info, pvecback_right),
+                   pba->error_message,
+                   pba->error_message);
+
+        for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+          y_stage[index_bi] = y[index_bi] + h*k3[index_bi];
+        class_call(background_derivs_of_vecback(pba, exp(loga_right), pvecback_right, y_stage, k4, pba->error_message),
+                   pba->error_message,
+                   pba->error_message);
+
+        for (index_bi=0; index_bi<pba->bi_size; index_bi++)
+          y[index_bi] += h/6.*(k1[index_bi]+2.*k2[index_bi]+2.*k3[index_bi]+k4[index_bi]);
+
+        pvecback_swap = pvecback_left;
+        pvecback_left = pvecback_right;
+        pvecback_right = pvecback_swap;
+
+        loga_left = loga_right;
+      }
+
+      index_loga += 1;
+
+      class_call(background_sources(pba->loga_table[index_loga], y, NULL, index_loga, &bpaw, pba->error_message),
+                 pba->error_message,
+                 pba->error_message);
+    }
+  }
+
+  free(pvecback_left);
+  free(pvecback_mid);
+  free(pvecback_right);
+  free(y_stage);
+
+  return _SUCCESS_;
+
+}
+
 /**
  * Assign initial values to background integrated variables.
  *
@@ -2718,7 +3688,7 @@ int background_derivs(
 
   struct background_parameters_and_workspace * pbpaw;
   struct background * pba;
-  double * pvecback, a, H, rho_M;
+  double * pvecback, a;
 
   pbpaw = parameters_and_workspace;
   pba =  pbpaw->pba;
@@ -2732,6 +3702,43 @@ int background_derivs(
              pba->error_message,
              error_message);
 
+  /** - compute the derivatives from these background quantities */
+  class_call(background_derivs_of_vecback(pba, a, pvecback, y, dy, error_message),
+             error_message,
+             error_message);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Derivatives of the integrated background quantities {B} with
+ * respect to loga, given the quantities {A} already returned by
+ * background_functions() at the same value of a. This is the part of
+ * background_derivs() that depends on y; it is also called directly
+ * by background_solve_UG_quadrature(), that evaluates
+ * background_functions() only once per value of a.
+ *
+ * @param pba           Input: pointer to background structure
+ * @param a             Input: scale factor
+ * @param pvecback      Input: vector of background quantities at a (normal format at least)
+ * @param y             Input: current vector of integrated quantities (with index_bi)
+ * @param dy            Output: derivative of y w.r.t log(a)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int background_derivs_of_vecback(
+                                 struct background *pba,
+                                 double a,
+                                 double * pvecback,
+                                 double * y,
+                                 double * dy,
+                                 ErrorMsg error_message
+                                 ) {
+
+  double H, rho_M;
+
   /** - Short hand notation for Hubble */
   H = pvecback[pba->index_bg_H];
 
@@ -2827,6 +3834,7 @@ int background_sources(
   pba =  pbpaw->pba;
 
   /** - localize the row inside background_table where the current values must be stored */
+  index_loga += pbpaw->index_loga_offset;
   bg_table_row = pba->background_table + index_loga*pba->bg_size;
 
   /** - scale factor a (in fact, given our normalisation conventions, this stands for a/a_0) */
@@ -0,0 +1,1058 @@
+/** @file checkpoint.c Binary checkpoints of the computed modules
+ *
+ * The structures of the background, thermodynamics, perturbations,
+ * transfer, harmonic and lensing modules, once computed, can be saved
+ * in a binary file, and restored in a later run instead of being
+ * computed again: e.g. for post-processing a long high-precision run,
+ * or for restarting it from the transfer module with different
+ * transfer or harmonic settings. The primordial, fourier and distortions
+ * modules are fast and always computed again.
+ *
+ * A checkpoint is only valid for the input from which it was computed:
+ * the digests of the input of each module (see input_module_digests())
+ * are saved with it, and only the modules whose input did not change
+ * (nor that of the modules they depend on, see input_module_reuse())
+ * are restored. The arrays are read in memory allocated as by the init
+ * functions, such that the restored structures are freed by the usual
+ * _free() functions.
+ *
+ * The following functions can be called from other modules:
+ *
+ * -# checkpoint_write() for saving the computed structures
+ * -# checkpoint_read() for restoring them before modules_init()
+ */
+
+#include "checkpoint.h"
+#include <unistd.h>
+
+/** Direction of the transfer between a structure and a checkpoint file */
+
+struct checkpoint_stream {
+  FILE * file;            /**< checkpoint file */
+  short reading;          /**< _TRUE_ when restoring the structures, _FALSE_ when saving them */
+  ErrorMsg error_message; /**< zone for writing error messages */
+};
+
+static const char * checkpoint_names[module_size] = {
+  "background","thermodynamics","perturbations","primordial","fourier",
+  "transfer","harmonic","lensing","distortions"
+};
+
+/**
+ * Write or read a block of bytes.
+ *
+ * @param pcs  Input/Output: stream
+ * @param data Input/Output: block
+ * @param size Input: number of bytes
+ * @return the error status
+ */
+
+static int checkpoint_bytes(
+                            struct checkpoint_stream * pcs,
+                            void * data,
+                            size_t size
+                            ) {
+
+  if (pcs->reading == _TRUE_) {
+    class_test(fread(data,1,size,pcs->file) != size,
+               pcs->error_message,
+               "the checkpoint file is truncated");
+  }
+  else {
+    class_test(fwrite(data,1,size,pcs->file) != size,
+               pcs->error_message,
+               "could not write the checkpoint file");
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read an array of a structure. When reading, the array is
+ * allocated; its number of elements, as inferred from the structure,
+ * must be the same as in the file.
+ *
+ * @param pcs     Input/Output: stream
+ * @param parray  Input/Output: pointer to the array
+ * @param size    Input: size of each element
+ * @param count   Input: number of elements
+ * @param present Input: whether the array is allocated in the structure (otherwise it is saved as NULL)
+ * @return the error status
+ */
+
+static int checkpoint_array(
+                            struct checkpoint_stream * pcs,
+                            void ** parray,
+                            size_t size,
+                            long long count,
+                            short present
+                            ) {
+
+  long long stored;
+
+  if (pcs->reading == _FALSE_) {
+    stored = ((present == _TRUE_) && (*parray != NULL)) ? count : -1;
+    class_call(checkpoint_bytes(pcs,&stored,sizeof(long long)),
+               pcs->error_message,
+               pcs->error_message);
+    if (stored > 0) {
+      class_call(checkpoint_bytes(pcs,*parray,(size_t)stored*size),
+                 pcs->error_message,
+                 pcs->error_message);
+    }
+    return _SUCCESS_;
+  }
+
+  class_call(checkpoint_bytes(pcs,&stored,sizeof(long long)),
+             pcs->error_message,
+             pcs->error_message);
+
+  if (stored < 0) {
+    *parray = NULL;
+    return _SUCCESS_;
+  }
+
+  class_test((present == _FALSE_) || (stored != count),
+             pcs->error_message,
+             "array of %lld elements in the checkpoint file instead of %lld",stored,count);
+
+  class_alloc(*parray,MAX(count,1)*size,pcs->error_message);
+
+  class_call(checkpoint_bytes(pcs,*parray,(size_t)count*size),
+             pcs->error_message,
+             pcs->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read an array of pointers of a structure. Only its
+ * number of elements is saved: when reading, it is allocated with NULL
+ * pointers, to be set by the caller.
+ *
+ * @param pcs     Input/Output: stream
+ * @param plist   Input/Output: pointer to the array of pointers
+ * @param count   Input: number of pointers
+ * @param present Input: whether the array is allocated in the structure
+ * @return the error status
+ */
+
+static int checkpoint_pointers(
+                               struct checkpoint_stream * pcs,
+                               void *** plist,
+                               long long count,
+                               short present
+                               ) {
+
+  long long stored;
+
+  if (pcs->reading == _FALSE_) {
+    stored = ((present == _TRUE_) && (*plist != NULL)) ? count : -1;
+    class_call(checkpoint_bytes(pcs,&stored,sizeof(long long)),
+               pcs->error_message,
+               pcs->error_message);
+    return _SUCCESS_;
+  }
+
+  class_call(checkpoint_bytes(pcs,&stored,sizeof(long long)),
+             pcs->error_message,
+             pcs->error_message);
+
+  if (stored < 0) {
+    *plist = NULL;
+    return _SUCCESS_;
+  }
+
+  class_test((present == _FALSE_) || (stored != count),
+             pcs->error_message,
+             "array of %lld pointers in the checkpoint file instead of %lld",stored,count);
+
+  class_calloc(*plist,MAX(count,1),sizeof(void *),pcs->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read the background structure. When reading, the arrays
+ * allocated by the input module are those of the current run.
+ *
+ * @param pcs Input/Output: stream
+ * @param pba Input/Output: pointer to background structure
+ * @return the error status
+ */
+
+static int checkpoint_background(
+                                 struct checkpoint_stream * pcs,
+                                 struct background * pba
+                                 ) {
+
+  struct background * pba_input = NULL;
+  int n_ncdm;
+  short has_table;
+
+  if (pcs->reading == _TRUE_) {
+    class_alloc(pba_input,sizeof(struct background),pcs->error_message);
+    *pba_input = *pba;
+  }
+
+  class_call_except(checkpoint_bytes(pcs,pba,sizeof(struct background)),
+                    pcs->error_message,
+                    pcs->error_message,
+                    free(pba_input));
+
+  if (pcs->reading == _TRUE_) {
+    pba->ncdm_psd_files = pba_input->ncdm_psd_files;
+    pba->got_files = pba_input->got_files;
+    pba->ncdm_psd_parameters = pba_input->ncdm_psd_parameters;
+    pba->M_ncdm = pba_input->M_ncdm;
+    pba->m_ncdm_in_eV = pba_input->m_ncdm_in_eV;
+    pba->Omega0_ncdm = pba_input->Omega0_ncdm;
+    pba->T_ncdm = pba_input->T_ncdm;
+    pba->ksi_ncdm = pba_input->ksi_ncdm;
+    pba->deg_ncdm = pba_input->deg_ncdm;
+    pba->ncdm_input_q_size = pba_input->ncdm_input_q_size;
+    pba->ncdm_qmax = pba_input->ncdm_qmax;
+    pba->scf_parameters = pba_input->scf_parameters;
+    pba->ncdm_quadrature_strategy = pba_input->ncdm_quadrature_strategy;
+    pba->q_ncdm_bg = pba_input->q_ncdm_bg;
+    pba->w_ncdm_bg = pba_input->w_ncdm_bg;
+    pba->q_ncdm = pba_input->q_ncdm;
+    pba->w_ncdm = pba_input->w_ncdm;
+    pba->dlnf0_dlnq_ncdm = pba_input->dlnf0_dlnq_ncdm;
+    pba->q_size_ncdm_bg = pba_input->q_size_ncdm_bg;
+    pba->q_size_ncdm = pba_input->q_size_ncdm;
+    pba->factor_ncdm = pba_input->factor_ncdm;
+    free(pba_input);
+    memset(&(pba->stats),0,sizeof(struct class_stats));
+  }
+
+  class_call(checkpoint_array(pcs,(void**)&(pba->loga_table),sizeof(double),pba->bt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pba->tau_table),sizeof(double),pba->bt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pba->z_table),sizeof(double),pba->bt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pba->d2tau_dz2_table),sizeof(double),pba->bt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pba->d2z_dtau2_table),sizeof(double),pba->bt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pba->background_table),sizeof(double),(long long)pba->bt_size*pba->bg_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pba->d2background_dloga2_table),sizeof(double),(long long)pba->bt_size*pba->bg_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+
+  /* tables of the ncdm momentum sums (see background_ncdm_tabulate()) */
+  has_table = (pba->ncdm_bg_table_size > 0);
+  class_call(checkpoint_pointers(pcs,(void***)&(pba->ncdm_bg_table),pba->N_ncdm,has_table),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(pba->ncdm_bg_table_dd),pba->N_ncdm,has_table),
+             pcs->error_message,pcs->error_message);
+  if (pba->ncdm_bg_table != NULL) {
+    for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+      class_call(checkpoint_array(pcs,(void**)&(pba->ncdm_bg_table[n_ncdm]),sizeof(double),3*pba->ncdm_bg_table_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      class_call(checkpoint_array(pcs,(void**)&(pba->ncdm_bg_table_dd[n_ncdm]),sizeof(double),3*pba->ncdm_bg_table_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read the thermodynamics structure (without exotic energy
+ * injection, see checkpoint_write()).
+ *
+ * @param pcs Input/Output: stream
+ * @param pth Input/Output: pointer to thermodynamics structure
+ * @return the error status
+ */
+
+static int checkpoint_thermodynamics(
+                                     struct checkpoint_stream * pcs,
+                                     struct thermodynamics * pth
+                                     ) {
+
+  struct thermodynamics * pth_input = NULL;
+
+  if (pcs->reading == _TRUE_) {
+    class_alloc(pth_input,sizeof(struct thermodynamics),pcs->error_message);
+    *pth_input = *pth;
+  }
+
+  class_call_except(checkpoint_bytes(pcs,pth,sizeof(struct thermodynamics)),
+                    pcs->error_message,
+                    pcs->error_message,
+                    free(pth_input));
+
+  if (pcs->reading == _TRUE_) {
+    pth->binned_reio_z = pth_input->binned_reio_z;
+    pth->binned_reio_xe = pth_input->binned_reio_xe;
+    pth->many_tanh_z = pth_input->many_tanh_z;
+    pth->many_tanh_xe = pth_input->many_tanh_xe;
+    pth->reio_inter_z = pth_input->reio_inter_z;
+    pth->reio_inter_xe = pth_input->reio_inter_xe;
+    pth->in = pth_input->in;
+    free(pth_input);
+    memset(&(pth->stats),0,sizeof(struct class_stats));
+  }
+
+  class_call(checkpoint_array(pcs,(void**)&(pth->z_table),sizeof(double),pth->tt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pth->tau_table),sizeof(double),pth->tt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pth->thermodynamics_table),sizeof(double),(long long)pth->th_size*pth->tt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(pth->d2thermodynamics_dz2_table),sizeof(double),(long long)pth->th_size*pth->tt_size,_TRUE_),
+             pcs->error_message,pcs->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read the perturbations structure: the source functions and
+ * their sampling, and the tables of the perturbations output (without
+ * temporary files, see checkpoint_write()).
+ *
+ * @param pcs Input/Output: stream
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input/Output: pointer to perturbations structure
+ * @return the error status
+ */
+
+static int checkpoint_perturbations(
+                                    struct checkpoint_stream * pcs,
+                                    struct background * pba,
+                                    struct thermodynamics * pth,
+                                    struct perturbations * ppt
+                                    ) {
+
+  struct perturbations * ppt_input = NULL;
+  short has = ppt->has_perturbations;
+  short has_late, has_float;
+  int index_md, index_tp, tp_size, filenum;
+
+  if (pcs->reading == _TRUE_) {
+    class_alloc(ppt_input,sizeof(struct perturbations),pcs->error_message);
+    *ppt_input = *ppt;
+  }
+
+  class_call_except(checkpoint_bytes(pcs,ppt,sizeof(struct perturbations)),
+                    pcs->error_message,
+                    pcs->error_message,
+                    free(ppt_input));
+
+  if (pcs->reading == _TRUE_) {
+    ppt->alpha_idm_dr = ppt_input->alpha_idm_dr;
+    ppt->beta_idr = ppt_input->beta_idr;
+    free(ppt_input);
+    memset(&(ppt->stats),0,sizeof(struct class_stats));
+    /* unused, or only needed during perturbations_init() */
+    ppt->selection_tau_min = NULL;
+    ppt->selection_tau_max = NULL;
+    ppt->selection_tau = NULL;
+    ppt->selection_function = NULL;
+    ppt->switch_table_size = NULL;
+    ppt->switch_table_lnk = NULL;
+    ppt->switch_table_tau = NULL;
+    for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++) {
+      ppt->scalar_perturbations_file[filenum] = NULL;
+      ppt->vector_perturbations_file[filenum] = NULL;
+      ppt->tensor_perturbations_file[filenum] = NULL;
+    }
+    has = ppt->has_perturbations;
+  }
+
+  has_late = ((has == _TRUE_) && (ppt->ln_tau_size > 1));
+  has_float = ((has == _TRUE_) && (ppt->storage == sources_storage_float));
+
+  class_call(checkpoint_array(pcs,(void**)&(ppt->tp_size),sizeof(int),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ppt->ic_size),sizeof(int),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ppt->k_size_cmb),sizeof(int),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ppt->k_size_cl),sizeof(int),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ppt->k_size),sizeof(int),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+
+  class_call(checkpoint_array(pcs,(void**)&(ppt->tau_sampling),sizeof(double),ppt->tau_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ppt->pvecback_sampling),sizeof(double),(long long)ppt->tau_size*pba->bg_size_normal,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ppt->pvecthermo_sampling),sizeof(double),(long long)ppt->tau_size*pth->th_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ppt->ln_tau),sizeof(double),ppt->ln_tau_size,has_late),
+             pcs->error_message,pcs->error_message);
+
+  class_call(checkpoint_pointers(pcs,(void***)&(ppt->k),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ppt->sources),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ppt->late_sources),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ppt->ddlate_sources),ppt->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ppt->sources_float),ppt->md_size,has_float),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ppt->late_sources_float),ppt->md_size,has_float),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ppt->ddlate_sources_float),ppt->md_size,has_float),
+             pcs->error_message,pcs->error_message);
+
+  if (has == _TRUE_) {
+
+    for (index_md = 0; index_md < ppt->md_size; index_md++) {
+
+      tp_size = ppt->ic_size[index_md]*ppt->tp_size[index_md];
+
+      class_call(checkpoint_array(pcs,(void**)&(ppt->k[index_md]),sizeof(double),ppt->k_size[index_md],_TRUE_),
+                 pcs->error_message,pcs->error_message);
+
+      class_call(checkpoint_pointers(pcs,(void***)&(ppt->sources[index_md]),tp_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      class_call(checkpoint_pointers(pcs,(void***)&(ppt->late_sources[index_md]),tp_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      class_call(checkpoint_pointers(pcs,(void***)&(ppt->ddlate_sources[index_md]),tp_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      if (has_float == _TRUE_) {
+        class_call(checkpoint_pointers(pcs,(void***)&(ppt->sources_float[index_md]),tp_size,_TRUE_),
+                   pcs->error_message,pcs->error_message);
+        class_call(checkpoint_pointers(pcs,(void***)&(ppt->late_sources_float[index_md]),tp_size,_TRUE_),
+                   pcs->error_message,pcs->error_message);
+        class_call(checkpoint_pointers(pcs,(void***)&(ppt->ddlate_sources_float[index_md]),tp_size,_TRUE_),
+                   pcs->error_message,pcs->error_message);
+      }
+
+      for (index_tp = 0; index_tp < tp_size; index_tp++) {
+
+        class_call(checkpoint_array(pcs,(void**)&(ppt->sources[index_md][index_tp]),sizeof(double),
+                                    (long long)ppt->k_size[index_md]*ppt->tau_size,_TRUE_),
+                   pcs->error_message,pcs->error_message);
+
+        class_call(checkpoint_array(pcs,(void**)&(ppt->ddlate_sources[index_md][index_tp]),sizeof(double),
+                                    (long long)ppt->k_size[index_md]*ppt->ln_tau_size,has_late),
+                   pcs->error_message,pcs->error_message);
+
+        /* late_sources points to the end of sources (see perturbations_indices()) */
+        if ((pcs->reading == _TRUE_) && (has_late == _TRUE_) && (has_float == _FALSE_)) {
+          ppt->late_sources[index_md][index_tp] = &(ppt->sources[index_md][index_tp][(ppt->tau_size-ppt->ln_tau_size)*ppt->k_size[index_md]]);
+        }
+
+        /* in single precision (see perturbations_storage_convert()), the double tables above are NULL */
+        if (has_float == _TRUE_) {
+          class_call(checkpoint_array(pcs,(void**)&(ppt->sources_float[index_md][index_tp]),sizeof(float),
+                                      (long long)ppt->k_size[index_md]*ppt->tau_size,_TRUE_),
+                     pcs->error_message,pcs->error_message);
+
+          class_call(checkpoint_array(pcs,(void**)&(ppt->ddlate_sources_float[index_md][index_tp]),sizeof(float),
+                                      (long long)ppt->k_size[index_md]*ppt->ln_tau_size,has_late),
+                     pcs->error_message,pcs->error_message);
+
+          if (pcs->reading == _TRUE_) {
+            ppt->late_sources[index_md][index_tp] = NULL;
+            ppt->late_sources_float[index_md][index_tp] = NULL;
+            if (has_late == _TRUE_)
+              ppt->late_sources_float[index_md][index_tp] = &(ppt->sources_float[index_md][index_tp][(ppt->tau_size-ppt->ln_tau_size)*ppt->k_size[index_md]]);
+          }
+        }
+      }
+    }
+  }
+
+  /* tables of the perturbations output of k_output_values */
+  class_call(checkpoint_array(pcs,(void**)&(ppt->index_k_output_values),sizeof(int),(long long)ppt->md_size*ppt->k_output_values_num,
+                              (has == _TRUE_) && (ppt->k_output_values_num > 0)),
+             pcs->error_message,pcs->error_message);
+
+  for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++) {
+    class_call(checkpoint_array(pcs,(void**)&(ppt->scalar_perturbations_data[filenum]),sizeof(double),ppt->size_scalar_perturbation_data[filenum],has),
+               pcs->error_message,pcs->error_message);
+    class_call(checkpoint_array(pcs,(void**)&(ppt->vector_perturbations_data[filenum]),sizeof(double),ppt->size_vector_perturbation_data[filenum],has),
+               pcs->error_message,pcs->error_message);
+    class_call(checkpoint_array(pcs,(void**)&(ppt->tensor_perturbations_data[filenum]),sizeof(double),ppt->size_tensor_perturbation_data[filenum],has),
+               pcs->error_message,pcs->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read the transfer structure, whatever the storage mode of
+ * the transfer functions.
+ *
+ * @param pcs Input/Output: stream
+ * @param ppt Input: pointer to perturbations structure
+ * @param ptr Input/Output: pointer to transfer structure
+ * @return the error status
+ */
+
+static int checkpoint_transfer(
+                               struct checkpoint_stream * pcs,
+                               struct perturbations * ppt,
+                               struct transfer * ptr
+                               ) {
+
+  short has, has_limber, has_direct, has_float, has_int16;
+  int index_md;
+  long long block_num, l_size_direct = 0, ic_size_direct = 0;
+
+  class_call(checkpoint_bytes(pcs,ptr,sizeof(struct transfer)),
+             pcs->error_message,
+             pcs->error_message);
+
+  if (pcs->reading == _TRUE_)
+    memset(&(ptr->stats),0,sizeof(struct class_stats));
+
+  has = ptr->has_cls;
+  has_limber = ((has == _TRUE_) && (ptr->do_lcmb_full_limber == _TRUE_));
+  has_direct = ((has == _TRUE_) && (ptr->do_lcmb_direct_limber == _TRUE_));
+  has_float = ((has == _TRUE_) && (ptr->storage == transfer_storage_float));
+  has_int16 = ((has == _TRUE_) && (ptr->storage == transfer_storage_int16));
+
+  class_call(checkpoint_array(pcs,(void**)&(ptr->nz_z),sizeof(double),ptr->nz_size,(has == _TRUE_) && (ptr->nz_size > 0)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->nz_nz),sizeof(double),ptr->nz_size,(has == _TRUE_) && (ptr->nz_size > 0)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->nz_ddnz),sizeof(double),ptr->nz_size,(has == _TRUE_) && (ptr->nz_size > 0)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->nz_evo_z),sizeof(double),ptr->nz_evo_size,(has == _TRUE_) && (ptr->nz_evo_size > 0)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->nz_evo_nz),sizeof(double),ptr->nz_evo_size,(has == _TRUE_) && (ptr->nz_evo_size > 0)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->nz_evo_dlog_nz),sizeof(double),ptr->nz_evo_size,(has == _TRUE_) && (ptr->nz_evo_size > 0)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->nz_evo_dd_dlog_nz),sizeof(double),ptr->nz_evo_size,(has == _TRUE_) && (ptr->nz_evo_size > 0)),
+             pcs->error_message,pcs->error_message);
+
+  class_call(checkpoint_array(pcs,(void**)&(ptr->tt_size),sizeof(int),ptr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->l_size),sizeof(int),ptr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->l),sizeof(int),ptr->l_size_max,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->q),sizeof(double),(long long)ptr->q_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->q_limber),sizeof(double),(long long)ptr->q_size_limber,has_limber),
+             pcs->error_message,pcs->error_message);
+
+  if (has_direct == _TRUE_) {
+    l_size_direct = ptr->l_size[ppt->index_md_scalars] - ptr->index_l_lcmb_direct;
+    ic_size_direct = ppt->ic_size[ppt->index_md_scalars];
+  }
+  class_call(checkpoint_array(pcs,(void**)&(ptr->k_size_lcmb_direct),sizeof(int),l_size_direct,has_direct),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->k_lcmb_direct),sizeof(double),l_size_direct*ptr->tau_size_lcmb_direct,has_direct),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_lcmb_direct),sizeof(double),ic_size_direct*l_size_direct*ptr->tau_size_lcmb_direct,has_direct),
+             pcs->error_message,pcs->error_message);
+
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->l_size_tt),ptr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->l_sampled),ptr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->k),ptr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->k_limber),ptr->md_size,has_limber),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer),ptr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer_limber),ptr->md_size,has_limber),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer_float),ptr->md_size,has_float),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer_limber_float),ptr->md_size,(has_float == _TRUE_) && (has_limber == _TRUE_)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer_int16),ptr->md_size,has_int16),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer_scale),ptr->md_size,has_int16),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer_limber_int16),ptr->md_size,(has_int16 == _TRUE_) && (has_limber == _TRUE_)),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(ptr->transfer_limber_scale),ptr->md_size,(has_int16 == _TRUE_) && (has_limber == _TRUE_)),
+             pcs->error_message,pcs->error_message);
+
+  if (has == _FALSE_)
+    return _SUCCESS_;
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+
+    block_num = (long long)ppt->ic_size[index_md]*ptr->tt_size[index_md]*ptr->l_size[index_md];
+
+    class_call(checkpoint_array(pcs,(void**)&(ptr->l_size_tt[index_md]),sizeof(int),ptr->tt_size[index_md],_TRUE_),
+               pcs->error_message,pcs->error_message);
+    if (ptr->l_sampled != NULL) {
+      class_call(checkpoint_array(pcs,(void**)&(ptr->l_sampled[index_md]),sizeof(short),ptr->tt_size[index_md]*ptr->l_size[index_md],_TRUE_),
+                 pcs->error_message,pcs->error_message);
+    }
+    class_call(checkpoint_array(pcs,(void**)&(ptr->k[index_md]),sizeof(double),(long long)ptr->q_size,_TRUE_),
+               pcs->error_message,pcs->error_message);
+
+    /* in float or int16 storage, the double precision tables are NULL */
+    class_call(checkpoint_array(pcs,(void**)&(ptr->transfer[index_md]),sizeof(double),block_num*ptr->q_size,_TRUE_),
+               pcs->error_message,pcs->error_message);
+
+    if (has_float == _TRUE_) {
+      class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_float[index_md]),sizeof(float),block_num*ptr->q_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+    }
+    if (has_int16 == _TRUE_) {
+      class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_int16[index_md]),sizeof(short),block_num*ptr->q_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_scale[index_md]),sizeof(double),block_num,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+    }
+
+    if (has_limber == _TRUE_) {
+      class_call(checkpoint_array(pcs,(void**)&(ptr->k_limber[index_md]),sizeof(double),(long long)ptr->q_size_limber,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_limber[index_md]),sizeof(double),block_num*ptr->q_size_limber,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      if (has_float == _TRUE_) {
+        class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_limber_float[index_md]),sizeof(float),block_num*ptr->q_size_limber,_TRUE_),
+                   pcs->error_message,pcs->error_message);
+      }
+      if (has_int16 == _TRUE_) {
+        class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_limber_int16[index_md]),sizeof(short),block_num*ptr->q_size_limber,_TRUE_),
+                   pcs->error_message,pcs->error_message);
+        class_call(checkpoint_array(pcs,(void**)&(ptr->transfer_limber_scale[index_md]),sizeof(double),block_num,_TRUE_),
+                   pcs->error_message,pcs->error_message);
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read the harmonic structure. When reading, the pointer to
+ * the fourier structure is set by the caller.
+ *
+ * @param pcs Input/Output: stream
+ * @param phr Input/Output: pointer to harmonic structure
+ * @return the error status
+ */
+
+static int checkpoint_harmonic(
+                               struct checkpoint_stream * pcs,
+                               struct harmonic * phr
+                               ) {
+
+  short has, has_cls;
+  int index_md;
+
+  class_call(checkpoint_bytes(pcs,phr,sizeof(struct harmonic)),
+             pcs->error_message,
+             pcs->error_message);
+
+  if (pcs->reading == _TRUE_) {
+    memset(&(phr->stats),0,sizeof(struct class_stats));
+    phr->pfo = NULL;
+  }
+
+  has = (phr->md_size > 0);
+  has_cls = ((has == _TRUE_) && (phr->ct_size > 0));
+
+  class_call(checkpoint_array(pcs,(void**)&(phr->ic_size),sizeof(int),phr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(phr->ic_ic_size),sizeof(int),phr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(phr->l_max),sizeof(int),phr->md_size,has_cls),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(phr->l_size),sizeof(int),phr->md_size,has_cls),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(phr->l),sizeof(double),phr->l_size_max,has_cls),
+             pcs->error_message,pcs->error_message);
+
+  class_call(checkpoint_pointers(pcs,(void***)&(phr->is_non_zero),phr->md_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(phr->l_max_ct),phr->md_size,has_cls),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(phr->cl),phr->md_size,has_cls),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_pointers(pcs,(void***)&(phr->ddcl),phr->md_size,has_cls),
+             pcs->error_message,pcs->error_message);
+
+  if (has == _FALSE_)
+    return _SUCCESS_;
+
+  for (index_md = 0; index_md < phr->md_size; index_md++) {
+    class_call(checkpoint_array(pcs,(void**)&(phr->is_non_zero[index_md]),sizeof(short),phr->ic_ic_size[index_md],_TRUE_),
+               pcs->error_message,pcs->error_message);
+    if (has_cls == _TRUE_) {
+      class_call(checkpoint_array(pcs,(void**)&(phr->l_max_ct[index_md]),sizeof(int),phr->ct_size,_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      class_call(checkpoint_array(pcs,(void**)&(phr->cl[index_md]),sizeof(double),
+                                  (long long)phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md],_TRUE_),
+                 pcs->error_message,pcs->error_message);
+      class_call(checkpoint_array(pcs,(void**)&(phr->ddcl[index_md]),sizeof(double),
+                                  (long long)phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md],_TRUE_),
+                 pcs->error_message,pcs->error_message);
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read the lensing structure.
+ *
+ * @param pcs Input/Output: stream
+ * @param ple Input/Output: pointer to lensing structure
+ * @return the error status
+ */
+
+static int checkpoint_lensing(
+                              struct checkpoint_stream * pcs,
+                              struct lensing * ple
+                              ) {
+
+  short has;
+
+  class_call(checkpoint_bytes(pcs,ple,sizeof(struct lensing)),
+             pcs->error_message,
+             pcs->error_message);
+
+  if (pcs->reading == _TRUE_)
+    memset(&(ple->stats),0,sizeof(struct class_stats));
+
+  has = ple->has_lensed_cls;
+
+  class_call(checkpoint_array(pcs,(void**)&(ple->l),sizeof(double),ple->l_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ple->cl_lens),sizeof(double),(long long)ple->l_size*ple->lt_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ple->ddcl_lens),sizeof(double),(long long)ple->l_size*ple->lt_size,has),
+             pcs->error_message,pcs->error_message);
+  class_call(checkpoint_array(pcs,(void**)&(ple->l_max_lt),sizeof(int),ple->lt_size,has),
+             pcs->error_message,pcs->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write or read the structure of one module.
+ */
+
+static int checkpoint_module(
+                             struct checkpoint_stream * pcs,
+                             int index_module,
+                             struct background * pba,
+                             struct thermodynamics * pth,
+                             struct perturbations * ppt,
+                             struct transfer * ptr,
+                             struct harmonic * phr,
+                             struct lensing * ple
+                             ) {
+
+  switch (index_module) {
+  case module_background:
+    class_call(checkpoint_background(pcs,pba),pcs->error_message,pcs->error_message);
+    break;
+  case module_thermodynamics:
+    class_call(checkpoint_thermodynamics(pcs,pth),pcs->error_message,pcs->error_message);
+    break;
+  case module_perturbations:
+    class_call(checkpoint_perturbations(pcs,pba,pth,ppt),pcs->error_message,pcs->error_message);
+    break;
+  case module_transfer:
+    class_call(checkpoint_transfer(pcs,ppt,ptr),pcs->error_message,pcs->error_message);
+    break;
+  case module_harmonic:
+    class_call(checkpoint_harmonic(pcs,phr),pcs->error_message,pcs->error_message);
+    break;
+  case module_lensing:
+    class_call(checkpoint_lensing(pcs,ple),pcs->error_message,pcs->error_message);
+    break;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Size of the structure of each module, 0 for those which are not saved
+ */
+
+static void checkpoint_struct_sizes(
+                                    int * struct_size
+                                    ) {
+
+  int index_module;
+
+  for (index_module = 0; index_module < module_size; index_module++)
+    struct_size[index_module] = 0;
+
+  struct_size[module_background] = (int)sizeof(struct background);
+  struct_size[module_thermodynamics] = (int)sizeof(struct thermodynamics);
+  struct_size[module_perturbations] = (int)sizeof(struct perturbations);
+  struct_size[module_transfer] = (int)sizeof(struct transfer);
+  struct_size[module_harmonic] = (int)sizeof(struct harmonic);
+  struct_size[module_lensing] = (int)sizeof(struct lensing);
+}
+
+/**
+ * Print the list of modules of a set of flags
+ */
+
+static void checkpoint_print_modules(
+                                     int modules
+                                     ) {
+
+  int index_module;
+  short first = _TRUE_;
+
+  for (index_module = 0; index_module < module_size; index_module++) {
+    if ((modules & (1 << index_module)) != 0) {
+      printf("%s%s",(first == _TRUE_) ? "" : ", ",checkpoint_names[index_module]);
+      first = _FALSE_;
+    }
+  }
+  if (first == _TRUE_)
+    printf("none");
+}
+
+/**
+ * Save the structures of the computed modules in a checkpoint file.
+ *
+ * The modules are saved in the order in which they are computed, up
+ * to the first one which was not computed or cannot be saved: the
+ * thermodynamics with exotic energy injection (whose tables are not
+ * saved), and the perturbations when their output for k_output_values
+ * is streamed through temporary files. The file is written under a
+ * temporary name and then renamed, such that a checkpoint is either
+ * complete or absent.
+ *
+ * @param file_name     Input: name of the checkpoint file
+ * @param digest        Input: digests of the input of each module (see input_module_digests())
+ * @param modules       Input: flags (1 << module_xxx) of the computed modules
+ * @param pba           Input: pointer to background structure
+ * @param pth           Input: pointer to thermodynamics structure
+ * @param ppt           Input: pointer to perturbations structure
+ * @param ptr           Input: pointer to transfer structure
+ * @param phr           Input: pointer to harmonic structure
+ * @param ple           Input: pointer to lensing structure
+ * @param verbose       Input: whether to print the list of saved modules
+ * @param written       Output: flags of the saved modules
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int checkpoint_write(
+                     char * file_name,
+                     unsigned long long * digest,
+                     int modules,
+                     struct background * pba,
+                     struct thermodynamics * pth,
+                     struct perturbations * ppt,
+                     struct transfer * ptr,
+                     struct harmonic * phr,
+                     struct lensing * ple,
+                     short verbose,
+                     int * written,
+                     ErrorMsg error_message
+                     ) {
+
+  struct checkpoint_stream cs;
+  struct checkpoint_header header;
+  char * tmp_name;
+  int index_module, filenum, status;
+  short can_save;
+
+  /** - find the modules to save */
+  *written = 0;
+  for (index_module = 0; index_module < module_size; index_module++) {
+    if ((_CHECKPOINT_MODULES_ & (1 << index_module)) == 0)
+      continue;
+    can_save = ((modules & (1 << index_module)) != 0);
+    if ((index_module == module_thermodynamics) && (pth->has_exotic_injection == _TRUE_))
+      can_save = _FALSE_;
+    if ((index_module == module_perturbations) && (ppt->has_perturbations == _TRUE_)) {
+      for (filenum = 0; filenum < _MAX_NUMBER_OF_K_FILES_; filenum++) {
+        if ((ppt->scalar_perturbations_file[filenum] != NULL) ||
+            (ppt->vector_perturbations_file[filenum] != NULL) ||
+            (ppt->tensor_perturbations_file[filenum] != NULL))
+          can_save = _FALSE_;
+      }
+    }
+    if (can_save == _FALSE_)
+      break;
+    *written |= (1 << index_module);
+  }
+
+  /** - write the header (completed with the position of each module at the end) and the modules */
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,"CLASSCKP",8);
+  header.version = _CHECKPOINT_VERSION_;
+  header.size_of_double = (int)sizeof(double);
+  header.size_of_pointer = (int)sizeof(void *);
+  checkpoint_struct_sizes(header.struct_size);
+  header.modules = *written;
+  memcpy(header.digest,digest,_NUM_INPUT_MODULES_*sizeof(unsigned long long));
+
+  class_alloc(tmp_name,strlen(file_name)+32,error_message);
+  sprintf(tmp_name,"%s.%ld.tmp",file_name,(long)getpid());
+
+  cs.reading = _FALSE_;
+  cs.file = fopen(tmp_name,"wb");
+  class_test_except(cs.file == NULL,
+                    error_message,
+                    free(tmp_name),
+                    "could not open the checkpoint file %s",tmp_name);
+
+  status = checkpoint_bytes(&cs,&header,sizeof(header));
+  for (index_module = 0; (index_module < module_size) && (status == _SUCCESS_); index_module++) {
+    if ((*written & (1 << index_module)) != 0) {
+      header.offset[index_module] = (long long)ftell(cs.file);
+      status = checkpoint_module(&cs,index_module,pba,pth,ppt,ptr,phr,ple);
+    }
+  }
+  if ((status == _SUCCESS_) && (fseek(cs.file,0,SEEK_SET) == 0))
+    status = checkpoint_bytes(&cs,&header,sizeof(header));
+
+  if ((fclose(cs.file) != 0) && (status == _SUCCESS_)) {
+    status = _FAILURE_;
+    class_sprintf(cs.error_message,"could not write the checkpoint file %s",tmp_name);
+  }
+  if ((status == _SUCCESS_) && (rename(tmp_name,file_name) != 0)) {
+    status = _FAILURE_;
+    class_sprintf(cs.error_message,"could not rename the checkpoint file %s into %s",tmp_name,file_name);
+  }
+  if (status == _FAILURE_)
+    remove(tmp_name);
+  free(tmp_name);
+
+  class_test(status == _FAILURE_,
+             error_message,
+             "%s",cs.error_message);
+
+  if (verbose > 0) {
+    printf(" -> saved ");
+    checkpoint_print_modules(*written);
+    printf(" in checkpoint %s\n",file_name);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Restore the structures of some modules from a checkpoint file,
+ * before calling modules_init() for the other ones.
+ *
+ * The structures must have been filled by the input module for the
+ * current run (the arrays allocated by the input module are kept).
+ * The modules which are not in the requested list are assumed to be
+ * already initialized. The requested modules are restored in the
+ * order in which they are computed, up to the first one which cannot
+ * be: either because it is not saved in the file, or because its
+ * input, or that of a module on which it depends, differs from the
+ * input of the checkpoint. The primordial and fourier modules, on
+ * which the transfer and harmonic ones depend, are not saved: they
+ * will be computed again, and are only compared through their digest.
+ *
+ * @param file_name     Input: name of the checkpoint file
+ * @param digest        Input: digests of the input of each module for the current run (see input_module_digests())
+ * @param modules       Input: flags (1 << module_xxx) of the modules to restore if possible
+ * @param pba           Input/Output: pointer to background structure
+ * @param pth           Input/Output: pointer to thermodynamics structure
+ * @param ppt           Input/Output: pointer to perturbations structure
+ * @param pfo           Input: pointer to fourier structure (filled by the input module)
+ * @param ptr           Input/Output: pointer to transfer structure
+ * @param phr           Input/Output: pointer to harmonic structure
+ * @param ple           Input/Output: pointer to lensing structure
+ * @param verbose       Input: whether to print the list of restored modules
+ * @param restored      Output: flags of the restored modules
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int checkpoint_read(
+                    char * file_name,
+                    unsigned long long * digest,
+                    int modules,
+                    struct background * pba,
+                    struct thermodynamics * pth,
+                    struct perturbations * ppt,
+                    struct fourier * pfo,
+                    struct transfer * ptr,
+                    struct harmonic * phr,
+                    struct lensing * ple,
+                    short verbose,
+                    int * restored,
+                    ErrorMsg error_message
+                    ) {
+
+  struct checkpoint_stream cs;
+  struct checkpoint_header header;
+  int struct_size[module_size];
+  short was_computed[_NUM_INPUT_MODULES_];
+  short can_reuse[_NUM_INPUT_MODULES_];
+  int index_module;
+
+  *restored = 0;
+
+  /** - read and check the header */
+  class_open(cs.file,file_name,"rb",error_message);
+  cs.reading = _TRUE_;
+
+  class_call_except(checkpoint_bytes(&cs,&header,sizeof(header)),
+                    cs.error_message,
+                    error_message,
+                    fclose(cs.file));
+
+  checkpoint_struct_sizes(struct_size);
+
+  class_test_except((memcmp(header.magic,"CLASSCKP",8) != 0) ||
+                    (header.version != _CHECKPOINT_VERSION_) ||
+                    (header.size_of_double != (int)sizeof(double)) ||
+                    (header.size_of_pointer != (int)sizeof(void *)) ||
+                    (memcmp(header.struct_size,struct_size,sizeof(struct_size)) != 0),
+                    error_message,
+                    fclose(cs.file),
+                    "%s is not a checkpoint file written by this build of CLASS",file_name);
+
+  /** - find the modules whose input is that of the checkpoint. The
+      indices of enum input_module and enum class_module are the
+      same; the modules which are not saved will be computed again
+      from the current input. */
+  for (index_module = 0; index_module < _NUM_INPUT_MODULES_; index_module++) {
+    was_computed[index_module] = ((index_module >= module_size) ||
+                                  ((_CHECKPOINT_MODULES_ & (1 << index_module)) == 0) ||
+                                  ((header.modules & (1 << index_module)) != 0));
+  }
+  class_call_except(input_module_reuse(header.digest,digest,was_computed,(pfo->method != nl_none),can_reuse),
+                    error_message,
+                    error_message,
+                    fclose(cs.file));
+
+  /** - restore the requested modules */
+  for (index_module = 0; index_module < module_size; index_module++) {
+    if (((_CHECKPOINT_MODULES_ & (1 << index_module)) == 0) || ((modules & (1 << index_module)) == 0))
+      continue;
+    if (((header.modules & (1 << index_module)) == 0) || (can_reuse[index_module] == _FALSE_))
+      break;
+    class_test_except(fseek(cs.file,(long)header.offset[index_module],SEEK_SET) != 0,
+                      error_message,
+                      fclose(cs.file),
+                      "could not find the %s module in the checkpoint file %s",checkpoint_names[index_module],file_name);
+    class_call_except(checkpoint_module(&cs,index_module,pba,pth,ppt,ptr,phr,ple),
+                      cs.error_message,
+                      error_message,
+                      fclose(cs.file));
+    *restored |= (1 << index_module);
+  }
+
+  fclose(cs.file);
+
+  if ((*restored & (1 << module_harmonic)) != 0)
+    phr->pfo = pfo;
+
+  if (verbose > 0) {
+    printf("Restored ");
+    checkpoint_print_modules(*restored);
+    printf(" from checkpoint %s\n",file_name);
+  }
+
+  return _SUCCESS_;
+}
@@ -11,6 +11,7 @@
  */
 
 #include "distortions.h"
+#include <unistd.h>
 
 /**
  * Initialize the distortions structure.
@@ -31,9 +32,13 @@ int distortions_init(struct precision * ppr,
                      struct primordial * ppm,
                      struct distortions * psd) {
 
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(psd->stats));
+
   if (psd->has_distortions == _FALSE_) {
     if (psd->distortions_verbose > 0)
       printf("No distortions requested. Distortions module skipped.\n");
+    class_timer_end(&(psd->stats));
     return _SUCCESS_;
   }
   if (psd->distortions_verbose > 0) {
@@ -83,6 +88,8 @@ int distortions_init(struct precision * ppr,
 
   psd->is_allocated = _TRUE_;
 
+  class_timer_end(&(psd->stats));
+
   return _SUCCESS_;
 }
 
@@ -164,7 +171,6 @@ int distortions_constants(struct precision * ppr,
     pow(pba->Omega0_b*pow(pba->h,2.)/0.02225,-2./5.)*
     pow(pba->T_cmb/2.726,1./5.);
 
-  class_sprintf(psd->sd_PCA_file_generator,"%s/%s",ppr->sd_external_path,"generate_PCA_files.py");
   class_sprintf(psd->sd_detector_list_file,"%s/%s",ppr->sd_external_path,"detectors_list.dat");
 
   return _SUCCESS_;
@@ -334,6 +340,13 @@ int distortions_set_detector(struct precision * ppr,
 
   fclose(det_list_file);
 
+  /* The frequencies and noise of a detector defined by a file are needed to generate it */
+  if (psd->has_detector_file ==_TRUE_) {
+    class_call(distortions_read_detector_noisefile(ppr,psd),
+               psd->error_message,
+               psd->error_message);
+  }
+
   /* If the detector has not been found, either the user has specified the settings and we create a new one,
    * or the user hasn't specified the settings and we have to stop */
   if (found_detector == _FALSE_) {
@@ -353,18 +366,20 @@ int distortions_set_detector(struct precision * ppr,
     }
   }
 
-  if (psd->has_detector_file ==_TRUE_) {
-    class_call(distortions_read_detector_noisefile(ppr,psd),
-               psd->error_message,
-               psd->error_message);
-  }
-
   return _SUCCESS_;
 }
 
 /**
  * Evaluate branching ratios, spectral shapes, E and S vectors for a given detector as
- * described in external/distortions/README using generate_PCA_files.py.
+ * described in external/distortions/README (following the algorithm of
+ * generate_PCA_files.py): the Green's function of Greens_data.dat is
+ * interpolated on the frequencies of the detector, the branching ratios
+ * are obtained by projecting it on the orthonormalized G, Y and M
+ * shapes, and the E vectors are the principal components of the Fisher
+ * matrix of the residual. The two tables are written in sd_external_path
+ * and kept in memory for distortions_read_br_data() and
+ * distortions_read_sd_data(), and the detector is added to
+ * detectors_list.dat.
  *
  * @param ppr        Input: pointer to precision structure
  * @param psd        Input: pointer to the distortions structure
@@ -375,60 +390,405 @@ int distortions_generate_detector(struct precision * ppr,
                                   struct distortions * psd){
 
   /** Define local variables*/
-  int is_success;
-  char temporary_string[2*_FILENAMESIZE_+2*_MAX_DETECTOR_NAME_LENGTH_+1024];
+  struct data_file * pgreens, * pnoise;
+  DetectorFileName file_name;
+  FILE * list_file;
+  short use_binary = ((ppr->sd_binary_files == _TRUE_) || (ppr->data_binary_files == _TRUE_));
+  int Nz_g,Nx_g,Nz,Nx,K=_SD_DETECTOR_PCA_SIZE_;
+  int index_z,index_x,index_k,index_zb,index_x_old=0,index_x_splined=-1,last_index=0;
+  double * greens_z, * greens_T_ini, * greens_T_last, * greens_drho, * greens_rows;
+  double * lnz_greens, * background_lines, * dd_background_lines, * G_lines, * dd_G_lines;
+  double * z, * lnz, * nu, * x, * weight, * T_ratio, * drho, * bb_vis;
+  double * G_th, * Gdist, * Ydist, * Mdist, * e_Y, * e_M, * e_G;
+  double * f_g, * f_y, * f_mu, * residual, * fisher, * eigenvalues, * br_table, * sd_table;
+  double values[3],x_s,frac,dlnz,norm_Y,norm_M,norm_G,M_Y,G_Y,G_M,sum_G,sum_M,sum_Y,max_component;
+
+  /** - read the Green's function (a stream of numbers: sizes, z, T_ini, T_last, drho, then rows of x, G_th(z), blackbody) */
+  class_sprintf(file_name,"%s/Greens_data.dat",ppr->sd_external_path);
+  class_call(data_file_get(file_name,data_file_columns,1,use_binary,&pgreens,psd->error_message),
+             psd->error_message,
+             psd->error_message);
 
+  class_test(pgreens->rows < 2,
+             psd->error_message,
+             "could not read the sizes of the Green's function in file '%s'",file_name);
+  Nz_g = (int)pgreens->data[0];
+  Nx_g = (int)pgreens->data[1];
+  class_test((Nz_g < 3) || (Nx_g < 2) || (pgreens->rows < 2+4*Nz_g+Nx_g*(Nz_g+2)),
+             psd->error_message,
+             "the file '%s' should contain %d redshifts and %d frequencies",file_name,Nz_g,Nx_g);
 
-  /* Test first whether or not python exists*/
-  if (psd->distortions_verbose > 0) {
-    printf(" -> Testing python\n");
-  }
-  is_success = system("python --version");
-  class_test(is_success == -1,
+  greens_z = pgreens->data+2;
+  greens_T_ini = greens_z+Nz_g;
+  greens_T_last = greens_T_ini+Nz_g;
+  greens_drho = greens_T_last+Nz_g;
+  greens_rows = greens_drho+Nz_g;
+
+  /** - redshifts and frequencies of the detector */
+  Nz = ppr->sd_z_size;
+  class_test(Nz < K,
              psd->error_message,
-             "The command 'python --version' failed.\nPlease install a valid version of python.");
+             "sd_z_size=%d should be at least the number of principal components %d",Nz,K);
 
-  /* Then activate the PCA generator*/
-  if (psd->distortions_verbose > 0) {
-    printf(" -> Executing the PCA generator\n");
+  if (psd->has_detector_file == _TRUE_) {
+    Nx = psd->x_size;
+  }
+  else {
+    Nx = psd->sd_detector_bin_number+1;
+  }
+  class_test(Nx < 4,
+             psd->error_message,
+             "the detector '%s' should have at least 4 frequencies, not %d",psd->sd_detector_name,Nx);
+
+  class_alloc(z,Nz*sizeof(double),psd->error_message);
+  class_alloc(lnz,Nz*sizeof(double),psd->error_message);
+  class_alloc(T_ratio,Nz*sizeof(double),psd->error_message);
+  class_alloc(drho,Nz*sizeof(double),psd->error_message);
+  class_alloc(bb_vis,Nz*sizeof(double),psd->error_message);
+  class_alloc(f_g,Nz*sizeof(double),psd->error_message);
+  class_alloc(f_y,Nz*sizeof(double),psd->error_message);
+  class_alloc(f_mu,Nz*sizeof(double),psd->error_message);
+  class_alloc(nu,Nx*sizeof(double),psd->error_message);
+  class_alloc(x,Nx*sizeof(double),psd->error_message);
+  class_alloc(weight,Nx*sizeof(double),psd->error_message);
+  class_alloc(Gdist,Nx*sizeof(double),psd->error_message);
+  class_alloc(Ydist,Nx*sizeof(double),psd->error_message);
+  class_alloc(Mdist,Nx*sizeof(double),psd->error_message);
+  class_alloc(e_Y,Nx*sizeof(double),psd->error_message);
+  class_alloc(e_M,Nx*sizeof(double),psd->error_message);
+  class_alloc(e_G,Nx*sizeof(double),psd->error_message);
+  class_alloc(G_th,Nx*Nz*sizeof(double),psd->error_message);
+  class_alloc(residual,Nx*Nz*sizeof(double),psd->error_message);
+  class_alloc(fisher,Nz*Nz*sizeof(double),psd->error_message);
+  class_alloc(eigenvalues,Nz*sizeof(double),psd->error_message);
+  class_alloc(br_table,Nz*(4+K)*sizeof(double),psd->error_message);
+  class_alloc(sd_table,Nx*(4+K)*sizeof(double),psd->error_message);
+
+  dlnz = log(ppr->sd_z_max/ppr->sd_z_min)/(Nz-1);
+  for (index_z=0; index_z<Nz; index_z++) {
+    z[index_z] = ppr->sd_z_min*exp(index_z*dlnz);
+    lnz[index_z] = log(1.+z[index_z]);
+    bb_vis[index_z] = exp(-pow(z[index_z]/psd->z_th,2.5));
   }
 
+  /* the frequencies are stored as given (the detector noise file is already in memory),
+     since they are compared to the frequencies of the output; the weight of each
+     frequency in the Fisher matrix is 1/(noise)^2 */
   if (psd->has_detector_file == _TRUE_) {
-    class_sprintf(temporary_string,"python %s %s %s %s %.10e %.10e %i %i %.10e %.10e %.10e",
-            psd->sd_PCA_file_generator,
-            psd->sd_detector_name,
-            ppr->sd_external_path,
-            psd->sd_detector_file_name,
-            ppr->sd_z_min,
-            ppr->sd_z_max,
-            ppr->sd_z_size,
-            6,
-            psd->z_th,
-            psd->DI_units,
-            psd->x_to_nu);
+    class_call(distortions_get_table(ppr,psd,psd->sd_detector_noise_file,0,&pnoise),
+               psd->error_message,
+               psd->error_message);
+  }
+  for (index_x=0; index_x<Nx; index_x++) {
+    if (psd->has_detector_file == _TRUE_) {
+      nu[index_x] = pnoise->data[index_x];
+      weight[index_x] = pow(dlnz/psd->delta_Ic_array[index_x]*1.e8,2);
+    }
+    else {
+      nu[index_x] = psd->sd_detector_nu_min+index_x*(psd->sd_detector_nu_max-psd->sd_detector_nu_min)/(Nx-1);
+      weight[index_x] = pow(dlnz/psd->sd_detector_delta_Ic*1.e8,2);
+    }
+    x[index_x] = nu[index_x]/psd->x_to_nu;
+  }
+  if (psd->has_detector_file == _TRUE_) {
+    data_file_release(pnoise);
+  }
+
+  /** - interpolate T_ini/T_last and drho of the Green's function at each redshift */
+  class_alloc(lnz_greens,Nz_g*sizeof(double),psd->error_message);
+  class_alloc(background_lines,3*Nz_g*sizeof(double),psd->error_message);
+  class_alloc(dd_background_lines,3*Nz_g*sizeof(double),psd->error_message);
+  class_alloc(G_lines,2*Nz_g*sizeof(double),psd->error_message);
+  class_alloc(dd_G_lines,2*Nz_g*sizeof(double),psd->error_message);
+
+  for (index_z=0; index_z<Nz_g; index_z++) {
+    lnz_greens[index_z] = log(1.+greens_z[index_z]);
+    background_lines[3*index_z] = greens_T_ini[index_z];
+    background_lines[3*index_z+1] = greens_T_last[index_z];
+    background_lines[3*index_z+2] = greens_drho[index_z];
+  }
+
+  class_call(array_spline_table_lines(lnz_greens,Nz_g,background_lines,3,dd_background_lines,_SPLINE_EST_DERIV_,psd->error_message),
+             psd->error_message,
+             psd->error_message);
 
+  for (index_z=0; index_z<Nz; index_z++) {
+    class_call(array_interpolate_spline(lnz_greens,Nz_g,background_lines,dd_background_lines,3,lnz[index_z],&last_index,values,3,psd->error_message),
+               psd->error_message,
+               psd->error_message);
+    T_ratio[index_z] = values[0]/values[1];
+    drho[index_z] = values[2];
+  }
+
+  /** - spectral shapes, and Green's function interpolated linearly in x and with splines in ln(1+z) (with
+        estimated derivatives at the ends, where generate_PCA_files.py used the not-a-knot condition) */
+  for (index_x=0; index_x<Nx; index_x++) {
+
+    Gdist[index_x] = pow(x[index_x],4)*exp(x[index_x])/pow(expm1(x[index_x]),2)*psd->DI_units*1.e18;
+    Ydist[index_x] = Gdist[index_x]*(x[index_x]/tanh(x[index_x]/2.)-4.);
+    Mdist[index_x] = Gdist[index_x]*(1./2.19229-1./x[index_x]);
+
+    class_test((x[index_x] < greens_rows[0]) || (x[index_x] > greens_rows[(size_t)(Nx_g-1)*(Nz_g+2)]),
+               psd->error_message,
+               "x=%e is not in the range [%e,%e] of the file '%s'",
+               x[index_x],greens_rows[0],greens_rows[(size_t)(Nx_g-1)*(Nz_g+2)],file_name);
+
+    /* as in generate_PCA_files.py, the interpolation uses the first point of the file at or above x and
+       the next one (slightly extrapolating), which reproduces the tables it generated */
+    while ((index_x_old < Nx_g-2) && (greens_rows[(size_t)index_x_old*(Nz_g+2)] < x[index_x]))
+      index_x_old++;
+
+    if (index_x_old != index_x_splined) {
+      for (index_z=0; index_z<Nz_g; index_z++) {
+        G_lines[2*index_z] = greens_rows[(size_t)index_x_old*(Nz_g+2)+1+index_z];
+        G_lines[2*index_z+1] = greens_rows[(size_t)(index_x_old+1)*(Nz_g+2)+1+index_z];
+      }
+      class_call(array_spline_table_lines(lnz_greens,Nz_g,G_lines,2,dd_G_lines,_SPLINE_EST_DERIV_,psd->error_message),
+                 psd->error_message,
+                 psd->error_message);
+      index_x_splined = index_x_old;
+    }
+
+    frac = (x[index_x]-greens_rows[(size_t)index_x_old*(Nz_g+2)])
+      /(greens_rows[(size_t)(index_x_old+1)*(Nz_g+2)]-greens_rows[(size_t)index_x_old*(Nz_g+2)]);
+
+    for (index_z=0; index_z<Nz; index_z++) {
+      class_call(array_interpolate_spline(lnz_greens,Nz_g,G_lines,dd_G_lines,2,lnz[index_z],&last_index,values,2,psd->error_message),
+                 psd->error_message,
+                 psd->error_message);
+
+      /* the Green's function of the file has part of the G_T distortion moved into a shift from T_ini to T_last, added back here */
+      x_s = T_ratio[index_z]*x[index_x];
+      G_th[index_x*Nz+index_z] = ((values[0]*(1.-frac)+values[1]*frac)*bb_vis[index_z]
+                                  +psd->DI_units*1.e26*pow(x[index_x],3)*(1./expm1(x_s)-1./expm1(x[index_x]))/drho[index_z])*1.e-8;
+    }
+  }
+  data_file_release(pgreens);
+
+  /** - orthonormalize the Y, M and G shapes */
+  norm_Y = 0.;
+  for (index_x=0; index_x<Nx; index_x++)
+    norm_Y += Ydist[index_x]*Ydist[index_x];
+  norm_Y = sqrt(norm_Y);
+
+  M_Y = 0.;
+  G_Y = 0.;
+  for (index_x=0; index_x<Nx; index_x++) {
+    e_Y[index_x] = Ydist[index_x]/norm_Y;
+    M_Y += e_Y[index_x]*Mdist[index_x];
+    G_Y += e_Y[index_x]*Gdist[index_x];
+  }
+
+  norm_M = 0.;
+  for (index_x=0; index_x<Nx; index_x++) {
+    e_M[index_x] = Mdist[index_x]-M_Y*e_Y[index_x];
+    norm_M += e_M[index_x]*e_M[index_x];
+  }
+  norm_M = sqrt(norm_M);
+
+  G_M = 0.;
+  for (index_x=0; index_x<Nx; index_x++) {
+    e_M[index_x] /= norm_M;
+    G_M += e_M[index_x]*Gdist[index_x];
+  }
+
+  norm_G = 0.;
+  for (index_x=0; index_x<Nx; index_x++) {
+    e_G[index_x] = Gdist[index_x]-G_Y*e_Y[index_x]-G_M*e_M[index_x];
+    norm_G += e_G[index_x]*e_G[index_x];
+  }
+  norm_G = sqrt(norm_G);
+  for (index_x=0; index_x<Nx; index_x++)
+    e_G[index_x] /= norm_G;
+
+  /** - branching ratios, from the projections of the Green's function, and residual */
+  for (index_z=0; index_z<Nz; index_z++) {
+    sum_G = 0.;
+    sum_M = 0.;
+    sum_Y = 0.;
+    for (index_x=0; index_x<Nx; index_x++) {
+      sum_G += G_th[index_x*Nz+index_z]*e_G[index_x];
+      sum_M += G_th[index_x*Nz+index_z]*e_M[index_x];
+      sum_Y += G_th[index_x*Nz+index_z]*e_Y[index_x];
+    }
+    f_g[index_z] = sum_G/norm_G;
+    f_mu[index_z] = (sum_M-G_M*f_g[index_z])/norm_M;
+    f_y[index_z] = (sum_Y-M_Y*f_mu[index_z]-G_Y*f_g[index_z])/norm_Y;
+
+    for (index_x=0; index_x<Nx; index_x++) {
+      residual[index_x*Nz+index_z] = G_th[index_x*Nz+index_z]
+        -Gdist[index_x]*f_g[index_z]-Ydist[index_x]*f_y[index_z]-Mdist[index_x]*f_mu[index_z];
+    }
+  }
+
+  /** - Fisher matrix of the residual, and its principal components */
+  for (index_z=0; index_z<Nz; index_z++) {
+    for (index_zb=index_z; index_zb<Nz; index_zb++) {
+      sum_G = 0.;
+      for (index_x=0; index_x<Nx; index_x++)
+        sum_G += residual[index_x*Nz+index_z]*residual[index_x*Nz+index_zb]*weight[index_x];
+      fisher[index_z*Nz+index_zb] = sum_G;
+      fisher[index_zb*Nz+index_z] = sum_G;
+    }
+  }
+
+  class_call(array_symmetric_eigen(fisher,Nz,eigenvalues,psd->error_message),
+             psd->error_message,
+             psd->error_message);
+
+  /** - fill the tables: z, f_g, f_y, f_mu, E_k (largest eigenvalues first), and nu, G_T, Y_SZ, M_mu, S_k */
+  for (index_z=0; index_z<Nz; index_z++) {
+    br_table[index_z] = z[index_z];
+    br_table[Nz+index_z] = f_g[index_z];
+    br_table[2*Nz+index_z] = f_y[index_z];
+    br_table[3*Nz+index_z] = f_mu[index_z];
+  }
+
+  for (index_k=0; index_k<K; index_k++) {
+    /* the sign of an eigenvector is arbitrary: make its largest component positive */
+    max_component = 0.;
+    for (index_z=0; index_z<Nz; index_z++) {
+      if (fabs(fisher[index_z*Nz+Nz-1-index_k]) > fabs(max_component))
+        max_component = fisher[index_z*Nz+Nz-1-index_k];
+    }
+    for (index_z=0; index_z<Nz; index_z++) {
+      br_table[(4+index_k)*Nz+index_z] = (max_component < 0. ? -1. : 1.)*fisher[index_z*Nz+Nz-1-index_k];
+    }
+  }
+
+  for (index_x=0; index_x<Nx; index_x++) {
+    sd_table[index_x] = nu[index_x];
+    sd_table[Nx+index_x] = Gdist[index_x];
+    sd_table[2*Nx+index_x] = Ydist[index_x];
+    sd_table[3*Nx+index_x] = Mdist[index_x];
+    for (index_k=0; index_k<K; index_k++) {
+      sum_G = 0.;
+      for (index_z=0; index_z<Nz; index_z++)
+        sum_G += br_table[(4+index_k)*Nz+index_z]*residual[index_x*Nz+index_z]*dlnz;
+      sd_table[(4+index_k)*Nx+index_x] = sum_G;
+    }
+  }
+
+  /** - write the tables, and keep them in memory for distortions_read_br_data() and distortions_read_sd_data() */
+  class_sprintf(file_name,"%s/%s_branching_ratios.dat",ppr->sd_external_path,psd->sd_detector_name);
+  class_call(distortions_write_detector_table(file_name,"z, J_T, J_y, J_mu, E_i",Nz,K,br_table,use_binary,psd->error_message),
+             psd->error_message,
+             psd->error_message);
+
+  class_sprintf(file_name,"%s/%s_distortions_shapes.dat",ppr->sd_external_path,psd->sd_detector_name);
+  class_call(distortions_write_detector_table(file_name,"nu, G_T, Y_SZ, M_mu, S_i",Nx,K,sd_table,use_binary,psd->error_message),
+             psd->error_message,
+             psd->error_message);
+
+  /** - add the detector to the list of known detectors */
+  class_open(list_file,psd->sd_detector_list_file,"a",psd->error_message);
+  if (psd->has_detector_file == _TRUE_) {
+    fprintf(list_file,"%s  %s\n",psd->sd_detector_name,psd->sd_detector_file_name);
   }
   else {
-    class_sprintf(temporary_string,"python %s %s %.10e %.10e %.10e  %i %.10e %.10e %i %.10e %i %.10e %.10e %.10e",
-            psd->sd_PCA_file_generator,
+    fprintf(list_file,"%s  %.6e  %.6e  %.6e  %i  %.6e\n",
             psd->sd_detector_name,
             psd->sd_detector_nu_min,
             psd->sd_detector_nu_max,
             psd->sd_detector_nu_delta,
             psd->sd_detector_bin_number,
-            ppr->sd_z_min,
-            ppr->sd_z_max,
-            ppr->sd_z_size,
-            psd->sd_detector_delta_Ic,
-            6,
-            psd->z_th,
-            psd->DI_units,
-            psd->x_to_nu);
+            psd->sd_detector_delta_Ic);
   }
-  is_success = system(temporary_string);
-  class_test(is_success == -1,
+  class_test(fclose(list_file) != 0,
              psd->error_message,
-             "The command 'python %s' failed.\nPlease make sure the file exists.",psd->sd_PCA_file_generator);
+             "could not write the file '%s'",psd->sd_detector_list_file);
+
+  if (psd->distortions_verbose > 1) {
+    printf(" -> PCA of detector %s computed for %d redshifts and %d frequencies\n",psd->sd_detector_name,Nz,Nx);
+  }
+
+  /** - free local arrays */
+  free(z);
+  free(lnz);
+  free(T_ratio);
+  free(drho);
+  free(bb_vis);
+  free(f_g);
+  free(f_y);
+  free(f_mu);
+  free(nu);
+  free(x);
+  free(weight);
+  free(Gdist);
+  free(Ydist);
+  free(Mdist);
+  free(e_Y);
+  free(e_M);
+  free(e_G);
+  free(G_th);
+  free(residual);
+  free(fisher);
+  free(eigenvalues);
+  free(br_table);
+  free(sd_table);
+  free(lnz_greens);
+  free(background_lines);
+  free(dd_background_lines);
+  free(G_lines);
+  free(dd_G_lines);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write one of the two tables of a generated detector, in the format
+ * read by distortions_get_table() (header line with the number of rows
+ * and of E or S vectors), with enough digits for the numbers to be read
+ * back exactly. The file is written through a temporary file renamed at
+ * the end, and the table is then registered with data_file_set().
+ *
+ * @param file_name     Input: full path of the file
+ * @param description   Input: names of the columns, for the comment line
+ * @param rows          Input: number of rows
+ * @param vectors       Input: number of E or S vectors
+ * @param table         Input: table[index_column*rows+index_row], with 4+vectors columns
+ * @param use_binary    Input: whether to write a binary copy of the file
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int distortions_write_detector_table(char * file_name,
+                                     char * description,
+                                     int rows,
+                                     int vectors,
+                                     double * table,
+                                     short use_binary,
+                                     ErrorMsg error_message){
+
+  /** Define local variables */
+  char tmp_name[sizeof(DetectorFileName)+64];
+  FILE * outfile;
+  int header[2];
+  int index_row,index_column;
+
+  class_sprintf(tmp_name,"%s.%ld.%p.tmp",file_name,(long)getpid(),(void *)table);
+  class_open(outfile,tmp_name,"w",error_message);
+
+  fprintf(outfile,"# In the file there is: %s (i=1-%d)\n",description,vectors);
+  fprintf(outfile,"# The first line contains the number of lines and the number of columns.\n");
+  fprintf(outfile,"%d %d\n",rows,vectors);
+  for (index_row=0; index_row<rows; index_row++) {
+    for (index_column=0; index_column<4+vectors; index_column++) {
+      fprintf(outfile,"%s%.16e",(index_column == 0 ? "" : " "),table[index_column*rows+index_row]);
+    }
+    fprintf(outfile,"\n");
+  }
+
+  class_test_except((fclose(outfile) != 0) || (rename(tmp_name,file_name) != 0),
+                    error_message,
+                    remove(tmp_name),
+                    "could not write the file '%s'",file_name);
+
+  header[0] = rows;
+  header[1] = vectors;
+  class_call(data_file_set(file_name,data_file_rows_header,4,header,rows,4+vectors,table,use_binary,error_message),
+             error_message,
+             error_message);
 
   return _SUCCESS_;
 }
@@ -446,59 +806,31 @@ int distortions_read_detector_noisefile(struct precision * ppr,
                                         struct distortions * psd){
 
   /** Define local variables */
+  struct data_file * ptable;
   int index_x;
-  double nu_temp,delta_Ic_temp;
-  FILE * infile;
-  char line[_LINE_LENGTH_MAX_];
-  char * left;
-  int headlines = 0;
-  int numcols;
 
-  /** Open file */
+  /** Get the content of the file */
   class_sprintf(psd->sd_detector_noise_file,"%s/%s",ppr->sd_external_path,psd->sd_detector_file_name);
-  class_open(infile, psd->sd_detector_noise_file, "r", psd->error_message);
-
-  /** Read header */
-  psd->br_exact_Nz = 0;
-  while (fgets(line,_LINE_LENGTH_MAX_-1,infile) != NULL) {
-    headlines++;
+  class_call(distortions_get_table(ppr,psd,psd->sd_detector_noise_file,0,&ptable),
+             psd->error_message,
+             psd->error_message);
 
-    /* Eliminate blank spaces at beginning of line */
-    left=line;
-    while (left[0]==' ') {
-      left++;
-    }
+  class_test(ptable->columns != 2,
+             psd->error_message,
+             "Incorrect number of columns in the detector noise file '%s'",psd->sd_detector_noise_file);
 
-    if (left[0] > 39) {
-      /** Read number of lines, infer size of arrays and allocate them */
-      class_test(sscanf(line,"%d %d", &psd->x_size, &numcols) != 2,
-                 psd->error_message,
-                 "could not header (number of lines, number of columns) at line %i in file '%s' \n",headlines,psd->sd_detector_noise_file);
-      class_test(numcols !=2,
-                 psd->error_message,
-                 "Incorrect number of columns in the detector noise file '%s'",psd->sd_detector_noise_file);
+  /** Infer size of arrays and allocate them */
+  psd->x_size = ptable->rows;
 
-      class_alloc(psd->x, psd->x_size*sizeof(double), psd->error_message);
-      class_alloc(psd->delta_Ic_array, psd->x_size*sizeof(double), psd->error_message);
-      break;
-    }
-  }
+  class_alloc(psd->x, psd->x_size*sizeof(double), psd->error_message);
+  class_alloc(psd->delta_Ic_array, psd->x_size*sizeof(double), psd->error_message);
 
-  /** Read parameters */
+  /** Copy parameters */
   for (index_x=0; index_x<psd->x_size; ++index_x){
-    class_test(fscanf(infile, "%le",
-                      &(nu_temp))!=1,                                                 // [-]
-               psd->error_message,
-               "Could not read nu at line %i in file '%s'",index_x+headlines,psd->sd_detector_noise_file);
-    psd->x[index_x] = nu_temp/psd->x_to_nu;
-    class_test(fscanf(infile, "%le",
-                      &(delta_Ic_temp))!=1,                            // [-]
-               psd->error_message,
-               "Could not read delta_Ic(nu) at line %i in file '%s'",index_x+headlines,psd->sd_detector_noise_file);
-    psd->delta_Ic_array[index_x] = delta_Ic_temp*1e-26;
+    psd->x[index_x] = ptable->data[index_x]/psd->x_to_nu;
+    psd->delta_Ic_array[index_x] = ptable->data[psd->x_size+index_x]*1e-26;
   }
-
-  fclose(infile);
+  data_file_release(ptable);
 
   return _SUCCESS_;
 }
@@ -793,7 +1125,7 @@ int distortions_compute_heating_rate(struct precision* ppr,
   struct injection* pin = &(pth->in);
 
   int index_z;
-  double tau;
+  double *tau;
   int last_index_back;
   double *pvecback;
   double heat;
@@ -817,17 +1149,23 @@ int distortions_compute_heating_rate(struct precision* ppr,
               psd->z_size*sizeof(double*),
               psd->error_message);
 
+  /** Find the conformal time at each z, in one sweep of the background table */
+  class_alloc(tau,
+              psd->z_size*sizeof(double),
+              psd->error_message);
+  class_call(background_tau_of_z_array(pba,
+                                       psd->z,
+                                       psd->z_size,
+                                       tau),
+             pba->error_message,
+             psd->error_message);
+
   /* Loop over z and calculate the heating at each point */
   for (index_z=0; index_z<psd->z_size; ++index_z){
 
     /** Import quantities from background structure */
-    class_call(background_tau_of_z(pba,
-                                   psd->z[index_z],
-                                   &tau),
-               pba->error_message,
-               psd->error_message);
     class_call(background_at_tau(pba,
-                                 tau,
+                                 tau[index_z],
                                  long_info,
                                  inter_closeby,
                                  &last_index_back,
@@ -862,6 +1200,7 @@ int distortions_compute_heating_rate(struct precision* ppr,
     psd->dQrho_dz_tot[index_z] = heat*a/(H*rho_g);                // [-]
   }
 
+  free(tau);
   free(pvecback);
 
   if (psd->include_only_exotic == _FALSE_) {
@@ -955,7 +1294,7 @@ int distortions_compute_spectral_shapes(struct precision * ppr,
   }
   else {
     /* If PCA analysis is required, the shapes has to be vectorized. This is done in the external
-       file spectral_shapes.dat using generate_PCA_files.py */
+       file spectral_shapes.dat, generated by distortions_generate_detector() */
 
     /* Read and spline data from file spectral_shapes.dat */
     class_call(distortions_read_sd_data(ppr,psd),
@@ -1401,6 +1740,44 @@ int distortions_add_effects_reio(struct background * pba,
   return _SUCCESS_;
 }
 
+/**
+ * Return the content of one of the external files of the distortions
+ * module: after the comment lines, a header line gives the number of
+ * rows and an integer n, followed by rows of n+first_columns numbers.
+ * The file is read only once per process (or again if it has been
+ * modified in the meantime, e.g. by the PCA generator), see
+ * data_file_get(); the runs must not modify the table, and give it
+ * back with data_file_release(). If ppr->sd_binary_files or
+ * ppr->data_binary_files is true, the table is also read from (or
+ * written to) a binary copy of the file with extension .bin, as long
+ * as the text file is unchanged.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param psd           Input: pointer to the distortions structure
+ * @param file_name     Input: full path of the file
+ * @param first_columns Input: number of columns in each row, on top of the second number of the header line
+ * @param pptable       Output: pointer to the table
+ * @return the error status
+ */
+
+int distortions_get_table(struct precision * ppr,
+                          struct distortions * psd,
+                          char * file_name,
+                          int first_columns,
+                          struct data_file ** pptable){
+
+  class_call(data_file_get(file_name,
+                           data_file_rows_header,
+                           first_columns,
+                           ((ppr->sd_binary_files == _TRUE_) || (ppr->data_binary_files == _TRUE_)),
+                           pptable,
+                           psd->error_message),
+             psd->error_message,
+             psd->error_message);
+
+  return _SUCCESS_;
+}
+
 /**
  * Reads the external file branching_ratios calculated according to Chluba & Jeong 2014
  *
@@ -1413,71 +1790,35 @@ int distortions_read_br_data(struct precision * ppr,
                              struct distortions * psd){
 
   /** Define local variables */
-  int index_k,index_z;
-  FILE * infile;
+  struct data_file * ptable;
   DetectorFileName br_file;
-  char line[_LINE_LENGTH_MAX_];
-  char * left;
-  int headlines = 0;
+  int Nz;
 
-  /** Open file */
+  /** Get the content of the file */
   class_sprintf(br_file,"%s/%s_branching_ratios.dat", ppr->sd_external_path, psd->sd_detector_name);
-  class_open(infile, br_file, "r", psd->error_message);
-
-  /** Read header */
-  psd->br_exact_Nz = 0;
-  while (fgets(line,_LINE_LENGTH_MAX_-1,infile) != NULL) {
-    headlines++;
-
-    /* Eliminate blank spaces at beginning of line */
-    left=line;
-    while (left[0]==' ') {
-      left++;
-    }
-
-    if (left[0] > 39) {
-      /** Read number of lines, infer size of arrays and allocate them */
-      class_test(sscanf(line,"%d %d", &psd->br_exact_Nz, &psd->E_vec_size) != 2,
-                 psd->error_message,
-                 "could not header (number of lines, number of multipoles) at line %i in file '%s' \n",headlines,br_file);
+  class_call(distortions_get_table(ppr,psd,br_file,4,&ptable),
+             psd->error_message,
+             psd->error_message);
 
-      class_alloc(psd->br_exact_z, psd->br_exact_Nz*sizeof(double), psd->error_message);
-      class_alloc(psd->f_g_exact, psd->br_exact_Nz*sizeof(double), psd->error_message);
-      class_alloc(psd->f_y_exact, psd->br_exact_Nz*sizeof(double), psd->error_message);
-      class_alloc(psd->f_mu_exact, psd->br_exact_Nz*sizeof(double), psd->error_message);
+  /** Infer size of arrays and allocate them */
+  psd->br_exact_Nz = ptable->rows;
+  psd->E_vec_size = ptable->header[1];
+  Nz = psd->br_exact_Nz;
 
-      class_alloc(psd->E_vec, psd->br_exact_Nz*psd->E_vec_size*sizeof(double), psd->error_message);
-      break;
-    }
-  }
+  class_alloc(psd->br_exact_z, Nz*sizeof(double), psd->error_message);
+  class_alloc(psd->f_g_exact, Nz*sizeof(double), psd->error_message);
+  class_alloc(psd->f_y_exact, Nz*sizeof(double), psd->error_message);
+  class_alloc(psd->f_mu_exact, Nz*sizeof(double), psd->error_message);
 
-  /** Read parameters */
-  for (index_z=0; index_z<psd->br_exact_Nz; ++index_z){
-    class_test(fscanf(infile, "%le",
-                      &(psd->br_exact_z[index_z]))!=1,                                // [-]
-               psd->error_message,
-               "Could not read z at line %i in file '%s'",index_z+headlines,br_file);
-    class_test(fscanf(infile, "%le",
-                      &(psd->f_g_exact[index_z]))!=1,                                 // [-]
-               psd->error_message,
-               "Could not read f_g at line %i in file '%s'",index_z+headlines,br_file);
-    class_test(fscanf(infile, "%le",
-                      &(psd->f_y_exact[index_z]))!=1,                                 // [-]
-               psd->error_message,
-               "Could not read f_y at line %i in file '%s'",index_z+headlines,br_file);
-    class_test(fscanf(infile,"%le",
-                      &(psd->f_mu_exact[index_z]))!=1,                                // [-]
-               psd->error_message,
-               "Could not read f_mu at line %i in file '%s'",index_z+headlines,br_file);
-    for (index_k=0; index_k<psd->E_vec_size; ++index_k){
-      class_test(fscanf(infile,"%le",
-                        &(psd->E_vec[index_k*psd->br_exact_Nz+index_z]))!=1,           // [-]
-                 psd->error_message,
-                 "Could not read E vector at line %i in file '%s'",index_z+headlines,br_file);
-    }
-  }
+  class_alloc(psd->E_vec, Nz*psd->E_vec_size*sizeof(double), psd->error_message);
 
-  fclose(infile);
+  /** Copy parameters: z, f_g, f_y, f_mu and the E vectors */
+  memcpy(psd->br_exact_z, ptable->data, Nz*sizeof(double));
+  memcpy(psd->f_g_exact, ptable->data+Nz, Nz*sizeof(double));
+  memcpy(psd->f_y_exact, ptable->data+2*Nz, Nz*sizeof(double));
+  memcpy(psd->f_mu_exact, ptable->data+3*Nz, Nz*sizeof(double));
+  memcpy(psd->E_vec, ptable->data+4*Nz, Nz*psd->E_vec_size*sizeof(double));
+  data_file_release(ptable);
 
   return _SUCCESS_;
 }
@@ -1646,76 +1987,44 @@ int distortions_read_sd_data(struct precision * ppr,
                              struct distortions * psd){
 
   /** Define local variables */
-  FILE * infile;
+  struct data_file * ptable;
   DetectorFileName sd_file;
-  char line[_LINE_LENGTH_MAX_];
-  char * left;
-  int headlines = 0;
+  int Nnu;
   int index_x,index_k;
 
-  /** Open file */
+  /** Get the content of the file */
   class_sprintf(sd_file,"%s/%s_distortions_shapes.dat",ppr->sd_external_path, psd->sd_detector_name);
-  class_open(infile, sd_file, "r", psd->error_message);
-
-  /** Read header */
-  psd->PCA_Nnu = 0;
-  while (fgets(line,_LINE_LENGTH_MAX_-1,infile) != NULL) {
-    headlines++;
-
-    /* Eliminate blank spaces at beginning of line */
-    left=line;
-    while (left[0]==' ') {
-      left++;
-    }
+  class_call(distortions_get_table(ppr,psd,sd_file,4,&ptable),
+             psd->error_message,
+             psd->error_message);
 
-    if (left[0] > 39) {
-      /** Read number of lines, infer size of arrays and allocate them */
-      class_test(sscanf(line, "%d %d", &psd->PCA_Nnu, &psd->S_vec_size) != 2,
-                 psd->error_message,
-                 "could not header (number of lines, number of multipoles) at line %i in file '%s' \n",headlines,sd_file);
+  /** Infer size of arrays and allocate them */
+  psd->PCA_Nnu = ptable->rows;
+  psd->S_vec_size = ptable->header[1];
+  Nnu = psd->PCA_Nnu;
 
-      class_alloc(psd->PCA_nu, psd->PCA_Nnu*sizeof(double), psd->error_message);
-      class_alloc(psd->PCA_G_T, psd->PCA_Nnu*sizeof(double), psd->error_message);
-      class_alloc(psd->PCA_Y_SZ, psd->PCA_Nnu*sizeof(double), psd->error_message);
-      class_alloc(psd->PCA_M_mu, psd->PCA_Nnu*sizeof(double), psd->error_message);
+  class_alloc(psd->PCA_nu, Nnu*sizeof(double), psd->error_message);
+  class_alloc(psd->PCA_G_T, Nnu*sizeof(double), psd->error_message);
+  class_alloc(psd->PCA_Y_SZ, Nnu*sizeof(double), psd->error_message);
+  class_alloc(psd->PCA_M_mu, Nnu*sizeof(double), psd->error_message);
 
-      class_alloc(psd->S_vec, psd->PCA_Nnu*psd->S_vec_size*sizeof(double), psd->error_message);
-      break;
-    }
-  }
+  class_alloc(psd->S_vec, Nnu*psd->S_vec_size*sizeof(double), psd->error_message);
 
-  /** Read parameters */
-  for (index_x=0; index_x<psd->PCA_Nnu; ++index_x){
-    class_test(fscanf(infile,"%le",
-                      &(psd->PCA_nu[index_x]))!=1,                                                  // [GHz]
-               psd->error_message,
-               "Could not read z at line %i in file '%s'",index_x+headlines,sd_file);
-    class_test(fscanf(infile,"%le",
-                      &(psd->PCA_G_T[index_x]))!=1,                                                 // [10^-18 W/(m^2 Hz sr)]
-               psd->error_message,
-               "Could not read f_g at line %i in file '%s'",index_x+headlines,sd_file);
+  /** Copy parameters, converting the shapes from [10^-18 W/(m^2 Hz sr)] to [-] */
+  for (index_x=0; index_x<Nnu; ++index_x){
+    psd->PCA_nu[index_x] = ptable->data[index_x];                                                   // [GHz]
+    psd->PCA_G_T[index_x] = ptable->data[Nnu+index_x];
     psd->PCA_G_T[index_x] /= (psd->DI_units*1.e18);                                                 // [-]
-    class_test(fscanf(infile,"%le",
-                      &(psd->PCA_Y_SZ[index_x]))!=1,                                                // [10^-18 W/(m^2 Hz sr)]
-               psd->error_message,
-               "Could not read f_y at line %i in file '%s'",index_x+headlines,sd_file);
+    psd->PCA_Y_SZ[index_x] = ptable->data[2*Nnu+index_x];
     psd->PCA_Y_SZ[index_x] /= (psd->DI_units*1.e18);                                                // [-]
-    class_test(fscanf(infile,"%le",
-                      &(psd->PCA_M_mu[index_x]))!=1,                                                // [10^-18 W/(m^2 Hz sr)]
-               psd->error_message,
-               "Could not read f_mu at line %i in file '%s'",index_x+headlines,sd_file);
+    psd->PCA_M_mu[index_x] = ptable->data[3*Nnu+index_x];
     psd->PCA_M_mu[index_x] /= (psd->DI_units*1.e18);                                                // [-]
     for (index_k=0; index_k<psd->S_vec_size; ++index_k){
-      class_test(fscanf(infile,"%le",
-                        &(psd->S_vec[index_k*psd->PCA_Nnu+index_x]))!=1,                            // [10^-18 W/(m^2 Hz sr)]
-                 psd->error_message,
-                 "Could not read E vector at line %i in file '%s'",index_x+headlines,sd_file);
-      psd->S_vec[index_k*psd->PCA_Nnu+index_x] /= (psd->DI_units*1.e18);                            // [-]
+      psd->S_vec[index_k*Nnu+index_x] = ptable->data[(4+index_k)*Nnu+index_x];
+      psd->S_vec[index_k*Nnu+index_x] /= (psd->DI_units*1.e18);                                     // [-]
     }
-
   }
-
-  fclose(infile);
+  data_file_release(ptable);
 
   return _SUCCESS_;
 }
@@ -14,6 +14,10 @@
 #include "fourier.h"
 #include "halofit.h"
 #include "hmcode.h"
+#include <pthread.h>
+
+/* protects the list pfo->nl_spectra of the spectra computed on demand */
+static pthread_mutex_t fourier_nl_spectra_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * Return the P(k,z) for a given redshift z and pk type (_m, _cb)
@@ -86,6 +90,7 @@ int fourier_pk_at_z(
   int index_ic2_ic2;
   int index_ic1_ic2;
   int last_index;
+  double h,a,b;
   short do_ic = _FALSE_;
 
   /** - check whether we need the decomposition into contributions from each initial condition */
@@ -99,10 +104,18 @@ int fourier_pk_at_z(
 
   class_test(pk_output == pk_analytic_nowiggle && pfo->has_pk_analytic_nowiggle == _FALSE_, pfo->error_message, "Cannot get analytic nowiggle power spectrum since it was not requested in input");
 
+  /** - case of a nonlinear spectrum computed on demand, at this very redshift */
+  if ((pk_output == pk_nonlinear) && (pfo->nl_on_demand == _TRUE_)) {
+
+    class_call(fourier_nl_spectrum_at_z(pba,pfo,z,index_pk,out_pk,NULL),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   /** - case z=0 requiring no interpolation in z. The
         pk_analytic_nowiggle can also be computed here because, in the
         current implementation, it is only computed at z=0. */
-  if ((z == 0) || (pk_output == pk_analytic_nowiggle)) {
+  else if ((z == 0) || (pk_output == pk_analytic_nowiggle)) {
 
     for (index_k=0; index_k<pfo->k_size; index_k++) {
 
@@ -214,34 +227,36 @@ int fourier_pk_at_z(
 
       if (pk_output == pk_linear) {
 
-        /** --> interpolate P_l(k) at tau from pre-computed array */
-        class_call(array_interpolate_spline(pfo->ln_tau,
-                                            pfo->ln_tau_size,
-                                            pfo->ln_pk_l[index_pk],
-                                            pfo->ddln_pk_l[index_pk],
-                                            pfo->k_size,
-                                            ln_tau,
-                                            &last_index,
-                                            out_pk,
-                                            pfo->k_size,
-                                            pfo->error_message),
+        /** --> find the interpolation weights at tau once for P_l(k) and P_ic_l(k) */
+        class_call(array_spline_bisect(pfo->ln_tau,
+                                       pfo->ln_tau_size,
+                                       ln_tau,
+                                       &last_index,
+                                       &h,&a,&b,
+                                       pfo->error_message),
                    pfo->error_message,
                    pfo->error_message);
 
+        /** --> interpolate P_l(k) at tau from pre-computed array */
+        array_spline_eval_columns(pfo->ln_pk_l[index_pk],
+                                  pfo->ddln_pk_l[index_pk],
+                                  pfo->k_size,
+                                  last_index,
+                                  h,a,b,
+                                  NULL,
+                                  out_pk,
+                                  pfo->k_size);
+
         /** --> interpolate P_ic_l(k) at tau from pre-computed array */
         if (do_ic == _TRUE_) {
-          class_call(array_interpolate_spline(pfo->ln_tau,
-                                              pfo->ln_tau_size,
-                                              pfo->ln_pk_ic_l[index_pk],
-                                              pfo->ddln_pk_ic_l[index_pk],
-                                              pfo->k_size*pfo->ic_ic_size,
-                                              ln_tau,
-                                              &last_index,
-                                              out_pk_ic,
-                                              pfo->k_size*pfo->ic_ic_size,
-                                              pfo->error_message),
-                     pfo->error_message,
-                     pfo->error_message);
+          array_spline_eval_columns(pfo->ln_pk_ic_l[index_pk],
+                                    pfo->ddln_pk_ic_l[index_pk],
+                                    pfo->k_size*pfo->ic_ic_size,
+                                    last_index,
+                                    h,a,b,
+                                    NULL,
+                                    out_pk_ic,
+                                    pfo->k_size*pfo->ic_ic_size);
         }
       }
 
@@ -861,6 +876,14 @@ int fourier_pks_at_kvec_and_zvec(
                 pfo->error_message);
   }
 
+  /** - If the nonlinear spectra are computed on demand, compute them at all the requested redshifts at once */
+
+  if (pk_output == pk_nonlinear) {
+    class_call(fourier_prepare_pk_nl(pba,pfo,zvec_size,zvec),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   /** - Construct table of log(P(k_n,z_j)) for pre-computed wavenumbers but requested redshifts: */
 
   for (index_zvec=0; index_zvec<zvec_size; index_zvec++){
@@ -1008,6 +1031,211 @@ int fourier_pks_at_kvec_and_zvec(
   return _SUCCESS_;
 }
 
+/**
+ * Return the P(k,z) of one pk type (_m, _cb) on the dense grid of all
+ * pairs (k_i,z_j) passed in input, either linear or nonlinear
+ * depending on input.
+ *
+ * Unlike fourier_pks_at_kvec_and_zvec(), the arrays kvec and zvec can
+ * be given in arbitrary order (kvec is sorted internally when needed)
+ * and only the requested pk type is computed. The interpolation in
+ * tau is done once per z_j for all tabulated wavenumbers; the
+ * interpolation in k then goes through the sorted k_i's, hunting
+ * each interval from the previous one and sharing the spline
+ * coefficients between all z_j's.
+ *
+ * If there are several initial conditions, this function is not
+ * designed to return individual contributions. Like
+ * fourier_pks_at_kvec_and_zvec(), it performs no extrapolation: for
+ * k_i outside of [kmin,kmax], it returns P(k_i,z_j)=0.
+ *
+ * @param pba            Input: pointer to background structure
+ * @param pfo            Input: pointer to fourier structure
+ * @param pk_output      Input: pk_linear, pk_nonlinear, nowiggle...
+ * @param index_pk       Input: index of pk type (_m, _cb)
+ * @param kvec           Input: array of wavenumbers in arbitrary order (in 1/Mpc)
+ * @param kvec_size      Input: size of array of wavenumbers
+ * @param zvec           Input: array of redshifts in arbitrary order
+ * @param zvec_size      Input: size of array of redshifts
+ * @param out_pk         Output: P(k_i,z_j) in Mpc**3, returned as out_pk[index_zvec*kvec_size+index_kvec] (already allocated)
+ * @return the error status
+ */
+
+int fourier_pk_at_kvec_and_zvec(
+                                struct background * pba,
+                                struct fourier * pfo,
+                                enum pk_outputs pk_output,
+                                int index_pk,
+                                double * kvec, // kvec[index_kvec]
+                                int kvec_size,
+                                double * zvec, // zvec[index_zvec]
+                                int zvec_size,
+                                double * out_pk // out_pk[index_zvec*kvec_size+index_kvec]
+                                ) {
+
+  class_call(fourier_pk_and_tilt_at_kvec_and_zvec(pba,
+                                                  pfo,
+                                                  pk_output,
+                                                  index_pk,
+                                                  kvec,
+                                                  kvec_size,
+                                                  zvec,
+                                                  zvec_size,
+                                                  out_pk,
+                                                  NULL),
+             pfo->error_message,
+             pfo->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Same as fourier_pk_at_kvec_and_zvec(), returning optionally also the
+ * logarithmic slope dln(P)/dln(k) at each (k_i,z_j), obtained by
+ * differentiating the same spline (it is zero outside of [kmin,kmax]).
+ *
+ * @param pba            Input: pointer to background structure
+ * @param pfo            Input: pointer to fourier structure
+ * @param pk_output      Input: pk_linear, pk_nonlinear, nowiggle...
+ * @param index_pk       Input: index of pk type (_m, _cb)
+ * @param kvec           Input: array of wavenumbers in arbitrary order (in 1/Mpc)
+ * @param kvec_size      Input: size of array of wavenumbers
+ * @param zvec           Input: array of redshifts in arbitrary order
+ * @param zvec_size      Input: size of array of redshifts
+ * @param out_pk         Output: P(k_i,z_j) in Mpc**3, returned as out_pk[index_zvec*kvec_size+index_kvec] (already allocated)
+ * @param out_tilt       Output: dln(P)/dln(k) at (k_i,z_j), with the same indexing (already allocated, or NULL if not needed)
+ * @return the error status
+ */
+
+int fourier_pk_and_tilt_at_kvec_and_zvec(
+                                         struct background * pba,
+                                         struct fourier * pfo,
+                                         enum pk_outputs pk_output,
+                                         int index_pk,
+                                         double * kvec, // kvec[index_kvec]
+                                         int kvec_size,
+                                         double * zvec, // zvec[index_zvec]
+                                         int zvec_size,
+                                         double * out_pk, // out_pk[index_zvec*kvec_size+index_kvec]
+                                         double * out_tilt // same indexing, or NULL
+                                         ) {
+
+  int index_kvec, index_zvec, index_sorted;
+  int last_index = 0;
+  short is_sorted = _TRUE_;
+  double * ln_k_sorted;
+  double * ln_pk_table;
+  double * ddln_pk_table;
+  double ln_k, h, a, b;
+
+  /** - sort the wavenumbers if needed, keeping track of their
+      original position: ln_k_sorted contains pairs (ln(k_i), i) */
+
+  class_alloc(ln_k_sorted, 2*sizeof(double)*kvec_size,
+              pfo->error_message);
+
+  for (index_kvec=0; index_kvec<kvec_size; index_kvec++) {
+    ln_k_sorted[2*index_kvec] = log(kvec[index_kvec]);
+    ln_k_sorted[2*index_kvec+1] = (double)index_kvec;
+    if ((index_kvec > 0) && (kvec[index_kvec] < kvec[index_kvec-1]))
+      is_sorted = _FALSE_;
+  }
+
+  if (is_sorted == _FALSE_)
+    qsort(ln_k_sorted, kvec_size, 2*sizeof(double), compare_doubles);
+
+  /** - construct the table of ln(P(k_n,z_j)) for the pre-computed
+      wavenumbers at the requested redshifts (one interpolation in
+      tau per redshift) */
+
+  class_alloc(ln_pk_table, sizeof(double)*pfo->k_size*zvec_size,
+              pfo->error_message);
+  class_alloc(ddln_pk_table, sizeof(double)*pfo->k_size*zvec_size,
+              pfo->error_message);
+
+  for (index_zvec=0; index_zvec<zvec_size; index_zvec++) {
+    class_call(fourier_pk_at_z(pba,
+                               pfo,
+                               logarithmic,
+                               pk_output,
+                               zvec[index_zvec],
+                               index_pk,
+                               &(ln_pk_table[index_zvec * pfo->k_size]),
+                               NULL),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
+  /** - spline it for interpolation along k */
+
+  class_call(array_spline_table_columns2(pfo->ln_k,
+                                         pfo->k_size,
+                                         ln_pk_table,
+                                         zvec_size,
+                                         ddln_pk_table,
+                                         _SPLINE_NATURAL_,
+                                         pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  /** - loop over the sorted wavenumbers: find the interval of each of
+      them by hunting from the previous one, and interpolate at all
+      redshifts with the same coefficients */
+
+  for (index_sorted=0; index_sorted<kvec_size; index_sorted++) {
+
+    ln_k = ln_k_sorted[2*index_sorted];
+    index_kvec = (int)ln_k_sorted[2*index_sorted+1];
+
+    /** --> no extrapolation outside of [kmin,kmax] */
+    if ((ln_k < pfo->ln_k[0]) || (ln_k > pfo->ln_k[pfo->k_size-1])) {
+      for (index_zvec=0; index_zvec<zvec_size; index_zvec++)
+        out_pk[index_zvec*kvec_size+index_kvec] = 0.;
+      if (out_tilt != NULL)
+        for (index_zvec=0; index_zvec<zvec_size; index_zvec++)
+          out_tilt[index_zvec*kvec_size+index_kvec] = 0.;
+      continue;
+    }
+
+    class_call(array_spline_hunt(pfo->ln_k,
+                                 pfo->k_size,
+                                 ln_k,
+                                 &last_index,
+                                 &h,&a,&b,
+                                 pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+
+    for (index_zvec=0; index_zvec<zvec_size; index_zvec++) {
+      out_pk[index_zvec*kvec_size+index_kvec] =
+        exp(
+            array_spline_eval(ln_pk_table,
+                              ddln_pk_table,
+                              (index_zvec * pfo->k_size + last_index),
+                              (index_zvec * pfo->k_size + last_index+1),
+                              h,a,b)
+            );
+    }
+
+    if (out_tilt != NULL) {
+      for (index_zvec=0; index_zvec<zvec_size; index_zvec++) {
+        out_tilt[index_zvec*kvec_size+index_kvec] =
+          array_spline_eval_derivative(ln_pk_table,
+                                       ddln_pk_table,
+                                       (index_zvec * pfo->k_size + last_index),
+                                       (index_zvec * pfo->k_size + last_index+1),
+                                       h,a,b);
+      }
+    }
+  }
+
+  free(ln_k_sorted);
+  free(ln_pk_table);
+  free(ddln_pk_table);
+
+  return _SUCCESS_;
+}
+
 /**
  * Return the logarithmic slope of P(k,z) for a given (k,z), a given
  * pk type (_m, _cb) (computed with linear P_L if pk_output =
@@ -1165,6 +1393,98 @@ int fourier_sigmas_at_z(
   return _SUCCESS_;
 }
 
+/**
+ * Same as fourier_sigmas_at_z(), for a list of redshifts: P(k,z) is
+ * read for all redshifts in one pass and splined along k at once, and
+ * the temporary arrays are allocated only once. The results are
+ * identical to those of successive calls to fourier_sigmas_at_z().
+ *
+ * @param ppr          Input: pointer to precision structure
+ * @param pba          Input: pointer to background structure
+ * @param pfo          Input: pointer to fourier structure
+ * @param R            Input: radius in Mpc
+ * @param z_size       Input: number of redshifts
+ * @param z            Input: array of redshifts
+ * @param index_pk     Input: type of pk (_m, _cb)
+ * @param sigma_output Input: quantity to be computed (sigma, sigma', ...)
+ * @param result       Output: array of results, of size z_size
+ * @return the error status
+ */
+
+int fourier_sigmas_at_z_list(
+                             struct precision * ppr,
+                             struct background * pba,
+                             struct fourier * pfo,
+                             double R,
+                             int z_size,
+                             double * z,
+                             int index_pk,
+                             enum out_sigmas sigma_output,
+                             double * result
+                             ) {
+
+  double * out_pk;
+  double * ddout_pk;
+  int index_z;
+
+  if (z_size < 1)
+    return _SUCCESS_;
+
+  /** - allocate temporary arrays for P(k,z_i) as a function of k, one column per redshift */
+
+  class_alloc(out_pk, z_size*pfo->k_size*sizeof(double), pfo->error_message);
+  class_alloc(ddout_pk, z_size*pfo->k_size*sizeof(double), pfo->error_message);
+
+  /** - get P(k,z_i) as a function of k for all redshifts */
+
+  for (index_z=0; index_z<z_size; index_z++) {
+    class_call(fourier_pk_at_z(pba,
+                               pfo,
+                               logarithmic,
+                               pk_linear,
+                               z[index_z],
+                               index_pk,
+                               out_pk+index_z*pfo->k_size,
+                               NULL),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
+  /** - spline all of them along k */
+
+  class_call(array_spline_table_columns(pfo->ln_k,
+                                        pfo->k_size,
+                                        out_pk,
+                                        z_size,
+                                        ddout_pk,
+                                        _SPLINE_EST_DERIV_,
+                                        pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  /** - compute the sigmas */
+
+  for (index_z=0; index_z<z_size; index_z++) {
+    class_call(fourier_sigmas(pfo,
+                              R,
+                              out_pk+index_z*pfo->k_size,
+                              ddout_pk+index_z*pfo->k_size,
+                              pfo->k_size,
+                              ppr->sigma_k_per_decade,
+                              sigma_output,
+                              result+index_z),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
+  /** - free allocated arrays */
+
+  free(out_pk);
+  free(ddout_pk);
+
+  return _SUCCESS_;
+}
+
 /**
  * Return the value of the non-linearity wavenumber k_nl for a given redshift z
  *
@@ -1186,6 +1506,28 @@ int fourier_k_nl_at_z(
 
   double tau;
 
+  /** - with the nonlinear spectra computed on demand, k_nl is computed with them */
+
+  if (pfo->nl_on_demand == _TRUE_) {
+
+    if (pfo->has_pk_m == _TRUE_) {
+      class_call(fourier_nl_spectrum_at_z(pba,pfo,z,pfo->index_pk_m,NULL,k_nl),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+
+    if (pfo->has_pk_cb == _TRUE_) {
+      class_call(fourier_nl_spectrum_at_z(pba,pfo,z,pfo->index_pk_cb,NULL,k_nl_cb),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+    else {
+      *k_nl_cb = *k_nl;
+    }
+
+    return _SUCCESS_;
+  }
+
   /** - convert input redshift into a conformal time */
 
   class_call(background_tau_of_z(pba,
@@ -1250,103 +1592,457 @@ int fourier_k_nl_at_z(
 }
 
 /**
- * Initialize the fourier structure, and in particular the
- * nl_corr_density and k_nl interpolation tables.
+ * Compute the nonlinear spectra at a list of redshifts, when they are
+ * computed on demand (pfo->nl_on_demand == _TRUE_; otherwise they are
+ * tabulated already, and this function does nothing).
  *
- * @param ppr Input: pointer to precision structure
- * @param pba Input: pointer to background structure
- * @param pth Input: pointer to therodynamics structure
- * @param ppt Input: pointer to perturbation structure
- * @param ppm Input: pointer to primordial structure
- * @param pfo Input/Output: pointer to initialized fourier structure
+ * The redshifts at which the spectra are known already are skipped.
+ * The other ones do not depend on each other, and are computed in
+ * parallel by halofit_at_tau_list() or hmcode_at_tau_list(), from
+ * P_L(k) interpolated at each of them. The results are kept in
+ * pfo->nl_spectra until fourier_free(), to be returned by
+ * fourier_pk_at_z() and fourier_k_nl_at_z(), which call this function
+ * for a single redshift if needed: calling it first with all the
+ * redshifts of interest is thus faster. It can be called from several
+ * threads at once.
+ *
+ * Where the nonlinear corrections are not computable, the stored
+ * spectra are the linear ones, as with the tabulated spectra.
+ *
+ * @param pba     Input: pointer to background structure
+ * @param pfo     Input/Output: pointer to fourier structure
+ * @param z_size  Input: number of redshifts
+ * @param z       Input: redshifts z[index_z], in arbitrary order
  * @return the error status
  */
 
-int fourier_init(
-                 struct precision *ppr,
-                 struct background *pba,
-                 struct thermodynamics *pth,
-                 struct perturbations *ppt,
-                 struct primordial *ppm,
-                 struct fourier *pfo
-                 ) {
+int fourier_prepare_pk_nl(
+                          struct background *pba,
+                          struct fourier * pfo,
+                          int z_size,
+                          double * z
+                          ) {
 
-  int index_ncdm;
-  int index_k;
-  int index_tau;
-  int index_tau_sources;
-  int index_tau_late;
+  int index_z;
+  int index_z_new;
+  int z_new_size;
   int index_pk;
-
-  double **pk_nl;
-  double **lnpk_l;
-  double **ddlnpk_l;
-
-  short nl_corr_not_computable_at_this_k = _FALSE_;
-
-  double * pvecback;
+  int index_k;
   int last_index;
-  double a,z;
-  int index_tau_desired_nl;
+  double * z_new;
+  double * tau_new;
+  double ln_tau;
+  double ** lnpk_l;
+  double ** pk_nl;
+  double ** k_nl;
+  short * nl_corr_not_computable;
+  short is_computable;
+  struct fourier_nl_spectrum * pspectrum;
+  struct fourier_nl_spectrum * pother;
+
+  if ((pfo->nl_on_demand == _FALSE_) || (z_size < 1))
+    return _SUCCESS_;
 
-  struct hmcode_workspace hw;
-  struct hmcode_workspace * phw;
+  /** - list the redshifts at which the spectra are still missing, without duplicates */
 
-  /** - Do we want to compute P(k,z)? Propagate the flag has_pk_matter
-      from the perturbations structure to the fourier structure */
-  pfo->has_pk_matter = ppt->has_pk_matter;
+  class_alloc(z_new,z_size*sizeof(double),pfo->error_message);
 
-  /** - preliminary tests */
+  z_new_size = 0;
 
-  /** --> This module only makes sense for dealing with scalar
-      perturbations, so it should do nothing if there are no
-      scalars */
-  if (ppt->has_scalars == _FALSE_) {
-    pfo->method = nl_none;
-    if (pfo->fourier_verbose > 0)
-      printf("No scalar modes requested. Nonlinear module skipped.\n");
-    return _SUCCESS_;
+  pthread_mutex_lock(&fourier_nl_spectra_mutex);
+  for (index_z=0; index_z<z_size; index_z++) {
+    for (pspectrum=pfo->nl_spectra; (pspectrum != NULL) && (pspectrum->z != z[index_z]); pspectrum=pspectrum->next);
+    for (index_z_new=0; (index_z_new < z_new_size) && (z_new[index_z_new] != z[index_z]); index_z_new++);
+    if ((pspectrum == NULL) && (index_z_new == z_new_size)) {
+      z_new[z_new_size] = z[index_z];
+      z_new_size++;
+    }
   }
+  pthread_mutex_unlock(&fourier_nl_spectra_mutex);
 
-  /** --> Nothing to be done if we don't want the matter power spectrum */
-
-  if ((pfo->has_pk_matter == _FALSE_) && (pfo->method == nl_none)) {
-    if (pfo->fourier_verbose > 0)
-      printf("No Fourier spectra nor nonlinear corrections requested. Nonlinear module skipped.\n");
+  if (z_new_size == 0) {
+    free(z_new);
     return _SUCCESS_;
   }
-  else {
-    if (pfo->fourier_verbose > 0)
-      printf("Computing linear Fourier spectra.\n");
+
+  /** - allocate the spectra at these redshifts */
+
+  class_alloc(tau_new,z_new_size*sizeof(double),pfo->error_message);
+  class_alloc(lnpk_l,pfo->pk_size*sizeof(double*),pfo->error_message);
+  class_alloc(pk_nl,pfo->pk_size*sizeof(double*),pfo->error_message);
+  class_alloc(k_nl,pfo->pk_size*sizeof(double*),pfo->error_message);
+  for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+    class_alloc(lnpk_l[index_pk],z_new_size*pfo->k_size_extra*sizeof(double),pfo->error_message);
+    class_alloc(pk_nl[index_pk],z_new_size*pfo->k_size*sizeof(double),pfo->error_message);
+    class_alloc(k_nl[index_pk],z_new_size*sizeof(double),pfo->error_message);
   }
+  class_alloc(nl_corr_not_computable,z_new_size*pfo->pk_size*sizeof(short),pfo->error_message);
 
-  /** --> check applicability of Halofit and HMcode */
-  if (pfo->method > nl_none) {
+  /** - get the times, and P_L(k) on the extended k range, at these
+      redshifts, with the same range checks as fourier_pk_at_z() */
 
-    if (pba->has_ncdm == _TRUE_) {
-      for (index_ncdm=0;index_ncdm < pba->N_ncdm; index_ncdm++){
-        if (pba->m_ncdm_in_eV[index_ncdm] >  _M_EV_TOO_BIG_FOR_HALOFIT_)
-          fprintf(stdout,"Warning: Halofit and HMcode are proved to work for CDM, and also with a small HDM component. But it sounds like you are running with a WDM component of mass %f eV, which makes the use of Halofit suspicious.\n",pba->m_ncdm_in_eV[index_ncdm]);
+  for (index_z=0; index_z<z_new_size; index_z++) {
+
+    if (z_new[index_z] == 0) {
+      tau_new[index_z] = pfo->tau[pfo->tau_size-1];
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+        memcpy(lnpk_l[index_pk]+index_z*pfo->k_size_extra,
+               pfo->ln_pk_l_extra[index_pk]+(pfo->ln_tau_size-1)*pfo->k_size_extra,
+               pfo->k_size_extra*sizeof(double));
       }
+      continue;
     }
-    if ((pba->has_idm == _TRUE_) && (ppt->perturbations_verbose > 0)){
-      fprintf(stdout,"Warning: Halofit and HMcode are proved to work for CDM, and also with a small HDM component. But you have requested interacting dark matter (idm), which makes the use of Halofit or HMCode unreliable.\n");
-    }
-  }
 
-  /** - define indices in fourier structure (and allocate some arrays in the structure) */
+    class_test(pfo->ln_tau_size == 1,
+               pfo->error_message,
+               "You are asking for the matter power spectrum at z=%e but the code was asked to store it only at z=0. You probably forgot to pass the input parameter z_max_pk (see explanatory.ini)",z_new[index_z]);
 
-  class_call(fourier_indices(ppr,
-                             pba,
-                             ppt,
-                             ppm,
-                             pfo),
-             pfo->error_message,
-             pfo->error_message);
+    class_call(background_tau_of_z(pba,
+                                   z_new[index_z],
+                                   &(tau_new[index_z])),
+               pba->error_message,
+               pfo->error_message);
 
-  /** - get the linear power spectrum at each time */
+    ln_tau = log(tau_new[index_z]);
 
-  for (index_tau=0; index_tau<pfo->ln_tau_size;index_tau++) {
+    class_test(ln_tau<pfo->ln_tau[0]-100.*_EPSILON_,
+               pfo->error_message,
+               "requested z was not inside of tau tabulation range (Requested ln(tau_=%.10e, Min %.10e). Solution might be to increase input parameter z_max_pk (see explanatory.ini)",ln_tau,pfo->ln_tau[0]);
+
+    class_test(ln_tau>pfo->ln_tau[pfo->ln_tau_size-1]+_EPSILON_,
+               pfo->error_message,
+               "requested z was not inside of tau tabulation range (Requested ln(tau_=%.10e, Max %.10e) ",ln_tau,pfo->ln_tau[pfo->ln_tau_size-1]);
+
+    ln_tau = MAX(pfo->ln_tau[0],MIN(ln_tau,pfo->ln_tau[pfo->ln_tau_size-1]));
+    tau_new[index_z] = exp(ln_tau);
+
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+      class_call(array_interpolate_spline(pfo->ln_tau,
+                                          pfo->ln_tau_size,
+                                          pfo->ln_pk_l_extra[index_pk],
+                                          pfo->ddln_pk_l_extra[index_pk],
+                                          pfo->k_size_extra,
+                                          ln_tau,
+                                          &last_index,
+                                          lnpk_l[index_pk]+index_z*pfo->k_size_extra,
+                                          pfo->k_size_extra,
+                                          pfo->error_message),
+                 pfo->error_message,
+                 pfo->error_message);
+    }
+  }
+
+  /** - compute P_NL(k) at all these times in parallel */
+
+  if (pfo->method == nl_halofit) {
+
+    class_call(halofit_at_tau_list(pfo->nl_ppr,
+                                   pba,
+                                   pfo->nl_ppt,
+                                   pfo->nl_ppm,
+                                   pfo,
+                                   z_new_size,
+                                   tau_new,
+                                   lnpk_l,
+                                   pk_nl,
+                                   k_nl,
+                                   nl_corr_not_computable,
+                                   pfo->nl_halofit_plan),
+               pfo->error_message,
+               pfo->error_message);
+  }
+  else if (pfo->method == nl_HMcode) {
+
+    class_call(hmcode_at_tau_list(pfo->nl_ppr,
+                                  pba,
+                                  pfo->nl_ppt,
+                                  pfo->nl_ppm,
+                                  pfo,
+                                  z_new_size,
+                                  tau_new,
+                                  lnpk_l,
+                                  pk_nl,
+                                  k_nl,
+                                  nl_corr_not_computable,
+                                  pfo->nl_hmcode_workspace),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
+  /** - store the results, unless another thread has just stored them
+      at the same redshift */
+
+  for (index_z=0; index_z<z_new_size; index_z++) {
+
+    class_alloc(pspectrum,sizeof(struct fourier_nl_spectrum),pfo->error_message);
+    class_alloc(pspectrum->ln_pk_nl,pfo->pk_size*pfo->k_size*sizeof(double),pfo->error_message);
+    class_alloc(pspectrum->k_nl,pfo->pk_size*sizeof(double),pfo->error_message);
+
+    pspectrum->z = z_new[index_z];
+
+    /* as for the tabulated spectra, if the corrections are not
+       computable for one index_pk, they are dropped for all */
+    is_computable = _TRUE_;
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+      if (nl_corr_not_computable[index_z*pfo->pk_size+index_pk] == _TRUE_)
+        is_computable = _FALSE_;
+    }
+
+    for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+      for (index_k=0; index_k<pfo->k_size; index_k++) {
+        if (is_computable == _TRUE_)
+          pspectrum->ln_pk_nl[index_pk*pfo->k_size+index_k] = log(pk_nl[index_pk][index_z*pfo->k_size+index_k]);
+        else
+          pspectrum->ln_pk_nl[index_pk*pfo->k_size+index_k] = lnpk_l[index_pk][index_z*pfo->k_size_extra+index_k];
+      }
+      pspectrum->k_nl[index_pk] = k_nl[index_pk][index_z];
+    }
+
+    if ((is_computable == _FALSE_) && (pfo->fourier_verbose > 0)) {
+      fprintf(stdout,
+              " -> [WARNING:] Non-linear corrections could not be computed at redshift z=%5.2f: the linear spectrum is returned there.\n    This is because k_max is too small for the algorithm (Halofit or HMcode) to be able to compute the scale k_NL at this redshift.\n    If non-linear corrections at such high redshift really matter for you,\n    just try to increase the precision parameter nonlinear_min_k_max (currently at %e) until k_NL can be computed at the desired z.\n",
+              z_new[index_z],pfo->nl_ppr->nonlinear_min_k_max);
+    }
+
+    pthread_mutex_lock(&fourier_nl_spectra_mutex);
+    for (pother=pfo->nl_spectra; (pother != NULL) && (pother->z != pspectrum->z); pother=pother->next);
+    if (pother == NULL) {
+      pspectrum->next = pfo->nl_spectra;
+      pfo->nl_spectra = pspectrum;
+      pspectrum = NULL;
+    }
+    pthread_mutex_unlock(&fourier_nl_spectra_mutex);
+
+    if (pspectrum != NULL) {
+      free(pspectrum->ln_pk_nl);
+      free(pspectrum->k_nl);
+      free(pspectrum);
+    }
+  }
+
+  /** - free the temporary arrays */
+
+  for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+    free(lnpk_l[index_pk]);
+    free(pk_nl[index_pk]);
+    free(k_nl[index_pk]);
+  }
+  free(lnpk_l);
+  free(pk_nl);
+  free(k_nl);
+  free(nl_corr_not_computable);
+  free(tau_new);
+  free(z_new);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Return the nonlinear spectrum and the non-linear wavenumber at a
+ * redshift z, when they are computed on demand: they are computed
+ * first by fourier_prepare_pk_nl() if they are not known yet at this
+ * redshift.
+ *
+ * @param pba      Input: pointer to background structure
+ * @param pfo      Input/Output: pointer to fourier structure
+ * @param z        Input: redshift
+ * @param index_pk Input: index of pk type (_m, _cb)
+ * @param ln_pk_nl Output: ln(P_NL(k)) at ln_pk_nl[index_k], or NULL
+ * @param k_nl     Output: k_nl, or NULL
+ * @return the error status
+ */
+
+int fourier_nl_spectrum_at_z(
+                             struct background *pba,
+                             struct fourier * pfo,
+                             double z,
+                             int index_pk,
+                             double * ln_pk_nl,
+                             double * k_nl
+                             ) {
+
+  struct fourier_nl_spectrum * pspectrum;
+
+  class_call(fourier_prepare_pk_nl(pba,pfo,1,&z),
+             pfo->error_message,
+             pfo->error_message);
+
+  pthread_mutex_lock(&fourier_nl_spectra_mutex);
+  for (pspectrum=pfo->nl_spectra; (pspectrum != NULL) && (pspectrum->z != z); pspectrum=pspectrum->next);
+  if (pspectrum != NULL) {
+    if (ln_pk_nl != NULL)
+      memcpy(ln_pk_nl,pspectrum->ln_pk_nl+index_pk*pfo->k_size,pfo->k_size*sizeof(double));
+    if (k_nl != NULL)
+      *k_nl = pspectrum->k_nl[index_pk];
+  }
+  pthread_mutex_unlock(&fourier_nl_spectra_mutex);
+
+  class_test(pspectrum == NULL,
+             pfo->error_message,
+             "nonlinear spectrum at z=%e missing after its calculation",z);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the nonlinear spectra computed on demand, and the Halofit or
+ * HMcode workspace kept for them by fourier_init().
+ *
+ * @param pfo Input/Output: pointer to fourier structure
+ * @return the error status
+ */
+
+int fourier_nl_spectra_free(
+                            struct fourier * pfo
+                            ) {
+
+  struct fourier_nl_spectrum * pspectrum;
+
+  while (pfo->nl_spectra != NULL) {
+    pspectrum = pfo->nl_spectra;
+    pfo->nl_spectra = pspectrum->next;
+    free(pspectrum->ln_pk_nl);
+    free(pspectrum->k_nl);
+    free(pspectrum);
+  }
+
+  if (pfo->nl_halofit_plan != NULL) {
+    fftlog_plan_free(pfo->nl_halofit_plan);
+    free(pfo->nl_halofit_plan);
+    pfo->nl_halofit_plan = NULL;
+  }
+
+  if (pfo->nl_hmcode_workspace != NULL) {
+
+    class_call(hmcode_workspace_free(pfo->nl_ppr,pfo,pfo->nl_hmcode_workspace),
+               pfo->error_message,
+               pfo->error_message);
+
+    class_call(hmcode_noradiation_growth_free(pfo,pfo->nl_hmcode_workspace),
+               pfo->error_message,
+               pfo->error_message);
+
+    free(pfo->nl_hmcode_workspace);
+    pfo->nl_hmcode_workspace = NULL;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Initialize the fourier structure, and in particular the
+ * nl_corr_density and k_nl interpolation tables.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to therodynamics structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param ppm Input: pointer to primordial structure
+ * @param pfo Input/Output: pointer to initialized fourier structure
+ * @return the error status
+ */
+
+int fourier_init(
+                 struct precision *ppr,
+                 struct background *pba,
+                 struct thermodynamics *pth,
+                 struct perturbations *ppt,
+                 struct primordial *ppm,
+                 struct fourier *pfo
+                 ) {
+
+  int index_ncdm;
+  int index_k;
+  int index_tau;
+  int index_tau_sources;
+  int index_tau_late;
+  int index_pk;
+
+  double **pk_nl;
+  double **lnpk_l;
+
+  short nl_corr_not_computable_at_this_k = _FALSE_;
+
+  double * pvecback;
+  int last_index;
+  double a,z;
+  int index_tau_desired_nl;
+
+  struct hmcode_workspace hw;
+  struct hmcode_workspace * phw;
+  double **pk_nl_at_all_tau;
+  short *nl_corr_not_computable_at_all_tau;
+  struct fftlog_plan halofit_plan;
+  struct fftlog_plan * pfp_halofit = NULL;
+
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(pfo->stats));
+
+  /** - Do we want to compute P(k,z)? Propagate the flag has_pk_matter
+      from the perturbations structure to the fourier structure */
+  pfo->has_pk_matter = ppt->has_pk_matter;
+
+  /** - The nonlinear spectra are tabulated below, unless they can be
+      computed on demand */
+  pfo->nl_on_demand = _FALSE_;
+  pfo->nl_spectra = NULL;
+  pfo->nowiggle_plan = NULL;
+  pfo->nl_halofit_plan = NULL;
+  pfo->nl_hmcode_workspace = NULL;
+
+  /** - preliminary tests */
+
+  /** --> This module only makes sense for dealing with scalar
+      perturbations, so it should do nothing if there are no
+      scalars */
+  if (ppt->has_scalars == _FALSE_) {
+    pfo->method = nl_none;
+    if (pfo->fourier_verbose > 0)
+      printf("No scalar modes requested. Nonlinear module skipped.\n");
+    class_timer_end(&(pfo->stats));
+    return _SUCCESS_;
+  }
+
+  /** --> Nothing to be done if we don't want the matter power spectrum */
+
+  if ((pfo->has_pk_matter == _FALSE_) && (pfo->method == nl_none)) {
+    if (pfo->fourier_verbose > 0)
+      printf("No Fourier spectra nor nonlinear corrections requested. Nonlinear module skipped.\n");
+    class_timer_end(&(pfo->stats));
+    return _SUCCESS_;
+  }
+  else {
+    if (pfo->fourier_verbose > 0)
+      printf("Computing linear Fourier spectra.\n");
+  }
+
+  /** --> check applicability of Halofit and HMcode */
+  if (pfo->method > nl_none) {
+
+    if (pba->has_ncdm == _TRUE_) {
+      for (index_ncdm=0;index_ncdm < pba->N_ncdm; index_ncdm++){
+        if (pba->m_ncdm_in_eV[index_ncdm] >  _M_EV_TOO_BIG_FOR_HALOFIT_)
+          fprintf(stdout,"Warning: Halofit and HMcode are proved to work for CDM, and also with a small HDM component. But it sounds like you are running with a WDM component of mass %f eV, which makes the use of Halofit suspicious.\n",pba->m_ncdm_in_eV[index_ncdm]);
+      }
+    }
+    if ((pba->has_idm == _TRUE_) && (ppt->perturbations_verbose > 0)){
+      fprintf(stdout,"Warning: Halofit and HMcode are proved to work for CDM, and also with a small HDM component. But you have requested interacting dark matter (idm), which makes the use of Halofit or HMCode unreliable.\n");
+    }
+  }
+
+  /** - define indices in fourier structure (and allocate some arrays in the structure) */
+
+  class_call(fourier_indices(ppr,
+                             pba,
+                             ppt,
+                             ppm,
+                             pfo),
+             pfo->error_message,
+             pfo->error_message);
+
+  /** - get the linear power spectrum at each time */
+
+  for (index_tau=0; index_tau<pfo->ln_tau_size;index_tau++) {
 
     /* If the user only wants z=0, then pfo->ln_tau_size=1 and we go
        only through index_tau=0. However we must pick up the last
@@ -1409,33 +2105,33 @@ int fourier_init(
   if (pfo->ln_tau_size > 1) {
     for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
 
-      class_call(array_spline_table_lines(pfo->ln_tau,
-                                          pfo->ln_tau_size,
-                                          pfo->ln_pk_l[index_pk],
-                                          pfo->k_size,
-                                          pfo->ddln_pk_l[index_pk],
-                                          _SPLINE_EST_DERIV_,
-                                          pfo->error_message),
+      class_call(array_spline_table_lines2(pfo->ln_tau,
+                                           pfo->ln_tau_size,
+                                           pfo->ln_pk_l[index_pk],
+                                           pfo->k_size,
+                                           pfo->ddln_pk_l[index_pk],
+                                           _SPLINE_EST_DERIV_,
+                                           pfo->error_message),
                  pfo->error_message,
                  pfo->error_message);
 
-      class_call(array_spline_table_lines(pfo->ln_tau,
-                                          pfo->ln_tau_size,
-                                          pfo->ln_pk_ic_l[index_pk],
-                                          pfo->k_size*pfo->ic_ic_size,
-                                          pfo->ddln_pk_ic_l[index_pk],
-                                          _SPLINE_EST_DERIV_,
-                                          pfo->error_message),
+      class_call(array_spline_table_lines2(pfo->ln_tau,
+                                           pfo->ln_tau_size,
+                                           pfo->ln_pk_ic_l[index_pk],
+                                           pfo->k_size*pfo->ic_ic_size,
+                                           pfo->ddln_pk_ic_l[index_pk],
+                                           _SPLINE_EST_DERIV_,
+                                           pfo->error_message),
                  pfo->error_message,
                  pfo->error_message);
 
-      class_call(array_spline_table_lines(pfo->ln_tau,
-                                          pfo->ln_tau_size,
-                                          pfo->ln_pk_l_extra[index_pk],
-                                          pfo->k_size_extra,
-                                          pfo->ddln_pk_l_extra[index_pk],
-                                          _SPLINE_EST_DERIV_,
-                                          pfo->error_message),
+      class_call(array_spline_table_lines2(pfo->ln_tau,
+                                           pfo->ln_tau_size,
+                                           pfo->ln_pk_l_extra[index_pk],
+                                           pfo->k_size_extra,
+                                           pfo->ddln_pk_l_extra[index_pk],
+                                           _SPLINE_EST_DERIV_,
+                                           pfo->error_message),
                  pfo->error_message,
                  pfo->error_message);
     }
@@ -1450,6 +2146,19 @@ int fourier_init(
                pfo->error_message);
   }
 
+  /** - prepare once for all the wiggle/nowiggle decomposition of the
+      linear spectra relative to the analytic one, used at each time
+      by HMcode 2020 and by the numerical nowiggle spectrum */
+
+  if ((pfo->method == nl_HMcode) || (pfo->has_pk_numerical_nowiggle == _TRUE_)) {
+
+    class_alloc(pfo->nowiggle_plan,sizeof(struct nowiggle_plan),pfo->error_message);
+
+    class_call(hmcode_nowiggle_plan_init(pfo,pfo->nowiggle_plan),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   /** - get the dewiggled power spectrum at each time in ln_tau */
   if (pfo->has_pk_numerical_nowiggle == _TRUE_) {
 
@@ -1510,6 +2219,20 @@ int fourier_init(
 	if ((pfo->fourier_verbose > 0) && (pfo->method == nl_HMcode))
       printf("Computing non-linear matter power spectrum with HMcode \n");
 
+    /** --> If requested, compute the spectra on demand only, unless
+        some C_l's need the nonlinear corrections to their sources */
+
+    if (pfo->has_nl_on_demand == _TRUE_) {
+      if ((ppt->has_cl_cmb_lensing_potential == _FALSE_) &&
+          (ppt->has_cl_lensing_potential == _FALSE_) &&
+          (ppt->has_cl_number_count == _FALSE_)) {
+        pfo->nl_on_demand = _TRUE_;
+      }
+      else if (pfo->fourier_verbose > 0) {
+        printf(" -> the C_l's need the nonlinear corrections at all times: they are tabulated rather than computed on demand\n");
+      }
+    }
+
     /** --> allocate temporary arrays for spectra at each given time/redshift */
 
     class_alloc(pk_nl,
@@ -1520,21 +2243,39 @@ int fourier_init(
                 pfo->pk_size*sizeof(double*),
                 pfo->error_message);
 
-    class_alloc(ddlnpk_l,
-                pfo->pk_size*sizeof(double*),
-                pfo->error_message);
-
     for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
       class_alloc(pk_nl[index_pk],pfo->k_size*sizeof(double),pfo->error_message);
-      class_alloc(lnpk_l[index_pk],pfo->k_size_extra*sizeof(double),pfo->error_message);
-      class_alloc(ddlnpk_l[index_pk],pfo->k_size_extra*sizeof(double),pfo->error_message);
+      class_alloc(lnpk_l[index_pk],pfo->k_size*sizeof(double),pfo->error_message);
+    }
+
+    /** --> With Halofit, prepare the FFTLog transform of the integral giving sigma(R) */
+
+    if ((pfo->method == nl_halofit) && (ppr->sigma_fftlog == _TRUE_)) {
+
+      if (pfo->nl_on_demand == _TRUE_) {
+        class_alloc(pfo->nl_halofit_plan,sizeof(struct fftlog_plan),pfo->error_message);
+        pfp_halofit = pfo->nl_halofit_plan;
+      }
+      else {
+        pfp_halofit = &halofit_plan;
+      }
+
+      class_call(halofit_fftlog_init(ppr,pfo,pfp_halofit),
+                 pfo->error_message,
+                 pfo->error_message);
     }
 
     /** --> Then go through preliminary steps specific to HMcode */
 
     if (pfo->method == nl_HMcode){
 
-      phw = &hw;
+      if (pfo->nl_on_demand == _TRUE_) {
+        class_alloc(pfo->nl_hmcode_workspace,sizeof(struct hmcode_workspace),pfo->error_message);
+        phw = pfo->nl_hmcode_workspace;
+      }
+      else {
+        phw = &hw;
+      }
 
       class_call(hmcode_workspace_init(ppr,pba,pfo,phw),
                  pfo->error_message,
@@ -1554,215 +2295,240 @@ int fourier_init(
 
     }
 
-    /** --> Loop over decreasing time/growing redhsift. For each
-        time/redshift, compute P_NL(k,z) using either Halofit or
-        HMcode */
+    /** --> With the spectra computed on demand, keep what
+        halofit_at_tau_list() or hmcode_at_tau_list() will need; no
+        source function gets nonlinear corrections, and ln_pk_nl just
+        holds the linear spectra, in case it is read directly */
+
+    if (pfo->nl_on_demand == _TRUE_) {
 
-    /* this flag will become _TRUE_ at the minimum redshift such that
-       the non-lienar corrections cannot be consistently computed */
-    nl_corr_not_computable_at_this_k = _FALSE_;
+      if (pfo->fourier_verbose > 0)
+        printf(" -> nonlinear spectra computed on demand, at the requested redshifts only\n");
 
-    /* this index will refer to the value of time corresponding to
-       that redhsift */
-    pfo->index_tau_min_nl = 0;
+      pfo->nl_ppr = ppr;
+      pfo->nl_ppt = ppt;
+      pfo->nl_ppm = ppm;
 
-    /* this size will refer to the computed Pk_NL range. We will reduce it if the corrections cannot be computed. */
-    pfo->ln_tau_size_nl = pfo->ln_tau_size;
+      pfo->index_tau_min_nl = pfo->tau_size-1;
+      pfo->ln_tau_size_nl = 0;
 
-    /* if we do not want any Cl’s derived from large scale structure source functions, try to compute non-linear
-	     corrections only in the range z<z_max_pk, that is, index_tau >= pfo->tau_size - pfo->ln_tau_size */
-    if ((ppt->has_cl_cmb_lensing_potential == _FALSE_) &&
-        (ppt->has_cl_lensing_potential == _FALSE_) &&
-        (ppt->has_cl_number_count == _FALSE_)) {
-		  index_tau_desired_nl = pfo->tau_size - pfo->ln_tau_size;
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+        for (index_tau=0; index_tau<pfo->tau_size; index_tau++) {
+          pfo->k_nl[index_pk][index_tau] = 0.;
+          for (index_k=0; index_k<pfo->k_size; index_k++) {
+            pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = 1.;
+          }
+        }
+        memcpy(pfo->ln_pk_nl[index_pk],
+               pfo->ln_pk_l[index_pk],
+               pfo->ln_tau_size*pfo->k_size*sizeof(double));
+      }
     }
-    /* otherwise, try to compute non-linear
-       corrections up the the highest possible redshift, that is, starting from the smallest possible time */
+
     else {
-      index_tau_desired_nl = 0;
-    }
 
-    /* loop over time. Go backward, starting from today and going back to earlier times. */
-    for (index_tau = pfo->tau_size-1; index_tau>=index_tau_desired_nl; index_tau--) {
+      /** --> Loop over decreasing time/growing redhsift. For each
+          time/redshift, compute P_NL(k,z) using either Halofit or
+          HMcode */
 
-      /* loop over index_pk, defined such that it is ensured
-       * that index_pk starts at index_pk_cb when neutrinos are
-       * included. This is necessary for hmcode, since the sigmatable
-       * needs to be filled for sigma_cb only. Thus, when HMcode
-       * evalutes P_m_nl, it needs both P_m_l and P_cb_l. */
+      /* this flag will become _TRUE_ at the minimum redshift such that
+         the non-lienar corrections cannot be consistently computed */
+      nl_corr_not_computable_at_this_k = _FALSE_;
 
-      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+      /* this index will refer to the value of time corresponding to
+         that redhsift */
+      pfo->index_tau_min_nl = 0;
 
-        /* if we are still in a range of time where P_NL(k) should be computable */
-        if (nl_corr_not_computable_at_this_k == _FALSE_) {
-
-          /* get P_L(k) at this time in order to estimate P_NL(k) */
-
-          /* we call fourier_pk_linear() once more. Note that we do
-             not use the results stored in pfo->ln_pk_l_extra, because
-             here we investigate different values of tau than when
-             storing pfo->ln_pk_l, pfo->ln_pk_l_extra, ... */
-          class_call(fourier_pk_linear(pba,
-                                       ppt,
-                                       ppm,
-                                       pfo,
-                                       index_pk,
-                                       index_tau,
-                                       pfo->k_size_extra,
-                                       lnpk_l[index_pk],
-                                       NULL),
-                     pfo->error_message,
-                     pfo->error_message);
+      /* this size will refer to the computed Pk_NL range. We will reduce it if the corrections cannot be computed. */
+      pfo->ln_tau_size_nl = pfo->ln_tau_size;
 
-          /* spline P_L(k) at this time along k */
-          class_call(array_spline_table_columns(pfo->ln_k,
-                                                pfo->k_size_extra,
-                                                lnpk_l[index_pk],
-                                                1,
-                                                ddlnpk_l[index_pk],
-                                                _SPLINE_NATURAL_,
-                                                pfo->error_message),
-                     pfo->error_message,
-                     pfo->error_message);
+      /* if we do not want any Cl’s derived from large scale structure source functions, try to compute non-linear
+  	     corrections only in the range z<z_max_pk, that is, index_tau >= pfo->tau_size - pfo->ln_tau_size */
+      if ((ppt->has_cl_cmb_lensing_potential == _FALSE_) &&
+          (ppt->has_cl_lensing_potential == _FALSE_) &&
+          (ppt->has_cl_number_count == _FALSE_)) {
+  		  index_tau_desired_nl = pfo->tau_size - pfo->ln_tau_size;
+      }
+      /* otherwise, try to compute non-linear
+         corrections up the the highest possible redshift, that is, starting from the smallest possible time */
+      else {
+        index_tau_desired_nl = 0;
+      }
 
-          /* get P_NL(k) at this time with Halofit */
-          if (pfo->method == nl_halofit) {
+      /* compute P_NL(k) at all times in parallel first; the loop below
+         only collects the results, in order, and stops at the first
+         time at which the corrections could not be computed */
 
-            class_call(halofit(ppr,
-                               pba,
-                               ppt,
-                               ppm,
-                               pfo,
-                               index_pk,
-                               pfo->tau[index_tau],
-                               pk_nl[index_pk],
-                               lnpk_l[index_pk],
-                               ddlnpk_l[index_pk],
-                               &(pfo->k_nl[index_pk][index_tau]),
-                               &nl_corr_not_computable_at_this_k),
-                       pfo->error_message,
-                       pfo->error_message);
+      class_alloc(pk_nl_at_all_tau,
+                  pfo->pk_size*sizeof(double*),
+                  pfo->error_message);
 
-          }
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
+        class_alloc(pk_nl_at_all_tau[index_pk],pfo->tau_size*pfo->k_size*sizeof(double),pfo->error_message);
+      }
 
-          /* get P_NL(k) at this time with HMcode */
-          else if (pfo->method == nl_HMcode) {
-
-            /* (preliminary step: fill table of sigma(R) */
-            class_call(hmcode_fill_sigtab(ppr,
-                                          pba,
-                                          ppt,
-                                          ppm,
-                                          pfo,
-                                          index_tau,
-                                          index_pk,
-                                          lnpk_l,
-                                          ddlnpk_l,
-                                          phw),
-                       pfo->error_message, pfo->error_message);
-
-            class_call(hmcode(ppr,
-                              pba,
-                              ppt,
-                              ppm,
-                              pfo,
-                              index_pk,
-                              index_tau,
-                              pfo->tau[index_tau],
-                              pk_nl[index_pk],
-                              lnpk_l,
-                              ddlnpk_l,
-                              &(pfo->k_nl[index_pk][index_tau]),
-                              &nl_corr_not_computable_at_this_k,
-                              phw),
+      class_alloc(nl_corr_not_computable_at_all_tau,
+                  pfo->tau_size*pfo->pk_size*sizeof(short),
+                  pfo->error_message);
+
+      if (pfo->method == nl_halofit) {
+
+        class_call(halofit_at_all_tau(ppr,
+                                      pba,
+                                      ppt,
+                                      ppm,
+                                      pfo,
+                                      index_tau_desired_nl,
+                                      pk_nl_at_all_tau,
+                                      nl_corr_not_computable_at_all_tau,
+                                      pfp_halofit),
+                   pfo->error_message,
+                   pfo->error_message);
+      }
+      else if (pfo->method == nl_HMcode) {
+
+        class_call(hmcode_at_all_tau(ppr,
+                                     pba,
+                                     ppt,
+                                     ppm,
+                                     pfo,
+                                     index_tau_desired_nl,
+                                     pk_nl_at_all_tau,
+                                     nl_corr_not_computable_at_all_tau,
+                                     phw),
+                   pfo->error_message,
+                   pfo->error_message);
+      }
+
+      /* loop over time. Go backward, starting from today and going back to earlier times. */
+      for (index_tau = pfo->tau_size-1; index_tau>=index_tau_desired_nl; index_tau--) {
+
+        /* loop over index_pk, defined such that it is ensured
+         * that index_pk starts at index_pk_cb when neutrinos are
+         * included. This is necessary for hmcode, since the sigmatable
+         * needs to be filled for sigma_cb only. Thus, when HMcode
+         * evalutes P_m_nl, it needs both P_m_l and P_cb_l. */
+
+        for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
+
+          /* if we are still in a range of time where P_NL(k) should be computable */
+          if (nl_corr_not_computable_at_this_k == _FALSE_) {
+
+            /* get P_L(k) at this time in order to infer R_NL from P_NL(k) */
+
+            /* we call fourier_pk_linear() once more. Note that we do
+               not use the results stored in pfo->ln_pk_l_extra, because
+               here we investigate different values of tau than when
+               storing pfo->ln_pk_l, pfo->ln_pk_l_extra, ... */
+            class_call(fourier_pk_linear(pba,
+                                         ppt,
+                                         ppm,
+                                         pfo,
+                                         index_pk,
+                                         index_tau,
+                                         pfo->k_size,
+                                         lnpk_l[index_pk],
+                                         NULL),
                        pfo->error_message,
                        pfo->error_message);
-          }
-          else {
-            class_stop(pfo->error_message,"nonlinear method not recognized.");
-          }
 
-          /* Above, we have checked the computability of NL corrections.
-             If they could be computed, infer and store R_NL=(P_NL/P_L)^1/2, and also store P_NL */
-           if (nl_corr_not_computable_at_this_k == _FALSE_) {
+            /* get P_NL(k) at this time (already computed by
+               halofit_at_all_tau() or hmcode_at_all_tau(), together
+               with pfo->k_nl) */
+            nl_corr_not_computable_at_this_k = nl_corr_not_computable_at_all_tau[index_tau*pfo->pk_size+index_pk];
+
+            for (index_k=0; index_k<pfo->k_size; index_k++) {
+              pk_nl[index_pk][index_k] = pk_nl_at_all_tau[index_pk][index_tau*pfo->k_size+index_k];
+            }
+
+            /* Above, we have checked the computability of NL corrections.
+               If they could be computed, infer and store R_NL=(P_NL/P_L)^1/2, and also store P_NL */
+             if (nl_corr_not_computable_at_this_k == _FALSE_) {
 
-            /* Store R_NL */
-             for (index_k=0; index_k<pfo->k_size; index_k++) {
-               pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = sqrt(pk_nl[index_pk][index_k]/exp(lnpk_l[index_pk][index_k]));
-             }
+              /* Store R_NL */
+               for (index_k=0; index_k<pfo->k_size; index_k++) {
+                 pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = sqrt(pk_nl[index_pk][index_k]/exp(lnpk_l[index_pk][index_k]));
+               }
 
-            /* Store P_NL (only if the output is requested, i.e. z < z_max_pk),
-               which is equivalent to index_tau >= pfo->tau_size - pfo->ln_tau_size */
-            if (index_tau >= pfo->tau_size - pfo->ln_tau_size) {
+              /* Store P_NL (only if the output is requested, i.e. z < z_max_pk),
+                 which is equivalent to index_tau >= pfo->tau_size - pfo->ln_tau_size */
+              if (index_tau >= pfo->tau_size - pfo->ln_tau_size) {
 
-              index_tau_late = index_tau - (pfo->tau_size - pfo->ln_tau_size);
+                index_tau_late = index_tau - (pfo->tau_size - pfo->ln_tau_size);
 
+                for (index_k=0; index_k<pfo->k_size; index_k++) {
+                  pfo->ln_pk_nl[index_pk][index_tau_late * pfo->k_size + index_k] = log(pk_nl[index_pk][index_k]);
+                }
+              }
+            }
+
+            /* otherwise we met the first problematic value of time */
+            else {
+
+              /* store the index of that value */
+              pfo->index_tau_min_nl = MIN(pfo->tau_size-1,index_tau+1); //this MIN() ensures that index_tau_min_nl is never out of bounds
+              pfo->ln_tau_size_nl = MIN(pfo->tau_size-1-index_tau,pfo->ln_tau_size); //this will be at most ln_tau_size, and at least 0 (if NL corr cannot be computed at first step)
+
+              /* store R_NL=1 for that time */
               for (index_k=0; index_k<pfo->k_size; index_k++) {
-                pfo->ln_pk_nl[index_pk][index_tau_late * pfo->k_size + index_k] = log(pk_nl[index_pk][index_k]);
+                pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = 1.;
+              }
+
+              /* send a warning to inform user about the corresponding value of redshift */
+              if (pfo->fourier_verbose > 0) {
+                class_alloc(pvecback,pba->bg_size*sizeof(double),pfo->error_message);
+                class_call(background_at_tau(pba,pfo->tau[index_tau],short_info,inter_normal,&last_index,pvecback),
+                           pba->error_message,
+                           pfo->error_message);
+                a = pvecback[pba->index_bg_a];
+                /* redshift (remeber that a in the code stands for (a/a_0)) */
+                z = 1./a-1.;
+                fprintf(stdout,
+                        " -> [WARNING:] Non-linear corrections could not be computed at redshift z=%5.2f and higher.\n    This is because k_max is too small for the algorithm (Halofit or HMcode) to be able to compute the scale k_NL at this redshift.\n    If non-linear corrections at such high redshift really matter for you,\n    just try to increase the precision parameter nonlinear_min_k_max (currently at %e) until k_NL can be computed at the desired z.\n",z,ppr->nonlinear_min_k_max);
+
+                free(pvecback);
               }
+
+              class_test(pfo->ln_tau_size_nl >1 && pfo->ln_tau_size_nl< 3, pfo->error_message, "Not enough redshifts had a non-linear correction computed, so spline-interpolation of the non-linear correction is impossible. Increase P_k_max_h/Mpc or P_k_max_1/Mpc or fourier_min_k_max.");
             }
           }
 
-          /* otherwise we met the first problematic value of time */
+          /* if we are still in a range of time where P_NL(k) should NOT be computable */
           else {
 
-            /* store the index of that value */
-            pfo->index_tau_min_nl = MIN(pfo->tau_size-1,index_tau+1); //this MIN() ensures that index_tau_min_nl is never out of bounds
-            pfo->ln_tau_size_nl = MIN(pfo->tau_size-1-index_tau,pfo->ln_tau_size); //this will be at most ln_tau_size, and at least 0 (if NL corr cannot be computed at first step)
-
-            /* store R_NL=1 for that time */
+            /* store R_NL=1 for that time (very fast) */
             for (index_k=0; index_k<pfo->k_size; index_k++) {
               pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = 1.;
             }
 
-            /* send a warning to inform user about the corresponding value of redshift */
-            if (pfo->fourier_verbose > 0) {
-              class_alloc(pvecback,pba->bg_size*sizeof(double),pfo->error_message);
-              class_call(background_at_tau(pba,pfo->tau[index_tau],short_info,inter_normal,&last_index,pvecback),
-                         pba->error_message,
-                         pfo->error_message);
-              a = pvecback[pba->index_bg_a];
-              /* redshift (remeber that a in the code stands for (a/a_0)) */
-              z = 1./a-1.;
-              fprintf(stdout,
-                      " -> [WARNING:] Non-linear corrections could not be computed at redshift z=%5.2f and higher.\n    This is because k_max is too small for the algorithm (Halofit or HMcode) to be able to compute the scale k_NL at this redshift.\n    If non-linear corrections at such high redshift really matter for you,\n    just try to increase the precision parameter nonlinear_min_k_max (currently at %e) until k_NL can be computed at the desired z.\n",z,ppr->nonlinear_min_k_max);
-
-              free(pvecback);
-            }
-
-            class_test(pfo->ln_tau_size_nl >1 && pfo->ln_tau_size_nl< 3, pfo->error_message, "Not enough redshifts had a non-linear correction computed, so spline-interpolation of the non-linear correction is impossible. Increase P_k_max_h/Mpc or P_k_max_1/Mpc or fourier_min_k_max.");
           }
-        }
 
-        /* if we are still in a range of time where P_NL(k) should NOT be computable */
-        else {
+        } // end loop over index_pk
+      } //end loop over index_tau
 
-          /* store R_NL=1 for that time (very fast) */
-          for (index_k=0; index_k<pfo->k_size; index_k++) {
-            pfo->nl_corr_density[index_pk][index_tau * pfo->k_size + index_k] = 1.;
-          }
 
-        }
-
-      } // end loop over index_pk
-    } //end loop over index_tau
+      /** --> spline the array of nonlinear power spectrum
+              (only above the first index where it could be computed) */
+      if (pfo->ln_tau_size_nl > 1) {
+        for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
 
+          class_call(array_spline_table_lines2(pfo->ln_tau+(pfo->ln_tau_size-pfo->ln_tau_size_nl),
+                                               pfo->ln_tau_size_nl,
+                                               pfo->ln_pk_nl[index_pk]+(pfo->ln_tau_size-pfo->ln_tau_size_nl)*pfo->k_size,
+                                               pfo->k_size,
+                                               pfo->ddln_pk_nl[index_pk]+(pfo->ln_tau_size-pfo->ln_tau_size_nl)*pfo->k_size,
+                                               _SPLINE_EST_DERIV_,
+                                               pfo->error_message),
+                     pfo->error_message,
+                     pfo->error_message);
+        }
+      }
 
-    /** --> spline the array of nonlinear power spectrum
-            (only above the first index where it could be computed) */
-    if (pfo->ln_tau_size_nl > 1) {
-      for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
-
-        class_call(array_spline_table_lines(pfo->ln_tau+(pfo->ln_tau_size-pfo->ln_tau_size_nl),
-                                            pfo->ln_tau_size_nl,
-                                            pfo->ln_pk_nl[index_pk]+(pfo->ln_tau_size-pfo->ln_tau_size_nl)*pfo->k_size,
-                                            pfo->k_size,
-                                            pfo->ddln_pk_nl[index_pk]+(pfo->ln_tau_size-pfo->ln_tau_size_nl)*pfo->k_size,
-                                            _SPLINE_EST_DERIV_,
-                                            pfo->error_message),
-                   pfo->error_message,
-                   pfo->error_message);
+      for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
+        free(pk_nl_at_all_tau[index_pk]);
       }
+      free(pk_nl_at_all_tau);
+      free(nl_corr_not_computable_at_all_tau);
     }
 
     /* --> free temporary arrays */
@@ -1770,18 +2536,20 @@ int fourier_init(
     for (index_pk=0; index_pk<pfo->pk_size; index_pk++){
       free(pk_nl[index_pk]);
       free(lnpk_l[index_pk]);
-      free(ddlnpk_l[index_pk]);
     }
 
     free(pk_nl);
     free(lnpk_l);
-    free(ddlnpk_l);
 
-    /** --> free the nonlinear workspace */
+    /** --> free the nonlinear workspace, unless it is kept for the spectra computed on demand */
+
+    if ((pfp_halofit != NULL) && (pfo->nl_on_demand == _FALSE_)) {
+      fftlog_plan_free(pfp_halofit);
+    }
 
-    if (pfo->method == nl_HMcode) {
+    if ((pfo->method == nl_HMcode) && (pfo->nl_on_demand == _FALSE_)) {
 
-      class_call(hmcode_workspace_free(pfo,phw),
+      class_call(hmcode_workspace_free(ppr,pfo,phw),
                  pfo->error_message,
                  pfo->error_message);
 
@@ -1798,6 +2566,9 @@ int fourier_init(
   }
 
   pfo->is_allocated = _TRUE_;
+
+  class_timer_end(&(pfo->stats));
+
   return _SUCCESS_;
 }
 
@@ -1814,6 +2585,12 @@ int fourier_free(
                  ) {
   int index_pk;
 
+  if (pfo->nl_on_demand == _TRUE_) {
+    class_call(fourier_nl_spectra_free(pfo),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
   if ((pfo->has_pk_matter == _TRUE_) || (pfo->method > nl_none)) {
 
     free(pfo->k);
@@ -1838,6 +2615,11 @@ int fourier_free(
       free(pfo->ddln_pk_l_an_extra);
     }
 
+    if (pfo->nowiggle_plan != NULL) {
+      nowiggle_plan_free(pfo->nowiggle_plan);
+      free(pfo->nowiggle_plan);
+    }
+
     free (pfo->sigma8);
 
     if (pfo->ln_tau_size>1) {
@@ -2169,7 +2951,6 @@ int fourier_get_tau_list(
  * @param index_ic        Input: index of required ic value
  * @param index_tp        Input: index of required tp value
  * @param index_tau       Input: index of required tau value
- * @param sources         Input: array containing the original sources
  * @param source          Output: desired value of source
  * @return the error status
  */
@@ -2182,7 +2963,6 @@ int fourier_get_source(
                        int index_ic,
                        int index_tp,
                        int index_tau,
-                       double ** sources,
                        double * source
                        ) {
 
@@ -2192,7 +2972,7 @@ int fourier_get_source(
 
   /** - use precomputed values */
   if (index_k < pfo->k_size) {
-    *source = sources[index_ic * ppt->tp_size[pfo->index_md_scalars] + index_tp][index_tau * pfo->k_size + index_k];
+    *source = _source_value_(ppt,pfo->index_md_scalars,index_ic * ppt->tp_size[pfo->index_md_scalars] + index_tp,index_tau * pfo->k_size + index_k);
   }
   /** - extrapolate **/
   else {
@@ -2203,13 +2983,13 @@ int fourier_get_source(
      * --> Get last source and k, which are used in (almost) all methods
      */
     k_max = pfo->k[pfo->k_size-1];
-    source_max = sources[index_ic * ppt->tp_size[pfo->index_md_scalars] + index_tp][index_tau * pfo->k_size + pfo->k_size - 1];
+    source_max = _source_value_(ppt,pfo->index_md_scalars,index_ic * ppt->tp_size[pfo->index_md_scalars] + index_tp,index_tau * pfo->k_size + pfo->k_size - 1);
 
     /**
      * --> Get previous source and k, which are used in best methods
      */
     k_previous = pfo->k[pfo->k_size-2];
-    source_previous = sources[index_ic * ppt->tp_size[pfo->index_md_scalars] + index_tp][index_tau * pfo->k_size + pfo->k_size - 2];
+    source_previous = _source_value_(ppt,pfo->index_md_scalars,index_ic * ppt->tp_size[pfo->index_md_scalars] + index_tp,index_tau * pfo->k_size + pfo->k_size - 2);
 
     switch(pfo->extrapolation_method){
       /**
@@ -2400,7 +3180,6 @@ int fourier_pk_linear(
                                     index_ic1,
                                     index_tp,
                                     index_tau,
-                                    ppt->sources[pfo->index_md_scalars],
                                     &source_ic1),
                  pfo->error_message,
                  pfo->error_message);
@@ -2433,7 +3212,6 @@ int fourier_pk_linear(
                                         index_ic1,
                                         index_tp,
                                         index_tau,
-                                        ppt->sources[pfo->index_md_scalars],
                                         &source_ic1),
                      pfo->error_message,
                      pfo->error_message);
@@ -2445,7 +3223,6 @@ int fourier_pk_linear(
                                         index_ic2,
                                         index_tp,
                                         index_tau,
-                                        ppt->sources[pfo->index_md_scalars],
                                         &source_ic2),
                      pfo->error_message,
                      pfo->error_message);
@@ -2547,13 +3324,13 @@ int fourier_wnw_split(
 
   if (pfo->ln_tau_size > 1) {
     /** - spline the nowiggle spectrum with respect to time */
-    class_call(array_spline_table_lines(pfo->ln_tau,
-                                        pfo->ln_tau_size,
-                                        pfo->ln_pk_l_nw_extra,
-                                        pfo->k_size_extra,
-                                        pfo->ddln_pk_l_nw_extra,
-                                        _SPLINE_EST_DERIV_,
-                                        pfo->error_message),
+    class_call(array_spline_table_lines2(pfo->ln_tau,
+                                         pfo->ln_tau_size,
+                                         pfo->ln_pk_l_nw_extra,
+                                         pfo->k_size_extra,
+                                         pfo->ddln_pk_l_nw_extra,
+                                         _SPLINE_EST_DERIV_,
+                                         pfo->error_message),
                pfo->error_message,
                pfo->error_message);
   }
@@ -2570,6 +3347,11 @@ int fourier_wnw_split(
  * stepsize, management of extrapolation at large k, ...) and is
  * overall more precise for sigma(R).
  *
+ * When the same P(k) is needed for several values of R, it is faster
+ * to call fourier_sigmas_pk_table() once and then
+ * fourier_sigmas_from_pk_table() for each R, which gives exactly the
+ * same result.
+ *
  * @param pfo          Input: pointer to fourier structure
  * @param R            Input: scale at which to compute sigma
  * @param lnpk_l       Input: array of ln(P(k))
@@ -2591,39 +3373,75 @@ int fourier_sigmas(
                    enum out_sigmas sigma_output,
                    double * result
                    ) {
-  double pk, lnpk;
 
-  double * array_for_sigma;
-  int index_num;
-  int index_x;
-  int index_y;
-  int index_ddy;
-  int i=0;
+  double * pk_table;
   int integrand_size;
-  int last_index=0;
 
-  double k,W,W_prime,x,t;
+  class_call(fourier_sigmas_pk_table(pfo,
+                                     lnpk_l,
+                                     ddlnpk_l,
+                                     k_size,
+                                     k_per_decade,
+                                     &integrand_size,
+                                     &pk_table),
+             pfo->error_message,
+             pfo->error_message);
 
-  /** - allocate temporary array for an integral over y(x) */
+  class_call(fourier_sigmas_from_pk_table(pfo,
+                                          R,
+                                          pk_table,
+                                          integrand_size,
+                                          k_per_decade,
+                                          sigma_output,
+                                          result),
+             pfo->error_message,
+             pfo->error_message);
 
-  class_define_index(index_x,  _TRUE_,i,1); // index for x
-  class_define_index(index_y,  _TRUE_,i,1); // index for integrand
-  class_define_index(index_ddy,_TRUE_,i,1); // index for its second derivative (spline method)
-  index_num=i;                              // number of columns in the array
+  free(pk_table);
 
-  integrand_size=(int)(log(pfo->k[k_size-1]/pfo->k[0])/log(10.)*k_per_decade)+1;
-  class_alloc(array_for_sigma,
-              integrand_size*index_num*sizeof(double),
-              pfo->error_message);
+  return _SUCCESS_;
+}
 
-  /** - fill the array with values of k and of the integrand */
+/**
+ * Sample P(k) on the grid of wavenumbers used by the integrals of
+ * fourier_sigmas(), k_i = k_0 10^(i/k_per_decade), such that it can be
+ * reused for several scales R with fourier_sigmas_from_pk_table().
+ *
+ * @param pfo            Input: pointer to fourier structure
+ * @param lnpk_l         Input: array of ln(P(k))
+ * @param ddlnpk_l       Input: its spline along k
+ * @param k_size         Input: dimension of array lnpk_l (see fourier_sigmas())
+ * @param k_per_decade   Input: logarithmic step for the integral
+ * @param integrand_size Output: number of sampled wavenumbers
+ * @param pk_table       Output: pointer to the array of P(k_i), allocated here, to be freed by the caller
+ * @return the error status
+ */
 
-  for (i=0; i<integrand_size; i++) {
+int fourier_sigmas_pk_table(
+                            struct fourier * pfo,
+                            double * lnpk_l,
+                            double * ddlnpk_l,
+                            int k_size,
+                            double k_per_decade,
+                            int * integrand_size,
+                            double ** pk_table
+                            ) {
+  double lnpk;
+  double k;
+  int i;
+  int last_index=0;
+
+  *integrand_size=(int)(log(pfo->k[k_size-1]/pfo->k[0])/log(10.)*k_per_decade)+1;
+  class_alloc(*pk_table,
+              (*integrand_size)*sizeof(double),
+              pfo->error_message);
+
+  for (i=0; i<*integrand_size; i++) {
 
     k=pfo->k[0]*pow(10.,i/k_per_decade);
 
     if (i==0) {
-      pk = exp(lnpk_l[0]);
+      (*pk_table)[i] = exp(lnpk_l[0]);
     }
     else {
       class_call(array_interpolate_spline(
@@ -2640,8 +3458,64 @@ int fourier_sigmas(
                  pfo->error_message,
                  pfo->error_message);
 
-      pk = exp(lnpk);
+      (*pk_table)[i] = exp(lnpk);
     }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Same as fourier_sigmas(), but from P(k) already sampled by
+ * fourier_sigmas_pk_table() with the same k_per_decade.
+ *
+ * @param pfo            Input: pointer to fourier structure
+ * @param R              Input: scale at which to compute sigma
+ * @param pk_table       Input: array of P(k_i) from fourier_sigmas_pk_table()
+ * @param integrand_size Input: its size
+ * @param k_per_decade   Input: logarithmic step for the integral
+ * @param sigma_output   Input: quantity to be computed (sigma, sigma', ...)
+ * @param result         Output: result
+ * @return the error status
+ */
+
+int fourier_sigmas_from_pk_table(
+                                 struct fourier * pfo,
+                                 double R,
+                                 double * pk_table,
+                                 int integrand_size,
+                                 double k_per_decade,
+                                 enum out_sigmas sigma_output,
+                                 double * result
+                                 ) {
+  double pk;
+
+  double * array_for_sigma;
+  int index_num;
+  int index_x;
+  int index_y;
+  int index_ddy;
+  int i=0;
+
+  double k,W,W_prime,x,t;
+
+  /** - allocate temporary array for an integral over y(x) */
+
+  class_define_index(index_x,  _TRUE_,i,1); // index for x
+  class_define_index(index_y,  _TRUE_,i,1); // index for integrand
+  class_define_index(index_ddy,_TRUE_,i,1); // index for its second derivative (spline method)
+  index_num=i;                              // number of columns in the array
+
+  class_alloc(array_for_sigma,
+              integrand_size*index_num*sizeof(double),
+              pfo->error_message);
+
+  /** - fill the array with values of k and of the integrand */
+
+  for (i=0; i<integrand_size; i++) {
+
+    k=pfo->k[0]*pow(10.,i/k_per_decade);
+    pk = pk_table[i];
 
     t = 1./(1.+k);
     if (i == (integrand_size-1)) k *= 0.9999999; // to prevent rounding error leading to k being bigger than maximum value
@@ -2733,6 +3607,202 @@ int fourier_sigmas(
   return _SUCCESS_;
 }
 
+/**
+ * Prepare the FFTLog transform used by fourier_sigmas_fftlog() for P(k)
+ * sampled by fourier_sigmas_pk_table() with the same k_size and
+ * k_per_decade. The plan depends only on the grid of wavenumbers and
+ * on the quantity computed, so it can be reused for all P(k) sampled
+ * on this grid; it is freed with fftlog_plan_free().
+ *
+ * @param pfo          Input: pointer to fourier structure
+ * @param k_size       Input: dimension of the array of ln(P(k)) sampled by fourier_sigmas_pk_table()
+ * @param k_per_decade Input: logarithmic step of the sampling
+ * @param sigma_output Input: quantity to be computed (sigma, sigma', ...)
+ * @param pfp          Output: pointer to the plan
+ * @return the error status
+ */
+
+int fourier_sigmas_fftlog_init(
+                               struct fourier * pfo,
+                               int k_size,
+                               double k_per_decade,
+                               enum out_sigmas sigma_output,
+                               struct fftlog_plan * pfp
+                               ) {
+
+  int integrand_size;
+
+  /* same grid as in fourier_sigmas_pk_table() */
+  integrand_size=(int)(log(pfo->k[k_size-1]/pfo->k[0])/log(10.)*k_per_decade)+1;
+
+  /* the bias makes the integrand k^3 P(k) k^(-bias) (or k P(k) k^(-bias)
+     for sigma_disp) decrease at both ends of the range */
+  switch (sigma_output) {
+
+  case out_sigma:
+    class_call(fftlog_plan_init(pfp,integrand_size,log(10.)/k_per_decade,1.5,fftlog_tophat_sq,pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+    break;
+
+  case out_sigma_prime:
+    class_call(fftlog_plan_init(pfp,integrand_size,log(10.)/k_per_decade,1.5,fftlog_tophat_sq_dlnx,pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+    break;
+
+  case out_sigma_disp:
+    class_call(fftlog_plan_init(pfp,integrand_size,log(10.)/k_per_decade,0.5,fftlog_tophat_sq,pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+    break;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Same quantities as fourier_sigmas_from_pk_table(), but for all
+ * values of R on the logarithmic grid R_j = 1/k_(n-1-j) at once, with
+ * one FFTLog transform (see tools/fftlog.c), and splined along
+ * ln(R). This is faster as soon as the result is needed for more than
+ * a few values of R; it agrees with the direct quadrature to about
+ * 1e-10 in the middle of the range, but it is less accurate within
+ * about one decade of 1/k_max and 1/k_min. The result can then be
+ * evaluated at any R with fourier_sigmas_from_fftlog_table().
+ *
+ * @param pfo          Input: pointer to fourier structure
+ * @param pfp          Input: pointer to plan from fourier_sigmas_fftlog_init() for this sigma_output
+ * @param pk_table     Input: array of P(k_i) from fourier_sigmas_pk_table()
+ * @param sigma_output Input: quantity to be computed (sigma, sigma', ...)
+ * @param lnR          Output: array of ln(R_j), of size pfp->n, in increasing order
+ * @param result       Output: array of results at R_j, of size pfp->n
+ * @param ddresult     Output: array of their second derivatives along ln(R), of size pfp->n
+ * @return the error status
+ */
+
+int fourier_sigmas_fftlog(
+                          struct fourier * pfo,
+                          struct fftlog_plan * pfp,
+                          double * pk_table,
+                          enum out_sigmas sigma_output,
+                          double * lnR,
+                          double * result,
+                          double * ddresult
+                          ) {
+
+  double * integrand;
+  double k;
+  int i;
+
+  class_alloc(integrand,pfp->n*sizeof(double),pfo->error_message);
+
+  for (i=0; i<pfp->n; i++) {
+    k = pfo->k[0]*exp(i*pfp->dlnk);
+    if (sigma_output == out_sigma_disp)
+      integrand[i] = k*pk_table[i]/(2.*_PI_*_PI_*3.);
+    else
+      integrand[i] = k*k*k*pk_table[i]/(2.*_PI_*_PI_);
+  }
+
+  class_call(fftlog_execute(pfp,integrand,log(pfo->k[0]),lnR,result,pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  for (i=0; i<pfp->n; i++) {
+    switch (sigma_output) {
+
+    case out_sigma:
+    case out_sigma_disp:
+      /* the ringing near the edges of the range could give slightly negative values */
+      result[i] = sqrt(MAX(result[i],0.));
+      break;
+
+    case out_sigma_prime:
+      result[i] /= exp(lnR[i]);
+      break;
+    }
+  }
+
+  class_call(array_spline_table_columns(lnR,
+                                        pfp->n,
+                                        result,
+                                        1,
+                                        ddresult,
+                                        _SPLINE_EST_DERIV_,
+                                        pfo->error_message),
+             pfo->error_message,
+             pfo->error_message);
+
+  free(integrand);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Evaluate at one value of R a quantity tabulated by
+ * fourier_sigmas_fftlog(), by spline interpolation, except within one
+ * decade of the edges of the table, where FFTLog is not accurate
+ * enough and the direct quadrature of fourier_sigmas_from_pk_table()
+ * is used instead.
+ *
+ * @param pfo           Input: pointer to fourier structure
+ * @param R             Input: radius in Mpc
+ * @param lnR           Input: array of ln(R_j) from fourier_sigmas_fftlog()
+ * @param table         Input: array of results at R_j from fourier_sigmas_fftlog()
+ * @param ddtable       Input: array of their second derivatives from fourier_sigmas_fftlog()
+ * @param pk_table      Input: array of P(k_i) from fourier_sigmas_pk_table()
+ * @param pk_table_size Input: dimension of pk_table, equal to that of the other arrays
+ * @param k_per_decade  Input: logarithmic step of the sampling
+ * @param sigma_output  Input: quantity to be computed (sigma, sigma', ...)
+ * @param last_index    Input/Output: index used by array_interpolate_spline() for faster successive calls
+ * @param result        Output: result
+ * @return the error status
+ */
+
+int fourier_sigmas_from_fftlog_table(
+                                     struct fourier * pfo,
+                                     double R,
+                                     double * lnR,
+                                     double * table,
+                                     double * ddtable,
+                                     double * pk_table,
+                                     int pk_table_size,
+                                     double k_per_decade,
+                                     enum out_sigmas sigma_output,
+                                     int * last_index,
+                                     double * result
+                                     ) {
+
+  if ((log(R) > lnR[0]+log(10.)) && (log(R) < lnR[pk_table_size-1]-log(10.))) {
+    class_call(array_interpolate_spline(lnR,
+                                        pk_table_size,
+                                        table,
+                                        ddtable,
+                                        1,
+                                        log(R),
+                                        last_index,
+                                        result,
+                                        1,
+                                        pfo->error_message),
+               pfo->error_message,
+               pfo->error_message);
+  }
+  else {
+    class_call(fourier_sigmas_from_pk_table(pfo,
+                                            R,
+                                            pk_table,
+                                            pk_table_size,
+                                            k_per_decade,
+                                            sigma_output,
+                                            result),
+               pfo->error_message,
+               pfo->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine computes the variance of density fluctuations in a
  * sphere of radius R at redshift z, sigma(R,z) for one given pk type (_m, _cb).
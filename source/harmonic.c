@@ -245,6 +245,57 @@ int harmonic_cl_at_l(
 
 }
 
+/**
+ * Total anisotropy power spectra \f$ C_l\f$'s for all types at each
+ * integer multipole l_min <= l <= l_max, in one call: same as calling
+ * harmonic_cl_at_l() for each l, with the temporary arrays for the
+ * modes and initial conditions allocated only once. Meant for the
+ * wrappers, which can then fill a whole table without leaving C.
+ *
+ * @param phr        Input: pointer to harmonic structure (containing pre-computed table)
+ * @param l_min      Input: first multipole
+ * @param l_max      Input: last multipole
+ * @param cl_tot     Output: array with argument cl_tot[(l-l_min)*phr->ct_size+index_ct] (must be already allocated)
+ * @return the error status
+ */
+
+int harmonic_cl_at_l_range(
+                           struct harmonic * phr,
+                           int l_min,
+                           int l_max,
+                           double * cl_tot
+                           ) {
+
+  double ** cl_md;
+  double ** cl_md_ic;
+  int index_md;
+  int l;
+  int status = _SUCCESS_;
+
+  class_alloc(cl_md,phr->md_size*sizeof(double*),phr->error_message);
+  class_alloc(cl_md_ic,phr->md_size*sizeof(double*),phr->error_message);
+  for (index_md = 0; index_md < phr->md_size; index_md++) {
+    class_alloc(cl_md[index_md],phr->ct_size*sizeof(double),phr->error_message);
+    class_alloc(cl_md_ic[index_md],phr->ct_size*phr->ic_ic_size[index_md]*sizeof(double),phr->error_message);
+  }
+
+  for (l = l_min; l <= l_max; l++) {
+    if (harmonic_cl_at_l(phr,(double)l,cl_tot+(l-l_min)*phr->ct_size,cl_md,cl_md_ic) == _FAILURE_) {
+      status = _FAILURE_;
+      break;
+    }
+  }
+
+  for (index_md = 0; index_md < phr->md_size; index_md++) {
+    free(cl_md[index_md]);
+    free(cl_md_ic[index_md]);
+  }
+  free(cl_md);
+  free(cl_md_ic);
+
+  return status;
+}
+
 /**
  * This routine initializes the harmonic structure (in particular,
  * computes table of anisotropy and Fourier spectra \f$ C_l^{X}, P(k), ... \f$)
@@ -271,12 +322,16 @@ int harmonic_init(
 
   /** Summary: */
 
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(phr->stats));
+
   /** - check that we really want to compute at least one spectrum */
 
   if (ppt->has_cls == _FALSE_) {
     phr->md_size = 0;
     if (phr->harmonic_verbose > 0)
       printf("No spectra requested. Spectra module skipped.\n");
+    class_timer_end(&(phr->stats));
     return _SUCCESS_;
   }
   else {
@@ -315,6 +370,8 @@ int harmonic_init(
   phr->pfo = pfo;
   phr->is_allocated = _TRUE_;
 
+  class_timer_end(&(phr->stats));
+
   return _SUCCESS_;
 }
 
@@ -679,7 +736,10 @@ int harmonic_cls(
   int index_ic1,index_ic2,index_ic1_ic2;
   int index_l;
   int index_ct;
-  int cl_integrand_num_columns;
+  double * cl_weight; /* array with argument cl_weight[index_ic1_ic2*ptr->q_size+index_q] */
+  double * cl_weight_limber; /* similar array for the full Limber k list */
+  double * cl_weight_lcmb_direct; /* similar array for the k lists of the direct Limber scheme */
+  short * cl_sampled; /* with the adaptive l sampling of the transfer module, flags of the C_l's computed, cl_sampled[(index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct] */
 
   /** - allocate pointers to arrays where results will be stored */
 
@@ -707,9 +767,29 @@ int harmonic_cls(
 
     class_alloc(phr->cl[index_md],sizeof(double)*phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md],phr->error_message);
     class_alloc(phr->ddcl[index_md],sizeof(double)*phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md],phr->error_message);
-    cl_integrand_num_columns = 1+phr->ct_size*2; /* one for k, ct_size for each type, ct_size for each second derivative of each type */
 
-    /** - --> (c) loop over initial conditions */
+    /** - --> (c) compute the weights of the integral over q, common to all l's and types */
+
+    class_call(harmonic_cl_weights(ppr,
+                                   pba,
+                                   ptr,
+                                   ppm,
+                                   phr,
+                                   index_md,
+                                   &cl_weight,
+                                   &cl_weight_limber,
+                                   &cl_weight_lcmb_direct),
+               phr->error_message,
+               phr->error_message);
+
+    cl_sampled = NULL;
+    if (ptr->l_sampled != NULL) {
+      class_alloc(cl_sampled,sizeof(short)*phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md],phr->error_message);
+      for (index_l=0; index_l < phr->l_size[index_md]*phr->ct_size*phr->ic_ic_size[index_md]; index_l++)
+        cl_sampled[index_l] = _TRUE_;
+    }
+
+    /** - --> (d) loop over initial conditions */
 
     class_setup_parallel();
 
@@ -722,73 +802,30 @@ int harmonic_cls(
 
           /** - ---> loop over l values defined in the transfer module.
               For each l, compute the \f$ C_l\f$'s for all types (TT, TE, ...)
-              by convolving primordial spectra with transfer  functions.
+              as weighted products over q of transfer functions.
               This elementary task is assigned to harmonic_compute_cl() */
 
-          for (index_l=0; index_l < ptr->l_size[index_md]; index_l++) {
-
-            class_run_parallel(=,
-
-              double * cl_integrand; /* array with argument cl_integrand[index_k*cl_integrand_num_columns+1+phr->index_ct] */
-              double * cl_integrand_limber; /* similar array with same columns but different number of lines (less k values) */
-              double * transfer_ic1; /* array with argument transfer_ic1[index_tt] */
-              double * transfer_ic2; /* idem */
-              double * primordial_pk;  /* array with argument primordial_pk[index_ic_ic]*/
-
-
-              class_alloc(cl_integrand,
-                          ptr->q_size*cl_integrand_num_columns*sizeof(double),
-                          phr->error_message);
-
-              cl_integrand_limber = NULL;
-              if (ptr->do_lcmb_full_limber == _TRUE_) {
-                class_alloc(cl_integrand_limber,
-                            ptr->q_size_limber*cl_integrand_num_columns*sizeof(double),
-                            phr->error_message);
-              }
-
-              class_alloc(primordial_pk,
-                          phr->ic_ic_size[index_md]*sizeof(double),
-                          phr->error_message);
-
-              class_alloc(transfer_ic1,
-                          ptr->tt_size[index_md]*sizeof(double),
-                          phr->error_message);
-
-              class_alloc(transfer_ic2,
-                          ptr->tt_size[index_md]*sizeof(double),
-                          phr->error_message);
+          class_label_parallel("harmonic:cl",0);
+          class_parallel_for(index_l,0,ptr->l_size[index_md],0,=,
 
               class_call(harmonic_compute_cl(ppr,
                                              pba,
                                              ppt,
                                              ptr,
-                                             ppm,
                                              phr,
                                              index_md,
                                              index_ic1,
                                              index_ic2,
                                              index_l,
-                                             cl_integrand_num_columns,
-                                             cl_integrand,
-                                             cl_integrand_limber,
-                                             primordial_pk,
-                                             transfer_ic1,
-                                             transfer_ic2),
+                                             cl_weight,
+                                             cl_weight_limber,
+                                             cl_weight_lcmb_direct,
+                                             cl_sampled),
                          phr->error_message,
                          phr->error_message);
 
-              free(cl_integrand);
-              if (ptr->do_lcmb_full_limber == _TRUE_) {
-                free(cl_integrand_limber);
-              }
-              free(primordial_pk);
-              free(transfer_ic1);
-              free(transfer_ic2);
-
               return _SUCCESS_;
-            );
-          } /* end of loop over l */
+            ); /* end of loop over l */
 
         }
         else {
@@ -808,7 +845,26 @@ int harmonic_cls(
 
     class_finish_parallel();
 
-    /** - --> (d) now that for a given mode, all possible \f$ C_l\f$'s have been computed,
+    free(cl_weight);
+    if (cl_weight_limber != NULL) {
+      free(cl_weight_limber);
+    }
+    if (cl_weight_lcmb_direct != NULL) {
+      free(cl_weight_lcmb_direct);
+    }
+
+    /** - --> with the adaptive l sampling of the transfer module,
+        interpolate the \f$ C_l\f$'s at the multipoles where they have
+        not been computed */
+
+    if (cl_sampled != NULL) {
+      class_call(harmonic_cl_fill_l(phr,index_md,cl_sampled),
+                 phr->error_message,
+                 phr->error_message);
+      free(cl_sampled);
+    }
+
+    /** - --> (e) now that for a given mode, all possible \f$ C_l\f$'s have been computed,
         compute second derivative of the array in which they are stored,
         in view of spline interpolation. */
 
@@ -828,80 +884,156 @@ int harmonic_cls(
 }
 
 /**
- * This routine computes the \f$ C_l\f$'s for a given mode, pair of initial conditions
- * and multipole, but for all types (TT, TE...), by convolving the
- * transfer functions with the primordial spectra.
+ * With the adaptive l sampling of the transfer module
+ * (ppr->transfer_l_adaptive), this routine fills the \f$ C_l\f$'s of
+ * each type at the multipoles where they have not been computed by
+ * harmonic_compute_cl(), by spline interpolation of the values at the
+ * multipoles where they have: those where the transfer functions of
+ * both fields are known. These always include the first and last
+ * multipoles. The interpolated function is \f$ [l(l+1)]^p C_l\f$,
+ * with p=1 for the temperature, E, B and number count fields and p=2
+ * for the CMB and galaxy lensing potentials (averaged over the two
+ * fields of cross-spectra), with a milder dependence on l.
  *
- * @param ppr           Input: pointer to precision structure
- * @param pba           Input: pointer to background structure
- * @param ppt           Input: pointer to perturbation structure
- * @param ptr           Input: pointer to transfer structure
- * @param ppm           Input: pointer to primordial structure
- * @param phr           Input/Output: pointer to harmonic structure (result stored here)
- * @param index_md      Input: index of mode under consideration
- * @param index_ic1     Input: index of first initial condition in the correlator
- * @param index_ic2     Input: index of second initial condition in the correlator
- * @param index_l       Input: index of multipole under consideration
- * @param cl_integrand_num_columns Input: number of columns in cl_integrand
- * @param cl_integrand  Input: an allocated workspace
- * @param cl_integrand_limber  Input: an allocated workspace for full Limber calculation
- * @param primordial_pk Input: table of primordial spectrum values
- * @param transfer_ic1  Input: table of transfer function values for first initial condition
- * @param transfer_ic2  Input: table of transfer function values for second initial condition
+ * @param phr        Input/Output: pointer to harmonic structure
+ * @param index_md   Input: index of mode under consideration
+ * @param cl_sampled Input: flags of the C_l's computed, with the same argument as phr->cl[index_md]
  * @return the error status
  */
 
-int harmonic_compute_cl(
+int harmonic_cl_fill_l(
+                       struct harmonic * phr,
+                       int index_md,
+                       short * cl_sampled
+                       ) {
+
+  int index_ic1_ic2;
+  int index_ct;
+  int index_l;
+  int index;
+  int sampled_size;
+  int last_index;
+  int ll_size;
+  double power;
+  double * l_sampled;
+  double * cl;
+  double * ddcl;
+
+  class_alloc(l_sampled,phr->l_size[index_md]*sizeof(double),phr->error_message);
+  class_alloc(cl,phr->l_size[index_md]*sizeof(double),phr->error_message);
+  class_alloc(ddcl,phr->l_size[index_md]*sizeof(double),phr->error_message);
+
+  /* number of types in the block of galaxy lensing spectra */
+  ll_size = (phr->d_size*(phr->d_size+1)-(phr->d_size-phr->non_diag)*(phr->d_size-1-phr->non_diag))/2;
+
+  for (index_ic1_ic2 = 0; index_ic1_ic2 < phr->ic_ic_size[index_md]; index_ic1_ic2++) {
+    for (index_ct = 0; index_ct < phr->ct_size; index_ct++) {
+
+      power = 1.;
+      if (((phr->has_pp == _TRUE_) && (index_ct == phr->index_ct_pp)) ||
+          ((phr->has_ll == _TRUE_) && (index_ct >= phr->index_ct_ll) && (index_ct < phr->index_ct_ll+ll_size)))
+        power = 2.;
+      if (((phr->has_tp == _TRUE_) && (index_ct == phr->index_ct_tp)) ||
+          ((phr->has_ep == _TRUE_) && (index_ct == phr->index_ct_ep)) ||
+          ((phr->has_pd == _TRUE_) && (index_ct >= phr->index_ct_pd) && (index_ct < phr->index_ct_pd+phr->d_size)) ||
+          ((phr->has_tl == _TRUE_) && (index_ct >= phr->index_ct_tl) && (index_ct < phr->index_ct_tl+phr->d_size)) ||
+          ((phr->has_dl == _TRUE_) && (index_ct >= phr->index_ct_dl)))
+        power = 1.5;
+
+      sampled_size = 0;
+      for (index_l = 0; index_l < phr->l_size[index_md]; index_l++) {
+        index = (index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct;
+        if (cl_sampled[index] == _TRUE_) {
+          l_sampled[sampled_size] = phr->l[index_l];
+          cl[sampled_size] = pow(phr->l[index_l]*(phr->l[index_l]+1.),power) * phr->cl[index_md][index];
+          sampled_size++;
+        }
+      }
+
+      if (sampled_size == phr->l_size[index_md])
+        continue;
+
+      class_test((sampled_size < 3) ||
+                 (cl_sampled[index_ic1_ic2 * phr->ct_size + index_ct] == _FALSE_) ||
+                 (cl_sampled[((phr->l_size[index_md]-1) * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct] == _FALSE_),
+                 phr->error_message,
+                 "the C_l's of type %d have been computed at %d multipoles only, without the first or last one",
+                 index_ct,sampled_size);
+
+      class_call(array_spline_table_lines(l_sampled,
+                                          sampled_size,
+                                          cl,
+                                          1,
+                                          ddcl,
+                                          _SPLINE_EST_DERIV_,
+                                          phr->error_message),
+                 phr->error_message,
+                 phr->error_message);
+
+      last_index = 0;
+      for (index_l = 0; index_l < phr->l_size[index_md]; index_l++) {
+        index = (index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct;
+        if (cl_sampled[index] == _FALSE_) {
+          class_call(array_interpolate_spline(l_sampled,
+                                              sampled_size,
+                                              cl,
+                                              ddcl,
+                                              1,
+                                              phr->l[index_l],
+                                              &last_index,
+                                              &(phr->cl[index_md][index]),
+                                              1,
+                                              phr->error_message),
+                     phr->error_message,
+                     phr->error_message);
+          phr->cl[index_md][index] /= pow(phr->l[index_l]*(phr->l[index_l]+1.),power);
+        }
+      }
+    }
+  }
+
+  free(l_sampled);
+  free(cl);
+  free(ddcl);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes, for a given mode and for each pair of
+ * initial conditions, the weights of the integral over q giving the
+ * \f$ C_l\f$'s. These weights include the quadrature weights of the
+ * spline (or trapezoidal) integration scheme, the measure \f$ 4 \pi dk/k \f$
+ * and the primordial spectrum, which depend neither on l nor on the
+ * type of \f$ C_l\f$. Then each \f$ C_l\f$ is a weighted sum over q
+ * of a product of two transfer functions.
+ *
+ * @param ppr              Input: pointer to precision structure
+ * @param pba              Input: pointer to background structure
+ * @param ptr              Input: pointer to transfer structure
+ * @param ppm              Input: pointer to primordial structure
+ * @param phr              Input: pointer to harmonic structure
+ * @param index_md         Input: index of mode under consideration
+ * @param cl_weight        Output: pointer to array of weights, allocated here, with argument cl_weight[index_ic1_ic2*ptr->q_size+index_q]
+ * @param cl_weight_limber Output: pointer to array of weights for the full Limber k list (allocated only if ptr->do_lcmb_full_limber is true, NULL otherwise)
+ * @param cl_weight_lcmb_direct Output: pointer to array of weights for the k lists of the direct Limber scheme, with argument cl_weight_lcmb_direct[(index_l-ptr->index_l_lcmb_direct)*phr->ic_ic_size[index_md]*ptr->tau_size_lcmb_direct+index_ic1_ic2*ptr->k_size_lcmb_direct[index_l-ptr->index_l_lcmb_direct]+index_k] (allocated only for scalars if ptr->do_lcmb_direct_limber is true, NULL otherwise)
+ * @return the error status
+ */
+
+int harmonic_cl_weights(
                         struct precision * ppr,
                         struct background * pba,
-                        struct perturbations * ppt,
                         struct transfer * ptr,
                         struct primordial * ppm,
                         struct harmonic * phr,
                         int index_md,
-                        int index_ic1,
-                        int index_ic2,
-                        int index_l,
-                        int cl_integrand_num_columns,
-                        double * cl_integrand,
-                        double * cl_integrand_limber,
-                        double * primordial_pk,
-                        double * transfer_ic1,
-                        double * transfer_ic2
+                        double ** cl_weight,
+                        double ** cl_weight_limber,
+                        double ** cl_weight_lcmb_direct
                         ) {
 
-  int index_q;
-  int index_tt;
-  int index_ct;
-  int index_d1,index_d2;
-  double k;
-  double clvalue;
-  int index_ic1_ic2;
-  double transfer_ic1_temp=0.;
-  double transfer_ic2_temp=0.;
-  double * transfer_ic1_nc=NULL;
-  double * transfer_ic2_nc=NULL;
-  double factor;
   int index_q_spline=0;
-  double * integrand;
-  int num_columns;
-  int num_k;
-  int column_k;
-  int column_integrand;
-  int column_derivative;
-  int index_spline;
-  double q_min;
-  double k_min;
-  double l;
-
-  l = phr->l[index_l];
-
-  index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
-
-  if (ppt->has_cl_number_count == _TRUE_ && _scalars_) {
-    class_alloc(transfer_ic1_nc,phr->d_size*sizeof(double),phr->error_message);
-    class_alloc(transfer_ic2_nc,phr->d_size*sizeof(double),phr->error_message);
-  }
+  int index_l, l_size_direct;
 
   /* Technical point: here, we will do a spline integral over the
      whole range of k's, excepted in the closed (K>0) case. In that
@@ -921,113 +1053,153 @@ int harmonic_compute_cl(
     index_q_spline = ptr->index_q_flat_approximation;
   }
 
-  for (index_q=0; index_q < ptr->q_size; index_q++) {
-
-    //q = ptr->q[index_q];
-    k = ptr->k[index_md][index_q];
-
-    cl_integrand[index_q*cl_integrand_num_columns+0] = k;
-
-    class_call(primordial_spectrum_at_k(ppm,index_md,linear,k,primordial_pk),
-               ppm->error_message,
-               phr->error_message);
-
-    /* above routine checks that k>0: no possible division by zero below */
+  class_alloc(*cl_weight,
+              phr->ic_ic_size[index_md]*ptr->q_size*sizeof(double),
+              phr->error_message);
 
-    for (index_tt=0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+  class_call(harmonic_cl_weights_at_k(pba,
+                                      ppm,
+                                      phr,
+                                      index_md,
+                                      ptr->k[index_md],
+                                      ptr->q_size,
+                                      index_q_spline,
+                                      ptr->q[0],
+                                      ptr->k[0][0],
+                                      *cl_weight),
+             phr->error_message,
+             phr->error_message);
 
-      transfer_ic1[index_tt] =
-        ptr->transfer[index_md]
-        [((index_ic1 * ptr->tt_size[index_md] + index_tt)
-          * ptr->l_size[index_md] + index_l)
-         * ptr->q_size + index_q];
+  /* full Limber calculation for some types (actually, only pp) */
 
-      if (index_ic1 == index_ic2) {
-        transfer_ic2[index_tt] = transfer_ic1[index_tt];
-      }
-      else {
-        transfer_ic2[index_tt] = ptr->transfer[index_md]
-          [((index_ic2 * ptr->tt_size[index_md] + index_tt)
-            * ptr->l_size[index_md] + index_l)
-           * ptr->q_size + index_q];
-      }
-    }
+  *cl_weight_limber = NULL;
 
-    /* define combinations of transfer functions */
+  if (ptr->do_lcmb_full_limber == _TRUE_) {
 
-    if (ppt->has_cl_cmb_temperature == _TRUE_) {
+    class_alloc(*cl_weight_limber,
+                phr->ic_ic_size[index_md]*ptr->q_size_limber*sizeof(double),
+                phr->error_message);
 
-      if (_scalars_) {
+    class_call(harmonic_cl_weights_at_k(pba,
+                                        ppm,
+                                        phr,
+                                        index_md,
+                                        ptr->k_limber[index_md],
+                                        ptr->q_size_limber,
+                                        0,
+                                        ptr->q_limber[0],
+                                        ptr->k_limber[0][0],
+                                        *cl_weight_limber),
+               phr->error_message,
+               phr->error_message);
+  }
 
-        transfer_ic1_temp = transfer_ic1[ptr->index_tt_t0] + transfer_ic1[ptr->index_tt_t1] + transfer_ic1[ptr->index_tt_t2];
-        transfer_ic2_temp = transfer_ic2[ptr->index_tt_t0] + transfer_ic2[ptr->index_tt_t1] + transfer_ic2[ptr->index_tt_t2];
+  /* direct Limber scheme for pp at high l: one list of k per multipole */
 
-      }
+  *cl_weight_lcmb_direct = NULL;
 
-      if (_vectors_) {
+  if ((ptr->do_lcmb_direct_limber == _TRUE_) && (index_md == phr->index_md_scalars)) {
 
-        transfer_ic1_temp = transfer_ic1[ptr->index_tt_t1] + transfer_ic1[ptr->index_tt_t2];
-        transfer_ic2_temp = transfer_ic2[ptr->index_tt_t1] + transfer_ic2[ptr->index_tt_t2];
+    l_size_direct = ptr->l_size[index_md] - ptr->index_l_lcmb_direct;
 
-      }
+    class_calloc(*cl_weight_lcmb_direct,
+                 l_size_direct*phr->ic_ic_size[index_md]*ptr->tau_size_lcmb_direct,
+                 sizeof(double),
+                 phr->error_message);
 
-      if (_tensors_) {
+    for (index_l = 0; index_l < l_size_direct; index_l++) {
+
+      if (ptr->k_size_lcmb_direct[index_l] < 2)
+        continue;
+
+      class_call(harmonic_cl_weights_at_k(pba,
+                                          ppm,
+                                          phr,
+                                          index_md,
+                                          ptr->k_lcmb_direct + index_l*ptr->tau_size_lcmb_direct,
+                                          ptr->k_size_lcmb_direct[index_l],
+                                          0,
+                                          0.,
+                                          0.,
+                                          *cl_weight_lcmb_direct + index_l*phr->ic_ic_size[index_md]*ptr->tau_size_lcmb_direct),
+                 phr->error_message,
+                 phr->error_message);
+    }
+  }
 
-        transfer_ic1_temp = transfer_ic1[ptr->index_tt_t2];
-        transfer_ic2_temp = transfer_ic2[ptr->index_tt_t2];
+  return _SUCCESS_;
+}
 
-      }
-    }
+/**
+ * This routine computes the weights of harmonic_cl_weights() for a
+ * given list of k values.
+ *
+ * @param pba           Input: pointer to background structure
+ * @param ppm           Input: pointer to primordial structure
+ * @param phr           Input: pointer to harmonic structure
+ * @param index_md      Input: index of mode under consideration
+ * @param k             Input: list of k values
+ * @param k_size        Input: number of k values
+ * @param index_spline  Input: index below which the integral is trapezoidal rather than spline
+ * @param q_min         Input: smallest value of q (for the correction to the first point in the closed case)
+ * @param k_min         Input: smallest value of k (idem)
+ * @param cl_weight     Output: array of weights (already allocated) with argument cl_weight[index_ic1_ic2*k_size+index_k]
+ * @return the error status
+ */
 
-    if (ppt->has_cl_number_count == _TRUE_ && _scalars_) {
+int harmonic_cl_weights_at_k(
+                             struct background * pba,
+                             struct primordial * ppm,
+                             struct harmonic * phr,
+                             int index_md,
+                             double * k,
+                             int k_size,
+                             int index_spline,
+                             double q_min,
+                             double k_min,
+                             double * cl_weight
+                             ) {
+
+  int index_k;
+  int index_ic1_ic2;
+  double * quadrature;
+  double * primordial_pk; /* array with argument primordial_pk[index_ic_ic]*/
 
-      for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+  class_alloc(quadrature,k_size*sizeof(double),phr->error_message);
+  class_alloc(primordial_pk,phr->ic_ic_size[index_md]*sizeof(double),phr->error_message);
 
-        transfer_ic1_nc[index_d1] = 0.;
-        transfer_ic2_nc[index_d1] = 0.;
+  /* weights of the values of the integrand in the integral computed by
+     array_spline() and array_integrate_all_trapzd_or_spline() */
 
-        if (ppt->has_nc_density == _TRUE_) {
-          transfer_ic1_nc[index_d1] += transfer_ic1[ptr->index_tt_density+index_d1];
-          transfer_ic2_nc[index_d1] += transfer_ic2[ptr->index_tt_density+index_d1];
-        }
+  class_call(array_integrate_all_trapzd_or_spline_weights(k,
+                                                          k_size,
+                                                          index_spline,
+                                                          quadrature,
+                                                          phr->error_message),
+             phr->error_message,
+             phr->error_message);
 
-        if (ppt->has_nc_rsd     == _TRUE_) {
-          transfer_ic1_nc[index_d1]
-            += transfer_ic1[ptr->index_tt_rsd+index_d1]
-            + transfer_ic1[ptr->index_tt_d0+index_d1]
-            + transfer_ic1[ptr->index_tt_d1+index_d1];
-          transfer_ic2_nc[index_d1]
-            += transfer_ic2[ptr->index_tt_rsd+index_d1]
-            + transfer_ic2[ptr->index_tt_d0+index_d1]
-            + transfer_ic2[ptr->index_tt_d1+index_d1];
-        }
+  /* in the closed case, instead of an integral, we have a
+     discrete sum. In practice, this does not matter: the previous
+     routine does give a correct approximation of the discrete
+     sum, both in the trapezoidal and spline regions. The only
+     error comes from the first point: the previous routine
+     assumes a weight for the first point which is too small
+     compared to what it would be in the an actual discrete
+     sum. The line below correct this problem in an exact way.
+  */
 
-        if (ppt->has_nc_lens == _TRUE_) {
-          transfer_ic1_nc[index_d1] +=
-            l*(l+1.)*transfer_ic1[ptr->index_tt_nc_lens+index_d1];
-          transfer_ic2_nc[index_d1] +=
-            l*(l+1.)*transfer_ic2[ptr->index_tt_nc_lens+index_d1];
-        }
+  if (pba->sgnK == 1) {
+    quadrature[0] += q_min/k_min*sqrt(pba->K)/2.;
+  }
 
-        if (ppt->has_nc_gr == _TRUE_) {
-          transfer_ic1_nc[index_d1]
-            += transfer_ic1[ptr->index_tt_nc_g1+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g2+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g3+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g4+index_d1]
-            + transfer_ic1[ptr->index_tt_nc_g5+index_d1];
-          transfer_ic2_nc[index_d1]
-            += transfer_ic2[ptr->index_tt_nc_g1+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g2+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g3+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g4+index_d1]
-            + transfer_ic2[ptr->index_tt_nc_g5+index_d1];
-        }
+  for (index_k=0; index_k < k_size; index_k++) {
 
-      }
-    }
+    class_call(primordial_spectrum_at_k(ppm,index_md,linear,k[index_k],primordial_pk),
+               ppm->error_message,
+               phr->error_message);
 
-    /* integrand of Cl's */
+    /* above routine checks that k>0: no possible division by zero below */
 
     /* note: we must integrate
 
@@ -1070,281 +1242,586 @@ int harmonic_compute_cl(
 
     */
 
-    factor = 4. * _PI_ / k;
-
-    if (phr->has_tt == _TRUE_)
-      cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_tt]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1_temp
-        * transfer_ic2_temp
-        * factor;
-
-    if (phr->has_ee == _TRUE_)
-      cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_ee]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1[ptr->index_tt_e]
-        * transfer_ic2[ptr->index_tt_e]
-        * factor;
-
-    if (phr->has_te == _TRUE_)
-      cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_te]=
-        primordial_pk[index_ic1_ic2]
-        * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_e] +
-               transfer_ic1[ptr->index_tt_e] * transfer_ic2_temp)
-        * factor;
-
-    if (_tensors_ && (phr->has_bb == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_bb]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1[ptr->index_tt_b]
-        * transfer_ic2[ptr->index_tt_b]
-        * factor;
-
-    if (_scalars_ && (phr->has_pp == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_pp]=
-        primordial_pk[index_ic1_ic2]
-        * transfer_ic1[ptr->index_tt_lcmb]
-        * transfer_ic2[ptr->index_tt_lcmb]
-        * factor;
-
-    if (_scalars_ && (phr->has_tp == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_tp]=
-        primordial_pk[index_ic1_ic2]
-        * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_lcmb] +
-               transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2_temp)
-        * factor;
-
-    if (_scalars_ && (phr->has_ep == _TRUE_))
-      cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_ep]=
-        primordial_pk[index_ic1_ic2]
-        * 0.5*(transfer_ic1[ptr->index_tt_e] * transfer_ic2[ptr->index_tt_lcmb] +
-               transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2[ptr->index_tt_e])
-        * factor;
-
-    if (_scalars_ && (phr->has_dd == _TRUE_)) {
-      index_ct=0;
-      for (index_d1=0; index_d1<phr->d_size; index_d1++) {
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
-          cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_dd+index_ct]=
-            primordial_pk[index_ic1_ic2]
-            * transfer_ic1_nc[index_d1]
-            * transfer_ic2_nc[index_d2]
-            * factor;
-          index_ct++;
+    for (index_ic1_ic2=0; index_ic1_ic2 < phr->ic_ic_size[index_md]; index_ic1_ic2++) {
+      cl_weight[index_ic1_ic2*k_size+index_k] =
+        quadrature[index_k]
+        * 4. * _PI_ / k[index_k]
+        * primordial_pk[index_ic1_ic2];
+    }
+  }
+
+  free(quadrature);
+  free(primordial_pk);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the \f$ C_l\f$'s for a given mode, pair of initial conditions
+ * and multipole, but for all types (TT, TE...), by convolving the
+ * transfer functions with the primordial spectra.
+ *
+ * The transfer functions are first combined into a few fields (total
+ * temperature, E, B, CMB lensing potential, number count and lensing
+ * of each bin), each tabulated over q. Each \f$ C_l\f$ is then a
+ * weighted scalar product over q of two fields, with the weights of
+ * harmonic_cl_weights(): for all bins, this is a matrix product
+ * \f$ \Delta^T W \Delta \f$ over q.
+ *
+ * @param ppr              Input: pointer to precision structure
+ * @param pba              Input: pointer to background structure
+ * @param ppt              Input: pointer to perturbation structure
+ * @param ptr              Input: pointer to transfer structure
+ * @param phr              Input/Output: pointer to harmonic structure (result stored here)
+ * @param index_md         Input: index of mode under consideration
+ * @param index_ic1        Input: index of first initial condition in the correlator
+ * @param index_ic2        Input: index of second initial condition in the correlator
+ * @param index_l          Input: index of multipole under consideration
+ * @param cl_weight        Input: weights computed by harmonic_cl_weights()
+ * @param cl_weight_limber Input: weights for the full Limber calculation (or NULL)
+ * @param cl_weight_lcmb_direct Input: weights for the direct Limber scheme (or NULL)
+ * @param cl_sampled       Output: with the adaptive l sampling of the transfer module, flags of the C_l's computed (the others are left to zero), with the same argument as phr->cl[index_md]; NULL otherwise
+ * @return the error status
+ */
+
+int harmonic_compute_cl(
+                        struct precision * ppr,
+                        struct background * pba,
+                        struct perturbations * ppt,
+                        struct transfer * ptr,
+                        struct harmonic * phr,
+                        int index_md,
+                        int index_ic1,
+                        int index_ic2,
+                        int index_l,
+                        double * cl_weight,
+                        double * cl_weight_limber,
+                        double * cl_weight_lcmb_direct,
+                        short * cl_sampled
+                        ) {
+
+  int index_q;
+  int index_ic;
+  int index_ct;
+  int index_d1,index_d2;
+  int index_ic1_ic2;
+  int index_f_temp=-1;
+  int index_f_e=-1;
+  int index_f_b=-1;
+  int index_f_lcmb=-1;
+  int index_f_nc=-1;
+  int index_f_lensing=-1;
+  int f_size=0;
+  int q_size;
+  int stride_tt;
+  int offset;
+  short same_ic;
+  double * field_ic1; /* array with argument field_ic1[index_f*ptr->q_size+index_q] */
+  double * field_ic2; /* idem (points to field_ic1 if index_ic1 == index_ic2) */
+  double * field;
+  double * weight;
+  double * cl;
+  short * f_sampled;
+  int index_tt_nc;
+  double l;
+
+  l = phr->l[index_l];
+  q_size = ptr->q_size;
+
+  index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
+  same_ic = (index_ic1 == index_ic2) ? _TRUE_ : _FALSE_;
+
+  weight = cl_weight + index_ic1_ic2*q_size;
+
+  /* results, for all types: the null spectra (C_l^BB of scalars,
+     C_l^pp of tensors, etc.) keep the value zero */
+
+  cl = phr->cl[index_md] + (index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size;
+
+  for (index_ct=0; index_ct<phr->ct_size; index_ct++) {
+    cl[index_ct] = 0.;
+  }
+
+  /* define combinations of transfer functions */
+
+  class_define_index(index_f_temp,   ppt->has_cl_cmb_temperature == _TRUE_,                       f_size,1);
+  class_define_index(index_f_e,      ppt->has_cl_cmb_polarization == _TRUE_,                      f_size,1);
+  class_define_index(index_f_b,      _tensors_ && (phr->has_bb == _TRUE_),                        f_size,1);
+  class_define_index(index_f_lcmb,   _scalars_ && (ppt->has_cl_cmb_lensing_potential == _TRUE_),  f_size,1);
+  class_define_index(index_f_nc,     _scalars_ && (ppt->has_cl_number_count == _TRUE_),           f_size,phr->d_size);
+  class_define_index(index_f_lensing,_scalars_ && (ppt->has_cl_lensing_potential == _TRUE_),      f_size,phr->d_size);
+
+  /* with the adaptive l sampling of the transfer module, find which
+     fields have been computed at this multipole (all the types of a
+     field share the same sampling, see transfer_l_field()) */
+
+  f_sampled = NULL;
+  if (cl_sampled != NULL) {
+
+    cl_sampled += (index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size;
+
+#define _field_sampled_(index_tt) ptr->l_sampled[index_md][(index_tt) * ptr->l_size[index_md] + index_l]
+
+    class_alloc(f_sampled,MAX(f_size,1)*sizeof(short),phr->error_message);
+
+    if (index_f_temp != -1)
+      f_sampled[index_f_temp] = _field_sampled_(ptr->index_tt_t2);
+    if (index_f_e != -1)
+      f_sampled[index_f_e] = _field_sampled_(ptr->index_tt_e);
+    if (index_f_b != -1)
+      f_sampled[index_f_b] = _field_sampled_(ptr->index_tt_b);
+    if (index_f_lcmb != -1)
+      f_sampled[index_f_lcmb] = _field_sampled_(ptr->index_tt_lcmb);
+    if (index_f_nc != -1) {
+      if (ppt->has_nc_density == _TRUE_)
+        index_tt_nc = ptr->index_tt_density;
+      else if (ppt->has_nc_rsd == _TRUE_)
+        index_tt_nc = ptr->index_tt_rsd;
+      else if (ppt->has_nc_lens == _TRUE_)
+        index_tt_nc = ptr->index_tt_nc_lens;
+      else
+        index_tt_nc = ptr->index_tt_nc_g1;
+      for (index_d1=0; index_d1<phr->d_size; index_d1++)
+        f_sampled[index_f_nc+index_d1] = _field_sampled_(index_tt_nc+index_d1);
+    }
+    if (index_f_lensing != -1) {
+      for (index_d1=0; index_d1<phr->d_size; index_d1++)
+        f_sampled[index_f_lensing+index_d1] = _field_sampled_(ptr->index_tt_lensing+index_d1);
+    }
+
+#undef _field_sampled_
+  }
+
+  /* macro: whether the C_l of type index_ct, product of the two
+     fields index_f1 and index_f2, must be computed (it is then flagged
+     in cl_sampled) */
+#define _cl_sampled_(index_ct,index_f1,index_f2)                        \
+  ((cl_sampled == NULL) ||                                              \
+   ((cl_sampled[index_ct] = (((f_sampled[index_f1] == _TRUE_) && (f_sampled[index_f2] == _TRUE_)) ? _TRUE_ : _FALSE_)) == _TRUE_))
+
+  class_alloc(field_ic1,MAX(f_size,1)*q_size*sizeof(double),phr->error_message);
+  if (same_ic == _TRUE_) {
+    field_ic2 = field_ic1;
+  }
+  else {
+    class_alloc(field_ic2,MAX(f_size,1)*q_size*sizeof(double),phr->error_message);
+  }
+
+  /* fill the fields for each of the two initial conditions. In
+     ptr->transfer, for a given (ic, tt, l), values are contiguous in
+     q */
+
+  stride_tt = ptr->l_size[index_md] * q_size;
+
+  for (index_ic = index_ic1; index_ic <= index_ic2; index_ic++) {
+
+    if ((index_ic != index_ic1) && (index_ic != index_ic2))
+      continue;
+
+    field = (index_ic == index_ic1) ? field_ic1 : field_ic2;
+    offset = (index_ic * ptr->tt_size[index_md] * ptr->l_size[index_md] + index_l) * q_size;
+
+    if (index_f_temp != -1) {
+      for (index_q=0; index_q < q_size; index_q++) {
+        if (_scalars_) {
+          field[index_f_temp*q_size+index_q] =
+            _transfer_value_(ptr,index_md,offset+ptr->index_tt_t0*stride_tt+index_q)
+            + _transfer_value_(ptr,index_md,offset+ptr->index_tt_t1*stride_tt+index_q)
+            + _transfer_value_(ptr,index_md,offset+ptr->index_tt_t2*stride_tt+index_q);
+        }
+        if (_vectors_) {
+          field[index_f_temp*q_size+index_q] =
+            _transfer_value_(ptr,index_md,offset+ptr->index_tt_t1*stride_tt+index_q)
+            + _transfer_value_(ptr,index_md,offset+ptr->index_tt_t2*stride_tt+index_q);
+        }
+        if (_tensors_) {
+          field[index_f_temp*q_size+index_q] =
+            _transfer_value_(ptr,index_md,offset+ptr->index_tt_t2*stride_tt+index_q);
         }
       }
     }
 
-    if (_scalars_ && (phr->has_td == _TRUE_)) {
-      for (index_d1=0; index_d1<phr->d_size; index_d1++) {
-        cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_td+index_d1]=
-          primordial_pk[index_ic1_ic2]
-          * 0.5*(transfer_ic1_temp * transfer_ic2_nc[index_d1] +
-                 transfer_ic1_nc[index_d1] * transfer_ic2_temp)
-          * factor;
+    if (index_f_e != -1) {
+      for (index_q=0; index_q < q_size; index_q++) {
+        field[index_f_e*q_size+index_q] =
+          _transfer_value_(ptr,index_md,offset+ptr->index_tt_e*stride_tt+index_q);
       }
     }
 
-    if (_scalars_ && (phr->has_pd == _TRUE_)) {
-      for (index_d1=0; index_d1<phr->d_size; index_d1++) {
-        cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_pd+index_d1]=
-          primordial_pk[index_ic1_ic2]
-          * 0.5*(transfer_ic1[ptr->index_tt_lcmb] * transfer_ic2_nc[index_d1] +
-                 transfer_ic1_nc[index_d1] * transfer_ic2[ptr->index_tt_lcmb])
-          * factor;
+    if (index_f_b != -1) {
+      for (index_q=0; index_q < q_size; index_q++) {
+        field[index_f_b*q_size+index_q] =
+          _transfer_value_(ptr,index_md,offset+ptr->index_tt_b*stride_tt+index_q);
       }
     }
 
-    if (_scalars_ && (phr->has_ll == _TRUE_)) {
-      index_ct=0;
-      for (index_d1=0; index_d1<phr->d_size; index_d1++) {
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
-          cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_ll+index_ct]=
-            primordial_pk[index_ic1_ic2]
-            * transfer_ic1[ptr->index_tt_lensing+index_d1]
-            * transfer_ic2[ptr->index_tt_lensing+index_d2]
-            * factor;
-          index_ct++;
-        }
+    if (index_f_lcmb != -1) {
+      for (index_q=0; index_q < q_size; index_q++) {
+        field[index_f_lcmb*q_size+index_q] =
+          _transfer_value_(ptr,index_md,offset+ptr->index_tt_lcmb*stride_tt+index_q);
       }
     }
 
-    if (_scalars_ && (phr->has_tl == _TRUE_)) {
+    if (index_f_nc != -1) {
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
-        cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_tl+index_d1]=
-          primordial_pk[index_ic1_ic2]
-          * 0.5*(transfer_ic1_temp * transfer_ic2[ptr->index_tt_lensing+index_d1] +
-                 transfer_ic1[ptr->index_tt_lensing+index_d1] * transfer_ic2_temp)
-          * factor;
+        for (index_q=0; index_q < q_size; index_q++) {
+
+          field[(index_f_nc+index_d1)*q_size+index_q] = 0.;
+
+          if (ppt->has_nc_density == _TRUE_) {
+            field[(index_f_nc+index_d1)*q_size+index_q] +=
+              _transfer_value_(ptr,index_md,offset+(ptr->index_tt_density+index_d1)*stride_tt+index_q);
+          }
+
+          if (ppt->has_nc_rsd     == _TRUE_) {
+            field[(index_f_nc+index_d1)*q_size+index_q] +=
+              _transfer_value_(ptr,index_md,offset+(ptr->index_tt_rsd+index_d1)*stride_tt+index_q)
+              + _transfer_value_(ptr,index_md,offset+(ptr->index_tt_d0+index_d1)*stride_tt+index_q)
+              + _transfer_value_(ptr,index_md,offset+(ptr->index_tt_d1+index_d1)*stride_tt+index_q);
+          }
+
+          if (ppt->has_nc_lens == _TRUE_) {
+            field[(index_f_nc+index_d1)*q_size+index_q] +=
+              l*(l+1.)*_transfer_value_(ptr,index_md,offset+(ptr->index_tt_nc_lens+index_d1)*stride_tt+index_q);
+          }
+
+          if (ppt->has_nc_gr == _TRUE_) {
+            field[(index_f_nc+index_d1)*q_size+index_q] +=
+              _transfer_value_(ptr,index_md,offset+(ptr->index_tt_nc_g1+index_d1)*stride_tt+index_q)
+              + _transfer_value_(ptr,index_md,offset+(ptr->index_tt_nc_g2+index_d1)*stride_tt+index_q)
+              + _transfer_value_(ptr,index_md,offset+(ptr->index_tt_nc_g3+index_d1)*stride_tt+index_q)
+              + _transfer_value_(ptr,index_md,offset+(ptr->index_tt_nc_g4+index_d1)*stride_tt+index_q)
+              + _transfer_value_(ptr,index_md,offset+(ptr->index_tt_nc_g5+index_d1)*stride_tt+index_q);
+          }
+        }
       }
     }
 
-    if (_scalars_ && (phr->has_dl == _TRUE_)) {
-      index_ct=0;
+    if (index_f_lensing != -1) {
       for (index_d1=0; index_d1<phr->d_size; index_d1++) {
-        for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
-          cl_integrand[index_q*cl_integrand_num_columns+1+phr->index_ct_dl+index_ct]=
-            primordial_pk[index_ic1_ic2]
-            * transfer_ic1_nc[index_d1] * transfer_ic2[ptr->index_tt_lensing+index_d2]
-            * factor;
-          index_ct++;
+        for (index_q=0; index_q < q_size; index_q++) {
+          field[(index_f_lensing+index_d1)*q_size+index_q] =
+            _transfer_value_(ptr,index_md,offset+(ptr->index_tt_lensing+index_d1)*stride_tt+index_q);
         }
       }
     }
   }
 
-  /* do also a full limber calculation for some types (actually, only pp) */
+  /* weighted products over q. For cross-correlations between two
+     fields, the product is symmetrized over initial conditions. */
+
+  if ((phr->has_tt == _TRUE_) && _cl_sampled_(phr->index_ct_tt,index_f_temp,index_f_temp))
+    cl[phr->index_ct_tt] =
+      harmonic_cl_product(weight,field_ic1+index_f_temp*q_size,field_ic2+index_f_temp*q_size,q_size);
+
+  if ((phr->has_ee == _TRUE_) && _cl_sampled_(phr->index_ct_ee,index_f_e,index_f_e))
+    cl[phr->index_ct_ee] =
+      harmonic_cl_product(weight,field_ic1+index_f_e*q_size,field_ic2+index_f_e*q_size,q_size);
 
-  if ((ptr->do_lcmb_full_limber == _TRUE_)  && (l>ppr->l_switch_limber)) {
+  if ((phr->has_te == _TRUE_) && _cl_sampled_(phr->index_ct_te,index_f_temp,index_f_e))
+    cl[phr->index_ct_te] =
+      harmonic_cl_symmetric_product(weight,field_ic1+index_f_temp*q_size,field_ic1+index_f_e*q_size,field_ic2+index_f_temp*q_size,field_ic2+index_f_e*q_size,q_size,same_ic);
 
-    for (index_q=0; index_q < ptr->q_size_limber; index_q++) {
+  if (_tensors_ && (phr->has_bb == _TRUE_) && _cl_sampled_(phr->index_ct_bb,index_f_b,index_f_b))
+    cl[phr->index_ct_bb] =
+      harmonic_cl_product(weight,field_ic1+index_f_b*q_size,field_ic2+index_f_b*q_size,q_size);
 
-      //q = ptr->q_limber[index_q];
-      k = ptr->k_limber[index_md][index_q];
+  if (_scalars_ && (phr->has_pp == _TRUE_) && _cl_sampled_(phr->index_ct_pp,index_f_lcmb,index_f_lcmb)) {
 
-      cl_integrand_limber[index_q*cl_integrand_num_columns+0] = k;
+    /* This is where we decide which of the normal, full Limber or
+       direct Limber scheme will be used for pp. If we wanted a full
+       Limber version of other types, we would add them here. */
 
-      class_call(primordial_spectrum_at_k(ppm,index_md,linear,k,primordial_pk),
-                 ppm->error_message,
+    if ((cl_weight_lcmb_direct != NULL) && (index_l >= ptr->index_l_lcmb_direct)) {
+      class_call(harmonic_compute_cl_lcmb_direct(ptr,
+                                                 phr,
+                                                 index_md,
+                                                 index_ic1,
+                                                 index_ic2,
+                                                 index_l,
+                                                 cl_weight_lcmb_direct,
+                                                 &(cl[phr->index_ct_pp])),
+                 phr->error_message,
                  phr->error_message);
+    }
+    else if ((ptr->do_lcmb_full_limber == _TRUE_) && (l>ppr->l_switch_limber)) {
+      class_call(harmonic_compute_cl_limber(ptr,
+                                            phr,
+                                            index_md,
+                                            index_ic1,
+                                            index_ic2,
+                                            index_l,
+                                            cl_weight_limber,
+                                            &(cl[phr->index_ct_pp])),
+                 phr->error_message,
+                 phr->error_message);
+    }
+    else {
+      cl[phr->index_ct_pp] =
+        harmonic_cl_product(weight,field_ic1+index_f_lcmb*q_size,field_ic2+index_f_lcmb*q_size,q_size);
+    }
+  }
 
-      /* This is where we define for which types of Cl's we want a
-         full Limber version. If we wanted it for more than phiphi, we
-         would add other if statements below. */
+  if (_scalars_ && (phr->has_tp == _TRUE_) && _cl_sampled_(phr->index_ct_tp,index_f_temp,index_f_lcmb))
+    cl[phr->index_ct_tp] =
+      harmonic_cl_symmetric_product(weight,field_ic1+index_f_temp*q_size,field_ic1+index_f_lcmb*q_size,field_ic2+index_f_temp*q_size,field_ic2+index_f_lcmb*q_size,q_size,same_ic);
 
-      if (_scalars_ && (phr->has_pp == _TRUE_)) {
+  if (_scalars_ && (phr->has_ep == _TRUE_) && _cl_sampled_(phr->index_ct_ep,index_f_e,index_f_lcmb))
+    cl[phr->index_ct_ep] =
+      harmonic_cl_symmetric_product(weight,field_ic1+index_f_e*q_size,field_ic1+index_f_lcmb*q_size,field_ic2+index_f_e*q_size,field_ic2+index_f_lcmb*q_size,q_size,same_ic);
 
-        index_tt = ptr->index_tt_lcmb;
-        index_ct = phr->index_ct_pp;
+  if (_scalars_ && (phr->has_dd == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        if (_cl_sampled_(phr->index_ct_dd+index_ct,index_f_nc+index_d1,index_f_nc+index_d2))
+          cl[phr->index_ct_dd+index_ct] =
+            harmonic_cl_product(weight,field_ic1+(index_f_nc+index_d1)*q_size,field_ic2+(index_f_nc+index_d2)*q_size,q_size);
+        index_ct++;
+      }
+    }
+  }
 
-        transfer_ic1[index_tt] =
-          ptr->transfer_limber[index_md]
-          [((index_ic1 * ptr->tt_size[index_md] + ptr->index_tt_lcmb)
-            * ptr->l_size[index_md] + index_l)
-           * ptr->q_size_limber + index_q];
+  if (_scalars_ && (phr->has_td == _TRUE_)) {
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      if (_cl_sampled_(phr->index_ct_td+index_d1,index_f_temp,index_f_nc+index_d1))
+        cl[phr->index_ct_td+index_d1] =
+          harmonic_cl_symmetric_product(weight,field_ic1+index_f_temp*q_size,field_ic1+(index_f_nc+index_d1)*q_size,field_ic2+index_f_temp*q_size,field_ic2+(index_f_nc+index_d1)*q_size,q_size,same_ic);
+    }
+  }
 
-        if (index_ic1 == index_ic2) {
-          transfer_ic2[index_tt] = transfer_ic1[ptr->index_tt_lcmb];
-        }
-        else {
-          transfer_ic2[index_tt] = ptr->transfer_limber[index_md]
-            [((index_ic2 * ptr->tt_size[index_md] + ptr->index_tt_lcmb)
-              * ptr->l_size[index_md] + index_l)
-             * ptr->q_size_limber + index_q];
-        }
+  if (_scalars_ && (phr->has_pd == _TRUE_)) {
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      if (_cl_sampled_(phr->index_ct_pd+index_d1,index_f_lcmb,index_f_nc+index_d1))
+        cl[phr->index_ct_pd+index_d1] =
+          harmonic_cl_symmetric_product(weight,field_ic1+index_f_lcmb*q_size,field_ic1+(index_f_nc+index_d1)*q_size,field_ic2+index_f_lcmb*q_size,field_ic2+(index_f_nc+index_d1)*q_size,q_size,same_ic);
+    }
+  }
+
+  if (_scalars_ && (phr->has_ll == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        if (_cl_sampled_(phr->index_ct_ll+index_ct,index_f_lensing+index_d1,index_f_lensing+index_d2))
+          cl[phr->index_ct_ll+index_ct] =
+            harmonic_cl_product(weight,field_ic1+(index_f_lensing+index_d1)*q_size,field_ic2+(index_f_lensing+index_d2)*q_size,q_size);
+        index_ct++;
+      }
+    }
+  }
 
-        factor = 4. * _PI_ / k;
+  if (_scalars_ && (phr->has_tl == _TRUE_)) {
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      if (_cl_sampled_(phr->index_ct_tl+index_d1,index_f_temp,index_f_lensing+index_d1))
+        cl[phr->index_ct_tl+index_d1] =
+          harmonic_cl_symmetric_product(weight,field_ic1+index_f_temp*q_size,field_ic1+(index_f_lensing+index_d1)*q_size,field_ic2+index_f_temp*q_size,field_ic2+(index_f_lensing+index_d1)*q_size,q_size,same_ic);
+    }
+  }
 
-        cl_integrand_limber[index_q*cl_integrand_num_columns+1+phr->index_ct_pp]=
-          primordial_pk[index_ic1_ic2]
-          * transfer_ic1[index_tt]
-          * transfer_ic2[index_tt]
-          * factor;
+  if (_scalars_ && (phr->has_dl == _TRUE_)) {
+    index_ct=0;
+    for (index_d1=0; index_d1<phr->d_size; index_d1++) {
+      for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        if (_cl_sampled_(phr->index_ct_dl+index_ct,index_f_nc+index_d1,index_f_lensing+index_d2))
+          cl[phr->index_ct_dl+index_ct] =
+            harmonic_cl_product(weight,field_ic1+(index_f_nc+index_d1)*q_size,field_ic2+(index_f_lensing+index_d2)*q_size,q_size);
+        index_ct++;
       }
     }
   }
 
-  for (index_ct=0; index_ct<phr->ct_size; index_ct++) {
+#undef _cl_sampled_
 
-    /* treat null spectra (C_l^BB of scalars, C_l^pp of tensors, etc. */
+  free(field_ic1);
+  if (same_ic == _FALSE_) {
+    free(field_ic2);
+  }
+  if (f_sampled != NULL) {
+    free(f_sampled);
+  }
 
-    if ((_scalars_ && (phr->has_bb == _TRUE_) && (index_ct == phr->index_ct_bb)) ||
-        (_tensors_ && (phr->has_pp == _TRUE_) && (index_ct == phr->index_ct_pp)) ||
-        (_tensors_ && (phr->has_tp == _TRUE_) && (index_ct == phr->index_ct_tp)) ||
-        (_tensors_ && (phr->has_ep == _TRUE_) && (index_ct == phr->index_ct_ep)) ||
-        (_tensors_ && (phr->has_dd == _TRUE_) && (index_ct == phr->index_ct_dd)) ||
-        (_tensors_ && (phr->has_td == _TRUE_) && (index_ct == phr->index_ct_td)) ||
-        (_tensors_ && (phr->has_pd == _TRUE_) && (index_ct == phr->index_ct_pd)) ||
-        (_tensors_ && (phr->has_ll == _TRUE_) && (index_ct == phr->index_ct_ll)) ||
-        (_tensors_ && (phr->has_tl == _TRUE_) && (index_ct == phr->index_ct_tl)) ||
-        (_tensors_ && (phr->has_dl == _TRUE_) && (index_ct == phr->index_ct_dl))
-        ) {
+  return _SUCCESS_;
 
-      phr->cl[index_md]
-        [(index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct] = 0.;
+}
 
-    }
-    /* for non-zero spectra, integrate over q */
-    else {
+/**
+ * This routine computes \f$ C_l^{\phi\phi}\f$ in the full Limber
+ * scheme, for a given mode, pair of initial conditions and multipole.
+ *
+ * @param ptr              Input: pointer to transfer structure
+ * @param phr              Input: pointer to harmonic structure
+ * @param index_md         Input: index of mode under consideration
+ * @param index_ic1        Input: index of first initial condition in the correlator
+ * @param index_ic2        Input: index of second initial condition in the correlator
+ * @param index_l          Input: index of multipole under consideration
+ * @param cl_weight_limber Input: weights computed by harmonic_cl_weights() for the full Limber k list
+ * @param clvalue          Output: \f$ C_l^{\phi\phi}\f$
+ * @return the error status
+ */
 
-      /* spline the integrand over the whole range of k's. This is
-         where we decide which of the normal or full Limber scheme
-         will be used at the end. */
-
-      if (_scalars_ && (ptr->do_lcmb_full_limber == _TRUE_) && (phr->has_pp == _TRUE_) && (index_ct == phr->index_ct_pp) && (l>ppr->l_switch_limber)) {
-        integrand = cl_integrand_limber;
-        num_columns = cl_integrand_num_columns;
-        num_k = ptr->q_size_limber;
-        index_spline = 0;
-        q_min = ptr->q_limber[0];
-        k_min = ptr->k_limber[0][0];
-      }
-      else{
-        integrand = cl_integrand;
-        num_columns = cl_integrand_num_columns;
-        num_k = ptr->q_size;
-        index_spline = index_q_spline;
-        q_min = ptr->q[0];
-        k_min = ptr->k[0][0];
-      }
+int harmonic_compute_cl_limber(
+                               struct transfer * ptr,
+                               struct harmonic * phr,
+                               int index_md,
+                               int index_ic1,
+                               int index_ic2,
+                               int index_l,
+                               double * cl_weight_limber,
+                               double * clvalue
+                               ) {
 
-      column_k = 0;
-      column_integrand = 1+index_ct;
-      column_derivative = 1+phr->ct_size+index_ct;
-
-      class_call(array_spline(integrand,
-                              num_columns,
-                              num_k,
-                              column_k,
-                              column_integrand,
-                              column_derivative,
-                              _SPLINE_EST_DERIV_,
-                              phr->error_message),
-                 phr->error_message,
-                 phr->error_message);
+  int index_q;
+  int index_ic1_ic2;
+  double transfer_ic1;
+  double transfer_ic2;
 
-      class_call(array_integrate_all_trapzd_or_spline(integrand,
-                                                      num_columns,
-                                                      num_k,
-                                                      index_spline,
-                                                      column_k,
-                                                      column_integrand,
-                                                      column_derivative,
-                                                      &clvalue,
-                                                      phr->error_message),
-                 phr->error_message,
-                 phr->error_message);
+  index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
 
-      /* in the closed case, instead of an integral, we have a
-         discrete sum. In practice, this does not matter: the previous
-         routine does give a correct approximation of the discrete
-         sum, both in the trapezoidal and spline regions. The only
-         error comes from the first point: the previous routine
-         assumes a weight for the first point which is too small
-         compared to what it would be in the an actual discrete
-         sum. The line below correct this problem in an exact way.
-      */
-
-      if (pba->sgnK == 1) {
-        clvalue += integrand[1+index_ct] * q_min/k_min*sqrt(pba->K)/2.;
-      }
+  *clvalue = 0.;
 
-      /* we have the correct C_l now. We can store it in the transfer structure. */
+  for (index_q=0; index_q < ptr->q_size_limber; index_q++) {
 
-      phr->cl[index_md]
-        [(index_l * phr->ic_ic_size[index_md] + index_ic1_ic2) * phr->ct_size + index_ct]
-        = clvalue;
+    transfer_ic1 =
+      _transfer_limber_value_(ptr,index_md,
+                              ((index_ic1 * ptr->tt_size[index_md] + ptr->index_tt_lcmb)
+                               * ptr->l_size[index_md] + index_l)
+                              * ptr->q_size_limber + index_q);
 
+    if (index_ic1 == index_ic2) {
+      transfer_ic2 = transfer_ic1;
     }
+    else {
+      transfer_ic2 =
+        _transfer_limber_value_(ptr,index_md,
+                                ((index_ic2 * ptr->tt_size[index_md] + ptr->index_tt_lcmb)
+                                 * ptr->l_size[index_md] + index_l)
+                                * ptr->q_size_limber + index_q);
+    }
+
+    *clvalue += cl_weight_limber[index_ic1_ic2*ptr->q_size_limber+index_q] * transfer_ic1 * transfer_ic2;
   }
 
-  if (ppt->has_cl_number_count == _TRUE_ && _scalars_) {
-    free(transfer_ic1_nc);
-    free(transfer_ic2_nc);
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes \f$ C_l^{\phi\phi}\f$ in the direct Limber
+ * scheme, for a given mode, pair of initial conditions and multipole
+ * l > ppr->l_switch_lcmb_direct_limber: a weighted sum over the
+ * wavenumbers probed by this multipole at each time of the lensing
+ * source (see transfer_lcmb_direct_limber()).
+ *
+ * @param ptr                   Input: pointer to transfer structure
+ * @param phr                   Input: pointer to harmonic structure
+ * @param index_md              Input: index of mode under consideration
+ * @param index_ic1             Input: index of first initial condition in the correlator
+ * @param index_ic2             Input: index of second initial condition in the correlator
+ * @param index_l               Input: index of multipole under consideration
+ * @param cl_weight_lcmb_direct Input: weights computed by harmonic_cl_weights() for the direct Limber scheme
+ * @param clvalue               Output: \f$ C_l^{\phi\phi}\f$
+ * @return the error status
+ */
+
+int harmonic_compute_cl_lcmb_direct(
+                                    struct transfer * ptr,
+                                    struct harmonic * phr,
+                                    int index_md,
+                                    int index_ic1,
+                                    int index_ic2,
+                                    int index_l,
+                                    double * cl_weight_lcmb_direct,
+                                    double * clvalue
+                                    ) {
+
+  int index_k;
+  int index_ic1_ic2;
+  int index_l_direct;
+  int l_size_direct;
+  int k_size;
+  double * weight;
+  double * transfer_ic1;
+  double * transfer_ic2;
+
+  index_ic1_ic2 = index_symmetric_matrix(index_ic1,index_ic2,phr->ic_size[index_md]);
+
+  index_l_direct = index_l - ptr->index_l_lcmb_direct;
+  l_size_direct = ptr->l_size[index_md] - ptr->index_l_lcmb_direct;
+  k_size = ptr->k_size_lcmb_direct[index_l_direct];
+
+  weight = cl_weight_lcmb_direct
+    + index_l_direct*phr->ic_ic_size[index_md]*ptr->tau_size_lcmb_direct
+    + index_ic1_ic2*k_size;
+  transfer_ic1 = ptr->transfer_lcmb_direct + (index_ic1*l_size_direct + index_l_direct)*ptr->tau_size_lcmb_direct;
+  transfer_ic2 = ptr->transfer_lcmb_direct + (index_ic2*l_size_direct + index_l_direct)*ptr->tau_size_lcmb_direct;
+
+  *clvalue = 0.;
+
+  if (k_size < 2)
+    return _SUCCESS_;
+
+  for (index_k=0; index_k < k_size; index_k++) {
+    *clvalue += weight[index_k] * transfer_ic1[index_k] * transfer_ic2[index_k];
   }
 
   return _SUCCESS_;
+}
+
+/**
+ * Weighted scalar product over q of two fields.
+ *
+ * @param weight  Input: weights over q
+ * @param field1  Input: first field
+ * @param field2  Input: second field
+ * @param size    Input: number of values of q
+ * @return the value of the product
+ */
+
+double harmonic_cl_product(
+                           double * weight,
+                           double * field1,
+                           double * field2,
+                           int size
+                           ) {
+
+  int index_q;
+  double result=0.;
+
+  for (index_q=0; index_q < size; index_q++) {
+    result += weight[index_q] * field1[index_q] * field2[index_q];
+  }
+
+  return result;
+}
+
+/**
+ * Weighted scalar product over q of two fields a and b, symmetrized
+ * over the two initial conditions: (a1 W b2 + b1 W a2)/2.
+ *
+ * @param weight   Input: weights over q
+ * @param field1_a Input: field a for first initial condition
+ * @param field1_b Input: field b for first initial condition
+ * @param field2_a Input: field a for second initial condition
+ * @param field2_b Input: field b for second initial condition
+ * @param size     Input: number of values of q
+ * @param same_ic  Input: _TRUE_ if the two initial conditions are identical (then the two terms are equal)
+ * @return the value of the product
+ */
 
+double harmonic_cl_symmetric_product(
+                                     double * weight,
+                                     double * field1_a,
+                                     double * field1_b,
+                                     double * field2_a,
+                                     double * field2_b,
+                                     int size,
+                                     short same_ic
+                                     ) {
+
+  if (same_ic == _TRUE_)
+    return harmonic_cl_product(weight,field1_a,field2_b,size);
+
+  return 0.5*(harmonic_cl_product(weight,field1_a,field2_b,size)
+              +harmonic_cl_product(weight,field1_b,field2_a,size));
 }
 
 /* deprecated functions (since v2.8) */
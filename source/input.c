@@ -23,6 +23,7 @@
 #include "fourier.h"
 #include "lensing.h"
 #include "distortions.h"
+#include "modules.h"
 #include "output.h"
 
 /**
@@ -444,6 +445,14 @@ int input_read_from_file(struct file_content * pfc,
              errmsg,
              errmsg);
 
+  /** Digests of the input of each module, identifying the checkpoints
+      written and read for this input */
+  if ((pop->write_checkpoint == _TRUE_) || (pop->checkpoint_file[0] != '\0')) {
+    class_call(input_module_digests(pfc,ppr,pop->digest,errmsg),
+               errmsg,
+               errmsg);
+  }
+
   if (pfo->has_pk_eq == _TRUE_) {
 
     if (input_verbose > 0) {
@@ -523,6 +532,8 @@ int input_shooting(struct file_content * pfc,
   int fevals=0;
   double xzero;
   double *dxdF, *x_inout;
+  struct fzerofun_workspace * fzw_jacobian;
+  void ** pfzw_jacobian;
   int target_indices[_NUM_TARGETS_];
   int needs_shooting;
   int shooting_failed=_FALSE_;
@@ -696,6 +707,22 @@ int input_shooting(struct file_content * pfc,
                  errmsg,
                  errmsg);
 
+      /* Each column of the jacobian is computed by a separate task, with
+         its own copy of the workspace (the file content is overwritten
+         at each evaluation) */
+      class_alloc(fzw_jacobian,
+                  sizeof(struct fzerofun_workspace)*unknown_parameters_size,
+                  errmsg);
+      class_alloc(pfzw_jacobian,
+                  sizeof(void *)*unknown_parameters_size,
+                  errmsg);
+      for (counter = 0; counter < unknown_parameters_size; counter++){
+        fzw_jacobian[counter] = fzw;
+        class_call(parser_init_from_pfc(&(fzw.fc), &(fzw_jacobian[counter].fc), errmsg),
+                   errmsg,errmsg);
+        pfzw_jacobian[counter] = &(fzw_jacobian[counter]);
+      }
+
       /* Use multi-dimensional Newton method */
       class_call_try(fzero_Newton(input_try_unknown_parameters,
                                   x_inout,
@@ -704,6 +731,7 @@ int input_shooting(struct file_content * pfc,
                                   ppr->tol_shooting_deltax,
                                   ppr->tol_shooting_deltaF,
                                   &fzw,
+                                  pfzw_jacobian,
                                   &fevals,
                                   errmsg),
                      errmsg,
@@ -729,6 +757,12 @@ int input_shooting(struct file_content * pfc,
       }
 
       /* Free local variables */
+      for (counter = 0; counter < unknown_parameters_size; counter++){
+        class_call(parser_free(&(fzw_jacobian[counter].fc)),
+                   errmsg, errmsg);
+      }
+      free(fzw_jacobian);
+      free(pfzw_jacobian);
       free(x_inout);
       free(dxdF);
     }
@@ -895,9 +929,12 @@ int input_needs_shooting_for_target(struct file_content * pfc,
 
 /**
  * Related to 'shooting': Find the root of a one-dimensional
- * function. This function starts from a first guess, then uses a few
- * steps to bracket the root, and then calls another function to
- * actually get the root.
+ * function. This function starts from a first guess, then tries a few
+ * secant steps seeded with the estimated derivative of the guess. The
+ * guess being usually very good, these converge within two or three
+ * runs of CLASS. If they do not, or if one of the runs fails, it falls
+ * back to a few steps bracketing the root, and then calls another
+ * function to actually get the root.
  *
  * @param xzero     Output: root x such that f(x)=0 up to tolerance (f(x) = input_fzerofun_1d)
  * @param fevals    Output: number of iterations (that is, of CLASS runs) needed to find the root
@@ -917,8 +954,10 @@ int input_find_root(double *xzero,
 
   /** Define local variables */
   double x1, x2, f1, f2, dxdy, dx;
+  double xa, xb, xc, fa, fb;
   int iter, iter2;
   int return_function;
+  short bracketed = _FALSE_;
 
   /** Fisrt we do our guess */
   class_call(input_get_guess(&x1, &dxdy, pfzw, errmsg),
@@ -930,11 +969,52 @@ int input_find_root(double *xzero,
              errmsg);
 
   (*fevals)++;
+
+  /** Then we try a few secant steps, the first one using the
+      derivative estimated by input_get_guess(). The last step is
+      accepted without running CLASS at that point: its error is of
+      the order of the product of the errors of the two previous
+      points, far below the step itself. */
+  xa = x1;
+  fa = f1;
+  xb = x1 - f1*dxdy;
+  for (iter=1; iter<=8; iter++){
+    if (input_fzerofun_1d(xb, pfzw, &fb, errmsg) == _FAILURE_) {
+      (*fevals)++;
+      break;
+    }
+    (*fevals)++;
+    if (fb == 0.) {
+      *xzero = xb;
+      return _SUCCESS_;
+    }
+    if (fa*fb < 0.) {
+      /* Keep the last bracket of the root, in case we need it below */
+      bracketed = _TRUE_;
+      x1 = xa;
+      f1 = fa;
+      x2 = xb;
+      f2 = fb;
+    }
+    if (fb == fa)
+      break;
+    xc = xb - fb*(xb-xa)/(fb-fa);
+    if (fabs(xc-xb) <= tol_x_rel*MAX(fabs(xb),fabs(xc))) {
+      *xzero = xc;
+      return _SUCCESS_;
+    }
+    xa = xb;
+    fa = fb;
+    xb = xc;
+  }
+
+  /** If this did not converge, we go back to the first guess and do
+      a linear hunt for the boundaries, unless the secant steps have
+      already bracketed the root */
   dx = 1.5*f1*dxdy;
 
-  /** Then we do a linear hunt for the boundaries */
   /* Try fifteen times to go above and below the root (i.e. where shooting succeeds) */
-  for (iter=1; iter<=15; iter++){
+  for (iter=1; (iter<=15) && (bracketed == _FALSE_); iter++){
     x2 = x1 - dx;
     /* Try three times to get a 'reasonable' value, i.e. no CLASS error */
     for (iter2=1; iter2 <= 3; iter2++) {
@@ -1590,6 +1670,14 @@ int input_read_precisions(struct file_content * pfc,
 #include "precisions.h"
 #undef __ASSIGN_DEFAULT_PRECISION__
 
+  /** Read the precision tier first and set the parameters depending
+      on it, such that those passed explicitly override them below */
+  class_read_int("precision_tier",ppr->precision_tier);
+
+  class_call(input_precision_tier(ppr,errmsg),
+             errmsg,
+             errmsg);
+
   /** Read all precision parameters from input (these very concise
       lines parse all precision parameters thanks to the macros
       defined in macros_precision.h) */
@@ -1602,6 +1690,73 @@ int input_read_precisions(struct file_content * pfc,
 }
 
 
+/**
+ * Set the precision parameters depending on the precision tier
+ * ppr->precision_tier, starting from their default values, and the
+ * estimated error ppr->precision_tier_error of the results. Tier 0
+ * keeps the defaults. Tiers 1 and 2 coarsen the samplings in k of
+ * the perturbations, in l and q of the transfer functions, and loosen
+ * the tolerance of the integration of the perturbations (by default,
+ * the time spent in the perturbations goes down by about 1.6 and 2
+ * for a lensed C_l's run with l_max = 2500): they only
+ * change parameters of the perturbations and transfer modules (see
+ * input_module_digests()), such that refining a model to tier 0 keeps
+ * its background and thermodynamics.
+ *
+ * @param ppr     Input/Output: pointer to precision structure
+ * @param errmsg  Input/Output: Error message
+ * @return the error status
+ */
+
+int input_precision_tier(struct precision * ppr,
+                         ErrorMsg errmsg){
+
+  /** Summary: */
+
+  /** - Define local variables */
+
+  /* for tiers 0, 1, 2: factors multiplying the default steps in k,
+     the default tolerance of the integration, the logarithm of the
+     default step in l and the step in q (the latter are kept at tier 1:
+     an undersampling of the oscillations of the transfer functions
+     quickly degrades the C_l's, for a small gain in time); and
+     estimated relative errors of the C_l's, above the largest errors
+     found against tier 0 for 2 <= l <= 2500 in LCDM models (the
+     errors of P(k) are larger, up to 0.4% and 0.9%) */
+  double k_step_factor[_PRECISION_TIERS_] = {1.0,2.0,3.0};
+  double tol_factor[_PRECISION_TIERS_] = {1.0,10.0,30.0};
+  double l_logstep_factor[_PRECISION_TIERS_] = {1.0,1.0,1.6};
+  double q_linstep_factor[_PRECISION_TIERS_] = {1.0,1.0,1.1};
+  double error[_PRECISION_TIERS_] = {0.,1.e-3,2.e-2};
+  int tier;
+
+  tier = ppr->precision_tier;
+
+  class_test((tier < 0) || (tier >= _PRECISION_TIERS_),
+             errmsg,
+             "precision_tier = %d, should be between 0 and %d",
+             tier,_PRECISION_TIERS_-1);
+
+  /** - Steps in k of the perturbations */
+  ppr->k_step_sub *= k_step_factor[tier];
+  ppr->k_step_super *= k_step_factor[tier];
+  ppr->k_per_decade_for_pk /= k_step_factor[tier];
+  ppr->k_per_decade_for_bao /= k_step_factor[tier];
+
+  /** - Tolerance of the integration of the perturbations */
+  ppr->tol_perturbations_integration *= tol_factor[tier];
+
+  /** - Steps in l and q of the transfer functions */
+  ppr->l_logstep = pow(ppr->l_logstep,l_logstep_factor[tier]);
+  ppr->q_linstep *= q_linstep_factor[tier];
+
+  /** - Estimated error of the results */
+  ppr->precision_tier_error = error[tier];
+
+  return _SUCCESS_;
+
+}
+
 /**
  * If entries are passed in file_content structure, carefully read and
  * interpret each of them, and tune the relevant input parameters
@@ -3872,6 +4027,11 @@ int input_read_parameters_nonlinear(struct file_content * pfc,
     }
   }
 
+  /** 1.c) non-linear spectra computed only at the requested redshifts */
+  if (pfo->method > nl_none) {
+    class_read_flag("non_linear_on_demand", pfo->has_nl_on_demand);
+  }
+
   /** 2.a) analytic nowiggle linear spectrum */
   class_read_flag("analytic_nowiggle", pfo->has_pk_analytic_nowiggle);
 
@@ -5035,6 +5195,47 @@ int input_read_parameters_spectra(struct file_content * pfc,
     }
   }
 
+  /** 4) Storage of the transfer functions */
+  if (ppt->has_cls == _TRUE_) {
+    /* Read */
+    class_call(parser_read_string(pfc,"transfer_storage",&string1,&flag1,errmsg),
+               errmsg,
+               errmsg);
+    /* Complete set of parameters */
+    if (flag1 == _TRUE_) {
+      if (strcmp(string1,"double") == 0) {
+        ptr->storage = transfer_storage_double;
+      }
+      else if (strcmp(string1,"float") == 0) {
+        ptr->storage = transfer_storage_float;
+      }
+      else if (strcmp(string1,"int16") == 0) {
+        ptr->storage = transfer_storage_int16;
+      }
+      else {
+        class_stop(errmsg,"You specified 'transfer_storage' as '%s'. It has to be one of {'double','float','int16'}.",string1);
+      }
+    }
+  }
+
+  /** 5) Storage of the source functions */
+  /* Read */
+  class_call(parser_read_string(pfc,"sources_storage",&string1,&flag1,errmsg),
+             errmsg,
+             errmsg);
+  /* Complete set of parameters */
+  if (flag1 == _TRUE_) {
+    if (strcmp(string1,"double") == 0) {
+      ppt->storage = sources_storage_double;
+    }
+    else if (strcmp(string1,"float") == 0) {
+      ppt->storage = sources_storage_float;
+    }
+    else {
+      class_stop(errmsg,"You specified 'sources_storage' as '%s'. It has to be one of {'double','float'}.",string1);
+    }
+  }
+
   return _SUCCESS_;
 
 }
@@ -5115,6 +5316,10 @@ int input_read_parameters_lensing(struct file_content * pfc,
 
   class_read_flag("want_lcmb_full_limber",ppt->want_lcmb_full_limber);
 
+  /** 4) Do we want to compute C_l^phiphi for l > ppr->l_switch_lcmb_direct_limber directly by a Limber integral over the times of the lensing source? The CMB lensing potential is then skipped in the transfer functions at these multipoles, where C_l^Tphi and C_l^Ephi are set to zero. Only in the flat case. */
+
+  class_read_flag("want_lcmb_direct_limber",ppt->want_lcmb_direct_limber);
+
   return _SUCCESS_;
 
 }
@@ -5407,6 +5612,11 @@ int input_read_parameters_additional(struct file_content* pfc,
     pth->compute_cb2_derivatives = _TRUE_;
   }
 
+  /* the adaptive truncation of the hierarchies uses the damping scale at recombination */
+  if (ppr->l_max_adaptive == _TRUE_) {
+    pth->compute_damping_scale = _TRUE_;
+  }
+
   class_test(ppr->ur_fluid_trigger_tau_over_tau_k==ppr->radiation_streaming_trigger_tau_over_tau_k,
              errmsg,
              "please choose different values for precision parameters ur_fluid_trigger_tau_over_tau_k and radiation_streaming_trigger_tau_over_tau_k, in order to avoid switching two approximation schemes at the same time");
@@ -5513,6 +5723,8 @@ int input_read_parameters_output(struct file_content * pfc,
       class_stop(errmsg,"You specified 'format' as '%s'. It has to be one of {'class','camb'}.",string1);
     }
   }
+  /* Read */
+  class_read_flag("write_npy",pop->write_npy);
 
   /** 1.d) Background quantities */
   /* Read */
@@ -5543,6 +5755,8 @@ int input_read_parameters_output(struct file_content * pfc,
     ppt->store_perturbations = _TRUE_;
     pop->write_perturbations = _TRUE_;
   }
+  /* Read */
+  class_read_flag("stream_perturbations",ppt->stream_perturbations);
 
   /** 1.g) Primordial spectra */
   /* Read */
@@ -5560,6 +5774,46 @@ int input_read_parameters_output(struct file_content * pfc,
   /* Read */
   class_read_flag_or_deprecated("write_distortions","write distortions",pop->write_distortions);
 
+  /** 1.k.2) Timings and counters of the modules */
+  /* Read */
+  class_read_flag_or_deprecated("write_timings","write timings",pop->write_timings);
+
+  /** 1.k.3) Trace of the tasks of the parallel regions */
+  /* Read */
+  class_read_flag_or_deprecated("write_trace","write trace",pop->write_trace);
+
+  /** 1.k.4) Checkpoint of the computed modules */
+  /* Read */
+  class_read_flag("write_checkpoint",pop->write_checkpoint);
+  class_read_string("checkpoint_file",pop->checkpoint_file);
+  class_call(parser_read_string(pfc,"restart_from",&string1,&flag1,errmsg),
+             errmsg,
+             errmsg);
+  /* Complete set of parameters */
+  if (flag1 == _TRUE_){
+    if (strcmp(string1,"background") == 0) {
+      pop->checkpoint_modules = 0;
+    }
+    else if (strcmp(string1,"thermodynamics") == 0) {
+      pop->checkpoint_modules = (1 << module_thermodynamics) - 1;
+    }
+    else if (strcmp(string1,"perturbations") == 0) {
+      pop->checkpoint_modules = (1 << module_perturbations) - 1;
+    }
+    else if (strcmp(string1,"transfer") == 0) {
+      pop->checkpoint_modules = (1 << module_transfer) - 1;
+    }
+    else if (strcmp(string1,"harmonic") == 0) {
+      pop->checkpoint_modules = (1 << module_harmonic) - 1;
+    }
+    else if (strcmp(string1,"lensing") == 0) {
+      pop->checkpoint_modules = (1 << module_lensing) - 1;
+    }
+    else{
+      class_stop(errmsg,"You specified 'restart_from' as '%s'. It has to be one of {'background','thermodynamics','perturbations','transfer','harmonic','lensing'}.",string1);
+    }
+  }
+
   /** 2) Verbosity */
   /* Read */
   class_read_int("background_verbose",pba->background_verbose);
@@ -5652,6 +5906,419 @@ int input_write_info(struct file_content * pfc,
 
 }
 
+/**
+ * Update a 64-bit FNV-1a digest with a sequence of bytes.
+ *
+ * @param digest  Input: current value of the digest
+ * @param data    Input: bytes to add
+ * @param size    Input: number of bytes
+ * @return the updated digest
+ */
+
+unsigned long long input_digest_bytes(unsigned long long digest,
+                                      const void * data,
+                                      size_t size){
+
+  const unsigned char * byte = (const unsigned char *) data;
+  size_t i;
+
+  for (i=0; i<size; i++) {
+    digest ^= (unsigned long long) byte[i];
+    digest *= 1099511628211ULL;
+  }
+
+  return digest;
+}
+
+/**
+ * Find the first module (in the order in which they are run) whose
+ * result depends on a given input parameter. Later modules depend on
+ * it through their dependency on this module (see
+ * input_module_reuse()).
+ *
+ * The parameters listed here are only those for which we know that
+ * they do not affect the background. All other parameters (including
+ * precision parameters) are conservatively attributed to the
+ * background, i.e. changing them invalidates all modules. Parameters
+ * only used by the output module are attributed to im_output, which
+ * never needs to be recomputed by a wrapper.
+ *
+ * @param name    Input: name of the parameter, as in the input file
+ * @param module  Output: first module depending on it
+ * @return the error status
+ */
+
+int input_module_of_parameter(char * name,
+                              enum input_module * module){
+
+  /** - Define local variables */
+
+  /* parameters read in input_read_parameters_primordial() that only
+     affect the primordial structure ('r' is not there, because r=0
+     switches off tensor perturbations) */
+  char * primordial_names[] = {
+    "P_k_ini type","Pk_ini_type","k_pivot","A_s","ln10^{10}A_s","ln_A_s_1e10","n_s","alpha_s",
+    "f_bi","n_bi","alpha_bi","f_cdi","n_cdi","alpha_cdi","f_nid","n_nid","alpha_nid","f_niv","n_niv","alpha_niv",
+    "c_ad_bi","n_ad_bi","alpha_ad_bi","c_ad_cdi","n_ad_cdi","alpha_ad_cdi","c_ad_nid","n_ad_nid","alpha_ad_nid",
+    "c_ad_niv","n_ad_niv","alpha_ad_niv","c_bi_cdi","n_bi_cdi","alpha_bi_cdi","c_bi_nid","n_bi_nid","alpha_bi_nid",
+    "c_bi_niv","n_bi_niv","alpha_bi_niv","c_cdi_nid","n_cdi_nid","alpha_cdi_nid","c_cdi_niv","n_cdi_niv","alpha_cdi_niv",
+    "c_nid_niv","n_nid_niv","alpha_nid_niv",
+    "c_bi_ad","n_bi_ad","alpha_bi_ad","c_cdi_ad","n_cdi_ad","alpha_cdi_ad","c_nid_ad","n_nid_ad","alpha_nid_ad",
+    "c_niv_ad","n_niv_ad","alpha_niv_ad","c_cdi_bi","n_cdi_bi","alpha_cdi_bi","c_nid_bi","n_nid_bi","alpha_nid_bi",
+    "c_niv_bi","n_niv_bi","alpha_niv_bi","c_nid_cdi","n_nid_cdi","alpha_nid_cdi","c_niv_cdi","n_niv_cdi","alpha_niv_cdi",
+    "c_niv_nid","n_niv_nid","alpha_niv_nid",
+    "n_t","alpha_t","special iso",
+    "potential","V_0","V_1","V_2","V_3","V_4","H_0","H_1","H_2","H_3","H_4",
+    "R_0","R_1","R_2","R_3","R_4","PSR_0","PSR_1","PSR_2","PSR_3","PSR_4","HSR_0","HSR_1","HSR_2","HSR_3","HSR_4",
+    "phi_end","Vparam0","Vparam1","Vparam2","Vparam3","Vparam4","ln_aH_ratio","N_star","full_potential","inflation_behavior",
+    "k1","k2","P_{RR}^1","P_{RR}^2","P_{II}^1","P_{II}^2","P_{RI}^1","|P_{RI}^2|",
+    "command","custom1","custom2","custom3","custom4","custom5","custom6","custom7","custom8","custom9","custom10"};
+
+  /* parameters read in input_read_parameters_output() and
+     input_write_info() that only affect the output module */
+  char * output_names[] = {
+    "root","headers","format","write_npy","input_verbose","output_verbose",
+    "write background","write_background","write thermodynamics","write_thermodynamics",
+    "write primordial","write_primordial","write exotic injection","write_exotic_injection",
+    "write noninjection","write_noninjection","write distortions","write_distortions","write timings","write_timings",
+    "write trace","write_trace","write parameters","write_parameters","write warnings","write_warnings","overwrite_root",
+    "write_checkpoint","checkpoint_file","restart_from"};
+
+  /* verbosity parameters, attributed to the module they refer to */
+  char * verbose_names[] = {
+    "background_verbose","thermodynamics_verbose","perturbations_verbose","primordial_verbose","fourier_verbose",
+    "transfer_verbose","harmonic_verbose","lensing_verbose","distortions_verbose","hyrec_verbose"};
+  enum input_module verbose_modules[] = {
+    im_background,im_thermodynamics,im_perturbations,im_primordial,im_fourier,
+    im_transfer,im_harmonic,im_lensing,im_distortions,im_thermodynamics};
+
+  /* precision parameters set by the precision tier (see
+     input_precision_tier()), attributed to the module using them */
+  char * tier_names[] = {
+    "precision_tier","k_step_sub","k_step_super","k_per_decade_for_pk","k_per_decade_for_bao",
+    "tol_perturbations_integration","l_logstep","q_linstep","precision_tier_error"};
+  enum input_module tier_modules[] = {
+    im_perturbations,im_perturbations,im_perturbations,im_perturbations,im_perturbations,
+    im_perturbations,im_transfer,im_transfer,im_output};
+
+  int i;
+
+  /** - By default, the background (and hence everything) depends on a parameter */
+  *module = im_background;
+
+  for (i=0; i<sizeof(primordial_names)/sizeof(char*); i++) {
+    if (strcmp(name,primordial_names[i]) == 0) {
+      *module = im_primordial;
+      return _SUCCESS_;
+    }
+  }
+
+  for (i=0; i<sizeof(output_names)/sizeof(char*); i++) {
+    if (strcmp(name,output_names[i]) == 0) {
+      *module = im_output;
+      return _SUCCESS_;
+    }
+  }
+
+  for (i=0; i<sizeof(verbose_names)/sizeof(char*); i++) {
+    if (strcmp(name,verbose_names[i]) == 0) {
+      *module = verbose_modules[i];
+      return _SUCCESS_;
+    }
+  }
+
+  for (i=0; i<sizeof(tier_names)/sizeof(char*); i++) {
+    if (strcmp(name,tier_names[i]) == 0) {
+      *module = tier_modules[i];
+      return _SUCCESS_;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute, for each module, a digest of the input parameters
+ * attributed to it by input_module_of_parameter(). The digests also
+ * include the precision parameters, as actually set in the precision
+ * structure: those set by the precision tier in the perturbations and
+ * transfer modules, all other ones in the background.
+ *
+ * The digest of each entry of the file content is summed, so that the
+ * result does not depend on the order in which parameters are
+ * passed. This function should be called after
+ * input_read_from_file(), since shooting may have replaced some
+ * entries.
+ *
+ * @param pfc     Input: pointer to file content
+ * @param ppr     Input: pointer to precision structure filled by input_read_from_file()
+ * @param digest  Output: array of _NUM_INPUT_MODULES_ digests
+ * @param errmsg  Input/Output: Error message
+ * @return the error status
+ */
+
+int input_module_digests(struct file_content * pfc,
+                         struct precision * ppr,
+                         unsigned long long * digest,
+                         ErrorMsg errmsg){
+
+  /** Summary: */
+
+  /** - Define local variables */
+  const unsigned long long fnv_offset = 14695981039346656037ULL;
+  unsigned long long entry, precision_digest;
+  struct precision pr_background;
+  enum input_module module;
+  int i;
+
+  for (i=0; i<_NUM_INPUT_MODULES_; i++) {
+    digest[i] = 0;
+  }
+
+  /** - Sum the digests of each 'name = value' entry in the relevant module */
+  for (i=0; i<pfc->size; i++) {
+    class_call(input_module_of_parameter(pfc->name[i],&module),
+               errmsg,
+               errmsg);
+    entry = input_digest_bytes(fnv_offset,pfc->name[i],strlen(pfc->name[i]));
+    entry = input_digest_bytes(entry,"=",1);
+    entry = input_digest_bytes(entry,pfc->value[i],strlen(pfc->value[i]));
+    digest[module] += entry;
+  }
+
+  /** - Add the precision parameters set by the precision tier (see
+      input_precision_tier()) to the digests of the modules using
+      them, such that changing the tier keeps the background and
+      thermodynamics (the estimated error of the tier does not change
+      any result, and is not digested) */
+  precision_digest = fnv_offset;
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->precision_tier),sizeof(ppr->precision_tier));
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->k_step_sub),sizeof(ppr->k_step_sub));
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->k_step_super),sizeof(ppr->k_step_super));
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->k_per_decade_for_pk),sizeof(ppr->k_per_decade_for_pk));
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->k_per_decade_for_bao),sizeof(ppr->k_per_decade_for_bao));
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->tol_perturbations_integration),sizeof(ppr->tol_perturbations_integration));
+  digest[im_perturbations] += precision_digest;
+
+  precision_digest = fnv_offset;
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->l_logstep),sizeof(ppr->l_logstep));
+  precision_digest = input_digest_bytes(precision_digest,&(ppr->q_linstep),sizeof(ppr->q_linstep));
+  digest[im_transfer] += precision_digest;
+
+  /** - Add all other precision parameters to the digest of the
+      background (these very concise lines digest all precision
+      parameters thanks to the macros defined in macros_precision.h,
+      here on a copy of the precision structure in which those set by
+      the tier are reset) */
+  pr_background = *ppr;
+  pr_background.precision_tier = 0;
+  pr_background.k_step_sub = 0.;
+  pr_background.k_step_super = 0.;
+  pr_background.k_per_decade_for_pk = 0.;
+  pr_background.k_per_decade_for_bao = 0.;
+  pr_background.tol_perturbations_integration = 0.;
+  pr_background.l_logstep = 0.;
+  pr_background.q_linstep = 0.;
+  pr_background.precision_tier_error = 0.;
+  ppr = &pr_background;
+
+  precision_digest = fnv_offset;
+#define __DIGEST_PRECISION_PARAMETER__
+#include "precisions.h"
+#undef __DIGEST_PRECISION_PARAMETER__
+  digest[im_background] += precision_digest;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Given the digests of a previous and of a new model, and the list of
+ * modules computed for the previous model, find which modules can be
+ * kept as they are. A module can be reused if it was computed, if
+ * its digest did not change, and if all modules on which it depends
+ * (those passed to its _init() function) can be reused.
+ *
+ * The transfer functions only depend on the fourier module through
+ * the non-linear corrections to the sources. Without them, a change
+ * in the primordial parameters does not invalidate the transfer
+ * functions.
+ *
+ * @param digest_old         Input: digests of the previous model
+ * @param digest_new         Input: digests of the new model
+ * @param was_computed       Input: array of _NUM_INPUT_MODULES_ flags, was the module computed for the previous model?
+ * @param has_nl_corrections Input: _TRUE_ if the fourier module computes non-linear corrections (pfo->method != nl_none)
+ * @param can_reuse          Output: array of _NUM_INPUT_MODULES_ flags, can the module be reused?
+ * @return the error status
+ */
+
+int input_module_reuse(unsigned long long * digest_old,
+                       unsigned long long * digest_new,
+                       short * was_computed,
+                       short has_nl_corrections,
+                       short * can_reuse){
+
+  /** Summary: */
+
+  /** - Define local variables */
+
+  /* modules on which each module depends, as in the arguments of the
+     _init() functions, terminated by -1 */
+  int depends_on[_NUM_INPUT_MODULES_][_NUM_INPUT_MODULES_] = {
+    /* background */     {-1},
+    /* thermodynamics */ {im_background,-1},
+    /* perturbations */  {im_background,im_thermodynamics,-1},
+    /* primordial */     {im_perturbations,-1},
+    /* fourier */        {im_background,im_thermodynamics,im_perturbations,im_primordial,-1},
+    /* transfer */       {im_background,im_thermodynamics,im_perturbations,im_fourier,-1},
+    /* harmonic */       {im_background,im_perturbations,im_primordial,im_fourier,im_transfer,-1},
+    /* lensing */        {im_perturbations,im_fourier,im_harmonic,-1},
+    /* distortions */    {im_background,im_thermodynamics,im_perturbations,im_primordial,-1},
+    /* output */         {im_background,im_thermodynamics,im_perturbations,im_primordial,im_fourier,
+                          im_transfer,im_harmonic,im_lensing,im_distortions,-1}
+  };
+  int index_module, index_dep;
+
+  /** - Modules are sorted such that dependencies come first */
+  for (index_module=0; index_module<_NUM_INPUT_MODULES_; index_module++) {
+
+    can_reuse[index_module] = ((was_computed[index_module] == _TRUE_) &&
+                               (digest_old[index_module] == digest_new[index_module]));
+
+    for (index_dep=0; (index_dep<_NUM_INPUT_MODULES_) && (depends_on[index_module][index_dep] >= 0); index_dep++) {
+      if ((index_module == im_transfer) && (depends_on[index_module][index_dep] == im_fourier) && (has_nl_corrections == _FALSE_))
+        continue;
+      if (can_reuse[depends_on[index_module][index_dep]] == _FALSE_)
+        can_reuse[index_module] = _FALSE_;
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Update the primordial parameters of a model for which all modules
+ * have already been computed, and recompute only the modules
+ * depending on them: primordial, fourier, harmonic, lensing and
+ * distortions. The perturbations are kept, and so are the transfer
+ * functions unless they include non-linear corrections.
+ *
+ * This is meant for sampling "fast" parameters (A_s, n_s, ...): the
+ * file content should contain only the primordial parameters to
+ * change (see input_module_of_parameter()), the other ones keep the
+ * values read by input_init().
+ *
+ * @param pfc     Input: pointer to file content with the new primordial parameters
+ * @param ppr     Input: pointer to precision structure
+ * @param pba     Input: pointer to background structure
+ * @param pth     Input: pointer to thermodynamics structure
+ * @param ppt     Input: pointer to perturbation structure
+ * @param ptr     Input/Output: pointer to transfer structure
+ * @param ppm     Input/Output: pointer to primordial structure
+ * @param phr     Input/Output: pointer to harmonic structure
+ * @param pfo     Input/Output: pointer to fourier structure
+ * @param ple     Input/Output: pointer to lensing structure
+ * @param psd     Input/Output: pointer to distortions structure
+ * @param errmsg  Input/Output: Error message
+ * @return the error status
+ */
+
+int input_update_primordial(struct file_content * pfc,
+                            struct precision * ppr,
+                            struct background * pba,
+                            struct thermodynamics * pth,
+                            struct perturbations * ppt,
+                            struct transfer * ptr,
+                            struct primordial * ppm,
+                            struct harmonic * phr,
+                            struct fourier * pfo,
+                            struct lensing * ple,
+                            struct distortions * psd,
+                            ErrorMsg errmsg){
+
+  /** Summary: */
+
+  /** - Define local variables */
+  enum input_module module;
+  short has_nl_corrections;
+  int i;
+
+  /** - Check that only primordial parameters are passed */
+  for (i=0; i<pfc->size; i++) {
+    class_call(input_module_of_parameter(pfc->name[i],&module),
+               errmsg,
+               errmsg);
+    class_test(module != im_primordial,
+               errmsg,
+               "the parameter '%s' is not a primordial parameter, all modules need to be recomputed",pfc->name[i]);
+  }
+
+  /* the command of an external spectrum and the tables of the pk_eq
+     method are allocated by the input module and freed with the
+     primordial and fourier structures */
+  class_test(ppm->primordial_spec_type == external_Pk,
+             errmsg,
+             "cannot update the parameters of an external primordial spectrum");
+  class_test(pfo->has_pk_eq == _TRUE_,
+             errmsg,
+             "cannot update the primordial parameters with the pk_eq method");
+
+  has_nl_corrections = (pfo->method != nl_none);
+
+  /** - Free the modules depending on the primordial parameters */
+  class_call(distortions_free(psd),
+             psd->error_message,
+             errmsg);
+  class_call(lensing_free(ple),
+             ple->error_message,
+             errmsg);
+  class_call(harmonic_free(phr),
+             phr->error_message,
+             errmsg);
+  if (has_nl_corrections == _TRUE_) {
+    class_call(transfer_free(ptr),
+               ptr->error_message,
+               errmsg);
+  }
+  class_call(fourier_free(pfo),
+             pfo->error_message,
+             errmsg);
+  class_call(primordial_free(ppm),
+             ppm->error_message,
+             errmsg);
+
+  /** - Read the new primordial parameters on top of the previous ones */
+  class_call(input_read_parameters_primordial(pfc,ppt,ppm,errmsg),
+             errmsg,
+             errmsg);
+
+  /** - Recompute the modules */
+  class_call(primordial_init(ppr,ppt,ppm),
+             ppm->error_message,
+             errmsg);
+  class_call(fourier_init(ppr,pba,pth,ppt,ppm,pfo),
+             pfo->error_message,
+             errmsg);
+  if (has_nl_corrections == _TRUE_) {
+    class_call(transfer_init(ppr,pba,pth,ppt,pfo,ptr),
+               ptr->error_message,
+               errmsg);
+  }
+  class_call(harmonic_init(ppr,pba,ppt,ppm,pfo,ptr,phr),
+             phr->error_message,
+             errmsg);
+  class_call(lensing_init(ppr,ppt,phr,pfo,ple),
+             ple->error_message,
+             errmsg);
+  class_call(distortions_init(ppr,pba,pth,ppt,ppm,psd),
+             psd->error_message,
+             errmsg);
+
+  return _SUCCESS_;
+
+}
+
 /**
  * All default parameter values (for input parameters)
  *
@@ -6009,6 +6676,7 @@ int input_default_params(struct background *pba,
   pfo->hm_version = hmcode_version_2020;
   pfo->z_infinity = 10.;
   pfo->has_pk_numerical_nowiggle = _FALSE_;
+  pfo->has_nl_on_demand = _FALSE_;
   pfo->pk_l_nw_index = &(pfo->index_pk_cluster);
 
   pfo->log10T_heat_hmcode = 7.8;
@@ -6155,6 +6823,10 @@ int input_default_params(struct background *pba,
   pop->z_pk[0] = 0.;
   /** 3.c) Maximum redshift */
   ppt->z_max_pk=0.;
+  /** 4) Storage of the transfer functions */
+  ptr->storage = transfer_storage_double;
+  /** 5) Storage of the source functions */
+  ppt->storage = sources_storage_double;
 
   /**
    * Default to input_read_parameters_lensing
@@ -6168,6 +6840,7 @@ int input_default_params(struct background *pba,
   ptr->lcmb_tilt=0.;
   ptr->lcmb_pivot=0.1;
   ppt->want_lcmb_full_limber = _TRUE_;
+  ppt->want_lcmb_direct_limber = _FALSE_;
 
   /**
    * Default to input_read_parameters_distortions
@@ -6225,6 +6898,7 @@ int input_default_params(struct background *pba,
   pop->write_header = _TRUE_;
   /** 1.c) Format */
   pop->output_format = class_format;
+  pop->write_npy = _FALSE_;
   /** 1.d) Background quantities */
   pop->write_background = _FALSE_;
   /** 1.e) Thermodynamics quantities */
@@ -6233,6 +6907,7 @@ int input_default_params(struct background *pba,
   ppt->k_output_values_num=0;
   pop->write_perturbations = _FALSE_;
   ppt->store_perturbations = _FALSE_;
+  ppt->stream_perturbations = _FALSE_;
   /** 1.g) Primordial spectra */
   pop->write_primordial = _FALSE_;
   /** 1.h) Exotic energy injection function */
@@ -6240,6 +6915,11 @@ int input_default_params(struct background *pba,
   pop->write_noninjection = _FALSE_;
   /** 1.i) Spectral distortions */
   pop->write_distortions = _FALSE_;
+  pop->write_timings = _FALSE_;
+  pop->write_trace = _FALSE_;
+  pop->write_checkpoint = _FALSE_;
+  pop->checkpoint_file[0] = '\0';
+  pop->checkpoint_modules = _ALL_MODULES_;
 
   /* BEGIN MODIFICATION UG */
 
@@ -18,6 +18,17 @@
 #include "lensing.h"
 #include <time.h>
 #include "parallel.h"
+#include <mutex>
+#ifdef _LENSING_DXX_MMAP_
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* tables of d^l_mm' kept for the next runs by lensing_dxx_get() */
+static struct lensing_dxx * lensing_dxx_cached = NULL;
+static std::mutex lensing_dxx_mutex;
 
 /**
  * Anisotropy power spectra \f$ C_l\f$'s for all types, modes and initial conditions.
@@ -70,6 +81,35 @@ int lensing_cl_at_l(
   return _SUCCESS_;
 }
 
+/**
+ * Lensed anisotropy power spectra \f$ C_l\f$'s for all types at each
+ * integer multipole l_min <= l <= l_max, in one call (same as calling
+ * lensing_cl_at_l() for each l).
+ *
+ * @param ple        Input: pointer to lensing structure
+ * @param l_min      Input: first multipole
+ * @param l_max      Input: last multipole
+ * @param cl_lensed  Output: array with argument cl_lensed[(l-l_min)*ple->lt_size+index_lt] (must be already allocated)
+ * @return the error status
+ */
+
+int lensing_cl_at_l_range(
+                          struct lensing * ple,
+                          int l_min,
+                          int l_max,
+                          double * cl_lensed
+                          ) {
+  int l;
+
+  for (l = l_min; l <= l_max; l++) {
+    class_call(lensing_cl_at_l(ple,l,cl_lensed+(l-l_min)*ple->lt_size),
+               ple->error_message,
+               ple->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * This routine initializes the lensing structure (in particular,
  * computes table of lensed anisotropy spectra \f$ C_l^{X} \f$)
@@ -96,7 +136,6 @@ int lensing_init(
   double * mu; /* mu[index_mu]: discretized values of mu
                   between -1 and 1, roots of Legendre polynomial */
   double * w8; /* Corresponding Gauss-Legendre quadrature weights */
-  double theta,delta_theta;
 
   double ** d00;  /* dmn[index_mu][index_l] */
   double ** d11;
@@ -110,7 +149,11 @@ int lensing_init(
   double ** d3m3 = NULL;
   double ** d4m2 = NULL;
   double ** d4m4 = NULL;
-  double * buf_dxx; /* buffer */
+  double * buf_sqrt; /* buffer */
+  struct lensing_dxx * pdxx; /* values of mu, weights and tables of dmn (NULL in streaming mode) */
+  double * buf_dxx = NULL; /* buffer for one block of rows of dmn in streaming mode */
+  int mu_block_size,index_mu_start,index_mu_end;
+  double * cl_sum; /* partial sums over mu of the lensed cl's */
 
   double * Cgl;   /* Cgl[index_mu] */
   double * Cgl2;  /* Cgl2[index_mu] */
@@ -145,15 +188,15 @@ int lensing_init(
 
   int index_md;
 
-  /* Timing */
-  //double debut, fin;
-  //double cpu_time;
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(ple->stats));
 
   /** - check that we really want to compute at least one spectrum */
 
   if (ple->has_lensed_cls == _FALSE_) {
     if (ple->lensing_verbose > 0)
       printf("No lensing requested. Lensing module skipped.\n");
+    class_timer_end(&(ple->stats));
     return _SUCCESS_;
   }
   else {
@@ -184,45 +227,53 @@ int lensing_init(
     /* Integrate correlation function difference on [0,pi/16] */
     num_mu = (ple->l_unlensed_max * 2 )/16;
   }
-  /** - allocate array of \f$ \mu \f$ values, as well as quadrature weights */
+  if (ppr->lensing_mu_block_size > 0) {
 
-  class_alloc(mu,
-              num_mu*sizeof(double),
-              ple->error_message);
-  /* Reserve last element of mu for mu=1, needed for sigma2 */
-  mu[num_mu-1] = 1.0;
+    /** - in streaming mode, only get the values of \f$ \mu \f$ and
+        the quadrature weights: the tables of \f$ d^l_{mm'} (\mu) \f$
+        will be computed by blocks of lensing_mu_block_size values of
+        \f$ \mu \f$, and used immediately */
 
-  class_alloc(w8,
-              (num_mu-1)*sizeof(double),
-              ple->error_message);
+    pdxx = NULL;
 
-  if (ppr->accurate_lensing == _TRUE_) {
+    class_alloc(mu,
+                num_mu*sizeof(double),
+                ple->error_message);
 
-    //debut = omp_get_wtime();
-    class_call(quadrature_gauss_legendre(mu,
-                                         w8,
-                                         num_mu-1,
-                                         ppr->tol_gauss_legendre,
-                                         ple->error_message),
+    class_alloc(w8,
+                (num_mu-1)*sizeof(double),
+                ple->error_message);
+
+    class_call(lensing_quadrature(ppr,num_mu,mu,w8,ple->error_message),
                ple->error_message,
                ple->error_message);
-    //fin = omp_get_wtime();
-    //cpu_time = (fin-debut);
-    //printf("time in quadrature_gauss_legendre=%4.3f s\n",cpu_time);
 
-  } else { /* Crude integration on [0,pi/16]: Riemann sum on theta */
+    mu_block_size = MIN(ppr->lensing_mu_block_size,num_mu-1);
+  }
+  else {
 
-    delta_theta = _PI_/16. / (double)(num_mu-1);
-    for (index_mu=0;index_mu<num_mu-1;index_mu++) {
-      theta = (index_mu+1)*delta_theta;
-      mu[index_mu] = cos(theta);
-      w8[index_mu] = sin(theta)*delta_theta; /* We integrate on mu */
-    }
+    /** - otherwise get the values of \f$ \mu \f$, the quadrature
+        weights and the full tables of \f$ d^l_{mm'} (\mu) \f$: they
+        only depend on l_unlensed_max and on precision parameters, and
+        may come from a previous run (see lensing_dxx_get()) */
+
+    class_call(lensing_dxx_get(ppr,
+                               ple,
+                               num_mu,
+                               ple->has_te,
+                               (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_),
+                               &pdxx),
+               ple->error_message,
+               ple->error_message);
+
+    mu = pdxx->mu;
+    w8 = pdxx->w8;
+
+    mu_block_size = num_mu-1;
   }
 
-  /** - Compute \f$ d^l_{mm'} (\mu) \f$*/
+  /** - allocate the arrays of pointers to the rows of the tables of \f$ d^l_{mm'} (\mu) \f$*/
 
-  icount = 0;
   class_alloc(d00,
               num_mu*sizeof(double*),
               ple->error_message);
@@ -238,7 +289,6 @@ int lensing_init(
   class_alloc(d2m2,
               num_mu*sizeof(double*),
               ple->error_message);
-  icount += 4*num_mu*(ple->l_unlensed_max+1);
 
   if (ple->has_te==_TRUE_) {
 
@@ -253,7 +303,6 @@ int lensing_init(
     class_alloc(d4m2,
                 num_mu*sizeof(double*),
                 ple->error_message);
-    icount += 3*num_mu*(ple->l_unlensed_max+1);
   }
 
   if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
@@ -277,118 +326,65 @@ int lensing_init(
     class_alloc(d4m4,
                 num_mu*sizeof(double*),
                 ple->error_message);
-    icount += 5*num_mu*(ple->l_unlensed_max+1);
   }
 
-  icount += 5*(ple->l_unlensed_max+1); /* for arrays sqrt1[l] to sqrt5[l] */
+  if (pdxx != NULL) {
 
-  /** - Allocate main contiguous buffer **/
-  class_alloc(buf_dxx,
-              icount * sizeof(double),
-              ple->error_message);
+    /* all rows point into the full tables */
+    for (index_mu=0; index_mu<num_mu; index_mu++) {
 
-  icount = 0;
-  for (index_mu=0; index_mu<num_mu; index_mu++) {
+      d00[index_mu] = pdxx->d00 +index_mu*(ple->l_unlensed_max+1);
+      d11[index_mu] = pdxx->d11 +index_mu*(ple->l_unlensed_max+1);
+      d1m1[index_mu]= pdxx->d1m1+index_mu*(ple->l_unlensed_max+1);
+      d2m2[index_mu]= pdxx->d2m2+index_mu*(ple->l_unlensed_max+1);
 
-    d00[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-    d11[index_mu] = &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-    d1m1[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
-    d2m2[index_mu]= &(buf_dxx[icount+(index_mu+3*num_mu) * (ple->l_unlensed_max+1)]);
-  }
-  icount += 4*num_mu*(ple->l_unlensed_max+1);
+      if (ple->has_te==_TRUE_) {
+        d20[index_mu] = pdxx->d20 +index_mu*(ple->l_unlensed_max+1);
+        d3m1[index_mu]= pdxx->d3m1+index_mu*(ple->l_unlensed_max+1);
+        d4m2[index_mu]= pdxx->d4m2+index_mu*(ple->l_unlensed_max+1);
+      }
 
-  if (ple->has_te==_TRUE_) {
-    for (index_mu=0; index_mu<num_mu; index_mu++) {
-      d20[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-      d3m1[index_mu]= &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-      d4m2[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
+      if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+        d22[index_mu] = pdxx->d22 +index_mu*(ple->l_unlensed_max+1);
+        d31[index_mu] = pdxx->d31 +index_mu*(ple->l_unlensed_max+1);
+        d3m3[index_mu]= pdxx->d3m3+index_mu*(ple->l_unlensed_max+1);
+        d40[index_mu] = pdxx->d40 +index_mu*(ple->l_unlensed_max+1);
+        d4m4[index_mu]= pdxx->d4m4+index_mu*(ple->l_unlensed_max+1);
+      }
     }
-    icount += 3*num_mu*(ple->l_unlensed_max+1);
   }
+  else {
 
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    /* the rows of one block point into this buffer */
+    icount = 4;
+    if (ple->has_te==_TRUE_)
+      icount += 3;
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_)
+      icount += 5;
 
-    for (index_mu=0; index_mu<num_mu; index_mu++) {
-      d22[index_mu] = &(buf_dxx[icount+index_mu            * (ple->l_unlensed_max+1)]);
-      d31[index_mu] = &(buf_dxx[icount+(index_mu+num_mu)   * (ple->l_unlensed_max+1)]);
-      d3m3[index_mu]= &(buf_dxx[icount+(index_mu+2*num_mu) * (ple->l_unlensed_max+1)]);
-      d40[index_mu] = &(buf_dxx[icount+(index_mu+3*num_mu) * (ple->l_unlensed_max+1)]);
-      d4m4[index_mu]= &(buf_dxx[icount+(index_mu+4*num_mu) * (ple->l_unlensed_max+1)]);
-    }
-    icount += 5*num_mu*(ple->l_unlensed_max+1);
+    class_alloc(buf_dxx,
+                (size_t)icount*mu_block_size*(ple->l_unlensed_max+1)*sizeof(double),
+                ple->error_message);
   }
 
-  sqrt1 = &(buf_dxx[icount]);
+  /** - allocate arrays sqrt1[l] to sqrt5[l] in one buffer **/
+
+  class_alloc(buf_sqrt,
+              5*(ple->l_unlensed_max+1) * sizeof(double),
+              ple->error_message);
+
+  icount = 0;
+  sqrt1 = &(buf_sqrt[icount]);
   icount += ple->l_unlensed_max+1;
-  sqrt2 = &(buf_dxx[icount]);
+  sqrt2 = &(buf_sqrt[icount]);
   icount += ple->l_unlensed_max+1;
-  sqrt3 = &(buf_dxx[icount]);
+  sqrt3 = &(buf_sqrt[icount]);
   icount += ple->l_unlensed_max+1;
-  sqrt4 = &(buf_dxx[icount]);
+  sqrt4 = &(buf_sqrt[icount]);
   icount += ple->l_unlensed_max+1;
-  sqrt5 = &(buf_dxx[icount]);
+  sqrt5 = &(buf_sqrt[icount]);
   icount += ple->l_unlensed_max+1;
 
-  //debut = omp_get_wtime();
-  class_call(lensing_d00(mu,num_mu,ple->l_unlensed_max,d00),
-             ple->error_message,
-             ple->error_message);
-
-  class_call(lensing_d11(mu,num_mu,ple->l_unlensed_max,d11),
-             ple->error_message,
-             ple->error_message);
-
-  class_call(lensing_d1m1(mu,num_mu,ple->l_unlensed_max,d1m1),
-             ple->error_message,
-             ple->error_message);
-
-  class_call(lensing_d2m2(mu,num_mu,ple->l_unlensed_max,d2m2),
-             ple->error_message,
-             ple->error_message);
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in lensing_dxx=%4.3f s\n",cpu_time);
-
-
-  if (ple->has_te==_TRUE_) {
-
-    class_call(lensing_d20(mu,num_mu,ple->l_unlensed_max,d20),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d3m1(mu,num_mu,ple->l_unlensed_max,d3m1),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d4m2(mu,num_mu,ple->l_unlensed_max,d4m2),
-               ple->error_message,
-               ple->error_message);
-
-  }
-
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-
-    class_call(lensing_d22(mu,num_mu,ple->l_unlensed_max,d22),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d31(mu,num_mu,ple->l_unlensed_max,d31),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d3m3(mu,num_mu,ple->l_unlensed_max,d3m3),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d40(mu,num_mu,ple->l_unlensed_max,d40),
-               ple->error_message,
-               ple->error_message);
-
-    class_call(lensing_d4m4(mu,num_mu,ple->l_unlensed_max,d4m4),
-               ple->error_message,
-               ple->error_message);
-  }
-
   /** - compute \f$ Cgl(\mu)\f$, \f$ Cgl2(\mu) \f$ and sigma2(\f$\mu\f$) */
 
   class_alloc(Cgl,
@@ -481,49 +477,7 @@ int lensing_init(
   free(cl_md_ic);
   free(cl_md);
 
-  /** - Compute sigma2\f$(\mu)\f$ and Cgl2(\f$\mu\f$) **/
-
-  class_setup_parallel();
-
-  for (index_mu=0; index_mu<num_mu; index_mu++) {
-
-    int l_unlensed_max;
-    l_unlensed_max = ple->l_unlensed_max;
-    class_run_parallel(with_arguments(index_mu,l_unlensed_max,Cgl,Cgl2,cl_pp,d11,d1m1),
-      int l;
-
-      Cgl[index_mu]=0;
-      Cgl2[index_mu]=0;
-
-      for (l=2; l<=l_unlensed_max; l++) {
-
-        Cgl[index_mu] += (2.*l+1.)*l*(l+1.)*
-          cl_pp[l]*d11[index_mu][l];
-
-        Cgl2[index_mu] += (2.*l+1.)*l*(l+1.)*
-          cl_pp[l]*d1m1[index_mu][l];
-
-      }
-
-      Cgl[index_mu] /= 4.*_PI_;
-      Cgl2[index_mu] /= 4.*_PI_;
-      return _SUCCESS_;
-    );
-
-  }
-
-  class_finish_parallel();
-
-  for (index_mu=0; index_mu<num_mu-1; index_mu++) {
-    /* Cgl(1.0) - Cgl(mu) */
-    sigma2[index_mu] = Cgl[num_mu-1] - Cgl[index_mu];
-  }
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in Cgl,Cgl2,sigma2=%4.3f s\n",cpu_time);
-
-
-  /** - compute ksi, ksi+, ksi-, ksiX */
+  /** - allocate ksi, ksi+, ksi-, ksiX */
 
   /** - --> ksi is for TT **/
   if (ple->has_tt==_TRUE_) {
@@ -567,169 +521,215 @@ int lensing_init(
     sqrt5[l]=sqrt(ll*(ll+1));
   }
 
-  for (index_mu=0;index_mu<num_mu-1;index_mu++) {
+  /** - compute the correlation functions and their projection on the
+      lensed \f$ C_l\f$'s by blocks of values of \f$ \mu \f$ (a single
+      block when the full tables of \f$ d^l_{mm'} (\mu) \f$ are
+      available, otherwise one block of rows of each table is computed
+      just before being used) */
+
+  class_calloc(cl_sum,
+               4*ple->l_size,
+               sizeof(double),
+               ple->error_message);
+
+  class_setup_parallel();
+
+  /** - --> Cgl(\f$\mu=1\f$), needed for sigma2(\f$\mu\f$) */
+
+  if (pdxx == NULL) {
+    class_call(lensing_dxx_block(mu,num_mu-1,num_mu,ple->l_unlensed_max,buf_dxx,
+                                 d00,d11,d1m1,d2m2,d20,d3m1,d4m2,d22,d31,d3m3,d40,d4m4),
+               ple->error_message,
+               ple->error_message);
+  }
+
+  class_call(lensing_cgl(ple,num_mu-1,num_mu,cl_pp,d11,d1m1,Cgl,Cgl2),
+             ple->error_message,
+             ple->error_message);
+
+  for (index_mu_start=0; index_mu_start<num_mu-1; index_mu_start+=mu_block_size) {
+
+    index_mu_end = MIN(index_mu_start+mu_block_size,num_mu-1);
+
+    if (pdxx == NULL) {
+      class_call(lensing_dxx_block(mu,index_mu_start,index_mu_end,ple->l_unlensed_max,buf_dxx,
+                                   d00,d11,d1m1,d2m2,d20,d3m1,d4m2,d22,d31,d3m3,d40,d4m4),
+                 ple->error_message,
+                 ple->error_message);
+    }
+
+    /** - --> Cgl(\f$\mu\f$), Cgl2(\f$\mu\f$) and sigma2(\f$\mu\f$) */
+
+    class_call(lensing_cgl(ple,index_mu_start,index_mu_end,cl_pp,d11,d1m1,Cgl,Cgl2),
+               ple->error_message,
+               ple->error_message);
+
+    for (index_mu=index_mu_start; index_mu<index_mu_end; index_mu++) {
+      /* Cgl(1.0) - Cgl(mu) */
+      sigma2[index_mu] = Cgl[num_mu-1] - Cgl[index_mu];
+    }
+
+    /** - --> ksi, ksi+, ksi-, ksiX */
 
     // = means that all dependencies are captured.
-    class_run_parallel(=,
-
-    int l;
-    double declare_list_of_variables_inside_parallel_region(ll,fac, fac1, X_000, X_p000, X_220,X_022,X_p022,X_121,X_132,X_242);
-    double declare_list_of_variables_inside_parallel_region(res,resX,resp,resm,lens,lensp,lensm);
-    for (l=2;l<=ple->l_unlensed_max;l++) {
-
-      ll = (double)l;
-
-      fac = ll*(ll+1)/4.;
-      fac1 = (2*ll+1)/(4.*_PI_);
-
-      /* In the following we will keep terms of the form (sigma2)^k*(Cgl2)^m
-         with k+m <= 2 */
-
-      X_000 = exp(-fac*sigma2[index_mu]);
-      X_p000 = -fac*X_000;
-      /* X_220 = 0.25*sqrt1[l] * exp(-(fac-0.5)*sigma2[index_mu]); */
-      X_220 = 0.25*sqrt1[l] * X_000; /* Order 0 */
-      /* next 5 lines useless, but avoid compiler warning 'may be used uninitialized' */
-      X_242=0.;
-      X_132=0.;
-      X_121=0.;
-      X_p022=0.;
-      X_022=0.;
-
-      if (ple->has_te==_TRUE_ || ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
-        /* X_022 = exp(-(fac-1.)*sigma2[index_mu]); */
-        X_022 = X_000 * (1+sigma2[index_mu]*(1+0.5*sigma2[index_mu])); /* Order 2 */
-        X_p022 = -(fac-1.)*X_022; /* Old versions were missing the
-                                     minus sign in this line, which introduced a very small error
-                                     on the high-l C_l^TE lensed spectrum [credits for bug fix:
-                                     Selim Hotinli] */
-
-        /* X_242 = 0.25*sqrt4[l] * exp(-(fac-5./2.)*sigma2[index_mu]); */
-        X_242 = 0.25*sqrt4[l] * X_000; /* Order 0 */
-        if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+    class_label_parallel("lensing:ksi",0);
+    class_parallel_for(index_mu,index_mu_start,index_mu_end,0,=,
 
-          /* X_121 = - 0.5*sqrt2[l] * exp(-(fac-2./3.)*sigma2[index_mu]);
-             X_132 = - 0.5*sqrt3[l] * exp(-(fac-5./3.)*sigma2[index_mu]); */
-          X_121 = -0.5*sqrt2[l] * X_000 * (1+2./3.*sigma2[index_mu]); /* Order 1 */
-          X_132 = -0.5*sqrt3[l] * X_000 * (1+5./3.*sigma2[index_mu]); /* Order 1 */
+      int l;
+      double declare_list_of_variables_inside_parallel_region(ll,fac, fac1, X_000, X_p000, X_220,X_022,X_p022,X_121,X_132,X_242);
+      double declare_list_of_variables_inside_parallel_region(res,resX,resp,resm,lens,lensp,lensm);
+      for (l=2;l<=ple->l_unlensed_max;l++) {
+
+        ll = (double)l;
+
+        fac = ll*(ll+1)/4.;
+        fac1 = (2*ll+1)/(4.*_PI_);
+
+        /* In the following we will keep terms of the form (sigma2)^k*(Cgl2)^m
+           with k+m <= 2 */
+
+        X_000 = exp(-fac*sigma2[index_mu]);
+        X_p000 = -fac*X_000;
+        /* X_220 = 0.25*sqrt1[l] * exp(-(fac-0.5)*sigma2[index_mu]); */
+        X_220 = 0.25*sqrt1[l] * X_000; /* Order 0 */
+        /* next 5 lines useless, but avoid compiler warning 'may be used uninitialized' */
+        X_242=0.;
+        X_132=0.;
+        X_121=0.;
+        X_p022=0.;
+        X_022=0.;
+
+        if (ple->has_te==_TRUE_ || ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+          /* X_022 = exp(-(fac-1.)*sigma2[index_mu]); */
+          X_022 = X_000 * (1+sigma2[index_mu]*(1+0.5*sigma2[index_mu])); /* Order 2 */
+          X_p022 = -(fac-1.)*X_022; /* Old versions were missing the
+                                       minus sign in this line, which introduced a very small error
+                                       on the high-l C_l^TE lensed spectrum [credits for bug fix:
+                                       Selim Hotinli] */
+
+          /* X_242 = 0.25*sqrt4[l] * exp(-(fac-5./2.)*sigma2[index_mu]); */
+          X_242 = 0.25*sqrt4[l] * X_000; /* Order 0 */
+          if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+
+            /* X_121 = - 0.5*sqrt2[l] * exp(-(fac-2./3.)*sigma2[index_mu]);
+               X_132 = - 0.5*sqrt3[l] * exp(-(fac-5./3.)*sigma2[index_mu]); */
+            X_121 = -0.5*sqrt2[l] * X_000 * (1+2./3.*sigma2[index_mu]); /* Order 1 */
+            X_132 = -0.5*sqrt3[l] * X_000 * (1+5./3.*sigma2[index_mu]); /* Order 1 */
+          }
         }
-      }
 
 
-      if (ple->has_tt==_TRUE_) {
+        if (ple->has_tt==_TRUE_) {
 
-        res = fac1*cl_tt[l];
+          res = fac1*cl_tt[l];
 
-        lens = (X_000*X_000*d00[index_mu][l] +
-                X_p000*X_p000*d1m1[index_mu][l]
-                *Cgl2[index_mu]*8./(ll*(ll+1)) +
-                (X_p000*X_p000*d00[index_mu][l] +
-                 X_220*X_220*d2m2[index_mu][l])
-                *Cgl2[index_mu]*Cgl2[index_mu]);
-        if (ppr->accurate_lensing == _FALSE_) {
-          /* Remove unlensed correlation function */
-          lens -= d00[index_mu][l];
+          lens = (X_000*X_000*d00[index_mu][l] +
+                  X_p000*X_p000*d1m1[index_mu][l]
+                  *Cgl2[index_mu]*8./(ll*(ll+1)) +
+                  (X_p000*X_p000*d00[index_mu][l] +
+                   X_220*X_220*d2m2[index_mu][l])
+                  *Cgl2[index_mu]*Cgl2[index_mu]);
+          if (ppr->accurate_lensing == _FALSE_) {
+            /* Remove unlensed correlation function */
+            lens -= d00[index_mu][l];
+          }
+          res *= lens;
+          ksi[index_mu] += res;
         }
-        res *= lens;
-        ksi[index_mu] += res;
-      }
 
-      if (ple->has_te==_TRUE_) {
+        if (ple->has_te==_TRUE_) {
 
-        resX = fac1*cl_te[l];
+          resX = fac1*cl_te[l];
 
 
-        lens = ( X_022*X_000*d20[index_mu][l] +
-                 Cgl2[index_mu]*2.*X_p000/sqrt5[l] *
-                 (X_121*d11[index_mu][l] + X_132*d3m1[index_mu][l]) +
-                 0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
-                 ( ( 2.*X_p022*X_p000+X_220*X_220 ) *
-                   d20[index_mu][l] + X_220*X_242*d4m2[index_mu][l] ) );
-        if (ppr->accurate_lensing == _FALSE_) {
-          lens -= d20[index_mu][l];
+          lens = ( X_022*X_000*d20[index_mu][l] +
+                   Cgl2[index_mu]*2.*X_p000/sqrt5[l] *
+                   (X_121*d11[index_mu][l] + X_132*d3m1[index_mu][l]) +
+                   0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
+                   ( ( 2.*X_p022*X_p000+X_220*X_220 ) *
+                     d20[index_mu][l] + X_220*X_242*d4m2[index_mu][l] ) );
+          if (ppr->accurate_lensing == _FALSE_) {
+            lens -= d20[index_mu][l];
+          }
+          resX *= lens;
+          ksiX[index_mu] += resX;
         }
-        resX *= lens;
-        ksiX[index_mu] += resX;
-      }
 
-      if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+        if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
 
-        resp = fac1*(cl_ee[l]+cl_bb[l]);
-        resm = fac1*(cl_ee[l]-cl_bb[l]);
-
-        lensp = ( X_022*X_022*d22[index_mu][l] +
-                  2.*Cgl2[index_mu]*X_132*X_121*d31[index_mu][l] +
-                  Cgl2[index_mu]*Cgl2[index_mu] *
-                  ( X_p022*X_p022*d22[index_mu][l] +
-                    X_242*X_220*d40[index_mu][l] ) );
-
-        lensm = ( X_022*X_022*d2m2[index_mu][l] +
-                  Cgl2[index_mu] *
-                  ( X_121*X_121*d1m1[index_mu][l] +
-                    X_132*X_132*d3m3[index_mu][l] ) +
-                  0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
-                  ( 2.*X_p022*X_p022*d2m2[index_mu][l] +
-                    X_220*X_220*d00[index_mu][l] +
-                    X_242*X_242*d4m4[index_mu][l] ) );
-        if (ppr->accurate_lensing == _FALSE_) {
-          lensp -= d22[index_mu][l];
-          lensm -= d2m2[index_mu][l];
+          resp = fac1*(cl_ee[l]+cl_bb[l]);
+          resm = fac1*(cl_ee[l]-cl_bb[l]);
+
+          lensp = ( X_022*X_022*d22[index_mu][l] +
+                    2.*Cgl2[index_mu]*X_132*X_121*d31[index_mu][l] +
+                    Cgl2[index_mu]*Cgl2[index_mu] *
+                    ( X_p022*X_p022*d22[index_mu][l] +
+                      X_242*X_220*d40[index_mu][l] ) );
+
+          lensm = ( X_022*X_022*d2m2[index_mu][l] +
+                    Cgl2[index_mu] *
+                    ( X_121*X_121*d1m1[index_mu][l] +
+                      X_132*X_132*d3m3[index_mu][l] ) +
+                    0.5 * Cgl2[index_mu] * Cgl2[index_mu] *
+                    ( 2.*X_p022*X_p022*d2m2[index_mu][l] +
+                      X_220*X_220*d00[index_mu][l] +
+                      X_242*X_242*d4m4[index_mu][l] ) );
+          if (ppr->accurate_lensing == _FALSE_) {
+            lensp -= d22[index_mu][l];
+            lensm -= d2m2[index_mu][l];
+          }
+          resp *= lensp;
+          resm *= lensm;
+          ksip[index_mu] += resp;
+          ksim[index_mu] += resm;
         }
-        resp *= lensp;
-        resm *= lensm;
-        ksip[index_mu] += resp;
-        ksim[index_mu] += resm;
       }
-    }
-    return _SUCCESS_;
+      return _SUCCESS_;
 
-    );
-  }
+      );
 
-  class_finish_parallel();
-  //fin = omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in ksi=%4.3f s\n",cpu_time);
+    class_finish_parallel();
 
+    /** - --> add the contribution of this block to the lensed \f$ C_l\f$'s */
 
-  /** - compute lensed \f$ C_l\f$'s by integration */
-  //debut = omp_get_wtime();
-  if (ple->has_tt==_TRUE_) {
-    class_call(lensing_lensed_cl_tt(ksi,d00,w8,num_mu-1,ple),
-               ple->error_message,
-               ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
-      class_call(lensing_addback_cl_tt(ple,cl_tt),
+    if (ple->has_tt==_TRUE_) {
+      class_call(lensing_lensed_cl_tt(ksi,d00,w8,index_mu_start,index_mu_end,cl_sum,ple),
                  ple->error_message,
                  ple->error_message);
     }
-  }
 
-  if (ple->has_te==_TRUE_) {
-    class_call(lensing_lensed_cl_te(ksiX,d20,w8,num_mu-1,ple),
-               ple->error_message,
-               ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
-      class_call(lensing_addback_cl_te(ple,cl_te),
+    if (ple->has_te==_TRUE_) {
+      class_call(lensing_lensed_cl_te(ksiX,d20,w8,index_mu_start,index_mu_end,cl_sum+ple->l_size,ple),
+                 ple->error_message,
+                 ple->error_message);
+    }
+
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+      class_call(lensing_lensed_cl_ee_bb(ksip,ksim,d22,d2m2,w8,index_mu_start,index_mu_end,cl_sum+2*ple->l_size,ple),
                  ple->error_message,
                  ple->error_message);
     }
   }
 
-  if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
+  /** - in fast mode, add back the unlensed \f$ C_l\f$'s */
 
-    class_call(lensing_lensed_cl_ee_bb(ksip,ksim,d22,d2m2,w8,num_mu-1,ple),
-               ple->error_message,
-               ple->error_message);
-    if (ppr->accurate_lensing == _FALSE_) {
+  if (ppr->accurate_lensing == _FALSE_) {
+    if (ple->has_tt==_TRUE_) {
+      class_call(lensing_addback_cl_tt(ple,cl_tt),
+                 ple->error_message,
+                 ple->error_message);
+    }
+    if (ple->has_te==_TRUE_) {
+      class_call(lensing_addback_cl_te(ple,cl_te),
+                 ple->error_message,
+                 ple->error_message);
+    }
+    if (ple->has_ee==_TRUE_ || ple->has_bb==_TRUE_) {
       class_call(lensing_addback_cl_ee_bb(ple,cl_ee,cl_bb),
                  ple->error_message,
                  ple->error_message);
     }
   }
-  //fin=omp_get_wtime();
-  //cpu_time = (fin-debut);
-  //printf("time in final lensing computation=%4.3f s\n",cpu_time);
 
   /** - spline computed \f$ C_l\f$'s in view of interpolation */
 
@@ -744,7 +744,7 @@ int lensing_init(
              ple->error_message);
 
   /** - Free lots of stuff **/
-  free(buf_dxx);
+  free(buf_sqrt);
 
   free(d00);
   free(d11);
@@ -775,8 +775,18 @@ int lensing_init(
   free(Cgl2);
   free(sigma2);
 
-  free(mu);
-  free(w8);
+  free(cl_sum);
+
+  if (pdxx == NULL) {
+    free(mu);
+    free(w8);
+    free(buf_dxx);
+  }
+  else {
+    class_call(lensing_dxx_release(pdxx),
+               ple->error_message,
+               ple->error_message);
+  }
 
   free(cl_unlensed);
   free(cl_tt);
@@ -791,6 +801,8 @@ int lensing_init(
 
   ple->is_allocated = _TRUE_;
 
+  class_timer_end(&(ple->stats));
+
   return _SUCCESS_;
 
 }
@@ -1035,65 +1047,802 @@ int lensing_indices(
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine returns the values of \f$ \mu \f$, the quadrature
+ * weights and the tables of \f$ d^l_{mm'}(\mu) \f$ needed by
+ * lensing_init(). They only depend on num_mu, l_unlensed_max and the
+ * lensing precision parameters. If ppr->lensing_dxx_cache is true,
+ * the last tables are kept in memory and returned again by the next
+ * calls with the same values (e.g. successive runs from a wrapper),
+ * and if ppr->lensing_dxx_cache_disk is also true they are written
+ * to (and mapped back from) a file of ppr->lensing_dxx_cache_path.
  *
- * @param ksi  Input: Lensed correlation function (ksi[index_mu])
- * @param d00  Input: Legendre polynomials (\f$ d^l_{00}\f$[l][index_mu])
- * @param w8   Input: Legendre quadrature weights (w8[index_mu])
- * @param nmu  Input: Number of quadrature points (0<=index_mu<=nmu)
- * @param ple  Input/output: Pointer to the lensing structure
+ * Each call must be matched by a call to lensing_dxx_release().
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param ple        Input: pointer to lensing structure
+ * @param num_mu     Input: number of values of \f$ \mu \f$
+ * @param need_d_te  Input: are d20, d3m1, d4m2 needed?
+ * @param need_d_pol Input: are d22, d31, d3m3, d40, d4m4 needed?
+ * @param ppdxx      Output: pointer to the tables
  * @return the error status
  */
 
+int lensing_dxx_get(
+                    struct precision * ppr,
+                    struct lensing * ple,
+                    int num_mu,
+                    short need_d_te,
+                    short need_d_pol,
+                    struct lensing_dxx ** ppdxx
+                    ) {
 
-int lensing_lensed_cl_tt(
-                         double *ksi,
-                         double **d00,
-                         double *w8,
-                         int nmu,
-                         struct lensing * ple
-                         ) {
+  struct lensing_dxx * pdxx;
+  struct lensing_dxx * pdxx_same_key = NULL;
+  char file_name[_FILENAMESIZE_];
+  short has_map = _FALSE_;
+  short use_disk;
 
-  int index_l;
+  std::unique_lock<std::mutex> lock(lensing_dxx_mutex);
 
-  /** Integration by Gauss-Legendre quadrature. **/
-  class_setup_parallel();
+  use_disk = ((ppr->lensing_dxx_cache == _TRUE_) && (ppr->lensing_dxx_cache_disk == _TRUE_)) ? _TRUE_ : _FALSE_;
 
-  for (index_l=0; index_l<ple->l_size; index_l++){
-    class_run_parallel(=,
-      double cle;
-      int imu;
-      cle=0;
-      for (imu=0;imu<nmu;imu++) {
-        cle += ksi[imu]*d00[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
-      }
-      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt]=cle*2.0*_PI_;
-      return _SUCCESS_;
-    );
-  }
+  /** - reuse the tables of a previous run if they have the same key and all the needed tables */
 
-  class_finish_parallel();
+  if ((ppr->lensing_dxx_cache == _TRUE_) && (lensing_dxx_cached != NULL)) {
 
-  return _SUCCESS_;
-}
+    pdxx = lensing_dxx_cached;
 
-/**
- * This routine adds back the unlensed \f$ cl_{tt}\f$ power spectrum
- * Used in case of fast (and BB inaccurate) integration of
- * correlation functions.
- *
- * @param ple   Input/output: Pointer to the lensing structure
- * @param cl_tt Input: Array of unlensed power spectrum
- * @return the error status
- */
+    if ((pdxx->accurate_lensing == ppr->accurate_lensing) &&
+        (pdxx->num_mu == num_mu) &&
+        (pdxx->l_unlensed_max == ple->l_unlensed_max) &&
+        (pdxx->tol_gauss_legendre == ppr->tol_gauss_legendre)) {
 
-int lensing_addback_cl_tt(
-                          struct lensing * ple,
-                          double *cl_tt) {
-  int index_l, l;
+      if (((pdxx->has_d_te == _TRUE_) || (need_d_te == _FALSE_)) &&
+          ((pdxx->has_d_pol == _TRUE_) || (need_d_pol == _FALSE_))) {
 
-  for (index_l=0; index_l<ple->l_size; index_l++) {
-    l = (int)ple->l[index_l];
+        pdxx->users++;
+        *ppdxx = pdxx;
+
+        if (ple->lensing_verbose > 1)
+          printf(" -> reusing the tables of d^l_mm' of a previous run\n");
+
+        return _SUCCESS_;
+      }
+
+      pdxx_same_key = pdxx;
+    }
+  }
+
+  /** - otherwise get new tables, keeping the groups already computed for the same key */
+
+  class_calloc(pdxx,
+               1,
+               sizeof(struct lensing_dxx),
+               ple->error_message);
+
+  pdxx->accurate_lensing = ppr->accurate_lensing;
+  pdxx->num_mu = num_mu;
+  pdxx->l_unlensed_max = ple->l_unlensed_max;
+  pdxx->tol_gauss_legendre = ppr->tol_gauss_legendre;
+  pdxx->has_d_te = need_d_te;
+  pdxx->has_d_pol = need_d_pol;
+  if (pdxx_same_key != NULL) {
+    pdxx->has_d_te = (pdxx->has_d_te == _TRUE_) || (pdxx_same_key->has_d_te == _TRUE_);
+    pdxx->has_d_pol = (pdxx->has_d_pol == _TRUE_) || (pdxx_same_key->has_d_pol == _TRUE_);
+  }
+  pdxx->map = NULL;
+
+  /* the tables are computed outside of the lock: lensing_dxx_compute()
+     sends its parallel regions to the pool, whose thread may then run
+     the task of another run calling this function */
+  lock.unlock();
+
+  if (use_disk == _TRUE_) {
+
+    class_call(lensing_dxx_cache_file_name(ppr,pdxx,file_name,ple->error_message),
+               ple->error_message,
+               ple->error_message);
+
+    lensing_dxx_cache_map(file_name,pdxx,pdxx->has_d_te,pdxx->has_d_pol,&has_map);
+
+    if ((has_map == _TRUE_) && (ple->lensing_verbose > 1))
+      printf(" -> reading the tables of d^l_mm' from %s\n",file_name);
+  }
+
+  if (has_map == _FALSE_) {
+
+    class_call_except(lensing_dxx_compute(ppr,pdxx,ple->error_message),
+                      ple->error_message,
+                      ple->error_message,
+                      lensing_dxx_free(pdxx));
+
+    if (use_disk == _TRUE_)
+      lensing_dxx_cache_write(ppr->lensing_dxx_cache_path,file_name,pdxx);
+  }
+
+  lock.lock();
+
+  /** - keep the new tables for the next runs, and drop the previous ones */
+
+  if (ppr->lensing_dxx_cache == _TRUE_) {
+
+    if (lensing_dxx_cached != NULL) {
+      lensing_dxx_cached->is_cached = _FALSE_;
+      if (lensing_dxx_cached->users == 0)
+        lensing_dxx_free(lensing_dxx_cached);
+    }
+
+    pdxx->is_cached = _TRUE_;
+    lensing_dxx_cached = pdxx;
+  }
+
+  pdxx->users = 1;
+  *ppdxx = pdxx;
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine releases tables obtained with lensing_dxx_get(), and
+ * frees them unless they are kept for the next runs.
+ *
+ * @param pdxx Input: pointer to the tables
+ * @return the error status
+ */
+
+int lensing_dxx_release(
+                        struct lensing_dxx * pdxx
+                        ) {
+
+  std::lock_guard<std::mutex> lock(lensing_dxx_mutex);
+
+  pdxx->users--;
+
+  if ((pdxx->users == 0) && (pdxx->is_cached == _FALSE_))
+    lensing_dxx_free(pdxx);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine drops the tables kept in memory by lensing_dxx_get()
+ * (they are freed as soon as no run uses them).
+ *
+ * @return the error status
+ */
+
+int lensing_dxx_cache_clear(void) {
+
+  std::lock_guard<std::mutex> lock(lensing_dxx_mutex);
+
+  if (lensing_dxx_cached != NULL) {
+    lensing_dxx_cached->is_cached = _FALSE_;
+    if (lensing_dxx_cached->users == 0)
+      lensing_dxx_free(lensing_dxx_cached);
+    lensing_dxx_cached = NULL;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the values of \f$ \mu \f$, the quadrature
+ * weights and the tables of \f$ d^l_{mm'}(\mu) \f$ for the key and
+ * the groups of tables set in pdxx.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param pdxx          Input/output: pointer to the tables
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int lensing_dxx_compute(
+                        struct precision * ppr,
+                        struct lensing_dxx * pdxx,
+                        ErrorMsg error_message
+                        ) {
+
+  int num_mu = pdxx->num_mu;
+  int lmax = pdxx->l_unlensed_max;
+  int index_mu, index_d;
+  double ** rows;
+
+  double * dxx_table[12];
+  double ** dxx_rows[12];
+
+  class_alloc_large(pdxx->buf,
+                    lensing_dxx_size(pdxx),
+                    error_message);
+
+  lensing_dxx_set_pointers(pdxx);
+
+  /** - values of \f$ \mu \f$ and quadrature weights */
+
+  class_call(lensing_quadrature(ppr,num_mu,pdxx->mu,pdxx->w8,error_message),
+             error_message,
+             error_message);
+
+  /** - Compute \f$ d^l_{mm'} (\mu) \f$, through an array of pointers to the rows of each table */
+
+  dxx_table[0] = pdxx->d00;
+  dxx_table[1] = pdxx->d11;
+  dxx_table[2] = pdxx->d1m1;
+  dxx_table[3] = pdxx->d2m2;
+  dxx_table[4] = pdxx->d20;
+  dxx_table[5] = pdxx->d3m1;
+  dxx_table[6] = pdxx->d4m2;
+  dxx_table[7] = pdxx->d22;
+  dxx_table[8] = pdxx->d31;
+  dxx_table[9] = pdxx->d3m3;
+  dxx_table[10] = pdxx->d40;
+  dxx_table[11] = pdxx->d4m4;
+
+  class_alloc(rows,
+              12*num_mu*sizeof(double*),
+              error_message);
+
+  for (index_d=0; index_d<12; index_d++) {
+
+    if (dxx_table[index_d] == NULL) {
+      dxx_rows[index_d] = NULL;
+      continue;
+    }
+
+    dxx_rows[index_d] = rows+index_d*num_mu;
+    for (index_mu=0; index_mu<num_mu; index_mu++)
+      dxx_rows[index_d][index_mu] = dxx_table[index_d]+(size_t)index_mu*(lmax+1);
+  }
+
+  class_call(lensing_dxx(pdxx->mu,num_mu,lmax,
+                         dxx_rows[0],dxx_rows[1],dxx_rows[2],dxx_rows[3],
+                         dxx_rows[4],dxx_rows[5],dxx_rows[6],
+                         dxx_rows[7],dxx_rows[8],dxx_rows[9],dxx_rows[10],dxx_rows[11]),
+             error_message,
+             error_message);
+
+  free(rows);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the values of \f$ \mu \f$ and the quadrature
+ * weights: Gauss-Legendre quadrature in accurate mode, otherwise
+ * Riemann sum on \f$ \theta \f$ in [0,pi/16]. The last value is
+ * \f$ \mu=1 \f$, without weight.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param num_mu        Input: number of values of \f$ \mu \f$
+ * @param mu            Output: values of \f$ \mu \f$ (mu[index_mu])
+ * @param w8            Output: quadrature weights (w8[index_mu], num_mu-1 values)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int lensing_quadrature(
+                       struct precision * ppr,
+                       int num_mu,
+                       double * mu,
+                       double * w8,
+                       ErrorMsg error_message
+                       ) {
+
+  int index_mu;
+  double theta,delta_theta;
+
+  /* Reserve last element of mu for mu=1, needed for sigma2 */
+  mu[num_mu-1] = 1.0;
+
+  if (ppr->accurate_lensing == _TRUE_) {
+
+    class_call(quadrature_gauss_legendre(mu,
+                                         w8,
+                                         num_mu-1,
+                                         ppr->tol_gauss_legendre,
+                                         error_message),
+               error_message,
+               error_message);
+
+  } else { /* Crude integration on [0,pi/16]: Riemann sum on theta */
+
+    delta_theta = _PI_/16. / (double)(num_mu-1);
+    for (index_mu=0;index_mu<num_mu-1;index_mu++) {
+      theta = (index_mu+1)*delta_theta;
+      mu[index_mu] = cos(theta);
+      w8[index_mu] = sin(theta)*delta_theta; /* We integrate on mu */
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine computes the rows index_mu_start <= index_mu <
+ * index_mu_end of the tables of \f$ d^l_{mm'}(\mu) \f$, in the
+ * streaming mode of lensing_init(): the rows are pointed into buf,
+ * which must hold (index_mu_end-index_mu_start)*(lmax+1) values for
+ * each table. Tables with a NULL array of rows are skipped.
+ *
+ * @param mu             Input: values of \f$ \mu \f$ (mu[index_mu])
+ * @param index_mu_start Input: first row
+ * @param index_mu_end   Input: last row plus one
+ * @param lmax           Input: maximum multipole
+ * @param buf            Input: buffer for the rows
+ * @param d00            Input/output: rows of \f$ d^l_{00}\f$ (d00[index_mu][l]), and similarly for the other tables
+ * @param d11            Input/output: rows of \f$ d^l_{11}\f$
+ * @param d1m1           Input/output: rows of \f$ d^l_{1-1}\f$
+ * @param d2m2           Input/output: rows of \f$ d^l_{2-2}\f$
+ * @param d20            Input/output: rows of \f$ d^l_{20}\f$, or NULL
+ * @param d3m1           Input/output: rows of \f$ d^l_{3-1}\f$, or NULL
+ * @param d4m2           Input/output: rows of \f$ d^l_{4-2}\f$, or NULL
+ * @param d22            Input/output: rows of \f$ d^l_{22}\f$, or NULL
+ * @param d31            Input/output: rows of \f$ d^l_{31}\f$, or NULL
+ * @param d3m3           Input/output: rows of \f$ d^l_{3-3}\f$, or NULL
+ * @param d40            Input/output: rows of \f$ d^l_{40}\f$, or NULL
+ * @param d4m4           Input/output: rows of \f$ d^l_{4-4}\f$, or NULL
+ * @return the error status
+ */
+
+int lensing_dxx_block(
+                      double * mu,
+                      int index_mu_start,
+                      int index_mu_end,
+                      int lmax,
+                      double * buf,
+                      double ** d00,
+                      double ** d11,
+                      double ** d1m1,
+                      double ** d2m2,
+                      double ** d20,
+                      double ** d3m1,
+                      double ** d4m2,
+                      double ** d22,
+                      double ** d31,
+                      double ** d3m3,
+                      double ** d40,
+                      double ** d4m4
+                      ) {
+
+  int num_mu = index_mu_end-index_mu_start;
+  int index_mu, index_d;
+
+  double ** dxx_rows[12] = {
+    d00, d11, d1m1, d2m2,
+    d20, d3m1, d4m2,
+    d22, d31, d3m3, d40, d4m4};
+
+  for (index_d=0; index_d<12; index_d++) {
+
+    if (dxx_rows[index_d] == NULL)
+      continue;
+
+    for (index_mu=index_mu_start; index_mu<index_mu_end; index_mu++) {
+      dxx_rows[index_d][index_mu] = buf+(size_t)(index_mu-index_mu_start)*(lmax+1);
+    }
+    buf += (size_t)num_mu*(lmax+1);
+
+    dxx_rows[index_d] += index_mu_start;
+  }
+
+  return lensing_dxx(mu+index_mu_start,num_mu,lmax,
+                     dxx_rows[0],dxx_rows[1],dxx_rows[2],dxx_rows[3],
+                     dxx_rows[4],dxx_rows[5],dxx_rows[6],
+                     dxx_rows[7],dxx_rows[8],dxx_rows[9],dxx_rows[10],dxx_rows[11]);
+}
+
+/**
+ * This routine frees tables of \f$ d^l_{mm'}(\mu) \f$, or unmaps the
+ * cache file holding them.
+ *
+ * @param pdxx Input: pointer to the tables
+ * @return the error status
+ */
+
+int lensing_dxx_free(
+                     struct lensing_dxx * pdxx
+                     ) {
+
+#ifdef _LENSING_DXX_MMAP_
+  if (pdxx->map != NULL)
+    munmap(pdxx->map,pdxx->map_size);
+  else
+#endif
+    class_free_large(pdxx->buf);
+
+  free(pdxx);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Size in bytes of the buffer holding \f$ \mu \f$, the weights and
+ * the tables of \f$ d^l_{mm'}(\mu) \f$ (without the header of the
+ * cache files).
+ *
+ * @param pdxx Input: pointer to the tables
+ * @return the size
+ */
+
+size_t lensing_dxx_size(
+                        struct lensing_dxx * pdxx
+                        ) {
+
+  int num_tables = 4;
+
+  if (pdxx->has_d_te == _TRUE_)
+    num_tables += 3;
+  if (pdxx->has_d_pol == _TRUE_)
+    num_tables += 5;
+
+  return sizeof(double)*(2*(size_t)pdxx->num_mu-1+(size_t)num_tables*pdxx->num_mu*(pdxx->l_unlensed_max+1));
+}
+
+/**
+ * This routine points the arrays of pdxx into its buffer, in the
+ * order of the cache files.
+ *
+ * @param pdxx Input/output: pointer to the tables
+ * @return the error status
+ */
+
+int lensing_dxx_set_pointers(
+                             struct lensing_dxx * pdxx
+                             ) {
+
+  size_t table_size = (size_t)pdxx->num_mu*(pdxx->l_unlensed_max+1);
+
+  pdxx->mu = pdxx->buf;
+  pdxx->w8 = pdxx->mu + pdxx->num_mu;
+  pdxx->d00 = pdxx->w8 + pdxx->num_mu-1;
+  pdxx->d11 = pdxx->d00 + table_size;
+  pdxx->d1m1 = pdxx->d11 + table_size;
+  pdxx->d2m2 = pdxx->d1m1 + table_size;
+
+  pdxx->d20 = NULL;
+  pdxx->d3m1 = NULL;
+  pdxx->d4m2 = NULL;
+  pdxx->d22 = NULL;
+  pdxx->d31 = NULL;
+  pdxx->d3m3 = NULL;
+  pdxx->d40 = NULL;
+  pdxx->d4m4 = NULL;
+
+  if (pdxx->has_d_te == _TRUE_) {
+    pdxx->d20 = pdxx->d2m2 + table_size;
+    pdxx->d3m1 = pdxx->d20 + table_size;
+    pdxx->d4m2 = pdxx->d3m1 + table_size;
+  }
+
+  if (pdxx->has_d_pol == _TRUE_) {
+    pdxx->d22 = (pdxx->has_d_te == _TRUE_) ? pdxx->d4m2 + table_size : pdxx->d2m2 + table_size;
+    pdxx->d31 = pdxx->d22 + table_size;
+    pdxx->d3m3 = pdxx->d31 + table_size;
+    pdxx->d40 = pdxx->d3m3 + table_size;
+    pdxx->d4m4 = pdxx->d40 + table_size;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine sets the name of the cache file of the tables with
+ * the key of pdxx: a FNV-1a digest of the format version and of all
+ * parameters fixing the tables.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param pdxx          Input: pointer to the tables (only the key is used)
+ * @param file_name     Output: name of the cache file
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int lensing_dxx_cache_file_name(
+                                struct precision * ppr,
+                                struct lensing_dxx * pdxx,
+                                char * file_name,
+                                ErrorMsg error_message
+                                ) {
+
+  unsigned long long digest;
+  unsigned char * bytes;
+  int j;
+
+  digest = 14695981039346656037ULL;
+#define _LENSING_DXX_DIGEST_(var)                       \
+  bytes = (unsigned char *) &(var);                     \
+  for (j=0; j<(int)sizeof(var); j++) {                  \
+    digest ^= bytes[j];                                 \
+    digest *= 1099511628211ULL;                         \
+  }
+  j = _LENSING_DXX_VERSION_;
+  _LENSING_DXX_DIGEST_(j);
+  _LENSING_DXX_DIGEST_(pdxx->accurate_lensing);
+  _LENSING_DXX_DIGEST_(pdxx->num_mu);
+  _LENSING_DXX_DIGEST_(pdxx->l_unlensed_max);
+  _LENSING_DXX_DIGEST_(pdxx->tol_gauss_legendre);
+#undef _LENSING_DXX_DIGEST_
+
+  class_test(snprintf(file_name,_FILENAMESIZE_,"%s/dxx_%d_%d_%016llx.bin",
+                      ppr->lensing_dxx_cache_path,
+                      pdxx->num_mu,
+                      pdxx->l_unlensed_max,
+                      digest) >= _FILENAMESIZE_,
+             error_message,
+             "path of the cache directory '%s' is too long",
+             ppr->lensing_dxx_cache_path);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine maps the cache file file_name and points the arrays of
+ * pdxx into it, if it holds tables with the key of pdxx and at least
+ * the needed groups of tables. Any mismatch or system error just
+ * returns has_map = _FALSE_.
+ *
+ * @param file_name  Input: name of the cache file
+ * @param pdxx       Input/output: pointer to the tables
+ * @param need_d_te  Input: are d20, d3m1, d4m2 needed?
+ * @param need_d_pol Input: are d22, d31, d3m3, d40, d4m4 needed?
+ * @param has_map    Output: have the tables been mapped?
+ * @return the error status
+ */
+
+int lensing_dxx_cache_map(
+                          char * file_name,
+                          struct lensing_dxx * pdxx,
+                          short need_d_te,
+                          short need_d_pol,
+                          short * has_map
+                          ) {
+
+#ifdef _LENSING_DXX_MMAP_
+  struct lensing_dxx_cache_header header;
+  struct stat file_stat;
+  void * map;
+  size_t size;
+  int fd;
+
+  *has_map = _FALSE_;
+
+  fd = open(file_name,O_RDONLY);
+  if (fd < 0)
+    return _SUCCESS_;
+
+  if ((fstat(fd,&file_stat) != 0) ||
+      (file_stat.st_size < (off_t)_LENSING_DXX_HEADER_SIZE_) ||
+      (read(fd,&header,sizeof(header)) != (ssize_t)sizeof(header)) ||
+      (strncmp(header.magic,"CLASSDXX",8) != 0) ||
+      (header.version != _LENSING_DXX_VERSION_) ||
+      (header.size_of_int != (int)sizeof(int)) ||
+      (header.size_of_double != (int)sizeof(double)) ||
+      (header.one != 1.0) ||
+      (header.accurate_lensing != pdxx->accurate_lensing) ||
+      (header.num_mu != pdxx->num_mu) ||
+      (header.l_unlensed_max != pdxx->l_unlensed_max) ||
+      (header.tol_gauss_legendre != pdxx->tol_gauss_legendre) ||
+      ((need_d_te == _TRUE_) && (header.has_d_te == _FALSE_)) ||
+      ((need_d_pol == _TRUE_) && (header.has_d_pol == _FALSE_))) {
+    close(fd);
+    return _SUCCESS_;
+  }
+
+  pdxx->has_d_te = header.has_d_te;
+  pdxx->has_d_pol = header.has_d_pol;
+
+  size = _LENSING_DXX_HEADER_SIZE_ + lensing_dxx_size(pdxx);
+  if ((size_t)file_stat.st_size != size) {
+    pdxx->has_d_te = need_d_te;
+    pdxx->has_d_pol = need_d_pol;
+    close(fd);
+    return _SUCCESS_;
+  }
+
+  map = mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    pdxx->has_d_te = need_d_te;
+    pdxx->has_d_pol = need_d_pol;
+    return _SUCCESS_;
+  }
+
+  pdxx->buf = (double *)((char *)map + _LENSING_DXX_HEADER_SIZE_);
+  lensing_dxx_set_pointers(pdxx);
+  pdxx->map = map;
+  pdxx->map_size = size;
+
+  *has_map = _TRUE_;
+#else
+  *has_map = _FALSE_;
+#endif
+  return _SUCCESS_;
+}
+
+/**
+ * This routine writes the tables of pdxx to file_name, through a
+ * temporary file renamed at the end, so that concurrent runs never
+ * see partial tables. Returns _FAILURE_ without message if anything
+ * goes wrong, the caller can ignore it.
+ *
+ * @param cache_directory Input: directory of the cache files
+ * @param file_name       Input: name of the cache file
+ * @param pdxx            Input: pointer to the tables
+ * @return the error status
+ */
+
+int lensing_dxx_cache_write(
+                            char * cache_directory,
+                            char * file_name,
+                            struct lensing_dxx * pdxx
+                            ) {
+
+#ifdef _LENSING_DXX_MMAP_
+  struct lensing_dxx_cache_header header;
+  char tmp_name[_FILENAMESIZE_+32];
+  char padding[_LENSING_DXX_HEADER_SIZE_];
+  FILE * file;
+  size_t size = lensing_dxx_size(pdxx);
+  int status;
+
+  mkdir(cache_directory,0777);
+
+  if (snprintf(tmp_name,_FILENAMESIZE_+32,"%s.%ld.tmp",file_name,(long)getpid()) >= _FILENAMESIZE_+32)
+    return _FAILURE_;
+
+  file = fopen(tmp_name,"wb");
+  if (file == NULL)
+    return _FAILURE_;
+
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,"CLASSDXX",8);
+  header.version = _LENSING_DXX_VERSION_;
+  header.size_of_int = (int)sizeof(int);
+  header.size_of_double = (int)sizeof(double);
+  header.accurate_lensing = pdxx->accurate_lensing;
+  header.num_mu = pdxx->num_mu;
+  header.l_unlensed_max = pdxx->l_unlensed_max;
+  header.has_d_te = pdxx->has_d_te;
+  header.has_d_pol = pdxx->has_d_pol;
+  header.one = 1.0;
+  header.tol_gauss_legendre = pdxx->tol_gauss_legendre;
+
+  memset(padding,0,_LENSING_DXX_HEADER_SIZE_);
+  memcpy(padding,&header,sizeof(header));
+
+  status = ((fwrite(padding,1,_LENSING_DXX_HEADER_SIZE_,file) == _LENSING_DXX_HEADER_SIZE_) &&
+            (fwrite(pdxx->buf,1,size,file) == size));
+
+  if ((fclose(file) != 0) || (status == 0) || (rename(tmp_name,file_name) != 0)) {
+    remove(tmp_name);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+#else
+  return _FAILURE_;
+#endif
+}
+
+/**
+ * This routine computes Cgl(\f$\mu\f$) and Cgl2(\f$\mu\f$) for
+ * index_mu_start <= index_mu < index_mu_end
+ *
+ * @param ple            Input: pointer to lensing structure
+ * @param index_mu_start Input: first value of \f$ \mu \f$
+ * @param index_mu_end   Input: last value of \f$ \mu \f$ plus one
+ * @param cl_pp          Input: unlensed lensing potential spectrum (cl_pp[l])
+ * @param d11            Input: Wigner d-function (\f$ d^l_{11}\f$[index_mu][l])
+ * @param d1m1           Input: Wigner d-function (\f$ d^l_{1-1}\f$[index_mu][l])
+ * @param Cgl            Output: Cgl[index_mu]
+ * @param Cgl2           Output: Cgl2[index_mu]
+ * @return the error status
+ */
+
+int lensing_cgl(
+                struct lensing * ple,
+                int index_mu_start,
+                int index_mu_end,
+                double * cl_pp,
+                double ** d11,
+                double ** d1m1,
+                double * Cgl,
+                double * Cgl2
+                ) {
+
+  int l_unlensed_max = ple->l_unlensed_max;
+
+  class_setup_parallel();
+
+  class_label_parallel("lensing:cgl",0);
+  class_parallel_for(index_mu,index_mu_start,index_mu_end,0,with_arguments(l_unlensed_max,Cgl,Cgl2,cl_pp,d11,d1m1),
+      int l;
+
+      Cgl[index_mu]=0;
+      Cgl2[index_mu]=0;
+
+      for (l=2; l<=l_unlensed_max; l++) {
+
+        Cgl[index_mu] += (2.*l+1.)*l*(l+1.)*
+          cl_pp[l]*d11[index_mu][l];
+
+        Cgl2[index_mu] += (2.*l+1.)*l*(l+1.)*
+          cl_pp[l]*d1m1[index_mu][l];
+
+      }
+
+      Cgl[index_mu] /= 4.*_PI_;
+      Cgl2[index_mu] /= 4.*_PI_;
+      return _SUCCESS_;
+    );
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine adds the contribution of one block of quadrature
+ * points to the lensed power spectra, computed by Gaussian quadrature
+ *
+ * @param ksi  Input: Lensed correlation function (ksi[index_mu])
+ * @param d00  Input: Legendre polynomials (\f$ d^l_{00}\f$[l][index_mu])
+ * @param w8   Input: Legendre quadrature weights (w8[index_mu])
+ * @param index_mu_start Input: first quadrature point of this block
+ * @param index_mu_end   Input: last quadrature point of this block plus one
+ * @param sum  Input/output: sums over the quadrature points of the previous blocks, set to zero before the first block (sum[index_l])
+ * @param ple  Input/output: Pointer to the lensing structure
+ * @return the error status
+ */
+
+
+int lensing_lensed_cl_tt(
+                         double *ksi,
+                         double **d00,
+                         double *w8,
+                         int index_mu_start,
+                         int index_mu_end,
+                         double * sum,
+                         struct lensing * ple
+                         ) {
+
+  /** Integration by Gauss-Legendre quadrature. **/
+  class_setup_parallel();
+
+  class_label_parallel("lensing:lensed_cl_tt",0);
+  class_parallel_for(index_l,0,ple->l_size,0,=,
+      double cle;
+      int imu;
+      cle=sum[index_l];
+      for (imu=index_mu_start;imu<index_mu_end;imu++) {
+        cle += ksi[imu]*d00[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
+      }
+      sum[index_l]=cle;
+      ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt]=cle*2.0*_PI_;
+      return _SUCCESS_;
+    );
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine adds back the unlensed \f$ cl_{tt}\f$ power spectrum
+ * Used in case of fast (and BB inaccurate) integration of
+ * correlation functions.
+ *
+ * @param ple   Input/output: Pointer to the lensing structure
+ * @param cl_tt Input: Array of unlensed power spectrum
+ * @return the error status
+ */
+
+int lensing_addback_cl_tt(
+                          struct lensing * ple,
+                          double *cl_tt) {
+  int index_l, l;
+
+  for (index_l=0; index_l<ple->l_size; index_l++) {
+    l = (int)ple->l[index_l];
     ple->cl_lens[index_l*ple->lt_size+ple->index_lt_tt] += cl_tt[l];
   }
   return _SUCCESS_;
@@ -1101,12 +1850,15 @@ int lensing_addback_cl_tt(
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine adds the contribution of one block of quadrature
+ * points to the lensed power spectra, computed by Gaussian quadrature
  *
  * @param ksiX Input: Lensed correlation function (ksiX[index_mu])
  * @param d20  Input: Wigner d-function (\f$ d^l_{20}\f$[l][index_mu])
  * @param w8   Input: Legendre quadrature weights (w8[index_mu])
- * @param nmu  Input: Number of quadrature points (0<=index_mu<=nmu)
+ * @param index_mu_start Input: first quadrature point of this block
+ * @param index_mu_end   Input: last quadrature point of this block plus one
+ * @param sum  Input/output: sums over the quadrature points of the previous blocks, set to zero before the first block (sum[index_l])
  * @param ple  Input/output: Pointer to the lensing structure
  * @return the error status
  */
@@ -1116,27 +1868,27 @@ int lensing_lensed_cl_te(
                          double *ksiX,
                          double **d20,
                          double *w8,
-                         int nmu,
+                         int index_mu_start,
+                         int index_mu_end,
+                         double * sum,
                          struct lensing * ple
                          ) {
 
-  int index_l;
-
   /** Integration by Gauss-Legendre quadrature. **/
   class_setup_parallel();
 
-  for (index_l=0; index_l < ple->l_size; index_l++){
-    class_run_parallel(=,
+  class_label_parallel("lensing:lensed_cl_te",0);
+  class_parallel_for(index_l,0,ple->l_size,0,=,
       double clte;
       int imu;
-      clte=0;
-      for (imu=0;imu<nmu;imu++) {
+      clte=sum[index_l];
+      for (imu=index_mu_start;imu<index_mu_end;imu++) {
         clte += ksiX[imu]*d20[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
       }
+      sum[index_l]=clte;
       ple->cl_lens[index_l*ple->lt_size+ple->index_lt_te]=clte*2.0*_PI_;
       return _SUCCESS_;
     );
-  }
 
   class_finish_parallel();
   return _SUCCESS_;
@@ -1166,14 +1918,17 @@ int lensing_addback_cl_te(
 }
 
 /**
- * This routine computes the lensed power spectra by Gaussian quadrature
+ * This routine adds the contribution of one block of quadrature
+ * points to the lensed power spectra, computed by Gaussian quadrature
  *
  * @param ksip Input: Lensed correlation function (ksi+[index_mu])
  * @param ksim Input: Lensed correlation function (ksi-[index_mu])
  * @param d22  Input: Wigner d-function (\f$ d^l_{22}\f$[l][index_mu])
  * @param d2m2 Input: Wigner d-function (\f$ d^l_{2-2}\f$[l][index_mu])
  * @param w8   Input: Legendre quadrature weights (w8[index_mu])
- * @param nmu  Input: Number of quadrature points (0<=index_mu<=nmu)
+ * @param index_mu_start Input: first quadrature point of this block
+ * @param index_mu_end   Input: last quadrature point of this block plus one
+ * @param sum  Input/output: sums over the quadrature points of the previous blocks, set to zero before the first block (sum[2*index_l] for ksi+, sum[2*index_l+1] for ksi-)
  * @param ple  Input/output: Pointer to the lensing structure
  * @return the error status
  */
@@ -1185,59 +1940,462 @@ int lensing_lensed_cl_ee_bb(
                             double **d22,
                             double **d2m2,
                             double *w8,
-                            int nmu,
+                            int index_mu_start,
+                            int index_mu_end,
+                            double * sum,
                             struct lensing * ple
                             ) {
 
-  int index_l;
-
   class_setup_parallel();
   /** Integration by Gauss-Legendre quadrature. **/
-  for (index_l=0; index_l < ple->l_size; index_l++){
-    class_run_parallel(=,
+  class_label_parallel("lensing:lensed_cl_ee_bb",0);
+  class_parallel_for(index_l,0,ple->l_size,0,=,
       double clp;
       double clm;
       int imu;
-      clp=0; clm=0;
-      for (imu=0;imu<nmu;imu++) {
+      clp=sum[2*index_l]; clm=sum[2*index_l+1];
+      for (imu=index_mu_start;imu<index_mu_end;imu++) {
         clp += ksip[imu]*d22[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
         clm += ksim[imu]*d2m2[imu][(int)ple->l[index_l]]*w8[imu]; /* loop could be optimized */
       }
+      sum[2*index_l]=clp;
+      sum[2*index_l+1]=clm;
       ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee]=(clp+clm)*_PI_;
       ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb]=(clp-clm)*_PI_;
       return _SUCCESS_;
     );
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine adds back the unlensed \f$ cl_{ee}\f$, \f$ cl_{bb}\f$ power spectra
+ * Used in case of fast (and BB inaccurate) integration of
+ * correlation functions.
+ *
+ * @param ple   Input/output: Pointer to the lensing structure
+ * @param cl_ee Input: Array of unlensed power spectrum
+ * @param cl_bb Input: Array of unlensed power spectrum
+ * @return the error status
+ */
+
+int lensing_addback_cl_ee_bb(
+                             struct lensing * ple,
+                             double * cl_ee,
+                             double * cl_bb) {
+
+  int index_l, l;
+
+  for (index_l=0; index_l<ple->l_size; index_l++) {
+    l = (int)ple->l[index_l];
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] += cl_ee[l];
+    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] += cl_bb[l];
+  }
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine computes the prefactors of the recurrences of all
+ * tables of \f$ d^l_{mm'}(\mu) \f$, for 2 <= l < lmax (1 <= l < lmax
+ * for d00). There is one set of four arrays per group of tables:
+ * fac[(index_group*4+index_fac)*lmax+l] (see lensing_dxx_lanes()).
+ * The tables \f$ d^l_{mm'} \f$ and \f$ d^l_{m-m'} \f$ share the same
+ * group, since only the sign of the shift of \f$ \mu \f$ differs.
+ *
+ * @param lmax Input: maximum multipole
+ * @param fac  Output: prefactors
+ * @return the error status
+ */
+
+int lensing_dxx_prefactors(
+                           int lmax,
+                           double * fac
+                           ) {
+
+  double ll;
+  int l;
+  double * fac1;
+  double * fac2;
+  double * fac3;
+  double * fac4;
+
+#define _LENSING_DXX_FAC_(index_group)          \
+  fac1 = fac+(4*(index_group))*(size_t)lmax;    \
+  fac2 = fac1+lmax;                             \
+  fac3 = fac2+lmax;                             \
+  fac4 = fac3+lmax;
+
+  /* d00: the coefficient of dlm1 is stored in fac3 */
+  _LENSING_DXX_FAC_(0);
+  for (l=1; l<lmax; l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(2*ll+1)/(ll+1);
+    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*ll/(ll+1);
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d11, d1m1 */
+  _LENSING_DXX_FAC_(1);
+  for (l=2;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/(ll*(ll+2));
+    fac2[l] = 1.0/(ll*(ll+1.));
+    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-1)*(ll+1)/(ll*(ll+2))*(ll+1)/ll;
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d22, d2m2 */
+  _LENSING_DXX_FAC_(2);
+  for (l=2;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/((ll-1)*(ll+3));
+    fac2[l] = 4.0/(ll*(ll+1));
+    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-2)*(ll+2)/((ll-1)*(ll+3))*(ll+1)/ll;
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d20 */
+  _LENSING_DXX_FAC_(3);
+  for (l=2;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-1)*(ll+3)));
+    fac3[l] = sqrt((2*ll+3)*(ll-2)*(ll+2)/((2*ll-1)*(ll-1)*(ll+3)));
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d31, d3m1 */
+  _LENSING_DXX_FAC_(4);
+  for (l=3;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-2)*(ll+4)*ll*(ll+2))) * (ll+1);
+    fac2[l] = 3.0/(ll*(ll+1));
+    fac3[l] = sqrt((2*ll+3)/(2*ll-1)*(ll-3)*(ll+3)*(ll-1)*(ll+1)/((ll-2)*(ll+4)*ll*(ll+2)))*(ll+1)/ll;
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d3m3 */
+  _LENSING_DXX_FAC_(5);
+  for (l=3;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)*(2*ll+1))*(ll+1)/((ll-2)*(ll+4));
+    fac2[l] = 9.0/(ll*(ll+1));
+    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-3)*(ll+3)*(l+1)/((ll-2)*(ll+4)*ll);
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d40 */
+  _LENSING_DXX_FAC_(6);
+  for (l=4;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-3)*(ll+5)));
+    fac3[l] = sqrt((2*ll+3)*(ll-4)*(ll+4)/((2*ll-1)*(ll-3)*(ll+5)));
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d4m2 */
+  _LENSING_DXX_FAC_(7);
+  for (l=4;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-3)*(ll+5)*(ll-1)*(ll+3))) * (ll+1.);
+    fac2[l] = 8./(ll*(ll+1));
+    fac3[l] = sqrt((2*ll+3)*(ll-4)*(ll+4)*(ll-2)*(ll+2)/((2*ll-1)*(ll-3)*(ll+5)*(ll-1)*(ll+3)))*(ll+1)/ll;
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+  /* d4m4 */
+  _LENSING_DXX_FAC_(8);
+  for (l=4;l<lmax;l++) {
+    ll = (double) l;
+    fac1[l] = sqrt((2*ll+3)*(2*ll+1))*(ll+1)/((ll-3)*(ll+5));
+    fac2[l] = 16./(ll*(ll+1));
+    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-4)*(ll+4)*(ll+1)/((ll-3)*(ll+5)*ll);
+    fac4[l] = sqrt(2./(2*ll+3));
+  }
+
+#undef _LENSING_DXX_FAC_
+
+  return _SUCCESS_;
+}
+
+/**
+ * Recurrence on \f$ \sqrt{(2l+1)/2} d^l_{mm'} \f$ from l_start to
+ * lmax, for _LENSING_DXX_LANES_ values of \f$ \mu \f$ at once (the
+ * first num_lanes ones are stored). The shift of \f$ \mu \f$ is
+ * \f$ -m m'/(l(l+1)) \f$ for shift < 0, \f$ +|m m'|/(l(l+1)) \f$ for
+ * shift > 0 and zero for m'=0. With has_mirror, the table \f$
+ * d^l_{m-m'} \f$ (shift > 0) is computed in the same pass, sharing
+ * the reads of the prefactors.
+ *
+ * Each value of \f$ \mu \f$ goes through exactly the same
+ * operations as in a scalar loop, the lanes only expose independent
+ * recurrences to the compiler.
+ */
+
+template <int shift, bool has_mirror>
+_CLASS_TARGET_CLONES_
+static void lensing_dxx_recurrence(
+                                   const double * mu,
+                                   int num_lanes,
+                                   int l_start,
+                                   int lmax,
+                                   const double * fac,
+                                   const double * dlm1_start,
+                                   const double * dl_start,
+                                   double ** d,
+                                   const double * dlm1_start_mirror,
+                                   const double * dl_start_mirror,
+                                   double ** d_mirror
+                                   ) {
+
+  const double * fac1 = fac;
+  const double * fac2 = fac1+lmax;
+  const double * fac3 = fac2+lmax;
+  const double * fac4 = fac3+lmax;
+  double dlm1[_LENSING_DXX_LANES_], dl[_LENSING_DXX_LANES_], out[_LENSING_DXX_LANES_];
+  double dlm1_m[_LENSING_DXX_LANES_], dl_m[_LENSING_DXX_LANES_], out_m[_LENSING_DXX_LANES_];
+  double f1, f2, f3, f4, dlp1;
+  int l, i;
+
+  for (i=0; i<_LENSING_DXX_LANES_; i++) {
+    dlm1[i] = dlm1_start[i];
+    dl[i] = dl_start[i];
+    if (has_mirror) {
+      dlm1_m[i] = dlm1_start_mirror[i];
+      dl_m[i] = dl_start_mirror[i];
+    }
+  }
+
+  for (l=l_start; l<lmax; l++) {
+
+    f1 = fac1[l];
+    f2 = (shift != 0) ? fac2[l] : 0.;
+    f3 = fac3[l];
+    f4 = fac4[l];
+
+    for (i=0; i<_LENSING_DXX_LANES_; i++) {
+      if (shift < 0)
+        dlp1 = f1*(mu[i]-f2)*dl[i] - f3*dlm1[i];
+      else if (shift > 0)
+        dlp1 = f1*(mu[i]+f2)*dl[i] - f3*dlm1[i];
+      else
+        dlp1 = f1*mu[i]*dl[i] - f3*dlm1[i];
+      out[i] = dlp1 * f4;
+      dlm1[i] = dl[i];
+      dl[i] = dlp1;
+      if (has_mirror) {
+        dlp1 = f1*(mu[i]+f2)*dl_m[i] - f3*dlm1_m[i];
+        out_m[i] = dlp1 * f4;
+        dlm1_m[i] = dl_m[i];
+        dl_m[i] = dlp1;
+      }
+    }
+
+    for (i=0; i<num_lanes; i++) {
+      d[i][l+1] = out[i];
+      if (has_mirror)
+        d_mirror[i][l+1] = out_m[i];
+    }
+  }
+}
+
+/**
+ * This routine computes the requested tables of \f$ d^l_{mm'}(\mu)
+ * \f$ for up to _LENSING_DXX_LANES_ consecutive values of \f$ \mu \f$:
+ * starting values at l_start-1 and l_start, then one pass of
+ * lensing_dxx_recurrence() per group of tables.
+ *
+ * @param mu        Input: values of \f$ \mu \f$
+ * @param num_lanes Input: number of values of \f$ \mu \f$ (at most _LENSING_DXX_LANES_)
+ * @param lmax      Input: maximum multipole
+ * @param fac       Input: prefactors from lensing_dxx_prefactors()
+ * @param dxx       Input/output: rows of the tables, dxx[index_d][index_mu][l] in the order
+ *                  d00, d11, d1m1, d2m2, d20, d3m1, d4m2, d22, d31, d3m3, d40, d4m4 (NULL if not requested)
+ * @return the error status
+ */
+
+int lensing_dxx_lanes(
+                      double * mu,
+                      int num_lanes,
+                      int lmax,
+                      double * fac,
+                      double *** dxx
+                      ) {
+
+  /* for each table: first multipole of the recurrence, group of
+     prefactors, sign of the shift of mu, table with the opposite
+     shift computed in the same pass, and conversely */
+  const int l_start[12] = {1, 2, 2, 2, 2, 3, 4, 2, 3, 3, 4, 4};
+  const int index_group[12] = {0, 1, 1, 2, 3, 4, 7, 2, 4, 5, 6, 8};
+  const int shift[12] = {0, -1, 1, 1, 0, 1, 1, -1, -1, 1, 0, 1};
+  const int index_mirror[12] = {-1, 2, -1, -1, -1, -1, -1, 3, 5, -1, -1, -1};
+  const int mirror_of[12] = {-1, -1, 1, 7, -1, 8, -1, -1, -1, -1, -1, -1};
+
+  double x[_LENSING_DXX_LANES_];
+  double dlm1[12][_LENSING_DXX_LANES_];
+  double dl[12][_LENSING_DXX_LANES_];
+  double * fac_d;
+  int index_d, i, l;
+
+  /* pad with the last value of mu, the extra lanes are not stored */
+  for (i=0; i<_LENSING_DXX_LANES_; i++)
+    x[i] = mu[MIN(i,num_lanes-1)];
+
+  /** - starting values of \f$ \sqrt{(2l+1)/2} d^l_{mm'} \f$ at l_start-1 and l_start */
+
+  for (i=0; i<_LENSING_DXX_LANES_; i++) {
+
+    dlm1[0][i]=1.0/sqrt(2.); /* l=0 */
+    dl[0][i]=x[i] * sqrt(3./2.); /*l=1*/
+
+    dlm1[1][i]=(1.0+x[i])/2. * sqrt(3./2.); /*l=1*/
+    dl[1][i]=(1.0+x[i])/2.*(2.0*x[i]-1.0) * sqrt(5./2.); /*l=2*/
+
+    dlm1[2][i]=(1.0-x[i])/2. * sqrt(3./2.); /*l=1*/
+    dl[2][i]=(1.0-x[i])/2.*(2.0*x[i]+1.0) * sqrt(5./2.); /*l=2*/
+
+    dlm1[3][i]=0.; /*l=1*/
+    dl[3][i]=(1.0-x[i])*(1.0-x[i])/4. * sqrt(5./2.); /*l=2*/
+
+    dlm1[4][i]=0.; /*l=1*/
+    dl[4][i]=sqrt(15.)/4.*(1-x[i]*x[i]); /*l=2*/
+
+    dlm1[5][i]=0.; /*l=2*/
+    dl[5][i]=sqrt(105./2.)*(1+x[i])*(1-x[i])*(1-x[i])/8.; /*l=3*/
+
+    dlm1[6][i]=0.; /*l=3*/
+    dl[6][i]=sqrt(126.)*(1+x[i])*(1-x[i])*(1-x[i])*(1-x[i])/16.; /*l=4*/
+
+    dlm1[7][i]=0.; /*l=1*/
+    dl[7][i]=(1.0+x[i])*(1.0+x[i])/4. * sqrt(5./2.); /*l=2*/
+
+    dlm1[8][i]=0.; /*l=2*/
+    dl[8][i]=sqrt(105./2.)*(1+x[i])*(1+x[i])*(1-x[i])/8.; /*l=3*/
+
+    dlm1[9][i]=0.; /*l=2*/
+    dl[9][i]=sqrt(7./2.)*(1-x[i])*(1-x[i])*(1-x[i])/8.; /*l=3*/
+
+    dlm1[10][i]=0.; /*l=3*/
+    dl[10][i]=sqrt(315.)*(1+x[i])*(1+x[i])*(1-x[i])*(1-x[i])/16.; /*l=4*/
+
+    dlm1[11][i]=0.; /*l=3*/
+    dl[11][i]=sqrt(9./2.)*(1-x[i])*(1-x[i])*(1-x[i])*(1-x[i])/16.; /*l=4*/
+  }
+
+  for (index_d=0; index_d<12; index_d++) {
+    if (dxx[index_d] == NULL)
+      continue;
+    for (i=0; i<num_lanes; i++) {
+      for (l=0; l<l_start[index_d]-1; l++)
+        dxx[index_d][i][l] = 0;
+      dxx[index_d][i][l_start[index_d]-1] = dlm1[index_d][i] * sqrt(2./(2*l_start[index_d]-1));
+      dxx[index_d][i][l_start[index_d]] = dl[index_d][i] * sqrt(2./(2*l_start[index_d]+1));
+    }
+  }
+
+  /** - recurrences, computing \f$ d^l_{mm'} \f$ and \f$ d^l_{m-m'} \f$ in the same pass when both are requested */
+
+  for (index_d=0; index_d<12; index_d++) {
+
+    if (dxx[index_d] == NULL)
+      continue;
+
+    /* d1m1, d2m2, d3m1 are computed together with d11, d22, d31 when these are also requested */
+    if ((mirror_of[index_d] >= 0) && (dxx[mirror_of[index_d]] != NULL))
+      continue;
+
+    fac_d = fac+4*index_group[index_d]*(size_t)lmax;
+
+    if ((index_mirror[index_d] >= 0) && (dxx[index_mirror[index_d]] != NULL))
+      lensing_dxx_recurrence<-1,true>(x,num_lanes,l_start[index_d],lmax,fac_d,
+                                      dlm1[index_d],dl[index_d],dxx[index_d],
+                                      dlm1[index_mirror[index_d]],dl[index_mirror[index_d]],dxx[index_mirror[index_d]]);
+    else if (shift[index_d] < 0)
+      lensing_dxx_recurrence<-1,false>(x,num_lanes,l_start[index_d],lmax,fac_d,
+                                       dlm1[index_d],dl[index_d],dxx[index_d],NULL,NULL,NULL);
+    else if (shift[index_d] > 0)
+      lensing_dxx_recurrence<1,false>(x,num_lanes,l_start[index_d],lmax,fac_d,
+                                      dlm1[index_d],dl[index_d],dxx[index_d],NULL,NULL,NULL);
+    else
+      lensing_dxx_recurrence<0,false>(x,num_lanes,l_start[index_d],lmax,fac_d,
+                                      dlm1[index_d],dl[index_d],dxx[index_d],NULL,NULL,NULL);
   }
-  class_finish_parallel();
 
   return _SUCCESS_;
 }
 
 /**
- * This routine adds back the unlensed \f$ cl_{ee}\f$, \f$ cl_{bb}\f$ power spectra
- * Used in case of fast (and BB inaccurate) integration of
- * correlation functions.
+ * This routine computes the requested tables of \f$ d^l_{mm'}(\mu) \f$
+ * (the other arguments are NULL), for all values of \f$ \mu \f$, in
+ * one parallel region: each task handles _LENSING_DXX_LANES_
+ * consecutive values of \f$ \mu \f$ with lensing_dxx_lanes().
  *
- * @param ple   Input/output: Pointer to the lensing structure
- * @param cl_ee Input: Array of unlensed power spectrum
- * @param cl_bb Input: Array of unlensed power spectrum
+ * @param mu     Input: Vector of cos(beta) values
+ * @param num_mu Input: Number of cos(beta) values
+ * @param lmax   Input: maximum multipole
+ * @param d00    Input/output: rows of \f$ d^l_{00}\f$ (d00[index_mu][l]), or NULL; and similarly for the other tables
+ * @param d11    Input/output: rows of \f$ d^l_{11}\f$, or NULL
+ * @param d1m1   Input/output: rows of \f$ d^l_{1-1}\f$, or NULL
+ * @param d2m2   Input/output: rows of \f$ d^l_{2-2}\f$, or NULL
+ * @param d20    Input/output: rows of \f$ d^l_{20}\f$, or NULL
+ * @param d3m1   Input/output: rows of \f$ d^l_{3-1}\f$, or NULL
+ * @param d4m2   Input/output: rows of \f$ d^l_{4-2}\f$, or NULL
+ * @param d22    Input/output: rows of \f$ d^l_{22}\f$, or NULL
+ * @param d31    Input/output: rows of \f$ d^l_{31}\f$, or NULL
+ * @param d3m3   Input/output: rows of \f$ d^l_{3-3}\f$, or NULL
+ * @param d40    Input/output: rows of \f$ d^l_{40}\f$, or NULL
+ * @param d4m4   Input/output: rows of \f$ d^l_{4-4}\f$, or NULL
  * @return the error status
- */
+ *
+ * Wigner d-functions, computed by recurrence
+ * actual recurrence on \f$ \sqrt{(2l+1)/2} d^l_{mm'} \f$ for stability
+ * Formulae from Kostelec & Rockmore 2003
+ **/
 
-int lensing_addback_cl_ee_bb(
-                             struct lensing * ple,
-                             double * cl_ee,
-                             double * cl_bb) {
+int lensing_dxx(
+                double * mu,
+                int num_mu,
+                int lmax,
+                double ** d00,
+                double ** d11,
+                double ** d1m1,
+                double ** d2m2,
+                double ** d20,
+                double ** d3m1,
+                double ** d4m2,
+                double ** d22,
+                double ** d31,
+                double ** d3m3,
+                double ** d40,
+                double ** d4m4
+                ) {
 
-  int index_l, l;
+  double ** dxx[12] = {
+    d00, d11, d1m1, d2m2,
+    d20, d3m1, d4m2,
+    d22, d31, d3m3, d40, d4m4};
+  double * fac;
+  ErrorMsg erreur;
 
-  for (index_l=0; index_l<ple->l_size; index_l++) {
-    l = (int)ple->l[index_l];
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_ee] += cl_ee[l];
-    ple->cl_lens[index_l*ple->lt_size+ple->index_lt_bb] += cl_bb[l];
-  }
-  return _SUCCESS_;
+  class_alloc(fac,36*(size_t)lmax*sizeof(double),erreur);
 
+  lensing_dxx_prefactors(lmax,fac);
+
+  class_setup_parallel();
+  /* one index per group of _LENSING_DXX_LANES_ values of mu */
+  class_label_parallel("lensing:dxx",0);
+  class_parallel_for(index_lanes,0,(num_mu+_LENSING_DXX_LANES_-1)/_LENSING_DXX_LANES_,0,=,
+      double ** rows[12];
+      int index_d;
+      int index_mu = index_lanes*_LENSING_DXX_LANES_;
+      for (index_d=0; index_d<12; index_d++)
+        rows[index_d] = (dxx[index_d] == NULL) ? NULL : dxx[index_d]+index_mu;
+      return lensing_dxx_lanes(mu+index_mu,MIN(_LENSING_DXX_LANES_,num_mu-index_mu),lmax,fac,rows);
+    );
+  class_finish_parallel();
+  free(fac);
+  return _SUCCESS_;
 }
 
 /**
@@ -1259,43 +2417,7 @@ int lensing_d00(
                 int lmax,
                 double ** d00
                 ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3;
-  ErrorMsg erreur;
-
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  for (l=1; l<lmax; l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(2*ll+1)/(ll+1);
-    fac2[l] = sqrt((2*ll+3)/(2*ll-1))*ll/(ll+1);
-    fac3[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      int l;
-      dlm1=1.0/sqrt(2.); /* l=0 */
-      d00[index_mu][0]=dlm1*sqrt(2.);
-      dl=mu[index_mu] * sqrt(3./2.); /*l=1*/
-      d00[index_mu][1]=dl*sqrt(2./3.);
-      for (l=1;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d00 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*mu[index_mu]*dl - fac2[l]*dlm1;
-        d00[index_mu][l+1] = dlp1 * fac3[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,d00,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);
 }
 
 
@@ -1318,45 +2440,7 @@ int lensing_d11(
                 int lmax,
                 double ** d11
                 ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=2;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/(ll*(ll+2));
-    fac2[l] = 1.0/(ll*(ll+1.));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-1)*(ll+1)/(ll*(ll+2))*(ll+1)/ll;
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d11[index_mu][0]=0;
-      dlm1=(1.0+mu[index_mu])/2. * sqrt(3./2.); /*l=1*/
-      d11[index_mu][1]=dlm1 * sqrt(2./3.);
-      dl=(1.0+mu[index_mu])/2.*(2.0*mu[index_mu]-1.0) * sqrt(5./2.); /*l=2*/
-      d11[index_mu][2] = dl * sqrt(2./5.);
-      for (l=2;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d11 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]-fac2[l])*dl - fac3[l]*dlm1;
-        d11[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,d11,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);
 }
 
 /**
@@ -1378,44 +2462,7 @@ int lensing_d1m1(
                  int lmax,
                  double ** d1m1
                  ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=2;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/(ll*(ll+2));
-    fac2[l] = 1.0/(ll*(ll+1.));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-1)*(ll+1)/(ll*(ll+2))*(ll+1)/ll;
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d1m1[index_mu][0]=0;
-      dlm1=(1.0-mu[index_mu])/2. * sqrt(3./2.); /*l=1*/
-      d1m1[index_mu][1]=dlm1 * sqrt(2./3.);
-      dl=(1.0-mu[index_mu])/2.*(2.0*mu[index_mu]+1.0) * sqrt(5./2.); /*l=2*/
-      d1m1[index_mu][2] = dl * sqrt(2./5.);
-      for (l=2;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d1m1 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]+fac2[l])*dl - fac3[l]*dlm1;
-        d1m1[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,d1m1,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);
 }
 
 /**
@@ -1437,45 +2484,7 @@ int lensing_d2m2(
                  int lmax,
                  double ** d2m2
                  ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=2;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/((ll-1)*(ll+3));
-    fac2[l] = 4.0/(ll*(ll+1));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-2)*(ll+2)/((ll-1)*(ll+3))*(ll+1)/ll;
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d2m2[index_mu][0]=0;
-      dlm1=0.; /*l=1*/
-      d2m2[index_mu][1]=0;
-      dl=(1.0-mu[index_mu])*(1.0-mu[index_mu])/4. * sqrt(5./2.); /*l=2*/
-      d2m2[index_mu][2] = dl * sqrt(2./5.);
-      for (l=2;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d2m2 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]+fac2[l])*dl - fac3[l]*dlm1;
-        d2m2[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,d2m2,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL);
 }
 
 /**
@@ -1497,45 +2506,7 @@ int lensing_d22(
                 int lmax,
                 double ** d22
                 ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=2;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)/(2*ll+1))*(ll+1)*(2*ll+1)/((ll-1)*(ll+3));
-    fac2[l] = 4.0/(ll*(ll+1));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-2)*(ll+2)/((ll-1)*(ll+3))*(ll+1)/ll;
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d22[index_mu][0]=0;
-      dlm1=0.; /*l=1*/
-      d22[index_mu][1]=0;
-      dl=(1.0+mu[index_mu])*(1.0+mu[index_mu])/4. * sqrt(5./2.); /*l=2*/
-      d22[index_mu][2] = dl * sqrt(2./5.);
-      for (l=2;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]-fac2[l])*dl - fac3[l]*dlm1;
-        d22[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,NULL,NULL,NULL,d22,NULL,NULL,NULL,NULL);
 }
 
 /**
@@ -1557,43 +2528,7 @@ int lensing_d20(
                 int lmax,
                 double ** d20
                 ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=2;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-1)*(ll+3)));
-    fac3[l] = sqrt((2*ll+3)*(ll-2)*(ll+2)/((2*ll-1)*(ll-1)*(ll+3)));
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d20[index_mu][0]=0;
-      dlm1=0.; /*l=1*/
-      d20[index_mu][1]=0;
-      dl=sqrt(15.)/4.*(1-mu[index_mu]*mu[index_mu]); /*l=2*/
-      d20[index_mu][2] = dl * sqrt(2./5.);
-      for (l=2;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*mu[index_mu]*dl - fac3[l]*dlm1;
-        d20[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,d20,NULL,NULL,NULL,NULL,NULL,NULL,NULL);
 }
 
 /**
@@ -1615,46 +2550,7 @@ int lensing_d31(
                 int lmax,
                 double ** d31
                 ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=3;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-2)*(ll+4)*ll*(ll+2))) * (ll+1);
-    fac2[l] = 3.0/(ll*(ll+1));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1)*(ll-3)*(ll+3)*(ll-1)*(ll+1)/((ll-2)*(ll+4)*ll*(ll+2)))*(ll+1)/ll;
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d31[index_mu][0]=0;
-      d31[index_mu][1]=0;
-      dlm1=0.; /*l=2*/
-      d31[index_mu][2]=0;
-      dl=sqrt(105./2.)*(1+mu[index_mu])*(1+mu[index_mu])*(1-mu[index_mu])/8.; /*l=3*/
-      d31[index_mu][3] = dl * sqrt(2./7.);
-      for (l=3;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]-fac2[l])*dl - fac3[l]*dlm1;
-        d31[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,d31,NULL,NULL,NULL);
 }
 
 /**
@@ -1676,46 +2572,7 @@ int lensing_d3m1(
                  int lmax,
                  double ** d3m1
                  ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=3;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-2)*(ll+4)*ll*(ll+2))) * (ll+1);
-    fac2[l] = 3.0/(ll*(ll+1));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1)*(ll-3)*(ll+3)*(ll-1)*(ll+1)/((ll-2)*(ll+4)*ll*(ll+2)))*(ll+1)/ll;
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d3m1[index_mu][0]=0;
-      d3m1[index_mu][1]=0;
-      dlm1=0.; /*l=2*/
-      d3m1[index_mu][2]=0;
-      dl=sqrt(105./2.)*(1+mu[index_mu])*(1-mu[index_mu])*(1-mu[index_mu])/8.; /*l=3*/
-      d3m1[index_mu][3] = dl * sqrt(2./7.);
-      for (l=3;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]+fac2[l])*dl - fac3[l]*dlm1;
-        d3m1[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,NULL,d3m1,NULL,NULL,NULL,NULL,NULL,NULL);
 }
 
 /**
@@ -1737,46 +2594,7 @@ int lensing_d3m3(
                  int lmax,
                  double ** d3m3
                  ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=3;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)*(2*ll+1))*(ll+1)/((ll-2)*(ll+4));
-    fac2[l] = 9.0/(ll*(ll+1));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-3)*(ll+3)*(l+1)/((ll-2)*(ll+4)*ll);
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d3m3[index_mu][0]=0;
-      d3m3[index_mu][1]=0;
-      dlm1=0.; /*l=2*/
-      d3m3[index_mu][2]=0;
-      dl=sqrt(7./2.)*(1-mu[index_mu])*(1-mu[index_mu])*(1-mu[index_mu])/8.; /*l=3*/
-      d3m3[index_mu][3] = dl * sqrt(2./7.);
-      for (l=3;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]+fac2[l])*dl - fac3[l]*dlm1;
-        d3m3[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,d3m3,NULL,NULL);
 }
 
 /**
@@ -1798,45 +2616,7 @@ int lensing_d40(
                 int lmax,
                 double ** d40
                 ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=4;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-3)*(ll+5)));
-    fac3[l] = sqrt((2*ll+3)*(ll-4)*(ll+4)/((2*ll-1)*(ll-3)*(ll+5)));
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d40[index_mu][0]=0;
-      d40[index_mu][1]=0;
-      d40[index_mu][2]=0;
-      dlm1=0.; /*l=3*/
-      d40[index_mu][3]=0;
-      dl=sqrt(315.)*(1+mu[index_mu])*(1+mu[index_mu])*(1-mu[index_mu])*(1-mu[index_mu])/16.; /*l=4*/
-      d40[index_mu][4] = dl * sqrt(2./9.);
-      for (l=4;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*mu[index_mu]*dl - fac3[l]*dlm1;
-        d40[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,d40,NULL);
 }
 
 /**
@@ -1858,47 +2638,7 @@ int lensing_d4m2(
                  int lmax,
                  double ** d4m2
                  ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=4;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)*(2*ll+1)/((ll-3)*(ll+5)*(ll-1)*(ll+3))) * (ll+1.);
-    fac2[l] = 8./(ll*(ll+1));
-    fac3[l] = sqrt((2*ll+3)*(ll-4)*(ll+4)*(ll-2)*(ll+2)/((2*ll-1)*(ll-3)*(ll+5)*(ll-1)*(ll+3)))*(ll+1)/ll;
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d4m2[index_mu][0]=0;
-      d4m2[index_mu][1]=0;
-      d4m2[index_mu][2]=0;
-      dlm1=0.; /*l=3*/
-      d4m2[index_mu][3]=0;
-      dl=sqrt(126.)*(1+mu[index_mu])*(1-mu[index_mu])*(1-mu[index_mu])*(1-mu[index_mu])/16.; /*l=4*/
-      d4m2[index_mu][4] = dl * sqrt(2./9.);
-      for (l=4;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]+fac2[l])*dl - fac3[l]*dlm1;
-        d4m2[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,NULL,NULL,d4m2,NULL,NULL,NULL,NULL,NULL);
 }
 
 /**
@@ -1920,45 +2660,5 @@ int lensing_d4m4(
                  int lmax,
                  double ** d4m4
                  ) {
-  double ll;
-  int index_mu, l;
-  double *fac1, *fac2, *fac3, *fac4;
-  ErrorMsg erreur;
-  class_alloc(fac1,lmax*sizeof(double),erreur);
-  class_alloc(fac2,lmax*sizeof(double),erreur);
-  class_alloc(fac3,lmax*sizeof(double),erreur);
-  class_alloc(fac4,lmax*sizeof(double),erreur);
-  for (l=4;l<lmax;l++) {
-    ll = (double) l;
-    fac1[l] = sqrt((2*ll+3)*(2*ll+1))*(ll+1)/((ll-3)*(ll+5));
-    fac2[l] = 16./(ll*(ll+1));
-    fac3[l] = sqrt((2*ll+3)/(2*ll-1))*(ll-4)*(ll+4)*(ll+1)/((ll-3)*(ll+5)*ll);
-    fac4[l] = sqrt(2./(2*ll+3));
-  }
-
-  class_setup_parallel();
-  for (index_mu=0;index_mu<num_mu;index_mu++) {
-    class_run_parallel(=,
-      int l;
-      double declare_list_of_variables_inside_parallel_region(dlm1, dl, dlp1);
-      d4m4[index_mu][0]=0;
-      d4m4[index_mu][1]=0;
-      d4m4[index_mu][2]=0;
-      dlm1=0.; /*l=3*/
-      d4m4[index_mu][3]=0;
-      dl=sqrt(9./2.)*(1-mu[index_mu])*(1-mu[index_mu])*(1-mu[index_mu])*(1-mu[index_mu])/16.; /*l=4*/
-      d4m4[index_mu][4] = dl * sqrt(2./9.);
-      for (l=4;l<lmax;l++){
-        /* sqrt((2l+1)/2)*d22 recurrence, supposed to be more stable */
-        dlp1 = fac1[l]*(mu[index_mu]+fac2[l])*dl - fac3[l]*dlm1;
-        d4m4[index_mu][l+1] = dlp1 * fac4[l];
-        dlm1 = dl;
-        dl = dlp1;
-      }
-      return _SUCCESS_;
-    );
-  }
-  class_finish_parallel();
-  free(fac1); free(fac2); free(fac3); free(fac4);
-  return _SUCCESS_;
+  return lensing_dxx(mu,num_mu,lmax,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,d4m4);
 }
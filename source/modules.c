@@ -0,0 +1,251 @@
+/** @file modules.c Running the init functions of all modules
+ *
+ * The modules are usually initialized one after the other, in the order
+ * background, thermodynamics, perturbations, primordial, fourier,
+ * transfer, harmonic, lensing, distortions. Several of them are however
+ * independent: transfer only needs fourier for the non-linear corrections
+ * of its sources, and neither fourier, nor distortions, is needed by
+ * the following modules. modules_init() runs each module as soon as the
+ * modules it depends on are done, as a task of the pool of the calling
+ * thread, such that independent modules run concurrently (each of them
+ * sending its own parallel regions to the same pool).
+ *
+ * The following functions can be called from other modules:
+ *
+ * -# modules_init() in place of the successive calls to the init functions
+ * -# modules_dependencies() for the modules needed by a given one
+ */
+
+#include "modules.h"
+#include "parallel.h"
+#include <atomic>
+#include <functional>
+
+/**
+ * Modules whose results are needed by a given module.
+ *
+ * @param pfo          Input: pointer to fourier structure (after input_init())
+ * @param index_module Input: index of the module
+ * @return the flags (1 << module_xxx) of the modules needed by this one
+ */
+
+unsigned int modules_dependencies(
+                                  struct fourier * pfo,
+                                  int index_module
+                                  ) {
+
+  switch (index_module) {
+  case module_thermodynamics:
+    return (1 << module_background);
+  case module_perturbations:
+    return (1 << module_thermodynamics);
+  case module_primordial:
+    return (1 << module_perturbations);
+  case module_fourier:
+    return (1 << module_primordial);
+  case module_transfer:
+    /* the non-linear corrections to the sources, only read when there are some */
+    if (pfo->method != nl_none)
+      return (1 << module_perturbations) | (1 << module_fourier);
+    return (1 << module_perturbations);
+  case module_harmonic:
+    return (1 << module_primordial) | (1 << module_transfer);
+  case module_lensing:
+    return (1 << module_harmonic);
+  case module_distortions:
+    return (1 << module_primordial);
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Call the init function of one module, and copy its error message in
+ * case of failure.
+ */
+
+static int modules_init_one(
+                            struct precision * ppr,
+                            struct background * pba,
+                            struct thermodynamics * pth,
+                            struct perturbations * ppt,
+                            struct primordial * ppm,
+                            struct fourier * pfo,
+                            struct transfer * ptr,
+                            struct harmonic * phr,
+                            struct lensing * ple,
+                            struct distortions * psd,
+                            int index_module,
+                            ErrorMsg error_message
+                            ) {
+
+  switch (index_module) {
+  case module_background:
+    class_call(background_init(ppr,pba),
+               pba->error_message,
+               error_message);
+    break;
+  case module_thermodynamics:
+    class_call(thermodynamics_init(ppr,pba,pth),
+               pth->error_message,
+               error_message);
+    break;
+  case module_perturbations:
+    class_call(perturbations_init(ppr,pba,pth,ppt),
+               ppt->error_message,
+               error_message);
+    break;
+  case module_primordial:
+    class_call(primordial_init(ppr,ppt,ppm),
+               ppm->error_message,
+               error_message);
+    break;
+  case module_fourier:
+    class_call(fourier_init(ppr,pba,pth,ppt,ppm,pfo),
+               pfo->error_message,
+               error_message);
+    break;
+  case module_transfer:
+    class_call(transfer_init(ppr,pba,pth,ppt,pfo,ptr),
+               ptr->error_message,
+               error_message);
+    break;
+  case module_harmonic:
+    class_call(harmonic_init(ppr,pba,ppt,ppm,pfo,ptr,phr),
+               phr->error_message,
+               error_message);
+    break;
+  case module_lensing:
+    class_call(lensing_init(ppr,ppt,phr,pfo,ple),
+               ple->error_message,
+               error_message);
+    break;
+  case module_distortions:
+    class_call(distortions_init(ppr,pba,pth,ppt,ppm,psd),
+               psd->error_message,
+               error_message);
+    break;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Initialize the requested modules, each of them as soon as the modules
+ * it depends on (see modules_dependencies()) are done. The modules which
+ * are not requested are assumed to be already initialized. Without a
+ * pool of threads, the modules are initialized one after the other, in
+ * the usual order.
+ *
+ * After a failure, the modules still running are cancelled (see
+ * class_parallel_cancelled()) and those not started yet are skipped; the
+ * error message is that of the module which failed first.
+ *
+ * @param ppr           Input: pointer to precision structure
+ * @param pba           Input/Output: pointer to background structure
+ * @param pth           Input/Output: pointer to thermodynamics structure
+ * @param ppt           Input/Output: pointer to perturbation structure
+ * @param ppm           Input/Output: pointer to primordial structure
+ * @param pfo           Input/Output: pointer to fourier structure
+ * @param ptr           Input/Output: pointer to transfer structure
+ * @param phr           Input/Output: pointer to harmonic structure
+ * @param ple           Input/Output: pointer to lensing structure
+ * @param psd           Input/Output: pointer to distortions structure
+ * @param modules       Input: flags (1 << module_xxx) of the modules to initialize
+ * @param computed      Output: flags of the modules successfully initialized (also in case of failure, e.g. for freeing them)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int modules_init(
+                 struct precision * ppr,
+                 struct background * pba,
+                 struct thermodynamics * pth,
+                 struct perturbations * ppt,
+                 struct primordial * ppm,
+                 struct fourier * pfo,
+                 struct transfer * ptr,
+                 struct harmonic * phr,
+                 struct lensing * ple,
+                 struct distortions * psd,
+                 int modules,
+                 int * computed,
+                 ErrorMsg error_message
+                 ) {
+
+  static const char * labels[module_size] = {
+    "modules:background",
+    "modules:thermodynamics",
+    "modules:perturbations",
+    "modules:primordial",
+    "modules:fourier",
+    "modules:transfer",
+    "modules:harmonic",
+    "modules:lensing",
+    "modules:distortions"
+  };
+  int index_module;
+  int status;
+  unsigned int dependencies[module_size];
+  std::atomic<int> done(0);
+  std::atomic<int> missing[module_size];
+  std::function<void(int)> start;
+
+  *computed = 0;
+
+  class_setup_parallel();
+
+  if (task_system.IsParallel() == false) {
+    for (index_module = 0; index_module < module_size; index_module++) {
+      if ((modules & (1 << index_module)) != 0) {
+        class_call(modules_init_one(ppr,pba,pth,ppt,ppm,pfo,ptr,phr,ple,psd,index_module,error_message),
+                   error_message,
+                   error_message);
+        *computed |= (1 << index_module);
+      }
+    }
+    return _SUCCESS_;
+  }
+
+  /** - count the requested dependencies of each requested module
+      (before starting any of them, since fourier_init() may change
+      pfo->method) */
+  for (index_module = 0; index_module < module_size; index_module++) {
+    dependencies[index_module] = modules_dependencies(pfo,index_module) & modules;
+    missing[index_module].store(__builtin_popcount(dependencies[index_module]),std::memory_order_relaxed);
+  }
+
+  /** - run a module, and then start those which were only waiting for it.
+      The first module to fail writes the error message, the others are
+      cancelled and leave it untouched. */
+  start = [&] (int index_module) {
+    task_system.Spawn(labels[index_module],index_module,[&,index_module] () {
+      int index_next;
+      class_call(modules_init_one(ppr,pba,pth,ppt,ppm,pfo,ptr,phr,ple,psd,index_module,error_message),
+                 error_message,
+                 error_message);
+      done.fetch_or(1 << index_module,std::memory_order_relaxed);
+      for (index_next = index_module+1; index_next < module_size; index_next++) {
+        if (((modules & (1 << index_next)) != 0) &&
+            ((dependencies[index_next] & (1 << index_module)) != 0) &&
+            (missing[index_next].fetch_sub(1,std::memory_order_acq_rel) == 1)) {
+          start(index_next);
+        }
+      }
+      return _SUCCESS_;
+    });
+  };
+
+  for (index_module = 0; index_module < module_size; index_module++) {
+    if (((modules & (1 << index_module)) != 0) &&
+        (missing[index_module].load(std::memory_order_relaxed) == 0)) {
+      start(index_module);
+    }
+  }
+
+  /** - wait for all of them */
+  status = task_system.WaitAll();
+  *computed = done.load(std::memory_order_relaxed);
+
+  return status;
+}
@@ -14,6 +14,7 @@
  */
 
 #include "output.h"
+#include "parallel.h"
 
 int output_total_cl_at_l(
                          struct harmonic * phr,
@@ -121,9 +122,11 @@ int output_init(
 
   /** Summary: */
 
+  FileName file_name;
+
   /** - check that we really want to output at least one file */
 
-  if ((ppt->has_cls == _FALSE_) && (ppt->has_pk_matter == _FALSE_) && (ppt->has_density_transfers == _FALSE_) && (ppt->has_velocity_transfers == _FALSE_) && (pop->write_background == _FALSE_) && (pop->write_thermodynamics == _FALSE_) && (pop->write_primordial == _FALSE_)) {
+  if ((ppt->has_cls == _FALSE_) && (ppt->has_pk_matter == _FALSE_) && (ppt->has_density_transfers == _FALSE_) && (ppt->has_velocity_transfers == _FALSE_) && (pop->write_background == _FALSE_) && (pop->write_thermodynamics == _FALSE_) && (pop->write_primordial == _FALSE_) && (pop->write_timings == _FALSE_) && (pop->write_trace == _FALSE_)) {
     if (pop->output_verbose > 0)
       printf("No output files requested. Output module skipped.\n");
     return _SUCCESS_;
@@ -241,6 +244,26 @@ int output_init(
                pop->error_message);
   }
 
+  /** - deal with timings and counters of the modules */
+
+  if (pop->write_timings == _TRUE_) {
+
+    class_call(output_timings(pba,pth,ppt,ppm,ptr,phr,pfo,ple,psd,pop),
+               pop->error_message,
+               pop->error_message);
+  }
+
+  /** - deal with the trace of the tasks of the parallel regions */
+
+  if (pop->write_trace == _TRUE_) {
+
+    class_sprintf(file_name,"%s%s",pop->root,"trace.json");
+    class_parallel_trace_stop();
+    class_call(class_parallel_trace_write(file_name,pop->error_message),
+               pop->error_message,
+               pop->error_message);
+  }
+
   return _SUCCESS_;
 
 }
@@ -696,6 +719,14 @@ int output_pk(
 
   if ((pk_output == pk_linear) || (pk_output == pk_nonlinear)) {
 
+    /** - if the nonlinear spectra are computed on demand, compute them at all redshifts at once */
+
+    if (pk_output == pk_nonlinear) {
+      class_call(fourier_prepare_pk_nl(pba,pfo,pop->z_pk_num,pop->z_pk),
+                 pfo->error_message,
+                 pop->error_message);
+    }
+
     /** - loop over pk type (_cb, _m) */
 
     for (index_pk=0; index_pk<pfo->pk_size; index_pk++) {
@@ -861,7 +892,7 @@ int output_pk(
 
         for (index_k=0; index_k<pfo->k_size; index_k++) {
 
-          class_call(output_one_line_of_pk(out_pk,
+          class_call(output_one_line_of_pk(pop,out_pk,
                                            exp(pfo->ln_k[index_k])/pba->h,
                                            exp(ln_pk[index_k])*pow(pba->h,3)
                                            ),
@@ -874,7 +905,7 @@ int output_pk(
 
               if (pfo->is_non_zero[index_ic1_ic2] == _TRUE_) {
 
-                class_call(output_one_line_of_pk(out_pk_ic[index_ic1_ic2],
+                class_call(output_one_line_of_pk(pop,out_pk_ic[index_ic1_ic2],
                                                  exp(pfo->ln_k[index_k])/pba->h,
                                                  exp(ln_pk_ic[index_k * pfo->ic_ic_size + index_ic1_ic2])*pow(pba->h,3)),
                            pop->error_message,
@@ -952,7 +983,7 @@ int output_pk(
 
       for (index_k=0; index_k<pfo->k_size; index_k++) {
 
-        class_call(output_one_line_of_pk(out_pk,
+        class_call(output_one_line_of_pk(pop,out_pk,
                                          exp(pfo->ln_k[index_k])/pba->h,
                                          exp(ln_pk[index_k])*pow(pba->h,3)
                                          ),
@@ -988,7 +1019,7 @@ int output_pk(
 
     for (index_k=0; index_k<pfo->k_size; index_k++) {
 
-      class_call(output_one_line_of_pk(out_pk,
+      class_call(output_one_line_of_pk(pop,out_pk,
                                        pfo->k[index_k]/pba->h,
                                        exp(pfo->ln_pk_l_an_extra[index_k])*pow(pba->h,3)
                                        ),
@@ -1107,9 +1138,11 @@ int output_tk(
       else
         class_sprintf(file_name,"%s%s%s%s%s",pop->root,redshift_suffix,"tk_",ic_suffix,".dat");
 
-      class_open(tkfile, file_name, "w", pop->error_message);
+      class_call(output_open_file(pop,&tkfile,file_name,pop->error_message),
+                 pop->error_message,
+                 pop->error_message);
 
-      if (pop->write_header == _TRUE_) {
+      if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
         if (pop->output_format == class_format) {
           fprintf(tkfile,"# Transfer functions T_i(k) %sat redshift z=%g\n",first_line,z);
           fprintf(tkfile,"# for k=%g to %g h/Mpc,\n",ppt->k[index_md][0]/pba->h,ppt->k[index_md][ppt->k_size[index_md]-1]/pba->h);
@@ -1140,7 +1173,8 @@ int output_tk(
         }
       }
 
-      output_print_data(tkfile,
+      output_print_data(pop,
+                        tkfile,
                         titles,
                         data+index_ic*size_data,
                         size_data);
@@ -1183,9 +1217,11 @@ int output_background(
              pop->error_message);
 
   class_sprintf(file_name,"%s%s",pop->root,"background.dat");
-  class_open(backfile,file_name,"w",pop->error_message);
+  class_call(output_open_file(pop,&backfile,file_name,pop->error_message),
+             pop->error_message,
+             pop->error_message);
 
-  if (pop->write_header == _TRUE_) {
+  if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
     fprintf(backfile,"# Table of selected background quantities\n");
     fprintf(backfile,"# All densities are multiplied by (8piG/3) (below, shortcut notation (.) for this factor) \n");
     fprintf(backfile,"# Densities are in units [Mpc^-2] while all distances are in [Mpc]. \n");
@@ -1197,7 +1233,8 @@ int output_background(
     }
   }
 
-  output_print_data(backfile,
+  output_print_data(pop,
+                    backfile,
                     titles,
                     data,
                     size_data);
@@ -1235,9 +1272,11 @@ int output_thermodynamics(
              pop->error_message);
 
   class_sprintf(file_name,"%s%s",pop->root,"thermodynamics.dat");
-  class_open(thermofile,file_name,"w",pop->error_message);
+  class_call(output_open_file(pop,&thermofile,file_name,pop->error_message),
+             pop->error_message,
+             pop->error_message);
 
-  if (pop->write_header == _TRUE_) {
+  if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
     fprintf(thermofile,"# Table of selected thermodynamics quantities\n");
     fprintf(thermofile,"# The following notation is used in column titles:\n");
     fprintf(thermofile,"#         x_e = electron ionization fraction\n");
@@ -1262,7 +1301,8 @@ int output_thermodynamics(
     }
   }
 
-  output_print_data(thermofile,
+  output_print_data(pop,
+                    thermofile,
                     titles,
                     data,
                     size_data);
@@ -1292,12 +1332,20 @@ int output_perturbations(
       index_md = ppt->index_md_scalars;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       class_sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_s.dat");
-      class_open(out, file_name, "w", ppt->error_message);
-      fprintf(out,"#scalar perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
-      output_print_data(out,
-                        ppt->scalar_titles,
-                        ppt->scalar_perturbations_data[index_ikout],
-                        ppt->size_scalar_perturbation_data[index_ikout]);
+      class_call(output_open_file(pop,&out,file_name,ppt->error_message),
+                 ppt->error_message,
+                 ppt->error_message);
+      if (pop->write_npy == _FALSE_)
+        fprintf(out,"#scalar perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
+      class_call(output_print_streamed_data(pop,
+                                            out,
+                                            ppt->scalar_titles,
+                                            ppt->scalar_perturbations_file[index_ikout],
+                                            ppt->scalar_perturbations_data[index_ikout],
+                                            ppt->size_scalar_perturbation_data[index_ikout],
+                                            pop->error_message),
+                 pop->error_message,
+                 pop->error_message);
 
       fclose(out);
     }
@@ -1305,12 +1353,20 @@ int output_perturbations(
       index_md = ppt->index_md_vectors;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       class_sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_v.dat");
-      class_open(out, file_name, "w", ppt->error_message);
-      fprintf(out,"#vector perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
-      output_print_data(out,
-                        ppt->vector_titles,
-                        ppt->vector_perturbations_data[index_ikout],
-                        ppt->size_vector_perturbation_data[index_ikout]);
+      class_call(output_open_file(pop,&out,file_name,ppt->error_message),
+                 ppt->error_message,
+                 ppt->error_message);
+      if (pop->write_npy == _FALSE_)
+        fprintf(out,"#vector perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
+      class_call(output_print_streamed_data(pop,
+                                            out,
+                                            ppt->vector_titles,
+                                            ppt->vector_perturbations_file[index_ikout],
+                                            ppt->vector_perturbations_data[index_ikout],
+                                            ppt->size_vector_perturbation_data[index_ikout],
+                                            pop->error_message),
+                 pop->error_message,
+                 pop->error_message);
 
       fclose(out);
     }
@@ -1318,12 +1374,20 @@ int output_perturbations(
       index_md = ppt->index_md_tensors;
       k = ppt->k[index_md][ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout]];
       class_sprintf(file_name,"%s%s%d%s",pop->root,"perturbations_k",index_ikout,"_t.dat");
-      class_open(out, file_name, "w", ppt->error_message);
-      fprintf(out,"#tensor perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
-      output_print_data(out,
-                        ppt->tensor_titles,
-                        ppt->tensor_perturbations_data[index_ikout],
-                        ppt->size_tensor_perturbation_data[index_ikout]);
+      class_call(output_open_file(pop,&out,file_name,ppt->error_message),
+                 ppt->error_message,
+                 ppt->error_message);
+      if (pop->write_npy == _FALSE_)
+        fprintf(out,"#tensor perturbations for mode k = %.*e Mpc^(-1)\n",_OUTPUTPRECISION_,k);
+      class_call(output_print_streamed_data(pop,
+                                            out,
+                                            ppt->tensor_titles,
+                                            ppt->tensor_perturbations_file[index_ikout],
+                                            ppt->tensor_perturbations_data[index_ikout],
+                                            ppt->size_tensor_perturbation_data[index_ikout],
+                                            pop->error_message),
+                 pop->error_message,
+                 pop->error_message);
 
       fclose(out);
     }
@@ -1360,12 +1424,15 @@ int output_primordial(
              ppm->error_message,
              pop->error_message);
 
-  class_open(out,file_name,"w",pop->error_message);
-  if (pop->write_header == _TRUE_) {
+  class_call(output_open_file(pop,&out,file_name,pop->error_message),
+             pop->error_message,
+             pop->error_message);
+  if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
     fprintf(out,"# Dimensionless primordial spectrum, equal to [k^3/2pi^2] P(k) \n");
   }
 
-  output_print_data(out,
+  output_print_data(pop,
+                    out,
                     titles,
                     data,
                     size_data);
@@ -1419,17 +1486,17 @@ int output_heating(struct injection* pin, struct noninjection* pni, struct outpu
                pop->error_message);
 
     /* File IO */
-    class_open(out_injection,
-               file_name_injection,
-               "w",
+    class_call(output_open_file(pop,&out_injection,file_name_injection,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
-    if (pop->write_header == _TRUE_){
+    if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
       fprintf(out_injection,"# Table of energy injection and deposition from exotic processes \n");
       fprintf(out_injection,"# Heat is dE/dt|dep_h\n");
     }
 
-    output_print_data(out_injection,
+    output_print_data(pop,
+                      out_injection,
                       titles_injection,
                       data_injection,
                       size_data_injection);
@@ -1461,16 +1528,16 @@ int output_heating(struct injection* pin, struct noninjection* pni, struct outpu
                pop->error_message);
 
     /* File IO */
-    class_open(out_noninjection,
-               file_name_noninjection,
-               "w",
+    class_call(output_open_file(pop,&out_noninjection,file_name_noninjection,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
-    if (pop->write_header == _TRUE_){
+    if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
       fprintf(out_noninjection,"# Table of non-injected energy influencing the photon spectral distortions \n");
     }
 
-    output_print_data(out_noninjection,
+    output_print_data(pop,
+                      out_noninjection,
                       titles_noninjection,
                       data_noninjection,
                       size_data_noninjection);
@@ -1521,18 +1588,18 @@ int output_distortions(
                pop->error_message);
 
     /* File IO */
-    class_open(out_heat,
-               file_name_heat,
-               "w",
+    class_call(output_open_file(pop,&out_heat,file_name_heat,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
-    if (pop->write_header == _TRUE_){
+    if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
       fprintf(out_heat,"# Heat is d(Q/rho)/dz\n");
       fprintf(out_heat,"# LHeat is d(Q/rho)/dlnz\n");
       fprintf(out_heat,"#\n");
     }
 
-    output_print_data(out_heat,
+    output_print_data(pop,
+                      out_heat,
                       titles_heat,
                       data_heat,
                       size_data_heat);
@@ -1560,19 +1627,19 @@ int output_distortions(
                pop->error_message);
 
     /* File IO */
-    class_open(out_distortion,
-               file_name_distortion,
-               "w",
+    class_call(output_open_file(pop,&out_distortion,file_name_distortion,pop->error_message),
+               pop->error_message,
                pop->error_message);
 
-    if (pop->write_header == _TRUE_){
+    if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
       fprintf(out_distortion,"# SD_tot is the amplitude of the overall spectral distortion (SD)\n");
       fprintf(out_distortion,"# The SD[i] are the amplitudes of the individual SDs\n");
       fprintf(out_distortion,"# The SDs are given in units [10^-26 W m^-2 Hz^-1 sr^-1] \n");
       fprintf(out_distortion,"#\n");
     }
 
-    output_print_data(out_distortion,
+    output_print_data(pop,
+                      out_distortion,
                       titles_distortion,
                       data_distortion,
                       size_data_distortion);
@@ -1584,18 +1651,182 @@ int output_distortions(
 }
 
 
-int output_print_data(FILE *out,
+/**
+ * This routine writes the wall time, CPU time and counters of the last
+ * call to the init function of each module in the file
+ * '<root>timings.dat', one row per module.
+ *
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param ppm Input: pointer to primordial structure
+ * @param ptr Input: pointer to transfer structure
+ * @param phr Input: pointer to harmonic structure
+ * @param pfo Input: pointer to fourier structure
+ * @param ple Input: pointer to lensing structure
+ * @param psd Input: pointer to distortions structure
+ * @param pop Input: pointer to output structure
+ * @return the error status
+ */
+
+int output_timings(
+                   struct background * pba,
+                   struct thermodynamics * pth,
+                   struct perturbations * ppt,
+                   struct primordial * ppm,
+                   struct transfer * ptr,
+                   struct harmonic * phr,
+                   struct fourier * pfo,
+                   struct lensing * ple,
+                   struct distortions * psd,
+                   struct output * pop
+                   ) {
+
+  FileName file_name;
+  FILE * out;
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+  const char * module_name[9] = {"background","thermodynamics","perturbations","primordial","fourier","transfer","harmonic","lensing","distortions"};
+  struct class_stats * module_stats[9];
+  double * data;
+  int number_of_titles, index_module, index_counter, storeidx;
+
+  module_stats[0] = &(pba->stats);
+  module_stats[1] = &(pth->stats);
+  module_stats[2] = &(ppt->stats);
+  module_stats[3] = &(ppm->stats);
+  module_stats[4] = &(pfo->stats);
+  module_stats[5] = &(ptr->stats);
+  module_stats[6] = &(phr->stats);
+  module_stats[7] = &(ple->stats);
+  module_stats[8] = &(psd->stats);
+
+  /* Titles */
+  class_store_columntitle(titles,"module",_TRUE_);
+  class_store_columntitle(titles,"wall_time [s]",_TRUE_);
+  class_store_columntitle(titles,"cpu_time [s]",_TRUE_);
+  for (index_counter=0; index_counter<counter_size; index_counter++) {
+    class_store_columntitle(titles,class_stats_counter_name(index_counter),_TRUE_);
+  }
+  class_store_columntitle(titles,"peak_rss [bytes]",_TRUE_);
+  number_of_titles = get_number_of_titles(titles);
+
+  /* Data array */
+  class_alloc(data,sizeof(double)*9*number_of_titles,pop->error_message);
+  storeidx = 0;
+  for (index_module=0; index_module<9; index_module++) {
+    data[storeidx++] = index_module+1;
+    data[storeidx++] = module_stats[index_module]->wall_time;
+    data[storeidx++] = module_stats[index_module]->cpu_time;
+    for (index_counter=0; index_counter<counter_size; index_counter++) {
+      data[storeidx++] = module_stats[index_module]->counter[index_counter];
+    }
+    data[storeidx++] = module_stats[index_module]->peak_rss;
+  }
+
+  /* File IO */
+  class_sprintf(file_name,"%s%s",pop->root,"timings.dat");
+  class_call(output_open_file(pop,&out,file_name,pop->error_message),
+             pop->error_message,
+             pop->error_message);
+
+  if ((pop->write_header == _TRUE_) && (pop->write_npy == _FALSE_)) {
+    fprintf(out,"# Timings and counters of the last call to the init function of each module\n");
+    fprintf(out,"# (counters are process-wide, and all zero if CLASS was compiled without _CLASS_STATS_;\n");
+    fprintf(out,"#  peak_rss is the increase of the peak resident set size of the process during the call)\n");
+    fprintf(out,"# Modules:");
+    for (index_module=0; index_module<9; index_module++) {
+      fprintf(out," %d:%s",index_module+1,module_name[index_module]);
+    }
+    fprintf(out,"\n#\n");
+  }
+
+  output_print_data(pop,out,titles,data,9*number_of_titles);
+
+  free(data);
+  fclose(out);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine opens one output file for writing. When the tables are
+ * written in .npy files, the '.dat' extension of the file name is
+ * replaced by '.npy'.
+ *
+ * @param pop           Input: pointer to output structure
+ * @param file          Output: returned pointer to file pointer
+ * @param filename      Input/Output: name of the file
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_open_file(
+                     struct output * pop,
+                     FILE ** file,
+                     FileName filename,
+                     ErrorMsg error_message
+                     ) {
+
+  char * extension;
+
+  if (pop->write_npy == _TRUE_) {
+    extension = strrchr(filename,'.');
+    if ((extension != NULL) && (strcmp(extension,".dat") == 0))
+      strcpy(extension,".npy");
+    class_open(*file,filename,"wb",error_message);
+  }
+  else {
+    class_open(*file,filename,"w",error_message);
+  }
+
+  return _SUCCESS_;
+}
+
+int output_print_data(struct output * pop,
+                      FILE *out,
                       char titles[_MAXTITLESTRINGLENGTH_],
                       double *dataptr,
                       int size_dataptr){
-  int colnum=1, number_of_titles;
-  int index_title, index_tau;
-  char thetitle[_MAXTITLESTRINGLENGTH_];
-  char *pch;
+  int number_of_titles;
 
   /** Summary*/
 
+  number_of_titles = get_number_of_titles(titles);
+
   /** - First we print the titles */
+  output_print_titles(pop,out,titles,(number_of_titles>0) ? size_dataptr/number_of_titles : 0);
+
+  /** - Then we print the data */
+  output_print_rows(pop,out,number_of_titles,dataptr,size_dataptr);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine prints the line of titles of a table, or for .npy files
+ * the corresponding header
+ *
+ * @param pop    Input: pointer to output structure
+ * @param out    Input: file pointer
+ * @param titles Input: titles of the columns, separated by _DELIMITER_
+ * @param rows   Input: number of rows of the table
+ * @return the error status
+ */
+
+int output_print_titles(struct output * pop,
+                        FILE *out,
+                        char titles[_MAXTITLESTRINGLENGTH_],
+                        int rows){
+  int colnum=1;
+  char thetitle[_MAXTITLESTRINGLENGTH_];
+  char *pch;
+
+  if (pop->write_npy == _TRUE_) {
+    if (get_number_of_titles(titles)>0)
+      output_npy_header(out,titles,rows);
+    return _SUCCESS_;
+  }
+
   fprintf(out,"#");
 
   strcpy(thetitle,titles);
@@ -1606,17 +1837,176 @@ int output_print_data(FILE *out,
   }
   fprintf(out,"\n");
 
-  /** - Then we print the data */
-  number_of_titles = colnum-1;
-  if (number_of_titles>0){
-    for (index_tau=0; index_tau<size_dataptr/number_of_titles; index_tau++){
-      fprintf(out," ");
-      for (index_title=0; index_title<number_of_titles; index_title++){
-        class_fprintf_double(out, dataptr[index_tau*number_of_titles+index_title], _TRUE_);
-      }
-      fprintf(out,"\n");
+  return _SUCCESS_;
+}
+
+/**
+ * This routine prints some rows of a table. In .npy files, they are
+ * written in one go.
+ *
+ * @param pop              Input: pointer to output structure
+ * @param out              Input: file pointer
+ * @param number_of_titles Input: number of columns
+ * @param dataptr          Input: rows of the table
+ * @param size_dataptr     Input: number of doubles in dataptr
+ * @return the error status
+ */
+
+int output_print_rows(struct output * pop,
+                      FILE *out,
+                      int number_of_titles,
+                      double *dataptr,
+                      int size_dataptr){
+  int index_title, index_tau;
+
+  if (number_of_titles == 0)
+    return _SUCCESS_;
+
+  if (pop->write_npy == _TRUE_) {
+    fwrite(dataptr,sizeof(double),size_dataptr,out);
+    return _SUCCESS_;
+  }
+
+  for (index_tau=0; index_tau<size_dataptr/number_of_titles; index_tau++){
+    fprintf(out," ");
+    for (index_title=0; index_title<number_of_titles; index_title++){
+      class_fprintf_double(out, dataptr[index_tau*number_of_titles+index_title], _TRUE_);
     }
+    fprintf(out,"\n");
   }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine prints a table whose first rows may have been moved to
+ * a temporary file (see perturbations_output_new_row()): the rows of
+ * the file are read back by chunks, followed by those still in
+ * memory.
+ *
+ * @param pop           Input: pointer to output structure
+ * @param out           Input: file pointer
+ * @param titles        Input: titles of the columns, separated by _DELIMITER_
+ * @param tmp_file      Input: temporary file with the first rows (or NULL)
+ * @param dataptr       Input: last rows of the table
+ * @param size_dataptr  Input: number of doubles in dataptr
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int output_print_streamed_data(struct output * pop,
+                               FILE *out,
+                               char titles[_MAXTITLESTRINGLENGTH_],
+                               FILE *tmp_file,
+                               double *dataptr,
+                               int size_dataptr,
+                               ErrorMsg error_message){
+  int number_of_titles;
+  long size_file;
+  size_t size_chunk;
+  double * chunk;
+
+  if (tmp_file == NULL)
+    return output_print_data(pop,out,titles,dataptr,size_dataptr);
+
+  number_of_titles = get_number_of_titles(titles);
+  class_test(number_of_titles == 0,
+             error_message,
+             "no columns in a table of perturbations");
+
+  size_file = ftell(tmp_file)/sizeof(double);
+  rewind(tmp_file);
+
+  output_print_titles(pop,out,titles,(size_file+size_dataptr)/number_of_titles);
+
+  class_alloc(chunk,sizeof(double)*_PERTURBATIONS_OUTPUT_CHUNK_*number_of_titles,error_message);
+  while ((size_chunk = fread(chunk,sizeof(double),_PERTURBATIONS_OUTPUT_CHUNK_*number_of_titles,tmp_file)) > 0) {
+    output_print_rows(pop,out,number_of_titles,chunk,size_chunk);
+  }
+  free(chunk);
+
+  output_print_rows(pop,out,number_of_titles,dataptr,size_dataptr);
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine writes the header of a .npy file (format version 1.0 of
+ * numpy, or 2.0 if the header is too long) for a table of doubles with
+ * one row per line and one named field per column. The rows must then
+ * be written contiguously, such that numpy.load() returns a structured
+ * array in which each column can be accessed by its title.
+ *
+ * @param out    Input: file pointer
+ * @param titles Input: titles of the columns, separated by _DELIMITER_
+ * @param rows   Input: number of rows of the table
+ * @return the error status
+ */
+
+int output_npy_header(FILE *out,
+                      char titles[_MAXTITLESTRINGLENGTH_],
+                      int rows){
+
+  char thetitle[_MAXTITLESTRINGLENGTH_];
+  /* each title gets at most doubled by escaping and 13 more characters, while it takes at least 2 in titles */
+  char header[8*_MAXTITLESTRINGLENGTH_+128];
+  char *pch, *pc, *ph;
+  char byte_order;
+  int one = 1;
+  int header_length, prelude_length;
+  unsigned char length_bytes[4];
+
+  /** - The type of each field, in the byte order of this machine */
+  byte_order = (*(char *)&one == 1) ? '<' : '>';
+
+  /** - The header is a python dictionary literal */
+  ph = header;
+  ph += sprintf(ph,"{'descr': [");
+  strcpy(thetitle,titles);
+  pch = strtok(thetitle,_DELIMITER_);
+  while (pch != NULL){
+    *ph++ = '(';
+    *ph++ = '\'';
+    for (pc = pch; *pc != '\0'; pc++) {
+      if ((*pc == '\'') || (*pc == '\\'))
+        *ph++ = '\\';
+      *ph++ = *pc;
+    }
+    ph += sprintf(ph,"', '%cf8'), ",byte_order);
+    pch = strtok(NULL,_DELIMITER_);
+  }
+  ph += sprintf(ph,"], 'fortran_order': False, 'shape': (%d,), }",rows);
+
+  /** - It is padded with spaces and terminated by a newline, such that
+      the data starts at a multiple of 64 bytes */
+  header_length = ph-header+1;
+  prelude_length = (header_length+64 <= 65535) ? 10 : 12;
+  while ((prelude_length+header_length)%64 != 0) {
+    *ph++ = ' ';
+    header_length++;
+  }
+  *ph = '\n';
+
+  /** - Magic string, version, and little-endian length of the header */
+  fwrite("\x93NUMPY",1,6,out);
+  if (prelude_length == 10) {
+    fputc(1,out);
+    fputc(0,out);
+    length_bytes[0] = header_length & 0xff;
+    length_bytes[1] = (header_length >> 8) & 0xff;
+    fwrite(length_bytes,1,2,out);
+  }
+  else {
+    fputc(2,out);
+    fputc(0,out);
+    length_bytes[0] = header_length & 0xff;
+    length_bytes[1] = (header_length >> 8) & 0xff;
+    length_bytes[2] = (header_length >> 16) & 0xff;
+    length_bytes[3] = (header_length >> 24) & 0xff;
+    fwrite(length_bytes,1,4,out);
+  }
+  fwrite(header,1,header_length,out);
+
   return _SUCCESS_;
 }
 
@@ -1647,12 +2037,92 @@ int output_open_cl_file(
   int index_d1,index_d2;
   int colnum = 1;
   char tmp[60]; //A fixed number here is ok, since it should just correspond to the largest string which is printed to tmp.
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
+  char thetitle[_MAXTITLESTRINGLENGTH_];
+  char *pch;
+
+  class_call(output_open_file(pop,clfile,filename,pop->error_message),
+             pop->error_message,
+             pop->error_message);
+
+  /** - First we list the columns, the first one being l */
+
+  class_store_columntitle(titles,"l",_TRUE_);
 
-  class_open(*clfile,filename,"w",pop->error_message);
+  if (pop->output_format == class_format) {
+    class_store_columntitle(titles,"TT",phr->has_tt);
+    class_store_columntitle(titles,"EE",phr->has_ee);
+    class_store_columntitle(titles,"TE",phr->has_te);
+    class_store_columntitle(titles,"BB",phr->has_bb);
+    class_store_columntitle(titles,"phiphi",phr->has_pp);
+    class_store_columntitle(titles,"TPhi",phr->has_tp);
+    class_store_columntitle(titles,"Ephi",phr->has_ep);
+  }
+  else if (pop->output_format == camb_format) {
+    class_store_columntitle(titles,"TT",phr->has_tt);
+    class_store_columntitle(titles,"EE",phr->has_ee);
+    class_store_columntitle(titles,"BB",phr->has_bb);
+    class_store_columntitle(titles,"TE",phr->has_te);
+    class_store_columntitle(titles,"dd",phr->has_pp);
+    class_store_columntitle(titles,"dT",phr->has_tp);
+    class_store_columntitle(titles,"dE",phr->has_ep);
+  }
+
+  /** - Then the entries that are independent of format type */
+
+  if (phr->has_dd == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
+        class_sprintf(tmp,"dens[%d]-dens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+  if (phr->has_td == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      class_sprintf(tmp,"T-dens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (phr->has_pd == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      class_sprintf(tmp,"phi-dens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (phr->has_ll == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
+        class_sprintf(tmp,"lens[%d]-lens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+  if (phr->has_tl == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      class_sprintf(tmp,"T-lens[%d]",index_d1+1);
+      class_store_columntitle(titles,tmp,_TRUE_);
+    }
+  }
+  if (phr->has_dl == _TRUE_){
+    for (index_d1=0; index_d1<phr->d_size; index_d1++){
+      for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
+        class_sprintf(tmp,"dens[%d]-lens[%d]",index_d1+1,index_d2+1);
+        class_store_columntitle(titles,tmp,_TRUE_);
+      }
+    }
+  }
+
+  /** - In .npy files, these are the names of the fields */
+
+  if (pop->write_npy == _TRUE_) {
+    output_npy_header(*clfile,titles,lmax-1);
+    return _SUCCESS_;
+  }
 
   if (pop->write_header == _TRUE_) {
 
-    /** - First we deal with the entries that are dependent of format type */
+    /** - Otherwise we write some information depending on the format type */
 
     if (pop->output_format == class_format) {
       fprintf(*clfile,"# dimensionless %s\n",first_line);
@@ -1691,76 +2161,17 @@ int output_open_cl_file(
 
     fprintf(*clfile,"#\n");
 
-    if (0==1){
-      fprintf(*clfile,"#");
-      class_fprintf_columntitle(*clfile,"l",_TRUE_,colnum);
-    }
-    else{
-      fprintf(*clfile,"# 1:l ");
-      colnum++;
-    }
-    if (pop->output_format == class_format) {
-      class_fprintf_columntitle(*clfile,"TT",phr->has_tt,colnum);
-      class_fprintf_columntitle(*clfile,"EE",phr->has_ee,colnum);
-      class_fprintf_columntitle(*clfile,"TE",phr->has_te,colnum);
-      class_fprintf_columntitle(*clfile,"BB",phr->has_bb,colnum);
-      class_fprintf_columntitle(*clfile,"phiphi",phr->has_pp,colnum);
-      class_fprintf_columntitle(*clfile,"TPhi",phr->has_tp,colnum);
-      class_fprintf_columntitle(*clfile,"Ephi",phr->has_ep,colnum);
-    }
-    else if (pop->output_format == camb_format) {
-      class_fprintf_columntitle(*clfile,"TT",phr->has_tt,colnum);
-      class_fprintf_columntitle(*clfile,"EE",phr->has_ee,colnum);
-      class_fprintf_columntitle(*clfile,"BB",phr->has_bb,colnum);
-      class_fprintf_columntitle(*clfile,"TE",phr->has_te,colnum);
-      class_fprintf_columntitle(*clfile,"dd",phr->has_pp,colnum);
-      class_fprintf_columntitle(*clfile,"dT",phr->has_tp,colnum);
-      class_fprintf_columntitle(*clfile,"dE",phr->has_ep,colnum);
-    }
+    /** - and the titles of the columns */
 
-    /** - Next deal with entries that are independent of format type */
+    fprintf(*clfile,"# 1:l ");
+    colnum++;
 
-    if (phr->has_dd == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
-          class_sprintf(tmp,"dens[%d]-dens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
-    }
-    if (phr->has_td == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        class_sprintf(tmp,"T-dens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (phr->has_pd == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        class_sprintf(tmp,"phi-dens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (phr->has_ll == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        for (index_d2=index_d1; index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++){
-          class_sprintf(tmp,"lens[%d]-lens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
-    }
-    if (phr->has_tl == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        class_sprintf(tmp,"T-lens[%d]",index_d1+1);
-        class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-      }
-    }
-    if (phr->has_dl == _TRUE_){
-      for (index_d1=0; index_d1<phr->d_size; index_d1++){
-        for (index_d2=MAX(index_d1-phr->non_diag,0); index_d2<=MIN(index_d1+phr->non_diag,phr->d_size-1); index_d2++) {
-          class_sprintf(tmp,"dens[%d]-lens[%d]",index_d1+1,index_d2+1);
-          class_fprintf_columntitle(*clfile,tmp,_TRUE_,colnum);
-        }
-      }
+    strcpy(thetitle,titles);
+    pch = strtok(thetitle,_DELIMITER_);
+    pch = strtok(NULL,_DELIMITER_);
+    while (pch != NULL){
+      class_fprintf_columntitle(*clfile, pch, _TRUE_, colnum);
+      pch = strtok(NULL,_DELIMITER_);
     }
     fprintf(*clfile,"\n");
   }
@@ -1796,31 +2207,35 @@ int output_one_line_of_cl(
 
   factor = l*(l+1)/2./_PI_;
 
-  fprintf(clfile," ");
+  if (pop->write_npy == _FALSE_) {
+    fprintf(clfile," ");
 
-  if (0==1){
-    class_fprintf_int(clfile, (int)l, _TRUE_);
+    if (0==1){
+      class_fprintf_int(clfile, (int)l, _TRUE_);
+    }
+    else{
+      fprintf(clfile,"%4d ",(int)l);
+    }
   }
-  else{
-    fprintf(clfile,"%4d ",(int)l);
+  else {
+    output_write_double(pop, clfile, l, _TRUE_);
   }
 
   if (pop->output_format == class_format) {
 
     for (index_ct=0; index_ct < ct_size; index_ct++) {
-      class_fprintf_double(clfile, factor*cl[index_ct], _TRUE_);
+      output_write_double(pop, clfile, factor*cl[index_ct], _TRUE_);
     }
-    fprintf(clfile,"\n");
   }
 
   if (pop->output_format == camb_format) {
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_tt], phr->has_tt);
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_ee], phr->has_ee);
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_bb], phr->has_bb);
-    class_fprintf_double(clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_te], phr->has_te);
-    class_fprintf_double(clfile, l*(l+1)*factor*cl[phr->index_ct_pp], phr->has_pp);
-    class_fprintf_double(clfile, sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_tp], phr->has_tp);
-    class_fprintf_double(clfile, sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_ep], phr->has_ep);
+    output_write_double(pop, clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_tt], phr->has_tt);
+    output_write_double(pop, clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_ee], phr->has_ee);
+    output_write_double(pop, clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_bb], phr->has_bb);
+    output_write_double(pop, clfile, factor*pow(pba->T_cmb*1.e6,2)*cl[phr->index_ct_te], phr->has_te);
+    output_write_double(pop, clfile, l*(l+1)*factor*cl[phr->index_ct_pp], phr->has_pp);
+    output_write_double(pop, clfile, sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_tp], phr->has_tp);
+    output_write_double(pop, clfile, sqrt(l*(l+1))*factor*pba->T_cmb*1.e6*cl[phr->index_ct_ep], phr->has_ep);
     index_ct_rest = 0;
     if (phr->has_tt == _TRUE_)
       index_ct_rest++;
@@ -1838,12 +2253,13 @@ int output_one_line_of_cl(
       index_ct_rest++;
     /* Now print the remaining (if any) entries:*/
     for (index_ct=index_ct_rest; index_ct < ct_size; index_ct++) {
-      class_fprintf_double(clfile, factor*cl[index_ct], _TRUE_);
+      output_write_double(pop, clfile, factor*cl[index_ct], _TRUE_);
     }
+  }
 
+  if (pop->write_npy == _FALSE_)
     fprintf(clfile,"\n");
 
-  }
   return _SUCCESS_;
 
 }
@@ -1873,9 +2289,18 @@ int output_open_pk_file(
                         ) {
 
   int colnum = 1;
-  class_open(*pkfile,filename,"w",pop->error_message);
+  char titles[_MAXTITLESTRINGLENGTH_]={0};
 
-  if (pop->write_header == _TRUE_) {
+  class_call(output_open_file(pop,pkfile,filename,pop->error_message),
+             pop->error_message,
+             pop->error_message);
+
+  if (pop->write_npy == _TRUE_) {
+    class_store_columntitle(titles,"k (h/Mpc)",_TRUE_);
+    class_store_columntitle(titles,"P (Mpc/h)^3",_TRUE_);
+    output_npy_header(*pkfile,titles,pfo->k_size);
+  }
+  else if (pop->write_header == _TRUE_) {
     fprintf(*pkfile,"# Matter power spectrum P(k) %sat redshift z=%g\n",first_line,z);
     fprintf(*pkfile,"# for k=%g to %g h/Mpc,\n",
             exp(pfo->ln_k[0])/pba->h,
@@ -1895,6 +2320,7 @@ int output_open_pk_file(
 /**
  * This routine writes one line with k and P(k)
  *
+ * @param pop     Input: pointer to output structure
  * @param pkfile  Input: file pointer
  * @param one_k   Input: wavenumber
  * @param one_pk  Input: matter power spectrum
@@ -1902,11 +2328,18 @@ int output_open_pk_file(
  */
 
 int output_one_line_of_pk(
+                          struct output * pop,
                           FILE * pkfile,
                           double one_k,
                           double one_pk
                           ) {
 
+  if (pop->write_npy == _TRUE_) {
+    output_write_double(pop,pkfile,one_k,_TRUE_);
+    output_write_double(pop,pkfile,one_pk,_TRUE_);
+    return _SUCCESS_;
+  }
+
   fprintf(pkfile," ");
   class_fprintf_double(pkfile,one_k,_TRUE_);
   class_fprintf_double(pkfile,one_pk,_TRUE_);
@@ -1915,3 +2348,32 @@ int output_one_line_of_pk(
   return _SUCCESS_;
 
 }
+
+/**
+ * This routine writes one number in a line of a table, either as text
+ * or, for .npy files, in binary
+ *
+ * @param pop       Input: pointer to output structure
+ * @param file      Input: file pointer
+ * @param value     Input: number to write
+ * @param condition Input: whether the column is present
+ * @return the error status
+ */
+
+int output_write_double(
+                        struct output * pop,
+                        FILE * file,
+                        double value,
+                        short condition
+                        ) {
+
+  if (condition == _TRUE_) {
+    if (pop->write_npy == _TRUE_)
+      fwrite(&value,sizeof(double),1,file);
+    else
+      class_fprintf_double(file,value,_TRUE_);
+  }
+
+  return _SUCCESS_;
+
+}
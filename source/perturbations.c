@@ -26,6 +26,38 @@
 
 #include "perturbations.h"
 #include "parallel.h"
+#include "class_mpi.h"
+#include "sys/time.h"
+#include <atomic>
+
+/**
+ * Per-thread pool of workspaces, one for each mode. The threads of the
+ * shared pool live as long as the process, hence each workspace is
+ * reused for all the wavenumbers evolved by a thread, and for all
+ * successive runs: its arrays are only reallocated when they grow.
+ */
+
+struct perturbations_workspace_arena {
+  struct perturbations_workspace workspace[_MAX_NUMBER_OF_MODES_];
+  perturbations_workspace_arena() {
+    memset(workspace,0,sizeof(workspace));
+  }
+  ~perturbations_workspace_arena() {
+    for (int index_md = 0; index_md < _MAX_NUMBER_OF_MODES_; index_md++)
+      perturbations_workspace_free(NULL,index_md,&(workspace[index_md]));
+  }
+};
+
+static thread_local struct perturbations_workspace_arena perturbations_arena;
+
+/**
+ * Counter of the calls to perturbations_init(), such that the
+ * workspaces can tell which of the data they keep from one wavenumber
+ * to the next (the sparsity patterns of the jacobian) belongs to the
+ * current run.
+ */
+
+static std::atomic<unsigned long> perturbations_run_count(0);
 
 
 /**
@@ -58,10 +90,15 @@ int perturbations_sources_at_tau(
 
   int last_index;
   double logtau;
-
+  int index_ic_tp, index_k, inf, sup, mid;
+  double * x_array;
+  double x;
+  int x_size;
+  double * rows;
   short do_spline = _FALSE_;
 
   logtau = log(tau);
+  index_ic_tp = index_ic * ppt->tp_size[index_md] + index_tp;
 
   /** - If we have defined a z_max_pk > 0, then we have already an
      array of sources and of their second derivative with respect to
@@ -76,6 +113,84 @@ int perturbations_sources_at_tau(
     }
   }
 
+  /** - If the sources are stored in single precision, convert the
+        two lines of the table bracketing tau (and their second
+        derivatives) to double precision, and interpolate between them
+        exactly as in the double precision case below */
+
+  if (ppt->storage != sources_storage_double) {
+
+    if (do_spline == _TRUE_) {
+      x_array = ppt->ln_tau;
+      x_size = ppt->ln_tau_size;
+      x = logtau;
+    }
+    else {
+      x_array = ppt->tau_sampling;
+      x_size = ppt->tau_size;
+      x = tau;
+    }
+
+    class_test((x < x_array[0]) || (x > x_array[x_size-1]),
+               ppt->error_message,
+               "tau=%e out of the range of the table of sources",tau);
+
+    inf = 0;
+    sup = x_size-1;
+    while (sup-inf > 1) {
+      mid = (inf+sup)/2;
+      if (x < x_array[mid]) {sup=mid;}
+      else {inf=mid;}
+    }
+
+    class_alloc(rows,4*ppt->k_size[index_md]*sizeof(double),ppt->error_message);
+
+    for (index_k = 0; index_k < 2*ppt->k_size[index_md]; index_k++) {
+      if (do_spline == _TRUE_) {
+        rows[index_k] = (double)ppt->late_sources_float[index_md][index_ic_tp][inf*ppt->k_size[index_md]+index_k];
+        rows[2*ppt->k_size[index_md]+index_k] = (double)ppt->ddlate_sources_float[index_md][index_ic_tp][inf*ppt->k_size[index_md]+index_k];
+      }
+      else {
+        rows[index_k] = (double)ppt->sources_float[index_md][index_ic_tp][inf*ppt->k_size[index_md]+index_k];
+      }
+    }
+
+    if (do_spline == _TRUE_) {
+      class_call_except(array_interpolate_spline(x_array+inf,
+                                                 2,
+                                                 rows,
+                                                 rows+2*ppt->k_size[index_md],
+                                                 ppt->k_size[index_md],
+                                                 logtau,
+                                                 &last_index,
+                                                 psource_at_tau,
+                                                 ppt->k_size[index_md],
+                                                 ppt->error_message),
+                        ppt->error_message,
+                        ppt->error_message,
+                        free(rows));
+    }
+    else {
+      class_call_except(array_interpolate_two_bis(x_array+inf,
+                                                  1,
+                                                  0,
+                                                  rows,
+                                                  ppt->k_size[index_md],
+                                                  2,
+                                                  tau,
+                                                  psource_at_tau,
+                                                  ppt->k_size[index_md],
+                                                  ppt->error_message),
+                        ppt->error_message,
+                        ppt->error_message,
+                        free(rows));
+    }
+
+    free(rows);
+
+    return _SUCCESS_;
+  }
+
   /** - If yes, we do such a spline */
 
   if (do_spline == _TRUE_) {
@@ -285,7 +400,7 @@ int perturbations_output_data_at_z(
       for (index_tp=0; index_tp<ppt->tp_size[index_md]; index_tp++) {
         for (index_ic=0; index_ic<ppt->ic_size[index_md]; index_ic++) {
           tkfull[(index_k * ppt->ic_size[index_md] + index_ic) * ppt->tp_size[index_md] + index_tp]
-            = ppt->sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp][(ppt->tau_size-1) * ppt->k_size[index_md] + index_k];
+            = _source_value_(ppt,index_md,index_ic * ppt->tp_size[index_md] + index_tp,(ppt->tau_size-1) * ppt->k_size[index_md] + index_k);
         }
       }
     }
@@ -391,7 +506,7 @@ int perturbations_output_data_at_index_tau(
     for (index_tp=0; index_tp<ppt->tp_size[index_md]; index_tp++) {
       for (index_ic=0; index_ic<ppt->ic_size[index_md]; index_ic++) {
         tkfull[(index_k * ppt->ic_size[index_md] + index_ic) * ppt->tp_size[index_md] + index_tp]
-          = ppt->late_sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp][index_tau * ppt->k_size[index_md] + index_k];
+          = _late_source_value_(ppt,index_md,index_ic * ppt->tp_size[index_md] + index_tp,index_tau * ppt->k_size[index_md] + index_k);
       }
     }
   }
@@ -710,12 +825,24 @@ int perturbations_init(
   int index_tp;
   /* background quantities */
   double w_fld_ini, w_fld_0,dw_over_da_fld,integral_fld;
+  /* list of (mode, initial condition, wavenumber) tasks */
+  struct perturbations_task * task_list;
+  int task_size;
+  int index_task;
+  /* start time, end time and worker of each task (only for verbose > 1) */
+  double * task_time = NULL;
+  /* identifier of this run, for the data kept in the workspaces */
+  unsigned long run_id;
+
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(ppt->stats));
 
   /** - perform preliminary checks */
 
   if (ppt->has_perturbations == _FALSE_) {
     if (ppt->perturbations_verbose > 0)
       printf("No sources requested. Perturbation module skipped.\n");
+    class_timer_end(&(ppt->stats));
     return _SUCCESS_;
   }
   else {
@@ -732,6 +859,11 @@ int perturbations_init(
               ppt->error_message,
               "your tight_coupling_approximation is set to %d, out of range defined in perturbations.h",ppr->tight_coupling_approximation);
 
+  class_test ((ppr->perturbations_k_schedule < k_schedule_reverse) ||
+              (ppr->perturbations_k_schedule > k_schedule_cost),
+              ppt->error_message,
+              "your perturbations_k_schedule is set to %d, out of range defined in perturbations.h",ppr->perturbations_k_schedule);
+
   class_test ((ppr->radiation_streaming_approximation < rsa_null) ||
               (ppr->radiation_streaming_approximation > rsa_none),
               ppt->error_message,
@@ -891,72 +1023,250 @@ int perturbations_init(
              ppt->error_message,
              ppt->error_message);
 
+  /** - tabulate the approximation switches on a coarse grid of wavenumbers, from which perturbations_find_approximation_switches() starts its bisections */
+  class_call(perturbations_tabulate_approximation_switches(ppr,
+                                                           pba,
+                                                           pth,
+                                                           ppt),
+             ppt->error_message,
+             ppt->error_message);
+
+  /** - list all the (mode, initial condition, wavenumber) tasks, in the order in which they should be dispatched */
+  class_call(perturbations_schedule_tasks(ppr,
+                                          pba,
+                                          pth,
+                                          ppt,
+                                          &task_size,
+                                          &task_list),
+             ppt->error_message,
+             ppt->error_message);
+
+  if (ppt->perturbations_verbose > 1) {
+    class_alloc(task_time,3*task_size*sizeof(double),ppt->error_message);
+  }
+
+  run_id = ++perturbations_run_count;
+
   /* Setup task system */
   class_setup_parallel();
-  /** - loop over modes (scalar, tensors, etc). For each mode: */
-  for (index_md = 0; index_md < ppt->md_size; index_md++) {
 
-    if (ppt->perturbations_verbose > 1)
-      printf("Evolving mode %d/%d\n",index_md+1,ppt->md_size);
+  /** - loop over tasks; for each of them, evolve perturbations and compute source functions with perturbations_solve()
+      (with MPI, only over the tasks of this process, see perturbations_task_rank()) */
+  for (index_task = 0; index_task < task_size; index_task++) {
 
-    /** - --> loop over initial conditions and wavenumbers; for each of them, evolve perturbations and compute source functions with perturbations_solve() */
+    if (perturbations_task_rank(ppt,task_list,index_task) != class_mpi_rank())
+      continue;
 
-    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+    /** - --> with the rk_batch evolver, the next perturbations_batch_size tasks of this process are evolved together by perturbations_solve_batch() */
+    if (ppr->evolver == rk_batch) {
 
-      if (ppt->perturbations_verbose > 1) {
-        printf("Evolving ic %d/%d\n",index_ic+1,ppt->ic_size[index_md]);
-        printf("evolving %d wavenumbers\n",ppt->k_size[index_md]);
+      int * batch_task;
+      int batch_size = 0;
+      int index_batch_task;
+
+      class_alloc(batch_task,MAX(ppr->perturbations_batch_size,1)*sizeof(int),ppt->error_message);
+      for (index_batch_task = index_task;
+           (index_batch_task < task_size) && (batch_size < MAX(ppr->perturbations_batch_size,1));
+           index_batch_task++) {
+        if (perturbations_task_rank(ppt,task_list,index_batch_task) == class_mpi_rank())
+          batch_task[batch_size++] = index_batch_task;
       }
+      index_task = batch_task[batch_size-1];
 
-      /* integrating backwards is slightly more optimal for parallel runs */
-      //for (index_k = 0; index_k < ppt->k_size; index_k++) {
-      for (index_k = ppt->k_size[index_md]-1; index_k >=0; index_k--) {
+      class_label_parallel("perturbations:index_k",task_list[batch_task[0]].index_k);
+      class_run_parallel(with_arguments(ppr,pba,pth,ppt,task_list,task_time,batch_task,batch_size),
+
+        struct perturbations_batch_lane * lanes;
+        struct perturbations_task * ptask;
+        int index_lane;
+        int lane_size = 0;
+        int status = _SUCCESS_;
+        struct timeval declare_list_of_variables_inside_parallel_region(task_begin, task_end);
+
+        if (task_time != NULL) {
+          gettimeofday(&task_begin, 0);
+        }
 
-        class_run_parallel(with_arguments(ppr,pba,pth,ppt,index_md,index_ic,index_k),
+        /* each lane has its own workspace, allocated for this batch */
+        lanes = (struct perturbations_batch_lane *) calloc(batch_size,sizeof(struct perturbations_batch_lane));
+        if (lanes == NULL) {
+          class_sprintf(ppt->error_message,"could not allocate the %d lanes of a batch",batch_size);
+          free(batch_task);
+          return _FAILURE_;
+        }
 
+        for (index_lane = 0; (index_lane < batch_size) && (status == _SUCCESS_); index_lane++) {
+          ptask = &(task_list[batch_task[index_lane]]);
           if (ppt->perturbations_verbose > 2) {
-            printf("evolving mode k=%e /Mpc  (%d/%d)",ppt->k[index_md][index_k],index_k+1,ppt->k_size[index_md]);
+            printf("evolving mode k=%e /Mpc  (%d/%d)",ppt->k[ptask->index_md][ptask->index_k],ptask->index_k+1,ppt->k_size[ptask->index_md]);
             if (pba->sgnK != 0)
-              printf(" (for scalar modes, corresponds to nu=%e)",sqrt(ppt->k[index_md][index_k]*ppt->k[index_md][index_k]+pba->K)/sqrt(pba->sgnK*pba->K));
+              printf(" (for scalar modes, corresponds to nu=%e)",sqrt(ppt->k[ptask->index_md][ptask->index_k]*ppt->k[ptask->index_md][ptask->index_k]+pba->K)/sqrt(pba->sgnK*pba->K));
             printf("\n");
           }
+          lanes[index_lane].ptask = ptask;
+          lanes[index_lane].ppw = (struct perturbations_workspace *) calloc(1,sizeof(struct perturbations_workspace));
+          if (lanes[index_lane].ppw == NULL) {
+            class_sprintf(ppt->error_message,"could not allocate the workspace of lane %d",index_lane);
+            status = _FAILURE_;
+            break;
+          }
+          status = perturbations_workspace_init(ppr,pba,pth,ppt,ptask->index_md,lanes[index_lane].ppw);
+          if (status == _SUCCESS_)
+            lane_size++;
+          else
+            free(lanes[index_lane].ppw);
+        }
+
+        if (status == _SUCCESS_) {
+          status = perturbations_solve_batch(ppr,pba,pth,ppt,lane_size,lanes);
+        }
+
+        for (index_lane = 0; index_lane < lane_size; index_lane++) {
+          lanes[index_lane].ptask->allocations = lanes[index_lane].ppw->allocation_count;
+          if (perturbations_workspace_free(ppt,lanes[index_lane].ptask->index_md,lanes[index_lane].ppw) == _FAILURE_)
+            status = _FAILURE_;
+          free(lanes[index_lane].ppw);
+        }
+        free(lanes);
+
+        /* the batch is timed as its first task */
+        if (task_time != NULL) {
+          gettimeofday(&task_end, 0);
+          for (index_lane = 0; index_lane < batch_size; index_lane++) {
+            task_time[3*batch_task[index_lane]] = (index_lane == 0) ? task_begin.tv_sec + 1.e-6*task_begin.tv_usec : task_end.tv_sec + 1.e-6*task_end.tv_usec;
+            task_time[3*batch_task[index_lane]+1] = task_end.tv_sec + 1.e-6*task_end.tv_usec;
+            task_time[3*batch_task[index_lane]+2] = Tools::TaskSystem::CurrentWorker();
+          }
+        }
 
-          struct perturbations_workspace pw;
-          class_call(perturbations_workspace_init(ppr,
-                                                  pba,
-                                                  pth,
-                                                  ppt,
-                                                  index_md,
-                                                  &pw),
-                     ppt->error_message,
-                     ppt->error_message);
+        free(batch_task);
 
-          class_call(perturbations_solve(ppr,
-                                         pba,
-                                         pth,
-                                         ppt,
-                                         index_md,
-                                         index_ic,
-                                         index_k,
-                                         &pw),
-                     ppt->error_message,
-                     ppt->error_message);
+        return status;
 
-          class_call(perturbations_workspace_free(ppt,index_md,&pw),
-                     ppt->error_message,
-                     ppt->error_message);
-          return _SUCCESS_;
+      );
+
+      continue;
+    }
+
+    class_label_parallel("perturbations:index_k",task_list[index_task].index_k);
+    class_run_parallel(with_arguments(ppr,pba,pth,ppt,task_list,task_time,index_task,run_id),
+
+      int index_md = task_list[index_task].index_md;
+      int index_ic;
+      int index_k = task_list[index_task].index_k;
+      struct timeval declare_list_of_variables_inside_parallel_region(task_begin, task_end);
+
+      if (task_time != NULL) {
+        gettimeofday(&task_begin, 0);
+      }
+
+      if (ppt->perturbations_verbose > 2) {
+        printf("evolving mode k=%e /Mpc  (%d/%d)",ppt->k[index_md][index_k],index_k+1,ppt->k_size[index_md]);
+        if (pba->sgnK != 0)
+          printf(" (for scalar modes, corresponds to nu=%e)",sqrt(ppt->k[index_md][index_k]*ppt->k[index_md][index_k]+pba->K)/sqrt(pba->sgnK*pba->K));
+        printf("\n");
+      }
+
+      /* use the workspace of this thread for this mode (or a temporary
+         one if it is already in use further up in the call stack) */
+      struct perturbations_workspace pw_temporary;
+      struct perturbations_workspace * ppw = &(perturbations_arena.workspace[index_md]);
+      int allocation_count;
+
+      if (ppw->is_in_use == _TRUE_) {
+        memset(&pw_temporary,0,sizeof(struct perturbations_workspace));
+        ppw = &pw_temporary;
+      }
+      ppw->is_in_use = _TRUE_;
+      allocation_count = ppw->allocation_count;
+
+      /* the sparsity patterns of the jacobian only hold within one run */
+      if (ppw->jacobian_pattern_run != run_id) {
+        ppw->jacobian_pattern_size = 0;
+        ppw->jacobian_pattern_run = run_id;
+      }
+
+      class_call_except(perturbations_workspace_init(ppr,
+                                                     pba,
+                                                     pth,
+                                                     ppt,
+                                                     index_md,
+                                                     ppw),
+                        ppt->error_message,
+                        ppt->error_message,
+                        ppw->is_in_use = _FALSE_);
+
+      for (index_ic = task_list[index_task].index_ic;
+           index_ic < task_list[index_task].index_ic+task_list[index_task].ic_size;
+           index_ic++) {
+        class_call_except(perturbations_solve(ppr,
+                                              pba,
+                                              pth,
+                                              ppt,
+                                              index_md,
+                                              index_ic,
+                                              index_k,
+                                              ppw),
+                          ppt->error_message,
+                          ppt->error_message,
+                          ppw->is_in_use = _FALSE_);
+      }
+
+      task_list[index_task].allocations = ppw->allocation_count - allocation_count;
+      ppw->is_in_use = _FALSE_;
+
+      if (ppw == &pw_temporary) {
+        class_call(perturbations_workspace_free(ppt,index_md,ppw),
+                   ppt->error_message,
+                   ppt->error_message);
+      }
+
+      if (task_time != NULL) {
+        gettimeofday(&task_end, 0);
+        task_time[3*index_task] = task_begin.tv_sec + 1.e-6*task_begin.tv_usec;
+        task_time[3*index_task+1] = task_end.tv_sec + 1.e-6*task_end.tv_usec;
+        task_time[3*index_task+2] = Tools::TaskSystem::CurrentWorker();
+      }
 
-        );
+      return _SUCCESS_;
 
-      } /* end of loop over wavenumbers */
+    );
+
+  } /* end of loop over tasks */
+
+  /** - with MPI, all processes fail if one of them did, and otherwise
+      send the sources they computed to the others */
+  class_call(class_mpi_agree(task_system.WaitAll(),ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
 
-    } /* end of loop over initial conditions */
+  if (class_mpi_size() > 1) {
+    class_call(perturbations_share_sources(ppt,task_size,task_list),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
-  } /* end loop over modes */
+  /** - if requested, report how well the tasks were balanced among threads (of a single process) */
+  if ((task_time != NULL) && (class_mpi_size() > 1)) {
+    free(task_time);
+    task_time = NULL;
+  }
+  if (task_time != NULL) {
+    class_call(perturbations_print_load_balance(ppt,
+                                                task_size,
+                                                task_list,
+                                                task_time,
+                                                task_system.get_num_threads()),
+               ppt->error_message,
+               ppt->error_message);
+    free(task_time);
+  }
 
-  class_finish_parallel();
+  free(task_list);
 
+  class_call(perturbations_free_approximation_switches(ppt),
+             ppt->error_message,
+             ppt->error_message);
 
   /** - spline the source array with respect to the time variable */
 
@@ -968,9 +1278,8 @@ int perturbations_init(
 
       for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
 
-        for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
-
-          class_run_parallel(with_arguments(ppt, index_md, index_ic, index_tp),
+        class_label_parallel("perturbations:source_spline",0);
+        class_parallel_for(index_tp, 0, ppt->tp_size[index_md], 0, with_arguments(ppt, index_md, index_ic),
             class_call(array_spline_table_lines(ppt->ln_tau,
                                                 ppt->ln_tau_size,
                                                 ppt->late_sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
@@ -981,9 +1290,7 @@ int perturbations_init(
                        ppt->error_message,
                        ppt->error_message);
             return _SUCCESS_;
-          );
-
-        } /* end of loop over type of source function*/
+          ); /* end of loop over type of source function*/
 
       } /* end of loop over initial condition */
 
@@ -992,154 +1299,703 @@ int perturbations_init(
     class_finish_parallel();
   }
 
-  ppt->is_allocated = _TRUE_;
-
-  return _SUCCESS_;
-}
-
-/**
- * Free all memory space allocated by input.
- *
- * Called by perturbations_free(), during shooting and if shooting failed
- *
- * @param ppt Input: perturbation structure with input pointers to be freed
- * @return the error status
- */
+  /** - if requested, store the source functions with less precision */
+  if (ppt->storage != sources_storage_double) {
+    class_call(perturbations_storage_convert(ppt),
+               ppt->error_message,
+               ppt->error_message);
+  }
 
-int perturbations_free_input(struct perturbations* ppt) {
+  ppt->is_allocated = _TRUE_;
 
-  if (ppt->alpha_idm_dr != NULL)
-    free(ppt->alpha_idm_dr);
-  if (ppt->beta_idr != NULL)
-    free(ppt->beta_idr);
+  class_timer_end(&(ppt->stats));
 
   return _SUCCESS_;
 }
 
 /**
- * Free all memory space allocated by perturbations_init().
- *
- * To be called at the end of each run, only when no further calls to
- * perturbations_sources_at_tau() are needed.
+ * Replace the tables of source functions (and of their second
+ * derivative in time at late times) computed in double precision by
+ * their single precision version, according to ppt->storage, in order
+ * to reduce the memory used by the perturbation structure and the
+ * memory traffic of the modules reading it. The double precision
+ * tables are freed. The largest error introduced by the conversion,
+ * relative to the maximum of the absolute value of each source over
+ * time and wavenumber, is stored in ppt->storage_error.
  *
- * @param ppt Input: perturbation structure to be freed
+ * @param ppt Input/output: pointer to perturbation structure
  * @return the error status
  */
 
-int perturbations_free(
-                       struct perturbations * ppt
-                       ) {
+int perturbations_storage_convert(
+                                  struct perturbations * ppt
+                                  ) {
 
-  int index_md,index_ic,index_tp;
-  int filenum;
+  int index_md, index_ic_tp, tp_size;
+  size_t index, size, late_size, size_double = 0;
+  double max;
+  double * table;
+  float * table_float;
 
-  perturbations_free_input(ppt);
+  ppt->storage_error = 0.;
 
-  if (ppt->has_perturbations == _TRUE_) {
+  class_alloc(ppt->sources_float,ppt->md_size*sizeof(float**),ppt->error_message);
+  class_alloc(ppt->late_sources_float,ppt->md_size*sizeof(float**),ppt->error_message);
+  class_alloc(ppt->ddlate_sources_float,ppt->md_size*sizeof(float**),ppt->error_message);
 
-    for (index_md = 0; index_md < ppt->md_size; index_md++) {
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
 
-      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+    tp_size = ppt->ic_size[index_md]*ppt->tp_size[index_md];
+    size = (size_t)ppt->k_size[index_md]*ppt->tau_size;
+    late_size = (size_t)ppt->k_size[index_md]*ppt->ln_tau_size;
 
-        for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
+    class_alloc(ppt->sources_float[index_md],tp_size*sizeof(float*),ppt->error_message);
+    class_alloc(ppt->late_sources_float[index_md],tp_size*sizeof(float*),ppt->error_message);
+    class_alloc(ppt->ddlate_sources_float[index_md],tp_size*sizeof(float*),ppt->error_message);
 
-          free(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp]);
-          if (ppt->ln_tau_size > 1)
-            free(ppt->ddlate_sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp]);
+    for (index_ic_tp = 0; index_ic_tp < tp_size; index_ic_tp++) {
+
+      /* source function */
+      table = ppt->sources[index_md][index_ic_tp];
+      class_alloc_large(table_float,size*sizeof(float),ppt->error_message);
 
+      max = 0.;
+      for (index = 0; index < size; index++) {
+        table_float[index] = (float)table[index];
+        max = MAX(max,fabs(table[index]));
+      }
+      if (max > 0.) {
+        for (index = 0; index < size; index++) {
+          ppt->storage_error = MAX(ppt->storage_error,fabs((double)table_float[index]-table[index])/max);
         }
       }
 
-      free(ppt->sources[index_md]);
-      free(ppt->late_sources[index_md]);
-      free(ppt->ddlate_sources[index_md]);
+      class_free_large(table);
+      ppt->sources[index_md][index_ic_tp] = NULL;
+      ppt->sources_float[index_md][index_ic_tp] = table_float;
+      size_double += size;
 
-      free(ppt->k[index_md]);
+      /* its late part and second derivative in time at late times */
+      ppt->late_sources_float[index_md][index_ic_tp] = NULL;
+      ppt->ddlate_sources_float[index_md][index_ic_tp] = NULL;
 
-    }
+      if (ppt->ln_tau_size > 1) {
 
-    free(ppt->tau_sampling);
-    if (ppt->ln_tau_size > 1)
-      free(ppt->ln_tau);
+        ppt->late_sources[index_md][index_ic_tp] = NULL;
+        ppt->late_sources_float[index_md][index_ic_tp] = table_float + (ppt->tau_size-ppt->ln_tau_size)*ppt->k_size[index_md];
 
-    free(ppt->tp_size);
+        table = ppt->ddlate_sources[index_md][index_ic_tp];
+        class_alloc(table_float,late_size*sizeof(float),ppt->error_message);
+        for (index = 0; index < late_size; index++) {
+          table_float[index] = (float)table[index];
+        }
 
-    free(ppt->ic_size);
+        free(table);
+        ppt->ddlate_sources[index_md][index_ic_tp] = NULL;
+        ppt->ddlate_sources_float[index_md][index_ic_tp] = table_float;
+        size_double += late_size;
+      }
+    }
+  }
 
-    free(ppt->k);
+  if (ppt->perturbations_verbose > 0) {
+    printf(" -> source functions stored in single precision (%.1f MB instead of %.1f MB), maximum relative error %.2e\n",
+           size_double*sizeof(float)/1048576.,
+           size_double*sizeof(double)/1048576.,
+           ppt->storage_error);
+  }
 
-    free(ppt->k_size_cmb);
+  return _SUCCESS_;
+}
 
-    free(ppt->k_size_cl);
+/**
+ * A priori estimate of the cost of evolving one wavenumber.
+ *
+ * The cost of perturbations_solve() is dominated by the number of
+ * integration steps. These are of three kinds: one (or a few) per
+ * oscillation of the photon-baryon fluid, as long as photons are not
+ * in the radiation streaming regime; a fixed overhead after each
+ * switch of approximation (new vector, new Jacobian); and one stop
+ * per point of tau_sampling at which sources are stored. The weights
+ * below are only meant to rank the tasks, not to predict timings.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param pba      Input: pointer to background structure
+ * @param pth      Input: pointer to thermodynamics structure
+ * @param ppt      Input: pointer to the perturbation structure
+ * @param index_md Input: index of mode
+ * @param k        Input: wavenumber
+ * @param cost     Output: estimated cost (arbitrary units)
+ * @return the error status
+ */
 
-    free(ppt->k_size);
+int perturbations_estimate_cost(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct thermodynamics * pth,
+                                struct perturbations * ppt,
+                                int index_md,
+                                double k,
+                                double * cost
+                                ) {
+
+  /* number of steps per oscillation period, and after each approximation switch */
+  double steps_per_oscillation = 10.;
+  double steps_per_switch = 20.;
+
+  double tau_end;
+  double tau_oscillation_end;
+  int number_of_switches = 0;
+  int n_ncdm;
 
-    free(ppt->sources);
-    free(ppt->late_sources);
-    free(ppt->ddlate_sources);
+  tau_end = ppt->tau_sampling[ppt->tau_size-1];
 
-    /** Stuff related to perturbations output: */
+  /** - oscillations last until free-streaming of photons is switched on */
+  tau_oscillation_end = tau_end;
+  if ((index_md == ppt->index_md_scalars) && (ppr->radiation_streaming_approximation != rsa_none)) {
+    tau_oscillation_end = MIN(tau_end,
+                              MAX(ppr->radiation_streaming_trigger_tau_over_tau_k/k,
+                                  pth->tau_free_streaming));
+    if (tau_oscillation_end < tau_end)
+      number_of_switches++;
+  }
 
-    /** - Free non-NULL pointers */
-    if (ppt->k_output_values_num > 0 )
-      free(ppt->index_k_output_values);
+  /** - count the other approximation switches taking place before tau_end */
+  /* tight-coupling is always switched off at some point for scalars */
+  if (index_md == ppt->index_md_scalars)
+    number_of_switches++;
 
-    for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++){
-      if (ppt->scalar_perturbations_data[filenum] != NULL)
-        free(ppt->scalar_perturbations_data[filenum]);
-      if (ppt->vector_perturbations_data[filenum] != NULL)
-        free(ppt->vector_perturbations_data[filenum]);
-      if (ppt->tensor_perturbations_data[filenum] != NULL)
-        free(ppt->tensor_perturbations_data[filenum]);
-    }
+  if ((pba->has_ur == _TRUE_) && (ppr->ur_fluid_approximation != ufa_none)
+      && (ppr->ur_fluid_trigger_tau_over_tau_k/k < tau_end))
+    number_of_switches++;
 
+  if (pba->has_ncdm == _TRUE_) {
+    for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++) {
+      if ((ppr->ncdm_fluid_approximation != ncdmfa_none)
+          && (ppr->ncdm_fluid_trigger_tau_over_tau_k/k < tau_end))
+        number_of_switches++;
+    }
   }
 
-  ppt->is_allocated = _FALSE_;
+  *cost = ppt->tau_size
+    + steps_per_oscillation * k * tau_oscillation_end / _TWOPI_
+    + steps_per_switch * number_of_switches;
+
   return _SUCCESS_;
+}
 
+/**
+ * Comparison function ranking tasks by decreasing cost (for qsort)
+ */
+
+static int perturbations_compare_tasks(const void * a,
+                                       const void * b) {
+  const struct perturbations_task * task_a = (const struct perturbations_task *) a;
+  const struct perturbations_task * task_b = (const struct perturbations_task *) b;
+  if (task_a->cost > task_b->cost)
+    return -1;
+  if (task_a->cost < task_b->cost)
+    return 1;
+  /* stay deterministic for equal costs */
+  return (task_b->index_k - task_a->index_k);
 }
 
 /**
- * Initialize all indices and allocate most arrays in perturbations structure.
+ * Establish the list of all (mode, initial condition, wavenumber)
+ * tasks of perturbations_init(), in the order in which they will be
+ * sent to the thread pool.
  *
- * @param ppr Input: pointer to precision structure
- * @param pba Input: pointer to background structure
- * @param pth Input: pointer to thermodynamics structure
- * @param ppt Input/Output: Initialized perturbation structure
+ * With k_schedule_reverse, wavenumbers are sent by decreasing k for
+ * each mode and initial condition. With k_schedule_cost, all tasks are
+ * sorted by decreasing estimated cost (longest processing time first),
+ * such that the last tasks left in the queues are the cheapest ones.
+ *
+ * @param ppr       Input: pointer to precision structure
+ * @param pba       Input: pointer to background structure
+ * @param pth       Input: pointer to thermodynamics structure
+ * @param ppt       Input: pointer to the perturbation structure
+ * @param task_size Output: number of tasks
+ * @param task_list Output: list of tasks, allocated here, to be freed by the caller
  * @return the error status
  */
 
-int perturbations_indices(
-                          struct precision * ppr,
-                          struct background * pba,
-                          struct thermodynamics * pth,
-                          struct perturbations * ppt
-                          ) {
-
-  /** Summary: */
-
-  /** - define local variables */
+int perturbations_schedule_tasks(
+                                 struct precision * ppr,
+                                 struct background * pba,
+                                 struct thermodynamics * pth,
+                                 struct perturbations * ppt,
+                                 int * task_size,
+                                 struct perturbations_task ** task_list
+                                 ) {
 
-  int index_type;
   int index_md;
   int index_ic;
-  int index_type_common;
-  int filenum;
+  int index_k;
+  int index_task;
+  int index_ikout;
+  short is_output_k;
 
-  /** - count modes (scalar, vector, tensor) and assign corresponding indices */
+  *task_size = 0;
+  for (index_md = 0; index_md < ppt->md_size; index_md++)
+    *task_size += ppt->ic_size[index_md]*ppt->k_size[index_md];
 
-  index_md = 0;
-  class_define_index(ppt->index_md_scalars,ppt->has_scalars,index_md,1);
-  class_define_index(ppt->index_md_vectors,ppt->has_vectors,index_md,1);
-  class_define_index(ppt->index_md_tensors,ppt->has_tensors,index_md,1);
-  ppt->md_size = index_md;
+  class_alloc(*task_list,MAX(*task_size,1)*sizeof(struct perturbations_task),ppt->error_message);
 
-  class_test(index_md == 0,
-             ppt->error_message,
-             "you should have at least one out of {scalars, vectors, tensors} !!!");
+  index_task = 0;
 
-  /** - allocate array of number of types for each mode, ppt->tp_size[index_md] */
+  /** - loop over modes (scalar, tensors, etc), initial conditions and wavenumbers */
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+
+    if (ppt->perturbations_verbose > 1)
+      printf("Evolving mode %d/%d\n",index_md+1,ppt->md_size);
+
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+
+      if (ppt->perturbations_verbose > 1) {
+        printf("Evolving ic %d/%d\n",index_ic+1,ppt->ic_size[index_md]);
+        printf("evolving %d wavenumbers\n",ppt->k_size[index_md]);
+      }
+
+      /* integrating backwards is slightly more optimal for parallel runs */
+      for (index_k = ppt->k_size[index_md]-1; index_k >=0; index_k--) {
+
+        /* the rows of the output tables of k_output_values must be
+           appended by one thread, one initial condition after the other */
+        is_output_k = _FALSE_;
+        for (index_ikout=0; index_ikout<ppt->k_output_values_num; index_ikout++){
+          if (ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout] == index_k)
+            is_output_k = _TRUE_;
+        }
+        if ((is_output_k == _TRUE_) && (index_ic > 0))
+          continue;
+
+        (*task_list)[index_task].index_md = index_md;
+        (*task_list)[index_task].index_ic = index_ic;
+        (*task_list)[index_task].ic_size = (is_output_k == _TRUE_) ? ppt->ic_size[index_md] : 1;
+        (*task_list)[index_task].index_k = index_k;
+        (*task_list)[index_task].allocations = 0;
+
+        class_call(perturbations_estimate_cost(ppr,
+                                               pba,
+                                               pth,
+                                               ppt,
+                                               index_md,
+                                               ppt->k[index_md][index_k],
+                                               &((*task_list)[index_task].cost)),
+                   ppt->error_message,
+                   ppt->error_message);
+        (*task_list)[index_task].cost *= (*task_list)[index_task].ic_size;
+
+        index_task++;
+      }
+    }
+  }
+  *task_size = index_task;
+
+  /** - in cost mode, dispatch the most expensive tasks first */
+  if (ppr->perturbations_k_schedule == k_schedule_cost) {
+    qsort(*task_list,*task_size,sizeof(struct perturbations_task),perturbations_compare_tasks);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Process which evolves a given task of perturbations_init() when the
+ * run is distributed over several MPI processes. The tasks being sorted
+ * by decreasing cost, dealing them in turn to the processes balances
+ * the load; the wavenumbers of k_output_values all go to the first
+ * process, which writes the output files.
+ *
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param task_list  Input: list of tasks
+ * @param index_task Input: index of the task
+ * @return the rank of the process
+ */
+
+int perturbations_task_rank(
+                            struct perturbations * ppt,
+                            struct perturbations_task * task_list,
+                            int index_task
+                            ) {
+
+  int index_ikout;
+  int num_processes = class_mpi_size();
+
+  if (num_processes == 1)
+    return 0;
+
+  for (index_ikout=0; index_ikout<ppt->k_output_values_num; index_ikout++) {
+    if (ppt->index_k_output_values[task_list[index_task].index_md*ppt->k_output_values_num+index_ikout] == task_list[index_task].index_k)
+      return 0;
+  }
+
+  return index_task % num_processes;
+}
+
+/**
+ * After the loop of perturbations_init() distributed over several MPI
+ * processes, send the source functions computed by each process to
+ * all the others, one process after the other, such that all of them
+ * hold the full tables again.
+ *
+ * @param ppt       Input/Output: pointer to the perturbation structure
+ * @param task_size Input: number of tasks
+ * @param task_list Input: list of tasks
+ * @return the error status
+ */
+
+int perturbations_share_sources(
+                                struct perturbations * ppt,
+                                int task_size,
+                                struct perturbations_task * task_list
+                                ) {
+
+  int rank, index_task;
+  size_t count;
+  double * buffer;
+
+  for (rank = 0; rank < class_mpi_size(); rank++) {
+
+    /** - size of the sources computed by this process */
+    count = 0;
+    for (index_task = 0; index_task < task_size; index_task++) {
+      if (perturbations_task_rank(ppt,task_list,index_task) == rank)
+        count += (size_t)task_list[index_task].ic_size * ppt->tp_size[task_list[index_task].index_md] * ppt->tau_size;
+    }
+    if (count == 0)
+      continue;
+
+    /** - packed by this process, and unpacked by the others */
+    class_alloc(buffer,count*sizeof(double),ppt->error_message);
+
+    if (rank == class_mpi_rank())
+      perturbations_copy_sources(ppt,task_size,task_list,rank,buffer,_TRUE_);
+
+    class_call_except(class_mpi_broadcast(buffer,count,rank,ppt->error_message),
+                      ppt->error_message,
+                      ppt->error_message,
+                      free(buffer));
+
+    if (rank != class_mpi_rank())
+      perturbations_copy_sources(ppt,task_size,task_list,rank,buffer,_FALSE_);
+
+    free(buffer);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Copy the source functions of the tasks of one MPI process to (or
+ * from) a contiguous buffer, in the order of the tasks.
+ *
+ * @param ppt       Input/Output: pointer to the perturbation structure
+ * @param task_size Input: number of tasks
+ * @param task_list Input: list of tasks
+ * @param rank      Input: rank of the process
+ * @param buffer    Input/Output: the buffer
+ * @param to_buffer Input: _TRUE_ for copying the sources to the buffer, _FALSE_ for the opposite
+ */
+
+void perturbations_copy_sources(
+                                struct perturbations * ppt,
+                                int task_size,
+                                struct perturbations_task * task_list,
+                                int rank,
+                                double * buffer,
+                                int to_buffer
+                                ) {
+
+  int index_task, index_md, index_ic, index_tp, index_tau, index_k;
+  double * sources;
+  size_t index = 0;
+
+  for (index_task = 0; index_task < task_size; index_task++) {
+    if (perturbations_task_rank(ppt,task_list,index_task) != rank)
+      continue;
+    index_md = task_list[index_task].index_md;
+    index_k = task_list[index_task].index_k;
+    for (index_ic = task_list[index_task].index_ic; index_ic < task_list[index_task].index_ic+task_list[index_task].ic_size; index_ic++) {
+      for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
+        sources = ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp];
+        for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+          if (to_buffer == _TRUE_)
+            buffer[index++] = sources[index_tau*ppt->k_size[index_md]+index_k];
+          else
+            sources[index_tau*ppt->k_size[index_md]+index_k] = buffer[index++];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Print statistics on the load balance of the parallel loop of
+ * perturbations_init(): total wall time, efficiency (busy time
+ * divided by wall time times number of threads), ratio of the busiest
+ * thread to the average one, and time during which at least one
+ * thread was idle at the end of the loop. The correlation coefficient
+ * between estimated and measured costs tells whether the scheduling
+ * estimate can be trusted.
+ *
+ * @param ppt         Input: pointer to the perturbation structure
+ * @param task_size   Input: number of tasks
+ * @param task_list   Input: list of tasks
+ * @param task_time   Input: start time, end time and worker index of each task
+ * @param num_threads Input: number of threads of the pool
+ * @return the error status
+ */
+
+int perturbations_print_load_balance(
+                                     struct perturbations * ppt,
+                                     int task_size,
+                                     struct perturbations_task * task_list,
+                                     double * task_time,
+                                     int num_threads
+                                     ) {
+
+  double * busy;
+  double * last_end;
+  double t_begin, t_end, duration, busy_max, busy_tot, first_idle;
+  double sum_c=0., sum_t=0., sum_cc=0., sum_tt=0., sum_ct=0., correlation=0.;
+  int index_task, index_worker, num_workers;
+  int allocations = 0;
+
+  if (task_size == 0)
+    return _SUCCESS_;
+
+  /* the last slot collects the tasks executed by a waiting (non-worker) thread */
+  num_workers = num_threads+1;
+  class_calloc(busy,num_workers,sizeof(double),ppt->error_message);
+  class_calloc(last_end,num_workers,sizeof(double),ppt->error_message);
+
+  t_begin = task_time[0];
+  t_end = task_time[1];
+
+  for (index_task = 0; index_task < task_size; index_task++) {
+    index_worker = (int)task_time[3*index_task+2];
+    if ((index_worker < 0) || (index_worker >= num_threads))
+      index_worker = num_threads;
+    duration = task_time[3*index_task+1]-task_time[3*index_task];
+    busy[index_worker] += duration;
+    last_end[index_worker] = MAX(last_end[index_worker],task_time[3*index_task+1]);
+    t_begin = MIN(t_begin,task_time[3*index_task]);
+    t_end = MAX(t_end,task_time[3*index_task+1]);
+
+    sum_c += task_list[index_task].cost;
+    sum_t += duration;
+    sum_cc += task_list[index_task].cost*task_list[index_task].cost;
+    sum_tt += duration*duration;
+    sum_ct += task_list[index_task].cost*duration;
+    allocations += task_list[index_task].allocations;
+  }
+
+  busy_max = 0.;
+  busy_tot = 0.;
+  first_idle = t_end;
+  for (index_worker = 0; index_worker < num_threads; index_worker++) {
+    busy_max = MAX(busy_max,busy[index_worker]);
+    busy_tot += busy[index_worker];
+    if (last_end[index_worker] > 0.)
+      first_idle = MIN(first_idle,last_end[index_worker]);
+  }
+  busy_tot += busy[num_threads];
+  /* count the waiting thread too if it took part in the work */
+  busy_max = MAX(busy_max,busy[num_threads]);
+  if (busy[num_threads] > 0.)
+    num_threads++;
+
+  if ((task_size > 1) && ((task_size*sum_cc-sum_c*sum_c) > 0.) && ((task_size*sum_tt-sum_t*sum_t) > 0.)) {
+    correlation = (task_size*sum_ct-sum_c*sum_t)/sqrt((task_size*sum_cc-sum_c*sum_c)*(task_size*sum_tt-sum_t*sum_t));
+  }
+
+  printf(" -> evolved %d tasks on %d threads in %.3f s\n",task_size,num_threads,t_end-t_begin);
+  printf("    busy time %.3f s, efficiency %.1f%%, busiest thread %.3f s = %.2f times the average\n",
+         busy_tot,
+         100.*busy_tot/(num_threads*(t_end-t_begin)),
+         busy_max,
+         busy_max/(busy_tot/num_threads));
+  printf("    some threads idle during the last %.3f s, correlation between estimated and actual cost %.2f\n",
+         t_end-first_idle,
+         correlation);
+  printf("    %d workspace (re)allocations, i.e. %.2f per wavenumber\n",
+         allocations,
+         (double)allocations/task_size);
+
+  free(busy);
+  free(last_end);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free all memory space allocated by input.
+ *
+ * Called by perturbations_free(), during shooting and if shooting failed
+ *
+ * @param ppt Input: perturbation structure with input pointers to be freed
+ * @return the error status
+ */
+
+int perturbations_free_input(struct perturbations* ppt) {
+
+  if (ppt->alpha_idm_dr != NULL)
+    free(ppt->alpha_idm_dr);
+  if (ppt->beta_idr != NULL)
+    free(ppt->beta_idr);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free all memory space allocated by perturbations_init().
+ *
+ * To be called at the end of each run, only when no further calls to
+ * perturbations_sources_at_tau() are needed.
+ *
+ * @param ppt Input: perturbation structure to be freed
+ * @return the error status
+ */
+
+int perturbations_free(
+                       struct perturbations * ppt
+                       ) {
+
+  int index_md,index_ic,index_tp;
+  int filenum;
+
+  perturbations_free_input(ppt);
+
+  if (ppt->has_perturbations == _TRUE_) {
+
+    for (index_md = 0; index_md < ppt->md_size; index_md++) {
+
+      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+
+        for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
+
+          class_free_large(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp]);
+          if (ppt->ln_tau_size > 1)
+            free(ppt->ddlate_sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp]);
+
+          if (ppt->storage == sources_storage_float) {
+            class_free_large(ppt->sources_float[index_md][index_ic*ppt->tp_size[index_md]+index_tp]);
+            free(ppt->ddlate_sources_float[index_md][index_ic*ppt->tp_size[index_md]+index_tp]);
+          }
+
+        }
+      }
+
+      free(ppt->sources[index_md]);
+      free(ppt->late_sources[index_md]);
+      free(ppt->ddlate_sources[index_md]);
+
+      if (ppt->storage == sources_storage_float) {
+        free(ppt->sources_float[index_md]);
+        free(ppt->late_sources_float[index_md]);
+        free(ppt->ddlate_sources_float[index_md]);
+      }
+
+      free(ppt->k[index_md]);
+
+    }
+
+    free(ppt->tau_sampling);
+    free(ppt->pvecback_sampling);
+    free(ppt->pvecthermo_sampling);
+    if (ppt->ln_tau_size > 1)
+      free(ppt->ln_tau);
+
+    free(ppt->tp_size);
+
+    free(ppt->ic_size);
+
+    free(ppt->k);
+
+    free(ppt->k_size_cmb);
+
+    free(ppt->k_size_cl);
+
+    free(ppt->k_size);
+
+    free(ppt->sources);
+    free(ppt->late_sources);
+    free(ppt->ddlate_sources);
+    if (ppt->storage == sources_storage_float) {
+      free(ppt->sources_float);
+      free(ppt->late_sources_float);
+      free(ppt->ddlate_sources_float);
+    }
+
+    /** Stuff related to perturbations output: */
+
+    /** - Free non-NULL pointers */
+    if (ppt->k_output_values_num > 0 )
+      free(ppt->index_k_output_values);
+
+    for (filenum = 0; filenum<_MAX_NUMBER_OF_K_FILES_; filenum++){
+      if (ppt->scalar_perturbations_data[filenum] != NULL)
+        free(ppt->scalar_perturbations_data[filenum]);
+      if (ppt->vector_perturbations_data[filenum] != NULL)
+        free(ppt->vector_perturbations_data[filenum]);
+      if (ppt->tensor_perturbations_data[filenum] != NULL)
+        free(ppt->tensor_perturbations_data[filenum]);
+      if (ppt->scalar_perturbations_file[filenum] != NULL)
+        fclose(ppt->scalar_perturbations_file[filenum]);
+      if (ppt->vector_perturbations_file[filenum] != NULL)
+        fclose(ppt->vector_perturbations_file[filenum]);
+      if (ppt->tensor_perturbations_file[filenum] != NULL)
+        fclose(ppt->tensor_perturbations_file[filenum]);
+    }
+
+  }
+
+  ppt->is_allocated = _FALSE_;
+  return _SUCCESS_;
+
+}
+
+/**
+ * Initialize all indices and allocate most arrays in perturbations structure.
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to thermodynamics structure
+ * @param ppt Input/Output: Initialized perturbation structure
+ * @return the error status
+ */
+
+int perturbations_indices(
+                          struct precision * ppr,
+                          struct background * pba,
+                          struct thermodynamics * pth,
+                          struct perturbations * ppt
+                          ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_type;
+  int index_md;
+  int index_ic;
+  int index_type_common;
+  int filenum;
+
+  /** - count modes (scalar, vector, tensor) and assign corresponding indices */
+
+  index_md = 0;
+  class_define_index(ppt->index_md_scalars,ppt->has_scalars,index_md,1);
+  class_define_index(ppt->index_md_vectors,ppt->has_vectors,index_md,1);
+  class_define_index(ppt->index_md_tensors,ppt->has_tensors,index_md,1);
+  ppt->md_size = index_md;
+
+  class_test(index_md == 0,
+             ppt->error_message,
+             "you should have at least one out of {scalars, vectors, tensors} !!!");
+
+  /** - allocate array of number of types for each mode, ppt->tp_size[index_md] */
 
   class_alloc(ppt->tp_size,ppt->md_size*sizeof(int),ppt->error_message);
 
@@ -1165,6 +2021,9 @@ int perturbations_indices(
     ppt->scalar_perturbations_data[filenum] = NULL;
     ppt->vector_perturbations_data[filenum] = NULL;
     ppt->tensor_perturbations_data[filenum] = NULL;
+    ppt->scalar_perturbations_file[filenum] = NULL;
+    ppt->vector_perturbations_file[filenum] = NULL;
+    ppt->tensor_perturbations_file[filenum] = NULL;
   }
 
   /** - initialization of all flags to false (will eventually be set to true later) */
@@ -1521,6 +2380,9 @@ int perturbations_indices(
     ppt->scalar_perturbations_data[filenum] = NULL;
     ppt->vector_perturbations_data[filenum] = NULL;
     ppt->tensor_perturbations_data[filenum] = NULL;
+    ppt->scalar_perturbations_file[filenum] = NULL;
+    ppt->vector_perturbations_file[filenum] = NULL;
+    ppt->tensor_perturbations_file[filenum] = NULL;
   }
 
   return _SUCCESS_;
@@ -1576,6 +2438,7 @@ int perturbations_timesampling_for_sources(
   double a_primeprime_over_a;
   double * pvecback;
   double * pvecthermo;
+  int capacity;
 
   /** - allocate background/thermodynamics vectors */
 
@@ -1746,18 +2609,45 @@ int perturbations_timesampling_for_sources(
       timescale_source=1/(1/timescale_source1+1/timescale_source2); repeat till today.
       - --> if CMB not requested:
       timescale_source = 1/aH; repeat till today.
-  */
+      The last sampling point is exactly today.
+
+      The background and thermodynamics quantities looked up at each
+      sampling point to find the next one are kept in
+      ppt->pvecback_sampling and ppt->pvecthermo_sampling, which
+      perturbations_sources() then uses for each wavenumber: the arrays
+      grow with the number of points, such that the sampling is done in
+      a single pass. */
+
+  free(pvecback);
+  free(pvecthermo);
 
-  counter = 1;
+  counter = 0;
+  capacity = 0;
+  ppt->tau_sampling = NULL;
+  ppt->pvecback_sampling = NULL;
+  ppt->pvecthermo_sampling = NULL;
   last_index_back = first_index_back;
   last_index_thermo = first_index_thermo;
   tau = tau_ini;
 
-  while (tau < pba->conformal_age) {
+  while (_TRUE_) {
+
+    /** - --> (b.1.) store the point, with its background and thermodynamics quantities */
+
+    if (counter == capacity) {
+      capacity = MAX(2*capacity,256);
+      class_realloc(ppt->tau_sampling,capacity*sizeof(double),ppt->error_message);
+      class_realloc(ppt->pvecback_sampling,capacity*pba->bg_size_normal*sizeof(double),ppt->error_message);
+      class_realloc(ppt->pvecthermo_sampling,capacity*pth->th_size*sizeof(double),ppt->error_message);
+    }
+
+    ppt->tau_sampling[counter] = tau;
+    pvecback = ppt->pvecback_sampling+counter*pba->bg_size_normal;
+    pvecthermo = ppt->pvecthermo_sampling+counter*pth->th_size;
 
     class_call(background_at_tau(pba,
                                  tau,
-                                 short_info,
+                                 normal_info,
                                  inter_closeby,
                                  &last_index_back,
                                  pvecback),
@@ -1774,6 +2664,13 @@ int perturbations_timesampling_for_sources(
                pth->error_message,
                ppt->error_message);
 
+    counter++;
+
+    if (tau == pba->conformal_age)
+      break;
+
+    /** - --> (b.2.) find the next point */
+
     if (ppt->has_cmb == _TRUE_) {
 
       /* variation rate of thermodynamics variables */
@@ -1817,106 +2714,15 @@ int perturbations_timesampling_for_sources(
                "integration step =%e < machine precision : leads either to numerical error or infinite loop",ppr->perturbations_sampling_stepsize*timescale_source);
 
     tau = tau + ppr->perturbations_sampling_stepsize*timescale_source;
-    counter++;
 
+    /* last sampling point = exactly today */
+    if (tau >= pba->conformal_age)
+      tau = pba->conformal_age;
   }
 
   /** - --> infer total number of time steps, ppt->tau_size */
   ppt->tau_size = counter;
 
-  /** - --> allocate array of time steps, ppt->tau_sampling[index_tau] */
-  class_alloc(ppt->tau_sampling,ppt->tau_size * sizeof(double),ppt->error_message);
-
-  /** - --> repeat the same steps, now filling the array with each tau value: */
-
-  /** - --> (b.1.) first sampling point = when the universe stops being opaque */
-
-  counter = 0;
-  ppt->tau_sampling[counter]=tau_ini;
-
-  /** - --> (b.2.) next sampling point = previous + ppr->perturbations_sampling_stepsize * timescale_source, where
-      timescale_source1 = \f$ |g/\dot{g}| = |\dot{\kappa}-\ddot{\kappa}/\dot{\kappa}|^{-1} \f$;
-      timescale_source2 = \f$ |2\ddot{a}/a-(\dot{a}/a)^2|^{-1/2} \f$ (to sample correctly the late ISW effect; and
-      timescale_source=1/(1/timescale_source1+1/timescale_source2); repeat till today.
-      If CMB not requested:
-      timescale_source = 1/aH; repeat till today.  */
-
-  last_index_back = first_index_back;
-  last_index_thermo = first_index_thermo;
-  tau = tau_ini;
-
-  while (tau < pba->conformal_age) {
-
-    class_call(background_at_tau(pba,
-                                 tau,
-                                 short_info,
-                                 inter_closeby,
-                                 &last_index_back,
-                                 pvecback),
-               pba->error_message,
-               ppt->error_message);
-
-    class_call(thermodynamics_at_z(pba,
-                                   pth,
-                                   1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
-                                   inter_closeby,
-                                   &last_index_thermo,
-                                   pvecback,
-                                   pvecthermo),
-               pth->error_message,
-               ppt->error_message);
-
-    if (ppt->has_cmb == _TRUE_) {
-
-      /* variation rate of thermodynamics variables */
-      rate_thermo = pvecthermo[pth->index_th_rate];
-
-      /* variation rate of metric due to late ISW effect (important at late times) */
-      a_prime_over_a = pvecback[pba->index_bg_H] * pvecback[pba->index_bg_a];
-      a_primeprime_over_a = pvecback[pba->index_bg_H_prime] * pvecback[pba->index_bg_a]
-        + 2. * a_prime_over_a * a_prime_over_a;
-      rate_isw_squared = fabs(2.*a_primeprime_over_a-a_prime_over_a*a_prime_over_a);
-
-      /* compute rate */
-      timescale_source = sqrt(rate_thermo*rate_thermo+rate_isw_squared);
-    }
-    else {
-      a_prime_over_a = pvecback[pba->index_bg_H] * pvecback[pba->index_bg_a];
-      timescale_source = a_prime_over_a;
-    }
-
-    /* check it is non-zero */
-    class_test(timescale_source == 0.,
-               ppt->error_message,
-               "null evolution rate, integration is diverging");
-
-    /* compute inverse rate */
-    timescale_source = 1./timescale_source;
-
-    /* added in v3.2.2: age fraction (between 0 and 1 ) such that,
-       when tau > conformal_age * age_fraction, the time sampling of
-       sources is twice finer, in order to boost the accuracy of the
-       lensing line-of-sight integrals without changing that of
-       unlensed CMB observables */
-    if (tau > pba->conformal_age * ppr->perturbations_sampling_boost_above_age_fraction) {
-      timescale_source /= 2.;
-    }
-
-    class_test(fabs(ppr->perturbations_sampling_stepsize*timescale_source/tau) < ppr->smallest_allowed_variation,
-               ppt->error_message,
-               "integration step =%e < machine precision : leads either to numerical error or infinite loop",ppr->perturbations_sampling_stepsize*timescale_source);
-
-    tau = tau + ppr->perturbations_sampling_stepsize*timescale_source;
-    counter++;
-    ppt->tau_sampling[counter]=tau;
-
-  }
-
-  /** - last sampling point = exactly today */
-  ppt->tau_sampling[counter] = pba->conformal_age;
-
-  free(pvecback);
-  free(pvecthermo);
 
   /** - check the maximum redshift z_max_pk at which the Fourier
       transfer functions \f$ T_i(k,z)\f$ should be computable by
@@ -1985,9 +2791,13 @@ int perturbations_timesampling_for_sources(
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
       for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
 
-        class_alloc(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp],
-                    ppt->k_size[index_md] * ppt->tau_size * sizeof(double),
-                    ppt->error_message);
+        class_alloc_large(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp],
+                          ppt->k_size[index_md] * ppt->tau_size * sizeof(double),
+                          ppt->error_message);
+
+        /* spread its pages over the NUMA nodes of the workers filling it */
+        class_parallel_first_touch(ppt->sources[index_md][index_ic*ppt->tp_size[index_md]+index_tp],
+                                   ppt->k_size[index_md] * ppt->tau_size * sizeof(double));
 
         if (ppt->ln_tau_size > 1) {
           /* late_sources is just a pointer to the end of sources (starting from the relevant time index) */
@@ -2142,7 +2952,7 @@ int perturbations_get_k_list(
     if (ppt->has_nl_corrections_based_on_delta_m == _TRUE_)
       k_max = MAX(k_max,ppr->nonlinear_min_k_max);
 
-    if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (ppt->want_lcmb_full_limber == _TRUE_))
+    if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && ((ppt->want_lcmb_full_limber == _TRUE_) || (ppt->want_lcmb_direct_limber == _TRUE_)))
       k_max = MAX(k_max, ppr->k_max_limber_over_l_max_scalars * ppt->l_scalar_max);
 
     /** - --> test that result for k_min, k_max make sense */
@@ -2656,6 +3466,12 @@ int perturbations_get_k_list(
  * (scalar/../tensor). Then, for each thread, all initial conditions
  * and wavenumbers will use the same workspace.
  *
+ * Arrays are only (re)allocated when they are too small for the
+ * current run, so the same workspace can be initialized again for
+ * each wavenumber, and even for successive runs, without touching the
+ * allocator in steady state. The structure must be either
+ * zero-initialized or previously initialized by this function.
+ *
  * @param ppr        Input: pointer to precision structure
  * @param pba        Input: pointer to background structure
  * @param pth        Input: pointer to the thermodynamics structure
@@ -2681,6 +3497,7 @@ int perturbations_workspace_init(
   int index_mt=0;
   int index_ap;
   int l;
+  int n_ncdm,kernel_size;
 
   /** - Compute maximum l_max for any multipole */;
   if (_scalars_) {
@@ -2696,12 +3513,26 @@ int perturbations_workspace_init(
     if (pba->has_ncdm == _TRUE_) ppw->max_l_max = MAX(ppw->max_l_max, ppr->l_max_ncdm);
   }
 
+  /* lengths of the scalar hierarchies, until perturbations_find_l_max() chooses them for each wavenumber */
+  ppw->l_max_g = ppr->l_max_g;
+  ppw->l_max_pol_g = ppr->l_max_pol_g;
+  ppw->l_max_ur = ppr->l_max_ur;
+  ppw->l_max_ncdm = ppr->l_max_ncdm;
+
   /** - Allocate \f$ s_l\f$[ ] array for freestreaming of multipoles (see arXiv:1305.3261) and initialize
       to 1.0, which is the K=0 value. */
-  class_alloc(ppw->s_l, sizeof(double)*(ppw->max_l_max+1),ppt->error_message);
+  class_call(perturbations_workspace_reserve((void**)&(ppw->s_l),&(ppw->s_l_capacity),ppw->max_l_max+1,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
   for (l=0; l<=ppw->max_l_max; l++){
     ppw->s_l[l] = 1.0;
   }
+  class_call(perturbations_workspace_reserve((void**)&(ppw->s_l_minus),&(ppw->s_l_minus_capacity),ppw->max_l_max+1,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+  class_call(perturbations_workspace_reserve((void**)&(ppw->s_l_plus),&(ppw->s_l_plus_capacity),ppw->max_l_max+1,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
 
   /** - define indices of metric perturbations obeying constraint
       equations (this can be done once and for all, because the
@@ -2762,9 +3593,40 @@ int perturbations_workspace_init(
       values of background, thermodynamics, metric and source
       quantities at a given time */
 
-  class_alloc(ppw->pvecback,pba->bg_size*sizeof(double),ppt->error_message);
-  class_alloc(ppw->pvecthermo,pth->th_size*sizeof(double),ppt->error_message);
-  class_alloc(ppw->pvecmetric,ppw->mt_size*sizeof(double),ppt->error_message);
+  class_call(perturbations_workspace_reserve((void**)&(ppw->pvecback),&(ppw->pvecback_capacity),pba->bg_size,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+  class_call(perturbations_workspace_reserve((void**)&(ppw->pvecthermo),&(ppw->pvecthermo_capacity),pth->th_size,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+  class_call(perturbations_workspace_reserve((void**)&(ppw->pvecmetric),&(ppw->pvecmetric_capacity),ppw->mt_size,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+  class_call(perturbations_workspace_reserve((void**)&(ppw->pvecback_derivs),&(ppw->pvecback_derivs_capacity),pba->bg_size_normal,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+  class_call(perturbations_workspace_reserve((void**)&(ppw->pvecthermo_derivs),&(ppw->pvecthermo_derivs_capacity),pth->th_size,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+
+  /* momentum kernels of the ncdm species, for all their momenta one after the other */
+  kernel_size = 0;
+  if (pba->has_ncdm == _TRUE_) {
+    for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++)
+      kernel_size += pba->q_size_ncdm[n_ncdm];
+  }
+  class_call(perturbations_workspace_reserve((void**)&(ppw->ncdm_kernels),&(ppw->ncdm_kernels_capacity),4*kernel_size,sizeof(double),ppw,ppt->error_message),
+             ppt->error_message,
+             ppt->error_message);
+  ppw->epsilon_ncdm = ppw->ncdm_kernels;
+  ppw->w_rho_ncdm = ppw->ncdm_kernels+kernel_size;
+  ppw->w_theta_ncdm = ppw->ncdm_kernels+2*kernel_size;
+  ppw->w_p_ncdm = ppw->ncdm_kernels+3*kernel_size;
+
+  /* the memoized quantities of perturbations_derivs() may belong to another run */
+  ppw->tau_derivs = -1.;
+  ppw->a_w_fld = -1.;
+  ppw->a_ncdm = -1.;
 
   /** - count number of approximations, initialize their indices, and allocate their flags */
   index_ap=0;
@@ -2783,7 +3645,9 @@ int perturbations_workspace_init(
   ppw->ap_size=index_ap;
 
   if (ppw->ap_size > 0)
-    class_alloc(ppw->approx,ppw->ap_size*sizeof(int),ppt->error_message);
+    class_call(perturbations_workspace_reserve((void**)&(ppw->approx),&(ppw->approx_capacity),ppw->ap_size,sizeof(int),ppw,ppt->error_message),
+               ppt->error_message,
+               ppt->error_message);
 
   /** - For definiteness, initialize approximation flags to arbitrary
       values (correct values are overwritten in
@@ -2821,9 +3685,16 @@ int perturbations_workspace_init(
 
     if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_) || (ppt->has_source_delta_m == _TRUE_)) {
 
-      class_alloc(ppw->delta_ncdm,pba->N_ncdm*sizeof(double),ppt->error_message);
-      class_alloc(ppw->theta_ncdm,pba->N_ncdm*sizeof(double),ppt->error_message);
-      class_alloc(ppw->shear_ncdm,pba->N_ncdm*sizeof(double),ppt->error_message);
+      if (pba->N_ncdm > ppw->ncdm_capacity) {
+        free(ppw->delta_ncdm);
+        free(ppw->theta_ncdm);
+        free(ppw->shear_ncdm);
+        class_alloc(ppw->delta_ncdm,pba->N_ncdm*sizeof(double),ppt->error_message);
+        class_alloc(ppw->theta_ncdm,pba->N_ncdm*sizeof(double),ppt->error_message);
+        class_alloc(ppw->shear_ncdm,pba->N_ncdm*sizeof(double),ppt->error_message);
+        ppw->ncdm_capacity = pba->N_ncdm;
+        ppw->allocation_count += 3;
+      }
 
     }
 
@@ -2834,10 +3705,11 @@ int perturbations_workspace_init(
 
 /**
  * Free the perturbations_workspace structure (with the exception of the
- * perturbations_vector '-->pv' field, which is freed separately in
- * perturbations_vector_free).
+ * perturbations_vector '-->pv' field, which is released separately in
+ * perturbations_vector_release), including the recycled vectors kept
+ * in the workspace.
  *
- * @param ppt        Input: pointer to the perturbation structure
+ * @param ppt        Input: pointer to the perturbation structure (unused, can be NULL)
  * @param index_md Input: index of mode under consideration (scalar/.../tensor)
  * @param ppw        Input: pointer to perturbations_workspace structure to be freed
  * @return the error status
@@ -2849,20 +3721,69 @@ int perturbations_workspace_free (
                                   struct perturbations_workspace * ppw
                                   ) {
 
+  int index_spare, index_pattern;
+
+  /* all fields are freed according to their allocated size, such
+     that this function does not depend on the current run (and ppt
+     can be NULL) */
   free(ppw->s_l);
+  free(ppw->s_l_minus);
+  free(ppw->s_l_plus);
   free(ppw->pvecback);
   free(ppw->pvecthermo);
   free(ppw->pvecmetric);
-  if (ppw->ap_size > 0)
-    free(ppw->approx);
+  free(ppw->pvecback_derivs);
+  free(ppw->pvecthermo_derivs);
+  free(ppw->ncdm_kernels);
+  free(ppw->approx);
+  free(ppw->delta_ncdm);
+  free(ppw->theta_ncdm);
+  free(ppw->shear_ncdm);
 
-  if (_scalars_) {
+  for (index_spare=0; index_spare<2; index_spare++) {
+    if (ppw->pv_spare[index_spare] != NULL)
+      perturbations_vector_free(ppw->pv_spare[index_spare]);
+  }
 
-    if ((ppt->has_density_transfers == _TRUE_) || (ppt->has_velocity_transfers == _TRUE_) || (ppt->has_source_delta_m == _TRUE_)) {
-      free(ppw->delta_ncdm);
-      free(ppw->theta_ncdm);
-      free(ppw->shear_ncdm);
-    }
+  if (ppw->jacobian_pattern != NULL) {
+    for (index_pattern=0; index_pattern<_MAX_NUMBER_OF_JACOBIAN_PATTERNS_; index_pattern++)
+      jacobian_pattern_free(&(ppw->jacobian_pattern[index_pattern]));
+    free(ppw->jacobian_pattern);
+  }
+  free(ppw->jacobian_pattern_key);
+
+  memset(ppw,0,sizeof(struct perturbations_workspace));
+
+  return _SUCCESS_;
+}
+
+/**
+ * Make sure that an array of the workspace can hold at least 'size'
+ * elements, reallocating it only if it is too small.
+ *
+ * @param pointer       Input/Output: address of the array pointer
+ * @param capacity      Input/Output: allocated number of elements
+ * @param size          Input: required number of elements
+ * @param element_size  Input: size of one element
+ * @param ppw           Input/Output: workspace (for counting allocations)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int perturbations_workspace_reserve(
+                                    void ** pointer,
+                                    int * capacity,
+                                    int size,
+                                    size_t element_size,
+                                    struct perturbations_workspace * ppw,
+                                    ErrorMsg error_message
+                                    ) {
+
+  if ((size > *capacity) || (*pointer == NULL)) {
+    free(*pointer);
+    class_alloc(*pointer,MAX(size,1)*element_size,error_message);
+    *capacity = MAX(size,1);
+    ppw->allocation_count++;
   }
 
   return _SUCCESS_;
@@ -2907,83 +3828,129 @@ int perturbations_solve(
 
   /** - define local variables */
 
-  /* contains all fixed parameters, indices and workspaces used by the perturbations_derivs function */
-  struct perturbations_parameters_and_workspace ppaw;
-
-  /* conformal time */
-  double tau,tau_lower,tau_upper,tau_mid;
-
-  /* multipole */
-  int l;
-
-  /* index running over time */
-  int index_tau;
+  /* state of the integration, containing all fixed parameters, indices and workspaces used by the perturbations_derivs function */
+  struct perturbations_solve_state ss;
+  struct perturbations_solve_state * pss = &ss;
 
-  /* number of values in the tau_sampling array that should be considered for a given mode */
-  int tau_actual_size;
+  /* function pointer to ODE evolver and names of possible evolvers */
 
-  /* running index over types (temperature, etc) */
-  int index_tp;
+  auto generic_evolver = &(evolver_ndf15);
 
-  /* Fourier mode */
-  double k;
+  /** - find the initial time and the approximation scheme in each time interval with perturbations_solve_begin() */
 
-  /* number of time intervals where the approximation scheme is uniform */
-  int interval_number;
+  class_call(perturbations_solve_begin(ppr,pba,pth,ppt,index_md,index_ic,index_k,ppw,pss),
+             ppt->error_message,
+             ppt->error_message);
 
-  /* index running over such time intervals */
-  int index_interval;
+  /** - loop over intervals over which approximation scheme is uniform. For each interval: */
 
-  /* number of time intervals where each particular approximation is uniform */
-  int * interval_number_of;
+  for (pss->index_interval=0; pss->index_interval<pss->interval_number; pss->index_interval++) {
 
-  /* edge of intervals where approximation scheme is uniform: tau_ini, tau_switch_1, ..., tau_end */
-  double * interval_limit;
+    /** - --> (a)-(c) fix the approximation scheme and define the vector of perturbations with perturbations_solve_interval() */
 
-  /* array of approximation scheme within each interval: interval_approx[index_interval][index_ap] */
-  int ** interval_approx;
+    class_call(perturbations_solve_interval(pss),
+               ppt->error_message,
+               ppt->error_message);
 
-  /* index running over approximations */
-  int index_ap;
+    /** - --> (d) integrate the perturbations over the current interval. */
 
-  /* approximation scheme within previous interval: previous_approx[index_ap] */
-  int * previous_approx;
+    if (ppr->evolver == rk){
+      generic_evolver = evolver_rk;
+    }
+    else {
+      generic_evolver = evolver_ndf15;
 
-  int n_ncdm,is_early_enough;
+      /* the equations are linear in the perturbations, so the
+         sparsity pattern of their jacobian can be found exactly when
+         an approximation scheme is met for the first time in this run */
+      if ((ppw->pv->jacobian_pattern != NULL) && (ppw->pv->jacobian_pattern->neq == 0)) {
+        class_call(jacobian_pattern_of_linear_system(perturbations_derivs,
+                                                     pss->interval_limit[pss->index_interval],
+                                                     ppw->pv->pt_size,
+                                                     &(pss->ppaw),
+                                                     ppw->pv->jacobian_pattern,
+                                                     ppt->error_message),
+                   ppt->error_message,
+                   ppt->error_message);
+        ppw->pv->jacobian_pattern->refresh_on_convergence = ppr->perturbations_refresh_lu_on_convergence;
+      }
+    }
 
-  /* function pointer to ODE evolver and names of possible evolvers */
+    class_call(generic_evolver(perturbations_derivs,
+                               pss->interval_limit[pss->index_interval],
+                               pss->interval_limit[pss->index_interval+1],
+                               ppw->pv->y,
+                               ppw->pv->used_in_sources,
+                               ppw->pv->pt_size,
+                               &(pss->ppaw),
+                               ppr->tol_perturbations_integration,
+                               ppr->smallest_allowed_variation,
+                               perturbations_timescale,
+                               ppr->perturbations_integration_stepsize,
+                               ppt->tau_sampling,
+                               pss->tau_actual_size,
+                               perturbations_sources,
+                               pss->print_variables,
+                               ppw->pv->jacobian_pattern,
+                               ppt->error_message),
+               ppt->error_message,
+               ppt->error_message);
 
+  }
 
-  auto generic_evolver = &(evolver_ndf15);
+  /** - print statistics and free memory with perturbations_solve_end() */
 
+  class_call(perturbations_solve_end(pss),
+             ppt->error_message,
+             ppt->error_message);
 
-  /* Related to the perturbation output */
-  int (*perhaps_print_variables)(double, double*, double*, void*, char*);
-  int index_ikout;
+  return _SUCCESS_;
+}
 
-  /** - initialize indices relevant for back/thermo tables search */
-  ppw->last_index_back=0;
-  ppw->last_index_thermo=0;
-  ppw->inter_mode = inter_normal;
+/**
+ * Find the time at which the integration of a wavenumber starts, and
+ * the intervals over which the approximation scheme is uniform until
+ * tau_end (with perturbations_find_approximation_number() and
+ * perturbations_find_approximation_switches()).
+ *
+ * @param ppr             Input: pointer to precision structure
+ * @param pba             Input: pointer to background structure
+ * @param pth             Input: pointer to the thermodynamics structure
+ * @param ppt             Input: pointer to the perturbation structure
+ * @param index_md        Input: index of mode under consideration (scalar/.../tensor)
+ * @param k               Input: wavenumber
+ * @param ppw             Input: pointer to perturbations_workspace structure containing index values and workspaces
+ * @param tau_end         Input: last time of the integration
+ * @param interval_number Output: number of intervals
+ * @param interval_limit  Output: edges of the intervals, tau_ini, tau_switch_1, ..., tau_end (allocated here)
+ * @param interval_approx Output: approximation scheme in each interval, interval_approx[index_interval][index_ap] (allocated here)
+ * @return the error status
+ */
 
-  /** - get wavenumber value */
-  k = ppt->k[index_md][index_k];
+int perturbations_find_approximation_intervals(
+                                               struct precision * ppr,
+                                               struct background * pba,
+                                               struct thermodynamics * pth,
+                                               struct perturbations * ppt,
+                                               int index_md,
+                                               double k,
+                                               struct perturbations_workspace * ppw,
+                                               double tau_end,
+                                               int * interval_number,
+                                               double ** interval_limit,
+                                               int *** interval_approx
+                                               ) {
 
-  class_test(k == 0.,
-             ppt->error_message,
-             "stop to avoid division by zero");
+  /* conformal time */
+  double tau,tau_lower,tau_upper,tau_mid;
 
-  /** - If non-zero curvature, update array of free-streaming coefficients ppw->s_l */
-  if (pba->has_curvature == _TRUE_){
-    for (l = 0; l<=ppw->max_l_max; l++){
-      ppw->s_l[l] = sqrt(MAX(1.0-pba->K*(l*l-1.0)/k/k,0.));
-    }
-  }
+  /* index running over time intervals where the approximation scheme is uniform */
+  int index_interval;
 
-  /** - maximum value of tau for which sources are calculated for this wavenumber */
+  /* number of time intervals where each particular approximation is uniform */
+  int * interval_number_of;
 
-  /* by default, today */
-  tau_actual_size = ppt->tau_size;
+  int n_ncdm,is_early_enough;
 
   /** - using bisection, compute minimum value of tau for which this
       wavenumber is integrated */
@@ -3114,18 +4081,18 @@ int perturbations_solve(
                                                      k,
                                                      ppw,
                                                      tau,
-                                                     ppt->tau_sampling[tau_actual_size-1],
-                                                     &interval_number,
+                                                     tau_end,
+                                                     interval_number,
                                                      interval_number_of),
              ppt->error_message,
              ppt->error_message);
 
-  class_alloc(interval_limit,(interval_number+1)*sizeof(double),ppt->error_message);
+  class_alloc(*interval_limit,(*interval_number+1)*sizeof(double),ppt->error_message);
 
-  class_alloc(interval_approx,interval_number*sizeof(int*),ppt->error_message);
+  class_alloc(*interval_approx,*interval_number*sizeof(int*),ppt->error_message);
 
-  for (index_interval=0; index_interval<interval_number; index_interval++)
-    class_alloc(interval_approx[index_interval],ppw->ap_size*sizeof(int),ppt->error_message);
+  for (index_interval=0; index_interval<*interval_number; index_interval++)
+    class_alloc((*interval_approx)[index_interval],ppw->ap_size*sizeof(int),ppt->error_message);
 
   class_call(perturbations_find_approximation_switches(ppr,
                                                        pba,
@@ -3135,125 +4102,386 @@ int perturbations_solve(
                                                        k,
                                                        ppw,
                                                        tau,
-                                                       ppt->tau_sampling[tau_actual_size-1],
+                                                       tau_end,
                                                        ppr->tol_tau_approx,
-                                                       interval_number,
+                                                       *interval_number,
                                                        interval_number_of,
-                                                       interval_limit,
-                                                       interval_approx),
+                                                       *interval_limit,
+                                                       *interval_approx),
              ppt->error_message,
              ppt->error_message);
 
   free(interval_number_of);
 
+  return _SUCCESS_;
+}
+
+/**
+ * Choose the length of the scalar hierarchies of photons, ur and ncdm
+ * for this wavenumber, now that the intervals over which each of them
+ * is evolved are known.
+ *
+ * By default (ppr->l_max_adaptive = _FALSE_), these are the fixed
+ * values ppr->l_max_g, ppr->l_max_pol_g, ppr->l_max_ur and
+ * ppr->l_max_ncdm. Otherwise, since free-streaming transfers the
+ * perturbations of a hierarchy to multipoles l ~ k d over a distance
+ * d, each of them is truncated at ppr->l_max_adaptive_min +
+ * ppr->l_max_adaptive_k_tau * k * d, where d is the time at which the
+ * hierarchy stops being evolved (ufa, ncdmfa or rsa switched on, or
+ * end of the integration) for ur and ncdm, and for photons the time
+ * elapsed since recombination plus the damping scale at
+ * recombination (before, multipoles beyond the damping scale are
+ * erased by scattering). The lengths are fixed for the whole
+ * integration of the wavenumber, such that the redistribution of the
+ * multipoles at the approximation switches is unchanged; the closure
+ * of the hierarchies at l_max is also the same.
+ *
+ * @param ppr             Input: pointer to precision structure
+ * @param pba             Input: pointer to background structure
+ * @param pth             Input: pointer to the thermodynamics structure
+ * @param ppt             Input: pointer to the perturbation structure
+ * @param index_md        Input: index of mode under consideration (scalar/.../tensor)
+ * @param k               Input: wavenumber
+ * @param ppw             Input/Output: pointer to perturbations_workspace structure, receiving the lengths of the hierarchies
+ * @param interval_number Input: number of intervals
+ * @param interval_limit  Input: edges of the intervals
+ * @param interval_approx Input: approximation scheme in each interval
+ * @return the error status
+ */
+
+int perturbations_find_l_max(
+                             struct precision * ppr,
+                             struct background * pba,
+                             struct thermodynamics * pth,
+                             struct perturbations * ppt,
+                             int index_md,
+                             double k,
+                             struct perturbations_workspace * ppw,
+                             int interval_number,
+                             double * interval_limit,
+                             int ** interval_approx
+                             ) {
+
+  int index_interval;
+
+  /* last times at which the hierarchies are evolved */
+  double tau_end_g=0.,tau_end_ur=0.,tau_end_ncdm=0.;
+
+  double length_g;
+
+  ppw->l_max_g = ppr->l_max_g;
+  ppw->l_max_pol_g = ppr->l_max_pol_g;
+  ppw->l_max_ur = ppr->l_max_ur;
+  ppw->l_max_ncdm = ppr->l_max_ncdm;
+
+  if ((ppr->l_max_adaptive == _FALSE_) || (!_scalars_))
+    return _SUCCESS_;
+
+  for (index_interval=0; index_interval<interval_number; index_interval++) {
+
+    if ((interval_approx[index_interval][ppw->index_ap_rsa] == (int)rsa_off) &&
+        (interval_approx[index_interval][ppw->index_ap_tca] == (int)tca_off))
+      tau_end_g = interval_limit[index_interval+1];
+
+    if ((pba->has_ur == _TRUE_) &&
+        (interval_approx[index_interval][ppw->index_ap_rsa] == (int)rsa_off) &&
+        (interval_approx[index_interval][ppw->index_ap_ufa] == (int)ufa_off))
+      tau_end_ur = interval_limit[index_interval+1];
+
+    if ((pba->has_ncdm == _TRUE_) &&
+        (interval_approx[index_interval][ppw->index_ap_ncdmfa] == (int)ncdmfa_off))
+      tau_end_ncdm = interval_limit[index_interval+1];
+  }
+
+  length_g = pth->rd_rec + MAX(tau_end_g-pth->tau_rec,0.);
+
+  ppw->l_max_g = MIN(ppr->l_max_g,MAX(4,ppr->l_max_adaptive_min+(int)ceil(ppr->l_max_adaptive_k_tau*k*length_g)));
+  ppw->l_max_pol_g = MIN(ppr->l_max_pol_g,MAX(4,ppr->l_max_adaptive_min+(int)ceil(ppr->l_max_adaptive_k_tau*k*length_g)));
+  ppw->l_max_ur = MIN(ppr->l_max_ur,MAX(4,ppr->l_max_adaptive_min+(int)ceil(ppr->l_max_adaptive_k_tau*k*tau_end_ur)));
+  ppw->l_max_ncdm = MIN(ppr->l_max_ncdm,MAX(4,ppr->l_max_adaptive_min+(int)ceil(ppr->l_max_adaptive_k_tau*k*tau_end_ncdm)));
+
+  if (ppt->perturbations_verbose>2)
+    fprintf(stdout,"Mode k=%e: hierarchies truncated at l_max_g=%d, l_max_pol_g=%d, l_max_ur=%d, l_max_ncdm=%d\n",
+            k,ppw->l_max_g,ppw->l_max_pol_g,ppw->l_max_ur,ppw->l_max_ncdm);
+
+  return _SUCCESS_;
+}
+
+/**
+ * First step of perturbations_solve(): find the time at which the
+ * integration of this wavenumber starts and the approximation scheme
+ * in each time interval, and fill the parameters of
+ * perturbations_derivs().
+ *
+ * @param ppr        Input: pointer to precision structure
+ * @param pba        Input: pointer to background structure
+ * @param pth        Input: pointer to the thermodynamics structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param index_md   Input: index of mode under consideration (scalar/.../tensor)
+ * @param index_ic   Input: index of initial condition under consideration (ad, iso...)
+ * @param index_k    Input: index of wavenumber
+ * @param ppw        Input: pointer to perturbations_workspace structure containing index values and workspaces
+ * @param pss        Output: state of the integration, before the first interval
+ * @return the error status
+ */
+
+int perturbations_solve_begin(
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermodynamics * pth,
+                              struct perturbations * ppt,
+                              int index_md,
+                              int index_ic,
+                              int index_k,
+                              struct perturbations_workspace * ppw,
+                              struct perturbations_solve_state * pss
+                              ) {
+
+  /* multipole */
+  int l;
+
+  /* Fourier mode */
+  double k;
+
+  /* index running over the sparsity patterns of the workspace, and statistics of the ndf15 evolver for this mode */
+  int index_pattern,index_stat;
+
+  /* Related to the perturbation output */
+  int index_ikout;
+
+  /** - initialize indices relevant for back/thermo tables search */
+  ppw->last_index_back=0;
+  ppw->last_index_thermo=0;
+  ppw->inter_mode = inter_normal;
+
+  /** - get wavenumber value */
+  k = ppt->k[index_md][index_k];
+
+  class_test(k == 0.,
+             ppt->error_message,
+             "stop to avoid division by zero");
+
+  class_counter_add(counter_k_modes,1);
+
+  /** - If non-zero curvature, update array of free-streaming coefficients ppw->s_l */
+  if (pba->has_curvature == _TRUE_){
+    for (l = 0; l<=ppw->max_l_max; l++){
+      ppw->s_l[l] = sqrt(MAX(1.0-pba->K*(l*l-1.0)/k/k,0.));
+    }
+  }
+
+  /** - Fill the coefficients of the free-streaming recurrence, used by perturbations_hierarchy_streaming() */
+  for (l = 0; l<ppw->max_l_max; l++){
+    ppw->s_l_minus[l] = l*ppw->s_l[l]/(2.*l+1.);
+    ppw->s_l_plus[l] = (l+1.)*ppw->s_l[l+1]/(2.*l+1.);
+  }
+  ppw->s_l_minus[ppw->max_l_max] = 0.;
+  ppw->s_l_plus[ppw->max_l_max] = 0.;
+
+  /** - maximum value of tau for which sources are calculated for this wavenumber */
+
+  /* by default, today */
+  pss->tau_actual_size = ppt->tau_size;
+
+  /** - find the initial time and the approximation scheme in each
+      interval with perturbations_find_approximation_intervals() */
+
+  class_call(perturbations_find_approximation_intervals(ppr,
+                                                        pba,
+                                                        pth,
+                                                        ppt,
+                                                        index_md,
+                                                        k,
+                                                        ppw,
+                                                        ppt->tau_sampling[pss->tau_actual_size-1],
+                                                        &(pss->interval_number),
+                                                        &(pss->interval_limit),
+                                                        &(pss->interval_approx)),
+             ppt->error_message,
+             ppt->error_message);
+
+  /** - choose the length of the hierarchies with perturbations_find_l_max() */
+
+  class_call(perturbations_find_l_max(ppr,
+                                      pba,
+                                      pth,
+                                      ppt,
+                                      index_md,
+                                      k,
+                                      ppw,
+                                      pss->interval_number,
+                                      pss->interval_limit,
+                                      pss->interval_approx),
+             ppt->error_message,
+             ppt->error_message);
+
   /** - fill the structure containing all fixed parameters, indices
       and workspaces needed by perturbations_derivs */
 
-  ppaw.ppr = ppr;
-  ppaw.pba = pba;
-  ppaw.pth = pth;
-  ppaw.ppt = ppt;
-  ppaw.index_md = index_md;
-  ppaw.index_ic = index_ic;
-  ppaw.index_k = index_k;
-  ppaw.k = k;
-  ppaw.ppw = ppw;
-  ppaw.ppw->inter_mode = inter_closeby;
-  ppaw.ppw->last_index_back = 0;
-  ppaw.ppw->last_index_thermo = 0;
+  pss->ppaw.ppr = ppr;
+  pss->ppaw.pba = pba;
+  pss->ppaw.pth = pth;
+  pss->ppaw.ppt = ppt;
+  pss->ppaw.index_md = index_md;
+  pss->ppaw.index_ic = index_ic;
+  pss->ppaw.index_k = index_k;
+  pss->ppaw.k = k;
+  pss->ppaw.ppw = ppw;
+  pss->ppaw.ppw->inter_mode = inter_closeby;
+  pss->ppaw.ppw->last_index_back = 0;
+  pss->ppaw.ppw->last_index_thermo = 0;
 
   /** - check whether we need to print perturbations to a file for this wavenumber */
 
-  perhaps_print_variables = NULL;
+  pss->print_variables = NULL;
   ppw->index_ikout = -1;
   for (index_ikout=0; index_ikout<ppt->k_output_values_num; index_ikout++){
     if (ppt->index_k_output_values[index_md*ppt->k_output_values_num+index_ikout] == index_k){
       ppw->index_ikout = index_ikout;
-      perhaps_print_variables = perturbations_print_variables;
+      pss->print_variables = perturbations_print_variables;
     }
   }
 
-  /** - loop over intervals over which approximation scheme is uniform. For each interval: */
+  /** - reset the statistics that the ndf15 evolver collects in the sparsity patterns */
 
-  for (index_interval=0; index_interval<interval_number; index_interval++) {
+  for (index_pattern=0; index_pattern<ppw->jacobian_pattern_size; index_pattern++) {
+    for (index_stat=0; index_stat<6; index_stat++)
+      ppw->jacobian_pattern[index_pattern].stepstat[index_stat] = 0;
+    ppw->jacobian_pattern[index_pattern].symbolic_decompositions = 0;
+  }
 
-    /** - --> (a) fix the approximation scheme */
+  return _SUCCESS_;
+}
 
-    for (index_ap=0; index_ap<ppw->ap_size; index_ap++)
-      ppw->approx[index_ap]=interval_approx[index_interval][index_ap];
+/**
+ * Second step of perturbations_solve(), for the interval
+ * pss->index_interval: fix the approximation scheme, and initialize
+ * (or redistribute) the vector of perturbations to be integrated over
+ * the interval.
+ *
+ * @param pss Input/Output: state of the integration
+ * @return the error status
+ */
 
-    /** - --> (b) get the previous approximation scheme. If the current
-        interval starts from the initial time tau_ini, the previous
-        approximation is set to be a NULL pointer, so that the
-        function perturbations_vector_init() knows that perturbations must
-        be initialized */
+int perturbations_solve_interval(
+                                 struct perturbations_solve_state * pss
+                                 ) {
 
-    if (index_interval==0) {
-      previous_approx=NULL;
-    }
-    else {
-      previous_approx=interval_approx[index_interval-1];
-    }
+  struct precision * ppr = pss->ppaw.ppr;
+  struct background * pba = pss->ppaw.pba;
+  struct thermodynamics * pth = pss->ppaw.pth;
+  struct perturbations * ppt = pss->ppaw.ppt;
+  struct perturbations_workspace * ppw = pss->ppaw.ppw;
+  int index_md = pss->ppaw.index_md;
+  int index_ic = pss->ppaw.index_ic;
+  double k = pss->ppaw.k;
 
-    /** - --> (c) define the vector of perturbations to be integrated
-        over. If the current interval starts from the initial time
-        tau_ini, fill the vector with initial conditions for each
-        mode. If it starts from an approximation switching point,
-        redistribute correctly the perturbations from the previous to
-        the new vector of perturbations. */
+  /* index running over approximations */
+  int index_ap;
 
-    class_call(perturbations_vector_init(ppr,
-                                         pba,
-                                         pth,
-                                         ppt,
-                                         index_md,
-                                         index_ic,
-                                         k,
-                                         interval_limit[index_interval],
-                                         ppw,
-                                         previous_approx),
-               ppt->error_message,
-               ppt->error_message);
+  /* approximation scheme within previous interval: previous_approx[index_ap] */
+  int * previous_approx;
 
-    /** - --> (d) integrate the perturbations over the current interval. */
+  /** - --> (a) fix the approximation scheme */
 
-    if (ppr->evolver == rk){
-      generic_evolver = evolver_rk;
-    }
-    else {
-      generic_evolver = evolver_ndf15;
-    }
+  for (index_ap=0; index_ap<ppw->ap_size; index_ap++)
+    ppw->approx[index_ap]=pss->interval_approx[pss->index_interval][index_ap];
 
-    class_call(generic_evolver(perturbations_derivs,
-                               interval_limit[index_interval],
-                               interval_limit[index_interval+1],
-                               ppw->pv->y,
-                               ppw->pv->used_in_sources,
-                               ppw->pv->pt_size,
-                               &ppaw,
-                               ppr->tol_perturbations_integration,
-                               ppr->smallest_allowed_variation,
-                               perturbations_timescale,
-                               ppr->perturbations_integration_stepsize,
-                               ppt->tau_sampling,
-                               tau_actual_size,
-                               perturbations_sources,
-                               perhaps_print_variables,
-                               ppt->error_message),
-               ppt->error_message,
-               ppt->error_message);
+  /** - --> (b) get the previous approximation scheme. If the current
+      interval starts from the initial time tau_ini, the previous
+      approximation is set to be a NULL pointer, so that the
+      function perturbations_vector_init() knows that perturbations must
+      be initialized */
+
+  if (pss->index_interval==0) {
+    previous_approx=NULL;
+  }
+  else {
+    previous_approx=pss->interval_approx[pss->index_interval-1];
+  }
+
+  /** - --> (c) define the vector of perturbations to be integrated
+      over. If the current interval starts from the initial time
+      tau_ini, fill the vector with initial conditions for each
+      mode. If it starts from an approximation switching point,
+      redistribute correctly the perturbations from the previous to
+      the new vector of perturbations. */
+
+  class_call(perturbations_vector_init(ppr,
+                                       pba,
+                                       pth,
+                                       ppt,
+                                       index_md,
+                                       index_ic,
+                                       k,
+                                       pss->interval_limit[pss->index_interval],
+                                       ppw,
+                                       previous_approx),
+             ppt->error_message,
+             ppt->error_message);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Last step of perturbations_solve(), after the last interval: print
+ * the statistics of the evolver, fill the sources after the last
+ * integrated time, and free the state of the integration.
+ *
+ * @param pss Input/Output: state of the integration
+ * @return the error status
+ */
+
+int perturbations_solve_end(
+                            struct perturbations_solve_state * pss
+                            ) {
+
+  struct precision * ppr = pss->ppaw.ppr;
+  struct perturbations * ppt = pss->ppaw.ppt;
+  struct perturbations_workspace * ppw = pss->ppaw.ppw;
+  int index_md = pss->ppaw.index_md;
+  int index_ic = pss->ppaw.index_ic;
+  int index_k = pss->ppaw.index_k;
+  double k = pss->ppaw.k;
+
+  /* index running over time */
+  int index_tau;
+
+  /* running index over types (temperature, etc) */
+  int index_tp;
+
+  /* index running over such time intervals */
+  int index_interval;
+
+  /* index running over the sparsity patterns of the workspace, and statistics of the ndf15 evolver for this mode */
+  int index_pattern,index_stat;
+  int stepstat[6];
+  int symbolic_decompositions;
 
+  /** - print the statistics of the ndf15 evolver for this mode, summed over intervals */
+
+  if ((ppr->evolver == ndf15) && (ppt->perturbations_verbose > 3)) {
+    for (index_stat=0; index_stat<6; index_stat++)
+      stepstat[index_stat] = 0;
+    symbolic_decompositions = 0;
+    for (index_pattern=0; index_pattern<ppw->jacobian_pattern_size; index_pattern++) {
+      for (index_stat=0; index_stat<6; index_stat++)
+        stepstat[index_stat] += ppw->jacobian_pattern[index_pattern].stepstat[index_stat];
+      symbolic_decompositions += ppw->jacobian_pattern[index_pattern].symbolic_decompositions;
+    }
+    printf("mode k=%e /Mpc: %d steps, %d rejected, %d derivs, %d jacobians, %d LU decompositions (%d symbolic), %d Newton iterations\n",
+           k,stepstat[0],stepstat[1],stepstat[2],stepstat[3],stepstat[4],symbolic_decompositions,stepstat[5]);
   }
 
   /** - if perturbations were printed in a file, close the file */
 
-  //if (perhaps_print_variables != NULL)
+  //if (pss->print_variables != NULL)
   //  fclose(ppw->perturbations_output_file);
 
   /** - fill the source terms array with zeros for all times between
       the last integrated time tau_max and tau_today. */
 
-  for (index_tau = tau_actual_size; index_tau < ppt->tau_size; index_tau++) {
+  for (index_tau = pss->tau_actual_size; index_tau < ppt->tau_size; index_tau++) {
     for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
       ppt->sources[index_md]
         [index_ic * ppt->tp_size[index_md] + index_tp]
@@ -3263,16 +4491,191 @@ int perturbations_solve(
 
   /** - free quantities allocated at the beginning of the routine */
 
-  class_call(perturbations_vector_free(ppw->pv),
+  class_call(perturbations_vector_release(ppw,ppw->pv),
              ppt->error_message,
              ppt->error_message);
+  ppw->pv = NULL;
+
+  for (index_interval=0; index_interval<pss->interval_number; index_interval++)
+    free(pss->interval_approx[index_interval]);
+
+  free(pss->interval_approx);
+
+  free(pss->interval_limit);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Evolve the wavenumbers of several tasks together with the rk_batch
+ * evolver: each lane of evolver_rk_batch() follows the steps of
+ * perturbations_solve() for the initial conditions of its task, with
+ * its own approximation intervals and step sizes, while the
+ * derivatives of all lanes are evaluated in one sweep at each stage of
+ * the Runge-Kutta method. The results are the same as with the rk
+ * evolver.
+ *
+ * @param ppr       Input: pointer to precision structure
+ * @param pba       Input: pointer to background structure
+ * @param pth       Input: pointer to the thermodynamics structure
+ * @param ppt       Input/Output: pointer to the perturbation structure (output source functions S(k,tau) written here)
+ * @param lane_size Input: number of lanes
+ * @param lanes     Input/Output: lanes, with their task and an initialized workspace for the mode of the task
+ * @return the error status
+ */
+
+int perturbations_solve_batch(
+                              struct precision * ppr,
+                              struct background * pba,
+                              struct thermodynamics * pth,
+                              struct perturbations * ppt,
+                              int lane_size,
+                              struct perturbations_batch_lane * lanes
+                              ) {
+
+  int index_lane;
+  struct perturbations_batch_lane * pbl;
+  struct evolver_rk_lane * evolver_lanes;
+
+  class_alloc(evolver_lanes,lane_size*sizeof(struct evolver_rk_lane),ppt->error_message);
+
+  /** - start each lane with the first interval of its first initial condition */
+
+  for (index_lane = 0; index_lane < lane_size; index_lane++) {
+
+    pbl = &(lanes[index_lane]);
+    pbl->index_ic = pbl->ptask->index_ic;
+
+    class_call_except(perturbations_solve_begin(ppr,
+                                                pba,
+                                                pth,
+                                                ppt,
+                                                pbl->ptask->index_md,
+                                                pbl->index_ic,
+                                                pbl->ptask->index_k,
+                                                pbl->ppw,
+                                                &(pbl->pss)),
+                      ppt->error_message,
+                      ppt->error_message,
+                      free(evolver_lanes));
+
+    /* the same time sampling is used by all lanes */
+    class_test_except(pbl->pss.tau_actual_size != ppt->tau_size,
+                      ppt->error_message,
+                      free(evolver_lanes),
+                      "the rk_batch evolver needs the full time sampling for each wavenumber");
+
+    pbl->pss.index_interval = 0;
+
+    class_call_except(perturbations_solve_interval(&(pbl->pss)),
+                      ppt->error_message,
+                      ppt->error_message,
+                      free(evolver_lanes));
+
+    evolver_lanes[index_lane].x_ini = pbl->pss.interval_limit[0];
+    evolver_lanes[index_lane].x_end = pbl->pss.interval_limit[1];
+    evolver_lanes[index_lane].y = pbl->ppw->pv->y;
+    evolver_lanes[index_lane].y_size = pbl->ppw->pv->pt_size;
+    evolver_lanes[index_lane].parameters_and_workspace = &(pbl->pss.ppaw);
+    evolver_lanes[index_lane].print_variables = pbl->pss.print_variables;
+  }
+
+  /** - integrate all lanes; perturbations_batch_restart() moves them to their next interval or initial condition */
+
+  class_call_except(evolver_rk_batch(perturbations_derivs,
+                                     lane_size,
+                                     evolver_lanes,
+                                     ppr->tol_perturbations_integration,
+                                     ppr->smallest_allowed_variation,
+                                     perturbations_timescale,
+                                     ppr->perturbations_integration_stepsize,
+                                     ppt->tau_sampling,
+                                     ppt->tau_size,
+                                     perturbations_sources,
+                                     perturbations_batch_restart,
+                                     lanes,
+                                     ppt->error_message),
+                    ppt->error_message,
+                    ppt->error_message,
+                    free(evolver_lanes));
+
+  free(evolver_lanes);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Restart function of evolver_rk_batch() for perturbations_solve_batch():
+ * set up the next interval of the lane, or the first interval of its
+ * next initial condition, or retire the lane when its task is done.
+ *
+ * @param index_lane         Input: index of the lane
+ * @param plane              Output: lane of the evolver, for its next interval
+ * @param restart_parameters Input/Output: array of the perturbations_batch_lane structures
+ * @param is_done            Output: _TRUE_ if the task of the lane is done
+ * @param error_message      Output: error message
+ * @return the error status
+ */
+
+int perturbations_batch_restart(
+                                int index_lane,
+                                struct evolver_rk_lane * plane,
+                                void * restart_parameters,
+                                short * is_done,
+                                ErrorMsg error_message
+                                ) {
+
+  struct perturbations_batch_lane * pbl = &(((struct perturbations_batch_lane *) restart_parameters)[index_lane]);
+  struct perturbations_solve_state * pss = &(pbl->pss);
+  struct precision * ppr = pss->ppaw.ppr;
+  struct background * pba = pss->ppaw.pba;
+  struct thermodynamics * pth = pss->ppaw.pth;
+  struct perturbations * ppt = pss->ppaw.ppt;
+
+  pss->index_interval++;
+
+  /** - after the last interval, finish this initial condition and begin the next one, if any */
+
+  if (pss->index_interval == pss->interval_number) {
+
+    class_call(perturbations_solve_end(pss),
+               ppt->error_message,
+               error_message);
+
+    pbl->index_ic++;
+
+    if (pbl->index_ic == pbl->ptask->index_ic + pbl->ptask->ic_size) {
+      *is_done = _TRUE_;
+      return _SUCCESS_;
+    }
+
+    class_call(perturbations_solve_begin(ppr,
+                                         pba,
+                                         pth,
+                                         ppt,
+                                         pbl->ptask->index_md,
+                                         pbl->index_ic,
+                                         pbl->ptask->index_k,
+                                         pbl->ppw,
+                                         pss),
+               ppt->error_message,
+               error_message);
 
-  for (index_interval=0; index_interval<interval_number; index_interval++)
-    free(interval_approx[index_interval]);
+    pss->index_interval = 0;
+  }
+
+  class_call(perturbations_solve_interval(pss),
+             ppt->error_message,
+             error_message);
 
-  free(interval_approx);
+  plane->x_ini = pss->interval_limit[pss->index_interval];
+  plane->x_end = pss->interval_limit[pss->index_interval+1];
+  plane->y = pbl->ppw->pv->y;
+  plane->y_size = pbl->ppw->pv->pt_size;
+  plane->parameters_and_workspace = &(pss->ppaw);
+  plane->print_variables = pss->print_variables;
 
-  free(interval_limit);
+  *is_done = _FALSE_;
 
   return _SUCCESS_;
 }
@@ -3535,6 +4938,7 @@ int perturbations_find_approximation_switches(
   int index_switch_tot;
   int num_switch;
   double tau_min,lower_bound,upper_bound;
+  double tau_before,tau_after;
   double mid=0;
   double * unsorted_tau_switch;
   double next_tau_switch;
@@ -3593,24 +4997,60 @@ int perturbations_find_approximation_switches(
           upper_bound=tau_end;
           mid = 0.5*(lower_bound+upper_bound);
 
-          while (upper_bound - lower_bound > precision) {
-
-            class_call(perturbations_approximations(ppr,
-                                                    pba,
-                                                    pth,
-                                                    ppt,
-                                                    index_md,
-                                                    k,
-                                                    mid,
-                                                    ppw),
+          /* times up to tau_before (from tau_after) are known to be
+             before (after) the switch: for a single switch, they are
+             first narrowed down around the value interpolated in the
+             table of perturbations_tabulate_approximation_switches() */
+          tau_before=lower_bound;
+          tau_after=upper_bound;
+
+          if (num_switch == 1) {
+            class_call(perturbations_predict_approximation_switch(ppr,
+                                                                  pba,
+                                                                  pth,
+                                                                  ppt,
+                                                                  index_md,
+                                                                  k,
+                                                                  ppw,
+                                                                  index_ap,
+                                                                  flag_ini+index_switch,
+                                                                  &tau_before,
+                                                                  &tau_after),
                        ppt->error_message,
                        ppt->error_message);
+          }
+
+          /* the bisection takes the same steps as without these bounds,
+             but only probes the approximations between them */
+          while (upper_bound - lower_bound > precision) {
 
-            if (ppw->approx[index_ap] > flag_ini+index_switch) {
+            if (mid <= tau_before) {
+              lower_bound=mid;
+            }
+            else if (mid >= tau_after) {
               upper_bound=mid;
             }
             else {
-              lower_bound=mid;
+
+              class_call(perturbations_approximations(ppr,
+                                                      pba,
+                                                      pth,
+                                                      ppt,
+                                                      index_md,
+                                                      k,
+                                                      mid,
+                                                      ppw),
+                         ppt->error_message,
+                         ppt->error_message);
+
+              class_counter_add(counter_approximation_probes,1);
+
+              if (ppw->approx[index_ap] > flag_ini+index_switch) {
+                upper_bound=mid;
+              }
+              else {
+                lower_bound=mid;
+              }
             }
 
             mid = 0.5*(lower_bound+upper_bound);
@@ -3772,6 +5212,275 @@ int perturbations_find_approximation_switches(
   return _SUCCESS_;
 }
 
+/**
+ * Tabulate the switching times of the approximations on a coarse grid
+ * of wavenumbers (one out of ppr->approximation_switch_k_step, and the
+ * last one), for perturbations_predict_approximation_switch(). Only
+ * the approximations switching exactly once are tabulated. The table
+ * is freed by perturbations_free_approximation_switches().
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param pba Input: pointer to background structure
+ * @param pth Input: pointer to the thermodynamics structure
+ * @param ppt Input/Output: pointer to the perturbation structure
+ * @return the error status
+ */
+
+int perturbations_tabulate_approximation_switches(
+                                                  struct precision * ppr,
+                                                  struct background * pba,
+                                                  struct thermodynamics * pth,
+                                                  struct perturbations * ppt
+                                                  ) {
+
+  int index_md;
+  int step,kt_size,ap_size;
+  struct perturbations_workspace pw;
+
+  class_calloc(ppt->switch_table_size,ppt->md_size,sizeof(int),ppt->error_message);
+  class_calloc(ppt->switch_table_lnk,ppt->md_size,sizeof(double*),ppt->error_message);
+  class_calloc(ppt->switch_table_tau,ppt->md_size,sizeof(double*),ppt->error_message);
+
+  step = ppr->approximation_switch_k_step;
+
+  if (step <= 0)
+    return _SUCCESS_;
+
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+
+    /** - choose the wavenumbers 0, step, 2*step, ..., and the last one */
+    kt_size = (ppt->k_size[index_md]-1)/step+1;
+    if ((kt_size-1)*step < ppt->k_size[index_md]-1)
+      kt_size++;
+
+    if (kt_size < 2)
+      continue;
+
+    /** - get the number of approximations of this mode */
+    memset(&pw,0,sizeof(struct perturbations_workspace));
+    class_call(perturbations_workspace_init(ppr,pba,pth,ppt,index_md,&pw),
+               ppt->error_message,
+               ppt->error_message);
+    ap_size = pw.ap_size;
+    class_call(perturbations_workspace_free(ppt,index_md,&pw),
+               ppt->error_message,
+               ppt->error_message);
+
+    class_alloc(ppt->switch_table_lnk[index_md],kt_size*sizeof(double),ppt->error_message);
+    class_alloc(ppt->switch_table_tau[index_md],kt_size*ap_size*sizeof(double),ppt->error_message);
+
+    /** - find the switches of each of these wavenumbers as in perturbations_solve_begin() */
+    class_setup_parallel();
+
+    class_parallel_for(index_kt,0,kt_size,0,with_arguments(ppr,pba,pth,ppt,index_md,step,ap_size),
+
+      int index_k = MIN(index_kt*step,ppt->k_size[index_md]-1);
+      double k = ppt->k[index_md][index_k];
+      struct perturbations_workspace pw_kt;
+      int interval_number;
+      double * interval_limit;
+      int ** interval_approx;
+      int index_ap;
+      int index_interval;
+      int switch_number;
+      double tau_switch;
+
+      memset(&pw_kt,0,sizeof(struct perturbations_workspace));
+      class_call(perturbations_workspace_init(ppr,pba,pth,ppt,index_md,&pw_kt),
+                 ppt->error_message,
+                 ppt->error_message);
+
+      class_call(perturbations_find_approximation_intervals(ppr,
+                                                            pba,
+                                                            pth,
+                                                            ppt,
+                                                            index_md,
+                                                            k,
+                                                            &pw_kt,
+                                                            ppt->tau_sampling[ppt->tau_size-1],
+                                                            &interval_number,
+                                                            &interval_limit,
+                                                            &interval_approx),
+                 ppt->error_message,
+                 ppt->error_message);
+
+      ppt->switch_table_lnk[index_md][index_kt] = log(k);
+
+      for (index_ap=0; index_ap<ap_size; index_ap++) {
+        switch_number = 0;
+        tau_switch = 0.;
+        for (index_interval=1; index_interval<interval_number; index_interval++) {
+          if (interval_approx[index_interval][index_ap] != interval_approx[index_interval-1][index_ap]) {
+            switch_number++;
+            tau_switch = interval_limit[index_interval];
+          }
+        }
+        ppt->switch_table_tau[index_md][index_kt*ap_size+index_ap] = (switch_number == 1) ? tau_switch : 0.;
+      }
+
+      for (index_interval=0; index_interval<interval_number; index_interval++)
+        free(interval_approx[index_interval]);
+      free(interval_approx);
+      free(interval_limit);
+
+      class_call(perturbations_workspace_free(ppt,index_md,&pw_kt),
+                 ppt->error_message,
+                 ppt->error_message);
+
+      return _SUCCESS_;
+    );
+
+    class_finish_parallel();
+
+    /* the table is only used once complete */
+    ppt->switch_table_size[index_md] = kt_size;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the table of perturbations_tabulate_approximation_switches().
+ *
+ * @param ppt Input/Output: pointer to the perturbation structure
+ * @return the error status
+ */
+
+int perturbations_free_approximation_switches(
+                                              struct perturbations * ppt
+                                              ) {
+
+  int index_md;
+
+  for (index_md = 0; index_md < ppt->md_size; index_md++) {
+    free(ppt->switch_table_lnk[index_md]);
+    free(ppt->switch_table_tau[index_md]);
+  }
+  free(ppt->switch_table_size);
+  free(ppt->switch_table_lnk);
+  free(ppt->switch_table_tau);
+
+  ppt->switch_table_size = NULL;
+  ppt->switch_table_lnk = NULL;
+  ppt->switch_table_tau = NULL;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Narrow down the times between which an approximation switches for
+ * a given wavenumber, around the time interpolated (linearly in log(k)
+ * and log(tau)) in the table of
+ * perturbations_tabulate_approximation_switches(). The approximations
+ * are probed on each side of the interpolated time, at relative
+ * distances growing from ppr->approximation_switch_bracket, and the
+ * bounds are updated with each result: the bisection of
+ * perturbations_find_approximation_switches() then skips the probes
+ * outside the bounds. Without a table, or if the table does not
+ * bracket this wavenumber, the bounds are left unchanged.
+ *
+ * @param ppr         Input: pointer to precision structure
+ * @param pba         Input: pointer to background structure
+ * @param pth         Input: pointer to the thermodynamics structure
+ * @param ppt         Input: pointer to the perturbation structure
+ * @param index_md    Input: index of mode under consideration (scalar/.../tensor)
+ * @param k           Input: wavenumber
+ * @param ppw         Input: pointer to perturbations_workspace structure containing index values and workspaces
+ * @param index_ap    Input: index of the approximation
+ * @param flag_switch Input: the approximation has switched when its value gets larger than this
+ * @param tau_before  Input/Output: time up to which the approximation is known not to have switched
+ * @param tau_after   Input/Output: time from which the approximation is known to have switched
+ * @return the error status
+ */
+
+int perturbations_predict_approximation_switch(
+                                               struct precision * ppr,
+                                               struct background * pba,
+                                               struct thermodynamics * pth,
+                                               struct perturbations * ppt,
+                                               int index_md,
+                                               double k,
+                                               struct perturbations_workspace * ppw,
+                                               int index_ap,
+                                               int flag_switch,
+                                               double * tau_before,
+                                               double * tau_after
+                                               ) {
+
+  int kt_size,inf,sup,mid;
+  double lnk,tau_inf,tau_sup,tau_switch,tau_probe,delta;
+  double * lnk_table;
+
+  if ((ppt->switch_table_size == NULL) || (ppt->switch_table_size[index_md] < 2))
+    return _SUCCESS_;
+
+  kt_size = ppt->switch_table_size[index_md];
+  lnk_table = ppt->switch_table_lnk[index_md];
+  lnk = log(k);
+
+  if ((lnk < lnk_table[0]) || (lnk > lnk_table[kt_size-1]))
+    return _SUCCESS_;
+
+  /** - find the tabulated wavenumbers around k */
+  inf = 0;
+  sup = kt_size-1;
+  while (sup-inf > 1) {
+    mid = (inf+sup)/2;
+    if (lnk < lnk_table[mid])
+      sup = mid;
+    else
+      inf = mid;
+  }
+
+  tau_inf = ppt->switch_table_tau[index_md][inf*ppw->ap_size+index_ap];
+  tau_sup = ppt->switch_table_tau[index_md][sup*ppw->ap_size+index_ap];
+
+  if ((tau_inf <= 0.) || (tau_sup <= 0.))
+    return _SUCCESS_;
+
+  tau_switch = exp(log(tau_inf) + (log(tau_sup)-log(tau_inf))*(lnk-lnk_table[inf])/(lnk_table[sup]-lnk_table[inf]));
+
+  /** - probe the approximation on each side of the interpolated time,
+      at relative distances growing from ppr->approximation_switch_bracket
+      by factors of ten until the switch is bracketed */
+
+  for (delta = ppr->approximation_switch_bracket; delta < 1.; delta *= 10.) {
+    tau_probe = tau_switch*(1.-delta);
+    if (tau_probe <= *tau_before)
+      break;
+    class_call(perturbations_approximations(ppr,pba,pth,ppt,index_md,k,tau_probe,ppw),
+               ppt->error_message,
+               ppt->error_message);
+    class_counter_add(counter_approximation_probes,1);
+    if (ppw->approx[index_ap] > flag_switch) {
+      *tau_after = tau_probe;
+    }
+    else {
+      *tau_before = tau_probe;
+      break;
+    }
+  }
+
+  for (delta = ppr->approximation_switch_bracket; delta < 1.e10; delta *= 10.) {
+    tau_probe = tau_switch*(1.+delta);
+    if (tau_probe >= *tau_after)
+      break;
+    class_call(perturbations_approximations(ppr,pba,pth,ppt,index_md,k,tau_probe,ppw),
+               ppt->error_message,
+               ppt->error_message);
+    class_counter_add(counter_approximation_probes,1);
+    if (ppw->approx[index_ap] > flag_switch) {
+      *tau_after = tau_probe;
+      break;
+    }
+    else {
+      *tau_before = tau_probe;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Initialize the field '-->pv' of a perturbations_workspace structure, which
  * is a perturbations_vector structure. This structure contains indices and
@@ -3838,14 +5547,13 @@ int perturbations_vector_init(
   int n_ncdm,index_q,ncdm_l_size;
   double rho_plus_p_ncdm,q,q2,epsilon,a,factor;
 
-  /** - allocate a new perturbations_vector structure to which ppw-->pv will point at the end of the routine */
+  /** - get a new perturbations_vector structure to which ppw-->pv will
+      point at the end of the routine (recycled from the workspace if
+      possible) */
 
-  class_alloc(ppv,sizeof(struct perturbations_vector),ppt->error_message);
-
-  /** - initialize pointers to NULL (they will be allocated later if
-      needed), relevant for perturbations_vector_free() */
-  ppv->l_max_ncdm = NULL;
-  ppv->q_size_ncdm = NULL;
+  class_call(perturbations_vector_acquire(pba,ppt,ppw,&ppv),
+             ppt->error_message,
+             ppt->error_message);
 
   /** - define all indices in this new vector (depends on approximation scheme, described by the input structure ppw-->pa) */
 
@@ -3889,7 +5597,7 @@ int perturbations_vector_init(
 
       /* temperature */
 
-      ppv->l_max_g = ppr->l_max_g;
+      ppv->l_max_g = ppw->l_max_g;
 
       class_define_index(ppv->index_pt_delta_g,_TRUE_,index_pt,1); /* photon density */
       class_define_index(ppv->index_pt_theta_g,_TRUE_,index_pt,1); /* photon velocity */
@@ -3901,7 +5609,7 @@ int perturbations_vector_init(
 
         /* polarization */
 
-        ppv->l_max_pol_g = ppr->l_max_pol_g;
+        ppv->l_max_pol_g = ppw->l_max_pol_g;
 
         class_define_index(ppv->index_pt_pol0_g,_TRUE_,index_pt,1);
         class_define_index(ppv->index_pt_pol1_g,_TRUE_,index_pt,1);
@@ -3965,7 +5673,7 @@ int perturbations_vector_init(
       class_define_index(ppv->index_pt_shear_ur,_TRUE_,index_pt,1); /* shear of ultra-relativistic neutrinos/relics */
 
       if (ppw->approx[ppw->index_ap_ufa] == (int)ufa_off) {
-        ppv->l_max_ur = ppr->l_max_ur;
+        ppv->l_max_ur = ppw->l_max_ur;
         class_define_index(ppv->index_pt_l3_ur,_TRUE_,index_pt,ppv->l_max_ur-2); /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3) */
       }
     }
@@ -3992,8 +5700,6 @@ int perturbations_vector_init(
     if (pba->has_ncdm == _TRUE_) {
       ppv->index_pt_psi0_ncdm1 = index_pt; /* density of ultra-relativistic neutrinos/relics */
       ppv->N_ncdm = pba->N_ncdm;
-      class_alloc(ppv->l_max_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
-      class_alloc(ppv->q_size_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
 
       for (n_ncdm = 0; n_ncdm < pba->N_ncdm; n_ncdm++){
         // Set value of ppv->l_max_ncdm:
@@ -4003,7 +5709,7 @@ int perturbations_vector_init(
                      ppt->error_message,
                      "ppr->l_max_ncdm=%d should be at least 4, i.e. we must integrate at least over first four momenta of non-cold dark matter perturbed phase-space distribution",n_ncdm);
           //Copy value from precision parameter:
-          ppv->l_max_ncdm[n_ncdm] = ppr->l_max_ncdm;
+          ppv->l_max_ncdm[n_ncdm] = ppw->l_max_ncdm;
           ppv->q_size_ncdm[n_ncdm] = pba->q_size_ncdm[n_ncdm];
         }
         else{
@@ -4106,8 +5812,6 @@ int perturbations_vector_init(
     if (ppt->evolve_tensor_ncdm == _TRUE_) {
       ppv->index_pt_psi0_ncdm1 = index_pt;
       ppv->N_ncdm = pba->N_ncdm;
-      class_alloc(ppv->l_max_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
-      class_alloc(ppv->q_size_ncdm,ppv->N_ncdm*sizeof(double),ppt->error_message);
 
       for (n_ncdm = 0; n_ncdm < pba->N_ncdm; n_ncdm++){
         // Set value of ppv->l_max_ncdm:
@@ -4136,9 +5840,15 @@ int perturbations_vector_init(
   /** - allocate vectors for storing the values of all these
       quantities and their time-derivatives at a given time */
 
-  class_calloc(ppv->y,ppv->pt_size,sizeof(double),ppt->error_message);
-  class_alloc(ppv->dy,ppv->pt_size*sizeof(double),ppt->error_message);
-  class_alloc(ppv->used_in_sources,ppv->pt_size*sizeof(int),ppt->error_message);
+  class_call(perturbations_vector_reserve(ppt,ppw,ppv),
+             ppt->error_message,
+             ppt->error_message);
+
+  /** - register the sparsity pattern of the jacobian for this approximation scheme */
+
+  class_call(perturbations_vector_jacobian_pattern(ppt,ppw,ppv),
+             ppt->error_message,
+             ppt->error_message);
 
   /** - specify which perturbations are needed in the evaluation of source terms */
 
@@ -5196,55 +6906,270 @@ int perturbations_vector_init(
         /* Use tight-coupling relation F_0^(2) = sqrt(6)*4/3* H'/kappa' (Credits C. Pitrou v3.3.0) */
         ppv->y[ppv->index_pt_delta_g] = _SQRT6_*4./3.*ppw->pv->y[ppw->pv->index_pt_gwdot]/ppw->pvecthermo[pth->index_th_dkappa];
 
-        /* Use tight-coupling relation G_0^(2) = -sqrt(2/3)* H'/kappa' (Credits C. Pitrou v3.3.0) */
-        ppv->y[ppv->index_pt_pol0_g] = -_SQRT6_/3.*ppw->pv->y[ppw->pv->index_pt_gwdot]/ppw->pvecthermo[pth->index_th_dkappa];
-      }
+        /* Use tight-coupling relation G_0^(2) = -sqrt(2/3)* H'/kappa' (Credits C. Pitrou v3.3.0) */
+        ppv->y[ppv->index_pt_pol0_g] = -_SQRT6_/3.*ppw->pv->y[ppw->pv->index_pt_gwdot]/ppw->pvecthermo[pth->index_th_dkappa];
+      }
+
+      /* -- case of switching on radiation streaming
+         approximation. Provide correct initial conditions to new set
+         of variables */
+
+      if ((pa_old[ppw->index_ap_rsa] == (int)rsa_off) && (ppw->approx[ppw->index_ap_rsa] == (int)rsa_on)) {
+
+        if (ppt->perturbations_verbose>2)
+          fprintf(stdout,"Mode k=%e: switch on radiation streaming approximation at tau=%e with Omega_r=%g\n",k,tau,ppw->pvecback[pba->index_bg_Omega_r]);
+
+      }
+    }
+
+    /** - --> (d) release the previous vector of perturbations */
+
+    class_call(perturbations_vector_release(ppw,ppw->pv),
+               ppt->error_message,
+               ppt->error_message);
+
+    /** - --> (e) let ppw-->pv points towards the perturbations_vector structure
+        that we just created */
+
+    ppw->pv = ppv;
+
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the perturbations_vector structure.
+ *
+ * @param pv        Input: pointer to perturbations_vector structure to be freed
+ * @return the error status
+ */
+
+int perturbations_vector_free(
+                              struct perturbations_vector * pv
+                              ) {
+
+  if (pv->l_max_ncdm != NULL) free(pv->l_max_ncdm);
+  if (pv->q_size_ncdm != NULL) free(pv->q_size_ncdm);
+  free(pv->y);
+  free(pv->dy);
+  free(pv->used_in_sources);
+  free(pv);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Get an empty perturbations_vector structure: either one previously
+ * released in the workspace, or a newly allocated one. The arrays
+ * l_max_ncdm and q_size_ncdm are ready for pba->N_ncdm species; the
+ * arrays y, dy and used_in_sources are resized later by
+ * perturbations_vector_reserve(), once pt_size is known.
+ *
+ * @param pba        Input: pointer to background structure
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param ppw        Input/Output: pointer to perturbations_workspace structure
+ * @param ppv        Output: pointer to the vector
+ * @return the error status
+ */
+
+int perturbations_vector_acquire(
+                                 struct background * pba,
+                                 struct perturbations * ppt,
+                                 struct perturbations_workspace * ppw,
+                                 struct perturbations_vector ** ppv
+                                 ) {
+
+  struct perturbations_vector * pv = NULL;
+  int index_spare;
+
+  for (index_spare=0; index_spare<2; index_spare++) {
+    if (ppw->pv_spare[index_spare] != NULL) {
+      pv = ppw->pv_spare[index_spare];
+      ppw->pv_spare[index_spare] = NULL;
+      break;
+    }
+  }
+
+  if (pv == NULL) {
+    class_calloc(pv,1,sizeof(struct perturbations_vector),ppt->error_message);
+    ppw->allocation_count++;
+  }
+
+  if ((pba->has_ncdm == _TRUE_) && (pba->N_ncdm > pv->N_ncdm_capacity)) {
+    free(pv->l_max_ncdm);
+    free(pv->q_size_ncdm);
+    pv->l_max_ncdm = NULL;
+    pv->q_size_ncdm = NULL;
+    pv->N_ncdm_capacity = 0;
+    class_alloc(pv->l_max_ncdm,pba->N_ncdm*sizeof(int),ppt->error_message);
+    class_alloc(pv->q_size_ncdm,pba->N_ncdm*sizeof(int),ppt->error_message);
+    pv->N_ncdm_capacity = pba->N_ncdm;
+    ppw->allocation_count += 2;
+  }
+
+  *ppv = pv;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Resize (if needed) the arrays y, dy and used_in_sources of a vector
+ * to its current pt_size, and set y to zero.
+ *
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param ppw        Input/Output: pointer to perturbations_workspace structure (for counting allocations)
+ * @param pv         Input/Output: pointer to the vector
+ * @return the error status
+ */
 
-      /* -- case of switching on radiation streaming
-         approximation. Provide correct initial conditions to new set
-         of variables */
+int perturbations_vector_reserve(
+                                 struct perturbations * ppt,
+                                 struct perturbations_workspace * ppw,
+                                 struct perturbations_vector * pv
+                                 ) {
 
-      if ((pa_old[ppw->index_ap_rsa] == (int)rsa_off) && (ppw->approx[ppw->index_ap_rsa] == (int)rsa_on)) {
+  if ((pv->pt_size > pv->pt_capacity) || (pv->y == NULL)) {
+    free(pv->y);
+    free(pv->dy);
+    free(pv->used_in_sources);
+    pv->y = NULL;
+    pv->dy = NULL;
+    pv->used_in_sources = NULL;
+    pv->pt_capacity = 0;
+    class_alloc(pv->y,MAX(pv->pt_size,1)*sizeof(double),ppt->error_message);
+    class_alloc(pv->dy,MAX(pv->pt_size,1)*sizeof(double),ppt->error_message);
+    class_alloc(pv->used_in_sources,MAX(pv->pt_size,1)*sizeof(int),ppt->error_message);
+    pv->pt_capacity = MAX(pv->pt_size,1);
+    ppw->allocation_count += 3;
+  }
 
-        if (ppt->perturbations_verbose>2)
-          fprintf(stdout,"Mode k=%e: switch on radiation streaming approximation at tau=%e with Omega_r=%g\n",k,tau,ppw->pvecback[pba->index_bg_Omega_r]);
+  memset(pv->y,0,pv->pt_size*sizeof(double));
 
-      }
-    }
+  return _SUCCESS_;
+}
 
-    /** - --> (d) free the previous vector of perturbations */
+/**
+ * Give back a vector which is no longer needed. It is kept in the
+ * workspace for the next approximation switch or wavenumber, or freed
+ * if the workspace already holds enough spare vectors.
+ *
+ * @param ppw        Input/Output: pointer to perturbations_workspace structure
+ * @param pv         Input: pointer to the vector
+ * @return the error status
+ */
 
-    class_call(perturbations_vector_free(ppw->pv),
-               ppt->error_message,
-               ppt->error_message);
+int perturbations_vector_release(
+                                 struct perturbations_workspace * ppw,
+                                 struct perturbations_vector * pv
+                                 ) {
 
-    /** - --> (e) let ppw-->pv points towards the perturbations_vector structure
-        that we just created */
+  int index_spare;
 
-    ppw->pv = ppv;
+  if (pv == NULL)
+    return _SUCCESS_;
 
+  for (index_spare=0; index_spare<2; index_spare++) {
+    if (ppw->pv_spare[index_spare] == NULL) {
+      ppw->pv_spare[index_spare] = pv;
+      return _SUCCESS_;
+    }
   }
 
-  return _SUCCESS_;
+  return perturbations_vector_free(pv);
 }
 
 /**
- * Free the perturbations_vector structure.
+ * Point the vector to the sparsity pattern of the jacobian kept in
+ * the workspace for its approximation scheme, registering a new
+ * (empty) one if this scheme was not met yet in this run.
  *
- * @param pv        Input: pointer to perturbations_vector structure to be freed
+ * The structure of the equations in perturbations_derivs() only
+ * depends on the mode, on the approximation scheme and on the lengths
+ * of the hierarchies, which also fix pt_size; it does not depend on
+ * the wavenumber (unless the hierarchies are truncated adaptively,
+ * see perturbations_find_l_max()) or on the initial condition. Hence
+ * the pattern, computed in
+ * perturbations_solve() for the first wavenumber, can be given to the
+ * ndf15 evolver for all the next ones, instead of being learned again
+ * from full jacobians in each time interval.
+ *
+ * @param ppt        Input: pointer to the perturbation structure
+ * @param ppw        Input/Output: pointer to perturbations_workspace structure, with the current approximation flags
+ * @param pv         Input/Output: pointer to the vector, with its final pt_size
  * @return the error status
  */
 
-int perturbations_vector_free(
-                              struct perturbations_vector * pv
-                              ) {
+int perturbations_vector_jacobian_pattern(
+                                          struct perturbations * ppt,
+                                          struct perturbations_workspace * ppw,
+                                          struct perturbations_vector * pv
+                                          ) {
 
-  if (pv->l_max_ncdm != NULL) free(pv->l_max_ncdm);
-  if (pv->q_size_ncdm != NULL) free(pv->q_size_ncdm);
-  free(pv->y);
-  free(pv->dy);
-  free(pv->used_in_sources);
-  free(pv);
+  int index_pattern, index_ap, key_size;
+  int * key;
+
+  key_size = ppw->ap_size+5;
+
+  /** - look for the current scheme among those already met */
+  for (index_pattern=0; index_pattern<ppw->jacobian_pattern_size; index_pattern++) {
+    key = ppw->jacobian_pattern_key + index_pattern*key_size;
+    if ((key[0] != pv->pt_size) ||
+        (key[ppw->ap_size+1] != ppw->l_max_g) ||
+        (key[ppw->ap_size+2] != ppw->l_max_pol_g) ||
+        (key[ppw->ap_size+3] != ppw->l_max_ur) ||
+        (key[ppw->ap_size+4] != ppw->l_max_ncdm))
+      continue;
+    for (index_ap=0; index_ap<ppw->ap_size; index_ap++) {
+      if (key[index_ap+1] != ppw->approx[index_ap])
+        break;
+    }
+    if (index_ap == ppw->ap_size) {
+      pv->jacobian_pattern = &(ppw->jacobian_pattern[index_pattern]);
+      return _SUCCESS_;
+    }
+  }
+
+  /** - otherwise register a new pattern, if there is room left */
+  if (ppw->jacobian_pattern_size == _MAX_NUMBER_OF_JACOBIAN_PATTERNS_) {
+    pv->jacobian_pattern = NULL;
+    return _SUCCESS_;
+  }
+
+  if (ppw->jacobian_pattern == NULL) {
+    class_calloc(ppw->jacobian_pattern,
+                 _MAX_NUMBER_OF_JACOBIAN_PATTERNS_,
+                 sizeof(struct jacobian_pattern),
+                 ppt->error_message);
+    ppw->allocation_count++;
+  }
+
+  /* ap_size is fixed within a run, so the keys only need to be resized for the first pattern */
+  if (ppw->jacobian_pattern_size == 0) {
+    class_call(perturbations_workspace_reserve((void**)&(ppw->jacobian_pattern_key),
+                                               &(ppw->jacobian_pattern_key_capacity),
+                                               _MAX_NUMBER_OF_JACOBIAN_PATTERNS_*key_size,
+                                               sizeof(int),
+                                               ppw,
+                                               ppt->error_message),
+               ppt->error_message,
+               ppt->error_message);
+  }
+
+  index_pattern = ppw->jacobian_pattern_size;
+  key = ppw->jacobian_pattern_key + index_pattern*key_size;
+  key[0] = pv->pt_size;
+  for (index_ap=0; index_ap<ppw->ap_size; index_ap++) {
+    key[index_ap+1] = ppw->approx[index_ap];
+  }
+  key[ppw->ap_size+1] = ppw->l_max_g;
+  key[ppw->ap_size+2] = ppw->l_max_pol_g;
+  key[ppw->ap_size+3] = ppw->l_max_ur;
+  key[ppw->ap_size+4] = ppw->l_max_ncdm;
+  jacobian_pattern_reset(&(ppw->jacobian_pattern[index_pattern]));
+  ppw->jacobian_pattern_size++;
+
+  pv->jacobian_pattern = &(ppw->jacobian_pattern[index_pattern]);
 
   return _SUCCESS_;
 }
@@ -6746,7 +8671,96 @@ int perturbations_einstein(
   }
 
   return _SUCCESS_;
+}
+
+/**
+ * Equation of state of the fluid with background_w_fld(), memoized in
+ * the workspace: perturbations_derivs() and
+ * perturbations_total_stress_energy() need it at the same scale
+ * factor, and so do the successive calls of perturbations_derivs() at
+ * the same time.
+ *
+ * @param pba            Input: pointer to background structure
+ * @param ppw            Input/Output: pointer to perturbation workspace
+ * @param a              Input: scale factor
+ * @param w_fld          Output: equation of state parameter w(a)
+ * @param dw_over_da_fld Output: its derivative dw/da
+ * @param integral_fld   Output: its integral (see background_w_fld())
+ * @param error_message  Output: error message
+ * @return the error status
+ */
+
+int perturbations_w_fld(
+                        struct background * pba,
+                        struct perturbations_workspace * ppw,
+                        double a,
+                        double * w_fld,
+                        double * dw_over_da_fld,
+                        double * integral_fld,
+                        ErrorMsg error_message
+                        ) {
+
+  if (a != ppw->a_w_fld) {
+    class_call(background_w_fld(pba,a,&(ppw->w_fld),&(ppw->dw_over_da_fld),&(ppw->integral_fld)),
+               pba->error_message,
+               error_message);
+    ppw->a_w_fld = a;
+  }
+
+  *w_fld = ppw->w_fld;
+  *dw_over_da_fld = ppw->dw_over_da_fld;
+  *integral_fld = ppw->integral_fld;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the factors of the momentum integrals of the ncdm species at
+ * scale factor a (energy and weights of each momentum bin, see the
+ * definitions in the perturbations_workspace structure), and
+ * keep them in the workspace: they do not depend on the perturbations,
+ * and perturbations_derivs() and perturbations_total_stress_energy()
+ * need them at the same scale factor, as do the successive calls of
+ * perturbations_derivs() at the same time.
+ *
+ * @param pba Input: pointer to background structure
+ * @param ppw Input/Output: pointer to perturbation workspace
+ * @param a   Input: scale factor
+ * @return the error status
+ */
+
+int perturbations_ncdm_kernels(
+                               struct background * pba,
+                               struct perturbations_workspace * ppw,
+                               double a
+                               ) {
 
+  int n_ncdm,index_q,index_kernel;
+  double q,q2,epsilon,a2;
+
+  if (a == ppw->a_ncdm)
+    return _SUCCESS_;
+
+  a2 = a*a;
+  index_kernel = 0;
+
+  for (n_ncdm=0; n_ncdm<pba->N_ncdm; n_ncdm++) {
+    for (index_q=0; index_q<pba->q_size_ncdm[n_ncdm]; index_q++) {
+      q = pba->q_ncdm[n_ncdm][index_q];
+      q2 = q*q;
+      /* the two ways of grouping the terms of the original expressions differ by rounding */
+      ppw->epsilon_ncdm[index_kernel] = sqrt(q*q+a2*pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]);
+      epsilon = sqrt(q2+pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]*a2);
+      ppw->w_rho_ncdm[index_kernel] = q2*epsilon*pba->w_ncdm[n_ncdm][index_q];
+      ppw->w_theta_ncdm[index_kernel] = q2*q*pba->w_ncdm[n_ncdm][index_q];
+      ppw->w_p_ncdm[index_kernel] = q2*q2/epsilon*pba->w_ncdm[n_ncdm][index_q];
+      index_kernel++;
+    }
+  }
+
+  ppw->a_ncdm = a;
+
+  return _SUCCESS_;
 }
 
 int perturbations_total_stress_energy(
@@ -6783,8 +8797,8 @@ int perturbations_total_stress_energy(
   double delta_p_ncdm=0.;
   double factor;
   double rho_plus_p_ncdm;
-  int index_q,n_ncdm,idx;
-  double epsilon,q,q2,cg2_ncdm,w_ncdm,rho_ncdm_bg,p_ncdm_bg,pseudo_p_ncdm;
+  int index_q,n_ncdm,idx,index_kernel;
+  double cg2_ncdm,w_ncdm,rho_ncdm_bg,p_ncdm_bg,pseudo_p_ncdm;
   double w_fld,dw_over_da_fld,integral_fld;
   double gwncdm;
   double rho_relativistic;
@@ -7074,6 +9088,10 @@ int perturbations_total_stress_energy(
       }
       else{
         // We must integrate to find perturbations:
+        class_call(perturbations_ncdm_kernels(pba,ppw,a),
+                   ppt->error_message,
+                   ppt->error_message);
+        index_kernel = 0;
         for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++){
           rho_delta_ncdm = 0.0;
           rho_plus_p_theta_ncdm = 0.0;
@@ -7083,17 +9101,14 @@ int perturbations_total_stress_energy(
 
           for (index_q=0; index_q < ppw->pv->q_size_ncdm[n_ncdm]; index_q ++) {
 
-            q = pba->q_ncdm[n_ncdm][index_q];
-            q2 = q*q;
-            epsilon = sqrt(q2+pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]*a2);
-
-            rho_delta_ncdm += q2*epsilon*pba->w_ncdm[n_ncdm][index_q]*y[idx];
-            rho_plus_p_theta_ncdm += q2*q*pba->w_ncdm[n_ncdm][index_q]*y[idx+1];
-            rho_plus_p_shear_ncdm += q2*q2/epsilon*pba->w_ncdm[n_ncdm][index_q]*y[idx+2];
-            delta_p_ncdm += q2*q2/epsilon*pba->w_ncdm[n_ncdm][index_q]*y[idx];
+            rho_delta_ncdm += ppw->w_rho_ncdm[index_kernel]*y[idx];
+            rho_plus_p_theta_ncdm += ppw->w_theta_ncdm[index_kernel]*y[idx+1];
+            rho_plus_p_shear_ncdm += ppw->w_p_ncdm[index_kernel]*y[idx+2];
+            delta_p_ncdm += ppw->w_p_ncdm[index_kernel]*y[idx];
 
             //Jump to next momentum bin:
             idx+=(ppw->pv->l_max_ncdm[n_ncdm]+1);
+            index_kernel++;
           }
 
           rho_delta_ncdm *= factor;
@@ -7177,7 +9192,7 @@ int perturbations_total_stress_energy(
     /* fluid contribution */
     if (pba->has_fld == _TRUE_) {
 
-      class_call(background_w_fld(pba,a,&w_fld,&dw_over_da_fld,&integral_fld), pba->error_message, ppt->error_message);
+      class_call(perturbations_w_fld(pba,ppw,a,&w_fld,&dw_over_da_fld,&integral_fld,ppt->error_message), ppt->error_message, ppt->error_message);
       w_prime_fld = dw_over_da_fld * a_prime_over_a * a;
 
       if (pba->use_ppf == _FALSE_) {
@@ -7365,6 +9380,10 @@ int perturbations_total_stress_energy(
       idx = ppw->pv->index_pt_psi0_ncdm1;
 
       // We must integrate to find perturbations:
+      class_call(perturbations_ncdm_kernels(pba,ppw,a),
+                 ppt->error_message,
+                 ppt->error_message);
+      index_kernel = 0;
       for (n_ncdm=0; n_ncdm < pba->N_ncdm; n_ncdm++){
 
         gwncdm = 0.;
@@ -7373,14 +9392,11 @@ int perturbations_total_stress_energy(
 
         for (index_q=0; index_q < ppw->pv->q_size_ncdm[n_ncdm]; index_q ++) {
 
-          q = pba->q_ncdm[n_ncdm][index_q];
-          q2 = q*q;
-          epsilon = sqrt(q2+pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]*a2);
-
-          gwncdm += q2*q2/epsilon*pba->w_ncdm[n_ncdm][index_q]*(1./15.*y[idx]+2./21.*y[idx+2]+1./35.*y[idx+4]);
+          gwncdm += ppw->w_p_ncdm[index_kernel]*(1./15.*y[idx]+2./21.*y[idx+2]+1./35.*y[idx+4]);
 
           //Jump to next momentum bin:
           idx+=(ppw->pv->l_max_ncdm[n_ncdm]+1);
+          index_kernel++;
         }
 
         gwncdm *= -_SQRT6_*4*a2*factor;
@@ -7482,29 +9498,45 @@ int perturbations_sources(
   pvecthermo = ppw->pvecthermo;
   pvecmetric = ppw->pvecmetric;
 
-  /** - get background/thermo quantities in this point */
+  /** - get background/thermo quantities in this point (copied from
+      the tables of perturbations_timesampling_for_sources() when tau
+      is one of the sampling points, as it is with ndf15) */
 
-  class_call(background_at_tau(pba,
-                               tau,
-                               normal_info,
-                               inter_closeby,
-                               &(ppw->last_index_back),
-                               pvecback),
-             pba->error_message,
-             error_message);
+  if (tau == ppt->tau_sampling[index_tau]) {
 
-  /* redshift (remember that a in the code stands for (a/a_0)) */
-  z = 1./pvecback[pba->index_bg_a]-1.;
+    memcpy(pvecback,
+           ppt->pvecback_sampling+index_tau*pba->bg_size_normal,
+           pba->bg_size_normal*sizeof(double));
+    memcpy(pvecthermo,
+           ppt->pvecthermo_sampling+index_tau*pth->th_size,
+           pth->th_size*sizeof(double));
 
-  class_call(thermodynamics_at_z(pba,
-                                 pth,
-                                 z,  /* redshift z=1/a-1 */
+    z = 1./pvecback[pba->index_bg_a]-1.;
+  }
+  else {
+
+    class_call(background_at_tau(pba,
+                                 tau,
+                                 normal_info,
                                  inter_closeby,
-                                 &(ppw->last_index_thermo),
-                                 pvecback,
-                                 pvecthermo),
-             pth->error_message,
-             error_message);
+                                 &(ppw->last_index_back),
+                                 pvecback),
+               pba->error_message,
+               error_message);
+
+    /* redshift (remember that a in the code stands for (a/a_0)) */
+    z = 1./pvecback[pba->index_bg_a]-1.;
+
+    class_call(thermodynamics_at_z(pba,
+                                   pth,
+                                   z,  /* redshift z=1/a-1 */
+                                   inter_closeby,
+                                   &(ppw->last_index_thermo),
+                                   pvecback,
+                                   pvecthermo),
+               pth->error_message,
+               error_message);
+  }
 
   a = ppw->pvecback[pba->index_bg_a];
   a2 = a * a;
@@ -7972,7 +10004,7 @@ int perturbations_sources(
     /* theta_fld */
     if (ppt->has_source_theta_fld == _TRUE_) {
 
-      class_call(background_w_fld(pba,a,&w_fld,&dw_over_da_fld,&integral_fld), pba->error_message, ppt->error_message);
+      class_call(perturbations_w_fld(pba,ppw,a,&w_fld,&dw_over_da_fld,&integral_fld,ppt->error_message), ppt->error_message, ppt->error_message);
 
       _set_source_(ppt->index_tp_theta_fld) = ppw->rho_plus_p_theta_fld/(1.+w_fld)/pvecback[pba->index_bg_rho_fld]
         + theta_shift; // N-body gauge correction
@@ -8073,6 +10105,77 @@ int perturbations_sources(
 }
 
 
+/**
+ * Get a pointer to a new row at the end of one of the tables filled
+ * by perturbations_print_variables().
+ *
+ * In streaming mode (ppt->stream_perturbations), the table in memory
+ * holds at most _PERTURBATIONS_OUTPUT_CHUNK_ rows: when it is full,
+ * its content is appended to a temporary file (created at the first
+ * call) and the table starts again from its beginning. The full table
+ * is then made of the rows in the file, followed by those in memory.
+ * Since each value of k is integrated by a single thread, no lock is
+ * needed.
+ *
+ * @param ppt              Input: pointer to perturbation structure
+ * @param data             Input/Output: table in memory
+ * @param size_data        Input/Output: number of doubles in the table in memory
+ * @param file             Input/Output: temporary file (streaming mode only)
+ * @param number_of_titles Input: number of columns
+ * @param dataptr          Output: pointer to the new row
+ * @param error_message    Output: error message
+ * @return the error status
+ */
+
+int perturbations_output_new_row(
+                                 struct perturbations * ppt,
+                                 double ** data,
+                                 int * size_data,
+                                 FILE ** file,
+                                 int number_of_titles,
+                                 double ** dataptr,
+                                 ErrorMsg error_message
+                                 ) {
+
+  if (*data == NULL){
+    if (ppt->stream_perturbations == _TRUE_) {
+      class_alloc(*data,
+                  sizeof(double)*_PERTURBATIONS_OUTPUT_CHUNK_*number_of_titles,
+                  error_message);
+    }
+    else {
+      class_alloc(*data,
+                  sizeof(double)*number_of_titles,
+                  error_message);
+    }
+    *size_data = 0;
+  }
+  else if (ppt->stream_perturbations == _TRUE_) {
+    if (*size_data == _PERTURBATIONS_OUTPUT_CHUNK_*number_of_titles) {
+      if (*file == NULL) {
+        *file = tmpfile();
+        class_test(*file == NULL,
+                   error_message,
+                   "could not create a temporary file for the output of perturbations");
+      }
+      class_test(fwrite(*data,sizeof(double),*size_data,*file) != (size_t)(*size_data),
+                 error_message,
+                 "could not write the output of perturbations to a temporary file");
+      *size_data = 0;
+    }
+  }
+  else {
+    class_realloc(*data,
+                  (*size_data+number_of_titles)*sizeof(double),
+                  error_message);
+  }
+
+  *dataptr = *data+*size_data;
+  *size_data += number_of_titles;
+
+  return _SUCCESS_;
+}
+
 /**
  * When testing the code or a cosmological model, it can be useful to
  * output perturbations at each step of integration (and not just the
@@ -8491,22 +10594,17 @@ int perturbations_print_variables(double tau,
     }
 
     //    fprintf(ppw->perturbations_output_file," ");
-    /** - --> Handle (re-)allocation */
-    if (ppt->scalar_perturbations_data[ppw->index_ikout] == NULL){
-      class_alloc(ppt->scalar_perturbations_data[ppw->index_ikout],
-                  sizeof(double)*ppt->number_of_scalar_titles,
-                  error_message);
-      ppt->size_scalar_perturbation_data[ppw->index_ikout] = 0;
-    }
-    else{
-      class_realloc(ppt->scalar_perturbations_data[ppw->index_ikout],
-                    (ppt->size_scalar_perturbation_data[ppw->index_ikout]+ppt->number_of_scalar_titles)*sizeof(double),
-                    ppt->error_message);
-    }
+    /** - --> Get the next row of the table */
+    class_call(perturbations_output_new_row(ppt,
+                                            &(ppt->scalar_perturbations_data[ppw->index_ikout]),
+                                            &(ppt->size_scalar_perturbation_data[ppw->index_ikout]),
+                                            &(ppt->scalar_perturbations_file[ppw->index_ikout]),
+                                            ppt->number_of_scalar_titles,
+                                            &dataptr,
+                                            error_message),
+               error_message,
+               error_message);
     storeidx = 0;
-    dataptr = ppt->scalar_perturbations_data[ppw->index_ikout]+
-      ppt->size_scalar_perturbation_data[ppw->index_ikout];
-    ppt->size_scalar_perturbation_data[ppw->index_ikout] += ppt->number_of_scalar_titles;
 
     class_store_double(dataptr, tau, _TRUE_, storeidx);
     class_store_double(dataptr, pvecback[pba->index_bg_a], _TRUE_, storeidx);
@@ -8603,22 +10701,17 @@ int perturbations_print_variables(double tau,
       l4_ur = y[ppw->pv->index_pt_delta_ur+4];
     }
 
-    /** - --> Handle (re-)allocation */
-    if (ppt->tensor_perturbations_data[ppw->index_ikout] == NULL){
-      class_alloc(ppt->tensor_perturbations_data[ppw->index_ikout],
-                  sizeof(double)*ppt->number_of_tensor_titles,
-                  error_message);
-      ppt->size_tensor_perturbation_data[ppw->index_ikout] = 0;
-    }
-    else{
-      ppt->tensor_perturbations_data[ppw->index_ikout] =
-        (double*)realloc(ppt->tensor_perturbations_data[ppw->index_ikout],
-                sizeof(double)*(ppt->size_tensor_perturbation_data[ppw->index_ikout]+ppt->number_of_tensor_titles));
-    }
+    /** - --> Get the next row of the table */
+    class_call(perturbations_output_new_row(ppt,
+                                            &(ppt->tensor_perturbations_data[ppw->index_ikout]),
+                                            &(ppt->size_tensor_perturbation_data[ppw->index_ikout]),
+                                            &(ppt->tensor_perturbations_file[ppw->index_ikout]),
+                                            ppt->number_of_tensor_titles,
+                                            &dataptr,
+                                            error_message),
+               error_message,
+               error_message);
     storeidx = 0;
-    dataptr = ppt->tensor_perturbations_data[ppw->index_ikout]+
-      ppt->size_tensor_perturbation_data[ppw->index_ikout];
-    ppt->size_tensor_perturbation_data[ppw->index_ikout] += ppt->number_of_tensor_titles;
 
     //fprintf(ppw->perturbations_output_file," ");
     class_store_double(dataptr, tau, _TRUE_, storeidx);
@@ -8697,6 +10790,40 @@ int perturbations_print_variables(double tau,
 
 }
 
+/**
+ * Free-streaming recurrence of a Boltzmann hierarchy, for \f$ l_{min} \leq l < l_{max} \f$:
+ * \f$ F_l' = {\rm factor} \times [l s_l F_{l-1} - (l+1) s_{l+1} F_{l+1}]/(2l+1) - {\rm rate} \times F_l \f$.
+ *
+ * The coefficients are taken from the workspace, so that the loop has
+ * no division and no branch, and can be vectorized by the compiler.
+ *
+ * @param y      Input: first multipole of the hierarchy, \f$ F_0 \f$
+ * @param dy     Output: its derivative (a different array than y)
+ * @param ppw    Input: workspace, with the coefficients s_l_minus and s_l_plus
+ * @param factor Input: free-streaming factor (k, or qk/epsilon for ncdm)
+ * @param rate   Input: damping rate (e.g. Thomson scattering rate, or 0)
+ * @param l_min  Input: first multipole
+ * @param l_max  Input: end of the loop (the last multipole is truncated separately)
+ */
+
+static inline void perturbations_hierarchy_streaming(
+                                                     const double * __restrict__ y,
+                                                     double * __restrict__ dy,
+                                                     struct perturbations_workspace * ppw,
+                                                     double factor,
+                                                     double rate,
+                                                     int l_min,
+                                                     int l_max
+                                                     ) {
+  const double * __restrict__ s_l_minus = ppw->s_l_minus;
+  const double * __restrict__ s_l_plus = ppw->s_l_plus;
+  int l;
+
+  for (l = l_min; l < l_max; l++) {
+    dy[l] = factor*(s_l_minus[l]*y[l-1]-s_l_plus[l]*y[l+1]) - rate*y[l];
+  }
+}
+
 /**
  * Compute derivative of all perturbations to be integrated
  *
@@ -8780,7 +10907,7 @@ int perturbations_derivs(double tau,
   double R_idm_b = 0., dR_idm_b = 0., S_idm_b = 0.; /* these are just going to be used as a short hand notation */
 
   /* for use with non-cold dark matter (ncdm): */
-  int index_q,n_ncdm,idx;
+  int index_q,n_ncdm,idx,index_kernel;
   double q,epsilon,dlnf0_dlnq,qk_div_epsilon;
   double rho_ncdm_bg,p_ncdm_bg,pseudo_p_ncdm,w_ncdm,ca2_ncdm,ceff2_ncdm=0.,cvis2_ncdm=0.;
 
@@ -8810,26 +10937,40 @@ int perturbations_derivs(double tau,
   pvecmetric = ppw->pvecmetric;
   pv = ppw->pv;
 
-  /** - get background/thermo quantities in this point */
+  /** - get background/thermo quantities in this point (copied from
+      the previous call if it was at the same time, as for the
+      numerical jacobian and the Newton iterations of ndf15; pvecback
+      and pvecthermo may have been overwritten in between) */
 
-  class_call(background_at_tau(pba,
-                               tau,
-                               normal_info,
-                               inter_closeby,
-                               &(ppw->last_index_back),
-                               pvecback),
-             pba->error_message,
-             error_message);
+  if (tau == ppw->tau_derivs) {
+    memcpy(pvecback,ppw->pvecback_derivs,pba->bg_size_normal*sizeof(double));
+    memcpy(pvecthermo,ppw->pvecthermo_derivs,pth->th_size*sizeof(double));
+  }
+  else {
 
-  class_call(thermodynamics_at_z(pba,
-                                 pth,
-                                 1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
+    class_call(background_at_tau(pba,
+                                 tau,
+                                 normal_info,
                                  inter_closeby,
-                                 &(ppw->last_index_thermo),
-                                 pvecback,
-                                 pvecthermo),
-             pth->error_message,
-             error_message);
+                                 &(ppw->last_index_back),
+                                 pvecback),
+               pba->error_message,
+               error_message);
+
+    class_call(thermodynamics_at_z(pba,
+                                   pth,
+                                   1./pvecback[pba->index_bg_a]-1.,  /* redshift z=1/a-1 */
+                                   inter_closeby,
+                                   &(ppw->last_index_thermo),
+                                   pvecback,
+                                   pvecthermo),
+               pth->error_message,
+               error_message);
+
+    memcpy(ppw->pvecback_derivs,pvecback,pba->bg_size_normal*sizeof(double));
+    memcpy(ppw->pvecthermo_derivs,pvecthermo,pth->th_size*sizeof(double));
+    ppw->tau_derivs = tau;
+  }
 
   /** - get metric perturbations with perturbations_einstein() */
   class_call(perturbations_einstein(ppr,
@@ -9147,12 +11288,8 @@ int perturbations_derivs(double tau,
           - photon_scattering_rate*y[pv->index_pt_l3_g];
 
         /** - -----> photon temperature l>3 */
-        for (l = 4; l < pv->l_max_g; l++) {
-
-          dy[pv->index_pt_delta_g+l] = k/(2.0*l+1.0)*
-            (l*s_l[l]*y[pv->index_pt_delta_g+l-1]-(l+1)*s_l[l+1]*y[pv->index_pt_delta_g+l+1])
-            - photon_scattering_rate*y[pv->index_pt_delta_g+l];
-        }
+        perturbations_hierarchy_streaming(y+pv->index_pt_delta_g,dy+pv->index_pt_delta_g,ppw,
+                                          k,photon_scattering_rate,4,pv->l_max_g);
 
         /** - -----> photon temperature lmax */
         l = pv->l_max_g; /* l=lmax */
@@ -9180,10 +11317,8 @@ int perturbations_derivs(double tau,
 
         /** - -----> photon polarization l>2 */
 
-        for (l=3; l < pv->l_max_pol_g; l++)
-          dy[pv->index_pt_pol0_g+l] = k/(2.*l+1)*
-            (l*s_l[l]*y[pv->index_pt_pol0_g+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_pol0_g+l+1])
-            -photon_scattering_rate*y[pv->index_pt_pol0_g+l];
+        perturbations_hierarchy_streaming(y+pv->index_pt_pol0_g,dy+pv->index_pt_pol0_g,ppw,
+                                          k,photon_scattering_rate,3,pv->l_max_pol_g);
 
         /** - -----> photon polarization lmax_pol */
 
@@ -9343,10 +11478,8 @@ int perturbations_derivs(double tau,
         (l*s_l[l]*s_l[2]*y[pv->index_pt_F0_dr+2]-(l+1.)*s_l[l+1]*y[pv->index_pt_F0_dr+4]);
 
       /** - ----> exact dr l>3 */
-      for (l = 4; l < pv->l_max_dr; l++) {
-        dy[pv->index_pt_F0_dr+l] = k/(2.*l+1)*
-          (l*s_l[l]*y[pv->index_pt_F0_dr+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_F0_dr+l+1]);
-      }
+      perturbations_hierarchy_streaming(y+pv->index_pt_F0_dr,dy+pv->index_pt_F0_dr,ppw,
+                                        k,0.,4,pv->l_max_dr);
 
       /** - ----> exact dr lmax_dr */
       l = pv->l_max_dr;
@@ -9364,7 +11497,7 @@ int perturbations_derivs(double tau,
         /** - ----> factors w, w_prime, adiabatic sound speed ca2 (all three background-related),
             plus actual sound speed in the fluid rest frame cs2 */
 
-        class_call(background_w_fld(pba,a,&w_fld,&dw_over_da_fld,&integral_fld), pba->error_message, ppt->error_message);
+        class_call(perturbations_w_fld(pba,ppw,a,&w_fld,&dw_over_da_fld,&integral_fld,ppt->error_message), ppt->error_message, ppt->error_message);
         w_prime_fld = dw_over_da_fld * a_prime_over_a * a;
 
         ca2 = w_fld - w_prime_fld / 3. / (1.+w_fld) / a_prime_over_a;
@@ -9444,10 +11577,8 @@ int perturbations_derivs(double tau,
             (l*2.*s_l[l]*s_l[2]*y[pv->index_pt_shear_ur]-(l+1.)*s_l[l+1]*y[pv->index_pt_l3_ur+1]);
 
           /** - -----> exact ur l>3 */
-          for (l = 4; l < pv->l_max_ur; l++) {
-            dy[pv->index_pt_delta_ur+l] = k/(2.*l+1)*
-              (l*s_l[l]*y[pv->index_pt_delta_ur+l-1]-(l+1.)*s_l[l+1]*y[pv->index_pt_delta_ur+l+1]);
-          }
+          perturbations_hierarchy_streaming(y+pv->index_pt_delta_ur,dy+pv->index_pt_delta_ur,ppw,
+                                            k,0.,4,pv->l_max_ur);
 
           /** - -----> exact ur lmax_ur */
           l = pv->l_max_ur;
@@ -9576,6 +11707,11 @@ int perturbations_derivs(double tau,
 
       else {
 
+        class_call(perturbations_ncdm_kernels(pba,ppw,a),
+                   ppt->error_message,
+                   error_message);
+        index_kernel = 0;
+
         /** - -----> loop over species */
 
         for (n_ncdm=0; n_ncdm<pv->N_ncdm; n_ncdm++) {
@@ -9588,7 +11724,7 @@ int perturbations_derivs(double tau,
 
             dlnf0_dlnq = pba->dlnf0_dlnq_ncdm[n_ncdm][index_q];
             q = pba->q_ncdm[n_ncdm][index_q];
-            epsilon = sqrt(q*q+a2*pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]);
+            epsilon = ppw->epsilon_ncdm[index_kernel];
             qk_div_epsilon = k*q/epsilon;
 
             /** - -----> ncdm density for given momentum bin */
@@ -9607,9 +11743,8 @@ int perturbations_derivs(double tau,
 
             /** - -----> ncdm l>3 for given momentum bin */
 
-            for (l=3; l<pv->l_max_ncdm[n_ncdm]; l++){
-              dy[idx+l] = qk_div_epsilon/(2.*l+1.0)*(l*s_l[l]*y[idx+(l-1)]-(l+1.)*s_l[l+1]*y[idx+(l+1)]);
-            }
+            l = pv->l_max_ncdm[n_ncdm];
+            perturbations_hierarchy_streaming(y+idx,dy+idx,ppw,qk_div_epsilon,0.,3,l);
 
             /** - -----> ncdm lmax for given momentum bin (truncation as in Ma and Bertschinger)
                 but with curvature taken into account a la arXiv:1305.3261 */
@@ -9619,6 +11754,7 @@ int perturbations_derivs(double tau,
             /** - -----> jump to next momentum bin or species */
 
             idx += (pv->l_max_ncdm[n_ncdm]+1);
+            index_kernel++;
           }
         }
       }
@@ -9727,11 +11863,8 @@ int perturbations_derivs(double tau,
       -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_l3_g];
 
     /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
-    for (l=4; l < pv->l_max_g; l++)
-      dy[pv->index_pt_delta_g+l] =
-        k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_delta_g+l-1]
-                     -(l+1.)*s_l[l+1]*y[pv->index_pt_delta_g+l+1])
-        -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_delta_g+l];
+    perturbations_hierarchy_streaming(y+pv->index_pt_delta_g,dy+pv->index_pt_delta_g,ppw,
+                                      k,pvecthermo[pth->index_th_dkappa],4,pv->l_max_g);
 
     /* l=lmax */
     l = pv->l_max_g;
@@ -9746,11 +11879,8 @@ int perturbations_derivs(double tau,
       -pvecthermo[pth->index_th_dkappa]*(y[pv->index_pt_pol0_g]-_SQRT6_*P1);
 
     /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
-    for (l=1; l < pv->l_max_pol_g; l++)
-      dy[pv->index_pt_pol0_g+l] =
-        k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_pol0_g+l-1]
-                     -(l+1.)*s_l[l+1]*y[pv->index_pt_pol0_g+l+1])
-        -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_pol0_g+l];
+    perturbations_hierarchy_streaming(y+pv->index_pt_pol0_g,dy+pv->index_pt_pol0_g,ppw,
+                                      k,pvecthermo[pth->index_th_dkappa],1,pv->l_max_pol_g);
 
     /* l=lmax */
     l = pv->l_max_pol_g;
@@ -9835,11 +11965,8 @@ int perturbations_derivs(double tau,
           -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_l3_g];
 
         /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
-        for (l=4; l < pv->l_max_g; l++)
-          dy[pv->index_pt_delta_g+l] =
-            k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_delta_g+l-1]
-                         -(l+1.)*s_l[l+1]*y[pv->index_pt_delta_g+l+1])
-            -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_delta_g+l];
+        perturbations_hierarchy_streaming(y+pv->index_pt_delta_g,dy+pv->index_pt_delta_g,ppw,
+                                          k,pvecthermo[pth->index_th_dkappa],4,pv->l_max_g);
 
         /* l=lmax */
         l = pv->l_max_g;
@@ -9854,11 +11981,8 @@ int perturbations_derivs(double tau,
           -pvecthermo[pth->index_th_dkappa]*(y[pv->index_pt_pol0_g]-_SQRT6_*P2);
 
         /* additional momenta in Boltzmann hierarchy (beyond l=0,1,2,3,4) */
-        for (l=1; l < pv->l_max_pol_g; l++)
-          dy[pv->index_pt_pol0_g+l] =
-            k/(2.*l+1.)*(l*s_l[l]*y[pv->index_pt_pol0_g+l-1]
-                         -(l+1.)*s_l[l+1]*y[pv->index_pt_pol0_g+l+1])
-            -pvecthermo[pth->index_th_dkappa]*y[pv->index_pt_pol0_g+l];
+        perturbations_hierarchy_streaming(y+pv->index_pt_pol0_g,dy+pv->index_pt_pol0_g,ppw,
+                                          k,pvecthermo[pth->index_th_dkappa],1,pv->l_max_pol_g);
 
         /* l=lmax */
         l = pv->l_max_pol_g;
@@ -9900,6 +12024,11 @@ int perturbations_derivs(double tau,
 
       idx = pv->index_pt_psi0_ncdm1;
 
+      class_call(perturbations_ncdm_kernels(pba,ppw,a),
+                 ppt->error_message,
+                 error_message);
+      index_kernel = 0;
+
       /** - ---> loop over species */
 
       for (n_ncdm=0; n_ncdm<pv->N_ncdm; n_ncdm++) {
@@ -9912,8 +12041,7 @@ int perturbations_derivs(double tau,
 
           dlnf0_dlnq = pba->dlnf0_dlnq_ncdm[n_ncdm][index_q];
           q = pba->q_ncdm[n_ncdm][index_q];
-          epsilon = sqrt(q*q+a2*pba->M_ncdm[n_ncdm]*pba->M_ncdm[n_ncdm]);
-          qk_div_epsilon = k*q/epsilon;
+          qk_div_epsilon = k*q/ppw->epsilon_ncdm[index_kernel];
 
           /** - ----> ncdm density for given momentum bin */
 
@@ -9921,9 +12049,8 @@ int perturbations_derivs(double tau,
 
           /** - ----> ncdm l>0 for given momentum bin */
 
-          for (l=1; l<pv->l_max_ncdm[n_ncdm]; l++){
-            dy[idx+l] = qk_div_epsilon/(2.*l+1.0)*(l*s_l[l]*y[idx+(l-1)]-(l+1.)*s_l[l+1]*y[idx+(l+1)]);
-          }
+          l = pv->l_max_ncdm[n_ncdm];
+          perturbations_hierarchy_streaming(y+idx,dy+idx,ppw,qk_div_epsilon,0.,1,l);
 
           /** - ----> ncdm lmax for given momentum bin (truncation as in Ma and Bertschinger)
               but with curvature taken into account a la arXiv:1305.3261 */
@@ -9933,6 +12060,7 @@ int perturbations_derivs(double tau,
           /** - ----> jump to next momentum bin or species */
 
           idx += (pv->l_max_ncdm[n_ncdm]+1);
+          index_kernel++;
         }
       }
     }
@@ -202,12 +202,16 @@ int primordial_init(
      (for correlated isocurvature modes) */
   //double cos_delta_k;
 
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(ppm->stats));
+
   /** - check that we really need to compute the primordial spectra */
 
   if (ppt->has_perturbations == _FALSE_) {
     ppm->lnk_size=0;
     if (ppm->primordial_verbose > 0)
       printf("No perturbations requested. Primordial module skipped.\n");
+    class_timer_end(&(ppm->stats));
     return _SUCCESS_;
   }
   else {
@@ -543,6 +547,8 @@ int primordial_init(
 
   ppm->is_allocated = _TRUE_;
 
+  class_timer_end(&(ppm->stats));
+
   return _SUCCESS_;
 
 }
@@ -1586,7 +1592,13 @@ int primordial_inflation_analytic_spectra(
 
 /**
  * Routine with a loop over wavenumbers for the computation of the primordial
- * spectrum. For each wavenumber it calls primordial_inflation_one_wavenumber()
+ * spectrum. It calls primordial_inflation_wavenumbers() for the initial
+ * list of wavenumbers. If primordial_inflation_tol_sampling is positive,
+ * this list is then refined: each interval in which the spline
+ * interpolation of \f$ \ln{P_k} \f$ at mid-point is off by more than this
+ * tolerance (for scalars or tensors) is split in two, until the
+ * interpolation is accurate everywhere, or until the intervals have been
+ * halved _PRIMORDIAL_INFLATION_MAX_REFINEMENTS_ times.
  *
  * @param ppt   Input: pointer to perturbation structure
  * @param ppm   Input/output: pointer to primordial structure
@@ -1601,30 +1613,383 @@ int primordial_inflation_spectra(
                                  struct precision * ppr,
                                  double * y_ini
                                  ) {
-  int index_k;
+  int index_k,index_mid,index_new;
+  int old_size,mid_size,refinement;
+  int last_index;
+  int index_md[2];
+  int i;
+  short * is_inaccurate;
+  short * was_inaccurate;
+  double * lnk_mid;
+  double * lnk_new;
+  double * lnpk_new[2];
+  double lnpk_interpolated;
+
+  index_md[0] = ppt->index_md_scalars;
+  index_md[1] = ppt->index_md_tensors;
+
+  /** - compute the spectra for the initial list of wavenumbers */
+  class_call(primordial_inflation_wavenumbers(ppt,ppm,ppr,y_ini,0),
+             ppm->error_message,
+             ppm->error_message);
+
+  ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
+  ppm->is_non_zero[ppt->index_md_tensors][ppt->index_ic_ten] = _TRUE_;
+
+  if (ppr->primordial_inflation_tol_sampling <= 0.)
+    return _SUCCESS_;
+
+  /** - eventually, refine this list: at first, all intervals are candidates */
+  class_calloc(is_inaccurate,ppm->lnk_size-1,sizeof(short),ppm->error_message);
+  for (index_k=0; index_k < ppm->lnk_size-1; index_k++)
+    is_inaccurate[index_k] = _TRUE_;
+
+  for (refinement=0; refinement < _PRIMORDIAL_INFLATION_MAX_REFINEMENTS_; refinement++) {
+
+    old_size = ppm->lnk_size;
+
+    mid_size = 0;
+    for (index_k=0; index_k < old_size-1; index_k++)
+      if (is_inaccurate[index_k] == _TRUE_)
+        mid_size++;
+
+    if (mid_size == 0)
+      break;
+
+    /** - spline of the current spectra, for predicting them at mid-points */
+    for (i=0; i<2; i++) {
+      class_call(array_spline_table_lines(ppm->lnk,
+                                          old_size,
+                                          ppm->lnpk[index_md[i]],
+                                          1,
+                                          ppm->ddlnpk[index_md[i]],
+                                          _SPLINE_EST_DERIV_,
+                                          ppm->error_message),
+                 ppm->error_message,
+                 ppm->error_message);
+    }
+
+    /** - compute the spectra at the mid-points, temporarily stored at the end of the tables */
+    ppm->lnk_size = old_size+mid_size;
+
+    class_realloc(ppm->lnk,ppm->lnk_size*sizeof(double),ppm->error_message);
+    for (i=0; i<2; i++) {
+      class_realloc(ppm->lnpk[index_md[i]],ppm->lnk_size*sizeof(double),ppm->error_message);
+      class_realloc(ppm->ddlnpk[index_md[i]],ppm->lnk_size*sizeof(double),ppm->error_message);
+    }
+
+    lnk_mid = ppm->lnk+old_size;
+    index_mid = 0;
+    for (index_k=0; index_k < old_size-1; index_k++) {
+      if (is_inaccurate[index_k] == _TRUE_) {
+        lnk_mid[index_mid] = 0.5*(ppm->lnk[index_k]+ppm->lnk[index_k+1]);
+        index_mid++;
+      }
+    }
+
+    class_call(primordial_inflation_wavenumbers(ppt,ppm,ppr,y_ini,old_size),
+               ppm->error_message,
+               ppm->error_message);
+
+    /** - merge the two lists, and flag the two halves of the intervals which were not accurate enough */
+    was_inaccurate = is_inaccurate;
+    class_calloc(is_inaccurate,ppm->lnk_size-1,sizeof(short),ppm->error_message);
+    class_alloc(lnk_new,ppm->lnk_size*sizeof(double),ppm->error_message);
+    for (i=0; i<2; i++)
+      class_alloc(lnpk_new[i],ppm->lnk_size*sizeof(double),ppm->error_message);
+
+    index_mid = 0;
+    index_new = 0;
+    last_index = 0;
+    for (index_k=0; index_k < old_size; index_k++) {
+
+      lnk_new[index_new] = ppm->lnk[index_k];
+      for (i=0; i<2; i++)
+        lnpk_new[i][index_new] = ppm->lnpk[index_md[i]][index_k];
+      index_new++;
+
+      if ((index_k < old_size-1) && (was_inaccurate[index_k] == _TRUE_)) {
+
+        lnk_new[index_new] = lnk_mid[index_mid];
+
+        for (i=0; i<2; i++) {
+
+          lnpk_new[i][index_new] = ppm->lnpk[index_md[i]][old_size+index_mid];
+
+          class_call(array_interpolate_spline(ppm->lnk,
+                                              old_size,
+                                              ppm->lnpk[index_md[i]],
+                                              ppm->ddlnpk[index_md[i]],
+                                              1,
+                                              lnk_mid[index_mid],
+                                              &last_index,
+                                              &lnpk_interpolated,
+                                              1,
+                                              ppm->error_message),
+                     ppm->error_message,
+                     ppm->error_message);
+
+          if (fabs(lnpk_interpolated-lnpk_new[i][index_new]) > ppr->primordial_inflation_tol_sampling) {
+            is_inaccurate[index_new-1] = _TRUE_;
+            is_inaccurate[index_new] = _TRUE_;
+          }
+        }
+
+        index_mid++;
+        index_new++;
+      }
+    }
 
+    memcpy(ppm->lnk,lnk_new,ppm->lnk_size*sizeof(double));
+    for (i=0; i<2; i++)
+      memcpy(ppm->lnpk[index_md[i]],lnpk_new[i],ppm->lnk_size*sizeof(double));
+
+    free(lnk_new);
+    for (i=0; i<2; i++)
+      free(lnpk_new[i]);
+    free(was_inaccurate);
+  }
+
+  free(is_inaccurate);
+
+  if (ppm->primordial_verbose > 1)
+    printf(" -> sampled primordial spectra with %d wavenumbers\n",ppm->lnk_size);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * Routine computing the primordial spectrum for the wavenumbers
+ * ppm->lnk[index_k], with index_k running from index_k_min to
+ * ppm->lnk_size-1 (by increasing values of k). It first evolves the
+ * background once until the starting time of each wavenumber with
+ * primordial_inflation_background_at_k(), and then calls
+ * primordial_inflation_one_wavenumber() for each wavenumber in parallel.
+ *
+ * @param ppt         Input: pointer to perturbation structure
+ * @param ppm         Input/output: pointer to primordial structure
+ * @param ppr         Input: pointer to precision structure
+ * @param y_ini       Input: initial conditions for the vector of background/perturbations, already allocated and filled
+ * @param index_k_min Input: index of the first wavenumber to be considered
+ * @return the error status
+ */
+
+int primordial_inflation_wavenumbers(
+                                     struct perturbations * ppt,
+                                     struct primordial * ppm,
+                                     struct precision * ppr,
+                                     double * y_ini,
+                                     int index_k_min
+                                     ) {
+  double * y_table;
+
+  /** - background vector at the starting time of each wavenumber */
+  class_alloc(y_table,(ppm->lnk_size-index_k_min)*ppm->in_bg_size*sizeof(double),ppm->error_message);
+
+  class_call_except(primordial_inflation_background_at_k(ppm,
+                                                         ppr,
+                                                         y_ini,
+                                                         ppm->lnk+index_k_min,
+                                                         ppm->lnk_size-index_k_min,
+                                                         y_table),
+                    ppm->error_message,
+                    ppm->error_message,
+                    free(y_table));
+
+  /** - loop over Fourier wavenumbers */
   class_setup_parallel();
-  /* loop over Fourier wavenumbers */
-  for (index_k=0; index_k < ppm->lnk_size; index_k++) {
 
-    class_run_parallel(with_arguments(ppt,ppm,ppr,y_ini,index_k),
+  class_label_parallel("primordial:inflation",0);
+  class_parallel_for(index_k,index_k_min,ppm->lnk_size,0,with_arguments(ppt,ppm,ppr,y_table,index_k_min),
 
-    class_call(primordial_inflation_one_wavenumber(ppt,ppm,ppr,y_ini,index_k),
+    class_call(primordial_inflation_one_wavenumber(ppt,ppm,ppr,y_table+(index_k-index_k_min)*ppm->in_bg_size,index_k),
                ppm->error_message,
                ppm->error_message);
     return _SUCCESS_;
     );
-  }
 
   class_finish_parallel();
 
-  ppm->is_non_zero[ppt->index_md_scalars][ppt->index_ic_ad] = _TRUE_;
-  ppm->is_non_zero[ppt->index_md_tensors][ppt->index_ic_ten] = _TRUE_;
+  free(y_table);
 
   return _SUCCESS_;
 
 }
 
+/**
+ * Routine evolving the inflaton background forward once, from the
+ * initial conditions y_ini[ ] and across all the times at which
+ * aH = k/primordial_inflation_ratio_min for a list of increasing
+ * wavenumbers. For each of them, it stores the background vector at
+ * that time, which is the starting point of the integration of the
+ * perturbations in primordial_inflation_one_k(). The steps and the
+ * final trapezoidal step towards each target are exactly those of
+ * primordial_inflation_evolve_background(..., _aH_, ..., forward,
+ * conformal), but the steps common to all wavenumbers are taken only
+ * once.
+ *
+ * @param ppm      Input: pointer to primordial structure
+ * @param ppr      Input: pointer to precision structure
+ * @param y_ini    Input: initial conditions for the vector of background/perturbations, already allocated and filled
+ * @param lnk      Input: list of increasing values of ln(k)
+ * @param lnk_size Input: size of this list
+ * @param y_table  Output: background vectors, of size lnk_size*ppm->in_bg_size, already allocated
+ * @return the error status
+ */
+
+int primordial_inflation_background_at_k(
+                                         struct primordial * ppm,
+                                         struct precision * ppr,
+                                         double * y_ini,
+                                         double * lnk,
+                                         int lnk_size,
+                                         double * y_table
+                                         ) {
+
+  struct primordial_inflation_parameters_and_workspace pipaw;
+  struct generic_integrator_workspace gi;
+  double * y;
+  double * dy;
+  double * y_k;
+  double tau_start,tau_end,dtau,dtau_last;
+  double quantity,stop,aH;
+  double V,dV,ddV;
+  double H,dH,ddH,dddH;
+  short has_dphi;
+  int index_k;
+
+  has_dphi = ((ppm->primordial_spec_type == inflation_V) || (ppm->primordial_spec_type == inflation_V_end));
+
+  class_alloc(y,ppm->in_size*sizeof(double),ppm->error_message);
+  class_alloc(dy,ppm->in_size*sizeof(double),ppm->error_message);
+
+  y[ppm->index_in_a] = y_ini[ppm->index_in_a];
+  y[ppm->index_in_phi] = y_ini[ppm->index_in_phi];
+  if (has_dphi == _TRUE_)
+    y[ppm->index_in_dphi] = y_ini[ppm->index_in_dphi];
+
+  pipaw.ppm = ppm;
+  pipaw.N = ppm->in_bg_size;
+  pipaw.integrate = forward;
+  pipaw.time = conformal;
+
+  class_call(initialize_generic_integrator(pipaw.N,&gi),
+             gi.error_message,
+             ppm->error_message);
+
+  /* at starting point, compute the stepsize dtau and the expected value of aH after the next step */
+
+  tau_end = 0;
+
+  class_call_except(primordial_inflation_derivs(tau_end,
+                                                y,
+                                                dy,
+                                                &pipaw,
+                                                ppm->error_message),
+                    ppm->error_message,
+                    ppm->error_message,
+                    cleanup_generic_integrator(&gi);free(y);free(dy));
+
+  if (has_dphi == _TRUE_)
+    dtau = ppr->primordial_inflation_bg_stepsize
+      *MIN(y[ppm->index_in_a]/dy[ppm->index_in_a],fabs(y[ppm->index_in_dphi]/dy[ppm->index_in_dphi]));
+  else
+    dtau = ppr->primordial_inflation_bg_stepsize*y[ppm->index_in_a]/dy[ppm->index_in_a];
+
+  quantity = dy[ppm->index_in_a] * (1.+ dy[ppm->index_in_a]/y[ppm->index_in_a] * dtau) / y[ppm->index_in_a];
+
+  for (index_k=0; index_k < lnk_size; index_k++) {
+
+    stop = exp(lnk[index_k])/ppr->primordial_inflation_ratio_min;
+
+    /* loop over time steps, checking that there will be no overshooting */
+
+    while (quantity < stop) {
+
+      /* check that V(phi) or H(phi) do not take forbidden values */
+
+      if (has_dphi == _TRUE_) {
+        class_call_except(primordial_inflation_check_potential(ppm,y[ppm->index_in_phi],&V,&dV,&ddV),
+                          ppm->error_message,
+                          ppm->error_message,
+                          cleanup_generic_integrator(&gi);free(y);free(dy));
+      }
+      else {
+        class_call_except(primordial_inflation_check_hubble(ppm,y[ppm->index_in_phi],&H,&dH,&ddH,&dddH),
+                          ppm->error_message,
+                          ppm->error_message,
+                          cleanup_generic_integrator(&gi);free(y);free(dy));
+      }
+
+      /* take one time step */
+
+      tau_start = tau_end;
+
+      tau_end = tau_start + dtau;
+
+      class_test_except(fabs(dtau/tau_start) < ppr->smallest_allowed_variation,
+                        ppm->error_message,
+                        cleanup_generic_integrator(&gi);free(y);free(dy),
+                        "integration step: relative change in time =%e < machine precision : leads either to numerical error or infinite loop",dtau/tau_start);
+
+      class_call_except(generic_integrator(primordial_inflation_derivs,
+                                           tau_start,
+                                           tau_end,
+                                           y,
+                                           &pipaw,
+                                           ppr->primordial_inflation_tol_integration,
+                                           ppr->smallest_allowed_variation,
+                                           &gi),
+                        gi.error_message,
+                        ppm->error_message,
+                        cleanup_generic_integrator(&gi);free(y);free(dy));
+
+      /* recompute new value of next conformal time step */
+
+      class_call_except(primordial_inflation_derivs(tau_end,
+                                                    y,
+                                                    dy,
+                                                    &pipaw,
+                                                    ppm->error_message),
+                        ppm->error_message,
+                        ppm->error_message,
+                        cleanup_generic_integrator(&gi);free(y);free(dy));
+
+      if (has_dphi == _TRUE_)
+        dtau = ppr->primordial_inflation_bg_stepsize
+          *MIN(y[ppm->index_in_a]/dy[ppm->index_in_a],fabs(y[ppm->index_in_dphi]/dy[ppm->index_in_dphi]));
+      else
+        dtau = ppr->primordial_inflation_bg_stepsize*y[ppm->index_in_a]/dy[ppm->index_in_a];
+
+      quantity = dy[ppm->index_in_a] * (1.+ dy[ppm->index_in_a]/y[ppm->index_in_a] * dtau) / y[ppm->index_in_a];
+    }
+
+    /* one last trapezoidal step bringing approximately aH to its
+       target, applied to a copy of the background vector, since the
+       next targets are reached from the current time */
+
+    aH = dy[ppm->index_in_a]/y[ppm->index_in_a];
+    dtau_last = (stop/aH-1.)/aH;
+
+    y_k = y_table + index_k*ppm->in_bg_size;
+    y_k[ppm->index_in_a] = y[ppm->index_in_a] + dy[ppm->index_in_a]*dtau_last;
+    y_k[ppm->index_in_phi] = y[ppm->index_in_phi] + dy[ppm->index_in_phi]*dtau_last;
+    if (has_dphi == _TRUE_)
+      y_k[ppm->index_in_dphi] = y[ppm->index_in_dphi] + dy[ppm->index_in_dphi]*dtau_last;
+  }
+
+  class_call_except(cleanup_generic_integrator(&gi),
+                    gi.error_message,
+                    ppm->error_message,
+                    free(y);free(dy));
+
+  free(y);
+  free(dy);
+
+  return _SUCCESS_;
+}
+
 /**
  * Routine coordinating the computation of the primordial
  * spectrum for one wavenumber. It calls primordial_inflation_one_k() to
@@ -1634,7 +1999,7 @@ int primordial_inflation_spectra(
  * @param ppt     Input: pointer to perturbation structure
  * @param ppm     Input/output: pointer to primordial structure
  * @param ppr     Input: pointer to precision structure
- * @param y_ini   Input: initial conditions for the vector of background/perturbations, already allocated and filled
+ * @param y_bg    Input: background vector at the time when aH = k/primordial_inflation_ratio_min, already allocated and filled
  * @param index_k Input: index of wavenumber to be considered
  * @return the error status
  */
@@ -1643,7 +2008,7 @@ int primordial_inflation_one_wavenumber(
                                         struct perturbations * ppt,
                                         struct primordial * ppm,
                                         struct precision * ppr,
-                                        double * y_ini,
+                                        double * y_bg,
                                         int index_k
                                         ) {
   double k;
@@ -1658,25 +2023,12 @@ int primordial_inflation_one_wavenumber(
   class_alloc(y,ppm->in_size*sizeof(double),ppm->error_message);
   class_alloc(dy,ppm->in_size*sizeof(double),ppm->error_message);
 
-  /** - initialize the background part of the running vector */
-  y[ppm->index_in_a] = y_ini[ppm->index_in_a];
-  y[ppm->index_in_phi] = y_ini[ppm->index_in_phi];
+  /** - initialize the background part of the running vector at the
+      relevant initial time for integrating perturbations */
+  y[ppm->index_in_a] = y_bg[ppm->index_in_a];
+  y[ppm->index_in_phi] = y_bg[ppm->index_in_phi];
   if ((ppm->primordial_spec_type == inflation_V) || (ppm->primordial_spec_type == inflation_V_end))
-    y[ppm->index_in_dphi] = y_ini[ppm->index_in_dphi];
-
-  /** - evolve the background until the relevant initial time for
-      integrating perturbations */
-  class_call(primordial_inflation_evolve_background(ppm,
-                                                    ppr,
-                                                    y,
-                                                    dy,
-                                                    _aH_,
-                                                    k/ppr->primordial_inflation_ratio_min,
-                                                    _FALSE_,
-                                                    forward,
-                                                    conformal),
-             ppm->error_message,
-             ppm->error_message);
+    y[ppm->index_in_dphi] = y_bg[ppm->index_in_dphi];
 
   /** - evolve the background/perturbation equations from this time and
       until some time after Horizon crossing */
@@ -285,6 +285,71 @@ int thermodynamics_at_z(
   return _SUCCESS_;
 }
 
+/**
+ * Thermodynamics quantities at each redshift of a sorted array.
+ *
+ * Same as calling thermodynamics_at_z() in closeby mode for each
+ * element, with one index in the interpolation table carried from
+ * one redshift to the next, such that the lookup never requires a
+ * bisection over the full table. Results are written in one
+ * contiguous block, in the same format as the thermodynamics table.
+ *
+ * @param pba              Input: pointer to background structure
+ * @param pth              Input: pointer to the thermodynamics structure (containing pre-computed table)
+ * @param z                Input: array of redshifts, in increasing or decreasing order
+ * @param z_size           Input: size of the array
+ * @param pvecback_table   Input: background quantities at each redshift, in rows of size pvecback_size (used only for z>z_initial,
+ as pvecback in thermodynamics_at_z(); can be NULL if all redshifts are in the pre-computed range)
+ * @param pvecback_size    Input: size of each row of pvecback_table
+ * @param pvecthermo_table Output: thermodynamics quantities, pvecthermo_table[index_z*pth->th_size+index_th] (assumed to be already allocated)
+ * @return the error status
+ */
+
+int thermodynamics_at_z_array(
+                              struct background * pba,
+                              struct thermodynamics * pth,
+                              double * z,
+                              int z_size,
+                              double * pvecback_table,
+                              int pvecback_size,
+                              double * pvecthermo_table
+                              ) {
+
+  int index_z;
+  int last_index = 0;
+
+  /** - find the starting index once with a bisection, if the first redshift is in the table */
+  if ((z_size > 0) && (z[0] < pth->z_table[pth->tt_size-1])) {
+    class_call(array_hunt_ascending(pth->z_table,
+                                    pth->tt_size,
+                                    z[0],
+                                    &last_index,
+                                    pth->error_message),
+               pth->error_message,
+               pth->error_message);
+  }
+
+  /** - step through the array in closeby mode */
+  for (index_z=0; index_z<z_size; index_z++) {
+
+    class_test((z[index_z] >= pth->z_table[pth->tt_size-1]) && (pvecback_table == NULL),
+               pth->error_message,
+               "z=%e is beyond the thermodynamics table: background quantities are needed",z[index_z]);
+
+    class_call(thermodynamics_at_z(pba,
+                                   pth,
+                                   z[index_z],
+                                   inter_closeby,
+                                   &last_index,
+                                   (pvecback_table == NULL) ? NULL : pvecback_table+index_z*pvecback_size,
+                                   pvecthermo_table+index_z*pth->th_size),
+               pth->error_message,
+               pth->error_message);
+  }
+
+  return _SUCCESS_;
+}
+
 /**
  * Initialize the thermodynamics structure, and in particular the
  * thermodynamics interpolation table.
@@ -315,6 +380,9 @@ int thermodynamics_init(
   pth->has_idm_dr = pba->has_idm && (pba->has_idr && pth->a_idm_dr > 0.);
   pth->has_idm_b = pba->has_idm && (pth->cross_idm_b > 0.);
 
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(pth->stats));
+
   /** - update the user about which recombination code is being run */
   if (pth->thermodynamics_verbose > 0) {
     switch (pth->recombination) {
@@ -428,6 +496,8 @@ int thermodynamics_init(
 
   pth->is_allocated = _TRUE_;
 
+  class_timer_end(&(pth->stats));
+
   return _SUCCESS_;
 }
 
@@ -529,9 +599,7 @@ int thermodynamics_helium_from_bbn(
   /** Summary: */
 
   /** Define local variables */
-  FILE * fA;
-  char line[_LINE_LENGTH_MAX_];
-  char * left;
+  struct data_file * pdf;
 
   int num_omegab=0;
   int num_deltaN=0;
@@ -543,7 +611,7 @@ int thermodynamics_helium_from_bbn(
   double * YHe_at_deltaN=NULL;
   double * ddYHe_at_deltaN=NULL;
 
-  int array_line=0;
+  int array_line;
   double DeltaNeff;
   double omega_b;
   int last_index;
@@ -590,54 +658,32 @@ int thermodynamics_helium_from_bbn(
      .....
   */
 
-  class_open(fA,ppr->sBBN_file, "r",pth->error_message);
-
-  /* go through each line */
-  while (fgets(line,_LINE_LENGTH_MAX_-1,fA) != NULL) {
-
-    /* eliminate blank spaces at beginning of line */
-    left=line;
-    while (left[0]==' ') {
-      left++;
-    }
-
-    /* check that the line is neither blank neither a comment. In ASCII, left[0]>39 means that first non-blank character might
-       be the beginning of some data (it is not a newline, a #, a %, etc.) */
-    if (left[0] > 39) {
-
-      /* if the line contains data, we must interpret it. If (num_omegab, num_deltaN)=(0,0), the current line must contain
-         their values. Otherwise, it must contain (omegab, delatN, YHe). */
-      if ((num_omegab==0) && (num_deltaN==0)) {
-
-        /* read (num_omegab, num_deltaN), infer size of arrays and allocate them */
-        class_test(sscanf(line,"%d %d",&num_omegab,&num_deltaN) != 2,
-                   pth->error_message,
-                   "could not read value of parameters (num_omegab,num_deltaN) in file %s\n",ppr->sBBN_file);
+  /* the file is parsed once per process (see data_file_get()); the
+     table is shared with the other runs, so YHe points into it */
+  class_call(data_file_get(ppr->sBBN_file,
+                           data_file_grid_header,
+                           3,
+                           ppr->data_binary_files,
+                           &pdf,
+                           pth->error_message),
+             pth->error_message,
+             pth->error_message);
 
-        class_alloc(omegab,num_omegab*sizeof(double),pth->error_message);
-        class_alloc(deltaN,num_deltaN*sizeof(double),pth->error_message);
-        class_alloc(YHe,num_omegab*num_deltaN*sizeof(double),pth->error_message);
-        class_alloc(ddYHe,num_omegab*num_deltaN*sizeof(double),pth->error_message);
-        class_alloc(YHe_at_deltaN,num_omegab*sizeof(double),pth->error_message);
-        class_alloc(ddYHe_at_deltaN,num_omegab*sizeof(double),pth->error_message);
-        array_line=0;
+  num_omegab = pdf->header[0];
+  num_deltaN = pdf->header[1];
 
-      }
-      else{
+  class_alloc(omegab,num_omegab*sizeof(double),pth->error_message);
+  class_alloc(deltaN,num_deltaN*sizeof(double),pth->error_message);
+  class_alloc(ddYHe,num_omegab*num_deltaN*sizeof(double),pth->error_message);
+  class_alloc(YHe_at_deltaN,num_omegab*sizeof(double),pth->error_message);
+  class_alloc(ddYHe_at_deltaN,num_omegab*sizeof(double),pth->error_message);
 
-        /* read (omegab, deltaN, YHe) */
-        class_test(sscanf(line,"%lg %lg %lg",&(omegab[array_line%num_omegab]),
-                          &(deltaN[array_line/num_omegab]),
-                          &(YHe[array_line])
-                          ) != 3,
-                   pth->error_message,
-                   "could not read value of parameters (omegab,deltaN,YHe) in file %s\n",ppr->sBBN_file);
-        array_line ++;
-      }
-    }
+  /* read (omegab, deltaN, YHe) */
+  for (array_line=0; array_line<pdf->rows; array_line++) {
+    omegab[array_line%num_omegab] = pdf->data[array_line];
+    deltaN[array_line/num_omegab] = pdf->data[pdf->rows+array_line];
   }
-
-  fclose(fA);
+  YHe = pdf->data+2*pdf->rows;
 
   /** - spline in one dimension (along deltaN) */
   class_call(array_spline_table_lines(deltaN,
@@ -717,9 +763,9 @@ int thermodynamics_helium_from_bbn(
   }
 
   /** - deallocate arrays */
+  data_file_release(pdf);
   free(omegab);
   free(deltaN);
-  free(YHe);
   free(ddYHe);
   free(YHe_at_deltaN);
   free(ddYHe_at_deltaN);
@@ -1110,7 +1156,7 @@ int thermodynamics_lists(
   /** Summary: */
 
   /** Define local variables */
-  int index_tau, index_z;
+  int index_z;
   double zinitial,zlinear;
 
   pth->tt_size = ptw->Nz_tot;
@@ -1142,13 +1188,12 @@ int thermodynamics_lists(
     pth->z_table[(pth->tt_size-1)-(index_z+ptw->Nz_reco)] = -(-ppr->reionization_z_start_max * (double)(ptw->Nz_reio-1-index_z) / (double)(ptw->Nz_reio));
   }
 
-  for (index_tau=0; index_tau < pth->tt_size; index_tau++) {
-    class_call(background_tau_of_z(pba,
-                                   pth->z_table[index_tau],
-                                   pth->tau_table+index_tau),
-               pba->error_message,
-               pth->error_message);
-  }
+  class_call(background_tau_of_z_array(pba,
+                                       pth->z_table,
+                                       pth->tt_size,
+                                       pth->tau_table),
+             pba->error_message,
+             pth->error_message);
 
   /** - store initial value of conformal time in the structure */
   pth->tau_ini = pth->tau_table[pth->tt_size-1];
@@ -1261,7 +1306,7 @@ int thermodynamics_set_parameters_reionization(
 
     }
 
-    /** - --> if reionization optical depth given as an input, find reionization redshift by bisection and initialize the remaining values */
+    /** - --> if reionization optical depth given as an input, initialize the remaining values with the largest reionization redshift (z_reio is then found by thermodynamics_reionization_evolve_with_tau()) */
     if (pth->reio_z_or_tau == reio_tau) {
       z_sup = ppr->reionization_z_start_max-ppr->reionization_start_factor*pth->reionization_width;
       class_test(z_sup < 0.,
@@ -1645,8 +1690,8 @@ int thermodynamics_solve(
     /** - --> (c1) If we have the optical depth tau_reio as input the
         last evolver step (reionization approximation) is done
         separately in a loop, to find the approximate redshift of
-        reionization given the input of tau_reio, using a bisection
-        method. This is similar to the general CLASS shooting method,
+        reionization given the input of tau_reio, using a corrected
+        model of tau_reio(z_reio). This is similar to the general CLASS shooting method,
         but doing this step here is more advantageous since we only
         need to do repeatedly the last approximation step of the
         integration, instead of the full background and thermodynamics
@@ -1680,6 +1725,7 @@ int thermodynamics_solve(
                                  pth->tt_size, // size of previous array
                                  thermodynamics_sources, // function for output
                                  NULL, // print variables
+                                 NULL, // jacobian pattern
                                  pth->error_message),
                  pth->error_message,
                  pth->error_message);
@@ -2159,10 +2205,13 @@ int thermodynamics_vector_init(
  *
  * Instead of computing the evolution of quantities during
  * reionization for a fixed z_reio, as the evolver would do, this
- * function finds z_reio by bisection. First we make an initial guess
- * for z_reio with reionization_z_start_max and then find a z_reio
- * which leads to the given tau_reio (in the range of tolerance
- * reionization_optical_depth_tol).
+ * function finds the z_reio which leads to the given tau_reio (in the
+ * range of tolerance reionization_optical_depth_tol). Each trial value
+ * is the root of a cheap model of tau_reio(z_reio), the integral of
+ * the reionization function weighted by dkappa/dz (see
+ * thermodynamics_reionization_tau_model()), corrected by its error at
+ * the previous trial, such that the reionization interval is usually
+ * evolved only two or three times.
  *
  * @param ptpaw      Input: pointer to parameters and workspace
  * @param mz_ini     Input: initial redshift
@@ -2184,11 +2233,15 @@ int thermodynamics_reionization_evolve_with_tau(
 
   /** Define local variables */
   int counter;
-  double z_sup,z_mid,z_inf;
-  double tau_sup,tau_mid,tau_inf;
+  double z_max,z_sup,z_mid,z_inf,z;
+  double tau_mid,tau_model,offset;
+  short has_inf,has_sup;
 
-  int index_ti;
-  int last_index_back_mz_ini;
+  int index_ti,index_z,z_size;
+  int last_index_back_mz_ini,last_index_back;
+
+  /* weights of the model of tau_reio(z_reio) */
+  double * weight;
 
   struct precision * ppr;
   struct background * pba;
@@ -2261,172 +2314,81 @@ int thermodynamics_reionization_evolve_with_tau(
 
   ptw->ptdw->ptv = ptv;
 
-  /** - Evolve quantities through reionization assuming upper value of z_reio */
+  /** - Largest possible reionization redshift */
 
-  z_sup = ppr->reionization_z_start_max-ppr->reionization_start_factor*pth->reionization_width;
-  class_test(z_sup < 0.,
+  z_max = ppr->reionization_z_start_max-ppr->reionization_start_factor*pth->reionization_width;
+  class_test(z_max < 0.,
              pth->error_message,
              "parameters are such that reionization cannot take place before today while starting after z_start_max; need to increase z_start_max");
 
-  /* maximum possible reionization redshift */
-  ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_redshift] = z_sup;
-  /* maximum possible starting redshift */
-  switch (pth->reio_parametrization) {
-  case reio_camb:
-    ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = ppr->reionization_z_start_max;
-    break;
-  case reio_half_tanh:
-    ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = z_sup;
-    break;
-  default:
-    class_stop(pth->error_message,"Should not be there: tau_reio acan be an input only for reio_camb and reio_half_tanh");
-    break;
-  }
-
   /* ptaw->ptw->last_index_back has been properly set according to the
      redshift z = -mz_inbi, we should keep memory of it */
   last_index_back_mz_ini = ptpaw->ptw->last_index_back;
 
-  /* Calculate a first ionization history at upper limit */
-  class_call(generic_evolver(thermodynamics_derivs,
-                             mz_ini,
-                             mz_end,
-                             ptv->y,
-                             ptv->used_in_output,
-                             ptv->ti_size,
-                             ptpaw,
-                             ppr->tol_thermo_integration,
-                             ppr->smallest_allowed_variation,
-                             thermodynamics_timescale,  // timescale
-                             ppr->thermo_integration_stepsize, // stepsize
-                             mz_output, // values of z for output
-                             mz_size, // size of previous array
-                             thermodynamics_sources, // function for output
-                             NULL, // print variables
-                             pth->error_message),
-             pth->error_message,
-             pth->error_message);
-
-  /* infer corresponding tau_reio */
-  class_call(thermodynamics_reionization_get_tau(ppr,
-                                                 pba,
-                                                 pth,
-                                                 ptw),
-             pth->error_message,
-             pth->error_message);
+  /** - Weights of the model of tau_reio(z_reio) on the redshifts of
+      the table inside the reionization interval (see
+      thermodynamics_reionization_tau_model()) */
 
-  tau_sup=ptw->reionization_optical_depth;
+  for (z_size=0; (z_size < pth->tt_size) && (pth->z_table[z_size] <= -mz_ini); z_size++);
 
-  class_test(tau_sup < pth->tau_reio,
-             pth->error_message,
-             "parameters are such that reionization cannot start after z_start_max");
+  class_alloc(weight,z_size*sizeof(double),pth->error_message);
 
-  /** - Restore initial conditions */
-  ptv->y[ptv->index_ti_D_Tmat] = ptvs->y[ptvs->index_ti_D_Tmat];
-  ptv->y[ptv->index_ti_x_H] = ptvs->y[ptvs->index_ti_x_H];
-  ptv->y[ptv->index_ti_x_He] = ptvs->y[ptvs->index_ti_x_He];
-  if (pba->has_idm == _TRUE_)
-    ptv->y[ptv->index_ti_T_idm] = ptvs->y[ptvs->index_ti_T_idm];
-
-  /** - Evolve quantities through reionization assuming lower value of z_reio */
-
-  z_inf = 0.;
-
-  /* minimum possible reionization redshift */
-  ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_redshift] = z_inf;
-  /* minimum possible starting redshift */
-  switch (pth->reio_parametrization) {
-  case reio_camb:
-    ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = ppr->reionization_start_factor*pth->reionization_width;
-    if (ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] < pth->helium_fullreio_redshift+ppr->reionization_start_factor*pth->helium_fullreio_width) {
-      ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = pth->helium_fullreio_redshift+ppr->reionization_start_factor*pth->helium_fullreio_width;
-    }
-  case reio_half_tanh:
-    ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = z_inf;
-    break;
-  default:
-    class_stop(pth->error_message,"Should not be there: tau_reio acan be an input only for reio_camb and reio_half_tanh");
-    break;
+  last_index_back = last_index_back_mz_ini;
+  for (index_z=0; index_z<z_size; index_z++) {
+    z = pth->z_table[index_z];
+    class_call(background_at_z(pba,
+                               z,
+                               normal_info,
+                               inter_closeby,
+                               &last_index_back,
+                               ptpaw->pvecback),
+               pba->error_message,
+               pth->error_message);
+    /* dkappa/dz per free electron, times the trapezoidal step */
+    weight[index_z] = (1.+z)*(1.+z)*ptw->SIunit_nH0*_sigma_*_Mpc_over_m_/ptpaw->pvecback[pba->index_bg_H]
+      *0.5*(pth->z_table[MIN(index_z+1,z_size-1)]-pth->z_table[MAX(index_z-1,0)]);
   }
 
-  /* reset ptaw->ptw->last_index_back to match the redshift z = -mz_inbi */
-  ptpaw->ptw->last_index_back = last_index_back_mz_ini;
-
-  /* Calculate a second ionization history at lower limit */
-  class_call(generic_evolver(thermodynamics_derivs,
-                             mz_ini,
-                             mz_end,
-                             ptv->y,
-                             ptv->used_in_output,
-                             ptv->ti_size,
-                             ptpaw,
-                             ppr->tol_thermo_integration,
-                             ppr->smallest_allowed_variation,
-                             thermodynamics_timescale,  // timescale
-                             ppr->thermo_integration_stepsize, // stepsize
-                             mz_output, // values of z for output
-                             mz_size, // size of previous array
-                             thermodynamics_sources, // function for output
-                             NULL, // print variables
-                             pth->error_message),
-             pth->error_message,
-             pth->error_message);
-
-  /* infer corresponding tau_reio */
-  class_call(thermodynamics_reionization_get_tau(ppr,
-                                                 pba,
-                                                 pth,
-                                                 ptw),
-             pth->error_message,
-             pth->error_message);
+  /** - Evolve quantities through reionization for successive values
+      of z_reio, each of them being the root of the model corrected by
+      its error at the previous value. The model differs from the
+      evolved tau_reio(z_reio) by a slowly varying offset (the
+      ionization fraction before and outside reionization, and all
+      effects of the evolution), so that few iterations are needed. The
+      values already tried bracket the solution, and a proposed value
+      outside of the bracket is replaced by its middle */
 
-  tau_inf=ptw->reionization_optical_depth;
+  z_inf = 0.;
+  z_sup = z_max;
+  has_inf = _FALSE_;
+  has_sup = _FALSE_;
+  offset = 0.;
+  counter = 0;
 
-  class_test(tau_inf > pth->tau_reio,
-             pth->error_message,
-             "CLASS cannot reach the low value of tau_reio that was selected, even when setting z_reio as low as 0.\nThis means that some additional physical component is requiring some minimal tau_reio_min = %.10e.\nThis is usually caused by strong energy injections or other modifications of the x_e(z) behaviour.",tau_inf);
+  do {
 
-  /** - Restore initial conditions */
-  ptv->y[ptv->index_ti_D_Tmat] = ptvs->y[ptvs->index_ti_D_Tmat];
-  ptv->y[ptv->index_ti_x_H] = ptvs->y[ptvs->index_ti_x_H];
-  ptv->y[ptv->index_ti_x_He] = ptvs->y[ptvs->index_ti_x_He];
-  if (pba->has_idm == _TRUE_)
-    ptv->y[ptv->index_ti_T_idm] = ptvs->y[ptvs->index_ti_T_idm];
+    class_call(thermodynamics_reionization_z_of_tau_model(ppr,pth,ptw->ptrp,z_size,weight,pth->tau_reio-offset,z_max,&z_mid),
+               pth->error_message,
+               pth->error_message);
 
-  /** - Evolve quantities through reionization, trying intermediate values of z_reio by bisection */
-  counter=0;
-  while ((tau_sup-tau_inf) > pth->tau_reio * ppr->reionization_optical_depth_tol) {
-    z_mid=0.5*(z_sup+z_inf);
-
-    /* reionization redshift */
-    ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_redshift] = z_mid;
-
-    /* infer starting redshift for hydrogen (Note, that this is only the start of the ADDITIONAL tanh re-ionization function)*/
-    switch (pth->reio_parametrization) {
-    case reio_camb:
-      ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_redshift]+ppr->reionization_start_factor*pth->reionization_width;
-      /* if starting redshift for helium is larger, take that one
-       *    (does not happen in realistic models) */
-      if (ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] < pth->helium_fullreio_redshift+ppr->reionization_start_factor*pth->helium_fullreio_width) {
-        ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = pth->helium_fullreio_redshift+ppr->reionization_start_factor*pth->helium_fullreio_width;
-      }
-      break;
-    case reio_half_tanh:
-      ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] = z_mid;
-      break;
-    default:
-      class_stop(pth->error_message,"Should not be there: tau_reio acan be an input only for reio_camb and reio_half_tanh");
-      break;
-    }
+    if (((has_inf == _TRUE_) && (z_mid <= z_inf)) || ((has_sup == _TRUE_) && (z_mid >= z_sup)))
+      z_mid = 0.5*(z_inf+z_sup);
 
-    class_test(ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_start] > ppr->reionization_z_start_max,
+    class_call(thermodynamics_reionization_set_redshift(ppr,pth,ptw->ptrp,z_mid),
                pth->error_message,
-               "starting redshift for reionization > reionization_z_start_max = %e",ppr->reionization_z_start_max);
+               pth->error_message);
+
+    /* restore initial conditions */
+    ptv->y[ptv->index_ti_D_Tmat] = ptvs->y[ptvs->index_ti_D_Tmat];
+    ptv->y[ptv->index_ti_x_H] = ptvs->y[ptvs->index_ti_x_H];
+    ptv->y[ptv->index_ti_x_He] = ptvs->y[ptvs->index_ti_x_He];
+    if (pba->has_idm == _TRUE_)
+      ptv->y[ptv->index_ti_T_idm] = ptvs->y[ptvs->index_ti_T_idm];
 
     /* reset ptaw->ptw->last_index_back to match the redshift z = -mz_inbi */
     ptpaw->ptw->last_index_back = last_index_back_mz_ini;
 
-    /* Compute a new ionization history */
+    /* compute a new ionization history */
     class_call(generic_evolver(thermodynamics_derivs,
                                mz_ini,
                                mz_end,
@@ -2442,6 +2404,7 @@ int thermodynamics_reionization_evolve_with_tau(
                                mz_size, // size of previous array
                                thermodynamics_sources, // function for output
                                NULL, // print variables
+                               NULL, // jacobian pattern
                                pth->error_message),
                pth->error_message,
                pth->error_message);
@@ -2454,32 +2417,46 @@ int thermodynamics_reionization_evolve_with_tau(
                pth->error_message,
                pth->error_message);
 
-    tau_mid=ptw->reionization_optical_depth;
+    tau_mid = ptw->reionization_optical_depth;
+
+    class_test((z_mid == z_max) && (tau_mid < pth->tau_reio),
+               pth->error_message,
+               "parameters are such that reionization cannot start after z_start_max");
 
-    /* trial */
+    class_test((z_mid == 0.) && (tau_mid > pth->tau_reio),
+               pth->error_message,
+               "CLASS cannot reach the low value of tau_reio that was selected, even when setting z_reio as low as 0.\nThis means that some additional physical component is requiring some minimal tau_reio_min = %.10e.\nThis is usually caused by strong energy injections or other modifications of the x_e(z) behaviour.",tau_mid);
+
+    /* new bracket */
     if (tau_mid > pth->tau_reio) {
-      z_sup=z_mid;
-      tau_sup=tau_mid;
+      z_sup = z_mid;
+      has_sup = _TRUE_;
     }
     else {
-      z_inf=z_mid;
-      tau_inf=tau_mid;
+      z_inf = z_mid;
+      has_inf = _TRUE_;
     }
 
-    /* Restore initial conditions */
-    ptv->y[ptv->index_ti_D_Tmat] = ptvs->y[ptvs->index_ti_D_Tmat];
-    ptv->y[ptv->index_ti_x_H] = ptvs->y[ptvs->index_ti_x_H];
-    ptv->y[ptv->index_ti_x_He] = ptvs->y[ptvs->index_ti_x_He];
-    if (pba->has_idm == _TRUE_)
-      ptv->y[ptv->index_ti_T_idm] = ptvs->y[ptvs->index_ti_T_idm];
+    /* new offset of the model */
+    class_call(thermodynamics_reionization_tau_model(ppr,pth,ptw->ptrp,z_size,weight,z_mid,&tau_model),
+               pth->error_message,
+               pth->error_message);
+    offset = tau_mid-tau_model;
 
     /* counter to avoid infinite loop */
     counter++;
     class_test(counter > _MAX_IT_,
                pth->error_message,
                "while searching for reionization_optical_depth, maximum number of iterations exceeded");
+
+  } while (fabs(tau_mid-pth->tau_reio) > pth->tau_reio * ppr->reionization_optical_depth_tol);
+
+  if (pth->thermodynamics_verbose > 2) {
+    printf(" -> z_reio found after %d evolutions of the reionization interval\n",counter);
   }
 
+  free(weight);
+
   /** - Store the ionization redshift in the thermodynamics structure */
   pth->z_reio = ptw->ptrp->reionization_parameters[ptw->ptrp->index_re_reio_redshift];
 
@@ -2494,6 +2471,190 @@ int thermodynamics_reionization_evolve_with_tau(
   return _SUCCESS_;
 }
 
+/**
+ * Set the redshift of reionization in the parameters of the
+ * reionization function, together with the corresponding starting
+ * redshift, for the parametrizations in which tau_reio can be an input
+ *
+ * @param ppr    Input: pointer to precision structure
+ * @param pth    Input: pointer to thermodynamics structure
+ * @param preio  Input/Output: pointer to reionization parameters
+ * @param z_reio Input: redshift of reionization
+ * @return the error status
+ */
+
+int thermodynamics_reionization_set_redshift(
+                                             struct precision * ppr,
+                                             struct thermodynamics * pth,
+                                             struct thermo_reionization_parameters * preio,
+                                             double z_reio
+                                             ) {
+
+  /* reionization redshift */
+  preio->reionization_parameters[preio->index_re_reio_redshift] = z_reio;
+
+  /* infer starting redshift for hydrogen (Note, that this is only the start of the ADDITIONAL tanh re-ionization function)*/
+  switch (pth->reio_parametrization) {
+  case reio_camb:
+    preio->reionization_parameters[preio->index_re_reio_start] = MIN(z_reio+ppr->reionization_start_factor*pth->reionization_width,
+                                                                     ppr->reionization_z_start_max);
+    /* if starting redshift for helium is larger, take that one
+     *    (does not happen in realistic models) */
+    if (preio->reionization_parameters[preio->index_re_reio_start] < pth->helium_fullreio_redshift+ppr->reionization_start_factor*pth->helium_fullreio_width) {
+      preio->reionization_parameters[preio->index_re_reio_start] = pth->helium_fullreio_redshift+ppr->reionization_start_factor*pth->helium_fullreio_width;
+    }
+    break;
+  case reio_half_tanh:
+    preio->reionization_parameters[preio->index_re_reio_start] = z_reio;
+    break;
+  default:
+    class_stop(pth->error_message,"Should not be there: tau_reio acan be an input only for reio_camb and reio_half_tanh");
+    break;
+  }
+
+  class_test(preio->reionization_parameters[preio->index_re_reio_start] > ppr->reionization_z_start_max,
+             pth->error_message,
+             "starting redshift for reionization > reionization_z_start_max = %e",ppr->reionization_z_start_max);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Model of the reionization optical depth as a function of z_reio,
+ * used by thermodynamics_reionization_evolve_with_tau(): the integral
+ * over the first lines of the thermodynamics table of the free
+ * electrons added by the reionization function (with zero ionization
+ * before reionization), weighted by dkappa/dz per free electron
+ *
+ * @param ppr    Input: pointer to precision structure
+ * @param pth    Input: pointer to thermodynamics structure
+ * @param preio  Input/Output: pointer to reionization parameters (z_reio is set, xe_before is set to zero)
+ * @param z_size Input: number of lines of pth->z_table in the sum
+ * @param weight Input: their weights
+ * @param z_reio Input: redshift of reionization
+ * @param tau    Output: modelled optical depth
+ * @return the error status
+ */
+
+int thermodynamics_reionization_tau_model(
+                                          struct precision * ppr,
+                                          struct thermodynamics * pth,
+                                          struct thermo_reionization_parameters * preio,
+                                          int z_size,
+                                          double * weight,
+                                          double z_reio,
+                                          double * tau
+                                          ) {
+
+  int index_z;
+  double x;
+
+  class_call(thermodynamics_reionization_set_redshift(ppr,pth,preio,z_reio),
+             pth->error_message,
+             pth->error_message);
+
+  preio->reionization_parameters[preio->index_re_xe_before] = 0.;
+
+  *tau = 0.;
+  for (index_z=0; (index_z < z_size) && (pth->z_table[index_z] <= preio->reionization_parameters[preio->index_re_reio_start]); index_z++) {
+    class_call(thermodynamics_reionization_function(pth->z_table[index_z],pth,preio,&x),
+               pth->error_message,
+               pth->error_message);
+    *tau += weight[index_z]*x;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the redshift of reionization for which the model of
+ * thermodynamics_reionization_tau_model() gives some optical depth,
+ * with the Illinois variant of the false position method, between 0
+ * and z_max (or at these limits if the model cannot reach tau)
+ *
+ * @param ppr    Input: pointer to precision structure
+ * @param pth    Input: pointer to thermodynamics structure
+ * @param preio  Input/Output: pointer to reionization parameters (modified by the model)
+ * @param z_size Input: number of lines of pth->z_table in the model
+ * @param weight Input: their weights
+ * @param tau    Input: optical depth
+ * @param z_max  Input: largest possible redshift of reionization
+ * @param z_reio Output: redshift of reionization
+ * @return the error status
+ */
+
+int thermodynamics_reionization_z_of_tau_model(
+                                               struct precision * ppr,
+                                               struct thermodynamics * pth,
+                                               struct thermo_reionization_parameters * preio,
+                                               int z_size,
+                                               double * weight,
+                                               double tau,
+                                               double z_max,
+                                               double * z_reio
+                                               ) {
+
+  double z_a, z_b, z_c, f_a, f_b, f_c;
+  int counter, side;
+
+  z_a = 0.;
+  class_call(thermodynamics_reionization_tau_model(ppr,pth,preio,z_size,weight,z_a,&f_a),
+             pth->error_message,
+             pth->error_message);
+  f_a -= tau;
+
+  z_b = z_max;
+  class_call(thermodynamics_reionization_tau_model(ppr,pth,preio,z_size,weight,z_b,&f_b),
+             pth->error_message,
+             pth->error_message);
+  f_b -= tau;
+
+  if (f_a >= 0.) {
+    *z_reio = z_a;
+    return _SUCCESS_;
+  }
+  if (f_b <= 0.) {
+    *z_reio = z_b;
+    return _SUCCESS_;
+  }
+
+  /* the model is only a guess for the evolution: it is enough to
+     solve it much more precisely than the tolerance on tau_reio */
+  side = 0;
+  z_c = z_a;
+  for (counter=0; counter < _MAX_IT_; counter++) {
+
+    z_c = (z_a*f_b-z_b*f_a)/(f_b-f_a);
+
+    class_call(thermodynamics_reionization_tau_model(ppr,pth,preio,z_size,weight,z_c,&f_c),
+               pth->error_message,
+               pth->error_message);
+    f_c -= tau;
+
+    if (fabs(f_c) < 1.e-2*ppr->reionization_optical_depth_tol*tau)
+      break;
+
+    if (f_c > 0.) {
+      z_b = z_c;
+      f_b = f_c;
+      if (side == -1)
+        f_a *= 0.5;
+      side = -1;
+    }
+    else {
+      z_a = z_c;
+      f_a = f_c;
+      if (side == 1)
+        f_b *= 0.5;
+      side = 1;
+    }
+  }
+
+  *z_reio = z_c;
+
+  return _SUCCESS_;
+}
+
 /**
  * Subroutine evaluating the derivative of thermodynamical quantities
  * with respect to negative redshift mz=-z.
@@ -3172,24 +3333,25 @@ int thermodynamics_calculate_conformal_drag_time(
   /** - compute minus the baryon drag interaction rate time, -dkappa_d/dtau = -[1/R * kappa'], with R = 3 rho_b / 4 rho_gamma,
       stored temporarily in column ddkappa */
 
-  /* find the value of last_index_back for tau_table[0] in order to speed up subsequent interpolations in the loop */
-  class_call(background_at_tau(pba,
-                               pth->tau_table[0],
-                               normal_info,
-                               inter_normal,
-                               &last_index_back,
-                               pvecback),
+  /* find the value of last_index_back for z_table[0] in order to speed up subsequent interpolations in the loop
+     (the background is evaluated at the redshifts of the table, rather than at z(tau_table)) */
+  class_call(background_at_z(pba,
+                             pth->z_table[0],
+                             normal_info,
+                             inter_normal,
+                             &last_index_back,
+                             pvecback),
              pba->error_message,
              pth->error_message);
 
   for (index_tau=0; index_tau < pth->tt_size; index_tau++) {
 
-    class_call(background_at_tau(pba,
-                                 pth->tau_table[index_tau],
-                                 normal_info,
-                                 inter_closeby,
-                                 &last_index_back,
-                                 pvecback),
+    class_call(background_at_z(pba,
+                               pth->z_table[index_tau],
+                               normal_info,
+                               inter_closeby,
+                               &last_index_back,
+                               pvecback),
                pba->error_message,
                pth->error_message);
 
@@ -3260,14 +3422,14 @@ int thermodynamics_calculate_damping_scale(
   class_alloc(tau_table_growing,pth->tt_size*sizeof(double),pth->error_message);
 
   /* find the value of last_index_back for
-     tau_table[pth->tt_size-1] = tau_table_growing[0] in order to
+     z_table[pth->tt_size-1], i.e. tau_table_growing[0], in order to
      speed up subsequent interpolations in the loop */
-  class_call(background_at_tau(pba,
-                               pth->tau_table[pth->tt_size-1],
-                               normal_info,
-                               inter_normal,
-                               &last_index_back,
-                               pvecback),
+  class_call(background_at_z(pba,
+                             pth->z_table[pth->tt_size-1],
+                             normal_info,
+                             inter_normal,
+                             &last_index_back,
+                             pvecback),
              pba->error_message,
              pth->error_message);
 
@@ -3276,12 +3438,12 @@ int thermodynamics_calculate_damping_scale(
 
     tau_table_growing[index_tau] = pth->tau_table[pth->tt_size-1-index_tau];
 
-    class_call(background_at_tau(pba,
-                                 tau_table_growing[index_tau],
-                                 normal_info,
-                                 inter_closeby,
-                                 &last_index_back,
-                                 pvecback),
+    class_call(background_at_z(pba,
+                               pth->z_table[pth->tt_size-1-index_tau],
+                               normal_info,
+                               inter_closeby,
+                               &last_index_back,
+                               pvecback),
                pba->error_message,
                pth->error_message);
 
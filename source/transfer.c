@@ -29,6 +29,7 @@
 
 #include "transfer.h"
 #include "parallel.h"
+#include "class_mpi.h"
 
 /**
  * Transfer function \f$ \Delta_l^{X} (q) \f$ at a given wavenumber q.
@@ -70,14 +71,27 @@ int transfer_functions_at_q(
                             ) {
   /** Summary: */
 
+  int index_q, index_start;
+  double * transfer_at_l;
+
+  index_start = ((index_ic * ptr->tt_size[index_md] + index_tt) * ptr->l_size[index_md] + index_l) * ptr->q_size;
+
+  /** - if the transfer functions are not stored in double precision, read them back for this multipole */
+  if (ptr->storage == transfer_storage_double) {
+    transfer_at_l = ptr->transfer[index_md] + index_start;
+  }
+  else {
+    class_alloc(transfer_at_l,ptr->q_size*sizeof(double),ptr->error_message);
+    for (index_q = 0; index_q < ptr->q_size; index_q++)
+      transfer_at_l[index_q] = _transfer_value_(ptr,index_md,index_start+index_q);
+  }
+
   /** - interpolate in pre-computed table using array_interpolate_two() */
   class_call(array_interpolate_two(
                                    ptr->q,
                                    1,
                                    0,
-                                   ptr->transfer[index_md]
-                                   +((index_ic * ptr->tt_size[index_md] + index_tt) * ptr->l_size[index_md] + index_l)
-                                   * ptr->q_size,
+                                   transfer_at_l,
                                    1,
                                    ptr->q_size,
                                    q,
@@ -87,6 +101,9 @@ int transfer_functions_at_q(
              ptr->error_message,
              ptr->error_message);
 
+  if (ptr->storage != transfer_storage_double)
+    free(transfer_at_l);
+
   return _SUCCESS_;
 }
 
@@ -126,8 +143,20 @@ int transfer_init(
 
   /** - define local variables */
 
-  /* running index for wavenumbers */
-  int index_q;
+  /* first index of each block of wavenumbers, and size of the blocks */
+  int index_q_block, q_block_size;
+
+  /* adaptive q sampling: number of wavenumbers to loop over, flags of
+     those still to be computed, refinement level and number of new values */
+  int index_q, q_loop_size;
+  short * q_needed;
+  int q_level, q_new;
+  short ** l_needed;
+  int l_level, l_new;
+  int index_md;
+  /* adaptive l sampling: sources kept between the passes */
+  struct transfer_sources_cache sc;
+  struct transfer_sources_cache * psc;
 
   /* conformal time today */
   double tau0;
@@ -139,12 +168,18 @@ int transfer_init(
   /* maximum number of sampling times for transfer sources */
   int tau_size_max;
 
-  /* array of sources S(k,tau), just taken from perturbation module,
-     or transformed if non-linear corrections are needed
+  /* array of sources S(k,tau), just taken from perturbation module
+     (only the pointers are copied, not the data)
      sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp][index_tau * ppt->k_size[index_md] + index_k]
   */
   double *** sources;
 
+  /* non-linear correction factors by which the previous sources
+     must be multiplied, or NULL for sources used as they are,
+     nl_corrections[index_md][index_ic * ppt->tp_size[index_md] + index_tp][index_tau * ppt->k_size[index_md] + index_k]
+  */
+  double *** nl_corrections;
+
   /* array of source derivatives S''(k,tau)
      (second derivative with respect to k, not tau!),
      used to interpolate sources at the right values of k,
@@ -153,6 +188,9 @@ int transfer_init(
   double *** sources_spline;
 
 
+  /** - start the timer and counters of this module */
+  class_timer_begin(&(ptr->stats));
+
   /** - array with the correspondence between the index of sources in
       the perturbation module and in the transfer module,
       tp_of_tt[index_md][index_tt]
@@ -162,6 +200,9 @@ int transfer_init(
   /* structure containing the flat spherical bessel functions */
 
   HyperInterpStruct BIS;
+  /* its copy on the device, if any */
+  struct transfer_offload offload;
+  short from_cache;
   double xmax;
 
 
@@ -171,6 +212,7 @@ int transfer_init(
     ptr->has_cls = _FALSE_;
     if (ptr->transfer_verbose > 0)
       printf("No harmonic space transfer functions to compute. Transfer module skipped.\n");
+    class_timer_end(&(ptr->stats));
     return _SUCCESS_;
   }
   else
@@ -188,6 +230,16 @@ int transfer_init(
     ptr->do_lcmb_full_limber = _FALSE_;
   }
 
+  /** - check whether we will compute C_l^phiphi at high l in the
+      direct Limber scheme (flat case only) */
+
+  if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (ppt->want_lcmb_direct_limber == _TRUE_) && (pba->sgnK == 0)) {
+    ptr->do_lcmb_direct_limber = _TRUE_;
+  }
+  else {
+    ptr->do_lcmb_direct_limber = _FALSE_;
+  }
+
   /** - get number of modes (scalars, tensors...) */
 
   ptr->md_size = ppt->md_size;
@@ -215,23 +267,17 @@ int transfer_init(
              ptr->error_message,
              ptr->error_message);
 
-  /** - copy sources to a local array sources (in fact, only the pointers are copied, not the data), and eventually apply non-linear corrections to the sources */
+  /** - copy sources to a local array sources (in fact, only the pointers are copied, not the data), and find the non-linear corrections to be applied to some of them */
 
   class_alloc(sources,
               ptr->md_size*sizeof(double**),
               ptr->error_message);
 
-  class_call(transfer_perturbation_copy_sources_and_nl_corrections(ppt,pfo,ptr,sources),
-             ptr->error_message,
-             ptr->error_message);
-
-  /** - spline all the sources passed by the perturbation module with respect to k (in order to interpolate later at a given value of k) */
-
-  class_alloc(sources_spline,
+  class_alloc(nl_corrections,
               ptr->md_size*sizeof(double**),
               ptr->error_message);
 
-  class_call(transfer_perturbation_source_spline(ppt,ptr,sources,sources_spline),
+  class_call(transfer_perturbation_copy_sources_and_nl_corrections(ppt,pfo,ptr,sources,nl_corrections),
              ptr->error_message,
              ptr->error_message);
 
@@ -245,6 +291,16 @@ int transfer_init(
              ptr->error_message,
              ptr->error_message);
 
+  /** - spline the sources passed by the perturbation module with respect to k (in order to interpolate later at a given value of k), for the types actually used by the transfer module */
+
+  class_alloc(sources_spline,
+              ptr->md_size*sizeof(double**),
+              ptr->error_message);
+
+  class_call(transfer_perturbation_source_spline(ppt,ptr,tp_of_tt,sources,nl_corrections,sources_spline),
+             ptr->error_message,
+             ptr->error_message);
+
   /** - evaluate maximum number of sampled times in the transfer
       sources: needs to be known here, in order to allocate a large
       enough workspace */
@@ -260,23 +316,56 @@ int transfer_init(
   if (pba->sgnK == -1 && ptr->index_q_flat_approximation < ptr->q_size)
     xmax *= sqrt(pba->sgnK*pba->K)/ptr->q[ptr->q_size-1]*(ptr->l[ptr->l_size_max-1]+1)/asinh((ptr->l[ptr->l_size_max-1]+1)/ptr->q[ptr->q_size-1]*sqrt(pba->sgnK*pba->K))*1.01;
 
-  class_call(hyperspherical_HIS_create(0,
-                                       1.,
-                                       ptr->l_size_max,
-                                       ptr->l,
-                                       ppr->hyper_x_min,
-                                       xmax,
-                                       ppr->hyper_sampling_flat,
-                                       ptr->l[ptr->l_size_max-1]+1,
-                                       ppr->hyper_phi_min_abs,
-                                       &BIS,
-                                       ptr->error_message),
+  if (ppr->hyper_flat_cache == _TRUE_) {
+
+    class_call(hyperspherical_HIS_create_cached(ppr->hyper_flat_cache_path,
+                                                0,
+                                                1.,
+                                                ptr->l_size_max,
+                                                ptr->l,
+                                                ppr->hyper_x_min,
+                                                xmax,
+                                                ppr->hyper_sampling_flat,
+                                                ptr->l[ptr->l_size_max-1]+1,
+                                                ppr->hyper_phi_min_abs,
+                                                &BIS,
+                                                &from_cache,
+                                                ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+
+    if ((ptr->transfer_verbose > 1) && (from_cache == _TRUE_))
+      printf(" -> read %d bessel functions (%d points) from cache in %s\n",BIS.l_size,BIS.x_size,ppr->hyper_flat_cache_path);
+  }
+  else {
+
+    class_call(hyperspherical_HIS_create(0,
+                                         1.,
+                                         ptr->l_size_max,
+                                         ptr->l,
+                                         ppr->hyper_x_min,
+                                         xmax,
+                                         ppr->hyper_sampling_flat,
+                                         ptr->l[ptr->l_size_max-1]+1,
+                                         ppr->hyper_phi_min_abs,
+                                         &BIS,
+                                         ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  /** - with OFFLOAD=yes, copy the Bessel functions to the device */
+
+  class_call(transfer_offload_init(&offload,&BIS,ptr->error_message),
              ptr->error_message,
              ptr->error_message);
 
+  if ((ptr->transfer_verbose > 1) && (offload.is_active == _TRUE_))
+    printf(" -> line-of-sight integrals of the flat case offloaded to device %d\n",offload.device);
+
   /** - eventually read the selection and evolution functions */
 
-  class_call(transfer_global_selection_read(ptr),
+  class_call(transfer_global_selection_read(ppr,ptr),
              ptr->error_message,
              ptr->error_message);
 
@@ -296,91 +385,232 @@ int transfer_init(
 
   class_setup_parallel();
 
-  /** - loop over all wavenumbers (parallelized).*/
-  /* For each wavenumber: */
-  for (index_q = 0; index_q < MAX(ptr->q_size,ptr->q_size_limber); index_q++) {
- class_run_parallel(with_arguments(pba,pth,ppt,ptr,ppr,index_q,tau_rec,tp_of_tt,sources,sources_spline,tau_size_max,window,tau0,&BIS),
+  /** - loop over all wavenumbers (parallelized), by blocks of
+      ppr->transfer_q_block_size consecutive values sharing the same
+      thread and workspace.*/
+  q_block_size = MAX(1,ppr->transfer_q_block_size);
+  q_needed = NULL;
+  q_level = 0;
+  l_needed = ptr->l_sampled;
+  l_level = 0;
+  psc = NULL;
+
+  /* In the adaptive l sampling, the whole loop is repeated for the
+     multipoles added by transfer_refine_l_list(), flagged in l_needed
+     (the list of q values being refined before, with the first
+     multipoles only). */
+  do {
+
+    /* the sources are kept between the passes as soon as the list of
+       q values is final */
+    if ((ptr->l_sampled != NULL) && (ppt->has_scalars == _TRUE_) && (psc == NULL) &&
+        ((l_level > 0) || (ppr->transfer_q_adaptive == _FALSE_) || (ptr->q_list_from_file == _TRUE_))) {
+      psc = &sc;
+      class_call(transfer_sources_cache_init(ppr,pba,ppt,ptr,tau_rec,window,tau_size_max,psc),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
 
-      /* compute the transfer functions in the normal case (not the
-         full Limber one) */
+  /* In the adaptive scheme, the loop is repeated for the values of q
+     added by transfer_refine_q_list(), flagged in q_needed. */
+  do {
 
-      struct transfer_workspace tw;
-      struct transfer_workspace * ptw = &tw;
+    q_loop_size = ((q_needed == NULL) && (l_level == 0)) ? MAX(ptr->q_size,ptr->q_size_limber) : ptr->q_size;
 
-      class_call(transfer_workspace_init(ptr,
-                                         ppr,
-                                         ptw,
-                                         ppt->tau_size,
-                                         tau_size_max,
-                                         pba->K,
-                                         pba->sgnK,
-                                         tau0-pth->tau_cut,
-                                         &BIS),
-                 ptr->error_message,
-                 ptr->error_message);
+    /* For each block of wavenumbers (with MPI, for the blocks of this process): */
+    for (index_q_block = 0; index_q_block < q_loop_size; index_q_block += q_block_size) {
 
-      if (index_q < ptr->q_size) {
+      if ((index_q_block/q_block_size) % class_mpi_size() != class_mpi_rank())
+        continue;
 
-        if (ptr->transfer_verbose > 2)
-        printf("Compute transfer for wavenumber [%d/%zu]\n",index_q,ptr->q_size-1);
+      /* skip blocks without any new value */
+      if (q_needed != NULL) {
+        for (index_q = index_q_block; index_q < MIN(index_q_block+q_block_size,q_loop_size); index_q++) {
+          if (q_needed[index_q] == _TRUE_)
+            break;
+        }
+        if (index_q == MIN(index_q_block+q_block_size,q_loop_size))
+          continue;
+      }
 
-        /* Update interpolation structure: */
-        class_call(transfer_update_HIS(ppr,
-                                       ptr,
-                                       ptw,
-                                       index_q,
-                                       tau0),
+   class_label_parallel("transfer:index_q",index_q_block);
+   class_run_parallel(with_arguments(pba,pth,ppt,ptr,ppr,index_q_block,q_block_size,q_loop_size,q_needed,l_needed,l_level,psc,tau_rec,tp_of_tt,sources,nl_corrections,sources_spline,tau_size_max,window,tau0,&BIS,&offload),
+
+        int index_q;
+        struct transfer_workspace tw;
+        struct transfer_workspace * ptw = &tw;
+
+        class_call(transfer_workspace_init(ptr,
+                                           ppr,
+                                           ptw,
+                                           ppt->tau_size,
+                                           tau_size_max,
+                                           pba->K,
+                                           pba->sgnK,
+                                           tau0-pth->tau_cut,
+                                           &BIS,
+                                           &offload),
                    ptr->error_message,
                    ptr->error_message);
 
-        class_call(transfer_compute_for_each_q(ppr,
-                                               pba,
-                                               ppt,
-                                               ptr,
-                                               tp_of_tt,
-                                               index_q,
-                                               tau_size_max,
-                                               tau_rec,
-                                               sources,
-                                               sources_spline,
-                                               window,
-                                               ptw,
-                                               _FALSE_),
+        ptw->l_needed = l_needed;
+        ptw->psc = psc;
+
+        /* For each wavenumber in the block: */
+        for (index_q = index_q_block; index_q < MIN(index_q_block+q_block_size,q_loop_size); index_q++) {
+
+          /* compute the transfer functions in the normal case (not the
+             full Limber one) */
+
+          if ((index_q < ptr->q_size) && ((q_needed == NULL) || (q_needed[index_q] == _TRUE_))) {
+
+            if (ptr->transfer_verbose > 2)
+            printf("Compute transfer for wavenumber [%d/%zu]\n",index_q,ptr->q_size-1);
+
+            /* Update interpolation structure: */
+            class_call(transfer_update_HIS(ppr,
+                                           ptr,
+                                           ptw,
+                                           index_q,
+                                           tau0),
+                       ptr->error_message,
+                       ptr->error_message);
+
+            class_call(transfer_compute_for_each_q(ppr,
+                                                   pba,
+                                                   ppt,
+                                                   ptr,
+                                                   tp_of_tt,
+                                                   index_q,
+                                                   tau_size_max,
+                                                   tau_rec,
+                                                   sources,
+                                                   nl_corrections,
+                                                   sources_spline,
+                                                   window,
+                                                   ptw,
+                                                   _FALSE_),
+                       ptr->error_message,
+                       ptr->error_message);
+          }
+
+          /* compute the transfer functions in the full Limber case (if
+             this case is not needed, ptr->q_size_limber=0 and the
+             condition is never met); the full Limber list is never
+             refined */
+
+          if ((index_q < ptr->q_size_limber) && (q_needed == NULL) && (l_level == 0)) {
+
+            class_call(transfer_compute_for_each_q(ppr,
+                                                   pba,
+                                                   ppt,
+                                                   ptr,
+                                                   tp_of_tt,
+                                                   index_q,
+                                                   tau_size_max,
+                                                   tau_rec,
+                                                   sources,
+                                                   nl_corrections,
+                                                   sources_spline,
+                                                   window,
+                                                   ptw,
+                                                   _TRUE_),
+                       ptr->error_message,
+                       ptr->error_message);
+          }
+        }
+
+        class_call(transfer_workspace_free(ptr,ptw),
                    ptr->error_message,
                    ptr->error_message);
-      }
+        return _SUCCESS_;
+      );
+    } /* end of loop over wavenumber */
 
-      /* compute the transfer functions in the full Limber case (if
-       this case is not needed, ptr->q_size_limber=0 and the
-       condition is never met) */
+    /* with MPI, all processes fail if one of them did, and otherwise
+       send the transfer functions they computed to the others, which
+       all need them for refining the list of q and in the harmonic module */
+    class_call(class_mpi_agree(task_system.WaitAll(),ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
 
-      if (index_q < ptr->q_size_limber) {
+    if (class_mpi_size() > 1) {
+      class_call(transfer_share_q(ppt,ptr,q_block_size,q_loop_size,q_needed),
+                 ptr->error_message,
+                 ptr->error_message);
+    }
 
-        class_call(transfer_compute_for_each_q(ppr,
-                                               pba,
-                                               ppt,
-                                               ptr,
-                                               tp_of_tt,
-                                               index_q,
-                                               tau_size_max,
-                                               tau_rec,
-                                               sources,
-                                               sources_spline,
-                                               window,
-                                               ptw,
-                                               _TRUE_),
-                            ptr->error_message,
-                            ptr->error_message);
-      }
+    /* eventually refine the list of q values */
+    q_new = 0;
+    if ((ppr->transfer_q_adaptive == _TRUE_) && (ptr->q_list_from_file == _FALSE_) && (q_level < ppr->transfer_q_adaptive_levels) && (l_level == 0)) {
 
-      class_call(transfer_workspace_free(ptr,ptw),
+      class_call(transfer_refine_q_list(ppr,ppt,ptr,pba->K,pba->sgnK,&q_needed,&q_new),
                  ptr->error_message,
                  ptr->error_message);
-      return _SUCCESS_;
-    );
-  } /* end of loop over wavenumber */
 
-  class_finish_parallel();
+      q_level++;
+
+      if (ptr->transfer_verbose > 1)
+        printf(" -> adaptive q sampling, level %d: %d new values of q (%zu in total)\n",q_level,q_new,ptr->q_size);
+    }
+
+  } while (q_new > 0);
+
+    /* the next passes are over all values of q */
+    free(q_needed);
+    q_needed = NULL;
+
+    /* eventually refine the list of multipoles */
+    l_new = 0;
+    if ((ptr->l_sampled != NULL) && (l_level < ppr->transfer_l_adaptive_levels)) {
+
+      class_call(transfer_refine_l_list(ppr,ppt,ptr,&l_needed,&l_new),
+                 ptr->error_message,
+                 ptr->error_message);
+
+      if (psc != NULL) {
+        class_call(transfer_sources_cache_release(ptr,l_needed,psc),
+                   ptr->error_message,
+                   ptr->error_message);
+      }
+
+      l_level++;
+
+      if (ptr->transfer_verbose > 1)
+        printf(" -> adaptive l sampling, level %d: %d new multipoles, summed over the fields\n",l_level,l_new);
+    }
+
+  } while (l_new > 0);
+
+  free(q_needed);
+
+  if (l_needed != ptr->l_sampled) {
+    for (index_md = 0; index_md < ptr->md_size; index_md++)
+      free(l_needed[index_md]);
+    free(l_needed);
+  }
+
+  if (psc != NULL) {
+    class_call(transfer_sources_cache_free(psc),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  /** - if requested, store the list of q values for the next runs */
+  if ((ppr->transfer_q_list_cache == _TRUE_) && (ptr->q_list_from_file == _FALSE_)) {
+    class_call(transfer_write_q_list(ppr,ptr,q_period),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  /** - in the direct Limber scheme, get the transfer functions of
+      the CMB lensing potential at the multipoles skipped above */
+
+  if (ptr->do_lcmb_direct_limber == _TRUE_) {
+    class_call(transfer_lcmb_direct_limber(ppt,ptr,tau_rec,tau0,tp_of_tt,nl_corrections,sources_spline),
+               ptr->error_message,
+               ptr->error_message);
+  }
 
   /** - finally, free arrays allocated outside parallel zone */
   free(window);
@@ -389,7 +619,7 @@ int transfer_init(
              ptr->error_message,
              ptr->error_message);
 
-  class_call(transfer_perturbation_sources_free(ppt,pfo,ptr,sources),
+  class_call(transfer_perturbation_sources_free(ppt,pfo,ptr,sources,nl_corrections),
              ptr->error_message,
              ptr->error_message);
 
@@ -397,14 +627,152 @@ int transfer_init(
              ptr->error_message,
              ptr->error_message);
 
+  class_call(transfer_offload_free(&offload),
+             ptr->error_message,
+             ptr->error_message);
+
   class_call(hyperspherical_HIS_free(&BIS,ptr->error_message),
              ptr->error_message,
              ptr->error_message);
 
+  /** - if requested, store the transfer functions with less precision */
+  if (ptr->storage != transfer_storage_double) {
+    class_call(transfer_storage_convert(ppt,ptr),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
   ptr->is_allocated = _TRUE_;
+  class_timer_end(&(ptr->stats));
+
+  return _SUCCESS_;
+}
+
+/**
+ * After one pass of the loop over q of transfer_init() distributed over
+ * several MPI processes (which deals the blocks of q values to the
+ * processes in turn), send the transfer functions computed by each
+ * process to all the others, one process after the other.
+ *
+ * @param ppt          Input: pointer to perturbation structure
+ * @param ptr          Input/Output: pointer to transfer structure
+ * @param q_block_size Input: number of q values per block
+ * @param q_loop_size  Input: number of q values of the loop
+ * @param q_needed     Input: flags of the q values computed in this pass (NULL for all of them)
+ * @return the error status
+ */
+
+int transfer_share_q(
+                     struct perturbations * ppt,
+                     struct transfer * ptr,
+                     int q_block_size,
+                     int q_loop_size,
+                     short * q_needed
+                     ) {
+
+  int rank;
+  size_t count;
+  double * buffer;
+
+  for (rank = 0; rank < class_mpi_size(); rank++) {
+
+    /** - size of the transfer functions computed by this process */
+    count = transfer_copy_q(ppt,ptr,q_block_size,q_loop_size,q_needed,rank,NULL,_TRUE_);
+    if (count == 0)
+      continue;
+
+    /** - packed by this process, and unpacked by the others */
+    class_alloc(buffer,count*sizeof(double),ptr->error_message);
+
+    if (rank == class_mpi_rank())
+      transfer_copy_q(ppt,ptr,q_block_size,q_loop_size,q_needed,rank,buffer,_TRUE_);
+
+    class_call_except(class_mpi_broadcast(buffer,count,rank,ptr->error_message),
+                      ptr->error_message,
+                      ptr->error_message,
+                      free(buffer));
+
+    if (rank != class_mpi_rank())
+      transfer_copy_q(ppt,ptr,q_block_size,q_loop_size,q_needed,rank,buffer,_FALSE_);
+
+    free(buffer);
+  }
+
   return _SUCCESS_;
 }
 
+/**
+ * Copy the transfer functions computed by one MPI process in one pass
+ * of the loop over q to (or from) a contiguous buffer.
+ *
+ * @param ppt          Input: pointer to perturbation structure
+ * @param ptr          Input/Output: pointer to transfer structure
+ * @param q_block_size Input: number of q values per block
+ * @param q_loop_size  Input: number of q values of the loop
+ * @param q_needed     Input: flags of the q values computed in this pass (NULL for all of them)
+ * @param rank         Input: rank of the process
+ * @param buffer       Input/Output: the buffer (NULL for only counting the values)
+ * @param to_buffer    Input: _TRUE_ for copying the transfer functions to the buffer, _FALSE_ for the opposite
+ * @return the number of values
+ */
+
+size_t transfer_copy_q(
+                       struct perturbations * ppt,
+                       struct transfer * ptr,
+                       int q_block_size,
+                       int q_loop_size,
+                       short * q_needed,
+                       int rank,
+                       double * buffer,
+                       int to_buffer
+                       ) {
+
+  int index_q_block, index_q, index_md;
+  size_t index_row, row_size;
+  size_t index = 0;
+
+  for (index_q_block = 0; index_q_block < q_loop_size; index_q_block += q_block_size) {
+
+    if ((index_q_block/q_block_size) % class_mpi_size() != rank)
+      continue;
+
+    for (index_q = index_q_block; index_q < MIN(index_q_block+q_block_size,q_loop_size); index_q++) {
+
+      for (index_md = 0; index_md < ptr->md_size; index_md++) {
+
+        row_size = (size_t)ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md];
+
+        /* same conditions as in the loop of transfer_init() */
+        if ((index_q < ptr->q_size) && ((q_needed == NULL) || (q_needed[index_q] == _TRUE_))) {
+          for (index_row = 0; index_row < row_size; index_row++) {
+            if (buffer != NULL) {
+              if (to_buffer == _TRUE_)
+                buffer[index] = ptr->transfer[index_md][index_row * ptr->q_size + index_q];
+              else
+                ptr->transfer[index_md][index_row * ptr->q_size + index_q] = buffer[index];
+            }
+            index++;
+          }
+        }
+
+        if ((index_q < ptr->q_size_limber) && (q_needed == NULL) && (ptr->do_lcmb_full_limber == _TRUE_)) {
+          for (index_row = 0; index_row < row_size; index_row++) {
+            if (buffer != NULL) {
+              if (to_buffer == _TRUE_)
+                buffer[index] = ptr->transfer_limber[index_md][index_row * ptr->q_size_limber + index_q];
+              else
+                ptr->transfer_limber[index_md][index_row * ptr->q_size_limber + index_q] = buffer[index];
+            }
+            index++;
+          }
+        }
+      }
+    }
+  }
+
+  return index;
+}
+
 /**
  * This routine frees all the memory space allocated by transfer_init().
  *
@@ -425,7 +793,7 @@ int transfer_free(
 
     for (index_md = 0; index_md < ptr->md_size; index_md++) {
       free(ptr->l_size_tt[index_md]);
-      free(ptr->transfer[index_md]);
+      class_free_large(ptr->transfer[index_md]);
       free(ptr->k[index_md]);
       if (ptr->do_lcmb_full_limber == _TRUE_) {
         free(ptr->transfer_limber[index_md]);
@@ -433,6 +801,12 @@ int transfer_free(
       }
     }
 
+    if (ptr->l_sampled != NULL) {
+      for (index_md = 0; index_md < ptr->md_size; index_md++)
+        free(ptr->l_sampled[index_md]);
+      free(ptr->l_sampled);
+    }
+
     free(ptr->tt_size);
     free(ptr->l_size_tt);
     free(ptr->l_size);
@@ -445,6 +819,39 @@ int transfer_free(
       free(ptr->k_limber);
       free(ptr->transfer_limber);
     }
+    if (ptr->do_lcmb_direct_limber == _TRUE_) {
+      free(ptr->k_size_lcmb_direct);
+      free(ptr->k_lcmb_direct);
+      free(ptr->transfer_lcmb_direct);
+    }
+
+    if (ptr->storage == transfer_storage_float) {
+      for (index_md = 0; index_md < ptr->md_size; index_md++) {
+        free(ptr->transfer_float[index_md]);
+        if (ptr->do_lcmb_full_limber == _TRUE_)
+          free(ptr->transfer_limber_float[index_md]);
+      }
+      free(ptr->transfer_float);
+      if (ptr->do_lcmb_full_limber == _TRUE_)
+        free(ptr->transfer_limber_float);
+    }
+
+    if (ptr->storage == transfer_storage_int16) {
+      for (index_md = 0; index_md < ptr->md_size; index_md++) {
+        free(ptr->transfer_int16[index_md]);
+        free(ptr->transfer_scale[index_md]);
+        if (ptr->do_lcmb_full_limber == _TRUE_) {
+          free(ptr->transfer_limber_int16[index_md]);
+          free(ptr->transfer_limber_scale[index_md]);
+        }
+      }
+      free(ptr->transfer_int16);
+      free(ptr->transfer_scale);
+      if (ptr->do_lcmb_full_limber == _TRUE_) {
+        free(ptr->transfer_limber_int16);
+        free(ptr->transfer_limber_scale);
+      }
+    }
 
     if (ptr->nz_size > 0) {
       free(ptr->nz_z);
@@ -467,60 +874,226 @@ int transfer_free(
 }
 
 /**
- * This routine defines all indices and allocates all tables
- * in the transfer structure
+ * Replace the tables of transfer functions computed in double
+ * precision by their single precision or 16-bit version, according to
+ * ptr->storage, in order to reduce the memory used by the transfer
+ * structure once it has been computed. The double precision tables
+ * are freed. The largest error introduced by the conversion, relative
+ * to the maximum of |Delta_l(q)| over q for each mode, initial
+ * condition, type and multipole, is stored in ptr->storage_error.
  *
- * Compute list of (k, l) values, allocate and fill corresponding
- * arrays in the transfer structure. Allocate the array of transfer
- * function tables.
- *
- * @param ppr      Input: pointer to precision structure
- * @param ppt      Input: pointer to perturbation structure
- * @param ptr      Input/Output: pointer to transfer structure
- * @param q_period Input: order of magnitude of the oscillation period of transfer functions
- * @param K        Input: spatial curvature (in absolute value)
- * @param sgnK     Input: spatial curvature sign (open/closed/flat)
+ * @param ppt Input: pointer to perturbation structure
+ * @param ptr Input/output: pointer to transfer structure
  * @return the error status
  */
 
-int transfer_indices(
-                     struct precision * ppr,
-                     struct perturbations * ppt,
-                     struct transfer * ptr,
-                     double q_period,
-                     double K,
-                     int sgnK
-                     ) {
+int transfer_storage_convert(
+                             struct perturbations * ppt,
+                             struct transfer * ptr
+                             ) {
 
-  /** Summary: */
+  int index_md, block_num;
+  size_t size_double = 0, size_stored = 0;
 
-  /** - define local variables */
+  ptr->storage_error = 0.;
 
-  int index_md,index_tt,index_tt_common;
+  if (ptr->storage == transfer_storage_float) {
+    class_alloc(ptr->transfer_float,ptr->md_size*sizeof(float*),ptr->error_message);
+    if (ptr->do_lcmb_full_limber == _TRUE_)
+      class_alloc(ptr->transfer_limber_float,ptr->md_size*sizeof(float*),ptr->error_message);
+  }
+  else {
+    class_alloc(ptr->transfer_int16,ptr->md_size*sizeof(short*),ptr->error_message);
+    class_alloc(ptr->transfer_scale,ptr->md_size*sizeof(double*),ptr->error_message);
+    if (ptr->do_lcmb_full_limber == _TRUE_) {
+      class_alloc(ptr->transfer_limber_int16,ptr->md_size*sizeof(short*),ptr->error_message);
+      class_alloc(ptr->transfer_limber_scale,ptr->md_size*sizeof(double*),ptr->error_message);
+    }
+  }
 
-  /** - define indices for transfer types */
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
-  class_alloc(ptr->tt_size,ptr->md_size * sizeof(int),ptr->error_message);
+    block_num = ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md];
 
-  /** - type indices common to scalars and tensors */
+    class_call(transfer_storage_convert_table(ptr,
+                                              ptr->transfer[index_md],
+                                              block_num,
+                                              ptr->q_size,
+                                              (ptr->storage == transfer_storage_float) ? &(ptr->transfer_float[index_md]) : NULL,
+                                              (ptr->storage == transfer_storage_int16) ? &(ptr->transfer_int16[index_md]) : NULL,
+                                              (ptr->storage == transfer_storage_int16) ? &(ptr->transfer_scale[index_md]) : NULL),
+               ptr->error_message,
+               ptr->error_message);
 
-  index_tt = 0;
+    class_free_large(ptr->transfer[index_md]);
+    ptr->transfer[index_md] = NULL;
+    size_double += (size_t)block_num * ptr->q_size;
 
-  class_define_index(ptr->index_tt_t2,ppt->has_cl_cmb_temperature, index_tt,1);
-  class_define_index(ptr->index_tt_e, ppt->has_cl_cmb_polarization,index_tt,1);
+    if (ptr->do_lcmb_full_limber == _TRUE_) {
 
-  index_tt_common=index_tt;
+      class_call(transfer_storage_convert_table(ptr,
+                                                ptr->transfer_limber[index_md],
+                                                block_num,
+                                                ptr->q_size_limber,
+                                                (ptr->storage == transfer_storage_float) ? &(ptr->transfer_limber_float[index_md]) : NULL,
+                                                (ptr->storage == transfer_storage_int16) ? &(ptr->transfer_limber_int16[index_md]) : NULL,
+                                                (ptr->storage == transfer_storage_int16) ? &(ptr->transfer_limber_scale[index_md]) : NULL),
+                 ptr->error_message,
+                 ptr->error_message);
 
-  /** - type indices for scalars */
+      free(ptr->transfer_limber[index_md]);
+      ptr->transfer_limber[index_md] = NULL;
+      size_double += (size_t)block_num * ptr->q_size_limber;
+    }
+  }
 
-  if (ppt->has_scalars == _TRUE_) {
+  if (ptr->storage == transfer_storage_float) {
+    size_stored = size_double*sizeof(float);
+  }
+  else {
+    size_stored = size_double*sizeof(short);
+  }
+  size_double *= sizeof(double);
+
+  if (ptr->transfer_verbose > 0) {
+    printf(" -> transfer functions stored in %s (%.1f MB instead of %.1f MB), maximum relative error %.2e\n",
+           (ptr->storage == transfer_storage_float) ? "single precision" : "16-bit integers",
+           size_stored/1048576.,
+           size_double/1048576.,
+           ptr->storage_error);
+  }
 
-    index_tt = index_tt_common;
+  return _SUCCESS_;
+}
 
-    class_define_index(ptr->index_tt_t0,     ppt->has_cl_cmb_temperature,      index_tt,1);
-    class_define_index(ptr->index_tt_t1,     ppt->has_cl_cmb_temperature,      index_tt,1);
-    class_define_index(ptr->index_tt_lcmb,   ppt->has_cl_cmb_lensing_potential,index_tt,1);
-    class_define_index(ptr->index_tt_density,ppt->has_nc_density,              index_tt,ppt->selection_num);
+/**
+ * Convert one table of transfer functions, made of block_num blocks
+ * of block_size wavenumbers, to single precision (if table_float is
+ * not NULL) or to 16-bit integers with one scale per block (if
+ * table_int16 and scale are not NULL). The converted table is
+ * allocated here. The values are read back and compared with the
+ * original ones, and ptr->storage_error is updated with the largest
+ * error relative to the maximum of the block.
+ *
+ * @param ptr         Input/output: pointer to transfer structure
+ * @param table       Input: table in double precision
+ * @param block_num   Input: number of blocks (modes, initial conditions, types and multipoles)
+ * @param block_size  Input: number of wavenumbers in each block
+ * @param table_float Output: pointer to the table in single precision, or NULL
+ * @param table_int16 Output: pointer to the table of 16-bit integers, or NULL
+ * @param scale       Output: pointer to the table of scales of each block, or NULL
+ * @return the error status
+ */
+
+int transfer_storage_convert_table(
+                                   struct transfer * ptr,
+                                   double * table,
+                                   int block_num,
+                                   int block_size,
+                                   float ** table_float,
+                                   short ** table_int16,
+                                   double ** scale
+                                   ) {
+
+  int index_block, index_q;
+  double * block, max, value;
+
+  if (table_float != NULL) {
+    class_alloc(*table_float,(size_t)block_num*block_size*sizeof(float),ptr->error_message);
+  }
+  if (table_int16 != NULL) {
+    class_alloc(*table_int16,(size_t)block_num*block_size*sizeof(short),ptr->error_message);
+    class_alloc(*scale,block_num*sizeof(double),ptr->error_message);
+  }
+
+  for (index_block = 0; index_block < block_num; index_block++) {
+
+    block = table + (size_t)index_block*block_size;
+
+    max = 0.;
+    for (index_q = 0; index_q < block_size; index_q++)
+      max = MAX(max,fabs(block[index_q]));
+
+    for (index_q = 0; index_q < block_size; index_q++) {
+
+      if (table_float != NULL) {
+        (*table_float)[(size_t)index_block*block_size+index_q] = (float)block[index_q];
+        value = (double)((*table_float)[(size_t)index_block*block_size+index_q]);
+      }
+      else {
+        if (max > 0.)
+          (*table_int16)[(size_t)index_block*block_size+index_q] = (short)lrint(block[index_q]/max*_TRANSFER_INT16_MAX_);
+        else
+          (*table_int16)[(size_t)index_block*block_size+index_q] = 0;
+        value = (*table_int16)[(size_t)index_block*block_size+index_q]*max/_TRANSFER_INT16_MAX_;
+      }
+
+      if (max > 0.)
+        ptr->storage_error = MAX(ptr->storage_error,fabs(value-block[index_q])/max);
+    }
+
+    if (table_int16 != NULL)
+      (*scale)[index_block] = max;
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine defines all indices and allocates all tables
+ * in the transfer structure
+ *
+ * Compute list of (k, l) values, allocate and fill corresponding
+ * arrays in the transfer structure. Allocate the array of transfer
+ * function tables.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input/Output: pointer to transfer structure
+ * @param q_period Input: order of magnitude of the oscillation period of transfer functions
+ * @param K        Input: spatial curvature (in absolute value)
+ * @param sgnK     Input: spatial curvature sign (open/closed/flat)
+ * @return the error status
+ */
+
+int transfer_indices(
+                     struct precision * ppr,
+                     struct perturbations * ppt,
+                     struct transfer * ptr,
+                     double q_period,
+                     double K,
+                     int sgnK
+                     ) {
+
+  /** Summary: */
+
+  /** - define local variables */
+
+  int index_md,index_tt,index_tt_common;
+
+  /** - define indices for transfer types */
+
+  class_alloc(ptr->tt_size,ptr->md_size * sizeof(int),ptr->error_message);
+
+  /** - type indices common to scalars and tensors */
+
+  index_tt = 0;
+
+  class_define_index(ptr->index_tt_t2,ppt->has_cl_cmb_temperature, index_tt,1);
+  class_define_index(ptr->index_tt_e, ppt->has_cl_cmb_polarization,index_tt,1);
+
+  index_tt_common=index_tt;
+
+  /** - type indices for scalars */
+
+  if (ppt->has_scalars == _TRUE_) {
+
+    index_tt = index_tt_common;
+
+    class_define_index(ptr->index_tt_t0,     ppt->has_cl_cmb_temperature,      index_tt,1);
+    class_define_index(ptr->index_tt_t1,     ppt->has_cl_cmb_temperature,      index_tt,1);
+    class_define_index(ptr->index_tt_lcmb,   ppt->has_cl_cmb_lensing_potential,index_tt,1);
+    class_define_index(ptr->index_tt_density,ppt->has_nc_density,              index_tt,ppt->selection_num);
     class_define_index(ptr->index_tt_rsd,    ppt->has_nc_rsd,                  index_tt,ppt->selection_num);
     class_define_index(ptr->index_tt_d0,     ppt->has_nc_rsd,                  index_tt,ppt->selection_num);
     class_define_index(ptr->index_tt_d1,     ppt->has_nc_rsd,                  index_tt,ppt->selection_num);
@@ -630,14 +1203,41 @@ int transfer_indices(
              ptr->error_message,
              ptr->error_message);
 
+  /** - in the direct Limber scheme, find the first multipole computed
+      this way (if there is none, the scheme is not used) */
+  if (ptr->do_lcmb_direct_limber == _TRUE_) {
+    index_md = ppt->index_md_scalars;
+    ptr->index_l_lcmb_direct = 0;
+    while ((ptr->index_l_lcmb_direct < ptr->l_size[index_md]) &&
+           (ptr->l[ptr->index_l_lcmb_direct] <= ppr->l_switch_lcmb_direct_limber))
+      ptr->index_l_lcmb_direct++;
+    if (ptr->index_l_lcmb_direct == ptr->l_size[index_md])
+      ptr->do_lcmb_direct_limber = _FALSE_;
+  }
+
+  /** - in the adaptive l sampling, get the first multipoles computed for each type using transfer_get_l_sampling() */
+  class_call(transfer_get_l_sampling(ppr,ppt,ptr),
+             ptr->error_message,
+             ptr->error_message);
+
   /** - loop over modes (scalar, etc). For each mode: */
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
     /** - allocate arrays of transfer functions, (ptr->transfer[index_md])[index_ic][index_tt][index_l][index_k] */
-    class_alloc(ptr->transfer[index_md],
-                ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md] * ptr->q_size * sizeof(double),
-                ptr->error_message);
+    class_alloc_large(ptr->transfer[index_md],
+                      ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md] * ptr->q_size * sizeof(double),
+                      ptr->error_message);
+
+    /* spread its pages over the NUMA nodes of the workers filling and reading it */
+    class_parallel_first_touch(ptr->transfer[index_md],
+                               ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md] * ptr->q_size * sizeof(double));
+
+    /* in the adaptive l sampling, the transfer functions at the multipoles left out remain equal to zero */
+    if (ptr->l_sampled != NULL) {
+      memset(ptr->transfer[index_md],0,
+             ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md] * ptr->q_size * sizeof(double));
+    }
 
     if (ptr->do_lcmb_full_limber == _TRUE_) {
       class_alloc(ptr->transfer_limber[index_md],
@@ -651,17 +1251,32 @@ int transfer_indices(
 
 }
 
+/**
+ * This routine gives access to the sources of the perturbation
+ * module without copying them: only the pointers are copied. For the
+ * sources that need non-linear corrections, it also stores a pointer
+ * to the relevant table of correction factors; the correction is then
+ * applied on the fly when the sources are splined and interpolated,
+ * so that no corrected copy of the sources is ever kept in memory.
+ *
+ * @param ppt            Input: pointer to perturbation structure
+ * @param pfo            Input: pointer to fourier structure
+ * @param ptr            Input: pointer to transfer structure
+ * @param sources        Output: pointers to the sources of the perturbation module
+ * @param nl_corrections Output: pointers to the non-linear correction factors of each source, or NULL
+ * @return the error status
+ */
+
 int transfer_perturbation_copy_sources_and_nl_corrections(
                                                           struct perturbations * ppt,
                                                           struct fourier * pfo,
                                                           struct transfer * ptr,
-                                                          double *** sources
+                                                          double *** sources,
+                                                          double *** nl_corrections
                                                           ) {
   int index_md;
   int index_ic;
   int index_tp;
-  int index_k;
-  int index_tau;
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
@@ -669,10 +1284,19 @@ int transfer_perturbation_copy_sources_and_nl_corrections(
                 ppt->ic_size[index_md]*ppt->tp_size[index_md]*sizeof(double*),
                 ptr->error_message);
 
+    class_alloc(nl_corrections[index_md],
+                ppt->ic_size[index_md]*ppt->tp_size[index_md]*sizeof(double*),
+                ptr->error_message);
+
     for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
 
       for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
 
+        sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp] =
+          ppt->sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+
+        nl_corrections[index_md][index_ic * ppt->tp_size[index_md] + index_tp] = NULL;
+
         if ((pfo->method != nl_none) && (_scalars_) &&
             (((ppt->has_source_delta_m == _TRUE_) && (index_tp == ppt->index_tp_delta_m)) ||
              ((ppt->has_source_delta_cb == _TRUE_) && (index_tp == ppt->index_tp_delta_cb)) ||
@@ -683,37 +1307,13 @@ int transfer_perturbation_copy_sources_and_nl_corrections(
              ((ppt->has_source_phi_plus_psi == _TRUE_) && (index_tp == ppt->index_tp_phi_plus_psi)) ||
              ((ppt->has_source_psi == _TRUE_) && (index_tp == ppt->index_tp_psi)))) {
 
-          class_alloc(sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
-                      ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
-                      ptr->error_message);
-
-          for (index_tau=0; index_tau<ppt->tau_size; index_tau++) {
-            for (index_k=0; index_k<ppt->k_size[index_md]; index_k++) {
-              if (((ppt->has_source_delta_cb == _TRUE_) && (index_tp == ppt->index_tp_delta_cb)) ||
-                  ((ppt->has_source_theta_cb == _TRUE_) && (index_tp == ppt->index_tp_theta_cb))){
-                sources[index_md]
-                  [index_ic * ppt->tp_size[index_md] + index_tp]
-                  [index_tau * ppt->k_size[index_md] + index_k] =
-                  ppt->sources[index_md]
-                  [index_ic * ppt->tp_size[index_md] + index_tp]
-                  [index_tau * ppt->k_size[index_md] + index_k]
-                  * pfo->nl_corr_density[pfo->index_pk_cb][index_tau * ppt->k_size[index_md] + index_k];
-              }
-              else{
-                sources[index_md]
-                  [index_ic * ppt->tp_size[index_md] + index_tp]
-                  [index_tau * ppt->k_size[index_md] + index_k] =
-                  ppt->sources[index_md]
-                  [index_ic * ppt->tp_size[index_md] + index_tp]
-                  [index_tau * ppt->k_size[index_md] + index_k]
-                  * pfo->nl_corr_density[pfo->index_pk_m][index_tau * ppt->k_size[index_md] + index_k];
-              }
-            }
+          if (((ppt->has_source_delta_cb == _TRUE_) && (index_tp == ppt->index_tp_delta_cb)) ||
+              ((ppt->has_source_theta_cb == _TRUE_) && (index_tp == ppt->index_tp_theta_cb))) {
+            nl_corrections[index_md][index_ic * ppt->tp_size[index_md] + index_tp] = pfo->nl_corr_density[pfo->index_pk_cb];
+          }
+          else {
+            nl_corrections[index_md][index_ic * ppt->tp_size[index_md] + index_tp] = pfo->nl_corr_density[pfo->index_pk_m];
           }
-        }
-        else {
-          sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp] =
-            ppt->sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
         }
       }
     }
@@ -723,16 +1323,40 @@ int transfer_perturbation_copy_sources_and_nl_corrections(
 
 }
 
+/**
+ * This routine splines the sources with respect to k, for the types
+ * used by at least one transfer type (the spline of the other ones is
+ * set to NULL). For sources with non-linear corrections, the product
+ * of the source by the correction is splined; it is built one source
+ * at a time in a temporary buffer, which is also used to convert the
+ * sources stored in single precision (see ppt->storage).
+ *
+ * @param ppt            Input: pointer to perturbation structure
+ * @param ptr            Input: pointer to transfer structure
+ * @param tp_of_tt       Input: correspondence between perturbation and transfer types
+ * @param sources        Input: pointers to the sources of the perturbation module
+ * @param nl_corrections Input: pointers to the non-linear correction factors of each source, or NULL
+ * @param sources_spline Output: second derivative of the (corrected) sources with respect to k
+ * @return the error status
+ */
 
 int transfer_perturbation_source_spline(
                                         struct perturbations * ppt,
                                         struct transfer * ptr,
+                                        int ** tp_of_tt,
                                         double *** sources,
+                                        double *** nl_corrections,
                                         double *** sources_spline
                                         ) {
   int index_md;
   int index_ic;
   int index_tp;
+  int index_tt;
+  int index;
+  short used;
+  double * source;
+  double * nl_correction;
+  double * corrected_source;
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
@@ -744,13 +1368,36 @@ int transfer_perturbation_source_spline(
 
       for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
 
+        sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp] = NULL;
+
+        used = _FALSE_;
+        for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+          if (tp_of_tt[index_md][index_tt] == index_tp)
+            used = _TRUE_;
+        }
+        if (used == _FALSE_)
+          continue;
+
         class_alloc(sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
                     ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
                     ptr->error_message);
 
+        source = sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+        nl_correction = nl_corrections[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+
+        if ((nl_correction != NULL) || (ppt->storage != sources_storage_double)) {
+          class_alloc(corrected_source,
+                      ppt->k_size[index_md]*ppt->tau_size*sizeof(double),
+                      ptr->error_message);
+          for (index = 0; index < ppt->k_size[index_md]*ppt->tau_size; index++)
+            corrected_source[index] = _source_value_(ppt,index_md,index_ic * ppt->tp_size[index_md] + index_tp,index)
+              * (nl_correction != NULL ? nl_correction[index] : 1.);
+          source = corrected_source;
+        }
+
         class_call(array_spline_table_columns2(ppt->k[index_md],
                                                ppt->k_size[index_md],
-                                               sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
+                                               source,
                                                ppt->tau_size,
                                                sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp],
                                                _SPLINE_EST_DERIV_,
@@ -758,6 +1405,9 @@ int transfer_perturbation_source_spline(
                    ptr->error_message,
                    ptr->error_message);
 
+        if ((nl_correction != NULL) || (ppt->storage != sources_storage_double))
+          free(corrected_source);
+
       }
     }
   }
@@ -770,32 +1420,17 @@ int transfer_perturbation_sources_free(
                                        struct perturbations * ppt,
                                        struct fourier * pfo,
                                        struct transfer * ptr,
-                                       double *** sources
+                                       double *** sources,
+                                       double *** nl_corrections
                                        ) {
   int index_md;
-  int index_ic;
-  int index_tp;
 
   for (index_md = 0; index_md < ptr->md_size; index_md++) {
-    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
-      for (index_tp = 0; index_tp < ppt->tp_size[index_md]; index_tp++) {
-        if ((pfo->method != nl_none) && (_scalars_) &&
-            (((ppt->has_source_delta_m == _TRUE_) && (index_tp == ppt->index_tp_delta_m)) ||
-             ((ppt->has_source_theta_m == _TRUE_) && (index_tp == ppt->index_tp_theta_m)) ||
-             ((ppt->has_source_delta_cb == _TRUE_) && (index_tp == ppt->index_tp_delta_cb)) ||
-             ((ppt->has_source_theta_cb == _TRUE_) && (index_tp == ppt->index_tp_theta_cb)) ||
-             ((ppt->has_source_phi == _TRUE_) && (index_tp == ppt->index_tp_phi)) ||
-             ((ppt->has_source_phi_prime == _TRUE_) && (index_tp == ppt->index_tp_phi_prime)) ||
-             ((ppt->has_source_phi_plus_psi == _TRUE_) && (index_tp == ppt->index_tp_phi_plus_psi)) ||
-             ((ppt->has_source_psi == _TRUE_) && (index_tp == ppt->index_tp_psi)))) {
-
-          free(sources[index_md][index_ic * ppt->tp_size[index_md] + index_tp]);
-        }
-      }
-    }
     free(sources[index_md]);
+    free(nl_corrections[index_md]);
   }
   free(sources);
+  free(nl_corrections);
 
   return _SUCCESS_;
 }
@@ -1017,122 +1652,770 @@ int transfer_get_l_list(
 }
 
 /**
- * This routine defines the number and values of wavenumbers q for
- * each mode (goes smoothly from logarithmic step for small q's to
- * linear step for large q's).
+ * This routine returns the index of the field of the harmonic module
+ * to which a scalar transfer type contributes (temperature, E
+ * polarization, CMB lensing, then number count and lensing of each
+ * bin), such that the adaptive l sampling (ppr->transfer_l_adaptive)
+ * is the same for all the types combined by harmonic_compute_cl().
  *
- * @param ppr     Input: pointer to precision structure
- * @param ppt     Input: pointer to perturbation structure
- * @param ptr     Input/Output: pointer to transfer structure containing q's
- * @param q_period Input: order of magnitude of the oscillation period of transfer functions
- * @param K        Input: spatial curvature (in absolute value)
- * @param sgnK     Input: spatial curvature sign (open/closed/flat)
- * @return the error status
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input: pointer to transfer structure
+ * @param index_md Input: index of mode
+ * @param index_tt Input: index of type
+ * @return the index of the field, or -1 for the types of the other modes (always computed at all multipoles)
  */
 
-int transfer_get_q_list(
-                        struct precision * ppr,
-                        struct perturbations * ppt,
-                        struct transfer * ptr,
-                        double q_period,
-                        double K,
-                        int sgnK
-                        ) {
-
-  int index_q;
-  double q,q_min=0.,q_max=0.,q_step,k_max;
-  int nu, nu_min, nu_proposed;
-  int q_size_max;
-  double q_approximation;
-  double last_step=0.;
-  int last_index=0;
-  double q_logstep_spline;
-  double q_logstep_trapzd;
-  double q_threshold;
-  int index_md;
+int transfer_l_field(
+                     struct perturbations * ppt,
+                     struct transfer * ptr,
+                     int index_md,
+                     int index_tt
+                     ) {
 
-  /* first and last value in flat case*/
+  int bin = -1;
 
-  if (sgnK == 0) {
-    q_min = ppt->k_min;
+  if (!(_scalars_))
+    return -1;
 
-    q_max = 0.;
-    for (index_md=0; index_md<ppt->md_size; index_md++) {
-      q_max = MAX(q_max,ppt->k[index_md][ppt->k_size_cl[index_md]-1]);
-    }
+  if ((ppt->has_cl_cmb_temperature == _TRUE_) &&
+      ((index_tt == ptr->index_tt_t0) || (index_tt == ptr->index_tt_t1) || (index_tt == ptr->index_tt_t2)))
+    return 0;
 
-    K=0;
-  }
+  if ((ppt->has_cl_cmb_polarization == _TRUE_) && (index_tt == ptr->index_tt_e))
+    return 1;
 
-  /* first and last value in open case*/
+  if ((ppt->has_cl_cmb_lensing_potential == _TRUE_) && (index_tt == ptr->index_tt_lcmb))
+    return 2;
 
-  else if (sgnK == -1) {
-    q_min = sqrt(ppt->k_min*ppt->k_min+K);
+  if (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential))
+    return 3 + ppt->selection_num + index_tt - ptr->index_tt_lensing;
 
-    k_max = 0.;
-    for (index_md=0; index_md<ppt->md_size; index_md++) {
-      k_max = MAX(k_max,ppt->k[index_md][ppt->k_size_cl[index_md]-1]);
-    }
+  _get_bin_nonintegrated_ncl_(index_tt);
+  _get_bin_integrated_ncl_(index_tt);
 
-    q_max = sqrt(k_max*k_max+K);
-    if (ppt->has_vectors == _TRUE_)
-      q_max = MIN(q_max,sqrt(k_max*k_max+2.*K));
-    if (ppt->has_tensors == _TRUE_)
-      q_max = MIN(q_max,sqrt(k_max*k_max+3.*K));
-  }
+  return 3 + bin;
+}
 
-  /* first and last value in closed case*/
+/**
+ * This routine defines, in the adaptive l sampling
+ * (ppr->transfer_l_adaptive), the multipoles at which the transfer
+ * functions are first computed: for the scalar types, one value out
+ * of 2^ppr->transfer_l_adaptive_levels in the list of
+ * transfer_get_l_list(), and the last one needed by the type; for the
+ * other modes, all of them. The sampling is then refined by
+ * transfer_refine_l_list().
+ *
+ * @param ppr Input: pointer to precision structure
+ * @param ppt Input: pointer to perturbation structure
+ * @param ptr Input/Output: pointer to transfer structure (ptr->l_sampled allocated here, or set to NULL)
+ * @return the error status
+ */
 
-  else if (sgnK == 1) {
-    nu_min = 3;
-    q_min = nu_min * sqrt(K);
+int transfer_get_l_sampling(
+                            struct precision * ppr,
+                            struct perturbations * ppt,
+                            struct transfer * ptr
+                            ) {
 
-    q_max = 0.;
-    for (index_md=0; index_md<ppt->md_size; index_md++) {
-      q_max = MAX(q_max,ppt->k[index_md][ppt->k_size_cl[index_md]-1]);
-    }
-  }
+  int index_md;
+  int index_tt;
+  int index_l;
+  int l_step;
+  short * sampled;
 
-  /* adjust the parameter governing the log step size to curvature */
+  ptr->l_sampled = NULL;
 
-  q_logstep_spline = ppr->q_logstep_spline/pow(ptr->angular_rescaling,ppr->q_logstep_open);
-  q_logstep_trapzd = ppr->q_logstep_trapzd;
+  if (ppr->transfer_l_adaptive == _FALSE_)
+    return _SUCCESS_;
 
-  /* slightly conservative estimate of number of values */
+  class_test((ppr->transfer_l_adaptive_levels < 0) || (ppr->transfer_l_adaptive_levels > 10),
+             ptr->error_message,
+             "transfer_l_adaptive_levels = %d, should be between 0 and 10",
+             ppr->transfer_l_adaptive_levels);
 
-  // One can divide the q range into 3 regions:
-  // For q_threshold = q_linstep/q_logstep, we can show explicitly that
-  // If q<q_threshold , then delta q > q * (1+q_logstep/2)
-  // If q< N * q_threshold, then delta q > q + N/(N+1) * q_linstep
-  // It makes sense to combine the first range, with the second range for N=1,10,100,...
-  // In practice, we don't need percent level, so N=10 is sufficient
-  // The total formula then reads
-  // N_steps = ln(MIN(q_max,q_threshold)/q_min)/ln(1+b/2) + 18/q_logstep + 11/10 * (q_max-MIN(10 q_threshold, q_max))/(a)
-  // The additional MIN/MAX just catch cases where q_max < q_threshold
-  // The contribution from the term 18/q_logstep accounts for the range [q_threshold, 10 q_threshold], and in prinicple can be ignored when q_max < q_threshold, BUT
-  // since usually q_logstep is of order unity, we neglect this detail, simplifying our lives
-  // The +1 is just to always round up
-  if (sgnK == 1) {
+  l_step = 1 << ppr->transfer_l_adaptive_levels;
 
-    q_approximation = MIN(ppr->hyper_flat_approximation_nu,(q_max/sqrt(K)))*sqrt(K);
+  class_alloc(ptr->l_sampled,ptr->md_size*sizeof(short *),ptr->error_message);
 
-    /* max contribution from integer nu values */
-    q_threshold = ppr->q_linstep/q_logstep_trapzd;
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
 
-    q_step = 1.+0.5*q_period*q_logstep_trapzd;
-    q_size_max = (int)(log(MIN(q_approximation,q_threshold)/q_min)/log(q_step)+1);
+    class_alloc(ptr->l_sampled[index_md],ptr->tt_size[index_md]*ptr->l_size[index_md]*sizeof(short),ptr->error_message);
 
-    // Either linear q step OR AT LEAST delta nu = 1 until we reach the approximation/q_max
-    q_step = MAX(q_period*ppr->q_linstep, 1*sqrt(K));
-    q_size_max += (int)(1.1*(q_approximation-MIN(q_min,10*q_threshold))/q_step+18*q_threshold/q_step+1);
+    for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
 
-    /* max contribution from non-integer nu values */
-    q_threshold = ppr->q_linstep/q_logstep_spline;
+      sampled = ptr->l_sampled[index_md] + index_tt * ptr->l_size[index_md];
+
+      for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
+        sampled[index_l] = ((transfer_l_field(ppt,ptr,index_md,index_tt) == -1) ||
+                            (index_l % l_step == 0) ||
+                            (index_l >= ptr->l_size_tt[index_md][index_tt]-1)) ? _TRUE_ : _FALSE_;
+      }
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine refines the adaptive l sampling
+ * (ppr->transfer_l_adaptive), once the transfer functions have been
+ * computed for all the current multipoles.
+ *
+ * For each field of the harmonic module (see transfer_l_field()), the
+ * function \f$ \int \Delta_l(q)^2 d\ln q \f$, summed over initial
+ * conditions, is a proxy of the \f$ C_l \f$'s. Its values at the
+ * multipoles added at the previous level (the first time, at every
+ * other multipole) are compared to the spline interpolation of the
+ * values at the other multipoles. When the relative difference
+ * exceeds ppr->transfer_l_adaptive_tol, the two intervals around this
+ * multipole are bisected, within the list of transfer_get_l_list().
+ *
+ * Each field is refined on its own: the new multipoles are flagged
+ * for the types of this field only, in ptr->l_sampled and in
+ * *l_needed. The harmonic module computes the cross-spectra of two
+ * fields at the multipoles sampled for both of them.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input/Output: pointer to transfer structure
+ * @param l_needed Input/Output: flags of the multipoles added at the previous level (ptr->l_sampled the first time), replaced by those of the new multipoles
+ * @param l_new    Output: number of new multipoles, summed over the fields
+ * @return the error status
+ */
+
+int transfer_refine_l_list(
+                           struct precision * ppr,
+                           struct perturbations * ppt,
+                           struct transfer * ptr,
+                           short *** l_needed,
+                           int * l_new
+                           ) {
+
+  int index_md;
+  int index_ic;
+  int index_tt;
+  int index_l;
+  int index_q;
+  int index_f;
+  int index_prev;
+  int index_next;
+  int f_size;
+  int l_size;
+  int base_size;
+  int last_index;
+  short first_call;
+  short * f_sampled;
+  short * f_tested;
+  short * f_new;
+  int * f_of_tt;
+  int * f_l_size;
+  double * proxy;
+  double * field;
+  double * l_base;
+  double * proxy_base;
+  double * ddproxy_base;
+  double * trsf;
+  double weight, value;
+  short ** needed;
+
+  first_call = (*l_needed == ptr->l_sampled) ? _TRUE_ : _FALSE_;
+
+  class_alloc(needed,ptr->md_size*sizeof(short *),ptr->error_message);
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    class_calloc(needed[index_md],ptr->tt_size[index_md]*ptr->l_size[index_md],sizeof(short),ptr->error_message);
+  }
+
+  *l_new = 0;
+
+  if (ppt->has_scalars == _TRUE_) {
+
+    index_md = ppt->index_md_scalars;
+    l_size = ptr->l_size[index_md];
+    f_size = 3 + 2*ppt->selection_num;
+
+    class_calloc(f_sampled,f_size*l_size,sizeof(short),ptr->error_message);
+    class_calloc(f_tested,f_size*l_size,sizeof(short),ptr->error_message);
+    class_calloc(f_new,f_size*l_size,sizeof(short),ptr->error_message);
+    class_calloc(f_l_size,f_size,sizeof(int),ptr->error_message);
+    class_alloc(f_of_tt,ptr->tt_size[index_md]*sizeof(int),ptr->error_message);
+    class_calloc(proxy,f_size*l_size,sizeof(double),ptr->error_message);
+    class_alloc(field,ptr->q_size*sizeof(double),ptr->error_message);
+    class_alloc(l_base,l_size*sizeof(double),ptr->error_message);
+    class_alloc(proxy_base,l_size*sizeof(double),ptr->error_message);
+    class_alloc(ddproxy_base,l_size*sizeof(double),ptr->error_message);
+
+    /** - find the multipoles sampled and tested for each field (the same for all its types) */
+
+    for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+      index_f = transfer_l_field(ppt,ptr,index_md,index_tt);
+      f_of_tt[index_tt] = index_f;
+      if (index_f == -1)
+        continue;
+      f_l_size[index_f] = MAX(f_l_size[index_f],ptr->l_size_tt[index_md][index_tt]);
+      for (index_l = 0; index_l < l_size; index_l++) {
+        f_sampled[index_f*l_size+index_l] = ptr->l_sampled[index_md][index_tt*l_size+index_l];
+        if (first_call == _FALSE_)
+          f_tested[index_f*l_size+index_l] = (*l_needed)[index_md][index_tt*l_size+index_l];
+      }
+    }
+
+    /* the first time, the multipoles are tested against the list of every other one */
+    if (first_call == _TRUE_) {
+      for (index_f = 0; index_f < f_size; index_f++) {
+        base_size = 0;
+        for (index_l = 0; index_l < f_l_size[index_f]-1; index_l++) {
+          if (f_sampled[index_f*l_size+index_l] == _TRUE_) {
+            if (base_size % 2 == 1)
+              f_tested[index_f*l_size+index_l] = _TRUE_;
+            base_size++;
+          }
+        }
+      }
+    }
+
+    /** - compute the proxy of the C_l's of each field at the sampled multipoles */
+
+    for (index_l = 0; index_l < l_size; index_l++) {
+      for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+        for (index_f = 0; index_f < f_size; index_f++) {
+
+          if ((index_l >= f_l_size[index_f]) || (f_sampled[index_f*l_size+index_l] == _FALSE_))
+            continue;
+
+          for (index_q = 0; index_q < ptr->q_size; index_q++)
+            field[index_q] = 0.;
+
+          for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+            if (f_of_tt[index_tt] != index_f)
+              continue;
+            /* like in harmonic_compute_cl() */
+            weight = 1.;
+            if (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens))
+              weight = (double)ptr->l[index_l]*(ptr->l[index_l]+1.);
+            trsf = ptr->transfer[index_md] + ((index_ic * ptr->tt_size[index_md] + index_tt) * l_size + index_l) * ptr->q_size;
+            for (index_q = 0; index_q < ptr->q_size; index_q++)
+              field[index_q] += weight * trsf[index_q];
+          }
+
+          for (index_q = 0; index_q < ptr->q_size-1; index_q++) {
+            proxy[index_f*l_size+index_l] += 0.5 * (field[index_q]*field[index_q] + field[index_q+1]*field[index_q+1])
+              * log(ptr->q[index_q+1]/ptr->q[index_q]);
+          }
+        }
+      }
+    }
+
+    /** - compare the proxy at the tested multipoles with its spline
+          interpolation between the others. The proxy is positive and
+          spans several decades over the logarithmically spaced
+          multipoles, so the spline is done in log-log space, where the
+          difference is the relative error on the proxy. */
+
+    for (index_f = 0; index_f < f_size; index_f++) {
+
+      base_size = 0;
+      for (index_l = 0; index_l < f_l_size[index_f]; index_l++) {
+        if ((f_sampled[index_f*l_size+index_l] == _TRUE_) && (f_tested[index_f*l_size+index_l] == _FALSE_)) {
+          l_base[base_size] = log((double)ptr->l[index_l]);
+          proxy_base[base_size] = log(MAX(proxy[index_f*l_size+index_l],DBL_MIN));
+          base_size++;
+        }
+      }
+
+      if (base_size >= 3) {
+        class_call(array_spline_table_lines(l_base,
+                                            base_size,
+                                            proxy_base,
+                                            1,
+                                            ddproxy_base,
+                                            _SPLINE_EST_DERIV_,
+                                            ptr->error_message),
+                   ptr->error_message,
+                   ptr->error_message);
+      }
+
+      last_index = 0;
+
+      for (index_l = 0; index_l < f_l_size[index_f]; index_l++) {
+
+        if (f_tested[index_f*l_size+index_l] == _FALSE_)
+          continue;
+
+        /* with too few other multipoles, always bisect */
+        if (base_size >= 3) {
+          class_call(array_interpolate_spline(l_base,
+                                              base_size,
+                                              proxy_base,
+                                              ddproxy_base,
+                                              1,
+                                              log((double)ptr->l[index_l]),
+                                              &last_index,
+                                              &value,
+                                              1,
+                                              ptr->error_message),
+                     ptr->error_message,
+                     ptr->error_message);
+
+          if (fabs(value-log(MAX(proxy[index_f*l_size+index_l],DBL_MIN))) <= ppr->transfer_l_adaptive_tol)
+            continue;
+        }
+
+        /* bisect the intervals between the previous and next sampled multipoles */
+        for (index_prev = index_l-1; (index_prev > 0) && (f_sampled[index_f*l_size+index_prev] == _FALSE_); index_prev--);
+        for (index_next = index_l+1; (index_next < f_l_size[index_f]-1) && (f_sampled[index_f*l_size+index_next] == _FALSE_); index_next++);
+
+        if ((index_prev >= 0) && (index_l-index_prev >= 2))
+          f_new[index_f*l_size+(index_prev+index_l)/2] = _TRUE_;
+        if ((index_next < f_l_size[index_f]) && (index_next-index_l >= 2))
+          f_new[index_f*l_size+(index_l+index_next)/2] = _TRUE_;
+      }
+    }
+
+    for (index_l = 0; index_l < f_size*l_size; index_l++) {
+      if (f_new[index_l] == _TRUE_)
+        (*l_new)++;
+    }
+
+    /** - flag the new multipoles for all the types of each field */
+
+    for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+      index_f = f_of_tt[index_tt];
+      if (index_f == -1)
+        continue;
+      for (index_l = 0; index_l < l_size; index_l++) {
+        if (f_new[index_f*l_size+index_l] == _TRUE_) {
+          needed[index_md][index_tt*l_size+index_l] = _TRUE_;
+          ptr->l_sampled[index_md][index_tt*l_size+index_l] = _TRUE_;
+        }
+      }
+    }
+
+    free(f_sampled);
+    free(f_tested);
+    free(f_new);
+    free(f_l_size);
+    free(f_of_tt);
+    free(proxy);
+    free(field);
+    free(l_base);
+    free(proxy_base);
+    free(ddproxy_base);
+  }
+
+  if (first_call == _FALSE_) {
+    for (index_md = 0; index_md < ptr->md_size; index_md++)
+      free((*l_needed)[index_md]);
+    free(*l_needed);
+  }
+  *l_needed = needed;
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine prepares, in the adaptive l sampling
+ * (ppr->transfer_l_adaptive), the cache of the sources of the scalar
+ * transfer functions. The sources of each wavenumber are interpolated
+ * from the perturbation module and resampled by transfer_sources()
+ * during the first pass, and read back from the cache during the
+ * passes over the new multipoles.
+ *
+ * Only the types with multipoles still to be computed are kept, in
+ * their order, within ppr->transfer_l_adaptive_cache_size: the others
+ * are resampled at each pass. The time sampling of the types kept does
+ * not depend on the wavenumber, and is computed here once for all.
+ *
+ * @param ppr          Input: pointer to precision structure
+ * @param pba          Input: pointer to background structure
+ * @param ppt          Input: pointer to perturbation structure
+ * @param ptr          Input: pointer to transfer structure
+ * @param tau_rec      Input: recombination time
+ * @param window       Input: window functions of the number count and lensing types
+ * @param tau_size_max Input: maximum number of times of the sources
+ * @param psc          Output: pointer to the cache
+ * @return the error status
+ */
+
+int transfer_sources_cache_init(
+                                struct precision * ppr,
+                                struct background * pba,
+                                struct perturbations * ppt,
+                                struct transfer * ptr,
+                                double tau_rec,
+                                double * window,
+                                int tau_size_max,
+                                struct transfer_sources_cache * psc
+                                ) {
+
+  int index_md;
+  int index_ic;
+  int index_tt;
+  int index_l;
+  int index_q;
+  double * interpolated_sources;
+  double * sources;
+  short has_l_left;
+  double size, size_max;
+  int kept_size;
+
+  index_md = ppt->index_md_scalars;
+
+  psc->index_md = index_md;
+  psc->tt_size = ptr->tt_size[index_md];
+  psc->ic_tt_size = ppt->ic_size[index_md]*psc->tt_size;
+  psc->q_size = ptr->q_size;
+
+  class_calloc(psc->kept,psc->ic_tt_size,sizeof(short),ptr->error_message);
+  class_calloc(psc->tau_size,psc->tt_size,sizeof(int),ptr->error_message);
+  class_calloc(psc->tau0_minus_tau,psc->tt_size,sizeof(double *),ptr->error_message);
+  class_calloc(psc->w_trapz,psc->tt_size,sizeof(double *),ptr->error_message);
+
+  /* the time sampling is that of transfer_sources(), whatever the
+     values of the sources and of k */
+  class_calloc(interpolated_sources,ppt->tau_size,sizeof(double),ptr->error_message);
+  class_alloc(sources,tau_size_max*sizeof(double),ptr->error_message);
+
+  size = 0.;
+  size_max = ppr->transfer_l_adaptive_cache_size*1024.*1024./sizeof(double);
+  kept_size = 0;
+
+  for (index_tt = 0; index_tt < psc->tt_size; index_tt++) {
+
+    if (transfer_l_field(ppt,ptr,index_md,index_tt) == -1)
+      continue;
+
+    has_l_left = _FALSE_;
+    for (index_l = 0; index_l < ptr->l_size_tt[index_md][index_tt]; index_l++) {
+      if (ptr->l_sampled[index_md][index_tt*ptr->l_size[index_md]+index_l] == _FALSE_)
+        has_l_left = _TRUE_;
+    }
+    if (has_l_left == _FALSE_)
+      continue;
+
+    /* keep the types in their order, as long as they fit in
+       ppr->transfer_l_adaptive_cache_size */
+    class_call(transfer_source_tau_size(ppr,pba,ppt,ptr,tau_rec,pba->conformal_age,index_md,index_tt,&(psc->tau_size[index_tt])),
+               ptr->error_message,
+               ptr->error_message);
+
+    if (size + (double)psc->q_size*ppt->ic_size[index_md]*psc->tau_size[index_tt] > size_max)
+      continue;
+
+    size += (double)psc->q_size*ppt->ic_size[index_md]*psc->tau_size[index_tt];
+    kept_size++;
+
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++)
+      psc->kept[index_ic*psc->tt_size+index_tt] = _TRUE_;
+
+    class_alloc(psc->tau0_minus_tau[index_tt],tau_size_max*sizeof(double),ptr->error_message);
+    class_alloc(psc->w_trapz[index_tt],tau_size_max*sizeof(double),ptr->error_message);
+
+    class_call(transfer_sources(ppr,
+                                pba,
+                                ppt,
+                                ptr,
+                                interpolated_sources,
+                                tau_rec,
+                                ptr->k[index_md][0],
+                                index_md,
+                                index_tt,
+                                sources,
+                                window,
+                                tau_size_max,
+                                psc->tau0_minus_tau[index_tt],
+                                psc->w_trapz[index_tt],
+                                &(psc->tau_size[index_tt])),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
+  free(interpolated_sources);
+  free(sources);
+
+  if (ptr->transfer_verbose > 1)
+    printf(" -> adaptive l sampling: sources of %d types kept between the passes (%.0f MB)\n",
+           kept_size,size*sizeof(double)/1024./1024.);
+
+  class_alloc(psc->sources,psc->q_size*sizeof(double **),ptr->error_message);
+  for (index_q = 0; index_q < psc->q_size; index_q++) {
+    class_calloc(psc->sources[index_q],psc->ic_tt_size,sizeof(double *),ptr->error_message);
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine frees, after each refinement of the adaptive l
+ * sampling, the cached sources of the types without any new
+ * multipole, which are not computed anymore.
+ *
+ * @param ptr      Input: pointer to transfer structure
+ * @param l_needed Input: flags of the multipoles of the next pass
+ * @param psc      Input/Output: pointer to the cache
+ * @return the error status
+ */
+
+int transfer_sources_cache_release(
+                                   struct transfer * ptr,
+                                   short ** l_needed,
+                                   struct transfer_sources_cache * psc
+                                   ) {
+
+  int index_ic_tt;
+  int index_tt;
+  int index_l;
+  int index_q;
+
+  for (index_ic_tt = 0; index_ic_tt < psc->ic_tt_size; index_ic_tt++) {
+
+    if (psc->kept[index_ic_tt] == _FALSE_)
+      continue;
+
+    index_tt = index_ic_tt % psc->tt_size;
+
+    for (index_l = 0; index_l < ptr->l_size[psc->index_md]; index_l++) {
+      if (l_needed[psc->index_md][index_tt*ptr->l_size[psc->index_md]+index_l] == _TRUE_)
+        break;
+    }
+    if (index_l < ptr->l_size[psc->index_md])
+      continue;
+
+    psc->kept[index_ic_tt] = _FALSE_;
+    for (index_q = 0; index_q < psc->q_size; index_q++) {
+      free(psc->sources[index_q][index_ic_tt]);
+      psc->sources[index_q][index_ic_tt] = NULL;
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine frees the cache of the sources of the adaptive l
+ * sampling.
+ *
+ * @param psc Input: pointer to the cache
+ * @return the error status
+ */
+
+int transfer_sources_cache_free(
+                                struct transfer_sources_cache * psc
+                                ) {
+
+  int index_ic_tt;
+  int index_tt;
+  int index_q;
+
+  for (index_q = 0; index_q < psc->q_size; index_q++) {
+    for (index_ic_tt = 0; index_ic_tt < psc->ic_tt_size; index_ic_tt++)
+      free(psc->sources[index_q][index_ic_tt]);
+    free(psc->sources[index_q]);
+  }
+  free(psc->sources);
+
+  for (index_tt = 0; index_tt < psc->tt_size; index_tt++) {
+    free(psc->tau0_minus_tau[index_tt]);
+    free(psc->w_trapz[index_tt]);
+  }
+  free(psc->tau0_minus_tau);
+  free(psc->w_trapz);
+  free(psc->tau_size);
+  free(psc->kept);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine defines the number and values of wavenumbers q for
+ * each mode (goes smoothly from logarithmic step for small q's to
+ * linear step for large q's).
+ *
+ * If ppr->transfer_q_list_cache is set and ppr->transfer_q_list_file
+ * exists, the values are instead read from this file (rescaled by the
+ * ratio of q_period to the one of the run that wrote the file, which
+ * is exactly one for the same cosmology), and only extended with the
+ * usual steps if the file does not reach q_max. If ppr->transfer_q_adaptive is set, the steps are
+ * coarsened, the list being refined later by transfer_refine_q_list().
+ *
+ * @param ppr     Input: pointer to precision structure
+ * @param ppt     Input: pointer to perturbation structure
+ * @param ptr     Input/Output: pointer to transfer structure containing q's
+ * @param q_period Input: order of magnitude of the oscillation period of transfer functions
+ * @param K        Input: spatial curvature (in absolute value)
+ * @param sgnK     Input: spatial curvature sign (open/closed/flat)
+ * @return the error status
+ */
+
+int transfer_get_q_list(
+                        struct precision * ppr,
+                        struct perturbations * ppt,
+                        struct transfer * ptr,
+                        double q_period,
+                        double K,
+                        int sgnK
+                        ) {
+
+  int index_q;
+  double q,q_min=0.,q_max=0.,q_step,k_max;
+  int nu, nu_min, nu_proposed;
+  int q_size_max;
+  double q_approximation;
+  double last_step=0.;
+  int last_index=0;
+  double q_logstep_spline;
+  double q_logstep_trapzd;
+  double q_threshold;
+  double q_linstep;
+  int index_md;
+  FILE * q_file;
+  double * q_from_file = NULL;
+  int q_file_size = 0;
+  int index_file;
+  double x;
+  double q_period_file = 0.;
+  char line[_LINE_LENGTH_MAX_];
+
+  /* first and last value in flat case*/
+
+  if (sgnK == 0) {
+    q_min = ppt->k_min;
+
+    q_max = 0.;
+    for (index_md=0; index_md<ppt->md_size; index_md++) {
+      q_max = MAX(q_max,ppt->k[index_md][ppt->k_size_cl[index_md]-1]);
+    }
+
+    K=0;
+  }
+
+  /* first and last value in open case*/
+
+  else if (sgnK == -1) {
+    q_min = sqrt(ppt->k_min*ppt->k_min+K);
+
+    k_max = 0.;
+    for (index_md=0; index_md<ppt->md_size; index_md++) {
+      k_max = MAX(k_max,ppt->k[index_md][ppt->k_size_cl[index_md]-1]);
+    }
+
+    q_max = sqrt(k_max*k_max+K);
+    if (ppt->has_vectors == _TRUE_)
+      q_max = MIN(q_max,sqrt(k_max*k_max+2.*K));
+    if (ppt->has_tensors == _TRUE_)
+      q_max = MIN(q_max,sqrt(k_max*k_max+3.*K));
+  }
+
+  /* first and last value in closed case*/
+
+  else if (sgnK == 1) {
+    nu_min = 3;
+    q_min = nu_min * sqrt(K);
+
+    q_max = 0.;
+    for (index_md=0; index_md<ppt->md_size; index_md++) {
+      q_max = MAX(q_max,ppt->k[index_md][ppt->k_size_cl[index_md]-1]);
+    }
+  }
+
+  /* adjust the parameter governing the log step size to curvature */
+
+  q_logstep_spline = ppr->q_logstep_spline/pow(ptr->angular_rescaling,ppr->q_logstep_open);
+  q_logstep_trapzd = ppr->q_logstep_trapzd;
+  q_linstep = ppr->q_linstep;
+
+  /* eventually read the list of a previous run */
+
+  ptr->q_list_from_file = _FALSE_;
+
+  if ((ppr->transfer_q_list_cache == _TRUE_) && (file_exists(ppr->transfer_q_list_file) == _TRUE_)) {
+
+    class_test(sgnK == 1,
+               ptr->error_message,
+               "the list of q values cannot be read from a file in the closed case, where it depends on the integer values of nu");
+
+    /* the first number is the q_period of the run that wrote the
+       file, followed by its values of q */
+    class_open(q_file,ppr->transfer_q_list_file,"r",ptr->error_message);
+    while (fgets(line,_LINE_LENGTH_MAX_,q_file) != NULL) {
+      if ((line[0] == '#') || (sscanf(line,"%lf",&x) != 1))
+        continue;
+      if (q_period_file == 0.) {
+        q_period_file = x;
+        continue;
+      }
+      class_realloc(q_from_file,(q_file_size+1)*sizeof(double),ptr->error_message);
+      q_from_file[q_file_size] = x;
+      q_file_size++;
+    }
+    fclose(q_file);
+
+    class_test(q_period_file <= 0.,
+               ptr->error_message,
+               "could not read the oscillation period in %s",ppr->transfer_q_list_file);
+
+    /* for the same cosmology, the ratio is exactly one and the values
+       are those of the run that wrote the file, bit for bit */
+    for (index_file = 0; index_file < q_file_size; index_file++)
+      q_from_file[index_file] *= q_period/q_period_file;
+
+    ptr->q_list_from_file = _TRUE_;
+
+    if (ptr->transfer_verbose > 1)
+      printf(" -> read %d values of q from %s\n",q_file_size,ppr->transfer_q_list_file);
+  }
+
+  /* in the adaptive scheme, start from coarser steps */
+
+  else if (ppr->transfer_q_adaptive == _TRUE_) {
+
+    class_test(sgnK == 1,
+               ptr->error_message,
+               "the adaptive q sampling is not implemented in the closed case, where q values are rounded to integer values of nu");
+
+    q_linstep *= ppr->transfer_q_adaptive_coarsening;
+    q_logstep_spline *= ppr->transfer_q_adaptive_coarsening;
+  }
+
+  /* slightly conservative estimate of number of values */
+
+  // One can divide the q range into 3 regions:
+  // For q_threshold = q_linstep/q_logstep, we can show explicitly that
+  // If q<q_threshold , then delta q > q * (1+q_logstep/2)
+  // If q< N * q_threshold, then delta q > q + N/(N+1) * q_linstep
+  // It makes sense to combine the first range, with the second range for N=1,10,100,...
+  // In practice, we don't need percent level, so N=10 is sufficient
+  // The total formula then reads
+  // N_steps = ln(MIN(q_max,q_threshold)/q_min)/ln(1+b/2) + 18/q_logstep + 11/10 * (q_max-MIN(10 q_threshold, q_max))/(a)
+  // The additional MIN/MAX just catch cases where q_max < q_threshold
+  // The contribution from the term 18/q_logstep accounts for the range [q_threshold, 10 q_threshold], and in prinicple can be ignored when q_max < q_threshold, BUT
+  // since usually q_logstep is of order unity, we neglect this detail, simplifying our lives
+  // The +1 is just to always round up
+  if (sgnK == 1) {
+
+    q_approximation = MIN(ppr->hyper_flat_approximation_nu,(q_max/sqrt(K)))*sqrt(K);
+
+    /* max contribution from integer nu values */
+    q_threshold = q_linstep/q_logstep_trapzd;
+
+    q_step = 1.+0.5*q_period*q_logstep_trapzd;
+    q_size_max = (int)(log(MIN(q_approximation,q_threshold)/q_min)/log(q_step)+1);
+
+    // Either linear q step OR AT LEAST delta nu = 1 until we reach the approximation/q_max
+    q_step = MAX(q_period*q_linstep, 1*sqrt(K));
+    q_size_max += (int)(1.1*(q_approximation-MIN(q_min,10*q_threshold))/q_step+18*q_threshold/q_step+1);
+
+    /* max contribution from non-integer nu values */
+    q_threshold = q_linstep/q_logstep_spline;
 
     q_step = 1.+0.5*q_period*q_logstep_spline;
     q_size_max += (int)(log(MIN(q_max, q_threshold)/q_approximation)/log(q_step)+1);
 
-    q_step = q_period*ppr->q_linstep;
+    q_step = q_period*q_linstep;
     q_size_max += (int)(1.1*(q_max-MIN(q_max, 10*q_threshold))/q_step+18*q_threshold/q_step+1);
 
     /* Make a final maximum with a very large number -- 2^25 (~3*10^7)
@@ -1144,16 +2427,20 @@ int transfer_get_q_list(
   else {
 
     /* max contribution from non-integer nu values */
-    q_threshold = ppr->q_linstep/q_logstep_spline;
+    q_threshold = q_linstep/q_logstep_spline;
 
     q_step = 1.+0.5*q_period*q_logstep_spline;
     q_size_max = (int)(log(MIN(q_max, q_threshold)/q_min)/log(q_step)+1);
 
-    q_step = q_period*ppr->q_linstep;
+    q_step = q_period*q_linstep;
     q_size_max += (int)(1.1*(q_max-MIN(q_max, 10*q_threshold))/q_step+18*q_threshold/q_step+1);
 
   }
 
+  /* values read from a file come on top of this estimate */
+
+  q_size_max += q_file_size;
+
   /* create array with this conservative size estimate. The exact size
      will be readjusted below, after filling the array. */
 
@@ -1168,6 +2455,16 @@ int transfer_get_q_list(
   nu = 3;
   index_q++;
 
+  /* then the values read from a file, within the range (q_min, q_max] */
+
+  for (index_file = 0; index_file < q_file_size; index_file++) {
+    if ((q_from_file[index_file] > ptr->q[index_q-1]) && (q_from_file[index_file] <= q_max)) {
+      ptr->q[index_q] = q_from_file[index_file];
+      index_q++;
+    }
+  }
+  free(q_from_file);
+
   /* loop over the values */
 
   while (ptr->q[index_q-1] < q_max) {
@@ -1181,14 +2478,14 @@ int transfer_get_q_list(
        q_period * q_logstep_spline
 
        - in the large q limit, it is linear with: (delta q) = q_period
-       * ppr->q_linstep
+       * q_linstep
        */
 
     if (sgnK<=0) {
 
       q = ptr->q[index_q-1]
-        + q_period * ppr->q_linstep * ptr->q[index_q-1]
-        / (ptr->q[index_q-1] + ppr->q_linstep/q_logstep_spline);
+        + q_period * q_linstep * ptr->q[index_q-1]
+        / (ptr->q[index_q-1] + q_linstep/q_logstep_spline);
 
     }
 
@@ -1209,8 +2506,8 @@ int transfer_get_q_list(
       if (nu < (int)ppr->hyper_flat_approximation_nu) {
 
         q = ptr->q[index_q-1]
-          + q_period * ppr->q_linstep * ptr->q[index_q-1]
-          / (ptr->q[index_q-1] + ppr->q_linstep/q_logstep_trapzd);
+          + q_period * q_linstep * ptr->q[index_q-1]
+          / (ptr->q[index_q-1] + q_linstep/q_logstep_trapzd);
 
         nu_proposed = (int)(q/sqrt(K));
         if (nu_proposed <= nu+1)
@@ -1224,7 +2521,7 @@ int transfer_get_q_list(
       }
       else {
 
-        q_step = q_period * ppr->q_linstep * ptr->q[index_q-1] / (ptr->q[index_q-1] + ppr->q_linstep/q_logstep_spline);
+        q_step = q_period * q_linstep * ptr->q[index_q-1] / (ptr->q[index_q-1] + q_linstep/q_logstep_spline);
 
         if (index_q-last_index < (int)ppr->q_numstep_transition)
           q = ptr->q[index_q-1] + (1-(double)(index_q-last_index)/ppr->q_numstep_transition) * last_step + (double)(index_q-last_index)/ppr->q_numstep_transition * q_step;
@@ -1239,43 +2536,382 @@ int transfer_get_q_list(
 
   /* infer total number of values (also checking if we overshot the last point) */
 
-  if (ptr->q[index_q-1] > q_max)
-    ptr->q_size=index_q-1;
-  else
-    ptr->q_size=index_q;
+  if (ptr->q[index_q-1] > q_max) {
+    /* with coarse steps, the last interval would be too large to be dropped: end exactly at q_max */
+    if ((ppr->transfer_q_adaptive == _TRUE_) && (ptr->q_list_from_file == _FALSE_)) {
+      ptr->q[index_q-1] = q_max;
+      ptr->q_size=index_q;
+    }
+    else {
+      ptr->q_size=index_q-1;
+    }
+  }
+  else
+    ptr->q_size=index_q;
+
+  class_test(ptr->q_size<2,ptr->error_message,"buggy q-list definition");
+
+  /* now, readjust array size */
+
+  class_realloc(ptr->q,
+                ptr->q_size*sizeof(double),
+                ptr->error_message);
+
+  /* in curved universe, check at which index the flat rescaling
+     approximation will start being used */
+
+  class_call(transfer_get_q_flat_approximation(ppr,ptr,K,sgnK),
+             ptr->error_message,
+             ptr->error_message);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine finds, in curved universes, the index of the first
+ * value of q for which the flat rescaling approximation is used.
+ *
+ * @param ppr     Input: pointer to precision structure
+ * @param ptr     Input/Output: pointer to transfer structure containing q's
+ * @param K       Input: spatial curvature (in absolute value)
+ * @param sgnK    Input: spatial curvature sign (open/closed/flat)
+ * @return the error status
+ */
+
+int transfer_get_q_flat_approximation(
+                                      struct precision * ppr,
+                                      struct transfer * ptr,
+                                      double K,
+                                      int sgnK
+                                      ) {
+
+  double q_approximation;
+
+  if (sgnK != 0) {
+
+    q_approximation = ppr->hyper_flat_approximation_nu * sqrt(sgnK*K);
+    /* If q_approximation >= q_max, we can skip any computation and conclude we cannot do an approximation */
+    if(q_approximation < ptr->q[ptr->q_size-1]){
+      /* Otherwise, just find the first index at which the approximation would break */
+      for (ptr->index_q_flat_approximation=0;
+           ptr->index_q_flat_approximation < ptr->q_size-1;
+           ptr->index_q_flat_approximation++) {
+        if (ptr->q[ptr->index_q_flat_approximation] > q_approximation) break;
+      }
+      if (ptr->transfer_verbose > 1)
+        printf("Flat bessel approximation spares hyperspherical bessel computations for %zu wavenumbers over a total of %zu\n",
+               ptr->q_size-ptr->index_q_flat_approximation,ptr->q_size);
+    }
+    else{
+      ptr->index_q_flat_approximation = ptr->q_size;
+      if (ptr->transfer_verbose > 1)
+        printf("Cannot use flat bessel approximation, since q_max = %.5e > q_start_approximation = %.5e\n", ptr->q[ptr->q_size-1], q_approximation);
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine is called by transfer_refine_q_list() for one function
+ * \f$ \Delta_l(q) \f$ (or a sum of them) sampled on the current
+ * list of q values. The change of the trapezoidal integral of
+ * \f$ \Delta_l(q)^2 \f$ over \f$ \ln q \f$ brought by the values
+ * added at the previous level is, by Richardson extrapolation, three
+ * times the error of the current integral. If this error exceeds
+ * ppr->transfer_q_adaptive_tol times the integral, the intervals with
+ * the largest contributions to the error are flagged for bisection.
+ *
+ * @param ppr             Input: pointer to precision structure
+ * @param ptr             Input: pointer to transfer structure
+ * @param trsf            Input: function sampled at each q
+ * @param q_size          Input: current number of q values
+ * @param q_needed        Input: flags of the values added at the previous level
+ * @param bisection_error Input: workspace of size q_size
+ * @param bisect          Input/Output: flags of the intervals to bisect
+ * @return the error status
+ */
+
+int transfer_q_bisection_test(
+                              struct precision * ppr,
+                              struct transfer * ptr,
+                              double * trsf,
+                              int q_size,
+                              short * q_needed,
+                              double * bisection_error,
+                              short * bisect
+                              ) {
+
+  int index_q;
+  double norm, error, f_a, f_m, f_b;
+
+  norm = 0.;
+  for (index_q = 0; index_q < q_size-1; index_q++) {
+    norm += 0.5 * (trsf[index_q]*trsf[index_q] + trsf[index_q+1]*trsf[index_q+1])
+      * log(ptr->q[index_q+1]/ptr->q[index_q]);
+  }
+
+  error = 0.;
+  for (index_q = 1; index_q < q_size-1; index_q++) {
+    if (q_needed[index_q] == _TRUE_) {
+      f_a = trsf[index_q-1]*trsf[index_q-1];
+      f_m = trsf[index_q]*trsf[index_q];
+      f_b = trsf[index_q+1]*trsf[index_q+1];
+      bisection_error[index_q] =
+        (0.5 * (f_a + f_m) * log(ptr->q[index_q]/ptr->q[index_q-1])
+         + 0.5 * (f_m + f_b) * log(ptr->q[index_q+1]/ptr->q[index_q])
+         - 0.5 * (f_a + f_b) * log(ptr->q[index_q+1]/ptr->q[index_q-1]))/3.;
+      error += bisection_error[index_q];
+    }
+  }
+
+  if (fabs(error) <= ppr->transfer_q_adaptive_tol * norm)
+    return _SUCCESS_;
+
+  for (index_q = 1; index_q < q_size-1; index_q++) {
+    if ((q_needed[index_q] == _TRUE_) &&
+        (fabs(bisection_error[index_q]) > ppr->transfer_q_adaptive_tol * norm)) {
+      bisect[index_q-1] = _TRUE_;
+      bisect[index_q] = _TRUE_;
+    }
+  }
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine refines the list of q values in the adaptive scheme
+ * (ppr->transfer_q_adaptive), once the transfer functions have been
+ * computed for all the current values.
+ *
+ * The first time (*q_needed is NULL), the integrals of
+ * \f$ \Delta_l(q)^2 \f$ over \f$ \ln q \f$ are compared to those
+ * obtained with every other value of q; in the next calls, to those
+ * obtained without the values added at the previous level (see
+ * transfer_q_bisection_test()). When the error is too large for at
+ * least one mode, initial condition, type and multipole, the
+ * intervals contributing most to it are bisected.
+ *
+ * New values are inserted in ptr->q and ptr->k, the arrays of
+ * transfer functions are enlarged accordingly (keeping the values
+ * already computed), and the new values are flagged in *q_needed.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input/Output: pointer to transfer structure containing q's
+ * @param K        Input: spatial curvature (in absolute value)
+ * @param sgnK     Input: spatial curvature sign (open/closed/flat)
+ * @param q_needed Input/Output: flags of the values added at the previous level (or NULL the first time), replaced by those of the new values
+ * @param q_new    Output: number of new values
+ * @return the error status
+ */
+
+int transfer_refine_q_list(
+                           struct precision * ppr,
+                           struct perturbations * ppt,
+                           struct transfer * ptr,
+                           double K,
+                           int sgnK,
+                           short ** q_needed,
+                           int * q_new
+                           ) {
+
+  int index_md;
+  int index_ic;
+  int index_tt;
+  int index_l;
+  int index_row;
+  int row_size;
+  int index_q;
+  int index_new;
+  size_t q_size_old;
+  short * bisect;
+  int * index_of_old;
+  double * q_old;
+  double * transfer_old;
+  double * bisection_error;
+  double * temperature;
+
+  q_size_old = ptr->q_size;
+
+  /* transfer function of given mode, initial condition, type and multipole, as a function of q */
+#define _transfer_row_(index_md,index_ic,index_tt,index_l) \
+  (ptr->transfer[index_md] + ((index_ic * ptr->tt_size[index_md] + index_tt) * ptr->l_size[index_md] + index_l) * q_size_old)
+
+  /** - decide which intervals [q[index_q], q[index_q+1]] must be bisected */
+
+  class_calloc(bisect,q_size_old-1,sizeof(short),ptr->error_message);
+
+  /* the first time, the errors are estimated with respect to the
+     list of every other value */
+  if (*q_needed == NULL) {
+    class_calloc(*q_needed,q_size_old,sizeof(short),ptr->error_message);
+    for (index_q = 1; index_q < q_size_old-1; index_q += 2)
+      (*q_needed)[index_q] = _TRUE_;
+  }
+
+  class_alloc(bisection_error,q_size_old*sizeof(double),ptr->error_message);
+  class_alloc(temperature,q_size_old*sizeof(double),ptr->error_message);
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+
+    for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+
+      for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
+
+        /* the harmonic module only uses the sum of the temperature
+           terms j=0,1,2: test their sum rather than each of them */
+        if (ppt->has_cl_cmb_temperature == _TRUE_) {
+
+          for (index_q = 0; index_q < q_size_old; index_q++) {
+            temperature[index_q] = _transfer_row_(index_md,index_ic,ptr->index_tt_t2,index_l)[index_q];
+            if (_scalars_)
+              temperature[index_q] += _transfer_row_(index_md,index_ic,ptr->index_tt_t0,index_l)[index_q];
+            if (_scalars_ || _vectors_)
+              temperature[index_q] += _transfer_row_(index_md,index_ic,ptr->index_tt_t1,index_l)[index_q];
+          }
+
+          class_call(transfer_q_bisection_test(ppr,ptr,temperature,q_size_old,*q_needed,bisection_error,bisect),
+                     ptr->error_message,
+                     ptr->error_message);
+        }
+
+        for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+
+          if ((ppt->has_cl_cmb_temperature == _TRUE_) &&
+              ((index_tt == ptr->index_tt_t2) ||
+               (_scalars_ && (index_tt == ptr->index_tt_t0)) ||
+               ((_scalars_ || _vectors_) && (index_tt == ptr->index_tt_t1))))
+            continue;
+
+          class_call(transfer_q_bisection_test(ppr,ptr,_transfer_row_(index_md,index_ic,index_tt,index_l),q_size_old,*q_needed,bisection_error,bisect),
+                     ptr->error_message,
+                     ptr->error_message);
+        }
+      }
+    }
+  }
+
+  free(temperature);
+  free(bisection_error);
+  free(*q_needed);
+
+#undef _transfer_row_
+
+  *q_new = 0;
+  for (index_q = 0; index_q < q_size_old-1; index_q++) {
+    if (bisect[index_q] == _TRUE_)
+      (*q_new)++;
+  }
+
+  /** - insert the middle of these intervals in the list of q values */
+
+  class_alloc(index_of_old,q_size_old*sizeof(int),ptr->error_message);
+  class_calloc(*q_needed,q_size_old+(*q_new),sizeof(short),ptr->error_message);
+
+  q_old = ptr->q;
+  ptr->q_size = q_size_old + (*q_new);
+  class_alloc(ptr->q,ptr->q_size*sizeof(double),ptr->error_message);
+
+  index_new = 0;
+  for (index_q = 0; index_q < q_size_old; index_q++) {
+    index_of_old[index_q] = index_new;
+    ptr->q[index_new] = q_old[index_q];
+    index_new++;
+    if ((index_q < q_size_old-1) && (bisect[index_q] == _TRUE_)) {
+      ptr->q[index_new] = 0.5*(q_old[index_q]+q_old[index_q+1]);
+      (*q_needed)[index_new] = _TRUE_;
+      index_new++;
+    }
+  }
+
+  free(q_old);
+  free(bisect);
+
+  /** - enlarge the arrays of transfer functions, keeping the values already computed */
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+
+    row_size = ppt->ic_size[index_md] * ptr->tt_size[index_md] * ptr->l_size[index_md];
+
+    transfer_old = ptr->transfer[index_md];
+
+    class_alloc_large(ptr->transfer[index_md],
+                      row_size * ptr->q_size * sizeof(double),
+                      ptr->error_message);
+    memset(ptr->transfer[index_md],0,row_size * ptr->q_size * sizeof(double));
+
+    for (index_row = 0; index_row < row_size; index_row++) {
+      for (index_q = 0; index_q < q_size_old; index_q++) {
+        ptr->transfer[index_md][index_row * ptr->q_size + index_of_old[index_q]] =
+          transfer_old[index_row * q_size_old + index_q];
+      }
+    }
+
+    class_free_large(transfer_old);
+  }
+
+  free(index_of_old);
+
+  /** - update the list of k values and the index of the flat rescaling approximation */
+
+  for (index_md = 0; index_md < ptr->md_size; index_md++) {
+    free(ptr->k[index_md]);
+    if (ptr->do_lcmb_full_limber == _TRUE_)
+      free(ptr->k_limber[index_md]);
+  }
+  free(ptr->k);
+  if (ptr->do_lcmb_full_limber == _TRUE_)
+    free(ptr->k_limber);
+
+  class_call(transfer_get_k_list(ppt,ptr,K),
+             ptr->error_message,
+             ptr->error_message);
+
+  class_call(transfer_get_q_flat_approximation(ppr,ptr,K,sgnK),
+             ptr->error_message,
+             ptr->error_message);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine writes the list of q values in
+ * ppr->transfer_q_list_file, such that it can be read by
+ * transfer_get_q_list() in the next runs. The file starts with
+ * q_period, followed by the values of q; all of them are written in
+ * hexadecimal notation (%a), which is read back exactly.
+ *
+ * @param ppr      Input: pointer to precision structure
+ * @param ptr      Input: pointer to transfer structure containing q's
+ * @param q_period Input: order of magnitude of the oscillation period of transfer functions
+ * @return the error status
+ */
 
-  class_test(ptr->q_size<2,ptr->error_message,"buggy q-list definition");
+int transfer_write_q_list(
+                          struct precision * ppr,
+                          struct transfer * ptr,
+                          double q_period
+                          ) {
 
-  /* now, readjust array size */
+  FILE * q_file;
+  int index_q;
 
-  class_realloc(ptr->q,
-                ptr->q_size*sizeof(double),
-                ptr->error_message);
+  class_open(q_file,ppr->transfer_q_list_file,"w",ptr->error_message);
 
-  /* in curved universe, check at which index the flat rescaling
-     approximation will start being used */
+  fprintf(q_file,"# oscillation period 2pi/r_a(tau_rec) of this run, followed by the list of %zu wavenumbers q of the transfer module, in 1/Mpc\n",ptr->q_size);
+  fprintf(q_file,"%a\n",q_period);
+  for (index_q = 0; index_q < ptr->q_size; index_q++)
+    fprintf(q_file,"%a\n",ptr->q[index_q]);
 
-  if (sgnK != 0) {
+  fclose(q_file);
 
-    q_approximation = ppr->hyper_flat_approximation_nu * sqrt(sgnK*K);
-    /* If q_approximation >= q_max, we can skip any computation and conclude we cannot do an approximation */
-    if(q_approximation < ptr->q[ptr->q_size-1]){
-      /* Otherwise, just find the first index at which the approximation would break */
-      for (ptr->index_q_flat_approximation=0;
-           ptr->index_q_flat_approximation < ptr->q_size-1;
-           ptr->index_q_flat_approximation++) {
-        if (ptr->q[ptr->index_q_flat_approximation] > q_approximation) break;
-      }
-      if (ptr->transfer_verbose > 1)
-        printf("Flat bessel approximation spares hyperspherical bessel computations for %zu wavenumbers over a total of %zu\n",
-               ptr->q_size-ptr->index_q_flat_approximation,ptr->q_size);
-    }
-    else{
-      ptr->index_q_flat_approximation = ptr->q_size;
-      if (ptr->transfer_verbose > 1)
-        printf("Cannot use flat bessel approximation, since q_max = %.5e > q_start_approximation = %.5e\n", ptr->q[ptr->q_size-1], q_approximation);
-    }
-  }
+  if (ptr->transfer_verbose > 1)
+    printf(" -> wrote %zu values of q in %s\n",ptr->q_size,ppr->transfer_q_list_file);
 
   return _SUCCESS_;
 
@@ -1852,6 +3488,7 @@ int transfer_compute_for_each_q(
                                 int tau_size_max,
                                 double tau_rec,
                                 double *** pert_sources,
+                                double *** pert_nl_corrections,
                                 double *** pert_sources_spline,
                                 double * window,
                                 struct transfer_workspace * ptw,
@@ -1906,6 +3543,10 @@ int transfer_compute_for_each_q(
 
   double q,k,k_max;
 
+  /* in the adaptive l sampling, sources kept between the passes for
+     this wavenumber, initial condition and type (or NULL) */
+  double ** cached_sources;
+
   /** - store the sources in the workspace and define all
       fields in this workspace */
   interpolated_sources = ptw->interpolated_sources;
@@ -1934,6 +3575,12 @@ int transfer_compute_for_each_q(
 
     if (k <= k_max) {
 
+      /** - find the weights of the interpolation of all sources at this k */
+
+      class_call(transfer_interpolation_weights(ppt,ptr,ptw,index_md,k),
+                 ptr->error_message,
+                 ptr->error_message);
+
       /** - loop over initial conditions. */
       /* For each of them: */
 
@@ -1953,56 +3600,96 @@ int transfer_compute_for_each_q(
                 only the lensing CMB potential in the full limber
                 way. */
 
+          /* in the adaptive l sampling, skip the types without any
+             multipole to compute in this pass (the full Limber
+             transfer functions are computed for all multipoles at
+             once) */
+          if ((use_full_limber == _FALSE_) && (ptw->l_needed != NULL)) {
+            for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
+              if (ptw->l_needed[index_md][index_tt * ptr->l_size[index_md] + index_l] == _TRUE_)
+                break;
+            }
+            if (index_l == ptr->l_size[index_md])
+              continue;
+          }
+
           if ((use_full_limber == _FALSE_) || (index_tt == ptr->index_tt_lcmb)) {
 
-            /** - check if we must now deal with a new source with a
-                new index ppt->index_type. If yes, interpolate it at the
-                right values of k. */
-
-            if (tp_of_tt[index_md][index_tt] != previous_type) {
-
-              class_call(transfer_interpolate_sources(ppt,
-                                                      ptr,
-                                                      k,
-                                                      index_md,
-                                                      index_ic,
-                                                      tp_of_tt[index_md][index_tt],
-                                                      pert_sources[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
-                                                      pert_sources_spline[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
-                                                      interpolated_sources),
-                         ptr->error_message,
-                         ptr->error_message);
+            /** - in the adaptive l sampling, find whether the sources
+                of this type are kept between the passes (then, after
+                the first one, they are just read back) */
+
+            cached_sources = NULL;
+            if ((use_full_limber == _FALSE_) && (ptw->psc != NULL) && (index_md == ptw->psc->index_md) &&
+                (ptw->psc->kept[index_ic * ptr->tt_size[index_md] + index_tt] == _TRUE_))
+              cached_sources = &(ptw->psc->sources[index_q][index_ic * ptr->tt_size[index_md] + index_tt]);
+
+            if ((cached_sources != NULL) && (*cached_sources != NULL)) {
+
+              *tau_size = ptw->psc->tau_size[index_tt];
+              memcpy(sources,*cached_sources,*tau_size*sizeof(double));
+              memcpy(tau0_minus_tau,ptw->psc->tau0_minus_tau[index_tt],*tau_size*sizeof(double));
+              memcpy(w_trapz,ptw->psc->w_trapz[index_tt],*tau_size*sizeof(double));
+
+              /* the interpolated source is not that of this type */
+              previous_type = -1;
             }
+            else {
 
-            previous_type = tp_of_tt[index_md][index_tt];
+              /** - check if we must now deal with a new source with a
+                  new index ppt->index_type. If yes, interpolate it at the
+                  right values of k. */
+
+              if (tp_of_tt[index_md][index_tt] != previous_type) {
+
+                class_call(transfer_interpolate_sources(ppt,
+                                                        ptw,
+                                                        index_md,
+                                                        index_ic,
+                                                        tp_of_tt[index_md][index_tt],
+                                                        pert_sources[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
+                                                        pert_nl_corrections[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
+                                                        pert_sources_spline[index_md][index_ic * ppt->tp_size[index_md] + tp_of_tt[index_md][index_tt]],
+                                                        interpolated_sources),
+                           ptr->error_message,
+                           ptr->error_message);
+              }
 
-            /* the code makes a distinction between "perturbation
-               sources" (e.g. gravitational potential) and "transfer
-               sources" (e.g. total density fluctuations, obtained
-               through the Poisson equation, and observed with a given
-               selection function).
+              previous_type = tp_of_tt[index_md][index_tt];
 
-               The next routine computes the transfer source given the
-               interpolated perturbation source, and copies it in the
-               workspace. */
+              /* the code makes a distinction between "perturbation
+                 sources" (e.g. gravitational potential) and "transfer
+                 sources" (e.g. total density fluctuations, obtained
+                 through the Poisson equation, and observed with a given
+                 selection function).
 
-            class_call(transfer_sources(ppr,
-                                        pba,
-                                        ppt,
-                                        ptr,
-                                        interpolated_sources,
-                                        tau_rec,
-                                        k,
-                                        index_md,
-                                        index_tt,
-                                        sources,
-                                        window,
-                                        tau_size_max,
-                                        tau0_minus_tau,
-                                        w_trapz,
-                                        tau_size),
-                       ptr->error_message,
-                       ptr->error_message);
+                 The next routine computes the transfer source given the
+                 interpolated perturbation source, and copies it in the
+                 workspace. */
+
+              class_call(transfer_sources(ppr,
+                                          pba,
+                                          ppt,
+                                          ptr,
+                                          interpolated_sources,
+                                          tau_rec,
+                                          k,
+                                          index_md,
+                                          index_tt,
+                                          sources,
+                                          window,
+                                          tau_size_max,
+                                          tau0_minus_tau,
+                                          w_trapz,
+                                          tau_size),
+                         ptr->error_message,
+                         ptr->error_message);
+
+              if (cached_sources != NULL) {
+                class_alloc(*cached_sources,*tau_size*sizeof(double),ptr->error_message);
+                memcpy(*cached_sources,sources,*tau_size*sizeof(double));
+              }
+            }
 
             /* now that the array of times tau0_minus_tau is known, we can
                infer the array of radial coordinates r(tau0_minus_tau) as well as a
@@ -2012,6 +3699,9 @@ int transfer_compute_for_each_q(
                        ptr->error_message,
                        ptr->error_message);
 
+            /* the Limber kernel of the previous source is now obsolete */
+            ptw->limber_index_tau = -1;
+
             /** - Select radial function type */
             class_call(transfer_select_radial_function(
                                                        ppt,
@@ -2024,6 +3714,10 @@ int transfer_compute_for_each_q(
 
             for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
 
+              if ((use_full_limber == _FALSE_) && (ptw->l_needed != NULL) &&
+                  (ptw->l_needed[index_md][index_tt * ptr->l_size[index_md] + index_l] == _FALSE_))
+                continue;
+
               l = (double)ptr->l[index_l];
 
               /* neglect transfer function when l is much smaller than k*tau0 */
@@ -2044,6 +3738,13 @@ int transfer_compute_for_each_q(
               if ((ptw->sgnK == 1) && (ptr->l[index_l] >= (int)(q/sqrt(ptw->K)+0.2))) {
                 neglect = _TRUE_;
               }
+              /* in the direct Limber scheme, the lensing potential is
+                 not needed above the switch multipole (see
+                 transfer_lcmb_direct_limber()) */
+              if ((ptr->do_lcmb_direct_limber == _TRUE_) && (_scalars_) &&
+                  (index_tt == ptr->index_tt_lcmb) && (index_l >= ptr->index_l_lcmb_direct)) {
+                neglect = _TRUE_;
+              }
               /* This would maybe go into transfer_can_be_neglected later: */
               if ((ptw->sgnK != 0) && (index_q < ptr->index_q_flat_approximation) && (index_l>=ptw->HIS.l_size) && (use_full_limber == _FALSE_)) {
                 neglect = _TRUE_;
@@ -2117,6 +3818,21 @@ int transfer_compute_for_each_q(
 
             } /* end of loop over l */
 
+            /* integrate the multipoles left in the block */
+            if (ptw->l_block_num > 0) {
+              class_call(transfer_integrate_l_block(ppt,
+                                                    ptr,
+                                                    ptw,
+                                                    index_q,
+                                                    index_md,
+                                                    index_ic,
+                                                    index_tt,
+                                                    k,
+                                                    radial_type),
+                         ptr->error_message,
+                         ptr->error_message);
+            }
+
           }
           else {
             for (index_l = 0; index_l < ptr->l_size[index_md]; index_l++) {
@@ -2207,50 +3923,35 @@ int transfer_radial_coordinates(
 
 
 /**
- * This routine interpolates sources \f$ S(k, \tau) \f$ for each mode,
- * initial condition and type (of perturbation module), to get them at
- * the right values of k, using the spline interpolation method.
+ * This routine finds the weights of the spline interpolation of the
+ * perturbation sources at a given wavenumber k, and stores them in
+ * the workspace: they are the same for all types, initial conditions
+ * and times, and are thus computed once for each mode and each value
+ * of k, before the sources are interpolated by
+ * transfer_interpolate_sources().
  *
- * @param ppt                   Input: pointer to perturbation structure
- * @param ptr                   Input: pointer to transfer structure
- * @param k                     Input: wavenumber at which to interpolate
- * @param index_md              Input: index of mode
- * @param index_ic              Input: index of initial condition
- * @param index_type            Input: index of type of source (in perturbation module)
- * @param pert_source           Input: array of sources
- * @param pert_source_spline    Input: array of second derivative of sources
- * @param interpolated_sources  Output: array of interpolated sources (filled here but allocated in transfer_init() to avoid numerous reallocation)
+ * @param ppt      Input: pointer to perturbation structure
+ * @param ptr      Input: pointer to transfer structure
+ * @param ptw      Input/Output: pointer to transfer workspace
+ * @param index_md Input: index of mode
+ * @param k        Input: wavenumber at which to interpolate
  * @return the error status
  */
 
-int transfer_interpolate_sources(
-                                 struct perturbations * ppt,
-                                 struct transfer * ptr,
-                                 double k,
-                                 int index_md,
-                                 int index_ic,
-                                 int index_type,
-                                 double * pert_source,       /* array with argument pert_source[index_tau*ppt->k_size[index_md]+index_k] (must be allocated) */
-                                 double * pert_source_spline, /* array with argument pert_source_spline[index_tau*ppt->k_size[index_md]+index_k] (must be allocated) */
-                                 double * interpolated_sources /* array with argument interpolated_sources[index_tau] (must be allocated) */
-                                 ) {
-
-  /** Summary: */
-
-  /** - define local variables */
+int transfer_interpolation_weights(
+                                   struct perturbations * ppt,
+                                   struct transfer * ptr,
+                                   struct transfer_workspace * ptw,
+                                   int index_md,
+                                   double k
+                                   ) {
 
   /* index running on k values in the original source array */
   int index_k;
 
-  /* index running on time */
-  int index_tau;
-
   /* variables used for spline interpolation algorithm */
   double h, a, b;
 
-  /** - interpolate at each k value using the usual
-      spline interpolation algorithm. */
-
   index_k = 0;
   h = ppt->k[index_md][index_k+1] - ppt->k[index_md][index_k];
 
@@ -2267,14 +3968,119 @@ int transfer_interpolate_sources(
   b = (k - ppt->k[index_md][index_k])/h;
   a = 1.-b;
 
-  for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+  ptw->interp_index_k = index_k;
+  ptw->interp_a = a;
+  ptw->interp_b = b;
+  ptw->interp_c = (a*a*a-a)*h*h/6.0;
+  ptw->interp_d = (b*b*b-b)*h*h/6.0;
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine interpolates sources \f$ S(k, \tau) \f$ for each mode,
+ * initial condition and type (of perturbation module), to get them at
+ * the right values of k, using the spline interpolation method, with
+ * the weights found by transfer_interpolation_weights().
+ *
+ * @param ppt                   Input: pointer to perturbation structure
+ * @param ptw                   Input: pointer to transfer workspace, containing the interpolation weights
+ * @param index_md              Input: index of mode
+ * @param index_ic              Input: index of initial condition
+ * @param index_type            Input: index of type of source (in perturbation module)
+ * @param pert_source           Input: array of sources (NULL if they are stored in single precision, see ppt->storage)
+ * @param nl_correction         Input: array of non-linear correction factors by which the sources are multiplied, or NULL
+ * @param pert_source_spline    Input: array of second derivative of (corrected) sources
+ * @param interpolated_sources  Output: array of interpolated sources (filled here but allocated in transfer_init() to avoid numerous reallocation)
+ * @return the error status
+ */
+
+_CLASS_TARGET_CLONES_
+int transfer_interpolate_sources(
+                                 struct perturbations * ppt,
+                                 struct transfer_workspace * ptw,
+                                 int index_md,
+                                 int index_ic,
+                                 int index_type,
+                                 double * pert_source,       /* array with argument pert_source[index_tau*ppt->k_size[index_md]+index_k] (must be allocated, unless ppt->storage is sources_storage_float) */
+                                 double * nl_correction,     /* array with argument nl_correction[index_tau*ppt->k_size[index_md]+index_k], or NULL */
+                                 double * pert_source_spline, /* array with argument pert_source_spline[index_tau*ppt->k_size[index_md]+index_k] (must be allocated) */
+                                 double * interpolated_sources /* array with argument interpolated_sources[index_tau] (must be allocated) */
+                                 ) {
 
-    interpolated_sources[index_tau] =
-      a * pert_source[index_tau*ppt->k_size[index_md]+index_k]
-      + b * pert_source[index_tau*ppt->k_size[index_md]+index_k+1]
-      + ((a*a*a-a) * pert_source_spline[index_tau*ppt->k_size[index_md]+index_k]
-         +(b*b*b-b) * pert_source_spline[index_tau*ppt->k_size[index_md]+index_k+1])*h*h/6.0;
+  /** Summary: */
+
+  /** - define local variables */
+
+  /* index running on time */
+  int index_tau;
+
+  /* stride between two times in the source arrays */
+  int k_size = ppt->k_size[index_md];
+
+  /* interpolation weights, kept in local variables so that the
+     loops below only read the sources */
+  double a = ptw->interp_a;
+  double b = ptw->interp_b;
+  double c = ptw->interp_c;
+  double d = ptw->interp_d;
+
+  /* sources, corrections and second derivatives at the bracketing
+     wavenumbers index_k and index_k+1 of the first time */
+  double * source = (pert_source != NULL ? pert_source + ptw->interp_index_k : NULL);
+  double * correction = (nl_correction != NULL ? nl_correction + ptw->interp_index_k : NULL);
+  double * spline = pert_source_spline + ptw->interp_index_k;
+  float * source_float;
+
+  /** - interpolate at each time, with the same weights for all of
+      them: the four branches only differ by the way the sources are
+      read, to keep the loops free of tests */
+
+  if (ppt->storage == sources_storage_float) {
+
+    /* same reading the sources stored in single precision */
+    source_float = ppt->sources_float[index_md][index_ic * ppt->tp_size[index_md] + index_type] + ptw->interp_index_k;
+
+    if (nl_correction == NULL) {
+      for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+        interpolated_sources[index_tau] =
+          a * (double)source_float[index_tau*k_size]
+          + b * (double)source_float[index_tau*k_size+1]
+          + c * spline[index_tau*k_size]
+          + d * spline[index_tau*k_size+1];
+      }
+    }
+    else {
+      /* with the non-linear correction applied on the fly */
+      for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+        interpolated_sources[index_tau] =
+          a * ((double)source_float[index_tau*k_size] * correction[index_tau*k_size])
+          + b * ((double)source_float[index_tau*k_size+1] * correction[index_tau*k_size+1])
+          + c * spline[index_tau*k_size]
+          + d * spline[index_tau*k_size+1];
+      }
+    }
+  }
+  else if (nl_correction == NULL) {
+
+    for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+      interpolated_sources[index_tau] =
+        a * source[index_tau*k_size]
+        + b * source[index_tau*k_size+1]
+        + c * spline[index_tau*k_size]
+        + d * spline[index_tau*k_size+1];
+    }
+  }
+  else {
 
+    /* same with the non-linear correction applied on the fly */
+    for (index_tau = 0; index_tau < ppt->tau_size; index_tau++) {
+      interpolated_sources[index_tau] =
+        a * (source[index_tau*k_size] * correction[index_tau*k_size])
+        + b * (source[index_tau*k_size+1] * correction[index_tau*k_size+1])
+        + c * spline[index_tau*k_size]
+        + d * spline[index_tau*k_size+1];
+    }
   }
 
   return _SUCCESS_;
@@ -2969,36 +4775,34 @@ int transfer_source_resample(
   /* running index on time */
   int index_tau;
 
-  /* array of values of source */
-  double * source_at_tau;
+  /* index of the perturbation time just below the current one */
+  int inf;
 
-  /* array of source values for a given time and for all k's */
-  class_alloc(source_at_tau,
-              sizeof(double),
-              ptr->error_message);
+  double tau, weight;
 
-  /* interpolate the sources linearly at the new time values */
+  /* interpolate the sources linearly at the new time values (like
+     array_interpolate_two(), but the new times are ordered, so the
+     bracketing index is found by walking from the previous one) */
+  inf = 0;
   for (index_tau=0; index_tau<tau_size; index_tau++) {
 
-    class_call(array_interpolate_two(ppt->tau_sampling,
-                                     1,
-                                     0,
-                                     interpolated_sources,
-                                     1,
-                                     ppt->tau_size,
-                                     tau0-tau0_minus_tau[index_tau],
-                                     source_at_tau,
-                                     1,
-                                     ptr->error_message),
+    tau = tau0-tau0_minus_tau[index_tau];
+
+    class_test((tau < ppt->tau_sampling[0]) || (tau > ppt->tau_sampling[ppt->tau_size-1]),
                ptr->error_message,
-               ptr->error_message);
+               "tau=%e out of the range [%e, %e] of the sources",
+               tau,ppt->tau_sampling[0],ppt->tau_sampling[ppt->tau_size-1]);
 
-    /* copy the new values in the output sources array */
-    sources[index_tau] = source_at_tau[0];
-  }
+    while ((inf < ppt->tau_size-2) && (tau >= ppt->tau_sampling[inf+1]))
+      inf++;
+    while ((inf > 0) && (tau < ppt->tau_sampling[inf]))
+      inf--;
+
+    weight = (tau-ppt->tau_sampling[inf])/(ppt->tau_sampling[inf+1]-ppt->tau_sampling[inf]);
 
-  /* deallocate the temporary array */
-  free(source_at_tau);
+    sources[index_tau] = interpolated_sources[inf] * (1.-weight)
+      + weight * interpolated_sources[inf+1];
+  }
 
   return _SUCCESS_;
 
@@ -3123,7 +4927,7 @@ int transfer_selection_compute(
   double norm;
 
   /* used for calling background_at_tau() */
-  int last_index;
+  int last_index=0;
 
   /* running value of redshift */
   double z;
@@ -3140,7 +4944,7 @@ int transfer_selection_compute(
       class_call(background_at_tau(pba,
                                    tau,
                                    long_info,
-                                   inter_normal,
+                                   inter_closeby,
                                    &last_index,
                                    pvecback),
                  pba->error_message,
@@ -3296,6 +5100,31 @@ int transfer_compute_for_each_l(
                  ptr->error_message);
 
     }
+    else if (ptw->l_block_size > 1) {
+
+      /* defer the integral to transfer_integrate_l_block(), which
+         deals with the block of multipoles once it is full (or after
+         the last multipole in transfer_compute_for_each_q()) */
+      ptw->l_block_index_l[ptw->l_block_num] = index_l;
+      ptw->l_block_neglect_late_source[ptw->l_block_num] = ptw->neglect_late_source;
+      ptw->l_block_num++;
+
+      if (ptw->l_block_num == ptw->l_block_size) {
+        class_call(transfer_integrate_l_block(ppt,
+                                              ptr,
+                                              ptw,
+                                              index_q,
+                                              index_md,
+                                              index_ic,
+                                              index_tt,
+                                              k,
+                                              radial_type),
+                   ptr->error_message,
+                   ptr->error_message);
+      }
+
+      return _SUCCESS_;
+    }
     else {
       class_call(transfer_integrate(
                                     ppt,
@@ -3441,146 +5270,363 @@ int transfer_integrate(
   /** - define local variables */
 
   double * tau0_minus_tau = ptw->tau0_minus_tau;
-  double * w_trapz = ptw->w_trapz;
+  double * w_trapz = ptw->w_trapz;
+  double * sources = ptw->sources;
+
+  /* minimum value of \f$ (\tau0-\tau) \f$ at which \f$ j_l(k[\tau_0-\tau]) \f$ is known, given that \f$ j_l(x) \f$ is sampled above some finite value \f$ x_{\min} \f$ (below which it can be approximated by zero) */
+  double tau0_minus_tau_min_bessel;
+
+  /* index in the source's tau list corresponding to the last point in the overlapping region between sources and bessels */
+  int index_tau_max;
+
+  /* whether the integral is truncated because of the Bessel function */
+  short bessel_truncation;
+
+  double bessel, *radial_function = ptw->radial_function;
+
+  /** - find the range of the integral, return zero if it is empty */
+  class_call(transfer_integration_bounds(ptr,
+                                         ptw,
+                                         index_q,
+                                         l,
+                                         index_l,
+                                         k,
+                                         ptw->neglect_late_source,
+                                         &index_tau_max,
+                                         &tau0_minus_tau_min_bessel,
+                                         &bessel_truncation),
+             ptr->error_message,
+             ptr->error_message);
+
+  if (index_tau_max < 0) {
+    *trsf = 0.;
+    return _SUCCESS_;
+  }
+
+  /** - trivial case: the source is a Dirac function and is sampled in only one point */
+  if (ptw->tau_size == 1) {
+
+    class_call(transfer_radial_function(
+                                        ptw,
+                                        ppt,
+                                        ptr,
+                                        k,
+                                        index_q,
+                                        index_l,
+                                        1,
+                                        0,
+                                        1,
+                                        &bessel,
+                                        radial_type
+                                        ),
+               ptr->error_message,
+               ptr->error_message);
+
+    *trsf = sources[0] * bessel;
+    return _SUCCESS_;
+  }
+
+  /** - Compute the radial function: */
+  class_call(transfer_radial_function(
+                                      ptw,
+                                      ppt,
+                                      ptr,
+                                      k,
+                                      index_q,
+                                      index_l,
+                                      index_tau_max+1,
+                                      0,
+                                      index_tau_max+1,
+                                      radial_function,
+                                      radial_type
+                                      ),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - Now we do most of the convolution integral: */
+  class_call(array_trapezoidal_convolution(sources,
+                                           radial_function,
+                                           index_tau_max+1,
+                                           w_trapz,
+                                           trsf,
+                                           ptr->error_message),
+             ptr->error_message,
+             ptr->error_message);
+
+  /** - This integral is correct for the case where no truncation has
+      occurred. If it has been truncated at some index_tau_max because
+      f[index_tau_max+1]==0, it is still correct. The 'mistake' in using
+      the wrong weight w_trapz[index_tau_max] is exactly compensated by the
+      triangle we miss. However, for the Bessel cut off, we must subtract the
+      wrong triangle and add the correct triangle. */
+  if (bessel_truncation == _TRUE_) {
+    *trsf -= 0.5*(tau0_minus_tau[index_tau_max+1]-tau0_minus_tau_min_bessel)*
+      radial_function[index_tau_max]*sources[index_tau_max];
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the range of time over which the source must be convolved with
+ * the radial function in transfer_integrate(), i.e. the region in which
+ * both the source and the Bessel function are non-zero.
+ *
+ * @param ptr                       Input: pointer to transfer structure
+ * @param ptw                       Input: pointer to transfer_workspace structure
+ * @param index_q                   Input: index of wavenumber
+ * @param l                         Input: multipole
+ * @param index_l                   Input: index of multipole
+ * @param k                         Input: wavenumber
+ * @param neglect_late_source       Input: whether the time cut approximation is used for this multipole
+ * @param index_tau_max             Output: last index of the integral in the source's tau list, or -1 if the transfer function vanishes
+ * @param tau0_minus_tau_min_bessel Output: value of (tau0-tau) below which the Bessel function can be approximated by zero
+ * @param bessel_truncation         Output: _TRUE_ if the integral is truncated at index_tau_max because of the Bessel function
+ * @return the error status
+ */
+
+int transfer_integration_bounds(
+                                struct transfer * ptr,
+                                struct transfer_workspace * ptw,
+                                int index_q,
+                                double l,
+                                int index_l,
+                                double k,
+                                short neglect_late_source,
+                                int * index_tau_max,
+                                double * tau0_minus_tau_min_bessel,
+                                short * bessel_truncation
+                                ) {
+
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
   double * sources = ptw->sources;
 
-  /* minimum value of \f$ (\tau0-\tau) \f$ at which \f$ j_l(k[\tau_0-\tau]) \f$ is known, given that \f$ j_l(x) \f$ is sampled above some finite value \f$ x_{\min} \f$ (below which it can be approximated by zero) */
-  double tau0_minus_tau_min_bessel;
-
-  /* index in the source's tau list corresponding to the last point in the overlapping region between sources and bessels. Also the index of possible Bessel truncation. */
-  int index_tau_max, index_tau_max_Bessel;
-
-  double bessel, *radial_function;
+  /* index of possible Bessel truncation */
+  int index_tau_max_Bessel;
 
   double x_turning_point;
 
+  *bessel_truncation = _FALSE_;
+
   /** - find minimum value of (tau0-tau) at which \f$ j_l(k[\tau_0-\tau]) \f$ is known, given that \f$ j_l(x) \f$ is sampled above some finite value \f$ x_{\min} \f$ (below which it can be approximated by zero) */
-  //tau0_minus_tau_min_bessel = x_min_l/k; /* segmentation fault impossible, checked before that k != 0 */
-  //printf("index_l=%d\n",index_l);
   if (ptw->sgnK==0){
-    tau0_minus_tau_min_bessel = ptw->pBIS->chi_at_phimin[index_l]/k; /* segmentation fault impossible, checked before that k != 0 */
+    *tau0_minus_tau_min_bessel = ptw->pBIS->chi_at_phimin[index_l]/k; /* segmentation fault impossible, checked before that k != 0 */
   }
   else{
 
     if (index_q < ptr->index_q_flat_approximation) {
 
-      tau0_minus_tau_min_bessel = ptw->HIS.chi_at_phimin[index_l]/sqrt(ptw->sgnK*ptw->K);
+      *tau0_minus_tau_min_bessel = ptw->HIS.chi_at_phimin[index_l]/sqrt(ptw->sgnK*ptw->K);
 
     }
     else {
 
-      tau0_minus_tau_min_bessel = ptw->pBIS->chi_at_phimin[index_l]/sqrt(ptw->sgnK*ptw->K);
+      *tau0_minus_tau_min_bessel = ptw->pBIS->chi_at_phimin[index_l]/sqrt(ptw->sgnK*ptw->K);
 
       if (ptw->sgnK == 1) {
         x_turning_point = asin(sqrt(l*(l+1.))/ptr->q[index_q]*sqrt(ptw->sgnK*ptw->K));
-        tau0_minus_tau_min_bessel *= x_turning_point/sqrt(l*(l+1.));
+        *tau0_minus_tau_min_bessel *= x_turning_point/sqrt(l*(l+1.));
       }
       else {
         x_turning_point = asinh(sqrt(l*(l+1.))/ptr->q[index_q]*sqrt(ptw->sgnK*ptw->K));
-        tau0_minus_tau_min_bessel *= x_turning_point/sqrt(l*(l+1.));
+        *tau0_minus_tau_min_bessel *= x_turning_point/sqrt(l*(l+1.));
       }
     }
   }
-  /** - if there is no overlap between the region in which bessels and sources are non-zero, return zero */
-  if (tau0_minus_tau_min_bessel >= tau0_minus_tau[0]) {
-    *trsf = 0.;
+
+  /** - if there is no overlap between the region in which bessels and sources are non-zero, return -1 */
+  if (*tau0_minus_tau_min_bessel >= tau0_minus_tau[0]) {
+    *index_tau_max = -1;
     return _SUCCESS_;
   }
 
-  /** - if there is an overlap: */
-
-  /** - --> trivial case: the source is a Dirac function and is sampled in only one point */
+  /** - if the source is a Dirac function, it is sampled in only one point */
   if (ptw->tau_size == 1) {
-
-    class_call(transfer_radial_function(
-                                        ptw,
-                                        ppt,
-                                        ptr,
-                                        k,
-                                        index_q,
-                                        index_l,
-                                        1,
-                                        &bessel,
-                                        radial_type
-                                        ),
-               ptr->error_message,
-               ptr->error_message);
-
-    *trsf = sources[0] * bessel;
+    *index_tau_max = 0;
     return _SUCCESS_;
   }
 
-  /** - --> other cases */
-
-  /** - ---> (a) find index in the source's tau list corresponding to the last point in the overlapping region. After this step, index_tau_max can be as small as zero, but not negative. */
-  index_tau_max = ptw->tau_size-1;
-  while (tau0_minus_tau[index_tau_max] < tau0_minus_tau_min_bessel)
-    index_tau_max--;
+  /** - (a) find index in the source's tau list corresponding to the last point in the overlapping region. After this step, index_tau_max can be as small as zero, but not negative. */
+  *index_tau_max = ptw->tau_size-1;
+  while (tau0_minus_tau[*index_tau_max] < *tau0_minus_tau_min_bessel)
+    (*index_tau_max)--;
   /* Set index so we know if the truncation of the convolution integral is due to Bessel and not
      due to the source. */
-  index_tau_max_Bessel = index_tau_max;
+  index_tau_max_Bessel = *index_tau_max;
 
-  /** - ---> (b) the source function can vanish at large \f$ \tau \f$. Check if further points can be eliminated. After this step and if we did not return a null transfer function, index_tau_max can be as small as zero, but not negative. */
-  while (sources[index_tau_max] == 0.) {
-    index_tau_max--;
-    if (index_tau_max < 0) {
-      *trsf = 0.;
+  /** - (b) the source function can vanish at large \f$ \tau \f$. Check if further points can be eliminated. After this step and if we did not return a null transfer function, index_tau_max can be as small as zero, but not negative. */
+  while (sources[*index_tau_max] == 0.) {
+    (*index_tau_max)--;
+    if (*index_tau_max < 0) {
       return _SUCCESS_;
     }
   }
 
-  if (ptw->neglect_late_source == _TRUE_) {
+  if (neglect_late_source == _TRUE_) {
 
-    while (tau0_minus_tau[index_tau_max] < ptw->tau0_minus_tau_cut) {
-      index_tau_max--;
-      if (index_tau_max < 0) {
-        *trsf = 0.;
+    while (tau0_minus_tau[*index_tau_max] < ptw->tau0_minus_tau_cut) {
+      (*index_tau_max)--;
+      if (*index_tau_max < 0) {
         return _SUCCESS_;
       }
     }
   }
 
-  /** - Compute the radial function: */
-  class_alloc(radial_function,sizeof(double)*(index_tau_max+1),ptr->error_message);
+  if ((*index_tau_max != (ptw->tau_size-1)) && (*index_tau_max == index_tau_max_Bessel)) {
+    *bessel_truncation = _TRUE_;
+  }
 
-  class_call(transfer_radial_function(
-                                      ptw,
-                                      ppt,
-                                      ptr,
-                                      k,
-                                      index_q,
-                                      index_l,
-                                      index_tau_max+1,
-                                      radial_function,
-                                      radial_type
-                                      ),
-             ptr->error_message,
-             ptr->error_message);
+  return _SUCCESS_;
+}
 
-  /** - Now we do most of the convolution integral: */
-  class_call(array_trapezoidal_convolution(sources,
-                                           radial_function,
-                                           index_tau_max+1,
-                                           w_trapz,
-                                           trsf,
-                                           ptr->error_message),
-             ptr->error_message,
-             ptr->error_message);
+/**
+ * Same as transfer_integrate(), but for all the multipoles stored in
+ * the block of the workspace by transfer_compute_for_each_l() (they
+ * share the same mode, initial condition, type and wavenumber). Instead
+ * of convolving the source with the radial function of each multipole
+ * in turn, the time grid is cut in tiles of _TRANSFER_TILE_ values, and
+ * each tile is convolved with the radial functions of all the
+ * multipoles before going to the next one, such that the source, the
+ * weights and the arguments are read from cache. Each integral is
+ * summed in the same order as in transfer_integrate(), the results
+ * only differ by round-off in the interpolation of the Bessel
+ * functions. With a device (see transfer_offload.h), the integrals of
+ * the flat case are computed there instead. The transfer functions are
+ * stored in the transfer structure, and the block is emptied.
+ *
+ * @param ppt            Input: pointer to perturbation structure
+ * @param ptr            Input/output: pointer to transfer structure
+ * @param ptw            Input/output: pointer to transfer_workspace structure
+ * @param index_q        Input: index of wavenumber
+ * @param index_md       Input: index of mode
+ * @param index_ic       Input: index of initial condition
+ * @param index_tt       Input: index of type
+ * @param k              Input: wavenumber
+ * @param radial_type    Input: type of radial (Bessel) functions to convolve with
+ * @return the error status
+ */
 
-  /** - This integral is correct for the case where no truncation has
-      occurred. If it has been truncated at some index_tau_max because
-      f[index_tau_max+1]==0, it is still correct. The 'mistake' in using
-      the wrong weight w_trapz[index_tau_max] is exactly compensated by the
-      triangle we miss. However, for the Bessel cut off, we must subtract the
-      wrong triangle and add the correct triangle. */
-  if ((index_tau_max!=(ptw->tau_size-1))&&(index_tau_max==index_tau_max_Bessel)){
-    //Bessel truncation
-    *trsf -= 0.5*(tau0_minus_tau[index_tau_max+1]-tau0_minus_tau_min_bessel)*
-      radial_function[index_tau_max]*sources[index_tau_max];
+int transfer_integrate_l_block(
+                               struct perturbations * ppt,
+                               struct transfer * ptr,
+                               struct transfer_workspace * ptw,
+                               int index_q,
+                               int index_md,
+                               int index_ic,
+                               int index_tt,
+                               double k,
+                               radial_function_type radial_type
+                               ) {
+
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
+  double * w_trapz = ptw->w_trapz;
+  double * sources = ptw->sources;
+  double * radial_function = ptw->radial_function;
+  double bessel;
+  int index_block, index_l, index_tau, index_tau_min, index_tau_end, tau_size_block = 0;
+
+  /** - find the range of each integral, and deal with the trivial cases */
+  for (index_block = 0; index_block < ptw->l_block_num; index_block++) {
+
+    index_l = ptw->l_block_index_l[index_block];
+    ptw->l_block_trsf[index_block] = 0.;
+
+    class_call(transfer_integration_bounds(ptr,
+                                           ptw,
+                                           index_q,
+                                           (double)ptr->l[index_l],
+                                           index_l,
+                                           k,
+                                           ptw->l_block_neglect_late_source[index_block],
+                                           &(ptw->l_block_index_tau_max[index_block]),
+                                           &(ptw->l_block_tau0_minus_tau_min_bessel[index_block]),
+                                           &(ptw->l_block_bessel_truncation[index_block])),
+               ptr->error_message,
+               ptr->error_message);
+
+    if ((ptw->tau_size == 1) && (ptw->l_block_index_tau_max[index_block] == 0)) {
+
+      class_call(transfer_radial_function(ptw,
+                                          ppt,
+                                          ptr,
+                                          k,
+                                          index_q,
+                                          index_l,
+                                          1,
+                                          0,
+                                          1,
+                                          &bessel,
+                                          radial_type),
+                 ptr->error_message,
+                 ptr->error_message);
+
+      ptw->l_block_trsf[index_block] = sources[0] * bessel;
+      ptw->l_block_index_tau_max[index_block] = -1;
+    }
+
+    tau_size_block = MAX(tau_size_block,ptw->l_block_index_tau_max[index_block]+1);
+  }
+
+  /** - with a device, compute the integrals there, otherwise loop
+      over the tiles of the time grid, and for each of them over the
+      multipoles */
+  if (transfer_offload_supports(ptw->pto,ptw,radial_type) == _TRUE_) {
+    class_call(transfer_offload_l_block(ptw->pto,
+                                        ptw,
+                                        tau_size_block,
+                                        radial_type,
+                                        ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+  }
+  else {
+    for (index_tau_min = 0; index_tau_min < tau_size_block; index_tau_min += _TRANSFER_TILE_) {
+
+      for (index_block = 0; index_block < ptw->l_block_num; index_block++) {
+
+        if (ptw->l_block_index_tau_max[index_block] < index_tau_min)
+          continue;
+
+        index_l = ptw->l_block_index_l[index_block];
+        index_tau_end = MIN(index_tau_min+_TRANSFER_TILE_,ptw->l_block_index_tau_max[index_block]+1);
+
+        class_call(transfer_radial_function(ptw,
+                                            ppt,
+                                            ptr,
+                                            k,
+                                            index_q,
+                                            index_l,
+                                            ptw->l_block_index_tau_max[index_block]+1,
+                                            index_tau_min,
+                                            index_tau_end,
+                                            radial_function,
+                                            radial_type),
+                   ptr->error_message,
+                   ptr->error_message);
+
+        for (index_tau = index_tau_min; index_tau < index_tau_end; index_tau++) {
+          ptw->l_block_trsf[index_block] += sources[index_tau]*radial_function[index_tau-index_tau_min]*w_trapz[index_tau];
+        }
+
+        /* last tile for this multipole: correct for the Bessel cut off as in transfer_integrate() */
+        if ((index_tau_end == ptw->l_block_index_tau_max[index_block]+1) && (ptw->l_block_bessel_truncation[index_block] == _TRUE_)) {
+          ptw->l_block_trsf[index_block] -= 0.5*(tau0_minus_tau[index_tau_end]-ptw->l_block_tau0_minus_tau_min_bessel[index_block])*
+            radial_function[index_tau_end-1-index_tau_min]*sources[index_tau_end-1];
+        }
+      }
+    }
+  }
+
+  /** - store the transfer functions in the transfer structure */
+  for (index_block = 0; index_block < ptw->l_block_num; index_block++) {
+    ptr->transfer[index_md][((index_ic * ptr->tt_size[index_md] + index_tt)
+                             * ptr->l_size[index_md] + ptw->l_block_index_l[index_block])
+                            * ptr->q_size + index_q]
+      = ptw->l_block_trsf[index_block];
   }
 
+  ptw->l_block_num = 0;
 
-  free(radial_function);
   return _SUCCESS_;
 }
 
@@ -3625,6 +5671,16 @@ int transfer_limber(
   double tau0_minus_tau_limber=0.;
   double IPhiFlat = 0.;
 
+  /** - the first time the Limber approximation is used for this
+      source, build the kernel interpolated below; it is then shared
+      by all multipoles */
+
+  if (ptw->limber_index_tau < 0) {
+    class_call(transfer_limber_sources(ptw),
+               ptr->error_message,
+               ptr->error_message);
+  }
+
   if (radial_type == SCALAR_TEMPERATURE_0) {
 
     /** - get k, l and infer tau such that k(tau0-tau)=l+1/2;
@@ -3650,9 +5706,10 @@ int transfer_limber(
 
     class_call(transfer_limber_interpolate(ptr,
                                            ptw->tau0_minus_tau,
-                                           ptw->sources,
+                                           ptw->limber_sources,
                                            ptw->tau_size,
                                            tau0_minus_tau_limber,
+                                           &(ptw->limber_index_tau),
                                            &S),
                ptr->error_message,
                ptr->error_message);
@@ -3684,18 +5741,20 @@ int transfer_limber(
 
     class_call(transfer_limber_interpolate(ptr,
                                            ptw->tau0_minus_tau,
-                                           ptw->sources,
+                                           ptw->limber_sources,
                                            ptw->tau_size,
                                            (l+1.5)/q,
+                                           &(ptw->limber_index_tau),
                                            &Sp),
                ptr->error_message,
                ptr->error_message);
 
     class_call(transfer_limber_interpolate(ptr,
                                            ptw->tau0_minus_tau,
-                                           ptw->sources,
+                                           ptw->limber_sources,
                                            ptw->tau_size,
                                            (l-0.5)/q,
+                                           &(ptw->limber_index_tau),
                                            &Sm),
                ptr->error_message,
                ptr->error_message);
@@ -3716,27 +5775,30 @@ int transfer_limber(
 
     class_call(transfer_limber_interpolate(ptr,
                                            ptw->tau0_minus_tau,
-                                           ptw->sources,
+                                           ptw->limber_sources,
                                            ptw->tau_size,
                                            (l+2.5)/q,
+                                           &(ptw->limber_index_tau),
                                            &Sp),
                ptr->error_message,
                ptr->error_message);
 
     class_call(transfer_limber_interpolate(ptr,
                                            ptw->tau0_minus_tau,
-                                           ptw->sources,
+                                           ptw->limber_sources,
                                            ptw->tau_size,
                                            (l-1.5)/q,
+                                           &(ptw->limber_index_tau),
                                            &Sm),
                ptr->error_message,
                ptr->error_message);
 
     class_call(transfer_limber_interpolate(ptr,
                                            ptw->tau0_minus_tau,
-                                           ptw->sources,
+                                           ptw->limber_sources,
                                            ptw->tau_size,
                                            (l+0.5)/q,
+                                           &(ptw->limber_index_tau),
                                            &S),
                ptr->error_message,
                ptr->error_message);
@@ -3760,71 +5822,251 @@ int transfer_limber(
 
 }
 
+/**
+ * This routine builds the Limber kernel of the source currently
+ * stored in the workspace, i.e. the product S*(tau0-tau) interpolated
+ * by transfer_limber_interpolate(). Indeed this product is regular in
+ * tau=tau0, while S alone diverges for lensing. The source vanishes at
+ * the last point (tau0=tau), where we use in very good approximation
+ * the fact that S*(tau0-tau) is constant near tau=tau0: the product at
+ * the previous point is copied there.
+ *
+ * The kernel is built once for each wavenumber and type (each
+ * selection bin being a separate type) and then reused for all
+ * multipoles computed in the Limber approximation.
+ *
+ * @param ptw Input/Output: pointer to transfer workspace structure
+ * @return the error status
+ */
+
+int transfer_limber_sources(
+                            struct transfer_workspace * ptw
+                            ){
+
+  int index_tau;
+
+  for (index_tau=0; index_tau<ptw->tau_size; index_tau++)
+    ptw->limber_sources[index_tau] = ptw->sources[index_tau]*ptw->tau0_minus_tau[index_tau];
+
+  if (ptw->tau_size > 1)
+    ptw->limber_sources[ptw->tau_size-1] = ptw->limber_sources[ptw->tau_size-2];
+
+  ptw->limber_index_tau = 1;
+
+  return _SUCCESS_;
+}
+
+/**
+ * This routine interpolates the Limber kernel built by
+ * transfer_limber_sources() at a given value of (tau0-tau), by
+ * fitting a polynomial of order two through three neighbouring points.
+ *
+ * Successive calls for growing multipoles move monotonically along the
+ * time grid, so the search for the bracketing indices starts from the
+ * result of the previous call rather than from the edge of the grid.
+ *
+ * @param ptr                    Input: pointer to transfer structure
+ * @param tau0_minus_tau         Input: array of values of (tau_today - tau)
+ * @param limber_sources         Input: Limber kernel S*(tau0-tau)
+ * @param tau_size               Input: size of the two arrays above
+ * @param tau0_minus_tau_limber  Input: value of (tau_today - tau) at which the kernel is needed
+ * @param index_tau              Input/Output: bracketing index of the previous call, updated
+ * @param S                      Output: interpolated value of the kernel
+ * @return the error status
+ */
+
 int transfer_limber_interpolate(
                                 struct transfer * ptr,
                                 double * tau0_minus_tau,
-                                double * sources,
+                                double * limber_sources,
                                 int tau_size,
                                 double tau0_minus_tau_limber,
+                                int * index_tau,
                                 double * S
                                 ){
 
-  int index_tau;
+  int index;
   double dS,ddS;
 
-  /** - find  bracketing indices.
-      index_tau must be at least 1 (so that index_tau-1 is at least 0)
-      and at most tau_size-2 (so that index_tau+1 is at most tau_size-1).
+  /** - find bracketing indices, i.e. the smallest index such that
+      tau0_minus_tau[index] <= tau0_minus_tau_limber.
+      index must be at least 1 (so that index-1 is at least 0)
+      and at most tau_size-2 (so that index+1 is at most tau_size-1).
   */
-  index_tau=1;
-  while ((tau0_minus_tau[index_tau] > tau0_minus_tau_limber) && (index_tau<tau_size-2))
-    index_tau++;
+  index = MIN(MAX(*index_tau,1),tau_size-2);
 
-  /** - interpolate by fitting a polynomial of order two; get source
-      and its first two derivatives. Note that we are not
-      interpolating S, but the product S*(tau0-tau). Indeed this
-      product is regular in tau=tau0, while S alone diverges for
-      lensing. */
-
-  /* the case where the last of the three point is the edge (tau0=tau) must be treated separately, see below */
-  if (index_tau < tau_size-2) {
-
-    class_call(array_interpolate_parabola(tau0_minus_tau[index_tau-1],
-                                          tau0_minus_tau[index_tau],
-                                          tau0_minus_tau[index_tau+1],
-                                          tau0_minus_tau_limber,
-                                          sources[index_tau-1]*tau0_minus_tau[index_tau-1],
-                                          sources[index_tau]*tau0_minus_tau[index_tau],
-                                          sources[index_tau+1]*tau0_minus_tau[index_tau+1],
-                                          S,
-                                          &dS,
-                                          &ddS,
-                                          ptr->error_message),
-               ptr->error_message,
-               ptr->error_message);
+  if (tau0_minus_tau[index] > tau0_minus_tau_limber) {
+    while ((tau0_minus_tau[index] > tau0_minus_tau_limber) && (index<tau_size-2))
+      index++;
+  }
+  else {
+    while ((index > 1) && (tau0_minus_tau[index-1] <= tau0_minus_tau_limber))
+      index--;
+  }
+
+  *index_tau = index;
+
+  /** - interpolate by fitting a polynomial of order two; get the
+      kernel and its first two derivatives. */
+
+  class_call(array_interpolate_parabola(tau0_minus_tau[index-1],
+                                        tau0_minus_tau[index],
+                                        tau0_minus_tau[index+1],
+                                        tau0_minus_tau_limber,
+                                        limber_sources[index-1],
+                                        limber_sources[index],
+                                        limber_sources[index+1],
+                                        S,
+                                        &dS,
+                                        &ddS,
+                                        ptr->error_message),
+             ptr->error_message,
+             ptr->error_message);
+
+  return _SUCCESS_;
+
+}
+
+/**
+ * This routine prepares the direct Limber scheme of the CMB lensing
+ * potential (ppt->want_lcmb_direct_limber), for the multipoles
+ * l > ppr->l_switch_lcmb_direct_limber, at which the lensing
+ * potential is skipped by transfer_compute_for_each_q().
+ *
+ * In the Limber approximation, the multipole l only probes the
+ * source at a single wavenumber k = (l+1/2)/(tau0-tau) at each time.
+ * Instead of filling a k or q grid, and then interpolating the source
+ * in time for each value of q like transfer_limber(), we use the
+ * times tau at which the lensing source of the perturbation module
+ * is sampled after recombination, and interpolate it in k only (with
+ * the splines already computed for the other multipoles). For each
+ * multipole, this gives a list of wavenumbers, growing with tau, and
+ * the transfer functions at these wavenumbers, from which the
+ * harmonic module computes C_l^phiphi as for the full Limber scheme
+ * (see harmonic_compute_cl_lcmb_direct()).
+ *
+ * The lensing source is that of transfer_sources(), with the same
+ * rescaling and non-linear corrections, in the flat case only.
+ *
+ * @param ppt                 Input: pointer to perturbation structure
+ * @param ptr                 Input/Output: pointer to transfer structure
+ * @param tau_rec             Input: recombination time
+ * @param tau0                Input: conformal age
+ * @param tp_of_tt            Input: correspondence between perturbation and transfer types
+ * @param pert_nl_corrections Input: pointers to the non-linear correction factors of each source, or NULL
+ * @param pert_sources_spline Input: second derivative of the (corrected) sources with respect to k
+ * @return the error status
+ */
+
+int transfer_lcmb_direct_limber(
+                                struct perturbations * ppt,
+                                struct transfer * ptr,
+                                double tau_rec,
+                                double tau0,
+                                int ** tp_of_tt,
+                                double *** pert_nl_corrections,
+                                double *** pert_sources_spline
+                                ) {
+
+  int index_md = ppt->index_md_scalars;
+  int index_tp = tp_of_tt[index_md][ptr->index_tt_lcmb];
+  int k_size = ppt->k_size[index_md];
+  int l_size, index_l, index_ic, index_tau, index_tau_min, index_k, index;
+  double l, k, h, a, b, S, IPhiFlat;
+  double * nl_correction;
+  double * spline;
+  double * trsf;
+
+  l_size = ptr->l_size[index_md] - ptr->index_l_lcmb_direct;
+
+  /** - times of the lensing source after recombination, excluding tau0 */
+
+  index_tau_min = 0;
+  while (ppt->tau_sampling[index_tau_min] <= tau_rec)
+    index_tau_min++;
+
+  ptr->tau_size_lcmb_direct = MAX(ppt->tau_size - 1 - index_tau_min,0);
+
+  class_alloc(ptr->k_size_lcmb_direct,l_size*sizeof(int),ptr->error_message);
+  class_alloc(ptr->k_lcmb_direct,l_size*ptr->tau_size_lcmb_direct*sizeof(double),ptr->error_message);
+  class_alloc(ptr->transfer_lcmb_direct,ppt->ic_size[index_md]*l_size*ptr->tau_size_lcmb_direct*sizeof(double),ptr->error_message);
+
+  /** - wavenumbers probed by each multipole, within the range of the sources */
+
+  for (index_l = 0; index_l < l_size; index_l++) {
+
+    ptr->k_size_lcmb_direct[index_l] = 0;
+
+    /* above l_max of the lensing potential, no wavenumber */
+    if (ptr->index_l_lcmb_direct + index_l >= ptr->l_size_tt[index_md][ptr->index_tt_lcmb])
+      continue;
+
+    l = (double)ptr->l[ptr->index_l_lcmb_direct + index_l];
 
+    for (index_tau = index_tau_min; index_tau < index_tau_min + ptr->tau_size_lcmb_direct; index_tau++) {
+      k = (l+0.5)/(tau0-ppt->tau_sampling[index_tau]);
+      if (k < ppt->k[index_md][0])
+        continue;
+      if (k > ppt->k[index_md][k_size-1])
+        break;
+      ptr->k_lcmb_direct[index_l*ptr->tau_size_lcmb_direct + ptr->k_size_lcmb_direct[index_l]] = k;
+      ptr->k_size_lcmb_direct[index_l]++;
+    }
   }
 
-  /* in this case, we have stored a zero for sources[index_k*tau_size+index_tau+1]. But we can use in very good approximation the fact that S*(tau0-tau) is constant near tau=tau0 and replace sources[index_k*tau_size+index_tau+1]*tau0_minus_tau[index_tau+1] by sources[index_k*tau_size+index_tau]*tau0_minus_tau[index_tau] */
-  else {
+  /** - transfer functions at these wavenumbers: as in
+      transfer_limber(), transfer = source*(tau0-tau)*IPhiFlat/(l+1/2),
+      with the lensing source of transfer_sources() */
 
-    class_call(array_interpolate_parabola(tau0_minus_tau[index_tau-1],
-                                          tau0_minus_tau[index_tau],
-                                          tau0_minus_tau[index_tau+1],
-                                          tau0_minus_tau_limber,
-                                          sources[index_tau-1]*tau0_minus_tau[index_tau-1],
-                                          sources[index_tau]*tau0_minus_tau[index_tau],
-                                          sources[index_tau]*tau0_minus_tau[index_tau],
-                                          S,
-                                          &dS,
-                                          &ddS,
-                                          ptr->error_message),
-               ptr->error_message,
-               ptr->error_message);
+  for (index_ic = 0; index_ic < ppt->ic_size[index_md]; index_ic++) {
+
+    nl_correction = pert_nl_corrections[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+    spline = pert_sources_spline[index_md][index_ic * ppt->tp_size[index_md] + index_tp];
+
+    for (index_l = 0; index_l < l_size; index_l++) {
+
+      l = (double)ptr->l[ptr->index_l_lcmb_direct + index_l];
+      IPhiFlat = sqrt(_PI_/(2.*l))*(1.-0.25/l+1./32./(l*l));
+      trsf = ptr->transfer_lcmb_direct + (index_ic*l_size + index_l)*ptr->tau_size_lcmb_direct;
+
+      /* same loop over times as above, the wavenumbers growing with
+         tau: the bracketing wavenumbers of the sources are searched
+         from those of the previous time */
+      index = 0;
+      index_k = 0;
+      for (index_tau = index_tau_min; index < ptr->k_size_lcmb_direct[index_l]; index_tau++) {
+
+        k = (l+0.5)/(tau0-ppt->tau_sampling[index_tau]);
+        if (k < ppt->k[index_md][0])
+          continue;
+
+        while ((index_k+2 < k_size) && (ppt->k[index_md][index_k+1] < k))
+          index_k++;
+
+        h = ppt->k[index_md][index_k+1] - ppt->k[index_md][index_k];
+        b = (k - ppt->k[index_md][index_k])/h;
+        a = 1.-b;
+
+        S = a * _source_value_(ppt,index_md,index_ic * ppt->tp_size[index_md] + index_tp,index_tau*k_size+index_k)
+          * (nl_correction != NULL ? nl_correction[index_tau*k_size+index_k] : 1.)
+          + b * _source_value_(ppt,index_md,index_ic * ppt->tp_size[index_md] + index_tp,index_tau*k_size+index_k+1)
+          * (nl_correction != NULL ? nl_correction[index_tau*k_size+index_k+1] : 1.)
+          + ((a*a*a-a) * spline[index_tau*k_size+index_k]
+             +(b*b*b-b) * spline[index_tau*k_size+index_k+1])*h*h/6.0;
+
+        /* source*(tau0-tau), where the (tau0-tau) of the window function cancels */
+        trsf[index] = S
+          * (tau_rec-ppt->tau_sampling[index_tau])/(tau0-tau_rec)
+          * ptr->lcmb_rescale
+          * pow(k/ptr->lcmb_pivot,ptr->lcmb_tilt)
+          * IPhiFlat/(l+0.5);
+
+        index++;
+      }
+    }
   }
 
   return _SUCCESS_;
-
 }
 
 /**
@@ -4024,6 +6266,8 @@ int transfer_radial_function(
                              int index_q,
                              int index_l,
                              int x_size,
+                             int index_min,
+                             int index_max,
                              double * radial_function,
                              radial_function_type radial_type
                              ){
@@ -4032,8 +6276,8 @@ int transfer_radial_function(
   double *chi = ptw->chi;
   double *cscKgen = ptw->cscKgen;
   double *cotKgen = ptw->cotKgen;
-  int j;
-  double *Phi, *dPhi, *d2Phi, *chireverse;
+  int j, jj, j0, nj;
+  double Phi[_TRANSFER_TILE_], dPhi[_TRANSFER_TILE_], d2Phi[_TRANSFER_TILE_], chireverse[_TRANSFER_TILE_];
   double K=0.,k2=1.0;
   double sqrt_absK_over_k;
   double absK_over_k2;
@@ -4042,7 +6286,7 @@ int transfer_radial_function(
   double l = (double)ptr->l[index_l];
   double rescale_argument;
   double rescale_amplitude;
-  double* rescale_function;
+  double rescale_function[_TRANSFER_TILE_];
   int (*interpolate_Phi)(HyperInterpStruct*, int, int, double*, double*, char*);
   int (*interpolate_dPhi)(HyperInterpStruct*, int, int, double*, double*, char*);
   int (*interpolate_Phid2Phi)(HyperInterpStruct*, int, int, double*, double*, double*, char*);
@@ -4063,12 +6307,6 @@ int transfer_radial_function(
   }
   absK_over_k2 =sqrt_absK_over_k*sqrt_absK_over_k;
 
-  class_alloc(Phi,sizeof(double)*x_size,ptr->error_message);
-  class_alloc(dPhi,sizeof(double)*x_size,ptr->error_message);
-  class_alloc(d2Phi,sizeof(double)*x_size,ptr->error_message);
-  class_alloc(chireverse,sizeof(double)*x_size,ptr->error_message);
-  class_alloc(rescale_function,sizeof(double)*x_size,ptr->error_message);
-
   if (ptw->sgnK == 0) {
     pHIS = ptw->pBIS;
     rescale_argument = 1.;
@@ -4120,175 +6358,177 @@ int transfer_radial_function(
     break;
   }
 
-  //Reverse chi
-  for (j=0; j<x_size; j++) {
-    chireverse[j] = chi[x_size-1-j]*rescale_argument;
-    if (rescale_amplitude == 1.) {
-      rescale_function[j] = 1.;
-    }
-    else {
-      if (ptw->sgnK == 1) {
-        rescale_function[j] =
-          MIN(
-              rescale_amplitude
-              * (1
-                 + 0.34 * atan(ptr->l[index_l]/nu) * (chireverse[j]/rescale_argument-chi_tp)
-                 + 2.00 * pow(atan(ptr->l[index_l]/nu) * (chireverse[j]/rescale_argument-chi_tp),2)),
-              chireverse[j]/rescale_argument/sin(chireverse[j]/rescale_argument)
-              );
+  /** - the radial function is needed at index_min <= index < index_max,
+      i.e. at chi[x_size-1-j] for x_size-index_max <= j < x_size-index_min:
+      deal with these points by tiles of _TRANSFER_TILE_ values */
+  for (j0=x_size-index_max; j0<x_size-index_min; j0+=_TRANSFER_TILE_) {
+
+    nj = MIN(_TRANSFER_TILE_,x_size-index_min-j0);
+
+    //Reverse chi
+    for (jj=0, j=j0; jj<nj; jj++, j++) {
+      chireverse[jj] = chi[x_size-1-j]*rescale_argument;
+      if (rescale_amplitude == 1.) {
+        rescale_function[jj] = 1.;
       }
       else {
-        rescale_function[j] =
-          MAX(
-              rescale_amplitude
-              * (1
-                 - 0.38 * atan(ptr->l[index_l]/nu) * (chireverse[j]/rescale_argument-chi_tp)
-                 + 0.40 * pow(atan(ptr->l[index_l]/nu) * (chireverse[j]/rescale_argument-chi_tp),2)),
-              chireverse[j]/rescale_argument/sinh(chireverse[j]/rescale_argument)
-              );
+        if (ptw->sgnK == 1) {
+          rescale_function[jj] =
+            MIN(
+                rescale_amplitude
+                * (1
+                   + 0.34 * atan(ptr->l[index_l]/nu) * (chireverse[jj]/rescale_argument-chi_tp)
+                   + 2.00 * pow(atan(ptr->l[index_l]/nu) * (chireverse[jj]/rescale_argument-chi_tp),2)),
+                chireverse[jj]/rescale_argument/sin(chireverse[jj]/rescale_argument)
+                );
+        }
+        else {
+          rescale_function[jj] =
+            MAX(
+                rescale_amplitude
+                * (1
+                   - 0.38 * atan(ptr->l[index_l]/nu) * (chireverse[jj]/rescale_argument-chi_tp)
+                   + 0.40 * pow(atan(ptr->l[index_l]/nu) * (chireverse[jj]/rescale_argument-chi_tp),2)),
+                chireverse[jj]/rescale_argument/sinh(chireverse[jj]/rescale_argument)
+                );
+        }
       }
     }
-  }
 
-  /*
-    class_test(pHIS->x[0] > chireverse[0],
-    ptr->error_message,
-    "Bessels need to be interpolated at %e, outside the range in which they have been computed (>%e). Decrease their x_min.",
-    chireverse[0],
-    pHIS->x[0]);
-  */
+    /*
+      class_test(pHIS->x[0] > chireverse[0],
+      ptr->error_message,
+      "Bessels need to be interpolated at %e, outside the range in which they have been computed (>%e). Decrease their x_min.",
+      chireverse[0],
+      pHIS->x[0]);
+    */
 
-  class_test((pHIS->x[pHIS->x_size-1] < chireverse[x_size-1]) && (ptw->sgnK != 1),
-             ptr->error_message,
-             "Bessels need to be interpolated at %e, outside the range in which they have been computed (<%e). Increase their x_max.",
-             chireverse[x_size-1],
-             pHIS->x[pHIS->x_size-1]
-             );
-
-  switch (radial_type){
-  case SCALAR_TEMPERATURE_0:
-    class_call(interpolate_Phi(pHIS, x_size, index_l, chireverse, Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, NULL);
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = Phi[j]*rescale_function[j];
-    break;
-  case SCALAR_TEMPERATURE_1:
-    class_call(interpolate_dPhi(pHIS, x_size, index_l, chireverse, dPhi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, NULL, dPhi, NULL);
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = sqrt_absK_over_k*dPhi[j]*rescale_argument*rescale_function[j];
-    break;
-  case SCALAR_TEMPERATURE_2:
-    class_call(interpolate_Phid2Phi(pHIS, x_size, index_l, chireverse, Phi, d2Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, d2Phi);
-    s2 = sqrt(1.0-3.0*K/k2);
-    factor = 1.0/(2.0*s2);
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*(3*absK_over_k2*d2Phi[j]*rescale_argument*rescale_argument+Phi[j])*rescale_function[j];
-    break;
-  case SCALAR_POLARISATION_E:
-    class_call(interpolate_Phi(pHIS, x_size, index_l, chireverse, Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, NULL);
-    s2 = sqrt(1.0-3.0*K/k2);
-    factor = sqrt(3.0/8.0*(l+2.0)*(l+1.0)*l*(l-1.0))/s2;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*cscKgen[x_size-1-j]*cscKgen[x_size-1-j]*Phi[j]*rescale_function[j];
-    break;
-  case VECTOR_TEMPERATURE_1:
-    class_call(interpolate_Phi(pHIS, x_size, index_l, chireverse, Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, NULL);
-    s0 = sqrt(1.0+K/k2);
-    factor = sqrt(0.5*l*(l+1))/s0;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*cscKgen[x_size-1-j]*Phi[j]*rescale_function[j];
-    break;
-  case VECTOR_TEMPERATURE_2:
-    class_call(interpolate_PhidPhi(pHIS, x_size, index_l, chireverse, Phi, dPhi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, dPhi, NULL);
-    s0 = sqrt(1.0+K/k2);
-    ssqrt3 = sqrt(1.0-2.0*K/k2);
-    factor = sqrt(1.5*l*(l+1))/s0/ssqrt3;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*cscKgen[x_size-1-j]*(sqrt_absK_over_k*dPhi[j]*rescale_argument-cotKgen[j]*Phi[j])*rescale_function[j];
-    break;
-  case VECTOR_POLARISATION_E:
-    class_call(interpolate_PhidPhi(pHIS, x_size, index_l, chireverse, Phi, dPhi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //    hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, dPhi, NULL);
-    s0 = sqrt(1.0+K/k2);
-    ssqrt3 = sqrt(1.0-2.0*K/k2);
-    factor = 0.5*sqrt((l-1.0)*(l+2.0))/s0/ssqrt3;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*cscKgen[x_size-1-j]*(cotKgen[j]*Phi[j]+sqrt_absK_over_k*dPhi[j]*rescale_argument)*rescale_function[j];
-    break;
-  case VECTOR_POLARISATION_B:
-    class_call(interpolate_Phi(pHIS, x_size, index_l, chireverse, Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, NULL);
-    s0 = sqrt(1.0+K/k2);
-    ssqrt3 = sqrt(1.0-2.0*K/k2);
-    si = sqrt(1.0+2.0*K/k2);
-    factor = 0.5*sqrt((l-1.0)*(l+2.0))*si/s0/ssqrt3;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*cscKgen[x_size-1-j]*Phi[j]*rescale_function[j];
-    break;
-  case TENSOR_TEMPERATURE_2:
-    class_call(interpolate_Phi(pHIS, x_size, index_l, chireverse, Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, NULL);
-    ssqrt2 = sqrt(1.0-1.0*K/k2);
-    si = sqrt(1.0+2.0*K/k2);
-    factor = sqrt(3.0/8.0*(l+2.0)*(l+1.0)*l*(l-1.0))/si/ssqrt2;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*cscKgen[x_size-1-j]*cscKgen[x_size-1-j]*Phi[j]*rescale_function[j];
-    break;
-  case TENSOR_POLARISATION_E:
-    class_call(interpolate_PhidPhid2Phi(pHIS, x_size, index_l, chireverse, Phi, dPhi, d2Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, NULL);
-    ssqrt2 = sqrt(1.0-1.0*K/k2);
-    si = sqrt(1.0+2.0*K/k2);
-    factor = 0.25/si/ssqrt2;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*(absK_over_k2*d2Phi[j]*rescale_argument*rescale_argument
-                                            +4.0*cotKgen[x_size-1-j]*sqrt_absK_over_k*dPhi[j]*rescale_argument
-                                            -(1.0+4*K/k2-2.0*cotKgen[x_size-1-j]*cotKgen[x_size-1-j])*Phi[j])*rescale_function[j];
-    break;
-  case TENSOR_POLARISATION_B:
-    class_call(interpolate_PhidPhi(pHIS, x_size, index_l, chireverse, Phi, dPhi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, dPhi, NULL);
-    ssqrt2i = sqrt(1.0+3.0*K/k2);
-    ssqrt2 = sqrt(1.0-1.0*K/k2);
-    si = sqrt(1.0+2.0*K/k2);
-    factor = 0.5*ssqrt2i/ssqrt2/si;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*(sqrt_absK_over_k*dPhi[j]*rescale_argument+2.0*cotKgen[x_size-1-j]*Phi[j])*rescale_function[j];
-    break;
-  case NC_RSD:
-    class_call(interpolate_Phid2Phi(pHIS, x_size, index_l, chireverse, Phi, d2Phi, ptr->error_message),
-               ptr->error_message, ptr->error_message);
-    //hyperspherical_Hermite_interpolation_vector(pHIS, x_size, index_l, chireverse, Phi, NULL, d2Phi);
-    //s2 = sqrt(1.0-3.0*K/k2);
-    factor = 1.0;
-    for (j=0; j<x_size; j++)
-      radial_function[x_size-1-j] = factor*absK_over_k2*d2Phi[j]*rescale_argument*rescale_argument*rescale_function[j];
-    // Note: in previous line there was a missing factor absK_over_k2 until version 2.4.3. Credits Francesco Montanari.
-    break;
+    class_test((pHIS->x[pHIS->x_size-1] < chireverse[nj-1]) && (ptw->sgnK != 1),
+               ptr->error_message,
+               "Bessels need to be interpolated at %e, outside the range in which they have been computed (<%e). Increase their x_max.",
+               chireverse[nj-1],
+               pHIS->x[pHIS->x_size-1]
+               );
+
+    switch (radial_type){
+    case SCALAR_TEMPERATURE_0:
+      class_call(interpolate_Phi(pHIS, nj, index_l, chireverse, Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, NULL);
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = Phi[jj]*rescale_function[jj];
+      break;
+    case SCALAR_TEMPERATURE_1:
+      class_call(interpolate_dPhi(pHIS, nj, index_l, chireverse, dPhi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, NULL, dPhi, NULL);
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = sqrt_absK_over_k*dPhi[jj]*rescale_argument*rescale_function[jj];
+      break;
+    case SCALAR_TEMPERATURE_2:
+      class_call(interpolate_Phid2Phi(pHIS, nj, index_l, chireverse, Phi, d2Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, d2Phi);
+      s2 = sqrt(1.0-3.0*K/k2);
+      factor = 1.0/(2.0*s2);
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*(3*absK_over_k2*d2Phi[jj]*rescale_argument*rescale_argument+Phi[jj])*rescale_function[jj];
+      break;
+    case SCALAR_POLARISATION_E:
+      class_call(interpolate_Phi(pHIS, nj, index_l, chireverse, Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, NULL);
+      s2 = sqrt(1.0-3.0*K/k2);
+      factor = sqrt(3.0/8.0*(l+2.0)*(l+1.0)*l*(l-1.0))/s2;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*cscKgen[x_size-1-j]*cscKgen[x_size-1-j]*Phi[jj]*rescale_function[jj];
+      break;
+    case VECTOR_TEMPERATURE_1:
+      class_call(interpolate_Phi(pHIS, nj, index_l, chireverse, Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, NULL);
+      s0 = sqrt(1.0+K/k2);
+      factor = sqrt(0.5*l*(l+1))/s0;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*cscKgen[x_size-1-j]*Phi[jj]*rescale_function[jj];
+      break;
+    case VECTOR_TEMPERATURE_2:
+      class_call(interpolate_PhidPhi(pHIS, nj, index_l, chireverse, Phi, dPhi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, dPhi, NULL);
+      s0 = sqrt(1.0+K/k2);
+      ssqrt3 = sqrt(1.0-2.0*K/k2);
+      factor = sqrt(1.5*l*(l+1))/s0/ssqrt3;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*cscKgen[x_size-1-j]*(sqrt_absK_over_k*dPhi[jj]*rescale_argument-cotKgen[j]*Phi[jj])*rescale_function[jj];
+      break;
+    case VECTOR_POLARISATION_E:
+      class_call(interpolate_PhidPhi(pHIS, nj, index_l, chireverse, Phi, dPhi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //    hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, dPhi, NULL);
+      s0 = sqrt(1.0+K/k2);
+      ssqrt3 = sqrt(1.0-2.0*K/k2);
+      factor = 0.5*sqrt((l-1.0)*(l+2.0))/s0/ssqrt3;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*cscKgen[x_size-1-j]*(cotKgen[j]*Phi[jj]+sqrt_absK_over_k*dPhi[jj]*rescale_argument)*rescale_function[jj];
+      break;
+    case VECTOR_POLARISATION_B:
+      class_call(interpolate_Phi(pHIS, nj, index_l, chireverse, Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, NULL);
+      s0 = sqrt(1.0+K/k2);
+      ssqrt3 = sqrt(1.0-2.0*K/k2);
+      si = sqrt(1.0+2.0*K/k2);
+      factor = 0.5*sqrt((l-1.0)*(l+2.0))*si/s0/ssqrt3;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*cscKgen[x_size-1-j]*Phi[jj]*rescale_function[jj];
+      break;
+    case TENSOR_TEMPERATURE_2:
+      class_call(interpolate_Phi(pHIS, nj, index_l, chireverse, Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, NULL);
+      ssqrt2 = sqrt(1.0-1.0*K/k2);
+      si = sqrt(1.0+2.0*K/k2);
+      factor = sqrt(3.0/8.0*(l+2.0)*(l+1.0)*l*(l-1.0))/si/ssqrt2;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*cscKgen[x_size-1-j]*cscKgen[x_size-1-j]*Phi[jj]*rescale_function[jj];
+      break;
+    case TENSOR_POLARISATION_E:
+      class_call(interpolate_PhidPhid2Phi(pHIS, nj, index_l, chireverse, Phi, dPhi, d2Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, NULL);
+      ssqrt2 = sqrt(1.0-1.0*K/k2);
+      si = sqrt(1.0+2.0*K/k2);
+      factor = 0.25/si/ssqrt2;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*(absK_over_k2*d2Phi[jj]*rescale_argument*rescale_argument
+                                              +4.0*cotKgen[x_size-1-j]*sqrt_absK_over_k*dPhi[jj]*rescale_argument
+                                              -(1.0+4*K/k2-2.0*cotKgen[x_size-1-j]*cotKgen[x_size-1-j])*Phi[jj])*rescale_function[jj];
+      break;
+    case TENSOR_POLARISATION_B:
+      class_call(interpolate_PhidPhi(pHIS, nj, index_l, chireverse, Phi, dPhi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, dPhi, NULL);
+      ssqrt2i = sqrt(1.0+3.0*K/k2);
+      ssqrt2 = sqrt(1.0-1.0*K/k2);
+      si = sqrt(1.0+2.0*K/k2);
+      factor = 0.5*ssqrt2i/ssqrt2/si;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*(sqrt_absK_over_k*dPhi[jj]*rescale_argument+2.0*cotKgen[x_size-1-j]*Phi[jj])*rescale_function[jj];
+      break;
+    case NC_RSD:
+      class_call(interpolate_Phid2Phi(pHIS, nj, index_l, chireverse, Phi, d2Phi, ptr->error_message),
+                 ptr->error_message, ptr->error_message);
+      //hyperspherical_Hermite_interpolation_vector(pHIS, nj, index_l, chireverse, Phi, NULL, d2Phi);
+      //s2 = sqrt(1.0-3.0*K/k2);
+      factor = 1.0;
+      for (jj=0, j=j0; jj<nj; jj++, j++)
+        radial_function[x_size-1-j-index_min] = factor*absK_over_k2*d2Phi[jj]*rescale_argument*rescale_argument*rescale_function[jj];
+      // Note: in previous line there was a missing factor absK_over_k2 until version 2.4.3. Credits Francesco Montanari.
+      break;
+    }
   }
 
-  free(Phi);
-  free(dPhi);
-  free(d2Phi);
-  free(chireverse);
-  free(rescale_function);
-
   return _SUCCESS_;
 }
 
@@ -4391,41 +6631,36 @@ int transfer_select_radial_function(
 /* for reading global selection function (ie the one multiplying the selection function of each bin) */
 
 int transfer_global_selection_read(
+                                   struct precision * ppr,
                                    struct transfer * ptr
                                    ) {
 
-  /* for reading selection function */
-  FILE * input_file;
-  int row,status;
-  double tmp1,tmp2;
+  /* for reading selection function (the files are parsed once per process, see data_file_get()) */
+  struct data_file * pdf;
+  int row;
 
   ptr->nz_size = 0;
 
   if (ptr->has_nz_file == _TRUE_) {
 
-    input_file = fopen(ptr->nz_file_name,"r");
-    class_test(input_file == NULL,
+    class_call(data_file_get(ptr->nz_file_name,
+                             data_file_columns,
+                             2,
+                             ppr->data_binary_files,
+                             &pdf,
+                             ptr->error_message),
                ptr->error_message,
-               "Could not open file %s!",ptr->nz_file_name);
-
-    /* Find size of table */
-    for (row=0,status=2; status==2; row++){
-      status = fscanf(input_file,"%lf %lf",&tmp1,&tmp2);
-    }
-    rewind(input_file);
-    ptr->nz_size = row-1;
+               ptr->error_message);
+    ptr->nz_size = pdf->rows;
 
     /* Allocate room for interpolation table */
     class_alloc(ptr->nz_z,sizeof(double)*ptr->nz_size,ptr->error_message);
     class_alloc(ptr->nz_nz,sizeof(double)*ptr->nz_size,ptr->error_message);
     class_alloc(ptr->nz_ddnz,sizeof(double)*ptr->nz_size,ptr->error_message);
 
-    for (row=0; row<ptr->nz_size; row++){
-      status = fscanf(input_file,"%lf %lf",
-                      &ptr->nz_z[row],&ptr->nz_nz[row]);
-      //printf("%d: (z,dNdz) = (%g,%g)\n",row,ptr->nz_z[row],ptr->nz_nz[row]);
-    }
-    fclose(input_file);
+    memcpy(ptr->nz_z,pdf->data,sizeof(double)*ptr->nz_size);
+    memcpy(ptr->nz_nz,pdf->data+pdf->rows,sizeof(double)*ptr->nz_size);
+    data_file_release(pdf);
 
     /* Call spline interpolation: */
     class_call(array_spline_table_lines(ptr->nz_z,
@@ -4443,17 +6678,15 @@ int transfer_global_selection_read(
 
   if (ptr->has_nz_evo_file == _TRUE_) {
 
-    input_file = fopen(ptr->nz_evo_file_name,"r");
-    class_test(input_file == NULL,
+    class_call(data_file_get(ptr->nz_evo_file_name,
+                             data_file_columns,
+                             2,
+                             ppr->data_binary_files,
+                             &pdf,
+                             ptr->error_message),
                ptr->error_message,
-               "Could not open file %s!",ptr->nz_evo_file_name);
-
-    /* Find size of table */
-    for (row=0,status=2; status==2; row++){
-      status = fscanf(input_file,"%lf %lf",&tmp1,&tmp2);
-    }
-    rewind(input_file);
-    ptr->nz_evo_size = row-1;
+               ptr->error_message);
+    ptr->nz_evo_size = pdf->rows;
 
     /* Allocate room for interpolation table */
     class_alloc(ptr->nz_evo_z,sizeof(double)*ptr->nz_evo_size,ptr->error_message);
@@ -4461,11 +6694,9 @@ int transfer_global_selection_read(
     class_alloc(ptr->nz_evo_dlog_nz,sizeof(double)*ptr->nz_evo_size,ptr->error_message);
     class_alloc(ptr->nz_evo_dd_dlog_nz,sizeof(double)*ptr->nz_evo_size,ptr->error_message);
 
-    for (row=0; row<ptr->nz_evo_size; row++){
-      status = fscanf(input_file,"%lf %lf",
-                      &ptr->nz_evo_z[row],&ptr->nz_evo_nz[row]);
-    }
-    fclose(input_file);
+    memcpy(ptr->nz_evo_z,pdf->data,sizeof(double)*ptr->nz_evo_size);
+    memcpy(ptr->nz_evo_nz,pdf->data+pdf->rows,sizeof(double)*ptr->nz_evo_size);
+    data_file_release(pdf);
 
     /* infer dlog(dN/dz)/dz from dN/dz */
     ptr->nz_evo_dlog_nz[0] =
@@ -4511,16 +6742,20 @@ int transfer_workspace_init(
                             double K,
                             int sgnK,
                             double tau0_minus_tau_cut,
-                            HyperInterpStruct * pBIS){
+                            HyperInterpStruct * pBIS,
+                            struct transfer_offload * pto){
 
   ptw->tau_size_max = tau_size_max;
   ptw->l_size = ptr->l_size_max;
   ptw->HIS_allocated=_FALSE_;
   ptw->pBIS = pBIS;
+  ptw->pto = pto;
   ptw->K = K;
   ptw->sgnK = sgnK;
   ptw->tau0_minus_tau_cut = tau0_minus_tau_cut;
   ptw->neglect_late_source = _FALSE_;
+  ptw->l_needed = NULL;
+  ptw->psc = NULL;
 
   class_alloc(ptw->interpolated_sources,perturbations_tau_size*sizeof(double),ptr->error_message);
   class_alloc(ptw->sources,tau_size_max*sizeof(double),ptr->error_message);
@@ -4529,6 +6764,21 @@ int transfer_workspace_init(
   class_alloc(ptw->chi,tau_size_max*sizeof(double),ptr->error_message);
   class_alloc(ptw->cscKgen,tau_size_max*sizeof(double),ptr->error_message);
   class_alloc(ptw->cotKgen,tau_size_max*sizeof(double),ptr->error_message);
+  class_alloc(ptw->radial_function,tau_size_max*sizeof(double),ptr->error_message);
+  class_alloc(ptw->limber_sources,tau_size_max*sizeof(double),ptr->error_message);
+  ptw->limber_index_tau = -1;
+
+  ptw->l_block_size = MAX(1,ppr->transfer_l_block_size);
+  /* with a device, one kernel per wavenumber and type for all the multipoles */
+  if (pto->is_active == _TRUE_)
+    ptw->l_block_size = MAX(ptw->l_block_size,ptr->l_size_max);
+  ptw->l_block_num = 0;
+  class_alloc(ptw->l_block_index_l,ptw->l_block_size*sizeof(int),ptr->error_message);
+  class_alloc(ptw->l_block_neglect_late_source,ptw->l_block_size*sizeof(short),ptr->error_message);
+  class_alloc(ptw->l_block_index_tau_max,ptw->l_block_size*sizeof(int),ptr->error_message);
+  class_alloc(ptw->l_block_bessel_truncation,ptw->l_block_size*sizeof(short),ptr->error_message);
+  class_alloc(ptw->l_block_tau0_minus_tau_min_bessel,ptw->l_block_size*sizeof(double),ptr->error_message);
+  class_alloc(ptw->l_block_trsf,ptw->l_block_size*sizeof(double),ptr->error_message);
 
   return _SUCCESS_;
 }
@@ -4551,6 +6801,14 @@ int transfer_workspace_free(
   free(ptw->chi);
   free(ptw->cscKgen);
   free(ptw->cotKgen);
+  free(ptw->radial_function);
+  free(ptw->limber_sources);
+  free(ptw->l_block_index_l);
+  free(ptw->l_block_neglect_late_source);
+  free(ptw->l_block_index_tau_max);
+  free(ptw->l_block_bessel_truncation);
+  free(ptw->l_block_tau0_minus_tau_min_bessel);
+  free(ptw->l_block_trsf);
 
   return _SUCCESS_;
 }
@@ -4838,6 +7096,86 @@ int transfer_precompute_selection(
 
   /** - define local variables */
 
+  /* conformal time today */
+  double tau0;
+
+  /* array of selection functions, shared by all threads */
+  double * window_all;
+
+  int index_md = ppt->index_md_scalars;
+  int index_tt;
+
+  /* allocate output */
+  class_alloc((*window),tau_size_max*ptr->tt_size[index_md]*sizeof(double),ptr->error_message);
+  window_all = *window;
+
+  /* conformal time today */
+  tau0 = pba->conformal_age;
+
+  class_setup_parallel();
+
+  /** - loop over types (parallelized): each type (i.e. each
+      contribution of each bin) fills its own slice of the window
+      array, with its own temporary arrays */
+  for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+
+    class_label_parallel("transfer:index_tt",index_tt);
+    class_run_parallel(with_arguments(ppr,pba,ppt,ptr,tau_rec,tau0,tau_size_max,index_md,index_tt,window_all),
+
+      class_call(transfer_precompute_selection_for_each_type(ppr,
+                                                             pba,
+                                                             ppt,
+                                                             ptr,
+                                                             tau_rec,
+                                                             tau0,
+                                                             tau_size_max,
+                                                             index_md,
+                                                             index_tt,
+                                                             window_all),
+                 ptr->error_message,
+                 ptr->error_message);
+      return _SUCCESS_;
+    );
+  }
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute the window function of one type (see
+ * transfer_precompute_selection()). Called in parallel for each type:
+ * only writes in the slice window[index_tt*tau_size_max+...].
+ *
+ * @param ppr                   Input: pointer to precision structure
+ * @param pba                   Input: pointer to background structure
+ * @param ppt                   Input: pointer to perturbation structure
+ * @param ptr                   Input: pointer to transfer structure
+ * @param tau_rec               Input: recombination time
+ * @param tau0                  Input: conformal time today
+ * @param tau_size_max          Input: maximum size that tau array can have
+ * @param index_md              Input: index of mode (scalars)
+ * @param index_tt              Input: index of type
+ * @param window                Output: array of selection functions (already allocated)
+ * @return the error status
+ */
+
+int transfer_precompute_selection_for_each_type(
+                                                struct precision * ppr,
+                                                struct background * pba,
+                                                struct perturbations * ppt,
+                                                struct transfer * ptr,
+                                                double tau_rec,
+                                                double tau0,
+                                                int tau_size_max,
+                                                int index_md,
+                                                int index_tt,
+                                                double * window
+                                                ){
+
+  /** - define local variables */
+
   double* tau0_minus_tau;
   double* w_trapz;
 
@@ -4850,12 +7188,13 @@ int transfer_precompute_selection(
   /* number of tau values */
   int tau_size;
 
-  /* for calling background_at_eta */
-  int last_index;
+  /* for calling background_at_eta (with inter_closeby: times are
+     scanned in increasing order) */
+  int last_index=0;
   double * pvecback = NULL;
 
   /* conformal time */
-  double tau, tau0;
+  double tau;
 
   /* geometrical quantities */
   double sinKgen_source=0.;
@@ -4875,6 +7214,9 @@ int transfer_precompute_selection(
   /* trapezoidal weights for lensing source selection function */
   double * w_trapz_lensing_sources;
 
+  /* background-dependent factor of the g5 term at each source time */
+  double * g5_factor_lensing_sources;
+
   /* index running on time in previous two arrays */
   int index_tau_sources;
 
@@ -4884,401 +7226,427 @@ int transfer_precompute_selection(
   /* source evolution factor */
   double f_evo = 0.;
 
-
-  /* Setup initial variables and arrays*/
-  int index_md = ppt->index_md_scalars;
-  int index_tt;
-
-  /* allocate temporary arrays for storing selections, weights, times, and output; and for calling background */
+  /* allocate temporary arrays for storing selections, weights, times; and for calling background */
   class_alloc(tau0_minus_tau,tau_size_max*sizeof(double),ptr->error_message);
   class_alloc(selection,tau_size_max*sizeof(double),ptr->error_message);
   class_alloc(w_trapz,tau_size_max*sizeof(double),ptr->error_message);
-  class_alloc((*window),tau_size_max*ptr->tt_size[index_md]*sizeof(double),ptr->error_message);
   class_alloc(pvecback,pba->bg_size*sizeof(double),ptr->error_message);
 
-  /* conformal time today */
-  tau0 = pba->conformal_age;
+  /* First set the corresponding tau size */
+  class_call(transfer_source_tau_size(ppr,
+                                      pba,
+                                      ppt,
+                                      ptr,
+                                      tau_rec,
+                                      tau0,
+                                      index_md,
+                                      index_tt,
+                                      &tau_size),
+             ptr->error_message,
+             ptr->error_message);
 
-  /* Loop through different types to be precomputed */
-  for (index_tt = 0; index_tt < ptr->tt_size[index_md]; index_tt++) {
+  /* Start with non-integrated contributions */
+  if (_nonintegrated_ncl_) {
 
-    /* First set the corresponding tau size */
-    class_call(transfer_source_tau_size(ppr,
-                                        pba,
-                                        ppt,
-                                        ptr,
-                                        tau_rec,
-                                        tau0,
-                                        index_md,
-                                        index_tt,
-                                        &tau_size),
+    _get_bin_nonintegrated_ncl_(index_tt)
+
+      /* redefine the time sampling */
+      class_call(transfer_selection_sampling(ppr,
+                                             pba,
+                                             ppt,
+                                             ptr,
+                                             bin,
+                                             tau0_minus_tau,
+                                             tau_size),
+                 ptr->error_message,
+                 ptr->error_message);
+
+    class_test(tau0 - tau0_minus_tau[0] > ppt->tau_sampling[ppt->tau_size-1],
+               ptr->error_message,
+               "this should not happen, there was probably a rounding error, if this error occurred, then this must be coded more carefully");
+
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau,
+                                          tau_size,
+                                          w_trapz,
+                                          ptr->error_message),
                ptr->error_message,
                ptr->error_message);
 
-    /* Start with non-integrated contributions */
-    if (_nonintegrated_ncl_) {
+    /* compute values of selection function at sampled values of tau */
+    class_call(transfer_selection_compute(ppr,
+                                          pba,
+                                          ppt,
+                                          ptr,
+                                          selection,
+                                          tau0_minus_tau,
+                                          w_trapz,
+                                          tau_size,
+                                          pvecback,
+                                          tau0,
+                                          bin),
+               ptr->error_message,
+               ptr->error_message);
 
-      _get_bin_nonintegrated_ncl_(index_tt)
+    /* loop over time and rescale */
+    for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
-        /* redefine the time sampling */
-        class_call(transfer_selection_sampling(ppr,
-                                               pba,
-                                               ppt,
-                                               ptr,
-                                               bin,
-                                               tau0_minus_tau,
-                                               tau_size),
-                   ptr->error_message,
-                   ptr->error_message);
+      /* conformal time */
+      tau = tau0 - tau0_minus_tau[index_tau];
 
-      class_test(tau0 - tau0_minus_tau[0] > ppt->tau_sampling[ppt->tau_size-1],
-                 ptr->error_message,
-                 "this should not happen, there was probably a rounding error, if this error occurred, then this must be coded more carefully");
+      /* geometrical quantity */
+      switch (pba->sgnK){
+      case 1:
+        cotKgen_source = sqrt(pba->K)
+          *cos(tau0_minus_tau[index_tau]*sqrt(pba->K))
+          /sin(tau0_minus_tau[index_tau]*sqrt(pba->K));
+        break;
+      case 0:
+        cotKgen_source = 1./(tau0_minus_tau[index_tau]);
+        break;
+      case -1:
+        cotKgen_source = sqrt(-pba->K)
+          *cosh(tau0_minus_tau[index_tau]*sqrt(-pba->K))
+          /sinh(tau0_minus_tau[index_tau]*sqrt(-pba->K));
+        break;
+      }
 
-      /* Compute trapezoidal weights for integration over tau */
-      class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                            tau_size,
-                                            w_trapz,
-                                            ptr->error_message),
-                 ptr->error_message,
+      /* corresponding background quantities */
+      class_call(background_at_tau(pba,
+                                   tau,
+                                   long_info,
+                                   inter_closeby,
+                                   &last_index,
+                                   pvecback),
+                 pba->error_message,
                  ptr->error_message);
 
-      /* compute values of selection function at sampled values of tau */
-      class_call(transfer_selection_compute(ppr,
-                                            pba,
-                                            ppt,
-                                            ptr,
-                                            selection,
-                                            tau0_minus_tau,
-                                            w_trapz,
-                                            tau_size,
-                                            pvecback,
-                                            tau0,
-                                            bin),
-                 ptr->error_message,
-                 ptr->error_message);
+      /* Source evolution, used by nCl doppler and nCl gravity terms */
 
-      /* loop over time and rescale */
-      for (index_tau = 0; index_tau < tau_size; index_tau++) {
-
-        /* conformal time */
-        tau = tau0 - tau0_minus_tau[index_tau];
-
-        /* geometrical quantity */
-        switch (pba->sgnK){
-        case 1:
-          cotKgen_source = sqrt(pba->K)
-            *cos(tau0_minus_tau[index_tau]*sqrt(pba->K))
-            /sin(tau0_minus_tau[index_tau]*sqrt(pba->K));
-          break;
-        case 0:
-          cotKgen_source = 1./(tau0_minus_tau[index_tau]);
-          break;
-        case -1:
-          cotKgen_source = sqrt(-pba->K)
-            *cosh(tau0_minus_tau[index_tau]*sqrt(-pba->K))
-            /sinh(tau0_minus_tau[index_tau]*sqrt(-pba->K));
-          break;
+      if ((_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
+          (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
+          (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr)))
+        {
+          class_call(transfer_f_evo(pba,ptr,pvecback,last_index,cotKgen_source,&f_evo),
+                     ptr->error_message,
+                     ptr->error_message);
+          /* Error in old CLASS 2.6.3 : Number count evolution did not respect curvature */
         }
 
-        /* corresponding background quantities */
-        class_call(background_at_tau(pba,
-                                     tau,
-                                     long_info,
-                                     inter_normal,
-                                     &last_index,
-                                     pvecback),
-                   pba->error_message,
-                   ptr->error_message);
-
-        /* Source evolution, used by nCl doppler and nCl gravity terms */
-
-        if ((_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd)) ||
-            (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd)) ||
-            (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr)))
-          {
-            class_call(transfer_f_evo(pba,ptr,pvecback,last_index,cotKgen_source,&f_evo),
-                       ptr->error_message,
-                       ptr->error_message);
-            /* Error in old CLASS 2.6.3 : Number count evolution did not respect curvature */
-          }
-
-        /* matter density source =  [- (dz/dtau) W(z)] * delta_m(k,tau)
-           = W(tau) delta_m(k,tau)
-           with
-           delta_m = total matter perturbation (defined in gauge-independent way, see arXiv 1307.1459)
-           W(z) = redshift space selection function = dN/dz
-           W(tau) = same wrt conformal time = dN/dtau
-           (in tau = tau_0, set source = 0 to avoid division by zero;
-           regulated anyway by Bessel).
-        */
+      /* matter density source =  [- (dz/dtau) W(z)] * delta_m(k,tau)
+         = W(tau) delta_m(k,tau)
+         with
+         delta_m = total matter perturbation (defined in gauge-independent way, see arXiv 1307.1459)
+         W(z) = redshift space selection function = dN/dz
+         W(tau) = same wrt conformal time = dN/dtau
+         (in tau = tau_0, set source = 0 to avoid division by zero;
+         regulated anyway by Bessel).
+      */
 
-        if (_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density))
-          rescaling = ptr->selection_bias[bin]*selection[index_tau];
+      if (_index_tt_in_range_(ptr->index_tt_density, ppt->selection_num, ppt->has_nc_density))
+        rescaling = ptr->selection_bias[bin]*selection[index_tau];
 
-        /* redshift space distortion source = - [- (dz/dtau) W(z)] * (k/H) * theta(k,tau) */
+      /* redshift space distortion source = - [- (dz/dtau) W(z)] * (k/H) * theta(k,tau) */
 
-        if (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd))
-          rescaling = selection[index_tau]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
+      if (_index_tt_in_range_(ptr->index_tt_rsd,     ppt->selection_num, ppt->has_nc_rsd))
+        rescaling = selection[index_tau]/pvecback[pba->index_bg_H]/pvecback[pba->index_bg_a];
 
-        if (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd))
-          rescaling = (f_evo-3.)*selection[index_tau]*pvecback[pba->index_bg_H]*pvecback[pba->index_bg_a];
+      if (_index_tt_in_range_(ptr->index_tt_d0,      ppt->selection_num, ppt->has_nc_rsd))
+        rescaling = (f_evo-3.)*selection[index_tau]*pvecback[pba->index_bg_H]*pvecback[pba->index_bg_a];
 
-        if (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd))
+      if (_index_tt_in_range_(ptr->index_tt_d1,      ppt->selection_num, ppt->has_nc_rsd))
 
-          rescaling = selection[index_tau]*(1.
-                                            +pvecback[pba->index_bg_H_prime]
-                                            /pvecback[pba->index_bg_a]
-                                            /pvecback[pba->index_bg_H]
-                                            /pvecback[pba->index_bg_H]
-                                            +(2.-5.*ptr->selection_magnification_bias[bin])
-                                            // /tau0_minus_tau[index_tau] // in flat space
-                                            *cotKgen_source  // in general case
-                                            /pvecback[pba->index_bg_a]
-                                            /pvecback[pba->index_bg_H]
-                                            +5.*ptr->selection_magnification_bias[bin]
-                                            -f_evo
-                                            );
+        rescaling = selection[index_tau]*(1.
+                                          +pvecback[pba->index_bg_H_prime]
+                                          /pvecback[pba->index_bg_a]
+                                          /pvecback[pba->index_bg_H]
+                                          /pvecback[pba->index_bg_H]
+                                          +(2.-5.*ptr->selection_magnification_bias[bin])
+                                          // /tau0_minus_tau[index_tau] // in flat space
+                                          *cotKgen_source  // in general case
+                                          /pvecback[pba->index_bg_a]
+                                          /pvecback[pba->index_bg_H]
+                                          +5.*ptr->selection_magnification_bias[bin]
+                                          -f_evo
+                                          );
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))
+      if (_index_tt_in_range_(ptr->index_tt_nc_g1,   ppt->selection_num, ppt->has_nc_gr))
 
-          rescaling = selection[index_tau];
+        rescaling = selection[index_tau];
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))
+      if (_index_tt_in_range_(ptr->index_tt_nc_g2,   ppt->selection_num, ppt->has_nc_gr))
 
-          rescaling = -selection[index_tau]*(3.
-                                             +pvecback[pba->index_bg_H_prime]
-                                             /pvecback[pba->index_bg_a]
-                                             /pvecback[pba->index_bg_H]
-                                             /pvecback[pba->index_bg_H]
-                                             +(2.-5.*ptr->selection_magnification_bias[bin])
-                                             // /tau0_minus_tau[index_tau]  // in flat space
-                                             *cotKgen_source  // in general case
-                                             /pvecback[pba->index_bg_a]
-                                             /pvecback[pba->index_bg_H]
-                                             -f_evo
-                                             );
+        rescaling = -selection[index_tau]*(3.
+                                           +pvecback[pba->index_bg_H_prime]
+                                           /pvecback[pba->index_bg_a]
+                                           /pvecback[pba->index_bg_H]
+                                           /pvecback[pba->index_bg_H]
+                                           +(2.-5.*ptr->selection_magnification_bias[bin])
+                                           // /tau0_minus_tau[index_tau]  // in flat space
+                                           *cotKgen_source  // in general case
+                                           /pvecback[pba->index_bg_a]
+                                           /pvecback[pba->index_bg_H]
+                                           -f_evo
+                                           );
 
-        if (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
-          rescaling = selection[index_tau]/pvecback[pba->index_bg_a]/pvecback[pba->index_bg_H];
+      if (_index_tt_in_range_(ptr->index_tt_nc_g3,   ppt->selection_num, ppt->has_nc_gr))
+        rescaling = selection[index_tau]/pvecback[pba->index_bg_a]/pvecback[pba->index_bg_H];
 
-        /* finally store in array */
-        (*window)[index_tt*tau_size_max+index_tau] = rescaling;
-      }
+      /* finally store in array */
+      window[index_tt*tau_size_max+index_tau] = rescaling;
     }
-    /* End non-integrated contribution */
-
-    /* Now deal with integrated contributions */
-    if (_integrated_ncl_) {
-
-      _get_bin_integrated_ncl_(index_tt)
-
-        /* dirac case */
-        if (ppt->selection == dirac) {
-          tau_sources_size=1;
-        }
-      /* other cases (gaussian, tophat...) */
-        else {
-          tau_sources_size=ppr->selection_sampling;
-        }
+  }
+  /* End non-integrated contribution */
 
-      class_alloc(tau0_minus_tau_lensing_sources,
-                  tau_sources_size*sizeof(double),
-                  ptr->error_message);
+  /* Now deal with integrated contributions */
+  if (_integrated_ncl_) {
 
-      class_alloc(w_trapz_lensing_sources,
-                  tau_sources_size*sizeof(double),
-                  ptr->error_message);
+    _get_bin_integrated_ncl_(index_tt)
 
-      /* time sampling for source selection function */
-      class_call(transfer_selection_sampling(ppr,
-                                             pba,
-                                             ppt,
-                                             ptr,
-                                             bin,
-                                             tau0_minus_tau_lensing_sources,
-                                             tau_sources_size),
-                 ptr->error_message,
-                 ptr->error_message);
+      /* dirac case */
+      if (ppt->selection == dirac) {
+        tau_sources_size=1;
+      }
+    /* other cases (gaussian, tophat...) */
+      else {
+        tau_sources_size=ppr->selection_sampling;
+      }
 
-      /* Compute trapezoidal weights for integration over tau */
-      class_call(array_trapezoidal_mweights(tau0_minus_tau_lensing_sources,
-                                            tau_sources_size,
-                                            w_trapz_lensing_sources,
-                                            ptr->error_message),
-                 ptr->error_message,
-                 ptr->error_message);
+    class_alloc(tau0_minus_tau_lensing_sources,
+                tau_sources_size*sizeof(double),
+                ptr->error_message);
 
-      /* compute values of selection function at sampled values of tau */
-      class_call(transfer_selection_compute(ppr,
-                                            pba,
-                                            ppt,
-                                            ptr,
-                                            selection,
-                                            tau0_minus_tau_lensing_sources,
-                                            w_trapz_lensing_sources,
-                                            tau_sources_size,
-                                            pvecback,
-                                            tau0,
-                                            bin),
-                 ptr->error_message,
-                 ptr->error_message);
+    class_alloc(w_trapz_lensing_sources,
+                tau_sources_size*sizeof(double),
+                ptr->error_message);
 
-      /* redefine the time sampling */
-      class_call(transfer_lensing_sampling(ppr,
+    /* time sampling for source selection function */
+    class_call(transfer_selection_sampling(ppr,
                                            pba,
                                            ppt,
                                            ptr,
                                            bin,
-                                           tau0,
-                                           tau0_minus_tau,
-                                           tau_size),
-                 ptr->error_message,
-                 ptr->error_message);
+                                           tau0_minus_tau_lensing_sources,
+                                           tau_sources_size),
+               ptr->error_message,
+               ptr->error_message);
 
-      /* Compute trapezoidal weights for integration over tau */
-      class_call(array_trapezoidal_mweights(tau0_minus_tau,
-                                            tau_size,
-                                            w_trapz,
-                                            ptr->error_message),
-                 ptr->error_message,
-                 ptr->error_message);
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau_lensing_sources,
+                                          tau_sources_size,
+                                          w_trapz_lensing_sources,
+                                          ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
+
+    /* compute values of selection function at sampled values of tau */
+    class_call(transfer_selection_compute(ppr,
+                                          pba,
+                                          ppt,
+                                          ptr,
+                                          selection,
+                                          tau0_minus_tau_lensing_sources,
+                                          w_trapz_lensing_sources,
+                                          tau_sources_size,
+                                          pvecback,
+                                          tau0,
+                                          bin),
+               ptr->error_message,
+               ptr->error_message);
 
-      /* loop over time and rescale */
-      for (index_tau = 0; index_tau < tau_size; index_tau++) {
+    /* the g5 term depends on the background at the source time
+       only: compute it once for each source time, rather than inside
+       the loop over lensing times */
+    if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr)) {
 
-        /* lensing source =  - W(tau) (phi(k,tau) + psi(k,tau)) Heaviside(tau-tau_rec)
-           with
-           psi,phi = metric perturbation in newtonian gauge (phi+psi = Phi_A-Phi_H of Bardeen)
-           W = (tau-tau_rec)/(tau_0-tau)/(tau_0-tau_rec)
-           H(x) = Heaviside
-           (in tau = tau_0, set source = 0 to avoid division by zero;
-           regulated anyway by Bessel).
-        */
+      class_alloc(g5_factor_lensing_sources,
+                  tau_sources_size*sizeof(double),
+                  ptr->error_message);
 
-        if (index_tau == tau_size-1) {
-          rescaling=0.;
-        }
-        else {
+      for (index_tau_sources=0;
+           index_tau_sources < tau_sources_size;
+           index_tau_sources++) {
+
+        g5_factor_lensing_sources[index_tau_sources] = 0.;
+
+        /* sources located in z=zero are excluded from the sum anyway */
+        if (tau0_minus_tau_lensing_sources[index_tau_sources] > 0.) {
+
+          switch (pba->sgnK){
+          case 1:
+            sinKgen_source = sin(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sqrt(pba->K);
+            cotKgen_source = cos(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sinKgen_source;
+            break;
+          case 0:
+            cotKgen_source = 1./(tau0_minus_tau_lensing_sources[index_tau_sources]);
+            break;
+          case -1:
+            sinKgen_source = sinh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sqrt(-pba->K);
+            cotKgen_source = cosh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sinKgen_source;
+            break;
+          }
 
-          rescaling = 0.;
+          /* background quantities at time tau_lensing_source */
 
-          for (index_tau_sources=0;
-               index_tau_sources < tau_sources_size;
-               index_tau_sources++) {
+          class_call(background_at_tau(pba,
+                                       tau0-tau0_minus_tau_lensing_sources[index_tau_sources],
+                                       long_info,
+                                       inter_closeby,
+                                       &last_index,
+                                       pvecback),
+                     pba->error_message,
+                     ptr->error_message);
 
-            switch (pba->sgnK){
-            case 1:
-              sinKgen_source = sin(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sqrt(pba->K);
-              sinKgen_source_to_lens = sin((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(pba->K))/sqrt(pba->K);
-              cotKgen_source = cos(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sinKgen_source;
-              cscKgen_lens = sqrt(pba->K)/sin(sqrt(pba->K)*tau0_minus_tau[index_tau]);
-              break;
-            case 0:
-              sinKgen_source = tau0_minus_tau_lensing_sources[index_tau_sources];
-              sinKgen_source_to_lens = (tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources]);
-              cotKgen_source = 1./(tau0_minus_tau_lensing_sources[index_tau_sources]);
-              cscKgen_lens = 1./(tau0_minus_tau[index_tau]);
-              break;
-            case -1:
-              sinKgen_source = sinh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sqrt(-pba->K);
-              sinKgen_source_to_lens = sinh((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(-pba->K))/sqrt(-pba->K);
-              cotKgen_source = cosh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sinKgen_source;
-              cscKgen_lens = sqrt(-pba->K)/sinh(sqrt(-pba->K)*tau0_minus_tau[index_tau]);
-              break;
-            }
+          /* Source evolution at time tau_lensing_source */
 
-            /* condition for excluding from the sum the sources located in z=zero */
-            if ((tau0_minus_tau_lensing_sources[index_tau_sources] > 0.) && (tau0_minus_tau_lensing_sources[index_tau_sources]-tau0_minus_tau[index_tau] > 0.)) {
+          class_call(transfer_f_evo(pba,ptr,pvecback,last_index,cotKgen_source,&f_evo),
+                     ptr->error_message,
+                     ptr->error_message);
 
-              if (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential)) {
+          g5_factor_lensing_sources[index_tau_sources] =
+            (1.
+             + pvecback[pba->index_bg_H_prime]
+             /pvecback[pba->index_bg_a]
+             /pvecback[pba->index_bg_H]
+             /pvecback[pba->index_bg_H]
+             + (2.-5.*ptr->selection_magnification_bias[bin])
+             //  /tau0_minus_tau_lensing_sources[index_tau_sources]
+             * cotKgen_source
+             /pvecback[pba->index_bg_a]
+             /pvecback[pba->index_bg_H]
+             + 5.*ptr->selection_magnification_bias[bin]
+             - f_evo);
+        }
+      }
+    }
 
-                rescaling +=
-                  //  *(tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])
-                  //  /tau0_minus_tau[index_tau]
-                  //  /tau0_minus_tau_lensing_sources[index_tau_sources]
-                  sinKgen_source_to_lens
-                  *cscKgen_lens
-                  /sinKgen_source
-                  * selection[index_tau_sources]
-                  * w_trapz_lensing_sources[index_tau_sources];
-              }
+    /* redefine the time sampling */
+    class_call(transfer_lensing_sampling(ppr,
+                                         pba,
+                                         ppt,
+                                         ptr,
+                                         bin,
+                                         tau0,
+                                         tau0_minus_tau,
+                                         tau_size),
+               ptr->error_message,
+               ptr->error_message);
 
-              if (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens)) {
-
-                rescaling -=
-                  (2.-5.*ptr->selection_magnification_bias[bin])/2.
-                  //  *(tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])
-                  //  /tau0_minus_tau[index_tau]
-                  //  /tau0_minus_tau_lensing_sources[index_tau_sources]
-                  *sinKgen_source_to_lens
-                  *cscKgen_lens
-                  /sinKgen_source
-                  * selection[index_tau_sources]
-                  * w_trapz_lensing_sources[index_tau_sources];
-              }
+    /* Compute trapezoidal weights for integration over tau */
+    class_call(array_trapezoidal_mweights(tau0_minus_tau,
+                                          tau_size,
+                                          w_trapz,
+                                          ptr->error_message),
+               ptr->error_message,
+               ptr->error_message);
 
-              if (_index_tt_in_range_(ptr->index_tt_nc_g4, ppt->selection_num, ppt->has_nc_gr)) {
+    /* loop over time and rescale */
+    for (index_tau = 0; index_tau < tau_size; index_tau++) {
 
-                rescaling +=
-                  (2.-5.*ptr->selection_magnification_bias[bin])
-                  // /tau0_minus_tau_lensing_sources[index_tau_sources]
-                  * cotKgen_source
-                  * selection[index_tau_sources]
-                  * w_trapz_lensing_sources[index_tau_sources];
+      /* lensing source =  - W(tau) (phi(k,tau) + psi(k,tau)) Heaviside(tau-tau_rec)
+         with
+         psi,phi = metric perturbation in newtonian gauge (phi+psi = Phi_A-Phi_H of Bardeen)
+         W = (tau-tau_rec)/(tau_0-tau)/(tau_0-tau_rec)
+         H(x) = Heaviside
+         (in tau = tau_0, set source = 0 to avoid division by zero;
+         regulated anyway by Bessel).
+      */
+
+      if (index_tau == tau_size-1) {
+        rescaling=0.;
+      }
+      else {
 
-              }
+        rescaling = 0.;
+
+        for (index_tau_sources=0;
+             index_tau_sources < tau_sources_size;
+             index_tau_sources++) {
+
+          switch (pba->sgnK){
+          case 1:
+            sinKgen_source = sin(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sqrt(pba->K);
+            sinKgen_source_to_lens = sin((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(pba->K))/sqrt(pba->K);
+            cotKgen_source = cos(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(pba->K))/sinKgen_source;
+            cscKgen_lens = sqrt(pba->K)/sin(sqrt(pba->K)*tau0_minus_tau[index_tau]);
+            break;
+          case 0:
+            sinKgen_source = tau0_minus_tau_lensing_sources[index_tau_sources];
+            sinKgen_source_to_lens = (tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources]);
+            cotKgen_source = 1./(tau0_minus_tau_lensing_sources[index_tau_sources]);
+            cscKgen_lens = 1./(tau0_minus_tau[index_tau]);
+            break;
+          case -1:
+            sinKgen_source = sinh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sqrt(-pba->K);
+            sinKgen_source_to_lens = sinh((tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])*sqrt(-pba->K))/sqrt(-pba->K);
+            cotKgen_source = cosh(tau0_minus_tau_lensing_sources[index_tau_sources]*sqrt(-pba->K))/sinKgen_source;
+            cscKgen_lens = sqrt(-pba->K)/sinh(sqrt(-pba->K)*tau0_minus_tau[index_tau]);
+            break;
+          }
 
-              if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr)) {
+          /* condition for excluding from the sum the sources located in z=zero */
+          if ((tau0_minus_tau_lensing_sources[index_tau_sources] > 0.) && (tau0_minus_tau_lensing_sources[index_tau_sources]-tau0_minus_tau[index_tau] > 0.)) {
 
-                /* background quantities at time tau_lensing_source */
+            if (_index_tt_in_range_(ptr->index_tt_lensing, ppt->selection_num, ppt->has_cl_lensing_potential)) {
 
-                class_call(background_at_tau(pba,
-                                             tau0-tau0_minus_tau_lensing_sources[index_tau_sources],
-                                             long_info,
-                                             inter_normal,
-                                             &last_index,
-                                             pvecback),
-                           pba->error_message,
-                           ptr->error_message);
+              rescaling +=
+                //  *(tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])
+                //  /tau0_minus_tau[index_tau]
+                //  /tau0_minus_tau_lensing_sources[index_tau_sources]
+                sinKgen_source_to_lens
+                *cscKgen_lens
+                /sinKgen_source
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
+            }
+
+            if (_index_tt_in_range_(ptr->index_tt_nc_lens, ppt->selection_num, ppt->has_nc_lens)) {
+
+              rescaling -=
+                (2.-5.*ptr->selection_magnification_bias[bin])/2.
+                //  *(tau0_minus_tau[index_tau]-tau0_minus_tau_lensing_sources[index_tau_sources])
+                //  /tau0_minus_tau[index_tau]
+                //  /tau0_minus_tau_lensing_sources[index_tau_sources]
+                *sinKgen_source_to_lens
+                *cscKgen_lens
+                /sinKgen_source
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
+            }
 
-                /* Source evolution at time tau_lensing_source */
+            if (_index_tt_in_range_(ptr->index_tt_nc_g4, ppt->selection_num, ppt->has_nc_gr)) {
 
-                class_call(transfer_f_evo(pba,ptr,pvecback,last_index,cotKgen_source,&f_evo),
-                           ptr->error_message,
-                           ptr->error_message);
+              rescaling +=
+                (2.-5.*ptr->selection_magnification_bias[bin])
+                // /tau0_minus_tau_lensing_sources[index_tau_sources]
+                * cotKgen_source
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
+
+            }
 
+            if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr)) {
 
-                rescaling +=
-                  (1.
-                   + pvecback[pba->index_bg_H_prime]
-                   /pvecback[pba->index_bg_a]
-                   /pvecback[pba->index_bg_H]
-                   /pvecback[pba->index_bg_H]
-                   + (2.-5.*ptr->selection_magnification_bias[bin])
-                   //  /tau0_minus_tau_lensing_sources[index_tau_sources]
-                   * cotKgen_source
-                   /pvecback[pba->index_bg_a]
-                   /pvecback[pba->index_bg_H]
-                   + 5.*ptr->selection_magnification_bias[bin]
-                   - f_evo)
-                  * selection[index_tau_sources]
-                  * w_trapz_lensing_sources[index_tau_sources];
-              }
+              rescaling +=
+                g5_factor_lensing_sources[index_tau_sources]
+                * selection[index_tau_sources]
+                * w_trapz_lensing_sources[index_tau_sources];
             }
           }
         }
-
-        /* Finally store integrated result for later use */
-        (*window)[index_tt*tau_size_max+index_tau] = rescaling;
       }
 
-      /* deallocate temporary arrays */
-      free(tau0_minus_tau_lensing_sources);
-      free(w_trapz_lensing_sources);
+      /* Finally store integrated result for later use */
+      window[index_tt*tau_size_max+index_tau] = rescaling;
     }
-    /* End integrated contribution */
+
+    /* deallocate temporary arrays */
+    free(tau0_minus_tau_lensing_sources);
+    free(w_trapz_lensing_sources);
+    if (_index_tt_in_range_(ptr->index_tt_nc_g5, ppt->selection_num, ppt->has_nc_gr))
+      free(g5_factor_lensing_sources);
   }
+  /* End integrated contribution */
 
   /* deallocate temporary arrays */
   free(selection);
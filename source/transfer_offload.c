@@ -0,0 +1,307 @@
+/** @file transfer_offload.c Line-of-sight integrals of the transfer module on an accelerator
+ *
+ * The only file of CLASS with OpenMP target regions, compiled with
+ * OFFLOADFLAG when _CLASS_OFFLOAD_ is defined (see the Makefile and
+ * include/transfer_offload.h). Each kernel computes the integrals of one
+ * block of multipoles prepared by transfer_integrate_l_block(): one team
+ * per multipole, whose threads share the sum over time. The radial
+ * functions are interpolated on the device exactly as in
+ * hyperspherical_Hermite4_interpolation_vector_Phi() and its variants,
+ * and combined as in transfer_radial_function() for the flat case; the
+ * results only differ from those of the CPU by the order of the sums.
+ */
+
+#include "transfer.h"
+#ifdef _CLASS_OFFLOAD_
+#include <omp.h>
+#endif
+
+/**
+ * Copy the Bessel table of the flat case to the device, if there is
+ * one (or if CLASS_OFFLOAD=host). Otherwise, the structure is inactive.
+ *
+ * @param pto           Output: pointer to offload structure
+ * @param pBIS          Input: table of spherical Bessel functions
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int transfer_offload_init(
+                          struct transfer_offload * pto,
+                          HyperInterpStruct * pBIS,
+                          ErrorMsg error_message
+                          ) {
+
+  pto->is_active = _FALSE_;
+  pto->pBIS = pBIS;
+
+#ifdef _CLASS_OFFLOAD_
+  const char * mode = getenv("CLASS_OFFLOAD");
+  int host = omp_get_initial_device();
+  size_t table_size;
+
+  if ((mode != NULL) && (strcmp(mode,"no") == 0))
+    return _SUCCESS_;
+
+  if ((mode != NULL) && (strcmp(mode,"host") == 0))
+    pto->device = host;
+  else if (omp_get_num_devices() > 0)
+    pto->device = omp_get_default_device();
+  else
+    return _SUCCESS_;
+
+  pto->K = pBIS->K;
+  pto->beta = pBIS->beta;
+  pto->delta_x = pBIS->delta_x;
+  pto->x_size = pBIS->x_size;
+  pto->l_size = pBIS->l_size;
+  table_size = (size_t)pBIS->l_size*pBIS->x_size*sizeof(double);
+
+  pto->l = (int*)omp_target_alloc(pBIS->l_size*sizeof(int),pto->device);
+  pto->x = (double*)omp_target_alloc(pBIS->x_size*sizeof(double),pto->device);
+  pto->sinK = (double*)omp_target_alloc(pBIS->x_size*sizeof(double),pto->device);
+  pto->cotK = (double*)omp_target_alloc(pBIS->x_size*sizeof(double),pto->device);
+  pto->phi = (double*)omp_target_alloc(table_size,pto->device);
+  pto->dphi = (double*)omp_target_alloc(table_size,pto->device);
+
+  class_test((pto->l == NULL) || (pto->x == NULL) || (pto->sinK == NULL) || (pto->cotK == NULL) || (pto->phi == NULL) || (pto->dphi == NULL),
+             error_message,
+             "could not allocate the Bessel table (%zu bytes) on device %d",2*table_size,pto->device);
+
+  class_test((omp_target_memcpy(pto->l,pBIS->l,pBIS->l_size*sizeof(int),0,0,pto->device,host) != 0) ||
+             (omp_target_memcpy(pto->x,pBIS->x,pBIS->x_size*sizeof(double),0,0,pto->device,host) != 0) ||
+             (omp_target_memcpy(pto->sinK,pBIS->sinK,pBIS->x_size*sizeof(double),0,0,pto->device,host) != 0) ||
+             (omp_target_memcpy(pto->cotK,pBIS->cotK,pBIS->x_size*sizeof(double),0,0,pto->device,host) != 0) ||
+             (omp_target_memcpy(pto->phi,pBIS->phi,table_size,0,0,pto->device,host) != 0) ||
+             (omp_target_memcpy(pto->dphi,pBIS->dphi,table_size,0,0,pto->device,host) != 0),
+             error_message,
+             "could not copy the Bessel table to device %d",pto->device);
+
+  pto->is_active = _TRUE_;
+#endif
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the copy of the Bessel table on the device.
+ *
+ * @param pto Input: pointer to offload structure
+ * @return the error status
+ */
+
+int transfer_offload_free(
+                          struct transfer_offload * pto
+                          ) {
+
+#ifdef _CLASS_OFFLOAD_
+  if (pto->is_active == _TRUE_) {
+    omp_target_free(pto->l,pto->device);
+    omp_target_free(pto->x,pto->device);
+    omp_target_free(pto->sinK,pto->device);
+    omp_target_free(pto->cotK,pto->device);
+    omp_target_free(pto->phi,pto->device);
+    omp_target_free(pto->dphi,pto->device);
+    pto->is_active = _FALSE_;
+  }
+#endif
+
+  return _SUCCESS_;
+}
+
+/**
+ * Whether the integrals of the block at hand can be computed by the
+ * device: flat case (for which transfer_radial_function() uses the
+ * Bessel table without rescaling), and radial function implemented in
+ * transfer_offload_l_block().
+ *
+ * @param pto          Input: pointer to offload structure (or NULL)
+ * @param ptw          Input: pointer to transfer workspace
+ * @param radial_type  Input: type of radial function
+ * @return _TRUE_ or _FALSE_
+ */
+
+short transfer_offload_supports(
+                                struct transfer_offload * pto,
+                                struct transfer_workspace * ptw,
+                                int radial_type
+                                ) {
+
+  if ((pto == NULL) || (pto->is_active == _FALSE_) || (ptw->sgnK != 0) || (ptw->pBIS != pto->pBIS))
+    return _FALSE_;
+
+  switch (radial_type) {
+  case SCALAR_TEMPERATURE_0:
+  case SCALAR_TEMPERATURE_1:
+  case SCALAR_TEMPERATURE_2:
+  case SCALAR_POLARISATION_E:
+  case TENSOR_TEMPERATURE_2:
+  case TENSOR_POLARISATION_E:
+  case TENSOR_POLARISATION_B:
+  case NC_RSD:
+    return _TRUE_;
+  default:
+    return _FALSE_;
+  }
+}
+
+#ifdef _CLASS_OFFLOAD_
+#pragma omp declare target
+/* radial function of the flat case at argument chi, for the multipole
+   stored at index_l of the table (same formulas as in
+   transfer_radial_function() with K=0, for which all the rescaling
+   factors are one) */
+static double transfer_offload_radial(
+                                      const struct transfer_offload * pto,
+                                      int index_l,
+                                      int radial_type,
+                                      double chi,
+                                      double cscK,
+                                      double cotK
+                                      ) {
+
+  int l = pto->l[index_l];
+  double lxlp1 = l*(l+1.0);
+  double beta2 = pto->beta*pto->beta;
+  double deltax = pto->delta_x;
+  int nx = pto->x_size;
+  double xmin = pto->x[0];
+  double xmax = pto->x[nx-1];
+  const double * Phi_l = pto->phi+(size_t)index_l*nx;
+  const double * dPhi_l = pto->dphi+(size_t)index_l*nx;
+  double sign = ((chi<xmin)||(chi>xmax)) ? 0. : 1.;
+  int idx = ((int) ((chi-xmin)/deltax))+1;
+  idx = MAX(1,idx);
+  idx = MIN(nx-1,idx);
+
+  double ym = Phi_l[idx-1];
+  double yp = Phi_l[idx];
+  double dym = dPhi_l[idx-1];
+  double dyp = dPhi_l[idx];
+  double cotKm = pto->cotK[idx-1];
+  double sinKm = pto->sinK[idx-1];
+  double sinKm2 = sinKm*sinKm;
+  double cotKp = pto->cotK[idx];
+  double sinKp = pto->sinK[idx];
+  double sinKp2 = sinKp*sinKp;
+  double d2ym = -2*dym*cotKm+ym*(lxlp1/sinKm2-beta2+pto->K);
+  double d2yp = -2*dyp*cotKp+yp*(lxlp1/sinKp2-beta2+pto->K);
+  double d3ym = -2*cotKm*d2ym-2*ym*lxlp1*cotKm/sinKm2+
+    dym*(pto->K-beta2+(2+lxlp1)/sinKm2);
+  double d3yp = -2*cotKp*d2yp-2*yp*lxlp1*cotKp/sinKp2+
+    dyp*(pto->K-beta2+(2+lxlp1)/sinKp2);
+  double z = (chi-pto->x[idx-1])/deltax;
+  double z2 = z*z;
+  double z3 = z2*z;
+  double Phi = (ym+dym*deltax*z
+                +(-2*dym*deltax-dyp*deltax-3*ym+3*yp)*z2
+                +(dym*deltax+dyp*deltax+2*ym-2*yp)*z3)*sign;
+  double dPhi = (dym+d2ym*deltax*z
+                 +(-2*d2ym*deltax-d2yp*deltax-3*dym+3*dyp)*z2
+                 +(d2ym*deltax+d2yp*deltax+2*dym-2*dyp)*z3)*sign;
+  double d2Phi = (d2ym+d3ym*deltax*z
+                  +(-2*d3ym*deltax-d3yp*deltax-3*d2ym+3*d2yp)*z2
+                  +(d3ym*deltax+d3yp*deltax+2*d2ym-2*d2yp)*z3)*sign;
+
+  switch (radial_type) {
+  case SCALAR_TEMPERATURE_0:
+    return Phi;
+  case SCALAR_TEMPERATURE_1:
+    return dPhi;
+  case SCALAR_TEMPERATURE_2:
+    return 0.5*(3*d2Phi+Phi);
+  case SCALAR_POLARISATION_E:
+  case TENSOR_TEMPERATURE_2:
+    return sqrt(3.0/8.0*(l+2.0)*(l+1.0)*l*(l-1.0))*cscK*cscK*Phi;
+  case TENSOR_POLARISATION_E:
+    return 0.25*(d2Phi+4.0*cotK*dPhi-(1.0-2.0*cotK*cotK)*Phi);
+  case TENSOR_POLARISATION_B:
+    return 0.5*(dPhi+2.0*cotK*Phi);
+  case NC_RSD:
+    return d2Phi;
+  default:
+    return 0.;
+  }
+}
+#pragma omp end declare target
+#endif
+
+/**
+ * Compute on the device the integrals of the multipoles of the block of
+ * the workspace, whose bounds have been found by
+ * transfer_integrate_l_block(). The results are added to
+ * ptw->l_block_trsf.
+ *
+ * @param pto            Input: pointer to offload structure
+ * @param ptw            Input/Output: pointer to transfer workspace
+ * @param tau_size_block Input: number of time values needed by the block
+ * @param radial_type    Input: type of radial function (see transfer_offload_supports())
+ * @param error_message  Output: error message
+ * @return the error status
+ */
+
+int transfer_offload_l_block(
+                             struct transfer_offload * pto,
+                             struct transfer_workspace * ptw,
+                             int tau_size_block,
+                             int radial_type,
+                             ErrorMsg error_message
+                             ) {
+
+#ifdef _CLASS_OFFLOAD_
+  struct transfer_offload table = *pto;
+  int block_num = ptw->l_block_num;
+  int tau_size = ptw->tau_size;
+  double * sources = ptw->sources;
+  double * w_trapz = ptw->w_trapz;
+  double * tau0_minus_tau = ptw->tau0_minus_tau;
+  double * chi = ptw->chi;
+  double * cscKgen = ptw->cscKgen;
+  double * cotKgen = ptw->cotKgen;
+  int * block_index_l = ptw->l_block_index_l;
+  int * block_index_tau_max = ptw->l_block_index_tau_max;
+  short * block_bessel_truncation = ptw->l_block_bessel_truncation;
+  double * block_tau0_minus_tau_min_bessel = ptw->l_block_tau0_minus_tau_min_bessel;
+  double * block_trsf = ptw->l_block_trsf;
+  int index_block;
+
+  if (tau_size_block == 0)
+    return _SUCCESS_;
+
+  /* the table pointers of the copy are device addresses */
+#pragma omp target teams distribute device(table.device) firstprivate(table) \
+  map(to: sources[0:tau_size_block], w_trapz[0:tau_size_block], chi[0:tau_size_block], \
+      cscKgen[0:tau_size_block], cotKgen[0:tau_size_block], tau0_minus_tau[0:tau_size], \
+      block_index_l[0:block_num], block_index_tau_max[0:block_num], \
+      block_bessel_truncation[0:block_num], block_tau0_minus_tau_min_bessel[0:block_num]) \
+  map(tofrom: block_trsf[0:block_num])
+  for (index_block = 0; index_block < block_num; index_block++) {
+
+    int index_l = block_index_l[index_block];
+    int index_tau_max = block_index_tau_max[index_block];
+    int index_tau;
+    double sum = 0.;
+
+    if (index_tau_max >= 0) {
+
+#pragma omp parallel for reduction(+:sum)
+      for (index_tau = 0; index_tau <= index_tau_max; index_tau++) {
+        sum += sources[index_tau]*w_trapz[index_tau]*
+          transfer_offload_radial(&table,index_l,radial_type,chi[index_tau],cscKgen[index_tau],cotKgen[index_tau]);
+      }
+
+      /* correct for the Bessel cut off as in transfer_integrate() */
+      if (block_bessel_truncation[index_block] == _TRUE_) {
+        sum -= 0.5*(tau0_minus_tau[index_tau_max+1]-block_tau0_minus_tau_min_bessel[index_block])*
+          transfer_offload_radial(&table,index_l,radial_type,chi[index_tau_max],cscKgen[index_tau_max],cotKgen[index_tau_max])*sources[index_tau_max];
+      }
+
+      block_trsf[index_block] += sum;
+    }
+  }
+#else
+  class_stop(error_message,"CLASS was compiled without OFFLOAD=yes");
+#endif
+
+  return _SUCCESS_;
+}
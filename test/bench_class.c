@@ -0,0 +1,470 @@
+/** @file bench_class.c
+ *
+ * End-to-end benchmark of the modules of CLASS, on a list of workloads.
+ */
+
+/* this main runs the same sequence of modules as main/class.c, for a
+   list of workloads, and reports for each module the wall time, the
+   CPU time of all threads, the thread utilization (CPU time divided by
+   wall time and by the number of threads) and the peak resident memory
+   of the process so far.
+
+   Usage: bench_class [-n repeat] [-t threads] [-m cold|warm|both] [-o file] [workload ...]
+
+   A workload is an input file, optionally followed by parameters
+   replacing or completing those of the file, separated by colons, for
+   instance UG.ini:model=1 or default.ini:l_max_scalars=5000. Without
+   workloads, the canonical list bench_workloads[] below is run.
+
+   Each measurement runs in a child process of its own, so that the
+   caches of the process (HyRec and quadrature tables, Wigner
+   d-functions, Bessel functions, ...) and its peak memory start from
+   scratch. In cold mode, each of the 'repeat' repetitions gets a new
+   process; in warm mode, one process runs the workload once without
+   timing it, and then 'repeat' times. This does not flush the caches
+   kept on disk, if they are enabled in the input file.
+
+   The verbosity parameters of the workloads are set to zero, and their
+   output files are written with the root _BENCH_ROOT_, overwritten at
+   each run. The table has one line per module and per repetition,
+   with tab-separated columns, and is written to stdout or to the file
+   given with -o. */
+
+#include "class.h"
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define _BENCH_ROOT_ "output/bench_"
+#define _BENCH_MAX_WORKLOADS_ 64
+
+char * bench_workloads[] = {
+  "explanatory.ini",
+  "base_2018_plikHM_TTTEEE_lowl_lowE_lensing.ini",
+  "UG.ini:has_UG=1:model=1",
+  "UG.ini:has_UG=1:model=2",
+  "default.ini:l_max_scalars=5000"
+};
+
+enum bench_module {
+  bench_input,
+  bench_background,
+  bench_thermodynamics,
+  bench_perturbations,
+  bench_primordial,
+  bench_fourier,
+  bench_transfer,
+  bench_harmonic,
+  bench_lensing,
+  bench_distortions,
+  bench_output,
+  bench_free,
+  bench_total,
+  bench_module_size
+};
+
+char * bench_module_name[] = {
+  "input",
+  "background",
+  "thermodynamics",
+  "perturbations",
+  "primordial",
+  "fourier",
+  "transfer",
+  "harmonic",
+  "lensing",
+  "distortions",
+  "output",
+  "free",
+  "total"
+};
+
+struct bench_clock {
+  double wall;
+  double cpu;
+};
+
+struct bench_timing {
+  double wall[bench_module_size];
+  double cpu[bench_module_size];
+  double peak_rss[bench_module_size];  /* in MB, after each module */
+  struct bench_clock last;
+};
+
+void bench_clock_now(struct bench_clock * pclock) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  pclock->wall = ts.tv_sec + 1.e-9*ts.tv_nsec;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+  pclock->cpu = ts.tv_sec + 1.e-9*ts.tv_nsec;
+}
+
+double bench_peak_rss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF,&usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss/1048576.;   /* in bytes */
+#else
+  return usage.ru_maxrss/1024.;      /* in kB */
+#endif
+}
+
+/* record the time elapsed since the previous call, for one module */
+void bench_stop(struct bench_timing * pbt, enum bench_module module) {
+  struct bench_clock now;
+  bench_clock_now(&now);
+  pbt->wall[module] = now.wall - pbt->last.wall;
+  pbt->cpu[module] = now.cpu - pbt->last.cpu;
+  pbt->peak_rss[module] = bench_peak_rss();
+  pbt->last = now;
+}
+
+/* replace the value of a parameter, or add it */
+int bench_set_parameter(
+                        struct file_content * pfc,
+                        char * name,
+                        char * value,
+                        ErrorMsg errmsg
+                        ) {
+
+  int index;
+
+  for (index=0; index<pfc->size; index++) {
+    if (strcmp(pfc->name[index],name) == 0)
+      break;
+  }
+  if (index == pfc->size) {
+    class_call(parser_extend(pfc,1,errmsg),
+               errmsg,
+               errmsg);
+    strcpy(pfc->name[index],name);
+  }
+  strcpy(pfc->value[index],value);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read the input file of a workload, apply its parameters, and silence
+ * its verbosity.
+ *
+ * @param workload Input: file name, followed by name=value pairs separated by colons
+ * @param pfc      Output: file content, allocated here
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int bench_read_workload(
+                        char * workload,
+                        struct file_content * pfc,
+                        ErrorMsg errmsg
+                        ) {
+
+  char spec[_ARGUMENT_LENGTH_MAX_];
+  char * item;
+  char * equal;
+  char * context;
+  int index;
+  int is_file = _TRUE_;
+
+  class_test(strlen(workload) >= _ARGUMENT_LENGTH_MAX_,
+             errmsg,
+             "workload '%s' is too long",workload);
+  strcpy(spec,workload);
+
+  for (item = strtok_r(spec,":",&context); item != NULL; item = strtok_r(NULL,":",&context)) {
+
+    if (is_file == _TRUE_) {
+      class_call(parser_read_file(item,pfc,errmsg),
+                 errmsg,
+                 errmsg);
+      is_file = _FALSE_;
+      continue;
+    }
+
+    equal = strchr(item,'=');
+    class_test(equal == NULL,
+               errmsg,
+               "in workload '%s', '%s' should be of the form name=value",workload,item);
+    *equal = '\0';
+    class_call(bench_set_parameter(pfc,item,equal+1,errmsg),
+               errmsg,
+               errmsg);
+  }
+
+  /* the output files go to a fixed root, overwritten at each run
+     (overwrite_root is only read by input_init()) */
+  class_call(bench_set_parameter(pfc,"root",_BENCH_ROOT_,errmsg),
+             errmsg,
+             errmsg);
+  for (index=0; index<pfc->size; index++) {
+    if (strcmp(pfc->name[index],"overwrite_root") == 0)
+      pfc->read[index] = _TRUE_;
+  }
+
+  for (index=0; index<pfc->size; index++) {
+    if ((strlen(pfc->name[index]) > 8) && (strcmp(pfc->name[index]+strlen(pfc->name[index])-8,"_verbose") == 0))
+      strcpy(pfc->value[index],"0");
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Run all the modules once for a workload, as in main/class.c, and
+ * time each of them.
+ *
+ * @param workload Input: workload, see bench_read_workload()
+ * @param pbt      Output: timings
+ * @param errmsg   Output: error message
+ * @return the error status
+ */
+
+int bench_run_workload(
+                       char * workload,
+                       struct bench_timing * pbt,
+                       ErrorMsg errmsg
+                       ) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermodynamics th;           /* for thermodynamics */
+  struct perturbations pt;         /* for source functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct fourier fo;        /* for non-linear spectra */
+  struct transfer tr;        /* for transfer functions */
+  struct harmonic hr;          /* for output spectra */
+  struct lensing le;          /* for lensed spectra */
+  struct distortions sd;      /* for spectral distortions */
+  struct output op;           /* for output files */
+  struct file_content fc;
+  struct bench_clock start;
+
+  bench_clock_now(&start);
+  pbt->last = start;
+
+  class_call(bench_read_workload(workload,&fc,errmsg),errmsg,errmsg);
+  class_call(input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg),errmsg,errmsg);
+  parser_free(&fc);
+  bench_stop(pbt,bench_input);
+
+  class_call(background_init(&pr,&ba),ba.error_message,errmsg);
+  bench_stop(pbt,bench_background);
+
+  class_call(thermodynamics_init(&pr,&ba,&th),th.error_message,errmsg);
+  bench_stop(pbt,bench_thermodynamics);
+
+  class_call(perturbations_init(&pr,&ba,&th,&pt),pt.error_message,errmsg);
+  bench_stop(pbt,bench_perturbations);
+
+  class_call(primordial_init(&pr,&pt,&pm),pm.error_message,errmsg);
+  bench_stop(pbt,bench_primordial);
+
+  class_call(fourier_init(&pr,&ba,&th,&pt,&pm,&fo),fo.error_message,errmsg);
+  bench_stop(pbt,bench_fourier);
+
+  class_call(transfer_init(&pr,&ba,&th,&pt,&fo,&tr),tr.error_message,errmsg);
+  bench_stop(pbt,bench_transfer);
+
+  class_call(harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr),hr.error_message,errmsg);
+  bench_stop(pbt,bench_harmonic);
+
+  class_call(lensing_init(&pr,&pt,&hr,&fo,&le),le.error_message,errmsg);
+  bench_stop(pbt,bench_lensing);
+
+  class_call(distortions_init(&pr,&ba,&th,&pt,&pm,&sd),sd.error_message,errmsg);
+  bench_stop(pbt,bench_distortions);
+
+  class_call(output_init(&ba,&th,&pt,&pm,&tr,&hr,&fo,&le,&sd,&op),op.error_message,errmsg);
+  bench_stop(pbt,bench_output);
+
+  class_call(distortions_free(&sd),sd.error_message,errmsg);
+  class_call(lensing_free(&le),le.error_message,errmsg);
+  class_call(harmonic_free(&hr),hr.error_message,errmsg);
+  class_call(transfer_free(&tr),tr.error_message,errmsg);
+  class_call(fourier_free(&fo),fo.error_message,errmsg);
+  class_call(primordial_free(&pm),pm.error_message,errmsg);
+  class_call(perturbations_free(&pt),pt.error_message,errmsg);
+  class_call(thermodynamics_free(&th),th.error_message,errmsg);
+  class_call(background_free(&ba),ba.error_message,errmsg);
+  bench_stop(pbt,bench_free);
+
+  pbt->wall[bench_total] = pbt->last.wall - start.wall;
+  pbt->cpu[bench_total] = pbt->last.cpu - start.cpu;
+  pbt->peak_rss[bench_total] = pbt->peak_rss[bench_free];
+
+  return _SUCCESS_;
+}
+
+void bench_print(
+                 FILE * output,
+                 char * workload,
+                 char * mode,
+                 int repetition,
+                 int threads,
+                 struct bench_timing * pbt
+                 ) {
+
+  int module;
+
+  for (module=0; module<bench_module_size; module++) {
+    fprintf(output,"%s\t%s\t%d\t%s\t%.6f\t%.6f\t%.3f\t%.1f\t%d\n",
+            workload,
+            mode,
+            repetition,
+            bench_module_name[module],
+            pbt->wall[module],
+            pbt->cpu[module],
+            (pbt->wall[module] > 0.) ? pbt->cpu[module]/pbt->wall[module]/threads : 0.,
+            pbt->peak_rss[module],
+            threads);
+  }
+  fflush(output);
+}
+
+/**
+ * Run one workload in a child process, either once per repetition
+ * (cold), or once untimed and then 'repeat' times (warm).
+ *
+ * @return _SUCCESS_ if the child succeeded
+ */
+
+int bench_child(
+                FILE * output,
+                char * workload,
+                short warm,
+                int repeat,
+                int first_repetition,
+                int num_threads
+                ) {
+
+  struct bench_timing bt;
+  ErrorMsg errmsg;
+  pid_t pid;
+  int status, index_repeat, threads;
+
+  fflush(output);
+  fflush(stdout);
+
+  pid = fork();
+  if (pid < 0) {
+    fprintf(stderr,"bench_class: cannot fork for workload %s\n",workload);
+    return _FAILURE_;
+  }
+
+  if (pid > 0) {
+    waitpid(pid,&status,0);
+    return (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? _SUCCESS_ : _FAILURE_;
+  }
+
+  /* in the child process */
+
+  if (num_threads > 0)
+    class_parallel_attach_thread(num_threads);
+  threads = class_parallel_get_num_threads();
+
+  if (warm == _TRUE_) {
+    if (bench_run_workload(workload,&bt,errmsg) == _FAILURE_) {
+      fprintf(stderr,"\n\nError in workload %s \n=>%s\n",workload,errmsg);
+      _exit(1);
+    }
+  }
+
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    if (bench_run_workload(workload,&bt,errmsg) == _FAILURE_) {
+      fprintf(stderr,"\n\nError in workload %s \n=>%s\n",workload,errmsg);
+      _exit(1);
+    }
+    bench_print(output,workload,(warm == _TRUE_) ? "warm" : "cold",first_repetition+index_repeat,threads,&bt);
+  }
+
+  fflush(stdout);
+  _exit(0);
+}
+
+int main(int argc, char **argv) {
+
+  int repeat = 3;
+  int num_threads = 0;
+  short do_cold = _TRUE_;
+  short do_warm = _TRUE_;
+  char * output_name = NULL;
+  FILE * output = stdout;
+  char * workloads[_BENCH_MAX_WORKLOADS_];
+  int num_workloads = 0;
+  int num_failures = 0;
+  int i, index_workload, index_repeat;
+
+  for (i=1; i<argc; i++) {
+    if ((strcmp(argv[i],"-n") == 0) && (i+1 < argc)) {
+      repeat = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i],"-t") == 0) && (i+1 < argc)) {
+      num_threads = atoi(argv[++i]);
+    }
+    else if ((strcmp(argv[i],"-m") == 0) && (i+1 < argc)) {
+      i++;
+      do_cold = ((strcmp(argv[i],"cold") == 0) || (strcmp(argv[i],"both") == 0));
+      do_warm = ((strcmp(argv[i],"warm") == 0) || (strcmp(argv[i],"both") == 0));
+      if ((do_cold == _FALSE_) && (do_warm == _FALSE_)) {
+        fprintf(stderr,"bench_class: mode should be cold, warm or both, not %s\n",argv[i]);
+        return _FAILURE_;
+      }
+    }
+    else if ((strcmp(argv[i],"-o") == 0) && (i+1 < argc)) {
+      output_name = argv[++i];
+    }
+    else if (argv[i][0] == '-') {
+      fprintf(stderr,"usage: %s [-n repeat] [-t threads] [-m cold|warm|both] [-o file] [workload ...]\n",argv[0]);
+      return _FAILURE_;
+    }
+    else if (num_workloads < _BENCH_MAX_WORKLOADS_) {
+      workloads[num_workloads++] = argv[i];
+    }
+  }
+
+  if (num_workloads == 0) {
+    for (index_workload=0; index_workload<(int)(sizeof(bench_workloads)/sizeof(char*)); index_workload++)
+      workloads[num_workloads++] = bench_workloads[index_workload];
+  }
+
+  if (repeat < 1)
+    repeat = 1;
+
+  if (output_name != NULL) {
+    output = fopen(output_name,"w");
+    if (output == NULL) {
+      fprintf(stderr,"bench_class: cannot open %s\n",output_name);
+      return _FAILURE_;
+    }
+  }
+
+  /* no module of CLASS is called in this process, which has therefore no thread pool when forking */
+  fprintf(output,"#workload\tmode\trepetition\tmodule\twall_s\tcpu_s\tutilization\tpeak_rss_MB\tthreads\n");
+
+  for (index_workload=0; index_workload<num_workloads; index_workload++) {
+
+    if (do_cold == _TRUE_) {
+      for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+        if (bench_child(output,workloads[index_workload],_FALSE_,1,index_repeat,num_threads) == _FAILURE_)
+          num_failures++;
+      }
+    }
+
+    if (do_warm == _TRUE_) {
+      if (bench_child(output,workloads[index_workload],_TRUE_,repeat,0,num_threads) == _FAILURE_)
+        num_failures++;
+    }
+  }
+
+  if (output != stdout)
+    fclose(output);
+
+  if (num_failures > 0) {
+    fprintf(stderr,"bench_class: %d run(s) failed\n",num_failures);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
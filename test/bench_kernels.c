@@ -0,0 +1,696 @@
+/** @file bench_kernels.c
+ *
+ * Micro-benchmarks of the innermost kernels of CLASS.
+ */
+
+/* this main times, on fixed inputs, the kernels that dominate the run
+   time of a model: spline interpolation and tabulation, the tables and
+   the interpolation of hyperspherical Bessel functions, one call to
+   perturbations_derivs() and to numjac() on a realistic vector of
+   perturbations, the Wigner d-functions of the lensing module, and the
+   C_l's at one multipole. The inputs of the last kernels come from a
+   LCDM model computed first.
+
+   Each kernel is repeated until one sample lasts at least
+   _BENCH_SAMPLE_TIME_ seconds, and the median over _BENCH_SAMPLES_
+   samples is reported, in ns per operation and in GB/s. The bandwidth
+   is estimated from the size of the arrays read and written by one
+   operation, so it is only an order of magnitude for the kernels which
+   are not limited by memory. The results are also written in JSON
+   format to the file passed as first argument (default:
+   bench_kernels.json), in order to be compared between two versions of
+   the code. The random inputs are drawn with a fixed seed. */
+
+#include "class.h"
+#include <time.h>
+
+#define _BENCH_SAMPLES_ 9
+#define _BENCH_SAMPLE_TIME_ 0.02
+#define _BENCH_MAX_KERNELS_ 16
+
+/* one kernel runs 'repeat' times the operation that it times */
+typedef int (*bench_kernel)(void * arg, long repeat, ErrorMsg errmsg);
+
+struct bench_result {
+  char name[_ARGUMENT_LENGTH_MAX_];
+  double ns_per_op;        /* median over the samples */
+  double bytes_per_op;     /* estimate of the memory read and written by one operation */
+  long ops_per_sample;
+};
+
+struct bench_result results[_BENCH_MAX_KERNELS_];
+int results_size = 0;
+
+unsigned long long bench_seed = 20111104ULL;
+
+/* uniform deviate in [0,1), the same on all platforms */
+double bench_random() {
+  bench_seed = bench_seed*6364136223846793005ULL+1442695040888963407ULL;
+  return (bench_seed >> 11)*(1./9007199254740992.);
+}
+
+double bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec + 1.e-9*ts.tv_nsec;
+}
+
+int bench_compare(const void * a, const void * b) {
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+/**
+ * Time one kernel, and append the result to the list.
+ *
+ * @param name         Input: name of the kernel in the report
+ * @param kernel       Input: function running the operation 'repeat' times
+ * @param arg          Input: arguments of the kernel
+ * @param ops_per_call Input: number of operations done by the kernel for repeat=1
+ * @param bytes_per_op Input: memory read and written by one operation
+ * @param errmsg       Output: error message
+ * @return the error status
+ */
+
+int bench_run(
+              char * name,
+              bench_kernel kernel,
+              void * arg,
+              long ops_per_call,
+              double bytes_per_op,
+              ErrorMsg errmsg
+              ) {
+
+  long repeat = 1;
+  int index_sample;
+  double time, sample[_BENCH_SAMPLES_];
+  struct bench_result * pres;
+
+  class_test(results_size == _BENCH_MAX_KERNELS_,
+             errmsg,
+             "increase _BENCH_MAX_KERNELS_");
+
+  /* warm up, and find the number of repetitions of one sample */
+  while (1) {
+    time = bench_now();
+    class_call(kernel(arg,repeat,errmsg),errmsg,errmsg);
+    time = bench_now()-time;
+    if (time >= _BENCH_SAMPLE_TIME_)
+      break;
+    repeat *= 2;
+  }
+
+  for (index_sample=0; index_sample<_BENCH_SAMPLES_; index_sample++) {
+    time = bench_now();
+    class_call(kernel(arg,repeat,errmsg),errmsg,errmsg);
+    sample[index_sample] = bench_now()-time;
+  }
+
+  qsort(sample,_BENCH_SAMPLES_,sizeof(double),bench_compare);
+
+  pres = &(results[results_size++]);
+  strcpy(pres->name,name);
+  pres->ops_per_sample = repeat*ops_per_call;
+  pres->ns_per_op = 1.e9*sample[_BENCH_SAMPLES_/2]/pres->ops_per_sample;
+  pres->bytes_per_op = bytes_per_op;
+
+  printf("%-48s %14.2f ns/op %10.3f GB/s\n",
+         pres->name,
+         pres->ns_per_op,
+         pres->bytes_per_op/pres->ns_per_op);
+
+  return _SUCCESS_;
+}
+
+int bench_write_json(
+                     char * filename,
+                     ErrorMsg errmsg
+                     ) {
+
+  FILE * output;
+  int index;
+
+  class_open(output,filename,"w",errmsg);
+
+  fprintf(output,"{\n");
+  fprintf(output,"  \"threads\": %d,\n",class_parallel_get_num_threads());
+  fprintf(output,"  \"samples\": %d,\n",_BENCH_SAMPLES_);
+  fprintf(output,"  \"kernels\": [\n");
+  for (index=0; index<results_size; index++) {
+    fprintf(output,"    {\"name\": \"%s\", \"ns_per_op\": %.6e, \"gb_per_s\": %.6e, \"ops_per_sample\": %ld}%s\n",
+            results[index].name,
+            results[index].ns_per_op,
+            results[index].bytes_per_op/results[index].ns_per_op,
+            results[index].ops_per_sample,
+            (index < results_size-1) ? "," : "");
+  }
+  fprintf(output,"  ]\n");
+  fprintf(output,"}\n");
+
+  fclose(output);
+
+  return _SUCCESS_;
+}
+
+/* array_interpolate_spline() at points in random order */
+
+struct bench_spline {
+  double * x;
+  int n_lines;
+  int n_columns;
+  double * y;
+  double * ddy;
+  double * x_interp;
+  int x_interp_size;
+  double * result;
+};
+
+int bench_interpolate_spline(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_spline * pbs = (struct bench_spline *)arg;
+  long index_repeat;
+  int index_x, last_index = 0;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    for (index_x=0; index_x<pbs->x_interp_size; index_x++) {
+      class_call(array_interpolate_spline(pbs->x,pbs->n_lines,pbs->y,pbs->ddy,pbs->n_columns,
+                                          pbs->x_interp[index_x],&last_index,pbs->result,pbs->n_columns,errmsg),
+                 errmsg,
+                 errmsg);
+    }
+  }
+  return _SUCCESS_;
+}
+
+int bench_spline_table_lines(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_spline * pbs = (struct bench_spline *)arg;
+  long index_repeat;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    class_call(array_spline_table_lines(pbs->x,pbs->n_lines,pbs->y,pbs->n_columns,pbs->ddy,_SPLINE_EST_DERIV_,errmsg),
+               errmsg,
+               errmsg);
+  }
+  return _SUCCESS_;
+}
+
+/* tables and interpolation of the flat Bessel functions, as in transfer_init() */
+
+struct bench_hyperspherical {
+  int l_size;
+  int * l;
+  double xmin;
+  double xmax;
+  double sampling;
+  double phiminabs;
+  HyperInterpStruct HIS;
+  int index_l;
+  int x_interp_size;
+  double * x_interp;
+  double * Phi;
+  double * dPhi;
+};
+
+int bench_HIS_create(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_hyperspherical * pbh = (struct bench_hyperspherical *)arg;
+  HyperInterpStruct HIS;
+  long index_repeat;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    class_call(hyperspherical_HIS_create(0,1.,pbh->l_size,pbh->l,pbh->xmin,pbh->xmax,pbh->sampling,
+                                         pbh->l[pbh->l_size-1]+1,pbh->phiminabs,&HIS,errmsg),
+               errmsg,
+               errmsg);
+    class_call(hyperspherical_HIS_free(&HIS,errmsg),
+               errmsg,
+               errmsg);
+  }
+  return _SUCCESS_;
+}
+
+int bench_Hermite_interpolation(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_hyperspherical * pbh = (struct bench_hyperspherical *)arg;
+  long index_repeat;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    hyperspherical_Hermite_interpolation_vector(&(pbh->HIS),pbh->x_interp_size,pbh->index_l,pbh->x_interp,pbh->Phi,pbh->dPhi,NULL);
+  }
+  return _SUCCESS_;
+}
+
+/* perturbations_derivs() and numjac() for one wavenumber, at one time */
+
+struct bench_perturbations {
+  struct perturbations_parameters_and_workspace ppaw;
+  double tau;
+  int neq;
+  double * y;       /* y[1..neq], as in evolver_ndf15() */
+  double * dy;
+  struct jacobian jac;
+  struct numjac_workspace nj_ws;
+};
+
+int bench_perturbations_derivs(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_perturbations * pbp = (struct bench_perturbations *)arg;
+  long index_repeat;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    class_call(perturbations_derivs(pbp->tau,pbp->y+1,pbp->dy+1,&(pbp->ppaw),errmsg),
+               errmsg,
+               errmsg);
+  }
+  return _SUCCESS_;
+}
+
+int bench_numjac(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_perturbations * pbp = (struct bench_perturbations *)arg;
+  long index_repeat;
+  int nfe;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    nfe = 0;
+    class_call(numjac(perturbations_derivs,pbp->tau,pbp->y,pbp->dy,&(pbp->jac),&(pbp->nj_ws),
+                      1.e-15,pbp->neq,&nfe,&(pbp->ppaw),errmsg),
+               errmsg,
+               errmsg);
+  }
+  return _SUCCESS_;
+}
+
+/* the twelve Wigner d-functions of lensing_dxx() */
+
+struct bench_lensing {
+  int num_mu;
+  int lmax;
+  double * mu;
+  double * table;
+  double ** rows[12];
+};
+
+int bench_lensing_dxx(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_lensing * pbl = (struct bench_lensing *)arg;
+  long index_repeat;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    class_call(lensing_dxx(pbl->mu,pbl->num_mu,pbl->lmax,
+                           pbl->rows[0],pbl->rows[1],pbl->rows[2],pbl->rows[3],
+                           pbl->rows[4],pbl->rows[5],pbl->rows[6],
+                           pbl->rows[7],pbl->rows[8],pbl->rows[9],pbl->rows[10],pbl->rows[11]),
+               errmsg,
+               errmsg);
+  }
+  return _SUCCESS_;
+}
+
+/* harmonic_compute_cl() for all multipoles of the scalar mode */
+
+struct bench_harmonic {
+  struct precision * ppr;
+  struct background * pba;
+  struct perturbations * ppt;
+  struct transfer * ptr;
+  struct harmonic * phr;
+  int index_md;
+  double * cl_weight;
+  double * cl_weight_limber;
+  double * cl_weight_lcmb_direct;
+};
+
+int bench_harmonic_compute_cl(void * arg, long repeat, ErrorMsg errmsg) {
+  struct bench_harmonic * pbc = (struct bench_harmonic *)arg;
+  long index_repeat;
+  int index_l;
+  for (index_repeat=0; index_repeat<repeat; index_repeat++) {
+    for (index_l=0; index_l<pbc->ptr->l_size[pbc->index_md]; index_l++) {
+      class_call(harmonic_compute_cl(pbc->ppr,pbc->pba,pbc->ppt,pbc->ptr,pbc->phr,pbc->index_md,0,0,index_l,
+                                     pbc->cl_weight,pbc->cl_weight_limber,pbc->cl_weight_lcmb_direct,NULL),
+                 pbc->phr->error_message,
+                 errmsg);
+    }
+  }
+  return _SUCCESS_;
+}
+
+int bench_all(
+              struct precision * ppr,
+              struct background * pba,
+              struct thermodynamics * pth,
+              struct perturbations * ppt,
+              struct primordial * ppm,
+              struct transfer * ptr,
+              struct harmonic * phr,
+              ErrorMsg errmsg
+              ) {
+
+  struct bench_spline bs;
+  struct bench_hyperspherical bh;
+  struct bench_perturbations bp;
+  struct perturbations_workspace pw;
+  struct perturbations_workspace * ppw = &pw;
+  struct bench_lensing bl;
+  struct bench_harmonic bc;
+  char name[_ARGUMENT_LENGTH_MAX_];
+  int index, index_l, index_mu, index_d;
+  int index_md = ppt->index_md_scalars;
+  int * approx_ini;
+  double k, tau_ini;
+
+  /** - splines: 1000 lines of 16 columns */
+
+  bs.n_lines = 1000;
+  bs.n_columns = 16;
+  bs.x_interp_size = 1000;
+  class_alloc(bs.x,bs.n_lines*sizeof(double),errmsg);
+  class_alloc(bs.y,bs.n_lines*bs.n_columns*sizeof(double),errmsg);
+  class_alloc(bs.ddy,bs.n_lines*bs.n_columns*sizeof(double),errmsg);
+  class_alloc(bs.x_interp,bs.x_interp_size*sizeof(double),errmsg);
+  class_alloc(bs.result,bs.n_columns*sizeof(double),errmsg);
+
+  bs.x[0] = 0.;
+  for (index=1; index<bs.n_lines; index++)
+    bs.x[index] = bs.x[index-1] + 0.5 + bench_random();
+  for (index=0; index<bs.n_lines*bs.n_columns; index++)
+    bs.y[index] = bench_random();
+  for (index=0; index<bs.x_interp_size; index++)
+    bs.x_interp[index] = bs.x[bs.n_lines-1]*bench_random();
+
+  class_call(bench_spline_table_lines(&bs,1,errmsg),errmsg,errmsg);
+
+  sprintf(name,"array_interpolate_spline[%dx%d]",bs.n_lines,bs.n_columns);
+  class_call(bench_run(name,bench_interpolate_spline,&bs,bs.x_interp_size,
+                       (4.*bs.n_columns+1.)*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  sprintf(name,"array_spline_table_lines[%dx%d]",bs.n_lines,bs.n_columns);
+  class_call(bench_run(name,bench_spline_table_lines,&bs,1,
+                       3.*bs.n_lines*bs.n_columns*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  free(bs.x);
+  free(bs.y);
+  free(bs.ddy);
+  free(bs.x_interp);
+  free(bs.result);
+
+  /** - hyperspherical Bessel functions, for the multipoles of the transfer module */
+
+  bh.l_size = ptr->l_size_max;
+  bh.l = ptr->l;
+  bh.xmin = ppr->hyper_x_min;
+  bh.xmax = 2.*ptr->l[ptr->l_size_max-1];
+  bh.sampling = ppr->hyper_sampling_flat;
+  bh.phiminabs = ppr->hyper_phi_min_abs;
+
+  class_call(hyperspherical_HIS_create(0,1.,bh.l_size,bh.l,bh.xmin,bh.xmax,bh.sampling,
+                                       bh.l[bh.l_size-1]+1,bh.phiminabs,&(bh.HIS),errmsg),
+             errmsg,
+             errmsg);
+
+  sprintf(name,"hyperspherical_HIS_create[%dx%d]",bh.HIS.l_size,bh.HIS.x_size);
+  class_call(bench_run(name,bench_HIS_create,&bh,1,
+                       2.*bh.HIS.l_size*bh.HIS.x_size*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  /* sorted points between the first non-negligible value and the end of the table, as in the transfer module */
+  bh.index_l = bh.HIS.l_size/2;
+  bh.x_interp_size = 16*_HERMITE_BLOCK_;
+  class_alloc(bh.x_interp,bh.x_interp_size*sizeof(double),errmsg);
+  class_alloc(bh.Phi,bh.x_interp_size*sizeof(double),errmsg);
+  class_alloc(bh.dPhi,bh.x_interp_size*sizeof(double),errmsg);
+  for (index=0; index<bh.x_interp_size; index++)
+    bh.x_interp[index] = bh.HIS.chi_at_phimin[bh.index_l]
+      + (bh.HIS.x[bh.HIS.x_size-1]-bh.HIS.chi_at_phimin[bh.index_l])*(index+bench_random())/bh.x_interp_size;
+
+  sprintf(name,"hyperspherical_Hermite_interpolation_vector[l=%d]",bh.HIS.l[bh.index_l]);
+  class_call(bench_run(name,bench_Hermite_interpolation,&bh,bh.x_interp_size,
+                       6.*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  class_call(hyperspherical_HIS_free(&(bh.HIS),errmsg),errmsg,errmsg);
+  free(bh.x_interp);
+  free(bh.Phi);
+  free(bh.dPhi);
+
+  /** - perturbations_derivs() and numjac() for an intermediate
+      wavenumber, after recombination, with the approximation scheme
+      and the vector of perturbations set up as in
+      perturbations_solve() (the perturbations are the initial
+      conditions, carried over to the approximation scheme at tau:
+      their values do not change the cost of one call) */
+
+  memset(ppw,0,sizeof(struct perturbations_workspace));
+  class_call(perturbations_workspace_init(ppr,pba,pth,ppt,index_md,ppw),
+             ppt->error_message,
+             errmsg);
+
+  k = ppt->k[index_md][ppt->k_size[index_md]/2];
+  for (index_l=0; index_l<ppw->max_l_max; index_l++) {
+    ppw->s_l_minus[index_l] = index_l*ppw->s_l[index_l]/(2.*index_l+1.);
+    ppw->s_l_plus[index_l] = (index_l+1.)*ppw->s_l[index_l+1]/(2.*index_l+1.);
+  }
+  ppw->s_l_minus[ppw->max_l_max] = 0.;
+  ppw->s_l_plus[ppw->max_l_max] = 0.;
+  ppw->last_index_back = 0;
+  ppw->last_index_thermo = 0;
+  ppw->inter_mode = inter_normal;
+
+  /* initial conditions at an early time, then switch to the approximation scheme at tau */
+  tau_ini = 0.1*ppt->tau_sampling[0];
+  bp.tau = ppt->tau_sampling[ppt->tau_size/4];
+
+  class_call(perturbations_approximations(ppr,pba,pth,ppt,index_md,k,tau_ini,ppw),
+             ppt->error_message,
+             errmsg);
+
+  class_call(perturbations_vector_init(ppr,pba,pth,ppt,index_md,ppt->index_ic_ad,k,tau_ini,ppw,NULL),
+             ppt->error_message,
+             errmsg);
+
+  class_alloc(approx_ini,ppw->ap_size*sizeof(int),errmsg);
+  for (index=0; index<ppw->ap_size; index++)
+    approx_ini[index] = ppw->approx[index];
+
+  class_call(perturbations_approximations(ppr,pba,pth,ppt,index_md,k,bp.tau,ppw),
+             ppt->error_message,
+             errmsg);
+
+  class_call(perturbations_vector_init(ppr,pba,pth,ppt,index_md,ppt->index_ic_ad,k,bp.tau,ppw,approx_ini),
+             ppt->error_message,
+             errmsg);
+
+  free(approx_ini);
+
+  bp.ppaw.ppr = ppr;
+  bp.ppaw.pba = pba;
+  bp.ppaw.pth = pth;
+  bp.ppaw.ppt = ppt;
+  bp.ppaw.index_md = index_md;
+  bp.ppaw.index_ic = ppt->index_ic_ad;
+  bp.ppaw.index_k = ppt->k_size[index_md]/2;
+  bp.ppaw.k = k;
+  bp.ppaw.ppw = ppw;
+  ppw->inter_mode = inter_closeby;
+
+  bp.neq = ppw->pv->pt_size;
+  class_alloc(bp.y,(bp.neq+1)*sizeof(double),errmsg);
+  class_alloc(bp.dy,(bp.neq+1)*sizeof(double),errmsg);
+  for (index=0; index<bp.neq; index++)
+    bp.y[index+1] = ppw->pv->y[index];
+
+  class_call(bench_perturbations_derivs(&bp,1,errmsg),errmsg,errmsg);
+
+  sprintf(name,"perturbations_derivs[neq=%d]",bp.neq);
+  class_call(bench_run(name,bench_perturbations_derivs,&bp,1,
+                       2.*bp.neq*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  class_call(initialize_jacobian(&(bp.jac),bp.neq,errmsg),errmsg,errmsg);
+  class_call(initialize_numjac_workspace(&(bp.nj_ws),bp.neq,errmsg),errmsg,errmsg);
+
+  sprintf(name,"numjac[neq=%d]",bp.neq);
+  class_call(bench_run(name,bench_numjac,&bp,1,
+                       1.*bp.neq*bp.neq*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  uninitialize_jacobian(&(bp.jac));
+  uninitialize_numjac_workspace(&(bp.nj_ws));
+  free(bp.y);
+  free(bp.dy);
+
+  class_call(perturbations_vector_release(ppw,ppw->pv),
+             ppt->error_message,
+             errmsg);
+  class_call(perturbations_workspace_free(ppt,index_md,ppw),
+             ppt->error_message,
+             errmsg);
+
+  /** - Wigner d-functions, for the multipoles of the lensed spectra */
+
+  bl.num_mu = 8*_LENSING_DXX_LANES_;
+  bl.lmax = phr->l_max_tot+ppr->delta_l_max;
+  class_alloc(bl.mu,bl.num_mu*sizeof(double),errmsg);
+  class_alloc(bl.table,12*(size_t)bl.num_mu*(bl.lmax+1)*sizeof(double),errmsg);
+  for (index_d=0; index_d<12; index_d++) {
+    class_alloc(bl.rows[index_d],bl.num_mu*sizeof(double*),errmsg);
+    for (index_mu=0; index_mu<bl.num_mu; index_mu++)
+      bl.rows[index_d][index_mu] = bl.table + ((size_t)index_d*bl.num_mu+index_mu)*(bl.lmax+1);
+  }
+  for (index_mu=0; index_mu<bl.num_mu; index_mu++)
+    bl.mu[index_mu] = -1.+2.*(index_mu+bench_random())/bl.num_mu;
+
+  sprintf(name,"lensing_dxx[%dx%d]",bl.num_mu,bl.lmax+1);
+  class_call(bench_run(name,bench_lensing_dxx,&bl,(long)bl.num_mu*(bl.lmax+1),
+                       12.*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  for (index_d=0; index_d<12; index_d++)
+    free(bl.rows[index_d]);
+  free(bl.mu);
+  free(bl.table);
+
+  /** - C_l's at each multipole, for the adiabatic mode */
+
+  bc.ppr = ppr;
+  bc.pba = pba;
+  bc.ppt = ppt;
+  bc.ptr = ptr;
+  bc.phr = phr;
+  bc.index_md = phr->index_md_scalars;
+
+  class_call(harmonic_cl_weights(ppr,pba,ptr,ppm,phr,bc.index_md,&(bc.cl_weight),&(bc.cl_weight_limber),&(bc.cl_weight_lcmb_direct)),
+             phr->error_message,
+             errmsg);
+
+  sprintf(name,"harmonic_compute_cl[q=%d]",ptr->q_size);
+  class_call(bench_run(name,bench_harmonic_compute_cl,&bc,ptr->l_size[bc.index_md],
+                       (ptr->tt_size[bc.index_md]+1.)*ptr->q_size*sizeof(double),errmsg),
+             errmsg,errmsg);
+
+  free(bc.cl_weight);
+  if (bc.cl_weight_limber != NULL)
+    free(bc.cl_weight_limber);
+  if (bc.cl_weight_lcmb_direct != NULL)
+    free(bc.cl_weight_lcmb_direct);
+
+  return _SUCCESS_;
+}
+
+int main(int argc, char **argv) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermodynamics th;           /* for thermodynamics */
+  struct perturbations pt;         /* for source functions */
+  struct transfer tr;        /* for transfer functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct harmonic hr;          /* for output spectra */
+  struct fourier fo;        /* for non-linear spectra */
+  struct lensing le;          /* for lensed spectra */
+  struct distortions sd;      /* for spectral distortions */
+  struct output op;           /* for output files */
+  struct file_content fc;
+  ErrorMsg errmsg;
+  char * json_file = "bench_kernels.json";
+
+  if (argc > 1)
+    json_file = argv[1];
+
+  /* a LCDM model with the temperature, polarization and lensing potential spectra */
+  if (parser_init(&fc,3,"",errmsg) == _FAILURE_) {
+    printf("\n\nError running parser_init \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  strcpy(fc.name[0],"output");
+  strcpy(fc.value[0],"tCl,pCl,lCl");
+  strcpy(fc.name[1],"lensing");
+  strcpy(fc.value[1],"yes");
+  strcpy(fc.name[2],"l_max_scalars");
+  strcpy(fc.value[2],"2500");
+
+  if (input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg) == _FAILURE_) {
+    printf("\n\nError running input_read_from_file \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  parser_free(&fc);
+
+  if (background_init(&pr,&ba) == _FAILURE_) {
+    printf("\n\nError running background_init \n=>%s\n",ba.error_message);
+    return _FAILURE_;
+  }
+
+  if (thermodynamics_init(&pr,&ba,&th) == _FAILURE_) {
+    printf("\n\nError in thermodynamics_init \n=>%s\n",th.error_message);
+    return _FAILURE_;
+  }
+
+  if (perturbations_init(&pr,&ba,&th,&pt) == _FAILURE_) {
+    printf("\n\nError in perturbations_init \n=>%s\n",pt.error_message);
+    return _FAILURE_;
+  }
+
+  if (primordial_init(&pr,&pt,&pm) == _FAILURE_) {
+    printf("\n\nError in primordial_init \n=>%s\n",pm.error_message);
+    return _FAILURE_;
+  }
+
+  if (fourier_init(&pr,&ba,&th,&pt,&pm,&fo) == _FAILURE_) {
+    printf("\n\nError in fourier_init \n=>%s\n",fo.error_message);
+    return _FAILURE_;
+  }
+
+  if (transfer_init(&pr,&ba,&th,&pt,&fo,&tr) == _FAILURE_) {
+    printf("\n\nError in transfer_init \n=>%s\n",tr.error_message);
+    return _FAILURE_;
+  }
+
+  if (harmonic_init(&pr,&ba,&pt,&pm,&fo,&tr,&hr) == _FAILURE_) {
+    printf("\n\nError in harmonic_init \n=>%s\n",hr.error_message);
+    return _FAILURE_;
+  }
+
+  printf("# kernel benchmarks, median of %d samples, %d thread(s)\n",_BENCH_SAMPLES_,class_parallel_get_num_threads());
+
+  if (bench_all(&pr,&ba,&th,&pt,&pm,&tr,&hr,errmsg) == _FAILURE_) {
+    printf("\n\nError in bench_all \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  if (bench_write_json(json_file,errmsg) == _FAILURE_) {
+    printf("\n\nError in bench_write_json \n=>%s\n",errmsg);
+    return _FAILURE_;
+  }
+
+  printf("# results written in %s\n",json_file);
+
+  if (harmonic_free(&hr) == _FAILURE_) {
+    printf("\n\nError in harmonic_free \n=>%s\n",hr.error_message);
+    return _FAILURE_;
+  }
+
+  if (transfer_free(&tr) == _FAILURE_) {
+    printf("\n\nError in transfer_free \n=>%s\n",tr.error_message);
+    return _FAILURE_;
+  }
+
+  if (fourier_free(&fo) == _FAILURE_) {
+    printf("\n\nError in fourier_free \n=>%s\n",fo.error_message);
+    return _FAILURE_;
+  }
+
+  if (primordial_free(&pm) == _FAILURE_) {
+    printf("\n\nError in primordial_free \n=>%s\n",pm.error_message);
+    return _FAILURE_;
+  }
+
+  if (perturbations_free(&pt) == _FAILURE_) {
+    printf("\n\nError in perturbations_free \n=>%s\n",pt.error_message);
+    return _FAILURE_;
+  }
+
+  if (thermodynamics_free(&th) == _FAILURE_) {
+    printf("\n\nError in thermodynamics_free \n=>%s\n",th.error_message);
+    return _FAILURE_;
+  }
+
+  if (background_free(&ba) == _FAILURE_) {
+    printf("\n\nError in background_free \n=>%s\n",ba.error_message);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+}
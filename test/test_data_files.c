@@ -0,0 +1,195 @@
+/** @file test_data_files.c
+ *
+ * Test of the layouts of external files read by data_file_get().
+ */
+
+/* this main writes small external files in the temporary directory,
+   reads them with data_file_get(), from the text file and from its
+   binary copy, and checks the tables. It covers the three layouts,
+   including a header (rows, n) followed by rows of n numbers and no
+   other column (format_columns = 0, as for the noise files of the
+   distortions detectors), and checks that a header announcing no
+   column at all is an error. Finally, it registers a file twice with
+   data_file_set(), and checks that the second table replaces the
+   first one, which stays readable until it is given back. */
+
+#include "data_files.h"
+#include <unistd.h>
+
+int num_failures;
+
+void check(
+           short condition,
+           char * what
+           ) {
+
+  if (condition == _FALSE_) {
+    printf("# FAILED: %s\n",what);
+    num_failures++;
+  }
+}
+
+/* write text in a new temporary file, whose name is set in file_name */
+int write_file(
+               char * text,
+               char * file_name
+               ) {
+
+  int fd;
+  FILE * file;
+
+  sprintf(file_name,"/tmp/test_data_files_XXXXXX");
+  fd = mkstemp(file_name);
+  if (fd < 0)
+    return _FAILURE_;
+  file = fdopen(fd,"w");
+  if (file == NULL)
+    return _FAILURE_;
+  fputs(text,file);
+  fclose(file);
+
+  return _SUCCESS_;
+}
+
+/* check that the table has the expected size, and that the number in
+   row index_row and column index_column is 10*(index_row+1)+index_column */
+void check_table(
+                 struct data_file * pdf,
+                 int rows,
+                 int columns,
+                 char * what
+                 ) {
+
+  int index_row,index_column;
+  short same = _TRUE_;
+  char message[_ERRORMSGSIZE_+_FILENAMESIZE_];
+
+  sprintf(message,"%s: %d x %d table instead of %d x %d",what,pdf->rows,pdf->columns,rows,columns);
+  check((pdf->rows == rows) && (pdf->columns == columns),message);
+  if ((pdf->rows != rows) || (pdf->columns != columns))
+    return;
+
+  for (index_row=0; index_row<rows; index_row++)
+    for (index_column=0; index_column<columns; index_column++)
+      if (pdf->data[index_column*rows+index_row] != 10.*(index_row+1)+index_column)
+        same = _FALSE_;
+
+  sprintf(message,"%s: wrong numbers",what);
+  check(same,message);
+}
+
+/* read the file with data_file_get(), writing its binary copy, then
+   read the binary copy alone, and check both tables */
+void check_layout(
+                  char * text,
+                  enum data_file_format format,
+                  int format_columns,
+                  int rows,
+                  int columns,
+                  char * what
+                  ) {
+
+  char file_name[_FILENAMESIZE_];
+  char binary_file_name[_FILENAMESIZE_+4];
+  char message[_ERRORMSGSIZE_+_FILENAMESIZE_];
+  struct data_file * pdf;
+  struct data_file copy;
+  ErrorMsg error_message;
+
+  if (write_file(text,file_name) == _FAILURE_) {
+    check(_FALSE_,"could not write a temporary file");
+    return;
+  }
+  sprintf(binary_file_name,"%s.bin",file_name);
+
+  if (data_file_get(file_name,format,format_columns,_TRUE_,&pdf,error_message) == _FAILURE_) {
+    sprintf(message,"%s: %s",what,error_message);
+    check(_FALSE_,message);
+  }
+  else {
+    check_table(pdf,rows,columns,what);
+
+    /* the binary copy, as read by the next processes */
+    memset(&copy,0,sizeof(struct data_file));
+    copy.file_name = file_name;
+    copy.file_size = pdf->file_size;
+    copy.file_mtime = pdf->file_mtime;
+    copy.format = format;
+    copy.format_columns = format_columns;
+    sprintf(message,"%s (binary copy)",what);
+    if (data_file_read_binary(binary_file_name,&copy) == _FAILURE_)
+      check(_FALSE_,message);
+    else
+      check_table(&copy,rows,columns,message);
+    data_file_release(pdf);
+  }
+
+  unlink(binary_file_name);
+  unlink(file_name);
+}
+
+int main() {
+
+  char file_name[_FILENAMESIZE_];
+  struct data_file * pdf, * pdf_old;
+  ErrorMsg error_message;
+  int header[2] = {2,0};
+  double data[2][4] = {{10.,20.,11.,21.},{10.,20.,12.,22.}};
+
+  num_failures = 0;
+
+  check_layout("# two columns, until the first entry which is not a number\n"
+               "10 11\n20 21\n# comment\n30 31\nend\n",
+               data_file_columns,2,3,2,
+               "columns");
+
+  check_layout("# header (rows, n), then rows of n plus one numbers\n"
+               "3 2\n10 11 12\n20 21 22\n30 31 32\n",
+               data_file_rows_header,1,3,3,
+               "rows with header and one fixed column");
+
+  check_layout("# header (rows, n), then rows of n numbers only\n"
+               "3 2\n10 11\n20 21\n30 31\n",
+               data_file_rows_header,0,3,2,
+               "rows with header and no fixed column");
+
+  check_layout("# header (n1, n2), then n1*n2 rows\n"
+               "2 2\n10 11 12\n20 21 22\n30 31 32\n40 41 42\n",
+               data_file_grid_header,3,4,3,
+               "grid with header");
+
+  /* a header announcing no column is an error, not an empty table */
+  if (write_file("1 0\n10\n",file_name) == _SUCCESS_) {
+    check(data_file_get(file_name,data_file_rows_header,0,_FALSE_,&pdf,error_message) == _FAILURE_,
+          "rows with header and no column at all should be an error");
+    unlink(file_name);
+  }
+
+  /* so is no column without header */
+  if (write_file("10 11\n",file_name) == _SUCCESS_) {
+    check(data_file_get(file_name,data_file_columns,0,_FALSE_,&pdf,error_message) == _FAILURE_,
+          "columns without any column should be an error");
+    unlink(file_name);
+  }
+
+  /* a table registered again for the same file replaces the first one */
+  if (write_file("2 0\n10 11\n20 21\n",file_name) == _SUCCESS_) {
+    check((data_file_set(file_name,data_file_rows_header,2,header,2,2,data[0],_FALSE_,error_message) == _SUCCESS_) &&
+          (data_file_get(file_name,data_file_rows_header,2,_FALSE_,&pdf_old,error_message) == _SUCCESS_),
+          "could not register a table");
+    check(pdf_old->data[3] == 21.,"wrong registered table");
+    check((data_file_set(file_name,data_file_rows_header,2,header,2,2,data[1],_FALSE_,error_message) == _SUCCESS_) &&
+          (data_file_get(file_name,data_file_rows_header,2,_FALSE_,&pdf,error_message) == _SUCCESS_),
+          "could not register a table again");
+    check((pdf != pdf_old) && (pdf->data[3] == 22.),"the table registered again should replace the first one");
+    check(pdf_old->data[3] == 21.,"the first table should stay readable until it is given back");
+    data_file_release(pdf_old);
+    data_file_release(pdf);
+    unlink(file_name);
+  }
+
+  if (num_failures == 0)
+    printf("# all layouts of external files are read correctly\n");
+
+  return (num_failures == 0) ? _SUCCESS_ : _FAILURE_;
+}
@@ -0,0 +1,194 @@
+/** @file test_instances.c
+ *
+ * Stress test for several independent instances of CLASS running
+ * concurrently in the same process.
+ */
+
+/* this main computes the background and thermodynamics of a list of
+   cosmologies, first one after the other, and then several times from
+   concurrent threads (each thread running its own instance of CLASS,
+   with alternatively HyRec and Recfast). The results of the concurrent
+   runs must be bitwise identical to those of the sequential ones: any
+   difference reveals some state shared between instances. The number
+   of concurrent instances can be passed as first argument (default:
+   4), and the number of threads of each of them as second argument
+   (default: 0, all instances sharing the pool of the process). */
+
+#include "class.h"
+#include <pthread.h>
+
+#define _NUM_JOBS_ 8
+#define _NUM_ROUNDS_ 3
+
+struct job {
+  int recombination;   /* 0 for HyRec, 1 for Recfast */
+  double omega_b;
+  double z_rec;
+  double checksum;
+};
+
+struct job jobs[_NUM_JOBS_];
+int next_job;
+int num_failures;
+int threads_per_instance;
+pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int run_instance(
+                 struct job * pj,
+                 double * z_rec,
+                 double * checksum,
+                 ErrorMsg errmsg
+                 ) {
+
+  struct precision pr;        /* for precision parameters */
+  struct background ba;       /* for cosmological background */
+  struct thermodynamics th;           /* for thermodynamics */
+  struct perturbations pt;         /* for source functions */
+  struct transfer tr;        /* for transfer functions */
+  struct primordial pm;       /* for primordial spectra */
+  struct harmonic hr;          /* for output spectra */
+  struct fourier fo;        /* for non-linear spectra */
+  struct lensing le;          /* for lensed spectra */
+  struct distortions sd;      /* for spectral distortions */
+  struct output op;           /* for output files */
+  struct file_content fc;
+  int index;
+
+  /* each instance has its own file content, since input_read_from_file() marks the entries as read */
+  class_call(parser_init(&fc,3,"",errmsg),
+             errmsg,
+             errmsg);
+
+  strcpy(fc.name[0],"recombination");
+  strcpy(fc.value[0],(pj->recombination == 0) ? "HyRec" : "RECFAST");
+
+  strcpy(fc.name[1],"omega_b");
+  sprintf(fc.value[1],"%e",pj->omega_b);
+
+  strcpy(fc.name[2],"z_reio");
+  sprintf(fc.value[2],"%e",10.);
+
+  class_call(input_read_from_file(&fc,&pr,&ba,&th,&pt,&tr,&pm,&hr,&fo,&le,&sd,&op,errmsg),
+             errmsg,
+             errmsg);
+
+  class_call(parser_free(&fc),
+             errmsg,
+             errmsg);
+
+  class_call(background_init(&pr,&ba),
+             ba.error_message,
+             errmsg);
+
+  class_call(thermodynamics_init(&pr,&ba,&th),
+             th.error_message,
+             errmsg);
+
+  /* any difference in the tables shows up in this weighted sum */
+  *z_rec = th.z_rec;
+  *checksum = 0.;
+  for (index=0; index < th.tt_size*th.th_size; index++) {
+    *checksum += th.thermodynamics_table[index]*(1.+1.e-3*(index%97));
+  }
+
+  class_call(thermodynamics_free(&th),
+             th.error_message,
+             errmsg);
+
+  class_call(background_free(&ba),
+             ba.error_message,
+             errmsg);
+
+  return _SUCCESS_;
+}
+
+void * run_jobs(void * arg) {
+
+  int index_job;
+  double z_rec, checksum;
+  ErrorMsg errmsg;
+
+  class_parallel_attach_thread(threads_per_instance);
+
+  while (1) {
+
+    pthread_mutex_lock(&job_mutex);
+    index_job = next_job++;
+    pthread_mutex_unlock(&job_mutex);
+
+    if (index_job >= _NUM_ROUNDS_*_NUM_JOBS_)
+      break;
+
+    if (run_instance(&jobs[index_job%_NUM_JOBS_],&z_rec,&checksum,errmsg) == _FAILURE_) {
+      printf("\n\nError in instance %d \n=>%s\n",index_job,errmsg);
+      pthread_mutex_lock(&job_mutex);
+      num_failures++;
+      pthread_mutex_unlock(&job_mutex);
+      continue;
+    }
+
+    if ((z_rec != jobs[index_job%_NUM_JOBS_].z_rec) || (checksum != jobs[index_job%_NUM_JOBS_].checksum)) {
+      printf("instance %d : results differ from the sequential run (z_rec = %.16e instead of %.16e)\n",
+             index_job,z_rec,jobs[index_job%_NUM_JOBS_].z_rec);
+      pthread_mutex_lock(&job_mutex);
+      num_failures++;
+      pthread_mutex_unlock(&job_mutex);
+    }
+  }
+
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+
+  int i;
+  int num_instances = 4;
+  pthread_t * threads;
+  ErrorMsg errmsg;
+
+  if (argc > 1)
+    num_instances = atoi(argv[1]);
+  if (num_instances < 1)
+    num_instances = 1;
+  threads_per_instance = 0;
+  if (argc > 2)
+    threads_per_instance = atoi(argv[2]);
+  if (threads_per_instance < 0)
+    threads_per_instance = 0;
+
+  /* reference results, computed one after the other */
+  for (i=0; i<_NUM_JOBS_; i++) {
+    jobs[i].recombination = i%2;
+    jobs[i].omega_b = 0.018 + i*0.002;
+    if (run_instance(&jobs[i],&jobs[i].z_rec,&jobs[i].checksum,errmsg) == _FAILURE_) {
+      printf("\n\nError in sequential run %d \n=>%s\n",i,errmsg);
+      return _FAILURE_;
+    }
+  }
+
+  /* the same cosmologies, from concurrent instances */
+  printf("# running %d x %d instances of CLASS from %d threads",_NUM_ROUNDS_,_NUM_JOBS_,num_instances);
+  if (threads_per_instance > 0)
+    printf(" with %d threads each",threads_per_instance);
+  printf("\n");
+
+  threads = malloc(num_instances*sizeof(pthread_t));
+  next_job = 0;
+  num_failures = 0;
+  for (i=0; i<num_instances; i++) {
+    pthread_create(&threads[i],NULL,run_jobs,NULL);
+  }
+  for (i=0; i<num_instances; i++) {
+    pthread_join(threads[i],NULL);
+  }
+  free(threads);
+
+  if (num_failures > 0) {
+    printf("# %d instance(s) failed\n",num_failures);
+    return _FAILURE_;
+  }
+
+  printf("# all instances agree with the sequential runs\n");
+
+  return _SUCCESS_;
+}
@@ -215,6 +215,8 @@ int main() {
     /* set the number of threads inside each CLASS instance */
 #ifdef _OPENMP
     omp_set_num_threads(number_of_threads_inside_class);
+    /* the same share of the threads of the process for the pool of each instance */
+    class_parallel_attach_thread_share(number_of_class_instances);
 #endif
 
     /* for each thread/instance, create all CLASS input/output
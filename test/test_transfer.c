@@ -105,10 +105,10 @@ int main(int argc, char **argv) {
 
           /* use this to plot a single type : */
 
-          transfer = tr.transfer[index_mode]
-            [((index_ic * tr.tt_size[index_mode] + index_type)
-              * tr.l_size[index_mode] + index_l)
-             * tr.q_size + index_q];
+          transfer = _transfer_value_((&tr),index_mode,
+                                      ((index_ic * tr.tt_size[index_mode] + index_type)
+                                       * tr.l_size[index_mode] + index_l)
+                                      * tr.q_size + index_q);
 
           /* or use this to plot the full temperature transfer function: */
           /*
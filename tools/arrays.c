@@ -552,21 +552,30 @@ int array_spline_table_line_to_line(
   return _SUCCESS_;
  }
 
-int array_spline_table_lines(
-			     double * x, /* vector of size x_size */
-			     int x_size,
-			     double * y_array, /* array of size x_size*y_size with elements
-						  y_array[index_x*y_size+index_y] */
-			     int y_size,
-			     double * ddy_array, /* array of size x_size*y_size */
-			     short spline_mode,
-			     ErrorMsg errmsg
-			     ) {
-
-  double * p;
-  double * qn;
-  double * un;
-  double * u;
+/**
+ * Spline y_size adjacent columns of a table with y_stride columns per
+ * line, as in array_spline_table_lines(): the recursion runs along x
+ * for all the columns of the block at once, so that the inner loops
+ * over columns have unit stride and are vectorised.
+ *
+ * Called by array_spline_table_lines() and array_spline_table_lines2().
+ */
+static int array_spline_table_lines_block(
+                                          double * __restrict__ x, /* vector of size x_size */
+                                          int x_size,
+                                          double * __restrict__ y_array, /* first column of the block, with elements
+                                                                            y_array[index_x*y_stride+index_y] */
+                                          int y_stride,
+                                          int y_size,
+                                          double * __restrict__ ddy_array, /* same layout as y_array */
+                                          short spline_mode,
+                                          ErrorMsg errmsg
+                                          ) {
+
+  double * __restrict__ p;
+  double * __restrict__ qn;
+  double * __restrict__ un;
+  double * __restrict__ u;
   double sig;
   int index_x;
   int index_y;
@@ -601,7 +610,7 @@ int array_spline_table_lines(
 
   if (spline_mode == _SPLINE_NATURAL_) {
     for (index_y=0; index_y < y_size; index_y++) {
-      ddy_array[index_x*y_size+index_y] = u[index_x*y_size+index_y] = 0.0;
+      ddy_array[index_x*y_stride+index_y] = u[index_x*y_size+index_y] = 0.0;
     }
   }
   else {
@@ -611,16 +620,16 @@ int array_spline_table_lines(
 
 	dy_first =
 	  ((x[2]-x[0])*(x[2]-x[0])*
-	   (y_array[1*y_size+index_y]-y_array[0*y_size+index_y])-
+	   (y_array[1*y_stride+index_y]-y_array[0*y_stride+index_y])-
 	   (x[1]-x[0])*(x[1]-x[0])*
-	   (y_array[2*y_size+index_y]-y_array[0*y_size+index_y]))/
+	   (y_array[2*y_stride+index_y]-y_array[0*y_stride+index_y]))/
 	  ((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
 
-	ddy_array[index_x*y_size+index_y] = -0.5;
+	ddy_array[index_x*y_stride+index_y] = -0.5;
 
 	u[index_x*y_size+index_y] =
 	  (3./(x[1] -  x[0]))*
-	  ((y_array[1*y_size+index_y]-y_array[0*y_size+index_y])/
+	  ((y_array[1*y_stride+index_y]-y_array[0*y_stride+index_y])/
 	   (x[1] - x[0])-dy_first);
 
       }
@@ -638,14 +647,14 @@ int array_spline_table_lines(
 
     for (index_y=0; index_y < y_size; index_y++) {
 
-      p[index_y] = sig * ddy_array[(index_x-1)*y_size+index_y] + 2.0;
+      p[index_y] = sig * ddy_array[(index_x-1)*y_stride+index_y] + 2.0;
 
-      ddy_array[index_x*y_size+index_y] = (sig-1.0)/p[index_y];
+      ddy_array[index_x*y_stride+index_y] = (sig-1.0)/p[index_y];
 
       u[index_x*y_size+index_y] =
-	(y_array[(index_x+1)*y_size+index_y] - y_array[index_x*y_size+index_y])
+	(y_array[(index_x+1)*y_stride+index_y] - y_array[index_x*y_stride+index_y])
 	/ (x[index_x+1] - x[index_x])
-	- (y_array[index_x*y_size+index_y] - y_array[(index_x-1)*y_size+index_y])
+	- (y_array[index_x*y_stride+index_y] - y_array[(index_x-1)*y_stride+index_y])
 	/ (x[index_x] - x[index_x-1]);
 
       u[index_x*y_size+index_y] = (6.0 * u[index_x*y_size+index_y] /
@@ -669,16 +678,16 @@ int array_spline_table_lines(
 
 	dy_last =
 	  ((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
-	   (y_array[(x_size-2)*y_size+index_y]-y_array[(x_size-1)*y_size+index_y])-
+	   (y_array[(x_size-2)*y_stride+index_y]-y_array[(x_size-1)*y_stride+index_y])-
 	   (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
-	   (y_array[(x_size-3)*y_size+index_y]-y_array[(x_size-1)*y_size+index_y]))/
+	   (y_array[(x_size-3)*y_stride+index_y]-y_array[(x_size-1)*y_stride+index_y]))/
 	  ((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
 
 	qn[index_y]=0.5;
 
 	un[index_y]=
 	  (3./(x[x_size-1] - x[x_size-2]))*
-	  (dy_last-(y_array[(x_size-1)*y_size+index_y] - y_array[(x_size-2)*y_size+index_y])/
+	  (dy_last-(y_array[(x_size-1)*y_stride+index_y] - y_array[(x_size-2)*y_stride+index_y])/
 	   (x[x_size-1] - x[x_size-2]));
 
       }
@@ -692,16 +701,16 @@ int array_spline_table_lines(
   index_x=x_size-1;
 
   for (index_y=0; index_y < y_size; index_y++) {
-    ddy_array[index_x*y_size+index_y] =
+    ddy_array[index_x*y_stride+index_y] =
       (un[index_y] - qn[index_y] * u[(index_x-1)*y_size+index_y]) /
-      (qn[index_y] * ddy_array[(index_x-1)*y_size+index_y] + 1.0);
+      (qn[index_y] * ddy_array[(index_x-1)*y_stride+index_y] + 1.0);
   }
 
   for (index_x=x_size-2; index_x >= 0; index_x--) {
     for (index_y=0; index_y < y_size; index_y++) {
 
-      ddy_array[index_x*y_size+index_y] = ddy_array[index_x*y_size+index_y] *
-	ddy_array[(index_x+1)*y_size+index_y] + u[index_x*y_size+index_y];
+      ddy_array[index_x*y_stride+index_y] = ddy_array[index_x*y_stride+index_y] *
+	ddy_array[(index_x+1)*y_stride+index_y] + u[index_x*y_size+index_y];
 
     }
   }
@@ -714,6 +723,56 @@ int array_spline_table_lines(
   return _SUCCESS_;
  }
 
+int array_spline_table_lines(
+			     double * x, /* vector of size x_size */
+			     int x_size,
+			     double * y_array, /* array of size x_size*y_size with elements
+						  y_array[index_x*y_size+index_y] */
+			     int y_size,
+			     double * ddy_array, /* array of size x_size*y_size */
+			     short spline_mode,
+			     ErrorMsg errmsg
+			     ) {
+
+  return array_spline_table_lines_block(x,x_size,y_array,y_size,y_size,ddy_array,spline_mode,errmsg);
+}
+
+/**
+ * Same as array_spline_table_lines(), with the columns split in blocks
+ * of _SPLINE_COLUMN_BLOCK_ columns splined in parallel.
+ */
+int array_spline_table_lines2(
+			      double * x, /* vector of size x_size */
+			      int x_size,
+			      double * y_array, /* array of size x_size*y_size with elements
+						   y_array[index_x*y_size+index_y] */
+			      int y_size,
+			      double * ddy_array, /* array of size x_size*y_size */
+			      short spline_mode,
+			      ErrorMsg errmsg
+			      ) {
+
+  int index_y;
+
+  class_test((spline_mode != _SPLINE_NATURAL_) && (spline_mode != _SPLINE_EST_DERIV_),
+             errmsg,
+             "Spline mode not identified: %d",spline_mode);
+
+  class_setup_parallel_optional(y_size > _SPLINE_COLUMN_BLOCK_);
+
+  for (index_y=0; index_y < y_size; index_y+=_SPLINE_COLUMN_BLOCK_) {
+
+    class_label_parallel("arrays:index_y",index_y);
+    class_run_parallel(=,
+      return array_spline_table_lines_block(x,x_size,y_array+index_y,y_size,MIN(_SPLINE_COLUMN_BLOCK_,y_size-index_y),ddy_array+index_y,spline_mode,errmsg);
+    );
+  }
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
 int array_logspline_table_lines(
 			     double * x, /* vector of size x_size */
 			     int x_size,
@@ -1058,133 +1117,23 @@ int array_spline_table_columns2(
 		       ErrorMsg errmsg
 		       ) {
 
-  double * p;
-  double * qn;
-  double * un;
-  double * u;
-
   int index_y;
 
-  u = (double*)malloc((x_size-1) * y_size * sizeof(double));
-  p = (double*)malloc(y_size * sizeof(double));
-  qn = (double*)malloc(y_size * sizeof(double));
-  un = (double*)malloc(y_size * sizeof(double));
-  if (u == NULL) {
-    class_sprintf(errmsg,"%s(L:%d) Cannot allocate u",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (p == NULL) {
-    class_sprintf(errmsg,"%s(L:%d) Cannot allocate p",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (qn == NULL) {
-    class_sprintf(errmsg,"%s(L:%d) Cannot allocate qn",__func__,__LINE__);
-    return _FAILURE_;
-  }
-  if (un == NULL) {
-    class_sprintf(errmsg,"%s(L:%d) Cannot allocate un",__func__,__LINE__);
-    return _FAILURE_;
-  }
-
-  if (x_size==2) spline_mode = _SPLINE_NATURAL_; // in the case of only 2 x-values, only the natural spline method is appropriate, for _SPLINE_EST_DERIV_ 3 x-values are needed.
+  /* each block of _SPLINE_COLUMN_BLOCK_ columns is contiguous in memory
+     and splined by array_spline_table_columns() */
 
-  class_setup_parallel();
+  class_setup_parallel_optional(y_size > _SPLINE_COLUMN_BLOCK_);
 
-  for (index_y=0; index_y < y_size; index_y++) {
+  for (index_y=0; index_y < y_size; index_y+=_SPLINE_COLUMN_BLOCK_) {
 
+    class_label_parallel("arrays:index_y",index_y);
     class_run_parallel(=,
-
-      double dy_first;
-      double dy_last;
-      int index_x;
-      double sig;
-      if (spline_mode == _SPLINE_NATURAL_) {
-        ddy_array[index_y*x_size+0] = 0.0;
-        u[0*y_size+index_y] = 0.0;
-      }
-      else {
-        dy_first =
-          ((x[2]-x[0])*(x[2]-x[0])*
-           (y_array[index_y*x_size+1]-y_array[index_y*x_size+0])-
-           (x[1]-x[0])*(x[1]-x[0])*
-           (y_array[index_y*x_size+2]-y_array[index_y*x_size+0]))/
-          ((x[2]-x[0])*(x[1]-x[0])*(x[2]-x[1]));
-
-        ddy_array[index_y*x_size+0] = -0.5;
-
-        u[0*y_size+index_y] =
-          (3./(x[1] -  x[0]))*
-          ((y_array[index_y*x_size+1]-y_array[index_y*x_size+0])/
-           (x[1] - x[0])-dy_first);
-
-      }
-
-      for (index_x=1; index_x < x_size-1; index_x++) {
-
-        sig = (x[index_x] - x[index_x-1])/(x[index_x+1] - x[index_x-1]);
-
-        p[index_y] = sig * ddy_array[index_y*x_size+(index_x-1)] + 2.0;
-
-        ddy_array[index_y*x_size+index_x] = (sig-1.0)/p[index_y];
-
-        u[index_x*y_size+index_y] =
-          (y_array[index_y*x_size+(index_x+1)] - y_array[index_y*x_size+index_x])
-          / (x[index_x+1] - x[index_x])
-          - (y_array[index_y*x_size+index_x] - y_array[index_y*x_size+(index_x-1)])
-          / (x[index_x] - x[index_x-1]);
-
-        u[index_x*y_size+index_y] = (6.0 * u[index_x*y_size+index_y] /
-                                     (x[index_x+1] - x[index_x-1])
-                                     - sig * u[(index_x-1)*y_size+index_y]) / p[index_y];
-
-      }
-
-      if (spline_mode == _SPLINE_NATURAL_) {
-
-        qn[index_y]=un[index_y]=0.0;
-
-      }
-      else {
-
-        dy_last =
-          ((x[x_size-3]-x[x_size-1])*(x[x_size-3]-x[x_size-1])*
-           (y_array[index_y*x_size+(x_size-2)]-y_array[index_y*x_size+(x_size-1)])-
-           (x[x_size-2]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*
-           (y_array[index_y*x_size+(x_size-3)]-y_array[index_y*x_size+(x_size-1)]))/
-          ((x[x_size-3]-x[x_size-1])*(x[x_size-2]-x[x_size-1])*(x[x_size-3]-x[x_size-2]));
-
-        qn[index_y]=0.5;
-
-        un[index_y]=
-          (3./(x[x_size-1] - x[x_size-2]))*
-          (dy_last-(y_array[index_y*x_size+(x_size-1)] - y_array[index_y*x_size+(x_size-2)])/
-           (x[x_size-1] - x[x_size-2]));
-
-      }
-
-      index_x=x_size-1;
-
-      ddy_array[index_y*x_size+index_x] =
-        (un[index_y] - qn[index_y] * u[(index_x-1)*y_size+index_y]) /
-        (qn[index_y] * ddy_array[index_y*x_size+(index_x-1)] + 1.0);
-
-      for (index_x=x_size-2; index_x >= 0; index_x--) {
-
-        ddy_array[index_y*x_size+index_x] = ddy_array[index_y*x_size+index_x] *
-          ddy_array[index_y*x_size+(index_x+1)] + u[index_x*y_size+index_y];
-
-      }
-      return _SUCCESS_;
+      return array_spline_table_columns(x,x_size,y_array+index_y*x_size,MIN(_SPLINE_COLUMN_BLOCK_,y_size-index_y),ddy_array+index_y*x_size,spline_mode,errmsg);
     );
   }
 
   class_finish_parallel();
 
-  free(qn);
-  free(p);
-  free(u);
-  free(un);
-
   return _SUCCESS_;
  }
 
@@ -1564,6 +1513,130 @@ int array_integrate_all_trapzd_or_spline(
   return _SUCCESS_;
 }
 
+/**
+ * Weights w_i such that sum_i w_i y_i is equal to the result of
+ * array_spline() with _SPLINE_EST_DERIV_ followed by
+ * array_integrate_all_trapzd_or_spline(), for any y_i sampled on the
+ * same x_i. Both routines are linear in y: the weights are obtained by
+ * running the transposed spline recursions once, in O(n_lines).
+ *
+ * Called by harmonic_cl_weights().
+ */
+int array_integrate_all_trapzd_or_spline_weights(
+                                                 double * x,
+                                                 int n_lines,
+                                                 int index_start_spline,
+                                                 double * weights,
+                                                 ErrorMsg errmsg) {
+
+  int i;
+  double h,g,e;
+  double * c;
+  double * p;
+  double * sig;
+  double * ubar;
+  double * ddbar;
+  double dx1,dx2,den;
+  double x1m,x2m,x3m,a,b;
+  double qn=0.5;
+
+  class_test(n_lines < 3,
+             errmsg,
+             "n_lines=%d, while routine needs n_lines >= 3",n_lines);
+
+  class_test((index_start_spline<0) || (index_start_spline>=n_lines),
+             errmsg,
+             "index_start_spline outside of range");
+
+  class_alloc(c,n_lines*sizeof(double),errmsg);
+  class_alloc(p,n_lines*sizeof(double),errmsg);
+  class_alloc(sig,n_lines*sizeof(double),errmsg);
+  class_alloc(ubar,n_lines*sizeof(double),errmsg);
+  class_alloc(ddbar,n_lines*sizeof(double),errmsg);
+
+  /* coefficients of y and y'' in the integral */
+
+  for (i=0; i < n_lines; i++) {
+    weights[i] = 0.;
+    ddbar[i] = 0.;
+  }
+
+  for (i=0; i < n_lines-1; i++) {
+    h = x[i+1]-x[i];
+    weights[i] += h/2.;
+    weights[i+1] += h/2.;
+    if (i >= index_start_spline) {
+      ddbar[i] -= h*h*h/24.;
+      ddbar[i+1] -= h*h*h/24.;
+    }
+  }
+
+  /* coefficients of the spline recursion, independent of y (same as in array_spline()) */
+
+  c[0] = -0.5;
+  for (i=1; i < n_lines-1; i++) {
+    sig[i] = (x[i]-x[i-1])/(x[i+1]-x[i-1]);
+    p[i] = sig[i]*c[i-1]+2.0;
+    c[i] = (sig[i]-1.0)/p[i];
+  }
+
+  /* transposed back-substitution: y''_k = c_k y''_{k+1} + u_k */
+
+  for (i=0; i < n_lines-1; i++) {
+    ubar[i] = ddbar[i];
+    ddbar[i+1] += c[i]*ddbar[i];
+  }
+
+  /* transposed last point: y''_{n-1} = (u_n - qn u_{n-2})/(qn c_{n-2} + 1),
+     with u_n depending on the last three y's */
+
+  g = ddbar[n_lines-1]/(qn*c[n_lines-2]+1.0);
+  ubar[n_lines-2] -= qn*g;
+
+  x1m = x[n_lines-1];
+  x2m = x[n_lines-2];
+  x3m = x[n_lines-3];
+  a = (x3m-x1m)*(x3m-x1m);
+  b = (x2m-x1m)*(x2m-x1m);
+  den = (x3m-x1m)*(x2m-x1m)*(x3m-x2m);
+  h = x1m-x2m;
+  g *= 3./h;
+  weights[n_lines-1] += g*((b-a)/den-1./h);
+  weights[n_lines-2] += g*(a/den+1./h);
+  weights[n_lines-3] += g*(-b/den);
+
+  /* transposed forward recursion on u_i */
+
+  for (i=n_lines-2; i >= 1; i--) {
+    g = ubar[i]/p[i];
+    e = 6.0*g/(x[i+1]-x[i-1]);
+    weights[i+1] += e/(x[i+1]-x[i]);
+    weights[i] -= e/(x[i+1]-x[i]) + e/(x[i]-x[i-1]);
+    weights[i-1] += e/(x[i]-x[i-1]);
+    ubar[i-1] -= sig[i]*g;
+  }
+
+  /* transposed first point: u_0 depends on the first three y's */
+
+  g = ubar[0];
+  h = x[1]-x[0];
+  dx1 = x[1]-x[0];
+  dx2 = x[2]-x[0];
+  den = dx2*dx1*(x[2]-x[1]);
+  g *= 3./h;
+  weights[0] += g*(-1./h-(dx1*dx1-dx2*dx2)/den);
+  weights[1] += g*(1./h-dx2*dx2/den);
+  weights[2] += g*(dx1*dx1/den);
+
+  free(c);
+  free(p);
+  free(sig);
+  free(ubar);
+  free(ddbar);
+
+  return _SUCCESS_;
+}
+
  /**
  * Not called.
  */
@@ -1736,6 +1809,8 @@ int array_interpolate_spline_transposed(double * array,
   int inf,sup,mid;
   double h,a,b;
 
+  class_counter_add(counter_interpolations,1);
+
   inf=0;
   sup=x_size-1;
 
@@ -1812,9 +1887,11 @@ int array_interpolate_spline(
                              int result_size, /** from 1 to n_columns */
                              ErrorMsg errmsg) {
 
-  int inf,sup,mid,i;
+  int inf,sup,mid;
   double h,a,b;
 
+  class_counter_add(counter_interpolations,1);
+
   inf=0;
   sup=n_lines-1;
 
@@ -1868,12 +1945,7 @@ int array_interpolate_spline(
   b = (x-x_array[inf])/h;
   a = 1-b;
 
-  for (i=0; i<result_size; i++)
-    *(result+i) =
-      a * *(array+inf*n_columns+i) +
-      b * *(array+sup*n_columns+i) +
-      ((a*a*a-a)* *(array_splined+inf*n_columns+i) +
-       (b*b*b-b)* *(array_splined+sup*n_columns+i))*h*h/6.;
+  array_spline_eval_columns(array,array_splined,n_columns,inf,h,a,b,NULL,result,result_size);
 
   return _SUCCESS_;
 }
@@ -1963,6 +2035,8 @@ int array_interpolate_linear(
   int inf,sup,mid,i;
   double h,a,b;
 
+  class_counter_add(counter_interpolations,1);
+
   inf=0;
   sup=n_lines-1;
 
@@ -2520,9 +2594,11 @@ int array_interpolate_spline_growing_closeby(
 					     int result_size, /** from 1 to n_columns */
 					     ErrorMsg errmsg) {
 
-  int inf,sup,i;
+  int inf,sup;
   double h,a,b;
 
+  class_counter_add(counter_interpolations,1);
+
   /*
   if (*last_index < 0) {
     class_sprintf(errmsg,"%s(L:%d) problem with last_index =%d < 0",__func__,__LINE__,*last_index);
@@ -2563,12 +2639,7 @@ int array_interpolate_spline_growing_closeby(
   b = (x-x_array[inf])/h;
   a = 1-b;
 
-  for (i=0; i<result_size; i++)
-    *(result+i) =
-      a * *(array+inf*n_columns+i) +
-      b * *(array+sup*n_columns+i) +
-      ((a*a*a-a)* *(array_splined+inf*n_columns+i) +
-       (b*b*b-b)* *(array_splined+sup*n_columns+i))*h*h/6.;
+  array_spline_eval_columns(array,array_splined,n_columns,inf,h,a,b,NULL,result,result_size);
 
   return _SUCCESS_;
 }
@@ -2590,9 +2661,11 @@ int array_interpolate_spline_growing_hunt(
 					     int result_size, /** from 1 to n_columns */
 					     ErrorMsg errmsg) {
 
-  int inf,sup,mid,i,inc;
+  int inf,sup,mid,inc;
   double h,a,b;
 
+  class_counter_add(counter_interpolations,1);
+
   inc=1;
 
   if (x >= x_array[*last_index]) {
@@ -2656,12 +2729,7 @@ int array_interpolate_spline_growing_hunt(
   b = (x-x_array[inf])/h;
   a = 1-b;
 
-  for (i=0; i<result_size; i++)
-    *(result+i) =
-      a * *(array+inf*n_columns+i) +
-      b * *(array+sup*n_columns+i) +
-      ((a*a*a-a)* *(array_splined+inf*n_columns+i) +
-       (b*b*b-b)* *(array_splined+sup*n_columns+i))*h*h/6.;
+  array_spline_eval_columns(array,array_splined,n_columns,inf,h,a,b,NULL,result,result_size);
 
   return _SUCCESS_;
 }
@@ -2755,6 +2823,170 @@ int array_spline_hunt(double* x_array,
   return _SUCCESS_;
 }
 
+/**
+ * Same as array_spline_hunt(), for an arbitrary point x in an array
+ * sorted in growing or decreasing order: find the index and the
+ * relative offset by bisection, but do not yet actually interpolate
+ */
+int array_spline_bisect(double * __restrict__ x_array,
+                        int x_size,
+                        double x,
+                        int * __restrict__ last,
+                        double * h,
+                        double * a,
+                        double * b,
+                        ErrorMsg errmsg){
+
+  int inf,sup,mid;
+
+  inf=0;
+  sup=x_size-1;
+
+  if (x_array[inf] < x_array[sup]){
+
+    if (x < x_array[inf]) {
+      class_sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[inf]);
+      return _FAILURE_;
+    }
+
+    if (x > x_array[sup]) {
+      class_sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[sup]);
+      return _FAILURE_;
+    }
+
+    while (sup-inf > 1) {
+
+      mid=(int)(0.5*(inf+sup));
+      if (x < x_array[mid]) {sup=mid;}
+      else {inf=mid;}
+
+    }
+
+  }
+
+  else {
+
+    if (x < x_array[sup]) {
+      class_sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,x,x_array[sup]);
+      return _FAILURE_;
+    }
+
+    if (x > x_array[inf]) {
+      class_sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,x,x_array[inf]);
+      return _FAILURE_;
+    }
+
+    while (sup-inf > 1) {
+
+      mid=(int)(0.5*(inf+sup));
+      if (x > x_array[mid]) {sup=mid;}
+      else {inf=mid;}
+
+    }
+
+  }
+
+  *last = inf;
+  *h = x_array[sup] - x_array[inf];
+  *b = (x-x_array[inf])/(*h);
+  *a = 1-(*b);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Same as array_spline_hunt(), for an array sorted in growing order
+ * and a point x presumably very close to the one of the previous call:
+ * walk from the previous index to find the index and the relative
+ * offset, but do not yet actually interpolate
+ */
+int array_spline_closeby(double * __restrict__ x_array,
+                         int x_size,
+                         double x,
+                         int * __restrict__ last,
+                         double * h,
+                         double * a,
+                         double * b,
+                         ErrorMsg errmsg){
+
+  int inf,sup;
+
+  inf = *last;
+  class_test(inf<0 || inf>(x_size-1),
+             errmsg,
+             "*lastindex=%d out of range [0:%d]\n",inf,x_size-1);
+  while (x < x_array[inf]) {
+    inf--;
+    if (inf < 0) {
+      class_sprintf(errmsg,"%s(L:%d) : x=%e < x_min=%e",__func__,__LINE__,
+                    x,x_array[0]);
+      return _FAILURE_;
+    }
+  }
+  sup = inf+1;
+  while (x > x_array[sup]) {
+    sup++;
+    if (sup > (x_size-1)) {
+      class_sprintf(errmsg,"%s(L:%d) : x=%e > x_max=%e",__func__,__LINE__,
+                    x,x_array[x_size-1]);
+      return _FAILURE_;
+    }
+  }
+  inf = sup-1;
+
+  *last = inf;
+  *h = x_array[sup] - x_array[inf];
+  *b = (x-x_array[inf])/(*h);
+  *a = 1-(*b);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Evaluate the spline interpolation of several columns of a row-major
+ * table between the lines inf and inf+1, with the offsets h, a, b
+ * returned by array_spline_hunt(), array_spline_bisect() or
+ * array_spline_closeby().
+ *
+ * The weights are computed once. If columns is NULL, the first
+ * result_size columns are evaluated with unit stride (the loop is
+ * vectorised by the compiler). Otherwise only the result_size columns
+ * listed in columns are evaluated, and each of them is stored at its
+ * own index in result, so that result can be addressed with the same
+ * indices as the table.
+ */
+_CLASS_TARGET_CLONES_
+void array_spline_eval_columns(double * __restrict__ array,
+                               double * __restrict__ array_splined,
+                               int n_columns,
+                               int inf,
+                               double h,
+                               double a,
+                               double b,
+                               int * __restrict__ columns,
+                               double * __restrict__ result,
+                               int result_size){
+
+  const double * __restrict__ y_inf = array+inf*n_columns;
+  const double * __restrict__ y_sup = y_inf+n_columns;
+  const double * __restrict__ dd_inf = array_splined+inf*n_columns;
+  const double * __restrict__ dd_sup = dd_inf+n_columns;
+  double a3 = a*a*a-a;
+  double b3 = b*b*b-b;
+  int i,j;
+
+  if (columns == NULL) {
+    for (i=0; i<result_size; i++)
+      result[i] = a*y_inf[i] + b*y_sup[i] + (a3*dd_inf[i] + b3*dd_sup[i])*h*h/6.;
+  }
+  else {
+    for (j=0; j<result_size; j++) {
+      i = columns[j];
+      result[i] = a*y_inf[i] + b*y_sup[i] + (a3*dd_inf[i] + b3*dd_sup[i])*h*h/6.;
+    }
+  }
+}
+
 /**
  * interpolate linearily to get y_i(x), when x and y_i are in two different arrays
  *
@@ -3611,3 +3843,218 @@ int array_smooth_Gaussian(double * x,
   }
   return _SUCCESS_;
 }
+
+/**
+ * Eigenvalues and eigenvectors of a real symmetric n x n matrix, by
+ * Householder reduction to tridiagonal form followed by the implicit QL
+ * algorithm (as in the public domain routines tred2 and tql2 of
+ * EISPACK/JAMA), in O(n^3) operations.
+ *
+ * On input, matrix[i*n+j] holds the (full) symmetric matrix. On output,
+ * eigenvalues contains the n eigenvalues in ascending order, and the
+ * columns of matrix the corresponding orthonormal eigenvectors: matrix[i*n+j]
+ * is the component i of the eigenvector j.
+ *
+ * Called by distortions_generate_detector().
+ */
+int array_symmetric_eigen(
+                          double * matrix,
+                          int n,
+                          double * eigenvalues,
+                          ErrorMsg errmsg){
+
+  double * v = matrix;
+  double * d = eigenvalues;
+  double * e;
+  double scale,f,g,h,hh,p,r,c,c2,c3,s,s2,el1,dl1,tst1;
+  double eps = DBL_EPSILON;
+  int i,j,k,l,m,iter;
+
+  class_test(n < 1,errmsg,"the size of the matrix should be positive, not %d",n);
+
+  class_alloc(e,n*sizeof(double),errmsg);
+
+  /** - Householder reduction to tridiagonal form (diagonal d, subdiagonal e) */
+  for (j=0; j<n; j++)
+    d[j] = v[(n-1)*n+j];
+
+  for (i=n-1; i>0; i--) {
+    scale = 0.;
+    h = 0.;
+    for (k=0; k<i; k++)
+      scale += fabs(d[k]);
+    if (scale == 0.) {
+      e[i] = d[i-1];
+      for (j=0; j<i; j++) {
+        d[j] = v[(i-1)*n+j];
+        v[i*n+j] = 0.;
+        v[j*n+i] = 0.;
+      }
+    }
+    else {
+      for (k=0; k<i; k++) {
+        d[k] /= scale;
+        h += d[k]*d[k];
+      }
+      f = d[i-1];
+      g = sqrt(h);
+      if (f > 0.)
+        g = -g;
+      e[i] = scale*g;
+      h -= f*g;
+      d[i-1] = f-g;
+      for (j=0; j<i; j++)
+        e[j] = 0.;
+      for (j=0; j<i; j++) {
+        f = d[j];
+        v[j*n+i] = f;
+        g = e[j]+v[j*n+j]*f;
+        for (k=j+1; k<i; k++) {
+          g += v[k*n+j]*d[k];
+          e[k] += v[k*n+j]*f;
+        }
+        e[j] = g;
+      }
+      f = 0.;
+      for (j=0; j<i; j++) {
+        e[j] /= h;
+        f += e[j]*d[j];
+      }
+      hh = f/(h+h);
+      for (j=0; j<i; j++)
+        e[j] -= hh*d[j];
+      for (j=0; j<i; j++) {
+        f = d[j];
+        g = e[j];
+        for (k=j; k<i; k++)
+          v[k*n+j] -= (f*e[k]+g*d[k]);
+        d[j] = v[(i-1)*n+j];
+        v[i*n+j] = 0.;
+      }
+    }
+    d[i] = h;
+  }
+
+  /** - accumulate the transformations */
+  for (i=0; i<n-1; i++) {
+    v[(n-1)*n+i] = v[i*n+i];
+    v[i*n+i] = 1.;
+    h = d[i+1];
+    if (h != 0.) {
+      for (k=0; k<=i; k++)
+        d[k] = v[k*n+i+1]/h;
+      for (j=0; j<=i; j++) {
+        g = 0.;
+        for (k=0; k<=i; k++)
+          g += v[k*n+i+1]*v[k*n+j];
+        for (k=0; k<=i; k++)
+          v[k*n+j] -= g*d[k];
+      }
+    }
+    for (k=0; k<=i; k++)
+      v[k*n+i+1] = 0.;
+  }
+  for (j=0; j<n; j++) {
+    d[j] = v[(n-1)*n+j];
+    v[(n-1)*n+j] = 0.;
+  }
+  v[(n-1)*n+n-1] = 1.;
+  e[0] = 0.;
+
+  /** - implicit QL iterations on the tridiagonal matrix */
+  for (i=1; i<n; i++)
+    e[i-1] = e[i];
+  e[n-1] = 0.;
+
+  f = 0.;
+  tst1 = 0.;
+  for (l=0; l<n; l++) {
+
+    tst1 = MAX(tst1,fabs(d[l])+fabs(e[l]));
+    for (m=l; m<n-1; m++) {
+      if (fabs(e[m]) <= eps*tst1)
+        break;
+    }
+
+    if (m > l) {
+      iter = 0;
+      do {
+        iter++;
+        class_test_except(iter > 100,
+                          errmsg,
+                          free(e),
+                          "no convergence of the eigenvalue %d of a %d x %d matrix",l,n,n);
+
+        g = d[l];
+        p = (d[l+1]-g)/(2.*e[l]);
+        r = sqrt(p*p+1.);
+        if (p < 0.)
+          r = -r;
+        d[l] = e[l]/(p+r);
+        d[l+1] = e[l]*(p+r);
+        dl1 = d[l+1];
+        h = g-d[l];
+        for (i=l+2; i<n; i++)
+          d[i] -= h;
+        f += h;
+
+        p = d[m];
+        c = 1.;
+        c2 = c;
+        c3 = c;
+        el1 = e[l+1];
+        s = 0.;
+        s2 = 0.;
+        for (i=m-1; i>=l; i--) {
+          c3 = c2;
+          c2 = c;
+          s2 = s;
+          g = c*e[i];
+          h = c*p;
+          r = sqrt(p*p+e[i]*e[i]);
+          e[i+1] = s*r;
+          s = e[i]/r;
+          c = p/r;
+          p = c*d[i]-s*g;
+          d[i+1] = h+s*(c*g+s*d[i]);
+          for (k=0; k<n; k++) {
+            h = v[k*n+i+1];
+            v[k*n+i+1] = s*v[k*n+i]+c*h;
+            v[k*n+i] = c*v[k*n+i]-s*h;
+          }
+        }
+        p = -s*s2*c3*el1*e[l]/dl1;
+        e[l] = s*p;
+        d[l] = c*p;
+
+      } while (fabs(e[l]) > eps*tst1);
+    }
+    d[l] += f;
+    e[l] = 0.;
+  }
+
+  free(e);
+
+  /** - sort the eigenvalues and eigenvectors in ascending order */
+  for (i=0; i<n-1; i++) {
+    k = i;
+    p = d[i];
+    for (j=i+1; j<n; j++) {
+      if (d[j] < p) {
+        k = j;
+        p = d[j];
+      }
+    }
+    if (k != i) {
+      d[k] = d[i];
+      d[i] = p;
+      for (j=0; j<n; j++) {
+        p = v[j*n+i];
+        v[j*n+i] = v[j*n+k];
+        v[j*n+k] = p;
+      }
+    }
+  }
+
+  return _SUCCESS_;
+}
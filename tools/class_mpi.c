@@ -0,0 +1,127 @@
+/** @file class_mpi.c Distribution of single runs over several MPI processes
+ *
+ * The only file of CLASS calling MPI, when compiled with _CLASS_MPI_
+ * (see the Makefile). The processes run the same code, and only
+ * diverge in the loops distributed by the modules (which then call
+ * class_mpi_agree() and class_mpi_broadcast()); the collective calls
+ * are therefore always made in the same order by all of them.
+ */
+
+#include "class_mpi.h"
+#ifdef _CLASS_MPI_
+#include <mpi.h>
+#include <limits.h>
+
+static void class_mpi_finalize() {
+  int finalized;
+  MPI_Finalized(&finalized);
+  if (finalized == 0)
+    MPI_Finalize();
+}
+#endif
+
+/**
+ * Initialize MPI, if not done yet by the caller (e.g. by a python
+ * wrapper), and finalize it at exit.
+ *
+ * @param argc Input/Output: pointer to the number of arguments of main()
+ * @param argv Input/Output: pointer to the arguments of main()
+ * @return the error status
+ */
+
+int class_mpi_init(int * argc, char *** argv) {
+#ifdef _CLASS_MPI_
+  int initialized, provided;
+  MPI_Initialized(&initialized);
+  if (initialized == 0) {
+    /* the modules calling MPI may run in different workers of the pool
+       (see modules_init()), but never at the same time */
+    if (MPI_Init_thread(argc,argv,MPI_THREAD_SERIALIZED,&provided) != MPI_SUCCESS)
+      return _FAILURE_;
+    atexit(class_mpi_finalize);
+  }
+#endif
+  return _SUCCESS_;
+}
+
+/**
+ * Number of processes sharing the run (1 without MPI)
+ */
+
+int class_mpi_size() {
+#ifdef _CLASS_MPI_
+  int initialized, size;
+  MPI_Initialized(&initialized);
+  if (initialized == 0)
+    return 1;
+  MPI_Comm_size(MPI_COMM_WORLD,&size);
+  return size;
+#else
+  return 1;
+#endif
+}
+
+/**
+ * Rank of the calling process (0 without MPI)
+ */
+
+int class_mpi_rank() {
+#ifdef _CLASS_MPI_
+  int initialized, rank;
+  MPI_Initialized(&initialized);
+  if (initialized == 0)
+    return 0;
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  return rank;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * Combine the status of a distributed loop over all processes: the
+ * loop fails everywhere if it failed in any process. The processes in
+ * which it did not fail get an error message pointing to the others.
+ *
+ * @param status        Input: status of the loop in the calling process
+ * @param error_message Output: error message
+ * @return the status of the loop in all processes
+ */
+
+int class_mpi_agree(int status, ErrorMsg error_message) {
+#ifdef _CLASS_MPI_
+  int any_failure;
+  if (class_mpi_size() > 1) {
+    MPI_Allreduce(&status,&any_failure,1,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+    class_test((status == _SUCCESS_) && (any_failure != _SUCCESS_),
+               error_message,
+               "failure in another MPI process");
+    return any_failure;
+  }
+#endif
+  return status;
+}
+
+/**
+ * Send an array from one process to all the others.
+ *
+ * @param buffer        Input/Output: the array (input in process root, output in the others)
+ * @param count         Input: number of values
+ * @param root          Input: rank of the sending process
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int class_mpi_broadcast(double * buffer, size_t count, int root, ErrorMsg error_message) {
+#ifdef _CLASS_MPI_
+  size_t offset, chunk;
+  /* the counts of MPI are int */
+  for (offset = 0; offset < count; offset += chunk) {
+    chunk = MIN(count-offset,(size_t)(INT_MAX/2));
+    class_test(MPI_Bcast(buffer+offset,(int)chunk,MPI_DOUBLE,root,MPI_COMM_WORLD) != MPI_SUCCESS,
+               error_message,
+               "could not broadcast %zu values from process %d",count,root);
+  }
+#endif
+  return _SUCCESS_;
+}
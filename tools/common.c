@@ -1,7 +1,229 @@
 #include "common.h"
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+/* set while the calling thread unwinds a cancelled parallel task (see class_parallel_cancelled()) */
+static __thread int class_error_messages_muted = _FALSE_;
+
+int class_mute_error_messages(int muted) {
+  int previous = class_error_messages_muted;
+  class_error_messages_muted = muted;
+  return previous;
+}
+
+/* size of the transparent huge pages */
+#define _HUGE_PAGE_SIZE_ (2*1024*1024)
+
+/* smallest array recycled by class_recycle_large(): smaller arrays are
+   left to malloc(), which reuses the memory of the arrays freed before
+   them (the allocator of the GNU C library maps new pages for each
+   array above a threshold adapted to the arrays already freed, but at
+   most 32 MB) */
+#define _RECYCLE_MIN_SIZE_ (32*1024*1024)
+
+/* big arrays possibly kept by class_free_large() for being reused by
+   class_malloc_large() (see class_recycle_large()) */
+struct class_large_block {
+  void * pointer;   /* the array */
+  size_t capacity;  /* its size in bytes */
+};
+
+static struct {
+  pthread_mutex_t mutex;
+  int recycle;                        /* whether the arrays freed by class_free_large() are kept */
+  struct class_large_block * live;    /* arrays allocated while recycling, not yet freed */
+  int live_num, live_max;
+  struct class_large_block * kept;    /* arrays freed while recycling, oldest first */
+  int kept_num, kept_max;
+  size_t live_bytes, kept_bytes;
+  size_t peak_bytes;                  /* largest live_bytes so far */
+} class_large = {PTHREAD_MUTEX_INITIALIZER,0,NULL,0,0,NULL,0,0,0,0,0};
+
+/* append a block to one of the lists of class_large (mutex held) */
+static int class_large_push(struct class_large_block ** list, int * num, int * max, void * pointer, size_t capacity) {
+  struct class_large_block * grown;
+  if (*num == *max) {
+    grown = (struct class_large_block *)realloc(*list,(*max+64)*sizeof(struct class_large_block));
+    if (grown == NULL)
+      return _FAILURE_;
+    *list = grown;
+    *max += 64;
+  }
+  (*list)[*num].pointer = pointer;
+  (*list)[*num].capacity = capacity;
+  (*num)++;
+  return _SUCCESS_;
+}
+
+/* remove the block of index i of one of the lists of class_large, keeping the order (mutex held) */
+static void class_large_remove(struct class_large_block * list, int * num, int i) {
+  memmove(list+i,list+i+1,(*num-i-1)*sizeof(struct class_large_block));
+  (*num)--;
+}
+
+/**
+ * Start or stop recycling the big arrays of class_alloc_large(), for
+ * programs computing many models in a row with the same precision
+ * (classy in a chain, class_server...), whose tables have (nearly) the
+ * same sizes from one model to the next. While recycling, the arrays
+ * released by class_free_large() (that is, by the *_free() function of
+ * each module) are kept, and given back by class_malloc_large() for
+ * any request between 80% and 100% of their size: the pages of the
+ * next model are then already mapped, which avoids the page faults and
+ * the zeroing of the new pages by the kernel. The kept arrays are freed
+ * when they would bring the memory used by the big arrays above its
+ * largest value so far, and when recycling stops.
+ *
+ * @param recycle Input: _TRUE_ to start, _FALSE_ to stop and free the kept arrays
+ * @return the previous state
+ */
+
+int class_recycle_large(int recycle) {
+  int previous;
+
+  pthread_mutex_lock(&class_large.mutex);
+  previous = class_large.recycle;
+  class_large.recycle = recycle;
+  if (recycle == _FALSE_) {
+    while (class_large.kept_num > 0) {
+      class_large.kept_num--;
+      free(class_large.kept[class_large.kept_num].pointer);
+    }
+    class_large.kept_bytes = 0;
+  }
+  pthread_mutex_unlock(&class_large.mutex);
+
+  return previous;
+}
+
+/* find a kept array for a request of the given size, and record it
+   as live; without one, make room for the new array (mutex held) */
+static void * class_large_reuse(size_t size) {
+  int i;
+  void * pointer;
+  size_t capacity;
+
+  for (i = class_large.kept_num-1; i >= 0; i--) {
+    capacity = class_large.kept[i].capacity;
+    if ((capacity >= size) && (capacity - capacity/5 <= size)) {
+      pointer = class_large.kept[i].pointer;
+      if (class_large_push(&class_large.live,&class_large.live_num,&class_large.live_max,pointer,capacity) == _FAILURE_)
+        return NULL;
+      class_large_remove(class_large.kept,&class_large.kept_num,i);
+      class_large.kept_bytes -= capacity;
+      class_large.live_bytes += capacity;
+      return pointer;
+    }
+  }
+
+  while ((class_large.kept_num > 0) &&
+         (class_large.kept_bytes + class_large.live_bytes + size > class_large.peak_bytes)) {
+    class_large.kept_bytes -= class_large.kept[0].capacity;
+    free(class_large.kept[0].pointer);
+    class_large_remove(class_large.kept,&class_large.kept_num,0);
+  }
+
+  return NULL;
+}
+
+/**
+ * Allocate a big array, released by class_free_large(). Above the
+ * size of a huge page, the array is aligned on 2 MB and, on Linux, the
+ * kernel is advised to back it with transparent huge pages (this only
+ * has an effect if /sys/kernel/mm/transparent_hugepage/enabled is
+ * 'madvise' or 'always'). Setting the environment variable
+ * CLASS_HUGE_PAGES to 'no' falls back to malloc(). While recycling
+ * (see class_recycle_large()), an array kept from a previous model is
+ * returned if its size fits.
+ *
+ * @param size Input: size in bytes
+ * @return the array, or NULL if it could not be allocated
+ */
+
+void* class_malloc_large(size_t size) {
+  void * pointer;
+  char * s;
+  int recycle;
+
+  if (size < _HUGE_PAGE_SIZE_)
+    return malloc(size);
+
+  pthread_mutex_lock(&class_large.mutex);
+  recycle = (class_large.recycle == _TRUE_) && (size >= _RECYCLE_MIN_SIZE_);
+  pointer = NULL;
+  if (recycle == _TRUE_)
+    pointer = class_large_reuse(size);
+  pthread_mutex_unlock(&class_large.mutex);
+
+  if (pointer != NULL)
+    return pointer;
+
+  s = getenv("CLASS_HUGE_PAGES");
+
+  if ((s != NULL) && (strcmp(s,"no") == 0)) {
+    pointer = malloc(size);
+  }
+  else {
+    if (posix_memalign(&pointer,_HUGE_PAGE_SIZE_,size) != 0)
+      return NULL;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    /* only the whole huge pages of the array, the advice failing harmlessly if they are disabled */
+    madvise(pointer,size-size%_HUGE_PAGE_SIZE_,MADV_HUGEPAGE);
+#endif
+  }
+
+  if ((recycle == _TRUE_) && (pointer != NULL)) {
+    pthread_mutex_lock(&class_large.mutex);
+    if (class_large_push(&class_large.live,&class_large.live_num,&class_large.live_max,pointer,size) == _SUCCESS_) {
+      class_large.live_bytes += size;
+      class_large.peak_bytes = MAX(class_large.peak_bytes,class_large.live_bytes);
+    }
+    pthread_mutex_unlock(&class_large.mutex);
+  }
+
+  return pointer;
+}
+
+/**
+ * Release an array allocated by class_malloc_large() (or by malloc()):
+ * while recycling, it is kept for a later allocation (see
+ * class_recycle_large()), otherwise it is freed.
+ *
+ * @param pointer Input: the array, or NULL
+ */
+
+void class_free_large(void * pointer) {
+  int i;
+
+  if (pointer == NULL)
+    return;
+
+  pthread_mutex_lock(&class_large.mutex);
+  for (i = class_large.live_num-1; i >= 0; i--) {
+    if (class_large.live[i].pointer == pointer)
+      break;
+  }
+  if (i >= 0) {
+    class_large.live_bytes -= class_large.live[i].capacity;
+    if ((class_large.recycle == _TRUE_) &&
+        (class_large_push(&class_large.kept,&class_large.kept_num,&class_large.kept_max,pointer,class_large.live[i].capacity) == _SUCCESS_)) {
+      class_large.kept_bytes += class_large.live[i].capacity;
+      pointer = NULL;
+    }
+    class_large_remove(class_large.live,&class_large.live_num,i);
+  }
+  pthread_mutex_unlock(&class_large.mutex);
+
+  free(pointer);
+}
 
 void class_protect_sprintf(char* dest, char* tpl,...) {
   va_list args;
+  if (class_error_messages_muted == _TRUE_)
+    return;
   va_start(args,tpl);
   vsnprintf(dest, 2048,tpl,args);
   va_end(args);
@@ -0,0 +1,574 @@
+/** @file data_files.c Tables of numbers read from external files
+ *
+ * The external files of the modules (BBN table, phase-space
+ * distributions of ncdm species, selection functions, tables of the
+ * distortions module) are parsed here, once per process: the tables
+ * are kept in a list shared by all the runs, and found again from the
+ * path, size and modification time of the file. On request, each
+ * table is also written in binary form next to its file, with
+ * extension .bin, and the next processes map this copy instead of
+ * parsing the text file, as long as the latter is unchanged.
+ */
+
+#include "data_files.h"
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef _DATA_FILES_MMAP_
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
+/* tables read by data_file_get(), shared by all the runs */
+static struct data_file * data_files = NULL;
+static pthread_mutex_t data_files_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void data_file_free(struct data_file * pdf);
+static void data_file_insert(struct data_file * pdf);
+
+/**
+ * Return the content of an external file of numbers. The file is read
+ * only once per process (or again if it has been modified in the
+ * meantime): the tables are kept in memory and shared by all the runs,
+ * which must not modify them. If use_binary is true, the table is also
+ * read from (or written to) a binary copy of the file with extension
+ * .bin, as long as the text file is unchanged. The caller must give
+ * the table back with data_file_release() once it is done with it, so
+ * that a table replaced in the meantime (file modified, or registered
+ * again by data_file_set()) can be freed.
+ *
+ * @param file_name      Input: full path of the file
+ * @param format         Input: layout of the file
+ * @param format_columns Input: fixed number of columns of the layout (see enum data_file_format)
+ * @param use_binary     Input: whether to use a binary copy of the file
+ * @param ppdf           Output: pointer to the table
+ * @param error_message  Output: error message
+ * @return the error status
+ */
+
+int data_file_get(char * file_name,
+                  enum data_file_format format,
+                  int format_columns,
+                  short use_binary,
+                  struct data_file ** ppdf,
+                  ErrorMsg error_message){
+
+  /** Define local variables */
+  struct data_file * pdf;
+  struct stat file_stat;
+  char * binary_file_name = NULL;
+  int has_binary = _FALSE_;
+
+  class_test(stat(file_name,&file_stat) != 0,
+             error_message,
+             "could not open %s",file_name);
+
+  class_test((format_columns < 0) || ((format_columns == 0) && (format != data_file_rows_header)),
+             error_message,
+             "the number of columns of %s should be positive, not %d",file_name,format_columns);
+
+  pthread_mutex_lock(&data_files_mutex);
+
+  /** Look for a table read from the same (unchanged) file */
+  for (pdf=data_files; pdf!=NULL; pdf=pdf->next) {
+    if ((strcmp(pdf->file_name,file_name) == 0) &&
+        (pdf->file_size == (long long)file_stat.st_size) &&
+        (pdf->file_mtime == (long long)file_stat.st_mtime) &&
+        (pdf->format == format) &&
+        (pdf->format_columns == format_columns)) {
+      pdf->users++;
+      pthread_mutex_unlock(&data_files_mutex);
+      *ppdf = pdf;
+      return _SUCCESS_;
+    }
+  }
+
+  /** Otherwise, read the file (or its binary copy) in a new table */
+  pdf = (struct data_file *)calloc(1,sizeof(struct data_file));
+  if (pdf != NULL)
+    pdf->file_name = (char *)malloc(strlen(file_name)+1);
+  if ((pdf != NULL) && (use_binary == _TRUE_))
+    binary_file_name = (char *)malloc(strlen(file_name)+5);
+  class_test_except((pdf == NULL) || (pdf->file_name == NULL) || ((use_binary == _TRUE_) && (binary_file_name == NULL)),
+                    error_message,
+                    if (pdf != NULL) free(pdf->file_name);free(pdf);free(binary_file_name);pthread_mutex_unlock(&data_files_mutex),
+                    "could not allocate the table of %s",file_name);
+
+  strcpy(pdf->file_name,file_name);
+  pdf->file_size = (long long)file_stat.st_size;
+  pdf->file_mtime = (long long)file_stat.st_mtime;
+  pdf->format = format;
+  pdf->format_columns = format_columns;
+
+  if (use_binary == _TRUE_) {
+    sprintf(binary_file_name,"%s.bin",file_name);
+    has_binary = (data_file_read_binary(binary_file_name,pdf) == _SUCCESS_);
+  }
+
+  if (has_binary == _FALSE_) {
+    class_call_except(data_file_read(pdf,error_message),
+                      error_message,
+                      error_message,
+                      free(pdf->data);free(pdf->file_name);free(pdf);free(binary_file_name);pthread_mutex_unlock(&data_files_mutex));
+
+    /* a failure to write the binary copy is not an error */
+    if (use_binary == _TRUE_) {
+      data_file_write_binary(binary_file_name,pdf);
+    }
+  }
+
+  free(binary_file_name);
+
+  pdf->users = 1;
+  data_file_insert(pdf);
+
+  pthread_mutex_unlock(&data_files_mutex);
+
+  *ppdf = pdf;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Register in the list of data_file_get() the content of an external
+ * file that has just been written by the caller, so that the runs
+ * asking for this file get the table without parsing it again (and, if
+ * use_binary is true, write its binary copy). The table is a copy of
+ * data; it must be exactly what data_file_read() would read from the
+ * file. It replaces any table of the list read from the same file.
+ *
+ * @param file_name      Input: full path of the file
+ * @param format         Input: layout of the file
+ * @param format_columns Input: fixed number of columns of the layout (see enum data_file_format)
+ * @param header         Input: the two numbers of the header line (ignored for data_file_columns)
+ * @param rows           Input: number of rows
+ * @param columns        Input: number of numbers in each row
+ * @param data           Input: data[index_column*rows+index_row]
+ * @param use_binary     Input: whether to write a binary copy of the file
+ * @param error_message  Output: error message
+ * @return the error status
+ */
+
+int data_file_set(char * file_name,
+                  enum data_file_format format,
+                  int format_columns,
+                  int * header,
+                  int rows,
+                  int columns,
+                  double * data,
+                  short use_binary,
+                  ErrorMsg error_message){
+
+  /** Define local variables */
+  struct data_file * pdf;
+  struct stat file_stat;
+  char * binary_file_name;
+  size_t size = (size_t)rows*columns;
+
+  class_test(stat(file_name,&file_stat) != 0,
+             error_message,
+             "could not open %s",file_name);
+
+  class_test((rows <= 0) || (columns <= 0),
+             error_message,
+             "the table of %s should not be empty",file_name);
+
+  class_calloc(pdf,1,sizeof(struct data_file),error_message);
+  class_alloc(pdf->file_name,strlen(file_name)+1,error_message);
+  class_alloc(pdf->data,size*sizeof(double),error_message);
+
+  strcpy(pdf->file_name,file_name);
+  pdf->file_size = (long long)file_stat.st_size;
+  pdf->file_mtime = (long long)file_stat.st_mtime;
+  pdf->format = format;
+  pdf->format_columns = format_columns;
+  if (format != data_file_columns) {
+    pdf->header[0] = header[0];
+    pdf->header[1] = header[1];
+  }
+  pdf->rows = rows;
+  pdf->columns = columns;
+  memcpy(pdf->data,data,size*sizeof(double));
+
+  /* a failure to write the binary copy is not an error */
+  if (use_binary == _TRUE_) {
+    binary_file_name = (char *)malloc(strlen(file_name)+5);
+    if (binary_file_name != NULL) {
+      sprintf(binary_file_name,"%s.bin",file_name);
+      data_file_write_binary(binary_file_name,pdf);
+      free(binary_file_name);
+    }
+  }
+
+  pthread_mutex_lock(&data_files_mutex);
+  data_file_insert(pdf);
+  pthread_mutex_unlock(&data_files_mutex);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Give back a table returned by data_file_get(). The table stays in
+ * the list for the next runs, unless it has been replaced in the
+ * meantime: it is then freed by its last user. A run failing between
+ * data_file_get() and this call only keeps a replaced table in memory.
+ *
+ * @param pdf Input: table
+ * @return the error status
+ */
+
+int data_file_release(struct data_file * pdf){
+
+  pthread_mutex_lock(&data_files_mutex);
+  pdf->users--;
+  if ((pdf->is_stale == _TRUE_) && (pdf->users == 0))
+    data_file_free(pdf);
+  pthread_mutex_unlock(&data_files_mutex);
+
+  return _SUCCESS_;
+}
+
+/* Prepend a new table to the list (with the mutex locked), in place of
+   the tables read from the same file with the same layout: these are
+   freed now if no run uses them, or else by their last user in
+   data_file_release() */
+static void data_file_insert(struct data_file * pdf){
+
+  struct data_file ** ppdf = &data_files;
+  struct data_file * pdf_old;
+
+  while (*ppdf != NULL) {
+    pdf_old = *ppdf;
+    if ((strcmp(pdf_old->file_name,pdf->file_name) == 0) &&
+        (pdf_old->format == pdf->format) &&
+        (pdf_old->format_columns == pdf->format_columns)) {
+      *ppdf = pdf_old->next;
+      pdf_old->is_stale = _TRUE_;
+      if (pdf_old->users == 0)
+        data_file_free(pdf_old);
+    }
+    else {
+      ppdf = &(pdf_old->next);
+    }
+  }
+
+  pdf->next = data_files;
+  data_files = pdf;
+}
+
+/* Free a table, allocated or mapped from its binary copy */
+static void data_file_free(struct data_file * pdf){
+
+#ifdef _DATA_FILES_MMAP_
+  if (pdf->map != NULL)
+    munmap(pdf->map,_DATA_FILES_HEADER_SIZE_+(size_t)pdf->rows*pdf->columns*sizeof(double));
+  else
+#endif
+    free(pdf->data);
+  free(pdf->file_name);
+  free(pdf);
+}
+
+/**
+ * Parse an external text file in one go. The comment lines are first
+ * blanked out (as everywhere in CLASS, a line is a comment if its
+ * first non-blank character is not above 39 in ASCII, e.g. # or %),
+ * then the header numbers and the rows are read from the remaining
+ * stream of numbers.
+ *
+ * @param pdf           Input/Output: table (with file_name, file_size, file_mtime, format and format_columns already set)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int data_file_read(struct data_file * pdf,
+                   ErrorMsg error_message){
+
+  /** Define local variables */
+  FILE * infile;
+  char * text;
+  char * left;
+  char * right;
+  double * values = NULL;
+  size_t text_size,size,values_size=0,values_max=0,needed;
+  int at_line_start,index_row,index_column;
+  long header;
+
+  /** Read the whole file */
+  class_open(infile, pdf->file_name, "r", error_message);
+
+  text_size = (size_t)pdf->file_size;
+  class_alloc(text, text_size+1, error_message);
+  size = fread(text,1,text_size,infile);
+  fclose(infile);
+  text[size] = '\0';
+
+  /** Blank out the comment lines */
+  for (left=text, at_line_start=_TRUE_; *left!='\0'; left++) {
+    if (*left == '\n') {
+      at_line_start = _TRUE_;
+    }
+    else if ((at_line_start == _TRUE_) && (isspace((unsigned char)*left) == 0)) {
+      at_line_start = _FALSE_;
+      if (*left <= 39) {
+        while ((*left != '\0') && (*left != '\n')) {
+          *left = ' ';
+          left++;
+        }
+        if (*left == '\0')
+          break;
+        at_line_start = _TRUE_;
+      }
+    }
+  }
+
+  left = text;
+
+  /** Read the header line, if any, and infer the size of the table */
+  pdf->header[0] = 0;
+  pdf->header[1] = 0;
+  if (pdf->format != data_file_columns) {
+    for (index_column=0; index_column<2; index_column++) {
+      header = strtol(left,&right,10);
+      class_test_except((right == left) || ((*right != '\0') && (isspace((unsigned char)*right) == 0)),
+                        error_message,
+                        free(text),
+                        "could not read the header (two integers) of file '%s'",pdf->file_name);
+      class_test_except((header < 0) || (header > INT_MAX),
+                        error_message,
+                        free(text),
+                        "the numbers of the header of file '%s' should not be negative",pdf->file_name);
+      pdf->header[index_column] = (int)header;
+      left = right;
+    }
+  }
+
+  switch (pdf->format) {
+  case data_file_columns:
+    pdf->columns = pdf->format_columns;
+    break;
+  case data_file_rows_header:
+    pdf->rows = pdf->header[0];
+    pdf->columns = pdf->format_columns+pdf->header[1];
+    break;
+  case data_file_grid_header:
+    pdf->rows = pdf->header[0]*pdf->header[1];
+    pdf->columns = pdf->format_columns;
+    break;
+  }
+
+  class_test_except(pdf->columns <= 0,
+                    error_message,
+                    free(text),
+                    "no columns in file '%s'",pdf->file_name);
+
+  /** Read the numbers, until the first entry which is not a number */
+  for (;;) {
+    if (values_size == values_max) {
+      values_max = MAX(2*values_max,1024);
+      values = (double *)realloc(values,values_max*sizeof(double));
+      class_test_except(values == NULL,
+                        error_message,
+                        free(text),
+                        "could not allocate the numbers of file '%s'",pdf->file_name);
+    }
+    values[values_size] = strtod(left,&right);
+    if (right == left)
+      break;
+    values_size++;
+    left = right;
+  }
+
+  free(text);
+
+  if (pdf->format == data_file_columns) {
+    pdf->rows = (int)(values_size/pdf->columns);
+  }
+  else {
+    needed = (size_t)pdf->rows*pdf->columns;
+    class_test_except(values_size < needed,
+                      error_message,
+                      free(values),
+                      "could not read column %d of row %d in file '%s'",
+                      (int)(values_size%pdf->columns)+1,(int)(values_size/pdf->columns)+1,pdf->file_name);
+  }
+
+  class_test_except(pdf->rows == 0,
+                    error_message,
+                    free(values),
+                    "no rows of %d numbers in file '%s'",pdf->columns,pdf->file_name);
+
+  /** Store the numbers column by column */
+  class_alloc(pdf->data, (size_t)pdf->rows*pdf->columns*sizeof(double), error_message);
+  for (index_row=0; index_row<pdf->rows; index_row++) {
+    for (index_column=0; index_column<pdf->columns; index_column++) {
+      pdf->data[(size_t)index_column*pdf->rows+index_row] = values[(size_t)index_row*pdf->columns+index_column];
+    }
+  }
+
+  free(values);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read the binary copy of an external file written by
+ * data_file_write_binary(), if it exists and matches the text file:
+ * the data is mapped in memory when possible. Returns _FAILURE_
+ * without message otherwise.
+ *
+ * @param binary_file_name Input: full path of the binary file
+ * @param pdf              Input/Output: table (with file_name, file_size, file_mtime, format and format_columns already set)
+ * @return the error status
+ */
+
+int data_file_read_binary(char * binary_file_name,
+                          struct data_file * pdf){
+
+  /** Define local variables */
+  struct data_file_binary_header header;
+  size_t size;
+#ifdef _DATA_FILES_MMAP_
+  struct stat file_stat;
+  void * map;
+  int fd;
+
+  fd = open(binary_file_name,O_RDONLY);
+  if (fd < 0)
+    return _FAILURE_;
+
+  if ((fstat(fd,&file_stat) != 0) ||
+      (read(fd,&header,sizeof(header)) != (ssize_t)sizeof(header))) {
+    close(fd);
+    return _FAILURE_;
+  }
+#else
+  FILE * infile;
+
+  infile = fopen(binary_file_name,"rb");
+  if (infile == NULL)
+    return _FAILURE_;
+
+  if (fread(&header,sizeof(header),1,infile) != 1) {
+    fclose(infile);
+    return _FAILURE_;
+  }
+#endif
+
+  size = (size_t)header.rows*header.columns;
+
+  if ((strncmp(header.magic,"CLASSDAT",8) != 0) ||
+      (header.version != _DATA_FILES_VERSION_) ||
+      (header.size_of_double != (int)sizeof(double)) ||
+      (header.file_size != pdf->file_size) ||
+      (header.file_mtime != pdf->file_mtime) ||
+      (header.format != (int)pdf->format) ||
+      (header.format_columns != pdf->format_columns) ||
+      (header.rows <= 0) ||
+      (header.columns <= 0)
+#ifdef _DATA_FILES_MMAP_
+      || ((size_t)file_stat.st_size != _DATA_FILES_HEADER_SIZE_+size*sizeof(double))
+#endif
+      ) {
+#ifdef _DATA_FILES_MMAP_
+    close(fd);
+#else
+    fclose(infile);
+#endif
+    return _FAILURE_;
+  }
+
+#ifdef _DATA_FILES_MMAP_
+  map = mmap(NULL,(size_t)file_stat.st_size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return _FAILURE_;
+
+  pdf->map = map;
+  pdf->data = (double *)((char *)map + _DATA_FILES_HEADER_SIZE_);
+#else
+  pdf->data = (double *)malloc(size*sizeof(double));
+  if ((pdf->data == NULL) ||
+      (fseek(infile,_DATA_FILES_HEADER_SIZE_,SEEK_SET) != 0) ||
+      (fread(pdf->data,sizeof(double),size,infile) != size)) {
+    free(pdf->data);
+    pdf->data = NULL;
+    fclose(infile);
+    return _FAILURE_;
+  }
+
+  fclose(infile);
+#endif
+
+  pdf->header[0] = header.header[0];
+  pdf->header[1] = header.header[1];
+  pdf->rows = header.rows;
+  pdf->columns = header.columns;
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write the binary copy of an external file, through a temporary file
+ * renamed at the end, so that concurrent processes never see a partial
+ * file. Returns _FAILURE_ without message if anything goes wrong, the
+ * caller can ignore it.
+ *
+ * @param binary_file_name Input: full path of the binary file
+ * @param pdf              Input: table
+ * @return the error status
+ */
+
+int data_file_write_binary(char * binary_file_name,
+                           struct data_file * pdf){
+
+  /** Define local variables */
+  struct data_file_binary_header header;
+  char padding[_DATA_FILES_HEADER_SIZE_];
+  char * tmp_name;
+  FILE * outfile;
+  size_t size = (size_t)pdf->rows*pdf->columns;
+  int status;
+
+  tmp_name = (char *)malloc(strlen(binary_file_name)+32);
+  if (tmp_name == NULL)
+    return _FAILURE_;
+  sprintf(tmp_name,"%s.%ld.tmp",binary_file_name,(long)getpid());
+
+  outfile = fopen(tmp_name,"wb");
+  if (outfile == NULL) {
+    free(tmp_name);
+    return _FAILURE_;
+  }
+
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,"CLASSDAT",8);
+  header.version = _DATA_FILES_VERSION_;
+  header.size_of_double = (int)sizeof(double);
+  header.file_size = pdf->file_size;
+  header.file_mtime = pdf->file_mtime;
+  header.format = (int)pdf->format;
+  header.format_columns = pdf->format_columns;
+  header.header[0] = pdf->header[0];
+  header.header[1] = pdf->header[1];
+  header.rows = pdf->rows;
+  header.columns = pdf->columns;
+
+  memset(padding,0,_DATA_FILES_HEADER_SIZE_);
+  memcpy(padding,&header,sizeof(header));
+
+  status = ((fwrite(padding,1,_DATA_FILES_HEADER_SIZE_,outfile) == _DATA_FILES_HEADER_SIZE_) &&
+            (fwrite(pdf->data,sizeof(double),size,outfile) == size));
+
+  if ((fclose(outfile) != 0) || (status == 0) || (rename(tmp_name,binary_file_name) != 0)) {
+    remove(tmp_name);
+    free(tmp_name);
+    return _FAILURE_;
+  }
+
+  free(tmp_name);
+
+  return _SUCCESS_;
+}
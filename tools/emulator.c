@@ -0,0 +1,476 @@
+/** @file emulator.c Polynomial emulators of vectors of outputs
+ *
+ * An emulator predicts a vector of outputs (C_l's, derived
+ * parameters...) for given values of a few parameters, from a sample
+ * of vectors computed with CLASS for other values. The outputs are
+ * standardized and decomposed on their principal components (from the
+ * Gram matrix of the sample, since there are much fewer samples than
+ * outputs), and the coefficient of each component is fitted by a
+ * polynomial of the parameters, by least squares. The leave-one-out
+ * error of the fits is kept with the emulator, so that the caller can
+ * decide whether its predictions are accurate enough.
+ */
+
+#include "emulator.h"
+#include "arrays.h"
+
+/**
+ * Train an emulator on a sample.
+ *
+ * The degree of the polynomials is reduced if the sample is too small
+ * for the requested one: there must be more samples than monomials.
+ *
+ * @param num_parameters Input: number of parameters
+ * @param num_outputs    Input: number of outputs
+ * @param num_samples    Input: number of samples
+ * @param parameters     Input: parameters[index_sample*num_parameters+index_parameter]
+ * @param outputs        Input: outputs[index_sample*num_outputs+index_output]
+ * @param scale          Input: scale of each output, in which the errors are measured,
+ *                       or NULL for its rms value over the sample
+ * @param degree         Input: requested degree of the polynomials
+ * @param pem            Output: emulator, allocated here
+ * @param error_message  Output: error message
+ * @return the error status
+ */
+
+int emulator_train(int num_parameters,
+                   int num_outputs,
+                   int num_samples,
+                   double * parameters,
+                   double * outputs,
+                   double * scale,
+                   int degree,
+                   struct emulator * pem,
+                   ErrorMsg error_message) {
+
+  int np = num_parameters;
+  int no = num_outputs;
+  int ns = num_samples;
+  int index_sample, index_sample2, index_parameter, index_output, index_term, index_term2, index_component;
+  int num_combinations, index_combination, total, current, sum_exponents, d, nt, nc;
+  double * u;        /* parameters, rescaled to [-1,1] */
+  double * y;        /* standardized outputs */
+  double * gram;     /* Gram matrix of y, then its eigenvectors */
+  double * lambda;   /* its eigenvalues */
+  double * score;    /* score[index_sample*nc+index_component] = y_sample.component */
+  double * design;   /* design[index_sample*nt+index_term] = value of the monomial for the sample */
+  double * normal;   /* normal matrix of the least squares, then its eigenvectors */
+  double * mu;       /* its eigenvalues */
+  double * pinv;     /* pseudo-inverse of the normal matrix */
+  double * rhs;
+  double * fit;
+  double * hat;      /* diagonal of the hat matrix */
+  double * residual;
+  double sum, value, error, lambda_max, mu_max;
+
+  class_test((np < 1) || (np > _EMULATOR_PARAMETERS_MAX_),
+             error_message,
+             "an emulator needs between 1 and %d parameters, not %d",_EMULATOR_PARAMETERS_MAX_,np);
+  class_test(ns < 2,
+             error_message,
+             "an emulator needs at least two samples, not %d",ns);
+  class_test((degree < 0) || (degree > _EMULATOR_DEGREE_MAX_),
+             error_message,
+             "the degree of an emulator should be between 0 and %d, not %d",_EMULATOR_DEGREE_MAX_,degree);
+
+  memset(pem,0,sizeof(struct emulator));
+  pem->num_parameters = np;
+  pem->num_outputs = no;
+
+  /** - choose the largest degree with fewer monomials than samples */
+  num_combinations = 1;
+  for (index_parameter=0; index_parameter<np; index_parameter++)
+    num_combinations *= (degree+1);
+  class_alloc(pem->exponent,num_combinations*np*sizeof(int),error_message);
+
+  for (d=degree; d>=0; d--) {
+    nt = 0;
+    /* monomials sorted by total degree */
+    for (total=0; total<=d; total++) {
+      for (index_combination=0; index_combination<num_combinations; index_combination++) {
+        current = index_combination;
+        sum_exponents = 0;
+        for (index_parameter=0; index_parameter<np; index_parameter++) {
+          pem->exponent[nt*np+index_parameter] = current % (degree+1);
+          sum_exponents += current % (degree+1);
+          current /= (degree+1);
+        }
+        if (sum_exponents == total)
+          nt++;
+      }
+    }
+    if (nt < ns)
+      break;
+  }
+  pem->degree = d;
+  pem->num_terms = nt;
+
+  /** - rescale the parameters */
+  class_alloc(pem->parameter_min,np*sizeof(double),error_message);
+  class_alloc(pem->parameter_max,np*sizeof(double),error_message);
+  for (index_parameter=0; index_parameter<np; index_parameter++) {
+    pem->parameter_min[index_parameter] = parameters[index_parameter];
+    pem->parameter_max[index_parameter] = parameters[index_parameter];
+    for (index_sample=1; index_sample<ns; index_sample++) {
+      value = parameters[index_sample*np+index_parameter];
+      pem->parameter_min[index_parameter] = MIN(pem->parameter_min[index_parameter],value);
+      pem->parameter_max[index_parameter] = MAX(pem->parameter_max[index_parameter],value);
+    }
+  }
+
+  class_alloc(u,ns*np*sizeof(double),error_message);
+  for (index_sample=0; index_sample<ns; index_sample++) {
+    for (index_parameter=0; index_parameter<np; index_parameter++) {
+      if (pem->parameter_max[index_parameter] > pem->parameter_min[index_parameter])
+        u[index_sample*np+index_parameter] = 2.*(parameters[index_sample*np+index_parameter]-pem->parameter_min[index_parameter])
+          /(pem->parameter_max[index_parameter]-pem->parameter_min[index_parameter]) - 1.;
+      else
+        u[index_sample*np+index_parameter] = 0.;
+    }
+  }
+
+  /** - standardize the outputs */
+  class_alloc(pem->mean,no*sizeof(double),error_message);
+  class_alloc(pem->scale,no*sizeof(double),error_message);
+  class_alloc(y,ns*no*sizeof(double),error_message);
+  for (index_output=0; index_output<no; index_output++) {
+    pem->mean[index_output] = 0.;
+    pem->scale[index_output] = 0.;
+    for (index_sample=0; index_sample<ns; index_sample++) {
+      value = outputs[index_sample*no+index_output];
+      pem->mean[index_output] += value/ns;
+      pem->scale[index_output] += value*value/ns;
+    }
+    pem->scale[index_output] = (scale == NULL) ? sqrt(pem->scale[index_output]) : fabs(scale[index_output]);
+    if (pem->scale[index_output] == 0.)
+      pem->scale[index_output] = 1.;
+    for (index_sample=0; index_sample<ns; index_sample++)
+      y[index_sample*no+index_output] = (outputs[index_sample*no+index_output]-pem->mean[index_output])/pem->scale[index_output];
+  }
+
+  /** - principal components, from the eigenvectors v of the Gram matrix
+      Y Y^T: the components are Y^T v / sqrt(lambda) */
+  class_alloc(gram,ns*ns*sizeof(double),error_message);
+  class_alloc(lambda,ns*sizeof(double),error_message);
+  for (index_sample=0; index_sample<ns; index_sample++) {
+    for (index_sample2=0; index_sample2<=index_sample; index_sample2++) {
+      sum = 0.;
+      for (index_output=0; index_output<no; index_output++)
+        sum += y[index_sample*no+index_output]*y[index_sample2*no+index_output];
+      gram[index_sample*ns+index_sample2] = sum;
+      gram[index_sample2*ns+index_sample] = sum;
+    }
+  }
+  class_call(array_symmetric_eigen(gram,ns,lambda,error_message),
+             error_message,
+             error_message);
+
+  /* eigenvalues in ascending order: keep the largest ones, down to rounding errors */
+  lambda_max = lambda[ns-1];
+  nc = 0;
+  while ((nc < ns) && (lambda[ns-1-nc] > 1.e-14*lambda_max))
+    nc++;
+  pem->num_components = nc;
+
+  class_calloc(pem->component,MAX(nc,1)*no,sizeof(double),error_message);
+  class_alloc(score,ns*MAX(nc,1)*sizeof(double),error_message);
+  for (index_component=0; index_component<nc; index_component++) {
+    for (index_sample=0; index_sample<ns; index_sample++) {
+      value = gram[index_sample*ns+ns-1-index_component];
+      score[index_sample*nc+index_component] = sqrt(lambda[ns-1-index_component])*value;
+      for (index_output=0; index_output<no; index_output++)
+        pem->component[index_component*no+index_output] += y[index_sample*no+index_output]*value/sqrt(lambda[ns-1-index_component]);
+    }
+  }
+
+  /** - least squares fit of each score, with the pseudo-inverse of the
+      normal matrix A^T A (degenerate if a parameter takes a single value) */
+  class_alloc(design,ns*nt*sizeof(double),error_message);
+  for (index_sample=0; index_sample<ns; index_sample++) {
+    for (index_term=0; index_term<nt; index_term++) {
+      value = 1.;
+      for (index_parameter=0; index_parameter<np; index_parameter++)
+        value *= pow(u[index_sample*np+index_parameter],pem->exponent[index_term*np+index_parameter]);
+      design[index_sample*nt+index_term] = value;
+    }
+  }
+
+  class_alloc(normal,nt*nt*sizeof(double),error_message);
+  class_alloc(mu,nt*sizeof(double),error_message);
+  class_calloc(pinv,nt*nt,sizeof(double),error_message);
+  for (index_term=0; index_term<nt; index_term++) {
+    for (index_term2=0; index_term2<nt; index_term2++) {
+      sum = 0.;
+      for (index_sample=0; index_sample<ns; index_sample++)
+        sum += design[index_sample*nt+index_term]*design[index_sample*nt+index_term2];
+      normal[index_term*nt+index_term2] = sum;
+    }
+  }
+  class_call(array_symmetric_eigen(normal,nt,mu,error_message),
+             error_message,
+             error_message);
+  mu_max = mu[nt-1];
+  for (d=0; d<nt; d++) {
+    if (mu[d] <= 1.e-12*mu_max)
+      continue;
+    for (index_term=0; index_term<nt; index_term++) {
+      for (index_term2=0; index_term2<nt; index_term2++)
+        pinv[index_term*nt+index_term2] += normal[index_term*nt+d]*normal[index_term2*nt+d]/mu[d];
+    }
+  }
+
+  class_calloc(pem->coefficient,MAX(nc,1)*nt,sizeof(double),error_message);
+  class_alloc(rhs,nt*sizeof(double),error_message);
+  for (index_component=0; index_component<nc; index_component++) {
+    for (index_term=0; index_term<nt; index_term++) {
+      rhs[index_term] = 0.;
+      for (index_sample=0; index_sample<ns; index_sample++)
+        rhs[index_term] += design[index_sample*nt+index_term]*score[index_sample*nc+index_component];
+    }
+    for (index_term=0; index_term<nt; index_term++) {
+      for (index_term2=0; index_term2<nt; index_term2++)
+        pem->coefficient[index_component*nt+index_term] += pinv[index_term*nt+index_term2]*rhs[index_term2];
+    }
+  }
+
+  /** - leave-one-out error: the residual of the fit of each sample,
+      divided by 1-h (h being the diagonal of the hat matrix), is the
+      residual of a fit without the sample */
+  class_alloc(hat,ns*sizeof(double),error_message);
+  class_alloc(fit,MAX(nc,1)*sizeof(double),error_message);
+  class_alloc(residual,no*sizeof(double),error_message);
+  pem->error = 0.;
+  for (index_sample=0; index_sample<ns; index_sample++) {
+
+    hat[index_sample] = 0.;
+    for (index_term=0; index_term<nt; index_term++) {
+      for (index_term2=0; index_term2<nt; index_term2++)
+        hat[index_sample] += design[index_sample*nt+index_term]*pinv[index_term*nt+index_term2]*design[index_sample*nt+index_term2];
+    }
+    if (1.-hat[index_sample] < 1.e-10) {
+      pem->error = _HUGE_;
+      break;
+    }
+
+    for (index_component=0; index_component<nc; index_component++) {
+      fit[index_component] = 0.;
+      for (index_term=0; index_term<nt; index_term++)
+        fit[index_component] += pem->coefficient[index_component*nt+index_term]*design[index_sample*nt+index_term];
+    }
+
+    for (index_output=0; index_output<no; index_output++) {
+      /* part of the sample not described by the components kept */
+      residual[index_output] = y[index_sample*no+index_output];
+      for (index_component=0; index_component<nc; index_component++)
+        residual[index_output] -= score[index_sample*nc+index_component]*pem->component[index_component*no+index_output];
+    }
+    for (index_component=0; index_component<nc; index_component++) {
+      value = (score[index_sample*nc+index_component]-fit[index_component])/(1.-hat[index_sample]);
+      for (index_output=0; index_output<no; index_output++)
+        residual[index_output] += value*pem->component[index_component*no+index_output];
+    }
+    for (index_output=0; index_output<no; index_output++) {
+      error = fabs(residual[index_output]);
+      pem->error = MAX(pem->error,error);
+    }
+  }
+
+  free(u);
+  free(y);
+  free(gram);
+  free(lambda);
+  free(score);
+  free(design);
+  free(normal);
+  free(mu);
+  free(pinv);
+  free(rhs);
+  free(hat);
+  free(fit);
+  free(residual);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Predict the outputs for some values of the parameters.
+ *
+ * @param pem        Input: emulator
+ * @param parameters Input: values of the parameters
+ * @param outputs    Output: predicted outputs (array of size num_outputs)
+ * @param inside     Output: _TRUE_ if the parameters are within the range of the sample
+ *                   (the prediction is an extrapolation otherwise)
+ * @return the error status
+ */
+
+int emulator_predict(struct emulator * pem,
+                     double * parameters,
+                     double * outputs,
+                     short * inside) {
+
+  int np = pem->num_parameters;
+  int nt = pem->num_terms;
+  int no = pem->num_outputs;
+  int index_parameter, index_term, index_component, index_output;
+  double u[_EMULATOR_PARAMETERS_MAX_];
+  double z, monomial;
+
+  *inside = _TRUE_;
+  for (index_parameter=0; index_parameter<np; index_parameter++) {
+    if ((parameters[index_parameter] < pem->parameter_min[index_parameter]) ||
+        (parameters[index_parameter] > pem->parameter_max[index_parameter]))
+      *inside = _FALSE_;
+    if (pem->parameter_max[index_parameter] > pem->parameter_min[index_parameter])
+      u[index_parameter] = 2.*(parameters[index_parameter]-pem->parameter_min[index_parameter])
+        /(pem->parameter_max[index_parameter]-pem->parameter_min[index_parameter]) - 1.;
+    else
+      u[index_parameter] = 0.;
+  }
+
+  for (index_output=0; index_output<no; index_output++)
+    outputs[index_output] = 0.;
+
+  for (index_component=0; index_component<pem->num_components; index_component++) {
+    z = 0.;
+    for (index_term=0; index_term<nt; index_term++) {
+      monomial = 1.;
+      for (index_parameter=0; index_parameter<np; index_parameter++)
+        monomial *= pow(u[index_parameter],pem->exponent[index_term*np+index_parameter]);
+      z += pem->coefficient[index_component*nt+index_term]*monomial;
+    }
+    for (index_output=0; index_output<no; index_output++)
+      outputs[index_output] += z*pem->component[index_component*no+index_output];
+  }
+
+  for (index_output=0; index_output<no; index_output++)
+    outputs[index_output] = pem->mean[index_output] + pem->scale[index_output]*outputs[index_output];
+
+  return _SUCCESS_;
+}
+
+/**
+ * Write an emulator to a binary file, opened by the caller.
+ *
+ * @param file          Input: file
+ * @param pem           Input: emulator
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_write(FILE * file,
+                   struct emulator * pem,
+                   ErrorMsg error_message) {
+
+  int version = _EMULATOR_VERSION_;
+  int np = pem->num_parameters;
+  int no = pem->num_outputs;
+  int nt = pem->num_terms;
+  int nc = pem->num_components;
+  int status;
+
+  status = ((fwrite("CLASSEMU",1,8,file) == 8) &&
+            (fwrite(&version,sizeof(int),1,file) == 1) &&
+            (fwrite(&(pem->num_parameters),sizeof(int),1,file) == 1) &&
+            (fwrite(&(pem->num_outputs),sizeof(int),1,file) == 1) &&
+            (fwrite(&(pem->degree),sizeof(int),1,file) == 1) &&
+            (fwrite(&(pem->num_terms),sizeof(int),1,file) == 1) &&
+            (fwrite(&(pem->num_components),sizeof(int),1,file) == 1) &&
+            (fwrite(&(pem->error),sizeof(double),1,file) == 1) &&
+            (fwrite(pem->exponent,sizeof(int),nt*np,file) == nt*np) &&
+            (fwrite(pem->parameter_min,sizeof(double),np,file) == np) &&
+            (fwrite(pem->parameter_max,sizeof(double),np,file) == np) &&
+            (fwrite(pem->mean,sizeof(double),no,file) == no) &&
+            (fwrite(pem->scale,sizeof(double),no,file) == no) &&
+            (fwrite(pem->component,sizeof(double),nc*no,file) == nc*no) &&
+            (fwrite(pem->coefficient,sizeof(double),nc*nt,file) == nc*nt));
+
+  class_test(status == 0,
+             error_message,
+             "could not write an emulator");
+
+  return _SUCCESS_;
+}
+
+/**
+ * Read an emulator written by emulator_write(), from a file opened by
+ * the caller.
+ *
+ * @param file          Input: file
+ * @param pem           Output: emulator, allocated here
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int emulator_read(FILE * file,
+                  struct emulator * pem,
+                  ErrorMsg error_message) {
+
+  char magic[8];
+  int version;
+  int np, no, nt, nc;
+
+  memset(pem,0,sizeof(struct emulator));
+
+  class_test((fread(magic,1,8,file) != 8) ||
+             (strncmp(magic,"CLASSEMU",8) != 0) ||
+             (fread(&version,sizeof(int),1,file) != 1) ||
+             (version != _EMULATOR_VERSION_),
+             error_message,
+             "this is not an emulator written by this version of CLASS");
+
+  class_test((fread(&(pem->num_parameters),sizeof(int),1,file) != 1) ||
+             (fread(&(pem->num_outputs),sizeof(int),1,file) != 1) ||
+             (fread(&(pem->degree),sizeof(int),1,file) != 1) ||
+             (fread(&(pem->num_terms),sizeof(int),1,file) != 1) ||
+             (fread(&(pem->num_components),sizeof(int),1,file) != 1) ||
+             (fread(&(pem->error),sizeof(double),1,file) != 1) ||
+             (pem->num_parameters < 1) || (pem->num_parameters > _EMULATOR_PARAMETERS_MAX_) || (pem->num_outputs < 0) ||
+             (pem->num_terms < 1) || (pem->num_components < 0),
+             error_message,
+             "the emulator is truncated or corrupted");
+
+  np = pem->num_parameters;
+  no = pem->num_outputs;
+  nt = pem->num_terms;
+  nc = pem->num_components;
+
+  class_alloc(pem->exponent,nt*np*sizeof(int),error_message);
+  class_alloc(pem->parameter_min,np*sizeof(double),error_message);
+  class_alloc(pem->parameter_max,np*sizeof(double),error_message);
+  class_alloc(pem->mean,MAX(no,1)*sizeof(double),error_message);
+  class_alloc(pem->scale,MAX(no,1)*sizeof(double),error_message);
+  class_alloc(pem->component,MAX(nc*no,1)*sizeof(double),error_message);
+  class_alloc(pem->coefficient,MAX(nc*nt,1)*sizeof(double),error_message);
+
+  class_test((fread(pem->exponent,sizeof(int),nt*np,file) != nt*np) ||
+             (fread(pem->parameter_min,sizeof(double),np,file) != np) ||
+             (fread(pem->parameter_max,sizeof(double),np,file) != np) ||
+             (fread(pem->mean,sizeof(double),no,file) != no) ||
+             (fread(pem->scale,sizeof(double),no,file) != no) ||
+             (fread(pem->component,sizeof(double),nc*no,file) != nc*no) ||
+             (fread(pem->coefficient,sizeof(double),nc*nt,file) != nc*nt),
+             error_message,
+             "the emulator is truncated or corrupted");
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free the arrays of an emulator.
+ *
+ * @param pem Input: emulator
+ * @return the error status
+ */
+
+int emulator_free(struct emulator * pem) {
+
+  free(pem->exponent);
+  free(pem->parameter_min);
+  free(pem->parameter_max);
+  free(pem->mean);
+  free(pem->scale);
+  free(pem->component);
+  free(pem->coefficient);
+
+  return _SUCCESS_;
+}
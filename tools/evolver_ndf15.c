@@ -53,11 +53,28 @@
     structure of the equations are nearly optimal for the LU decomposition, so we don't
     want to mess it up by too many row permutations if we can avoid it. This is also why
     do not use any column permutation to pre-order the matrix.
+
+    Learning the pattern costs a few full jacobians in each call to the evolver. When the
+    caller knows the pattern (e.g. the perturbations, which integrate the same linear
+    system for each wavenumber and approximation scheme), it can register it by passing
+    a struct jacobian_pattern: it is then trusted from the first jacobian, and all
+    jacobians are computed with column grouping only. A registered pattern missing some
+    entries would only slow down the Newton iterations: if they fail with a current
+    jacobian, we go back to the full jacobian and learn the pattern as usual.
+
+    The registered pattern also keeps the symbolic part of the sparse LU decomposition
+    (AMD ordering, pivots on the diagonal and fill-in), so that new_linearisation only
+    does the numerical refactorization, and falls back to partial pivoting if a pivot
+    becomes too small. If jacobian_pattern->refresh_on_convergence is set, the LU
+    decomposition is not even redone when the stepsize or order changes: the Newton
+    iterations then use the last one, until they converge too slowly. The statistics
+    of each call are added to jacobian_pattern->stepstat.
 */
 #include "common.h"
 #include "evolver_ndf15.h"
 //#include "perturbations.h"
 #include "sparse.h"
+#include "parallel.h"
 
 int evolver_ndf15(
           int (*derivs)(double x,double * y,double * dy,
@@ -81,6 +98,7 @@ int evolver_ndf15(
                 ErrorMsg error_message),
           int (*print_variables)(double x, double y[], double dy[], void *parameters_and_workspace,
                      ErrorMsg error_message),
+          struct jacobian_pattern * jacobian_pattern,
           ErrorMsg error_message){
 
   /* Constants: */
@@ -103,14 +121,15 @@ int evolver_ndf15(
   /* Method variables: */
   double t,t0,tfinal,tnew=0;
   double rh,htspan,absh,hmin,hmax,h,tdel;
-  double abshlast,hinvGak,minnrm,oldnrm=0.,newnrm;
+  double abshlast,hinvGak,hinvGak_lu,minnrm,oldnrm=0.,newnrm;
   double err,hopt,errkm1,hkm1,errit,rate=0.,temp,errkp1,hkp1,maxtmp;
   int k,klast,nconhk,iter,next,kopt,tdir;
 
   /* Misc: */
-  int stepstat[6],nfenj,j,ii,jj, numidx, neqp=neq+1;
+  int stepstat[6],nfenj,j,ii,jj,nz, numidx, neqp=neq+1;
   int verbose=0;
   int funcreturn;
+  int refresh_on_convergence;
 
   /** Allocate memory . */
 
@@ -186,6 +205,13 @@ int evolver_ndf15(
   /*Initialize the jacobian:*/
   class_call(initialize_jacobian(&jac,neq,error_message),error_message,error_message);
 
+  /* Use the sparsity pattern registered by the caller, if any: */
+  refresh_on_convergence = _FALSE_;
+  if (jacobian_pattern != NULL){
+    jacobian_pattern_load(jacobian_pattern,&jac,neq);
+    refresh_on_convergence = jacobian_pattern->refresh_on_convergence;
+  }
+
   /* Initialize workspace for numjac: */
   class_call(initialize_numjac_workspace(&nj_ws,neq,error_message),error_message,error_message);
 
@@ -265,11 +291,24 @@ int evolver_ndf15(
              error_message,error_message);
   stepstat[2] += 1;
 
-  /*I assume that a full jacobi matrix is always calculated in the beginning...*/
-  for(ii=1;ii<=neq;ii++){
-    ddfddt[ii]=0.0;
-    for(jj=1;jj<=neq;jj++){
-      ddfddt[ii]+=(jac.dfdy[ii][jj])*f0[jj];
+  /*A full jacobi matrix is calculated in the beginning, unless the
+    sparsity pattern was registered: then only the sparse one is.*/
+  if ((jac.use_sparse)&&(jac.repeated_pattern >= jac.trust_sparse)){
+    for(ii=1;ii<=neq;ii++){
+      ddfddt[ii]=0.0;
+    }
+    for(jj=0;jj<neq;jj++){
+      for(nz=jac.spJ->Ap[jj];nz<jac.spJ->Ap[jj+1];nz++){
+        ddfddt[jac.spJ->Ai[nz]+1]+=jac.xjac[nz]*f0[jj+1];
+      }
+    }
+  }
+  else{
+    for(ii=1;ii<=neq;ii++){
+      ddfddt[ii]=0.0;
+      for(jj=1;jj<=neq;jj++){
+        ddfddt[ii]+=(jac.dfdy[ii][jj])*f0[jj];
+      }
     }
   }
 
@@ -295,6 +334,7 @@ int evolver_ndf15(
   nconhk = 0;     /*steps taken with current h and k*/
   class_call(new_linearisation(&jac,hinvGak,neq,error_message),
              error_message,error_message);
+  hinvGak_lu = hinvGak;
   stepstat[4] += 1;
   havrate = _FALSE_; /*false*/
 
@@ -302,6 +342,11 @@ int evolver_ndf15(
   done = _FALSE_;
   at_hmin = _FALSE_;
   while (done==_FALSE_){
+    /* stop early when another task of the parallel region has failed */
+    class_test_except(class_parallel_cancelled() == _TRUE_,
+                      error_message,
+                      free(buffer);uninitialize_jacobian(&jac);uninitialize_numjac_workspace(&nj_ws),
+                      "integration cancelled at t=%e",t);
     /**class_test(stepstat[2] > 1e5, error_message,
            "Too many steps in evolver! Current stepsize:%g, in interval: [%g:%g]\n",
            absh,t0,tfinal);*/
@@ -328,9 +373,12 @@ int evolver_ndf15(
       adjust_stepsize(dif,(absh/abshlast),neq,k);
       hinvGak = h * invGa[k-1];
       nconhk = 0;
-      class_call(new_linearisation(&jac,hinvGak,neq,error_message),
-                 error_message,error_message);
-      stepstat[4] += 1;
+      if (refresh_on_convergence == _FALSE_){
+        class_call(new_linearisation(&jac,hinvGak,neq,error_message),
+                   error_message,error_message);
+        hinvGak_lu = hinvGak;
+        stepstat[4] += 1;
+      }
       havrate = _FALSE_;
     }
     /*        Loop for advancing one step */
@@ -451,7 +499,11 @@ int evolver_ndf15(
         if (tooslow==_TRUE_){
           stepstat[1] += 1;
           /*    ! Speed up the iteration by forming new linearization or reducing h. */
-          if (Jcurrent==_FALSE_){
+          if (hinvGak_lu != hinvGak){
+            /* The LU decomposition was kept from another stepsize or order
+               (refresh_on_convergence): refreshing it is enough for now. */
+          }
+          else if (Jcurrent==_FALSE_){
             class_call((*derivs)(t,y+1,f0+1,parameters_and_workspace_for_derivs,error_message),
                        error_message,error_message);
             nfenj=0;
@@ -462,6 +514,23 @@ int evolver_ndf15(
             stepstat[2] += (nfenj + 1);
             Jcurrent = _TRUE_;
           }
+          else if (jac.has_registered_pattern == _TRUE_){
+            /* The current jacobian was computed with a registered
+               pattern, which may miss some entries: compute the full
+               jacobian and learn the pattern again. */
+            jac.has_registered_pattern = _FALSE_;
+            jac.symbolic_from_pattern = _FALSE_;
+            jac.repeated_pattern = 0;
+            jac.has_grouping = 0;
+            class_call((*derivs)(t,y+1,f0+1,parameters_and_workspace_for_derivs,error_message),
+                       error_message,error_message);
+            nfenj=0;
+            class_call(numjac((*derivs),t,y,f0,&jac,&nj_ws,abstol,neq,
+                       &nfenj,parameters_and_workspace_for_derivs,error_message),
+                       error_message,error_message);
+            stepstat[3] += 1;
+            stepstat[2] += (nfenj + 1);
+          }
           else if (absh <= hmin){
             class_test(absh <= hmin, error_message,
                        "Step size too small: step:%g, minimum:%g, in interval: [%g:%g]\n",
@@ -476,9 +545,10 @@ int evolver_ndf15(
             hinvGak = h * invGa[k-1];
             nconhk = 0;
           }
-          /* A new linearisation is needed in both cases */
+          /* A new linearisation is needed in all cases */
           class_call(new_linearisation(&jac,hinvGak,neq,error_message),
                      error_message,error_message);
+          hinvGak_lu = hinvGak;
           stepstat[4] += 1;
           havrate = _FALSE_;
         }
@@ -526,9 +596,12 @@ int evolver_ndf15(
         adjust_stepsize(dif,(absh/abshlast),neq,k);
         hinvGak = h * invGa[k-1];
         nconhk = 0;
-        class_call(new_linearisation(&jac,hinvGak,neq,error_message),
-                   error_message,error_message);
-        stepstat[4] += 1;
+        if (refresh_on_convergence == _FALSE_){
+          class_call(new_linearisation(&jac,hinvGak,neq,error_message),
+                     error_message,error_message);
+          hinvGak_lu = hinvGak;
+          stepstat[4] += 1;
+        }
         havrate = _FALSE_;
       }
       else {
@@ -678,6 +751,17 @@ int evolver_ndf15(
        stepstat[2],stepstat[3],stepstat[4],stepstat[5]);
   }
 
+  if (jacobian_pattern != NULL){
+    for(ii=0;ii<6;ii++) jacobian_pattern->stepstat[ii] += stepstat[ii];
+  }
+
+  class_counter_add(counter_ndf15_integrations,1);
+  class_counter_add(counter_ndf15_steps,stepstat[0]);
+  class_counter_add(counter_ndf15_failed_steps,stepstat[1]);
+  class_counter_add(counter_ndf15_function_evaluations,stepstat[2]);
+  class_counter_add(counter_ndf15_jacobians,stepstat[3]);
+  class_counter_add(counter_ndf15_lu_decompositions,stepstat[4]);
+
   /** Deallocate memory */
 
   free(buffer);
@@ -964,26 +1048,38 @@ int new_linearisation(struct jacobian *jac,double hinvGak,int neq,ErrorMsg error
       }
     }
     /* Matrix constructed... */
-    if(jac->new_jacobian==_TRUE_){
-      /*I have a new pattern, and I have not done a LU decomposition
-        since the last jacobian calculation, so    I need to do a full
-        sparse LU-decomposition: */
-      /* Find the sparsity pattern C = J + J':*/
-      calc_C(jac);
-      /* Calculate the optimal ordering: */
-      sp_amd(jac->Cp, jac->Ci, neq, jac->cnzmax,
-         jac->Numerical->q,jac->Numerical->wamd);
-      /* if the next line is uncomented, the code uses natural ordering instead of AMD ordering */
-      /*jac->Numerical->q = NULL;*/
-      funcreturn = sp_ludcmp(jac->Numerical, jac->spJ, 1e-3);
-      class_test(funcreturn == _FAILURE_,error_message,
-         "Failure in sp_ludcmp. Possibly singular matrix!");
-      jac->new_jacobian = _FALSE_;
+    if((jac->new_jacobian==_TRUE_)&&(jac->has_registered_pattern==_TRUE_)&&(jac->symbolic_from_pattern==_FALSE_)){
+      /* The pattern is registered: use its symbolic LU decomposition, which
+         is only computed the first time. */
+      class_call(jacobian_pattern_symbolic(jac->pattern,jac,neq,error_message),
+                 error_message,error_message);
     }
-    else{
-      /* I have a repeated pattern, so I can just refactor:*/
-      sp_refactor(jac->Numerical, jac->spJ);
+    if((jac->new_jacobian==_FALSE_)||(jac->symbolic_from_pattern==_TRUE_)){
+      /* I have a repeated or registered pattern, so I can just refactor,
+         unless a pivot became too small. With the static pivots of the
+         registered pattern, this is the diagonal preference of sp_ludcmp: */
+      funcreturn = sp_refactor(jac->Numerical, jac->spJ,
+                               (jac->symbolic_from_pattern==_TRUE_) ? 1e-3 : 0.0);
+      if (funcreturn == _SUCCESS_){
+        jac->new_jacobian = _FALSE_;
+        return _SUCCESS_;
+      }
     }
+    /*I have a new pattern, and I have not done a LU decomposition
+      since the last jacobian calculation (or the pivots of the last one
+      cannot be kept), so    I need to do a full sparse LU-decomposition: */
+    /* Find the sparsity pattern C = J + J':*/
+    calc_C(jac);
+    /* Calculate the optimal ordering: */
+    sp_amd(jac->Cp, jac->Ci, neq, jac->cnzmax,
+       jac->Numerical->q,jac->Numerical->wamd);
+    /* if the next line is uncomented, the code uses natural ordering instead of AMD ordering */
+    /*jac->Numerical->q = NULL;*/
+    funcreturn = sp_ludcmp(jac->Numerical, jac->spJ, 1e-3);
+    class_test(funcreturn == _FAILURE_,error_message,
+       "Failure in sp_ludcmp. Possibly singular matrix!");
+    jac->new_jacobian = _FALSE_;
+    jac->symbolic_from_pattern = _FALSE_;
   }
   else{
     /* Normal calculation: */
@@ -1078,15 +1174,27 @@ int fzero_Newton(int (*func)(double *x,
                  double tolx,
                  double tolF,
                  void *param,
+                 void **param_jacobian,
                  int *fevals,
                  ErrorMsg error_message){
   /**Given an initial guess x[1..n] for a root in n dimensions,
      take ntrial Newton-Raphson steps to improve the root.
      Stop if the root converges in either summed absolute
-     variable increments tolx or summed absolute function values tolf.*/
+     variable increments tolx or summed absolute function values tolf.
+
+     The jacobian is computed by finite differences at the first step
+     only, and then updated with Broyden's rank-one formula from the
+     previous step. It is computed again whenever a step
+     did not decrease the summed absolute function values.
+
+     If param_jacobian is not NULL, it contains x_size workspaces
+     equivalent to param, one for each column of the jacobian: these
+     columns are then computed concurrently.*/
   int k,i,j,*indx, ntrial=20;
-  double errx,errf,d,*F0,*Fdel,**Fjac,*p, *lu_work;
+  double errx,errf,errf_old=0.,d,*F0,*F_old,*Fdel,**Fjac,*Jac,*p, *lu_work;
+  double *x_jac, *dx_old, dx2, dF;
   int has_converged = _FALSE_;
+  short compute_jacobian = _TRUE_;
   int funcreturn;
   double toljac = 1e-3;
   double *delx;
@@ -1104,8 +1212,15 @@ int fzero_Newton(int (*func)(double *x,
   }
 
   class_alloc(F0, sizeof(double)*x_size, error_message);
+  class_alloc(F_old, sizeof(double)*x_size, error_message);
+  class_alloc(dx_old, sizeof(double)*x_size, error_message);
   class_alloc(delx, sizeof(double)*x_size, error_message);
-  class_alloc(Fdel, sizeof(double)*x_size, error_message);
+  /* jacobian Jac[j*x_size+i] = dF_j/dx_i, kept between the steps
+     since ludcmp overwrites Fjac */
+  class_alloc(Jac, sizeof(double)*x_size*x_size, error_message);
+  /* one shifted point and one function value per column of the jacobian */
+  class_alloc(x_jac, sizeof(double)*x_size*x_size, error_message);
+  class_alloc(Fdel, sizeof(double)*x_size*x_size, error_message);
 
   for (i=1; i<=x_size; i++){
     delx[i-1] = toljac*dxdF[i-1];
@@ -1113,11 +1228,8 @@ int fzero_Newton(int (*func)(double *x,
 
   for (k=1;k<=ntrial;k++) {
     /** Compute F(x): */
-    /**printf("x = [%f, %f], delx = [%e, %e]\n",
-       x_inout[0],x_inout[1],delx[0],delx[1]);*/
     class_call(func(x_inout, x_size, param, F0, error_message),
                error_message, error_message);
-    /**    printf("F0 = [%f, %f]\n",F0[0],F0[1]);*/
     *fevals = *fevals + 1;
     errf=0.0; //fvec and Jacobian matrix in fjac.
     for (i=1; i<=x_size; i++)
@@ -1127,33 +1239,61 @@ int fzero_Newton(int (*func)(double *x,
       break;
     }
 
-    /**
-    if (k==1){
-      for (i=1; i<=x_size; i++){
-        delx[i-1] *= F0[i-1];
+    /** Update the jacobian of F with the last step, or compute it
+        again if that step was not an improvement: */
+    if (compute_jacobian == _FALSE_) {
+      if (errf > errf_old) {
+        compute_jacobian = _TRUE_;
+      }
+      else {
+        dx2 = 0.;
+        for (i=0; i<x_size; i++)
+          dx2 += dx_old[i]*dx_old[i];
+        for (j=0; j<x_size; j++) {
+          dF = F0[j]-F_old[j];
+          for (i=0; i<x_size; i++)
+            dF -= Jac[j*x_size+i]*dx_old[i];
+          for (i=0; i<x_size; i++)
+            Jac[j*x_size+i] += dF*dx_old[i]/dx2;
+        }
       }
     }
-    */
 
     /** Compute the jacobian of F: */
-    for (i=1; i<=x_size; i++){
-      if (F0[i-1]<0.0)
-        delx[i-1] *= -1;
-      x_inout[i-1] += delx[i-1];
-
-      /**      printf("x = [%f, %f], delx = [%e, %e]\n",
-               x_inout[0],x_inout[1],delx[0],delx[1]);*/
-      class_call(func(x_inout, x_size, param, Fdel, error_message),
-                 error_message, error_message);
-      /**      printf("F = [%f, %f]\n",Fdel[0],Fdel[1]);*/
-      for (j=1; j<=x_size; j++)
-        Fjac[j][i] = (Fdel[j-1]-F0[j-1])/delx[i-1];
-      x_inout[i-1] -= delx[i-1];
+    if (compute_jacobian == _TRUE_) {
+
+      class_setup_parallel_optional(param_jacobian != NULL);
+
+      for (i=0; i<x_size; i++){
+        if (F0[i]<0.0)
+          delx[i] *= -1;
+        class_label_parallel("numjac:index_x",i);
+        class_run_parallel(with_arguments(func,x_inout,x_size,x_jac,Fdel,delx,i,param,param_jacobian,error_message),
+          int j;
+          for (j=0; j<x_size; j++)
+            x_jac[i*x_size+j] = x_inout[j];
+          x_jac[i*x_size+i] += delx[i];
+          class_call(func(x_jac+i*x_size, x_size, (param_jacobian == NULL) ? param : param_jacobian[i], Fdel+i*x_size, error_message),
+                     error_message, error_message);
+          return _SUCCESS_;
+        );
+      }
+
+      class_finish_parallel();
+
+      for (i=0; i<x_size; i++){
+        for (j=0; j<x_size; j++)
+          Jac[j*x_size+i] = (Fdel[i*x_size+j]-F0[j])/delx[i];
+      }
+      *fevals = *fevals + x_size;
+      compute_jacobian = _FALSE_;
     }
-    *fevals = *fevals + x_size;
 
-    for (i=1; i<=x_size; i++)
+    for (i=1; i<=x_size; i++){
       p[i] = -F0[i-1]; //Right-hand side of linear equations.
+      for (j=1; j<=x_size; j++)
+        Fjac[i][j] = Jac[(i-1)*x_size+j-1];
+    }
     funcreturn = ludcmp(Fjac, x_size, indx, &d, lu_work); //Solve linear equations using LU decomposition.
     class_test(funcreturn == _FAILURE_,error_message,
                "Failure in ludcmp. Possibly singular matrix!");
@@ -1164,7 +1304,10 @@ int fzero_Newton(int (*func)(double *x,
     for (i=1; i<=x_size; i++) { //Update solution.
       errx += fabs(p[i]);
       x_inout[i-1] += p[i];
+      dx_old[i-1] = p[i];
+      F_old[i-1] = F0[i-1];
     }
+    errf_old = errf;
     if (errx <= tolx){
       has_converged = _TRUE_;
       break;
@@ -1177,7 +1320,11 @@ int fzero_Newton(int (*func)(double *x,
   free(Fjac[1]);
   free(Fjac);
   free(F0);
+  free(F_old);
+  free(dx_old);
   free(delx);
+  free(Jac);
+  free(x_jac);
   free(Fdel);
 
   if (has_converged == _TRUE_){
@@ -1539,6 +1686,9 @@ int initialize_jacobian(struct jacobian *jac, int neq, ErrorMsg error_message){
   /* Number of times a pattern is repeated before we trust it. */
   jac->has_grouping = 0;
   jac->has_pattern = 0;
+  jac->has_registered_pattern = 0;
+  jac->pattern = NULL;
+  jac->symbolic_from_pattern = 0;
   jac->sparse_stuff_initialized=0;
 
   /*Setup memory for the pointers of the dense method:*/
@@ -1654,3 +1804,155 @@ int uninitialize_numjac_workspace(struct numjac_workspace * nj_ws){
   free(nj_ws->Rowmax);
   return _SUCCESS_;
 }
+
+/* Routines handling the sparsity pattern registered by the caller of
+   evolver_ndf15: "jacobian_pattern_reset", "jacobian_pattern_free",
+   "jacobian_pattern_load", "jacobian_pattern_symbolic",
+   "jacobian_pattern_of_linear_system". */
+
+int jacobian_pattern_reset(struct jacobian_pattern *pattern){
+  /* Forget the pattern and its statistics, but keep the memory: */
+  int i;
+  pattern->neq = 0;
+  pattern->nonzero = 0;
+  pattern->has_symbolic = _FALSE_;
+  for(i=0;i<6;i++) pattern->stepstat[i] = 0;
+  pattern->symbolic_decompositions = 0;
+  return _SUCCESS_;
+}
+
+int jacobian_pattern_free(struct jacobian_pattern *pattern){
+  free(pattern->Ap);
+  free(pattern->Ai);
+  free(pattern->q);
+  free(pattern->topvec);
+  free(pattern->xi);
+  pattern->Ap = NULL;
+  pattern->Ai = NULL;
+  pattern->q = NULL;
+  pattern->topvec = NULL;
+  pattern->xi = NULL;
+  pattern->neq_capacity = 0;
+  pattern->nonzero_capacity = 0;
+  pattern->symbolic_capacity = 0;
+  return jacobian_pattern_reset(pattern);
+}
+
+int jacobian_pattern_load(struct jacobian_pattern *pattern, struct jacobian *jac, int neq){
+  int j;
+  /* The pattern can only be used if it refers to a system of the same size, and if
+     it is still sparse enough for the current jacobian: */
+  if ((jac->use_sparse==_FALSE_) || (pattern->neq != neq) || (pattern->nonzero > jac->max_nonzero)){
+    return _SUCCESS_;
+  }
+  for(j=0;j<=neq;j++) jac->spJ->Ap[j] = pattern->Ap[j];
+  for(j=0;j<pattern->nonzero;j++) jac->spJ->Ai[j] = pattern->Ai[j];
+  /* Trust it right away, the grouping will be done in the first call to numjac: */
+  jac->has_pattern = 1;
+  jac->repeated_pattern = jac->trust_sparse;
+  jac->has_grouping = 0;
+  jac->has_registered_pattern = 1;
+  jac->pattern = pattern;
+  jac->symbolic_from_pattern = 0;
+  return _SUCCESS_;
+}
+
+int jacobian_pattern_symbolic(struct jacobian_pattern *pattern, struct jacobian *jac, int neq, ErrorMsg error_message){
+  /* Put the symbolic LU decomposition of the registered pattern in jac->Numerical.
+     The first time, it is computed from the AMD ordering of C = J + J' and static
+     pivots on the diagonal, so that it only depends on the pattern: */
+  sp_num *N = jac->Numerical;
+  int k;
+
+  if (pattern->has_symbolic == _FALSE_){
+    calc_C(jac);
+    sp_amd(jac->Cp, jac->Ci, neq, jac->cnzmax, N->q, N->wamd);
+    sp_symbolic(N, jac->spJ);
+
+    if (pattern->symbolic_capacity < neq){
+      free(pattern->q);
+      free(pattern->topvec);
+      free(pattern->xi);
+      pattern->symbolic_capacity = 0;
+      class_alloc(pattern->q,sizeof(int)*neq,error_message);
+      class_alloc(pattern->topvec,sizeof(int)*neq,error_message);
+      class_alloc(pattern->xi,sizeof(int)*neq*neq,error_message);
+      pattern->symbolic_capacity = neq;
+    }
+    memcpy(pattern->q,N->q,sizeof(int)*neq);
+    memcpy(pattern->topvec,N->topvec,sizeof(int)*neq);
+    memcpy(pattern->xi,N->xi[0],sizeof(int)*neq*neq);
+    pattern->has_symbolic = _TRUE_;
+    pattern->symbolic_decompositions++;
+  }
+  else{
+    memcpy(N->q,pattern->q,sizeof(int)*neq);
+    memcpy(N->topvec,pattern->topvec,sizeof(int)*neq);
+    memcpy(N->xi[0],pattern->xi,sizeof(int)*neq*neq);
+    for(k=0;k<neq;k++){
+      N->p[k] = N->q[k];
+      N->pinv[N->q[k]] = k;
+    }
+  }
+  jac->symbolic_from_pattern = _TRUE_;
+  return _SUCCESS_;
+}
+
+int jacobian_pattern_of_linear_system(int (*derivs)(double x,double * y,double * dy,void * parameters_and_workspace,ErrorMsg error_message),
+                                      double t, int neq, void * parameters_and_workspace_for_derivs,
+                                      struct jacobian_pattern *pattern, ErrorMsg error_message){
+  /* For a linear system dy/dt = A(t) y (+ b(t)), column j of the jacobian is exactly
+     f(e_j)-f(0), where e_j is the j-th unit vector. Unlike finite differences around the
+     current y, this gives the non-zero entries without any round-off, hence the same
+     pattern for any wavenumber or initial condition. The diagonal is always included. */
+  double *y, *f0, *fj;
+  int i,j,nz;
+
+  class_alloc(y,sizeof(double)*3*neq,error_message);
+  f0 = y+neq;
+  fj = f0+neq;
+  for(i=0;i<neq;i++) y[i] = 0.0;
+
+  if (pattern->neq_capacity < neq){
+    free(pattern->Ap);
+    pattern->neq_capacity = 0;
+    class_alloc(pattern->Ap,sizeof(int)*(neq+1),error_message);
+    pattern->neq_capacity = neq;
+  }
+  if (pattern->nonzero_capacity < 3*neq){
+    free(pattern->Ai);
+    pattern->nonzero_capacity = 0;
+    class_alloc(pattern->Ai,sizeof(int)*3*neq,error_message);
+    pattern->nonzero_capacity = 3*neq;
+  }
+
+  class_call((*derivs)(t,y,f0,parameters_and_workspace_for_derivs,error_message),
+             error_message,error_message);
+
+  nz = 0;
+  pattern->Ap[0] = 0;
+  for(j=0;j<neq;j++){
+    y[j] = 1.0;
+    class_call((*derivs)(t,y,fj,parameters_and_workspace_for_derivs,error_message),
+               error_message,error_message);
+    y[j] = 0.0;
+    if (nz+neq > pattern->nonzero_capacity){
+      pattern->nonzero_capacity = MAX(2*pattern->nonzero_capacity,nz+neq);
+      class_realloc(pattern->Ai,sizeof(int)*pattern->nonzero_capacity,error_message);
+    }
+    for(i=0;i<neq;i++){
+      if ((i==j)||(fj[i]-f0[i]!=0.0)){
+        pattern->Ai[nz] = i;
+        nz++;
+      }
+    }
+    pattern->Ap[j+1] = nz;
+  }
+
+  pattern->neq = neq;
+  pattern->nonzero = nz;
+  pattern->has_symbolic = _FALSE_;
+
+  free(y);
+  return _SUCCESS_;
+}
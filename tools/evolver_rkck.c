@@ -1,4 +1,5 @@
 #include "evolver_rkck.h"
+#include "parallel.h"
 
 int evolver_rk(int (*derivs)(double x,
 				  double * y,
@@ -31,6 +32,7 @@ int evolver_rk(int (*derivs)(double x,
 					   double dy[],
 					   void * parameters_and_workspace,
 					   ErrorMsg error_message),
+		    struct jacobian_pattern * jacobian_pattern,
 		    ErrorMsg error_message) {
 
   int next_index_x;
@@ -59,6 +61,12 @@ int evolver_rk(int (*derivs)(double x,
 
   while ((x1 < x_end) && (next_index_x<x_size)) {
 
+    /* stop early when another task of the parallel region has failed */
+    class_test_except(class_parallel_cancelled() == _TRUE_,
+		      error_message,
+		      cleanup_generic_integrator(&gi);free(dy),
+		      "integration cancelled at x=%e",x1);
+
     class_call((*evaluate_timescale)(x1,
 				     parameters_and_workspace_for_derivs,
 				     &timescale,
@@ -176,3 +184,454 @@ int evolver_rk(int (*derivs)(double x,
   return _SUCCESS_;
 
 }
+
+/**
+ * Points of the steps of evolver_rk(), generic_integrator() and rkqs()
+ * at which an integration by evolver_rk_batch() resumes once the
+ * derivatives requested by the lane are known (or without derivatives
+ * for rk_lane_start, rk_lane_outer, rk_lane_step_done and rk_lane_done).
+ */
+
+enum evolver_rk_lane_state {
+  rk_lane_start,     /**< beginning of evolver_rk() */
+  rk_lane_outer,     /**< beginning of a step of evolver_rk() */
+  rk_lane_print,     /**< derivatives at x_ini known, for print_variables */
+  rk_lane_step,      /**< derivatives at the beginning of a step of generic_integrator() known */
+  rk_lane_stage,     /**< derivatives of a stage of rkck() known */
+  rk_lane_step_done, /**< end of the call to generic_integrator() */
+  rk_lane_output,    /**< derivatives at the point of output known */
+  rk_lane_last,      /**< derivatives at the end of the interval known */
+  rk_lane_done       /**< end of evolver_rk() */
+};
+
+/* arguments of evolver_rk_batch() shared by all lanes */
+struct evolver_rk_batch_parameters {
+  double tolerance;
+  double minimum_variation;
+  int (*evaluate_timescale)(double x, void * parameters_and_workspace, double * timescale, ErrorMsg error_message);
+  double timestep_over_timescale;
+  double * x_sampling;
+  int x_size;
+  int (*output)(double x, double y[], double dy[], int index_x, void * parameters_and_workspace, ErrorMsg error_message);
+};
+
+/* request the derivatives at (x,y) in dy, and resume at the given state once they are known */
+#define _RK_LANE_REQUEST_(X,Y,DY,STATE) {               \
+    pl->request_x = (X);                                \
+    pl->request_y = (Y);                                \
+    pl->request_dy = (DY);                              \
+    pl->state = (STATE);                                \
+    return _SUCCESS_;                                   \
+  }
+
+/**
+ * Combine the stages of rkck() already known into the argument of the
+ * next one, and request its derivatives. The arithmetic is that of
+ * rkck(), such that each lane gives the same results as evolver_rk().
+ */
+
+static int evolver_rk_lane_next_stage(
+                                      struct evolver_rk_lane * pl,
+                                      int stage
+                                      ) {
+
+  struct generic_integrator_workspace * pgi = &(pl->gi);
+  double x = pl->x;
+  double h = pl->h_stage;
+  int i;
+
+  pl->stage = stage;
+
+  switch (stage) {
+  case 2:
+    for (i=0;i<pl->y_size;i++)
+      pgi->ytemp[i]=pgi->y[i]+_RKCK_b21_*h*pgi->dydx[i];
+    _RK_LANE_REQUEST_(x+_RKCK_a2_*h,pgi->ytemp,pgi->ak2,rk_lane_stage);
+  case 3:
+    for (i=0;i<pl->y_size;i++)
+      pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b31_*pgi->dydx[i]+_RKCK_b32_*pgi->ak2[i]);
+    _RK_LANE_REQUEST_(x+_RKCK_a3_*h,pgi->ytemp,pgi->ak3,rk_lane_stage);
+  case 4:
+    for (i=0;i<pl->y_size;i++)
+      pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b41_*pgi->dydx[i]+_RKCK_b42_*pgi->ak2[i]+_RKCK_b43_*pgi->ak3[i]);
+    _RK_LANE_REQUEST_(x+_RKCK_a4_*h,pgi->ytemp,pgi->ak4,rk_lane_stage);
+  case 5:
+    for (i=0;i<pl->y_size;i++)
+      pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b51_*pgi->dydx[i]+_RKCK_b52_*pgi->ak2[i]+_RKCK_b53_*pgi->ak3[i]+_RKCK_b54_*pgi->ak4[i]);
+    _RK_LANE_REQUEST_(x+_RKCK_a5_*h,pgi->ytemp,pgi->ak5,rk_lane_stage);
+  default:
+    for (i=0;i<pl->y_size;i++)
+      pgi->ytemp[i]=pgi->y[i]+h*(_RKCK_b61_*pgi->dydx[i]+_RKCK_b62_*pgi->ak2[i]+_RKCK_b63_*pgi->ak3[i]+_RKCK_b64_*pgi->ak4[i]+_RKCK_b65_*pgi->ak5[i]);
+    _RK_LANE_REQUEST_(x+_RKCK_a6_*h,pgi->ytemp,pgi->ak6,rk_lane_stage);
+  }
+}
+
+/**
+ * Advance one lane of evolver_rk_batch() until it needs new
+ * derivatives (or reaches the end of its interval). The states follow
+ * the steps of evolver_rk(), generic_integrator(), rkqs() and rkck(),
+ * with the same arithmetic and the same calls to the functions of the
+ * caller in the same order: each lane gives exactly the results of
+ * evolver_rk().
+ */
+
+static int evolver_rk_lane_advance(
+                                   struct evolver_rk_lane * pl,
+                                   struct evolver_rk_batch_parameters * pb,
+                                   ErrorMsg error_message
+                                   ) {
+
+  struct generic_integrator_workspace * pgi = &(pl->gi);
+  double timestep,timescale,errmax,htemp,hnext,xnew;
+  int i;
+
+  for (;;) {
+
+    switch (pl->state) {
+
+    case rk_lane_start:
+
+      class_test(pl->x_ini > pb->x_sampling[pb->x_size-1],
+                 error_message,
+                 "called with x=%e, last x_sampling=%e",pl->x_ini,pb->x_sampling[pb->x_size-1]);
+
+      pl->next_index_x=0;
+
+      while (pb->x_sampling[pl->next_index_x] < pl->x_ini) pl->next_index_x++;
+
+      if (pl->y_size > pl->size_allocated) {
+        if (pl->size_allocated > 0) {
+          cleanup_generic_integrator(pgi);
+          free(pl->dy);
+        }
+        pl->size_allocated = 0;
+        class_call(initialize_generic_integrator(pl->y_size, pgi),
+                   pgi->error_message,
+                   error_message);
+        class_alloc(pl->dy,pl->y_size*sizeof(double),error_message);
+        pl->size_allocated = pl->y_size;
+      }
+      pgi->n = pl->y_size;
+
+      pl->x1 = pl->x_ini;
+      pl->x2 = 0.;
+      pl->call_output = _FALSE_;
+      pl->state = rk_lane_outer;
+      break;
+
+    case rk_lane_outer:
+
+      /* a last call is compulsory to ensure that all quantitites in
+         y,dy,parameters_and_workspace_for_derivs are updated to the last
+         point in the covered range */
+      if (!((pl->x1 < pl->x_end) && (pl->next_index_x < pb->x_size)))
+        _RK_LANE_REQUEST_(pl->x1,pl->y,pl->dy,rk_lane_last);
+
+      /* stop early when another task of the parallel region has failed */
+      class_test(class_parallel_cancelled() == _TRUE_,
+                 error_message,
+                 "integration cancelled at x=%e",pl->x1);
+
+      class_call((*pb->evaluate_timescale)(pl->x1,
+                                           pl->parameters_and_workspace,
+                                           &timescale,
+                                           error_message),
+                 error_message,
+                 error_message);
+
+      timestep = pb->timestep_over_timescale * timescale;
+
+      class_test(fabs(timestep/pl->x1) < pb->minimum_variation,
+                 error_message,
+                 "integration step =%e < machine precision : leads either to numerical error or infinite loop",fabs(timestep/pl->x1));
+
+      if (pl->x1 + 2.* timestep < pb->x_sampling[pl->next_index_x]) {
+        pl->x2 = pl->x1 + timestep;
+      }
+      else {
+        pl->x2 = pb->x_sampling[pl->next_index_x];
+        pl->call_output = _TRUE_;
+      }
+
+      if (pl->x2 > pl->x_end) {
+        pl->x2 = pl->x_end;
+        pl->call_output = _FALSE_;
+      }
+
+      if (pl->print_variables != NULL) {
+        if (pl->x1 == pl->x_ini)
+          _RK_LANE_REQUEST_(pl->x1,pl->y,pl->dy,rk_lane_print);
+        class_call((*pl->print_variables)(pl->x1,
+                                          pl->y,
+                                          pl->dy,
+                                          pl->parameters_and_workspace,
+                                          error_message),
+                   error_message,
+                   error_message);
+      }
+
+      /* beginning of generic_integrator() from x1 to x2 */
+      pl->h = dsign(pl->x2-pl->x1,pl->x2-pl->x1);
+      pl->x = pl->x1;
+      for (i=0;i<pl->y_size;i++) pgi->y[i]=pl->y[i];
+      pl->nstp = 1;
+      _RK_LANE_REQUEST_(pl->x,pgi->y,pgi->dydx,rk_lane_step);
+
+    case rk_lane_print:
+
+      class_call((*pl->print_variables)(pl->x1,
+                                        pl->y,
+                                        pl->dy,
+                                        pl->parameters_and_workspace,
+                                        error_message),
+                 error_message,
+                 error_message);
+
+      pl->h = dsign(pl->x2-pl->x1,pl->x2-pl->x1);
+      pl->x = pl->x1;
+      for (i=0;i<pl->y_size;i++) pgi->y[i]=pl->y[i];
+      pl->nstp = 1;
+      _RK_LANE_REQUEST_(pl->x,pgi->y,pgi->dydx,rk_lane_step);
+
+    case rk_lane_step:
+
+      for (i=0;i<pl->y_size;i++)
+        pgi->yscal[i]=fabs(pgi->y[i])+fabs(pgi->dydx[i]*pl->h)+_TINY_;
+      if ((pl->x+pl->h-pl->x2)*(pl->x+pl->h-pl->x1) > 0.0) pl->h=pl->x2-pl->x;
+
+      /* beginning of rkqs() */
+      pl->h_stage = pl->h;
+      return evolver_rk_lane_next_stage(pl,2);
+
+    case rk_lane_stage:
+
+      if (pl->stage < 6)
+        return evolver_rk_lane_next_stage(pl,pl->stage+1);
+
+      /* end of rkck() */
+      for (i=0;i<pl->y_size;i++)
+        pgi->ytemp[i]=pgi->y[i]+pl->h_stage*(_RKCK_c1_*pgi->dydx[i]+_RKCK_c3_*pgi->ak3[i]+_RKCK_c4_*pgi->ak4[i]+_RKCK_c6_*pgi->ak6[i]);
+
+      for (i=0;i<pl->y_size;i++)
+        pgi->yerr[i]=pl->h_stage*(_RKCK_dc1_*pgi->dydx[i]+_RKCK_dc3_*pgi->ak3[i]+_RKCK_dc4_*pgi->ak4[i]+_RKCK_dc5_*pgi->ak5[i]+_RKCK_dc6_*pgi->ak6[i]);
+
+      /* step control of rkqs() */
+      errmax=0.0;
+      for (i=0;i<pl->y_size;i++) errmax=MAX(errmax,fabs(pgi->yerr[i]/pgi->yscal[i]));
+      errmax /= pb->tolerance;
+      if (errmax > 1.0) {
+        htemp=_SAFETY_*pl->h_stage*pow(errmax,_PSHRNK_);
+        pl->h_stage=(pl->h_stage >= 0.0 ? MAX(htemp,0.1*pl->h_stage) : MIN(htemp,0.1*pl->h_stage));
+        xnew=pl->x+pl->h_stage;
+        class_test(xnew == pl->x,
+                   error_message,
+                   "stepsize underflow at x=%e",xnew);
+        return evolver_rk_lane_next_stage(pl,2);
+      }
+      if (errmax > _ERRCON_) hnext=_SAFETY_*pl->h_stage*pow(errmax,_PGROW_);
+      else hnext=5.0*pl->h_stage;
+      pl->x += pl->h_stage;
+      for (i=0;i<pl->y_size;i++) pgi->y[i]=pgi->ytemp[i];
+
+      /* step control of generic_integrator() */
+      if ((pl->x-pl->x2)*(pl->x2-pl->x1) >= 0.0) {
+        for (i=0;i<pl->y_size;i++) pl->y[i]=pgi->y[i];
+        pl->state = rk_lane_step_done;
+        break;
+      }
+      class_test(fabs(hnext/pl->x1) <= pl->x1*pb->minimum_variation,
+                 error_message,
+                 "Step size too small: step:%g, minimum:%g, in interval: [%g:%g]",
+                 fabs(hnext/pl->x1),
+                 pl->x1*pb->minimum_variation,
+                 pl->x1,
+                 pl->x2);
+      pl->h=hnext;
+      pl->nstp++;
+      class_test(pl->nstp > _MAXSTP_,
+                 error_message,
+                 "Too many integration steps needed within interval [%g : %g],\n the system of equations is probably buggy or featuring a discontinuity",pl->x1,pl->x2);
+      _RK_LANE_REQUEST_(pl->x,pgi->y,pgi->dydx,rk_lane_step);
+
+    case rk_lane_step_done:
+
+      if (pl->call_output == _TRUE_)
+        _RK_LANE_REQUEST_(pl->x2,pl->y,pl->dy,rk_lane_output);
+      pl->x1 = pl->x2;
+      pl->state = rk_lane_outer;
+      break;
+
+    case rk_lane_output:
+
+      class_call((*pb->output)(pl->x2,
+                               pl->y,
+                               pl->dy,
+                               pl->next_index_x,
+                               pl->parameters_and_workspace,
+                               error_message),
+                 error_message,
+                 error_message);
+
+      pl->call_output = _FALSE_;
+      pl->next_index_x++;
+      pl->x1 = pl->x2;
+      pl->state = rk_lane_outer;
+      break;
+
+    case rk_lane_last:
+
+      if (pl->print_variables != NULL)
+        class_call((*pl->print_variables)(pl->x1,
+                                          pl->y,
+                                          pl->dy,
+                                          pl->parameters_and_workspace,
+                                          error_message),
+                   error_message,
+                   error_message);
+
+      pl->state = rk_lane_done;
+      return _SUCCESS_;
+
+    default:
+      return _SUCCESS_;
+    }
+  }
+}
+
+static void evolver_rk_batch_free(int lane_size, struct evolver_rk_lane * lanes) {
+  int index_lane;
+  for (index_lane = 0; index_lane < lane_size; index_lane++) {
+    if (lanes[index_lane].size_allocated > 0) {
+      cleanup_generic_integrator(&(lanes[index_lane].gi));
+      free(lanes[index_lane].dy);
+      lanes[index_lane].size_allocated = 0;
+    }
+  }
+}
+
+/**
+ * Integrate several independent systems of equations (the lanes) with
+ * the method of evolver_rk(), in lockstep: the lanes are advanced in
+ * turn until each of them needs new derivatives, and the derivatives
+ * requested by all of them are then evaluated in one sweep. Each lane
+ * keeps its own interval, step size and error control, and its results
+ * are exactly those of evolver_rk(). When a lane reaches the end of its
+ * interval, restart() either sets a new interval (possibly with a new
+ * vector and new parameters) or retires the lane; the function returns
+ * when all lanes are retired.
+ *
+ * The sweep over the lanes is where a batched evaluation of the
+ * derivatives (over SIMD lanes or on a device) would take place; with
+ * the scalar derivs, its gain lies in the independent steps of the
+ * lanes, which the processor can overlap.
+ *
+ * @param derivs                  Input: derivatives, as for evolver_rk()
+ * @param lane_size               Input: number of lanes
+ * @param lanes                   Input/Output: lanes, with their public fields set
+ * @param tolerance               Input: as for evolver_rk()
+ * @param minimum_variation       Input: as for evolver_rk()
+ * @param evaluate_timescale      Input: as for evolver_rk()
+ * @param timestep_over_timescale Input: as for evolver_rk()
+ * @param x_sampling              Input: points of output, shared by all lanes
+ * @param x_size                  Input: number of points of output
+ * @param output                  Input: as for evolver_rk()
+ * @param restart                 Input: called at the end of the interval of each lane, sets is_done to _TRUE_ or the public fields of the lane
+ * @param restart_parameters      Input: passed to restart()
+ * @param error_message           Output: error message
+ * @return the error status
+ */
+
+int evolver_rk_batch(int (*derivs)(double x,
+                                   double * y,
+                                   double * dy,
+                                   void * parameters_and_workspace,
+                                   ErrorMsg error_message),
+                     int lane_size,
+                     struct evolver_rk_lane * lanes,
+                     double tolerance,
+                     double minimum_variation,
+                     int (*evaluate_timescale)(double x,
+                                               void * parameters_and_workspace,
+                                               double * timescale,
+                                               ErrorMsg error_message),
+                     double timestep_over_timescale,
+                     double * x_sampling,
+                     int x_size,
+                     int (*output)(double x,
+                                   double y[],
+                                   double dy[],
+                                   int index_x,
+                                   void * parameters_and_workspace,
+                                   ErrorMsg error_message),
+                     int (*restart)(int index_lane,
+                                    struct evolver_rk_lane * plane,
+                                    void * restart_parameters,
+                                    short * is_done,
+                                    ErrorMsg error_message),
+                     void * restart_parameters,
+                     ErrorMsg error_message) {
+
+  struct evolver_rk_batch_parameters batch;
+  struct evolver_rk_lane * pl;
+  int index_lane, active_size;
+  short is_done;
+
+  batch.tolerance = tolerance;
+  batch.minimum_variation = minimum_variation;
+  batch.evaluate_timescale = evaluate_timescale;
+  batch.timestep_over_timescale = timestep_over_timescale;
+  batch.x_sampling = x_sampling;
+  batch.x_size = x_size;
+  batch.output = output;
+
+  for (index_lane = 0; index_lane < lane_size; index_lane++) {
+    lanes[index_lane].state = rk_lane_start;
+    lanes[index_lane].size_allocated = 0;
+  }
+
+  do {
+
+    /** - advance each lane until it needs new derivatives; the lanes
+        reaching the end of their interval are restarted or retired */
+    active_size = 0;
+    for (index_lane = 0; index_lane < lane_size; index_lane++) {
+      pl = &(lanes[index_lane]);
+      while (pl->state != rk_lane_done) {
+        class_call_except(evolver_rk_lane_advance(pl,&batch,error_message),
+                          error_message,
+                          error_message,
+                          evolver_rk_batch_free(lane_size,lanes));
+        if (pl->state != rk_lane_done) {
+          active_size++;
+          break;
+        }
+        class_call_except((*restart)(index_lane,pl,restart_parameters,&is_done,error_message),
+                          error_message,
+                          error_message,
+                          evolver_rk_batch_free(lane_size,lanes));
+        if (is_done == _FALSE_)
+          pl->state = rk_lane_start;
+      }
+    }
+
+    /** - evaluate the derivatives requested by the active lanes */
+    for (index_lane = 0; index_lane < lane_size; index_lane++) {
+      pl = &(lanes[index_lane]);
+      if (pl->state == rk_lane_done)
+        continue;
+      class_call_except((*derivs)(pl->request_x,
+                                  pl->request_y,
+                                  pl->request_dy,
+                                  pl->parameters_and_workspace,
+                                  error_message),
+                        error_message,
+                        error_message,
+                        evolver_rk_batch_free(lane_size,lanes));
+    }
+
+  } while (active_size > 0);
+
+  evolver_rk_batch_free(lane_size,lanes);
+
+  return _SUCCESS_;
+}
@@ -0,0 +1,320 @@
+/**
+ * Module computing integral transforms F(r) = int dlnk f(k) K(kr) of
+ * functions sampled on a logarithmic grid, with the FFTLog method
+ * (Talman 1978, Hamilton 2000): the biased function f(k) k^(-bias) is
+ * expanded in Fourier series of ln(k) by one FFT, each term is
+ * integrated analytically against the kernel thanks to its Mellin
+ * transform, and the series is resumed by a second FFT. This gives
+ * F(r) on a whole logarithmic grid of r in O(N log N) operations,
+ * instead of O(N) operations for each value of r with a direct
+ * quadrature.
+ */
+
+#include "fftlog.h"
+#include <complex.h>
+
+/* Lanczos coefficients (g=7, n=9) for the logarithm of the Gamma
+   function, with a relative accuracy of about 1e-15 for Re(z)>1/2 */
+static const double fftlog_lanczos_coef[9] = {
+  0.99999999999980993,
+  676.5203681218851,
+  -1259.1392167224028,
+  771.32342877765313,
+  -176.61502916214059,
+  12.507343278686905,
+  -0.13857109526572012,
+  9.9843695780195716e-6,
+  1.5056327351493116e-7
+};
+
+/**
+ * Logarithm of the Gamma function for a complex argument (on any
+ * branch, since only exponentials or differences of this logarithm
+ * are used). For Re(z)<1/2, the reflection formula is used, with
+ * ln(sin(pi z)) evaluated without overflow at large Im(z).
+ */
+
+static double complex fftlog_lngamma(double complex z) {
+
+  double complex x, t;
+  double re, im, a;
+  int i;
+
+  if (creal(z) < 0.5) {
+    re = creal(z);
+    im = cimag(z);
+    a = _PI_*fabs(im);
+    /* sin(pi z) = exp(pi |Im z|)/2 * [(1+exp(-2 a)) sin(pi Re z) + i sgn(Im z) (1-exp(-2 a)) cos(pi Re z)] */
+    t = a - log(2.) + clog((1.+exp(-2.*a))*sin(_PI_*re) + I*(im >= 0. ? 1. : -1.)*(1.-exp(-2.*a))*cos(_PI_*re));
+    return log(_PI_) - t - fftlog_lngamma(1.-z);
+  }
+
+  z -= 1.;
+  x = fftlog_lanczos_coef[0];
+  for (i=1; i<9; i++) {
+    x += fftlog_lanczos_coef[i]/(z+i);
+  }
+  t = z + 7.5;
+
+  return 0.5*log(2.*_PI_) + (z+0.5)*clog(t) - t + clog(x);
+}
+
+/**
+ * Mellin transform M(s) = int dx x^(s-1) K(x) of the kernels of enum
+ * fftlog_kernel. For the top-hat window, it follows from the
+ * Weber-Schafheitlin integral of J_{3/2}(x)^2 x^(s-4).
+ */
+
+static double complex fftlog_mellin(enum fftlog_kernel kernel, double complex s) {
+
+  double complex lnM;
+
+  switch (kernel) {
+
+  case fftlog_tophat_sq:
+  case fftlog_tophat_sq_dlnx:
+    lnM = log(4.5*_PI_) + (s-4.)*log(2.)
+      + fftlog_lngamma(4.-s) + fftlog_lngamma(0.5*s)
+      - 2.*fftlog_lngamma(0.5*(5.-s)) - fftlog_lngamma(0.5*(8.-s));
+    if (kernel == fftlog_tophat_sq_dlnx)
+      /* integration by parts */
+      return -s*cexp(lnM);
+    return cexp(lnM);
+
+  case fftlog_gauss:
+    return 0.5*cexp(fftlog_lngamma(0.5*s));
+
+  case fftlog_gauss_x2:
+    return cexp(fftlog_lngamma(0.5*s+1.));
+
+  case fftlog_gauss_x2_x4:
+    return -s*cexp(fftlog_lngamma(0.5*s+1.));
+  }
+
+  return 0.;
+}
+
+/**
+ * In-place forward discrete Fourier transform
+ * data_j <- sum_m data_m exp(-2 i pi j m/n), with the radix-2
+ * Cooley-Tukey algorithm. The array data contains the real and
+ * imaginary parts of the n complex values, with n a power of 2, and
+ * twiddle contains exp(-2 i pi m/n) for 0 <= m < n/2 in the same
+ * format. Also used by the convolutions of nowiggle.c.
+ */
+
+void fftlog_fft(double * data, int n, double * twiddle) {
+
+  int i, j, m, len, half, stride;
+  double tr, ti, wr, wi, ur, ui;
+
+  /** - bit-reversal permutation */
+  for (i=1, j=0; i<n; i++) {
+    m = n >> 1;
+    for (; j & m; m >>= 1)
+      j ^= m;
+    j ^= m;
+    if (i < j) {
+      tr = data[2*i]; data[2*i] = data[2*j]; data[2*j] = tr;
+      ti = data[2*i+1]; data[2*i+1] = data[2*j+1]; data[2*j+1] = ti;
+    }
+  }
+
+  /** - butterflies */
+  for (len=2; len<=n; len <<= 1) {
+    half = len >> 1;
+    stride = n/len;
+    for (i=0; i<n; i+=len) {
+      for (m=0; m<half; m++) {
+        wr = twiddle[2*m*stride];
+        wi = twiddle[2*m*stride+1];
+        ur = data[2*(i+m+half)];
+        ui = data[2*(i+m+half)+1];
+        tr = wr*ur - wi*ui;
+        ti = wr*ui + wi*ur;
+        data[2*(i+m+half)] = data[2*(i+m)] - tr;
+        data[2*(i+m+half)+1] = data[2*(i+m)+1] - ti;
+        data[2*(i+m)] += tr;
+        data[2*(i+m)+1] += ti;
+      }
+    }
+  }
+}
+
+/**
+ * Prepare the transforms F(r) = int dlnk f(k) K(kr) of functions
+ * sampled at n values of k with logarithmic step dlnk, i.e. compute
+ * the transform of the kernel for each Fourier mode. This is the
+ * expensive part of the method; it does not depend on the function f
+ * nor on the smallest k, so that one plan can be used for many
+ * functions (also from several threads at the same time, since
+ * fftlog_execute() does not modify it).
+ *
+ * The integral is over the sampled range only (f is zero-padded to at
+ * least twice its size to avoid aliasing), such that the result can
+ * be compared with a direct quadrature over the same range. It is
+ * accurate when f(k) k^(-bias) is small at both ends of the range,
+ * which constrains the bias; the Mellin transform of the kernel
+ * should also converge for this bias (see enum fftlog_kernel). The
+ * highest Fourier modes are smoothly filtered out to limit the
+ * ringing (window of Fang et al. 2017 on the last quarter of the
+ * modes).
+ *
+ * @param pfp           Output: pointer to plan
+ * @param n             Input: number of samples
+ * @param dlnk          Input: logarithmic step
+ * @param bias          Input: power-law bias
+ * @param kernel        Input: kernel K(x)
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int fftlog_plan_init(
+                     struct fftlog_plan * pfp,
+                     int n,
+                     double dlnk,
+                     double bias,
+                     enum fftlog_kernel kernel,
+                     ErrorMsg error_message
+                     ) {
+
+  int N, m, n_cut;
+  double eta, window, lnkr0, x;
+  double complex u;
+
+  class_test(n < 2,
+             error_message,
+             "cannot transform a function sampled at %d point(s)",n);
+
+  /** - size of the zero-padded array */
+  for (N=1; N<2*n; N<<=1);
+
+  pfp->n = n;
+  pfp->N = N;
+  pfp->dlnk = dlnk;
+  pfp->bias = bias;
+  pfp->kernel = kernel;
+
+  /** - transform of the kernel at s = bias + i eta_m, times
+      (k_0 r_0)^(-i eta_m), times the window */
+
+  class_alloc(pfp->u,2*(N/2+1)*sizeof(double),error_message);
+  class_alloc(pfp->twiddle,N*sizeof(double),error_message);
+
+  /* computed directly rather than by recurrence, for accuracy */
+  for (m=0; m<N/2; m++) {
+    pfp->twiddle[2*m] = cos(2.*_PI_*m/N);
+    pfp->twiddle[2*m+1] = -sin(2.*_PI_*m/N);
+  }
+
+  lnkr0 = -(n-1)*dlnk;
+  n_cut = (3*(N/2))/4;
+
+  for (m=0; m<=N/2; m++) {
+
+    eta = 2.*_PI_*m/(N*dlnk);
+
+    if (m <= n_cut) {
+      window = 1.;
+    }
+    else {
+      x = (double)(N/2-m)/(double)(N/2-n_cut);
+      window = x - sin(2.*_PI_*x)/(2.*_PI_);
+    }
+
+    u = fftlog_mellin(kernel,bias+I*eta) * cexp(-I*eta*lnkr0) * window;
+
+    pfp->u[2*m] = creal(u);
+    pfp->u[2*m+1] = cimag(u);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Compute F(r) = int dlnk f(k) K(kr), for f sampled at the n values
+ * ln(k_m) = lnk_min + m dlnk, on the n values of r such that
+ * r_j k_(n-1-j) = 1, i.e. ln(r_j) = -lnk_min - (n-1-j) dlnk.
+ *
+ * @param pfp           Input: pointer to plan
+ * @param f             Input: array of f(k_m), of size n
+ * @param lnk_min       Input: smallest ln(k)
+ * @param lnr           Output: array of ln(r_j), of size n, in increasing order
+ * @param F             Output: array of F(r_j), of size n
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int fftlog_execute(
+                   struct fftlog_plan * pfp,
+                   double * f,
+                   double lnk_min,
+                   double * lnr,
+                   double * F,
+                   ErrorMsg error_message
+                   ) {
+
+  int n = pfp->n;
+  int N = pfp->N;
+  int m, j;
+  double * data;
+  double cr, ci;
+
+  class_calloc(data,2*N,sizeof(double),error_message);
+
+  /** - Fourier coefficients of the biased function */
+  for (m=0; m<n; m++) {
+    data[2*m] = f[m]*exp(-pfp->bias*(lnk_min+m*pfp->dlnk))/N;
+  }
+
+  fftlog_fft(data,N,pfp->twiddle);
+
+  /** - multiply them by the transform of the kernel; the modes of
+      negative frequency are the complex conjugates, since f and K
+      are real */
+  for (m=0; m<=N/2; m++) {
+
+    cr = data[2*m]*pfp->u[2*m] - data[2*m+1]*pfp->u[2*m+1];
+    ci = data[2*m]*pfp->u[2*m+1] + data[2*m+1]*pfp->u[2*m];
+
+    if ((m == 0) || (m == N/2)) {
+      data[2*m] = cr;
+      data[2*m+1] = 0.;
+    }
+    else {
+      data[2*m] = cr;
+      data[2*m+1] = ci;
+      data[2*(N-m)] = cr;
+      data[2*(N-m)+1] = -ci;
+    }
+  }
+
+  /** - resum the series */
+  fftlog_fft(data,N,pfp->twiddle);
+
+  for (j=0; j<n; j++) {
+    lnr[j] = -lnk_min-(n-1-j)*pfp->dlnk;
+    F[j] = data[2*j]*exp(-pfp->bias*lnr[j]);
+  }
+
+  free(data);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free a plan
+ *
+ * @param pfp Input: pointer to plan
+ * @return the error status
+ */
+
+int fftlog_plan_free(
+                     struct fftlog_plan * pfp
+                     ) {
+
+  free(pfp->u);
+  free(pfp->twiddle);
+
+  return _SUCCESS_;
+}
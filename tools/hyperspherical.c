@@ -7,6 +7,12 @@
 
 #include "hyperspherical.h"
 #include "parallel.h"
+#ifdef _HIS_CACHE_MMAP_
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 int hyperspherical_HIS_create(int K,
                               double beta,
@@ -26,25 +32,47 @@ int hyperspherical_HIS_create(int K,
       single call, and return the pointer as ppHIS. All pointers inside are
       then relative to ppHIS.
   */
-  double deltax, beta2, lambda, x, xfwd;
-  double *sqrtK, *one_over_sqrtK,*PhiL;
-  int j, k, l, nx, lmax, l_recurrence_max;
-  int current_chunk, index_x;
+  double deltax, lambda;
+  int nx;
 
-  beta2 = beta*beta;
-  lmax = lvec[nl-1];
   lambda = 2*_PI_/beta;
   nx = (int) ((xmax-xmin)*sampling/lambda);
   nx = MAX(nx,2);
   deltax = (xmax-xmin)/(nx-1.0);
   //fprintf(stderr,"dx=%e\n",deltax);
   //fprintf(stderr,"%e %e\n",beta,sampling);
+
+  return hyperspherical_HIS_create_grid(K,beta,nl,lvec,xmin,nx,deltax,l_WKB,phiminabs,pHIS,error_message);
+}
+
+int hyperspherical_HIS_create_grid(int K,
+                                   double beta,
+                                   int nl,
+                                   int *lvec,
+                                   double xmin,
+                                   int nx,
+                                   double deltax,
+                                   int l_WKB,
+                                   double phiminabs,
+                                   HyperInterpStruct *pHIS,
+                                   ErrorMsg error_message){
+  /** Same as hyperspherical_HIS_create(), for a given grid of nx points
+      x = xmin + j*deltax. */
+  double beta2, x, xfwd;
+  double *sqrtK, *one_over_sqrtK,*PhiL;
+  int j, k, l, lmax, l_recurrence_max;
+  int current_chunk, index_x;
+
+  beta2 = beta*beta;
+  lmax = lvec[nl-1];
   //Set scalar values:
   pHIS->beta = beta;
   pHIS->delta_x = deltax;
   pHIS->l_size = nl;
   pHIS->x_size = nx;
   pHIS->K = K;
+  pHIS->cache_map = NULL;
+  pHIS->cache_size = 0;
   //Set pointervalues in pHIS:
 
   class_alloc(pHIS->l, sizeof(int)*nl,error_message);
@@ -52,8 +80,11 @@ int hyperspherical_HIS_create(int K,
   class_alloc(pHIS->x,sizeof(double)*nx,error_message);
   class_alloc(pHIS->sinK,sizeof(double)*nx,error_message);
   class_alloc(pHIS->cotK,sizeof(double)*nx,error_message);
-  class_alloc(pHIS->phi,sizeof(double)*nx*nl,error_message);
-  class_alloc(pHIS->dphi,sizeof(double)*nx*nl,error_message);
+  class_alloc_large(pHIS->phi,sizeof(double)*nx*nl,error_message);
+  class_alloc_large(pHIS->dphi,sizeof(double)*nx*nl,error_message);
+  //Spread the pages of the big tables over the NUMA nodes of the workers:
+  class_parallel_first_touch(pHIS->phi,sizeof(double)*nx*nl);
+  class_parallel_first_touch(pHIS->dphi,sizeof(double)*nx*nl);
 
   //Order needed for trig interpolation: (We are using Taylor's remainder theorem)
   if (0.5*deltax*deltax < _TRIG_PRECISSION_)
@@ -134,29 +165,39 @@ int hyperspherical_HIS_create(int K,
   //Only work in parallel if K==0
   class_setup_parallel_optional(K == 0);
 
-  //Calculate and assign Phi and dPhi values:
-  for (j=0; j<MIN(nx,xfwdidx); j++){
+  //Calculate and assign Phi and dPhi values, by chunks of x values:
+  for (j=0; j<MIN(nx,xfwdidx); j+=_HYPER_CHUNK_){
+    class_label_parallel("hyperspherical:index_x",j);
     class_run_parallel_mutable(=,
-    class_alloc(PhiL,(lmax+2)*sizeof(double),error_message);
+    //Use backwards method:
+    current_chunk = MIN(_HYPER_CHUNK_,MIN(nx,xfwdidx)-j);
+    class_alloc(PhiL,(lmax+2)*sizeof(double)*current_chunk,error_message);
     if ((K == 1) && ((int)(beta+0.2) == (lmax+1))) {
-      PhiL[lmax+1] = 0.0;
+      for(k=0; k<(lmax+2)*current_chunk; k++){
+        PhiL[k] = 0.0;
+      }
       lmax--;
     }
-    //Use backwards method:
-    hyperspherical_backwards_recurrence(K,
-                                        MIN(l_recurrence_max,lmax)+1,
-                                        beta,
-                                        pHIS->x[j],
-                                        pHIS->sinK[j],
-                                        pHIS->cotK[j],
-                                        sqrtK,
-                                        one_over_sqrtK,
-                                        PhiL);
+    hyperspherical_backwards_recurrence_chunk(K,
+                                              MIN(l_recurrence_max,lmax)+1,
+                                              beta,
+                                              pHIS->x+j,
+                                              pHIS->sinK+j,
+                                              pHIS->cotK+j,
+                                              current_chunk,
+                                              sqrtK,
+                                              one_over_sqrtK,
+                                              PhiL);
+
     //We have now populated PhiL at x, assign Phi and dPhi for all l in lvec:
     for (k=0; k<=index_recurrence_max; k++){
       l = lvec[k];
-      pHIS->phi[k*nx+j] = PhiL[l];
-      pHIS->dphi[k*nx+j] = l*pHIS->cotK[j]*PhiL[l]-sqrtK[l+1]*PhiL[l+1];
+      for (index_x=0; index_x<current_chunk; index_x++){
+        pHIS->phi[k*nx+j+index_x] = PhiL[l*current_chunk+index_x];
+        pHIS->dphi[k*nx+j+index_x] = l*pHIS->cotK[j+index_x]*
+          PhiL[l*current_chunk+index_x]-
+          sqrtK[l+1]*PhiL[(l+1)*current_chunk+index_x];
+      }
     }
     free(PhiL);
     return _SUCCESS_;
@@ -164,6 +205,7 @@ int hyperspherical_HIS_create(int K,
   }
 
   for (j=xfwdidx; j<nx; j+=_HYPER_CHUNK_){
+    class_label_parallel("hyperspherical:index_x",j);
     class_run_parallel_mutable(=,
     //Use forwards method:
     current_chunk = MIN(_HYPER_CHUNK_,nx-j);
@@ -238,17 +280,272 @@ int hyperspherical_update_pointers(HyperInterpStruct *pHIS_local,
 int hyperspherical_HIS_free(HyperInterpStruct *pHIS,
                             ErrorMsg error_message){
   /** Free the Hyperspherical Interpolation Structure. */
+#ifdef _HIS_CACHE_MMAP_
+  if (pHIS->cache_map != NULL){
+    /* all arrays point into the mapped cache file */
+    munmap(pHIS->cache_map,pHIS->cache_size);
+    pHIS->cache_map = NULL;
+    return _SUCCESS_;
+  }
+#endif
   free(pHIS->l);
   free(pHIS->chi_at_phimin);
   free(pHIS->x);
   free(pHIS->sinK);
   free(pHIS->cotK);
-  free(pHIS->phi);
-  free(pHIS->dphi);
+  class_free_large(pHIS->phi);
+  class_free_large(pHIS->dphi);
 
   return _SUCCESS_;
 }
 
+int hyperspherical_HIS_create_cached(char * cache_directory,
+                                     int K,
+                                     double beta,
+                                     int nl,
+                                     int *lvec,
+                                     double xmin,
+                                     double xmax,
+                                     double sampling,
+                                     int l_WKB,
+                                     double phiminabs,
+                                     HyperInterpStruct *pHIS,
+                                     short * from_cache,
+                                     ErrorMsg error_message){
+  /** Same as hyperspherical_HIS_create(), but the table is stored in (and
+      read back from) a file of cache_directory. In order for one file to
+      serve many cosmologies, the step is fixed to (2 pi/beta)/sampling
+      instead of being adjusted to [xmin, xmax], and the number of points
+      is rounded up to a multiple of _HIS_CACHE_BLOCK_: any file with
+      the same grid and at least as many points as needed is used,
+      memory-mapped without a copy. Failing to write the file is not an
+      error, we just keep the table in memory. */
+  char file_name[_FILENAMESIZE_];
+  double deltax;
+  int nx_needed, nx, j;
+  unsigned long long digest;
+  unsigned char * bytes;
+  short has_map;
+
+  *from_cache = _FALSE_;
+
+  deltax = 2*_PI_/beta/sampling;
+  nx_needed = (int)ceil((xmax-xmin)/deltax)+1;
+  nx_needed = MAX(nx_needed,2);
+
+  /** - the file name is a FNV-1a digest of everything fixing the grid and
+      the table, except its size */
+  digest = 14695981039346656037ULL;
+#define _HIS_DIGEST_(var) \
+  bytes = (unsigned char *) &(var);                     \
+  for (j=0; j<(int)sizeof(var); j++) {                  \
+    digest ^= bytes[j];                                 \
+    digest *= 1099511628211ULL;                         \
+  }
+  j = _HIS_CACHE_VERSION_;
+  _HIS_DIGEST_(j);
+  _HIS_DIGEST_(K);
+  _HIS_DIGEST_(beta);
+  _HIS_DIGEST_(nl);
+  _HIS_DIGEST_(xmin);
+  _HIS_DIGEST_(deltax);
+  _HIS_DIGEST_(l_WKB);
+  _HIS_DIGEST_(phiminabs);
+#undef _HIS_DIGEST_
+  bytes = (unsigned char *) lvec;
+  for (j=0; j<(int)(nl*sizeof(int)); j++){
+    digest ^= bytes[j];
+    digest *= 1099511628211ULL;
+  }
+
+  class_test(snprintf(file_name,_FILENAMESIZE_,"%s/his_K%d_%016llx.bin",cache_directory,K,digest) >= _FILENAMESIZE_,
+             error_message,
+             "path of the cache directory '%s' is too long",
+             cache_directory);
+
+  /** - try the existing file */
+  hyperspherical_cache_map(file_name,K,beta,nl,lvec,xmin,deltax,nx_needed,l_WKB,phiminabs,pHIS,&has_map);
+  if (has_map == _TRUE_){
+    *from_cache = _TRUE_;
+    return _SUCCESS_;
+  }
+
+  /** - otherwise compute the table and store it for the next run */
+  nx = ((nx_needed+_HIS_CACHE_BLOCK_-1)/_HIS_CACHE_BLOCK_)*_HIS_CACHE_BLOCK_;
+
+  class_call(hyperspherical_HIS_create_grid(K,beta,nl,lvec,xmin,nx,deltax,l_WKB,phiminabs,pHIS,error_message),
+             error_message,
+             error_message);
+
+  hyperspherical_cache_write(cache_directory,file_name,pHIS,xmin,l_WKB,phiminabs);
+
+  return _SUCCESS_;
+}
+
+size_t hyperspherical_cache_size(int nl, int nx){
+  /** Size in bytes of a cache file, see struct hyperspherical_cache_header. */
+  return(_HIS_CACHE_HEADER_SIZE_+sizeof(double)*(nl+3*(size_t)nx+2*(size_t)nx*nl)+sizeof(int)*nl);
+}
+
+int hyperspherical_cache_map(char * file_name,
+                             int K,
+                             double beta,
+                             int nl,
+                             int *lvec,
+                             double xmin,
+                             double deltax,
+                             int nx_needed,
+                             int l_WKB,
+                             double phiminabs,
+                             HyperInterpStruct *pHIS,
+                             short * has_map){
+  /** Map the cache file file_name and point the arrays of pHIS into it, if it
+      holds a table with exactly the requested grid and at least nx_needed
+      points. Any mismatch or system error just returns has_map = _FALSE_. */
+#ifdef _HIS_CACHE_MMAP_
+  struct hyperspherical_cache_header header;
+  struct stat file_stat;
+  void * map;
+  double * data;
+  int * l;
+  int fd, j;
+  size_t size;
+
+  *has_map = _FALSE_;
+
+  fd = open(file_name,O_RDONLY);
+  if (fd < 0)
+    return _SUCCESS_;
+
+  if ((fstat(fd,&file_stat) != 0) ||
+      (file_stat.st_size < (off_t)_HIS_CACHE_HEADER_SIZE_) ||
+      (read(fd,&header,sizeof(header)) != (ssize_t)sizeof(header)) ||
+      (strncmp(header.magic,"CLASSHIS",8) != 0) ||
+      (header.version != _HIS_CACHE_VERSION_) ||
+      (header.size_of_int != (int)sizeof(int)) ||
+      (header.size_of_double != (int)sizeof(double)) ||
+      (header.one != 1.0) ||
+      (header.K != K) ||
+      (header.l_size != nl) ||
+      (header.x_size < nx_needed) ||
+      (header.l_WKB != l_WKB) ||
+      (header.beta != beta) ||
+      (header.x_min != xmin) ||
+      (header.delta_x != deltax) ||
+      (header.phiminabs != phiminabs)){
+    close(fd);
+    return _SUCCESS_;
+  }
+
+  size = hyperspherical_cache_size(nl,header.x_size);
+  if ((size_t)file_stat.st_size != size){
+    close(fd);
+    return _SUCCESS_;
+  }
+
+  map = mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return _SUCCESS_;
+
+  data = (double *)((char *)map + _HIS_CACHE_HEADER_SIZE_);
+  l = (int *)(data + nl + 3*(size_t)header.x_size + 2*(size_t)header.x_size*nl);
+  for (j=0; j<nl; j++){
+    if (l[j] != lvec[j]){
+      munmap(map,size);
+      return _SUCCESS_;
+    }
+  }
+
+  pHIS->K = K;
+  pHIS->beta = beta;
+  pHIS->delta_x = deltax;
+  pHIS->trig_order = header.trig_order;
+  pHIS->l_size = nl;
+  pHIS->x_size = header.x_size;
+  pHIS->l = l;
+  pHIS->chi_at_phimin = data;
+  pHIS->x = pHIS->chi_at_phimin + nl;
+  pHIS->sinK = pHIS->x + pHIS->x_size;
+  pHIS->cotK = pHIS->sinK + pHIS->x_size;
+  pHIS->phi = pHIS->cotK + pHIS->x_size;
+  pHIS->dphi = pHIS->phi + (size_t)pHIS->x_size*nl;
+  pHIS->cache_map = map;
+  pHIS->cache_size = size;
+
+  *has_map = _TRUE_;
+#else
+  *has_map = _FALSE_;
+#endif
+  return _SUCCESS_;
+}
+
+int hyperspherical_cache_write(char * cache_directory,
+                               char * file_name,
+                               HyperInterpStruct *pHIS,
+                               double xmin,
+                               int l_WKB,
+                               double phiminabs){
+  /** Write pHIS to file_name, through a temporary file renamed at the end,
+      so that concurrent runs never see a partial table. Returns _FAILURE_
+      without message if anything goes wrong, the caller can ignore it. */
+#ifdef _HIS_CACHE_MMAP_
+  struct hyperspherical_cache_header header;
+  char tmp_name[_FILENAMESIZE_+32];
+  char padding[_HIS_CACHE_HEADER_SIZE_];
+  FILE * file;
+  size_t nx = pHIS->x_size;
+  size_t nl = pHIS->l_size;
+  int status;
+
+  mkdir(cache_directory,0777);
+
+  if (snprintf(tmp_name,_FILENAMESIZE_+32,"%s.%ld.tmp",file_name,(long)getpid()) >= _FILENAMESIZE_+32)
+    return _FAILURE_;
+
+  file = fopen(tmp_name,"wb");
+  if (file == NULL)
+    return _FAILURE_;
+
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,"CLASSHIS",8);
+  header.version = _HIS_CACHE_VERSION_;
+  header.size_of_int = (int)sizeof(int);
+  header.size_of_double = (int)sizeof(double);
+  header.K = pHIS->K;
+  header.l_size = pHIS->l_size;
+  header.x_size = pHIS->x_size;
+  header.trig_order = pHIS->trig_order;
+  header.l_WKB = l_WKB;
+  header.one = 1.0;
+  header.beta = pHIS->beta;
+  header.x_min = xmin;
+  header.delta_x = pHIS->delta_x;
+  header.phiminabs = phiminabs;
+
+  memset(padding,0,_HIS_CACHE_HEADER_SIZE_);
+  memcpy(padding,&header,sizeof(header));
+
+  status = ((fwrite(padding,1,_HIS_CACHE_HEADER_SIZE_,file) == _HIS_CACHE_HEADER_SIZE_) &&
+            (fwrite(pHIS->chi_at_phimin,sizeof(double),nl,file) == nl) &&
+            (fwrite(pHIS->x,sizeof(double),nx,file) == nx) &&
+            (fwrite(pHIS->sinK,sizeof(double),nx,file) == nx) &&
+            (fwrite(pHIS->cotK,sizeof(double),nx,file) == nx) &&
+            (fwrite(pHIS->phi,sizeof(double),nx*nl,file) == nx*nl) &&
+            (fwrite(pHIS->dphi,sizeof(double),nx*nl,file) == nx*nl) &&
+            (fwrite(pHIS->l,sizeof(int),nl,file) == nl));
+
+  if ((fclose(file) != 0) || (status == 0) || (rename(tmp_name,file_name) != 0)){
+    remove(tmp_name);
+    return _FAILURE_;
+  }
+
+  return _SUCCESS_;
+#else
+  return _FAILURE_;
+#endif
+}
+
 int hyperspherical_Hermite_interpolation_vector(HyperInterpStruct *pHIS,
                                                 int nxi,
                                                 int lnum,
@@ -455,6 +752,7 @@ int hyperspherical_forwards_recurrence(int K,
   return _SUCCESS_;
 }
 
+_CLASS_TARGET_CLONES_
 int hyperspherical_forwards_recurrence_chunk(int K,
                                              int lmax,
                                              double beta,
@@ -570,6 +868,7 @@ int hyperspherical_backwards_recurrence(int K,
   return _SUCCESS_;
 }
 
+_CLASS_TARGET_CLONES_
 int hyperspherical_backwards_recurrence_chunk(int K,
                                               int lmax,
                                               double beta,
@@ -580,13 +879,14 @@ int hyperspherical_backwards_recurrence_chunk(int K,
                                               double * __restrict__ sqrtK,
                                               double * __restrict__ one_over_sqrtK,
                                               double * __restrict__ PhiL){
-  double phi0, phi1, phipr1;
+  double phi0, phi1, phipr1, phimax;
   int l, k, isign;
-  int funcreturn = _FAILURE_;
+  int funcreturn;
   int index_x;
   double scalevec[_HYPER_CHUNK_]={0};
 
   for (index_x=0; index_x<chunk; index_x++){
+    funcreturn = _FAILURE_;
     if (K==1){
       if (beta > 1.5*lmax) {
         funcreturn = get_CF1(K,lmax,beta,cotK[index_x], &phipr1, &isign);
@@ -609,13 +909,16 @@ int hyperspherical_backwards_recurrence_chunk(int K,
   }
   for (l=lmax-2; l>=0; l--){
     //Use recurrence Phi_{l} = --Phi_{l+1} + -- Phi_{l+2}
+    phimax = 0.;
     for (index_x=0; index_x<chunk; index_x++){
       PhiL[l*chunk+index_x] = one_over_sqrtK[l+1]*
         ((2*l+3)*cotK[index_x]*PhiL[(l+1)*chunk+index_x]-
          sqrtK[l+2]*PhiL[(l+2)*chunk+index_x]);
+      phimax = MAX(phimax,fabs(PhiL[l*chunk+index_x]));
     }
 
-    if (fabs(PhiL[l*chunk])>_HYPER_OVERFLOW_){
+    //Any x of the chunk may overflow first, not only the first one:
+    if (phimax>_HYPER_OVERFLOW_){
       //Rescale whole Phi vector until this point.
       //Create scale vector:
       for (index_x=0; index_x<chunk; index_x++)
@@ -1429,11 +1732,12 @@ int hyperspherical_get_xmin_from_approx(int K,
     preprocessor. Apologise in advance, but speed for this function
     is important and it is better than manual copy-paste.
 */
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite3_interpolation_vector_Phi(HyperInterpStruct *pHIS,
                                                      int nxi,
                                                      int lnum,
                                                      double * xinterp,
-                                                     double * Phi,
+                                                     double * __restrict__ Phi,
                                                      ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1442,11 +1746,12 @@ int hyperspherical_Hermite3_interpolation_vector_Phi(HyperInterpStruct *pHIS,
 #include "hermite3_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite3_interpolation_vector_dPhi(HyperInterpStruct *pHIS,
                                                       int nxi,
                                                       int lnum,
                                                       double * xinterp,
-                                                      double * dPhi,
+                                                      double * __restrict__ dPhi,
                                                       ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1455,11 +1760,12 @@ int hyperspherical_Hermite3_interpolation_vector_dPhi(HyperInterpStruct *pHIS,
 #include "hermite3_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite3_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,
                                                        int nxi,
                                                        int lnum,
                                                        double * xinterp,
-                                                       double * d2Phi,
+                                                       double * __restrict__ d2Phi,
                                                        ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1468,12 +1774,13 @@ int hyperspherical_Hermite3_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,
 #include "hermite3_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite3_interpolation_vector_PhidPhi(HyperInterpStruct *pHIS,
                                                          int nxi,
                                                          int lnum,
                                                          double * xinterp,
-                                                         double * Phi,
-                                                         double * dPhi,
+                                                         double * __restrict__ Phi,
+                                                         double * __restrict__ dPhi,
                                                          ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1483,12 +1790,13 @@ int hyperspherical_Hermite3_interpolation_vector_PhidPhi(HyperInterpStruct *pHIS
 #include "hermite3_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite3_interpolation_vector_Phid2Phi(HyperInterpStruct *pHIS,
                                                           int nxi,
                                                           int lnum,
                                                           double * xinterp,
-                                                          double * Phi,
-                                                          double * d2Phi,
+                                                          double * __restrict__ Phi,
+                                                          double * __restrict__ d2Phi,
                                                           ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1498,12 +1806,13 @@ int hyperspherical_Hermite3_interpolation_vector_Phid2Phi(HyperInterpStruct *pHI
 #include "hermite3_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite3_interpolation_vector_dPhid2Phi(HyperInterpStruct *pHIS,
                                                            int nxi,
                                                            int lnum,
                                                            double * xinterp,
-                                                           double * dPhi,
-                                                           double * d2Phi,
+                                                           double * __restrict__ dPhi,
+                                                           double * __restrict__ d2Phi,
                                                            ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1514,13 +1823,14 @@ int hyperspherical_Hermite3_interpolation_vector_dPhid2Phi(HyperInterpStruct *pH
   return _SUCCESS_;
 }
 
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite3_interpolation_vector_PhidPhid2Phi(HyperInterpStruct *pHIS,
                                                               int nxi,
                                                               int lnum,
                                                               double * xinterp,
-                                                              double *Phi,
-                                                              double * dPhi,
-                                                              double * d2Phi,
+                                                              double * __restrict__ Phi,
+                                                              double * __restrict__ dPhi,
+                                                              double * __restrict__ d2Phi,
                                                               ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1531,11 +1841,12 @@ int hyperspherical_Hermite3_interpolation_vector_PhidPhid2Phi(HyperInterpStruct
 #include "hermite3_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite4_interpolation_vector_Phi(HyperInterpStruct *pHIS,
                                                      int nxi,
                                                      int lnum,
                                                      double * xinterp,
-                                                     double * Phi,
+                                                     double * __restrict__ Phi,
                                                      ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1544,11 +1855,12 @@ int hyperspherical_Hermite4_interpolation_vector_Phi(HyperInterpStruct *pHIS,
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite4_interpolation_vector_dPhi(HyperInterpStruct *pHIS,
                                                       int nxi,
                                                       int lnum,
                                                       double * xinterp,
-                                                      double * dPhi,
+                                                      double * __restrict__ dPhi,
                                                       ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1557,11 +1869,12 @@ int hyperspherical_Hermite4_interpolation_vector_dPhi(HyperInterpStruct *pHIS,
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite4_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,
                                                        int nxi,
                                                        int lnum,
                                                        double * xinterp,
-                                                       double * d2Phi,
+                                                       double * __restrict__ d2Phi,
                                                        ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1570,12 +1883,13 @@ int hyperspherical_Hermite4_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite4_interpolation_vector_PhidPhi(HyperInterpStruct *pHIS,
                                                          int nxi,
                                                          int lnum,
                                                          double * xinterp,
-                                                         double * Phi,
-                                                         double * dPhi,
+                                                         double * __restrict__ Phi,
+                                                         double * __restrict__ dPhi,
                                                          ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1585,12 +1899,13 @@ int hyperspherical_Hermite4_interpolation_vector_PhidPhi(HyperInterpStruct *pHIS
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite4_interpolation_vector_Phid2Phi(HyperInterpStruct *pHIS,
                                                           int nxi,
                                                           int lnum,
                                                           double * xinterp,
-                                                          double * Phi,
-                                                          double * d2Phi,
+                                                          double * __restrict__ Phi,
+                                                          double * __restrict__ d2Phi,
                                                           ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1600,12 +1915,13 @@ int hyperspherical_Hermite4_interpolation_vector_Phid2Phi(HyperInterpStruct *pHI
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite4_interpolation_vector_dPhid2Phi(HyperInterpStruct *pHIS,
                                                            int nxi,
                                                            int lnum,
                                                            double * xinterp,
-                                                           double * dPhi,
-                                                           double * d2Phi,
+                                                           double * __restrict__ dPhi,
+                                                           double * __restrict__ d2Phi,
                                                            ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1616,13 +1932,14 @@ int hyperspherical_Hermite4_interpolation_vector_dPhid2Phi(HyperInterpStruct *pH
   return _SUCCESS_;
 }
 
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite4_interpolation_vector_PhidPhid2Phi(HyperInterpStruct *pHIS,
                                                               int nxi,
                                                               int lnum,
                                                               double * xinterp,
-                                                              double *Phi,
-                                                              double * dPhi,
-                                                              double * d2Phi,
+                                                              double * __restrict__ Phi,
+                                                              double * __restrict__ dPhi,
+                                                              double * __restrict__ d2Phi,
                                                               ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1633,11 +1950,12 @@ int hyperspherical_Hermite4_interpolation_vector_PhidPhid2Phi(HyperInterpStruct
 #include "hermite4_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite6_interpolation_vector_Phi(HyperInterpStruct *pHIS,
                                                      int nxi,
                                                      int lnum,
                                                      double * xinterp,
-                                                     double * Phi,
+                                                     double * __restrict__ Phi,
                                                      ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1646,11 +1964,12 @@ int hyperspherical_Hermite6_interpolation_vector_Phi(HyperInterpStruct *pHIS,
 #include "hermite6_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite6_interpolation_vector_dPhi(HyperInterpStruct *pHIS,
                                                       int nxi,
                                                       int lnum,
                                                       double * xinterp,
-                                                      double * dPhi,
+                                                      double * __restrict__ dPhi,
                                                       ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1659,11 +1978,12 @@ int hyperspherical_Hermite6_interpolation_vector_dPhi(HyperInterpStruct *pHIS,
 #include "hermite6_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite6_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,
                                                        int nxi,
                                                        int lnum,
                                                        double * xinterp,
-                                                       double * d2Phi,
+                                                       double * __restrict__ d2Phi,
                                                        ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1672,12 +1992,13 @@ int hyperspherical_Hermite6_interpolation_vector_d2Phi(HyperInterpStruct *pHIS,
 #include "hermite6_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite6_interpolation_vector_PhidPhi(HyperInterpStruct *pHIS,
                                                          int nxi,
                                                          int lnum,
                                                          double * xinterp,
-                                                         double * Phi,
-                                                         double * dPhi,
+                                                         double * __restrict__ Phi,
+                                                         double * __restrict__ dPhi,
                                                          ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1687,12 +2008,13 @@ int hyperspherical_Hermite6_interpolation_vector_PhidPhi(HyperInterpStruct *pHIS
 #include "hermite6_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite6_interpolation_vector_Phid2Phi(HyperInterpStruct *pHIS,
                                                           int nxi,
                                                           int lnum,
                                                           double * xinterp,
-                                                          double * Phi,
-                                                          double * d2Phi,
+                                                          double * __restrict__ Phi,
+                                                          double * __restrict__ d2Phi,
                                                           ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1702,12 +2024,13 @@ int hyperspherical_Hermite6_interpolation_vector_Phid2Phi(HyperInterpStruct *pHI
 #include "hermite6_interpolation_csource.h"
   return _SUCCESS_;
 }
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite6_interpolation_vector_dPhid2Phi(HyperInterpStruct *pHIS,
                                                            int nxi,
                                                            int lnum,
                                                            double * xinterp,
-                                                           double * dPhi,
-                                                           double * d2Phi,
+                                                           double * __restrict__ dPhi,
+                                                           double * __restrict__ d2Phi,
                                                            ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -1718,13 +2041,14 @@ int hyperspherical_Hermite6_interpolation_vector_dPhid2Phi(HyperInterpStruct *pH
   return _SUCCESS_;
 }
 
+_CLASS_TARGET_CLONES_
 int hyperspherical_Hermite6_interpolation_vector_PhidPhid2Phi(HyperInterpStruct *pHIS,
                                                               int nxi,
                                                               int lnum,
                                                               double * xinterp,
-                                                              double *Phi,
-                                                              double * dPhi,
-                                                              double * d2Phi,
+                                                              double * __restrict__ Phi,
+                                                              double * __restrict__ dPhi,
+                                                              double * __restrict__ d2Phi,
                                                               ErrorMsg error_message) {
 #undef HERMITE_DO_PHI
 #undef HERMITE_DO_DPHI
@@ -0,0 +1,248 @@
+/**
+ * Module splitting power spectra into a wiggle and a nowiggle part,
+ * shared by the fourier module (numerical nowiggle spectrum) and by
+ * HMcode 2020 (dewiggling of the two-halo term). The spectrum is
+ * first divided by a smooth reference spectrum (normally the analytic
+ * approximation of Eisenstein & Hu), to reduce its dynamical range;
+ * the ratio is smoothed with a Gaussian of width sigma in ln(k) on a
+ * uniform grid, and multiplied back by the reference.
+ *
+ * Everything that does not depend on the spectrum (grid, reference
+ * spectrum on the grid, transform of the Gaussian weights and their
+ * normalisation) is computed once by nowiggle_plan_init(). The
+ * smoothing itself, which would take O(n^2) operations for a direct
+ * sum over the n points of the grid, is then a convolution done with
+ * two FFTs in O(n log n) operations by nowiggle_split(). It gives the
+ * same result as array_smooth_Gaussian() up to rounding errors.
+ */
+
+#include "nowiggle.h"
+#include "arrays.h"
+#include "fftlog.h"
+
+/* points closer to the ends of the grid than this number of sigma
+   are not smoothed, as in array_smooth_Gaussian() */
+#define _NOWIGGLE_NSIG_ 3.
+
+/**
+ * Prepare the smoothing of spectra on a uniform grid of n values of
+ * ln(k) from lnk_min to lnk_max, with a Gaussian of width sigma in
+ * ln(k), relative to a smooth reference spectrum given on another
+ * grid (and interpolated here on the uniform one). The plan is not
+ * modified by nowiggle_split(), and can thus be used from several
+ * threads at the same time.
+ *
+ * @param pnp           Output: pointer to plan
+ * @param n             Input: number of points of the uniform grid
+ * @param lnk_min       Input: smallest ln(k)
+ * @param lnk_max       Input: largest ln(k)
+ * @param sigma         Input: width of the Gaussian in ln(k)
+ * @param lnk_ref       Input: ln(k) values of the reference spectrum, in increasing order
+ * @param lnpk_ref      Input: ln(P_ref(k)) at these values
+ * @param ddlnpk_ref    Input: its second derivative with respect to ln(k), for spline interpolation
+ * @param ref_size      Input: number of values of the reference spectrum
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int nowiggle_plan_init(
+                       struct nowiggle_plan * pnp,
+                       int n,
+                       double lnk_min,
+                       double lnk_max,
+                       double sigma,
+                       double * lnk_ref,
+                       double * lnpk_ref,
+                       double * ddlnpk_ref,
+                       int ref_size,
+                       ErrorMsg error_message
+                       ) {
+
+  int N, i, m;
+  int last_index = 0;
+  double * data;
+  double * cumulated;
+
+  class_test(n < 2,
+             error_message,
+             "cannot smooth a function sampled at %d point(s)",n);
+
+  class_test(sigma <= 0.,
+             error_message,
+             "Cannot smooth with sigma<0 (sigma=%e)",sigma);
+
+  /** - size of the zero-padded array, such that the convolution does not wrap around */
+  for (N=1; N<2*n; N<<=1);
+
+  pnp->n = n;
+  pnp->N = N;
+
+  class_alloc(pnp->lnk,n*sizeof(double),error_message);
+  class_alloc(pnp->lnpk_ref,n*sizeof(double),error_message);
+  class_alloc(pnp->kernel,N*sizeof(double),error_message);
+  class_alloc(pnp->norm,n*sizeof(double),error_message);
+  class_alloc(pnp->twiddle,N*sizeof(double),error_message);
+
+  /** - uniform grid, and reference spectrum on this grid */
+  for (i=0; i<n; i++) {
+
+    pnp->lnk[i] = lnk_min+i*(lnk_max-lnk_min)/(n-1);
+
+    class_call(array_interpolate_spline(lnk_ref,
+                                        ref_size,
+                                        lnpk_ref,
+                                        ddlnpk_ref,
+                                        1,
+                                        pnp->lnk[i],
+                                        &last_index,
+                                        &(pnp->lnpk_ref[i]),
+                                        1,
+                                        error_message),
+               error_message,
+               error_message);
+  }
+
+  /** - range of the smoothed points */
+  for (pnp->i_min=0; (pnp->i_min<n) && (fabs(pnp->lnk[pnp->i_min]-pnp->lnk[0]) < _NOWIGGLE_NSIG_*sigma); pnp->i_min++);
+  for (pnp->i_max=n-1; (pnp->i_max>=0) && (fabs(pnp->lnk[pnp->i_max]-pnp->lnk[n-1]) < _NOWIGGLE_NSIG_*sigma); pnp->i_max--);
+
+  /* computed directly rather than by recurrence, for accuracy */
+  for (m=0; m<N/2; m++) {
+    pnp->twiddle[2*m] = cos(2.*_PI_*m/N);
+    pnp->twiddle[2*m+1] = -sin(2.*_PI_*m/N);
+  }
+
+  /** - Gaussian weights w(i-j) as a function of the distance i-j,
+      stored circularly (negative distances at the end), and their
+      transform, which is real since they are symmetric */
+  class_calloc(data,2*N,sizeof(double),error_message);
+  class_alloc(cumulated,n*sizeof(double),error_message);
+
+  for (i=0; i<n; i++) {
+    data[2*i] = exp(-(pnp->lnk[i]-pnp->lnk[0])*(pnp->lnk[i]-pnp->lnk[0])/(2.*sigma*sigma));
+    if (i > 0)
+      data[2*(N-i)] = data[2*i];
+    cumulated[i] = (i > 0) ? cumulated[i-1]+data[2*i] : data[2*i];
+  }
+
+  /** - normalisation: the weights of points j around point i sum to
+      w(0) + sum_{d=1}^{i} w(d) + sum_{d=1}^{n-1-i} w(d) */
+  for (i=0; i<n; i++) {
+    pnp->norm[i] = 1./(cumulated[i]+cumulated[n-1-i]-data[0]);
+  }
+
+  fftlog_fft(data,N,pnp->twiddle);
+
+  for (m=0; m<N; m++) {
+    pnp->kernel[m] = data[2*m]/N;
+  }
+
+  free(data);
+  free(cumulated);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Split a spectrum P(k) into a nowiggle part, the reference spectrum
+ * times the smoothed ratio P(k)/P_ref(k), and a wiggle part, P(k)
+ * minus the nowiggle part, on the uniform grid of the plan pnp->lnk.
+ *
+ * @param pnp           Input: pointer to plan
+ * @param lnk           Input: ln(k) values of the spectrum, in increasing order
+ * @param lnpk          Input: ln(P(k)) at these values
+ * @param ddlnpk        Input: its second derivative with respect to ln(k), for spline interpolation
+ * @param k_size        Input: number of values of the spectrum
+ * @param pk_nw         Output: nowiggle spectrum at pnp->lnk[i], array of size pnp->n
+ * @param pk_w          Output: wiggle spectrum at pnp->lnk[i], array of size pnp->n
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int nowiggle_split(
+                   struct nowiggle_plan * pnp,
+                   double * lnk,
+                   double * lnpk,
+                   double * ddlnpk,
+                   int k_size,
+                   double * pk_nw,
+                   double * pk_w,
+                   ErrorMsg error_message
+                   ) {
+
+  int n = pnp->n;
+  int N = pnp->N;
+  int i, m;
+  int last_index = 0;
+  double * data;
+  double * lnpk_lin;
+
+  class_calloc(data,2*N,sizeof(double),error_message);
+  class_alloc(lnpk_lin,n*sizeof(double),error_message);
+
+  /** - ratio P(k)/P_ref(k) on the uniform grid */
+  for (i=0; i<n; i++) {
+
+    class_call(array_interpolate_spline(lnk,
+                                        k_size,
+                                        lnpk,
+                                        ddlnpk,
+                                        1,
+                                        pnp->lnk[i],
+                                        &last_index,
+                                        &(lnpk_lin[i]),
+                                        1,
+                                        error_message),
+               error_message,
+               error_message);
+
+    data[2*i] = exp(lnpk_lin[i]-pnp->lnpk_ref[i]);
+  }
+
+  /** - convolve it with the Gaussian weights: transform, multiply
+      by the transform of the weights, and transform back (the
+      inverse transform is the forward one of the complex conjugate,
+      whose real part is all we need) */
+  fftlog_fft(data,N,pnp->twiddle);
+
+  for (m=0; m<N; m++) {
+    data[2*m] *= pnp->kernel[m];
+    data[2*m+1] *= -pnp->kernel[m];
+  }
+
+  fftlog_fft(data,N,pnp->twiddle);
+
+  /** - normalise the smoothed ratio, and multiply it back by the reference spectrum */
+  for (i=0; i<n; i++) {
+    if ((i >= pnp->i_min) && (i <= pnp->i_max))
+      pk_nw[i] = data[2*i]*pnp->norm[i]*exp(pnp->lnpk_ref[i]);
+    else
+      pk_nw[i] = exp(lnpk_lin[i]-pnp->lnpk_ref[i])*exp(pnp->lnpk_ref[i]);
+    pk_w[i] = exp(lnpk_lin[i])-pk_nw[i];
+  }
+
+  free(data);
+  free(lnpk_lin);
+
+  return _SUCCESS_;
+}
+
+/**
+ * Free a plan
+ *
+ * @param pnp Input: pointer to plan
+ * @return the error status
+ */
+
+int nowiggle_plan_free(
+                       struct nowiggle_plan * pnp
+                       ) {
+
+  free(pnp->lnk);
+  free(pnp->lnpk_ref);
+  free(pnp->kernel);
+  free(pnp->norm);
+  free(pnp->twiddle);
+
+  return _SUCCESS_;
+}
@@ -0,0 +1,389 @@
+/** @file parallel.c C interface to the shared thread pool
+ *
+ * The pool itself is defined in include/parallel.h. This file only
+ * exposes it to the C parts of the code and to the wrappers, in order to
+ * size it explicitly, or to detach it from the forthcoming runs (each
+ * parallel region then creates and joins its own threads, as before),
+ * to place its workers on the cores, and to record the execution of its
+ * tasks.
+ */
+
+#include "common.h"
+#include "parallel.h"
+#include <dirent.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/**
+ * Attach the shared pool to all subsequent runs, with a given number of
+ * threads. The threads are (re)started lazily at the next parallel region.
+ *
+ * @param num_threads Input: number of threads, or 0 for the default (OMP_NUM_THREADS, SLURM_CPUS_PER_TASK, or number of cores)
+ * @return the error status
+ */
+
+int class_parallel_attach(int num_threads) {
+  if (num_threads < 0) {
+    return _FAILURE_;
+  }
+  Tools::TaskSystem::AttachShared((unsigned int)num_threads);
+  return _SUCCESS_;
+}
+
+/**
+ * Join the threads of the shared pool and stop using it, until the next
+ * call to class_parallel_attach(). Must not be called during a run.
+ *
+ * @return the error status
+ */
+
+int class_parallel_detach() {
+  Tools::TaskSystem::DetachShared();
+  return _SUCCESS_;
+}
+
+/**
+ * Number of threads used by the parallel regions of the next run
+ *
+ * @return the number of threads
+ */
+
+int class_parallel_get_num_threads() {
+  if (Tools::TaskSystem::BoundThreads() > 0) {
+    return (int)Tools::TaskSystem::BoundThreads();
+  }
+  if (Tools::TaskSystem::BoundPool() != nullptr) {
+    return (int)Tools::TaskSystem::BoundPool()->get_num_threads();
+  }
+  if (Tools::TaskSystem::SharedIsAttached()) {
+    return (int)Tools::TaskSystem::SharedNumThreads();
+  }
+  return (int)Tools::TaskSystem::GetNumThreads();
+}
+
+/**
+ * Whether the parallel regions currently use the shared pool
+ *
+ * @return _TRUE_ or _FALSE_
+ */
+
+int class_parallel_is_attached() {
+  return (Tools::TaskSystem::SharedIsAttached() ? _TRUE_ : _FALSE_);
+}
+
+/**
+ * Give the calling thread its own quota of threads, used by all the runs
+ * started from this thread instead of the shared pool. This bounds the
+ * number of threads of one instance of CLASS, when several instances run
+ * concurrently from different threads of the caller (e.g. in classy).
+ * The quota includes the calling thread, and is taken from the budget of
+ * the process (see class_parallel_set_budget()): when the budget is
+ * exhausted, the thread gets less threads than requested, down to running
+ * its parallel regions serially, such that the instances together never
+ * oversubscribe the cores. The pool is reused by the next runs of the
+ * thread, and joined when its size changes or when the thread exits. Must
+ * not be called during a run.
+ *
+ * @param num_threads Input: number of threads, or 0 to go back to the shared pool
+ * @return the error status
+ */
+
+int class_parallel_attach_thread(int num_threads) {
+  if (num_threads < 0) {
+    return _FAILURE_;
+  }
+  Tools::TaskSystem::AttachThread((unsigned int)num_threads);
+  return _SUCCESS_;
+}
+
+/**
+ * Give the calling thread an equal share of the budget of threads, for
+ * num_instances instances of CLASS running side by side (each of them
+ * calling this function from its own thread)
+ *
+ * @param num_instances Input: number of instances sharing the budget
+ * @return the error status
+ */
+
+int class_parallel_attach_thread_share(int num_instances) {
+  if (num_instances < 1) {
+    return _FAILURE_;
+  }
+  Tools::TaskSystem::AttachThread((unsigned int)MAX(1,(int)Tools::TaskSystem::Budget()/num_instances));
+  return _SUCCESS_;
+}
+
+/**
+ * Set the total number of threads that the pools of
+ * class_parallel_attach_thread(), and the private pools used when the
+ * shared pool is detached, may run together. The threads already granted
+ * are not affected.
+ *
+ * @param num_threads Input: number of threads, or 0 for the default (OMP_NUM_THREADS, SLURM_CPUS_PER_TASK, or number of cores)
+ * @return the error status
+ */
+
+int class_parallel_set_budget(int num_threads) {
+  if (num_threads < 0) {
+    return _FAILURE_;
+  }
+  Tools::TaskSystem::SetBudget((unsigned int)num_threads);
+  return _SUCCESS_;
+}
+
+/**
+ * Total number of threads of the budget (see class_parallel_set_budget())
+ *
+ * @return the number of threads
+ */
+
+int class_parallel_get_budget() {
+  return (int)Tools::TaskSystem::Budget();
+}
+
+/**
+ * Start recording the execution of the tasks of all parallel regions,
+ * forgetting the events recorded previously. Each task is recorded with
+ * the time at which it was enqueued, started and completed, the thread
+ * which executed it, and its label (see class_label_parallel()). Must not
+ * be called during a run.
+ *
+ * @return the error status
+ */
+
+int class_parallel_trace_start() {
+  Tools::TaskTrace::Start();
+  return _SUCCESS_;
+}
+
+/**
+ * Stop recording the tasks; the events recorded so far are kept until
+ * the next call to class_parallel_trace_start()
+ *
+ * @return the error status
+ */
+
+int class_parallel_trace_stop() {
+  Tools::TaskTrace::Stop();
+  return _SUCCESS_;
+}
+
+/**
+ * Write the recorded tasks in a file, in the Chrome trace event format
+ * (to be opened with chrome://tracing or https://ui.perfetto.dev). Must
+ * be called once all the tasks have completed, i.e. outside of a run.
+ *
+ * @param filename      Input: name of the file
+ * @param error_message Output: error message
+ * @return the error status
+ */
+
+int class_parallel_trace_write(char * filename, char * error_message) {
+  FILE * out;
+  class_open(out,filename,"w",error_message);
+  Tools::TaskTrace::Write(out);
+  fclose(out);
+  return _SUCCESS_;
+}
+
+/* policy of class_parallel_set_affinity(), -1 until it is read from CLASS_AFFINITY */
+static std::atomic<int> parallel_affinity_policy(-1);
+
+/* number of workers pinned so far, by all the pools of the process */
+static std::atomic<unsigned int> parallel_pinned_workers(0);
+
+/**
+ * Select the placement of the workers of the pools started from now on
+ * (the threads already running keep their placement)
+ *
+ * @param policy Input: affinity_none, affinity_compact or affinity_spread
+ * @return the error status
+ */
+
+int class_parallel_set_affinity(int policy) {
+  if ((policy != affinity_none) && (policy != affinity_compact) && (policy != affinity_spread)) {
+    return _FAILURE_;
+  }
+  parallel_affinity_policy.store(policy);
+  return _SUCCESS_;
+}
+
+/**
+ * Placement of the workers, read from the environment variable
+ * CLASS_AFFINITY at the first call unless class_parallel_set_affinity()
+ * was called before
+ *
+ * @return affinity_none, affinity_compact or affinity_spread
+ */
+
+int class_parallel_get_affinity() {
+  int policy = parallel_affinity_policy.load();
+  if (policy < 0) {
+    char * s = getenv("CLASS_AFFINITY");
+    policy = affinity_none;
+    if ((s != NULL) && (strcmp(s,"compact") == 0))
+      policy = affinity_compact;
+    if ((s != NULL) && (strcmp(s,"spread") == 0))
+      policy = affinity_spread;
+    parallel_affinity_policy.store(policy);
+  }
+  return policy;
+}
+
+#ifdef __linux__
+/* the cores allowed to the process, in the order in which the workers are pinned to them */
+static std::vector<int> parallel_affinity_cores(int policy) {
+  cpu_set_t allowed;
+  std::vector<std::vector<int> > nodes;
+  std::vector<int> cores;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0,sizeof(allowed),&allowed) != 0) {
+    return cores;
+  }
+  /* cores of each NUMA node, from /sys/devices/system/node/node<n>/cpulist */
+  if (policy == affinity_spread) {
+    DIR * dir = opendir("/sys/devices/system/node");
+    struct dirent * entry;
+    while ((dir != NULL) && ((entry = readdir(dir)) != NULL)) {
+      char filename[_FILENAMESIZE_];
+      int first, last;
+      char separator;
+      FILE * list;
+      if (strncmp(entry->d_name,"node",4) != 0)
+        continue;
+      sprintf(filename,"/sys/devices/system/node/%.64s/cpulist",entry->d_name);
+      if ((list = fopen(filename,"r")) == NULL)
+        continue;
+      nodes.push_back(std::vector<int>());
+      while (fscanf(list,"%d",&first) == 1) {
+        last = first;
+        if (fscanf(list,"%c",&separator) == 1 && separator == '-') {
+          if (fscanf(list,"%d",&last) != 1) break;
+          if (fscanf(list,"%c",&separator) != 1) separator = '\n';
+        }
+        for (int core = first; core <= last; core++)
+          if ((core < CPU_SETSIZE) && CPU_ISSET(core,&allowed))
+            nodes.back().push_back(core);
+        if (separator != ',')
+          break;
+      }
+      fclose(list);
+    }
+    if (dir != NULL)
+      closedir(dir);
+    /* one core of each node in turn */
+    for (size_t rank = 0; ; rank++) {
+      bool found = false;
+      for (auto& node : nodes) {
+        if (rank < node.size()) {
+          cores.push_back(node[rank]);
+          found = true;
+        }
+      }
+      if (!found)
+        break;
+    }
+  }
+  /* compact, or no NUMA information */
+  if (cores.empty()) {
+    for (int core = 0; core < CPU_SETSIZE; core++)
+      if (CPU_ISSET(core,&allowed))
+        cores.push_back(core);
+  }
+  return cores;
+}
+#endif
+
+/**
+ * Pin the calling worker to its core, following the policy of
+ * class_parallel_get_affinity(). Called by each worker of the pools when
+ * it starts; does nothing with affinity_none or outside of Linux.
+ */
+
+void class_parallel_pin_worker() {
+#ifdef __linux__
+  int policy = class_parallel_get_affinity();
+  if (policy == affinity_none)
+    return;
+  static std::mutex mutex;
+  static std::vector<int> cores[3];
+  int core;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (cores[policy].empty())
+      cores[policy] = parallel_affinity_cores(policy);
+    if (cores[policy].empty())
+      return;
+    core = cores[policy][parallel_pinned_workers++ % cores[policy].size()];
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core,&set);
+  pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+#endif
+}
+
+/**
+ * When the workers are pinned (see class_parallel_get_affinity()), touch a
+ * freshly allocated array in parallel, one block of pages per task, such
+ * that its pages are spread over the memory of the NUMA nodes of the
+ * workers instead of being all placed on the node of the allocating
+ * thread. The array is set to zero. Does nothing with affinity_none.
+ *
+ * @param array Input/Output: the array
+ * @param size  Input: its size in bytes
+ * @return the error status
+ */
+
+int class_parallel_first_touch(void * array, size_t size) {
+
+  /* 64 pages of 4 kB per task, or one huge page of 2 MB for the arrays
+     aligned on huge pages by class_alloc_large() (the whole huge page
+     is placed on the node of the thread touching it first) */
+  const size_t huge_page = 512*4096;
+  const size_t block = (((uintptr_t)array % huge_page) == 0) ? huge_page : 64*4096;
+  size_t offset;
+
+  if ((class_parallel_get_affinity() == affinity_none) || (size < 2*block))
+    return _SUCCESS_;
+
+  class_setup_parallel();
+
+  for (offset = 0; offset < size; offset += block) {
+    class_label_parallel("first_touch:block",(int)(offset/block));
+    class_run_parallel(=,
+      memset((char*)array+offset,0,MIN(block,size-offset));
+      return _SUCCESS_;
+    );
+  }
+
+  class_finish_parallel();
+
+  return _SUCCESS_;
+}
+
+/**
+ * Whether the parallel region of the task being executed by the calling
+ * thread has been cancelled, because another of its tasks (or a task of
+ * an enclosing region) has failed. Long computations running in a task,
+ * such as the step loops of the evolvers, check this and then return
+ * _FAILURE_, so that the region terminates quickly. From then on and until
+ * the end of the task, the error messages of the calling thread are muted
+ * (see class_mute_error_messages()), such that the region reports the
+ * message of the task which failed first. Always _FALSE_ outside of a
+ * parallel region.
+ *
+ * @return _TRUE_ if the region is cancelled, _FALSE_ otherwise
+ */
+
+int class_parallel_cancelled() {
+  Tools::TaskCompletion * region = Tools::TaskCompletion::Current();
+
+  if ((region == NULL) || (region->Cancelled() == false))
+    return _FALSE_;
+
+  class_mute_error_messages(_TRUE_);
+  return _TRUE_;
+}
@@ -60,6 +60,10 @@ int parser_init(struct file_content * pfc,
     class_alloc(pfc->read,size*sizeof(short),errmsg);
   }
 
+  pfc->index_size = 0;
+  pfc->index = NULL;
+  pfc->multiple = NULL;
+
   return _SUCCESS_;
 }
 
@@ -70,7 +74,113 @@ int parser_free(struct file_content * pfc) {
     free(pfc->value);
     free(pfc->read);
     free(pfc->filename);
+    parser_reset_index(pfc);
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Find the position of a parameter in the lists of a file_content
+ * structure.
+ *
+ * The first call builds a hash index of all the names (flagging at the
+ * same time the names appearing more than once in pfc->multiple), such
+ * that all lookups take a constant time instead of a scan of the
+ * lists. The index is rebuilt if the number of entries has changed
+ * since (e.g. when the shooting temporarily hides the last entries),
+ * but the names should not be modified directly without calling
+ * parser_reset_index() (the functions of this module that modify the
+ * lists take care of it).
+ *
+ * @param pfc    Input/Output: file content structure
+ * @param name   Input: name of the parameter
+ * @param index  Output: position of the first entry with this name, or pfc->size if there is none
+ * @param errmsg Output: error message
+ * @return the error status
+ */
+
+int parser_find(struct file_content * pfc,
+                char * name,
+                int * index,
+                ErrorMsg errmsg) {
+
+  unsigned int hash, mask, slot;
+  char * c;
+  int i;
+
+  *index = pfc->size;
+
+  if (pfc->size <= 0)
+    return _SUCCESS_;
+
+  if ((pfc->index_size > 0) && (pfc->index_entries != pfc->size))
+    parser_reset_index(pfc);
+
+  /** - build the index if not done yet, with 2 to 4 slots per entry */
+  if (pfc->index_size == 0) {
+
+    pfc->index_entries = pfc->size;
+    pfc->index_size = 2;
+    while (pfc->index_size < 2*pfc->size)
+      pfc->index_size *= 2;
+    mask = pfc->index_size-1;
+
+    class_alloc(pfc->index,pfc->index_size*sizeof(int),errmsg);
+    class_alloc(pfc->multiple,pfc->size*sizeof(short),errmsg);
+
+    for (slot=0; slot<pfc->index_size; slot++)
+      pfc->index[slot] = -1;
+
+    for (i=0; i<pfc->size; i++) {
+      pfc->multiple[i] = _FALSE_;
+      hash = 2166136261u;
+      for (c=pfc->name[i]; *c != '\0'; c++)
+        hash = (hash ^ (unsigned char)(*c))*16777619u;
+      for (slot = hash & mask; pfc->index[slot] >= 0; slot = (slot+1) & mask) {
+        if (strcmp(pfc->name[pfc->index[slot]],pfc->name[i]) == 0) {
+          pfc->multiple[pfc->index[slot]] = _TRUE_;
+          break;
+        }
+      }
+      if (pfc->index[slot] < 0)
+        pfc->index[slot] = i;
+    }
+  }
+
+  /** - look for the name (FNV-1a hash, linear probing) */
+  mask = pfc->index_size-1;
+  hash = 2166136261u;
+  for (c=name; *c != '\0'; c++)
+    hash = (hash ^ (unsigned char)(*c))*16777619u;
+  for (slot = hash & mask; pfc->index[slot] >= 0; slot = (slot+1) & mask) {
+    if (strcmp(pfc->name[pfc->index[slot]],name) == 0) {
+      *index = pfc->index[slot];
+      break;
+    }
+  }
+
+  return _SUCCESS_;
+}
+
+/**
+ * Forget the hash index of a file_content structure, after its names
+ * have been modified. It will be rebuilt by the next call to
+ * parser_find().
+ *
+ * @param pfc Input/Output: file content structure
+ * @return the error status
+ */
+
+int parser_reset_index(struct file_content * pfc) {
+
+  if (pfc->index_size > 0) {
+    free(pfc->index);
+    free(pfc->multiple);
   }
+  pfc->index_size = 0;
+  pfc->index = NULL;
+  pfc->multiple = NULL;
 
   return _SUCCESS_;
 }
@@ -167,7 +277,6 @@ int parser_read_int(struct file_content * pfc,
                     int * found,
                     ErrorMsg errmsg) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -175,9 +284,9 @@ int parser_read_int(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -199,11 +308,9 @@ int parser_read_int(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  class_test(pfc->multiple[index] == _TRUE_,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -217,7 +324,6 @@ int parser_read_double(struct file_content * pfc,
                        int * found,
                        ErrorMsg errmsg) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -225,9 +331,9 @@ int parser_read_double(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -249,11 +355,9 @@ int parser_read_double(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  class_test(pfc->multiple[index] == _TRUE_,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -268,7 +372,6 @@ int parser_read_double_and_position(struct file_content * pfc,
                                     int * found,
                                     ErrorMsg errmsg) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -276,9 +379,9 @@ int parser_read_double_and_position(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -300,11 +403,9 @@ int parser_read_double_and_position(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  class_test(pfc->multiple[index] == _TRUE_,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -320,7 +421,6 @@ int parser_read_string(struct file_content * pfc,
                        int * found,
                        ErrorMsg errmsg) {
   int index;
-  int i;
 
   /* intialize the 'found' flag to false */
 
@@ -328,9 +428,9 @@ int parser_read_string(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -350,11 +450,9 @@ int parser_read_string(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  class_test(pfc->multiple[index] == _TRUE_,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -383,9 +481,9 @@ int parser_read_list_of_doubles(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -436,11 +534,9 @@ int parser_read_list_of_doubles(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  class_test(pfc->multiple[index] == _TRUE_,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
 
@@ -469,9 +565,9 @@ int parser_read_list_of_integers(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -522,11 +618,9 @@ int parser_read_list_of_integers(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is found,
      return an error. */
 
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  class_test(pfc->multiple[index] == _TRUE_,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
   return _SUCCESS_;
@@ -554,9 +648,9 @@ int parser_read_list_of_strings(struct file_content * pfc,
 
   /* search parameter */
 
-  index=0;
-  while ((index < pfc->size) && (strcmp(pfc->name[index],name) != 0))
-    index++;
+  class_call(parser_find(pfc,name,&index,errmsg),
+             errmsg,
+             errmsg);
 
   /* if parameter not found, return with 'found' flag still equal to false */
 
@@ -605,11 +699,9 @@ int parser_read_list_of_strings(struct file_content * pfc,
   /* check for multiple entries of the same parameter. If another occurence is
      found,
      return an error. */
-  for (i=index+1; i < pfc->size; i++) {
-    class_test(strcmp(pfc->name[i],name) == 0,
-               errmsg,
-               "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
-  }
+  class_test(pfc->multiple[index] == _TRUE_,
+             errmsg,
+             "multiple entry of parameter '%s' in file '%s'\n",name,pfc->filename);
 
   /* if everything proceeded normally, return with 'found' flag equal to true */
   return _SUCCESS_;
@@ -644,6 +736,9 @@ int parser_cat(struct file_content * pfc1,
   }
 
   pfc3->size = pfc1->size + pfc2->size;
+  pfc3->index_size = 0;
+  pfc3->index = NULL;
+  pfc3->multiple = NULL;
   class_alloc(pfc3->value,pfc3->size*sizeof(FileArg),errmsg);
   class_alloc(pfc3->name,pfc3->size*sizeof(FileArg),errmsg);
   class_alloc(pfc3->read,pfc3->size*sizeof(short),errmsg);
@@ -741,6 +836,7 @@ int parser_check_options(char * strinput, char ** options, int N_options, int* v
 
 int parser_extend(struct file_content * pfc, int N_extend, ErrorMsg errmsg) {
   // Append N_extend empty entries in the vectors of pfc
+  parser_reset_index(pfc);
   pfc->size += N_extend;
   class_realloc(pfc->name,  pfc->size*sizeof(FileArg), errmsg);
   class_realloc(pfc->value, pfc->size*sizeof(FileArg), errmsg);
@@ -755,6 +851,7 @@ int parser_extend(struct file_content * pfc, int N_extend, ErrorMsg errmsg) {
 
 int parser_copy(struct file_content * pfc_source, struct file_content * pfc_destination, int index_start, int index_end) {
   // Copy the entries from index_start to index_end from pfc_source to pfc_destination
+  parser_reset_index(pfc_destination);
   memcpy(pfc_destination->name  + index_start, pfc_source->name  + index_start, (index_end - index_start)*sizeof(FileArg));
   memcpy(pfc_destination->value + index_start, pfc_source->value + index_start, (index_end - index_start)*sizeof(FileArg));
   memcpy(pfc_destination->read  + index_start, pfc_source->read  + index_start, (index_end - index_start)*sizeof(short));
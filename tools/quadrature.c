@@ -4,6 +4,71 @@
 /* Thomas Tram                            */
 /******************************************/
 #include "quadrature.h"
+#include <pthread.h>
+
+/* quadrature rules computed by quadrature_gauss_legendre() and compute_Laguerre(), shared by all the runs */
+static struct quadrature_rule * quadrature_rules = NULL;
+static pthread_mutex_t quadrature_rules_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Copy the nodes and weights of a rule computed earlier in the process,
+ * if there is one with the same type, size and parameter.
+ *
+ * @param type  Input: type of rule
+ * @param n     Input: number of nodes
+ * @param param Input: parameter of the rule (tolerance, or alpha for Laguerre)
+ * @param x     Output: nodes, if found
+ * @param w     Output: weights, if found
+ * @return _TRUE_ if the rule was found, _FALSE_ otherwise
+ */
+
+static int quadrature_rule_lookup(enum quadrature_rule_type type, int n, double param, double *x, double *w){
+
+  struct quadrature_rule * prule;
+  int found = _FALSE_;
+
+  pthread_mutex_lock(&quadrature_rules_mutex);
+  for (prule=quadrature_rules; prule!=NULL; prule=prule->next) {
+    if ((prule->type == type) && (prule->n == n) && (prule->param == param)) {
+      memcpy(x,prule->x,n*sizeof(double));
+      memcpy(w,prule->w,n*sizeof(double));
+      found = _TRUE_;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&quadrature_rules_mutex);
+
+  return found;
+}
+
+/**
+ * Keep a copy of the nodes and weights of a rule for the next calls.
+ * Failing to allocate the copy is not an error: the rule will simply
+ * be computed again.
+ */
+
+static void quadrature_rule_store(enum quadrature_rule_type type, int n, double param, double *x, double *w){
+
+  struct quadrature_rule * prule;
+
+  prule = (struct quadrature_rule *)malloc(sizeof(struct quadrature_rule)+2*n*sizeof(double));
+  if (prule == NULL)
+    return;
+
+  prule->type = type;
+  prule->n = n;
+  prule->param = param;
+  prule->x = (double *)(prule+1);
+  prule->w = prule->x+n;
+  memcpy(prule->x,x,n*sizeof(double));
+  memcpy(prule->w,w,n*sizeof(double));
+
+  /* the rules are never freed, since other runs may be using them */
+  pthread_mutex_lock(&quadrature_rules_mutex);
+  prule->next = quadrature_rules;
+  quadrature_rules = prule;
+  pthread_mutex_unlock(&quadrature_rules_mutex);
+}
 
 int get_qsampling_manual(double *x,
 			 double *w,
@@ -581,6 +646,10 @@ int compute_Laguerre(double *x, double *w, int N, double alpha, double *b, doubl
     b[i] = alpha + 2.0*i +1.0;
     c[i] = i*(alpha+i);
   }
+
+  if (quadrature_rule_lookup((totalweight == _TRUE_) ? quadrature_rule_laguerre_total : quadrature_rule_laguerre,N,alpha,x,w) == _TRUE_)
+    return _SUCCESS_;
+
   logprod = 0.0;
   for(i=1; i<N; i++) logprod +=log(c[i]);
   logcc = lgamma(alpha+1)+logprod;
@@ -630,6 +699,8 @@ int compute_Laguerre(double *x, double *w, int N, double alpha, double *b, doubl
        w[i] = exp(logcc-log(dp2*p1));
   }
 
+  quadrature_rule_store((totalweight == _TRUE_) ? quadrature_rule_laguerre_total : quadrature_rule_laguerre,N,alpha,x,w);
+
   return _SUCCESS_;
 
 }
@@ -751,6 +822,9 @@ int quadrature_gauss_legendre(
   int m,j,i,counter;
   double z1,z,pp,p3,p2,p1;
 
+  if (quadrature_rule_lookup(quadrature_rule_legendre,n,tol,mu,w8) == _TRUE_)
+    return _SUCCESS_;
+
   m=(n+1)/2;
   for (i=1;i<=m;i++) {
     z=cos(_PI_*((double)i-0.25)/((double)n+0.5));
@@ -777,6 +851,9 @@ int quadrature_gauss_legendre(
     w8[n-i]=w8[i-1];
 
   }
+
+  quadrature_rule_store(quadrature_rule_legendre,n,tol,mu,w8);
+
   return _SUCCESS_;
 }
 
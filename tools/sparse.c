@@ -227,8 +227,48 @@ int sp_lusolve(sp_num *N, double *b, double *x){
 	return _SUCCESS_;
 }
 
-int sp_refactor(sp_num *N, sp_mat *A){
-	double pivot, *Lx, *Ux, *x;
+int sp_symbolic(sp_num *N, sp_mat *A){
+	/* Symbolic part of sp_ludcmp, with static pivoting: the pivot of column q[k] is
+	taken on the diagonal, so that the result only depends on the pattern of A.
+	The values are then computed by sp_refactor. */
+	int *Lp, *Li, *pinv, *pvec, *q;
+	int n, k, top, p, i, col, lnz;
+	n = A->ncols; q = N->q;
+	Li = N->L->Ai; Lp = N->L->Ap;
+	lnz = 0;
+	pinv = N->pinv; pvec = N->p;
+	for (i=0; i<n; i++) pinv[i] = -1;
+	for (k=0; k<=n; k++) Lp[k] = 0;
+
+	for(k=0; k<n; k++){
+		Lp[k] = lnz;
+		col = q ? (q[k]) : k;
+
+		top = reachr(N->L, A, col, N->xi[k], pinv);
+		N->topvec[k] = top;
+		pinv[col] = k;
+		pvec[k] = col;
+		Li[lnz] = col;
+		lnz++;
+		for (p=top; p<n; p++){
+			i = N->xi[k][p];
+			if (pinv[i]<0){
+				Li[lnz] = i;
+				lnz++;
+			}
+		}
+	}
+	/* Finalize: */
+	Lp[n] = lnz;
+	for(p=0; p<lnz; p++) Li[p] = pinv[Li[p]];
+	return _SUCCESS_;
+}
+
+int sp_refactor(sp_num *N, sp_mat *A, double pivtol){
+	/* Numerical LU decomposition, keeping the pivots and the pattern of the last
+	call to sp_ludcmp or sp_symbolic. Fails if a pivot is zero, or smaller than
+	pivtol times the largest candidate pivot of its column. */
+	double pivot, *Lx, *Ux, *x, a, t;
 	int *Lp, *Li, *Up, *Ui, *pinv, *pvec, *q;
 	int n, ipiv, k, top, p, i, col, lnz, unz;
 	n = A->ncols;
@@ -246,10 +286,25 @@ int sp_refactor(sp_num *N, sp_mat *A){
 		col = q ? (q[k]) : k;
 
 		top = N->topvec[k];
+		/* pinv already holds the pivot of this column, so the triangular solve
+		divides it by the unit diagonal of L, which must be in place: */
+		Lx[lnz] = 1;
 		sp_splsolve(N->L, A, col, N->xi[k], top, x, pinv);
 		/* Assign values to U and L: */
 		ipiv = pvec[k];
 		pivot = x[ipiv];
+		if (pivot == 0.0) return _FAILURE_;
+		if (pivtol > 0.0){
+			a = 0.0;
+			for (p=top; p<n; p++){
+				i = N->xi[k][p];
+				if (pinv[i]>k){
+					t = fabs(x[i]);
+					if (t>a) a = t;
+				}
+			}
+			if (fabs(pivot)<a*pivtol) return _FAILURE_;
+		}
 		Li[lnz] = ipiv;
 		Lx[lnz] = 1;
 		lnz++;
@@ -0,0 +1,125 @@
+/** @file timing.c Timers and counters of the modules of CLASS
+ *
+ * Each thread increments its own block of counters, registered in a
+ * process-wide list when the thread first counts something; reading the
+ * counters sums the blocks of all threads, plus those of the threads
+ * which have exited.
+ */
+
+#include "common.h"
+#include <time.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+struct class_stats_block;
+
+struct class_stats_registry {
+  std::mutex mutex;
+  std::vector<class_stats_block *> blocks;
+  long retired[counter_size];
+};
+
+/* never destroyed, since threads may still count after the static objects are destroyed at exit */
+static class_stats_registry * class_stats_get_registry() {
+  static class_stats_registry * registry = []() {
+    class_stats_registry * r = new class_stats_registry;
+    for (int index = 0; index < counter_size; index++)
+      r->retired[index] = 0;
+    return r;
+  }();
+  return registry;
+}
+
+struct class_stats_block {
+  /* only written by the owning thread, hence relaxed loads and stores are enough */
+  std::atomic<long> counter[counter_size];
+
+  class_stats_block() {
+    for (int index = 0; index < counter_size; index++)
+      counter[index].store(0,std::memory_order_relaxed);
+    class_stats_registry * registry = class_stats_get_registry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    registry->blocks.push_back(this);
+  }
+
+  ~class_stats_block() {
+    class_stats_registry * registry = class_stats_get_registry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    for (int index = 0; index < counter_size; index++)
+      registry->retired[index] += counter[index].load(std::memory_order_relaxed);
+    registry->blocks.erase(std::find(registry->blocks.begin(),registry->blocks.end(),this));
+  }
+};
+
+void class_stats_count(int index, long n) {
+  static thread_local class_stats_block block;
+  block.counter[index].store(block.counter[index].load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+}
+
+void class_stats_read(long * counter) {
+  class_stats_registry * registry = class_stats_get_registry();
+  std::lock_guard<std::mutex> lock(registry->mutex);
+  for (int index = 0; index < counter_size; index++) {
+    counter[index] = registry->retired[index];
+    for (class_stats_block * block : registry->blocks)
+      counter[index] += block->counter[index].load(std::memory_order_relaxed);
+  }
+}
+
+/* peak resident set size of the process, in bytes */
+static long class_stats_peak_rss() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF,&usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return 1024*usage.ru_maxrss;
+#endif
+}
+
+/* the start values are kept in the fields themselves until class_stats_end() */
+void class_stats_begin(struct class_stats * pstats) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  pstats->wall_time = ts.tv_sec + 1.e-9*ts.tv_nsec;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+  pstats->cpu_time = ts.tv_sec + 1.e-9*ts.tv_nsec;
+  class_stats_read(pstats->counter);
+  pstats->peak_rss = class_stats_peak_rss();
+}
+
+void class_stats_end(struct class_stats * pstats) {
+  struct timespec ts;
+  long counter[counter_size];
+  class_stats_read(counter);
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  pstats->wall_time = ts.tv_sec + 1.e-9*ts.tv_nsec - pstats->wall_time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+  pstats->cpu_time = ts.tv_sec + 1.e-9*ts.tv_nsec - pstats->cpu_time;
+  for (int index = 0; index < counter_size; index++)
+    pstats->counter[index] = counter[index] - pstats->counter[index];
+  pstats->peak_rss = class_stats_peak_rss() - pstats->peak_rss;
+}
+
+const char * class_stats_counter_name(int index) {
+  static const char * names[counter_size] = {
+    "k_modes",
+    "ndf15_integrations",
+    "ndf15_steps",
+    "ndf15_failed_steps",
+    "ndf15_function_evaluations",
+    "ndf15_jacobians",
+    "ndf15_lu_decompositions",
+    "interpolations",
+    "allocations",
+    "allocated_bytes",
+    "approximation_probes"
+  };
+  if ((index < 0) || (index >= counter_size))
+    return "";
+  return names[index];
+}